@@ -34,6 +34,12 @@
 #error "MBEDTLS_HAVE_TIME_DATE without MBEDTLS_HAVE_TIME does not make sense"
 #endif
 
+#if defined(MBEDTLS_MEMORY_PROFILE) &&                                  \
+    (!defined(MBEDTLS_PLATFORM_MEMORY) ||                               \
+    (defined(MBEDTLS_PLATFORM_CALLOC_MACRO) && defined(MBEDTLS_PLATFORM_FREE_MACRO)))
+#error "MBEDTLS_MEMORY_PROFILE defined, but not all prerequisites"
+#endif
+
 /* Limitations on ECC curves acceleration: partial curve acceleration is only
  * supported with crypto excluding PK, X.509 or TLS.
  * Note: no need to check X.509 as it depends on PK. */
@@ -214,6 +220,40 @@
 #error "MBEDTLS_SSL_ASYNC_PRIVATE defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_NET_REACTOR) && !defined(MBEDTLS_NET_C)
+#error "MBEDTLS_NET_REACTOR defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_NET_IO_URING) && !defined(MBEDTLS_NET_C)
+#error "MBEDTLS_NET_IO_URING defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_NET_DGRAM_DEMUX) && !defined(MBEDTLS_NET_C)
+#error "MBEDTLS_NET_DGRAM_DEMUX defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_TIMING_WHEEL) && !defined(MBEDTLS_TIMING_C)
+#error "MBEDTLS_TIMING_WHEEL defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_KTLS) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_NET_C) )
+#error "MBEDTLS_SSL_KTLS defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_QUIC) && !defined(MBEDTLS_SSL_PROTO_TLS1_3)
+#error "MBEDTLS_SSL_QUIC defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX) && !defined(MBEDTLS_THREADING_C)
+#error "MBEDTLS_SSL_FULL_DUPLEX defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_THREADING_C) )
+#error "MBEDTLS_SSL_RECORD_PIPELINE defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_TLS_C) && !(defined(MBEDTLS_CIPHER_C) || \
     defined(MBEDTLS_USE_PSA_CRYPTO))
 #error "MBEDTLS_SSL_TLS_C defined, but not all prerequisites"
@@ -278,6 +318,111 @@
 #endif
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID_COMPAT && MBEDTLS_SSL_DTLS_CONNECTION_ID_COMPAT != 0 */
 
+#if defined(MBEDTLS_SSL_ANTI_REPLAY_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_ANTI_REPLAY_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_ASYNC_BATCH_C) && !defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+#error "MBEDTLS_SSL_ASYNC_BATCH_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_SHM_C) && !defined(MBEDTLS_THREADING_PTHREAD)
+#error "MBEDTLS_SSL_CACHE_SHM_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CID_TABLE_C) && !defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+#error "MBEDTLS_SSL_CID_TABLE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C) && \
+    ( !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_PROTO_TLS1_3) || \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_GROUP_CACHE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_HS_ADMISSION) && !defined(MBEDTLS_SSL_SRV_C)
+#error "MBEDTLS_SSL_HS_ADMISSION defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_HS_BUDGET_C) && \
+    ( !defined(MBEDTLS_SSL_HS_ADMISSION) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_HS_BUDGET_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_KEY_SHARE_POOL_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C) && \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_SSL_PROTO_TLS1_2) || \
+    !defined(MBEDTLS_USE_PSA_CRYPTO) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_ECDHE_REUSE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_OWN_CERT_MSG_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE) && \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_SSL_PROTO_TLS1_2) || \
+      !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_CA_DN_LIST_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) || \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(PSA_WANT_ALG_SHA_256) )
+#error "MBEDTLS_SSL_PEER_CERT_TABLE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_PSK_STORE_C) && \
+    ( !defined(MBEDTLS_SSL_SRV_C) || \
+    ( !defined(MBEDTLS_KEY_EXCHANGE_PSK_ENABLED) && \
+    !defined(MBEDTLS_KEY_EXCHANGE_DHE_PSK_ENABLED) && \
+    !defined(MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED) && \
+    !defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_ENABLED) && \
+    !defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED) ) )
+#error "MBEDTLS_SSL_PSK_STORE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_X509_CRT_PARSE_C) || \
+    !defined(PSA_WANT_ALG_SHA_256) )
+#error "MBEDTLS_SSL_CACHED_INFO defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_CONFIG_OVERLAY defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_CREDS_C) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_CREDS_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C) && \
+    ( !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_X509_CRT_PARSE_C) || \
+    !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_SESSION_STORE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS) && \
+    ( MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS < 1 || MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS > 255 )
+#error "MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS must be between 1 and 255"
+#endif
+
+#if defined(MBEDTLS_SSL_SNI_TABLE_C) && \
+    ( !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) )
+#error "MBEDTLS_SSL_SNI_TABLE_C defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_WARM_POOL_C) && \
+    ( !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_NET_C) || \
+    !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_WARM_POOL_C defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_ENCRYPT_THEN_MAC) &&   \
     !defined(MBEDTLS_SSL_PROTO_TLS1_2)
 #error "MBEDTLS_SSL_ENCRYPT_THEN_MAC defined, but not all prerequisites"
@@ -288,6 +433,11 @@
 #error "MBEDTLS_SSL_EXTENDED_MASTER_SECRET defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_FALSE_START) && \
+    ( !defined(MBEDTLS_SSL_PROTO_TLS1_2) || !defined(MBEDTLS_SSL_CLI_C) )
+#error "MBEDTLS_SSL_FALSE_START defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_RENEGOTIATION) && \
     !defined(MBEDTLS_SSL_PROTO_TLS1_2)
 #error "MBEDTLS_SSL_RENEGOTIATION defined, but not all prerequisites"
@@ -304,6 +454,11 @@
 #error "MBEDTLS_SSL_TICKET_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_TICKET_MAX_KEYS) && \
+    (MBEDTLS_SSL_TICKET_MAX_KEYS < 2 || MBEDTLS_SSL_TICKET_MAX_KEYS > 64)
+#error "MBEDTLS_SSL_TICKET_MAX_KEYS must be between 2 and 64"
+#endif
+
 #if defined(MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH) && \
     MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH >= 256
 #error "MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH must be less than 256"
@@ -340,6 +495,14 @@
 #error "MBEDTLS_X509_CRL_PARSE_C defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX) && !defined(MBEDTLS_X509_CRL_PARSE_C)
+#error "MBEDTLS_X509_CRL_SERIAL_INDEX defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_CRL_STREAM) && !defined(MBEDTLS_X509_CRL_PARSE_C)
+#error "MBEDTLS_X509_CRL_STREAM defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_X509_CSR_PARSE_C) && ( !defined(MBEDTLS_X509_USE_C) )
 #error "MBEDTLS_X509_CSR_PARSE_C defined, but not all prerequisites"
 #endif
@@ -357,18 +520,101 @@
 #error "MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_X509_TRUST_STORE) && !defined(MBEDTLS_X509_CRT_PARSE_C)
+#error "MBEDTLS_X509_TRUST_STORE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_TRUST_IMAGE) && !defined(MBEDTLS_X509_TRUST_STORE)
+#error "MBEDTLS_X509_TRUST_IMAGE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_VERIFY_CACHE) && \
+    ( !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(PSA_WANT_ALG_SHA_256) )
+#error "MBEDTLS_X509_VERIFY_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_CA_CB_CACHE) && \
+    ( !defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK) || \
+    !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_X509_CA_CB_CACHE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_PARALLEL_VERIFY) && !defined(MBEDTLS_X509_CRT_PARSE_C)
+#error "MBEDTLS_X509_PARALLEL_VERIFY defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_OCSP_STAPLE) && !defined(MBEDTLS_X509_CRT_PARSE_C)
+#error "MBEDTLS_X509_OCSP_STAPLE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_X509_CRT_CA_DIR) && \
+    ( !defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK) || \
+    !defined(MBEDTLS_FS_IO) || !defined(PSA_WANT_ALG_SHA_1) )
+#error "MBEDTLS_X509_CRT_CA_DIR defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_DTLS_SRTP) && ( !defined(MBEDTLS_SSL_PROTO_DTLS) )
 #error "MBEDTLS_SSL_DTLS_SRTP defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY) && !defined(MBEDTLS_SSL_PROTO_DTLS)
+#error "MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH) && ( !defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) )
 #error "MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_STATIC_MEMORY) && defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
+#error "MBEDTLS_SSL_STATIC_MEMORY defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_HANDSHAKE_TRACE defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_USDT_PROBES) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_USDT_PROBES defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_STATS) && !defined(MBEDTLS_SSL_TLS_C)
+#error "MBEDTLS_SSL_STATS defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_RECORD_AEAD_ONLY) && \
+    ( !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_SSL_HAVE_AEAD) )
+#error "MBEDTLS_SSL_RECORD_AEAD_ONLY defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_RECORD_SIZE_LIMIT) && ( !defined(MBEDTLS_SSL_PROTO_TLS1_3) )
 #error "MBEDTLS_SSL_RECORD_SIZE_LIMIT defined, but not all prerequisites"
 #endif
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && \
+    ( !defined(MBEDTLS_SSL_PROTO_TLS1_3) || !defined(MBEDTLS_X509_CRT_PARSE_C) )
+#error "MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY) && \
+    ( !defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED) || \
+    !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) || \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_PK_WRITE_C) )
+#error "MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && \
+    ( !defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED) || \
+    !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE) || \
+    !defined(MBEDTLS_X509_OCSP_STAPLE) || !defined(MBEDTLS_HAVE_TIME) )
+#error "MBEDTLS_SSL_OCSP_STAPLING defined, but not all prerequisites"
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR) && \
+    ( !defined(MBEDTLS_SSL_SRV_C) || \
+    !defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED) )
+#error "MBEDTLS_SSL_TLS1_3_STATELESS_HRR defined, but not all prerequisites"
+#endif
+
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION) && \
     !( defined(PSA_WANT_ALG_CCM) || defined(PSA_WANT_ALG_GCM) || \
     defined(PSA_WANT_ALG_CHACHA20_POLY1305) )
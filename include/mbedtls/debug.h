@@ -22,30 +22,50 @@
 
 #define MBEDTLS_DEBUG_STRIP_PARENS(...)   __VA_ARGS__
 
+/* The threshold and the callbacks are checked before the arguments are
+ * evaluated, so a message above the threshold costs a load and a compare. */
+#define MBEDTLS_SSL_DEBUG_IF(level, call)                      \
+    do {                                                        \
+        if (MBEDTLS_DEBUG_ENABLED(ssl, level)) {                \
+            call;                                               \
+        }                                                       \
+    } while (0)
+
 #define MBEDTLS_SSL_DEBUG_MSG(level, args)                    \
-    mbedtls_debug_print_msg(ssl, level, __FILE__, __LINE__,    \
-                            MBEDTLS_DEBUG_STRIP_PARENS args)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_msg(ssl, level, __FILE__, __LINE__, \
+                                                 MBEDTLS_DEBUG_STRIP_PARENS args))
 
 #define MBEDTLS_SSL_DEBUG_RET(level, text, ret)                \
-    mbedtls_debug_print_ret(ssl, level, __FILE__, __LINE__, text, ret)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_ret(ssl, level, __FILE__, __LINE__, \
+                                                 text, ret))
 
 #define MBEDTLS_SSL_DEBUG_BUF(level, text, buf, len)           \
-    mbedtls_debug_print_buf(ssl, level, __FILE__, __LINE__, text, buf, len)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_buf(ssl, level, __FILE__, __LINE__, \
+                                                 text, buf, len))
 
 #if defined(MBEDTLS_BIGNUM_C)
 #define MBEDTLS_SSL_DEBUG_MPI(level, text, X)                  \
-    mbedtls_debug_print_mpi(ssl, level, __FILE__, __LINE__, text, X)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_mpi(ssl, level, __FILE__, __LINE__, \
+                                                 text, X))
 #endif
 
 #if defined(MBEDTLS_ECP_C)
 #define MBEDTLS_SSL_DEBUG_ECP(level, text, X)                  \
-    mbedtls_debug_print_ecp(ssl, level, __FILE__, __LINE__, text, X)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_ecp(ssl, level, __FILE__, __LINE__, \
+                                                 text, X))
 #endif
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
 #define MBEDTLS_SSL_DEBUG_CRT(level, text, crt)                \
-    mbedtls_debug_print_crt(ssl, level, __FILE__, __LINE__, text, crt)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_print_crt(ssl, level, __FILE__, __LINE__, \
+                                                 text, crt))
 #else
 #define MBEDTLS_SSL_DEBUG_CRT(level, text, crt)       do { } while (0)
 #endif /* MBEDTLS_X509_REMOVE_INFO */
@@ -53,7 +73,9 @@
 
 #if defined(MBEDTLS_ECDH_C)
 #define MBEDTLS_SSL_DEBUG_ECDH(level, ecdh, attr)               \
-    mbedtls_debug_printf_ecdh(ssl, level, __FILE__, __LINE__, ecdh, attr)
+    MBEDTLS_SSL_DEBUG_IF(level,                                 \
+                         mbedtls_debug_printf_ecdh(ssl, level, __FILE__, __LINE__, \
+                                                   ecdh, attr))
 #endif
 
 #else /* MBEDTLS_DEBUG_C */
@@ -149,6 +171,28 @@ extern "C" {
  */
 void mbedtls_debug_set_threshold(int threshold);
 
+#if defined(MBEDTLS_DEBUG_C)
+/**
+ * \brief          Format a debug event given to the callback of
+ *                 mbedtls_ssl_conf_dbg_event()
+ *
+ *                 The output is the first line that the debug callback of
+ *                 mbedtls_ssl_conf_dbg() would get for the event, without
+ *                 the thread identifier and the final newline. A buffer is
+ *                 not dumped, only described.
+ *
+ * \param event    Event, during the call to the event callback
+ * \param buf      Output buffer
+ * \param size     Size of \p buf, at least 1
+ *
+ * \return         The length of the formatted event, as with snprintf():
+ *                 if it is \p size or more, the output was truncated.
+ * \return         A negative value on a formatting error.
+ */
+int mbedtls_debug_format_event(const mbedtls_ssl_debug_event *event,
+                               char *buf, size_t size);
+#endif /* MBEDTLS_DEBUG_C */
+
 #ifdef __cplusplus
 }
 #endif
@@ -47,6 +47,55 @@
  */
 #define MBEDTLS_NET_C
 
+/**
+ * \def MBEDTLS_NET_REACTOR
+ *
+ * Enable the event loop integration of the networking routines, see
+ * mbedtls_net_reactor_setup(). It waits for many sockets at once and reports
+ * edge-triggered readiness through callbacks.
+ *
+ * \note This is implemented with epoll on Linux and kqueue on BSD and OS X.
+ * Other platforms are not supported.
+ *
+ * Requires: MBEDTLS_NET_C
+ *
+ * Uncomment this macro to enable the network reactor.
+ */
+//#define MBEDTLS_NET_REACTOR
+
+/**
+ * \def MBEDTLS_NET_IO_URING
+ *
+ * Enable send and receive callbacks for mbedtls_ssl_set_bio() that queue
+ * operations on a Linux io_uring, see mbedtls_net_uring_setup(). A single
+ * system call then submits and completes the I/O of many connections.
+ *
+ * \note This needs Linux 5.6 or later at runtime, and the io_uring kernel
+ * headers at build time.
+ *
+ * Requires: MBEDTLS_NET_C
+ *
+ * Uncomment this macro to enable the io_uring callbacks.
+ */
+//#define MBEDTLS_NET_IO_URING
+
+/**
+ * \def MBEDTLS_NET_DGRAM_DEMUX
+ *
+ * Enable the datagram demultiplexer, see mbedtls_net_dgram_setup(). It
+ * serves many DTLS peers from a single UDP socket, routing datagrams by
+ * connection ID or source address, and receives and sends them in batches.
+ *
+ * \note On Linux this uses recvmmsg(), sendmmsg() and UDP segmentation
+ * offload. Other Unix-like systems fall back to one system call per
+ * datagram. Windows is not supported.
+ *
+ * Requires: MBEDTLS_NET_C
+ *
+ * Uncomment this macro to enable the datagram demultiplexer.
+ */
+//#define MBEDTLS_NET_DGRAM_DEMUX
+
 /**
  * \def MBEDTLS_TIMING_ALT
  *
@@ -84,6 +133,19 @@
  */
 #define MBEDTLS_TIMING_C
 
+/**
+ * \def MBEDTLS_TIMING_WHEEL
+ *
+ * Enable the hierarchical timer wheel, see mbedtls_timing_wheel_setup().
+ * It keeps the DTLS retransmission timers of many SSL contexts, so that an
+ * event loop can drive all of them with a single timeout.
+ *
+ * Requires: MBEDTLS_TIMING_C
+ *
+ * Comment this macro to disable the timer wheel.
+ */
+#define MBEDTLS_TIMING_WHEEL
+
 /** \} name SECTION: Platform abstraction layer */
 
 /**
@@ -121,6 +183,29 @@
  */
 #define MBEDTLS_ERROR_STRERROR_DUMMY
 
+/**
+ * \def MBEDTLS_MEMORY_PROFILE
+ *
+ * Enable accounting of heap usage per library subsystem: record buffers,
+ * handshake parameters, transforms, sessions, peer certificates, session
+ * caches, X.509 structures, ...
+ *
+ * Once mbedtls_memory_profile_init() is called, every block records its
+ * size and the subsystem that allocated it, and
+ * mbedtls_memory_profile_get() reports the current and peak usage of each
+ * subsystem. This costs a header of 16 bytes or so per block and a lock
+ * per allocation, so it is meant for profiling builds.
+ *
+ * Module:  library/memory_profile.c
+ * Caller:  every module of the library that allocates memory
+ *
+ * Requires: MBEDTLS_PLATFORM_MEMORY, without MBEDTLS_PLATFORM_CALLOC_MACRO
+ *           and MBEDTLS_PLATFORM_FREE_MACRO
+ *
+ * Uncomment this to enable heap usage accounting.
+ */
+//#define MBEDTLS_MEMORY_PROFILE
+
 /**
  * \def MBEDTLS_VERSION_C
  *
@@ -470,18 +555,57 @@
  */
 #define MBEDTLS_SSL_ALPN
 
+/**
+ * \def MBEDTLS_SSL_ANTI_REPLAY_C
+ *
+ * Enable the detection of replayed TLS 1.3 early data with time-bucketed
+ * Bloom filters, to be plugged into mbedtls_ssl_conf_early_data_anti_replay().
+ *
+ * Module:  library/ssl_anti_replay.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ */
+#define MBEDTLS_SSL_ANTI_REPLAY_C
+
 /**
  * \def MBEDTLS_SSL_ASYNC_PRIVATE
  *
  * Enable asynchronous external private key operations in SSL. This allows
  * you to configure an SSL connection to call an external cryptographic
  * module to perform private key operations instead of performing the
- * operation inside the library.
+ * operation inside the library. It also enables asynchronous verification
+ * of the peer's certificate chain, see mbedtls_ssl_conf_async_verify().
  *
  * Requires: MBEDTLS_X509_CRT_PARSE_C
  */
 //#define MBEDTLS_SSL_ASYNC_PRIVATE
 
+/**
+ * \def MBEDTLS_SSL_ASYNC_BATCH_C
+ *
+ * Enable the batching of the private key signatures of concurrent handshakes
+ * through the asynchronous private key callbacks, see
+ * mbedtls_ssl_async_batch_conf().
+ *
+ * Module:  library/ssl_async_batch.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_ASYNC_PRIVATE
+ */
+//#define MBEDTLS_SSL_ASYNC_BATCH_C
+
+/**
+ * \def MBEDTLS_SSL_BUFFER_POOL_C
+ *
+ * Enable a simple pool of SSL record buffers, to be plugged into
+ * mbedtls_ssl_conf_buffer_alloc().
+ *
+ * Module:  library/ssl_buffer_pool.c
+ * Caller:
+ */
+#define MBEDTLS_SSL_BUFFER_POOL_C
+
 /**
  * \def MBEDTLS_SSL_CACHE_C
  *
@@ -494,6 +618,57 @@
  */
 #define MBEDTLS_SSL_CACHE_C
 
+/**
+ * \def MBEDTLS_SSL_CACHE_SHARDED_C
+ *
+ * Enable an SSL session cache that scales to many entries and threads:
+ * sessions are spread over independently locked hash tables.
+ *
+ * Module:  library/ssl_cache_sharded.c
+ * Caller:
+ */
+#define MBEDTLS_SSL_CACHE_SHARDED_C
+
+/**
+ * \def MBEDTLS_SSL_CACHE_SHM_C
+ *
+ * Enable an SSL session cache in an anonymous shared mapping, for servers
+ * that fork their worker processes: the workers share the cached sessions
+ * and, with MBEDTLS_SSL_TICKET_C, the session ticket key. See
+ * mbedtls_ssl_cache_shm_setup().
+ *
+ * \note This needs mmap() and process-shared pthread mutexes. On Linux and
+ * FreeBSD, the mutexes are robust, so a worker dying while updating the
+ * cache does not block the others.
+ *
+ * Module:  library/ssl_cache_shm.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_THREADING_PTHREAD
+ *
+ * Uncomment this macro to enable the shared memory session cache.
+ */
+//#define MBEDTLS_SSL_CACHE_SHM_C
+
+/**
+ * \def MBEDTLS_SSL_CID_TABLE_C
+ *
+ * Enable a table mapping DTLS connection IDs to SSL contexts, for routing
+ * incoming datagrams on a server.
+ *
+ * \note With MBEDTLS_THREADING_C, lookups are lock-free when the compiler
+ * has GCC-style atomic builtins (GCC, Clang). With other compilers, they
+ * take the table mutex.
+ *
+ * Module:  library/ssl_cid_table.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_DTLS_CONNECTION_ID
+ *
+ * Uncomment this macro to enable the connection ID table.
+ */
+//#define MBEDTLS_SSL_CID_TABLE_C
+
 /**
  * \def MBEDTLS_SSL_CLI_C
  *
@@ -529,9 +704,10 @@
  * lighter handshakes, while context serialization is a local optimization in
  * handling a single, potentially long-lived connection.
  *
- * Enabling these APIs makes some SSL structures larger, as 64 extra bytes are
- * saved after the handshake to allow for more efficient serialization, so if
- * you don't need this feature you'll save RAM by disabling it.
+ * Enabling these APIs makes some SSL structures larger, as up to 154 extra
+ * bytes (the Hello random bytes and the AEAD key block) are saved after the
+ * handshake to allow for more efficient serialization, so if you don't need
+ * this feature you'll save RAM by disabling it.
  *
  * Requires: MBEDTLS_GCM_C or MBEDTLS_CCM_C or MBEDTLS_CHACHAPOLY_C
  *
@@ -549,6 +725,186 @@
  */
 #define MBEDTLS_SSL_COOKIE_C
 
+/**
+ * \def MBEDTLS_SSL_CREDS_C
+ *
+ * Enable slots of trusted CAs and own certificates that can be replaced in
+ * a live configuration, see mbedtls_ssl_conf_creds(). Handshakes in
+ * progress keep the credentials they started with.
+ *
+ * Module:  library/ssl_creds.c
+ * Caller:  library/ssl_tls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_X509_CRT_PARSE_C
+ */
+#define MBEDTLS_SSL_CREDS_C
+
+/**
+ * \def MBEDTLS_SSL_GROUP_CACHE_C
+ *
+ * Enable a client-side cache of the group each server selected, see
+ * mbedtls_ssl_conf_group_cache(). A TLS 1.3 client then offers the right
+ * key share first, saving a HelloRetryRequest round trip.
+ *
+ * Module:  library/ssl_group_cache.c
+ * Caller:  library/ssl_tls13_client.c
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_SSL_PROTO_TLS1_3,
+ *           MBEDTLS_X509_CRT_PARSE_C
+ */
+#define MBEDTLS_SSL_GROUP_CACHE_C
+
+/**
+ * \def MBEDTLS_SSL_HS_BUDGET_C
+ *
+ * Enable a CPU budget for server handshakes, see
+ * mbedtls_ssl_hs_budget_admit(). Under overload, resumed handshakes keep
+ * going through while full handshakes are deferred, then rejected.
+ *
+ * Module:  library/ssl_hs_budget.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_HS_ADMISSION, MBEDTLS_HAVE_TIME
+ */
+#define MBEDTLS_SSL_HS_BUDGET_C
+
+/**
+ * \def MBEDTLS_SSL_KEY_SHARE_POOL_C
+ *
+ * Enable a pool of pre-generated ephemeral key pairs, see
+ * mbedtls_ssl_conf_key_share_pool(). It moves the key generation of TLS 1.3
+ * key shares and TLS 1.2 ECDHE key exchanges out of the handshake, to a
+ * thread or idle time of the application.
+ *
+ * Module:  library/ssl_key_share_pool.c
+ * Caller:  library/ssl_tls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ */
+#define MBEDTLS_SSL_KEY_SHARE_POOL_C
+
+/**
+ * \def MBEDTLS_SSL_ECDHE_REUSE_C
+ *
+ * Enable the reuse of ephemeral ECDHE key pairs by TLS 1.2 servers for a
+ * bounded window, see mbedtls_ssl_conf_ecdhe_reuse(). This saves a key
+ * generation per full handshake under load, but sessions that share a key
+ * pair lose forward secrecy with respect to each other. Reuse only happens
+ * for configurations that opt in at runtime.
+ *
+ * Module:  library/ssl_ecdhe_reuse.c
+ * Caller:  library/ssl_tls12_server.c
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_SSL_PROTO_TLS1_2,
+ *           MBEDTLS_USE_PSA_CRYPTO, MBEDTLS_HAVE_TIME
+ *
+ * Uncomment to allow TLS 1.2 servers to reuse ECDHE key pairs.
+ */
+//#define MBEDTLS_SSL_ECDHE_REUSE_C
+
+/**
+ * \def MBEDTLS_SSL_OWN_CERT_MSG_CACHE
+ *
+ * Encode the certificate list of the Certificate message once, when a
+ * certificate chain is set with mbedtls_ssl_conf_own_cert() or
+ * mbedtls_ssl_set_hs_own_cert(), instead of walking the chain in every
+ * handshake. This costs a copy of the DER certificates per enabled
+ * protocol version.
+ *
+ * \note The chain must not be modified, e.g. by parsing more certificates
+ *       into it, after it is set.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment to cache the encoded own certificate chain.
+ */
+//#define MBEDTLS_SSL_OWN_CERT_MSG_CACHE
+
+/**
+ * \def MBEDTLS_SSL_CA_DN_LIST_CACHE
+ *
+ * Encode the list of acceptable CA names of the TLS 1.2 CertificateRequest
+ * message once, when the CA chain or the DN hints of a server configuration
+ * are set with mbedtls_ssl_conf_ca_chain() or mbedtls_ssl_conf_dn_hints(),
+ * instead of walking the chain in every handshake that requests a client
+ * certificate. This costs a copy of the subject names.
+ *
+ * \note The chain must not be modified, e.g. by parsing more certificates
+ *       into it, after it is set.
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_SSL_PROTO_TLS1_2,
+ *           MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment to cache the encoded CA names.
+ */
+//#define MBEDTLS_SSL_CA_DN_LIST_CACHE
+
+/**
+ * \def MBEDTLS_SSL_PEER_CERT_TABLE_C
+ *
+ * Enable a table through which sessions share identical peer certificate
+ * chains, see mbedtls_ssl_conf_peer_cert_table(). This saves memory on
+ * servers holding many sessions with the same client certificates.
+ *
+ * Module:  library/ssl_peer_cert_table.c
+ * Caller:  library/ssl_tls.c
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_SSL_KEEP_PEER_CERTIFICATE,
+ *           MBEDTLS_X509_CRT_PARSE_C, PSA_WANT_ALG_SHA_256
+ */
+#define MBEDTLS_SSL_PEER_CERT_TABLE_C
+
+/**
+ * \def MBEDTLS_SSL_PSK_STORE_C
+ *
+ * Enable a hash table of server pre-shared keys by identity, opaque or raw,
+ * for use as the PSK callback, see mbedtls_ssl_psk_store_cb().
+ *
+ * Module:  library/ssl_psk_store.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C and a PSK key exchange, one of
+ *           MBEDTLS_KEY_EXCHANGE_PSK_ENABLED,
+ *           MBEDTLS_KEY_EXCHANGE_DHE_PSK_ENABLED,
+ *           MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED,
+ *           MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_ENABLED or
+ *           MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
+ *
+ * Uncomment this to look up PSK identities in a built-in table.
+ */
+//#define MBEDTLS_SSL_PSK_STORE_C
+
+/**
+ * \def MBEDTLS_SSL_CACHED_INFO
+ *
+ * Enable the cached_info extension (RFC 7924) for certificate chains, in
+ * TLS 1.2 and TLS 1.3: a client that knows the chain of the server, see
+ * mbedtls_ssl_set_cached_server_chain(), sends its hash, and the server
+ * sends the hash back in place of the chain if it matches.
+ *
+ * Servers honour the extension whenever this option is enabled.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_X509_CRT_PARSE_C, PSA_WANT_ALG_SHA_256
+ *
+ * Uncomment to enable the cached_info extension.
+ */
+//#define MBEDTLS_SSL_CACHED_INFO
+
+/**
+ * \def MBEDTLS_SSL_CONFIG_OVERLAY
+ *
+ * Enable configuration overlays: a context with an overlay, see
+ * mbedtls_ssl_set_config_overlay(), takes its ciphersuites, ALPN protocols
+ * and authentication mode from the overlay where the overlay sets them, and
+ * from its configuration otherwise. Contexts of many tenants then share one
+ * configuration and a small overlay per tenant.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment to enable configuration overlays.
+ */
+//#define MBEDTLS_SSL_CONFIG_OVERLAY
+
 /**
  * \def MBEDTLS_SSL_DEBUG_ALL
  *
@@ -691,6 +1047,28 @@
  */
 //#define MBEDTLS_SSL_DTLS_SRTP
 
+/**
+ * \def MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY
+ *
+ * Buffer and reassemble DTLS handshake messages in a fixed area of
+ * MBEDTLS_SSL_DTLS_MAX_BUFFERING bytes in the handshake structure, instead of
+ * allocating a buffer for each fragmented or out-of-order message.
+ *
+ * The received parts of a fragmented message are tracked as a short list of
+ * byte ranges rather than a bitmap. A fragment that would need more ranges
+ * than the list holds is dropped, and received again when the peer
+ * retransmits its flight.
+ *
+ * \note This makes each handshake of a DTLS context take
+ *       MBEDTLS_SSL_DTLS_MAX_BUFFERING more bytes of RAM up front, but
+ *       reassembly no longer allocates from the heap during the handshake.
+ *
+ * Requires: MBEDTLS_SSL_PROTO_DTLS
+ *
+ * Uncomment this to reassemble DTLS handshake messages without the heap.
+ */
+//#define MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY
+
 /**
  * \def MBEDTLS_SSL_EARLY_DATA
  *
@@ -741,6 +1119,72 @@
  */
 #define MBEDTLS_SSL_EXTENDED_MASTER_SECRET
 
+/**
+ * \def MBEDTLS_SSL_FALSE_START
+ *
+ * Enable mbedtls_ssl_conf_false_start(), with which a TLS 1.2 client sends
+ * application data right after its Finished message in full handshakes
+ * with forward-secret AEAD ciphersuites (RFC 7918 TLS False Start). This
+ * saves a round trip before the first write to TLS 1.2 servers.
+ *
+ * Requires: MBEDTLS_SSL_PROTO_TLS1_2, MBEDTLS_SSL_CLI_C
+ *
+ * Comment this macro to disable support for False Start.
+ */
+#define MBEDTLS_SSL_FALSE_START
+
+/**
+ * \def MBEDTLS_SSL_HANDSHAKE_TRACE
+ *
+ * Enable mbedtls_ssl_conf_handshake_trace(), which reports the duration, the
+ * time spent in the send and receive callbacks and the bytes exchanged in
+ * each step of the TLS 1.2 and TLS 1.3 handshake state machines.
+ *
+ * When no trace callback is set, this only costs a test of the callback per
+ * handshake step and per call to the send and receive callbacks.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable handshake tracing.
+ */
+//#define MBEDTLS_SSL_HANDSHAKE_TRACE
+
+/**
+ * \def MBEDTLS_SSL_USDT_PROBES
+ *
+ * Add USDT probes of provider "mbedtls", for bpftrace, perf or SystemTap,
+ * at:
+ * - each handshake step, with the state before and after it
+ *   (handshake_step_entry, handshake_step_return);
+ * - the protection and unprotection of each record, with its length
+ *   (encrypt_entry, encrypt_return, decrypt_entry, decrypt_return);
+ * - each call to the send and receive callbacks (send_entry, send_return,
+ *   recv_entry, recv_return);
+ * - the session cache lookups and stores, and the ticket parsing, with
+ *   their results (cache_get, cache_set, ticket_parse).
+ *
+ * The first argument of each probe is the SSL context. A probe costs a nop
+ * when no tracer is attached.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C and the <sys/sdt.h> header of SystemTap
+ *
+ * Uncomment this macro to add the USDT probes.
+ */
+//#define MBEDTLS_SSL_USDT_PROBES
+
+/**
+ * \def MBEDTLS_SSL_HS_ADMISSION
+ *
+ * Enable mbedtls_ssl_conf_hs_admission(), with which a server admits,
+ * defers or rejects each handshake once it knows what the handshake will
+ * cost, before any public key operation.
+ *
+ * Requires: MBEDTLS_SSL_SRV_C
+ *
+ * Comment this macro to disable the handshake admission callback.
+ */
+#define MBEDTLS_SSL_HS_ADMISSION
+
 /**
  * \def MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
  *
@@ -765,6 +1209,70 @@
  */
 #define MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
 
+/**
+ * \def MBEDTLS_SSL_KTLS
+ *
+ * Enable offloading the record protection of established TLS connections to
+ * the Linux kernel (kTLS), see mbedtls_net_ktls_enable().
+ *
+ * This keeps a copy of the raw traffic keys in every SSL transform, so that
+ * they can be handed over to the kernel.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_NET_C
+ *
+ * Uncomment this macro to enable kernel TLS offload.
+ */
+//#define MBEDTLS_SSL_KTLS
+
+/**
+ * \def MBEDTLS_SSL_QUIC
+ *
+ * Enable running TLS 1.3 handshakes for QUIC (RFC 9001), see
+ * mbedtls_ssl_set_quic(). Handshake messages are exchanged with the QUIC
+ * stack by encryption level rather than in TLS records, the traffic
+ * secrets are handed to the QUIC stack, and the quic_transport_parameters
+ * extension carries the transport parameters of each endpoint.
+ *
+ * Requires: MBEDTLS_SSL_PROTO_TLS1_3
+ *
+ * Uncomment this macro to enable the QUIC handshake interface.
+ */
+//#define MBEDTLS_SSL_QUIC
+
+/**
+ * \def MBEDTLS_SSL_FULL_DUPLEX
+ *
+ * Allow one thread to call mbedtls_ssl_read() while another thread calls
+ * mbedtls_ssl_write() on the same TLS context, once the handshake is over.
+ *
+ * Each context gets a mutex that serialises everything except receiving and
+ * decrypting a record: the reader only gives it up while it waits for the
+ * next record, and takes it back to process anything but application data.
+ * See mbedtls_ssl_read() for the exact contract.
+ *
+ * Requires: MBEDTLS_THREADING_C
+ *
+ * Uncomment this macro to enable concurrent reads and writes.
+ */
+//#define MBEDTLS_SSL_FULL_DUPLEX
+
+/**
+ * \def MBEDTLS_SSL_RECORD_PIPELINE
+ *
+ * Allow the records of a TLS connection to be protected and deprotected on
+ * several threads, see mbedtls_ssl_conf_record_pipeline(). Large writes are
+ * split into records that are encrypted in parallel with pre-assigned
+ * sequence numbers, and records read ahead are decrypted in parallel.
+ *
+ * Only AEAD ciphersuites are pipelined, as their records grow by a known
+ * amount. This needs the PSA Crypto API to be thread-safe.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, MBEDTLS_THREADING_C
+ *
+ * Uncomment this macro to enable the multi-threaded record pipeline.
+ */
+//#define MBEDTLS_SSL_RECORD_PIPELINE
+
 /**
  * \def MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
  *
@@ -813,6 +1321,26 @@
  */
 #define MBEDTLS_SSL_PROTO_TLS1_3
 
+/**
+ * \def MBEDTLS_SSL_RECORD_AEAD_ONLY
+ *
+ * Only protect records with AEAD ciphersuites.
+ *
+ * The TLS 1.2 ciphersuites using CBC or the NULL cipher are removed, even if
+ * the cryptography configuration has CBC or MBEDTLS_CIPHER_NULL_CIPHER for
+ * other uses, and so is the code that protects records with them: MAC
+ * computation, CBC padding, Encrypt-then-MAC and the choice of the record
+ * protection mode of each record. This makes the library smaller and its
+ * record layer shorter for applications that only use TLS 1.3, or TLS 1.2
+ * with GCM, CCM or ChaCha20-Poly1305 ciphersuites.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C, PSA_WANT_ALG_GCM or PSA_WANT_ALG_CCM or
+ *           PSA_WANT_ALG_CHACHA20_POLY1305
+ *
+ * Uncomment this macro to remove the CBC and stream ciphersuites.
+ */
+//#define MBEDTLS_SSL_RECORD_AEAD_ONLY
+
 /**
  * \def MBEDTLS_SSL_RECORD_SIZE_LIMIT
  *
@@ -873,6 +1401,36 @@
  */
 #define MBEDTLS_SSL_SESSION_TICKETS
 
+/**
+ * \def MBEDTLS_SSL_SESSION_STORE_C
+ *
+ * Enable a client-side store of the sessions to resume, by server, see
+ * mbedtls_ssl_conf_session_store(). Handshakes then resume without the
+ * application calling mbedtls_ssl_get_session() and
+ * mbedtls_ssl_set_session().
+ *
+ * Module:  library/ssl_session_store.c
+ * Caller:  library/ssl_client.c
+ *          library/ssl_tls.c
+ *          library/ssl_tls13_client.c
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_X509_CRT_PARSE_C, MBEDTLS_HAVE_TIME
+ */
+#define MBEDTLS_SSL_SESSION_STORE_C
+
+/**
+ * \def MBEDTLS_SSL_SNI_TABLE_C
+ *
+ * Enable a table of server certificates by exact and wildcard host name,
+ * for use as the ServerName callback, see mbedtls_ssl_sni_table_cb().
+ *
+ * Module:  library/ssl_sni_table.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_SRV_C, MBEDTLS_SSL_SERVER_NAME_INDICATION
+ */
+#define MBEDTLS_SSL_SNI_TABLE_C
+
 /**
  * \def MBEDTLS_SSL_SRV_C
  *
@@ -889,6 +1447,25 @@
  */
 #define MBEDTLS_SSL_SRV_C
 
+/**
+ * \def MBEDTLS_SSL_STATS
+ *
+ * Enable mbedtls_ssl_get_stats() and mbedtls_ssl_set_stats_sink(), which
+ * count, per SSL context, the records and bytes protected and unprotected,
+ * the authentication failures of received records, the #MBEDTLS_ERR_SSL_WANT_READ
+ * and #MBEDTLS_ERR_SSL_WANT_WRITE returns of the transport callbacks, the DTLS
+ * retransmissions and dropped buffered messages, the session cache hits and
+ * misses, the ticket failures and the number and duration of handshakes.
+ *
+ * This adds a few counter increments on the record path and about 120 bytes
+ * to each SSL context.
+ *
+ * Requires: MBEDTLS_SSL_TLS_C
+ *
+ * Uncomment this macro to enable the SSL statistics counters.
+ */
+//#define MBEDTLS_SSL_STATS
+
 /**
  * \def MBEDTLS_SSL_TICKET_C
  *
@@ -902,6 +1479,23 @@
  */
 #define MBEDTLS_SSL_TICKET_C
 
+/**
+ * \def MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION
+ *
+ * Enable support for TLS 1.3 certificate compression (RFC 8879).
+ *
+ * The compression algorithms are provided by the application with
+ * mbedtls_ssl_conf_cert_compression(). A server compresses its certificate
+ * chains once, when they are set, and sends a CompressedCertificate message
+ * to clients that offer a common algorithm. A client offers the algorithms
+ * it can decompress.
+ *
+ * Requires: MBEDTLS_SSL_PROTO_TLS1_3, MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment this macro to enable certificate compression.
+ */
+//#define MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION
+
 /**
  * \def MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE
  *
@@ -968,6 +1562,64 @@
  */
 #define MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_EPHEMERAL_ENABLED
 
+/**
+ * \def MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY
+ *
+ * Enable support for raw public keys in TLS 1.3 (RFC 7250).
+ *
+ * Peers that pin each other's keys can then authenticate with a bare
+ * SubjectPublicKeyInfo instead of a certificate chain, negotiated with the
+ * server_certificate_type and client_certificate_type extensions. This
+ * saves sending, parsing and storing the chains. See
+ * mbedtls_ssl_conf_own_rpk() and mbedtls_ssl_conf_rpk_verify().
+ *
+ * Requires: MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED,
+ *           MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, MBEDTLS_X509_CRT_PARSE_C,
+ *           MBEDTLS_PK_WRITE_C
+ *
+ * Uncomment this macro to enable raw public keys.
+ */
+//#define MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY
+
+/**
+ * \def MBEDTLS_SSL_OCSP_STAPLING
+ *
+ * Enable OCSP stapling in TLS 1.3 (status_request extension, RFC 6066 and
+ * RFC 8446 section 4.4.2.1).
+ *
+ * A server then sends the OCSP response it has for its certificate, set
+ * with mbedtls_ssl_conf_own_cert_ocsp(), in its Certificate message, and
+ * can refresh it in the background. A client requests it with
+ * mbedtls_ssl_conf_ocsp_stapling() and checks it while verifying the chain
+ * of the server, which saves the round trip of an OCSP request.
+ *
+ * Requires: MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED,
+ *           MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, MBEDTLS_X509_OCSP_STAPLE,
+ *           MBEDTLS_HAVE_TIME
+ *
+ * Uncomment this macro to enable OCSP stapling.
+ */
+//#define MBEDTLS_SSL_OCSP_STAPLING
+
+/**
+ * \def MBEDTLS_SSL_TLS1_3_STATELESS_HRR
+ *
+ * Enable stateless HelloRetryRequest on TLS 1.3 servers.
+ *
+ * With cookie callbacks set with mbedtls_ssl_conf_tls13_hrr_cookies(), a
+ * server that sends a HelloRetryRequest puts the hash of the first
+ * ClientHello and the group it selected in an authenticated cookie, and
+ * mbedtls_ssl_handshake() returns #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED.
+ * The context can then be reset or freed: the second ClientHello carries
+ * all the server needs to go on with the handshake on a fresh context.
+ *
+ * Requires: MBEDTLS_SSL_SRV_C,
+ *           MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED
+ *
+ * Uncomment this macro to enable stateless HelloRetryRequest.
+ */
+//#define MBEDTLS_SSL_TLS1_3_STATELESS_HRR
+
 /**
  * \def MBEDTLS_SSL_TLS_C
  *
@@ -984,6 +1636,33 @@
  */
 #define MBEDTLS_SSL_TLS_C
 
+/**
+ * \def MBEDTLS_SSL_STATIC_MEMORY
+ *
+ * Bound the heap used by each connection at compile time, so that a static
+ * heap such as the one of MBEDTLS_MEMORY_BUFFER_ALLOC_C can be sized for a
+ * number of connections: #MBEDTLS_SSL_CONNECTION_MEMORY bytes each.
+ *
+ * The parts of a handshake whose size depends on the peer are capped:
+ * a certificate chain of more than MBEDTLS_X509_MAX_INTERMEDIATE_CA + 1
+ * certificates, or with a certificate longer than
+ * MBEDTLS_SSL_MAX_PEER_CERT_LEN bytes, is rejected, and a DTLS flight kept
+ * for retransmission cannot exceed MBEDTLS_SSL_DTLS_MAX_BUFFERING bytes.
+ * Going over a cap fails the handshake the same way each time, instead of
+ * wherever the heap runs out. mbedtls_ssl_setup() refuses configurations
+ * with read-ahead or write batching, whose buffers hold several records.
+ *
+ * \note The budget does not cover DTLS flight coalescing and the DTLS
+ *       flight cache, see mbedtls_ssl_conf_flight_coalescing() and
+ *       mbedtls_ssl_conf_dtls_flight_cache(), which are disabled by
+ *       default, nor what the application allocates itself.
+ *
+ * Requires: !MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
+ *
+ * Uncomment this to bound the memory of each connection.
+ */
+//#define MBEDTLS_SSL_STATIC_MEMORY
+
 /**
  * \def MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
  *
@@ -994,9 +1673,35 @@
  */
 //#define MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH
 
+/**
+ * \def MBEDTLS_SSL_WARM_POOL_C
+ *
+ * Enable a client-side pool of connections established ahead of use, by
+ * server, see mbedtls_ssl_warm_pool_prewarm(). A connection the application
+ * expects to need can then be acquired with its handshake already done.
+ *
+ * Module:  library/ssl_warm_pool.c
+ * Caller:
+ *
+ * Requires: MBEDTLS_SSL_CLI_C, MBEDTLS_NET_C, MBEDTLS_HAVE_TIME
+ */
+#define MBEDTLS_SSL_WARM_POOL_C
+
 //#define MBEDTLS_PSK_MAX_LEN               32 /**< Max size of TLS pre-shared keys, in bytes (default 256 or 384 bits) */
+//#define MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE    64 /**< Maximum buffers kept by a buffer pool */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_MAX_ENTRIES      50 /**< Maximum entries in cache */
 //#define MBEDTLS_SSL_CACHE_DEFAULT_TIMEOUT       86400 /**< 1 day  */
+//#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_SHARDS        16 /**< Number of shards in a sharded cache */
+//#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_MAX_ENTRIES 1024 /**< Maximum entries in a sharded cache */
+//#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_TIMEOUT    86400 /**< 1 day  */
+//#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_MAX_ENTRIES     1024 /**< Maximum entries in a shared memory cache */
+//#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_ENTRY_SIZE      1024 /**< Serialized session room in a shared memory cache */
+//#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_TIMEOUT        86400 /**< 1 day  */
+//#define MBEDTLS_SSL_HS_BUDGET_DEFAULT_MAX_DEFERRALS     16 /**< Deferrals before a handshake over budget is rejected */
+//#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT    86400 /**< 1 day  */
+//#define MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS            4 /**< TLS 1.3 tickets kept per server in a session store */
+//#define MBEDTLS_SSL_WARM_POOL_DEFAULT_IDLE_TIMEOUT   30000 /**< Milliseconds a warm connection is kept unused */
+//#define MBEDTLS_SSL_WARM_POOL_DEFAULT_CONNECT_TIMEOUT 10000 /**< Milliseconds allowed for a warm connection to connect */
 
 /** \def MBEDTLS_SSL_CID_IN_LEN_MAX
  *
@@ -1044,6 +1749,8 @@
 
 //#define MBEDTLS_SSL_COOKIE_TIMEOUT        60 /**< Default expiration delay of DTLS cookies, in seconds if HAVE_TIME, or in number of cookies issued */
 
+//#define MBEDTLS_SSL_ANTI_REPLAY_WINDOW 12000 /**< Default lifetime of the early data anti-replay filters, in milliseconds if HAVE_TIME, or in number of attempts */
+
 /** \def MBEDTLS_SSL_DTLS_MAX_BUFFERING
  *
  * Maximum number of heap-allocated bytes for the purpose of
@@ -1061,6 +1768,61 @@
  */
 //#define MBEDTLS_SSL_DTLS_MAX_BUFFERING             32768
 
+/** \def MBEDTLS_SSL_QUIC_MAX_BUFFERING
+ *
+ * Maximum number of bytes of handshake data given by the QUIC stack with
+ * mbedtls_ssl_quic_provide_data() and not processed yet, for each
+ * encryption level.
+ *
+ * This should be at least the size of the largest flight of handshake
+ * messages the peer sends at one level, usually its certificate chain.
+ */
+//#define MBEDTLS_SSL_QUIC_MAX_BUFFERING             65536
+
+/** \def MBEDTLS_SSL_DTLS_REPLAY_WINDOW
+ *
+ * Width in bits of the DTLS anti-replay window, a multiple of 64. A record
+ * that arrives more than this many records after a record with a higher
+ * sequence number is dropped as if it were replayed.
+ *
+ * The default of 64 is the minimum required by RFC 6347. Widen it on links
+ * that reorder datagrams by more than that, for example with multipath
+ * routing. Each context uses one byte per 8 bits of window.
+ *
+ * Only the most recent 64 bits are kept by mbedtls_ssl_context_save(), and
+ * mbedtls_ssl_context_load() considers the older records of the window seen.
+ */
+//#define MBEDTLS_SSL_DTLS_REPLAY_WINDOW             64
+
+/** \def MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE
+ *
+ * Size in bytes of the arena embedded in each handshake context. Data that
+ * lives as long as the handshake, such as the TLS 1.3 handshake and early
+ * data transforms, the cookies of a client and the supported groups of a
+ * TLS 1.2 client, is allocated from it and released at once with the
+ * handshake. An allocation that does not fit is taken from the heap.
+ *
+ * Set to 0 to allocate everything from the heap.
+ */
+//#define MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE           1024
+
+/** \def MBEDTLS_SSL_HANDSHAKE_MEMORY
+ *
+ * Heap in bytes allowed for a handshake besides the I/O buffers, the peer
+ * certificate chain and the DTLS buffering: the handshake, session and
+ * transform structures and the temporary data of the cryptography, which
+ * only depend on the configuration. Part of #MBEDTLS_SSL_CONNECTION_MEMORY,
+ * see MBEDTLS_SSL_STATIC_MEMORY.
+ */
+//#define MBEDTLS_SSL_HANDSHAKE_MEMORY               32768
+
+/** \def MBEDTLS_SSL_MAX_PEER_CERT_LEN
+ *
+ * Longest certificate in bytes, DER-encoded, accepted in the chain of the
+ * peer when MBEDTLS_SSL_STATIC_MEMORY is enabled.
+ */
+//#define MBEDTLS_SSL_MAX_PEER_CERT_LEN              4096
+
 /** \def MBEDTLS_SSL_IN_CONTENT_LEN
  *
  * Maximum length (in bytes) of incoming plaintext fragments.
@@ -1115,6 +1877,19 @@
  */
 //#define MBEDTLS_SSL_OUT_CONTENT_LEN             16384
 
+/**
+ * \def MBEDTLS_SSL_TICKET_MAX_KEYS
+ *
+ * Maximum number of session ticket keys held by a ticket context, see
+ * mbedtls_ssl_ticket_add_key(). One of them encrypts new tickets, the others
+ * are only used to decrypt tickets issued earlier, for example by other
+ * servers that have not rotated their keys yet.
+ *
+ * Each key uses a few hundred bytes of RAM with the legacy cipher API. The
+ * minimum is 2, the maximum 64.
+ */
+//#define MBEDTLS_SSL_TICKET_MAX_KEYS 2
+
 /**
  * \def MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS
  *
@@ -1125,6 +1900,17 @@
  */
 //#define MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS 1
 
+/**
+ * \def MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS
+ *
+ * Default number of records protected with the same TLS 1.3 application
+ * traffic key before a KeyUpdate is sent, see
+ * mbedtls_ssl_conf_tls13_key_update_limit(). The default of 2^23 records is
+ * within the usage limits of AES-GCM and AES-CCM in RFC 8446, section 5.5.
+ * 0 disables automatic key updates.
+ */
+//#define MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS 8388608
+
 /**
  * \def MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE
  *
@@ -1211,6 +1997,34 @@
  */
 #define MBEDTLS_X509_CRL_PARSE_C
 
+/**
+ * \def MBEDTLS_X509_CRL_SERIAL_INDEX
+ *
+ * Sort the entries of each parsed CRL by serial number, so that
+ * mbedtls_x509_crt_is_revoked() and certificate verification look up a
+ * serial with a binary search instead of walking every entry. This costs
+ * one pointer per CRL entry.
+ *
+ * Requires: MBEDTLS_X509_CRL_PARSE_C
+ *
+ * Comment this macro to walk the entries instead.
+ */
+#define MBEDTLS_X509_CRL_SERIAL_INDEX
+
+/**
+ * \def MBEDTLS_X509_CRL_STREAM
+ *
+ * Enable mbedtls_x509_crl_stream_update() and related functions, which
+ * parse a DER-encoded CRL given in pieces. Instead of a copy of the CRL and
+ * a list node per entry, a streamed CRL only keeps a small serial number
+ * record per entry, which makes very large CRLs affordable.
+ *
+ * Requires: MBEDTLS_X509_CRL_PARSE_C
+ *
+ * Comment this macro to disable the streaming CRL parser.
+ */
+#define MBEDTLS_X509_CRL_STREAM
+
 /**
  * \def MBEDTLS_X509_CRT_PARSE_C
  *
@@ -1311,6 +2125,110 @@
  */
 //#define MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK
 
+/**
+ * \def MBEDTLS_X509_TRUST_STORE
+ *
+ * Enable the indexed trust store, see mbedtls_x509_trust_store_setup().
+ * Verification against a large list of trusted CAs then looks up the
+ * candidate parents of a certificate by subject name and key identifier
+ * instead of comparing its issuer with every trusted CA.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Comment this macro to disable the trust store.
+ */
+#define MBEDTLS_X509_TRUST_STORE
+
+/**
+ * \def MBEDTLS_X509_TRUST_IMAGE
+ *
+ * Enable trust images, see mbedtls_x509_trust_image_write() and
+ * mbedtls_x509_trust_image_setup(). A bundle of trusted CAs can then be
+ * compiled once, with programs/x509/trust_image, into a file that
+ * processes map into memory and share. Only the CAs needed to verify a
+ * certificate are parsed, instead of the whole bundle at startup.
+ *
+ * Requires: MBEDTLS_X509_TRUST_STORE
+ *
+ * Uncomment to enable trust images.
+ */
+//#define MBEDTLS_X509_TRUST_IMAGE
+
+/**
+ * \def MBEDTLS_X509_VERIFY_CACHE
+ *
+ * Enable the cache of verified certificate chains, see
+ * mbedtls_x509_crt_verify_with_cache() and mbedtls_ssl_conf_verify_cache().
+ * A peer presenting a chain that was verified before then skips the
+ * signature checks, which helps servers that see the same client
+ * certificates over and over.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C, PSA_WANT_ALG_SHA_256
+ *
+ * Uncomment to enable the verification cache.
+ */
+//#define MBEDTLS_X509_VERIFY_CACHE
+
+/**
+ * \def MBEDTLS_X509_CA_CB_CACHE
+ *
+ * Enable the cache of the trusted CAs returned by a CA callback, see
+ * mbedtls_x509_crt_ca_cache_setup(). The candidate parents of a certificate
+ * are then looked up by the callback and parsed once per time to live, and
+ * verifications in between use the parsed certificates as they are.
+ *
+ * Requires: MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK, MBEDTLS_HAVE_TIME
+ *
+ * Uncomment to enable the CA callback cache.
+ */
+//#define MBEDTLS_X509_CA_CB_CACHE
+
+/**
+ * \def MBEDTLS_X509_PARALLEL_VERIFY
+ *
+ * Enable mbedtls_x509_crt_verify_parallel(), which builds the path of a
+ * certificate chain first and then hands all its signature checks at once
+ * to an executor supplied by the application, e.g. a thread pool. This
+ * cuts the latency of verifying long chains on multicore systems.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment to enable parallel signature verification.
+ */
+//#define MBEDTLS_X509_PARALLEL_VERIFY
+
+/**
+ * \def MBEDTLS_X509_OCSP_STAPLE
+ *
+ * Enable mbedtls_x509_crt_set_ocsp_response(), which attaches an OCSP
+ * response (RFC 6960) to an end-entity certificate. The response is then
+ * checked as part of verifying the chain of the certificate, which flags
+ * the certificate as revoked without a separate OCSP request. This is how
+ * the SSL module checks the responses stapled by servers, see
+ * MBEDTLS_SSL_OCSP_STAPLING.
+ *
+ * Requires: MBEDTLS_X509_CRT_PARSE_C
+ *
+ * Uncomment to check attached OCSP responses.
+ */
+//#define MBEDTLS_X509_OCSP_STAPLE
+
+/**
+ * \def MBEDTLS_X509_CRT_CA_DIR
+ *
+ * Enable hashed CA directories, see mbedtls_x509_crt_ca_dir_setup(). A
+ * directory laid out by OpenSSL's c_rehash, such as /etc/ssl/certs, is
+ * then only listed at startup, and each CA is parsed the first time it is
+ * needed, instead of parsing the whole directory with
+ * mbedtls_x509_crt_parse_path().
+ *
+ * Requires: MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK, MBEDTLS_FS_IO,
+ *           PSA_WANT_ALG_SHA_1
+ *
+ * Uncomment to enable hashed CA directories.
+ */
+//#define MBEDTLS_X509_CRT_CA_DIR
+
 /**
  * \def MBEDTLS_X509_USE_C
  *
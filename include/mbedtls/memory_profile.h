@@ -0,0 +1,111 @@
+/**
+ * \file memory_profile.h
+ *
+ * \brief Heap usage accounting per library subsystem
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_MEMORY_PROFILE_H
+#define MBEDTLS_MEMORY_PROFILE_H
+
+#include "mbedtls/build_info.h"
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Subsystem an allocation is accounted to
+ */
+typedef enum {
+    MBEDTLS_MEMORY_TAG_OTHER = 0,       /*!< untagged, including all the
+                                         *   allocations of the crypto
+                                         *   library and PSA key slots   */
+    MBEDTLS_MEMORY_TAG_SSL,             /*!< other SSL context and
+                                         *   configuration data          */
+    MBEDTLS_MEMORY_TAG_SSL_RECORD,      /*!< record buffers              */
+    MBEDTLS_MEMORY_TAG_SSL_HANDSHAKE,   /*!< handshake parameters and
+                                         *   buffered messages           */
+    MBEDTLS_MEMORY_TAG_SSL_TRANSFORM,   /*!< record protection contexts  */
+    MBEDTLS_MEMORY_TAG_SSL_SESSION,     /*!< sessions and tickets        */
+    MBEDTLS_MEMORY_TAG_SSL_PEER_CERT,   /*!< peer certificate chains     */
+    MBEDTLS_MEMORY_TAG_SSL_CACHE,       /*!< session caches and other
+                                         *   tables shared by contexts   */
+    MBEDTLS_MEMORY_TAG_X509,            /*!< X.509 and PKCS7 parsing and
+                                         *   writing                     */
+    MBEDTLS_MEMORY_TAG_NET,             /*!< network layer               */
+    MBEDTLS_MEMORY_TAG_COUNT            /*!< number of tags              */
+} mbedtls_memory_tag;
+
+/**
+ * \brief   Heap usage of one tag
+ */
+typedef struct mbedtls_memory_profile_usage {
+    size_t current;         /*!< bytes currently allocated          */
+    size_t peak;            /*!< largest value of \c current        */
+    size_t blocks;          /*!< blocks currently allocated         */
+    size_t allocations;     /*!< successful allocations so far      */
+} mbedtls_memory_profile_usage;
+
+/**
+ * \brief          Start accounting heap usage
+ *
+ *                 This installs an accounting allocator with
+ *                 mbedtls_platform_set_calloc_free(). Each block then
+ *                 records its size and the tag of the library code that
+ *                 allocated it, so that freeing it updates the usage of
+ *                 that tag.
+ *
+ * \note           Call this before any other Mbed TLS or PSA function, as
+ *                 the memory allocated before cannot be freed afterwards.
+ *
+ * \return         \c 0 on success, or a negative error code.
+ */
+int mbedtls_memory_profile_init(void);
+
+/**
+ * \brief          Get the heap usage of a tag
+ *
+ * \param tag      Tag to query
+ * \param usage    Where to store the usage of \p tag. It is zero if
+ *                 \p tag is out of range.
+ */
+void mbedtls_memory_profile_get(mbedtls_memory_tag tag,
+                                mbedtls_memory_profile_usage *usage);
+
+/**
+ * \brief          Reset the peak usage of every tag to its current usage
+ *
+ *                 Use this to measure the peak usage of one phase, such as
+ *                 a handshake.
+ */
+void mbedtls_memory_profile_reset_peak(void);
+
+/**
+ * \brief          Get a short name of a tag, such as "ssl_record"
+ *
+ * \param tag      Tag to name
+ *
+ * \return         A static string, or \c NULL if \p tag is out of range.
+ */
+const char *mbedtls_memory_profile_tag_name(mbedtls_memory_tag tag);
+
+/**
+ * \brief          Stop accounting heap usage
+ *
+ *                 This puts the standard allocator back.
+ *
+ * \note           Call this only once all the memory allocated since
+ *                 mbedtls_memory_profile_init() is freed.
+ */
+void mbedtls_memory_profile_free(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* memory_profile.h */
@@ -69,6 +69,18 @@
 #define MBEDTLS_NET_POLL_READ  1 /**< Used in \c mbedtls_net_poll to check for pending data  */
 #define MBEDTLS_NET_POLL_WRITE 2 /**< Used in \c mbedtls_net_poll to check if write possible */
 
+#if !defined(MBEDTLS_NET_REACTOR_MAX_EVENTS)
+#define MBEDTLS_NET_REACTOR_MAX_EVENTS 64 /**< Events collected per system call by \c mbedtls_net_reactor_dispatch */
+#endif
+
+#if !defined(MBEDTLS_NET_CONNECT_ATTEMPT_DELAY)
+#define MBEDTLS_NET_CONNECT_ATTEMPT_DELAY 250 /**< Default delay in milliseconds between connection attempts of \c mbedtls_net_connect_timeout */
+#endif
+
+#if !defined(MBEDTLS_NET_DGRAM_BATCH)
+#define MBEDTLS_NET_DGRAM_BATCH 32 /**< Datagrams received or sent per system call by a datagram demultiplexer */
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -91,6 +103,193 @@ typedef struct mbedtls_net_context {
 }
 mbedtls_net_context;
 
+#if defined(MBEDTLS_NET_REACTOR)
+/**
+ * \brief          Callback type: a registered socket became ready
+ *
+ * \param p_ready  The context passed to mbedtls_net_reactor_add()
+ * \param events   Bitmask composed of MBEDTLS_NET_POLL_READ and
+ *                 MBEDTLS_NET_POLL_WRITE. Errors and hangups are reported
+ *                 as readiness, so that the next read or write returns the
+ *                 actual condition.
+ */
+typedef void mbedtls_net_reactor_cb_t(void *p_ready, uint32_t events);
+
+/**
+ * \brief          Registration of a socket with a reactor.
+ *
+ *                 The caller owns this structure, typically as part of its
+ *                 per-connection state, so that registering a socket does
+ *                 not allocate memory.
+ */
+typedef struct mbedtls_net_reactor_item {
+    mbedtls_net_context *MBEDTLS_PRIVATE(ctx);           /*!< registered socket    */
+    mbedtls_net_reactor_cb_t *MBEDTLS_PRIVATE(f_ready);  /*!< readiness callback   */
+    void *MBEDTLS_PRIVATE(p_ready);                      /*!< callback context     */
+}
+mbedtls_net_reactor_item;
+
+/**
+ * \brief          Event loop waiting for many sockets at once.
+ */
+typedef struct mbedtls_net_reactor {
+    int MBEDTLS_PRIVATE(fd);     /*!< epoll or kqueue descriptor */
+}
+mbedtls_net_reactor;
+#endif /* MBEDTLS_NET_REACTOR */
+
+#if defined(MBEDTLS_NET_IO_URING)
+/**
+ * \brief          Callback type: an io_uring operation of a connection
+ *                 completed
+ *
+ * \param p_ready  The context passed to mbedtls_net_uring_context_setup()
+ * \param events   MBEDTLS_NET_POLL_READ if a receive completed,
+ *                 MBEDTLS_NET_POLL_WRITE if a send completed.
+ */
+typedef void mbedtls_net_uring_cb_t(void *p_ready, uint32_t events);
+
+/**
+ * \brief          An io_uring shared by many connections.
+ */
+typedef struct mbedtls_net_uring {
+    int MBEDTLS_PRIVATE(fd);                     /*!< io_uring descriptor    */
+    void *MBEDTLS_PRIVATE(sq_ring);              /*!< submission ring map    */
+    size_t MBEDTLS_PRIVATE(sq_ring_len);
+    void *MBEDTLS_PRIVATE(cq_ring);              /*!< completion ring map    */
+    size_t MBEDTLS_PRIVATE(cq_ring_len);
+    void *MBEDTLS_PRIVATE(sqes);                 /*!< submission entries     */
+    size_t MBEDTLS_PRIVATE(sqes_len);
+    unsigned *MBEDTLS_PRIVATE(sq_head);
+    unsigned *MBEDTLS_PRIVATE(sq_tail);
+    unsigned *MBEDTLS_PRIVATE(sq_array);
+    unsigned MBEDTLS_PRIVATE(sq_mask);
+    unsigned MBEDTLS_PRIVATE(sq_entries);
+    unsigned MBEDTLS_PRIVATE(to_submit);         /*!< queued, not submitted  */
+    unsigned *MBEDTLS_PRIVATE(cq_head);
+    unsigned *MBEDTLS_PRIVATE(cq_tail);
+    unsigned MBEDTLS_PRIVATE(cq_mask);
+    void *MBEDTLS_PRIVATE(cqes);                 /*!< completion entries     */
+    unsigned char *MBEDTLS_PRIVATE(region);      /*!< registered buffers     */
+    size_t MBEDTLS_PRIVATE(region_len);
+}
+mbedtls_net_uring;
+
+/**
+ * \brief          State of one queued send or receive.
+ */
+typedef struct mbedtls_net_uring_op {
+    struct mbedtls_net_uring_context *MBEDTLS_PRIVATE(owner);
+    const unsigned char *MBEDTLS_PRIVATE(buf);   /*!< buffer of the operation */
+    size_t MBEDTLS_PRIVATE(len);
+    int MBEDTLS_PRIVATE(state);                  /*!< idle, pending or done   */
+    int MBEDTLS_PRIVATE(res);                    /*!< result once done        */
+}
+mbedtls_net_uring_op;
+
+/**
+ * \brief          A connection whose I/O goes through an io_uring.
+ *
+ *                 Pass this as the BIO context of mbedtls_ssl_set_bio(),
+ *                 with mbedtls_net_uring_send() and mbedtls_net_uring_recv().
+ */
+typedef struct mbedtls_net_uring_context {
+    mbedtls_net_uring *MBEDTLS_PRIVATE(ring);
+    mbedtls_net_context *MBEDTLS_PRIVATE(net);
+    mbedtls_net_uring_cb_t *MBEDTLS_PRIVATE(f_ready);
+    void *MBEDTLS_PRIVATE(p_ready);
+    mbedtls_net_uring_op MBEDTLS_PRIVATE(rx);
+    mbedtls_net_uring_op MBEDTLS_PRIVATE(tx);
+}
+mbedtls_net_uring_context;
+#endif /* MBEDTLS_NET_IO_URING */
+
+#if defined(MBEDTLS_NET_DGRAM_DEMUX)
+#define MBEDTLS_NET_DGRAM_ADDR_MAX  128 /**< Maximum peer address length, the size of struct sockaddr_storage */
+#define MBEDTLS_NET_DGRAM_CID_MAX    32 /**< Maximum length of a routing connection ID */
+
+/**
+ * \brief          Callback type: datagrams arrived for a peer
+ *
+ * \param p_ready  The context passed to mbedtls_net_dgram_peer_add()
+ * \param events   MBEDTLS_NET_POLL_READ
+ */
+typedef void mbedtls_net_dgram_cb_t(void *p_ready, uint32_t events);
+
+struct mbedtls_net_dgram_demux;
+struct mbedtls_net_dgram_slot;
+
+/**
+ * \brief          A peer of a datagram demultiplexer.
+ *
+ *                 Pass this as the BIO context of mbedtls_ssl_set_bio(),
+ *                 with mbedtls_net_dgram_peer_send() and
+ *                 mbedtls_net_dgram_peer_recv(). The caller owns this
+ *                 structure, typically as part of its per-connection state.
+ */
+typedef struct mbedtls_net_dgram_peer {
+    struct mbedtls_net_dgram_demux *MBEDTLS_PRIVATE(demux);
+    unsigned char MBEDTLS_PRIVATE(addr)[MBEDTLS_NET_DGRAM_ADDR_MAX]; /*!< peer sockaddr */
+    size_t MBEDTLS_PRIVATE(addr_len);
+    unsigned char MBEDTLS_PRIVATE(cid)[MBEDTLS_NET_DGRAM_CID_MAX];   /*!< our CID, if any */
+    size_t MBEDTLS_PRIVATE(cid_len);
+    struct mbedtls_net_dgram_peer *MBEDTLS_PRIVATE(addr_next);  /*!< address hash chain */
+    struct mbedtls_net_dgram_peer *MBEDTLS_PRIVATE(cid_next);   /*!< CID hash chain     */
+    struct mbedtls_net_dgram_peer *MBEDTLS_PRIVATE(ready_next); /*!< peers with input   */
+    unsigned MBEDTLS_PRIVATE(gen);               /*!< batch the queue is from */
+    int MBEDTLS_PRIVATE(rx_head);                /*!< queued datagrams, slots */
+    int MBEDTLS_PRIVATE(rx_tail);
+    mbedtls_net_dgram_cb_t *MBEDTLS_PRIVATE(f_ready);
+    void *MBEDTLS_PRIVATE(p_ready);
+}
+mbedtls_net_dgram_peer;
+
+/**
+ * \brief          Callback type: a datagram arrived from an unknown peer
+ *
+ * \param p_accept The context passed to mbedtls_net_dgram_set_accept_cb()
+ * \param addr     Address of the sender
+ * \param addr_len Length of \p addr
+ * \param buf      The datagram
+ * \param len      Length of \p buf
+ *
+ * \return         A peer the callback added with mbedtls_net_dgram_peer_add(),
+ *                 which receives the datagram, or NULL to drop it.
+ */
+typedef mbedtls_net_dgram_peer *mbedtls_net_dgram_accept_cb_t(void *p_accept,
+                                                              const unsigned char *addr,
+                                                              size_t addr_len,
+                                                              const unsigned char *buf,
+                                                              size_t len);
+
+/**
+ * \brief          Datagram demultiplexer: many DTLS peers behind a single
+ *                 unconnected UDP socket.
+ *
+ *                 Datagrams are received and sent in batches of up to
+ *                 #MBEDTLS_NET_DGRAM_BATCH per system call, and routed to
+ *                 peers by connection ID or by source address.
+ */
+typedef struct mbedtls_net_dgram_demux {
+    mbedtls_net_context *MBEDTLS_PRIVATE(net);   /*!< bound UDP socket       */
+    size_t MBEDTLS_PRIVATE(max_len);             /*!< largest datagram       */
+    size_t MBEDTLS_PRIVATE(cid_len);             /*!< routing CID length     */
+    mbedtls_net_dgram_peer **MBEDTLS_PRIVATE(addr_buckets);
+    mbedtls_net_dgram_peer **MBEDTLS_PRIVATE(cid_buckets);
+    size_t MBEDTLS_PRIVATE(bucket_mask);         /*!< bucket count - 1       */
+    mbedtls_net_dgram_accept_cb_t *MBEDTLS_PRIVATE(f_accept);
+    void *MBEDTLS_PRIVATE(p_accept);
+    unsigned MBEDTLS_PRIVATE(gen);               /*!< receive batch counter  */
+    struct mbedtls_net_dgram_slot *MBEDTLS_PRIVATE(rx);
+    unsigned char *MBEDTLS_PRIVATE(rx_buf);
+    struct mbedtls_net_dgram_slot *MBEDTLS_PRIVATE(tx);
+    unsigned char *MBEDTLS_PRIVATE(tx_buf);
+    size_t MBEDTLS_PRIVATE(tx_count);            /*!< queued datagrams       */
+    int MBEDTLS_PRIVATE(gso);                    /*!< use UDP segmentation   */
+}
+mbedtls_net_dgram_demux;
+#endif /* MBEDTLS_NET_DGRAM_DEMUX */
+
 /**
  * \brief          Initialize a context
  *                 Just makes the context ready to be used or freed safely.
@@ -116,6 +315,74 @@ void mbedtls_net_init(mbedtls_net_context *ctx);
  */
 int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host, const char *port, int proto);
 
+/**
+ * \brief          Initiate a TCP connection with host:port using TCP Fast
+ *                 Open (RFC 7413)
+ *
+ *                 The connection is only opened by the first send, whose
+ *                 data rides in the SYN if the server gave this host a Fast
+ *                 Open cookie on an earlier connection. With TLS, this is
+ *                 the ClientHello, which saves a round trip, and early data
+ *                 with TLS 1.3 if it goes out in the same flush.
+ *
+ * \note           This uses TCP_FASTOPEN_CONNECT (Linux 4.11). Where that is
+ *                 not available, this is the same as mbedtls_net_connect().
+ *                 Since connecting does not wait for the server, only the
+ *                 first address of \p host is tried, and errors such as a
+ *                 refused connection are reported by the first send or
+ *                 receive.
+ *
+ * \param ctx      Socket to use
+ * \param host     Host to connect to
+ * \param port     Port to connect to
+ *
+ * \return         0 if successful, or one of:
+ *                      MBEDTLS_ERR_NET_SOCKET_FAILED,
+ *                      MBEDTLS_ERR_NET_UNKNOWN_HOST,
+ *                      MBEDTLS_ERR_NET_CONNECT_FAILED
+ */
+int mbedtls_net_connect_fastopen(mbedtls_net_context *ctx, const char *host,
+                                 const char *port);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Initiate a connection with host:port, trying its addresses
+ *                 in parallel, within a time limit
+ *
+ *                 Unlike mbedtls_net_connect(), which waits for each address
+ *                 in turn, this starts a non-blocking connection to the next
+ *                 address every \p attempt_delay milliseconds, or as soon as
+ *                 the previous attempts have failed, and keeps the first one
+ *                 to complete (Happy Eyeballs, RFC 8305). The addresses
+ *                 alternate between IPv6 and IPv4, so an unreachable
+ *                 address of one family does not hold up the other.
+ *
+ * \param ctx      Socket to use
+ * \param host     Host to connect to
+ * \param port     Port to connect to
+ * \param proto    Protocol: MBEDTLS_NET_PROTO_TCP or MBEDTLS_NET_PROTO_UDP.
+ *                 With UDP, this is the same as mbedtls_net_connect(), as
+ *                 that does not wait for the network.
+ * \param attempt_delay Delay in milliseconds before starting the next
+ *                 attempt, or 0 for #MBEDTLS_NET_CONNECT_ATTEMPT_DELAY
+ * \param timeout  Overall time limit in milliseconds, or 0 for none
+ *
+ * \return         0 if successful, or one of:
+ *                      MBEDTLS_ERR_NET_SOCKET_FAILED,
+ *                      MBEDTLS_ERR_NET_UNKNOWN_HOST,
+ *                      MBEDTLS_ERR_NET_CONNECT_FAILED,
+ *                      MBEDTLS_ERR_NET_POLL_FAILED,
+ *                      MBEDTLS_ERR_SSL_TIMEOUT if no attempt succeeded in
+ *                      time.
+ *
+ * \note           The socket is left in blocking mode, as with
+ *                 mbedtls_net_connect(). At most 16 addresses are tried.
+ */
+int mbedtls_net_connect_timeout(mbedtls_net_context *ctx, const char *host,
+                                const char *port, int proto,
+                                uint32_t attempt_delay, uint32_t timeout);
+#endif /* MBEDTLS_HAVE_TIME */
+
 /**
  * \brief          Create a receiving socket on bind_ip:port in the chosen
  *                 protocol. If bind_ip == NULL, all interfaces are bound.
@@ -136,6 +403,61 @@ int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host, const char *
  */
 int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *port, int proto);
 
+/**
+ * \brief          Create a listening TCP socket on bind_ip:port that accepts
+ *                 TCP Fast Open (RFC 7413)
+ *
+ *                 Clients that use mbedtls_net_connect_fastopen() can then
+ *                 send their first flight in the SYN of later connections.
+ *                 The data is available to mbedtls_net_accept() callers
+ *                 as soon as the connection is accepted.
+ *
+ * \note           If the system does not support or allow Fast Open (on
+ *                 Linux, see the net.ipv4.tcp_fastopen sysctl), this is the
+ *                 same as mbedtls_net_bind() with #MBEDTLS_NET_PROTO_TCP.
+ *
+ * \param ctx      Socket to use
+ * \param bind_ip  IP to bind to, can be NULL
+ * \param port     Port number to use
+ *
+ * \return         0 if successful, or one of:
+ *                      MBEDTLS_ERR_NET_SOCKET_FAILED,
+ *                      MBEDTLS_ERR_NET_UNKNOWN_HOST,
+ *                      MBEDTLS_ERR_NET_BIND_FAILED,
+ *                      MBEDTLS_ERR_NET_LISTEN_FAILED
+ */
+int mbedtls_net_bind_fastopen(mbedtls_net_context *ctx, const char *bind_ip,
+                              const char *port);
+
+/**
+ * \brief          Create several receiving sockets on the same bind_ip:port
+ *
+ *                 The sockets, or shards, share the port with SO_REUSEPORT,
+ *                 and the kernel spreads incoming connections or datagrams
+ *                 over them by hashing the peer address. Giving each worker
+ *                 thread or process its own shard avoids contention on a
+ *                 single accept queue, and waking every worker for each
+ *                 connection.
+ *
+ * \param shards   Array of \p count sockets to use
+ * \param count    Number of sockets
+ * \param bind_ip  IP to bind to, can be NULL
+ * \param port     Port number to use. If this is "0", the system picks a
+ *                 port, which all shards share.
+ * \param proto    Protocol: MBEDTLS_NET_PROTO_TCP or MBEDTLS_NET_PROTO_UDP
+ *
+ * \return         0 if successful, or one of:
+ *                      MBEDTLS_ERR_NET_SOCKET_FAILED, also if the platform
+ *                      does not support SO_REUSEPORT,
+ *                      MBEDTLS_ERR_NET_UNKNOWN_HOST,
+ *                      MBEDTLS_ERR_NET_BIND_FAILED,
+ *                      MBEDTLS_ERR_NET_LISTEN_FAILED,
+ *                      MBEDTLS_ERR_NET_BAD_INPUT_DATA.
+ *                 On error, no socket is left open.
+ */
+int mbedtls_net_bind_shards(mbedtls_net_context *shards, size_t count,
+                            const char *bind_ip, const char *port, int proto);
+
 /**
  * \brief           Accept a connection from a remote client
  *
@@ -158,12 +480,41 @@ int mbedtls_net_accept(mbedtls_net_context *bind_ctx,
                        mbedtls_net_context *client_ctx,
                        void *client_ip, size_t buf_size, size_t *cip_len);
 
+/**
+ * \brief           Accept the pending connections on a TCP socket
+ *
+ *                  This drains up to \p max connections from the listen
+ *                  backlog in one call. The accepted sockets are
+ *                  non-blocking and closed on exec (with a single
+ *                  accept4() system call each on Linux).
+ *
+ * \note            If \p bind_ctx is blocking, this waits for the first
+ *                  connection only. Make it non-blocking to use this from
+ *                  an event loop.
+ *
+ * \param bind_ctx  Listening TCP socket
+ * \param clients   Array of \p max contexts to receive the client sockets
+ * \param max       Maximum number of connections to accept, at most
+ *                  INT_MAX
+ *
+ * \return          The number of connections accepted, or
+ *                  MBEDTLS_ERR_SSL_WANT_READ if bind_ctx is non-blocking
+ *                  and no connection is pending, or
+ *                  MBEDTLS_ERR_NET_ACCEPT_FAILED, or
+ *                  MBEDTLS_ERR_NET_BAD_INPUT_DATA. An error after some
+ *                  connections were accepted is not reported until the
+ *                  next call.
+ */
+int mbedtls_net_accept_batch(mbedtls_net_context *bind_ctx,
+                             mbedtls_net_context *clients, size_t max);
+
 /**
  * \brief          Check and wait for the context to be ready for read/write
  *
- * \note           The current implementation of this function uses
- *                 select() and returns an error if the file descriptor
- *                 is \c FD_SETSIZE or greater.
+ * \note           On Unix-like platforms, the current implementation of this
+ *                 function uses poll(), so any file descriptor value can be
+ *                 used. To wait for many sockets at once, see
+ *                 mbedtls_net_reactor_setup().
  *
  * \param ctx      Socket to check
  * \param rw       Bitflag composed of MBEDTLS_NET_POLL_READ and
@@ -246,9 +597,9 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len);
  *                 'timeout' seconds. If no error occurs, the actual amount
  *                 read is returned.
  *
- * \note           The current implementation of this function uses
- *                 select() and returns an error if the file descriptor
- *                 is \c FD_SETSIZE or greater.
+ * \note           On Unix-like platforms, the current implementation of this
+ *                 function uses poll(), so any file descriptor value can be
+ *                 used.
  *
  * \param ctx      Socket
  * \param buf      The buffer to write to
@@ -270,6 +621,615 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len);
 int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf, size_t len,
                              uint32_t timeout);
 
+#if defined(MBEDTLS_SSL_KTLS)
+/**
+ * \brief          Offload the record protection of an established TLS
+ *                 connection to the Linux kernel (kTLS).
+ *
+ *                 Afterwards, the kernel encrypts and decrypts records, so
+ *                 data can also be sent with plain write() or sendfile() on
+ *                 the socket. mbedtls_ssl_read() and mbedtls_ssl_write()
+ *                 keep working and pass the data through unchanged.
+ *
+ * \param ctx      Socket of the connection
+ * \param ssl      SSL context of the connection, with the handshake
+ *                 complete and no data buffered
+ * \param directions #MBEDTLS_SSL_KTLS_TX, #MBEDTLS_SSL_KTLS_RX, or both.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the platform, the
+ *                 kernel or the negotiated ciphersuite does not support
+ *                 offloading. Only AES-GCM and ChaCha20-Poly1305 are
+ *                 supported, with TLS 1.2 or TLS 1.3.
+ * \return         Another error code from mbedtls_ssl_ktls_export().
+ *
+ * \note           The connection can go on without offload if this function
+ *                 fails because of mbedtls_ssl_ktls_export(). If it fails
+ *                 once the socket has been configured, close the connection.
+ *
+ * \note           See mbedtls_ssl_ktls_start() for the limitations of
+ *                 offloaded connections.
+ */
+int mbedtls_net_ktls_enable(mbedtls_net_context *ctx,
+                            mbedtls_ssl_context *ssl, int directions);
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_TLS_C)
+/**
+ * \brief          Try to write a range of a file as application data.
+ *
+ *                 The file is read with pread() straight into the outgoing
+ *                 records, which are protected in place, see
+ *                 mbedtls_ssl_write_from(). If the sending direction is
+ *                 offloaded with mbedtls_net_ktls_enable(), the kernel
+ *                 sends the file with sendfile() instead, without copying
+ *                 it to user space at all.
+ *
+ * \param ctx      Socket of the connection, as given to mbedtls_ssl_set_bio()
+ * \param ssl      SSL context of the connection
+ * \param fd       File descriptor of the file, open for reading. Its file
+ *                 offset is not used nor changed.
+ * \param offset   Offset of the first byte to send in the file
+ * \param len      Number of bytes to send
+ *
+ * \return         The (non-negative) number of bytes actually written if
+ *                 successful. It may be less than \p len, in particular at
+ *                 the end of the file: call this function again with the
+ *                 offset and length advanced by that number.
+ * \return         #MBEDTLS_ERR_NET_RECV_FAILED if reading the file fails.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE on platforms without
+ *                 pread().
+ * \return         Any of the error codes of mbedtls_ssl_write(), with the
+ *                 same meaning and the same requirements on the caller: on
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE, call again with the same
+ *                 arguments.
+ */
+int mbedtls_net_write_from_fd(mbedtls_net_context *ctx,
+                              mbedtls_ssl_context *ssl,
+                              int fd, uint64_t offset, size_t len);
+#endif /* MBEDTLS_SSL_TLS_C */
+
+#if defined(MBEDTLS_NET_REACTOR)
+/**
+ * \brief          Initialize a reactor
+ *                 Just makes the context ready to be set up or freed safely.
+ *
+ * \param reactor  Reactor to initialize
+ */
+void mbedtls_net_reactor_init(mbedtls_net_reactor *reactor);
+
+/**
+ * \brief          Create the kernel event queue of a reactor
+ *                 (epoll on Linux, kqueue on BSD and OS X).
+ *
+ *                 A reactor reports when registered sockets become ready,
+ *                 with edge-triggered semantics: a socket is reported once
+ *                 each time it becomes readable or writable, not for as long
+ *                 as it stays so. The intended use is to drive an SSL
+ *                 context with non-blocking sockets: when
+ *                 mbedtls_ssl_handshake(), mbedtls_ssl_read() or
+ *                 mbedtls_ssl_write() return #MBEDTLS_ERR_SSL_WANT_READ or
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE, simply return to the event
+ *                 loop, and call them again from the readiness callback.
+ *
+ * \param reactor  Reactor to set up
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_SOCKET_FAILED if the queue cannot be
+ *                 created, or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA if it was already set up.
+ */
+int mbedtls_net_reactor_setup(mbedtls_net_reactor *reactor);
+
+/**
+ * \brief          Register a socket with a reactor
+ *
+ *                 The socket should be non-blocking. It is watched for both
+ *                 reading and writing until it is removed.
+ *
+ * \note           Because notifications are edge-triggered, after a
+ *                 callback the application must keep reading (or writing)
+ *                 until the operation returns #MBEDTLS_ERR_SSL_WANT_READ or
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE, or it may not be notified
+ *                 again. Data already buffered by the SSL layer, see
+ *                 mbedtls_ssl_check_pending(), does not trigger a callback.
+ *
+ * \param reactor  Reactor, set up with mbedtls_net_reactor_setup()
+ * \param item     Registration to fill. It must stay valid until the socket
+ *                 is removed and mbedtls_net_reactor_dispatch() returns.
+ * \param ctx      Socket to watch
+ * \param f_ready  Callback invoked when the socket becomes ready
+ * \param p_ready  Context for the callback
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT,
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA or
+ *                 MBEDTLS_ERR_NET_POLL_FAILED.
+ */
+int mbedtls_net_reactor_add(mbedtls_net_reactor *reactor,
+                            mbedtls_net_reactor_item *item,
+                            mbedtls_net_context *ctx,
+                            mbedtls_net_reactor_cb_t *f_ready,
+                            void *p_ready);
+
+/**
+ * \brief          Unregister a socket from a reactor
+ *
+ * \note           This must be called before the socket is closed. It may be
+ *                 called from a callback, including for another item of the
+ *                 same dispatch, whose callback is then skipped.
+ *
+ * \param reactor  Reactor the socket was added to
+ * \param item     Registration filled by mbedtls_net_reactor_add()
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT,
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA or
+ *                 MBEDTLS_ERR_NET_POLL_FAILED.
+ */
+int mbedtls_net_reactor_remove(mbedtls_net_reactor *reactor,
+                               mbedtls_net_reactor_item *item);
+
+/**
+ * \brief          Wait for registered sockets to become ready and invoke
+ *                 their callbacks
+ *
+ *                 At most #MBEDTLS_NET_REACTOR_MAX_EVENTS notifications are
+ *                 handled per call.
+ *
+ * \param reactor  Reactor to wait on
+ * \param timeout  Maximal amount of time to wait, in milliseconds. If
+ *                 \c timeout is zero, the function returns immediately. If
+ *                 \c timeout is -1u, the function blocks potentially
+ *                 indefinitely.
+ *
+ * \return         The number of notifications handled, which is 0 on
+ *                 timeout or if interrupted by a signal, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_POLL_FAILED.
+ */
+int mbedtls_net_reactor_dispatch(mbedtls_net_reactor *reactor,
+                                 uint32_t timeout);
+
+/**
+ * \brief          Close the event queue of a reactor
+ *
+ * \note           Registered sockets are not closed.
+ *
+ * \param reactor  Reactor to free
+ */
+void mbedtls_net_reactor_free(mbedtls_net_reactor *reactor);
+#endif /* MBEDTLS_NET_REACTOR */
+
+#if defined(MBEDTLS_NET_IO_URING)
+/**
+ * \brief          Initialize an io_uring context
+ *                 Just makes the context ready to be set up or freed safely.
+ *
+ * \param ring     Context to initialize
+ */
+void mbedtls_net_uring_init(mbedtls_net_uring *ring);
+
+/**
+ * \brief          Create an io_uring
+ *
+ *                 Sends and receives of all connections attached to the
+ *                 ring are queued by mbedtls_net_uring_send() and
+ *                 mbedtls_net_uring_recv(), and submitted together, with
+ *                 the completions of earlier ones, by a single system call
+ *                 in mbedtls_net_uring_run().
+ *
+ * \param ring     Context to set up
+ * \param entries  Number of submission queue entries. Each connection
+ *                 uses at most two at a time.
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_SOCKET_FAILED if the kernel does not
+ *                 support io_uring or the ring cannot be created, or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA if it was already set up.
+ */
+int mbedtls_net_uring_setup(mbedtls_net_uring *ring, unsigned entries);
+
+/**
+ * \brief          Register a memory region for fixed buffer I/O
+ *
+ *                 Operations on buffers that lie entirely within the region
+ *                 use the kernel's pre-mapped copy of it, which saves the
+ *                 kernel from mapping the pages on every operation. To make
+ *                 the SSL input and output buffers fixed buffers, carve
+ *                 them from the region with a buffer allocator, see
+ *                 mbedtls_ssl_conf_buffer_alloc().
+ *
+ * \note           Only one region can be registered per ring.
+ *
+ * \param ring     Context set up with mbedtls_net_uring_setup()
+ * \param region   Start of the region. It must stay valid until the ring
+ *                 is freed.
+ * \param len      Length of the region in bytes, at most 1 GiB.
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA if a region is already
+ *                 registered, or
+ *                 MBEDTLS_ERR_NET_SOCKET_FAILED if the kernel refuses it.
+ */
+int mbedtls_net_uring_register_region(mbedtls_net_uring *ring,
+                                      unsigned char *region, size_t len);
+
+/**
+ * \brief          Submit queued operations and handle completions
+ *
+ *                 Completed operations are recorded in their connection,
+ *                 and the completion callback of the connection, if any,
+ *                 is invoked. The next mbedtls_net_uring_recv() or
+ *                 mbedtls_net_uring_send() call on that connection, which
+ *                 is made by retrying the SSL operation that returned
+ *                 #MBEDTLS_ERR_SSL_WANT_READ or #MBEDTLS_ERR_SSL_WANT_WRITE,
+ *                 returns the result.
+ *
+ * \note           Callbacks must not call this function.
+ *
+ * \param ring     Context set up with mbedtls_net_uring_setup()
+ * \param wait_nr  Minimum number of completions to wait for, or 0 to
+ *                 return immediately.
+ *
+ * \return         The number of completions handled, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_POLL_FAILED.
+ */
+int mbedtls_net_uring_run(mbedtls_net_uring *ring, unsigned wait_nr);
+
+/**
+ * \brief          Free an io_uring
+ *
+ * \note           Detach all connections from the ring first.
+ *
+ * \param ring     Context to free
+ */
+void mbedtls_net_uring_free(mbedtls_net_uring *ring);
+
+/**
+ * \brief          Initialize an io_uring connection context
+ *
+ * \param ctx      Context to initialize
+ */
+void mbedtls_net_uring_context_init(mbedtls_net_uring_context *ctx);
+
+/**
+ * \brief          Attach a connected socket to an io_uring
+ *
+ * \param ctx      Context to set up
+ * \param ring     Context set up with mbedtls_net_uring_setup()
+ * \param net      The socket. It must stay open until \p ctx is freed.
+ * \param f_ready  Callback invoked from mbedtls_net_uring_run() when an
+ *                 operation of this connection completes, or NULL.
+ * \param p_ready  Context for the callback
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA.
+ */
+int mbedtls_net_uring_context_setup(mbedtls_net_uring_context *ctx,
+                                    mbedtls_net_uring *ring,
+                                    mbedtls_net_context *net,
+                                    mbedtls_net_uring_cb_t *f_ready,
+                                    void *p_ready);
+
+/**
+ * \brief          Receive callback implementation for mbedtls_ssl_set_bio()
+ *
+ *                 The first call queues a receive directly into \p buf and
+ *                 returns #MBEDTLS_ERR_SSL_WANT_READ. Once the receive has
+ *                 completed in mbedtls_net_uring_run(), the retried call,
+ *                 with the same buffer, returns its result.
+ *
+ * \note           \p buf must remain valid until the operation completes.
+ *                 This holds for the SSL input buffer while the SSL context
+ *                 is alive, so detach \p ctx before freeing the SSL context.
+ *                 Likewise, do not call mbedtls_ssl_release_buffers() while
+ *                 a receive is pending.
+ *
+ * \param ctx      An mbedtls_net_uring_context
+ * \param buf      The buffer to write to
+ * \param len      Maximum length of the buffer
+ *
+ * \return         The number of bytes received, 0 on end of stream,
+ *                 #MBEDTLS_ERR_SSL_WANT_READ while the receive is pending,
+ *                 or an MBEDTLS_ERR_NET_xxx error code.
+ */
+int mbedtls_net_uring_recv(void *ctx, unsigned char *buf, size_t len);
+
+/**
+ * \brief          Send callback implementation for mbedtls_ssl_set_bio()
+ *
+ *                 Works like mbedtls_net_uring_recv(), returning
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE until the send completes.
+ *
+ * \param ctx      An mbedtls_net_uring_context
+ * \param buf      The buffer to read from
+ * \param len      The length of the buffer
+ *
+ * \return         The number of bytes sent,
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE while the send is pending,
+ *                 or an MBEDTLS_ERR_NET_xxx error code.
+ */
+int mbedtls_net_uring_send(void *ctx, const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Detach a connection from its io_uring
+ *
+ *                 Pending operations are cancelled and waited for, so their
+ *                 buffers can be freed afterwards. Their completion is not
+ *                 reported through the callback.
+ *
+ * \param ctx      Context to detach
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_POLL_FAILED if waiting for the pending
+ *                 operations failed. The buffers must then not be freed.
+ */
+int mbedtls_net_uring_context_detach(mbedtls_net_uring_context *ctx);
+#endif /* MBEDTLS_NET_IO_URING */
+
+#if defined(MBEDTLS_NET_DGRAM_DEMUX)
+/**
+ * \brief          Initialize a datagram demultiplexer
+ *                 Just makes the context ready to be set up or freed safely.
+ *
+ * \param demux    Context to initialize
+ */
+void mbedtls_net_dgram_init(mbedtls_net_dgram_demux *demux);
+
+/**
+ * \brief          Set up a datagram demultiplexer on a bound UDP socket
+ *
+ *                 This replaces the mbedtls_net_accept() model, where each
+ *                 client gets its own connected socket, with a single socket
+ *                 for all clients. Use mbedtls_net_bind() with
+ *                 #MBEDTLS_NET_PROTO_UDP to create the socket.
+ *
+ * \param demux        Context to set up
+ * \param net          The socket. It must stay open until \p demux is freed.
+ * \param max_len      Size of the largest datagram, at least the MTU of the
+ *                     SSL contexts (see mbedtls_ssl_set_mtu()). Longer
+ *                     datagrams are dropped.
+ * \param num_buckets  Size of the peer hash tables. This is rounded up to a
+ *                     power of two, and should be about the expected number
+ *                     of peers.
+ * \param cid_len      Length of the connection IDs the server assigns with
+ *                     mbedtls_ssl_set_cid(), or 0 to route by source address
+ *                     only. Records carrying a connection ID of this length
+ *                     are routed by it, so a peer whose address changes (for
+ *                     example behind a NAT) keeps reaching its SSL context.
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA if the parameters are out
+ *                 of range or it was already set up, or
+ *                 MBEDTLS_ERR_NET_SOCKET_FAILED on allocation failure.
+ */
+int mbedtls_net_dgram_setup(mbedtls_net_dgram_demux *demux,
+                            mbedtls_net_context *net,
+                            size_t max_len, size_t num_buckets,
+                            size_t cid_len);
+
+/**
+ * \brief          Bind several UDP sockets to the same address and port
+ *
+ *                 Each socket, or shard, can then be served by its own
+ *                 datagram demultiplexer, typically one per thread. The
+ *                 kernel spreads peers over the shards by hashing their
+ *                 address (SO_REUSEPORT), so datagrams from one address
+ *                 always reach the same shard.
+ *
+ *                 This is mbedtls_net_bind_shards() for UDP, with the option
+ *                 below.
+ *
+ * \note           A peer whose address changes would be hashed to another
+ *                 shard, which does not know its connection ID. With
+ *                 \p steer_cid, records with a connection ID go to shard
+ *                 number <tt>cid[0] % count</tt> instead, so a server that
+ *                 picks the first byte of the connection IDs a shard
+ *                 assigns accordingly keeps these peers on their shard.
+ *                 This is only supported on Linux.
+ *
+ * \param shards   Array of \p count contexts to bind
+ * \param count    Number of shards, at most 256 with \p steer_cid
+ * \param bind_ip  IP to bind to, can be NULL
+ * \param port     Port number to use. If this is "0", the system picks a
+ *                 port, which all shards share.
+ * \param steer_cid Nonzero to route records with a connection ID by it
+ *
+ * \return         0 if successful, or one of:
+ *                      MBEDTLS_ERR_NET_SOCKET_FAILED, also if the platform
+ *                      does not support sharing a port or \p steer_cid,
+ *                      MBEDTLS_ERR_NET_UNKNOWN_HOST,
+ *                      MBEDTLS_ERR_NET_BIND_FAILED,
+ *                      MBEDTLS_ERR_NET_BAD_INPUT_DATA.
+ *                 On error, no socket is left open.
+ */
+int mbedtls_net_dgram_bind_shards(mbedtls_net_context *shards, size_t count,
+                                  const char *bind_ip, const char *port,
+                                  int steer_cid);
+
+/**
+ * \brief          Set the callback for datagrams from unknown peers
+ *
+ *                 Without a callback, such datagrams are dropped. A server
+ *                 typically checks the ClientHello cookie with
+ *                 mbedtls_ssl_check_client_hello_cookie(), answers with
+ *                 mbedtls_net_dgram_sendto() if it is not valid, and only
+ *                 sets up an SSL context and adds a peer once it is.
+ *
+ * \param demux    Context set up with mbedtls_net_dgram_setup()
+ * \param f_accept Callback, or NULL
+ * \param p_accept Context for the callback
+ */
+void mbedtls_net_dgram_set_accept_cb(mbedtls_net_dgram_demux *demux,
+                                     mbedtls_net_dgram_accept_cb_t *f_accept,
+                                     void *p_accept);
+
+/**
+ * \brief          Receive a batch of datagrams and route them
+ *
+ *                 Each datagram is queued on its peer, then the callback of
+ *                 every peer that got datagrams is invoked once. Datagrams
+ *                 that are not read before the next call to this function
+ *                 are dropped, as if lost in the network.
+ *
+ * \note           A callback may remove its own peer, but no other peer.
+ *
+ * \param demux    Context set up with mbedtls_net_dgram_setup()
+ *
+ * \return         The number of datagrams received, or
+ *                 #MBEDTLS_ERR_SSL_WANT_READ if none is available on a
+ *                 non-blocking socket or if interrupted by a signal, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_RECV_FAILED.
+ */
+int mbedtls_net_dgram_receive(mbedtls_net_dgram_demux *demux);
+
+/**
+ * \brief          Send the queued datagrams
+ *
+ *                 Consecutive datagrams to the same peer, such as a
+ *                 handshake flight, are handed to the kernel as a single
+ *                 segmentation offload (UDP GSO) message where supported.
+ *
+ * \param demux    Context set up with mbedtls_net_dgram_setup()
+ *
+ * \return         0 if the queue is empty, or
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE if the socket is not ready to
+ *                 send the rest, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_SEND_FAILED if some datagrams were
+ *                 rejected. These are dropped.
+ */
+int mbedtls_net_dgram_flush(mbedtls_net_dgram_demux *demux);
+
+/**
+ * \brief          Queue a datagram to any address
+ *
+ *                 This is meant for stateless replies, such as a
+ *                 HelloVerifyRequest, from the accept callback.
+ *
+ * \param demux    Context set up with mbedtls_net_dgram_setup()
+ * \param addr     Destination address, as passed to the accept callback
+ * \param addr_len Length of \p addr
+ * \param buf      The datagram
+ * \param len      Length of \p buf, at most the \c max_len of the context
+ *
+ * \return         \p len if queued, or
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE if the queue is full and
+ *                 cannot be flushed, or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA or an error code of
+ *                 mbedtls_net_dgram_flush().
+ */
+int mbedtls_net_dgram_sendto(mbedtls_net_dgram_demux *demux,
+                             const unsigned char *addr, size_t addr_len,
+                             const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Free a datagram demultiplexer
+ *
+ * \note           Remove all peers first. Queued datagrams are dropped and
+ *                 the socket is not closed.
+ *
+ * \param demux    Context to free
+ */
+void mbedtls_net_dgram_free(mbedtls_net_dgram_demux *demux);
+
+/**
+ * \brief          Initialize a datagram peer
+ *
+ * \param peer     Peer to initialize
+ */
+void mbedtls_net_dgram_peer_init(mbedtls_net_dgram_peer *peer);
+
+/**
+ * \brief          Add a peer to a datagram demultiplexer
+ *
+ * \param demux    Context set up with mbedtls_net_dgram_setup()
+ * \param peer     Peer initialized with mbedtls_net_dgram_peer_init()
+ * \param addr     Address of the peer, as passed to the accept callback
+ * \param addr_len Length of \p addr
+ * \param f_ready  Callback invoked from mbedtls_net_dgram_receive() when
+ *                 datagrams arrive for this peer, or NULL.
+ * \param p_ready  Context for the callback
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA if the address is invalid
+ *                 or already used by another peer.
+ */
+int mbedtls_net_dgram_peer_add(mbedtls_net_dgram_demux *demux,
+                               mbedtls_net_dgram_peer *peer,
+                               const unsigned char *addr, size_t addr_len,
+                               mbedtls_net_dgram_cb_t *f_ready,
+                               void *p_ready);
+
+/**
+ * \brief          Route records with a connection ID to a peer
+ *
+ * \note           The source address of such records is not checked and
+ *                 the peer address is not updated, as the record has not
+ *                 yet been authenticated when it is routed. Update it with
+ *                 mbedtls_net_dgram_peer_add() after a successful read, if
+ *                 desired.
+ *
+ * \param peer     Peer added with mbedtls_net_dgram_peer_add()
+ * \param cid      The connection ID set with mbedtls_ssl_set_cid() on the
+ *                 SSL context of the peer
+ * \param cid_len  Length of \p cid, which must be the \c cid_len of the
+ *                 demultiplexer
+ *
+ * \return         0 if successful, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT or
+ *                 MBEDTLS_ERR_NET_BAD_INPUT_DATA.
+ */
+int mbedtls_net_dgram_peer_set_cid(mbedtls_net_dgram_peer *peer,
+                                   const unsigned char *cid, size_t cid_len);
+
+/**
+ * \brief          Remove a peer from its datagram demultiplexer
+ *
+ *                 Its queued input is dropped. Its queued output is still
+ *                 sent by the next mbedtls_net_dgram_flush().
+ *
+ * \param peer     Peer to remove
+ */
+void mbedtls_net_dgram_peer_remove(mbedtls_net_dgram_peer *peer);
+
+/**
+ * \brief          Receive callback implementation for mbedtls_ssl_set_bio()
+ *
+ *                 Returns the next datagram routed to the peer by the last
+ *                 mbedtls_net_dgram_receive().
+ *
+ * \param ctx      An mbedtls_net_dgram_peer
+ * \param buf      The buffer to write to
+ * \param len      Maximum length of the buffer
+ *
+ * \return         The number of bytes received, which is truncated to \p len,
+ *                 #MBEDTLS_ERR_SSL_WANT_READ if no datagram is queued, or
+ *                 MBEDTLS_ERR_NET_INVALID_CONTEXT.
+ */
+int mbedtls_net_dgram_peer_recv(void *ctx, unsigned char *buf, size_t len);
+
+/**
+ * \brief          Send callback implementation for mbedtls_ssl_set_bio()
+ *
+ *                 Queues the datagram for the next mbedtls_net_dgram_flush(),
+ *                 so a whole flight goes out in one system call.
+ *
+ * \param ctx      An mbedtls_net_dgram_peer
+ * \param buf      The buffer to read from
+ * \param len      The length of the buffer
+ *
+ * \return         \p len if queued, or an error code of
+ *                 mbedtls_net_dgram_sendto().
+ */
+int mbedtls_net_dgram_peer_send(void *ctx, const unsigned char *buf, size_t len);
+#endif /* MBEDTLS_NET_DGRAM_DEMUX */
+
 /**
  * \brief          Closes down the connection and free associated data
  *
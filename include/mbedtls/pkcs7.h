@@ -41,6 +41,7 @@
 #include "mbedtls/build_info.h"
 
 #include "mbedtls/asn1.h"
+#include "mbedtls/md.h"
 #include "mbedtls/x509_crt.h"
 
 /**
@@ -141,6 +142,18 @@ typedef struct mbedtls_pkcs7 {
 }
 mbedtls_pkcs7;
 
+/**
+ * Context for the verification of a PKCS #7 signature over data
+ * hashed in several chunks.
+ */
+typedef struct mbedtls_pkcs7_verify_ctx {
+    mbedtls_pkcs7 *MBEDTLS_PRIVATE(pkcs7);
+    mbedtls_md_context_t MBEDTLS_PRIVATE(md_ctx);
+    unsigned char MBEDTLS_PRIVATE(hash)[MBEDTLS_MD_MAX_SIZE];
+    size_t MBEDTLS_PRIVATE(hash_len);       /*!< 0 until the hash is final */
+}
+mbedtls_pkcs7_verify_ctx;
+
 /**
  * \brief          Initialize mbedtls_pkcs7 structure.
  *
@@ -225,6 +238,137 @@ int mbedtls_pkcs7_signed_hash_verify(mbedtls_pkcs7 *pkcs7,
                                      const mbedtls_x509_crt *cert,
                                      const unsigned char *hash, size_t hashlen);
 
+/**
+ * \brief          Verification of each signer of a PKCS #7 signature
+ *                 against its own certificate.
+ *
+ *                 Unlike mbedtls_pkcs7_signed_data_verify(), which succeeds
+ *                 if the signature of any signer verifies with a single
+ *                 certificate, this function looks up the certificate of each
+ *                 signer in \p certs by issuer and serial number, and reports
+ *                 the result of each signer. The data is hashed only once.
+ *
+ *                 This function does not use the certificates held within the
+ *                 PKCS #7 structure itself, and does not check that the
+ *                 certificates are signed by a trusted certification authority.
+ *
+ * \param pkcs7    PKCS #7 structure containing signature.
+ * \param certs    Chain of the certificates of the signers, in any order.
+ * \param data     Plain data on which signature has to be verified.
+ * \param datalen  Length of the data.
+ * \param status   Array receiving the result of each signer, in the order
+ *                 of the PKCS #7 structure: \c 0 if its signature verifies,
+ *                 #MBEDTLS_ERR_PKCS7_INVALID_CERT if \p certs has no
+ *                 certificate for it, #MBEDTLS_ERR_PKCS7_CERT_DATE_INVALID
+ *                 if its certificate is not valid now, or the error of the
+ *                 signature verification.
+ * \param status_len  Number of entries of \p status, at least the number of
+ *                 signers.
+ *
+ * \return         0 if the signatures of all signers verify.
+ * \return         #MBEDTLS_ERR_PKCS7_VERIFY_FAIL if any of them doesn't, as
+ *                 reported in \p status.
+ * \return         Another negative error code if \p status is not filled in.
+ */
+int mbedtls_pkcs7_signers_verify(mbedtls_pkcs7 *pkcs7,
+                                 const mbedtls_x509_crt *certs,
+                                 const unsigned char *data,
+                                 size_t datalen,
+                                 int *status,
+                                 size_t status_len);
+
+/**
+ * \brief          Initialize a streaming verification context.
+ *
+ * \param ctx      The context to initialize.
+ */
+void mbedtls_pkcs7_verify_init(mbedtls_pkcs7_verify_ctx *ctx);
+
+/**
+ * \brief          Start the verification of a PKCS #7 signature over data
+ *                 which is passed in chunks, with the digest algorithm of
+ *                 the signed data.
+ *
+ *                 This is the streaming equivalent of
+ *                 mbedtls_pkcs7_signed_data_verify(), for data too large to
+ *                 be held in memory at once, such as a firmware image read
+ *                 from flash or from the network.
+ *
+ * \param ctx      The context, initialized with mbedtls_pkcs7_verify_init().
+ * \param pkcs7    PKCS #7 structure containing signature. It must remain
+ *                 valid until mbedtls_pkcs7_verify_free() is called.
+ *
+ * \return         0 on success, or a negative error code on failure.
+ */
+int mbedtls_pkcs7_verify_starts(mbedtls_pkcs7_verify_ctx *ctx,
+                                mbedtls_pkcs7 *pkcs7);
+
+/**
+ * \brief          Hash a chunk of the signed data.
+ *
+ * \param ctx      The context, started with mbedtls_pkcs7_verify_starts().
+ * \param data     The next chunk of the plain data.
+ * \param datalen  Length of \p data.
+ *
+ * \return         0 on success.
+ * \return         #MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA if the context is not
+ *                 started or mbedtls_pkcs7_verify_finish() was called.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_pkcs7_verify_update(mbedtls_pkcs7_verify_ctx *ctx,
+                                const unsigned char *data,
+                                size_t datalen);
+
+/**
+ * \brief          Verify the PKCS #7 signature over all the data passed to
+ *                 mbedtls_pkcs7_verify_update(), against a caller-supplied
+ *                 certificate.
+ *
+ *                 As with mbedtls_pkcs7_signed_data_verify(), verification
+ *                 succeeds if the signature of any signer verifies.
+ *
+ * \param ctx      The context, started with mbedtls_pkcs7_verify_starts().
+ * \param cert     Certificate containing key to verify signature.
+ *
+ * \note           The first call makes the hash final. This function can
+ *                 be called again with other certificates, but no more data
+ *                 can be passed to mbedtls_pkcs7_verify_update().
+ *
+ * \return         0 if the signature verifies, or a negative error code on failure.
+ */
+int mbedtls_pkcs7_verify_finish(mbedtls_pkcs7_verify_ctx *ctx,
+                                const mbedtls_x509_crt *cert);
+
+/**
+ * \brief          Verify each signer of the PKCS #7 signature over all the
+ *                 data passed to mbedtls_pkcs7_verify_update(), against its
+ *                 own certificate.
+ *
+ *                 This is the streaming equivalent of
+ *                 mbedtls_pkcs7_signers_verify(), see there for \p certs,
+ *                 \p status, \p status_len and the return values.
+ *
+ * \param ctx      The context, started with mbedtls_pkcs7_verify_starts().
+ * \param certs    Chain of the certificates of the signers.
+ * \param status   Array receiving the result of each signer.
+ * \param status_len  Number of entries of \p status.
+ *
+ * \return         0 if the signatures of all signers verify, or a negative
+ *                 error code on failure.
+ */
+int mbedtls_pkcs7_verify_finish_signers(mbedtls_pkcs7_verify_ctx *ctx,
+                                        const mbedtls_x509_crt *certs,
+                                        int *status,
+                                        size_t status_len);
+
+/**
+ * \brief          Free a streaming verification context.
+ *
+ * \param ctx      The context to free. It doesn't free the PKCS #7
+ *                 structure it was started with.
+ */
+void mbedtls_pkcs7_verify_free(mbedtls_pkcs7_verify_ctx *ctx);
+
 /**
  * \brief          Unallocate all PKCS #7 data and zeroize the memory.
  *                 It doesn't free \p pkcs7 itself. This should be done by the caller.
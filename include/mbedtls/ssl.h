@@ -38,6 +38,10 @@
 #include "mbedtls/platform_time.h"
 #endif
 
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+#include "mbedtls/threading.h"
+#endif
+
 #include "psa/crypto.h"
 
 /*
@@ -155,7 +159,8 @@
 #define MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS                 -0x6500
 /** Internal-only message signaling that a message arrived early. */
 #define MBEDTLS_ERR_SSL_EARLY_MESSAGE                     -0x6480
-/* Error space gap */
+/** The handshake was refused by the admission callback. */
+#define MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED                -0x6400
 /* Error space gap */
 /* Error space gap */
 /* Error space gap */
@@ -333,12 +338,43 @@
 #define MBEDTLS_SSL_EARLY_DATA_DISABLED        0
 #define MBEDTLS_SSL_EARLY_DATA_ENABLED         1
 
+#define MBEDTLS_SSL_TLS1_3_KEY_UPDATE_NOT_REQUESTED    0
+#define MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED        1
+
 #define MBEDTLS_SSL_DTLS_SRTP_MKI_UNSUPPORTED    0
 #define MBEDTLS_SSL_DTLS_SRTP_MKI_SUPPORTED      1
 
 #define MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_CLIENT  1
 #define MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_SERVER  0
 
+#define MBEDTLS_SSL_FLIGHT_COALESCING_DISABLED    0
+#define MBEDTLS_SSL_FLIGHT_COALESCING_ENABLED     1
+
+#define MBEDTLS_SSL_HANDSHAKE_REUSE_DISABLED      0
+#define MBEDTLS_SSL_HANDSHAKE_REUSE_ENABLED       1
+
+#define MBEDTLS_SSL_LAZY_SETUP_DISABLED           0
+#define MBEDTLS_SSL_LAZY_SETUP_ENABLED            1
+
+/*
+ * What a lazily set up server context reads of its first record: the record
+ * counter kept in front of the header, the record and handshake headers, and
+ * the version of the ClientHello.
+ */
+#define MBEDTLS_SSL_LAZY_SETUP_BUF_LEN            (8 + 5 + 4 + 2)
+
+#define MBEDTLS_SSL_DTLS_FLIGHT_CACHE_DISABLED    0
+#define MBEDTLS_SSL_DTLS_FLIGHT_CACHE_ENABLED     1
+
+#define MBEDTLS_SSL_DTLS_PMTU_PROBING_DISABLED    0
+#define MBEDTLS_SSL_DTLS_PMTU_PROBING_ENABLED     1
+
+#define MBEDTLS_SSL_WRITE_QUEUE_DISABLED          0
+#define MBEDTLS_SSL_WRITE_QUEUE_ENABLED           1
+
+#define MBEDTLS_SSL_FALSE_START_DISABLED          0
+#define MBEDTLS_SSL_FALSE_START_ENABLED           1
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
 #if defined(PSA_WANT_ALG_SHA_384)
 #define MBEDTLS_SSL_TLS1_3_TICKET_RESUMPTION_KEY_LEN        48
@@ -408,6 +444,78 @@
 #define MBEDTLS_SSL_DTLS_MAX_BUFFERING 32768
 #endif
 
+/*
+ * Width in bits of the DTLS replay window, see mbedtls_config.h.
+ */
+#if !defined(MBEDTLS_SSL_DTLS_REPLAY_WINDOW)
+#define MBEDTLS_SSL_DTLS_REPLAY_WINDOW 64
+#endif
+
+/*
+ * Handshake data buffered for each QUIC encryption level, see
+ * mbedtls_config.h.
+ */
+#if !defined(MBEDTLS_SSL_QUIC_MAX_BUFFERING)
+#define MBEDTLS_SSL_QUIC_MAX_BUFFERING 65536
+#endif
+
+/*
+ * Size of the arena of each handshake context, see mbedtls_config.h.
+ */
+#if !defined(MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE)
+#define MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE 1024
+#endif
+
+/*
+ * Heap allowed for a handshake besides the buffers, the peer chain and the
+ * DTLS buffering, see mbedtls_config.h.
+ */
+#if !defined(MBEDTLS_SSL_HANDSHAKE_MEMORY)
+#define MBEDTLS_SSL_HANDSHAKE_MEMORY 32768
+#endif
+
+/*
+ * Longest peer certificate with MBEDTLS_SSL_STATIC_MEMORY, see
+ * mbedtls_config.h.
+ */
+#if !defined(MBEDTLS_SSL_MAX_PEER_CERT_LEN)
+#define MBEDTLS_SSL_MAX_PEER_CERT_LEN 4096
+#endif
+
+/*
+ * Heap used at most by each connection with MBEDTLS_SSL_STATIC_MEMORY, see
+ * mbedtls_config.h. These are constant expressions, not preprocessor
+ * numbers: use them to size a static heap, not in #if.
+ *
+ * Each I/O buffer is its content length plus at most
+ * MBEDTLS_SSL_RECORD_OVERHEAD_MAX bytes of record header, IV, MAC, padding
+ * and connection ID. Each peer certificate takes its structure, the copy of
+ * its DER and the names and lists parsed from it, which are allowed twice
+ * the DER again. DTLS buffers up to MBEDTLS_SSL_DTLS_MAX_BUFFERING bytes of
+ * incoming messages, and as much of the outgoing flight.
+ */
+#define MBEDTLS_SSL_RECORD_OVERHEAD_MAX 1024
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+#define MBEDTLS_SSL_PEER_CHAIN_MEMORY                                     \
+    ((MBEDTLS_X509_MAX_INTERMEDIATE_CA + 1) *                           \
+     (sizeof(mbedtls_x509_crt) + 3 * MBEDTLS_SSL_MAX_PEER_CERT_LEN))
+#else
+#define MBEDTLS_SSL_PEER_CHAIN_MEMORY 0
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+#define MBEDTLS_SSL_DTLS_MEMORY (2 * MBEDTLS_SSL_DTLS_MAX_BUFFERING)
+#else
+#define MBEDTLS_SSL_DTLS_MEMORY 0
+#endif
+
+#define MBEDTLS_SSL_CONNECTION_MEMORY                                     \
+    (MBEDTLS_SSL_IN_CONTENT_LEN + MBEDTLS_SSL_OUT_CONTENT_LEN +        \
+     2 * MBEDTLS_SSL_RECORD_OVERHEAD_MAX +                             \
+     MBEDTLS_SSL_PEER_CHAIN_MEMORY + MBEDTLS_SSL_DTLS_MEMORY +          \
+     MBEDTLS_SSL_HANDSHAKE_MEMORY)
+
 /*
  * Maximum length of CIDs for incoming and outgoing messages.
  */
@@ -439,6 +547,10 @@
 #define MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS 1
 #endif
 
+#if !defined(MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS)
+#define MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS 8388608
+#endif
+
 /** \} name SECTION: Module settings */
 
 /*
@@ -510,6 +622,31 @@
 
 #define MBEDTLS_TLS1_3_SIG_NONE 0x0
 
+/*
+ * TLS 1.3 certificate compression algorithms, RFC 8879 section 7.3
+ */
+#define MBEDTLS_SSL_CERT_COMPRESSION_NONE        0
+#define MBEDTLS_SSL_CERT_COMPRESSION_ZLIB        1
+#define MBEDTLS_SSL_CERT_COMPRESSION_BROTLI      2
+#define MBEDTLS_SSL_CERT_COMPRESSION_ZSTD        3
+
+/*
+ * Certificate types, RFC 7250 section 3
+ */
+#define MBEDTLS_TLS_CERT_TYPE_X509               0
+#define MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY     2
+
+/*
+ * Cached information, RFC 7924 section 3
+ */
+#define MBEDTLS_SSL_CACHED_INFO_TYPE_CERT        1
+#define MBEDTLS_SSL_CACHED_INFO_HASH_LEN        32 /* SHA-256 */
+
+/*
+ * CertificateStatusType, RFC 6066 section 8
+ */
+#define MBEDTLS_SSL_CERT_STATUS_TYPE_OCSP        1
+
 /*
  * Client Certificate Types
  * RFC 5246 section 7.4.4 plus RFC 4492 section 5.5
@@ -575,6 +712,8 @@
 #define MBEDTLS_SSL_HS_CERTIFICATE_VERIFY      15
 #define MBEDTLS_SSL_HS_CLIENT_KEY_EXCHANGE     16
 #define MBEDTLS_SSL_HS_FINISHED                20
+#define MBEDTLS_SSL_HS_KEY_UPDATE              24
+#define MBEDTLS_SSL_HS_COMPRESSED_CERTIFICATE  25 /* RFC 8879 */
 #define MBEDTLS_SSL_HS_MESSAGE_HASH           254
 
 /*
@@ -604,6 +743,9 @@
 #define MBEDTLS_TLS_EXT_ENCRYPT_THEN_MAC            22 /* 0x16 */
 #define MBEDTLS_TLS_EXT_EXTENDED_MASTER_SECRET  0x0017 /* 23 */
 
+#define MBEDTLS_TLS_EXT_CACHED_INFO                 25 /* RFC 7924 TLS 1.2 and 1.3 */
+
+#define MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE        27 /* RFC 8879 TLS 1.3 */
 #define MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT           28 /* RFC 8449 (implemented for TLS 1.3 only) */
 
 #define MBEDTLS_TLS_EXT_SESSION_TICKET              35
@@ -620,6 +762,8 @@
 #define MBEDTLS_TLS_EXT_SIG_ALG_CERT                50 /* RFC 8446 TLS 1.3 */
 #define MBEDTLS_TLS_EXT_KEY_SHARE                   51 /* RFC 8446 TLS 1.3 */
 
+#define MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS   57 /* RFC 9001 TLS 1.3 */
+
 #if MBEDTLS_SSL_DTLS_CONNECTION_ID_COMPAT == 0
 #define MBEDTLS_TLS_EXT_CID                         54 /* RFC 9146 DTLS 1.2 CID */
 #else
@@ -817,6 +961,100 @@ typedef int mbedtls_ssl_recv_timeout_t(void *ctx,
                                        unsigned char *buf,
                                        size_t len,
                                        uint32_t timeout);
+
+#if defined(MBEDTLS_SSL_KTLS)
+/**
+ * \brief          Callback type: send a non-application-data record through
+ *                 a transport that protects records itself (kTLS).
+ *
+ * \param ctx      Context given to mbedtls_ssl_ktls_start() (typically a
+ *                 socket)
+ * \param type     Record content type, e.g. #MBEDTLS_SSL_MSG_ALERT
+ * \param buf      Record content
+ * \param len      Length of the record content
+ *
+ * \return         The callback must return the number of bytes sent if any,
+ *                 or a non-zero error code, as mbedtls_ssl_send_t.
+ */
+typedef int mbedtls_ssl_send_record_t(void *ctx,
+                                      unsigned char type,
+                                      const unsigned char *buf,
+                                      size_t len);
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+/**
+ * \brief          QUIC encryption levels (RFC 9001, section 4)
+ */
+typedef enum {
+    MBEDTLS_SSL_QUIC_LEVEL_INITIAL = 0,     /*!< Initial packets        */
+    MBEDTLS_SSL_QUIC_LEVEL_EARLY_DATA,      /*!< 0-RTT packets          */
+    MBEDTLS_SSL_QUIC_LEVEL_HANDSHAKE,       /*!< Handshake packets      */
+    MBEDTLS_SSL_QUIC_LEVEL_APPLICATION,     /*!< 1-RTT packets          */
+} mbedtls_ssl_quic_level;
+
+#define MBEDTLS_SSL_QUIC_LEVELS     4       /*!< number of levels       */
+
+/**
+ * \brief          Callback type: hand handshake data to the QUIC stack, to
+ *                 be sent in CRYPTO frames.
+ *
+ * \param ctx      Context of the QUIC callbacks
+ * \param level    Encryption level of the packets to send the data in
+ * \param buf      Handshake data: one or more whole handshake messages
+ * \param len      Length of the data
+ *
+ * \return         \c 0 once the data has been taken, or a negative error
+ *                 code, which aborts the handshake.
+ */
+typedef int mbedtls_ssl_quic_send_t(void *ctx,
+                                    mbedtls_ssl_quic_level level,
+                                    const unsigned char *buf,
+                                    size_t len);
+
+/**
+ * \brief          Callback type: install the traffic secrets of an
+ *                 encryption level in the QUIC stack.
+ *
+ *                 The secrets of a level are given before the first
+ *                 handshake message at that level, so the QUIC stack can
+ *                 derive the packet protection keys of RFC 9001, section 5.1
+ *                 with the hash and AEAD of \p ciphersuite.
+ *
+ * \param ctx      Context of the QUIC callbacks
+ * \param level    #MBEDTLS_SSL_QUIC_LEVEL_HANDSHAKE or
+ *                 #MBEDTLS_SSL_QUIC_LEVEL_APPLICATION
+ * \param ciphersuite Negotiated TLS 1.3 ciphersuite
+ * \param read_secret Traffic secret of the peer
+ * \param write_secret Traffic secret of this endpoint
+ * \param secret_len Length of each secret
+ *
+ * \return         \c 0 on success, or a negative error code, which aborts
+ *                 the handshake.
+ */
+typedef int mbedtls_ssl_quic_secrets_t(void *ctx,
+                                       mbedtls_ssl_quic_level level,
+                                       int ciphersuite,
+                                       const unsigned char *read_secret,
+                                       const unsigned char *write_secret,
+                                       size_t secret_len);
+
+/**
+ * \brief          Callback type: report a TLS alert to the QUIC stack,
+ *                 which closes the connection with the corresponding
+ *                 CRYPTO_ERROR code (RFC 9001, section 4.8).
+ *
+ * \param ctx      Context of the QUIC callbacks
+ * \param level    Current encryption level for sending
+ * \param alert    Alert description, e.g.
+ *                 #MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE
+ *
+ * \return         \c 0 on success, or a negative error code.
+ */
+typedef int mbedtls_ssl_quic_alert_t(void *ctx,
+                                     mbedtls_ssl_quic_level level,
+                                     unsigned char alert);
+#endif /* MBEDTLS_SSL_QUIC */
 /**
  * \brief          Callback type: set a pair of timers/delays to watch
  *
@@ -871,6 +1109,9 @@ typedef struct mbedtls_ssl_key_cert mbedtls_ssl_key_cert;
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 typedef struct mbedtls_ssl_flight_item mbedtls_ssl_flight_item;
 #endif
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+typedef struct mbedtls_ssl_pipeline mbedtls_ssl_pipeline;
+#endif
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
 #define MBEDTLS_SSL_TLS1_3_TICKET_ALLOW_PSK_RESUMPTION                          \
@@ -885,6 +1126,130 @@ typedef struct mbedtls_ssl_flight_item mbedtls_ssl_flight_item;
      MBEDTLS_SSL_TLS1_3_TICKET_ALLOW_EARLY_DATA)
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_SESSION_TICKETS */
 
+/**
+ * \brief          Kind of a debug event, see mbedtls_ssl_conf_dbg_event()
+ */
+typedef enum {
+    MBEDTLS_SSL_DEBUG_EVENT_MSG = 0,    /*!< message, \c text is the format */
+    MBEDTLS_SSL_DEBUG_EVENT_RET,        /*!< error code \c ret of the
+                                         *   function named \c text */
+    MBEDTLS_SSL_DEBUG_EVENT_BUF,        /*!< buffer \c buf of \c len bytes,
+                                         *   described by \c text */
+} mbedtls_ssl_debug_event_type_t;
+
+/**
+ * \brief          Debug event, not formatted
+ *
+ *                 The event is only valid during the call to the event
+ *                 callback. mbedtls_debug_format_event() formats it as the
+ *                 first line that the debug callback of
+ *                 mbedtls_ssl_conf_dbg() would get.
+ */
+typedef struct mbedtls_ssl_debug_event {
+    mbedtls_ssl_debug_event_type_t type;    /*!< kind of event */
+    const char *text;                       /*!< format or description */
+    int ret;                                /*!< error code, for RET */
+    const unsigned char *buf;               /*!< data, for BUF */
+    size_t len;                             /*!< length of \c buf, for BUF */
+    void *MBEDTLS_PRIVATE(args);            /*!< arguments of the format */
+} mbedtls_ssl_debug_event;
+
+/**
+ * \brief          Callback type: debug event
+ *
+ * \param p_dbg    Context given to mbedtls_ssl_conf_dbg_event()
+ * \param ssl      SSL context the event is about
+ * \param level    Debug level of the event
+ * \param file     File the event occurred in
+ * \param line     Line number the event occurred at
+ * \param event    The event
+ */
+typedef void mbedtls_ssl_dbg_event_t(void *p_dbg,
+                                     const mbedtls_ssl_context *ssl,
+                                     int level, const char *file, int line,
+                                     const mbedtls_ssl_debug_event *event);
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+/**
+ * \brief          One step of the handshake state machine, as reported to
+ *                 the callback of mbedtls_ssl_conf_handshake_trace()
+ *
+ *                 Times are in the unit of the trace clock. The time spent
+ *                 computing, mostly in cryptographic operations, is
+ *                 <code>end - start - io_time</code>.
+ */
+typedef struct mbedtls_ssl_handshake_trace {
+    int state;              /*!< state of the step, see mbedtls_ssl_states */
+    int next_state;         /*!< state after the step */
+    int ret;                /*!< return value of the step, for example
+                             *   #MBEDTLS_ERR_SSL_WANT_READ when it waits
+                             *   for the peer */
+    uint64_t start;         /*!< clock when the step started */
+    uint64_t end;           /*!< clock when the step ended */
+    uint64_t io_time;       /*!< time spent in the send and receive
+                             *   callbacks during the step */
+    size_t bytes_in;        /*!< bytes received during the step */
+    size_t bytes_out;       /*!< bytes sent during the step */
+} mbedtls_ssl_handshake_trace;
+
+/**
+ * \brief          Callback type: trace of a handshake step
+ *
+ * \param p_trace  Context given to mbedtls_ssl_conf_handshake_trace()
+ * \param ssl      SSL context of the handshake
+ * \param step     The step, only valid during the call
+ */
+typedef void mbedtls_ssl_handshake_trace_t(void *p_trace,
+                                           const mbedtls_ssl_context *ssl,
+                                           const mbedtls_ssl_handshake_trace *step);
+
+/**
+ * \brief          Callback type: trace clock
+ *
+ * \param p_trace  Context given to mbedtls_ssl_conf_handshake_trace()
+ *
+ * \return         The current time, in any unit, from a monotonic clock.
+ */
+typedef uint64_t mbedtls_ssl_trace_clock_t(void *p_trace);
+#endif /* MBEDTLS_SSL_HANDSHAKE_TRACE */
+
+#if defined(MBEDTLS_SSL_STATS)
+/**
+ * \brief          Counters of an SSL context, see mbedtls_ssl_get_stats()
+ *
+ *                 All the counters only ever increase, until the context is
+ *                 reset. Byte counts are of application and handshake
+ *                 content, without the record headers and the expansion of
+ *                 the record protection.
+ */
+typedef struct mbedtls_ssl_stats {
+    uint64_t records_out;       /*!< records sent */
+    uint64_t bytes_out;         /*!< content bytes of the records sent */
+    uint64_t records_in;        /*!< records received and unprotected */
+    uint64_t bytes_in;          /*!< content bytes of the records received */
+    uint64_t auth_failures;     /*!< received records whose authentication
+                                 *   (AEAD tag or MAC) failed */
+    uint64_t want_read;         /*!< calls to the receive callback that
+                                 *   returned #MBEDTLS_ERR_SSL_WANT_READ */
+    uint64_t want_write;        /*!< calls to the send callback that
+                                 *   returned #MBEDTLS_ERR_SSL_WANT_WRITE */
+    uint64_t retransmits;       /*!< DTLS flight retransmissions */
+    uint64_t buffered_dropped;  /*!< DTLS handshake messages or future
+                                 *   records dropped for lack of buffer
+                                 *   space */
+    uint64_t cache_hits;        /*!< sessions resumed from the session cache */
+    uint64_t cache_misses;      /*!< session IDs or TLS 1.3 identities not
+                                 *   found in the session cache */
+    uint64_t ticket_failures;   /*!< session tickets that could not be
+                                 *   decrypted or were rejected */
+    uint64_t handshakes;        /*!< handshakes completed, including
+                                 *   renegotiations */
+    uint64_t handshake_time;    /*!< total duration of the completed
+                                 *   handshakes, in milliseconds, \c 0 without
+                                 *   MBEDTLS_HAVE_TIME */
+} mbedtls_ssl_stats;
+#endif /* MBEDTLS_SSL_STATS */
+
 /**
  * \brief          Callback type: server-side session cache getter
  *
@@ -904,8 +1269,21 @@ typedef struct mbedtls_ssl_flight_item mbedtls_ssl_flight_item;
  *                        mbedtls_ssl_session_free() independent of the
  *                        return code of this function.
  *
+ * \note                  A cache backed by a remote store can return
+ *                        #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS to avoid
+ *                        blocking while the lookup is in flight. The
+ *                        handshake function then returns
+ *                        #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS as well, and
+ *                        calls this callback again with the same session ID
+ *                        when it is resumed, until the callback returns
+ *                        another value. The callback is responsible for
+ *                        matching the repeated call with its pending
+ *                        lookup, for example by session ID.
+ *
  * \return                \c 0 on success
- * \return                A non-zero return value on failure.
+ * \return                #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the lookup
+ *                        has not completed yet.
+ * \return                Another non-zero return value on failure.
  *
  */
 typedef int mbedtls_ssl_cache_get_t(void *data,
@@ -935,6 +1313,71 @@ typedef int mbedtls_ssl_cache_set_t(void *data,
                                     size_t session_id_len,
                                     const mbedtls_ssl_session *session);
 
+/**
+ * \brief          Callback type: get a record buffer
+ *
+ *                 This callback provides the memory for the input and
+ *                 output record buffers of an SSL context, instead of
+ *                 mbedtls_calloc().
+ *
+ * \param p_buf    The context passed to mbedtls_ssl_conf_buffer_alloc().
+ * \param len      The required size of the buffer in bytes.
+ *
+ * \return         A buffer of at least \p len bytes. Its content does
+ *                 not need to be initialized.
+ * \return         \c NULL if no buffer is available.
+ */
+typedef unsigned char *mbedtls_ssl_buffer_get_t(void *p_buf, size_t len);
+
+/**
+ * \brief          Callback type: release a record buffer
+ *
+ *                 This callback gives back a buffer obtained from the
+ *                 matching #mbedtls_ssl_buffer_get_t callback. The library
+ *                 wipes the buffer before releasing it.
+ *
+ * \param p_buf    The context passed to mbedtls_ssl_conf_buffer_alloc().
+ * \param buf      The buffer to release.
+ * \param len      The size that was requested when \p buf was obtained.
+ */
+typedef void mbedtls_ssl_buffer_release_t(void *p_buf, unsigned char *buf,
+                                          size_t len);
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+/**
+ * \brief          Callback type: one unit of work of the record pipeline,
+ *                 protecting or deprotecting a single record.
+ *
+ * \param job_ctx  The context passed to the #mbedtls_ssl_pipeline_t
+ *                 callback.
+ * \param index    The index of the record, below the \c count passed to
+ *                 the #mbedtls_ssl_pipeline_t callback.
+ */
+typedef void mbedtls_ssl_pipeline_job_t(void *job_ctx, size_t index);
+
+/**
+ * \brief          Callback type: run the jobs of a batch of records
+ *
+ *                 This callback must call \p job once for each index from
+ *                 0 to \p count - 1, in any order and on any threads, and
+ *                 return only once all of them have returned. The jobs of
+ *                 a batch are independent of each other.
+ *
+ * \param p_pipeline The context passed to
+ *                 mbedtls_ssl_conf_record_pipeline().
+ * \param job      The job to run for each record.
+ * \param job_ctx  The context to pass to \p job.
+ * \param count    The number of records in the batch, at least 2.
+ *
+ * \return         0 if all jobs have run.
+ * \return         A negative error code if they could not be run. This is
+ *                 fatal to the connection.
+ */
+typedef int mbedtls_ssl_pipeline_t(void *p_pipeline,
+                                   mbedtls_ssl_pipeline_job_t *job,
+                                   void *job_ctx, size_t count);
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /**
@@ -979,6 +1422,16 @@ typedef int mbedtls_ssl_cache_set_t(void *data,
  *                  `Ecdsa-Sig-Value` defined in
  *                  [RFC 4492 section 5.4](https://tools.ietf.org/html/rfc4492#section-5.4).
  *
+ * \note            In TLS 1.3, this callback also signs the CertificateVerify
+ *                  message, on the server and on a client with a certificate.
+ *                  The handshake is then in version #MBEDTLS_SSL_VERSION_TLS1_3
+ *                  (see mbedtls_ssl_get_version_number()), and RSA signatures
+ *                  must instead be RSASSA-PSS as defined in RFC 8017, section
+ *                  8.1, with MGF1 based on \p md_alg and a salt as long as the
+ *                  hash, as required by the \c rsa_pss_rsae_* signature
+ *                  schemes of RFC 8446. \p md_alg is never
+ *                  #MBEDTLS_MD_NONE in TLS 1.3.
+ *
  * \param ssl             The SSL connection instance. It should not be
  *                        modified other than via
  *                        mbedtls_ssl_set_async_operation_data().
@@ -1078,6 +1531,83 @@ typedef int mbedtls_ssl_async_decrypt_t(mbedtls_ssl_context *ssl,
                                         mbedtls_x509_crt *cert,
                                         const unsigned char *input,
                                         size_t input_len);
+
+/**
+ * \brief           Callback type: start external certificate verification.
+ *
+ *                  This callback is called during an SSL handshake to start
+ *                  the verification of the peer's certificate chain, in
+ *                  place of mbedtls_x509_crt_verify_with_profile() or of the
+ *                  CA callback. It typically hands \p chain to a worker
+ *                  thread or a remote PKI service, and does not wait for
+ *                  the verification to complete. This allows the handshake
+ *                  step to be non-blocking.
+ *
+ *                  The verifier is responsible for checking the chain, the
+ *                  expected host name and any custom policy: neither the
+ *                  trusted CAs nor the verification callback set in the
+ *                  configuration are used. The key usage and extended key
+ *                  usage checks of the SSL module are still done afterwards.
+ *
+ *                  This function may call mbedtls_ssl_set_async_operation_data()
+ *                  to store an operation context for later retrieval
+ *                  by the resume or cancel callback.
+ *
+ * \param ssl             The SSL connection instance. It should not be
+ *                        modified other than via
+ *                        mbedtls_ssl_set_async_operation_data().
+ * \param chain           The certificate chain sent by the peer. It remains
+ *                        valid and unmodified until the resume callback
+ *                        returns a value other than
+ *                        #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS, or the cancel
+ *                        callback is called.
+ *
+ * \return          0 if the verification was started successfully and the
+ *                  SSL stack should call the resume callback immediately.
+ * \return          #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the verification
+ *                  was started successfully and the SSL stack should return
+ *                  immediately without calling the resume callback yet.
+ * \return          #MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH if the verifier
+ *                  does not handle this chain. The SSL stack will verify it
+ *                  synchronously as if no verifier was configured.
+ * \return          Any other error indicates a fatal failure and is
+ *                  propagated up the call chain.
+ */
+typedef int mbedtls_ssl_async_verify_t(mbedtls_ssl_context *ssl,
+                                       mbedtls_x509_crt *chain);
+
+/**
+ * \brief           Callback type: resume external certificate verification.
+ *
+ *                  This callback is called during an SSL handshake to
+ *                  resume a verification started by the
+ *                  ::mbedtls_ssl_async_verify_t callback. It typically
+ *                  checks whether the result is available, and does not
+ *                  wait for it.
+ *
+ *                  Note that when this function returns a status other than
+ *                  #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS, it must free any
+ *                  resources associated with the operation.
+ *
+ * \param ssl             The SSL connection instance. It should not be
+ *                        modified other than via
+ *                        mbedtls_ssl_set_async_operation_data().
+ * \param flags           On success, the verification result: a bitwise
+ *                        combination of \c MBEDTLS_X509_BADCERT_XXX and
+ *                        \c MBEDTLS_X509_BADCRL_XXX flags, or \c 0 if the
+ *                        chain is trusted, as computed by
+ *                        mbedtls_x509_crt_verify_with_profile().
+ *
+ * \return          0 if the verification has completed and \p flags is set.
+ * \return          #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the verification
+ *                  is still in progress. Subsequent requests for progress
+ *                  on the SSL connection will call the resume callback
+ *                  again.
+ * \return          Any other error means that the verification could not
+ *                  be completed. The SSL handshake is aborted.
+ */
+typedef int mbedtls_ssl_async_verify_resume_t(mbedtls_ssl_context *ssl,
+                                              uint32_t *flags);
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 /**
@@ -1147,6 +1677,111 @@ typedef int mbedtls_ssl_async_resume_t(mbedtls_ssl_context *ssl,
 typedef void mbedtls_ssl_async_cancel_t(mbedtls_ssl_context *ssl);
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/**
+ * \brief           Callback type: compress a certificate message
+ *
+ *                  This callback is called when a certificate chain is set,
+ *                  not during handshakes.
+ *
+ * \param p_ctx           The context set with
+ *                        mbedtls_ssl_conf_cert_compression().
+ * \param alg             The compression algorithm, one of
+ *                        \c MBEDTLS_SSL_CERT_COMPRESSION_XXX.
+ * \param input           The Certificate message body to compress.
+ * \param input_len       Length of \p input in bytes.
+ * \param output          Buffer for the compressed data.
+ * \param output_size     Size of \p output in bytes. This is \p input_len:
+ *                        there is no point in a larger compressed message.
+ * \param output_len      On success, the length of the compressed data.
+ *
+ * \return          0 on success.
+ * \return          #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if the data does not
+ *                  compress to less than \p output_size bytes. The chain is
+ *                  then sent uncompressed.
+ * \return          Any other error is reported by the function that set
+ *                  the certificate chain.
+ */
+typedef int mbedtls_ssl_cert_compress_t(void *p_ctx, uint16_t alg,
+                                        const unsigned char *input,
+                                        size_t input_len,
+                                        unsigned char *output,
+                                        size_t output_size,
+                                        size_t *output_len);
+
+/**
+ * \brief           Callback type: decompress a certificate message
+ *
+ * \param p_ctx           The context set with
+ *                        mbedtls_ssl_conf_cert_compression().
+ * \param alg             The compression algorithm, one of those offered.
+ * \param input           The compressed data received from the peer.
+ * \param input_len       Length of \p input in bytes.
+ * \param output          Buffer for the Certificate message body.
+ * \param output_len      The uncompressed length announced by the peer.
+ *                        Lengths above the largest Certificate message the
+ *                        library accepts, a little over 64 KiB, are
+ *                        rejected before calling this function.
+ *
+ * \return          0 if \p input decompresses to exactly \p output_len
+ *                  bytes.
+ * \return          Any other value if the data could not be decompressed.
+ *                  The handshake is then aborted with a bad_certificate
+ *                  alert.
+ */
+typedef int mbedtls_ssl_cert_decompress_t(void *p_ctx, uint16_t alg,
+                                          const unsigned char *input,
+                                          size_t input_len,
+                                          unsigned char *output,
+                                          size_t output_len);
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/**
+ * \brief           Callback type: verify the raw public key of the peer
+ *
+ *                  The key replaces the certificate chain of the peer: the
+ *                  callback decides alone whether it is trusted, typically
+ *                  by comparing \p spki with the keys pinned for the peer.
+ *
+ * \param p_vrfy          The context set with mbedtls_ssl_conf_rpk_verify().
+ * \param ssl             The SSL context of the handshake.
+ * \param pk              The public key of the peer.
+ * \param spki            The SubjectPublicKeyInfo of the key, as sent by
+ *                        the peer.
+ * \param spki_len        Length of \p spki in bytes.
+ *
+ * \return          0 if the key is trusted.
+ * \return          Any other value otherwise. With authmode
+ *                  #MBEDTLS_SSL_VERIFY_REQUIRED, the handshake is then
+ *                  aborted with a bad_certificate alert.
+ */
+typedef int mbedtls_ssl_rpk_vrfy_t(void *p_vrfy, mbedtls_ssl_context *ssl,
+                                   const mbedtls_pk_context *pk,
+                                   const unsigned char *spki,
+                                   size_t spki_len);
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+/**
+ * \brief           Callback type: refresh the stapled OCSP response of a
+ *                  certificate chain
+ *
+ *                  A handshake that staples the response set with
+ *                  mbedtls_ssl_conf_own_cert_ocsp() calls it once the
+ *                  refresh time of the response has passed, once per
+ *                  response. It must not block the handshake: it typically
+ *                  has another thread request a new response from the OCSP
+ *                  responder and set it with mbedtls_ssl_conf_own_cert_ocsp().
+ *                  The current response is stapled meanwhile.
+ *
+ * \param p_refresh       The context set with mbedtls_ssl_conf_ocsp_refresh().
+ * \param own_cert        The certificate chain whose response is due.
+ */
+typedef void mbedtls_ssl_ocsp_refresh_t(void *p_refresh,
+                                        const mbedtls_x509_crt *own_cert);
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
+
 #if defined(MBEDTLS_KEY_EXCHANGE_WITH_CERT_ENABLED) &&        \
     !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
 #define MBEDTLS_SSL_PEER_CERT_DIGEST_MAX_LEN  48
@@ -1214,6 +1849,75 @@ typedef enum {
     MBEDTLS_SSL_VERSION_TLS1_3 = 0x0304, /*!< (D)TLS 1.3 */
 } mbedtls_ssl_protocol_version;
 
+#if defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief   Routing information of a ClientHello, filled by
+ *          mbedtls_ssl_parse_client_hello_info()
+ *
+ *          The pointers point into the buffer that was parsed.
+ */
+typedef struct mbedtls_ssl_client_hello_info {
+    /** The highest version offered by the client, or
+     *  #MBEDTLS_SSL_VERSION_UNKNOWN if it offers neither TLS 1.2
+     *  nor TLS 1.3. */
+    mbedtls_ssl_protocol_version max_tls_version;
+    /** The host name of the ServerName extension, not null-terminated, or
+     *  \c NULL if the client did not send one. */
+    const unsigned char *server_name;
+    size_t server_name_len;             /*!< length of \c server_name */
+    /** The ProtocolNameList of the ALPN extension, without its length: a
+     *  sequence of protocol names, each preceded by its length in one byte.
+     *  \c NULL if the client did not send the extension. */
+    const unsigned char *alpn_list;
+    size_t alpn_list_len;               /*!< length of \c alpn_list */
+} mbedtls_ssl_client_hello_info;
+
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+/**
+ * \brief   What a handshake will cost the server, as given to the
+ *          admission callback set with mbedtls_ssl_conf_hs_admission()
+ */
+typedef struct mbedtls_ssl_hs_admission_info {
+    mbedtls_ssl_protocol_version tls_version;   /*!< negotiated version */
+    int ciphersuite;                    /*!< selected ciphersuite */
+    /** Non-zero if the handshake resumes a session. */
+    int resume;
+    /** Non-zero if the handshake includes an ephemeral (EC)DH key
+     *  exchange. */
+    int ephemeral;
+    /** The type of the key the server signs or decrypts with in this
+     *  handshake, or #MBEDTLS_PK_NONE if it uses none. */
+    mbedtls_pk_type_t key_type;
+    /** The number of times the callback deferred this handshake. */
+    unsigned int deferrals;
+} mbedtls_ssl_hs_admission_info;
+
+/**
+ * \brief          Callback type: admit, defer or reject a handshake
+ *
+ *                 The server calls this once the ClientHello is processed
+ *                 and the kind of handshake is known, before it writes its
+ *                 ServerHello and before any public key operation.
+ *
+ * \param p_admission  Context for the callback
+ * \param ssl      SSL context of the handshake
+ * \param info     What the handshake will cost
+ *
+ * \return         \c 0 to go on with the handshake.
+ * \return         #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS to defer it: the
+ *                 handshake function returns this value, and calls the
+ *                 callback again, with \c deferrals one higher, when it is
+ *                 called again.
+ * \return         Another negative error code to reject the handshake. The
+ *                 server sends a handshake_failure alert and the handshake
+ *                 function returns this value.
+ */
+typedef int mbedtls_ssl_hs_admission_t(void *p_admission,
+                                       mbedtls_ssl_context *ssl,
+                                       const mbedtls_ssl_hs_admission_info *info);
+#endif /* MBEDTLS_SSL_HS_ADMISSION */
+#endif /* MBEDTLS_SSL_SRV_C */
+
 /*
  * This structure is used for storing current session data.
  *
@@ -1254,6 +1958,9 @@ struct mbedtls_ssl_session {
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     mbedtls_x509_crt *MBEDTLS_PRIVATE(peer_cert);       /*!< peer X.509 cert chain */
+    /*! If not NULL, peer_cert is shared with other sessions and owned by
+     *  this reference-counted handle. */
+    struct mbedtls_ssl_peer_cert_ref *MBEDTLS_PRIVATE(peer_cert_ref);
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     /*! The digest of the peer's end-CRT. This must be kept to detect CRT
      *  changes during renegotiation, mitigating the triple handshake attack. */
@@ -1423,6 +2130,7 @@ struct mbedtls_ssl_config {
     uint8_t MBEDTLS_PRIVATE(endpoint);      /*!< 0: client, 1: server               */
     uint8_t MBEDTLS_PRIVATE(transport);     /*!< 0: stream (TLS), 1: datagram (DTLS)    */
     uint8_t MBEDTLS_PRIVATE(authmode);      /*!< MBEDTLS_SSL_VERIFY_XXX             */
+    uint8_t MBEDTLS_PRIVATE(frozen);        /*!< checked by mbedtls_ssl_config_freeze() */
     /* needed even with renego disabled for LEGACY_BREAK_HANDSHAKE          */
     uint8_t MBEDTLS_PRIVATE(allow_legacy_renegotiation); /*!< MBEDTLS_LEGACY_XXX   */
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
@@ -1445,13 +2153,29 @@ struct mbedtls_ssl_config {
     defined(MBEDTLS_SSL_CLI_C)
     uint8_t MBEDTLS_PRIVATE(session_tickets);   /*!< use session tickets? */
 #endif
+#if defined(MBEDTLS_SSL_FALSE_START)
+    uint8_t MBEDTLS_PRIVATE(false_start);       /*!< send data before the
+                                                     server Finished? */
+#endif
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && \
     defined(MBEDTLS_SSL_SRV_C) && \
     defined(MBEDTLS_SSL_PROTO_TLS1_3)
     uint16_t MBEDTLS_PRIVATE(new_session_tickets_count);   /*!< number of NewSessionTicket */
+    uint32_t MBEDTLS_PRIVATE(tls13_stateful_ticket_lifetime); /*!< lifetime of cached
+                                                                   tickets, 0: disabled */
+#endif
+
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    uint16_t MBEDTLS_PRIVATE(tls13_max_psk_identities); /*!< offered PSK identities looked up */
+    uint16_t MBEDTLS_PRIVATE(tls13_max_psk_tickets);    /*!< offered tickets decrypted */
 #endif
 
+    uint16_t MBEDTLS_PRIVATE(in_content_len);   /*!< maximum incoming record content,
+                                                     0: MBEDTLS_SSL_IN_CONTENT_LEN */
+    uint16_t MBEDTLS_PRIVATE(out_content_len);  /*!< maximum outgoing record content,
+                                                     0: MBEDTLS_SSL_OUT_CONTENT_LEN */
+
 #if defined(MBEDTLS_SSL_SRV_C)
     uint8_t MBEDTLS_PRIVATE(cert_req_ca_list);  /*!< enable sending CA list in
                                                      Certificate Request messages? */
@@ -1468,6 +2192,46 @@ struct mbedtls_ssl_config {
     uint8_t MBEDTLS_PRIVATE(dtls_srtp_mki_support); /* support having mki_value
                                                        in the use_srtp extension? */
 #endif
+    uint8_t MBEDTLS_PRIVATE(write_batch_records); /*!< maximum number of
+                                                   application data records
+                                                   sent in a single flush */
+    uint8_t MBEDTLS_PRIVATE(read_ahead_records);  /*!< size of the input
+                                                   buffer used for TLS
+                                                   read-ahead, in records */
+    uint8_t MBEDTLS_PRIVATE(write_queue);         /*!< accept new application
+                                                   data while earlier records
+                                                   are still being sent? */
+    uint8_t MBEDTLS_PRIVATE(flight_coalescing);   /*!< send each handshake
+                                                   flight in one go? */
+    uint8_t MBEDTLS_PRIVATE(handshake_reuse);     /*!< keep the handshake
+                                                   structure for the next
+                                                   handshake? */
+#if defined(MBEDTLS_SSL_SRV_C)
+    uint8_t MBEDTLS_PRIVATE(lazy_setup);          /*!< allocate the buffers
+                                                   and handshake structures
+                                                   on the ClientHello? */
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    uint8_t MBEDTLS_PRIVATE(dtls_flight_cache);   /*!< keep the records of
+                                                   each flight for its
+                                                   retransmissions? */
+    uint8_t MBEDTLS_PRIVATE(dtls_pmtu_probing);   /*!< lower the path MTU
+                                                   step by step on handshake
+                                                   retransmissions? */
+#endif
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    uint8_t MBEDTLS_PRIVATE(peer_cert_lazy_ext);  /*!< parse the peer chain
+                                                   in lazy extension mode? */
+#endif
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    uint8_t MBEDTLS_PRIVATE(ocsp_stapling);       /*!< request the stapled
+                                                   OCSP response? */
+#endif
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+    uint8_t MBEDTLS_PRIVATE(context_save_keys);   /*!< save the traffic keys
+                                                   rather than re-derive
+                                                   them when loading? */
+#endif
 
     /*
      * Pointers
@@ -1479,11 +2243,26 @@ struct mbedtls_ssl_config {
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     /** Allowed TLS 1.3 key exchange modes.                                 */
     int MBEDTLS_PRIVATE(tls13_kex_modes);
+    /** Records sent or received with a traffic key before it is updated,
+     *  0 to disable automatic key updates                                  */
+    uint32_t MBEDTLS_PRIVATE(tls13_key_update_records);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
     /** Callback for printing debug output                                  */
     void(*MBEDTLS_PRIVATE(f_dbg))(void *, int, const char *, int, const char *);
     void *MBEDTLS_PRIVATE(p_dbg);                    /*!< context for the debug function     */
+#if defined(MBEDTLS_DEBUG_C)
+    /** Callback for unformatted debug events                               */
+    mbedtls_ssl_dbg_event_t *MBEDTLS_PRIVATE(f_dbg_event);
+    void *MBEDTLS_PRIVATE(p_dbg_event);              /*!< context for the event function     */
+#endif
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    /** Callback for tracing the handshake steps                            */
+    mbedtls_ssl_handshake_trace_t *MBEDTLS_PRIVATE(f_hs_trace);
+    mbedtls_ssl_trace_clock_t *MBEDTLS_PRIVATE(f_hs_clock); /*!< trace clock       */
+    void *MBEDTLS_PRIVATE(p_hs_trace);               /*!< context for the trace functions    */
+#endif
 
     /** Callback for getting (pseudo-)random numbers                        */
     int(*MBEDTLS_PRIVATE(f_rng))(void *, unsigned char *, size_t);
@@ -1494,6 +2273,24 @@ struct mbedtls_ssl_config {
     /** Callback to store a session into the cache                          */
     mbedtls_ssl_cache_set_t *MBEDTLS_PRIVATE(f_set_cache);
     void *MBEDTLS_PRIVATE(p_cache);                  /*!< context for cache callbacks        */
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    struct mbedtls_ssl_session_store *MBEDTLS_PRIVATE(session_store); /*!< sessions to resume */
+#endif
+
+    /** Callback to get an input or output record buffer                   */
+    mbedtls_ssl_buffer_get_t *MBEDTLS_PRIVATE(f_buf_get);
+    /** Callback to release an input or output record buffer               */
+    mbedtls_ssl_buffer_release_t *MBEDTLS_PRIVATE(f_buf_release);
+    void *MBEDTLS_PRIVATE(p_buf);                    /*!< context for buffer callbacks       */
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    /** Callback to protect or deprotect records in parallel               */
+    mbedtls_ssl_pipeline_t *MBEDTLS_PRIVATE(f_pipeline);
+    void *MBEDTLS_PRIVATE(p_pipeline);               /*!< context for the pipeline callback  */
+    /** Callback to protect outgoing records asynchronously                 */
+    mbedtls_ssl_pipeline_t *MBEDTLS_PRIVATE(f_pipeline_async);
+    void *MBEDTLS_PRIVATE(p_pipeline_async);         /*!< context for the async callback     */
+#endif
 
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     /** Callback for setting cert according to SNI extension                */
@@ -1525,6 +2322,13 @@ struct mbedtls_ssl_config {
     void *MBEDTLS_PRIVATE(p_cookie);                 /*!< context for the cookie callbacks   */
 #endif
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    /** Callbacks to write and verify a HelloRetryRequest cookie            */
+    mbedtls_ssl_cookie_write_t *MBEDTLS_PRIVATE(f_hrr_cookie_write);
+    mbedtls_ssl_cookie_check_t *MBEDTLS_PRIVATE(f_hrr_cookie_check);
+    void *MBEDTLS_PRIVATE(p_hrr_cookie);             /*!< context for the HRR cookie callbacks */
+#endif
+
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_SRV_C)
     /** Callback to create & write a session ticket                         */
     int(*MBEDTLS_PRIVATE(f_ticket_write))(void *, const mbedtls_ssl_session *,
@@ -1543,10 +2347,36 @@ struct mbedtls_ssl_config {
     mbedtls_ssl_key_cert *MBEDTLS_PRIVATE(key_cert); /*!< own certificate/key pair(s)        */
     mbedtls_x509_crt *MBEDTLS_PRIVATE(ca_chain);     /*!< trusted CAs                        */
     mbedtls_x509_crl *MBEDTLS_PRIVATE(ca_crl);       /*!< trusted CAs CRLs                   */
+#if defined(MBEDTLS_SSL_CREDS_C)
+    struct mbedtls_ssl_creds_slot *MBEDTLS_PRIVATE(creds); /*!< replaceable credentials    */
+#endif
 #if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
     mbedtls_x509_crt_ca_cb_t MBEDTLS_PRIVATE(f_ca_cb);
     void *MBEDTLS_PRIVATE(p_ca_cb);
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+    mbedtls_x509_crt_verify_cache *MBEDTLS_PRIVATE(verify_cache); /*!< cache of verified chains */
+#endif
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    struct mbedtls_ssl_peer_cert_table *MBEDTLS_PRIVATE(peer_cert_table); /*!< shared peer chains */
+#endif
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    const uint16_t *MBEDTLS_PRIVATE(cert_compression_algs); /*!< certificate compression algorithms */
+    mbedtls_ssl_cert_compress_t *MBEDTLS_PRIVATE(f_cert_compress);
+    mbedtls_ssl_cert_decompress_t *MBEDTLS_PRIVATE(f_cert_decompress);
+    void *MBEDTLS_PRIVATE(p_cert_compression);
+#endif
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    mbedtls_pk_context *MBEDTLS_PRIVATE(rpk_key);    /*!< own raw public key   */
+    unsigned char *MBEDTLS_PRIVATE(rpk_spki);        /*!< its SubjectPublicKeyInfo */
+    size_t MBEDTLS_PRIVATE(rpk_spki_len);
+    mbedtls_ssl_rpk_vrfy_t *MBEDTLS_PRIVATE(f_rpk_vrfy); /*!< verify peer raw keys */
+    void *MBEDTLS_PRIVATE(p_rpk_vrfy);
+#endif
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    mbedtls_ssl_ocsp_refresh_t *MBEDTLS_PRIVATE(f_ocsp_refresh); /*!< refresh stapled responses */
+    void *MBEDTLS_PRIVATE(p_ocsp_refresh);
+#endif
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
@@ -1557,6 +2387,11 @@ struct mbedtls_ssl_config {
     mbedtls_ssl_async_resume_t *MBEDTLS_PRIVATE(f_async_resume); /*!< resume asynchronous operation */
     mbedtls_ssl_async_cancel_t *MBEDTLS_PRIVATE(f_async_cancel); /*!< cancel asynchronous operation */
     void *MBEDTLS_PRIVATE(p_async_config_data); /*!< Configuration data set by mbedtls_ssl_conf_async_private_cb(). */
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    mbedtls_ssl_async_verify_t *MBEDTLS_PRIVATE(f_async_verify_start); /*!< start asynchronous certificate verification */
+    mbedtls_ssl_async_verify_resume_t *MBEDTLS_PRIVATE(f_async_verify_resume); /*!< resume asynchronous certificate verification */
+    mbedtls_ssl_async_cancel_t *MBEDTLS_PRIVATE(f_async_verify_cancel); /*!< cancel asynchronous certificate verification */
+#endif /* MBEDTLS_X509_CRT_PARSE_C */
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
@@ -1572,6 +2407,15 @@ struct mbedtls_ssl_config {
 #endif
 
     const uint16_t *MBEDTLS_PRIVATE(group_list);     /*!< allowed IANA NamedGroups */
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+    struct mbedtls_ssl_group_cache *MBEDTLS_PRIVATE(group_cache); /*!< groups selected by servers */
+#endif
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+    struct mbedtls_ssl_key_share_pool *MBEDTLS_PRIVATE(key_share_pool); /*!< pre-generated key pairs */
+#endif
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+    struct mbedtls_ssl_ecdhe_reuse *MBEDTLS_PRIVATE(ecdhe_reuse); /*!< reused ECDHE key pairs */
+#endif
 
 #if defined(MBEDTLS_DHM_C)
     mbedtls_mpi MBEDTLS_PRIVATE(dhm_P);              /*!< prime modulus for DHM              */
@@ -1619,6 +2463,15 @@ struct mbedtls_ssl_config {
 #if defined(MBEDTLS_SSL_SRV_C)
     /* The maximum amount of 0-RTT data. RFC 8446 section 4.6.1 */
     uint32_t MBEDTLS_PRIVATE(max_early_data_size);
+
+    /** Callback to detect replayed early data attempts */
+    int(*MBEDTLS_PRIVATE(f_early_data_replay))(void *, const unsigned char *, size_t);
+    void *MBEDTLS_PRIVATE(p_early_data_replay);  /*!< context for the replay callback */
+
+    /** Callback to deliver early data as records are decrypted */
+    int(*MBEDTLS_PRIVATE(f_early_data))(void *, mbedtls_ssl_context *,
+                                        const unsigned char *, size_t);
+    void *MBEDTLS_PRIVATE(p_early_data);         /*!< context for the early data callback */
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
@@ -1645,6 +2498,15 @@ struct mbedtls_ssl_config {
                                                         retransmission timeout (ms)        */
     uint32_t MBEDTLS_PRIVATE(hs_timeout_max);        /*!< maximum value of the handshake
                                                         retransmission timeout (ms)        */
+#if defined(MBEDTLS_HAVE_TIME)
+    uint32_t MBEDTLS_PRIVATE(hs_timeout_floor);      /*!< minimum value of the handshake
+                                                        retransmission timeout estimated
+                                                        from the round-trip time (ms),
+                                                        0 for no estimation                */
+#endif
+    uint32_t MBEDTLS_PRIVATE(app_packing_delay);     /*!< longest wait of application
+                                                        records for a datagram to fill
+                                                        (ms), 0 to send each at once       */
 #endif
 
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
@@ -1655,6 +2517,19 @@ struct mbedtls_ssl_config {
 
     unsigned int MBEDTLS_PRIVATE(badmac_limit);      /*!< limit of records with a bad MAC    */
 
+    unsigned int MBEDTLS_PRIVATE(hs_max_steps);      /*!< handshake steps run per call,
+                                                        0 for no limit             */
+
+    size_t MBEDTLS_PRIVATE(small_record_len);        /*!< payload of application data
+                                                        records at connection start,
+                                                        0 for full records         */
+    size_t MBEDTLS_PRIVATE(small_record_bytes);      /*!< bytes sent in small records
+                                                        before using full ones     */
+#if defined(MBEDTLS_HAVE_TIME)
+    uint32_t MBEDTLS_PRIVATE(small_record_idle);     /*!< idle time after which records
+                                                        are small again (ms)       */
+#endif
+
 #if defined(MBEDTLS_DHM_C) && defined(MBEDTLS_SSL_CLI_C)
     unsigned int MBEDTLS_PRIVATE(dhm_min_bitlen);    /*!< min. bit length of the DHM prime   */
 #endif
@@ -1668,26 +2543,54 @@ struct mbedtls_ssl_config {
 
 #if defined(MBEDTLS_SSL_SRV_C)
     mbedtls_ssl_hs_cb_t MBEDTLS_PRIVATE(f_cert_cb);  /*!< certificate selection callback */
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+    /** Callback to admit, defer or reject handshakes                       */
+    mbedtls_ssl_hs_admission_t *MBEDTLS_PRIVATE(f_admission);
+    void *MBEDTLS_PRIVATE(p_admission);              /*!< context for the admission callback */
+#endif
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #if defined(MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED)
     const mbedtls_x509_crt *MBEDTLS_PRIVATE(dn_hints);/*!< acceptable client cert issuers    */
 #endif
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+    const mbedtls_x509_crt *MBEDTLS_PRIVATE(ca_dn_list_src); /*!< chain encoded in ca_dn_list */
+    unsigned char *MBEDTLS_PRIVATE(ca_dn_list);      /*!< encoded subject DNs of it    */
+    size_t MBEDTLS_PRIVATE(ca_dn_list_len);          /*!< length of ca_dn_list         */
+#endif
 };
 
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+/**
+ * \brief          Settings that override those of the configuration of the
+ *                 contexts it is attached to, see
+ *                 mbedtls_ssl_set_config_overlay()
+ *
+ *                 An overlay only holds the fields it overrides, so that
+ *                 tenants that differ in a few settings share one
+ *                 configuration instead of each having a copy of it.
+ */
+typedef struct mbedtls_ssl_config_overlay {
+    const int *MBEDTLS_PRIVATE(ciphersuite_list); /*!< ciphersuites, or NULL */
+#if defined(MBEDTLS_SSL_ALPN)
+    const char **MBEDTLS_PRIVATE(alpn_list);      /*!< ALPN protocols, or NULL */
+#endif
+    int MBEDTLS_PRIVATE(authmode);                /*!< authmode, or
+                                                     MBEDTLS_SSL_VERIFY_UNSET */
+} mbedtls_ssl_config_overlay;
+#endif /* MBEDTLS_SSL_CONFIG_OVERLAY */
+
 struct mbedtls_ssl_context {
     const mbedtls_ssl_config *MBEDTLS_PRIVATE(conf); /*!< configuration information          */
 
     /*
-     * Miscellaneous
+     * Record layer state used for every record. It comes first and is kept
+     * compact, so that processing records on many contexts touches as few
+     * cache lines of each as possible. The state only used by handshakes,
+     * by some options or on errors follows it.
      */
     int MBEDTLS_PRIVATE(state);                  /*!< SSL handshake: current state     */
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-    int MBEDTLS_PRIVATE(renego_status);          /*!< Initial, in progress, pending?   */
-    int MBEDTLS_PRIVATE(renego_records_seen);    /*!< Records since renego request, or with DTLS,
-                                                    number of retransmissions of request if
-                                                    renego_max_records is < 0           */
-#endif /* MBEDTLS_SSL_RENEGOTIATION */
 
     /**
      * Maximum TLS version to be negotiated, then negotiated TLS version.
@@ -1707,20 +2610,10 @@ struct mbedtls_ssl_context {
      */
     mbedtls_ssl_protocol_version MBEDTLS_PRIVATE(tls_version);
 
-#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_CLI_C)
-    /**
-     * State of the negotiation and transfer of early data. Reset to
-     * MBEDTLS_SSL_EARLY_DATA_STATE_IDLE when the context is reset.
-     */
-    int MBEDTLS_PRIVATE(early_data_state);
-#endif
-
-    unsigned MBEDTLS_PRIVATE(badmac_seen);       /*!< records with a bad MAC received    */
-
-#if defined(MBEDTLS_X509_CRT_PARSE_C)
-    /** Callback to customize X.509 certificate chain verification          */
-    int(*MBEDTLS_PRIVATE(f_vrfy))(void *, mbedtls_x509_crt *, int, uint32_t *);
-    void *MBEDTLS_PRIVATE(p_vrfy);                   /*!< context for X.509 verify callback */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    /** TLS 1.3 KeyUpdate state, MBEDTLS_SSL_KEY_UPDATE_xxx flags in
+     *  ssl_misc.h. Reset to 0 when the context is reset. */
+    unsigned char MBEDTLS_PRIVATE(key_update);
 #endif
 
     mbedtls_ssl_send_t *MBEDTLS_PRIVATE(f_send); /*!< Callback for network send */
@@ -1730,16 +2623,48 @@ struct mbedtls_ssl_context {
 
     void *MBEDTLS_PRIVATE(p_bio);                /*!< context for I/O operations   */
 
-    /*
-     * Session layer
-     */
-    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_in);            /*!<  current session data (in)   */
-    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_out);           /*!<  current session data (out)  */
-    mbedtls_ssl_session *MBEDTLS_PRIVATE(session);               /*!<  negotiated session data     */
-    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_negotiate);     /*!<  session data in negotiation */
-
-    mbedtls_ssl_handshake_params *MBEDTLS_PRIVATE(handshake);    /*!<  params required only during
-                                                                    the handshake process        */
+#if defined(MBEDTLS_SSL_KTLS)
+    unsigned char MBEDTLS_PRIVATE(ktls_directions); /*!< record protection
+                                                     offloaded to the kernel:
+                                                     MBEDTLS_SSL_KTLS_TX and/or
+                                                     MBEDTLS_SSL_KTLS_RX   */
+    mbedtls_ssl_send_record_t *MBEDTLS_PRIVATE(f_ktls_send_record); /*!< send
+                                                     non-application-data
+                                                     records once TX is
+                                                     offloaded             */
+    void *MBEDTLS_PRIVATE(p_ktls_send_record);   /*!< context for
+                                                     f_ktls_send_record    */
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+    mbedtls_ssl_quic_send_t *MBEDTLS_PRIVATE(f_quic_send);       /*!< send
+                                                     handshake data, or NULL
+                                                     outside of QUIC       */
+    mbedtls_ssl_quic_secrets_t *MBEDTLS_PRIVATE(f_quic_secrets); /*!< install
+                                                     traffic secrets       */
+    mbedtls_ssl_quic_alert_t *MBEDTLS_PRIVATE(f_quic_alert);     /*!< report
+                                                     alerts                */
+    void *MBEDTLS_PRIVATE(p_quic);               /*!< context for QUIC     */
+    unsigned char *MBEDTLS_PRIVATE(quic_in)[MBEDTLS_SSL_QUIC_LEVELS]; /*!<
+                                                     handshake data not yet
+                                                     processed, by level   */
+    size_t MBEDTLS_PRIVATE(quic_in_len)[MBEDTLS_SSL_QUIC_LEVELS];
+    unsigned char *MBEDTLS_PRIVATE(quic_tp);     /*!< own transport
+                                                     parameters            */
+    size_t MBEDTLS_PRIVATE(quic_tp_len);
+    unsigned char *MBEDTLS_PRIVATE(quic_peer_tp); /*!< transport parameters
+                                                     of the peer           */
+    size_t MBEDTLS_PRIVATE(quic_peer_tp_len);
+#endif /* MBEDTLS_SSL_QUIC */
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    mbedtls_ssl_pipeline *MBEDTLS_PRIVATE(in_pipe);  /*!< records read ahead
+                                                     and decrypted in
+                                                     parallel, or NULL     */
+    mbedtls_ssl_pipeline *MBEDTLS_PRIVATE(out_pipe); /*!< records laid out for
+                                                     parallel encryption,
+                                                     or NULL               */
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
 
     /*
      * Record layer transformations
@@ -1750,28 +2675,6 @@ struct mbedtls_ssl_context {
     mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform_out);       /*!<  current transform params (out)
                                                                   *    This is always a reference,
                                                                   *    never an owning pointer.        */
-    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform);           /*!<  negotiated transform params
-                                                                  *    This pointer owns the transform
-                                                                  *    it references.                  */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform_negotiate); /*!<  transform params in negotiation
-                                                                  *    This pointer owns the transform
-                                                                  *    it references.                  */
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
-
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-    /*! The application data transform in TLS 1.3.
-     *  This pointer owns the transform it references. */
-    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform_application);
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
-
-    /*
-     * Timers
-     */
-    void *MBEDTLS_PRIVATE(p_timer);              /*!< context for the timer callbacks */
-
-    mbedtls_ssl_set_timer_t *MBEDTLS_PRIVATE(f_set_timer);       /*!< set timer callback */
-    mbedtls_ssl_get_timer_t *MBEDTLS_PRIVATE(f_get_timer);       /*!< get timer callback */
 
     /*
      * Record layer (incoming data)
@@ -1789,25 +2692,24 @@ struct mbedtls_ssl_context {
     unsigned char *MBEDTLS_PRIVATE(in_iv);       /*!< ivlen-byte IV                    */
     unsigned char *MBEDTLS_PRIVATE(in_msg);      /*!< message contents (in_iv+ivlen)   */
     unsigned char *MBEDTLS_PRIVATE(in_offt);     /*!< read offset in application data  */
+    unsigned char *MBEDTLS_PRIVATE(in_dst);      /*!< buffer of mbedtls_ssl_read() that
+                                                      the next application data record
+                                                      may be decrypted into, or NULL */
+    size_t MBEDTLS_PRIVATE(in_dst_len);          /*!< length of in_dst                 */
+    unsigned char MBEDTLS_PRIVATE(in_dst_used);  /*!< the current record was decrypted
+                                                      into in_dst, not in place */
 
     int MBEDTLS_PRIVATE(in_msgtype);             /*!< record header: message type      */
     size_t MBEDTLS_PRIVATE(in_msglen);           /*!< record header: message length    */
     size_t MBEDTLS_PRIVATE(in_left);             /*!< amount of data read so far       */
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t MBEDTLS_PRIVATE(in_buf_len);          /*!< length of input buffer           */
-#endif
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    uint16_t MBEDTLS_PRIVATE(in_epoch);          /*!< DTLS epoch for incoming records  */
-    size_t MBEDTLS_PRIVATE(next_record_offset);  /*!< offset of the next record in datagram
-                                                    (equal to in_left if none)       */
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
-#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
-    uint64_t MBEDTLS_PRIVATE(in_window_top);     /*!< last validated record seq_num    */
-    uint64_t MBEDTLS_PRIVATE(in_window);         /*!< bitmask for replay detection     */
-#endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
+    size_t MBEDTLS_PRIVATE(in_ahead_offset);     /*!< TLS read-ahead: offset from in_hdr
+                                                      of data read beyond the
+                                                      current record          */
+    size_t MBEDTLS_PRIVATE(in_ahead_len);        /*!< TLS read-ahead: amount of data
+                                                      read beyond the current
+                                                      record                  */
 
-    size_t MBEDTLS_PRIVATE(in_hslen);            /*!< current handshake message length,
-                                                    including the handshake header   */
     int MBEDTLS_PRIVATE(nb_zero);                /*!< # of 0-length encrypted messages */
 
     int MBEDTLS_PRIVATE(keep_current_message);   /*!< drop or reuse current message
@@ -1822,6 +2724,158 @@ struct mbedtls_ssl_context {
                                                     - \c 1 , alert is to be sent. */
     unsigned char MBEDTLS_PRIVATE(alert_type);   /*!< Type of alert if send_alert
                                                     != 0 */
+
+    /*
+     * Record layer (outgoing data)
+     */
+    unsigned char *MBEDTLS_PRIVATE(out_buf);     /*!< output buffer                    */
+    unsigned char *MBEDTLS_PRIVATE(out_ctr);     /*!< 64-bit outgoing message counter  */
+    unsigned char *MBEDTLS_PRIVATE(out_hdr);     /*!< start of record header           */
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    unsigned char *MBEDTLS_PRIVATE(out_cid);     /*!< The start of the CID;
+                                                  *   (the end is marked by in_len).   */
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    unsigned char *MBEDTLS_PRIVATE(out_len);     /*!< two-bytes message length field   */
+    unsigned char *MBEDTLS_PRIVATE(out_iv);      /*!< ivlen-byte IV                    */
+    unsigned char *MBEDTLS_PRIVATE(out_msg);     /*!< message contents (out_iv+ivlen)  */
+
+    int MBEDTLS_PRIVATE(out_msgtype);            /*!< record header: message type      */
+    size_t MBEDTLS_PRIVATE(out_msglen);          /*!< record header: message length    */
+    size_t MBEDTLS_PRIVATE(out_left);            /*!< amount of data not yet written   */
+    size_t MBEDTLS_PRIVATE(out_buf_len);         /*!< length of output buffer          */
+    size_t MBEDTLS_PRIVATE(out_batch_len);       /*!< application data bytes held in
+                                                      a batch of records that is
+                                                      not fully written yet        */
+    size_t MBEDTLS_PRIVATE(small_record_sent);   /*!< application data bytes sent
+                                                      since the start or the last
+                                                      idle period                  */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(last_write_time); /*!< time of the last
+                                                             application data
+                                                             write             */
+#endif
+
+    unsigned char MBEDTLS_PRIVATE(cur_out_ctr)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!<  Outgoing record sequence  number. */
+
+    /*
+     * Miscellaneous
+     */
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    uint64_t MBEDTLS_PRIVATE(trace_io_time);     /*!< I/O time of the current step     */
+    size_t MBEDTLS_PRIVATE(trace_bytes_in);      /*!< bytes received in the step       */
+    size_t MBEDTLS_PRIVATE(trace_bytes_out);     /*!< bytes sent in the step           */
+#endif
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats MBEDTLS_PRIVATE(stats);    /*!< counters of the context          */
+    mbedtls_ssl_stats *MBEDTLS_PRIVATE(stats_sink); /*!< counters to fold them into    */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(stats_hs_start); /*!< start of the handshake     */
+#endif
+#endif
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    int MBEDTLS_PRIVATE(renego_status);          /*!< Initial, in progress, pending?   */
+    int MBEDTLS_PRIVATE(renego_records_seen);    /*!< Records since renego request, or with DTLS,
+                                                    number of retransmissions of request if
+                                                    renego_max_records is < 0           */
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_CLI_C)
+    /**
+     * State of the negotiation and transfer of early data. Reset to
+     * MBEDTLS_SSL_EARLY_DATA_STATE_IDLE when the context is reset.
+     */
+    int MBEDTLS_PRIVATE(early_data_state);
+#endif
+
+    unsigned MBEDTLS_PRIVATE(badmac_seen);       /*!< records with a bad MAC received    */
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    /** Callback to customize X.509 certificate chain verification          */
+    int(*MBEDTLS_PRIVATE(f_vrfy))(void *, mbedtls_x509_crt *, int, uint32_t *);
+    void *MBEDTLS_PRIVATE(p_vrfy);                   /*!< context for X.509 verify callback */
+#endif
+
+    /** RNG used by this context: the one configured by mbedtls_ssl_conf_rng()
+     *  unless overridden with mbedtls_ssl_set_rng()                          */
+    int(*MBEDTLS_PRIVATE(f_rng))(void *, unsigned char *, size_t);
+    void *MBEDTLS_PRIVATE(p_rng);                    /*!< context for the RNG function       */
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex); /*!< held by every call
+                                                     but a reader waiting
+                                                     for the next record   */
+    unsigned char MBEDTLS_PRIVATE(in_unlocked);  /*!< the reader released
+                                                     the mutex to receive
+                                                     a record              */
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+    /*
+     * Session layer
+     */
+    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_in);            /*!<  current session data (in)   */
+    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_out);           /*!<  current session data (out)  */
+    mbedtls_ssl_session *MBEDTLS_PRIVATE(session);               /*!<  negotiated session data     */
+    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_negotiate);     /*!<  session data in negotiation */
+
+    mbedtls_ssl_handshake_params *MBEDTLS_PRIVATE(handshake);    /*!<  params required only during
+                                                                    the handshake process        */
+    mbedtls_ssl_handshake_params *MBEDTLS_PRIVATE(handshake_spare); /*!< cleared handshake params
+                                                                       kept for the next handshake */
+
+    /*
+     * Record layer transformations owned by the context
+     */
+    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform);           /*!<  negotiated transform params
+                                                                  *    This pointer owns the transform
+                                                                  *    it references.                  */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform_negotiate); /*!<  transform params in negotiation
+                                                                  *    This pointer owns the transform
+                                                                  *    it references.                  */
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    /*! The application data transform in TLS 1.3.
+     *  This pointer owns the transform it references. */
+    mbedtls_ssl_transform *MBEDTLS_PRIVATE(transform_application);
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
+    /*
+     * Timers
+     */
+    void *MBEDTLS_PRIVATE(p_timer);              /*!< context for the timer callbacks */
+
+    mbedtls_ssl_set_timer_t *MBEDTLS_PRIVATE(f_set_timer);       /*!< set timer callback */
+    mbedtls_ssl_get_timer_t *MBEDTLS_PRIVATE(f_get_timer);       /*!< get timer callback */
+
+    /*
+     * Record layer (incoming data), less frequently used
+     */
+    unsigned char MBEDTLS_PRIVATE(in_ctr_saved)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN];
+                                                 /*!< incoming record counter kept
+                                                      while the record buffers are
+                                                      released by
+                                                      mbedtls_ssl_release_buffers() */
+#if defined(MBEDTLS_SSL_SRV_C)
+    unsigned char MBEDTLS_PRIVATE(lazy_in_buf)[MBEDTLS_SSL_LAZY_SETUP_BUF_LEN];
+                                                 /*!< input buffer of a context
+                                                      set up lazily, until the
+                                                      ClientHello arrives */
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    uint16_t MBEDTLS_PRIVATE(in_epoch);          /*!< DTLS epoch for incoming records  */
+    size_t MBEDTLS_PRIVATE(next_record_offset);  /*!< offset of the next record in datagram
+                                                    (equal to in_left if none)       */
+    uint8_t MBEDTLS_PRIVATE(in_datagram_only);   /*!< do not receive a new datagram,
+                                                    see mbedtls_ssl_read_datagram() */
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+    uint64_t MBEDTLS_PRIVATE(in_window_top);     /*!< last validated record seq_num    */
+    uint64_t MBEDTLS_PRIVATE(in_window)[MBEDTLS_SSL_DTLS_REPLAY_WINDOW / 64]; /*!< bitmask for replay detection */
+#endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
+
+    size_t MBEDTLS_PRIVATE(in_hslen);            /*!< current handshake message length,
+                                                    including the handshake header   */
     int MBEDTLS_PRIVATE(alert_reason);           /*!< The error code to be returned
                                                     to the user once the fatal alert
                                                     has been sent. */
@@ -1845,30 +2899,27 @@ struct mbedtls_ssl_context {
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
     /*
-     * Record layer (outgoing data)
+     * Record layer (outgoing data), less frequently used
      */
-    unsigned char *MBEDTLS_PRIVATE(out_buf);     /*!< output buffer                    */
-    unsigned char *MBEDTLS_PRIVATE(out_ctr);     /*!< 64-bit outgoing message counter  */
-    unsigned char *MBEDTLS_PRIVATE(out_hdr);     /*!< start of record header           */
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    unsigned char *MBEDTLS_PRIVATE(out_cid);     /*!< The start of the CID;
-                                                  *   (the end is marked by in_len).   */
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-    unsigned char *MBEDTLS_PRIVATE(out_len);     /*!< two-bytes message length field   */
-    unsigned char *MBEDTLS_PRIVATE(out_iv);      /*!< ivlen-byte IV                    */
-    unsigned char *MBEDTLS_PRIVATE(out_msg);     /*!< message contents (out_iv+ivlen)  */
-
-    int MBEDTLS_PRIVATE(out_msgtype);            /*!< record header: message type      */
-    size_t MBEDTLS_PRIVATE(out_msglen);          /*!< record header: message length    */
-    size_t MBEDTLS_PRIVATE(out_left);            /*!< amount of data not yet written   */
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-    size_t MBEDTLS_PRIVATE(out_buf_len);         /*!< length of output buffer          */
-#endif
-
-    unsigned char MBEDTLS_PRIVATE(cur_out_ctr)[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!<  Outgoing record sequence  number. */
+    unsigned char *MBEDTLS_PRIVATE(out_coalesce_buf); /*!< handshake records held
+                                                           back until the end of
+                                                           the flight              */
+    size_t MBEDTLS_PRIVATE(out_coalesce_size);   /*!< length of out_coalesce_buf    */
+    size_t MBEDTLS_PRIVATE(out_coalesce_len);    /*!< bytes held in out_coalesce_buf */
+    size_t MBEDTLS_PRIVATE(out_coalesce_sent);   /*!< bytes of those already sent   */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     uint16_t MBEDTLS_PRIVATE(mtu);               /*!< path mtu, used to fragment outgoing messages */
+    uint16_t MBEDTLS_PRIVATE(path_mtu);          /*!< path mtu found on this connection,
+                                                      0 if unknown */
+    uint8_t MBEDTLS_PRIVATE(out_app_held);       /*!< the output buffer holds
+                                                      application records that
+                                                      earlier writes accepted */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(out_app_held_time); /*!< when the first
+                                                               of them was
+                                                               written       */
+#endif
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
     /*
@@ -1879,6 +2930,21 @@ struct mbedtls_ssl_context {
                                                     (and SNI if available)                 */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    uint16_t MBEDTLS_PRIVATE(server_port);       /*!< server port, for the session store  */
+#endif
+
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+    const mbedtls_ssl_config_overlay *MBEDTLS_PRIVATE(overlay); /*!< settings
+                                                    overriding the conf, or NULL */
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_CLI_C)
+    const mbedtls_x509_crt *MBEDTLS_PRIVATE(cached_srv_chain); /*!< chain the
+                                                    server is expected to send */
+    unsigned char MBEDTLS_PRIVATE(cached_srv_chain_hash)[MBEDTLS_SSL_CACHED_INFO_HASH_LEN];
+#endif
+
 #if defined(MBEDTLS_SSL_ALPN)
     const char *MBEDTLS_PRIVATE(alpn_chosen);    /*!<  negotiated protocol                   */
 #endif /* MBEDTLS_SSL_ALPN */
@@ -2133,6 +3199,141 @@ void mbedtls_ssl_conf_max_early_data_size(
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
+/**
+ * \brief           Callback type: check that an early data attempt is not a
+ *                  replay
+ *
+ * \note            This describes what a callback implementation should do.
+ *                  This callback should look \p id up in the attempts seen
+ *                  recently, for example in a store shared by all the
+ *                  servers that accept the same tickets, and record it if
+ *                  it was not there.
+ *
+ * \param p_replay  Context for the callback
+ * \param id        Identifier of the attempt: the binder of the first PSK
+ *                  offered in the ClientHello
+ * \param id_len    Length of \p id
+ *
+ * \return          0 if \p id was not seen, or
+ *                  any other value if it may have been seen or on failure,
+ *                  in which case the early data is rejected.
+ */
+typedef int mbedtls_ssl_early_data_replay_t(void *p_replay,
+                                            const unsigned char *id,
+                                            size_t id_len);
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Set the replay detection of early data (server only).
+ *                 (Default: none.)
+ *
+ *                 RFC 8446 section 8 requires some form of protection
+ *                 against the replay of early data. Each attempt to send
+ *                 early data whose other requirements are met is checked
+ *                 with \p f_replay before the early data is accepted, and
+ *                 the early data is rejected if \p f_replay returns non-zero:
+ *                 the handshake then completes without it.
+ *
+ * \note           mbedtls_ssl_anti_replay_check() is an implementation of
+ *                 the callback, for the servers that share a
+ *                 mbedtls_ssl_anti_replay context.
+ *
+ * \warning        Without replay detection, an attacker can replay early
+ *                 data, for example a request, to any server that accepts
+ *                 the ticket it was sent with.
+ *
+ * \param conf     SSL configuration
+ * \param f_replay Replay check callback, or \c NULL to accept early data
+ *                 without checking
+ * \param p_replay Context for the callback
+ */
+void mbedtls_ssl_conf_early_data_anti_replay(mbedtls_ssl_config *conf,
+                                             mbedtls_ssl_early_data_replay_t *f_replay,
+                                             void *p_replay);
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+/**
+ * \brief           Callback type: receive early data
+ *
+ * \param p_early_data  Context for the callback
+ * \param ssl       SSL context receiving the early data
+ * \param buf       Decrypted content of an early data record. It is only
+ *                  valid during the call.
+ * \param len       Length of \p buf, possibly \c 0
+ *
+ * \return          0 to go on with the handshake, or
+ *                  a non-zero code to abort it, which is then returned by
+ *                  the function that was performing the handshake.
+ */
+typedef int mbedtls_ssl_early_data_cb_t(void *p_early_data,
+                                        mbedtls_ssl_context *ssl,
+                                        const unsigned char *buf,
+                                        size_t len);
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Deliver early data through a callback (server only).
+ *                 (Default: none.)
+ *
+ *                 Each early data record is passed to \p f_early_data in
+ *                 the record buffer as soon as it is decrypted, and the
+ *                 handshake then goes on: mbedtls_ssl_handshake() does not
+ *                 return #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA, and nothing is
+ *                 left for mbedtls_ssl_read_early_data(). This lets the
+ *                 application start processing a request sent as early data
+ *                 while the handshake completes, without copying it.
+ *
+ * \note           The callback is called from within the handshake: it
+ *                 must not call other functions on \p ssl than getters.
+ *
+ * \param conf     SSL configuration
+ * \param f_early_data  Early data callback, or \c NULL to get early data
+ *                 with mbedtls_ssl_read_early_data()
+ * \param p_early_data  Context for the callback
+ */
+void mbedtls_ssl_conf_early_data_cb(mbedtls_ssl_config *conf,
+                                    mbedtls_ssl_early_data_cb_t *f_early_data,
+                                    void *p_early_data);
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+/**
+ * \brief          Register callbacks for stateless HelloRetryRequest
+ *                 cookies (server only, TLS 1.3)
+ *                 (Default: none, the server keeps its state across a
+ *                 HelloRetryRequest)
+ *
+ *                 When the server needs another key share, it sends a
+ *                 HelloRetryRequest with a cookie holding the hash of the
+ *                 first ClientHello, the selected cipher suite and group,
+ *                 and a MAC over them written by \p f_cookie_write. Then
+ *                 mbedtls_ssl_handshake() returns
+ *                 #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED: reset the context
+ *                 with mbedtls_ssl_session_reset(), or free it and set up a
+ *                 new one once the client sends again. The handshake of the
+ *                 context that receives the second ClientHello checks the
+ *                 cookie with \p f_cookie_check and goes on from there.
+ *
+ *                 The callbacks of ssl_cookie.h can be used, with the MAC
+ *                 over the state of the cookie in place of the client
+ *                 transport ID. Their expiration delay bounds the time a
+ *                 client has to send its second ClientHello.
+ *
+ * \note           A first ClientHello that offers early data gets the
+ *                 usual stateful HelloRetryRequest, so that the server can
+ *                 skip the early data records that follow it.
+ *
+ * \param conf     SSL configuration
+ * \param f_cookie_write Cookie write callback, or NULL to keep the state
+ * \param f_cookie_check Cookie check callback
+ * \param p_cookie Context for both callbacks
+ */
+void mbedtls_ssl_conf_tls13_hrr_cookies(mbedtls_ssl_config *conf,
+                                        mbedtls_ssl_cookie_write_t *f_cookie_write,
+                                        mbedtls_ssl_cookie_check_t *f_cookie_check,
+                                        void *p_cookie);
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /**
  * \brief          Set the verification callback (Optional).
@@ -2157,6 +3358,12 @@ void mbedtls_ssl_conf_verify(mbedtls_ssl_config *conf,
 /**
  * \brief          Set the random number generator callback
  *
+ * \note           All the contexts sharing \p conf call \p f_rng. If it
+ *                 locks \p p_rng, as mbedtls_ctr_drbg_random() does with
+ *                 MBEDTLS_THREADING_C, handshakes running in different
+ *                 threads wait for each other: give each thread its own
+ *                 generator with mbedtls_ssl_set_rng() instead.
+ *
  * \param conf     SSL configuration
  * \param f_rng    RNG function (mandatory)
  * \param p_rng    RNG parameter
@@ -2183,6 +3390,56 @@ void mbedtls_ssl_conf_dbg(mbedtls_ssl_config *conf,
                           void (*f_dbg)(void *, int, const char *, int, const char *),
                           void  *p_dbg);
 
+#if defined(MBEDTLS_DEBUG_C)
+/**
+ * \brief          Set the debug event callback
+ *
+ *                 Messages, error codes and buffers are then passed to
+ *                 \p f_event as they are, without being formatted, instead
+ *                 of the debug callback of mbedtls_ssl_conf_dbg(). The
+ *                 callback formats the events it keeps, if it needs to, with
+ *                 mbedtls_debug_format_event(). Other debug output, such as
+ *                 certificates and big numbers, still goes to the debug
+ *                 callback.
+ *
+ * \note           As with the debug callback, events above the threshold
+ *                 of mbedtls_debug_set_threshold() are discarded before
+ *                 their arguments are evaluated.
+ *
+ * \param conf     SSL configuration
+ * \param f_event  Event function, or \c NULL to send all the debug output
+ *                 to the debug callback
+ * \param p_event  Context for \p f_event
+ */
+void mbedtls_ssl_conf_dbg_event(mbedtls_ssl_config *conf,
+                                mbedtls_ssl_dbg_event_t *f_event,
+                                void *p_event);
+#endif /* MBEDTLS_DEBUG_C */
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+/**
+ * \brief          Set the handshake trace callback
+ *
+ *                 \p f_trace is called at the end of each call to
+ *                 mbedtls_ssl_handshake_step(), with the state it handled,
+ *                 its duration and the I/O it did. A step that returns
+ *                 #MBEDTLS_ERR_SSL_WANT_READ or #MBEDTLS_ERR_SSL_WANT_WRITE
+ *                 is reported as well, and repeated when the handshake goes
+ *                 on.
+ *
+ * \param conf     SSL configuration
+ * \param f_trace  Trace function, or \c NULL to disable tracing
+ * \param f_clock  Clock to time the steps with, or \c NULL to use
+ *                 mbedtls_ms_time() if MBEDTLS_HAVE_TIME is enabled, and
+ *                 to report times of \c 0 otherwise
+ * \param p_trace  Context for \p f_trace and \p f_clock
+ */
+void mbedtls_ssl_conf_handshake_trace(mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_handshake_trace_t *f_trace,
+                                      mbedtls_ssl_trace_clock_t *f_clock,
+                                      void *p_trace);
+#endif /* MBEDTLS_SSL_HANDSHAKE_TRACE */
+
 /**
  * \brief          Return the SSL configuration structure associated
  *                 with the given SSL context.
@@ -2447,6 +3704,34 @@ int mbedtls_ssl_get_peer_cid(mbedtls_ssl_context *ssl,
  * \param mtu      Value of the path MTU in bytes
  */
 void mbedtls_ssl_set_mtu(mbedtls_ssl_context *ssl, uint16_t mtu);
+
+/**
+ * \brief          Report the path MTU found by the transport for this
+ *                 connection, for example from an ICMP Fragmentation Needed
+ *                 or Packet Too Big message, an \c EMSGSIZE error of the
+ *                 socket, or the \c IP_MTU socket option.
+ *
+ *                 Outgoing datagrams are then limited to the lowest of this
+ *                 value and the one of mbedtls_ssl_set_mtu(), and datagram
+ *                 packing (see mbedtls_ssl_set_datagram_packing()) fills
+ *                 them up to that size. A larger value than the previous
+ *                 report raises the limit again, up to the one of
+ *                 mbedtls_ssl_set_mtu().
+ *
+ * \note           Unlike mbedtls_ssl_set_mtu(), the limit is part of the
+ *                 state of the connection: it is cleared by
+ *                 mbedtls_ssl_session_reset(), and is also set by
+ *                 handshake retransmissions when
+ *                 mbedtls_ssl_conf_dtls_pmtu_probing() is enabled.
+ *
+ * \param ssl      SSL context
+ * \param mtu      Maximum datagram payload in bytes, or \c 0 if the
+ *                 message did not give it, to lower the limit to the next
+ *                 common datagram size below the current one. Values below
+ *                 508 bytes, the size any IPv4 path delivers, are raised to
+ *                 it.
+ */
+void mbedtls_ssl_update_path_mtu(mbedtls_ssl_context *ssl, uint16_t mtu);
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -2473,6 +3758,32 @@ void mbedtls_ssl_set_verify(mbedtls_ssl_context *ssl,
                             void *p_vrfy);
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
+/**
+ * \brief          Set the random number generator of an SSL context
+ *
+ *                 The context then uses \p f_rng instead of the RNG of its
+ *                 configuration for everything it generates: randoms, key
+ *                 shares, session IDs, explicit IVs, ... This lets each
+ *                 thread of a server give the contexts it runs a generator
+ *                 of its own, for example a CTR_DRBG seeded from a shared
+ *                 entropy context, so that concurrent handshakes do not
+ *                 contend on the lock of a shared generator.
+ *
+ * \note           This call is analogous to mbedtls_ssl_conf_rng() but
+ *                 binds the RNG to an SSL context as opposed to an SSL
+ *                 configuration. Call it after mbedtls_ssl_setup(). The
+ *                 setting survives mbedtls_ssl_session_reset().
+ *
+ * \param ssl      The SSL context to use.
+ * \param f_rng    RNG function, or \c NULL to use the RNG of the
+ *                 configuration again.
+ * \param p_rng    RNG parameter. It must remain valid as long as \p ssl
+ *                 uses \p f_rng.
+ */
+void mbedtls_ssl_set_rng(mbedtls_ssl_context *ssl,
+                         int (*f_rng)(void *, unsigned char *, size_t),
+                         void *p_rng);
+
 /**
  * \brief          Set the timeout period for mbedtls_ssl_read()
  *                 (Default: no timeout.)
@@ -2491,6 +3802,34 @@ void mbedtls_ssl_set_verify(mbedtls_ssl_context *ssl,
  */
 void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout);
 
+/**
+ * \brief          Set how many handshake steps mbedtls_ssl_handshake() runs
+ *                 before it gives control back (Default: no limit.)
+ *
+ *                 A step is one state of the handshake, such as writing the
+ *                 key share, signing the handshake or deriving the keys of the
+ *                 next flight. Without a limit, a call can run all the steps
+ *                 before the next read from the peer, which holds up the other
+ *                 connections of a single-threaded event loop. With a limit,
+ *                 the call returns #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS after
+ *                 that many steps, and the application can serve other
+ *                 connections before calling it again.
+ *
+ * \param conf     SSL configuration
+ * \param max_steps Steps run per call, \c 1 to yield after each one.
+ *                 Use 0 for no limit (default).
+ *
+ * \note           This also applies to the handshake run by
+ *                 mbedtls_ssl_read() and mbedtls_ssl_write(), which then
+ *                 return #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS as well.
+ *
+ * \note           The step whose cryptography is the slowest one still runs
+ *                 in one go. To split the EC operations themselves, see
+ *                 mbedtls_ecp_set_max_ops().
+ */
+void mbedtls_ssl_conf_handshake_max_steps(mbedtls_ssl_config *conf,
+                                          unsigned int max_steps);
+
 /**
  * \brief          Check whether a buffer contains a valid and authentic record
  *                 that has not been seen before. (DTLS only).
@@ -2580,6 +3919,28 @@ static inline void mbedtls_ssl_conf_cert_cb(mbedtls_ssl_config *conf,
 {
     conf->MBEDTLS_PRIVATE(f_cert_cb) = f_cert_cb;
 }
+
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+/**
+ * \brief           Set the handshake admission callback (server-side only).
+ *
+ *                  The callback sees what each handshake will cost, such as
+ *                  whether it resumes a session and the type of key it
+ *                  uses, before the expensive part of the handshake. Under
+ *                  overload, it can then let cheap handshakes through and
+ *                  defer or reject the others. See
+ *                  mbedtls_ssl_hs_budget_admit() for a callback that does
+ *                  so with a CPU budget.
+ *
+ * \param conf          The SSL configuration to register the callback with.
+ * \param f_admission   The admission callback, or \c NULL to admit all
+ *                      handshakes.
+ * \param p_admission   Context for the callback.
+ */
+void mbedtls_ssl_conf_hs_admission(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_hs_admission_t *f_admission,
+                                   void *p_admission);
+#endif /* MBEDTLS_SSL_HS_ADMISSION */
 #endif /* MBEDTLS_SSL_SRV_C */
 
 /**
@@ -2608,6 +3969,12 @@ typedef int mbedtls_ssl_ticket_write_t(void *p_ticket,
                                        size_t *tlen,
                                        uint32_t *lifetime);
 
+/*
+ * Positive return values of the ticket parse callback, for valid tickets
+ */
+#define MBEDTLS_SSL_TICKET_PARSE_FRESH  1   /*!< valid, keep using it     */
+#define MBEDTLS_SSL_TICKET_PARSE_RENEW  2   /*!< valid, send a new ticket */
+
 /**
  * \brief           Callback type: parse and load session ticket
  *
@@ -2627,9 +3994,18 @@ typedef int mbedtls_ssl_ticket_write_t(void *p_ticket,
  * \param len       Length of the ticket.
  *
  * \return          0 if successful, or
+ *                  #MBEDTLS_SSL_TICKET_PARSE_FRESH if successful and the
+ *                  ticket need not be replaced, or
+ *                  #MBEDTLS_SSL_TICKET_PARSE_RENEW if successful and the
+ *                  ticket should be replaced by a new one, or
  *                  MBEDTLS_ERR_SSL_INVALID_MAC if not authentic, or
  *                  MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED if expired, or
  *                  any other non-zero code for other failures.
+ *
+ * \note            On 0, a TLS 1.2 server resuming the session does not send
+ *                  a new ticket and a TLS 1.3 server does. The positive
+ *                  values let the callback decide for both versions, so that
+ *                  a ticket is only replaced when it gets old.
  */
 typedef int mbedtls_ssl_ticket_parse_t(void *p_ticket,
                                        mbedtls_ssl_session *session,
@@ -2947,6 +4323,44 @@ void *mbedtls_ssl_get_async_operation_data(const mbedtls_ssl_context *ssl);
  */
 void mbedtls_ssl_set_async_operation_data(mbedtls_ssl_context *ssl,
                                           void *ctx);
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+/**
+ * \brief           Configure asynchronous certificate verification
+ *                  callbacks.
+ *
+ *                  While the verification of the peer's certificate chain is
+ *                  in progress, the handshake functions return
+ *                  #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS. Call them again
+ *                  once the verifier has completed, e.g. when a worker
+ *                  thread signals the event loop.
+ *
+ * \note            The asynchronous operation context set with
+ *                  mbedtls_ssl_set_async_operation_data() is shared with
+ *                  the callbacks of mbedtls_ssl_conf_async_private_cb().
+ *                  Only one asynchronous operation is in progress at a time.
+ *
+ * \param conf                  SSL configuration context
+ * \param f_async_verify        Callback to start a verification. See the
+ *                              description of ::mbedtls_ssl_async_verify_t
+ *                              for more information. \c NULL to verify
+ *                              synchronously.
+ * \param f_async_verify_resume Callback to resume a verification. See the
+ *                              description of
+ *                              ::mbedtls_ssl_async_verify_resume_t for more
+ *                              information. This may not be \c NULL unless
+ *                              \p f_async_verify is \c NULL.
+ * \param f_async_verify_cancel Callback to cancel a verification if the
+ *                              handshake is aborted while it is in progress.
+ *                              See the description of
+ *                              ::mbedtls_ssl_async_cancel_t. This may be
+ *                              \c NULL if no cleanup is needed.
+ */
+void mbedtls_ssl_conf_async_verify(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_async_verify_t *f_async_verify,
+                                   mbedtls_ssl_async_verify_resume_t *f_async_verify_resume,
+                                   mbedtls_ssl_async_cancel_t *f_async_verify_cancel);
+#endif /* MBEDTLS_X509_CRT_PARSE_C */
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 /**
@@ -3041,6 +4455,60 @@ int mbedtls_ssl_set_client_transport_id(mbedtls_ssl_context *ssl,
                                         const unsigned char *info,
                                         size_t ilen);
 
+/**
+ * \brief          Check the cookie in a datagram from an unknown peer,
+ *                 before any SSL context is allocated for it.
+ *                 (Server only. DTLS only.)
+ *
+ *                 This runs the same check as the handshake does on a first
+ *                 ClientHello, using the cookie callbacks registered with
+ *                 mbedtls_ssl_conf_dtls_cookies(), but needs nothing more
+ *                 than the configuration and performs no allocation. A
+ *                 server can call this on every datagram that does not
+ *                 belong to an existing connection, and only allocate and
+ *                 set up an SSL context once a peer has proved it can
+ *                 receive at its claimed address.
+ *
+ * \note           If this returns 0, set up a context for the peer, call
+ *                 mbedtls_ssl_set_client_transport_id() with the same
+ *                 \p cli_id and pass it the datagram. The handshake will
+ *                 check the cookie again and continue without sending a
+ *                 HelloVerifyRequest.
+ *
+ * \note           This function only reads \p conf, and may be called
+ *                 concurrently from several threads if the cookie
+ *                 callbacks allow it, which the ones in ssl_cookie.h do.
+ *
+ * \param conf     SSL configuration of a DTLS server, with cookie
+ *                 callbacks registered.
+ * \param cli_id   Transport-level info identifying the client (eg IP +
+ *                 port), as will later be passed to
+ *                 mbedtls_ssl_set_client_transport_id().
+ * \param cli_id_len Length of \p cli_id in bytes.
+ * \param in       The datagram received from the peer, including the
+ *                 DTLS record header.
+ * \param in_len   Length of \p in in bytes.
+ * \param obuf     Buffer for a HelloVerifyRequest record.
+ * \param buf_len  Size of \p obuf in bytes.
+ * \param olen     On #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED, the length of
+ *                 the record written to \p obuf.
+ *
+ * \return         \c 0 if the datagram is a ClientHello with a valid
+ *                 cookie: accept the peer.
+ * \return         #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED if the datagram
+ *                 looks like a ClientHello without a valid cookie. Send the
+ *                 \p olen bytes in \p obuf back to the peer and forget it.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p conf is not a DTLS
+ *                 server configuration with cookie callbacks.
+ * \return         Another negative error code if the datagram is not a
+ *                 ClientHello or \p obuf is too small. Drop the datagram.
+ */
+int mbedtls_ssl_check_client_hello_cookie(
+    const mbedtls_ssl_config *conf,
+    const unsigned char *cli_id, size_t cli_id_len,
+    const unsigned char *in, size_t in_len,
+    unsigned char *obuf, size_t buf_len, size_t *olen);
+
 #endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY && MBEDTLS_SSL_SRV_C */
 
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
@@ -3087,6 +4555,333 @@ void mbedtls_ssl_conf_dtls_anti_replay(mbedtls_ssl_config *conf, char mode);
  */
 void mbedtls_ssl_conf_dtls_badmac_limit(mbedtls_ssl_config *conf, unsigned limit);
 
+/**
+ * \brief          Set the maximum number of application data records that
+ *                 a single call to mbedtls_ssl_write() or mbedtls_ssl_writev()
+ *                 may protect back to back before handing them to the
+ *                 underlying transport in a single send.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: 1 (every record is flushed on its own).
+ *
+ * \param conf     SSL configuration
+ * \param records  Maximum number of records per flush. 0 and 1 both mean
+ *                 that batching is disabled.
+ *
+ * \note           The output buffer of each context set up with this
+ *                 configuration is enlarged to hold \p records full
+ *                 records, i.e. roughly \p records times 16 KiB of memory
+ *                 with the default configuration. This setting must be
+ *                 chosen before calling mbedtls_ssl_setup().
+ *
+ * \note           With batching enabled, mbedtls_ssl_write() may accept up
+ *                 to \p records times the maximum record payload in a single
+ *                 call. If the transport reports
+ *                 #MBEDTLS_ERR_SSL_WANT_WRITE, the whole batch stays
+ *                 buffered and the next call with the same arguments
+ *                 returns the number of bytes of the batch once it has been
+ *                 sent.
+ */
+void mbedtls_ssl_conf_write_batch(mbedtls_ssl_config *conf,
+                                  unsigned char records);
+
+/**
+ * \brief          Let mbedtls_ssl_write() and mbedtls_ssl_writev() accept
+ *                 new application data while the records of earlier calls
+ *                 are still waiting to be sent.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: #MBEDTLS_SSL_WRITE_QUEUE_DISABLED.
+ *
+ *                 Without the queue, a write that could not be sent entirely
+ *                 returns #MBEDTLS_ERR_SSL_WANT_WRITE and must be called again
+ *                 with the same arguments. With the queue, the data is
+ *                 accepted as soon as it is protected: the write returns the
+ *                 number of bytes taken, and the records are sent by later
+ *                 calls to mbedtls_ssl_write(), mbedtls_ssl_writev() or
+ *                 mbedtls_ssl_flush(). New data is protected behind the
+ *                 records still queued as long as they fit in the output
+ *                 buffer, see mbedtls_ssl_conf_write_batch() for its size.
+ *
+ * \param conf     SSL configuration
+ * \param queue    #MBEDTLS_SSL_WRITE_QUEUE_ENABLED or
+ *                 #MBEDTLS_SSL_WRITE_QUEUE_DISABLED
+ *
+ * \note           With the queue, #MBEDTLS_ERR_SSL_WANT_WRITE means that no
+ *                 data was taken because the output buffer is full, and the
+ *                 next call may pass any data. Use
+ *                 mbedtls_ssl_get_bytes_unsent() to know whether records are
+ *                 still queued, e.g. before closing the connection.
+ */
+void mbedtls_ssl_conf_write_queue(mbedtls_ssl_config *conf, int queue);
+
+/**
+ * \brief          Send application data in small records at the start of a
+ *                 connection and after it was idle, and in full records once
+ *                 enough data was sent.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: full records from the start.
+ *
+ *                 While TCP is in slow start, a full 16 KiB record spans
+ *                 several round trips and the peer can only decrypt it once
+ *                 it has all of it. Records that fit in one TCP segment can
+ *                 be processed as soon as they arrive, which lowers the time
+ *                 to the first byte. Larger records take less overhead once
+ *                 the congestion window has grown.
+ *
+ * \param conf     SSL configuration
+ * \param len      Maximum payload of the small records, typically the TCP
+ *                 maximum segment size minus the record expansion (see
+ *                 mbedtls_ssl_get_record_expansion()), for example 1400.
+ *                 0 disables small records.
+ * \param bytes    Number of bytes of application data to send in small
+ *                 records before switching to full records.
+ * \param idle     Time in milliseconds without application data written
+ *                 after which records are small again, as TCP restarts from
+ *                 a small congestion window after an idle period. 0 means
+ *                 never. Ignored without #MBEDTLS_HAVE_TIME.
+ *
+ * \note           mbedtls_ssl_write() and mbedtls_ssl_writev() then accept
+ *                 at most \p len bytes per record, so they may return less
+ *                 than the length of the data given to them.
+ */
+void mbedtls_ssl_conf_record_sizing(mbedtls_ssl_config *conf,
+                                    size_t len, size_t bytes, uint32_t idle);
+
+/**
+ * \brief          Enable read-ahead on the input path: read as much data as
+ *                 fits in the input buffer with each call to the receive
+ *                 callback, and parse further records from that data
+ *                 without calling the receive callback again.
+ *                 (TLS only, no effect on DTLS, which always reads whole
+ *                 datagrams.)
+ *                 Default: 1 (read-ahead disabled).
+ *
+ * \param conf     SSL configuration
+ * \param records  Size of the input buffer in records. 0 and 1 both mean
+ *                 that read-ahead is disabled and the receive callback is
+ *                 only asked for the bytes of the current record.
+ *
+ * \note           The input buffer of each context set up with this
+ *                 configuration is enlarged to hold \p records full
+ *                 records, i.e. roughly \p records times 16 KiB of memory
+ *                 with the default configuration. This setting must be
+ *                 chosen before calling mbedtls_ssl_setup().
+ *
+ * \note           Read-ahead is only used once the handshake is complete.
+ *
+ * \note           Once data has been read ahead, mbedtls_ssl_check_pending()
+ *                 returns 1 until it has been processed, so event-driven
+ *                 applications must call mbedtls_ssl_check_pending() before
+ *                 waiting on the underlying transport.
+ */
+void mbedtls_ssl_conf_read_ahead(mbedtls_ssl_config *conf,
+                                 unsigned char records);
+
+/**
+ * \brief          Enable or disable handshake flight coalescing: hold back
+ *                 the handshake records written by consecutive handshake
+ *                 steps and hand a whole flight (e.g. ServerHello,
+ *                 Certificate, ServerKeyExchange and ServerHelloDone) to
+ *                 the send callback at once, instead of calling it once
+ *                 per handshake message.
+ *                 (TLS only, no effect on DTLS, which already packs
+ *                 flights into datagrams.)
+ *                 Default: #MBEDTLS_SSL_FLIGHT_COALESCING_DISABLED.
+ *
+ * \param conf     SSL configuration
+ * \param coalescing #MBEDTLS_SSL_FLIGHT_COALESCING_ENABLED or
+ *                 #MBEDTLS_SSL_FLIGHT_COALESCING_DISABLED
+ *
+ * \note           This saves a system call and, on TCP, a partially
+ *                 filled segment per handshake message, without having to
+ *                 cork the socket with \c TCP_CORK or \c MSG_MORE.
+ *
+ * \note           The held back records are sent as soon as the handshake
+ *                 needs to read from the peer, when it completes, or when
+ *                 any other record is written. They are kept in a separate
+ *                 buffer of up to four full records, allocated for each
+ *                 flight and freed once it has been sent. A flight that
+ *                 does not fit is sent in several parts.
+ */
+void mbedtls_ssl_conf_flight_coalescing(mbedtls_ssl_config *conf,
+                                        int coalescing);
+
+/**
+ * \brief          Keep the handshake structure of an SSL context once its
+ *                 handshake is complete, for the next handshake on the same
+ *                 context after mbedtls_ssl_session_reset() or a
+ *                 renegotiation.
+ *                 Default: #MBEDTLS_SSL_HANDSHAKE_REUSE_DISABLED.
+ *
+ * \param conf     SSL configuration
+ * \param reuse    #MBEDTLS_SSL_HANDSHAKE_REUSE_ENABLED or
+ *                 #MBEDTLS_SSL_HANDSHAKE_REUSE_DISABLED
+ *
+ * \note           mbedtls_ssl_session_reset() always keeps the session and
+ *                 the record protection structures of the previous
+ *                 connection, and the record buffers, for the next one. With
+ *                 this option, the handshake structure is kept as well, and
+ *                 a server that resets its contexts for each new connection
+ *                 does not allocate them again: only the allocations whose
+ *                 size depends on the peer, such as certificates, remain.
+ *
+ * \note           The handshake structure is cleared when its handshake
+ *                 completes, but its memory, a few kilobytes depending on
+ *                 the configuration, stays allocated for as long as the
+ *                 connection is open.
+ */
+void mbedtls_ssl_conf_handshake_reuse(mbedtls_ssl_config *conf, int reuse);
+
+#if defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Defer the allocations of a server context until the
+ *                 first record of the connection looks like a ClientHello.
+ *                 Default: #MBEDTLS_SSL_LAZY_SETUP_DISABLED.
+ *
+ * \param conf     SSL configuration
+ * \param lazy     #MBEDTLS_SSL_LAZY_SETUP_ENABLED or
+ *                 #MBEDTLS_SSL_LAZY_SETUP_DISABLED
+ *
+ * \note           With this option, mbedtls_ssl_setup() allocates neither
+ *                 the record buffers nor the handshake structures. The
+ *                 context reads the headers of its first record into a
+ *                 small buffer of its own, and only allocates the rest once
+ *                 they are those of a ClientHello record. A connection that
+ *                 sends something else, or nothing, costs no allocation.
+ *
+ * \note           A first record that is not a ClientHello makes the
+ *                 handshake fail with #MBEDTLS_ERR_SSL_INVALID_RECORD,
+ *                 #MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE or
+ *                 #MBEDTLS_ERR_SSL_DECODE_ERROR, without an alert, since
+ *                 there is no output buffer to send it from.
+ *
+ * \note           This only applies to TLS, as DTLS has its own protection
+ *                 with mbedtls_ssl_conf_dtls_cookies(). A context reset with
+ *                 mbedtls_ssl_session_reset() after its ClientHello keeps
+ *                 what it has allocated, for the next connection.
+ */
+void mbedtls_ssl_conf_lazy_setup(mbedtls_ssl_config *conf, int lazy);
+#endif /* MBEDTLS_SSL_SRV_C */
+
+/**
+ * \brief          Set the allocator for the input and output record
+ *                 buffers of SSL contexts using this configuration.
+ *                 Default: \c NULL callbacks, which use mbedtls_calloc() and
+ *                 mbedtls_free().
+ *
+ *                 A pool of ready-made buffers avoids allocating and
+ *                 freeing about 33 KiB on every mbedtls_ssl_setup() and
+ *                 mbedtls_ssl_free(). The module ssl_buffer_pool provides
+ *                 a simple implementation of such a pool.
+ *
+ * \param conf     SSL configuration
+ * \param f_get    Callback to get a buffer, or \c NULL to use the default.
+ * \param f_release Callback to release a buffer, or \c NULL to use the
+ *                 default. Both callbacks must be set, or neither.
+ * \param p_buf    Context passed to both callbacks.
+ *
+ * \note           The allocator must be set before calling
+ *                 mbedtls_ssl_setup() and must not change while any context
+ *                 using this configuration is alive, since buffers are
+ *                 always released through the allocator they came from.
+ */
+void mbedtls_ssl_conf_buffer_alloc(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_buffer_get_t *f_get,
+                                   mbedtls_ssl_buffer_release_t *f_release,
+                                   void *p_buf);
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+/**
+ * \brief          Protect and deprotect the records of a connection in
+ *                 parallel, on the threads of a worker pool provided by the
+ *                 application.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: \c NULL, all records are processed in the
+ *                 calling thread.
+ *
+ *                 AEAD records are independent of each other given their
+ *                 sequence number, so a single connection can use more
+ *                 than one core:
+ *                 - With write batching (see mbedtls_ssl_conf_write_batch()),
+ *                   a large write is split into records which are laid out
+ *                   in the output buffer with their sequence numbers, then
+ *                   encrypted in parallel and sent in order.
+ *                 - With read-ahead (see mbedtls_ssl_conf_read_ahead()),
+ *                   the complete records read ahead of the current one are
+ *                   decrypted together with it, and then handed out in
+ *                   order by mbedtls_ssl_read().
+ *
+ * \param conf     SSL configuration
+ * \param f_pipeline Callback running the jobs of a batch of records, or
+ *                 \c NULL to disable the pipeline.
+ * \param p_pipeline Context passed to \p f_pipeline.
+ *
+ * \note           Ciphersuites that are not AEAD are always processed in
+ *                 the calling thread, since the size of their records
+ *                 cannot be known before they are protected.
+ *
+ * \note           \p f_pipeline may be called concurrently for different
+ *                 connections, and for the two directions of a connection
+ *                 with #MBEDTLS_SSL_FULL_DUPLEX.
+ *
+ * \note           With TLS 1.3, a record read ahead may turn out to carry
+ *                 a KeyUpdate, so the following records may be protected
+ *                 with the next key. The records read ahead are therefore
+ *                 copied before being decrypted, and decrypted again
+ *                 serially if needed.
+ */
+void mbedtls_ssl_conf_record_pipeline(mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_pipeline_t *f_pipeline,
+                                      void *p_pipeline);
+
+/**
+ * \brief          Protect the outgoing records of a connection
+ *                 asynchronously, e.g. on a crypto accelerator with a high
+ *                 throughput but a high latency.
+ *                 (TLS only, no effect on DTLS.)
+ *                 Default: \c NULL, records are protected synchronously.
+ *
+ *                 With write batching (see mbedtls_ssl_conf_write_batch()),
+ *                 the records of a write are laid out in the output buffer
+ *                 and \p f_async is called for them, as the callback of
+ *                 mbedtls_ssl_conf_record_pipeline() is, except that it may
+ *                 return before the jobs have run:
+ *                 - If \p f_async returns 0, all jobs have run.
+ *                 - If \p f_async returns #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS,
+ *                   it has started the jobs, which may run and return later
+ *                   on any thread. The write function returns
+ *                   #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS, and must be called
+ *                   again with the same arguments once the jobs are done,
+ *                   e.g. when the accelerator signals their completion. It
+ *                   returns #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS again as long
+ *                   as a job has not returned, and then sends the records
+ *                   and returns the number of bytes of the batch.
+ *
+ *                 With many connections per thread, each one can have a
+ *                 batch in flight while the thread serves the others.
+ *
+ * \param conf     SSL configuration
+ * \param f_async  Callback starting the jobs of a batch of outgoing
+ *                 records, which may have a single record, or \c NULL to
+ *                 protect them synchronously.
+ * \param p_async  Context passed to \p f_async.
+ *
+ * \note           Incoming records are always deprotected synchronously,
+ *                 with the callback of mbedtls_ssl_conf_record_pipeline()
+ *                 if set.
+ *
+ * \note           \p f_async is not used together with
+ *                 mbedtls_ssl_conf_write_queue().
+ *
+ * \note           While a batch is in flight, the output buffer of the
+ *                 context is in use: nothing is sent on the connection,
+ *                 and the context must not be reset or freed before the
+ *                 jobs have returned.
+ */
+void mbedtls_ssl_conf_record_pipeline_async(mbedtls_ssl_config *conf,
+                                            mbedtls_ssl_pipeline_t *f_async,
+                                            void *p_async);
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
 /**
@@ -3113,13 +4908,48 @@ void mbedtls_ssl_conf_dtls_badmac_limit(mbedtls_ssl_config *conf, unsigned limit
  *                 or flight retransmission (if no buffering is used) as
  *                 means to deal with reordering are needed less frequently.
  *
- * \note           Application records are not affected by this option and
- *                 are currently always sent in separate datagrams.
+ * \note           Application records are sent in separate datagrams,
+ *                 unless mbedtls_ssl_conf_dtls_app_packing() is used. Then
+ *                 disallowing packing disables it too.
  *
  */
 void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
                                       unsigned allow_packing);
 
+/**
+ * \brief          Pack the application records of successive writes into
+ *                 shared datagrams.
+ *                 (DTLS only, no effect on TLS.)
+ *                 Default: 0, each record is sent in its own datagram.
+ *
+ *                 Once the handshake is over, mbedtls_ssl_write() then
+ *                 protects each record behind those of the previous writes
+ *                 and returns without sending them, as long as the datagram
+ *                 has room for more. The datagram is sent when the next
+ *                 record does not fit in it, by the first write after it
+ *                 waited \p max_delay milliseconds, or by
+ *                 mbedtls_ssl_flush(). Other records, such as alerts, are
+ *                 sent together with the application records held.
+ *
+ * \param conf      SSL configuration
+ * \param max_delay Longest time in milliseconds that the records of a
+ *                  datagram wait for more, or 0 to disable packing.
+ *                  Only enforced with MBEDTLS_HAVE_TIME.
+ *
+ * \note           The library has no timer: records are only sent by the
+ *                 calls above. When a write leaves records unsent, which
+ *                 mbedtls_ssl_get_bytes_unsent() tells, the application
+ *                 should call mbedtls_ssl_flush() at most \p max_delay
+ *                 milliseconds later, typically when its event loop next
+ *                 wakes up, and before it waits for an answer.
+ *
+ * \note           The size of the datagrams is that of
+ *                 mbedtls_ssl_set_mtu() and mbedtls_ssl_conf_max_frag_len(),
+ *                 so set a MTU for packing to pay off.
+ */
+void mbedtls_ssl_conf_dtls_app_packing(mbedtls_ssl_config *conf,
+                                       uint32_t max_delay);
+
 /**
  * \brief          Set retransmit timeout values for the DTLS handshake.
  *                 (DTLS only, no effect on TLS.)
@@ -3152,6 +4982,97 @@ void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
  *                 resend ... 5s -> give up and return a timeout error.
  */
 void mbedtls_ssl_conf_handshake_timeout(mbedtls_ssl_config *conf, uint32_t min, uint32_t max);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Estimate the round-trip time to the peer during the
+ *                 handshake, and derive the retransmission timeout from it.
+ *                 (DTLS only, no effect on TLS.)
+ *                 Default: 0 (disabled).
+ *
+ * \param conf     SSL configuration
+ * \param floor    Lowest retransmission timeout in milliseconds, or \c 0 to
+ *                 always start from the 'min' value of
+ *                 mbedtls_ssl_conf_handshake_timeout().
+ *
+ * \note           The round-trip time is measured from the first
+ *                 transmission of an outgoing flight to the reception of the
+ *                 complete flight of the peer that answers it, so it
+ *                 includes the time the peer takes to process the flight. A
+ *                 flight that was retransmitted gives no measurement, since
+ *                 the answer may be to any of its transmissions.
+ *
+ * \note           The first flight of each handshake is sent with the 'min'
+ *                 timeout of mbedtls_ssl_conf_handshake_timeout(). Each
+ *                 following flight starts with the smoothed round-trip time
+ *                 plus four times its variation, as in RFC 6298, within
+ *                 \p floor and the 'max' timeout, and doubles it on each
+ *                 retransmission as usual.
+ *
+ * \note           The 'floor' value should be above the time it takes the
+ *                 peer to process a flight that needs more work than the
+ *                 ones measured. For example, a flight with a certificate
+ *                 verification or a key exchange may follow flights that
+ *                 are answered at once.
+ */
+void mbedtls_ssl_conf_dtls_adaptive_timeout(mbedtls_ssl_config *conf,
+                                            uint32_t floor);
+#endif /* MBEDTLS_HAVE_TIME */
+
+/**
+ * \brief          Keep the records of each outgoing handshake flight as
+ *                 first sent, to retransmit them as they are instead of
+ *                 fragmenting and packing the messages of the flight again.
+ *                 (DTLS only, no effect on TLS.)
+ *                 Default: #MBEDTLS_SSL_DTLS_FLIGHT_CACHE_DISABLED.
+ *
+ * \param conf     SSL configuration
+ * \param cache    #MBEDTLS_SSL_DTLS_FLIGHT_CACHE_ENABLED or
+ *                 #MBEDTLS_SSL_DTLS_FLIGHT_CACHE_DISABLED
+ *
+ * \note           DTLS requires a new record sequence number for each
+ *                 retransmitted record, and the sequence number is part of
+ *                 the protection of an encrypted record. Only the
+ *                 unprotected records of a flight, sent before the
+ *                 ChangeCipherSpec of the initial handshake, are kept: they
+ *                 are resent with their sequence number updated. The
+ *                 Finished message and the records of a renegotiation are
+ *                 still encrypted again for each retransmission.
+ *
+ * \note           The records of each flight are kept in a separate buffer,
+ *                 about the size of the flight, freed once the flight of the
+ *                 peer that answers it is received. The records are packed
+ *                 again when the MTU changes, for example when it is reduced
+ *                 after repeated retransmissions.
+ */
+void mbedtls_ssl_conf_dtls_flight_cache(mbedtls_ssl_config *conf, int cache);
+
+/**
+ * \brief          Lower the path MTU of a connection step by step when
+ *                 handshake flights are lost, and keep the size that got
+ *                 through for the rest of the connection.
+ *                 (DTLS only, no effect on TLS.)
+ *                 Default: #MBEDTLS_SSL_DTLS_PMTU_PROBING_DISABLED.
+ *
+ * \param conf     SSL configuration
+ * \param probing  #MBEDTLS_SSL_DTLS_PMTU_PROBING_ENABLED or
+ *                 #MBEDTLS_SSL_DTLS_PMTU_PROBING_DISABLED
+ *
+ * \note           Without probing, the second retransmission of a flight
+ *                 and the following ones are sent in datagrams of at most
+ *                 508 bytes, for the rest of the handshake only. With
+ *                 probing, each of these retransmissions goes down to the
+ *                 next common datagram size (1472, 1452, 1232, then 508
+ *                 bytes), and once the peer answers a flight sent at a
+ *                 reduced size, that size becomes the path MTU of the
+ *                 connection, as with mbedtls_ssl_update_path_mtu(), so
+ *                 application data is not sent in datagrams that the path
+ *                 drops.
+ *
+ * \note           Application data gives no feedback on loss in DTLS, so the
+ *                 limit is only raised again by mbedtls_ssl_update_path_mtu().
+ */
+void mbedtls_ssl_conf_dtls_pmtu_probing(mbedtls_ssl_config *conf, int probing);
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -3246,6 +5167,74 @@ void mbedtls_ssl_conf_session_cache(mbedtls_ssl_config *conf,
  * \sa             mbedtls_ssl_session_load()
  */
 int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session *session);
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+/**
+ * \brief          Set the store of the sessions to resume
+ *                 (client-side only, default: none)
+ *
+ *                 Before each initial handshake without a session set with
+ *                 mbedtls_ssl_set_session(), the client looks up a session
+ *                 for the server in the store and offers to resume it. The
+ *                 TLS 1.2 session of a full handshake and each TLS 1.3
+ *                 ticket received are added to the store.
+ *
+ *                 Servers are told apart by the name set with
+ *                 mbedtls_ssl_set_hostname(), which is required, the port
+ *                 set with mbedtls_ssl_set_server_port() and the first
+ *                 protocol set with mbedtls_ssl_conf_alpn_protocols().
+ *
+ * \note           The store can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled.
+ *
+ * \param conf     SSL configuration
+ * \param store    Store set up with mbedtls_ssl_session_store_setup(),
+ *                 or \c NULL to resume only sessions set by the application.
+ */
+void mbedtls_ssl_conf_session_store(mbedtls_ssl_config *conf,
+                                    struct mbedtls_ssl_session_store *store);
+
+/**
+ * \brief          Set the port of the server (client-side only, default: 0)
+ *
+ *                 The port is only used to tell apart, in the store set with
+ *                 mbedtls_ssl_conf_session_store(), servers sharing a name.
+ *
+ * \param ssl      SSL context
+ * \param port     Server port
+ */
+void mbedtls_ssl_set_server_port(mbedtls_ssl_context *ssl, uint16_t port);
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+/**
+ * \brief          Set the certificate chain the server is expected to send,
+ *                 as kept from an earlier connection (client-side only)
+ *
+ *                 The client sends a hash of the chain in the cached_info
+ *                 extension (RFC 7924). A server that would send the same
+ *                 chain then sends the hash in its place, and the client
+ *                 verifies this chain as if it had received it. This saves
+ *                 the bytes of the chain on each full handshake.
+ *
+ * \note           The chain is verified on each handshake as usual, so that
+ *                 a chain that no longer verifies is rejected.
+ *
+ * \param ssl      SSL context
+ * \param chain    Chain of the server, for example a copy of the chain
+ *                 returned by mbedtls_ssl_get_peer_cert() after an earlier
+ *                 handshake. It must stay valid, and unchanged, until the
+ *                 handshakes using it are over. \c NULL to send no
+ *                 cached_info extension.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl is not a client.
+ * \return         #MBEDTLS_ERR_SSL_INTERNAL_ERROR if the chain cannot be
+ *                 hashed.
+ */
+int mbedtls_ssl_set_cached_server_chain(mbedtls_ssl_context *ssl,
+                                        const mbedtls_x509_crt *chain);
+#endif /* MBEDTLS_SSL_CACHED_INFO */
 #endif /* MBEDTLS_SSL_CLI_C */
 
 /**
@@ -3411,6 +5400,28 @@ void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf,
 
 void mbedtls_ssl_conf_tls13_key_exchange_modes(mbedtls_ssl_config *conf,
                                                const int kex_modes);
+
+/**
+ * \brief   Set the number of records after which the TLS 1.3 application
+ *          traffic keys are updated.
+ *
+ *          When this many records have been sent with the same key, a
+ *          KeyUpdate message is sent and the next records are protected with
+ *          the next key. When this many records have been received with the
+ *          same key, the KeyUpdate sent asks the peer to update its key as
+ *          well. Since a record carries at most 2^14 bytes, this also bounds
+ *          the amount of data protected with a key.
+ *
+ * \note    The default value is \c MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS,
+ *          within the AES-GCM and AES-CCM usage limits of RFC 8446,
+ *          section 5.5.
+ *
+ * \param conf    SSL configuration
+ * \param records Number of records, or 0 to only update keys with
+ *                mbedtls_ssl_tls13_key_update() and when the peer asks for it.
+ */
+void mbedtls_ssl_conf_tls13_key_update_limit(mbedtls_ssl_config *conf,
+                                             uint32_t records);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
@@ -3481,6 +5492,30 @@ void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *conf,
                                mbedtls_x509_crt *ca_chain,
                                mbedtls_x509_crl *ca_crl);
 
+#if defined(MBEDTLS_SSL_CREDS_C)
+/**
+ * \brief          Set a slot of credentials that can be replaced while the
+ *                 configuration is in use, see mbedtls_ssl_creds_slot.
+ *
+ *                 Each handshake uses the trusted CAs and own certificates
+ *                 of the set current in the slot when it starts, instead of
+ *                 those set with mbedtls_ssl_conf_ca_chain() and
+ *                 mbedtls_ssl_conf_own_cert(), which remain in use for what
+ *                 the set does not have or while the slot has no set.
+ *
+ * \note           Certificates selected by the SNI callback still take
+ *                 precedence, and OCSP responses set with
+ *                 mbedtls_ssl_conf_own_cert_ocsp() are only sent for the
+ *                 certificates of the configuration.
+ *
+ * \param conf     SSL configuration
+ * \param slot     Slot initialized with mbedtls_ssl_creds_slot_init(), or
+ *                 \c NULL to only use the credentials of the configuration.
+ */
+void mbedtls_ssl_conf_creds(mbedtls_ssl_config *conf,
+                            struct mbedtls_ssl_creds_slot *slot);
+#endif /* MBEDTLS_SSL_CREDS_C */
+
 #if defined(MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED)
 /**
  * \brief          Set DN hints sent to client in CertificateRequest message
@@ -3493,12 +5528,8 @@ void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *conf,
  * \param crt      crt chain whose subject DNs are issuer DNs of client certs
  *                 from which the client should select client peer certificate.
  */
-static inline
 void mbedtls_ssl_conf_dn_hints(mbedtls_ssl_config *conf,
-                               const mbedtls_x509_crt *crt)
-{
-    conf->MBEDTLS_PRIVATE(dn_hints) = crt;
-}
+                               const mbedtls_x509_crt *crt);
 #endif /* MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED */
 
 #if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
@@ -3558,6 +5589,75 @@ void mbedtls_ssl_conf_ca_cb(mbedtls_ssl_config *conf,
                             void *p_ca_cb);
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
 
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+/**
+ * \brief          Set the cache of verified peer certificate chains
+ *                 (Default: none)
+ *
+ *                 When a peer presents a chain that was verified before
+ *                 against the CAs set with mbedtls_ssl_conf_ca_chain(), the
+ *                 stored result is reused instead of checking the
+ *                 signatures again. See mbedtls_x509_crt_verify_with_cache().
+ *                 The cache is not used with mbedtls_ssl_conf_ca_cb().
+ *
+ * \note           The cache can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled.
+ *
+ * \param conf     SSL configuration
+ * \param cache    Cache set up with mbedtls_x509_crt_verify_cache_setup(),
+ *                 or \c NULL to disable caching.
+ */
+void mbedtls_ssl_conf_verify_cache(mbedtls_ssl_config *conf,
+                                   mbedtls_x509_crt_verify_cache *cache);
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+/**
+ * \brief          Set the table through which sessions share identical
+ *                 peer certificate chains
+ *                 (Default: none)
+ *
+ *                 Once a peer certificate chain is verified, it is looked
+ *                 up in the table by a hash of its DER certificates. If a
+ *                 session already holds the same chain, the new session
+ *                 refers to it and the parsed copy is freed. Copies of
+ *                 the session, such as the ones made by
+ *                 mbedtls_ssl_get_session(), share it too.
+ *
+ * \note           The table can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled. Sessions
+ *                 keep their chains if the table is freed first, see
+ *                 mbedtls_ssl_peer_cert_table_free().
+ *
+ * \param conf     SSL configuration
+ * \param table    Table set up with mbedtls_ssl_peer_cert_table_setup(),
+ *                 or \c NULL to disable sharing.
+ */
+void mbedtls_ssl_conf_peer_cert_table(mbedtls_ssl_config *conf,
+                                      struct mbedtls_ssl_peer_cert_table *table);
+#endif /* MBEDTLS_SSL_PEER_CERT_TABLE_C */
+
+/**
+ * \brief          Parse peer certificate chains in lazy extension mode
+ *                 (Default: disabled)
+ *
+ *                 The subject alternative names, extended key usages and
+ *                 certificate policies of the peer certificates are then
+ *                 only decoded when used, see
+ *                 mbedtls_x509_crt_set_lazy_ext(). This makes receiving a
+ *                 long chain cheaper, since these are not needed for the
+ *                 intermediate certificates.
+ *
+ * \note           A verification callback, or an application reading the
+ *                 chain returned by mbedtls_ssl_get_peer_cert(), must call
+ *                 mbedtls_x509_crt_load_ext() before reading these fields
+ *                 directly.
+ *
+ * \param conf     SSL configuration
+ * \param enable   1 to enable lazy extension mode, 0 to disable it
+ */
+void mbedtls_ssl_conf_peer_cert_lazy_ext(mbedtls_ssl_config *conf, int enable);
+
 /**
  * \brief          Set own certificate chain and private key
  *
@@ -3597,6 +5697,152 @@ void mbedtls_ssl_conf_ca_cb(mbedtls_ssl_config *conf,
 int mbedtls_ssl_conf_own_cert(mbedtls_ssl_config *conf,
                               mbedtls_x509_crt *own_cert,
                               mbedtls_pk_context *pk_key);
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/**
+ * \brief          Set the certificate compression algorithms (TLS 1.3)
+ *
+ *                 A client offers to the server the algorithms it can
+ *                 decompress. A server sends its certificate chain
+ *                 compressed with the first of the algorithms, in the
+ *                 order of \p algs, that the client offered.
+ *
+ * \note           On server, a certificate chain is compressed when it is
+ *                 set with mbedtls_ssl_conf_own_cert() or
+ *                 mbedtls_ssl_set_hs_own_cert(), with each algorithm of
+ *                 \p algs. Call this function first: chains that were
+ *                 already set are sent uncompressed.
+ *
+ * \note           The client certificate is not compressed.
+ *
+ * \param conf         SSL configuration
+ * \param algs         List of \c MBEDTLS_SSL_CERT_COMPRESSION_XXX values,
+ *                     below 16 and terminated by
+ *                     #MBEDTLS_SSL_CERT_COMPRESSION_NONE, or NULL to disable
+ *                     compression. The list must remain available
+ *                     throughout the lifetime of the conf object.
+ * \param f_compress   Callback to compress a certificate message (server),
+ *                     or NULL.
+ * \param f_decompress Callback to decompress a certificate message (client),
+ *                     or NULL.
+ * \param p_ctx        Context for the callbacks
+ */
+void mbedtls_ssl_conf_cert_compression(mbedtls_ssl_config *conf,
+                                       const uint16_t *algs,
+                                       mbedtls_ssl_cert_compress_t *f_compress,
+                                       mbedtls_ssl_cert_decompress_t *f_decompress,
+                                       void *p_ctx);
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/**
+ * \brief          Set the key sent as a raw public key (RFC 7250, TLS 1.3)
+ *
+ *                 When the peer accepts raw public keys, the Certificate
+ *                 message carries the SubjectPublicKeyInfo of \p pk_key
+ *                 instead of a certificate chain, and \p pk_key signs the
+ *                 CertificateVerify message. A server sends it to clients
+ *                 that offer the raw public key type in their
+ *                 server_certificate_type extension, and a certificate
+ *                 chain set with mbedtls_ssl_conf_own_cert() to the others.
+ *                 A client offers it in its client_certificate_type
+ *                 extension, and sends it if the server asks for it.
+ *
+ * \param conf     SSL configuration
+ * \param pk_key   Own private key, or NULL to send certificates only.
+ *                 It must remain valid throughout the lifetime of the conf
+ *                 object.
+ *
+ * \return         0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         An \c MBEDTLS_ERR_PK_XXX or \c MBEDTLS_ERR_ASN1_XXX error
+ *                 code if the public key cannot be written.
+ */
+int mbedtls_ssl_conf_own_rpk(mbedtls_ssl_config *conf,
+                             mbedtls_pk_context *pk_key);
+
+/**
+ * \brief          Accept raw public keys from the peer (RFC 7250, TLS 1.3)
+ *
+ *                 A client offers the raw public key type in its
+ *                 server_certificate_type extension, and a server accepts
+ *                 it in the client_certificate_type extension of the
+ *                 clients it asks for a certificate. The peers that use it
+ *                 send no certificate chain: \p f_rpk_vrfy verifies their
+ *                 key instead of the CA chain, and the name of the peer is
+ *                 not checked. Peers that send certificates are verified as
+ *                 usual.
+ *
+ * \param conf         SSL configuration
+ * \param f_rpk_vrfy   Verification callback, or NULL to accept certificates
+ *                     only.
+ * \param p_rpk_vrfy   Context for the callback
+ */
+void mbedtls_ssl_conf_rpk_verify(mbedtls_ssl_config *conf,
+                                 mbedtls_ssl_rpk_vrfy_t *f_rpk_vrfy,
+                                 void *p_rpk_vrfy);
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+/**
+ * \brief          Request the OCSP response of the server with the
+ *                 status_request extension (client only, TLS 1.3)
+ *                 (Default: disabled)
+ *
+ *                 The response stapled by the server is checked while
+ *                 verifying its chain, see mbedtls_x509_crt_set_ocsp_response():
+ *                 a revoked certificate, or a response that is not valid,
+ *                 fails the verification. A server that staples no
+ *                 response is verified as usual.
+ *
+ * \param conf     SSL configuration
+ * \param enable   1 to request the response, 0 not to
+ */
+void mbedtls_ssl_conf_ocsp_stapling(mbedtls_ssl_config *conf, int enable);
+
+/**
+ * \brief          Set the OCSP response stapled to a certificate chain
+ *                 (server only, TLS 1.3)
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The response is sent to the clients that request it. It
+ *                 can be replaced at any time, including while handshakes
+ *                 are using \p conf, and is not checked: it is up to the
+ *                 client to verify it.
+ *
+ * \param conf     SSL configuration
+ * \param own_cert Certificate chain set with mbedtls_ssl_conf_own_cert()
+ * \param resp     DER-encoded OCSPResponse about the first certificate of
+ *                 \p own_cert, which is copied
+ * \param resp_len Length of \p resp, or \c 0 to staple no response
+ * \param refresh_at Time after which the callback set with
+ *                 mbedtls_ssl_conf_ocsp_refresh() is asked for a new
+ *                 response, typically some time before the nextUpdate of
+ *                 \p resp, or \c 0 for never
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p own_cert was not set
+ *                 with mbedtls_ssl_conf_own_cert() or \p resp is too large.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_conf_own_cert_ocsp(mbedtls_ssl_config *conf,
+                                   const mbedtls_x509_crt *own_cert,
+                                   const unsigned char *resp, size_t resp_len,
+                                   mbedtls_time_t refresh_at);
+
+/**
+ * \brief          Set the callback that refreshes stapled OCSP responses
+ *                 (server only)
+ *
+ * \param conf     SSL configuration
+ * \param f_refresh Refresh callback, or NULL to keep the responses
+ * \param p_refresh Context for the callback
+ */
+void mbedtls_ssl_conf_ocsp_refresh(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_ocsp_refresh_t *f_refresh,
+                                   void *p_refresh);
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_PSK_ENABLED)
@@ -3901,6 +6147,79 @@ void MBEDTLS_DEPRECATED mbedtls_ssl_conf_curves(mbedtls_ssl_config *conf,
 void mbedtls_ssl_conf_groups(mbedtls_ssl_config *conf,
                              const uint16_t *groups);
 
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+/**
+ * \brief          Set the cache of the groups selected by servers
+ *                 (client-side only, TLS 1.3 only, default: none)
+ *
+ *                 The client offers its key share for the group that the
+ *                 server, identified by the name set with
+ *                 mbedtls_ssl_set_hostname(), selected in the previous
+ *                 handshake, instead of the first group of the list set
+ *                 with mbedtls_ssl_conf_groups(). This avoids a
+ *                 HelloRetryRequest with servers preferring another group.
+ *                 The order of the supported_groups extension is unchanged.
+ *
+ * \note           The cache can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled.
+ *
+ * \param conf     SSL configuration
+ * \param cache    Cache set up with mbedtls_ssl_group_cache_setup(),
+ *                 or \c NULL to always offer the first group.
+ */
+void mbedtls_ssl_conf_group_cache(mbedtls_ssl_config *conf,
+                                  struct mbedtls_ssl_group_cache *cache);
+#endif /* MBEDTLS_SSL_GROUP_CACHE_C */
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+/**
+ * \brief          Set the pool of pre-generated ephemeral key pairs
+ *                 (Default: none)
+ *
+ *                 The key pairs of TLS 1.3 key shares and of TLS 1.2 ECDHE
+ *                 key exchanges are taken from the pool when it has one
+ *                 ready for the group, and generated during the handshake
+ *                 otherwise. Each key pair is used for a single handshake.
+ *
+ * \note           The pool can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled. It must
+ *                 outlive the handshakes of the configuration.
+ *
+ * \param conf     SSL configuration
+ * \param pool     Pool set up with mbedtls_ssl_key_share_pool_setup(),
+ *                 or \c NULL to generate every key pair in the handshake.
+ */
+void mbedtls_ssl_conf_key_share_pool(mbedtls_ssl_config *conf,
+                                     struct mbedtls_ssl_key_share_pool *pool);
+#endif /* MBEDTLS_SSL_KEY_SHARE_POOL_C */
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+/**
+ * \brief          Let TLS 1.2 ECDHE key exchanges of a server reuse their
+ *                 ephemeral key pair for a bounded window (Default: none)
+ *
+ *                 With ECDHE_RSA and ECDHE_ECDSA cipher suites, the key
+ *                 pair of the ServerKeyExchange message is the current one
+ *                 of \p ctx for the group, which serves handshakes until
+ *                 the window set with mbedtls_ssl_ecdhe_reuse_setup() is
+ *                 over. This saves a key generation per full handshake, at
+ *                 the cost of forward secrecy between the sessions sharing
+ *                 a key pair: see ::mbedtls_ssl_ecdhe_reuse before enabling
+ *                 it. A key pair taken from \p ctx takes precedence over the
+ *                 key share pool.
+ *
+ * \note           The context can be shared between configurations and
+ *                 threads if MBEDTLS_THREADING_C is enabled. It must
+ *                 outlive the handshakes of the configuration.
+ *
+ * \param conf     SSL configuration
+ * \param ctx      Context set up with mbedtls_ssl_ecdhe_reuse_setup(), or
+ *                 \c NULL to use a fresh key pair in every handshake.
+ */
+void mbedtls_ssl_conf_ecdhe_reuse(mbedtls_ssl_config *conf,
+                                  struct mbedtls_ssl_ecdhe_reuse *ctx);
+#endif /* MBEDTLS_SSL_ECDHE_REUSE_C */
+
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
 #if !defined(MBEDTLS_DEPRECATED_REMOVED) && defined(MBEDTLS_SSL_PROTO_TLS1_2)
 /**
@@ -4103,6 +6422,42 @@ void mbedtls_ssl_conf_sni(mbedtls_ssl_config *conf,
                           void *p_sni);
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
 
+#if defined(MBEDTLS_SSL_SRV_C)
+/**
+ * \brief          Extract the routing information of a TLS ClientHello
+ *                 from the first bytes received on a connection, without an
+ *                 SSL context.
+ *
+ *                 This lets a front-end pick a backend or a configuration
+ *                 based on the ServerName and ALPN extensions, then forward
+ *                 the bytes as they are or hand them to an SSL context set
+ *                 up accordingly. The function does not allocate memory and
+ *                 does not modify \p buf.
+ *
+ * \note           The ClientHello must be in the first record (TLS only,
+ *                 not DTLS). Only the framing of the message and of the
+ *                 extensions reported in \p info is checked: a successful
+ *                 return does not mean a handshake would succeed.
+ *
+ * \param buf      The bytes received, starting with the record header
+ * \param len      Number of bytes in \p buf
+ * \param info     On success, the routing information. Its pointers point
+ *                 into \p buf.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_WANT_READ if \p buf does not hold the
+ *                 whole first record yet.
+ * \return         #MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE if the record is not
+ *                 a handshake record starting with a ClientHello.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the ClientHello
+ *                 is fragmented over several records.
+ * \return         #MBEDTLS_ERR_SSL_DECODE_ERROR if the ClientHello is
+ *                 malformed.
+ */
+int mbedtls_ssl_parse_client_hello_info(const unsigned char *buf, size_t len,
+                                        mbedtls_ssl_client_hello_info *info);
+#endif /* MBEDTLS_SSL_SRV_C */
+
 #if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
 /**
  * \brief          Set the EC J-PAKE password for current handshake.
@@ -4140,36 +6495,106 @@ int mbedtls_ssl_set_hs_ecjpake_password(mbedtls_ssl_context *ssl,
  *
  * \return         0 on success, or a negative error code.
  */
-int mbedtls_ssl_set_hs_ecjpake_password_opaque(mbedtls_ssl_context *ssl,
-                                               mbedtls_svc_key_id_t pwd);
-#endif /*MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED */
+int mbedtls_ssl_set_hs_ecjpake_password_opaque(mbedtls_ssl_context *ssl,
+                                               mbedtls_svc_key_id_t pwd);
+#endif /*MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED */
+
+#if defined(MBEDTLS_SSL_ALPN)
+/**
+ * \brief          Set the supported Application Layer Protocols.
+ *
+ * \param conf     SSL configuration
+ * \param protos   Pointer to a NULL-terminated list of supported protocols,
+ *                 in decreasing preference order. The pointer to the list is
+ *                 recorded by the library for later reference as required, so
+ *                 the lifetime of the table must be at least as long as the
+ *                 lifetime of the SSL configuration structure.
+ *
+ * \return         0 on success, or MBEDTLS_ERR_SSL_BAD_INPUT_DATA.
+ */
+int mbedtls_ssl_conf_alpn_protocols(mbedtls_ssl_config *conf, const char **protos);
+
+/**
+ * \brief          Get the name of the negotiated Application Layer Protocol.
+ *                 This function should be called after the handshake is
+ *                 completed.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         Protocol name, or NULL if no protocol was negotiated.
+ */
+const char *mbedtls_ssl_get_alpn_protocol(const mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_ALPN */
+
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+/**
+ * \brief          Initialize a configuration overlay, which then overrides
+ *                 nothing.
+ *
+ * \param overlay  Overlay to initialize
+ */
+void mbedtls_ssl_config_overlay_init(mbedtls_ssl_config_overlay *overlay);
+
+/**
+ * \brief          Override the ciphersuites of the configuration, see
+ *                 mbedtls_ssl_conf_ciphersuites().
+ *
+ * \param overlay  Overlay to modify
+ * \param ciphersuites  A 0-terminated list of ciphersuites, not copied, or
+ *                 NULL to use those of the configuration.
+ */
+void mbedtls_ssl_overlay_ciphersuites(mbedtls_ssl_config_overlay *overlay,
+                                      const int *ciphersuites);
 
 #if defined(MBEDTLS_SSL_ALPN)
 /**
- * \brief          Set the supported Application Layer Protocols.
+ * \brief          Override the ALPN protocols of the configuration, see
+ *                 mbedtls_ssl_conf_alpn_protocols().
  *
- * \param conf     SSL configuration
- * \param protos   Pointer to a NULL-terminated list of supported protocols,
- *                 in decreasing preference order. The pointer to the list is
- *                 recorded by the library for later reference as required, so
- *                 the lifetime of the table must be at least as long as the
- *                 lifetime of the SSL configuration structure.
+ * \param overlay  Overlay to modify
+ * \param protos   A NULL-terminated list of protocols, not copied, or NULL
+ *                 to use those of the configuration.
  *
  * \return         0 on success, or MBEDTLS_ERR_SSL_BAD_INPUT_DATA.
  */
-int mbedtls_ssl_conf_alpn_protocols(mbedtls_ssl_config *conf, const char **protos);
+int mbedtls_ssl_overlay_alpn_protocols(mbedtls_ssl_config_overlay *overlay,
+                                       const char **protos);
+#endif /* MBEDTLS_SSL_ALPN */
 
 /**
- * \brief          Get the name of the negotiated Application Layer Protocol.
- *                 This function should be called after the handshake is
- *                 completed.
+ * \brief          Override the authentication mode of the configuration,
+ *                 see mbedtls_ssl_conf_authmode().
  *
- * \param ssl      SSL context
+ * \note           mbedtls_ssl_set_hs_authmode() still takes precedence over
+ *                 the overlay for the handshake it is called in.
  *
- * \return         Protocol name, or NULL if no protocol was negotiated.
+ * \param overlay  Overlay to modify
+ * \param authmode MBEDTLS_SSL_VERIFY_NONE, MBEDTLS_SSL_VERIFY_OPTIONAL,
+ *                 MBEDTLS_SSL_VERIFY_REQUIRED, or MBEDTLS_SSL_VERIFY_UNSET to
+ *                 use that of the configuration.
  */
-const char *mbedtls_ssl_get_alpn_protocol(const mbedtls_ssl_context *ssl);
-#endif /* MBEDTLS_SSL_ALPN */
+void mbedtls_ssl_overlay_authmode(mbedtls_ssl_config_overlay *overlay,
+                                  int authmode);
+
+/**
+ * \brief          Attach a configuration overlay to a context.
+ *
+ *                 The context takes the settings the overlay overrides from
+ *                 the overlay, and the others from its configuration. An
+ *                 overlay can be shared by any number of contexts.
+ *
+ * \note           Call this before the handshake starts. The overlay is
+ *                 kept across mbedtls_ssl_session_reset().
+ *
+ * \warning        The overlay is not copied. It must not be modified while
+ *                 a handshake uses it, and must outlive the context.
+ *
+ * \param ssl      SSL context
+ * \param overlay  Overlay, or NULL to detach the current one
+ */
+void mbedtls_ssl_set_config_overlay(mbedtls_ssl_context *ssl,
+                                    const mbedtls_ssl_config_overlay *overlay);
+#endif /* MBEDTLS_SSL_CONFIG_OVERLAY */
 
 #if defined(MBEDTLS_SSL_DTLS_SRTP)
 #if defined(MBEDTLS_DEBUG_C)
@@ -4396,6 +6821,35 @@ void mbedtls_ssl_conf_encrypt_then_mac(mbedtls_ssl_config *conf, char etm);
 void mbedtls_ssl_conf_extended_master_secret(mbedtls_ssl_config *conf, char ems);
 #endif /* MBEDTLS_SSL_EXTENDED_MASTER_SECRET */
 
+#if defined(MBEDTLS_SSL_FALSE_START)
+/**
+ * \brief           Enable or disable TLS False Start (RFC 7918)
+ *                  (client-side only, TLS 1.2 only, TLS only,
+ *                  Default: MBEDTLS_SSL_FALSE_START_DISABLED)
+ *
+ *                  In a full TLS 1.2 handshake with a forward-secret key
+ *                  exchange and an AEAD cipher, mbedtls_ssl_handshake()
+ *                  then returns \c 0 as soon as the client Finished message
+ *                  is sent, and mbedtls_ssl_write() sends application data
+ *                  without waiting for the server ChangeCipherSpec and
+ *                  Finished messages. This saves one round trip before the
+ *                  first request. The next mbedtls_ssl_read() completes the
+ *                  handshake, and mbedtls_ssl_is_handshake_over() only
+ *                  returns \c 1 after that.
+ *
+ * \warning         The data is sent before the server proved that it saw
+ *                  the same handshake. An attacker able to break the
+ *                  negotiated key exchange or cipher could read it, which
+ *                  is why only forward-secret AEAD ciphersuites are allowed.
+ *                  Other handshakes and resumptions run to their end.
+ *
+ * \param conf      SSL configuration
+ * \param false_start MBEDTLS_SSL_FALSE_START_ENABLED or
+ *                  MBEDTLS_SSL_FALSE_START_DISABLED
+ */
+void mbedtls_ssl_conf_false_start(mbedtls_ssl_config *conf, int false_start);
+#endif /* MBEDTLS_SSL_FALSE_START */
+
 #if defined(MBEDTLS_SSL_SRV_C)
 /**
  * \brief          Whether to send a list of acceptable CAs in
@@ -4448,6 +6902,51 @@ void mbedtls_ssl_conf_cert_req_ca_list(mbedtls_ssl_config *conf,
 int mbedtls_ssl_conf_max_frag_len(mbedtls_ssl_config *conf, unsigned char mfl_code);
 #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
 
+/**
+ * \brief          Set the maximum content length of the records received
+ *                 and sent by the contexts using this configuration, which
+ *                 sizes their record buffers.
+ *                 (Default: #MBEDTLS_SSL_IN_CONTENT_LEN and
+ *                 #MBEDTLS_SSL_OUT_CONTENT_LEN)
+ *
+ *                 This lets a single build serve both constrained peers,
+ *                 with small buffers, and peers that need full 16 KiB
+ *                 records, with one configuration for each.
+ *
+ * \param conf     SSL configuration
+ * \param in_len   Maximum content of an incoming record, in bytes, or 0 for
+ *                 #MBEDTLS_SSL_IN_CONTENT_LEN.
+ * \param out_len  Maximum content of an outgoing record, in bytes, or 0 for
+ *                 #MBEDTLS_SSL_OUT_CONTENT_LEN.
+ *
+ * 
+ote           The compile-time values are the upper bounds. Values below
+ *                 512 are rejected, as are handshake messages that do not
+ *                 fit in a record, so \p out_len must leave room for the
+ *                 certificate chain with TLS.
+ *
+ * 
+ote           The peer is only told about \p in_len with the record
+ *                 size limit extension (see #MBEDTLS_SSL_RECORD_SIZE_LIMIT).
+ *                 Otherwise, it must be kept under it by other means, e.g.
+ *                 the maximum fragment length extension negotiated by the
+ *                 client, see mbedtls_ssl_conf_max_frag_len().
+ *
+ * 
+ote           With #MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH, the buffers are
+ *                 sized for these values during the handshake, then shrunk
+ *                 to the negotiated record sizes once it is over.
+ *
+ * 
+ote           This setting must be chosen before calling
+ *                 mbedtls_ssl_setup().
+ *
+ * \return         0 if successful, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a
+ *                 length is out of range.
+ */
+int mbedtls_ssl_conf_max_content_len(mbedtls_ssl_config *conf,
+                                     size_t in_len, size_t out_len);
+
 #if defined(MBEDTLS_SSL_SRV_C)
 /**
  * \brief          Pick the ciphersuites order according to the second parameter
@@ -4499,10 +6998,63 @@ void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config *conf, int use_tickets)
  */
 void mbedtls_ssl_conf_new_session_tickets(mbedtls_ssl_config *conf,
                                           uint16_t num_tickets);
+
+/**
+ * \brief   Issue TLS 1.3 session tickets backed by the session cache
+ *          (server only).
+ *
+ *          When enabled, and a session cache is set with
+ *          mbedtls_ssl_conf_session_cache(), the server stores the state
+ *          of each ticket it issues in the cache, under a random
+ *          identifier of 16 bytes, and sends that identifier as the
+ *          ticket instead of the output of the ticket write callback. An
+ *          offered identity of that length is looked up in the cache
+ *          before it is passed to the ticket parse callback, if any.
+ *          This is the TLS 1.3 counterpart of the session ID resumption
+ *          of TLS 1.2: no ticket key is needed and the tickets can be
+ *          revoked by removing them from the cache, at the cost of a
+ *          cache entry per ticket.
+ *
+ * \note    The cache entry outlives neither the cache timeout nor
+ *          \p lifetime, whichever is shorter: to let clients know, set
+ *          \p lifetime to at most the cache timeout.
+ *
+ * \param conf      SSL configuration
+ * \param lifetime  Lifetime of the tickets in seconds, at most
+ *                  604800 (7 days), or \c 0 to disable (default).
+ */
+void mbedtls_ssl_conf_tls13_stateful_tickets(mbedtls_ssl_config *conf,
+                                             uint32_t lifetime);
 #endif /* MBEDTLS_SSL_SESSION_TICKETS &&
           MBEDTLS_SSL_SRV_C &&
           MBEDTLS_SSL_PROTO_TLS1_3*/
 
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_PROTO_TLS1_3)
+/**
+ * \brief   Bound the work spent on the PSK identities offered in a TLS 1.3
+ *          ClientHello (server only).
+ *
+ *          The server looks the offered identities up in order and stops at
+ *          the first usable one, whose binder is then checked. The
+ *          identities beyond \p max_identities, and the session tickets
+ *          beyond \p max_tickets, are not looked up: this bounds the
+ *          number of ticket decryptions and PSK callback calls that a
+ *          client offering many stale tickets can cause. If no identity is
+ *          usable within the limits, the server goes on with a full
+ *          handshake when the configured key exchange modes allow it.
+ *
+ * \note    The default is no limit (\c 0xFFFF for both).
+ *
+ * \param conf            SSL configuration
+ * \param max_identities  Maximum number of offered identities to look up.
+ * \param max_tickets     Maximum number of offered identities to decrypt
+ *                        as session tickets.
+ */
+void mbedtls_ssl_conf_tls13_psk_limits(mbedtls_ssl_config *conf,
+                                       uint16_t max_identities,
+                                       uint16_t max_tickets);
+#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_PROTO_TLS1_3 */
+
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
 /**
  * \brief          Enable / Disable renegotiation support for connection when
@@ -4638,7 +7190,10 @@ void mbedtls_ssl_conf_renegotiation_period(mbedtls_ssl_config *conf,
  *                 also signal pending data, but the converse does
  *                 not hold. For example, in DTLS there might be
  *                 further records waiting to be processed from
- *                 the current underlying transport's datagram.
+ *                 the current underlying transport's datagram, and
+ *                 in TLS with read-ahead enabled (see
+ *                 mbedtls_ssl_conf_read_ahead()) further records
+ *                 might already have been read from the stream.
  *
  * \note           If this function returns 1 (data pending), this
  *                 does not imply that a subsequent call to
@@ -4662,6 +7217,33 @@ void mbedtls_ssl_conf_renegotiation_period(mbedtls_ssl_config *conf,
  */
 int mbedtls_ssl_check_pending(const mbedtls_ssl_context *ssl);
 
+/**
+ * \brief          Release the input and output record buffers of an idle
+ *                 connection.
+ *
+ *                 The buffers are given back to the allocator (see
+ *                 mbedtls_ssl_conf_buffer_alloc()) and are acquired again
+ *                 automatically by the next call that needs them, such as
+ *                 mbedtls_ssl_read(), mbedtls_ssl_write() or
+ *                 mbedtls_ssl_close_notify(). This saves about 33 KiB per
+ *                 connection for connections that are idle most of the time.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         \c 0 if successful, or if the buffers were already
+ *                 released.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the handshake is not
+ *                 complete or if the connection is not idle: incoming data
+ *                 is pending (see mbedtls_ssl_check_pending()) or outgoing
+ *                 data has not been flushed yet. The buffers are kept in
+ *                 that case.
+ *
+ * \note           Once the buffers have been released, the next read or write
+ *                 may fail with #MBEDTLS_ERR_SSL_ALLOC_FAILED. The connection
+ *                 is still usable in that case, and the call can be retried.
+ */
+int mbedtls_ssl_release_buffers(mbedtls_ssl_context *ssl);
+
 /**
  * \brief          Return the number of application data bytes
  *                 remaining to be read from the current record.
@@ -4679,6 +7261,16 @@ int mbedtls_ssl_check_pending(const mbedtls_ssl_context *ssl);
  */
 size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl);
 
+/**
+ * \brief          Return the number of bytes of protected records waiting
+ *                 to be sent, see mbedtls_ssl_conf_write_queue().
+ *
+ * \param ssl      SSL context
+ *
+ * \return         How many bytes are left in the output buffer.
+ */
+size_t mbedtls_ssl_get_bytes_unsent(const mbedtls_ssl_context *ssl);
+
 /**
  * \brief          Return the result of the certificate verification
  *
@@ -4748,6 +7340,47 @@ const char *mbedtls_ssl_get_version(const mbedtls_ssl_context *ssl);
  */
 int mbedtls_ssl_get_record_expansion(const mbedtls_ssl_context *ssl);
 
+#if defined(MBEDTLS_SSL_STATS)
+/**
+ * \brief          Return the counters of an SSL context
+ *
+ * \param ssl      SSL context
+ *
+ * \return         The counters since the context was set up or last reset.
+ *                 They are updated as the context is used.
+ */
+const mbedtls_ssl_stats *mbedtls_ssl_get_stats(const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Set the counters that the counters of an SSL context are
+ *                 added to when it is reset or freed
+ *
+ *                 This aggregates the counters of many connections without
+ *                 walking them. A server that handles each connection in
+ *                 one thread can give each thread its own \p sink, for
+ *                 example a thread-local variable, and add them up with
+ *                 mbedtls_ssl_stats_add() when it reports them: the sink
+ *                 is updated without locking.
+ *
+ * \param ssl      SSL context
+ * \param sink     Counters to add to, or \c NULL. It stays set across
+ *                 session resets, and must remain valid until it is
+ *                 replaced or \p ssl is freed. It must not be updated by
+ *                 another thread while \p ssl is reset or freed.
+ */
+void mbedtls_ssl_set_stats_sink(mbedtls_ssl_context *ssl,
+                                mbedtls_ssl_stats *sink);
+
+/**
+ * \brief          Add counters to a total
+ *
+ * \param total    Counters to add to
+ * \param stats    Counters to add
+ */
+void mbedtls_ssl_stats_add(mbedtls_ssl_stats *total,
+                           const mbedtls_ssl_stats *stats);
+#endif /* MBEDTLS_SSL_STATS */
+
 /**
  * \brief          Return the current maximum outgoing record payload in bytes.
  *
@@ -4877,12 +7510,16 @@ int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl,
  *                 mbedtls_ssl_conf_async_private_cb()) - in this case you
  *                 must call this function again when the operation is ready.
  * \return         #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS if a cryptographic
- *                 operation is in progress (see mbedtls_ecp_set_max_ops()) -
- *                 in this case you must call this function again to complete
- *                 the handshake when you're done attending other tasks.
+ *                 operation is in progress (see mbedtls_ecp_set_max_ops())
+ *                 or the handshake ran the steps allowed per call (see
+ *                 mbedtls_ssl_conf_handshake_max_steps()) - in this case you
+ *                 must call this function again to complete the handshake
+ *                 when you're done attending other tasks.
  * \return         #MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED if DTLS is in use
- *                 and the client did not demonstrate reachability yet - in
- *                 this case you must stop using the context (see below).
+ *                 and the client did not demonstrate reachability yet, or
+ *                 a TLS 1.3 server sent a stateless HelloRetryRequest (see
+ *                 mbedtls_ssl_conf_tls13_hrr_cookies()) - in this case you
+ *                 must stop using the context (see below).
  * \return         #MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA if early data, as
  *                 defined in RFC 8446 (TLS 1.3 specification), has been
  *                 received as part of the handshake. This is server specific
@@ -5003,6 +7640,39 @@ int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl);
 int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl);
 #endif /* MBEDTLS_SSL_RENEGOTIATION */
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+/**
+ * \brief          Update the TLS 1.3 application traffic keys of the running
+ *                 connection with a KeyUpdate message.
+ *
+ *                 The records sent after the KeyUpdate are protected with the
+ *                 next application traffic secret. The keys of the current
+ *                 transform are replaced in place, without allocation.
+ *
+ * \param ssl      SSL context, with a TLS 1.3 handshake completed
+ * \param request  #MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED to ask the peer
+ *                 to update its sending keys as well, or
+ *                 #MBEDTLS_SSL_TLS1_3_KEY_UPDATE_NOT_REQUESTED.
+ *
+ * \note           If application data of a previous call to mbedtls_ssl_write()
+ *                 is not completely sent yet, the KeyUpdate is sent after it,
+ *                 by the next call to mbedtls_ssl_write() or mbedtls_ssl_read().
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_WANT_WRITE if the KeyUpdate is not
+ *                 completely sent yet. Call this function again, or
+ *                 mbedtls_ssl_write() or mbedtls_ssl_read(), to finish sending
+ *                 it. No other KeyUpdate is sent meanwhile.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the handshake is not over
+ *                 or the negotiated version is not TLS 1.3.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if record protection is
+ *                 offloaded with mbedtls_ssl_ktls_start().
+ * \return         Another negative error code on failure, after which the
+ *                 context must not be used for reading or writing.
+ */
+int mbedtls_ssl_tls13_key_update(mbedtls_ssl_context *ssl, int request);
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
 /**
  * \brief          Read at most 'len' application data bytes
  *
@@ -5087,9 +7757,78 @@ int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl);
  *                   being processed may contain further DTLS records. You should call
  *                   \c mbedtls_ssl_check_pending to check for remaining records.
  *
+ * \note           With MBEDTLS_SSL_FULL_DUPLEX, once the handshake is over,
+ *                 one thread may call this function (or
+ *                 mbedtls_ssl_read_peek() and mbedtls_ssl_read_consume())
+ *                 while another calls mbedtls_ssl_write(),
+ *                 mbedtls_ssl_writev(), mbedtls_ssl_close_notify() or
+ *                 mbedtls_ssl_tls13_key_update() on the same context. The
+ *                 send and receive callbacks must then support being called
+ *                 concurrently, as mbedtls_net_send() and mbedtls_net_recv()
+ *                 do. Reading only overlaps writing over TLS with
+ *                 renegotiation disabled; otherwise the calls are merely
+ *                 serialised. Two readers or two writers are not supported,
+ *                 nor are other functions, such as mbedtls_ssl_renegotiate()
+ *                 or mbedtls_ssl_release_buffers(), while a call is in
+ *                 progress in another thread.
+ *
  */
 int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
 
+/**
+ * \brief          Expose decrypted application data without copying it.
+ *
+ *                 This function behaves like mbedtls_ssl_read(), including
+ *                 driving the handshake and renegotiation as needed, but
+ *                 instead of copying the plaintext into a caller-provided
+ *                 buffer it makes \p *buf point directly to the decrypted
+ *                 data of the current record inside the SSL context. The
+ *                 data stays available until it is released with
+ *                 mbedtls_ssl_read_consume().
+ *
+ * \param ssl      SSL context
+ * \param buf      On success, set to the start of the available application
+ *                 data. Set to \c NULL if no data is returned.
+ * \param len      On success, set to the number of bytes available at
+ *                 \p *buf. Set to \c 0 if no data is returned.
+ *
+ * \return         The (positive) number of bytes available at \p *buf.
+ * \return         \c 0 if the read end of the underlying transport was closed
+ *                 or an empty application data record was received, with
+ *                 the same meaning as for mbedtls_ssl_read().
+ * \return         Any other return value of mbedtls_ssl_read(), with the
+ *                 same meaning and the same requirements on how to proceed.
+ *
+ * \note           Calling this function again without consuming any data
+ *                 returns the same data again.
+ *
+ * \warning        The data at \p *buf is owned by the SSL context. It is only
+ *                 valid until the next call to mbedtls_ssl_read_consume() and
+ *                 must not be accessed after any other function is called on
+ *                 \p ssl.
+ */
+int mbedtls_ssl_read_peek(mbedtls_ssl_context *ssl,
+                          const unsigned char **buf, size_t *len);
+
+/**
+ * \brief          Release application data previously exposed by
+ *                 mbedtls_ssl_read_peek().
+ *
+ * \param ssl      SSL context
+ * \param len      Number of bytes to release, from the start of the data
+ *                 returned by the last call to mbedtls_ssl_read_peek(). It
+ *                 may be less than the number of bytes available, in which
+ *                 case the next call to mbedtls_ssl_read_peek() or
+ *                 mbedtls_ssl_read() returns the remaining data first.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p len is larger than
+ *                 the amount of application data currently available.
+ *
+ * \note           The released plaintext is wiped from the internal buffer.
+ */
+int mbedtls_ssl_read_consume(mbedtls_ssl_context *ssl, size_t len);
+
 /**
  * \brief          Try to write exactly 'len' application data bytes
  *
@@ -5112,8 +7851,10 @@ int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
  *                 when the underlying transport is ready for the operation.
  * \return         #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if an asynchronous
  *                 operation is in progress (see
- *                 mbedtls_ssl_conf_async_private_cb()) - in this case you
- *                 must call this function again when the operation is ready.
+ *                 mbedtls_ssl_conf_async_private_cb() and
+ *                 mbedtls_ssl_conf_record_pipeline_async()) - in this case
+ *                 you must call this function again when the operation is
+ *                 ready.
  * \return         #MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS if a cryptographic
  *                 operation is in progress (see mbedtls_ecp_set_max_ops()) -
  *                 in this case you must call this function again to complete
@@ -5140,12 +7881,16 @@ int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
  *                 on it before re-using it for a new connection; the current
  *                 connection must be closed.
  *
- * \note           When this function returns #MBEDTLS_ERR_SSL_WANT_WRITE/READ,
+ * \note           When this function returns #MBEDTLS_ERR_SSL_WANT_WRITE/READ
+ *                 or, for records protected asynchronously,
+ *                 #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS,
  *                 it must be called later with the *same* arguments,
  *                 until it returns a value greater than or equal to 0. When
  *                 the function returns #MBEDTLS_ERR_SSL_WANT_WRITE there may be
  *                 some partial data in the output buffer, however this is not
- *                 yet sent.
+ *                 yet sent. With mbedtls_ssl_conf_write_queue(), the data is
+ *                 taken as soon as it is protected instead, and the next call
+ *                 may pass different arguments.
  *
  * \note           If the requested length is greater than the maximum
  *                 fragment length (either the built-in limit or the one set
@@ -5153,13 +7898,226 @@ int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len);
  *                 - with TLS, less bytes than requested are written.
  *                 - with DTLS, MBEDTLS_ERR_SSL_BAD_INPUT_DATA is returned.
  *                 \c mbedtls_ssl_get_max_out_record_payload() may be used to
- *                 query the active maximum fragment length.
+ *                 query the active maximum fragment length. With TLS, if
+ *                 write batching is enabled with
+ *                 mbedtls_ssl_conf_write_batch(), up to that many records
+ *                 are written and flushed together by a single call.
  *
  * \note           Attempting to write 0 bytes will result in an empty TLS
  *                 application record being sent.
+ *
+ * \note           With MBEDTLS_SSL_FULL_DUPLEX, this function may be called
+ *                 while another thread is in mbedtls_ssl_read(), see there.
  */
 int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len);
 
+/**
+ * \brief          One fragment of application data for mbedtls_ssl_writev().
+ */
+typedef struct mbedtls_ssl_iovec {
+    const unsigned char *base;  /*!< Start of the fragment. May be \c NULL
+                                 *   if \c len is \c 0. */
+    size_t len;                 /*!< Length of the fragment in bytes. */
+} mbedtls_ssl_iovec;
+
+/**
+ * \brief          Try to write application data gathered from several
+ *                 buffers.
+ *
+ *                 This function behaves like mbedtls_ssl_write() on the
+ *                 concatenation of the \p iovcnt fragments described by
+ *                 \p iov, without the caller having to assemble them in
+ *                 a contiguous buffer first. The fragments are gathered
+ *                 directly into the outgoing record, and as many bytes as
+ *                 fit in a single record are sent per call, so that
+ *                 small fragments do not each cost a record.
+ *
+ * \warning        This function will do partial writes in some cases. If the
+ *                 return value is non-negative but less than the total
+ *                 length of the fragments, the function must be called
+ *                 again with the fragments advanced by the number of bytes
+ *                 written, until all the data has been written.
+ *
+ * \param ssl      SSL context
+ * \param iov      Array of \p iovcnt fragments. This may be \c NULL if
+ *                 \p iovcnt is \c 0.
+ * \param iovcnt   The number of entries in \p iov.
+ *
+ * \return         The (non-negative) number of bytes actually written if
+ *                 successful (may be less than the total length of the
+ *                 fragments).
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p iov is \c NULL
+ *                 while \p iovcnt is not \c 0.
+ * \return         Any of the other error codes documented for
+ *                 mbedtls_ssl_write(), with the same meaning and the same
+ *                 requirements on the caller.
+ *
+ * \note           When this function returns #MBEDTLS_ERR_SSL_WANT_WRITE/READ,
+ *                 it must be called later with the *same* arguments,
+ *                 until it returns a value greater than or equal to 0.
+ *
+ * \note           If the total length of the fragments is greater than the
+ *                 maximum fragment length, then:
+ *                 - with TLS, less bytes than requested are written.
+ *                 - with DTLS, MBEDTLS_ERR_SSL_BAD_INPUT_DATA is returned.
+ */
+int mbedtls_ssl_writev(mbedtls_ssl_context *ssl,
+                       const mbedtls_ssl_iovec *iov, size_t iovcnt);
+
+/**
+ * \brief          Callback type: read the next bytes of the data written by
+ *                 mbedtls_ssl_write_from(), for example from a file.
+ *
+ * \param ctx      Context given to mbedtls_ssl_write_from()
+ * \param buf      Plaintext area of the outgoing record, to fill
+ * \param len      Number of bytes to read
+ *
+ * \return         The number of bytes read, at most \p len, or \c 0 at the
+ *                 end of the data.
+ * \return         A negative error code on failure.
+ */
+typedef int mbedtls_ssl_write_source_t(void *ctx, unsigned char *buf,
+                                       size_t len);
+
+/**
+ * \brief          Try to write application data read by a callback straight
+ *                 into the outgoing records.
+ *
+ *                 This function behaves like mbedtls_ssl_write() on the next
+ *                 \p len bytes that \p f_source reads, except that they are
+ *                 read into the plaintext area of each record and protected
+ *                 in place: serving a file costs no copy from a user buffer.
+ *                 mbedtls_net_write_from_fd() uses it to send files.
+ *
+ * \warning        This function will do partial writes in some cases, as
+ *                 mbedtls_ssl_write(). \p f_source is called once per record
+ *                 for the bytes of that record only, so when this function
+ *                 returns a value \c n, \p f_source has read exactly \c n
+ *                 bytes, and the next call must start where it stopped.
+ *
+ * \param ssl      SSL context
+ * \param f_source Callback that reads the data
+ * \param p_source Context for \p f_source
+ * \param len      Number of bytes to write
+ *
+ * \return         The (non-negative) number of bytes actually written if
+ *                 successful (may be less than \p len, in particular if
+ *                 \p f_source reached the end of the data).
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the sending
+ *                 direction is offloaded to kernel TLS: send the data on the
+ *                 socket directly, as mbedtls_net_write_from_fd() does.
+ * \return         The error returned by \p f_source if it fails before
+ *                 anything was written.
+ * \return         Any of the other error codes documented for
+ *                 mbedtls_ssl_write(), with the same meaning and the same
+ *                 requirements on the caller.
+ *
+ * \note           When this function returns #MBEDTLS_ERR_SSL_WANT_WRITE/READ,
+ *                 it must be called later with the *same* arguments,
+ *                 until it returns a value greater than or equal to 0. The
+ *                 data of the records already protected is not read again.
+ */
+int mbedtls_ssl_write_from(mbedtls_ssl_context *ssl,
+                           mbedtls_ssl_write_source_t *f_source,
+                           void *p_source, size_t len);
+
+/**
+ * \brief          Try to relay application data from one connection to
+ *                 another, as a TLS-terminating proxy does.
+ *
+ *                 This function behaves like mbedtls_ssl_read() on \p src
+ *                 followed by mbedtls_ssl_write() on \p dst of what was read,
+ *                 except that the data is decrypted by \p src and copied
+ *                 straight into the outgoing records of \p dst, which are
+ *                 protected in place: there is no intermediate application
+ *                 buffer. Data that \p src already decrypted fills further
+ *                 records of the same call, which are sent together if
+ *                 write batching is enabled on \p dst.
+ *
+ *                 Only the first read from \p src may wait for the network,
+ *                 so this function does not block on \p src once something
+ *                 was relayed.
+ *
+ * \param dst      SSL context to write to
+ * \param src      SSL context to read from, distinct from \p dst
+ * \param len      Maximum number of bytes to relay
+ *
+ * \return         The (positive) number of bytes relayed if successful.
+ * \return         \c 0 if \p src reached the end of the data, as
+ *                 mbedtls_ssl_read() returning \c 0.
+ * \return         #MBEDTLS_ERR_SSL_WANT_READ and the other error codes of
+ *                 mbedtls_ssl_read() on \p src, if nothing was relayed.
+ *                 Nothing was consumed from \p src in that case.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the sending
+ *                 direction of \p dst is offloaded to kernel TLS.
+ * \return         Any of the error codes of mbedtls_ssl_write() on \p dst,
+ *                 with the same meaning and the same requirements on the
+ *                 caller: on #MBEDTLS_ERR_SSL_WANT_WRITE, call this function
+ *                 again with the same arguments, and the data already taken
+ *                 from \p src is sent before anything else is read.
+ */
+int mbedtls_ssl_relay(mbedtls_ssl_context *dst, mbedtls_ssl_context *src,
+                      size_t len);
+
+/**
+ * \brief          Send the records still waiting in the output buffer,
+ *                 e.g. those queued by mbedtls_ssl_conf_write_queue().
+ *
+ * \param ssl      SSL context
+ *
+ * \return         0 if nothing is left to send.
+ * \return         #MBEDTLS_ERR_SSL_WANT_WRITE if the transport did not take
+ *                 everything. Call this function again later.
+ * \return         Another negative error code on failure, after which the
+ *                 connection must be closed.
+ */
+int mbedtls_ssl_flush(mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Read the application data of all the records of the
+ *                 current datagram at once.
+ *
+ *                 This function behaves like mbedtls_ssl_read() for the
+ *                 first record. With DTLS, it then goes on with the next
+ *                 application data records of the same datagram, decrypting
+ *                 each into \p buf behind the previous one, as long as the
+ *                 next record fits in what is left of \p buf and
+ *                 \p max_spans is not reached. It never waits for another
+ *                 datagram. With TLS, it reads a single record.
+ *
+ * \param ssl      SSL context
+ * \param buf      Buffer that receives the data of the records
+ * \param len      Length of \p buf
+ * \param spans    Array that receives where the data of each record is in
+ *                 \p buf, in the order of the records
+ * \param max_spans Number of entries in \p spans, at least 1
+ * \param nspans   Set to the number of entries of \p spans filled in. Empty
+ *                 records have no entry.
+ *
+ * \return         The (positive) number of bytes read into \p buf, which is
+ *                 the total length of the spans.
+ * \return         Any other return value of mbedtls_ssl_read(), with the same
+ *                 meaning and the same requirements on how to proceed, and
+ *                 \p *nspans set to \c 0.
+ *
+ * \note           A record larger than what is left of \p buf stays for
+ *                 the next call, unless it is the first one, which is then
+ *                 read in part like with mbedtls_ssl_read(). Use a buffer of
+ *                 at least #MBEDTLS_SSL_IN_CONTENT_LEN bytes to always get
+ *                 whole records.
+ *
+ * \note           A record of the datagram that is not application data
+ *                 ends the call, and is handled by the next one. An error on
+ *                 a record after the first that is not
+ *                 #MBEDTLS_ERR_SSL_WANT_READ or #MBEDTLS_ERR_SSL_WANT_WRITE is
+ *                 returned instead of the data read so far: the connection
+ *                 is unusable then.
+ */
+int mbedtls_ssl_read_datagram(mbedtls_ssl_context *ssl,
+                              unsigned char *buf, size_t len,
+                              mbedtls_ssl_iovec *spans, size_t max_spans,
+                              size_t *nspans);
+
 /**
  * \brief           Send an alert message
  *
@@ -5194,6 +8152,209 @@ int mbedtls_ssl_send_alert_message(mbedtls_ssl_context *ssl,
  */
 int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl);
 
+#if defined(MBEDTLS_SSL_KTLS)
+#define MBEDTLS_SSL_KTLS_TX                     1   /*!< Sending direction */
+#define MBEDTLS_SSL_KTLS_RX                     2   /*!< Receiving direction */
+
+#define MBEDTLS_SSL_KTLS_AES_128_GCM            1
+#define MBEDTLS_SSL_KTLS_AES_256_GCM            2
+#define MBEDTLS_SSL_KTLS_CHACHA20_POLY1305      3
+
+/**
+ * \brief          Record protection state of one direction of a connection,
+ *                 as needed to hand it over to kernel TLS.
+ */
+typedef struct mbedtls_ssl_ktls_params {
+    mbedtls_ssl_protocol_version tls_version;  /*!< Negotiated version */
+    int cipher;                 /*!< One of MBEDTLS_SSL_KTLS_xxx */
+    unsigned char key[32];      /*!< Traffic key */
+    size_t key_len;             /*!< Length of \c key in bytes */
+    unsigned char iv[12];       /*!< Static part of the nonce: the 4-byte
+                                 *   salt for AES-GCM in TLS 1.2, the full
+                                 *   12-byte IV otherwise. */
+    size_t iv_len;              /*!< Length of \c iv in bytes */
+    unsigned char rec_seq[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!< Sequence
+                                 *   number of the next record */
+} mbedtls_ssl_ktls_params;
+
+/**
+ * \brief          Export the record protection state of an established
+ *                 connection, to offload it to kernel TLS.
+ *
+ * \param ssl      SSL context
+ * \param direction #MBEDTLS_SSL_KTLS_TX or #MBEDTLS_SSL_KTLS_RX
+ * \param params   Structure to fill. It contains secret keys: wipe it with
+ *                 mbedtls_platform_zeroize() once it has been used.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the connection
+ *                 does not use TLS over a stream transport with AES-GCM or
+ *                 ChaCha20-Poly1305 and a full-length tag.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the handshake is not
+ *                 complete, or if data is still buffered in that direction.
+ */
+int mbedtls_ssl_ktls_export(const mbedtls_ssl_context *ssl, int direction,
+                            mbedtls_ssl_ktls_params *params);
+
+/**
+ * \brief          Record that the protection of some directions of the
+ *                 connection has been offloaded to the transport.
+ *
+ *                 Afterwards, mbedtls_ssl_write() and mbedtls_ssl_read()
+ *                 pass application data to and from the transport callbacks
+ *                 unchanged, and alerts are sent through \p f_send_record.
+ *                 mbedtls_net_ktls_enable() calls this function.
+ *
+ * \param ssl      SSL context
+ * \param directions #MBEDTLS_SSL_KTLS_TX, #MBEDTLS_SSL_KTLS_RX, or both.
+ * \param f_send_record Callback to send non-application-data records,
+ *                 required if \p directions includes #MBEDTLS_SSL_KTLS_TX.
+ * \param p_send_record Context for \p f_send_record. It is independent of
+ *                 the context given to mbedtls_ssl_set_bio().
+ *
+ * \return         \c 0 if successful, or #MBEDTLS_ERR_SSL_BAD_INPUT_DATA.
+ *
+ * \note           Once the receiving direction is offloaded, a record other
+ *                 than application data (alert, renegotiation request,
+ *                 TLS 1.3 post-handshake message) makes mbedtls_ssl_read()
+ *                 fail with the error returned by the receive callback.
+ *                 Renegotiation and TLS 1.3 key updates are not supported
+ *                 on offloaded connections.
+ */
+int mbedtls_ssl_ktls_start(mbedtls_ssl_context *ssl, int directions,
+                           mbedtls_ssl_send_record_t *f_send_record,
+                           void *p_send_record);
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+/**
+ * \brief          Run the TLS 1.3 handshake of a QUIC connection
+ *                 (RFC 9001), without TLS records.
+ *
+ *                 Call this instead of mbedtls_ssl_set_bio(). Handshake
+ *                 messages are then exchanged with the QUIC stack by
+ *                 encryption level: the messages to send are given to
+ *                 \p f_send, and the QUIC stack gives the content of the
+ *                 CRYPTO frames it receives with
+ *                 mbedtls_ssl_quic_provide_data(). The traffic secrets of
+ *                 each level are given to \p f_secrets, the QUIC stack
+ *                 protects the packets itself. Alerts are given to
+ *                 \p f_alert rather than sent.
+ *
+ *                 mbedtls_ssl_handshake() is used as with a non-blocking
+ *                 transport: it returns #MBEDTLS_ERR_SSL_WANT_READ when it
+ *                 needs more handshake data. After the handshake,
+ *                 mbedtls_ssl_read() processes the handshake data given at
+ *                 the application level, such as NewSessionTicket messages,
+ *                 with the same return values as over a non-blocking
+ *                 transport. mbedtls_ssl_write() cannot be used.
+ *
+ *                 The middlebox compatibility mode is not used, as
+ *                 RFC 9001, section 8.4 requires.
+ *
+ * \param ssl      SSL context, set up with a configuration for TLS 1.3 only
+ *                 over a stream transport, without early data
+ * \param p_quic   Context of the callbacks
+ * \param f_send   Callback to send handshake data
+ * \param f_secrets Callback to install traffic secrets
+ * \param f_alert  Callback to report alerts
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a callback is \c NULL.
+ * \return         #MBEDTLS_ERR_SSL_BAD_CONFIG if the configuration does not
+ *                 meet the conditions above.
+ *
+ * \note           0-RTT is not supported yet: early data must stay
+ *                 disabled on the configuration.
+ */
+int mbedtls_ssl_set_quic(mbedtls_ssl_context *ssl,
+                         void *p_quic,
+                         mbedtls_ssl_quic_send_t *f_send,
+                         mbedtls_ssl_quic_secrets_t *f_secrets,
+                         mbedtls_ssl_quic_alert_t *f_alert);
+
+/**
+ * \brief          Give the handshake data received in CRYPTO frames.
+ *
+ *                 The data need not be made of whole handshake messages:
+ *                 it is kept until the messages are complete. It must be
+ *                 given in order, without gaps or duplicates.
+ *
+ * \param ssl      SSL context set up with mbedtls_ssl_set_quic()
+ * \param level    Encryption level of the packets the data came in
+ * \param buf      Handshake data
+ * \param len      Length of the data
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl is not set up
+ *                 for QUIC or \p level is invalid.
+ * \return         #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if more than
+ *                 MBEDTLS_SSL_QUIC_MAX_BUFFERING bytes would be waiting at
+ *                 \p level.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_quic_provide_data(mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_quic_level level,
+                                  const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Get the encryption level at which handshake data is
+ *                 expected next.
+ *
+ * \param ssl      SSL context set up with mbedtls_ssl_set_quic()
+ *
+ * \return         The current encryption level for receiving.
+ */
+mbedtls_ssl_quic_level mbedtls_ssl_quic_read_level(
+    const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Get the encryption level at which handshake data is sent
+ *                 next.
+ *
+ * \param ssl      SSL context set up with mbedtls_ssl_set_quic()
+ *
+ * \return         The current encryption level for sending.
+ */
+mbedtls_ssl_quic_level mbedtls_ssl_quic_write_level(
+    const mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Set the transport parameters sent in the
+ *                 quic_transport_parameters extension, in the ClientHello
+ *                 or the EncryptedExtensions (RFC 9000, section 18).
+ *
+ *                 Both endpoints must send the extension: a handshake set
+ *                 up with mbedtls_ssl_set_quic() fails with a
+ *                 missing_extension alert if the peer does not send it.
+ *
+ * \param ssl      SSL context
+ * \param params   Encoded transport parameters, copied
+ * \param len      Length of \p params
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p len is larger than
+ *                 an extension can hold.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_ssl_set_quic_transport_params(mbedtls_ssl_context *ssl,
+                                          const unsigned char *params,
+                                          size_t len);
+
+/**
+ * \brief          Get the transport parameters of the peer.
+ *
+ * \param ssl      SSL context
+ * \param params   Set to the encoded transport parameters of the peer, or
+ *                 \c NULL if they have not been received. They stay valid
+ *                 until the context is reset or freed.
+ * \param len      Set to the length of \p params
+ */
+void mbedtls_ssl_get_peer_quic_transport_params(const mbedtls_ssl_context *ssl,
+                                                const unsigned char **params,
+                                                size_t *len);
+#endif /* MBEDTLS_SSL_QUIC */
+
 #if defined(MBEDTLS_SSL_EARLY_DATA)
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -5375,6 +8536,27 @@ int mbedtls_ssl_get_early_data_status(mbedtls_ssl_context *ssl);
 void mbedtls_ssl_free(mbedtls_ssl_context *ssl);
 
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+/**
+ * \brief          Save the traffic keys of (D)TLS 1.2 connections with
+ *                 mbedtls_ssl_context_save() (Default: disabled)
+ *
+ *                 The saved context then holds the keys and implicit IVs
+ *                 instead of the Hello random bytes, so that
+ *                 mbedtls_ssl_context_load() imports the keys without
+ *                 running the PRF, and the saved context is smaller with
+ *                 AES-128. mbedtls_ssl_context_load() accepts both formats
+ *                 whatever this setting.
+ *
+ * \note           A connection loaded from saved keys is always saved with
+ *                 its keys, as its random bytes are not known. Keys of
+ *                 TLS 1.3 connections are always derived from the saved
+ *                 traffic secrets.
+ *
+ * \param conf     SSL configuration
+ * \param enable   1 to save the traffic keys, 0 to save the random bytes
+ */
+void mbedtls_ssl_conf_context_save_keys(mbedtls_ssl_config *conf, int enable);
+
 /**
  * \brief          Save an active connection as serialized data in a buffer.
  *                 This allows the freeing or re-using of the SSL context
@@ -5388,8 +8570,15 @@ void mbedtls_ssl_free(mbedtls_ssl_context *ssl);
  *                 options, session identifier, keys, etc.
  *                 Loading a saved SSL context does not restore settings and
  *                 state related to how the application accesses the context,
- *                 such as configured callback functions, user data, pending
- *                 incoming or outgoing data, etc.
+ *                 such as configured callback functions, user data, etc.
+ *
+ * \note           With TLS, the records received but not processed yet, the
+ *                 application data not read yet and the records not sent
+ *                 yet are saved too, so the connection can be saved at any
+ *                 time between calls to mbedtls_ssl_read() and
+ *                 mbedtls_ssl_write(), and picked up over the same TCP
+ *                 connection in another process. With DTLS, there must be
+ *                 no such data.
  *
  * \note           This feature is currently only available under certain
  *                 conditions, see the documentation of the return value
@@ -5427,9 +8616,13 @@ void mbedtls_ssl_free(mbedtls_ssl_context *ssl);
  * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if memory allocation failed
  *                 while resetting the context.
  * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a handshake is in
- *                 progress, or there is pending data for reading or sending,
- *                 or the connection does not use DTLS 1.2 with an AEAD
- *                 ciphersuite, or renegotiation is enabled.
+ *                 progress, or a handshake message is being processed, or
+ *                 output is being coalesced, or the connection uses DTLS
+ *                 and there is pending data for reading or sending, or the
+ *                 connection uses neither (D)TLS 1.2 with an AEAD
+ *                 ciphersuite nor TLS 1.3, or renegotiation is enabled.
+ *                 Saving a TLS 1.3 connection also requires
+ *                 #MBEDTLS_SSL_SESSION_TICKETS.
  */
 int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
                              unsigned char *buf,
@@ -5507,6 +8700,69 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
 int mbedtls_ssl_context_load(mbedtls_ssl_context *ssl,
                              const unsigned char *buf,
                              size_t len);
+
+/**
+ * \brief          Park an idle connection: save it as with
+ *                 mbedtls_ssl_context_save(), then release all the memory
+ *                 the context holds for it.
+ *
+ *                 The input and output buffers, the transform, the session
+ *                 and the handshake structure are freed, or given back to
+ *                 the buffer pool of the configuration. The context keeps
+ *                 its configuration, I/O callbacks, user data and
+ *                 connection ID, so it can stay registered wherever the
+ *                 application finds it, for example in a
+ *                 mbedtls_ssl_cid_table, while the serialized data is kept
+ *                 elsewhere, possibly on disk.
+ *
+ * \see            mbedtls_ssl_unpark()
+ *
+ * \note           The same restrictions as for mbedtls_ssl_context_save()
+ *                 apply. Saving the traffic keys with
+ *                 mbedtls_ssl_conf_context_save_keys() makes the data
+ *                 smaller and mbedtls_ssl_unpark() faster.
+ *
+ * \param ssl      The SSL context to park.
+ * \param buf      The buffer to write the serialized data to, as for
+ *                 mbedtls_ssl_context_save().
+ * \param buf_len  The number of bytes available for writing in \p buf.
+ * \param olen     The size in bytes of the data that has been or would have
+ *                 been written.
+ *
+ * \return         \c 0 if successful. The context must then only be given
+ *                 to mbedtls_ssl_unpark() or mbedtls_ssl_free().
+ * \return         Any error of mbedtls_ssl_context_save(), in which case the
+ *                 connection is not parked.
+ */
+int mbedtls_ssl_park(mbedtls_ssl_context *ssl,
+                     unsigned char *buf,
+                     size_t buf_len,
+                     size_t *olen);
+
+/**
+ * \brief          Unpark a connection parked with mbedtls_ssl_park(), for
+ *                 example when a record arrives for it.
+ *
+ *                 This allocates the memory of the context again, then
+ *                 loads the connection as with mbedtls_ssl_context_load().
+ *
+ * \warning        As for mbedtls_ssl_context_load(), the serialized data
+ *                 must be loaded only once.
+ *
+ * \param ssl      The SSL context parked with mbedtls_ssl_park().
+ * \param buf      The serialized data written by mbedtls_ssl_park().
+ * \param len      The length of \p buf.
+ *
+ * \return         \c 0 if successful.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl is not parked.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure, in
+ *                 which case the context is still parked.
+ * \return         Any other error of mbedtls_ssl_context_load(), in which
+ *                 case the context is freed.
+ */
+int mbedtls_ssl_unpark(mbedtls_ssl_context *ssl,
+                       const unsigned char *buf,
+                       size_t len);
 #endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
 
 /**
@@ -5533,12 +8789,44 @@ void mbedtls_ssl_config_init(mbedtls_ssl_config *conf);
  *
  * \note           See \c mbedtls_ssl_conf_transport() for notes on DTLS.
  *
+ * \note           This function does not allocate memory: the preset lists
+ *                 point to static tables, and the default DHM group of a
+ *                 server is only read when a DHE handshake needs it.
+ *
  * \return         0 if successful, or
- *                 MBEDTLS_ERR_XXX_ALLOC_FAILED on memory allocation error.
+ *                 MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if no protocol
+ *                 version is available for \p transport.
  */
 int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
                                 int endpoint, int transport, int preset);
 
+/**
+ * \brief          Check an SSL configuration once and mark it as final
+ *
+ *                 mbedtls_ssl_setup() checks the configuration it is given
+ *                 on every call. Once a configuration is frozen, that check
+ *                 is skipped, which helps when a single configuration is
+ *                 shared by many short-lived contexts, possibly in several
+ *                 threads.
+ *
+ * \warning        The configuration must not be modified after it is
+ *                 frozen, by the mbedtls_ssl_conf_xxx() functions or
+ *                 otherwise, until it is freed: the check is not repeated.
+ *                 A frozen configuration is only read by the library, so it
+ *                 can be shared between threads (the objects it points to,
+ *                 such as the RNG, cache or ticket contexts, must be
+ *                 thread-safe themselves).
+ *
+ * \param conf     SSL configuration to freeze
+ *
+ * \return         \c 0 if successful.
+ * \return         The error mbedtls_ssl_setup() would return for an
+ *                 invalid configuration, for example
+ *                 #MBEDTLS_ERR_SSL_BAD_CONFIG or #MBEDTLS_ERR_SSL_NO_RNG.
+ *                 The configuration is not frozen then.
+ */
+int mbedtls_ssl_config_freeze(mbedtls_ssl_config *conf);
+
 /**
  * \brief          Free an SSL configuration context
  *
@@ -0,0 +1,138 @@
+/**
+ * \file ssl_anti_replay.h
+ *
+ * \brief Replay detection of TLS 1.3 early data, with time-bucketed Bloom
+ *        filters
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_ANTI_REPLAY_H
+#define MBEDTLS_SSL_ANTI_REPLAY_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_HAVE_TIME)
+#include "mbedtls/platform_time.h"
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+#if !defined(MBEDTLS_SSL_ANTI_REPLAY_WINDOW)
+#if defined(MBEDTLS_HAVE_TIME)
+/* Twice the ticket age tolerance: a ClientHello replayed later than that is
+ * rejected by the ticket age check. */
+#define MBEDTLS_SSL_ANTI_REPLAY_WINDOW (2 * MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE)
+#else
+#define MBEDTLS_SSL_ANTI_REPLAY_WINDOW 65536
+#endif
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Record of the early data attempts seen recently
+ *
+ *          Each attempt is identified by the binder of its ClientHello, and
+ *          recorded in a Bloom filter. There are two filters, the current
+ *          one and the previous one, and the previous one is cleared and
+ *          becomes the current one every window: an attempt is remembered
+ *          for one to two windows, in a fixed amount of memory.
+ *
+ *          A Bloom filter can mistake a fresh attempt for a replay, at a
+ *          rate that depends on its size and on the number of attempts per
+ *          window, but never the reverse. The early data of such an attempt
+ *          is rejected, and the client sends it again after the handshake.
+ */
+typedef struct mbedtls_ssl_anti_replay {
+    unsigned char *MBEDTLS_PRIVATE(filters);    /*!< the two filters, back to back */
+    size_t MBEDTLS_PRIVATE(mask);               /*!< bits per filter - 1 */
+    unsigned char MBEDTLS_PRIVATE(current);     /*!< index of the current filter */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(window);  /*!< window in milliseconds */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(start);   /*!< start of the current window */
+#else
+    unsigned long MBEDTLS_PRIVATE(window);      /*!< window in number of attempts */
+    unsigned long MBEDTLS_PRIVATE(count);       /*!< attempts in the current window */
+#endif
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the filters */
+#endif
+} mbedtls_ssl_anti_replay;
+
+/**
+ * \brief          Initialize an anti-replay context
+ *
+ * \param ctx      Context to initialize
+ */
+void mbedtls_ssl_anti_replay_init(mbedtls_ssl_anti_replay *ctx);
+
+/**
+ * \brief          Allocate the filters of an anti-replay context
+ *
+ * \param ctx      Context to set up
+ * \param filter_bytes  Size of each of the two filters in bytes, rounded up
+ *                 to a power of two. With 4 bits set per attempt, 2 bytes per
+ *                 attempt in a window give a false positive rate below 1%.
+ * \param window   Lifetime of a filter in milliseconds if MBEDTLS_HAVE_TIME
+ *                 is enabled, or in number of attempts otherwise, or \c 0
+ *                 for #MBEDTLS_SSL_ANTI_REPLAY_WINDOW. With MBEDTLS_HAVE_TIME,
+ *                 it must be at least twice the ticket age tolerance
+ *                 #MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE, after which the
+ *                 ticket of a replayed ClientHello is rejected anyway.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the context was already
+ *                 set up or a parameter is out of range.
+ */
+int mbedtls_ssl_anti_replay_setup(mbedtls_ssl_anti_replay *ctx,
+                                  size_t filter_bytes,
+                                  uint32_t window);
+
+/**
+ * \brief          Replay check callback for
+ *                 mbedtls_ssl_conf_early_data_anti_replay()
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param p_ctx    Context set up with mbedtls_ssl_anti_replay_setup()
+ * \param id       Identifier of the attempt, at least 16 bytes of it
+ * \param id_len   Length of \p id
+ *
+ * \return         \c 0 if \p id was not seen in the window, in which case it
+ *                 is recorded.
+ * \return         \c 1 if \p id may have been seen.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p id is too short, or
+ *                 a locking error.
+ */
+mbedtls_ssl_early_data_replay_t mbedtls_ssl_anti_replay_check;
+
+/**
+ * \brief          Free an anti-replay context
+ *
+ * \param ctx      Context to free
+ */
+void mbedtls_ssl_anti_replay_free(mbedtls_ssl_anti_replay *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_anti_replay.h */
@@ -0,0 +1,165 @@
+/**
+ * \file ssl_async_batch.h
+ *
+ * \brief Batched private key signatures across concurrent handshakes, with
+ *        the asynchronous private key callbacks
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_ASYNC_BATCH_H
+#define MBEDTLS_SSL_ASYNC_BATCH_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pk.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   A signature operation of a handshake, queued in a batch
+ *
+ *          The batch signing callback reads \c key, \c pk_type, \c md_alg
+ *          and \c hash, and writes \c sig, \c sig_len and \c ret.
+ */
+typedef struct mbedtls_ssl_async_batch_op {
+    mbedtls_pk_context *key;    /*!< private key to sign with */
+    mbedtls_pk_type_t pk_type;  /*!< #MBEDTLS_PK_RSASSA_PSS for an RSA key in
+                                 *   TLS 1.3, the type of \c key otherwise */
+    mbedtls_md_type_t md_alg;   /*!< hash algorithm of \c hash */
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];    /*!< hash to sign */
+    size_t hash_len;            /*!< length of \c hash */
+    unsigned char sig[MBEDTLS_PK_SIGNATURE_MAX_SIZE];   /*!< signature */
+    size_t sig_len;             /*!< length of \c sig */
+    int ret;                    /*!< \c 0 or an error code for this operation */
+
+    int (*MBEDTLS_PRIVATE(f_rng))(void *, unsigned char *, size_t);
+    void *MBEDTLS_PRIVATE(p_rng);
+    unsigned char MBEDTLS_PRIVATE(state);
+} mbedtls_ssl_async_batch_op;
+
+/**
+ * \brief           Callback type: sign a batch of hashes
+ *
+ *                  This is where a driver that signs several hashes at once,
+ *                  for example several RSA private key operations or ECDSA
+ *                  signatures with the same key in parallel lanes, gets all
+ *                  the operations that were queued since the last batch.
+ *
+ * \param p_sign    Context given to mbedtls_ssl_async_batch_setup()
+ * \param ops       Operations to perform. The callback sets \c sig,
+ *                  \c sig_len and \c ret of each of them.
+ * \param count     Number of operations in \p ops, at least 1
+ */
+typedef void mbedtls_ssl_async_batch_sign_t(void *p_sign,
+                                            mbedtls_ssl_async_batch_op **ops,
+                                            size_t count);
+
+/**
+ * \brief   Queue of the pending signatures of a set of handshakes
+ *
+ *          Set in a configuration with mbedtls_ssl_async_batch_conf(), it
+ *          queues the signature of each handshake instead of computing it,
+ *          and mbedtls_ssl_handshake() returns
+ *          #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS. The application calls
+ *          mbedtls_ssl_async_batch_run() once per iteration of its event
+ *          loop, or on a short timer, to sign all the hashes queued since
+ *          the last run in one call, then carries on with the handshakes.
+ *
+ *          When all the slots of the queue are in use, a handshake signs
+ *          synchronously. The private key decryption of TLS 1.2 RSA key
+ *          exchanges is always synchronous.
+ */
+typedef struct mbedtls_ssl_async_batch {
+    mbedtls_ssl_async_batch_op *MBEDTLS_PRIVATE(ops);   /*!< slots */
+    mbedtls_ssl_async_batch_op **MBEDTLS_PRIVATE(queue); /*!< batch being run */
+    size_t MBEDTLS_PRIVATE(capacity);                   /*!< number of slots */
+    unsigned char MBEDTLS_PRIVATE(running);             /*!< a run is in progress */
+    mbedtls_ssl_async_batch_sign_t *MBEDTLS_PRIVATE(f_sign);
+    void *MBEDTLS_PRIVATE(p_sign);
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);   /*!< protects the slots */
+#endif
+} mbedtls_ssl_async_batch;
+
+/**
+ * \brief          Initialize a signature batch
+ *
+ * \param batch    Batch to initialize
+ */
+void mbedtls_ssl_async_batch_init(mbedtls_ssl_async_batch *batch);
+
+/**
+ * \brief          Allocate the slots of a signature batch
+ *
+ * \param batch    Batch to set up
+ * \param capacity Maximum number of pending signatures, typically the
+ *                 number of handshakes that can be in progress at once
+ * \param f_sign   Batch signing callback, or \c NULL to sign the hashes one
+ *                 by one with mbedtls_pk_sign_ext()
+ * \param p_sign   Context for \p f_sign
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the batch was already
+ *                 set up or \p capacity is out of range.
+ */
+int mbedtls_ssl_async_batch_setup(mbedtls_ssl_async_batch *batch,
+                                  size_t capacity,
+                                  mbedtls_ssl_async_batch_sign_t *f_sign,
+                                  void *p_sign);
+
+/**
+ * \brief          Use a signature batch for the handshakes of a configuration
+ *
+ *                 This sets the asynchronous private key callbacks of
+ *                 \p conf, see mbedtls_ssl_conf_async_private_cb(). Several
+ *                 configurations can share a batch.
+ *
+ * \param conf     SSL configuration
+ * \param batch    Batch set up with mbedtls_ssl_async_batch_setup()
+ */
+void mbedtls_ssl_async_batch_conf(mbedtls_ssl_config *conf,
+                                  mbedtls_ssl_async_batch *batch);
+
+/**
+ * \brief          Sign all the hashes queued since the last run
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The handshakes whose signature is done continue at their
+ *                 next call to mbedtls_ssl_handshake().
+ *
+ * \note           With MBEDTLS_THREADING_C, the batch signing callback is
+ *                 called without holding the lock of \p batch, so handshakes
+ *                 can queue the next batch meanwhile. A run started while
+ *                 another one is in progress signs nothing.
+ *
+ * \param batch    Batch set up with mbedtls_ssl_async_batch_setup()
+ *
+ * \return         The number of hashes signed, possibly \c 0.
+ * \return         A negative error code on a locking error.
+ */
+int mbedtls_ssl_async_batch_run(mbedtls_ssl_async_batch *batch);
+
+/**
+ * \brief          Free a signature batch
+ *
+ * \param batch    Batch to free. No handshake must be using it.
+ */
+void mbedtls_ssl_async_batch_free(mbedtls_ssl_async_batch *batch);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_async_batch.h */
@@ -0,0 +1,143 @@
+/**
+ * \file ssl_buffer_pool.h
+ *
+ * \brief SSL record buffer pool implementation
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_BUFFER_POOL_H
+#define MBEDTLS_SSL_BUFFER_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE)
+#define MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE   64   /*!< Maximum buffers kept in a pool */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Buffer pool context
+ *
+ *          The pool keeps released buffers of a single size on a free
+ *          list and hands them out again in place of fresh allocations.
+ *          Requests for larger buffers bypass the pool.
+ *
+ * \note    For the best scalability on multi-threaded servers, use one
+ *          pool (and one SSL configuration) per thread. Each pool has its
+ *          own mutex when MBEDTLS_THREADING_C is enabled, so that mutex is
+ *          then never contended.
+ */
+typedef struct mbedtls_ssl_buffer_pool {
+    unsigned char *MBEDTLS_PRIVATE(free_list);   /*!< chain of free buffers  */
+    size_t MBEDTLS_PRIVATE(buf_len);             /*!< size of each buffer    */
+    size_t MBEDTLS_PRIVATE(free_count);          /*!< buffers in free_list   */
+    size_t MBEDTLS_PRIVATE(in_use);              /*!< pooled buffers handed out */
+    size_t MBEDTLS_PRIVATE(max_free);            /*!< maximum free buffers   */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< mutex                  */
+#endif
+} mbedtls_ssl_buffer_pool;
+
+/**
+ * \brief          Initialize a buffer pool
+ *
+ *                 The pool serves buffers of the default size of SSL input
+ *                 and output buffers and keeps at most
+ *                 #MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE free buffers.
+ *
+ * \param pool     Buffer pool context
+ */
+void mbedtls_ssl_buffer_pool_init(mbedtls_ssl_buffer_pool *pool);
+
+/**
+ * \brief          Set the size of the buffers served by the pool
+ *                 (Default: the size of SSL input and output buffers in
+ *                 the default configuration)
+ *
+ * \note           This must be called before any buffer is obtained from
+ *                 the pool.
+ *
+ * \param pool     Buffer pool context
+ * \param buf_len  Size of pooled buffers in bytes. Requests for larger
+ *                 buffers are served by mbedtls_calloc() directly.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p buf_len is too small
+ *                 or buffers were already handed out.
+ */
+int mbedtls_ssl_buffer_pool_set_buf_len(mbedtls_ssl_buffer_pool *pool,
+                                        size_t buf_len);
+
+/**
+ * \brief          Set the maximum number of free buffers kept by the pool
+ *                 (Default: MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE (64))
+ *
+ *                 Buffers released while the pool is full are freed.
+ *
+ * \param pool     Buffer pool context
+ * \param max_free Maximum number of free buffers.
+ */
+void mbedtls_ssl_buffer_pool_set_max_free(mbedtls_ssl_buffer_pool *pool,
+                                          size_t max_free);
+
+/**
+ * \brief          Buffer get callback implementation
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param p_pool   The buffer pool context to use.
+ * \param len      The required size of the buffer in bytes.
+ *
+ * \return         A zeroed buffer of at least \p len bytes, or \c NULL if
+ *                 memory allocation failed.
+ */
+unsigned char *mbedtls_ssl_buffer_pool_get(void *p_pool, size_t len);
+
+/**
+ * \brief          Buffer release callback implementation
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param p_pool   The buffer pool context to use.
+ * \param buf      A buffer obtained from mbedtls_ssl_buffer_pool_get() on
+ *                 the same pool, wiped by the caller.
+ * \param len      The size passed to mbedtls_ssl_buffer_pool_get().
+ */
+void mbedtls_ssl_buffer_pool_release(void *p_pool, unsigned char *buf,
+                                     size_t len);
+
+/**
+ * \brief          Free all buffers kept in a pool and clear memory
+ *
+ * \note           Buffers still in use by SSL contexts are not affected;
+ *                 free those contexts before freeing the pool.
+ *
+ * \param pool     Buffer pool context
+ */
+void mbedtls_ssl_buffer_pool_free(mbedtls_ssl_buffer_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_buffer_pool.h */
@@ -41,6 +41,9 @@
 extern "C" {
 #endif
 
+#define MBEDTLS_SSL_CACHE_STORE_SERIALIZED  0   /*!< store sessions serialized */
+#define MBEDTLS_SSL_CACHE_STORE_SESSION     1   /*!< store session structures  */
+
 typedef struct mbedtls_ssl_cache_context mbedtls_ssl_cache_context;
 typedef struct mbedtls_ssl_cache_entry mbedtls_ssl_cache_entry;
 
@@ -57,17 +60,41 @@ struct mbedtls_ssl_cache_entry {
 
     unsigned char *MBEDTLS_PRIVATE(session);             /*!< serialized session */
     size_t MBEDTLS_PRIVATE(session_len);
+    mbedtls_ssl_session *MBEDTLS_PRIVATE(session_record); /*!< stored session,
+                                                            *   see set_store_mode */
 
     mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(next);      /*!< chain pointer      */
+    mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(prev);      /*!< reverse chain pointer */
 };
 
+/**
+ * \brief   Cache statistics
+ *
+ *          Counters are cumulative since mbedtls_ssl_cache_init().
+ */
+typedef struct mbedtls_ssl_cache_stats {
+    unsigned long puts;          /*!< sessions stored                        */
+    unsigned long hits;          /*!< lookups that found a valid entry       */
+    unsigned long misses;        /*!< lookups that found no valid entry      */
+    unsigned long evictions;     /*!< valid entries dropped to make room     */
+    unsigned long expirations;   /*!< entries dropped after their timeout    */
+} mbedtls_ssl_cache_stats;
+
 /**
  * \brief Cache context
+ *
+ *        Entries are chained from oldest to newest, so both the next entry
+ *        to expire and the next entry to evict are at the start of the
+ *        chain.
  */
 struct mbedtls_ssl_cache_context {
     mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(chain);     /*!< start of the chain     */
+    mbedtls_ssl_cache_entry *MBEDTLS_PRIVATE(chain_tail); /*!< end of the chain      */
+    int MBEDTLS_PRIVATE(count);                  /*!< entries in the chain   */
     int MBEDTLS_PRIVATE(timeout);                /*!< cache entry timeout    */
     int MBEDTLS_PRIVATE(max_entries);            /*!< maximum entries        */
+    int MBEDTLS_PRIVATE(store_mode);             /*!< MBEDTLS_SSL_CACHE_STORE_xxx */
+    mbedtls_ssl_cache_stats MBEDTLS_PRIVATE(stats);      /*!< usage counters         */
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< mutex                  */
 #endif
@@ -173,6 +200,117 @@ static inline int mbedtls_ssl_cache_get_timeout(mbedtls_ssl_cache_context *cache
  */
 void mbedtls_ssl_cache_set_max_entries(mbedtls_ssl_cache_context *cache, int max);
 
+/**
+ * \brief          Select how sessions are stored in the cache
+ *                 (Default: #MBEDTLS_SSL_CACHE_STORE_SERIALIZED)
+ *
+ *                 With #MBEDTLS_SSL_CACHE_STORE_SERIALIZED, each entry holds
+ *                 the output of mbedtls_ssl_session_save(), which is
+ *                 compact but has to be parsed again with
+ *                 mbedtls_ssl_session_load() on every hit, including the
+ *                 peer certificate chain if
+ *                 MBEDTLS_SSL_KEEP_PEER_CERTIFICATE is enabled.
+ *
+ *                 With #MBEDTLS_SSL_CACHE_STORE_SESSION, each entry holds a
+ *                 copy of the session structure. A hit is a plain copy,
+ *                 and the peer certificate chain is parsed once and then
+ *                 shared, by reference count, between the cache and the
+ *                 connections that resumed the session. This uses more
+ *                 memory per entry when peer certificates are kept.
+ *
+ * \note           This only affects entries stored afterwards.
+ *
+ * \param cache    SSL cache context
+ * \param mode     #MBEDTLS_SSL_CACHE_STORE_SERIALIZED or
+ *                 #MBEDTLS_SSL_CACHE_STORE_SESSION
+ */
+void mbedtls_ssl_cache_set_store_mode(mbedtls_ssl_cache_context *cache, int mode);
+
+/**
+ * \brief          Get the usage counters of a cache
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 These can be used to size the cache: frequent evictions
+ *                 with few expirations suggest that the maximum number of
+ *                 entries is too small for the configured timeout.
+ *
+ * \param cache    SSL cache context
+ * \param stats    The structure to fill with the current counters.
+ *
+ * \return         \c 0 on success.
+ * \return         A negative error code on failure to lock the cache.
+ */
+int mbedtls_ssl_cache_get_stats(mbedtls_ssl_cache_context *cache,
+                                mbedtls_ssl_cache_stats *stats);
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+/**
+ * \brief          Write an encrypted snapshot of the valid entries of a
+ *                 cache, for mbedtls_ssl_cache_load() in a restarted process
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The snapshot holds the sessions as serialized by
+ *                 mbedtls_ssl_session_save(), with the age of their entries,
+ *                 behind a versioned header. It is encrypted and
+ *                 authenticated with \p key, so it can be kept in a file
+ *                 without exposing the master secrets.
+ *
+ * \param cache    SSL cache context
+ * \param key      Key of an AEAD algorithm, with the
+ *                 #PSA_KEY_USAGE_ENCRYPT usage. The same key must be given
+ *                 to mbedtls_ssl_cache_load().
+ * \param buf      Buffer to write the snapshot to, or \c NULL if
+ *                 \p buf_len is \c 0.
+ * \param buf_len  Size of \p buf in bytes.
+ * \param olen     Set to the size of the snapshot, even if \p buf is too
+ *                 small, so that a first call with \c NULL gives the size
+ *                 to allocate. Entries stored in between can make it grow.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if \p buf is too small.
+ * \return         Another negative error code on other failures.
+ */
+int mbedtls_ssl_cache_save(mbedtls_ssl_cache_context *cache,
+                           mbedtls_svc_key_id_t key,
+                           unsigned char *buf, size_t buf_len,
+                           size_t *olen);
+
+/**
+ * \brief          Restore the entries of a snapshot written by
+ *                 mbedtls_ssl_cache_save() into an empty cache
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Entries keep their age, so that they expire when they
+ *                 would have in the previous process. Entries that expired
+ *                 meanwhile are skipped. If the snapshot has more entries
+ *                 than the maximum of the cache, the newest ones are kept.
+ *
+ * \note           The sessions must have been saved by the same version of
+ *                 the library, with the same configuration, as for
+ *                 mbedtls_ssl_session_load().
+ *
+ * \param cache    SSL cache context, without entries
+ * \param key      Key the snapshot was written with, with the
+ *                 #PSA_KEY_USAGE_DECRYPT usage
+ * \param buf      The snapshot
+ * \param len      Size of the snapshot in bytes
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache has entries or
+ *                 the snapshot is malformed.
+ * \return         #MBEDTLS_ERR_SSL_INVALID_MAC if the snapshot is not
+ *                 authentic, or was written with another key.
+ * \return         #MBEDTLS_ERR_SSL_VERSION_MISMATCH if the snapshot or its
+ *                 sessions come from an incompatible version or
+ *                 configuration of the library. The entries restored until
+ *                 then, if any, are kept.
+ * \return         Another negative error code on other failures.
+ */
+int mbedtls_ssl_cache_load(mbedtls_ssl_cache_context *cache,
+                           mbedtls_svc_key_id_t key,
+                           const unsigned char *buf, size_t len);
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
 /**
  * \brief          Free referenced items in a cache context and clear memory
  *
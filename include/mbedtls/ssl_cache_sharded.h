@@ -0,0 +1,220 @@
+/**
+ * \file ssl_cache_sharded.h
+ *
+ * \brief SSL session cache with hash-indexed, lock-striped shards
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CACHE_SHARDED_H
+#define MBEDTLS_SSL_CACHE_SHARDED_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_SHARDS)
+#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_SHARDS        16   /*!< Number of shards */
+#endif
+
+#if !defined(MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_MAX_ENTRIES 1024   /*!< Maximum entries in cache */
+#endif
+
+#if !defined(MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_TIMEOUT)
+#define MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_TIMEOUT    86400   /*!< 1 day  */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_cache_sharded_entry mbedtls_ssl_cache_sharded_entry;
+
+/**
+ * \brief   This structure is used for storing cache entries
+ */
+struct mbedtls_ssl_cache_sharded_entry {
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t MBEDTLS_PRIVATE(timestamp);           /*!< entry timestamp    */
+#endif
+
+    unsigned char MBEDTLS_PRIVATE(session_id)[32];       /*!< session ID         */
+    size_t MBEDTLS_PRIVATE(session_id_len);
+    uint32_t MBEDTLS_PRIVATE(hash);                      /*!< hash of session ID */
+
+    unsigned char *MBEDTLS_PRIVATE(session);             /*!< serialized session */
+    size_t MBEDTLS_PRIVATE(session_len);
+
+    mbedtls_ssl_cache_sharded_entry *MBEDTLS_PRIVATE(bucket_next); /*!< hash chain */
+    mbedtls_ssl_cache_sharded_entry *MBEDTLS_PRIVATE(older);  /*!< age list, to head */
+    mbedtls_ssl_cache_sharded_entry *MBEDTLS_PRIVATE(newer);  /*!< age list, to tail */
+};
+
+/**
+ * \brief   A shard: an independent hash table with its own lock
+ *
+ *          Entries are kept in insertion order on a doubly linked list,
+ *          so the oldest entry is always at the head and can be evicted
+ *          without a search.
+ */
+typedef struct mbedtls_ssl_cache_shard {
+    mbedtls_ssl_cache_sharded_entry **MBEDTLS_PRIVATE(buckets);
+    size_t MBEDTLS_PRIVATE(bucket_mask);         /*!< bucket count - 1       */
+    mbedtls_ssl_cache_sharded_entry *MBEDTLS_PRIVATE(oldest); /*!< age list head */
+    mbedtls_ssl_cache_sharded_entry *MBEDTLS_PRIVATE(newest); /*!< age list tail */
+    size_t MBEDTLS_PRIVATE(count);               /*!< entries in this shard  */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< mutex                  */
+#endif
+} mbedtls_ssl_cache_shard;
+
+/**
+ * \brief   Sharded cache context
+ *
+ *          Sessions are distributed over shards by a hash of their
+ *          session ID. Lookup, insertion and eviction take constant time
+ *          and only lock the shard the session ID maps to, so threads
+ *          working on different sessions rarely contend.
+ */
+typedef struct mbedtls_ssl_cache_sharded_context {
+    mbedtls_ssl_cache_shard *MBEDTLS_PRIVATE(shards);
+    size_t MBEDTLS_PRIVATE(shard_mask);          /*!< shard count - 1        */
+    size_t MBEDTLS_PRIVATE(max_per_shard);       /*!< maximum entries per shard */
+    int MBEDTLS_PRIVATE(timeout);                /*!< cache entry timeout    */
+} mbedtls_ssl_cache_sharded_context;
+
+/**
+ * \brief          Initialize a sharded SSL cache context
+ *
+ * \note           The context must be set up with
+ *                 mbedtls_ssl_cache_sharded_setup() before it is used.
+ *
+ * \param cache    SSL cache context
+ */
+void mbedtls_ssl_cache_sharded_init(mbedtls_ssl_cache_sharded_context *cache);
+
+/**
+ * \brief          Allocate the shards of a sharded SSL cache
+ *
+ * \note           This must not be called while the cache is in use by
+ *                 SSL contexts.
+ *
+ * \param cache        SSL cache context
+ * \param num_shards   Number of shards. This is rounded up to a power of
+ *                     two. 0 selects
+ *                     #MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_SHARDS.
+ * \param max_entries  Maximum number of cached sessions, split evenly
+ *                     between the shards. 0 selects
+ *                     #MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_MAX_ENTRIES.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache was already
+ *                 set up or the parameters are out of range.
+ */
+int mbedtls_ssl_cache_sharded_setup(mbedtls_ssl_cache_sharded_context *cache,
+                                    size_t num_shards, size_t max_entries);
+
+/**
+ * \brief          Cache get callback implementation
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        for the session to load.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The address at which to store the session
+ *                        associated with \p session_id, if present.
+ *
+ * \return                \c 0 on success.
+ * \return                #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if there is
+ *                        no cache entry with specified session ID found, or
+ *                        any other negative error code for other failures.
+ */
+int mbedtls_ssl_cache_sharded_get(void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  mbedtls_ssl_session *session);
+
+/**
+ * \brief          Cache set callback implementation
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 When the shard is full, its oldest entry is evicted.
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to \p session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The session to store.
+ *
+ * \return                \c 0 on success.
+ * \return                A negative error code on failure.
+ */
+int mbedtls_ssl_cache_sharded_set(void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  const mbedtls_ssl_session *session);
+
+/**
+ * \brief          Remove the cache entry by the session ID
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ *
+ * \return                \c 0 on success. This indicates the cache entry for
+ *                        the session with provided ID is removed or does not
+ *                        exist.
+ * \return                A negative error code on failure.
+ */
+int mbedtls_ssl_cache_sharded_remove(void *data,
+                                     unsigned char const *session_id,
+                                     size_t session_id_len);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Set the cache timeout
+ *                 (Default: MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_TIMEOUT (1 day))
+ *
+ *                 A timeout of 0 indicates no timeout.
+ *
+ * \param cache    SSL cache context
+ * \param timeout  cache entry timeout in seconds
+ */
+void mbedtls_ssl_cache_sharded_set_timeout(mbedtls_ssl_cache_sharded_context *cache,
+                                           int timeout);
+#endif /* MBEDTLS_HAVE_TIME */
+
+/**
+ * \brief          Free referenced items in a sharded cache context and
+ *                 clear memory
+ *
+ * \param cache    SSL cache context
+ */
+void mbedtls_ssl_cache_sharded_free(mbedtls_ssl_cache_sharded_context *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_cache_sharded.h */
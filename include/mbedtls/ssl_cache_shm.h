@@ -0,0 +1,235 @@
+/**
+ * \file ssl_cache_shm.h
+ *
+ * \brief SSL session cache in memory shared between processes
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CACHE_SHM_H
+#define MBEDTLS_SSL_CACHE_SHM_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+#include "mbedtls/ssl_ticket.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_CACHE_SHM_DEFAULT_MAX_ENTRIES)
+#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_MAX_ENTRIES   1024   /*!< Maximum entries in cache */
+#endif
+
+#if !defined(MBEDTLS_SSL_CACHE_SHM_DEFAULT_ENTRY_SIZE)
+#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_ENTRY_SIZE    1024   /*!< Serialized session size */
+#endif
+
+#if !defined(MBEDTLS_SSL_CACHE_SHM_DEFAULT_TIMEOUT)
+#define MBEDTLS_SSL_CACHE_SHM_DEFAULT_TIMEOUT      86400   /*!< 1 day  */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Shared memory cache context
+ *
+ *          The cache is a set-associative table of fixed-size entries in
+ *          an anonymous shared mapping, created by
+ *          mbedtls_ssl_cache_shm_setup() before the worker processes are
+ *          forked. Each set of entries has its own process-shared mutex.
+ *          On platforms with robust mutexes (Linux, FreeBSD), a process
+ *          that dies while holding one only loses the sessions of that set.
+ *
+ *          This structure itself is private to each process: it holds the
+ *          address of the mapping, which fork() preserves.
+ */
+typedef struct mbedtls_ssl_cache_shm_context {
+    unsigned char *MBEDTLS_PRIVATE(shm);         /*!< shared mapping         */
+    size_t MBEDTLS_PRIVATE(shm_len);             /*!< size of the mapping    */
+    size_t MBEDTLS_PRIVATE(set_mask);            /*!< set count - 1          */
+    size_t MBEDTLS_PRIVATE(entry_size);          /*!< session bytes per entry */
+    size_t MBEDTLS_PRIVATE(entry_stride);        /*!< bytes between entries  */
+    int MBEDTLS_PRIVATE(timeout);                /*!< cache entry timeout    */
+    long MBEDTLS_PRIVATE(owner);                 /*!< process ID of the creator */
+    uint32_t MBEDTLS_PRIVATE(ticket_generation); /*!< ticket key installed
+                                                  *   by this process      */
+} mbedtls_ssl_cache_shm_context;
+
+/**
+ * \brief          Initialize a shared memory SSL cache context
+ *
+ * \note           The context must be set up with
+ *                 mbedtls_ssl_cache_shm_setup() before it is used.
+ *
+ * \param cache    SSL cache context
+ */
+void mbedtls_ssl_cache_shm_init(mbedtls_ssl_cache_shm_context *cache);
+
+/**
+ * \brief          Create the shared mapping of a cache
+ *
+ * \note           Call this in the parent process, before forking the
+ *                 processes that share the cache, which then pass the
+ *                 inherited context to mbedtls_ssl_conf_session_cache()
+ *                 with mbedtls_ssl_cache_shm_get() and
+ *                 mbedtls_ssl_cache_shm_set().
+ *
+ * \param cache        SSL cache context
+ * \param max_entries  Maximum number of cached sessions. 0 selects
+ *                     #MBEDTLS_SSL_CACHE_SHM_DEFAULT_MAX_ENTRIES. The
+ *                     capacity is rounded up to a whole number of sets.
+ * \param entry_size   Room for each serialized session, in bytes. Larger
+ *                     sessions are not cached. 0 selects
+ *                     #MBEDTLS_SSL_CACHE_SHM_DEFAULT_ENTRY_SIZE.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if the mapping or its
+ *                 mutexes could not be created.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache was already
+ *                 set up or the parameters are out of range.
+ */
+int mbedtls_ssl_cache_shm_setup(mbedtls_ssl_cache_shm_context *cache,
+                                size_t max_entries, size_t entry_size);
+
+/**
+ * \brief          Cache get callback implementation
+ *                 (Safe to call from several processes and threads)
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        for the session to load.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The address at which to store the session
+ *                        associated with \p session_id, if present.
+ *
+ * \return                \c 0 on success.
+ * \return                #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if there is
+ *                        no cache entry with specified session ID found, or
+ *                        any other negative error code for other failures.
+ */
+int mbedtls_ssl_cache_shm_get(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              mbedtls_ssl_session *session);
+
+/**
+ * \brief          Cache set callback implementation
+ *                 (Safe to call from several processes and threads)
+ *
+ *                 When the set the session ID maps to is full, its oldest
+ *                 entry is replaced.
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to \p session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ * \param session         The session to store.
+ *
+ * \return                \c 0 on success.
+ * \return                #MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL if the serialized
+ *                        session is larger than the entry size.
+ * \return                A negative error code on other failures.
+ */
+int mbedtls_ssl_cache_shm_set(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              const mbedtls_ssl_session *session);
+
+/**
+ * \brief          Remove the cache entry by the session ID
+ *                 (Safe to call from several processes and threads)
+ *
+ * \param data            The SSL cache context to use.
+ * \param session_id      The pointer to the buffer holding the session ID
+ *                        associated to session.
+ * \param session_id_len  The length of \p session_id in bytes.
+ *
+ * \return                \c 0 on success, including if there was no entry
+ *                        for \p session_id, or a negative error code.
+ */
+int mbedtls_ssl_cache_shm_remove(void *data,
+                                 unsigned char const *session_id,
+                                 size_t session_id_len);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/**
+ * \brief          Set the cache timeout
+ *                 (Default: MBEDTLS_SSL_CACHE_SHM_DEFAULT_TIMEOUT (1 day))
+ *
+ *                 A timeout of 0 indicates no timeout.
+ *
+ * \note           The timeout is part of the context of each process: set
+ *                 it before forking.
+ *
+ * \param cache    SSL cache context
+ * \param timeout  cache entry timeout in seconds
+ */
+void mbedtls_ssl_cache_shm_set_timeout(mbedtls_ssl_cache_shm_context *cache,
+                                       int timeout);
+#endif /* MBEDTLS_HAVE_TIME */
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+/**
+ * \brief          Share the session ticket key through the cache
+ *
+ *                 The shared mapping also holds a ticket key. This installs
+ *                 it in \p ticket with mbedtls_ssl_ticket_rotate() if this
+ *                 process has not done so yet, after generating a new one
+ *                 if there is none or, with MBEDTLS_HAVE_TIME, if it is
+ *                 older than \p lifetime. The processes then issue tickets
+ *                 that any of them can decrypt.
+ *
+ * \note           Each process calls this after mbedtls_ssl_ticket_setup()
+ *                 and then regularly, for example once per connection, and
+ *                 at least once per \p lifetime so that \p ticket does not
+ *                 generate a key of its own. The call is cheap when the
+ *                 shared key did not change.
+ *
+ * \param cache    SSL cache context
+ * \param ticket   Ticket context of this process
+ * \param f_rng    RNG callback to generate a new shared key
+ * \param p_rng    RNG context
+ * \param lifetime Lifetime of the tickets and of the shared key, in
+ *                 seconds. Use the same value in all the processes.
+ *
+ * \return         \c 0 on success, or a negative error code.
+ */
+int mbedtls_ssl_cache_shm_ticket_sync(mbedtls_ssl_cache_shm_context *cache,
+                                      mbedtls_ssl_ticket_context *ticket,
+                                      int (*f_rng)(void *, unsigned char *, size_t),
+                                      void *p_rng,
+                                      uint32_t lifetime);
+#endif /* MBEDTLS_SSL_TICKET_C */
+
+/**
+ * \brief          Unmap the shared memory of a cache and clear the context
+ *
+ * \note           In the process that set up the cache, this also zeroizes
+ *                 the sessions and destroys the mutexes, so it must only be
+ *                 called there once the other processes exited. In the
+ *                 other processes, it only removes their own mapping.
+ *
+ * \param cache    SSL cache context
+ */
+void mbedtls_ssl_cache_shm_free(mbedtls_ssl_cache_shm_context *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_cache_shm.h */
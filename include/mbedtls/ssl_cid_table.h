@@ -0,0 +1,191 @@
+/**
+ * \file ssl_cid_table.h
+ *
+ * \brief DTLS connection ID lookup table
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CID_TABLE_H
+#define MBEDTLS_SSL_CID_TABLE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   A slot of the table
+ *
+ *          Slots are updated under a sequence counter: it is odd while
+ *          the slot is being written, so readers can detect and retry
+ *          a torn read without taking a lock.
+ */
+typedef struct mbedtls_ssl_cid_table_entry {
+    unsigned MBEDTLS_PRIVATE(seq);               /*!< sequence counter   */
+    unsigned char MBEDTLS_PRIVATE(state);        /*!< empty, used, removed */
+    unsigned char MBEDTLS_PRIVATE(cid)[MBEDTLS_SSL_CID_IN_LEN_MAX];
+    mbedtls_ssl_context *MBEDTLS_PRIVATE(ssl);
+} mbedtls_ssl_cid_table_entry;
+
+/**
+ * \brief   Table mapping the connection IDs a DTLS server assigned with
+ *          mbedtls_ssl_set_cid() to the SSL contexts they belong to
+ *
+ *          Lookups take no lock and can run in any number of threads
+ *          concurrently with each other and with updates. Updates are
+ *          serialized by a mutex if MBEDTLS_THREADING_C is enabled.
+ *          With compilers that lack GCC-style atomic builtins, lookups
+ *          take the mutex too.
+ */
+typedef struct mbedtls_ssl_cid_table {
+    mbedtls_ssl_cid_table_entry *MBEDTLS_PRIVATE(entries); /*!< open addressing */
+    size_t MBEDTLS_PRIVATE(mask);                /*!< slot count - 1     */
+    size_t MBEDTLS_PRIVATE(cid_len);             /*!< length of all CIDs */
+    size_t MBEDTLS_PRIVATE(count);               /*!< used slots         */
+    size_t MBEDTLS_PRIVATE(max_entries);
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< serializes updates */
+#endif
+} mbedtls_ssl_cid_table;
+
+/**
+ * \brief          Find the connection ID of a DTLS record
+ *
+ *                 This only looks at the first bytes of the record header,
+ *                 which is much cheaper than mbedtls_ssl_check_record(),
+ *                 and is meant for routing a datagram before it is given
+ *                 to an SSL context.
+ *
+ * \param buf      The datagram, starting with a record header
+ * \param len      Length of \p buf
+ * \param cid_len  Length of the connection IDs the server assigns, as
+ *                 set with mbedtls_ssl_conf_cid()
+ * \param cid      On success, points to the connection ID within \p buf
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_UNEXPECTED_RECORD if the record does
+ *                 not carry a connection ID, or is too short.
+ */
+int mbedtls_ssl_peek_record_cid(const unsigned char *buf, size_t len,
+                                size_t cid_len, const unsigned char **cid);
+
+/**
+ * \brief          Initialize a connection ID table
+ *
+ * \param table    Table to initialize
+ */
+void mbedtls_ssl_cid_table_init(mbedtls_ssl_cid_table *table);
+
+/**
+ * \brief          Allocate the slots of a connection ID table
+ *
+ * \param table        Table to set up
+ * \param cid_len      Length of the connection IDs, as set with
+ *                     mbedtls_ssl_conf_cid(). It must not be 0.
+ * \param max_entries  Maximum number of connections. Twice as many slots
+ *                     are allocated, which keeps lookups short.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the table was already
+ *                 set up or the parameters are out of range.
+ */
+int mbedtls_ssl_cid_table_setup(mbedtls_ssl_cid_table *table,
+                                size_t cid_len, size_t max_entries);
+
+/**
+ * \brief          Map a connection ID to an SSL context
+ *
+ * \param table    Table set up with mbedtls_ssl_cid_table_setup()
+ * \param cid      The connection ID set with mbedtls_ssl_set_cid()
+ * \param cid_len  Length of \p cid
+ * \param ssl      The SSL context
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p cid has the wrong
+ *                 length or is already in the table.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if the table is full.
+ * \return         A threading error code if locking fails.
+ */
+int mbedtls_ssl_cid_table_add(mbedtls_ssl_cid_table *table,
+                              const unsigned char *cid, size_t cid_len,
+                              mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Remove a connection ID from the table
+ *
+ * \note           Lookups that started before the removal may still return
+ *                 the context. Before freeing it, make sure that no thread
+ *                 may still be using a pointer it looked up, for example by
+ *                 waiting for all packet processing threads to finish
+ *                 their current datagram.
+ *
+ * \param table    Table set up with mbedtls_ssl_cid_table_setup()
+ * \param cid      The connection ID
+ * \param cid_len  Length of \p cid
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p cid is not in the
+ *                 table.
+ * \return         A threading error code if locking fails.
+ */
+int mbedtls_ssl_cid_table_remove(mbedtls_ssl_cid_table *table,
+                                 const unsigned char *cid, size_t cid_len);
+
+/**
+ * \brief          Look up the SSL context of a connection ID
+ *                 (Thread-safe, lock-free with GCC or Clang)
+ *
+ * \param table    Table set up with mbedtls_ssl_cid_table_setup()
+ * \param cid      The connection ID
+ * \param cid_len  Length of \p cid
+ *
+ * \return         The SSL context, or NULL if \p cid is not in the table.
+ */
+mbedtls_ssl_context *mbedtls_ssl_cid_table_get(const mbedtls_ssl_cid_table *table,
+                                               const unsigned char *cid,
+                                               size_t cid_len);
+
+/**
+ * \brief          Look up the SSL context a DTLS record is addressed to
+ *                 (Thread-safe, lock-free with GCC or Clang)
+ *
+ *                 This combines mbedtls_ssl_peek_record_cid() and
+ *                 mbedtls_ssl_cid_table_get().
+ *
+ * \param table    Table set up with mbedtls_ssl_cid_table_setup()
+ * \param buf      The datagram, starting with a record header
+ * \param len      Length of \p buf
+ *
+ * \return         The SSL context, or NULL if the record has no connection
+ *                 ID or an unknown one. The datagram may then be from a new
+ *                 client, and should be routed by its source address.
+ */
+mbedtls_ssl_context *mbedtls_ssl_cid_table_get_record(const mbedtls_ssl_cid_table *table,
+                                                      const unsigned char *buf,
+                                                      size_t len);
+
+/**
+ * \brief          Free a connection ID table
+ *
+ * \note           The SSL contexts in the table are not freed.
+ *
+ * \param table    Table to free
+ */
+void mbedtls_ssl_cid_table_free(mbedtls_ssl_cid_table *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_cid_table.h */
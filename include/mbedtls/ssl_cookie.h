@@ -15,12 +15,6 @@
 
 #include "mbedtls/ssl.h"
 
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
-#if defined(MBEDTLS_THREADING_C)
-#include "mbedtls/threading.h"
-#endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
-
 /**
  * \name SECTION: Module settings
  *
@@ -40,25 +34,27 @@ extern "C" {
 
 /**
  * \brief          Context for the default cookie functions.
+ *
+ *                 Once set up, the context is only read by
+ *                 mbedtls_ssl_cookie_write() and mbedtls_ssl_cookie_check(),
+ *                 so it can be shared between threads without a lock.
+ *                 Without MBEDTLS_USE_PSA_CRYPTO, it holds the hash states
+ *                 after the HMAC inner and outer pads, which each cookie
+ *                 starts from instead of hashing the pads again.
  */
 typedef struct mbedtls_ssl_cookie_ctx {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     mbedtls_svc_key_id_t    MBEDTLS_PRIVATE(psa_hmac_key);  /*!< key id for the HMAC portion   */
     psa_algorithm_t         MBEDTLS_PRIVATE(psa_hmac_alg);  /*!< key algorithm for the HMAC portion   */
 #else
-    mbedtls_md_context_t    MBEDTLS_PRIVATE(hmac_ctx);   /*!< context for the HMAC portion   */
+    mbedtls_md_context_t    MBEDTLS_PRIVATE(inner_ctx);  /*!< hash state after K ^ ipad    */
+    mbedtls_md_context_t    MBEDTLS_PRIVATE(outer_ctx);  /*!< hash state after K ^ opad    */
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 #if !defined(MBEDTLS_HAVE_TIME)
     unsigned long   MBEDTLS_PRIVATE(serial);     /*!< serial number for expiration   */
 #endif
     unsigned long   MBEDTLS_PRIVATE(timeout);    /*!< timeout delay, in seconds if HAVE_TIME,
                                                     or in number of tickets issued */
-
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
-#if defined(MBEDTLS_THREADING_C)
-    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
-#endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 } mbedtls_ssl_cookie_ctx;
 
 /**
@@ -91,6 +87,13 @@ void mbedtls_ssl_cookie_free(mbedtls_ssl_cookie_ctx *ctx);
 
 /**
  * \brief          Generate cookie, see \c mbedtls_ssl_cookie_write_t
+ *
+ * \note           This function takes no lock and may be called
+ *                 concurrently on the same context, as may
+ *                 mbedtls_ssl_cookie_check(). Without MBEDTLS_HAVE_TIME,
+ *                 the serial number used for expiration is updated without
+ *                 synchronization, so concurrent callers may issue cookies
+ *                 with the same serial number.
  */
 mbedtls_ssl_cookie_write_t mbedtls_ssl_cookie_write;
 
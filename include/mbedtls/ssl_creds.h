@@ -0,0 +1,177 @@
+/**
+ * \file ssl_creds.h
+ *
+ * \brief Trusted CAs and own certificates of a configuration, replaceable
+ *        while handshakes are running
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_CREDS_H
+#define MBEDTLS_SSL_CREDS_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct mbedtls_ssl_creds mbedtls_ssl_creds;
+
+/**
+ * \brief          Callback type: a set of credentials is no longer used
+ *
+ *                 This is called once the set was replaced in its slot and
+ *                 the last handshake using it has ended, possibly on the
+ *                 thread of that handshake. The set is not used by the
+ *                 library anymore: the callback typically calls
+ *                 mbedtls_ssl_creds_free() and frees the certificates, CRLs
+ *                 and keys it refers to.
+ *
+ * \param p_release The context given to mbedtls_ssl_creds_init()
+ * \param creds    The set of credentials
+ */
+typedef void mbedtls_ssl_creds_release_t(void *p_release,
+                                         mbedtls_ssl_creds *creds);
+
+/**
+ * \brief   A set of credentials: trusted CAs with their CRLs, and own
+ *          certificate/key pairs
+ */
+struct mbedtls_ssl_creds {
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(ca_chain);    /*!< trusted CAs            */
+    mbedtls_x509_crl *MBEDTLS_PRIVATE(ca_crl);      /*!< trusted CAs CRLs       */
+    mbedtls_ssl_key_cert *MBEDTLS_PRIVATE(key_cert); /*!< own certificate/key pair(s) */
+    struct mbedtls_ssl_creds_slot *MBEDTLS_PRIVATE(slot); /*!< slot it was set in */
+    size_t MBEDTLS_PRIVATE(refs);                   /*!< slot and handshakes    */
+    mbedtls_ssl_creds_release_t *MBEDTLS_PRIVATE(f_release);
+    void *MBEDTLS_PRIVATE(p_release);               /*!< context for f_release  */
+};
+
+/**
+ * \brief   The current credentials of one or more configurations
+ *
+ *          Set in a configuration with mbedtls_ssl_conf_creds(), its
+ *          credentials are used instead of those set with
+ *          mbedtls_ssl_conf_ca_chain() and mbedtls_ssl_conf_own_cert().
+ *          Each handshake takes a reference to the current set when it
+ *          starts and keeps it until it ends, so
+ *          mbedtls_ssl_creds_slot_set() rotates certificates or CA bundles
+ *          on a live configuration: new handshakes use the new set at once,
+ *          handshakes in progress finish with the old one, and the old set
+ *          is released after the last of them.
+ *
+ *          Taking or dropping a reference only holds the mutex of the slot
+ *          for a few instructions, so a reload never stalls handshakes.
+ */
+typedef struct mbedtls_ssl_creds_slot {
+    mbedtls_ssl_creds *MBEDTLS_PRIVATE(current);    /*!< set for new handshakes */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+} mbedtls_ssl_creds_slot;
+
+/**
+ * \brief          Initialize a set of credentials
+ *
+ * \param creds    Set to initialize
+ * \param f_release Callback called when the set is no longer used after
+ *                 being replaced in its slot, or \c NULL.
+ * \param p_release Context passed to \p f_release.
+ */
+void mbedtls_ssl_creds_init(mbedtls_ssl_creds *creds,
+                            mbedtls_ssl_creds_release_t *f_release,
+                            void *p_release);
+
+/**
+ * \brief          Set the trusted CAs of a set of credentials, used as with
+ *                 mbedtls_ssl_conf_ca_chain()
+ *
+ * \param creds    Set of credentials, not set in a slot yet
+ * \param ca_chain Trusted CA chain, or \c NULL to keep those of the
+ *                 configuration
+ * \param ca_crl   Trusted CA CRLs
+ */
+void mbedtls_ssl_creds_set_ca_chain(mbedtls_ssl_creds *creds,
+                                    mbedtls_x509_crt *ca_chain,
+                                    mbedtls_x509_crl *ca_crl);
+
+/**
+ * \brief          Add an own certificate chain and private key to a set of
+ *                 credentials, as mbedtls_ssl_conf_own_cert() does
+ *
+ *                 If no certificate is added, handshakes use those of the
+ *                 configuration.
+ *
+ * \param creds    Set of credentials, not set in a slot yet
+ * \param conf     Configuration the set is for, used to prepare the
+ *                 certificate messages as for mbedtls_ssl_conf_own_cert()
+ * \param own_cert Own public certificate chain
+ * \param pk_key   Own private key
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the set is already
+ *                 in a slot.
+ */
+int mbedtls_ssl_creds_add_own_cert(mbedtls_ssl_creds *creds,
+                                   const mbedtls_ssl_config *conf,
+                                   mbedtls_x509_crt *own_cert,
+                                   mbedtls_pk_context *pk_key);
+
+/**
+ * \brief          Free the certificate/key lists of a set of credentials.
+ *                 The certificates, CRLs and keys themselves are not freed.
+ *
+ * \param creds    Set of credentials, not used by any slot or handshake
+ */
+void mbedtls_ssl_creds_free(mbedtls_ssl_creds *creds);
+
+/**
+ * \brief          Initialize a credential slot, with no current set
+ *
+ * \param slot     Slot to initialize
+ */
+void mbedtls_ssl_creds_slot_init(mbedtls_ssl_creds_slot *slot);
+
+/**
+ * \brief          Make a set of credentials the current one of a slot
+ *
+ *                 Handshakes starting after this call use \p creds. The
+ *                 previous set is released once the handshakes that use it
+ *                 have ended, possibly before this function returns.
+ *
+ * \param slot     Slot
+ * \param creds    Set of credentials, which cannot have been set in a slot
+ *                 before, or \c NULL to use those of the configuration
+ *                 again.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p creds was already
+ *                 set in a slot.
+ * \return         #MBEDTLS_ERR_THREADING_MUTEX_ERROR if the mutex of the
+ *                 slot cannot be locked.
+ */
+int mbedtls_ssl_creds_slot_set(mbedtls_ssl_creds_slot *slot,
+                               mbedtls_ssl_creds *creds);
+
+/**
+ * \brief          Free a credential slot, and release its current set
+ *
+ * \param slot     Slot, not used by any configuration or handshake
+ */
+void mbedtls_ssl_creds_slot_free(mbedtls_ssl_creds_slot *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_creds.h */
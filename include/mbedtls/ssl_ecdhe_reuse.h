@@ -0,0 +1,130 @@
+/**
+ * \file ssl_ecdhe_reuse.h
+ *
+ * \brief Bounded reuse of ephemeral ECDHE key pairs by TLS 1.2 servers
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_ECDHE_REUSE_H
+#define MBEDTLS_SSL_ECDHE_REUSE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Policy and current key pairs for ECDHE key reuse
+ *
+ *          When set with mbedtls_ssl_conf_ecdhe_reuse(), the TLS 1.2
+ *          ECDHE_RSA and ECDHE_ECDSA key exchanges of a server use the
+ *          current key pair of the negotiated group instead of generating
+ *          one, until it has served a number of handshakes or is older
+ *          than a number of milliseconds. The next handshake of the group
+ *          then generates a new key pair.
+ *
+ * \warning Reusing an ephemeral key weakens forward secrecy: a compromise
+ *          of the key pair, for example through a memory disclosure,
+ *          exposes every session it was used for, not just one. The
+ *          window bounds how many sessions that is. This is meant to shed
+ *          load temporarily, for example during an incident, and should
+ *          not be left enabled by default.
+ *
+ *          Key pairs are volatile PSA keys, which never leave the memory of
+ *          the process. A process created with fork() shares them with its
+ *          parent until mbedtls_ssl_ecdhe_reuse_flush() is called in it.
+ *          ECDHE_PSK key exchanges and TLS 1.3 key shares always use a
+ *          fresh key pair.
+ */
+typedef struct mbedtls_ssl_ecdhe_reuse {
+    struct mbedtls_ssl_ecdhe_reuse_key *MBEDTLS_PRIVATE(keys); /*!< current key pair of each group */
+    uint32_t MBEDTLS_PRIVATE(max_uses);     /*!< handshakes per key pair, 0 for no bound */
+    uint32_t MBEDTLS_PRIVATE(max_ms);       /*!< lifetime of a key pair, 0 for no bound */
+    uint64_t MBEDTLS_PRIVATE(generated);    /*!< key pairs generated    */
+    uint64_t MBEDTLS_PRIVATE(reused);       /*!< handshakes that reused one */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+} mbedtls_ssl_ecdhe_reuse;
+
+/**
+ * \brief          Initialize an ECDHE reuse context
+ *
+ * \param ctx      Context to initialize
+ */
+void mbedtls_ssl_ecdhe_reuse_init(mbedtls_ssl_ecdhe_reuse *ctx);
+
+/**
+ * \brief          Set the reuse window of an ECDHE reuse context
+ *
+ *                 A key pair is replaced when it has been used for
+ *                 \p max_uses handshakes or is \p max_ms milliseconds old,
+ *                 whichever comes first.
+ *
+ * \param ctx      Context to set up
+ * \param max_uses Maximum number of handshakes per key pair, or \c 0 for
+ *                 no bound on the number of handshakes. \c 1 disables reuse.
+ * \param max_ms   Maximum age of a key pair in milliseconds, or \c 0 for no
+ *                 bound on the age.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the context was already
+ *                 set up or both bounds are \c 0.
+ */
+int mbedtls_ssl_ecdhe_reuse_setup(mbedtls_ssl_ecdhe_reuse *ctx,
+                                  uint32_t max_uses, uint32_t max_ms);
+
+/**
+ * \brief          Retire the current key pairs, so that the next handshake
+ *                 of each group generates a new one
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 A key pair is destroyed when the last handshake using it
+ *                 ends. Call this in a child process after fork(), or when
+ *                 reuse is turned off.
+ *
+ * \param ctx      Context set up with mbedtls_ssl_ecdhe_reuse_setup()
+ */
+void mbedtls_ssl_ecdhe_reuse_flush(mbedtls_ssl_ecdhe_reuse *ctx);
+
+/**
+ * \brief          Get the counters of an ECDHE reuse context, for auditing
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param ctx      Context set up with mbedtls_ssl_ecdhe_reuse_setup()
+ * \param generated  On success, the number of key pairs generated through
+ *                 the context. Can be \c NULL.
+ * \param reused   On success, the number of handshakes that used a key pair
+ *                 already used by an earlier handshake. Can be \c NULL.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_THREADING_MUTEX_ERROR if locking fails.
+ */
+int mbedtls_ssl_ecdhe_reuse_stats(mbedtls_ssl_ecdhe_reuse *ctx,
+                                  uint64_t *generated, uint64_t *reused);
+
+/**
+ * \brief          Free an ECDHE reuse context and destroy its key pairs
+ *
+ * \note           No SSL context using \p ctx may be performing a handshake
+ *                 while it is freed.
+ *
+ * \param ctx      Context to free
+ */
+void mbedtls_ssl_ecdhe_reuse_free(mbedtls_ssl_ecdhe_reuse *ctx);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_ecdhe_reuse.h */
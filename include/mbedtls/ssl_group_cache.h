@@ -0,0 +1,126 @@
+/**
+ * \file ssl_group_cache.h
+ *
+ * \brief Cache of the key exchange group each server selected
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_GROUP_CACHE_H
+#define MBEDTLS_SSL_GROUP_CACHE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   A slot of the cache
+ */
+typedef struct mbedtls_ssl_group_cache_entry {
+    uint32_t MBEDTLS_PRIVATE(name_hash);         /*!< hash of the server name */
+    uint16_t MBEDTLS_PRIVATE(group);             /*!< IANA NamedGroup, 0 if empty */
+} mbedtls_ssl_group_cache_entry;
+
+/**
+ * \brief   Cache of the group each server selected, by server name
+ *
+ *          When set with mbedtls_ssl_conf_group_cache(), a TLS 1.3 client
+ *          remembers the group that the server selected in its
+ *          HelloRetryRequest or ServerHello, and offers its key share
+ *          first in the next handshake with the same server name. This
+ *          saves the HelloRetryRequest round trip and key generation with
+ *          servers that do not prefer the first configured group.
+ *
+ *          The cache is direct-mapped and only keeps a hash of the names:
+ *          two names may share a slot, in which case a prediction can be
+ *          wrong. A wrong prediction only costs a HelloRetryRequest, and
+ *          the predicted group is always one the configuration allows.
+ */
+typedef struct mbedtls_ssl_group_cache {
+    mbedtls_ssl_group_cache_entry *MBEDTLS_PRIVATE(entries);
+    size_t MBEDTLS_PRIVATE(mask);                /*!< slot count - 1     */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the entries */
+#endif
+} mbedtls_ssl_group_cache;
+
+/**
+ * \brief          Initialize a group cache
+ *
+ * \param cache    Cache to initialize
+ */
+void mbedtls_ssl_group_cache_init(mbedtls_ssl_group_cache *cache);
+
+/**
+ * \brief          Allocate the slots of a group cache
+ *
+ * \param cache    Cache to set up
+ * \param num_entries  Number of slots, rounded up to a power of two. About
+ *                 the number of servers the client connects to.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache was already
+ *                 set up or \p num_entries is out of range.
+ */
+int mbedtls_ssl_group_cache_setup(mbedtls_ssl_group_cache *cache,
+                                  size_t num_entries);
+
+/**
+ * \brief          Look up the group remembered for a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param cache    Cache set up with mbedtls_ssl_group_cache_setup()
+ * \param name     Server name, as set with mbedtls_ssl_set_hostname()
+ *
+ * \return         The IANA NamedGroup value, or
+ *                 #MBEDTLS_SSL_IANA_TLS_GROUP_NONE if none is known or
+ *                 locking fails.
+ */
+uint16_t mbedtls_ssl_group_cache_get(mbedtls_ssl_group_cache *cache,
+                                     const char *name);
+
+/**
+ * \brief          Remember the group selected by a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The handshake does this itself. This function can also
+ *                 be used to seed the cache.
+ *
+ * \param cache    Cache set up with mbedtls_ssl_group_cache_setup()
+ * \param name     Server name, as set with mbedtls_ssl_set_hostname()
+ * \param group    IANA NamedGroup value, or
+ *                 #MBEDTLS_SSL_IANA_TLS_GROUP_NONE to forget the server.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the cache is not set up.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_group_cache_set(mbedtls_ssl_group_cache *cache,
+                                const char *name, uint16_t group);
+
+/**
+ * \brief          Free a group cache
+ *
+ * \note           No SSL context using the cache may be performing a
+ *                 handshake while it is freed.
+ *
+ * \param cache    Cache to free
+ */
+void mbedtls_ssl_group_cache_free(mbedtls_ssl_group_cache *cache);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_group_cache.h */
@@ -0,0 +1,205 @@
+/**
+ * \file ssl_hs_budget.h
+ *
+ * \brief CPU budget for server handshakes, favouring cheap handshakes
+ *        under overload
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_HS_BUDGET_H
+#define MBEDTLS_SSL_HS_BUDGET_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_HS_BUDGET_DEFAULT_MAX_DEFERRALS)
+#define MBEDTLS_SSL_HS_BUDGET_DEFAULT_MAX_DEFERRALS 16 /*!< Deferrals before rejection */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/**
+ * \name Handshake classes
+ *
+ * What the budget charges for a handshake depends on its class.
+ * \{
+ */
+#define MBEDTLS_SSL_HS_BUDGET_RESUME        0 /*!< resumed session */
+#define MBEDTLS_SSL_HS_BUDGET_PSK           1 /*!< external PSK, no key */
+#define MBEDTLS_SSL_HS_BUDGET_ECC           2 /*!< full, with an EC key */
+#define MBEDTLS_SSL_HS_BUDGET_RSA           3 /*!< full, with an RSA key */
+#define MBEDTLS_SSL_HS_BUDGET_CLASSES       4 /*!< number of classes */
+/** \} name Handshake classes */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   CPU budget for server handshakes
+ *
+ *          The budget is a token bucket of cost units: it earns \c rate
+ *          units per second, up to \c capacity, and each admitted
+ *          handshake spends the cost of its class. The default costs are
+ *          1 for resumed and PSK handshakes, 4 for full handshakes with an
+ *          EC key and 16 with an RSA key, after the relative CPU time of
+ *          these handshakes. Set the rate to the cost units the workers can
+ *          afford per second, and adjust the costs to the measured ones.
+ *
+ *          Full handshakes are only admitted while more than \c reserve
+ *          units would be left, so that resumed handshakes keep going
+ *          through under overload. A handshake over budget is deferred,
+ *          which lets the worker take another one, and rejected once it has
+ *          been deferred \c max_deferrals times.
+ */
+typedef struct mbedtls_ssl_hs_budget {
+    uint32_t MBEDTLS_PRIVATE(rate);              /*!< units per second     */
+    uint32_t MBEDTLS_PRIVATE(capacity);          /*!< most units kept      */
+    uint32_t MBEDTLS_PRIVATE(reserve);           /*!< units for resumption */
+    uint32_t MBEDTLS_PRIVATE(max_deferrals);     /*!< deferrals allowed    */
+    uint32_t MBEDTLS_PRIVATE(cost)[MBEDTLS_SSL_HS_BUDGET_CLASSES];
+    uint64_t MBEDTLS_PRIVATE(level);             /*!< units left, in
+                                                      thousandths          */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(last);     /*!< time of last refill  */
+    uint32_t MBEDTLS_PRIVATE(admitted);          /*!< handshakes admitted  */
+    uint32_t MBEDTLS_PRIVATE(deferred);          /*!< deferrals            */
+    uint32_t MBEDTLS_PRIVATE(rejected);          /*!< handshakes rejected  */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the budget */
+#endif
+} mbedtls_ssl_hs_budget;
+
+/**
+ * \brief          Initialize a handshake budget
+ *
+ * \param budget   Budget to initialize
+ */
+void mbedtls_ssl_hs_budget_init(mbedtls_ssl_hs_budget *budget);
+
+/**
+ * \brief          Set up a handshake budget, full
+ *
+ * \param budget   Budget to set up
+ * \param rate     Cost units earned per second
+ * \param capacity Most cost units kept, which bounds the burst of
+ *                 handshakes admitted after an idle period
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p rate or \p capacity
+ *                 is \c 0.
+ */
+int mbedtls_ssl_hs_budget_setup(mbedtls_ssl_hs_budget *budget,
+                                uint32_t rate, uint32_t capacity);
+
+/**
+ * \brief          Set the cost of a class of handshakes
+ *
+ * \param budget   Budget to configure
+ * \param hs_class One of the \c MBEDTLS_SSL_HS_BUDGET_XXX classes
+ * \param cost     Cost units spent by each handshake of the class
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p hs_class is invalid.
+ */
+int mbedtls_ssl_hs_budget_set_cost(mbedtls_ssl_hs_budget *budget,
+                                   int hs_class, uint32_t cost);
+
+/**
+ * \brief          Set the units kept for resumed handshakes (Default: 0)
+ *
+ * \param budget   Budget to configure
+ * \param reserve  Cost units below which only resumed and PSK handshakes
+ *                 are admitted
+ */
+void mbedtls_ssl_hs_budget_set_reserve(mbedtls_ssl_hs_budget *budget,
+                                       uint32_t reserve);
+
+/**
+ * \brief          Set how many times a handshake over budget is deferred
+ *                 before it is rejected
+ *                 (Default: MBEDTLS_SSL_HS_BUDGET_DEFAULT_MAX_DEFERRALS)
+ *
+ * \param budget   Budget to configure
+ * \param max_deferrals Deferrals allowed, or \c 0 to reject handshakes over
+ *                 budget at once
+ */
+void mbedtls_ssl_hs_budget_set_max_deferrals(mbedtls_ssl_hs_budget *budget,
+                                             uint32_t max_deferrals);
+
+/**
+ * \brief          Get the class of a handshake
+ *
+ * \param info     What the handshake will cost
+ *
+ * \return         One of the \c MBEDTLS_SSL_HS_BUDGET_XXX classes.
+ */
+int mbedtls_ssl_hs_budget_class(const mbedtls_ssl_hs_admission_info *info);
+
+/**
+ * \brief          Admission callback that spends the budget
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Set it with mbedtls_ssl_conf_hs_admission(), with the
+ *                 budget as context. Each configuration or worker can have
+ *                 its own budget, or share one.
+ *
+ *                 A deferred handshake makes the handshake function return
+ *                 #MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS. The worker should then
+ *                 serve other connections and call the handshake function
+ *                 again later. A rejected one makes the handshake function
+ *                 return #MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED, after a
+ *                 handshake_failure alert.
+ *
+ * \param p_budget Budget set up with mbedtls_ssl_hs_budget_setup()
+ * \param ssl      SSL context of the handshake
+ * \param info     What the handshake will cost
+ *
+ * \return         See ::mbedtls_ssl_hs_admission_t.
+ */
+int mbedtls_ssl_hs_budget_admit(void *p_budget, mbedtls_ssl_context *ssl,
+                                const mbedtls_ssl_hs_admission_info *info);
+
+/**
+ * \brief          Get the counts of admitted, deferred and rejected
+ *                 handshakes (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param budget   Budget set up with mbedtls_ssl_hs_budget_setup()
+ * \param admitted Set to the number of admitted handshakes. Can be \c NULL.
+ * \param deferred Set to the number of deferrals. Can be \c NULL.
+ * \param rejected Set to the number of rejected handshakes. Can be \c NULL.
+ *
+ * \return         \c 0 on success.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_hs_budget_get_stats(mbedtls_ssl_hs_budget *budget,
+                                    uint32_t *admitted, uint32_t *deferred,
+                                    uint32_t *rejected);
+
+/**
+ * \brief          Free a handshake budget
+ *
+ * \param budget   Budget to free
+ */
+void mbedtls_ssl_hs_budget_free(mbedtls_ssl_hs_budget *budget);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_hs_budget.h */
@@ -0,0 +1,131 @@
+/**
+ * \file ssl_key_share_pool.h
+ *
+ * \brief Pool of pre-generated ephemeral key pairs for (EC)DHE handshakes
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_KEY_SHARE_POOL_H
+#define MBEDTLS_SSL_KEY_SHARE_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Pool of fresh ephemeral key pairs, in a ring per group
+ *
+ *          When set with mbedtls_ssl_conf_key_share_pool(), TLS 1.3 key
+ *          shares and TLS 1.2 ECDHE key exchanges take a key pair from
+ *          the pool instead of generating one, which takes the key
+ *          generation off the latency of the handshake. Each key pair is
+ *          used once. When the ring of a group is empty, the handshake
+ *          generates its key pair as without a pool.
+ *
+ *          The pool is filled by mbedtls_ssl_key_share_pool_refill(),
+ *          typically from a low-priority thread or when the application
+ *          is idle.
+ */
+typedef struct mbedtls_ssl_key_share_pool {
+    struct mbedtls_ssl_key_share_ring *MBEDTLS_PRIVATE(rings); /*!< one per group */
+    size_t MBEDTLS_PRIVATE(ring_count);
+    size_t MBEDTLS_PRIVATE(ring_size);           /*!< key pairs per group */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the rings */
+#endif
+} mbedtls_ssl_key_share_pool;
+
+/**
+ * \brief          Initialize a key share pool
+ *
+ * \param pool     Pool to initialize
+ */
+void mbedtls_ssl_key_share_pool_init(mbedtls_ssl_key_share_pool *pool);
+
+/**
+ * \brief          Allocate the rings of a key share pool
+ *
+ *                 The pool starts empty: call
+ *                 mbedtls_ssl_key_share_pool_refill() to fill it.
+ *
+ * \note           Each key pair in the pool occupies a PSA key slot.
+ *
+ * \param pool     Pool to set up
+ * \param groups   The groups to pre-generate key pairs for, as IANA
+ *                 NamedGroup values terminated by
+ *                 #MBEDTLS_SSL_IANA_TLS_GROUP_NONE, for example the first
+ *                 groups of the list set with mbedtls_ssl_conf_groups().
+ * \param ring_size  Number of key pairs to keep for each group
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the pool was already
+ *                 set up, the list is empty, a group is not supported or
+ *                 \p ring_size is out of range.
+ */
+int mbedtls_ssl_key_share_pool_setup(mbedtls_ssl_key_share_pool *pool,
+                                     const uint16_t *groups,
+                                     size_t ring_size);
+
+/**
+ * \brief          Generate key pairs for the groups whose ring is not full
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The keys are generated without holding the pool lock,
+ *                 so handshakes are not blocked meanwhile.
+ *
+ * \param pool     Pool set up with mbedtls_ssl_key_share_pool_setup()
+ * \param max_keys Maximum number of key pairs to generate, or \c 0 to
+ *                 fill the pool. A small value bounds the time the call
+ *                 takes, for example in an idle-time callback.
+ * \param generated  If not \c NULL, on return, the number of key pairs
+ *                 added to the pool.
+ *
+ * \return         \c 0 on success.
+ * \return         An \c MBEDTLS_ERR_XXX error code if key generation or
+ *                 locking fails. Key pairs added before the failure stay in
+ *                 the pool.
+ */
+int mbedtls_ssl_key_share_pool_refill(mbedtls_ssl_key_share_pool *pool,
+                                      size_t max_keys, size_t *generated);
+
+/**
+ * \brief          Number of key pairs ready for a group
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param pool     Pool set up with mbedtls_ssl_key_share_pool_setup()
+ * \param group    IANA NamedGroup value
+ *
+ * \return         The number of key pairs, or \c 0 if the pool has no ring
+ *                 for \p group or locking fails.
+ */
+size_t mbedtls_ssl_key_share_pool_count(mbedtls_ssl_key_share_pool *pool,
+                                        uint16_t group);
+
+/**
+ * \brief          Free a key share pool and destroy its key pairs
+ *
+ * \note           No SSL context using the pool may be performing a
+ *                 handshake, and no thread may be refilling it, while the
+ *                 pool is freed.
+ *
+ * \param pool     Pool to free
+ */
+void mbedtls_ssl_key_share_pool_free(mbedtls_ssl_key_share_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_key_share_pool.h */
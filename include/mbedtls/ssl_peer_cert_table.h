@@ -0,0 +1,97 @@
+/**
+ * \file ssl_peer_cert_table.h
+ *
+ * \brief Table of peer certificate chains shared between SSL sessions
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_PEER_CERT_TABLE_H
+#define MBEDTLS_SSL_PEER_CERT_TABLE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Table of the peer certificate chains in use, by a hash of their
+ *          DER certificates
+ *
+ *          When set with mbedtls_ssl_conf_peer_cert_table(), a peer
+ *          certificate chain that is identical to one already held by
+ *          another session is not kept: the session refers to the
+ *          existing chain instead. A chain leaves the table when the last
+ *          session referring to it is freed.
+ */
+typedef struct mbedtls_ssl_peer_cert_table {
+    struct mbedtls_ssl_peer_cert_ref **MBEDTLS_PRIVATE(buckets); /*!< hash chains */
+    size_t MBEDTLS_PRIVATE(mask);                /*!< bucket count - 1   */
+    size_t MBEDTLS_PRIVATE(count);               /*!< chains in the table */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the table and reference counts */
+#endif
+} mbedtls_ssl_peer_cert_table;
+
+/**
+ * \brief          Initialize a peer certificate table
+ *
+ * \param table    Table to initialize
+ */
+void mbedtls_ssl_peer_cert_table_init(mbedtls_ssl_peer_cert_table *table);
+
+/**
+ * \brief          Allocate the buckets of a peer certificate table
+ *
+ * \param table        Table to set up
+ * \param num_buckets  Number of hash buckets, rounded up to a power of two.
+ *                     About the number of distinct peer chains expected
+ *                     to be in use at the same time.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the table was already
+ *                 set up or \p num_buckets is out of range.
+ */
+int mbedtls_ssl_peer_cert_table_setup(mbedtls_ssl_peer_cert_table *table,
+                                      size_t num_buckets);
+
+/**
+ * \brief          Number of distinct chains in a peer certificate table
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param table    Table set up with mbedtls_ssl_peer_cert_table_setup()
+ *
+ * \return         The number of chains, or \c 0 if locking fails.
+ */
+size_t mbedtls_ssl_peer_cert_table_count(mbedtls_ssl_peer_cert_table *table);
+
+/**
+ * \brief          Free a peer certificate table
+ *
+ *                 Sessions still referring to chains of the table keep
+ *                 them, but the chains are no longer shared with new
+ *                 sessions.
+ *
+ * \note           No SSL context using the table may be performing a
+ *                 handshake, and no session referring to a chain of the
+ *                 table may be freed or copied, while the table is freed.
+ *
+ * \param table    Table to free
+ */
+void mbedtls_ssl_peer_cert_table_free(mbedtls_ssl_peer_cert_table *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_peer_cert_table.h */
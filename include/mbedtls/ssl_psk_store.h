@@ -0,0 +1,141 @@
+/**
+ * \file ssl_psk_store.h
+ *
+ * \brief Server pre-shared keys by identity, in a hash table
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_PSK_STORE_H
+#define MBEDTLS_SSL_PSK_STORE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Store of the pre-shared keys of a server, by identity
+ *
+ *          Set as the PSK callback with
+ *          mbedtls_ssl_conf_psk_cb(conf, mbedtls_ssl_psk_store_cb, store),
+ *          it selects the key of the identity the client offers, in TLS 1.2
+ *          and TLS 1.3, in constant time on average whatever the number of
+ *          identities.
+ *
+ *          A key is either an opaque PSA key imported by the application,
+ *          which handshakes use as is, or a raw key kept in the store. A
+ *          TLS 1.3 handshake reads a raw key from the store, with no key
+ *          import; a TLS 1.2 handshake imports it, as with
+ *          mbedtls_ssl_set_hs_psk(). Raw keys let a store hold far more
+ *          identities than there are PSA key slots.
+ *
+ *          Identities are added before the store is set in a configuration,
+ *          and the store must not be modified or freed while handshakes use
+ *          it.
+ */
+typedef struct mbedtls_ssl_psk_store {
+    struct mbedtls_ssl_psk_store_entry **MBEDTLS_PRIVATE(buckets);
+    size_t MBEDTLS_PRIVATE(mask);               /*!< number of buckets - 1 */
+    size_t MBEDTLS_PRIVATE(count);              /*!< number of identities */
+} mbedtls_ssl_psk_store;
+
+/**
+ * \brief          Initialize a PSK store
+ *
+ * \param store    Store to initialize
+ */
+void mbedtls_ssl_psk_store_init(mbedtls_ssl_psk_store *store);
+
+/**
+ * \brief          Allocate the buckets of a PSK store
+ *
+ * \param store    Store to set up
+ * \param num_buckets  Number of hash buckets, rounded up to a power of two,
+ *                 typically the number of identities to add.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store was already
+ *                 set up or \p num_buckets is out of range.
+ */
+int mbedtls_ssl_psk_store_setup(mbedtls_ssl_psk_store *store,
+                                size_t num_buckets);
+
+/**
+ * \brief          Add an identity with a raw key
+ *
+ * \param store    Store set up with mbedtls_ssl_psk_store_setup()
+ * \param identity PSK identity
+ * \param identity_len Length of \p identity
+ * \param psk      Pre-shared key, copied into the store
+ * \param psk_len  Length of \p psk, at most #MBEDTLS_PSK_MAX_LEN
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store is not set up,
+ *                 \p identity or \p psk is empty or too long, or the
+ *                 identity is already in the store.
+ */
+int mbedtls_ssl_psk_store_add(mbedtls_ssl_psk_store *store,
+                              const unsigned char *identity,
+                              size_t identity_len,
+                              const unsigned char *psk, size_t psk_len);
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+/**
+ * \brief          Add an identity with an opaque key
+ *
+ * \param store    Store set up with mbedtls_ssl_psk_store_setup()
+ * \param identity PSK identity
+ * \param identity_len Length of \p identity
+ * \param psk      Key, with a policy as for mbedtls_ssl_set_hs_psk_opaque().
+ *                 The store does not take ownership of the key, which must
+ *                 outlive it.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store is not set up,
+ *                 \p identity is empty or too long, \p psk is null, or the
+ *                 identity is already in the store.
+ */
+int mbedtls_ssl_psk_store_add_opaque(mbedtls_ssl_psk_store *store,
+                                     const unsigned char *identity,
+                                     size_t identity_len,
+                                     mbedtls_svc_key_id_t psk);
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+/**
+ * \brief          PSK callback for mbedtls_ssl_conf_psk_cb()
+ *
+ * \param p_store  Store set up with mbedtls_ssl_psk_store_setup()
+ * \param ssl      SSL context of the handshake
+ * \param identity PSK identity offered by the client
+ * \param identity_len Length of \p identity
+ *
+ * \return         \c 0 if the identity is in the store, and its key is set
+ *                 for the handshake.
+ * \return         #MBEDTLS_ERR_SSL_UNKNOWN_IDENTITY if it is not.
+ * \return         Another negative error code if the key cannot be set.
+ */
+int mbedtls_ssl_psk_store_cb(void *p_store, mbedtls_ssl_context *ssl,
+                             const unsigned char *identity,
+                             size_t identity_len);
+
+/**
+ * \brief          Free a PSK store, and wipe its raw keys
+ *
+ * \param store    Store to free
+ */
+void mbedtls_ssl_psk_store_free(mbedtls_ssl_psk_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_psk_store.h */
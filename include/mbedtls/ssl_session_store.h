@@ -0,0 +1,224 @@
+/**
+ * \file ssl_session_store.h
+ *
+ * \brief Client-side store of the sessions to resume, by server
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SESSION_STORE_H
+#define MBEDTLS_SSL_SESSION_STORE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT)
+#define MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT   86400   /*!< 1 day  */
+#endif
+
+#if !defined(MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS)
+#define MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS           4   /*!< TLS 1.3 tickets kept per server */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   A serialized session of a store entry
+ */
+typedef struct mbedtls_ssl_session_store_slot {
+    unsigned char *MBEDTLS_PRIVATE(data);        /*!< serialized session */
+    size_t MBEDTLS_PRIVATE(len);                 /*!< length of data     */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(expiry);   /*!< time it expires at */
+} mbedtls_ssl_session_store_slot;
+
+/**
+ * \brief   The sessions of one server
+ */
+typedef struct mbedtls_ssl_session_store_entry {
+    unsigned char *MBEDTLS_PRIVATE(key);         /*!< port, name and ALPN  */
+    size_t MBEDTLS_PRIVATE(key_len);             /*!< length of key        */
+    uint32_t MBEDTLS_PRIVATE(hash);              /*!< hash of key          */
+    uint32_t MBEDTLS_PRIVATE(bucket_next);       /*!< next in hash bucket,
+                                                      or in the free list  */
+    uint32_t MBEDTLS_PRIVATE(lru_prev);          /*!< more recently used   */
+    uint32_t MBEDTLS_PRIVATE(lru_next);          /*!< less recently used   */
+    uint16_t MBEDTLS_PRIVATE(tls_version);       /*!< version of the slots */
+    uint8_t MBEDTLS_PRIVATE(count);              /*!< slots in use         */
+    /*! Sessions, oldest first */
+    mbedtls_ssl_session_store_slot MBEDTLS_PRIVATE(slots)[MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS];
+} mbedtls_ssl_session_store_entry;
+
+/**
+ * \brief   Store of the sessions to resume, by server
+ *
+ *          When set with mbedtls_ssl_conf_session_store(), a client looks
+ *          up a session for the server before each initial handshake, and
+ *          stores the sessions it gets: the TLS 1.2 session at the end of
+ *          the handshake, and each TLS 1.3 ticket as it arrives. The
+ *          application no longer needs mbedtls_ssl_get_session() and
+ *          mbedtls_ssl_set_session() to resume.
+ *
+ *          Servers are told apart by the name set with
+ *          mbedtls_ssl_set_hostname(), the port set with
+ *          mbedtls_ssl_set_server_port() and the first protocol set with
+ *          mbedtls_ssl_conf_alpn_protocols().
+ *
+ *          A TLS 1.2 server has one session, which is reused until it
+ *          expires. A TLS 1.3 server has up to
+ *          #MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS tickets, each used once
+ *          as recommended by RFC 8446 appendix C.4: the most recent first,
+ *          and the oldest dropped when a new one does not fit. When the
+ *          store is full, the least recently used server is evicted.
+ */
+typedef struct mbedtls_ssl_session_store {
+    mbedtls_ssl_session_store_entry *MBEDTLS_PRIVATE(entries);
+    uint32_t *MBEDTLS_PRIVATE(buckets);          /*!< first entry of each bucket */
+    uint32_t MBEDTLS_PRIVATE(mask);              /*!< bucket count - 1           */
+    uint32_t MBEDTLS_PRIVATE(max_entries);       /*!< number of entries          */
+    uint32_t MBEDTLS_PRIVATE(used);              /*!< entries ever used          */
+    uint32_t MBEDTLS_PRIVATE(free_head);         /*!< first released entry       */
+    uint32_t MBEDTLS_PRIVATE(lru_head);          /*!< most recently used entry   */
+    uint32_t MBEDTLS_PRIVATE(lru_tail);          /*!< least recently used entry  */
+    uint32_t MBEDTLS_PRIVATE(timeout);           /*!< session timeout (seconds)  */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects the store */
+#endif
+} mbedtls_ssl_session_store;
+
+/**
+ * \brief          Initialize a session store
+ *
+ * \param store    Store to initialize
+ */
+void mbedtls_ssl_session_store_init(mbedtls_ssl_session_store *store);
+
+/**
+ * \brief          Allocate the entries of a session store
+ *
+ * \param store    Store to set up
+ * \param max_entries  Maximum number of servers kept
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store was already
+ *                 set up or \p max_entries is out of range.
+ */
+int mbedtls_ssl_session_store_setup(mbedtls_ssl_session_store *store,
+                                    size_t max_entries);
+
+/**
+ * \brief          Set the maximum age of the stored sessions
+ *                 (Default: MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT (1 day))
+ *
+ *                 Sessions with a ticket also expire with the lifetime the
+ *                 server gave to the ticket, if that is shorter.
+ *
+ * \param store    Store to configure
+ * \param timeout  Session timeout in seconds
+ */
+void mbedtls_ssl_session_store_set_timeout(mbedtls_ssl_session_store *store,
+                                           uint32_t timeout);
+
+/**
+ * \brief          Take a session to resume with a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The handshake does this itself. A TLS 1.3 session is
+ *                 removed from the store, a TLS 1.2 session is kept.
+ *
+ * \param store    Store set up with mbedtls_ssl_session_store_setup()
+ * \param name     Server name
+ * \param port     Server port, or \c 0 if unknown
+ * \param alpn     First offered ALPN protocol, or \c NULL
+ * \param session  Initialized session to fill
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if no session is
+ *                 stored for the server or all have expired.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store is not set up.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_session_store_get(mbedtls_ssl_session_store *store,
+                                  const char *name, uint16_t port,
+                                  const char *alpn,
+                                  mbedtls_ssl_session *session);
+
+/**
+ * \brief          Store a session to resume with a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The handshake does this itself. This function can also
+ *                 be used to seed the store, with sessions from
+ *                 mbedtls_ssl_get_session().
+ *
+ * \param store    Store set up with mbedtls_ssl_session_store_setup()
+ * \param name     Server name
+ * \param port     Server port, or \c 0 if unknown
+ * \param alpn     First offered ALPN protocol, or \c NULL
+ * \param session  Session to store. A TLS 1.2 session replaces the
+ *                 sessions of the server, a TLS 1.3 one is added to them.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store is not set
+ *                 up, or the session cannot be resumed or has no lifetime.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code on failure.
+ */
+int mbedtls_ssl_session_store_set(mbedtls_ssl_session_store *store,
+                                  const char *name, uint16_t port,
+                                  const char *alpn,
+                                  const mbedtls_ssl_session *session);
+
+/**
+ * \brief          Forget the sessions of a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ * \param store    Store set up with mbedtls_ssl_session_store_setup()
+ * \param name     Server name
+ * \param port     Server port, or \c 0 if unknown
+ * \param alpn     First offered ALPN protocol, or \c NULL
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if no session is
+ *                 stored for the server.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the store is not set up.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_session_store_remove(mbedtls_ssl_session_store *store,
+                                     const char *name, uint16_t port,
+                                     const char *alpn);
+
+/**
+ * \brief          Free a session store
+ *
+ * \note           No SSL context using the store may be performing a
+ *                 handshake while it is freed.
+ *
+ * \param store    Store to free
+ */
+void mbedtls_ssl_session_store_free(mbedtls_ssl_session_store *store);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_session_store.h */
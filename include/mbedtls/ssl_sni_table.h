@@ -0,0 +1,154 @@
+/**
+ * \file ssl_sni_table.h
+ *
+ * \brief Server certificate selection by host name, with hash maps of exact
+ *        and wildcard names
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_SNI_TABLE_H
+#define MBEDTLS_SSL_SNI_TABLE_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   Table of the certificates of a server, by host name
+ *
+ *          Set as the ServerName callback with
+ *          mbedtls_ssl_conf_sni(conf, mbedtls_ssl_sni_table_cb, table), it
+ *          selects the certificates, trusted CAs and authentication mode of
+ *          the name the client asks for. The key/certificate lists are
+ *          built when the names are added, so a handshake makes no
+ *          allocation to use them, unlike mbedtls_ssl_set_hs_own_cert().
+ *
+ *          A name is either an exact host name, like \c "www.example.com",
+ *          or a wildcard name, like \c "*.example.com", which matches any
+ *          name with one more label to the left, but not
+ *          \c "example.com" itself. An exact name takes precedence over a
+ *          wildcard one. Names are compared without regard to case.
+ *
+ *          Names are added before the table is set in a configuration, and
+ *          the table must not be modified or freed while handshakes use it.
+ */
+typedef struct mbedtls_ssl_sni_table {
+    struct mbedtls_ssl_sni_entry **MBEDTLS_PRIVATE(buckets);
+    size_t MBEDTLS_PRIVATE(mask);               /*!< number of buckets - 1 */
+    size_t MBEDTLS_PRIVATE(count);              /*!< number of names */
+} mbedtls_ssl_sni_table;
+
+/**
+ * \brief          Initialize a host name table
+ *
+ * \param table    Table to initialize
+ */
+void mbedtls_ssl_sni_table_init(mbedtls_ssl_sni_table *table);
+
+/**
+ * \brief          Allocate the buckets of a host name table
+ *
+ * \param table    Table to set up
+ * \param num_buckets  Number of hash buckets, rounded up to a power of two,
+ *                 typically the number of names to add.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the table was already
+ *                 set up or \p num_buckets is out of range.
+ */
+int mbedtls_ssl_sni_table_setup(mbedtls_ssl_sni_table *table,
+                                size_t num_buckets);
+
+/**
+ * \brief          Add a certificate for a host name
+ *
+ *                 Call it several times with the same name to offer several
+ *                 certificates, for example an RSA and an ECDSA one, as
+ *                 with mbedtls_ssl_set_hs_own_cert().
+ *
+ * \param table    Table set up with mbedtls_ssl_sni_table_setup()
+ * \param conf     Configuration the table is for, used to prepare the
+ *                 certificate messages as for mbedtls_ssl_conf_own_cert()
+ * \param name     Host name, or wildcard name starting with \c "*."
+ * \param name_len Length of \p name
+ * \param own_cert Certificate chain for the name
+ * \param pk_key   Private key of the first certificate of \p own_cert
+ * \param ca_chain Trusted CAs to verify client certificates with, or \c NULL
+ *                 to use those of the configuration
+ * \param ca_crl   CRLs of \p ca_chain, or \c NULL
+ * \param authmode Client authentication mode, as for
+ *                 mbedtls_ssl_set_hs_authmode(), or #MBEDTLS_SSL_VERIFY_UNSET
+ *                 to use the one of the configuration
+ *
+ * \note           The last CA chain and authentication mode given for a name
+ *                 apply to all of its certificates. The table keeps pointers
+ *                 to \p own_cert, \p pk_key, \p ca_chain and \p ca_crl, which
+ *                 must outlive it.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the table is not set up
+ *                 or \p name is empty or a bare \c "*.".
+ */
+int mbedtls_ssl_sni_table_add(mbedtls_ssl_sni_table *table,
+                              const mbedtls_ssl_config *conf,
+                              const char *name, size_t name_len,
+                              mbedtls_x509_crt *own_cert,
+                              mbedtls_pk_context *pk_key,
+                              mbedtls_x509_crt *ca_chain,
+                              mbedtls_x509_crl *ca_crl,
+                              int authmode);
+
+/**
+ * \brief          Find the first certificate of a host name, as selected
+ *                 for a client asking for it
+ *
+ * \param table    Table set up with mbedtls_ssl_sni_table_setup()
+ * \param name     Host name
+ * \param name_len Length of \p name
+ *
+ * \return         The certificate chain added first for the matching exact
+ *                 or wildcard name, or \c NULL if there is none.
+ */
+const mbedtls_x509_crt *mbedtls_ssl_sni_table_lookup(
+    const mbedtls_ssl_sni_table *table,
+    const unsigned char *name, size_t name_len);
+
+/**
+ * \brief          ServerName callback for mbedtls_ssl_conf_sni()
+ *
+ *                 If a name of the table matches, the handshake uses its
+ *                 certificates, and its CA chain and authentication mode if
+ *                 set. Otherwise the certificates of the configuration are
+ *                 used.
+ *
+ * \param p_table  Table set up with mbedtls_ssl_sni_table_setup()
+ * \param ssl      SSL context of the handshake
+ * \param name     Host name sent by the client
+ * \param name_len Length of \p name
+ *
+ * \return         \c 0.
+ */
+int mbedtls_ssl_sni_table_cb(void *p_table, mbedtls_ssl_context *ssl,
+                             const unsigned char *name, size_t name_len);
+
+/**
+ * \brief          Free a host name table
+ *
+ * \param table    Table to free
+ */
+void mbedtls_ssl_sni_table_free(mbedtls_ssl_sni_table *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_sni_table.h */
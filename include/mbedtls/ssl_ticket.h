@@ -40,6 +40,30 @@ extern "C" {
 
 #define MBEDTLS_SSL_TICKET_MAX_KEY_BYTES 32          /*!< Max supported key length in bytes */
 #define MBEDTLS_SSL_TICKET_KEY_NAME_BYTES 4          /*!< key name length in bytes */
+#define MBEDTLS_SSL_TICKET_MAX_SECRET_BYTES 64       /*!< Max master secret length in bytes */
+
+/* Keys derived from a master secret need PSA key derivation and a clock. */
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_HAVE_TIME) && \
+    defined(PSA_WANT_ALG_HKDF) && defined(PSA_WANT_ALG_SHA_256)
+#define MBEDTLS_SSL_TICKET_DERIVED_KEYS
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_TICKET_MAX_KEYS)
+#define MBEDTLS_SSL_TICKET_MAX_KEYS 2                /*!< Max keys in a context */
+#endif
+
+/** \} name SECTION: Module settings */
+
+/* Size of the key name hash index, kept at most a quarter full. */
+#define MBEDTLS_SSL_TICKET_INDEX_SIZE (4 * MBEDTLS_SSL_TICKET_MAX_KEYS)
 
 /**
  * \brief   Information for session ticket protection
@@ -54,6 +78,7 @@ typedef struct mbedtls_ssl_ticket_key {
      *  tickets created under that key.
      */
     uint32_t MBEDTLS_PRIVATE(lifetime);
+    uint32_t MBEDTLS_PRIVATE(serial);                /*!< insertion order, 0 if unused */
 #if !defined(MBEDTLS_USE_PSA_CRYPTO)
     mbedtls_cipher_context_t MBEDTLS_PRIVATE(ctx);   /*!< context for auth enc/decryption    */
 #else
@@ -69,10 +94,24 @@ mbedtls_ssl_ticket_key;
  * \brief   Context for session ticket handling functions
  */
 typedef struct mbedtls_ssl_ticket_context {
-    mbedtls_ssl_ticket_key MBEDTLS_PRIVATE(keys)[2]; /*!< ticket protection keys             */
+    /*! ticket protection keys */
+    mbedtls_ssl_ticket_key MBEDTLS_PRIVATE(keys)[MBEDTLS_SSL_TICKET_MAX_KEYS];
     unsigned char MBEDTLS_PRIVATE(active);           /*!< index of the currently active key  */
+    /*! open addressing hash index from key names to 1 + key index, 0 if empty */
+    unsigned char MBEDTLS_PRIVATE(index)[MBEDTLS_SSL_TICKET_INDEX_SIZE];
+    uint32_t MBEDTLS_PRIVATE(serial);                /*!< last key serial number             */
 
     uint32_t MBEDTLS_PRIVATE(ticket_lifetime);       /*!< lifetime of tickets in seconds     */
+    unsigned char MBEDTLS_PRIVATE(renewal);          /*!< percentage of the lifetime after
+                                                          which tickets are renewed, or 0 */
+
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+    /*! secret the keys are derived from, see
+     *  mbedtls_ssl_ticket_set_master_secret() */
+    unsigned char MBEDTLS_PRIVATE(master)[MBEDTLS_SSL_TICKET_MAX_SECRET_BYTES];
+    size_t MBEDTLS_PRIVATE(master_len);              /*!< master secret length      */
+    uint32_t MBEDTLS_PRIVATE(epoch_length);          /*!< seconds per derived key, or 0 */
+#endif
 
     /** Callback for getting (pseudo-)random numbers                        */
     int(*MBEDTLS_PRIVATE(f_rng))(void *, unsigned char *, size_t);
@@ -126,6 +165,73 @@ int mbedtls_ssl_ticket_setup(mbedtls_ssl_ticket_context *ctx,
                              mbedtls_cipher_type_t cipher,
                              uint32_t lifetime);
 
+/**
+ * \brief           Only renew the tickets used for resumption once they get
+ *                  old. (Default: 0, no renewal policy.)
+ *
+ *                  With a policy, mbedtls_ssl_ticket_parse() tells the TLS
+ *                  server whether to send a new ticket when it resumes a
+ *                  session: only when the ticket has been used for
+ *                  \p renewal percent of its lifetime or more, or if its key
+ *                  is no longer the active one. The other resumptions send
+ *                  no new ticket, which saves its encryption and its bytes.
+ *
+ *                  Without a policy, a TLS 1.2 server never renews the
+ *                  tickets and a TLS 1.3 server always does.
+ *
+ * \param ctx       Context to be configured
+ * \param renewal   Percentage of the ticket lifetime, from 1 to 100, or 0
+ *                  for no policy. Recommended value: 50.
+ *
+ * \return          0 if successful,
+ *                  or MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p renewal is
+ *                  greater than 100.
+ */
+int mbedtls_ssl_ticket_set_renewal(mbedtls_ssl_ticket_context *ctx,
+                                   unsigned renewal);
+
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+/**
+ * \brief           Derive the keys from a master secret shared by a fleet of
+ *                  servers, instead of generating them at random.
+ *
+ *                  Time is cut into epochs of \p epoch_length seconds. The
+ *                  key of each epoch is derived from \p secret with
+ *                  HKDF-SHA-256, and named after the number of the epoch, so
+ *                  that every server holding the secret issues tickets under
+ *                  the same key and resumes the tickets issued by the
+ *                  others, with no key distribution. The keys of past epochs
+ *                  whose tickets may still be valid, and of the next epoch,
+ *                  are derived again on demand to parse a ticket, which
+ *                  absorbs clock differences of up to one epoch.
+ *
+ * \param ctx       Context set up with mbedtls_ssl_ticket_setup()
+ * \param secret    Master secret, which should be cryptographically random
+ *                  data of at least 32 bytes
+ * \param secret_len Master secret length in bytes, at most
+ *                  #MBEDTLS_SSL_TICKET_MAX_SECRET_BYTES
+ * \param epoch_length Seconds each key issues tickets for, at most the
+ *                  ticket lifetime. Recommended value: a quarter of the
+ *                  ticket lifetime.
+ *
+ * \note            The secret protects all past and future tickets: forward
+ *                  secrecy now depends on replacing it, which takes a new
+ *                  call of this function on every server.
+ *
+ * \note            Keys added with mbedtls_ssl_ticket_rotate() or
+ *                  mbedtls_ssl_ticket_add_key() only stay active until the
+ *                  next epoch starts.
+ *
+ * \return          0 if successful,
+ *                  MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a parameter is invalid,
+ *                  or another specific MBEDTLS_ERR_XXX error code
+ */
+int mbedtls_ssl_ticket_set_master_secret(mbedtls_ssl_ticket_context *ctx,
+                                         const unsigned char *secret,
+                                         size_t secret_len,
+                                         uint32_t epoch_length);
+#endif /* MBEDTLS_SSL_TICKET_DERIVED_KEYS */
+
 /**
  * \brief           Rotate session ticket encryption key to new specified key.
  *                  Provides for external control of session ticket encryption
@@ -161,6 +267,10 @@ int mbedtls_ssl_ticket_setup(mbedtls_ssl_ticket_context *ctx,
  *                  handshake it will fail the connection when trying to send
  *                  the first ticket.
  *
+ * \note            This function is thread-safe if MBEDTLS_THREADING_C is
+ *                  enabled, and can be called while other threads write and
+ *                  parse tickets with \p ctx.
+ *
  * \return          0 if successful,
  *                  or a specific MBEDTLS_ERR_XXX error code
  */
@@ -169,15 +279,77 @@ int mbedtls_ssl_ticket_rotate(mbedtls_ssl_ticket_context *ctx,
                               const unsigned char *k, size_t klength,
                               uint32_t lifetime);
 
+/**
+ * \brief           Add a session ticket key.
+ *                  Provides for keys shared between machines that rotate at
+ *                  different times: tickets issued under any of the keys of
+ *                  a context are accepted, and only the active key is used
+ *                  to issue new tickets.
+ *
+ *                  If the context already holds MBEDTLS_SSL_TICKET_MAX_KEYS
+ *                  keys, the oldest key that is not active is replaced.
+ *
+ * \param ctx       Context, set up with mbedtls_ssl_ticket_setup()
+ * \param name      Session ticket key name
+ * \param nlength   Session ticket key name length in bytes
+ * \param k         Session ticket key
+ * \param klength   Session ticket key length in bytes
+ * \param lifetime  Lifetime in seconds of tickets issued under that key
+ * \param activate  Non-zero to use the new key for new tickets, zero to only
+ *                  use it to decrypt tickets.
+ *
+ * \note            \c nlength, \c klength and \c lifetime are subject to
+ *                  the same constraints as in mbedtls_ssl_ticket_rotate().
+ *                  Calling this function with \p activate set is the same
+ *                  as calling mbedtls_ssl_ticket_rotate().
+ *
+ * \note            This function is thread-safe if MBEDTLS_THREADING_C is
+ *                  enabled.
+ *
+ * \return          0 if successful.
+ * \return          #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if a key with the same
+ *                  name is already present.
+ * \return          Another specific MBEDTLS_ERR_XXX error code on failure.
+ */
+int mbedtls_ssl_ticket_add_key(mbedtls_ssl_ticket_context *ctx,
+                               const unsigned char *name, size_t nlength,
+                               const unsigned char *k, size_t klength,
+                               uint32_t lifetime, int activate);
+
+/**
+ * \brief           Remove a session ticket key.
+ *                  Tickets issued under that key are no longer accepted.
+ *
+ * \param ctx       Context, set up with mbedtls_ssl_ticket_setup()
+ * \param name      Name of the session ticket key to remove
+ * \param nlength   Session ticket key name length in bytes
+ *
+ * \note            This function is thread-safe if MBEDTLS_THREADING_C is
+ *                  enabled.
+ *
+ * \return          0 if successful, including if there is no such key.
+ * \return          #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if that key is active:
+ *                  activate another key first.
+ * \return          Another specific MBEDTLS_ERR_XXX error code on failure.
+ */
+int mbedtls_ssl_ticket_retire_key(mbedtls_ssl_ticket_context *ctx,
+                                  const unsigned char *name, size_t nlength);
+
 /**
  * \brief           Implementation of the ticket write callback
+ *                  (Thread-safe if MBEDTLS_THREADING_C is enabled)
  *
  * \note            See \c mbedtls_ssl_ticket_write_t for description
+ *
+ * \note            With MBEDTLS_USE_PSA_CRYPTO, the context is only locked
+ *                  while the key is selected, so that tickets are encrypted
+ *                  and decrypted in parallel.
  */
 mbedtls_ssl_ticket_write_t mbedtls_ssl_ticket_write;
 
 /**
  * \brief           Implementation of the ticket parse callback
+ *                  (Thread-safe if MBEDTLS_THREADING_C is enabled)
  *
  * \note            See \c mbedtls_ssl_ticket_parse_t for description
  */
@@ -0,0 +1,240 @@
+/**
+ * \file ssl_warm_pool.h
+ *
+ * \brief Client-side pool of connections established ahead of use
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_SSL_WARM_POOL_H
+#define MBEDTLS_SSL_WARM_POOL_H
+#include "mbedtls/private_access.h"
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_SSL_WARM_POOL_DEFAULT_IDLE_TIMEOUT)
+#define MBEDTLS_SSL_WARM_POOL_DEFAULT_IDLE_TIMEOUT  30000   /*!< 30 seconds */
+#endif
+
+#if !defined(MBEDTLS_SSL_WARM_POOL_DEFAULT_CONNECT_TIMEOUT)
+#define MBEDTLS_SSL_WARM_POOL_DEFAULT_CONNECT_TIMEOUT 10000 /*!< 10 seconds */
+#endif
+
+/** \} name SECTION: Module settings */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * \brief   A connection of a warm pool
+ */
+typedef struct mbedtls_ssl_warm_conn {
+    char *MBEDTLS_PRIVATE(host);                 /*!< server name      */
+    uint16_t MBEDTLS_PRIVATE(port);              /*!< server port      */
+    uint8_t MBEDTLS_PRIVATE(state);              /*!< free, connecting,
+                                                      handshaking, ready
+                                                      or acquired      */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(deadline); /*!< time it is closed
+                                                      at if unused     */
+    mbedtls_net_context MBEDTLS_PRIVATE(net);
+    mbedtls_ssl_context MBEDTLS_PRIVATE(ssl);
+} mbedtls_ssl_warm_conn;
+
+/**
+ * \brief   Pool of connections established ahead of use, by server
+ *
+ *          mbedtls_ssl_warm_pool_prewarm() connects to a server the
+ *          application expects to need and starts the handshake, which
+ *          mbedtls_ssl_warm_pool_run() carries on without blocking.
+ *          mbedtls_ssl_warm_pool_acquire() then hands out an established
+ *          connection to the server at once. Connections not acquired
+ *          within the idle timeout are closed with a close_notify alert.
+ *
+ *          With a session store set with mbedtls_ssl_conf_session_store()
+ *          on the configuration, warm handshakes resume the sessions of
+ *          earlier connections and keep the session store filled.
+ */
+typedef struct mbedtls_ssl_warm_pool {
+    const mbedtls_ssl_config *MBEDTLS_PRIVATE(conf);
+    mbedtls_ssl_warm_conn *MBEDTLS_PRIVATE(conns);
+    size_t MBEDTLS_PRIVATE(max_conns);           /*!< number of conns        */
+    uint32_t MBEDTLS_PRIVATE(idle_timeout);      /*!< in milliseconds        */
+    uint32_t MBEDTLS_PRIVATE(connect_timeout);   /*!< in milliseconds        */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects conns */
+#endif
+} mbedtls_ssl_warm_pool;
+
+/**
+ * \brief          Initialize a warm pool
+ *
+ * \param pool     Pool to initialize
+ */
+void mbedtls_ssl_warm_pool_init(mbedtls_ssl_warm_pool *pool);
+
+/**
+ * \brief          Allocate the connections of a warm pool
+ *
+ * \param pool     Pool to set up
+ * \param conf     Client configuration of the connections. It must stay
+ *                 valid, and unchanged, until the pool is freed.
+ * \param max_conns Maximum number of connections, warm or acquired
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the pool was already
+ *                 set up, \p conf is not a client configuration over TLS
+ *                 or \p max_conns is out of range.
+ */
+int mbedtls_ssl_warm_pool_setup(mbedtls_ssl_warm_pool *pool,
+                                const mbedtls_ssl_config *conf,
+                                size_t max_conns);
+
+/**
+ * \brief          Set how long a warm connection is kept unused
+ *                 (Default: MBEDTLS_SSL_WARM_POOL_DEFAULT_IDLE_TIMEOUT)
+ *
+ *                 The time counts from the call to
+ *                 mbedtls_ssl_warm_pool_prewarm() until the handshake is
+ *                 over, then again from the end of the handshake.
+ *
+ * \param pool     Pool to configure
+ * \param timeout  Idle timeout in milliseconds
+ */
+void mbedtls_ssl_warm_pool_set_idle_timeout(mbedtls_ssl_warm_pool *pool,
+                                            uint32_t timeout);
+
+/**
+ * \brief          Set the time limit of the TCP connection
+ *                 (Default: MBEDTLS_SSL_WARM_POOL_DEFAULT_CONNECT_TIMEOUT)
+ *
+ * \param pool     Pool to configure
+ * \param timeout  Time limit in milliseconds, see
+ *                 mbedtls_net_connect_timeout()
+ */
+void mbedtls_ssl_warm_pool_set_connect_timeout(mbedtls_ssl_warm_pool *pool,
+                                               uint32_t timeout);
+
+/**
+ * \brief          Open a connection to a server and start its handshake
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This waits for the TCP connection, trying the addresses
+ *                 of the server as mbedtls_net_connect_timeout() does, then
+ *                 sends the ClientHello. The socket is non-blocking from
+ *                 there on and mbedtls_ssl_warm_pool_run() completes the
+ *                 handshake.
+ *
+ *                 When the pool is full, the warm connection closest to
+ *                 its idle timeout is closed to make room.
+ *
+ * \param pool     Pool set up with mbedtls_ssl_warm_pool_setup()
+ * \param host     Server name, to connect to and to authenticate
+ * \param port     Server port
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the pool is not set up
+ *                 or \p host is \c NULL.
+ * \return         #MBEDTLS_ERR_SSL_ALLOC_FAILED if all connections are
+ *                 acquired or being set up, or on allocation failure.
+ * \return         An \c MBEDTLS_ERR_NET_XXX or \c MBEDTLS_ERR_SSL_XXX error
+ *                 code if the connection or handshake fails.
+ */
+int mbedtls_ssl_warm_pool_prewarm(mbedtls_ssl_warm_pool *pool,
+                                  const char *host, uint16_t port);
+
+/**
+ * \brief          Carry on the handshakes of the pool and close the
+ *                 connections that failed, were closed by the server or
+ *                 timed out (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This does not block. Call it regularly, or when a socket
+ *                 of the pool becomes readable. On established connections,
+ *                 it also processes post-handshake messages, such as TLS 1.3
+ *                 tickets, without consuming application data.
+ *
+ * \param pool     Pool set up with mbedtls_ssl_warm_pool_setup()
+ *
+ * \return         The number of handshakes still in progress.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the pool is not set up.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_warm_pool_run(mbedtls_ssl_warm_pool *pool);
+
+/**
+ * \brief          Take an established connection to a server
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 The connection stays in the pool, which no longer touches
+ *                 it, until it is given back with
+ *                 mbedtls_ssl_warm_pool_release().
+ *
+ * \param pool     Pool set up with mbedtls_ssl_warm_pool_setup()
+ * \param host     Server name
+ * \param port     Server port
+ * \param ssl      On success, the SSL context of the connection, ready for
+ *                 mbedtls_ssl_read() and mbedtls_ssl_write()
+ * \param net      On success, the socket of the connection, which is in
+ *                 non-blocking mode. Can be \c NULL.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND if no connection to
+ *                 the server has completed its handshake.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if the pool is not set up.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_warm_pool_acquire(mbedtls_ssl_warm_pool *pool,
+                                  const char *host, uint16_t port,
+                                  mbedtls_ssl_context **ssl,
+                                  mbedtls_net_context **net);
+
+/**
+ * \brief          Close an acquired connection and free its place in the
+ *                 pool (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This sends a close_notify alert if the connection is
+ *                 still open, without waiting for the socket.
+ *
+ * \param pool     Pool the connection was acquired from
+ * \param ssl      SSL context given by mbedtls_ssl_warm_pool_acquire()
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p ssl is not an
+ *                 acquired connection of the pool.
+ * \return         An \c MBEDTLS_ERR_THREADING_XXX error code if locking fails.
+ */
+int mbedtls_ssl_warm_pool_release(mbedtls_ssl_warm_pool *pool,
+                                  mbedtls_ssl_context *ssl);
+
+/**
+ * \brief          Close all connections and free a warm pool
+ *
+ * \note           No connection of the pool may be in use, and no thread
+ *                 in a function of the pool, while it is freed.
+ *
+ * \param pool     Pool to free
+ */
+void mbedtls_ssl_warm_pool_free(mbedtls_ssl_warm_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ssl_warm_pool.h */
@@ -13,6 +13,7 @@
 
 #include "mbedtls/build_info.h"
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -87,6 +88,206 @@ int mbedtls_timing_get_delay(void *data);
 uint32_t mbedtls_timing_get_final_delay(
     const mbedtls_timing_delay_context *data);
 
+#if !defined(MBEDTLS_TIMING_ALT)
+/**
+ * \brief          Return the time of a monotonic clock in milliseconds
+ *
+ *                 The clock is not affected by changes of the wall-clock
+ *                 time. Its origin is unspecified, so only differences
+ *                 between values are meaningful.
+ *
+ * \return         The current time in milliseconds.
+ */
+uint64_t mbedtls_timing_get_monotonic_ms(void);
+#endif /* !MBEDTLS_TIMING_ALT */
+
+#if defined(MBEDTLS_TIMING_WHEEL)
+
+#define MBEDTLS_TIMING_WHEEL_LEVELS      4  /*!< Levels of the wheel */
+#define MBEDTLS_TIMING_WHEEL_SLOT_BITS   6
+#define MBEDTLS_TIMING_WHEEL_SLOTS       (1 << MBEDTLS_TIMING_WHEEL_SLOT_BITS)
+
+struct mbedtls_timing_wheel;
+
+/**
+ * \brief          A timer driven by a timer wheel, usable as the timer
+ *                 context of one SSL context
+ */
+typedef struct mbedtls_timing_wheel_timer {
+    struct mbedtls_timing_wheel *MBEDTLS_PRIVATE(wheel);
+    void *MBEDTLS_PRIVATE(arg);                  /*!< passed to the callback */
+    struct mbedtls_timing_wheel_timer *MBEDTLS_PRIVATE(next); /*!< slot list */
+    struct mbedtls_timing_wheel_timer *MBEDTLS_PRIVATE(prev);
+    uint64_t MBEDTLS_PRIVATE(int_at);            /*!< intermediate deadline */
+    uint64_t MBEDTLS_PRIVATE(fin_at);            /*!< final deadline        */
+    uint64_t MBEDTLS_PRIVATE(expires);           /*!< tick of the wakeup    */
+    int MBEDTLS_PRIVATE(slot);                   /*!< level * slots + slot,
+                                                      -1 if not queued      */
+} mbedtls_timing_wheel_timer;
+
+/**
+ * \brief          Callback called when the final delay of a timer has passed
+ *
+ * \param p_expired  The context set with mbedtls_timing_wheel_setup()
+ * \param arg        The argument the timer was set up with, e.g. the SSL
+ *                   context whose handshake should now be resumed
+ */
+typedef void mbedtls_timing_wheel_cb_t(void *p_expired, void *arg);
+
+/**
+ * \brief          Hierarchical timer wheel
+ *
+ *                 A wheel keeps the DTLS retransmission timers of any number
+ *                 of SSL contexts, so that a single OS timer, typically the
+ *                 timeout of the event loop's poll call, is enough to drive
+ *                 all of them. Setting, cancelling and expiring a timer take
+ *                 constant time, and the wheel never visits empty slots.
+ *
+ *                 Four levels of 64 slots cover 2^24 ticks, i.e. more than
+ *                 4 hours at 1 ms per tick. Longer delays are rounded down to
+ *                 that and re-armed when they wake up early.
+ *
+ * \note           A wheel and its timers must only be used from a single
+ *                 thread at a time.
+ */
+typedef struct mbedtls_timing_wheel {
+    mbedtls_timing_wheel_timer *MBEDTLS_PRIVATE(slots)[MBEDTLS_TIMING_WHEEL_LEVELS]
+    [MBEDTLS_TIMING_WHEEL_SLOTS];
+    uint64_t MBEDTLS_PRIVATE(occupied)[MBEDTLS_TIMING_WHEEL_LEVELS]; /*!< non-empty slots */
+    uint64_t MBEDTLS_PRIVATE(now);               /*!< time of the last advance, ms */
+    uint64_t MBEDTLS_PRIVATE(tick);              /*!< now / tick_ms         */
+    uint32_t MBEDTLS_PRIVATE(tick_ms);           /*!< resolution            */
+#if !defined(MBEDTLS_TIMING_ALT)
+    uint64_t MBEDTLS_PRIVATE(origin);            /*!< monotonic time of setup */
+#else
+    struct mbedtls_timing_hr_time MBEDTLS_PRIVATE(clock); /*!< started at setup */
+#endif
+    size_t MBEDTLS_PRIVATE(count);               /*!< queued timers         */
+    mbedtls_timing_wheel_cb_t *MBEDTLS_PRIVATE(f_expired);
+    void *MBEDTLS_PRIVATE(p_expired);
+} mbedtls_timing_wheel;
+
+/**
+ * \brief          Initialize a timer wheel
+ *
+ * \param wheel    Wheel to initialize
+ */
+void mbedtls_timing_wheel_init(mbedtls_timing_wheel *wheel);
+
+/**
+ * \brief          Set up a timer wheel, starting its clock at 0
+ *
+ * \param wheel      Wheel to set up
+ * \param tick_ms    Resolution of the wheel in milliseconds. Delays are
+ *                   rounded up to a multiple of it. 0 selects 1 ms.
+ * \param f_expired  Callback called when the final delay of a timer
+ *                   passes, which is when a DTLS context needs to
+ *                   retransmit, or NULL. It may set, cancel or free any
+ *                   timer of the wheel.
+ * \param p_expired  Context for \p f_expired
+ */
+void mbedtls_timing_wheel_setup(mbedtls_timing_wheel *wheel, uint32_t tick_ms,
+                                mbedtls_timing_wheel_cb_t *f_expired,
+                                void *p_expired);
+
+/**
+ * \brief          Move the time of a wheel forward, and call the callback
+ *                 for each timer whose final delay passed
+ *
+ * \param wheel    Wheel set up with mbedtls_timing_wheel_setup()
+ * \param now_ms   The current time, in milliseconds since the wheel was
+ *                 set up. Times earlier than the time of the previous call
+ *                 are ignored.
+ */
+void mbedtls_timing_wheel_advance(mbedtls_timing_wheel *wheel, uint64_t now_ms);
+
+/**
+ * \brief          Move the time of a wheel forward to the current time,
+ *                 as mbedtls_timing_wheel_advance() does
+ *
+ * \param wheel    Wheel set up with mbedtls_timing_wheel_setup()
+ */
+void mbedtls_timing_wheel_run(mbedtls_timing_wheel *wheel);
+
+/**
+ * \brief          Return the time of a wheel, as of the last call to
+ *                 mbedtls_timing_wheel_advance() or mbedtls_timing_wheel_run()
+ *
+ * \param wheel    Wheel set up with mbedtls_timing_wheel_setup()
+ *
+ * \return         The time in milliseconds since the wheel was set up.
+ */
+uint64_t mbedtls_timing_wheel_now(const mbedtls_timing_wheel *wheel);
+
+/**
+ * \brief          Return how long the event loop may sleep before the
+ *                 wheel needs to be run again
+ *
+ * \param wheel    Wheel set up with mbedtls_timing_wheel_setup()
+ *
+ * \return         The time in milliseconds until the next timer of the
+ *                 wheel may expire, counted from mbedtls_timing_wheel_now().
+ *                 This may be earlier than the actual deadline.
+ * \return         \c -1u if no timer is set, so that the result can be
+ *                 passed as the timeout of mbedtls_net_reactor_dispatch().
+ */
+uint32_t mbedtls_timing_wheel_next_timeout(const mbedtls_timing_wheel *wheel);
+
+/**
+ * \brief          Initialize a timer of a wheel
+ *
+ * \param timer    Timer to initialize
+ * \param wheel    Wheel set up with mbedtls_timing_wheel_setup()
+ * \param arg      Argument for the callback of the wheel
+ */
+void mbedtls_timing_wheel_timer_init(mbedtls_timing_wheel_timer *timer,
+                                     mbedtls_timing_wheel *wheel, void *arg);
+
+/**
+ * \brief          Set a pair of delays to watch on a timer of a wheel
+ *                 (See \c mbedtls_timing_set_delay().)
+ *
+ *                 This and mbedtls_timing_wheel_get_delay() can be given to
+ *                 mbedtls_ssl_set_timer_cb() with the timer as context.
+ *
+ * \param data     Pointer to a timer initialized with
+ *                 mbedtls_timing_wheel_timer_init()
+ * \param int_ms   First (intermediate) delay in milliseconds.
+ * \param fin_ms   Second (final) delay in milliseconds.
+ *                 Pass 0 to cancel the current delay.
+ *
+ * \note           Delays are counted from mbedtls_timing_wheel_now(), so
+ *                 the wheel should be run each time the event loop wakes
+ *                 up, before processing any I/O.
+ */
+void mbedtls_timing_wheel_set_delay(void *data, uint32_t int_ms, uint32_t fin_ms);
+
+/**
+ * \brief          Get the status of the delays of a timer of a wheel
+ *                 (See \c mbedtls_timing_get_delay().)
+ *
+ *                 This only compares the deadlines against the time of the
+ *                 wheel, without reading the clock.
+ *
+ * \param data     Pointer to a timer initialized with
+ *                 mbedtls_timing_wheel_timer_init()
+ *
+ * \return         -1 if cancelled (fin_ms = 0),
+ *                  0 if none of the delays are passed,
+ *                  1 if only the intermediate delay is passed,
+ *                  2 if the final delay is passed.
+ */
+int mbedtls_timing_wheel_get_delay(void *data);
+
+/**
+ * \brief          Remove a timer from its wheel
+ *
+ * \param timer    Timer to free
+ */
+void mbedtls_timing_wheel_timer_free(mbedtls_timing_wheel_timer *timer);
+
+#endif /* MBEDTLS_TIMING_WHEEL */
+
 #ifdef __cplusplus
 }
 #endif
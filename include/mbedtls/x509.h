@@ -108,6 +108,9 @@
 #define MBEDTLS_X509_BADCRL_BAD_MD           0x020000  /**< The CRL is signed with an unacceptable hash. */
 #define MBEDTLS_X509_BADCRL_BAD_PK           0x040000  /**< The CRL is signed with an unacceptable PK alg (eg RSA vs ECDSA). */
 #define MBEDTLS_X509_BADCRL_BAD_KEY          0x080000  /**< The CRL is signed with an unacceptable key (eg bad curve, RSA too short). */
+#define MBEDTLS_X509_BADOCSP_NOT_TRUSTED     0x100000  /**< The OCSP response is malformed, not about the certificate, or not correctly signed by its issuer or by a responder of the issuer. */
+#define MBEDTLS_X509_BADOCSP_EXPIRED         0x200000  /**< The OCSP response is expired. */
+#define MBEDTLS_X509_BADOCSP_FUTURE          0x400000  /**< The OCSP response is from the future. */
 
 /** \} name X509 Verify codes */
 /** \} addtogroup x509_module */
@@ -15,6 +15,32 @@
 
 #include "mbedtls/x509.h"
 
+#if defined(MBEDTLS_X509_CRL_STREAM)
+#include "psa/crypto.h"
+#endif
+
+/**
+ * \name SECTION: Module settings
+ *
+ * The configuration options you can set for this module are in this section.
+ * Either change them in mbedtls_config.h or define them on the compiler command line.
+ * \{
+ */
+
+#if !defined(MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN)
+/** Longest serial number the streaming parser accepts: the 20 bytes of
+ * RFC 5280, plus the leading zero byte of a positive INTEGER. */
+#define MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN          21
+#endif
+
+#if !defined(MBEDTLS_X509_CRL_STREAM_MAX_ELEMENT_LEN)
+/** Largest single field (issuer, CRL entry, extensions, signature) the
+ * streaming parser buffers. */
+#define MBEDTLS_X509_CRL_STREAM_MAX_ELEMENT_LEN      16384
+#endif
+
+/** \} name SECTION: Module settings */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,6 +111,20 @@ typedef struct mbedtls_x509_crl {
     mbedtls_pk_type_t MBEDTLS_PRIVATE(sig_pk);           /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *MBEDTLS_PRIVATE(sig_opts);             /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
 
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+    const mbedtls_x509_crl_entry **MBEDTLS_PRIVATE(serial_index); /**< Entries sorted by serial, or NULL */
+    size_t MBEDTLS_PRIVATE(serial_count);        /**< Number of entries in \c serial_index */
+#endif
+
+#if defined(MBEDTLS_X509_CRL_STREAM)
+    unsigned char *MBEDTLS_PRIVATE(stream_data); /**< Fields other than the entries, for a streamed CRL */
+    size_t MBEDTLS_PRIVATE(stream_data_len);
+    unsigned char *MBEDTLS_PRIVATE(serials);     /**< Sorted serial records of a streamed CRL, or NULL */
+    size_t MBEDTLS_PRIVATE(serials_count);
+    unsigned char MBEDTLS_PRIVATE(tbs_hash)[MBEDTLS_MD_MAX_SIZE]; /**< Hash of \c tbs, if computed while streaming */
+    size_t MBEDTLS_PRIVATE(tbs_hash_len);        /**< 0 if \c tbs_hash is not set */
+#endif
+
     /** Next element in the linked list of CRL.
      * \p NULL indicates the end of the list.
      * Do not modify this field directly. */
@@ -171,6 +211,134 @@ void mbedtls_x509_crl_init(mbedtls_x509_crl *crl);
  */
 void mbedtls_x509_crl_free(mbedtls_x509_crl *crl);
 
+#if defined(MBEDTLS_X509_CRL_STREAM)
+/**
+ * \brief   Context for parsing a DER-encoded CRL piece by piece
+ *
+ *          The revoked certificates are reduced to fixed-size serial
+ *          number records as they are read, so memory use is about
+ *          #MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN + 1 bytes per entry,
+ *          and the TBSCertList is hashed on the fly for the signature
+ *          check.
+ */
+typedef struct mbedtls_x509_crl_stream {
+    int MBEDTLS_PRIVATE(state);
+    int MBEDTLS_PRIVATE(step);                   /**< Last TBSCertList field seen */
+    int MBEDTLS_PRIVATE(trailer);                /**< Fields seen after TBSCertList */
+    int MBEDTLS_PRIVATE(keep_raw);
+    size_t MBEDTLS_PRIVATE(off);                 /**< Bytes consumed so far */
+    size_t MBEDTLS_PRIVATE(outer_end);
+    size_t MBEDTLS_PRIVATE(tbs_start);
+    size_t MBEDTLS_PRIVATE(tbs_end);
+    size_t MBEDTLS_PRIVATE(entries_end);
+
+    unsigned char *MBEDTLS_PRIVATE(elem);        /**< The element being read */
+    size_t MBEDTLS_PRIVATE(elem_len);
+    size_t MBEDTLS_PRIVATE(elem_size);
+    size_t MBEDTLS_PRIVATE(elem_hdr_len);
+
+    unsigned char *MBEDTLS_PRIVATE(meta);        /**< Copy of all fields but the entries */
+    size_t MBEDTLS_PRIVATE(meta_len);
+    size_t MBEDTLS_PRIVATE(meta_size);
+    size_t MBEDTLS_PRIVATE(meta_hdr_len);        /**< TBSCertList header */
+    size_t MBEDTLS_PRIVATE(meta_tbs_len);        /**< TBSCertList fields */
+
+    unsigned char *MBEDTLS_PRIVATE(raw);         /**< Whole CRL, if kept */
+    size_t MBEDTLS_PRIVATE(raw_len);
+    size_t MBEDTLS_PRIVATE(raw_size);
+
+    unsigned char *MBEDTLS_PRIVATE(serials);
+    size_t MBEDTLS_PRIVATE(serials_count);
+    size_t MBEDTLS_PRIVATE(serials_size);        /**< Allocated bytes */
+
+    psa_algorithm_t MBEDTLS_PRIVATE(hash_alg);   /**< 0 until the TBSCertList signature field */
+    psa_hash_operation_t MBEDTLS_PRIVATE(hash);
+    mbedtls_x509_crl MBEDTLS_PRIVATE(crl);       /**< The CRL being parsed */
+} mbedtls_x509_crl_stream;
+
+/**
+ * \brief          Initialize a streaming CRL parser
+ *
+ * \param ctx      Context to initialize
+ */
+void mbedtls_x509_crl_stream_init(mbedtls_x509_crl_stream *ctx);
+
+/**
+ * \brief          Keep a copy of the whole DER-encoded CRL
+ *                 (Default: don't)
+ *
+ *                 By default, \c raw and \c tbs of the parsed CRL are
+ *                 empty. The signature of the CRL can still be checked, as
+ *                 the TBSCertList is hashed while it is parsed.
+ *
+ * \note           This must be called before the first call to
+ *                 mbedtls_x509_crl_stream_update().
+ *
+ * \param ctx      Context initialized with mbedtls_x509_crl_stream_init()
+ * \param keep_raw 1 to keep the DER data, 0 not to
+ */
+void mbedtls_x509_crl_stream_set_keep_raw(mbedtls_x509_crl_stream *ctx,
+                                          int keep_raw);
+
+/**
+ * \brief          Feed the next part of a DER-encoded CRL to the parser
+ *
+ *                 The input can be split anywhere. PEM data must be
+ *                 decoded by the caller first.
+ *
+ * \note           The PSA crypto subsystem must have been initialized by
+ *                 calling psa_crypto_init() before calling this function.
+ *
+ * \param ctx      Streaming parser
+ * \param buf      Next bytes of the CRL
+ * \param len      Length of \p buf
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_INVALID_FORMAT or another X509 or ASN.1
+ *                 error code if the data is not a valid CRL, or contains a
+ *                 field longer than #MBEDTLS_X509_CRL_STREAM_MAX_ELEMENT_LEN.
+ * \return         #MBEDTLS_ERR_X509_INVALID_SERIAL if a serial number is
+ *                 longer than #MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if an earlier call
+ *                 failed, or after mbedtls_x509_crl_stream_finish().
+ */
+int mbedtls_x509_crl_stream_update(mbedtls_x509_crl_stream *ctx,
+                                   const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Finish parsing and append the CRL to a chained list
+ *
+ *                 The CRL can be used like one parsed by
+ *                 mbedtls_x509_crl_parse_der(), except that its \c entry
+ *                 list is empty: revocation checks use the serial number
+ *                 records instead, and revocation dates and entry
+ *                 extensions are not kept.
+ *
+ * \param ctx      Streaming parser, fed the whole CRL
+ * \param chain    Points to the start of the chain
+ *
+ * \return         \c 0 on success.
+ * \return         An X509 or ASN.1 error code if the CRL is incomplete or
+ *                 invalid.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if an earlier call
+ *                 failed.
+ */
+int mbedtls_x509_crl_stream_finish(mbedtls_x509_crl_stream *ctx,
+                                   mbedtls_x509_crl *chain);
+
+/**
+ * \brief          Free a streaming CRL parser
+ *
+ * \note           A CRL appended to a chain by
+ *                 mbedtls_x509_crl_stream_finish() is not freed.
+ *
+ * \param ctx      Context to free
+ */
+void mbedtls_x509_crl_stream_free(mbedtls_x509_crl_stream *ctx);
+#endif /* MBEDTLS_X509_CRL_STREAM */
+
 /** \} name Structures and functions for parsing CRLs */
 /** \} addtogroup x509_module */
 
@@ -17,6 +17,15 @@
 #include "mbedtls/x509_crl.h"
 #include "mbedtls/bignum.h"
 
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+#include "mbedtls/platform_time.h"
+#endif
+
+#if (defined(MBEDTLS_X509_VERIFY_CACHE) || defined(MBEDTLS_X509_CRT_CA_DIR)) && \
+    defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
 /**
  * \addtogroup x509_module
  * \{
@@ -53,9 +62,15 @@ typedef struct mbedtls_x509_crt {
 
     mbedtls_x509_name issuer;           /**< The parsed issuer data (named information object). */
     mbedtls_x509_name subject;          /**< The parsed subject data (named information object). */
+    uint32_t MBEDTLS_PRIVATE(issuer_hash);       /**< Hash of \c issuer, equal for names that compare equal. Used for quick comparison. */
+    uint32_t MBEDTLS_PRIVATE(subject_hash);      /**< Hash of \c subject, equal for names that compare equal. Used for quick comparison. */
 
     mbedtls_x509_time valid_from;       /**< Start time of certificate validity. */
     mbedtls_x509_time valid_to;         /**< End time of certificate validity. */
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    int64_t MBEDTLS_PRIVATE(valid_from_ts);      /**< \c valid_from in seconds since the Epoch. Used for quick time checks. */
+    int64_t MBEDTLS_PRIVATE(valid_to_ts);        /**< \c valid_to in seconds since the Epoch. Used for quick time checks. */
+#endif
 
     mbedtls_x509_buf pk_raw;
     mbedtls_pk_context pk;              /**< Container for the public key context. */
@@ -84,6 +99,30 @@ typedef struct mbedtls_x509_crt {
     mbedtls_pk_type_t MBEDTLS_PRIVATE(sig_pk);           /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *MBEDTLS_PRIVATE(sig_opts);             /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
 
+    int MBEDTLS_PRIVATE(use_arena);              /**< Arena mode, see mbedtls_x509_crt_set_arena(). Only used in the first certificate of a chain. */
+    void *MBEDTLS_PRIVATE(arena);                /**< Single allocation holding the name, sequence and signature option nodes, or NULL */
+    size_t MBEDTLS_PRIVATE(arena_len);           /**< Length of \c arena */
+
+    int MBEDTLS_PRIVATE(use_lazy_ext);           /**< Lazy extension mode, see mbedtls_x509_crt_set_lazy_ext(). Only used in the first certificate of a chain. */
+    int MBEDTLS_PRIVATE(deferred_ext);           /**< Extensions found but not decoded yet, see mbedtls_x509_crt_load_ext() */
+    int MBEDTLS_PRIVATE(late_ext);               /**< Extensions decoded by mbedtls_x509_crt_load_ext(), which are not in \c arena */
+    mbedtls_x509_buf MBEDTLS_PRIVATE(deferred_san);      /**< Value of a deferred subject alternative name extension */
+    mbedtls_x509_buf MBEDTLS_PRIVATE(deferred_ext_key_usage); /**< Value of a deferred extended key usage extension */
+    mbedtls_x509_buf MBEDTLS_PRIVATE(deferred_policies); /**< Value of a deferred certificate policies extension */
+
+    mbedtls_x509_buf *MBEDTLS_PRIVATE(san_dns);  /**< DNS names of \c subject_alt_names, sorted case-insensitively, or NULL if there are few of them */
+    size_t MBEDTLS_PRIVATE(san_dns_len);         /**< Number of entries of \c san_dns */
+    unsigned int MBEDTLS_PRIVATE(san_types);     /**< Bit (1 << type) set for each type of subject alternative name present */
+
+#if defined(MBEDTLS_X509_TRUST_STORE)
+    const struct mbedtls_x509_trust_store *MBEDTLS_PRIVATE(trust_store); /**< Index over this chain, see mbedtls_x509_trust_store_setup(). Only set in the first certificate of a chain. */
+#endif
+
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+    unsigned char *MBEDTLS_PRIVATE(ocsp_response); /**< OCSP response checked when verifying this certificate, see mbedtls_x509_crt_set_ocsp_response(), or NULL */
+    size_t MBEDTLS_PRIVATE(ocsp_response_len);     /**< Length of \c ocsp_response */
+#endif
+
     /** Next certificate in the linked list that constitutes the CA chain.
      * \p NULL indicates the end of the list.
      * Do not modify this field directly. */
@@ -91,6 +130,56 @@ typedef struct mbedtls_x509_crt {
 }
 mbedtls_x509_crt;
 
+#if defined(MBEDTLS_X509_TRUST_STORE)
+/**
+ * \brief   An entry of a trust store index
+ */
+typedef struct mbedtls_x509_trust_store_entry {
+    struct mbedtls_x509_trust_store_entry *MBEDTLS_PRIVATE(next); /*!< hash chain */
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(crt);
+    uint32_t MBEDTLS_PRIVATE(hash);              /*!< subject or key ID hash */
+} mbedtls_x509_trust_store_entry;
+
+/**
+ * \brief   Trust store: an index over a chain of trusted CA certificates
+ *
+ *          The CAs are indexed by a hash of their subject name and by
+ *          their subject key identifier, so that finding the candidate
+ *          parents of a certificate does not compare its issuer with
+ *          every trusted CA. Once set up, the store is never modified
+ *          and can be shared between any number of SSL configurations
+ *          and threads.
+ */
+typedef struct mbedtls_x509_trust_store {
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(cas);      /*!< indexed chain          */
+    mbedtls_x509_trust_store_entry *MBEDTLS_PRIVATE(entries);
+    mbedtls_x509_trust_store_entry **MBEDTLS_PRIVATE(buckets); /*!< by subject, then by key ID */
+    size_t MBEDTLS_PRIVATE(mask);                /*!< buckets per index - 1  */
+    size_t MBEDTLS_PRIVATE(count);               /*!< indexed certificates   */
+} mbedtls_x509_trust_store;
+#endif /* MBEDTLS_X509_TRUST_STORE */
+
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+/**
+ * \brief   Trust image: a precompiled, read-only trust store
+ *
+ *          The image is a flat buffer written by
+ *          mbedtls_x509_trust_image_write(), which holds the DER
+ *          certificates and their indexes by subject name and by subject
+ *          key identifier. It contains no pointers, so it can be saved to
+ *          a file, mapped into memory read-only and shared by processes.
+ */
+typedef struct mbedtls_x509_trust_image {
+    const unsigned char *MBEDTLS_PRIVATE(buf);   /*!< the image, not owned */
+    size_t MBEDTLS_PRIVATE(len);
+    size_t MBEDTLS_PRIVATE(count);               /*!< certificates       */
+    size_t MBEDTLS_PRIVATE(key_id_count);        /*!< certificates with a key ID */
+    const unsigned char *MBEDTLS_PRIVATE(records);
+    const unsigned char *MBEDTLS_PRIVATE(by_subject); /*!< index by subject hash */
+    const unsigned char *MBEDTLS_PRIVATE(by_key_id);  /*!< index by key ID hash */
+} mbedtls_x509_trust_image;
+#endif /* MBEDTLS_X509_TRUST_IMAGE */
+
 /**
  * Build flag from an algorithm/curve identifier (pk, md, ecp)
  * Since 0 is always XXX_NONE, ignore it.
@@ -209,7 +298,16 @@ mbedtls_x509_crt_profile;
                         "The CRL is signed with an unacceptable PK alg (eg RSA vs ECDSA).")   \
     X509_CRT_ERROR_INFO(MBEDTLS_X509_BADCRL_BAD_KEY,                                                    \
                         "MBEDTLS_X509_BADCRL_BAD_KEY",                                                  \
-                        "The CRL is signed with an unacceptable key (eg bad curve, RSA too short).")
+                        "The CRL is signed with an unacceptable key (eg bad curve, RSA too short).")   \
+    X509_CRT_ERROR_INFO(MBEDTLS_X509_BADOCSP_NOT_TRUSTED,                          \
+                        "MBEDTLS_X509_BADOCSP_NOT_TRUSTED",                        \
+                        "The OCSP response is not correctly signed or not about the certificate.") \
+    X509_CRT_ERROR_INFO(MBEDTLS_X509_BADOCSP_EXPIRED,                              \
+                        "MBEDTLS_X509_BADOCSP_EXPIRED",                            \
+                        "The OCSP response is expired.")                           \
+    X509_CRT_ERROR_INFO(MBEDTLS_X509_BADOCSP_FUTURE,                               \
+                        "MBEDTLS_X509_BADOCSP_FUTURE",                             \
+                        "The OCSP response is from the future.")
 
 /**
  * Container for writing a certificate (CRT)
@@ -229,6 +327,28 @@ typedef struct mbedtls_x509write_cert {
 }
 mbedtls_x509write_cert;
 
+/**
+ * Container for the parts of the certificates of an issuer that are the
+ * same for all of them, encoded once: signature algorithm, issuer name and
+ * constant extensions.
+ */
+typedef struct mbedtls_x509write_crt_template {
+    unsigned char *MBEDTLS_PRIVATE(buf);
+    const unsigned char *MBEDTLS_PRIVATE(sig_alg);      /*!< in \c buf */
+    size_t MBEDTLS_PRIVATE(sig_alg_len);
+    const unsigned char *MBEDTLS_PRIVATE(issuer);       /*!< in \c buf */
+    size_t MBEDTLS_PRIVATE(issuer_len);
+    const unsigned char *MBEDTLS_PRIVATE(extensions);   /*!< in \c buf */
+    size_t MBEDTLS_PRIVATE(extensions_len);
+    mbedtls_pk_context *MBEDTLS_PRIVATE(issuer_key);
+    mbedtls_md_type_t MBEDTLS_PRIVATE(md_alg);
+    int MBEDTLS_PRIVATE(version);
+    mbedtls_pk_type_t MBEDTLS_PRIVATE(pk_alg);
+    const char *MBEDTLS_PRIVATE(sig_oid);
+    size_t MBEDTLS_PRIVATE(sig_oid_len);
+}
+mbedtls_x509write_crt_template;
+
 /**
  * \brief           Set Subject Alternative Name
  *
@@ -271,8 +391,120 @@ typedef struct {
      * ownership to the caller. */
     mbedtls_x509_crt *MBEDTLS_PRIVATE(trust_ca_cb_result);
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+    /* The entry of the CA callback cache holding the current candidate
+     * parents, referenced rather than owned. */
+    struct mbedtls_x509_crt_ca_cache_entry *MBEDTLS_PRIVATE(trust_ca_cache_entry);
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
 } mbedtls_x509_crt_verify_chain;
 
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+/**
+ * \brief   A verified chain, as stored in a verification cache
+ */
+typedef struct mbedtls_x509_crt_verify_cache_entry {
+    unsigned char MBEDTLS_PRIVATE(digest)[32];   /*!< SHA-256 of the chain and trust settings */
+    unsigned MBEDTLS_PRIVATE(generation);        /*!< 0 if the entry is empty */
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    mbedtls_x509_time MBEDTLS_PRIVATE(verified_at);
+    mbedtls_x509_time MBEDTLS_PRIVATE(horizon);  /*!< first time the result may change */
+    int MBEDTLS_PRIVATE(has_horizon);
+#endif
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(root);     /*!< trusted CA ending the chain, or NULL */
+    unsigned char MBEDTLS_PRIVATE(len);          /*!< length of the verified chain */
+    unsigned char MBEDTLS_PRIVATE(peer_index)[MBEDTLS_X509_MAX_VERIFY_CHAIN_SIZE]; /*!< position in the peer chain, 0xFF for root */
+    uint32_t MBEDTLS_PRIVATE(flags)[MBEDTLS_X509_MAX_VERIFY_CHAIN_SIZE];
+} mbedtls_x509_crt_verify_cache_entry;
+
+/**
+ * \brief   Cache of certificate chain verification results
+ *
+ *          Entries are keyed by a hash of the certificates presented by
+ *          the peer, of the trusted CA and CRL lists and of the security
+ *          profile, so that a chain seen again can skip the signature
+ *          checks. The table is direct-mapped: an entry evicts the one
+ *          previously stored in its slot.
+ */
+typedef struct mbedtls_x509_crt_verify_cache {
+    mbedtls_x509_crt_verify_cache_entry *MBEDTLS_PRIVATE(entries);
+    size_t MBEDTLS_PRIVATE(mask);                /*!< slot count - 1         */
+    unsigned MBEDTLS_PRIVATE(generation);        /*!< bumped by flush        */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+} mbedtls_x509_crt_verify_cache;
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+/**
+ * \brief   The candidate parents of an issuer, as stored in a CA callback
+ *          cache
+ */
+typedef struct mbedtls_x509_crt_ca_cache_entry {
+    unsigned char *MBEDTLS_PRIVATE(key);         /*!< issuer name, then key id */
+    size_t MBEDTLS_PRIVATE(issuer_len);          /*!< length of the name in key */
+    size_t MBEDTLS_PRIVATE(key_len);
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(cas);      /*!< candidates, or NULL */
+    mbedtls_ms_time_t MBEDTLS_PRIVATE(created);
+    unsigned MBEDTLS_PRIVATE(refs);              /*!< verifications using cas */
+    int MBEDTLS_PRIVATE(stale);                  /*!< flushed while in use */
+    struct mbedtls_x509_crt_ca_cache_entry *MBEDTLS_PRIVATE(next);
+} mbedtls_x509_crt_ca_cache_entry;
+
+/**
+ * \brief   Cache in front of a CA callback
+ *
+ *          Entries are keyed by the issuer name and authority key
+ *          identifier of the child certificates, and hold the candidate
+ *          parents returned by the callback, parsed, for a time to live.
+ *          They are kept most recently used first, and the least recently
+ *          used entry that no verification is using makes room for a new
+ *          one.
+ */
+typedef struct mbedtls_x509_crt_ca_cache {
+    int(*MBEDTLS_PRIVATE(f_ca_cb))(void *, mbedtls_x509_crt const *,
+                                   mbedtls_x509_crt **);
+    void *MBEDTLS_PRIVATE(p_ca_cb);
+    mbedtls_x509_crt_ca_cache_entry *MBEDTLS_PRIVATE(entries);
+    size_t MBEDTLS_PRIVATE(count);
+    size_t MBEDTLS_PRIVATE(max_entries);         /*!< 0 if not set up        */
+    uint32_t MBEDTLS_PRIVATE(ttl);               /*!< in milliseconds        */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);
+#endif
+} mbedtls_x509_crt_ca_cache;
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
+
+#if defined(MBEDTLS_X509_CRT_CA_DIR)
+/**
+ * \brief   A file of a CA directory
+ */
+typedef struct mbedtls_x509_crt_ca_dir_file {
+    uint32_t MBEDTLS_PRIVATE(hash);              /*!< subject hash, from the file name */
+    unsigned MBEDTLS_PRIVATE(suffix);            /*!< number after the hash */
+    char *MBEDTLS_PRIVATE(path);
+    int MBEDTLS_PRIVATE(state);                  /*!< not loaded, loaded, or failed */
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(crt);      /*!< parsed on first use */
+} mbedtls_x509_crt_ca_dir_file;
+
+/**
+ * \brief   A directory of trusted CAs, parsed on demand
+ *
+ *          The files are named after the subject hash of their
+ *          certificate, like the ones set up by OpenSSL's c_rehash or
+ *          openssl rehash: an 8-digit hexadecimal hash, a dot and a
+ *          number. Only the file names are read up front.
+ */
+typedef struct mbedtls_x509_crt_ca_dir {
+    mbedtls_x509_crt_ca_dir_file *MBEDTLS_PRIVATE(files); /*!< sorted by hash */
+    size_t MBEDTLS_PRIVATE(count);
+    size_t MBEDTLS_PRIVATE(size);                /*!< allocated entries  */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t MBEDTLS_PRIVATE(mutex);    /*!< protects loading */
+#endif
+} mbedtls_x509_crt_ca_dir;
+#endif /* MBEDTLS_X509_CRT_CA_DIR */
+
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
 
 /**
@@ -286,6 +518,9 @@ typedef struct {
     mbedtls_x509_crt *MBEDTLS_PRIVATE(parent); /* non-null iff parent_in in progress */
     mbedtls_x509_crt *MBEDTLS_PRIVATE(fallback_parent);
     int MBEDTLS_PRIVATE(fallback_signature_is_good);
+#if defined(MBEDTLS_X509_TRUST_STORE)
+    const mbedtls_x509_trust_store_entry *MBEDTLS_PRIVATE(parent_entry); /* index position of parent */
+#endif
 
     /* for find_parent() */
     int MBEDTLS_PRIVATE(parent_is_trusted); /* -1 if find_parent is not in progress */
@@ -524,6 +759,37 @@ int mbedtls_x509_crt_parse_der_nocopy(mbedtls_x509_crt *chain,
  */
 int mbedtls_x509_crt_parse(mbedtls_x509_crt *chain, const unsigned char *buf, size_t buflen);
 
+#if defined(MBEDTLS_PEM_PARSE_C)
+/**
+ * \brief          Parse a bundle of PEM certificates, such as the root
+ *                 certificates of a system, and add them to the chained
+ *                 list.
+ *
+ *                 This parses as mbedtls_x509_crt_parse() does with PEM data,
+ *                 but faster: each certificate is decoded in one pass, eight
+ *                 characters at a time, into the buffer the certificate
+ *                 keeps, and the certificates are appended without walking
+ *                 the chain again.
+ *
+ * \note           The PSA crypto subsystem must have been initialized by
+ *                 calling psa_crypto_init() before calling this function.
+ *
+ * \param chain    The chain to which to add the parsed certificates.
+ * \param buf      The buffer holding the PEM certificates, which need not be
+ *                 null-terminated.
+ * \param buflen   The size of \p buf.
+ *
+ * \return         \c 0 if all certificates were parsed successfully.
+ * \return         The (positive) number of certificates that couldn't
+ *                 be parsed if parsing was partly successful.
+ * \return         #MBEDTLS_ERR_X509_CERT_UNKNOWN_FORMAT if \p buf holds no
+ *                 PEM certificate.
+ * \return         A negative X509 or PEM error code otherwise.
+ */
+int mbedtls_x509_crt_parse_bundle(mbedtls_x509_crt *chain,
+                                  const unsigned char *buf, size_t buflen);
+#endif /* MBEDTLS_PEM_PARSE_C */
+
 #if defined(MBEDTLS_FS_IO)
 /**
  * \brief          Load one or more certificates and add them
@@ -543,6 +809,24 @@ int mbedtls_x509_crt_parse(mbedtls_x509_crt *chain, const unsigned char *buf, si
  */
 int mbedtls_x509_crt_parse_file(mbedtls_x509_crt *chain, const char *path);
 
+#if defined(MBEDTLS_PEM_PARSE_C)
+/**
+ * \brief          Load a bundle of PEM certificates from a file, see
+ *                 mbedtls_x509_crt_parse_bundle()
+ *
+ * \note           The PSA crypto subsystem must have been initialized by
+ *                 calling psa_crypto_init() before calling this function.
+ *
+ * \param chain    points to the start of the chain
+ * \param path     filename to read the certificates from
+ *
+ * \return         0 if all certificates parsed successfully, a positive number
+ *                 if partly successful or a specific X509 or PEM error code
+ */
+int mbedtls_x509_crt_parse_bundle_file(mbedtls_x509_crt *chain,
+                                       const char *path);
+#endif /* MBEDTLS_PEM_PARSE_C */
+
 /**
  * \brief          Load one or more certificate files from a path and add them
  *                 to the chained list. Parses permissively. If some
@@ -746,6 +1030,142 @@ int mbedtls_x509_crt_verify_restartable(mbedtls_x509_crt *crt,
                                         void *p_vrfy,
                                         mbedtls_x509_crt_restart_ctx *rs_ctx);
 
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+/**
+ * \brief          Version of \c mbedtls_x509_crt_verify_restartable() which
+ *                 looks up and stores the verified chain in a cache
+ *
+ *                 On a cache hit, the signatures and the revocation status
+ *                 are not checked again: the result stored when the chain
+ *                 was first verified is reused, as long as the time has not
+ *                 reached the first validity boundary of the certificates
+ *                 and CRLs involved. The name, the key of the end entity
+ *                 and \p f_vrfy are still checked on every call.
+ *
+ * \note           Adding a certificate or CRL to \p trust_ca or \p ca_crl
+ *                 changes the cache key. Call
+ *                 mbedtls_x509_crt_verify_cache_flush() after any other
+ *                 change to them, e.g. freeing and parsing them again.
+ *
+ * \param crt      The certificate chain to be verified.
+ * \param trust_ca The list of trusted CAs.
+ * \param ca_crl   The list of CRLs for trusted CAs.
+ * \param profile  The security profile to use for the verification.
+ * \param cn       The expected Common Name. This may be \c NULL if the
+ *                 CN need not be verified.
+ * \param flags    The address at which to store the result of the verification.
+ *                 If the verification couldn't be completed, the flag value is
+ *                 set to (uint32_t) -1.
+ * \param f_vrfy   The verification callback to use. See the documentation
+ *                 of mbedtls_x509_crt_verify() for more information.
+ * \param p_vrfy   The context to be passed to \p f_vrfy.
+ * \param rs_ctx   The restart context to use. This may be set to \c NULL
+ *                 to disable restartable ECC.
+ * \param cache    The cache set up with mbedtls_x509_crt_verify_cache_setup(),
+ *                 or \c NULL to verify without a cache.
+ *
+ * \return         See \c mbedtls_x509_crt_verify_restartable().
+ */
+int mbedtls_x509_crt_verify_with_cache(mbedtls_x509_crt *crt,
+                                       mbedtls_x509_crt *trust_ca,
+                                       mbedtls_x509_crl *ca_crl,
+                                       const mbedtls_x509_crt_profile *profile,
+                                       const char *cn, uint32_t *flags,
+                                       int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                                       void *p_vrfy,
+                                       mbedtls_x509_crt_restart_ctx *rs_ctx,
+                                       mbedtls_x509_crt_verify_cache *cache);
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_X509_PARALLEL_VERIFY)
+/**
+ * \brief   The check of a certificate signature by its parent
+ */
+typedef struct mbedtls_x509_crt_sig_job {
+    const mbedtls_x509_crt *MBEDTLS_PRIVATE(child);
+    mbedtls_x509_crt *MBEDTLS_PRIVATE(parent);
+    int MBEDTLS_PRIVATE(ret);                    /*!< 0 if the signature is good */
+} mbedtls_x509_crt_sig_job;
+
+/**
+ * \brief          The type of signature check executors.
+ *
+ *                 The executor is given all the signature checks of a
+ *                 chain at once. It must call mbedtls_x509_crt_sig_job_run()
+ *                 on each of them, in any order and from any thread, and
+ *                 only return once they have all completed.
+ *
+ * \note           The jobs of a call have different parents, so that no
+ *                 key is used by two jobs at the same time. Running them
+ *                 concurrently requires a thread-safe PSA Crypto
+ *                 implementation, i.e. MBEDTLS_THREADING_C.
+ *
+ * \param p_exec   An opaque context passed to the executor.
+ * \param jobs     The signature checks to run.
+ * \param count    The number of entries in \p jobs. This is at least 1.
+ *
+ * \return         \c 0 once all the jobs have run, whatever their result.
+ * \return         A non-zero error code if they could not be run, which
+ *                 makes the verification fail with
+ *                 #MBEDTLS_ERR_X509_FATAL_ERROR.
+ */
+typedef int (*mbedtls_x509_crt_executor_t)(void *p_exec,
+                                           mbedtls_x509_crt_sig_job *jobs,
+                                           size_t count);
+
+/**
+ * \brief          Check the signature of a job given to an executor
+ *
+ * \param job      The job. Its result is stored in it.
+ *
+ * \return         \c 0 if the signature is good, or a non-zero value
+ *                 otherwise.
+ */
+int mbedtls_x509_crt_sig_job_run(mbedtls_x509_crt_sig_job *job);
+
+/**
+ * \brief          Version of \c mbedtls_x509_crt_verify_with_profile()
+ *                 which checks the signatures of the chain concurrently
+ *
+ *                 The path to a trusted CA is built first, choosing the
+ *                 parents by name, key usage and validity period only.
+ *                 The signatures along that path are then all checked
+ *                 through \p f_exec. If the signature of the trusted CA
+ *                 turns out to be bad, another trusted CA may be a better
+ *                 parent: the chain is then verified again sequentially,
+ *                 so that the result is always the same as with
+ *                 \c mbedtls_x509_crt_verify_with_profile().
+ *
+ * \param crt      The certificate chain to be verified.
+ * \param trust_ca The list of trusted CAs.
+ * \param ca_crl   The list of CRLs for trusted CAs.
+ * \param profile  The security profile to use for the verification.
+ * \param cn       The expected Common Name. This may be \c NULL if the
+ *                 CN need not be verified.
+ * \param flags    The address at which to store the result of the verification.
+ *                 If the verification couldn't be completed, the flag value is
+ *                 set to (uint32_t) -1.
+ * \param f_vrfy   The verification callback to use. See the documentation
+ *                 of mbedtls_x509_crt_verify() for more information.
+ * \param p_vrfy   The context to be passed to \p f_vrfy.
+ * \param f_exec   The executor running the signature checks. See
+ *                 ::mbedtls_x509_crt_executor_t. This may be \c NULL to
+ *                 verify the chain sequentially.
+ * \param p_exec   The context to be passed to \p f_exec.
+ *
+ * \return         See \c mbedtls_x509_crt_verify_with_profile().
+ */
+int mbedtls_x509_crt_verify_parallel(mbedtls_x509_crt *crt,
+                                     mbedtls_x509_crt *trust_ca,
+                                     mbedtls_x509_crl *ca_crl,
+                                     const mbedtls_x509_crt_profile *profile,
+                                     const char *cn, uint32_t *flags,
+                                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                                     void *p_vrfy,
+                                     mbedtls_x509_crt_executor_t f_exec,
+                                     void *p_exec);
+#endif /* MBEDTLS_X509_PARALLEL_VERIFY */
+
 /**
  * \brief               The type of trusted certificate callbacks.
  *
@@ -874,6 +1294,514 @@ int mbedtls_x509_crt_is_revoked(const mbedtls_x509_crt *crt, const mbedtls_x509_
  */
 void mbedtls_x509_crt_init(mbedtls_x509_crt *crt);
 
+/**
+ * \brief          Enable or disable arena mode for a certificate chain
+ *
+ *                 In arena mode, each certificate subsequently parsed into
+ *                 \p chain keeps its issuer and subject name components,
+ *                 subject alternative names, extended key usages,
+ *                 certificate policies and signature options in a single
+ *                 allocation instead of one allocation per item. This keeps
+ *                 the data used during verification close together, and
+ *                 leaves far fewer small blocks on the heap when loading a
+ *                 large trust store. mbedtls_x509_crt_free() releases the
+ *                 arena with the certificate.
+ *
+ * \note           The parsed certificates are the same in both modes. If
+ *                 the arena cannot be allocated, a certificate keeps its
+ *                 individual allocations.
+ *
+ * \note           The mode is reset by mbedtls_x509_crt_free().
+ *
+ * \param chain    Certificate chain initialized with mbedtls_x509_crt_init()
+ * \param enable   1 to enable arena mode, 0 to disable it
+ */
+void mbedtls_x509_crt_set_arena(mbedtls_x509_crt *chain, int enable);
+
+/**
+ * \brief          Enable or disable lazy extension mode for a certificate
+ *                 chain
+ *
+ *                 In lazy extension mode, the non-critical subject
+ *                 alternative name, extended key usage and certificate
+ *                 policies extensions of each certificate subsequently
+ *                 parsed into \p chain are only located, not decoded.
+ *                 These are the extensions that need an allocation per
+ *                 item, and they are not needed to build a chain, so this
+ *                 makes loading many CA certificates, or receiving a long
+ *                 chain, cheaper.
+ *
+ *                 The library functions that use these extensions, such as
+ *                 mbedtls_x509_crt_verify() checking a name,
+ *                 mbedtls_x509_crt_check_extended_key_usage() and
+ *                 mbedtls_x509_crt_info(), decode them when needed without
+ *                 modifying the certificate, so a chain in lazy extension
+ *                 mode can be shared between threads like any other.
+ *
+ * \note           The \c subject_alt_names, \c ext_key_usage and
+ *                 \c certificate_policies fields of a certificate are empty
+ *                 until mbedtls_x509_crt_load_ext() is called. An
+ *                 application that reads them directly must call it first.
+ *
+ * \note           A deferred extension is only checked to be a well-formed
+ *                 extension at parse time. If its value is malformed, the
+ *                 certificate is still accepted, and the error is reported
+ *                 when the extension is decoded: a name does not match, an
+ *                 extended key usage is not allowed, and
+ *                 mbedtls_x509_crt_load_ext() or mbedtls_x509_crt_info()
+ *                 fails.
+ *
+ * \note           The mode is reset by mbedtls_x509_crt_free().
+ *
+ * \param chain    Certificate chain initialized with mbedtls_x509_crt_init()
+ * \param enable   1 to enable lazy extension mode, 0 to disable it
+ */
+void mbedtls_x509_crt_set_lazy_ext(mbedtls_x509_crt *chain, int enable);
+
+/**
+ * \brief          Decode the extensions deferred in lazy extension mode
+ *
+ *                 This fills the \c subject_alt_names, \c ext_key_usage and
+ *                 \c certificate_policies fields of each certificate in
+ *                 \p chain parsed with mbedtls_x509_crt_set_lazy_ext().
+ *                 It does nothing for certificates whose extensions are
+ *                 already decoded.
+ *
+ * \note           This modifies the certificates, so it must not be called
+ *                 while another thread may be using \p chain.
+ *
+ * \param chain    Certificate chain
+ *
+ * \return         \c 0 on success.
+ * \return         An X.509 or ASN.1 error code if an extension is
+ *                 malformed. Its field is then left empty, and the
+ *                 certificates before it in \p chain are decoded.
+ */
+int mbedtls_x509_crt_load_ext(mbedtls_x509_crt *chain);
+
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+/**
+ * \brief          Attach an OCSP response to an end-entity certificate
+ *
+ *                 When the chain of \p crt is verified, the response is
+ *                 checked against the issuer found for \p crt. It must be
+ *                 a successful BasicOCSPResponse (RFC 6960) with a status
+ *                 for \p crt, signed by the issuer or by a certificate
+ *                 included in the response that the issuer signed for
+ *                 OCSP signing. Otherwise, the certificate is flagged
+ *                 #MBEDTLS_X509_BADOCSP_NOT_TRUSTED. A \c revoked status
+ *                 flags it #MBEDTLS_X509_BADCERT_REVOKED, and a response
+ *                 outside of its validity period
+ *                 #MBEDTLS_X509_BADOCSP_EXPIRED or
+ *                 #MBEDTLS_X509_BADOCSP_FUTURE. An \c unknown status
+ *                 counts as no response.
+ *
+ * \note           The verification of a certificate with a response is
+ *                 not stored in, nor looked up from, a verification cache.
+ *
+ * \param crt      End-entity certificate, the first of its chain
+ * \param buf      DER-encoded OCSPResponse, which is copied
+ * \param len      Length of \p buf, or \c 0 to remove the response
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_x509_crt_set_ocsp_response(mbedtls_x509_crt *crt,
+                                       const unsigned char *buf, size_t len);
+#endif /* MBEDTLS_X509_OCSP_STAPLE */
+
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+/**
+ * \brief          Initialize a verification cache
+ *
+ * \param cache    Verification cache to initialize
+ */
+void mbedtls_x509_crt_verify_cache_init(mbedtls_x509_crt_verify_cache *cache);
+
+/**
+ * \brief          Allocate the entries of a verification cache
+ *
+ * \param cache        Verification cache to set up
+ * \param max_entries  Number of cached chains. This is rounded up to a
+ *                     power of two.
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if the cache was already
+ *                 set up or \p max_entries is 0 or too large.
+ */
+int mbedtls_x509_crt_verify_cache_setup(mbedtls_x509_crt_verify_cache *cache,
+                                        size_t max_entries);
+
+/**
+ * \brief          Forget all the cached results
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Call this whenever the trusted CAs or CRLs used with the
+ *                 cache are replaced.
+ *
+ * \param cache    Verification cache
+ *
+ * \return         \c 0 on success, or a threading error code.
+ */
+int mbedtls_x509_crt_verify_cache_flush(mbedtls_x509_crt_verify_cache *cache);
+
+/**
+ * \brief          Free a verification cache
+ *
+ * \param cache    Verification cache to free
+ */
+void mbedtls_x509_crt_verify_cache_free(mbedtls_x509_crt_verify_cache *cache);
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+/**
+ * \brief          Initialize a CA callback cache
+ *
+ * \param cache    CA callback cache to initialize
+ */
+void mbedtls_x509_crt_ca_cache_init(mbedtls_x509_crt_ca_cache *cache);
+
+/**
+ * \brief          Set up a CA callback cache in front of a CA callback
+ *
+ * \param cache        CA callback cache to set up
+ * \param f_ca_cb      The CA callback to cache the results of. It is only
+ *                     called on a cache miss, which holds no lock.
+ * \param p_ca_cb      The context of \p f_ca_cb
+ * \param max_entries  Number of issuers whose candidates are kept
+ * \param ttl          Time in milliseconds the candidates of an issuer are
+ *                     used for before asking \p f_ca_cb again
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if the cache was already
+ *                 set up, \p f_ca_cb is \c NULL, or \p max_entries or
+ *                 \p ttl is \c 0.
+ */
+int mbedtls_x509_crt_ca_cache_setup(mbedtls_x509_crt_ca_cache *cache,
+                                    mbedtls_x509_crt_ca_cb_t f_ca_cb,
+                                    void *p_ca_cb,
+                                    size_t max_entries, uint32_t ttl);
+
+/**
+ * \brief          CA callback answering from a CA callback cache
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Pass it to mbedtls_ssl_conf_ca_cb() or
+ *                 mbedtls_x509_crt_verify_with_ca_cb(), with the cache as
+ *                 context. The verification functions recognize it and use
+ *                 the cached certificates in place, so that they neither
+ *                 call the cached callback nor parse certificates until the
+ *                 entry expires. Called directly, it returns a copy of the
+ *                 cached candidates.
+ *
+ * \param p_cache        A cache set up with mbedtls_x509_crt_ca_cache_setup()
+ * \param child          The certificate to find candidate parents for
+ * \param candidate_cas  On success, the candidates, or \c NULL if there is none
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         The error returned by the cached callback.
+ */
+int mbedtls_x509_crt_ca_cache_cb(void *p_cache,
+                                 mbedtls_x509_crt const *child,
+                                 mbedtls_x509_crt **candidate_cas);
+
+/**
+ * \brief          Forget all the cached candidates
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 Call this whenever the trusted CAs behind the cached
+ *                 callback change. Verifications in progress finish with
+ *                 the candidates they already had.
+ *
+ * \param cache    CA callback cache
+ *
+ * \return         \c 0 on success, or a threading error code.
+ */
+int mbedtls_x509_crt_ca_cache_flush(mbedtls_x509_crt_ca_cache *cache);
+
+/**
+ * \brief          Free a CA callback cache
+ *
+ * \note           No verification may be using the cache while it is
+ *                 freed.
+ *
+ * \param cache    CA callback cache to free
+ */
+void mbedtls_x509_crt_ca_cache_free(mbedtls_x509_crt_ca_cache *cache);
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
+
+#if defined(MBEDTLS_X509_TRUST_STORE)
+/**
+ * \brief          Initialize a trust store
+ *
+ * \param store    Trust store to initialize
+ */
+void mbedtls_x509_trust_store_init(mbedtls_x509_trust_store *store);
+
+/**
+ * \brief          Index a chain of trusted CA certificates
+ *
+ *                 The index is attached to \p cas: when \p cas is passed
+ *                 as the trusted CA list to mbedtls_x509_crt_verify() and
+ *                 related functions, or to mbedtls_ssl_conf_ca_chain(), the
+ *                 candidate parents of a certificate are looked up in the
+ *                 index. CAs whose subject key identifier matches the
+ *                 authority key identifier of the certificate are tried
+ *                 first, then the other CAs with a matching subject name, in
+ *                 the order of the chain. Verification results are the same
+ *                 as without the index.
+ *
+ * \note           The trust store does not copy or own the certificates.
+ *                 No certificate may be added to \p cas while it is
+ *                 indexed, and the trust store must be freed before \p cas.
+ *
+ * \param store    Trust store initialized with mbedtls_x509_trust_store_init()
+ * \param cas      Chain of trusted CA certificates
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if \p store is already
+ *                 set up, or \p cas is already indexed.
+ */
+int mbedtls_x509_trust_store_setup(mbedtls_x509_trust_store *store,
+                                   mbedtls_x509_crt *cas);
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+/**
+ * \brief          CA callback returning the candidate parents of a
+ *                 certificate from a trust store
+ *                 (Thread-safe)
+ *
+ *                 This can be passed to mbedtls_ssl_conf_ca_cb() or
+ *                 mbedtls_x509_crt_verify_with_ca_cb(), with a trust store
+ *                 set up with mbedtls_x509_trust_store_setup() as context.
+ *                 The candidates are the trusted CAs whose subject name is
+ *                 the issuer name of \p child, in the order described in
+ *                 mbedtls_x509_trust_store_setup(). They refer to the data
+ *                 of the certificates in the store, which must outlive the
+ *                 returned list.
+ *
+ * \param p_store        The trust store
+ * \param child          The certificate to find candidate parents for
+ * \param candidate_cas  On success, the candidates, or \c NULL if there is none
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ */
+int mbedtls_x509_trust_store_ca_cb(void *p_store,
+                                   mbedtls_x509_crt const *child,
+                                   mbedtls_x509_crt **candidate_cas);
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+/**
+ * \brief          Free a trust store
+ *
+ *                 The index is detached from the chain it was set up with.
+ *                 The certificates are not freed.
+ *
+ * \param store    Trust store to free
+ */
+void mbedtls_x509_trust_store_free(mbedtls_x509_trust_store *store);
+#endif /* MBEDTLS_X509_TRUST_STORE */
+
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+/**
+ * \brief          Write a trust image of a chain of trusted CA certificates
+ *
+ *                 The image can be stored, then used with
+ *                 mbedtls_x509_trust_image_setup() without parsing the
+ *                 certificates again. It does not depend on the byte order
+ *                 or word size of the platform, but it does depend on the
+ *                 version of the library that wrote it.
+ *
+ * \param cas      Chain of trusted CA certificates
+ * \param buf      Buffer to write the image to
+ * \param size     Size of \p buf
+ * \param olen     On success, or if \p buf is too small, the length of the
+ *                 image
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_BUFFER_TOO_SMALL if \p size is less
+ *                 than \p *olen.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if the image would be
+ *                 larger than 4 GiB.
+ */
+int mbedtls_x509_trust_image_write(const mbedtls_x509_crt *cas,
+                                   unsigned char *buf, size_t size,
+                                   size_t *olen);
+
+/**
+ * \brief          Initialize a trust image
+ *
+ * \param image    Trust image to initialize
+ */
+void mbedtls_x509_trust_image_init(mbedtls_x509_trust_image *image);
+
+/**
+ * \brief          Use a trust image written by mbedtls_x509_trust_image_write()
+ *
+ *                 This checks the layout of the image, in time linear in
+ *                 the number of certificates, but does not parse or copy
+ *                 the certificates.
+ *
+ * \note           The image is not copied: \p buf must remain valid and
+ *                 unchanged until the trust image is freed, and until any
+ *                 candidate list returned by mbedtls_x509_trust_image_ca_cb()
+ *                 is freed. It may be read-only memory, for example a file
+ *                 mapped with mmap(), shared by several processes.
+ *
+ * \param image    Trust image initialized with mbedtls_x509_trust_image_init()
+ * \param buf      The image
+ * \param len      Length of \p buf
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_INVALID_FORMAT if \p buf is not a trust
+ *                 image, or one written by another version of the library.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if \p image is already
+ *                 set up.
+ */
+int mbedtls_x509_trust_image_setup(mbedtls_x509_trust_image *image,
+                                   const unsigned char *buf, size_t len);
+
+/**
+ * \brief          Number of certificates in a trust image
+ *
+ * \param image    Trust image set up with mbedtls_x509_trust_image_setup()
+ *
+ * \return         The number of certificates.
+ */
+size_t mbedtls_x509_trust_image_count(const mbedtls_x509_trust_image *image);
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+/**
+ * \brief          CA callback returning the candidate parents of a
+ *                 certificate from a trust image
+ *                 (Thread-safe)
+ *
+ *                 This can be passed to mbedtls_ssl_conf_ca_cb() or
+ *                 mbedtls_x509_crt_verify_with_ca_cb(), with a trust image
+ *                 set up with mbedtls_x509_trust_image_setup() as context.
+ *                 The candidates are found and ordered as with
+ *                 mbedtls_x509_trust_store_ca_cb(). Only they are parsed,
+ *                 and they refer to the data of the image.
+ *
+ * \param p_image        The trust image
+ * \param child          The certificate to find candidate parents for
+ * \param candidate_cas  On success, the candidates, or \c NULL if there is none
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code if a candidate in the image
+ *                 cannot be parsed.
+ */
+int mbedtls_x509_trust_image_ca_cb(void *p_image,
+                                   mbedtls_x509_crt const *child,
+                                   mbedtls_x509_crt **candidate_cas);
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+/**
+ * \brief          Free a trust image
+ *
+ *                 The buffer of the image is not freed or unmapped.
+ *
+ * \param image    Trust image to free
+ */
+void mbedtls_x509_trust_image_free(mbedtls_x509_trust_image *image);
+#endif /* MBEDTLS_X509_TRUST_IMAGE */
+
+#if defined(MBEDTLS_X509_CRT_CA_DIR)
+/**
+ * \brief          Initialize a CA directory
+ *
+ * \param dir      CA directory to initialize
+ */
+void mbedtls_x509_crt_ca_dir_init(mbedtls_x509_crt_ca_dir *dir);
+
+/**
+ * \brief          List the files of a hashed CA directory
+ *
+ *                 Files whose name is not a subject hash followed by a
+ *                 dot and a number are ignored. No file is read: a
+ *                 certificate is parsed the first time
+ *                 mbedtls_x509_crt_ca_dir_ca_cb() looks for its subject,
+ *                 or by mbedtls_x509_crt_ca_dir_preload().
+ *
+ * \param dir      CA directory initialized with mbedtls_x509_crt_ca_dir_init()
+ * \param path     Directory to list
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_FILE_IO_ERROR if the directory cannot
+ *                 be read.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if \p dir is already
+ *                 set up.
+ */
+int mbedtls_x509_crt_ca_dir_setup(mbedtls_x509_crt_ca_dir *dir, const char *path);
+
+/**
+ * \brief          Parse a share of the files of a CA directory now
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This parses the files whose position in the directory is
+ *                 \p worker modulo \p num_workers, so that \p num_workers
+ *                 threads, each with a different \p worker, can share the
+ *                 work of parsing the whole directory. Files already parsed
+ *                 are skipped. It can run while the directory is in use by
+ *                 mbedtls_x509_crt_ca_dir_ca_cb().
+ *
+ * \param dir          CA directory set up with mbedtls_x509_crt_ca_dir_setup()
+ * \param worker       Index of the caller, from 0 to \p num_workers - 1
+ * \param num_workers  Number of callers sharing the work. Pass 1 to
+ *                     parse the whole directory.
+ *
+ * \return         The number of files that could not be parsed, like
+ *                 mbedtls_x509_crt_parse_path().
+ * \return         #MBEDTLS_ERR_X509_BAD_INPUT_DATA if \p worker is out of
+ *                 range.
+ * \return         Another negative error code on allocation or threading
+ *                 failure.
+ */
+int mbedtls_x509_crt_ca_dir_preload(mbedtls_x509_crt_ca_dir *dir,
+                                    size_t worker, size_t num_workers);
+
+/**
+ * \brief          CA callback returning the candidate parents of a
+ *                 certificate from a CA directory
+ *                 (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *                 This can be passed to mbedtls_ssl_conf_ca_cb() or
+ *                 mbedtls_x509_crt_verify_with_ca_cb(), with a CA directory
+ *                 set up with mbedtls_x509_crt_ca_dir_setup() as context.
+ *                 The files named after the subject hash of the issuer of
+ *                 \p child are parsed if they were not yet, and the
+ *                 certificates they hold whose subject is the issuer of
+ *                 \p child are returned. They refer to the data of the
+ *                 certificates kept in \p p_dir, which must outlive the
+ *                 returned list.
+ *
+ * \param p_dir          The CA directory
+ * \param child          The certificate to find candidate parents for
+ * \param candidate_cas  On success, the candidates, or \c NULL if there is none
+ *
+ * \return         \c 0 on success.
+ * \return         #MBEDTLS_ERR_X509_ALLOC_FAILED on allocation failure.
+ * \return         Another negative error code on threading or hashing
+ *                 failure.
+ */
+int mbedtls_x509_crt_ca_dir_ca_cb(void *p_dir,
+                                  mbedtls_x509_crt const *child,
+                                  mbedtls_x509_crt **candidate_cas);
+
+/**
+ * \brief          Free a CA directory and the certificates parsed from it
+ *
+ * \param dir      CA directory to free
+ */
+void mbedtls_x509_crt_ca_dir_free(mbedtls_x509_crt_ca_dir *dir);
+#endif /* MBEDTLS_X509_CRT_CA_DIR */
+
 /**
  * \brief          Unallocate all certificate data
  *
@@ -1174,6 +2102,73 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx, unsigned char *buf, s
                               int (*f_rng)(void *, unsigned char *, size_t),
                               void *p_rng);
 
+/**
+ * \brief           Initialize a certificate template
+ *
+ * \param tmpl      Template to initialize
+ */
+void mbedtls_x509write_crt_template_init(mbedtls_x509write_crt_template *tmpl);
+
+/**
+ * \brief           Encode the issuer side of the certificates of an issuer
+ *                  once, for mbedtls_x509write_crt_der_from_template()
+ *
+ *                  The version, hash algorithm, issuer key, issuer name and
+ *                  extensions of \p ctx are taken. Extensions that are the
+ *                  same for all the certificates, such as basic constraints,
+ *                  key usage or the authority key identifier, belong here.
+ *
+ * \param tmpl      Template, initialized with
+ *                  mbedtls_x509write_crt_template_init()
+ * \param ctx       Certificate context with the issuer side set up
+ *
+ * \note            The template keeps a pointer to the issuer key of \p ctx,
+ *                  which must outlive it. \p ctx itself can be freed.
+ *
+ * \return          0 if successful, or a specific error code
+ */
+int mbedtls_x509write_crt_template_setup(mbedtls_x509write_crt_template *tmpl,
+                                         const mbedtls_x509write_cert *ctx);
+
+/**
+ * \brief           Write a certificate to a X509 DER structure, with the
+ *                  issuer side of a template
+ *                  Note: data is written at the end of the buffer! Use the
+ *                        return value to determine where you should start
+ *                        using the buffer
+ *
+ *                  This is mbedtls_x509write_crt_der() for CAs issuing many
+ *                  certificates: only the serial, validity, subject name,
+ *                  subject key and extensions of \p ctx are encoded, and the
+ *                  rest is copied from \p tmpl.
+ *
+ * \param tmpl      Template set up with mbedtls_x509write_crt_template_setup()
+ * \param ctx       Certificate context with the subject side set up. Its
+ *                  extensions, such as the subject alternative name or the
+ *                  subject key identifier, are written in addition to those
+ *                  of the template. Its version, hash algorithm, issuer key
+ *                  and issuer name are not used.
+ * \param buf       buffer to write to
+ * \param size      size of the buffer
+ * \param f_rng     RNG function. This must not be \c NULL.
+ * \param p_rng     RNG parameter
+ *
+ * \return          length of data written if successful, or a specific
+ *                  error code
+ */
+int mbedtls_x509write_crt_der_from_template(const mbedtls_x509write_crt_template *tmpl,
+                                            mbedtls_x509write_cert *ctx,
+                                            unsigned char *buf, size_t size,
+                                            int (*f_rng)(void *, unsigned char *, size_t),
+                                            void *p_rng);
+
+/**
+ * \brief           Free a certificate template
+ *
+ * \param tmpl      Template to free
+ */
+void mbedtls_x509write_crt_template_free(mbedtls_x509write_crt_template *tmpl);
+
 #if defined(MBEDTLS_PEM_WRITE_C)
 /**
  * \brief           Write a built up certificate to a X509 PEM string
@@ -57,6 +57,10 @@ typedef struct mbedtls_x509_csr {
     mbedtls_md_type_t MBEDTLS_PRIVATE(sig_md);       /**< Internal representation of the MD algorithm of the signature algorithm, e.g. MBEDTLS_MD_SHA256 */
     mbedtls_pk_type_t MBEDTLS_PRIVATE(sig_pk);       /**< Internal representation of the Public Key algorithm of the signature algorithm, e.g. MBEDTLS_PK_RSA */
     void *MBEDTLS_PRIVATE(sig_opts);         /**< Signature options to be passed to mbedtls_pk_verify_ext(), e.g. for RSASSA-PSS */
+
+    int MBEDTLS_PRIVATE(own_buffer);         /**< Indicates if \c raw is owned by the structure or not */
+    void *MBEDTLS_PRIVATE(arena);            /**< Single allocation holding the subject and SAN nodes and the signature options, or NULL */
+    size_t MBEDTLS_PRIVATE(arena_len);       /**< Length of \c arena */
 }
 mbedtls_x509_csr;
 
@@ -91,6 +95,61 @@ mbedtls_x509write_csr;
 int mbedtls_x509_csr_parse_der(mbedtls_x509_csr *csr,
                                const unsigned char *buf, size_t buflen);
 
+/**
+ * \brief          Load a Certificate Signing Request (CSR) in DER format.
+ *                 This is a variant of mbedtls_x509_csr_parse_der() which
+ *                 takes temporary ownership of the CSR buffer until the
+ *                 CSR is freed.
+ *
+ * \note           The PSA crypto subsystem must have been initialized by
+ *                 calling psa_crypto_init() before calling this function.
+ *
+ * \param csr      CSR context to fill
+ * \param buf      The address of the readable buffer holding the DER
+ *                 encoded CSR. On success, this buffer must be retained
+ *                 and not be changed until \p csr is freed through a call
+ *                 to mbedtls_x509_csr_free().
+ * \param buflen   size of the buffer
+ *
+ * \return         0 if successful, or a specific X509 error code
+ */
+int mbedtls_x509_csr_parse_der_nocopy(mbedtls_x509_csr *csr,
+                                      const unsigned char *buf, size_t buflen);
+
+/**
+ * \brief          Load a Certificate Signing Request (CSR) in DER format
+ *                 and check that it is signed with its own key
+ *
+ *                 The CSR is parsed as with
+ *                 mbedtls_x509_csr_parse_der_nocopy(), and its subject and
+ *                 subject alternative name lists are moved into a single
+ *                 allocation, released as one block by
+ *                 mbedtls_x509_csr_free(). The signature is then verified
+ *                 over the CertificationRequestInfo with the public key of
+ *                 the request, so callers do not need to hash and verify
+ *                 it themselves.
+ *
+ * \note           The PSA crypto subsystem must have been initialized by
+ *                 calling psa_crypto_init() before calling this function.
+ *
+ * \param csr      CSR context to fill
+ * \param buf      The address of the readable buffer holding the DER
+ *                 encoded CSR. On success, this buffer must be retained
+ *                 and not be changed until \p csr is freed through a call
+ *                 to mbedtls_x509_csr_free().
+ * \param buflen   size of the buffer
+ *
+ * \return         0 if successful.
+ * \return         #MBEDTLS_ERR_X509_CERT_VERIFY_FAILED if the signature
+ *                 does not verify.
+ * \return         #MBEDTLS_ERR_X509_SIG_MISMATCH if the signature algorithm
+ *                 does not match the key of the request.
+ * \return         Another specific X509 error code if the CSR cannot be
+ *                 parsed. On failure, \p csr is freed.
+ */
+int mbedtls_x509_csr_parse_der_verify(mbedtls_x509_csr *csr,
+                                      const unsigned char *buf, size_t buflen);
+
 /**
  * \brief          The type of certificate extension callbacks.
  *
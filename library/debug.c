@@ -21,11 +21,11 @@
 /* DEBUG_BUF_SIZE must be at least 2 */
 #define DEBUG_BUF_SIZE      512
 
-static int debug_threshold = 0;
+int mbedtls_debug_threshold = 0;
 
 void mbedtls_debug_set_threshold(int threshold)
 {
-    debug_threshold = threshold;
+    mbedtls_debug_threshold = threshold;
 }
 
 /*
@@ -41,14 +41,79 @@ static inline void debug_send_line(const mbedtls_ssl_context *ssl, int level,
      * context instead, as it shouldn't be shared between threads.
      */
 #if defined(MBEDTLS_THREADING_C)
+    static const char hex[] = "0123456789abcdef";
     char idstr[20 + DEBUG_BUF_SIZE]; /* 0x + 16 nibbles + ': ' */
-    mbedtls_snprintf(idstr, sizeof(idstr), "%p: %s", (void *) ssl, str);
+    uintptr_t id = (uintptr_t) ssl;
+    size_t i, n = 2 * sizeof(uintptr_t), len = strlen(str);
+
+    if (n > 16) {
+        n = 16;
+    }
+    if (len > DEBUG_BUF_SIZE - 1) {
+        len = DEBUG_BUF_SIZE - 1;
+    }
+
+    /* Written by hand rather than with "%p", as this is done for every
+     * line of debug output. */
+    idstr[0] = '0';
+    idstr[1] = 'x';
+    for (i = 0; i < n; i++) {
+        idstr[2 + i] = hex[(id >> (4 * (n - 1 - i))) & 0xF];
+    }
+    idstr[2 + n] = ':';
+    idstr[3 + n] = ' ';
+    memcpy(idstr + 4 + n, str, len);
+    idstr[4 + n + len] = '\0';
+
     ssl->conf->f_dbg(ssl->conf->p_dbg, level, file, line, idstr);
 #else
     ssl->conf->f_dbg(ssl->conf->p_dbg, level, file, line, str);
 #endif
 }
 
+/*
+ * Pass an event to the event callback if there is one.
+ * Return 1 if it did, 0 if the event is to be formatted for f_dbg.
+ */
+static int debug_send_event(const mbedtls_ssl_context *ssl, int level,
+                            const char *file, int line,
+                            const mbedtls_ssl_debug_event *event)
+{
+    if (ssl->conf->f_dbg_event == NULL) {
+        return 0;
+    }
+
+    ssl->conf->f_dbg_event(ssl->conf->p_dbg_event, ssl, level, file, line,
+                           event);
+
+    return 1;
+}
+
+int mbedtls_debug_format_event(const mbedtls_ssl_debug_event *event,
+                               char *buf, size_t size)
+{
+    int ret;
+    va_list args;
+
+    switch (event->type) {
+        case MBEDTLS_SSL_DEBUG_EVENT_MSG:
+            /* Copied, so that the event can be formatted again. */
+            va_copy(args, *(va_list *) event->args);
+            ret = mbedtls_vsnprintf(buf, size, event->text, args);
+            va_end(args);
+            return ret;
+        case MBEDTLS_SSL_DEBUG_EVENT_RET:
+            return mbedtls_snprintf(buf, size, "%s() returned %d (-0x%04x)",
+                                    event->text, event->ret,
+                                    (unsigned int) -event->ret);
+        case MBEDTLS_SSL_DEBUG_EVENT_BUF:
+            return mbedtls_snprintf(buf, size, "dumping '%s' (%u bytes)",
+                                    event->text, (unsigned int) event->len);
+        default:
+            return -1;
+    }
+}
+
 MBEDTLS_PRINTF_ATTRIBUTE(5, 6)
 void mbedtls_debug_print_msg(const mbedtls_ssl_context *ssl, int level,
                              const char *file, int line,
@@ -60,14 +125,18 @@ void mbedtls_debug_print_msg(const mbedtls_ssl_context *ssl, int level,
 
     MBEDTLS_STATIC_ASSERT(DEBUG_BUF_SIZE >= 2, "DEBUG_BUF_SIZE too small");
 
-    if (NULL == ssl              ||
-        NULL == ssl->conf        ||
-        NULL == ssl->conf->f_dbg ||
-        level > debug_threshold) {
+    if (!MBEDTLS_DEBUG_ENABLED(ssl, level)) {
         return;
     }
 
     va_start(argp, format);
+    if (ssl->conf->f_dbg_event != NULL) {
+        mbedtls_ssl_debug_event event = { MBEDTLS_SSL_DEBUG_EVENT_MSG,
+                                          format, 0, NULL, 0, &argp };
+        debug_send_event(ssl, level, file, line, &event);
+        va_end(argp);
+        return;
+    }
     ret = mbedtls_vsnprintf(str, DEBUG_BUF_SIZE, format, argp);
     va_end(argp);
 
@@ -89,11 +158,10 @@ void mbedtls_debug_print_ret(const mbedtls_ssl_context *ssl, int level,
                              const char *text, int ret)
 {
     char str[DEBUG_BUF_SIZE];
+    mbedtls_ssl_debug_event event = { MBEDTLS_SSL_DEBUG_EVENT_RET,
+                                      text, ret, NULL, 0, NULL };
 
-    if (NULL == ssl              ||
-        NULL == ssl->conf        ||
-        NULL == ssl->conf->f_dbg ||
-        level > debug_threshold) {
+    if (!MBEDTLS_DEBUG_ENABLED(ssl, level)) {
         return;
     }
 
@@ -106,6 +174,10 @@ void mbedtls_debug_print_ret(const mbedtls_ssl_context *ssl, int level,
         return;
     }
 
+    if (debug_send_event(ssl, level, file, line, &event)) {
+        return;
+    }
+
     mbedtls_snprintf(str, sizeof(str), "%s() returned %d (-0x%04x)\n",
                      text, ret, (unsigned int) -ret);
 
@@ -119,11 +191,14 @@ void mbedtls_debug_print_buf(const mbedtls_ssl_context *ssl, int level,
     char str[DEBUG_BUF_SIZE];
     char txt[17];
     size_t i, idx = 0;
+    mbedtls_ssl_debug_event event = { MBEDTLS_SSL_DEBUG_EVENT_BUF,
+                                      text, 0, buf, len, NULL };
 
-    if (NULL == ssl              ||
-        NULL == ssl->conf        ||
-        NULL == ssl->conf->f_dbg ||
-        level > debug_threshold) {
+    if (!MBEDTLS_DEBUG_ENABLED(ssl, level)) {
+        return;
+    }
+
+    if (debug_send_event(ssl, level, file, line, &event)) {
         return;
     }
 
@@ -177,7 +252,7 @@ void mbedtls_debug_print_ecp(const mbedtls_ssl_context *ssl, int level,
     if (NULL == ssl              ||
         NULL == ssl->conf        ||
         NULL == ssl->conf->f_dbg ||
-        level > debug_threshold) {
+        level > mbedtls_debug_threshold) {
         return;
     }
 
@@ -241,7 +316,7 @@ void mbedtls_debug_print_psa_ec(const mbedtls_ssl_context *ssl, int level,
     if (NULL == ssl              ||
         NULL == ssl->conf        ||
         NULL == ssl->conf->f_dbg ||
-        level > debug_threshold) {
+        level > mbedtls_debug_threshold) {
         return;
     }
 
@@ -274,7 +349,7 @@ void mbedtls_debug_print_mpi(const mbedtls_ssl_context *ssl, int level,
         NULL == ssl->conf        ||
         NULL == ssl->conf->f_dbg ||
         NULL == X                ||
-        level > debug_threshold) {
+        level > mbedtls_debug_threshold) {
         return;
     }
 
@@ -392,7 +467,7 @@ void mbedtls_debug_print_crt(const mbedtls_ssl_context *ssl, int level,
         NULL == ssl->conf        ||
         NULL == ssl->conf->f_dbg ||
         NULL == crt              ||
-        level > debug_threshold) {
+        level > mbedtls_debug_threshold) {
         return;
     }
 
@@ -12,6 +12,15 @@
 
 #include "mbedtls/debug.h"
 
+/* Threshold of mbedtls_debug_set_threshold(). */
+extern int mbedtls_debug_threshold;
+
+/* Whether output of the given level on \p ssl goes anywhere. */
+#define MBEDTLS_DEBUG_ENABLED(ssl, level)                               \
+    ((level) <= mbedtls_debug_threshold &&                              \
+     (ssl) != NULL && (ssl)->conf != NULL &&                            \
+     ((ssl)->conf->f_dbg != NULL || (ssl)->conf->f_dbg_event != NULL))
+
 /**
  * \brief    Print a message to the debug output. This function is always used
  *          through the MBEDTLS_SSL_DEBUG_MSG() macro, which supplies the ssl
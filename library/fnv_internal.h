@@ -0,0 +1,37 @@
+/**
+ * \file fnv_internal.h
+ *
+ * \brief FNV-1a hash, for the hash tables of the library.
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_FNV_INTERNAL_H
+#define MBEDTLS_FNV_INTERNAL_H
+
+#include "mbedtls/build_info.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Initial value (offset basis) of a 32-bit FNV-1a hash. */
+#define MBEDTLS_FNV1A32_INIT    0x811c9dc5u
+
+/*
+ * Continue the 32-bit FNV-1a hash \p h over \p n bytes at \p p. Start with
+ * MBEDTLS_FNV1A32_INIT. This is not collision resistant: only use it for
+ * keys that a peer cannot choose, or where collisions only cost time.
+ */
+static inline uint32_t mbedtls_fnv1a32(uint32_t h, const unsigned char *p, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 0x01000193u;
+    }
+
+    return h;
+}
+
+#endif /* MBEDTLS_FNV_INTERNAL_H */
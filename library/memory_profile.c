@@ -0,0 +1,223 @@
+/*
+ *  Heap usage accounting per library subsystem
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Every block carries a header that records its size and tag. The
+ * accounting allocator is installed as the platform allocator, so that
+ * blocks allocated by the crypto library carry a header too and any
+ * mbedtls_free() can read it. Library code passes a tag by calling
+ * mbedtls_memory_profile_calloc() through mbedtls_calloc_tagged(); the
+ * other allocations are accounted to MBEDTLS_MEMORY_TAG_OTHER.
+ */
+
+#include "common.h"
+
+#if defined(MBEDTLS_MEMORY_PROFILE)
+
+#include "mbedtls/memory_profile.h"
+#include "memory_profile_internal.h"
+#include "mbedtls/platform.h"
+
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+/* Keeps the blocks that follow it aligned for any type. */
+typedef union {
+    struct {
+        size_t size;
+        mbedtls_memory_tag tag;
+    } h;
+    long double ld;
+    long long ll;
+    void *p;
+} memory_profile_header;
+
+static mbedtls_memory_profile_usage memory_profile_usage[MBEDTLS_MEMORY_TAG_COUNT];
+static int memory_profile_active;
+
+#if defined(MBEDTLS_THREADING_C)
+static mbedtls_threading_mutex_t memory_profile_mutex;
+#endif
+
+static const char * const memory_profile_names[MBEDTLS_MEMORY_TAG_COUNT] = {
+    "other",
+    "ssl",
+    "ssl_record",
+    "ssl_handshake",
+    "ssl_transform",
+    "ssl_session",
+    "ssl_peer_cert",
+    "ssl_cache",
+    "x509",
+    "net",
+};
+
+static void *memory_profile_alloc(mbedtls_memory_tag tag, size_t n, size_t size)
+{
+    memory_profile_header *header;
+    mbedtls_memory_profile_usage *usage;
+    size_t len;
+
+    if (size != 0 && n > (SIZE_MAX - sizeof(memory_profile_header)) / size) {
+        return NULL;
+    }
+    len = n * size;
+
+    header = MBEDTLS_PLATFORM_STD_CALLOC(1, sizeof(memory_profile_header) + len);
+    if (header == NULL) {
+        return NULL;
+    }
+
+    if ((unsigned) tag >= MBEDTLS_MEMORY_TAG_COUNT) {
+        tag = MBEDTLS_MEMORY_TAG_OTHER;
+    }
+    header->h.size = len;
+    header->h.tag = tag;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&memory_profile_mutex) != 0) {
+        MBEDTLS_PLATFORM_STD_FREE(header);
+        return NULL;
+    }
+#endif
+    usage = &memory_profile_usage[tag];
+    usage->current += len;
+    if (usage->current > usage->peak) {
+        usage->peak = usage->current;
+    }
+    usage->blocks++;
+    usage->allocations++;
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock(&memory_profile_mutex);
+#endif
+
+    return header + 1;
+}
+
+static void *memory_profile_calloc_other(size_t n, size_t size)
+{
+    return memory_profile_alloc(MBEDTLS_MEMORY_TAG_OTHER, n, size);
+}
+
+static void memory_profile_release(void *ptr)
+{
+    memory_profile_header *header;
+    mbedtls_memory_profile_usage *usage;
+
+    if (ptr == NULL) {
+        return;
+    }
+    header = (memory_profile_header *) ptr - 1;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&memory_profile_mutex) == 0)
+#endif
+    {
+        usage = &memory_profile_usage[header->h.tag];
+        usage->current -= header->h.size;
+        usage->blocks--;
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_unlock(&memory_profile_mutex);
+#endif
+    }
+
+    MBEDTLS_PLATFORM_STD_FREE(header);
+}
+
+void *mbedtls_memory_profile_calloc(mbedtls_memory_tag tag, size_t n, size_t size)
+{
+    if (!memory_profile_active) {
+        return mbedtls_calloc(n, size);
+    }
+
+    return memory_profile_alloc(tag, n, size);
+}
+
+int mbedtls_memory_profile_init(void)
+{
+    if (memory_profile_active) {
+        return 0;
+    }
+
+    memset(memory_profile_usage, 0, sizeof(memory_profile_usage));
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&memory_profile_mutex);
+#endif
+    memory_profile_active = 1;
+
+    return mbedtls_platform_set_calloc_free(memory_profile_calloc_other,
+                                            memory_profile_release);
+}
+
+void mbedtls_memory_profile_get(mbedtls_memory_tag tag,
+                                mbedtls_memory_profile_usage *usage)
+{
+    memset(usage, 0, sizeof(mbedtls_memory_profile_usage));
+
+    if ((unsigned) tag >= MBEDTLS_MEMORY_TAG_COUNT || !memory_profile_active) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&memory_profile_mutex) != 0) {
+        return;
+    }
+#endif
+    *usage = memory_profile_usage[tag];
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock(&memory_profile_mutex);
+#endif
+}
+
+void mbedtls_memory_profile_reset_peak(void)
+{
+    size_t i;
+
+    if (!memory_profile_active) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&memory_profile_mutex) != 0) {
+        return;
+    }
+#endif
+    for (i = 0; i < MBEDTLS_MEMORY_TAG_COUNT; i++) {
+        memory_profile_usage[i].peak = memory_profile_usage[i].current;
+    }
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_unlock(&memory_profile_mutex);
+#endif
+}
+
+const char *mbedtls_memory_profile_tag_name(mbedtls_memory_tag tag)
+{
+    if ((unsigned) tag >= MBEDTLS_MEMORY_TAG_COUNT) {
+        return NULL;
+    }
+
+    return memory_profile_names[tag];
+}
+
+void mbedtls_memory_profile_free(void)
+{
+    if (!memory_profile_active) {
+        return;
+    }
+
+    mbedtls_platform_set_calloc_free(MBEDTLS_PLATFORM_STD_CALLOC,
+                                     MBEDTLS_PLATFORM_STD_FREE);
+    memory_profile_active = 0;
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&memory_profile_mutex);
+#endif
+}
+
+#endif /* MBEDTLS_MEMORY_PROFILE */
@@ -0,0 +1,35 @@
+/**
+ * \file memory_profile_internal.h
+ *
+ * \brief Internal part of the public "memory_profile.h".
+ */
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+#ifndef MBEDTLS_MEMORY_PROFILE_INTERNAL_H
+#define MBEDTLS_MEMORY_PROFILE_INTERNAL_H
+
+#include "mbedtls/build_info.h"
+
+#if defined(MBEDTLS_MEMORY_PROFILE)
+
+#include "mbedtls/memory_profile.h"
+
+/*
+ * Allocate like mbedtls_calloc(), accounting the block to \p tag once
+ * mbedtls_memory_profile_init() was called. The block is freed with
+ * mbedtls_free() as usual.
+ */
+void *mbedtls_memory_profile_calloc(mbedtls_memory_tag tag, size_t n, size_t size);
+
+#define mbedtls_calloc_tagged(tag, n, size)                                 \
+    mbedtls_memory_profile_calloc(MBEDTLS_MEMORY_TAG_ ## tag, n, size)
+
+#else /* MBEDTLS_MEMORY_PROFILE */
+
+#define mbedtls_calloc_tagged(tag, n, size) mbedtls_calloc(n, size)
+
+#endif /* MBEDTLS_MEMORY_PROFILE */
+
+#endif /* MBEDTLS_MEMORY_PROFILE_INTERNAL_H */
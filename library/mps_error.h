@@ -86,4 +86,39 @@
 
 /* \} name SECTION: MPS Reader error codes */
 
+/**
+ * \name SECTION:       MPS Writer error codes
+ *
+ * \{
+ */
+
+#ifndef MBEDTLS_MPS_WRITER_ERR_BASE
+#define MBEDTLS_MPS_WRITER_ERR_BASE (2 << 8)
+#endif
+
+#define MBEDTLS_MPS_WRITER_MAKE_ERROR(code) \
+    (-(MBEDTLS_MPS_WRITER_ERR_BASE | (code)))
+
+/*! An attempt to reclaim the output buffer from a writer without forcing it
+ *  failed because there is still space left in the buffer. */
+#define MBEDTLS_ERR_MPS_WRITER_DATA_LEFT             MBEDTLS_MPS_WRITER_MAKE_ERROR(0x1)
+
+/*! An invalid argument was passed to the writer. */
+#define MBEDTLS_ERR_MPS_WRITER_INVALID_ARG           MBEDTLS_MPS_WRITER_MAKE_ERROR(0x2)
+
+/*! The buffer passed to mbedtls_mps_writer_feed() has been filled entirely
+ *  with data queued from a previous output buffer, and more buffers need to
+ *  be fed to flush the rest of the queue. */
+#define MBEDTLS_ERR_MPS_WRITER_NEED_MORE             MBEDTLS_MPS_WRITER_MAKE_ERROR(0x3)
+
+/*! A get request failed because neither the output buffer nor the queue
+ *  have enough space left to serve it. */
+#define MBEDTLS_ERR_MPS_WRITER_OUT_OF_DATA           MBEDTLS_MPS_WRITER_MAKE_ERROR(0x4)
+
+/*! An attempt to omit data in mbedtls_mps_writer_commit_partial() exceeded
+ *  the data obtained since the last commit. */
+#define MBEDTLS_ERR_MPS_WRITER_TOO_MUCH_OMITTED      MBEDTLS_MPS_WRITER_MAKE_ERROR(0x5)
+
+/* \} name SECTION: MPS Writer error codes */
+
 #endif /* MBEDTLS_MPS_ERROR_H */
@@ -0,0 +1,397 @@
+/*
+ *  Message Processing Stack, Writer implementation
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+
+#include "mps_writer.h"
+#include "mps_common.h"
+#include "mps_trace.h"
+
+#include <string.h>
+
+#if defined(MBEDTLS_MPS_ENABLE_TRACE)
+static int mbedtls_mps_trace_id = MBEDTLS_MPS_TRACE_BIT_WRITER;
+#endif /* MBEDTLS_MPS_ENABLE_TRACE */
+
+/*
+ * The coding style follows the one of the reader, see the general
+ * note at the top of mps_reader.c: loads and stores are kept apart
+ * from other operations, and the writer's fields are only updated
+ * once an operation is known to succeed.
+ */
+
+static inline int mps_writer_is_providing(
+    mbedtls_mps_writer const *wr)
+{
+    unsigned char state = wr->state;
+    return state == MBEDTLS_MPS_WRITER_PROVIDING;
+}
+
+static inline int mps_writer_is_consuming(
+    mbedtls_mps_writer const *wr)
+{
+    return !mps_writer_is_providing(wr);
+}
+
+static inline void mps_writer_zero(mbedtls_mps_writer *wr)
+{
+    /* See mps_reader_zero() for why this isn't a memset(). */
+    static mbedtls_mps_writer const zero =
+    { .out             = NULL,
+      .out_len         = 0,
+      .commit          = 0,
+      .end             = 0,
+      .queue           = NULL,
+      .queue_len       = 0,
+      .queue_start     = 0,
+      .queue_next      = 0,
+      .queue_remaining = 0,
+      .state           = MBEDTLS_MPS_WRITER_PROVIDING };
+    *wr = zero;
+}
+
+int mbedtls_mps_writer_init(mbedtls_mps_writer *wr,
+                            unsigned char *queue,
+                            mbedtls_mps_size_t queue_len)
+{
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_init");
+    MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                      "* Queue size: %u bytes", (unsigned) queue_len);
+    mps_writer_zero(wr);
+    wr->queue = queue;
+    wr->queue_len = queue_len;
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_free(mbedtls_mps_writer *wr)
+{
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_free");
+    mps_writer_zero(wr);
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_feed(mbedtls_mps_writer *wr,
+                            unsigned char *new_out,
+                            mbedtls_mps_size_t new_out_len)
+{
+    mbedtls_mps_size_t queue_remaining, copy_from_queue = 0;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_feed");
+    MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                      "* Buffer length: %u bytes", (unsigned) new_out_len);
+
+    if (new_out == NULL) {
+        MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_INVALID_ARG);
+    }
+
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_providing(
+                                       wr),
+                                   "mbedtls_mps_writer_feed() requires writer to be in providing mode");
+
+    queue_remaining = wr->queue_remaining;
+    if (queue_remaining > 0) {
+        unsigned char *queue = wr->queue;
+        mbedtls_mps_size_t queue_next = wr->queue_next;
+
+        /* Skip over parts of the queue that have already been flushed. */
+        queue += queue_next;
+
+        copy_from_queue = queue_remaining;
+        if (copy_from_queue > new_out_len) {
+            copy_from_queue = new_out_len;
+        }
+
+        /* Flush queued data to the new buffer. */
+        memcpy(new_out, queue, copy_from_queue);
+
+        MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                          "Flush %u of %u queued bytes from queue offset %u",
+                          (unsigned) copy_from_queue, (unsigned) queue_remaining,
+                          (unsigned) queue_next);
+
+        queue_remaining -= copy_from_queue;
+        if (queue_remaining > 0) {
+            /* The buffer is full with queued data. Stay in providing mode. */
+            queue_next += copy_from_queue;
+            wr->queue_next = queue_next;
+            wr->queue_remaining = queue_remaining;
+            MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_NEED_MORE);
+        }
+
+        MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                          "Queue fully flushed");
+
+        wr->queue_next = 0;
+        wr->queue_remaining = 0;
+    }
+
+    wr->out = new_out;
+    wr->out_len = new_out_len;
+    wr->commit = copy_from_queue;
+    wr->end = copy_from_queue;
+    wr->state = MBEDTLS_MPS_WRITER_CONSUMING;
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_get(mbedtls_mps_writer *wr,
+                           mbedtls_mps_size_t desired,
+                           unsigned char **buffer,
+                           mbedtls_mps_size_t *buflen)
+{
+    unsigned char *queue;
+    mbedtls_mps_size_t end, queue_len, queue_start, queue_offset, queue_space;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_get");
+    MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                      "* Bytes requested: %u", (unsigned) desired);
+
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_consuming(
+                                       wr),
+                                   "mbedtls_mps_writer_get() requires writer to be in consuming mode");
+
+    end = wr->end;
+    queue = wr->queue;
+    queue_len = wr->queue_len;
+
+    if (wr->state == MBEDTLS_MPS_WRITER_CONSUMING) {
+        unsigned char *out;
+        mbedtls_mps_size_t out_len, out_remaining;
+
+        out_len = wr->out_len;
+        out_remaining = out_len - end;
+
+        /* Serve the request from the output buffer if possible, or
+         * with what is left of it if the user tolerates it. */
+        if (desired > out_remaining && buflen != NULL && out_remaining > 0) {
+            desired = out_remaining;
+        }
+
+        if (desired <= out_remaining) {
+            MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                              "Serve the request from the output buffer");
+            out = wr->out;
+            out += end;
+
+            *buffer = out;
+            if (buflen != NULL) {
+                *buflen = desired;
+            }
+
+            end += desired;
+            wr->end = end;
+            MBEDTLS_MPS_TRACE_RETURN(0);
+        }
+
+        /* Switch to the queue, where the rest of the outgoing data
+         * is held until the next output buffers are fed. */
+        if (queue == NULL || desired > queue_len) {
+            MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                              "Not enough space in the output buffer and no "
+                              "queue to serve the request.");
+            MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_OUT_OF_DATA);
+        }
+
+        MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                          "Start serving from the queue at offset %u",
+                          (unsigned) end);
+        wr->queue_start = end;
+        wr->state = MBEDTLS_MPS_WRITER_QUEUEING;
+    }
+
+    /* Serve the request from the queue. */
+    queue_start = wr->queue_start;
+    queue_offset = end - queue_start;
+    queue_space = queue_len - queue_offset;
+
+    if (desired > queue_space) {
+        if (buflen == NULL || queue_space == 0) {
+            MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                              "Not enough space in the queue "
+                              "to serve the request.");
+            MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_OUT_OF_DATA);
+        }
+
+        desired = queue_space;
+    }
+
+    queue += queue_offset;
+
+    *buffer = queue;
+    if (buflen != NULL) {
+        *buflen = desired;
+    }
+
+    end += desired;
+    wr->end = end;
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_commit(mbedtls_mps_writer *wr)
+{
+    mbedtls_mps_size_t end;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_commit");
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_consuming(
+                                       wr),
+                                   "mbedtls_mps_writer_commit() requires writer to be in consuming mode");
+
+    end = wr->end;
+    wr->commit = end;
+
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_commit_partial(mbedtls_mps_writer *wr,
+                                      mbedtls_mps_size_t omit)
+{
+    mbedtls_mps_size_t commit, end, queue_start;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_commit_partial");
+    MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                      "* Omit %u bytes", (unsigned) omit);
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_consuming(
+                                       wr),
+                                   "mbedtls_mps_writer_commit_partial() requires writer to be in consuming mode");
+
+    commit = wr->commit;
+    end = wr->end;
+
+    if (omit > end - commit) {
+        MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_TOO_MUCH_OMITTED);
+    }
+
+    end -= omit;
+
+    /* Stop using the queue if the omitted data was all there is in it. */
+    queue_start = wr->queue_start;
+    if (wr->state == MBEDTLS_MPS_WRITER_QUEUEING && end <= queue_start) {
+        wr->state = MBEDTLS_MPS_WRITER_CONSUMING;
+    }
+
+    wr->end = end;
+    wr->commit = end;
+
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_bytes_written(mbedtls_mps_writer const *wr,
+                                     mbedtls_mps_size_t *written)
+{
+    mbedtls_mps_size_t commit;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_bytes_written");
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_consuming(
+                                       wr),
+                                   "mbedtls_mps_writer_bytes_written() requires writer to be in consuming mode");
+
+    commit = wr->commit;
+    *written = commit;
+
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+int mbedtls_mps_writer_reclaim(mbedtls_mps_writer *wr,
+                               mbedtls_mps_size_t *olen,
+                               mbedtls_mps_size_t *queued,
+                               int force)
+{
+    unsigned char *out, *queue;
+    mbedtls_mps_size_t commit, out_len, queue_start;
+    mbedtls_mps_size_t written, queue_remaining, copy_from_queue;
+    MBEDTLS_MPS_TRACE_INIT("mbedtls_mps_writer_reclaim");
+
+    if (olen != NULL) {
+        *olen = 0;
+    }
+    if (queued != NULL) {
+        *queued = 0;
+    }
+
+    MBEDTLS_MPS_STATE_VALIDATE_RAW(mps_writer_is_consuming(
+                                       wr),
+                                   "mbedtls_mps_writer_reclaim() requires writer to be in consuming mode");
+
+    out         = wr->out;
+    out_len     = wr->out_len;
+    commit      = wr->commit;
+    queue_start = wr->queue_start;
+
+    /* Discard uncommitted data. */
+    wr->end = commit;
+
+    if (wr->state == MBEDTLS_MPS_WRITER_QUEUEING && commit <= queue_start) {
+        MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                          "No committed data in the queue.");
+        wr->state = MBEDTLS_MPS_WRITER_CONSUMING;
+    }
+
+    if (wr->state == MBEDTLS_MPS_WRITER_CONSUMING) {
+        if (!force && commit < out_len) {
+            MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                              "There is space left in the output buffer.");
+            MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_DATA_LEFT);
+        }
+
+        written = commit;
+        queue_remaining = 0;
+        copy_from_queue = 0;
+    } else {
+        mbedtls_mps_size_t queued_len;
+
+        queued_len = commit - queue_start;
+
+        /* Fill what is left of the output buffer from the queue. */
+        copy_from_queue = out_len - queue_start;
+        if (copy_from_queue > queued_len) {
+            copy_from_queue = queued_len;
+        }
+
+        queue = wr->queue;
+        memcpy(out + queue_start, queue, copy_from_queue);
+
+        written = queue_start + copy_from_queue;
+        queue_remaining = queued_len - copy_from_queue;
+
+        MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                          "Copied %u of %u queued bytes to the output buffer",
+                          (unsigned) copy_from_queue, (unsigned) queued_len);
+
+        if (!force && written < out_len) {
+            /* The queue fitted in the output buffer after all: carry on
+             * writing to the output buffer. */
+            MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                              "There is space left in the output buffer.");
+            wr->commit = written;
+            wr->end = written;
+            wr->queue_start = 0;
+            wr->state = MBEDTLS_MPS_WRITER_CONSUMING;
+            MBEDTLS_MPS_TRACE_RETURN(MBEDTLS_ERR_MPS_WRITER_DATA_LEFT);
+        }
+    }
+
+    wr->out     = NULL;
+    wr->out_len = 0;
+
+    wr->commit      = 0;
+    wr->end         = 0;
+    wr->queue_start = 0;
+
+    wr->queue_next      = queue_remaining > 0 ? copy_from_queue : 0;
+    wr->queue_remaining = queue_remaining;
+    wr->state           = MBEDTLS_MPS_WRITER_PROVIDING;
+
+    if (olen != NULL) {
+        *olen = written;
+    }
+    if (queued != NULL) {
+        *queued = queue_remaining;
+    }
+
+    MBEDTLS_MPS_TRACE(MBEDTLS_MPS_TRACE_TYPE_COMMENT,
+                      "Final state: written %u, queued %u",
+                      (unsigned) written, (unsigned) queue_remaining);
+    MBEDTLS_MPS_TRACE_RETURN(0);
+}
+
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
@@ -0,0 +1,375 @@
+/*
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+/**
+ * \file mps_writer.h
+ *
+ * \brief This file defines writer objects, which together with their
+ *        sibling reader objects form the basis for the communication
+ *        between the various layers of the Mbed TLS messaging stack,
+ *        as well as the communication between the messaging stack and
+ *        the (D)TLS handshake protocol implementation.
+ *
+ * Writers provide a means of transferring outgoing data from
+ * a 'consumer' writing it in chunks of arbitrary size, to
+ * a 'provider' which supplies output buffers of again arbitrary,
+ * and potentially different, size, typically the plaintext area
+ * of the next outgoing record.
+ *
+ * Writers can thus be seen as stream-to-datagram converters,
+ * and they abstract away the following two tasks from the user:
+ * 1. The pointer arithmetic of stepping through a provider-
+ *    supplied buffer in smaller chunks.
+ * 2. The splitting of outgoing data across several output buffers
+ *    in case the consumer writes a chunk which is larger than what
+ *    is left in the current output buffer. This is done through an
+ *    optional 'queue' buffer, whose contents are flushed into the
+ *    output buffers supplied next.
+ *
+ * The basic abstract flow of operation is the following:
+ * - Initially, the writer is in 'providing mode'.
+ * - The provider hands an output buffer to the writer, moving it
+ *   from 'providing' to 'consuming' mode.
+ * - The consumer subsequently requests space in the buffer and writes
+ *   to it, and marks what it has written as final through
+ *   mbedtls_mps_writer_commit(). Once the buffer is full, or the
+ *   consumer has nothing more to write, the provider revokes the
+ *   writer's access to the buffer, putting the writer back to
+ *   providing mode, and dispatches the committed data.
+ * - If the consumer wrote to the queue because the output buffer had
+ *   not enough space left, the data which did not fit in the output
+ *   buffer remains queued in the writer, and is copied to the front
+ *   of the output buffers fed next.
+ * - Repeat the above.
+ *
+ * The abstract states of the writer from the provider's and
+ * consumer's perspective are as follows:
+ *
+ * - From the perspective of the consumer, the state of the
+ *   writer consists of the following:
+ *   - A byte stream representing (concatenation of) the data
+ *     written to the buffers obtained through mbedtls_mps_writer_get(),
+ *   - A marker within that byte stream indicating which data
+ *     is final and will be dispatched when the writer is passed back
+ *     to the provider via mbedtls_mps_writer_reclaim(). The marker is
+ *     set via mbedtls_mps_writer_commit(), which places it at the end
+ *     of the current byte stream. Data past the marker is discarded on
+ *     reclaim.
+ *
+ * - From the perspective of the provider, the writer's state is one of:
+ *   - Attached: The writer is in consuming mode.
+ *   - Unset:    No output buffer is currently managed by the writer,
+ *               and all data written so far has been dispatched.
+ *   - Queuing:  No output buffer is currently managed by the writer,
+ *               but some committed data is still held in the queue
+ *               and needs to be flushed into output buffers fed
+ *               via mbedtls_mps_writer_feed().
+ *   The Attached state belongs to consuming mode, while the Unset and
+ *   Queuing states belong to providing mode.
+ *
+ * The following diagram depicts the provider-state progression:
+ *
+ *        +------------------+             reclaim
+ *        |      Unset       +<-------------------------------------+       get
+ *        +--------|---------+                                      |   +------+
+ *                 |                                                |   |      |
+ *                 |                                                |   |      |
+ *                 |                feed                  +---------+---+--+   |
+ *                 +-------------------------------------->                <---+
+ *                                                        |    Attached    |
+ *                 +-------------------------------------->                <---+
+ *                 |     feed, queue fully flushed        +---------+---+--+   |
+ *                 |                                                |   |      |
+ *                 |                                                |   |      |
+ *        +--------+---------+                                      |   +------+
+ *   +---->     Queuing      |<-------------------------------------+    commit
+ *   |    +---+--------------+      reclaim, committed data didn't
+ *   |        |                      fit into the output buffer
+ *   |        |
+ *   +--------+
+ *     feed, buffer filled before
+ *     the queue is flushed
+ *                                         |
+ *                                         |
+ *               providing mode            |           consuming mode
+ *                                         |
+ *
+ */
+
+#ifndef MBEDTLS_WRITER_H
+#define MBEDTLS_WRITER_H
+
+#include <stdio.h>
+
+#include "mps_common.h"
+#include "mps_error.h"
+
+struct mbedtls_mps_writer;
+typedef struct mbedtls_mps_writer mbedtls_mps_writer;
+
+/*
+ * Structure definitions
+ */
+
+#define MBEDTLS_MPS_WRITER_PROVIDING   0 /*!< No output buffer attached.    */
+#define MBEDTLS_MPS_WRITER_CONSUMING   1 /*!< Writing to the output buffer. */
+#define MBEDTLS_MPS_WRITER_QUEUEING    2 /*!< Writing to the queue after the
+                                          *   output buffer ran out of space. */
+
+struct mbedtls_mps_writer {
+    unsigned char *out;   /*!< The output buffer managed by the writer;
+                           *   it is provided to the writer through
+                           *   mbedtls_mps_writer_feed(). The writer does
+                           *   not own the buffer and does not perform any
+                           *   allocation operations on it, but does have
+                           *   write access to it.
+                           *
+                           *   The writer is in consuming mode if
+                           *   and only if \c out is not \c NULL.           */
+    mbedtls_mps_stored_size_t out_len;
+    /*!< The length of the output buffer.
+     *   Must be 0 if \c out == \c NULL.              */
+    mbedtls_mps_stored_size_t commit;
+    /*!< The offset of the last commit, relative
+     *   to the first byte in the output buffer. If
+     *   the queue is in use, it is viewed as a
+     *   continuation of the output buffer starting
+     *   at offset \c queue_start.
+     *
+     *   This is only used when the writer is in
+     *   consuming mode; otherwise, its value is \c 0. */
+    mbedtls_mps_stored_size_t end;
+    /*!< The offset of the end of the last chunk
+     *   passed to the user through a call to
+     *   mbedtls_mps_writer_get(), in the same units
+     *   as \c commit.
+     *
+     *   This is only used when the writer is in
+     *   consuming mode; otherwise, its value is \c 0. */
+
+    /* The queue is only needed if the user may request more space than
+     * what is left in the output buffer, and if this must not fail. */
+
+    unsigned char *queue; /*!< The queue is used to serve write requests
+                           *   via mbedtls_mps_writer_get() which cannot be
+                           *   served from the current output buffer.      */
+    mbedtls_mps_stored_size_t queue_len;
+    /*!< The total size of the queue.                 */
+    mbedtls_mps_stored_size_t queue_start;
+    /*!< The offset in the output buffer at which the
+     *   queue starts, if the queue is in use. It is
+     *   only used in consuming mode.                 */
+    mbedtls_mps_stored_size_t queue_next;
+    /*!< The offset in the queue of the next byte to
+     *   flush to the next output buffer. It is only
+     *   used in providing mode.                      */
+    mbedtls_mps_stored_size_t queue_remaining;
+    /*!< The amount of queued data still to be flushed.
+     *   It is only used in providing mode, and the
+     *   writer is in the Queuing state if and only if
+     *   it is not \c 0.                              */
+    unsigned char state;
+    /*!< One of the MBEDTLS_MPS_WRITER_XXX states.    */
+};
+
+/*
+ * API organization:
+ * A writer object is usually prepared and maintained
+ * by some lower layer and passed for usage to an upper
+ * layer, and the API naturally splits according to which
+ * layer is supposed to use the respective functions.
+ */
+
+/*
+ * Maintenance API (Lower layer)
+ */
+
+/**
+ * \brief           Initialize a writer object
+ *
+ * \param writer    The writer to be initialized.
+ * \param queue     The buffer to be used as a queue in case write requests
+ *                  through mbedtls_mps_writer_get() exceed the space left
+ *                  in the buffer provided by mbedtls_mps_writer_feed(),
+ *                  or \c NULL if no queue should be used.
+ *                  This buffer is owned by the caller and exclusive use
+ *                  for reading and writing is given to the writer for the
+ *                  duration of the writer's lifetime. It is thus the caller's
+ *                  responsibility to maintain (and not touch) the buffer for
+ *                  the lifetime of the writer, and to properly zeroize and
+ *                  free the memory after the writer has been destroyed.
+ * \param queue_len The size in Bytes of \p queue.
+ *
+ * \return          \c 0 on success.
+ * \return          A negative \c MBEDTLS_ERR_WRITER_XXX error code on failure.
+ */
+int mbedtls_mps_writer_init(mbedtls_mps_writer *writer,
+                            unsigned char *queue,
+                            mbedtls_mps_size_t queue_len);
+
+/**
+ * \brief           Free a writer object
+ *
+ * \param writer    The writer to be freed.
+ *
+ * \return          \c 0 on success.
+ * \return          A negative \c MBEDTLS_ERR_WRITER_XXX error code on failure.
+ */
+int mbedtls_mps_writer_free(mbedtls_mps_writer *writer);
+
+/**
+ * \brief           Pass an output buffer for the writer to manage.
+ *
+ * \param writer    The writer context to use. The writer must be
+ *                  in providing mode.
+ * \param buf       The buffer to be managed by the writer.
+ * \param buflen    The size in Bytes of \p buf.
+ *
+ * \return          \c 0 on success. In this case, the writer will be
+ *                  moved to consuming mode and obtains write access
+ *                  of \p buf until mbedtls_mps_writer_reclaim()
+ *                  is called. Any data still queued from a previous
+ *                  output buffer has been copied to the beginning
+ *                  of \p buf, and is reported as written by
+ *                  mbedtls_mps_writer_bytes_written().
+ * \return          #MBEDTLS_ERR_MPS_WRITER_NEED_MORE if \p buf has been
+ *                  filled entirely with queued data, and more output
+ *                  buffers are needed to flush the rest of the queue.
+ *                  In this case, the writer remains in providing mode
+ *                  and takes no ownership of \p buf, and the caller
+ *                  should dispatch its \p buflen Bytes before feeding
+ *                  the next buffer.
+ * \return          Another negative \c MBEDTLS_ERR_WRITER_XXX error code on
+ *                  different kinds of failures.
+ */
+int mbedtls_mps_writer_feed(mbedtls_mps_writer *writer,
+                            unsigned char *buf,
+                            mbedtls_mps_size_t buflen);
+
+/**
+ * \brief           Reclaim writer's access to the current output buffer.
+ *
+ *                  Data that has been obtained through
+ *                  mbedtls_mps_writer_get() but not committed is discarded.
+ *
+ * \param writer    The writer context to use. The writer must be
+ *                  in consuming mode.
+ * \param olen      If not \c NULL, the address at which to store the
+ *                  number of committed Bytes at the beginning of the output
+ *                  buffer, which the caller should dispatch.
+ * \param queued    If not \c NULL, the address at which to store the
+ *                  number of committed Bytes which did not fit in the
+ *                  output buffer and remain queued in the writer.
+ * \param force     Indicates whether the output buffer should be
+ *                  reclaimed even if there is space left in it.
+ *
+ * \return          \c 0 on success. In this case, the writer is in
+ *                  providing mode.
+ * \return          #MBEDTLS_ERR_MPS_WRITER_DATA_LEFT if \p force is \c 0
+ *                  and there is space left in the output buffer. In this
+ *                  case, the writer remains in consuming mode, with the
+ *                  uncommitted data discarded.
+ * \return          Another negative \c MBEDTLS_ERR_WRITER_XXX error code on
+ *                  different kinds of failures.
+ */
+int mbedtls_mps_writer_reclaim(mbedtls_mps_writer *writer,
+                               mbedtls_mps_size_t *olen,
+                               mbedtls_mps_size_t *queued,
+                               int force);
+
+/**
+ * \brief           Get the number of Bytes committed since the current
+ *                  output buffer was fed, including data flushed to it from
+ *                  the queue and data committed to the queue.
+ *
+ * \param writer    The writer context to use. The writer must be
+ *                  in consuming mode.
+ * \param written   The address at which to store the number of Bytes.
+ *
+ * \return          \c 0 on success.
+ * \return          A negative \c MBEDTLS_ERR_WRITER_XXX error code on failure.
+ */
+int mbedtls_mps_writer_bytes_written(mbedtls_mps_writer const *writer,
+                                     mbedtls_mps_size_t *written);
+
+/*
+ * Usage API (Upper layer)
+ */
+
+/**
+ * \brief           Request buffer space for writing.
+ *
+ * \param writer    The writer context to use. The writer must
+ *                  be in consuming mode.
+ * \param desired   The desired amount of space, in Bytes.
+ * \param buffer    The address to store the buffer pointer in.
+ *                  This must not be \c NULL.
+ * \param buflen    The address to store the actual buffer
+ *                  length in, or \c NULL.
+ *
+ * \return          \c 0 on success. In this case, \c *buf holds the
+ *                  address of a buffer of size \c *buflen
+ *                  (if \c buflen != \c NULL) or \c desired
+ *                  (if \c buflen == \c NULL). The user has write access
+ *                  to the buffer until the next call to
+ *                  mbedtls_mps_writer_commit(),
+ *                  mbedtls_mps_writer_commit_partial() or
+ *                  mbedtls_mps_writer_reclaim().
+ * \return          #MBEDTLS_ERR_MPS_WRITER_OUT_OF_DATA if there is not enough
+ *                  space available to serve the get request. In this case,
+ *                  the writer remains intact and in consuming mode, and the
+ *                  consumer should retry the call after a successful cycle
+ *                  of mbedtls_mps_writer_reclaim() and
+ *                  mbedtls_mps_writer_feed().
+ * \return          Another negative \c MBEDTLS_ERR_WRITER_XXX error
+ *                  code for different kinds of failure.
+ *
+ * \note            If \p buflen is not \c NULL and the output buffer has
+ *                  some space left, but not \p desired Bytes, the request
+ *                  is served with the remaining space of the output buffer
+ *                  rather than from the queue. Passing \c NULL as \p buflen
+ *                  is thus the way to write a chunk which must be
+ *                  contiguous, such as a handshake message header.
+ */
+int mbedtls_mps_writer_get(mbedtls_mps_writer *writer,
+                           mbedtls_mps_size_t desired,
+                           unsigned char **buffer,
+                           mbedtls_mps_size_t *buflen);
+
+/**
+ * \brief         Mark data obtained from mbedtls_mps_writer_get() as final.
+ *
+ *                This call indicates that all data written to the buffers
+ *                received from prior calls to mbedtls_mps_writer_get()
+ *                is ready to be dispatched.
+ *
+ * \param writer  The writer context to use.
+ *
+ * \return        \c 0 on success.
+ * \return        A negative \c MBEDTLS_ERR_WRITER_XXX error code on failure.
+ */
+int mbedtls_mps_writer_commit(mbedtls_mps_writer *writer);
+
+/**
+ * \brief         Mark all but the last \p omit Bytes of the data obtained
+ *                from mbedtls_mps_writer_get() as final.
+ *
+ *                This is useful when the user has requested the maximum
+ *                amount of space it could need, and has written less.
+ *
+ * \param writer  The writer context to use.
+ * \param omit    The number of Bytes at the end of the data obtained
+ *                since the last commit which should not be committed.
+ *
+ * \return        \c 0 on success.
+ * \return        #MBEDTLS_ERR_MPS_WRITER_TOO_MUCH_OMITTED if \p omit is
+ *                larger than the data obtained since the last commit.
+ * \return        Another negative \c MBEDTLS_ERR_WRITER_XXX error
+ *                code for different kinds of failure.
+ */
+int mbedtls_mps_writer_commit_partial(mbedtls_mps_writer *writer,
+                                      mbedtls_mps_size_t omit);
+
+#endif /* MBEDTLS_WRITER_H */
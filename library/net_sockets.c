@@ -14,6 +14,11 @@
 #ifndef _XOPEN_SOURCE
 #define _XOPEN_SOURCE 600 /* sockaddr_storage */
 #endif
+/* syscall(), for io_uring which has no C library wrapper, and recvmmsg()
+ * and sendmmsg() */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
 
 #include "ssl_misc.h"
 
@@ -29,14 +34,14 @@
 
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "fnv_internal.h"
 
 #include <string.h>
 
 #if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
     !defined(EFI32)
 
-#define IS_EINTR(ret) ((ret) == WSAEINTR)
-
 #include <ws2tcpip.h>
 
 #include <winsock2.h>
@@ -64,6 +69,7 @@ static int wsa_init_done = 0;
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -71,12 +77,77 @@ static int wsa_init_done = 0;
 #include <fcntl.h>
 #include <netdb.h>
 #include <errno.h>
+#include <poll.h>
 
-#define IS_EINTR(ret) ((ret) == EINTR)
 #define SOCKET int
 
 #endif /* ( _WIN32 || _WIN32_WCE ) && !EFIX64 && !EFI32 */
 
+#if defined(MBEDTLS_NET_REACTOR)
+#if defined(__linux__)
+#include <sys/epoll.h>
+#define NET_REACTOR_EPOLL
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__NetBSD__) || \
+    defined(__OpenBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#define NET_REACTOR_KQUEUE
+#else
+#error "MBEDTLS_NET_REACTOR needs epoll (Linux) or kqueue (BSD, OS X)"
+#endif
+#endif /* MBEDTLS_NET_REACTOR */
+
+#if defined(MBEDTLS_NET_IO_URING)
+#if !defined(__linux__)
+#error "MBEDTLS_NET_IO_URING needs Linux"
+#endif
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#define NET_URING_OP_IDLE       0
+#define NET_URING_OP_PENDING    1
+#define NET_URING_OP_DONE       2
+#endif /* MBEDTLS_NET_IO_URING */
+
+#if defined(MBEDTLS_NET_DGRAM_DEMUX)
+#if defined(_WIN32)
+#error "MBEDTLS_NET_DGRAM_DEMUX is not supported on Windows"
+#endif
+#if defined(__linux__)
+#include <netinet/udp.h>
+#include <sys/uio.h>
+#include <linux/filter.h>
+
+#if !defined(SOL_UDP)
+#define SOL_UDP         17
+#endif
+#if !defined(UDP_SEGMENT)
+#define UDP_SEGMENT     103     /* Linux 4.18 */
+#endif
+#if !defined(SO_ATTACH_REUSEPORT_CBPF)
+#define SO_ATTACH_REUSEPORT_CBPF 51     /* Linux 4.5 */
+#endif
+
+#define NET_DGRAM_MMSG
+#endif /* __linux__ */
+#endif /* MBEDTLS_NET_DGRAM_DEMUX */
+
+#if defined(MBEDTLS_SSL_KTLS) && defined(__linux__)
+#include <linux/tls.h>
+#include <sys/sendfile.h>
+
+#define NET_KTLS_SUPPORTED
+
+/* Older C libraries lack these definitions */
+#if !defined(TCP_ULP)
+#define TCP_ULP 31
+#endif
+#if !defined(SOL_TLS)
+#define SOL_TLS 282
+#endif
+#endif /* MBEDTLS_SSL_KTLS && __linux__ */
+
 /* Some MS functions want int and MSVC warns if we pass size_t,
  * but the standard functions use socklen_t, so cast only for MSVC */
 #if defined(_MSC_VER)
@@ -89,8 +160,10 @@ static int wsa_init_done = 0;
 
 #if defined(MBEDTLS_HAVE_TIME)
 #include <time.h>
+#include "mbedtls/platform_time.h"
 #endif
 
+#include <limits.h>
 #include <stdint.h>
 
 /*
@@ -119,29 +192,109 @@ static int net_prepare(void)
 
 /*
  * Return 0 if the file descriptor is valid, an error otherwise.
- * If for_select != 0, check whether the file descriptor is within the range
- * allowed for fd_set used for the FD_xxx macros and the select() function.
  */
-static int check_fd(int fd, int for_select)
+static int check_fd(int fd)
 {
     if (fd < 0) {
         return MBEDTLS_ERR_NET_INVALID_CONTEXT;
     }
 
+    return 0;
+}
+
+/*
+ * Wait for fd to be ready for the MBEDTLS_NET_POLL_xxx events in rw, for at
+ * most timeout ms, or potentially indefinitely if timeout is -1u.
+ *
+ * Return the ready events, MBEDTLS_ERR_SSL_WANT_READ if interrupted by a
+ * signal, or MBEDTLS_ERR_NET_POLL_FAILED.
+ *
+ * Unix-like platforms use poll(), which unlike select() has no limit on the
+ * value of the file descriptor. Windows sockets are not bound by
+ * FD_SETSIZE either, since fd_set is a list of handles there.
+ */
+static int net_wait(int fd, uint32_t rw, uint32_t timeout)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 #if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
     !defined(EFI32)
-    (void) for_select;
+    struct timeval tv;
+    fd_set read_fds;
+    fd_set write_fds;
+
+    FD_ZERO(&read_fds);
+    if (rw & MBEDTLS_NET_POLL_READ) {
+        FD_SET((SOCKET) fd, &read_fds);
+    }
+
+    FD_ZERO(&write_fds);
+    if (rw & MBEDTLS_NET_POLL_WRITE) {
+        FD_SET((SOCKET) fd, &write_fds);
+    }
+
+    tv.tv_sec  = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    ret = select(fd + 1, &read_fds, &write_fds, NULL,
+                 timeout == (uint32_t) -1 ? NULL : &tv);
+    if (ret < 0) {
+        return WSAGetLastError() == WSAEINTR ?
+               MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    ret = 0;
+    if (FD_ISSET(fd, &read_fds)) {
+        ret |= MBEDTLS_NET_POLL_READ;
+    }
+    if (FD_ISSET(fd, &write_fds)) {
+        ret |= MBEDTLS_NET_POLL_WRITE;
+    }
 #else
-    /* A limitation of select() is that it only works with file descriptors
-     * that are strictly less than FD_SETSIZE. This is a limitation of the
-     * fd_set type. Error out early, because attempting to call FD_SET on a
-     * large file descriptor is a buffer overflow on typical platforms. */
-    if (for_select && fd >= FD_SETSIZE) {
+    struct pollfd pfd;
+    int timeout_ms;
+
+    pfd.fd = fd;
+    pfd.events = 0;
+    pfd.revents = 0;
+    if (rw & MBEDTLS_NET_POLL_READ) {
+        pfd.events |= POLLIN;
+    }
+    if (rw & MBEDTLS_NET_POLL_WRITE) {
+        pfd.events |= POLLOUT;
+    }
+
+    if (timeout == (uint32_t) -1) {
+        timeout_ms = -1;
+    } else if (timeout > INT_MAX) {
+        timeout_ms = INT_MAX;
+    } else {
+        timeout_ms = (int) timeout;
+    }
+
+    ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0) {
+        return errno == EINTR ?
+               MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    if (pfd.revents & POLLNVAL) {
         return MBEDTLS_ERR_NET_POLL_FAILED;
     }
+
+    /* Like select(), report errors and hangups as readiness, so that the
+     * next read or write returns the actual condition. */
+    ret = 0;
+    if ((rw & MBEDTLS_NET_POLL_READ) &&
+        (pfd.revents & (POLLIN | POLLHUP | POLLERR))) {
+        ret |= MBEDTLS_NET_POLL_READ;
+    }
+    if ((rw & MBEDTLS_NET_POLL_WRITE) &&
+        (pfd.revents & (POLLOUT | POLLHUP | POLLERR))) {
+        ret |= MBEDTLS_NET_POLL_WRITE;
+    }
 #endif
 
-    return 0;
+    return ret;
 }
 
 /*
@@ -153,10 +306,11 @@ void mbedtls_net_init(mbedtls_net_context *ctx)
 }
 
 /*
- * Initiate a TCP connection with host:port and the given protocol
+ * Initiate a TCP connection with host:port and the given protocol, leaving
+ * the handshake to the first send with TCP Fast Open if asked to
  */
-int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
-                        const char *port, int proto)
+static int net_connect(mbedtls_net_context *ctx, const char *host,
+                       const char *port, int proto, int fastopen)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     struct addrinfo hints, *addr_list, *cur;
@@ -185,6 +339,18 @@ int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
             continue;
         }
 
+#if defined(TCP_FASTOPEN_CONNECT)
+        /* connect() then returns at once, and the SYN goes out with the
+         * data of the first send. Without it, this is a plain connect. */
+        if (fastopen && proto == MBEDTLS_NET_PROTO_TCP) {
+            int one = 1;
+            (void) setsockopt(ctx->fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+                              (const char *) &one, sizeof(one));
+        }
+#else
+        (void) fastopen;
+#endif
+
         if (connect(ctx->fd, cur->ai_addr, MSVC_INT_CAST cur->ai_addrlen) == 0) {
             ret = 0;
             break;
@@ -199,10 +365,291 @@ int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
     return ret;
 }
 
+int mbedtls_net_connect(mbedtls_net_context *ctx, const char *host,
+                        const char *port, int proto)
+{
+    return net_connect(ctx, host, port, proto, 0);
+}
+
+int mbedtls_net_connect_fastopen(mbedtls_net_context *ctx, const char *host,
+                                 const char *port)
+{
+    return net_connect(ctx, host, port, MBEDTLS_NET_PROTO_TCP, 1);
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+#define NET_CONNECT_MAX_ATTEMPTS 16
+
 /*
- * Create a listening socket on bind_ip:port
+ * Start a non-blocking connection attempt to one address. Return 0 if it is
+ * already connected, 1 if it is in progress, or an error code.
  */
-int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *port, int proto)
+static int net_connect_start(const struct addrinfo *addr, int *fd)
+{
+    mbedtls_net_context attempt;
+
+    attempt.fd = (int) socket(addr->ai_family, addr->ai_socktype,
+                              addr->ai_protocol);
+    if (attempt.fd < 0) {
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    if (mbedtls_net_set_nonblock(&attempt) != 0) {
+        mbedtls_net_close(&attempt);
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+
+    *fd = attempt.fd;
+    if (connect(attempt.fd, addr->ai_addr, MSVC_INT_CAST addr->ai_addrlen) == 0) {
+        return 0;
+    }
+#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
+    !defined(EFI32)
+    if (WSAGetLastError() == WSAEWOULDBLOCK) {
+        return 1;
+    }
+#else
+    if (errno == EINPROGRESS) {
+        return 1;
+    }
+#endif
+
+    *fd = -1;
+    mbedtls_net_close(&attempt);
+    return MBEDTLS_ERR_NET_CONNECT_FAILED;
+}
+
+/*
+ * Wait up to timeout ms for one of the connection attempts in progress,
+ * the non-negative entries of fds, to complete. Return the index of one
+ * that did, -1 if none did, or MBEDTLS_ERR_NET_POLL_FAILED.
+ */
+static int net_connect_wait(const int *fds, size_t n, uint32_t timeout)
+{
+    size_t i;
+    int ret;
+#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
+    !defined(EFI32)
+    struct timeval tv;
+    fd_set write_fds;
+    fd_set except_fds;
+
+    /* A failed connection is reported in the exception set */
+    FD_ZERO(&write_fds);
+    FD_ZERO(&except_fds);
+    for (i = 0; i < n; i++) {
+        if (fds[i] >= 0) {
+            FD_SET((SOCKET) fds[i], &write_fds);
+            FD_SET((SOCKET) fds[i], &except_fds);
+        }
+    }
+
+    tv.tv_sec  = timeout / 1000;
+    tv.tv_usec = (timeout % 1000) * 1000;
+
+    ret = select(0, NULL, &write_fds, &except_fds,
+                 timeout == (uint32_t) -1 ? NULL : &tv);
+    if (ret < 0) {
+        return WSAGetLastError() == WSAEINTR ? -1 : MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    for (i = 0; ret > 0 && i < n; i++) {
+        if (fds[i] >= 0 && (FD_ISSET((SOCKET) fds[i], &write_fds) ||
+                            FD_ISSET((SOCKET) fds[i], &except_fds))) {
+            return (int) i;
+        }
+    }
+#else
+    struct pollfd pfd[NET_CONNECT_MAX_ATTEMPTS];
+
+    /* poll() skips negative descriptors */
+    for (i = 0; i < n; i++) {
+        pfd[i].fd = fds[i];
+        pfd[i].events = POLLOUT;
+        pfd[i].revents = 0;
+    }
+
+    ret = poll(pfd, (nfds_t) n,
+               timeout == (uint32_t) -1 ? -1 :
+               timeout > INT_MAX ? INT_MAX : (int) timeout);
+    if (ret < 0) {
+        return errno == EINTR ? -1 : MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    for (i = 0; ret > 0 && i < n; i++) {
+        if (pfd[i].revents & POLLNVAL) {
+            return MBEDTLS_ERR_NET_POLL_FAILED;
+        }
+        if (pfd[i].revents & (POLLOUT | POLLERR | POLLHUP)) {
+            return (int) i;
+        }
+    }
+#endif
+
+    return -1;
+}
+
+/*
+ * Connect with staggered parallel attempts to the addresses of host
+ * (Happy Eyeballs, RFC 8305)
+ */
+int mbedtls_net_connect_timeout(mbedtls_net_context *ctx, const char *host,
+                                const char *port, int proto,
+                                uint32_t attempt_delay, uint32_t timeout)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct addrinfo hints, *addr_list, *a, *b;
+    const struct addrinfo *cand[NET_CONNECT_MAX_ATTEMPTS];
+    int fds[NET_CONNECT_MAX_ATTEMPTS];
+    size_t n = 0, started = 0, pending = 0, i;
+    mbedtls_ms_time_t start, now, next_attempt;
+    int winner = -1;
+    int family;
+
+    /* Connecting a UDP socket does not involve the peer */
+    if (proto == MBEDTLS_NET_PROTO_UDP) {
+        return mbedtls_net_connect(ctx, host, port, proto);
+    }
+
+    if (attempt_delay == 0) {
+        attempt_delay = MBEDTLS_NET_CONNECT_ATTEMPT_DELAY;
+    }
+
+    if ((ret = net_prepare()) != 0) {
+        return ret;
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+
+    if (getaddrinfo(host, port, &hints, &addr_list) != 0) {
+        return MBEDTLS_ERR_NET_UNKNOWN_HOST;
+    }
+
+    /* Alternate between address families, starting with the one that
+     * getaddrinfo() prefers */
+    family = addr_list->ai_family;
+    a = b = addr_list;
+    while (n < NET_CONNECT_MAX_ATTEMPTS && (a != NULL || b != NULL)) {
+        while (a != NULL && a->ai_family != family) {
+            a = a->ai_next;
+        }
+        if (a != NULL) {
+            cand[n++] = a;
+            a = a->ai_next;
+        }
+        while (b != NULL && b->ai_family == family) {
+            b = b->ai_next;
+        }
+        if (b != NULL && n < NET_CONNECT_MAX_ATTEMPTS) {
+            cand[n++] = b;
+            b = b->ai_next;
+        }
+    }
+
+    ret = MBEDTLS_ERR_NET_CONNECT_FAILED;
+    start = mbedtls_ms_time();
+    next_attempt = start;
+    for (;;) {
+        uint32_t wait = (uint32_t) -1;
+        int r;
+
+        now = mbedtls_ms_time();
+        if (timeout != 0 && now - start >= (mbedtls_ms_time_t) timeout) {
+            ret = MBEDTLS_ERR_SSL_TIMEOUT;
+            break;
+        }
+
+        /* The next attempt starts after a delay, or as soon as nothing is
+         * in progress any more */
+        if (started < n && (pending == 0 || now >= next_attempt)) {
+            fds[started] = -1;
+            r = net_connect_start(cand[started], &fds[started]);
+            started++;
+            if (r == 0) {
+                winner = (int) started - 1;
+                break;
+            }
+            if (r == 1) {
+                pending++;
+                next_attempt = now + attempt_delay;
+            } else {
+                ret = r;
+            }
+            continue;
+        }
+        if (pending == 0) {
+            break;
+        }
+
+        if (timeout != 0) {
+            wait = (uint32_t) (start + timeout - now);
+        }
+        if (started < n && (uint32_t) (next_attempt - now) < wait) {
+            wait = (uint32_t) (next_attempt - now);
+        }
+
+        r = net_connect_wait(fds, started, wait);
+        if (r < -1) {
+            ret = r;
+            break;
+        }
+        if (r >= 0) {
+            int err = 0;
+#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
+            !defined(EFI32)
+            int err_len = (int) sizeof(err);
+#else
+            socklen_t err_len = (socklen_t) sizeof(err);
+#endif
+
+            if (getsockopt(fds[r], SOL_SOCKET, SO_ERROR,
+                           (char *) &err, &err_len) == 0 && err == 0) {
+                winner = r;
+                break;
+            }
+
+            /* This one failed, start the next one right away */
+            close(fds[r]);
+            fds[r] = -1;
+            pending--;
+            next_attempt = now;
+            ret = MBEDTLS_ERR_NET_CONNECT_FAILED;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        if ((int) i != winner && fds[i] >= 0) {
+            close(fds[i]);
+        }
+    }
+
+    if (winner >= 0) {
+        /* Hand out a blocking socket, like mbedtls_net_connect() */
+        ctx->fd = fds[winner];
+        ret = 0;
+        if (mbedtls_net_set_block(ctx) != 0) {
+            mbedtls_net_close(ctx);
+            ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+        }
+    }
+
+    freeaddrinfo(addr_list);
+
+    return ret;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+/* Options of net_bind() */
+#define NET_BIND_REUSEPORT  1   /* share the port with SO_REUSEPORT    */
+#define NET_BIND_FASTOPEN   2   /* accept data in the SYN (TCP only)   */
+
+/*
+ * Create a listening socket on bind_ip:port with the given options
+ */
+static int net_bind(mbedtls_net_context *ctx, const char *bind_ip,
+                    const char *port, int proto, int flags)
 {
     int n, ret;
     struct addrinfo hints, *addr_list, *cur;
@@ -242,6 +689,16 @@ int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *
             continue;
         }
 
+#if defined(SO_REUSEPORT)
+        if ((flags & NET_BIND_REUSEPORT) &&
+            setsockopt(ctx->fd, SOL_SOCKET, SO_REUSEPORT,
+                       (const char *) &n, sizeof(n)) != 0) {
+            mbedtls_net_close(ctx);
+            ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+            continue;
+        }
+#endif
+
         if (bind(ctx->fd, cur->ai_addr, MSVC_INT_CAST cur->ai_addrlen) != 0) {
             mbedtls_net_close(ctx);
             ret = MBEDTLS_ERR_NET_BIND_FAILED;
@@ -250,6 +707,15 @@ int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *
 
         /* Listen only makes sense for TCP */
         if (proto == MBEDTLS_NET_PROTO_TCP) {
+#if defined(TCP_FASTOPEN)
+            /* Fast Open is an optimization, carry on without it if the
+             * system does not allow it */
+            if (flags & NET_BIND_FASTOPEN) {
+                n = MBEDTLS_NET_LISTEN_BACKLOG;
+                (void) setsockopt(ctx->fd, IPPROTO_TCP, TCP_FASTOPEN,
+                                  (const char *) &n, sizeof(n));
+            }
+#endif
             if (listen(ctx->fd, MBEDTLS_NET_LISTEN_BACKLOG) != 0) {
                 mbedtls_net_close(ctx);
                 ret = MBEDTLS_ERR_NET_LISTEN_FAILED;
@@ -268,43 +734,128 @@ int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *
 
 }
 
-#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
-    !defined(EFI32)
-/*
- * Check if the requested operation would be blocking on a non-blocking socket
- * and thus 'failed' with a negative return value.
- */
-static int net_would_block(const mbedtls_net_context *ctx)
+int mbedtls_net_bind(mbedtls_net_context *ctx, const char *bind_ip, const char *port, int proto)
 {
-    ((void) ctx);
-    return WSAGetLastError() == WSAEWOULDBLOCK;
+    return net_bind(ctx, bind_ip, port, proto, 0);
 }
-#else
+
+int mbedtls_net_bind_fastopen(mbedtls_net_context *ctx, const char *bind_ip,
+                              const char *port)
+{
+    return net_bind(ctx, bind_ip, port, MBEDTLS_NET_PROTO_TCP,
+                    NET_BIND_FASTOPEN);
+}
+
 /*
- * Check if the requested operation would be blocking on a non-blocking socket
- * and thus 'failed' with a negative return value.
- *
- * Note: on a blocking socket this function always returns 0!
+ * Create count sockets listening on the same bind_ip:port
  */
-static int net_would_block(const mbedtls_net_context *ctx)
+int mbedtls_net_bind_shards(mbedtls_net_context *shards, size_t count,
+                            const char *bind_ip, const char *port, int proto)
 {
-    int err = errno;
+#if defined(SO_REUSEPORT)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int one = 1;
+    struct sockaddr_storage addr;
+    socklen_t addr_len = sizeof(addr);
+    size_t i;
 
-    /*
-     * Never return 'WOULD BLOCK' on a blocking socket
-     */
-    if ((fcntl(ctx->fd, F_GETFL) & O_NONBLOCK) != O_NONBLOCK) {
-        errno = err;
-        return 0;
+    if (shards == NULL || count == 0) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
     }
 
-    switch (errno = err) {
-#if defined EAGAIN
-        case EAGAIN:
-#endif
-#if defined EWOULDBLOCK && EWOULDBLOCK != EAGAIN
-        case EWOULDBLOCK:
-#endif
+    for (i = 0; i < count; i++) {
+        shards[i].fd = -1;
+    }
+
+    /* The first shard resolves the address, the others bind to whatever it
+     * got, so that a port of "0" gives the same port to all of them. */
+    ret = net_bind(&shards[0], bind_ip, port, proto, NET_BIND_REUSEPORT);
+    if (ret != 0) {
+        return ret;
+    }
+    if (getsockname(shards[0].fd, (struct sockaddr *) &addr, &addr_len) != 0) {
+        ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+        goto cleanup;
+    }
+
+    for (i = 1; i < count; i++) {
+        shards[i].fd = (int) socket(addr.ss_family,
+                                    proto == MBEDTLS_NET_PROTO_UDP ? SOCK_DGRAM : SOCK_STREAM,
+                                    proto == MBEDTLS_NET_PROTO_UDP ? IPPROTO_UDP : IPPROTO_TCP);
+        if (shards[i].fd < 0 ||
+            setsockopt(shards[i].fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            setsockopt(shards[i].fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+            ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+            goto cleanup;
+        }
+        if (bind(shards[i].fd, (struct sockaddr *) &addr, addr_len) != 0) {
+            ret = MBEDTLS_ERR_NET_BIND_FAILED;
+            goto cleanup;
+        }
+        if (proto == MBEDTLS_NET_PROTO_TCP &&
+            listen(shards[i].fd, MBEDTLS_NET_LISTEN_BACKLOG) != 0) {
+            ret = MBEDTLS_ERR_NET_LISTEN_FAILED;
+            goto cleanup;
+        }
+    }
+
+    return 0;
+
+cleanup:
+    for (i = 0; i < count; i++) {
+        mbedtls_net_close(&shards[i]);
+    }
+    return ret;
+#else
+    (void) bind_ip;
+    (void) port;
+    (void) proto;
+
+    if (shards == NULL || count == 0) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    return MBEDTLS_ERR_NET_SOCKET_FAILED;
+#endif /* SO_REUSEPORT */
+}
+
+#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
+    !defined(EFI32)
+/*
+ * Check if the requested operation would be blocking on a non-blocking socket
+ * and thus 'failed' with a negative return value.
+ */
+static int net_would_block(const mbedtls_net_context *ctx)
+{
+    ((void) ctx);
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+}
+#else
+/*
+ * Check if the requested operation would be blocking on a non-blocking socket
+ * and thus 'failed' with a negative return value.
+ *
+ * Note: on a blocking socket this function always returns 0!
+ */
+static int net_would_block(const mbedtls_net_context *ctx)
+{
+    int err = errno;
+
+    /*
+     * Never return 'WOULD BLOCK' on a blocking socket
+     */
+    if ((fcntl(ctx->fd, F_GETFL) & O_NONBLOCK) != O_NONBLOCK) {
+        errno = err;
+        return 0;
+    }
+
+    switch (errno = err) {
+#if defined EAGAIN
+        case EAGAIN:
+#endif
+#if defined EWOULDBLOCK && EWOULDBLOCK != EAGAIN
+        case EWOULDBLOCK:
+#endif
     return 1;
     }
     return 0;
@@ -421,6 +972,64 @@ int mbedtls_net_accept(mbedtls_net_context *bind_ctx,
     return 0;
 }
 
+/*
+ * Accept the pending connections of a TCP listening socket
+ */
+int mbedtls_net_accept_batch(mbedtls_net_context *bind_ctx,
+                             mbedtls_net_context *clients, size_t max)
+{
+    size_t n;
+    int fd;
+#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
+    !defined(EFI32)
+    /* No way to tell, and checking readiness is harmless */
+    int blocking = 1;
+#else
+    int blocking = (fcntl(bind_ctx->fd, F_GETFL) & O_NONBLOCK) != O_NONBLOCK;
+#endif
+
+    if (clients == NULL || max == 0 || max > INT_MAX) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    for (n = 0; n < max; n++) {
+        /* On a blocking socket, only wait for the first connection */
+        if (n > 0 && blocking &&
+            net_wait(bind_ctx->fd, MBEDTLS_NET_POLL_READ, 0) <= 0) {
+            break;
+        }
+
+#if defined(__linux__)
+        fd = accept4(bind_ctx->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+        fd = (int) accept(bind_ctx->fd, NULL, NULL);
+#endif
+        if (fd < 0) {
+            if (n > 0) {
+                /* Report what was accepted, the error comes back next time */
+                break;
+            }
+            if (net_would_block(bind_ctx) != 0) {
+                return MBEDTLS_ERR_SSL_WANT_READ;
+            }
+            return MBEDTLS_ERR_NET_ACCEPT_FAILED;
+        }
+
+        clients[n].fd = fd;
+#if !defined(__linux__)
+        if (mbedtls_net_set_nonblock(&clients[n]) != 0) {
+            mbedtls_net_close(&clients[n]);
+            return n > 0 ? (int) n : MBEDTLS_ERR_NET_ACCEPT_FAILED;
+        }
+#if defined(FD_CLOEXEC)
+        (void) fcntl(fd, F_SETFD, FD_CLOEXEC);
+#endif
+#endif /* !__linux__ */
+    }
+
+    return (int) n;
+}
+
 /*
  * Set the socket blocking or non-blocking
  */
@@ -453,63 +1062,20 @@ int mbedtls_net_set_nonblock(mbedtls_net_context *ctx)
 int mbedtls_net_poll(mbedtls_net_context *ctx, uint32_t rw, uint32_t timeout)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    struct timeval tv;
-
-    fd_set read_fds;
-    fd_set write_fds;
-
     int fd = ctx->fd;
 
-    ret = check_fd(fd, 1);
+    ret = check_fd(fd);
     if (ret != 0) {
         return ret;
     }
 
-#if defined(__has_feature)
-#if __has_feature(memory_sanitizer)
-    /* Ensure that memory sanitizers consider read_fds and write_fds as
-     * initialized even on platforms such as Glibc/x86_64 where FD_ZERO
-     * is implemented in assembly. */
-    memset(&read_fds, 0, sizeof(read_fds));
-    memset(&write_fds, 0, sizeof(write_fds));
-#endif
-#endif
-
-    FD_ZERO(&read_fds);
-    if (rw & MBEDTLS_NET_POLL_READ) {
-        rw &= ~MBEDTLS_NET_POLL_READ;
-        FD_SET((SOCKET) fd, &read_fds);
-    }
-
-    FD_ZERO(&write_fds);
-    if (rw & MBEDTLS_NET_POLL_WRITE) {
-        rw &= ~MBEDTLS_NET_POLL_WRITE;
-        FD_SET((SOCKET) fd, &write_fds);
-    }
-
-    if (rw != 0) {
+    if ((rw & ~(uint32_t) (MBEDTLS_NET_POLL_READ | MBEDTLS_NET_POLL_WRITE)) != 0) {
         return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
     }
 
-    tv.tv_sec  = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-
     do {
-        ret = select(fd + 1, &read_fds, &write_fds, NULL,
-                     timeout == (uint32_t) -1 ? NULL : &tv);
-    } while (IS_EINTR(ret));
-
-    if (ret < 0) {
-        return MBEDTLS_ERR_NET_POLL_FAILED;
-    }
-
-    ret = 0;
-    if (FD_ISSET(fd, &read_fds)) {
-        ret |= MBEDTLS_NET_POLL_READ;
-    }
-    if (FD_ISSET(fd, &write_fds)) {
-        ret |= MBEDTLS_NET_POLL_WRITE;
-    }
+        ret = net_wait(fd, rw, timeout);
+    } while (ret == MBEDTLS_ERR_SSL_WANT_READ);
 
     return ret;
 }
@@ -542,7 +1108,7 @@ int mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len)
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     int fd = ((mbedtls_net_context *) ctx)->fd;
 
-    ret = check_fd(fd, 0);
+    ret = check_fd(fd);
     if (ret != 0) {
         return ret;
     }
@@ -582,43 +1148,29 @@ int mbedtls_net_recv_timeout(void *ctx, unsigned char *buf,
                              size_t len, uint32_t timeout)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    struct timeval tv;
-    fd_set read_fds;
     int fd = ((mbedtls_net_context *) ctx)->fd;
 
-    ret = check_fd(fd, 1);
+    ret = check_fd(fd);
     if (ret != 0) {
         return ret;
     }
 
-    FD_ZERO(&read_fds);
-    FD_SET((SOCKET) fd, &read_fds);
-
-    tv.tv_sec  = timeout / 1000;
-    tv.tv_usec = (timeout % 1000) * 1000;
-
-    ret = select(fd + 1, &read_fds, NULL, NULL, timeout == 0 ? NULL : &tv);
+    ret = net_wait(fd, MBEDTLS_NET_POLL_READ,
+                   timeout == 0 ? (uint32_t) -1 : timeout);
 
-    /* Zero fds ready means we timed out */
+    /* Not ready means we timed out */
     if (ret == 0) {
         return MBEDTLS_ERR_SSL_TIMEOUT;
     }
 
-    if (ret < 0) {
-#if (defined(_WIN32) || defined(_WIN32_WCE)) && !defined(EFIX64) && \
-        !defined(EFI32)
-        if (WSAGetLastError() == WSAEINTR) {
-            return MBEDTLS_ERR_SSL_WANT_READ;
-        }
-#else
-        if (errno == EINTR) {
-            return MBEDTLS_ERR_SSL_WANT_READ;
-        }
-#endif
-
+    if (ret == MBEDTLS_ERR_NET_POLL_FAILED) {
         return MBEDTLS_ERR_NET_RECV_FAILED;
     }
 
+    if (ret < 0) {
+        return ret;
+    }
+
     /* This call will not block */
     return mbedtls_net_recv(ctx, buf, len);
 }
@@ -631,7 +1183,7 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     int fd = ((mbedtls_net_context *) ctx)->fd;
 
-    ret = check_fd(fd, 0);
+    ret = check_fd(fd);
     if (ret != 0) {
         return ret;
     }
@@ -664,6 +1216,1623 @@ int mbedtls_net_send(void *ctx, const unsigned char *buf, size_t len)
     return ret;
 }
 
+#if defined(MBEDTLS_SSL_KTLS)
+#if defined(NET_KTLS_SUPPORTED)
+/*
+ * Send a record of the given content type through a kTLS socket, the one
+ * given to mbedtls_net_ktls_enable()
+ */
+static int net_ktls_send_record(void *ctx, unsigned char type,
+                                const unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int fd = ((mbedtls_net_context *) ctx)->fd;
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    struct iovec iov;
+    union {
+        char buf[CMSG_SPACE(sizeof(unsigned char))];
+        struct cmsghdr align;
+    } control;
+
+    ret = check_fd(fd);
+    if (ret != 0) {
+        return ret;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    memset(&control, 0, sizeof(control));
+
+    iov.iov_base = (void *) buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+    *CMSG_DATA(cmsg) = type;
+
+    ret = (int) sendmsg(fd, &msg, 0);
+
+    if (ret < 0) {
+        if (net_would_block(ctx) != 0) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+
+        if (errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    return ret;
+}
+
+/*
+ * Fill the AES-GCM crypto_info fields common to all key sizes
+ */
+static int net_ktls_fill_gcm(const mbedtls_ssl_ktls_params *params,
+                             unsigned char iv[8], unsigned char salt[4],
+                             unsigned char *key, size_t key_len,
+                             unsigned char rec_seq[8])
+{
+    if (params->key_len != key_len) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    memcpy(key, params->key, key_len);
+    memcpy(salt, params->iv, 4);
+    memcpy(rec_seq, params->rec_seq, 8);
+
+    if (params->iv_len == 4) {
+        /* TLS 1.2: the explicit nonce is the record sequence number */
+        memcpy(iv, params->rec_seq, 8);
+    } else if (params->iv_len == 12) {
+        /* TLS 1.3: the kernel XORs the sequence number into salt || iv */
+        memcpy(iv, params->iv + 4, 8);
+    } else {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    return 0;
+}
+
+/*
+ * Hand the protection state of one direction over to the kernel
+ */
+static int net_ktls_set_crypto_info(int fd, int optname,
+                                    const mbedtls_ssl_ktls_params *params)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    union {
+        struct tls12_crypto_info_aes_gcm_128 aes_128_gcm;
+        struct tls12_crypto_info_aes_gcm_256 aes_256_gcm;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        struct tls12_crypto_info_chacha20_poly1305 chachapoly;
+#endif
+    } info;
+    struct tls_crypto_info *common = (struct tls_crypto_info *) &info;
+    size_t info_len = 0;
+
+    memset(&info, 0, sizeof(info));
+
+    switch (params->tls_version) {
+        case MBEDTLS_SSL_VERSION_TLS1_2:
+            common->version = TLS_1_2_VERSION;
+            break;
+#if defined(TLS_1_3_VERSION)
+        case MBEDTLS_SSL_VERSION_TLS1_3:
+            common->version = TLS_1_3_VERSION;
+            break;
+#endif
+        default:
+            return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    switch (params->cipher) {
+        case MBEDTLS_SSL_KTLS_AES_128_GCM:
+            common->cipher_type = TLS_CIPHER_AES_GCM_128;
+            info_len = sizeof(info.aes_128_gcm);
+            ret = net_ktls_fill_gcm(params, info.aes_128_gcm.iv,
+                                    info.aes_128_gcm.salt,
+                                    info.aes_128_gcm.key,
+                                    sizeof(info.aes_128_gcm.key),
+                                    info.aes_128_gcm.rec_seq);
+            break;
+        case MBEDTLS_SSL_KTLS_AES_256_GCM:
+            common->cipher_type = TLS_CIPHER_AES_GCM_256;
+            info_len = sizeof(info.aes_256_gcm);
+            ret = net_ktls_fill_gcm(params, info.aes_256_gcm.iv,
+                                    info.aes_256_gcm.salt,
+                                    info.aes_256_gcm.key,
+                                    sizeof(info.aes_256_gcm.key),
+                                    info.aes_256_gcm.rec_seq);
+            break;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        case MBEDTLS_SSL_KTLS_CHACHA20_POLY1305:
+            common->cipher_type = TLS_CIPHER_CHACHA20_POLY1305;
+            info_len = sizeof(info.chachapoly);
+            if (params->key_len != sizeof(info.chachapoly.key) ||
+                params->iv_len != sizeof(info.chachapoly.iv)) {
+                ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+                break;
+            }
+            memcpy(info.chachapoly.key, params->key, params->key_len);
+            memcpy(info.chachapoly.iv, params->iv, params->iv_len);
+            memcpy(info.chachapoly.rec_seq, params->rec_seq,
+                   sizeof(info.chachapoly.rec_seq));
+            ret = 0;
+            break;
+#endif
+        default:
+            ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+            break;
+    }
+
+    if (ret == 0 &&
+        setsockopt(fd, SOL_TLS, optname, &info, (socklen_t) info_len) != 0) {
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    mbedtls_platform_zeroize(&info, sizeof(info));
+
+    return ret;
+}
+#endif /* NET_KTLS_SUPPORTED */
+
+/*
+ * Offload record protection to the kernel
+ */
+int mbedtls_net_ktls_enable(mbedtls_net_context *ctx,
+                            mbedtls_ssl_context *ssl, int directions)
+{
+#if defined(NET_KTLS_SUPPORTED)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_ktls_params tx, rx;
+
+    memset(&tx, 0, sizeof(tx));
+    memset(&rx, 0, sizeof(rx));
+
+    if (ctx == NULL || ssl == NULL || directions == 0 ||
+        (directions & ~(MBEDTLS_SSL_KTLS_TX | MBEDTLS_SSL_KTLS_RX)) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = check_fd(ctx->fd);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Check everything before touching the socket. */
+    if ((directions & MBEDTLS_SSL_KTLS_TX) != 0 &&
+        (ret = mbedtls_ssl_ktls_export(ssl, MBEDTLS_SSL_KTLS_TX, &tx)) != 0) {
+        goto cleanup;
+    }
+    if ((directions & MBEDTLS_SSL_KTLS_RX) != 0 &&
+        (ret = mbedtls_ssl_ktls_export(ssl, MBEDTLS_SSL_KTLS_RX, &rx)) != 0) {
+        goto cleanup;
+    }
+
+    if (setsockopt(ctx->fd, IPPROTO_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+        goto cleanup;
+    }
+
+    if ((directions & MBEDTLS_SSL_KTLS_TX) != 0 &&
+        (ret = net_ktls_set_crypto_info(ctx->fd, TLS_TX, &tx)) != 0) {
+        goto cleanup;
+    }
+    if ((directions & MBEDTLS_SSL_KTLS_RX) != 0 &&
+        (ret = net_ktls_set_crypto_info(ctx->fd, TLS_RX, &rx)) != 0) {
+        goto cleanup;
+    }
+
+    /* Records are sent on this socket, whatever the context given to
+     * mbedtls_ssl_set_bio() is. */
+    ret = mbedtls_ssl_ktls_start(ssl, directions, net_ktls_send_record, ctx);
+
+cleanup:
+    mbedtls_platform_zeroize(&tx, sizeof(tx));
+    mbedtls_platform_zeroize(&rx, sizeof(rx));
+
+    return ret;
+#else /* NET_KTLS_SUPPORTED */
+    (void) ctx;
+    (void) ssl;
+    (void) directions;
+
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif /* NET_KTLS_SUPPORTED */
+}
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_TLS_C)
+#if !defined(_WIN32)
+typedef struct {
+    int fd;
+    off_t offset;
+} net_file_source;
+
+/*
+ * Read the next bytes of a file for mbedtls_ssl_write_from()
+ */
+static int net_file_read(void *ctx, unsigned char *buf, size_t len)
+{
+    net_file_source *src = (net_file_source *) ctx;
+    ssize_t ret;
+
+    do {
+        ret = pread(src->fd, buf, len, src->offset);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+
+    src->offset += (off_t) ret;
+    return (int) ret;
+}
+
+#if defined(NET_KTLS_SUPPORTED)
+/*
+ * Send a range of a file through a kTLS socket
+ */
+static int net_ktls_sendfile(mbedtls_net_context *ctx, int fd,
+                             off_t offset, size_t len)
+{
+    int ret = check_fd(ctx->fd);
+    ssize_t sent;
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    sent = sendfile(ctx->fd, fd, &offset, len);
+
+    if (sent < 0) {
+        if (net_would_block(ctx) != 0 || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+
+        if (errno == EPIPE || errno == ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+
+        return MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    return (int) sent;
+}
+#endif /* NET_KTLS_SUPPORTED */
+#endif /* !_WIN32 */
+
+/*
+ * Write a range of a file as application data
+ */
+int mbedtls_net_write_from_fd(mbedtls_net_context *ctx,
+                              mbedtls_ssl_context *ssl,
+                              int fd, uint64_t offset, size_t len)
+{
+#if !defined(_WIN32)
+    net_file_source src;
+
+    if (ctx == NULL || ssl == NULL || fd < 0 ||
+        (uint64_t) (off_t) offset != offset || (off_t) offset < 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* The number of bytes written is returned as an int. */
+    if (len > INT_MAX) {
+        len = INT_MAX;
+    }
+
+#if defined(NET_KTLS_SUPPORTED)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_TX) {
+        return net_ktls_sendfile(ctx, fd, (off_t) offset, len);
+    }
+#endif
+
+    src.fd = fd;
+    src.offset = (off_t) offset;
+
+    return mbedtls_ssl_write_from(ssl, net_file_read, &src, len);
+#else /* !_WIN32 */
+    (void) ctx;
+    (void) ssl;
+    (void) fd;
+    (void) offset;
+    (void) len;
+
+    return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+#endif /* !_WIN32 */
+}
+#endif /* MBEDTLS_SSL_TLS_C */
+
+#if defined(MBEDTLS_NET_REACTOR)
+void mbedtls_net_reactor_init(mbedtls_net_reactor *reactor)
+{
+    reactor->fd = -1;
+}
+
+int mbedtls_net_reactor_setup(mbedtls_net_reactor *reactor)
+{
+    if (reactor->fd != -1) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+#if defined(NET_REACTOR_EPOLL)
+    reactor->fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    reactor->fd = kqueue();
+#endif
+    if (reactor->fd < 0) {
+        reactor->fd = -1;
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+
+    return 0;
+}
+
+/*
+ * Register for both directions at once: with edge-triggered notifications,
+ * interest never needs to be changed afterwards, so waiting after
+ * WANT_READ or WANT_WRITE costs no system call.
+ */
+int mbedtls_net_reactor_add(mbedtls_net_reactor *reactor,
+                            mbedtls_net_reactor_item *item,
+                            mbedtls_net_context *ctx,
+                            mbedtls_net_reactor_cb_t *f_ready,
+                            void *p_ready)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(NET_REACTOR_EPOLL)
+    struct epoll_event ev;
+#else
+    struct kevent ev[2];
+#endif
+
+    if (item == NULL || ctx == NULL || f_ready == NULL) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if ((ret = check_fd(reactor->fd)) != 0 ||
+        (ret = check_fd(ctx->fd)) != 0) {
+        return ret;
+    }
+
+    item->ctx = ctx;
+    item->f_ready = f_ready;
+    item->p_ready = p_ready;
+
+#if defined(NET_REACTOR_EPOLL)
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = item;
+    if (epoll_ctl(reactor->fd, EPOLL_CTL_ADD, ctx->fd, &ev) != 0) {
+        return MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+#else
+    EV_SET(&ev[0], ctx->fd, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, item);
+    EV_SET(&ev[1], ctx->fd, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, item);
+    if (kevent(reactor->fd, ev, 2, NULL, 0, NULL) != 0) {
+        return MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+#endif
+
+    return 0;
+}
+
+int mbedtls_net_reactor_remove(mbedtls_net_reactor *reactor,
+                               mbedtls_net_reactor_item *item)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(NET_REACTOR_EPOLL)
+    struct epoll_event ev;
+#else
+    struct kevent ev[2];
+#endif
+
+    if (item == NULL || item->ctx == NULL) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if ((ret = check_fd(reactor->fd)) != 0 ||
+        (ret = check_fd(item->ctx->fd)) != 0) {
+        return ret;
+    }
+
+#if defined(NET_REACTOR_EPOLL)
+    /* Linux before 2.6.9 requires a non-NULL event even for EPOLL_CTL_DEL */
+    memset(&ev, 0, sizeof(ev));
+    if (epoll_ctl(reactor->fd, EPOLL_CTL_DEL, item->ctx->fd, &ev) != 0) {
+        return MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+#else
+    EV_SET(&ev[0], item->ctx->fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&ev[1], item->ctx->fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    if (kevent(reactor->fd, ev, 2, NULL, 0, NULL) != 0) {
+        return MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+#endif
+
+    item->ctx = NULL;
+
+    return 0;
+}
+
+int mbedtls_net_reactor_dispatch(mbedtls_net_reactor *reactor,
+                                 uint32_t timeout)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int i, n;
+    uint32_t events;
+    mbedtls_net_reactor_item *item;
+#if defined(NET_REACTOR_EPOLL)
+    struct epoll_event ev[MBEDTLS_NET_REACTOR_MAX_EVENTS];
+    int timeout_ms;
+#else
+    struct kevent ev[MBEDTLS_NET_REACTOR_MAX_EVENTS];
+    struct timespec ts;
+#endif
+
+    ret = check_fd(reactor->fd);
+    if (ret != 0) {
+        return ret;
+    }
+
+#if defined(NET_REACTOR_EPOLL)
+    if (timeout == (uint32_t) -1) {
+        timeout_ms = -1;
+    } else if (timeout > INT_MAX) {
+        timeout_ms = INT_MAX;
+    } else {
+        timeout_ms = (int) timeout;
+    }
+
+    n = epoll_wait(reactor->fd, ev, MBEDTLS_NET_REACTOR_MAX_EVENTS,
+                   timeout_ms);
+#else
+    ts.tv_sec  = timeout / 1000;
+    ts.tv_nsec = (long) (timeout % 1000) * 1000000;
+
+    n = kevent(reactor->fd, NULL, 0, ev, MBEDTLS_NET_REACTOR_MAX_EVENTS,
+               timeout == (uint32_t) -1 ? NULL : &ts);
+#endif
+    if (n < 0) {
+        return errno == EINTR ? 0 : MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    for (i = 0; i < n; i++) {
+        events = 0;
+#if defined(NET_REACTOR_EPOLL)
+        item = ev[i].data.ptr;
+        /* Errors and hangups are reported as readiness, so that the next
+         * read or write returns the actual condition. */
+        if (ev[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+            events |= MBEDTLS_NET_POLL_READ;
+        }
+        if (ev[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            events |= MBEDTLS_NET_POLL_WRITE;
+        }
+#else
+        item = ev[i].udata;
+        if (ev[i].filter == EVFILT_READ) {
+            events |= MBEDTLS_NET_POLL_READ;
+        } else if (ev[i].filter == EVFILT_WRITE) {
+            events |= MBEDTLS_NET_POLL_WRITE;
+        }
+#endif
+        /* The item may have been removed by an earlier callback */
+        if (item->ctx != NULL && events != 0) {
+            item->f_ready(item->p_ready, events);
+        }
+    }
+
+    return n;
+}
+
+void mbedtls_net_reactor_free(mbedtls_net_reactor *reactor)
+{
+    if (reactor == NULL || reactor->fd == -1) {
+        return;
+    }
+
+    close(reactor->fd);
+
+    reactor->fd = -1;
+}
+#endif /* MBEDTLS_NET_REACTOR */
+
+#if defined(MBEDTLS_NET_IO_URING)
+/*
+ * The rings are shared with the kernel: the producer publishes entries by
+ * storing the tail with release semantics, and the consumer reads the tail
+ * with acquire semantics before looking at the entries.
+ */
+#define NET_URING_LOAD_ACQUIRE(p)       __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define NET_URING_STORE_RELEASE(p, v)   __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+static int net_uring_enter(mbedtls_net_uring *ring, unsigned wait_nr)
+{
+    long ret;
+
+    do {
+        ret = syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, wait_nr,
+                      wait_nr != 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0) {
+        return MBEDTLS_ERR_NET_POLL_FAILED;
+    }
+
+    ring->to_submit -= (unsigned) ret;
+
+    return 0;
+}
+
+void mbedtls_net_uring_init(mbedtls_net_uring *ring)
+{
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+int mbedtls_net_uring_setup(mbedtls_net_uring *ring, unsigned entries)
+{
+    struct io_uring_params params;
+    unsigned char *sq, *cq;
+    long fd;
+
+    if (ring->fd != -1 || entries == 0) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    memset(&params, 0, sizeof(params));
+    fd = syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    ring->fd = (int) fd;
+
+    ring->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_len = params.cq_off.cqes +
+                        params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_len > ring->sq_ring_len) {
+            ring->sq_ring_len = ring->cq_ring_len;
+        }
+        ring->cq_ring_len = 0;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        goto fail;
+    }
+
+    if (ring->cq_ring_len != 0) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_len, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            goto fail;
+        }
+    }
+
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        goto fail;
+    }
+
+    sq = ring->sq_ring;
+    cq = ring->cq_ring != NULL ? ring->cq_ring : ring->sq_ring;
+
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    return 0;
+
+fail:
+    mbedtls_net_uring_free(ring);
+    return MBEDTLS_ERR_NET_SOCKET_FAILED;
+}
+
+int mbedtls_net_uring_register_region(mbedtls_net_uring *ring,
+                                      unsigned char *region, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct iovec iov;
+
+    ret = check_fd(ring->fd);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (ring->region != NULL || region == NULL || len == 0) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    iov.iov_base = region;
+    iov.iov_len = len;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                &iov, 1) != 0) {
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+
+    ring->region = region;
+    ring->region_len = len;
+
+    return 0;
+}
+
+/*
+ * Get the next free submission queue entry, submitting what is queued if
+ * the queue is full. Return NULL if there is still no room.
+ */
+static struct io_uring_sqe *net_uring_get_sqe(mbedtls_net_uring *ring)
+{
+    struct io_uring_sqe *sqe;
+    unsigned tail = *ring->sq_tail;
+
+    if (tail - NET_URING_LOAD_ACQUIRE(ring->sq_head) >= ring->sq_entries) {
+        if (net_uring_enter(ring, 0) != 0 ||
+            tail - NET_URING_LOAD_ACQUIRE(ring->sq_head) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    sqe = (struct io_uring_sqe *) ring->sqes + (tail & ring->sq_mask);
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+/*
+ * Publish the entry returned by the last net_uring_get_sqe()
+ */
+static void net_uring_queue_sqe(mbedtls_net_uring *ring)
+{
+    unsigned tail = *ring->sq_tail;
+
+    ring->sq_array[tail & ring->sq_mask] = tail & ring->sq_mask;
+    NET_URING_STORE_RELEASE(ring->sq_tail, tail + 1);
+    ring->to_submit++;
+}
+
+int mbedtls_net_uring_run(mbedtls_net_uring *ring, unsigned wait_nr)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned head, tail;
+    int n = 0;
+    const struct io_uring_cqe *cqe;
+    mbedtls_net_uring_op *op;
+    mbedtls_net_uring_context *owner;
+
+    ret = check_fd(ring->fd);
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (ring->to_submit != 0 || wait_nr != 0) {
+        ret = net_uring_enter(ring, wait_nr);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    head = *ring->cq_head;
+    tail = NET_URING_LOAD_ACQUIRE(ring->cq_tail);
+
+    for (; head != tail; head++) {
+        cqe = (const struct io_uring_cqe *) ring->cqes + (head & ring->cq_mask);
+        op = (mbedtls_net_uring_op *) (uintptr_t) cqe->user_data;
+
+        /* Cancellation requests carry no operation */
+        if (op == NULL) {
+            NET_URING_STORE_RELEASE(ring->cq_head, head + 1);
+            continue;
+        }
+
+        op->res = cqe->res;
+        op->state = NET_URING_OP_DONE;
+        n++;
+
+        /* Free the entry before the callback, which may queue more I/O */
+        NET_URING_STORE_RELEASE(ring->cq_head, head + 1);
+
+        owner = op->owner;
+        if (owner->f_ready != NULL) {
+            owner->f_ready(owner->p_ready, op == &owner->rx ?
+                           MBEDTLS_NET_POLL_READ : MBEDTLS_NET_POLL_WRITE);
+        }
+    }
+
+    return n;
+}
+
+void mbedtls_net_uring_free(mbedtls_net_uring *ring)
+{
+    if (ring == NULL || ring->fd == -1) {
+        return;
+    }
+
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_len);
+    }
+    if (ring->cq_ring != NULL) {
+        munmap(ring->cq_ring, ring->cq_ring_len);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_len);
+    }
+
+    close(ring->fd);
+
+    mbedtls_net_uring_init(ring);
+}
+
+void mbedtls_net_uring_context_init(mbedtls_net_uring_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_net_uring_context_setup(mbedtls_net_uring_context *ctx,
+                                    mbedtls_net_uring *ring,
+                                    mbedtls_net_context *net,
+                                    mbedtls_net_uring_cb_t *f_ready,
+                                    void *p_ready)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ring == NULL || net == NULL || ctx->ring != NULL) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if ((ret = check_fd(ring->fd)) != 0 ||
+        (ret = check_fd(net->fd)) != 0) {
+        return ret;
+    }
+
+    ctx->ring = ring;
+    ctx->net = net;
+    ctx->f_ready = f_ready;
+    ctx->p_ready = p_ready;
+    ctx->rx.owner = ctx;
+    ctx->rx.state = NET_URING_OP_IDLE;
+    ctx->tx.owner = ctx;
+    ctx->tx.state = NET_URING_OP_IDLE;
+
+    return 0;
+}
+
+/*
+ * Common part of send and receive: return the result of a completed
+ * operation, or queue a new one and return want.
+ */
+static int net_uring_io(mbedtls_net_uring_context *ctx,
+                        mbedtls_net_uring_op *op, int is_send,
+                        const unsigned char *buf, size_t len,
+                        int want, int failed)
+{
+    mbedtls_net_uring *ring = ctx->ring;
+    struct io_uring_sqe *sqe;
+    int res;
+
+    if (ring == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+
+    if (op->state == NET_URING_OP_PENDING) {
+        return want;
+    }
+
+    if (len > UINT32_MAX) {
+        len = UINT32_MAX;
+    }
+
+    if (op->state == NET_URING_OP_DONE) {
+        op->state = NET_URING_OP_IDLE;
+
+        /* The data went to or came from the buffer of the queued call, so
+         * only a retry of that call can take the result. */
+        if (buf != op->buf || len < op->len) {
+            return failed;
+        }
+
+        res = op->res;
+        if (res >= 0) {
+            return res;
+        }
+        if (res == -EPIPE || res == -ECONNRESET) {
+            return MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        if (res != -EAGAIN && res != -EINTR) {
+            return failed;
+        }
+        /* Otherwise, queue the operation again */
+    }
+
+    sqe = net_uring_get_sqe(ring);
+    if (sqe == NULL) {
+        return want;
+    }
+
+    sqe->fd = ctx->net->fd;
+    sqe->addr = (uintptr_t) buf;
+    sqe->len = (uint32_t) len;
+    sqe->user_data = (uintptr_t) op;
+
+    if (ring->region != NULL && buf >= ring->region &&
+        len <= ring->region_len &&
+        (size_t) (buf - ring->region) <= ring->region_len - len) {
+        sqe->opcode = is_send ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->buf_index = 0;
+    } else {
+        sqe->opcode = is_send ? IORING_OP_SEND : IORING_OP_RECV;
+        sqe->msg_flags = is_send ? MSG_NOSIGNAL : 0;
+    }
+
+    op->buf = buf;
+    op->len = len;
+    op->state = NET_URING_OP_PENDING;
+    net_uring_queue_sqe(ring);
+
+    return want;
+}
+
+int mbedtls_net_uring_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    mbedtls_net_uring_context *uctx = (mbedtls_net_uring_context *) ctx;
+
+    return net_uring_io(uctx, &uctx->rx, 0, buf, len,
+                        MBEDTLS_ERR_SSL_WANT_READ, MBEDTLS_ERR_NET_RECV_FAILED);
+}
+
+int mbedtls_net_uring_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    mbedtls_net_uring_context *uctx = (mbedtls_net_uring_context *) ctx;
+
+    return net_uring_io(uctx, &uctx->tx, 1, buf, len,
+                        MBEDTLS_ERR_SSL_WANT_WRITE, MBEDTLS_ERR_NET_SEND_FAILED);
+}
+
+int mbedtls_net_uring_context_detach(mbedtls_net_uring_context *ctx)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_net_uring *ring = ctx->ring;
+    mbedtls_net_uring_op *ops[2];
+    struct io_uring_sqe *sqe;
+    size_t i;
+
+    if (ring == NULL) {
+        return 0;
+    }
+
+    ops[0] = &ctx->rx;
+    ops[1] = &ctx->tx;
+    ctx->f_ready = NULL;
+
+    for (i = 0; i < 2; i++) {
+        if (ops[i]->state != NET_URING_OP_PENDING) {
+            continue;
+        }
+
+        /* Wait for room to queue the cancellation */
+        while ((sqe = net_uring_get_sqe(ring)) == NULL) {
+            ret = mbedtls_net_uring_run(ring, 1);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = (uintptr_t) ops[i];
+        sqe->user_data = 0;
+        net_uring_queue_sqe(ring);
+    }
+
+    /* The kernel must be done with the buffers before they can go */
+    while (ctx->rx.state == NET_URING_OP_PENDING ||
+           ctx->tx.state == NET_URING_OP_PENDING) {
+        ret = mbedtls_net_uring_run(ring, 1);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    mbedtls_net_uring_context_init(ctx);
+
+    return 0;
+}
+#endif /* MBEDTLS_NET_IO_URING */
+
+#if defined(MBEDTLS_NET_DGRAM_DEMUX)
+/* Offsets in a DTLS 1.2 record header with a connection ID (RFC 9146) */
+#define NET_DGRAM_CID_OFFSET    11
+#define NET_DGRAM_HDR_MIN_LEN   13
+
+#define NET_DGRAM_GSO_MAX_SEGS  64
+#define NET_DGRAM_GSO_MAX_LEN   65000
+
+#if defined(NET_DGRAM_MMSG)
+
+/* Control message buffer for UDP_SEGMENT, aligned for struct cmsghdr */
+typedef union {
+    unsigned char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} net_dgram_ctrl;
+#endif /* NET_DGRAM_MMSG */
+
+struct mbedtls_net_dgram_slot {
+    mbedtls_net_dgram_peer *owner;  /* peer the datagram was routed to */
+    size_t len;
+    size_t addr_len;
+    int next;                       /* next datagram of the same peer  */
+    unsigned char addr[MBEDTLS_NET_DGRAM_ADDR_MAX];
+};
+
+/* FNV-1a, which is plenty for keys chosen by this host or the kernel */
+static size_t net_dgram_hash(const unsigned char *key, size_t len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, key, len);
+}
+
+static mbedtls_net_dgram_peer *net_dgram_find_addr(mbedtls_net_dgram_demux *demux,
+                                                   const unsigned char *addr,
+                                                   size_t addr_len)
+{
+    mbedtls_net_dgram_peer *peer;
+
+    peer = demux->addr_buckets[net_dgram_hash(addr, addr_len) & demux->bucket_mask];
+    while (peer != NULL &&
+           (peer->addr_len != addr_len || memcmp(peer->addr, addr, addr_len) != 0)) {
+        peer = peer->addr_next;
+    }
+
+    return peer;
+}
+
+static mbedtls_net_dgram_peer *net_dgram_find_cid(mbedtls_net_dgram_demux *demux,
+                                                  const unsigned char *cid)
+{
+    mbedtls_net_dgram_peer *peer;
+
+    peer = demux->cid_buckets[net_dgram_hash(cid, demux->cid_len) & demux->bucket_mask];
+    while (peer != NULL && memcmp(peer->cid, cid, demux->cid_len) != 0) {
+        peer = peer->cid_next;
+    }
+
+    return peer;
+}
+
+static void net_dgram_unlink(mbedtls_net_dgram_peer **pp,
+                             mbedtls_net_dgram_peer *peer, int by_cid)
+{
+    while (*pp != NULL && *pp != peer) {
+        pp = by_cid ? &(*pp)->cid_next : &(*pp)->addr_next;
+    }
+    if (*pp != NULL) {
+        *pp = by_cid ? peer->cid_next : peer->addr_next;
+    }
+}
+
+static mbedtls_net_dgram_peer *net_dgram_route(mbedtls_net_dgram_demux *demux,
+                                               const struct mbedtls_net_dgram_slot *slot,
+                                               const unsigned char *buf)
+{
+    mbedtls_net_dgram_peer *peer;
+
+    /* Only the first record of the datagram is looked at: the records of
+     * a datagram all belong to the same connection. */
+    if (demux->cid_len != 0 && buf[0] == MBEDTLS_SSL_MSG_CID &&
+        slot->len >= NET_DGRAM_HDR_MIN_LEN + demux->cid_len) {
+        peer = net_dgram_find_cid(demux, buf + NET_DGRAM_CID_OFFSET);
+        if (peer != NULL) {
+            return peer;
+        }
+    }
+
+    return net_dgram_find_addr(demux, slot->addr, slot->addr_len);
+}
+
+void mbedtls_net_dgram_init(mbedtls_net_dgram_demux *demux)
+{
+    memset(demux, 0, sizeof(*demux));
+}
+
+int mbedtls_net_dgram_setup(mbedtls_net_dgram_demux *demux,
+                            mbedtls_net_context *net,
+                            size_t max_len, size_t num_buckets,
+                            size_t cid_len)
+{
+    size_t buckets = 1;
+    size_t slots_len = MBEDTLS_NET_DGRAM_BATCH * sizeof(struct mbedtls_net_dgram_slot);
+    unsigned char *mem;
+
+    if (demux->net != NULL || net == NULL || max_len == 0 ||
+        max_len > NET_DGRAM_GSO_MAX_LEN || cid_len > MBEDTLS_NET_DGRAM_CID_MAX ||
+        num_buckets == 0 || num_buckets > (SIZE_MAX >> 2) / sizeof(void *)) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+    if (net->fd < 0) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+
+    while (buckets < num_buckets) {
+        buckets <<= 1;
+    }
+
+    demux->addr_buckets = mbedtls_calloc_tagged(NET, 2 * buckets, sizeof(mbedtls_net_dgram_peer *));
+    if (demux->addr_buckets == NULL) {
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    demux->cid_buckets = demux->addr_buckets + buckets;
+
+    /* Slots and payloads of both directions in one allocation. The spare
+     * byte after the receive payloads lets the last one detect truncation
+     * when the system does not report it. */
+    mem = mbedtls_calloc_tagged(NET, 1, 2 * (slots_len + MBEDTLS_NET_DGRAM_BATCH * max_len) + 1);
+    if (mem == NULL) {
+        mbedtls_free(demux->addr_buckets);
+        demux->addr_buckets = NULL;
+        demux->cid_buckets = NULL;
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+    demux->rx = (struct mbedtls_net_dgram_slot *) mem;
+    demux->tx = demux->rx + MBEDTLS_NET_DGRAM_BATCH;
+    demux->rx_buf = mem + 2 * slots_len;
+    demux->tx_buf = demux->rx_buf + MBEDTLS_NET_DGRAM_BATCH * max_len + 1;
+
+    demux->net = net;
+    demux->max_len = max_len;
+    demux->cid_len = cid_len;
+    demux->bucket_mask = buckets - 1;
+    demux->tx_count = 0;
+#if defined(NET_DGRAM_MMSG)
+    demux->gso = 1;
+#endif
+
+    return 0;
+}
+
+#if defined(NET_DGRAM_MMSG)
+/*
+ * Make the kernel pick the shard of a record with a connection ID from the
+ * first byte of the CID, and hash the addresses of other datagrams as usual.
+ * Offsets are relative to the UDP payload. A load past the end of a short
+ * datagram ends the program with 0, which picks the first shard.
+ */
+static int net_dgram_steer_cid(int fd, size_t count)
+{
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, MBEDTLS_SSL_MSG_CID, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffffffff), /* out of range: hash */
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, NET_DGRAM_CID_OFFSET),
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, (uint32_t) count),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog;
+
+    prog.len = (unsigned short) (sizeof(code) / sizeof(code[0]));
+    prog.filter = code;
+
+    return setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF,
+                      &prog, sizeof(prog));
+}
+#endif /* NET_DGRAM_MMSG */
+
+int mbedtls_net_dgram_bind_shards(mbedtls_net_context *shards, size_t count,
+                                  const char *bind_ip, const char *port,
+                                  int steer_cid)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (shards == NULL || count == 0 || (steer_cid && count > 256)) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+#if !defined(NET_DGRAM_MMSG)
+    if (steer_cid && count > 1) {
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+#endif
+
+    ret = mbedtls_net_bind_shards(shards, count, bind_ip, port,
+                                  MBEDTLS_NET_PROTO_UDP);
+    if (ret != 0) {
+        return ret;
+    }
+
+#if defined(NET_DGRAM_MMSG)
+    /* The program belongs to the group, attaching it once is enough */
+    if (steer_cid && count > 1 && net_dgram_steer_cid(shards[0].fd, count) != 0) {
+        size_t i;
+
+        for (i = 0; i < count; i++) {
+            mbedtls_net_close(&shards[i]);
+        }
+        return MBEDTLS_ERR_NET_SOCKET_FAILED;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_net_dgram_set_accept_cb(mbedtls_net_dgram_demux *demux,
+                                     mbedtls_net_dgram_accept_cb_t *f_accept,
+                                     void *p_accept)
+{
+    demux->f_accept = f_accept;
+    demux->p_accept = p_accept;
+}
+
+/*
+ * Fill the receive slots, returning the number of datagrams or an error
+ */
+static int net_dgram_recv_batch(mbedtls_net_dgram_demux *demux)
+{
+    int fd = demux->net->fd;
+    int n;
+#if defined(NET_DGRAM_MMSG)
+    struct mmsghdr msgs[MBEDTLS_NET_DGRAM_BATCH];
+    struct iovec iov[MBEDTLS_NET_DGRAM_BATCH];
+    int i;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (i = 0; i < MBEDTLS_NET_DGRAM_BATCH; i++) {
+        iov[i].iov_base = demux->rx_buf + (size_t) i * demux->max_len;
+        iov[i].iov_len = demux->max_len;
+        msgs[i].msg_hdr.msg_name = demux->rx[i].addr;
+        msgs[i].msg_hdr.msg_namelen = MBEDTLS_NET_DGRAM_ADDR_MAX;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Block for the first datagram only, as recv() would */
+    n = recvmmsg(fd, msgs, MBEDTLS_NET_DGRAM_BATCH, MSG_WAITFORONE, NULL);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        }
+        return MBEDTLS_ERR_NET_RECV_FAILED;
+    }
+
+    for (i = 0; i < n; i++) {
+        demux->rx[i].addr_len = msgs[i].msg_hdr.msg_namelen;
+        demux->rx[i].len = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+    }
+#else
+    ssize_t ret;
+    socklen_t addr_len;
+
+    for (n = 0; n < MBEDTLS_NET_DGRAM_BATCH; n++) {
+        addr_len = MBEDTLS_NET_DGRAM_ADDR_MAX;
+        /* One more byte than fits, which overlaps the next, still unused
+         * payload or the spare byte */
+        ret = recvfrom(fd, demux->rx_buf + (size_t) n * demux->max_len,
+                       demux->max_len + 1, n == 0 ? 0 : MSG_DONTWAIT,
+                       (struct sockaddr *) demux->rx[n].addr, &addr_len);
+        if (ret < 0) {
+            if (n > 0) {
+                break;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return MBEDTLS_ERR_SSL_WANT_READ;
+            }
+            return MBEDTLS_ERR_NET_RECV_FAILED;
+        }
+        demux->rx[n].addr_len = addr_len;
+        demux->rx[n].len = (size_t) ret <= demux->max_len ? (size_t) ret : 0;
+    }
+#endif
+
+    return n;
+}
+
+int mbedtls_net_dgram_receive(mbedtls_net_dgram_demux *demux)
+{
+    mbedtls_net_dgram_peer *peer, *ready = NULL;
+    struct mbedtls_net_dgram_slot *slot;
+    const unsigned char *buf;
+    unsigned gen;
+    int i, n;
+
+    if (demux->net == NULL || demux->net->fd < 0) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+
+    n = net_dgram_recv_batch(demux);
+    if (n < 0) {
+        return n;
+    }
+
+    /* Invalidates whatever the previous batch left unread */
+    gen = ++demux->gen;
+
+    for (i = 0; i < n; i++) {
+        slot = &demux->rx[i];
+        slot->owner = NULL;
+        slot->next = -1;
+        buf = demux->rx_buf + (size_t) i * demux->max_len;
+
+        if (slot->len == 0 || slot->addr_len == 0) {
+            continue;
+        }
+
+        peer = net_dgram_route(demux, slot, buf);
+        if (peer == NULL && demux->f_accept != NULL) {
+            peer = demux->f_accept(demux->p_accept, slot->addr, slot->addr_len,
+                                   buf, slot->len);
+        }
+        if (peer == NULL || peer->demux != demux) {
+            continue;
+        }
+
+        slot->owner = peer;
+        if (peer->gen != gen) {
+            peer->gen = gen;
+            peer->rx_head = i;
+            peer->ready_next = ready;
+            ready = peer;
+        } else if (peer->rx_head < 0) {
+            peer->rx_head = i;
+        } else {
+            demux->rx[peer->rx_tail].next = i;
+        }
+        peer->rx_tail = i;
+    }
+
+    /* Each peer sees all of its datagrams from this batch at once */
+    while (ready != NULL) {
+        peer = ready;
+        ready = peer->ready_next;
+        if (peer->f_ready != NULL) {
+            peer->f_ready(peer->p_ready, MBEDTLS_NET_POLL_READ);
+        }
+    }
+
+    return n;
+}
+
+/*
+ * Drop the first count queued datagrams
+ */
+static void net_dgram_tx_consume(mbedtls_net_dgram_demux *demux, size_t count)
+{
+    size_t rest = demux->tx_count - count;
+
+    if (rest != 0) {
+        memmove(demux->tx, demux->tx + count, rest * sizeof(*demux->tx));
+        memmove(demux->tx_buf, demux->tx_buf + count * demux->max_len,
+                rest * demux->max_len);
+    }
+    demux->tx_count = rest;
+}
+
+#if defined(NET_DGRAM_MMSG)
+/*
+ * Coalesce runs of datagrams to the same address into one message with
+ * UDP_SEGMENT: the kernel then splits the payload into datagrams of the
+ * segment size, of which only the last may be shorter. group_end[m] is the
+ * index after the last datagram of message m.
+ */
+static int net_dgram_build_msgs(mbedtls_net_dgram_demux *demux,
+                                struct mmsghdr *msgs, struct iovec *iov,
+                                net_dgram_ctrl *ctrl,
+                                size_t *group_end)
+{
+    struct mbedtls_net_dgram_slot *tx = demux->tx;
+    struct cmsghdr *cmsg;
+    uint16_t seg;
+    size_t i, j, total;
+    int m = 0;
+
+    memset(msgs, 0, demux->tx_count * sizeof(*msgs));
+    for (i = 0; i < demux->tx_count; i++) {
+        iov[i].iov_base = demux->tx_buf + i * demux->max_len;
+        iov[i].iov_len = tx[i].len;
+    }
+
+    for (i = 0; i < demux->tx_count; i = j) {
+        total = tx[i].len;
+        for (j = i + 1; demux->gso && j < demux->tx_count &&
+             j - i < NET_DGRAM_GSO_MAX_SEGS &&
+             tx[j - 1].len == tx[i].len && tx[j].len <= tx[i].len &&
+             total + tx[j].len <= NET_DGRAM_GSO_MAX_LEN &&
+             tx[j].addr_len == tx[i].addr_len &&
+             memcmp(tx[j].addr, tx[i].addr, tx[i].addr_len) == 0; j++) {
+            total += tx[j].len;
+        }
+
+        msgs[m].msg_hdr.msg_name = tx[i].addr;
+        msgs[m].msg_hdr.msg_namelen = (socklen_t) tx[i].addr_len;
+        msgs[m].msg_hdr.msg_iov = &iov[i];
+        msgs[m].msg_hdr.msg_iovlen = j - i;
+        if (j - i > 1) {
+            msgs[m].msg_hdr.msg_control = ctrl[m].buf;
+            msgs[m].msg_hdr.msg_controllen = sizeof(ctrl[m].buf);
+            cmsg = CMSG_FIRSTHDR(&msgs[m].msg_hdr);
+            cmsg->cmsg_level = SOL_UDP;
+            cmsg->cmsg_type = UDP_SEGMENT;
+            cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            seg = (uint16_t) tx[i].len;
+            memcpy(CMSG_DATA(cmsg), &seg, sizeof(seg));
+        }
+        group_end[m++] = j;
+    }
+
+    return m;
+}
+#endif /* NET_DGRAM_MMSG */
+
+int mbedtls_net_dgram_flush(mbedtls_net_dgram_demux *demux)
+{
+    int fd, failed = 0;
+#if defined(NET_DGRAM_MMSG)
+    struct mmsghdr msgs[MBEDTLS_NET_DGRAM_BATCH];
+    struct iovec iov[MBEDTLS_NET_DGRAM_BATCH];
+    net_dgram_ctrl ctrl[MBEDTLS_NET_DGRAM_BATCH];
+    size_t group_end[MBEDTLS_NET_DGRAM_BATCH];
+    int m, sent;
+#else
+    ssize_t ret;
+#endif
+
+    if (demux->net == NULL || demux->net->fd < 0) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    fd = demux->net->fd;
+
+    while (demux->tx_count != 0) {
+#if defined(NET_DGRAM_MMSG)
+        m = net_dgram_build_msgs(demux, msgs, iov, ctrl, group_end);
+        sent = sendmmsg(fd, msgs, (unsigned) m, 0);
+        if (sent > 0) {
+            net_dgram_tx_consume(demux, group_end[sent - 1]);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        if (demux->gso && group_end[0] > 1 &&
+            (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT ||
+             errno == EOPNOTSUPP)) {
+            /* No segmentation offload on this kernel or device */
+            demux->gso = 0;
+            continue;
+        }
+        net_dgram_tx_consume(demux, group_end[0]);
+#else
+        ret = sendto(fd, demux->tx_buf, demux->tx[0].len, 0,
+                     (const struct sockaddr *) demux->tx[0].addr,
+                     (socklen_t) demux->tx[0].addr_len);
+        if (ret >= 0) {
+            net_dgram_tx_consume(demux, 1);
+            continue;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        net_dgram_tx_consume(demux, 1);
+#endif
+        failed = 1;
+    }
+
+    return failed ? MBEDTLS_ERR_NET_SEND_FAILED : 0;
+}
+
+int mbedtls_net_dgram_sendto(mbedtls_net_dgram_demux *demux,
+                             const unsigned char *addr, size_t addr_len,
+                             const unsigned char *buf, size_t len)
+{
+    struct mbedtls_net_dgram_slot *slot;
+    int ret;
+
+    if (demux->net == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    if (addr_len == 0 || addr_len > MBEDTLS_NET_DGRAM_ADDR_MAX ||
+        len > demux->max_len || len > INT_MAX) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if (demux->tx_count == MBEDTLS_NET_DGRAM_BATCH) {
+        ret = mbedtls_net_dgram_flush(demux);
+        if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return ret;
+        }
+        if (demux->tx_count == MBEDTLS_NET_DGRAM_BATCH) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+    }
+
+    slot = &demux->tx[demux->tx_count];
+    memcpy(slot->addr, addr, addr_len);
+    slot->addr_len = addr_len;
+    slot->len = len;
+    if (len != 0) {
+        memcpy(demux->tx_buf + demux->tx_count * demux->max_len, buf, len);
+    }
+    demux->tx_count++;
+
+    return (int) len;
+}
+
+void mbedtls_net_dgram_free(mbedtls_net_dgram_demux *demux)
+{
+    if (demux == NULL) {
+        return;
+    }
+
+    mbedtls_free(demux->addr_buckets);
+    mbedtls_free(demux->rx);
+    mbedtls_net_dgram_init(demux);
+}
+
+void mbedtls_net_dgram_peer_init(mbedtls_net_dgram_peer *peer)
+{
+    memset(peer, 0, sizeof(*peer));
+    peer->rx_head = -1;
+    peer->rx_tail = -1;
+}
+
+int mbedtls_net_dgram_peer_add(mbedtls_net_dgram_demux *demux,
+                               mbedtls_net_dgram_peer *peer,
+                               const unsigned char *addr, size_t addr_len,
+                               mbedtls_net_dgram_cb_t *f_ready,
+                               void *p_ready)
+{
+    mbedtls_net_dgram_peer **bucket, *other;
+
+    if (demux->net == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    if (addr_len == 0 || addr_len > MBEDTLS_NET_DGRAM_ADDR_MAX ||
+        (peer->demux != NULL && peer->demux != demux)) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+    other = net_dgram_find_addr(demux, addr, addr_len);
+    if (other != NULL && other != peer) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    /* Adding a peer again moves it to a new address */
+    if (peer->demux == demux) {
+        net_dgram_unlink(&demux->addr_buckets[net_dgram_hash(peer->addr, peer->addr_len) &
+                                              demux->bucket_mask], peer, 0);
+    } else {
+        peer->demux = demux;
+        peer->gen = demux->gen - 1;
+        peer->rx_head = -1;
+    }
+
+    memcpy(peer->addr, addr, addr_len);
+    peer->addr_len = addr_len;
+    peer->f_ready = f_ready;
+    peer->p_ready = p_ready;
+
+    bucket = &demux->addr_buckets[net_dgram_hash(addr, addr_len) & demux->bucket_mask];
+    peer->addr_next = *bucket;
+    *bucket = peer;
+
+    return 0;
+}
+
+int mbedtls_net_dgram_peer_set_cid(mbedtls_net_dgram_peer *peer,
+                                   const unsigned char *cid, size_t cid_len)
+{
+    mbedtls_net_dgram_demux *demux = peer->demux;
+    mbedtls_net_dgram_peer **bucket, *other;
+
+    if (demux == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    if (cid_len == 0 || cid_len != demux->cid_len) {
+        return MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+    other = net_dgram_find_cid(demux, cid);
+    if (other != NULL) {
+        return other == peer ? 0 : MBEDTLS_ERR_NET_BAD_INPUT_DATA;
+    }
+
+    if (peer->cid_len != 0) {
+        net_dgram_unlink(&demux->cid_buckets[net_dgram_hash(peer->cid, peer->cid_len) &
+                                             demux->bucket_mask], peer, 1);
+    }
+
+    memcpy(peer->cid, cid, cid_len);
+    peer->cid_len = cid_len;
+
+    bucket = &demux->cid_buckets[net_dgram_hash(cid, cid_len) & demux->bucket_mask];
+    peer->cid_next = *bucket;
+    *bucket = peer;
+
+    return 0;
+}
+
+void mbedtls_net_dgram_peer_remove(mbedtls_net_dgram_peer *peer)
+{
+    mbedtls_net_dgram_demux *demux = peer->demux;
+
+    if (demux == NULL) {
+        return;
+    }
+
+    net_dgram_unlink(&demux->addr_buckets[net_dgram_hash(peer->addr, peer->addr_len) &
+                                          demux->bucket_mask], peer, 0);
+    if (peer->cid_len != 0) {
+        net_dgram_unlink(&demux->cid_buckets[net_dgram_hash(peer->cid, peer->cid_len) &
+                                             demux->bucket_mask], peer, 1);
+    }
+
+    mbedtls_net_dgram_peer_init(peer);
+}
+
+int mbedtls_net_dgram_peer_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    mbedtls_net_dgram_peer *peer = (mbedtls_net_dgram_peer *) ctx;
+    mbedtls_net_dgram_demux *demux = peer->demux;
+    struct mbedtls_net_dgram_slot *slot;
+    int i = peer->rx_head;
+
+    if (demux == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+    if (peer->gen != demux->gen || i < 0 || demux->rx[i].owner != peer) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    slot = &demux->rx[i];
+    if (len > slot->len) {
+        len = slot->len;
+    }
+    if (len > INT_MAX) {
+        len = INT_MAX;
+    }
+    memcpy(buf, demux->rx_buf + (size_t) i * demux->max_len, len);
+    peer->rx_head = slot->next;
+
+    return (int) len;
+}
+
+int mbedtls_net_dgram_peer_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    mbedtls_net_dgram_peer *peer = (mbedtls_net_dgram_peer *) ctx;
+
+    if (peer->demux == NULL) {
+        return MBEDTLS_ERR_NET_INVALID_CONTEXT;
+    }
+
+    return mbedtls_net_dgram_sendto(peer->demux, peer->addr, peer->addr_len, buf, len);
+}
+#endif /* MBEDTLS_NET_DGRAM_DEMUX */
+
 /*
  * Close the connection
  */
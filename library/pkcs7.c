@@ -202,7 +202,9 @@ static int pkcs7_get_certificates(unsigned char **p, unsigned char *end,
         return MBEDTLS_ERR_PKCS7_FEATURE_UNAVAILABLE;
     }
 
-    if ((ret = mbedtls_x509_crt_parse_der(certs, start, len1)) < 0) {
+    /* The certificate is used in place in the internal copy of the PKCS #7
+     * structure, which is freed after it. */
+    if ((ret = mbedtls_x509_crt_parse_der_nocopy(certs, start, len1)) < 0) {
         return MBEDTLS_ERR_PKCS7_INVALID_CERT;
     }
 
@@ -403,7 +405,7 @@ static int pkcs7_get_signers_info_set(unsigned char **p, unsigned char *end,
     mbedtls_pkcs7_signer_info *prev = signers_set;
     while (*p != end_set) {
         mbedtls_pkcs7_signer_info *signer =
-            mbedtls_calloc(1, sizeof(mbedtls_pkcs7_signer_info));
+            mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_pkcs7_signer_info));
         if (!signer) {
             ret = MBEDTLS_ERR_PKCS7_ALLOC_FAILED;
             goto cleanup;
@@ -514,6 +516,8 @@ static int pkcs7_get_signed_data(unsigned char *buf, size_t buflen,
 
     /* Look for certificates, there may or may not be any */
     mbedtls_x509_crt_init(&signed_data->certs);
+    /* Only the keys, issuers and serials of these are used. */
+    mbedtls_x509_crt_set_lazy_ext(&signed_data->certs, 1);
     ret = pkcs7_get_certificates(&p, end, &signed_data->certs);
     if (ret < 0) {
         return ret;
@@ -561,7 +565,7 @@ int mbedtls_pkcs7_parse_der(mbedtls_pkcs7 *pkcs7, const unsigned char *buf,
     }
 
     /* make an internal copy of the buffer for parsing */
-    pkcs7->raw.p = p = mbedtls_calloc(1, buflen);
+    pkcs7->raw.p = p = mbedtls_calloc_tagged(X509, 1, buflen);
     if (pkcs7->raw.p == NULL) {
         ret = MBEDTLS_ERR_PKCS7_ALLOC_FAILED;
         goto out;
@@ -654,10 +658,12 @@ static int mbedtls_pkcs7_data_or_hash_verify(mbedtls_pkcs7 *pkcs7,
         return MBEDTLS_ERR_PKCS7_INVALID_CERT;
     }
 
-    if (mbedtls_x509_time_is_past(&cert->valid_to) ||
-        mbedtls_x509_time_is_future(&cert->valid_from)) {
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    if (mbedtls_x509_crt_check_validity(cert,
+                                        (int64_t) mbedtls_time(NULL)) != 0) {
         return MBEDTLS_ERR_PKCS7_CERT_DATE_INVALID;
     }
+#endif
 
     ret = mbedtls_oid_get_md_alg(&pkcs7->signed_data.digest_alg_identifiers, &md_alg);
     if (ret != 0) {
@@ -669,7 +675,7 @@ static int mbedtls_pkcs7_data_or_hash_verify(mbedtls_pkcs7 *pkcs7,
         return MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
     }
 
-    hash = mbedtls_calloc(mbedtls_md_get_size(md_info), 1);
+    hash = mbedtls_calloc_tagged(X509, mbedtls_md_get_size(md_info), 1);
     if (hash == NULL) {
         return MBEDTLS_ERR_PKCS7_ALLOC_FAILED;
     }
@@ -739,6 +745,230 @@ int mbedtls_pkcs7_signed_hash_verify(mbedtls_pkcs7 *pkcs7,
     return mbedtls_pkcs7_data_or_hash_verify(pkcs7, cert, hash, hashlen, 1);
 }
 
+/* The certificate of a signer, by issuer and serial number. */
+static const mbedtls_x509_crt *pkcs7_find_signer_cert(
+    const mbedtls_pkcs7_signer_info *signer,
+    const mbedtls_x509_crt *certs)
+{
+    const mbedtls_x509_crt *crt;
+
+    for (crt = certs; crt != NULL && crt->raw.p != NULL; crt = crt->next) {
+        if (crt->serial.len == signer->serial.len &&
+            crt->issuer_raw.len == signer->issuer_raw.len &&
+            memcmp(crt->serial.p, signer->serial.p, signer->serial.len) == 0 &&
+            memcmp(crt->issuer_raw.p, signer->issuer_raw.p,
+                   signer->issuer_raw.len) == 0) {
+            return crt;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Check each signer against its own certificate. The parser only accepts
+ * signers using the single digest algorithm of the signed data, so the
+ * content is hashed once whatever the number of signers.
+ */
+static int pkcs7_signers_verify_hash(mbedtls_pkcs7 *pkcs7,
+                                     const mbedtls_x509_crt *certs,
+                                     const unsigned char *hash,
+                                     size_t hashlen,
+                                     int *status,
+                                     size_t status_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_md_type_t md_alg;
+    const mbedtls_pkcs7_signer_info *signer;
+    const mbedtls_x509_crt *crt;
+    mbedtls_pk_context pk_cxt;
+    int all_ok = 1;
+    size_t i;
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    int64_t now = (int64_t) mbedtls_time(NULL);
+#endif
+
+    if (pkcs7->signed_data.no_of_signers == 0) {
+        return MBEDTLS_ERR_PKCS7_INVALID_CERT;
+    }
+
+    if (status_len < (size_t) pkcs7->signed_data.no_of_signers) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    ret = mbedtls_oid_get_md_alg(&pkcs7->signed_data.digest_alg_identifiers, &md_alg);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (signer = &pkcs7->signed_data.signers, i = 0; signer != NULL;
+         signer = signer->next, i++) {
+        crt = pkcs7_find_signer_cert(signer, certs);
+        if (crt == NULL) {
+            ret = MBEDTLS_ERR_PKCS7_INVALID_CERT;
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+        } else if (mbedtls_x509_crt_check_validity(crt, now) != 0) {
+            ret = MBEDTLS_ERR_PKCS7_CERT_DATE_INVALID;
+#endif
+        } else {
+            pk_cxt = crt->pk;
+            ret = mbedtls_pk_verify(&pk_cxt, md_alg, hash, hashlen,
+                                    signer->sig.p, signer->sig.len);
+        }
+
+        status[i] = ret;
+        if (ret != 0) {
+            all_ok = 0;
+        }
+    }
+
+    return all_ok ? 0 : MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
+}
+
+int mbedtls_pkcs7_signers_verify(mbedtls_pkcs7 *pkcs7,
+                                 const mbedtls_x509_crt *certs,
+                                 const unsigned char *data,
+                                 size_t datalen,
+                                 int *status,
+                                 size_t status_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+    const mbedtls_md_info_t *md_info;
+    mbedtls_md_type_t md_alg;
+
+    if (data == NULL || status == NULL) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    ret = mbedtls_oid_get_md_alg(&pkcs7->signed_data.digest_alg_identifiers, &md_alg);
+    if (ret != 0) {
+        return ret;
+    }
+
+    md_info = mbedtls_md_info_from_type(md_alg);
+    if (md_info == NULL) {
+        return MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
+    }
+
+    if (mbedtls_md(md_info, data, datalen, hash) != 0) {
+        return MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
+    }
+
+    ret = pkcs7_signers_verify_hash(pkcs7, certs, hash, mbedtls_md_get_size(md_info),
+                                    status, status_len);
+    mbedtls_platform_zeroize(hash, sizeof(hash));
+
+    return ret;
+}
+
+void mbedtls_pkcs7_verify_init(mbedtls_pkcs7_verify_ctx *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_pkcs7_verify_ctx));
+    mbedtls_md_init(&ctx->md_ctx);
+}
+
+int mbedtls_pkcs7_verify_starts(mbedtls_pkcs7_verify_ctx *ctx,
+                                mbedtls_pkcs7 *pkcs7)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_md_info_t *md_info;
+    mbedtls_md_type_t md_alg;
+
+    if (pkcs7 == NULL || ctx->pkcs7 != NULL) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    ret = mbedtls_oid_get_md_alg(&pkcs7->signed_data.digest_alg_identifiers, &md_alg);
+    if (ret != 0) {
+        return ret;
+    }
+
+    md_info = mbedtls_md_info_from_type(md_alg);
+    if (md_info == NULL) {
+        return MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
+    }
+
+    if ((ret = mbedtls_md_setup(&ctx->md_ctx, md_info, 0)) != 0 ||
+        (ret = mbedtls_md_starts(&ctx->md_ctx)) != 0) {
+        return ret;
+    }
+
+    ctx->pkcs7 = pkcs7;
+    ctx->hash_len = 0;
+
+    return 0;
+}
+
+int mbedtls_pkcs7_verify_update(mbedtls_pkcs7_verify_ctx *ctx,
+                                const unsigned char *data,
+                                size_t datalen)
+{
+    if (ctx->pkcs7 == NULL || ctx->hash_len != 0) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    return mbedtls_md_update(&ctx->md_ctx, data, datalen);
+}
+
+static int pkcs7_verify_final_hash(mbedtls_pkcs7_verify_ctx *ctx)
+{
+    if (ctx->pkcs7 == NULL) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    if (ctx->hash_len == 0) {
+        if (mbedtls_md_finish(&ctx->md_ctx, ctx->hash) != 0) {
+            return MBEDTLS_ERR_PKCS7_VERIFY_FAIL;
+        }
+        ctx->hash_len = mbedtls_md_get_size(mbedtls_md_info_from_ctx(&ctx->md_ctx));
+    }
+
+    return 0;
+}
+
+int mbedtls_pkcs7_verify_finish(mbedtls_pkcs7_verify_ctx *ctx,
+                                const mbedtls_x509_crt *cert)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = pkcs7_verify_final_hash(ctx)) != 0) {
+        return ret;
+    }
+
+    return mbedtls_pkcs7_data_or_hash_verify(ctx->pkcs7, cert,
+                                             ctx->hash, ctx->hash_len, 1);
+}
+
+int mbedtls_pkcs7_verify_finish_signers(mbedtls_pkcs7_verify_ctx *ctx,
+                                        const mbedtls_x509_crt *certs,
+                                        int *status,
+                                        size_t status_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (status == NULL) {
+        return MBEDTLS_ERR_PKCS7_BAD_INPUT_DATA;
+    }
+
+    if ((ret = pkcs7_verify_final_hash(ctx)) != 0) {
+        return ret;
+    }
+
+    return pkcs7_signers_verify_hash(ctx->pkcs7, certs, ctx->hash, ctx->hash_len,
+                                     status, status_len);
+}
+
+void mbedtls_pkcs7_verify_free(mbedtls_pkcs7_verify_ctx *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_md_free(&ctx->md_ctx);
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_pkcs7_verify_ctx));
+}
+
 /*
  * Unallocate all pkcs7 data
  */
@@ -751,8 +981,6 @@ void mbedtls_pkcs7_free(mbedtls_pkcs7 *pkcs7)
         return;
     }
 
-    mbedtls_free(pkcs7->raw.p);
-
     mbedtls_x509_crt_free(&pkcs7->signed_data.certs);
     mbedtls_x509_crl_free(&pkcs7->signed_data.crl);
 
@@ -765,6 +993,8 @@ void mbedtls_pkcs7_free(mbedtls_pkcs7 *pkcs7)
         mbedtls_free(signer_prev);
     }
 
+    /* Last, since the certificates and signers point into it. */
+    mbedtls_free(pkcs7->raw.p);
     pkcs7->raw.p = NULL;
 }
 
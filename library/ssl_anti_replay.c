@@ -0,0 +1,187 @@
+/*
+ *  Replay detection of TLS 1.3 early data
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Two Bloom filters of the same size, back to back. An identifier sets
+ * SSL_ANTI_REPLAY_HASHES bits in the current filter, taken directly from
+ * its bytes: the binders it is used with are HMAC outputs, so they are
+ * already uniformly distributed. An identifier was seen if all of its bits
+ * are set in either filter.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_ANTI_REPLAY_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_anti_replay.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/* Upper bound that keeps bit indexes within 32 bits. */
+#define SSL_ANTI_REPLAY_MAX_FILTER_BYTES (1u << 28)
+
+#define SSL_ANTI_REPLAY_HASHES 4
+#define SSL_ANTI_REPLAY_MIN_ID_LEN (4 * SSL_ANTI_REPLAY_HASHES)
+
+void mbedtls_ssl_anti_replay_init(mbedtls_ssl_anti_replay *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ssl_anti_replay));
+}
+
+int mbedtls_ssl_anti_replay_setup(mbedtls_ssl_anti_replay *ctx,
+                                  size_t filter_bytes,
+                                  uint32_t window)
+{
+    size_t n = 1;
+
+    if (window == 0) {
+        window = MBEDTLS_SSL_ANTI_REPLAY_WINDOW;
+    }
+
+    if (ctx->filters != NULL || filter_bytes == 0 ||
+        filter_bytes > SSL_ANTI_REPLAY_MAX_FILTER_BYTES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+#if defined(MBEDTLS_HAVE_TIME)
+    if (window < 2 * MBEDTLS_SSL_TLS1_3_TICKET_AGE_TOLERANCE) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+#endif
+
+    while (n < filter_bytes) {
+        n <<= 1;
+    }
+
+    ctx->filters = mbedtls_calloc_tagged(SSL_CACHE, 2, n);
+    if (ctx->filters == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    ctx->mask = n * 8 - 1;
+    ctx->current = 0;
+    ctx->window = window;
+#if defined(MBEDTLS_HAVE_TIME)
+    ctx->start = mbedtls_ms_time();
+#else
+    ctx->count = 0;
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&ctx->mutex);
+#endif
+
+    return 0;
+}
+
+static unsigned char *ssl_anti_replay_filter(mbedtls_ssl_anti_replay *ctx,
+                                             unsigned char index)
+{
+    return ctx->filters + index * ((ctx->mask + 1) / 8);
+}
+
+/*
+ * Start a new window if the current one has ended: the previous filter is
+ * cleared and becomes the current one. Both are cleared if the previous
+ * filter is older than a window too, or if the clock went back.
+ */
+static void ssl_anti_replay_rotate(mbedtls_ssl_anti_replay *ctx)
+{
+    const size_t filter_bytes = (ctx->mask + 1) / 8;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+    mbedtls_ms_time_t elapsed = now - ctx->start;
+
+    if (elapsed >= 0 && elapsed < ctx->window) {
+        return;
+    }
+    if (elapsed < 0 || elapsed >= 2 * ctx->window) {
+        memset(ctx->filters, 0, 2 * filter_bytes);
+    }
+    ctx->start = now;
+#else
+    if (++ctx->count < ctx->window) {
+        return;
+    }
+    ctx->count = 0;
+#endif
+
+    ctx->current ^= 1;
+    memset(ssl_anti_replay_filter(ctx, ctx->current), 0, filter_bytes);
+}
+
+int mbedtls_ssl_anti_replay_check(void *p_ctx,
+                                  const unsigned char *id, size_t id_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_anti_replay *ctx = p_ctx;
+    unsigned char *cur, *prev;
+    uint32_t bits[SSL_ANTI_REPLAY_HASHES];
+    int in_cur = 1, in_prev = 1;
+    size_t i;
+
+    if (ctx == NULL || ctx->filters == NULL ||
+        id_len < SSL_ANTI_REPLAY_MIN_ID_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    for (i = 0; i < SSL_ANTI_REPLAY_HASHES; i++) {
+        bits[i] = MBEDTLS_GET_UINT32_LE(id, 4 * i) & (uint32_t) ctx->mask;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ssl_anti_replay_rotate(ctx);
+    cur = ssl_anti_replay_filter(ctx, ctx->current);
+    prev = ssl_anti_replay_filter(ctx, ctx->current ^ 1);
+
+    for (i = 0; i < SSL_ANTI_REPLAY_HASHES; i++) {
+        unsigned char mask = (unsigned char) (1u << (bits[i] & 7));
+        in_cur &= (cur[bits[i] >> 3] & mask) != 0;
+        in_prev &= (prev[bits[i] >> 3] & mask) != 0;
+    }
+
+    if (in_cur || in_prev) {
+        ret = 1;
+    } else {
+        for (i = 0; i < SSL_ANTI_REPLAY_HASHES; i++) {
+            cur[bits[i] >> 3] |= (unsigned char) (1u << (bits[i] & 7));
+        }
+        ret = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_anti_replay_free(mbedtls_ssl_anti_replay *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    if (ctx->filters != NULL) {
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&ctx->mutex);
+#endif
+        mbedtls_free(ctx->filters);
+    }
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_ssl_anti_replay));
+}
+
+#endif /* MBEDTLS_SSL_ANTI_REPLAY_C */
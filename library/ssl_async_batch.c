@@ -0,0 +1,301 @@
+/*
+ *  Batched private key signatures across concurrent handshakes
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A fixed array of slots, one per pending signature. A slot goes from free
+ * to queued when a handshake starts a signature, to running while a batch
+ * signs it, to done, and back to free when the handshake resumes and takes
+ * the signature. A handshake cancelled while its slot is running leaves it
+ * cancelled, and the run frees it.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_ASYNC_BATCH_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_async_batch.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/* Each operation carries a signature buffer of MBEDTLS_PK_SIGNATURE_MAX_SIZE
+ * bytes, so a batch this large already takes tens of MiB, and its last
+ * operations would wait longer than a peer waits for a handshake. */
+#define SSL_ASYNC_BATCH_MAX_CAPACITY (1u << 16)
+
+#define SSL_ASYNC_BATCH_FREE        0
+#define SSL_ASYNC_BATCH_QUEUED      1
+#define SSL_ASYNC_BATCH_RUNNING     2
+#define SSL_ASYNC_BATCH_DONE        3
+#define SSL_ASYNC_BATCH_CANCELLED   4
+
+#if defined(MBEDTLS_THREADING_C)
+#define SSL_ASYNC_BATCH_LOCK(batch)    mbedtls_mutex_lock(&(batch)->mutex)
+#define SSL_ASYNC_BATCH_UNLOCK(batch)  mbedtls_mutex_unlock(&(batch)->mutex)
+#else
+#define SSL_ASYNC_BATCH_LOCK(batch)    0
+#define SSL_ASYNC_BATCH_UNLOCK(batch)  0
+#endif
+
+void mbedtls_ssl_async_batch_init(mbedtls_ssl_async_batch *batch)
+{
+    memset(batch, 0, sizeof(mbedtls_ssl_async_batch));
+}
+
+int mbedtls_ssl_async_batch_setup(mbedtls_ssl_async_batch *batch,
+                                  size_t capacity,
+                                  mbedtls_ssl_async_batch_sign_t *f_sign,
+                                  void *p_sign)
+{
+    if (batch->ops != NULL || capacity == 0 ||
+        capacity > SSL_ASYNC_BATCH_MAX_CAPACITY) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    batch->ops = mbedtls_calloc_tagged(SSL, capacity, sizeof(mbedtls_ssl_async_batch_op));
+    batch->queue = mbedtls_calloc_tagged(SSL, capacity, sizeof(mbedtls_ssl_async_batch_op *));
+    if (batch->ops == NULL || batch->queue == NULL) {
+        mbedtls_free(batch->ops);
+        mbedtls_free(batch->queue);
+        batch->ops = NULL;
+        batch->queue = NULL;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    batch->capacity = capacity;
+    batch->running = 0;
+    batch->f_sign = f_sign;
+    batch->p_sign = p_sign;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&batch->mutex);
+#endif
+
+    return 0;
+}
+
+static int ssl_async_batch_sign_start(mbedtls_ssl_context *ssl,
+                                      mbedtls_x509_crt *cert,
+                                      mbedtls_md_type_t md_alg,
+                                      const unsigned char *hash,
+                                      size_t hash_len)
+{
+    mbedtls_ssl_async_batch *batch =
+        mbedtls_ssl_conf_get_async_config_data(ssl->conf);
+    mbedtls_pk_context *key = mbedtls_ssl_own_key(ssl);
+    mbedtls_pk_type_t pk_type;
+    mbedtls_ssl_async_batch_op *op = NULL;
+    size_t i;
+
+    (void) cert;
+
+    if (key == NULL || hash_len > MBEDTLS_MD_MAX_SIZE) {
+        return MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH;
+    }
+
+    pk_type = mbedtls_pk_get_type(key);
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3 &&
+        mbedtls_pk_can_do(key, MBEDTLS_PK_RSA)) {
+        pk_type = MBEDTLS_PK_RSASSA_PSS;
+    }
+#endif
+
+    if (SSL_ASYNC_BATCH_LOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    for (i = 0; i < batch->capacity; i++) {
+        if (batch->ops[i].state == SSL_ASYNC_BATCH_FREE) {
+            op = &batch->ops[i];
+            op->key = key;
+            op->pk_type = pk_type;
+            op->md_alg = md_alg;
+            memcpy(op->hash, hash, hash_len);
+            op->hash_len = hash_len;
+            op->sig_len = 0;
+            op->ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+            op->f_rng = ssl->f_rng;
+            op->p_rng = ssl->p_rng;
+            op->state = SSL_ASYNC_BATCH_QUEUED;
+            break;
+        }
+    }
+
+    if (SSL_ASYNC_BATCH_UNLOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    /* All slots in use: sign synchronously rather than wait. */
+    if (op == NULL) {
+        return MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH;
+    }
+
+    mbedtls_ssl_set_async_operation_data(ssl, op);
+
+    return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+}
+
+static int ssl_async_batch_resume(mbedtls_ssl_context *ssl,
+                                  unsigned char *output,
+                                  size_t *output_len,
+                                  size_t output_size)
+{
+    mbedtls_ssl_async_batch *batch =
+        mbedtls_ssl_conf_get_async_config_data(ssl->conf);
+    mbedtls_ssl_async_batch_op *op = mbedtls_ssl_get_async_operation_data(ssl);
+    int ret;
+
+    if (SSL_ASYNC_BATCH_LOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    if (op->state != SSL_ASYNC_BATCH_DONE) {
+        ret = MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+    } else {
+        ret = op->ret;
+        if (ret == 0) {
+            if (op->sig_len > output_size) {
+                ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+            } else {
+                memcpy(output, op->sig, op->sig_len);
+                *output_len = op->sig_len;
+            }
+        }
+        op->state = SSL_ASYNC_BATCH_FREE;
+    }
+
+    if (SSL_ASYNC_BATCH_UNLOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
+}
+
+static void ssl_async_batch_cancel(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_async_batch *batch =
+        mbedtls_ssl_conf_get_async_config_data(ssl->conf);
+    mbedtls_ssl_async_batch_op *op = mbedtls_ssl_get_async_operation_data(ssl);
+
+    if (op == NULL || SSL_ASYNC_BATCH_LOCK(batch) != 0) {
+        return;
+    }
+
+    op->state = op->state == SSL_ASYNC_BATCH_RUNNING ?
+                SSL_ASYNC_BATCH_CANCELLED : SSL_ASYNC_BATCH_FREE;
+
+    (void) SSL_ASYNC_BATCH_UNLOCK(batch);
+}
+
+void mbedtls_ssl_async_batch_conf(mbedtls_ssl_config *conf,
+                                  mbedtls_ssl_async_batch *batch)
+{
+    mbedtls_ssl_conf_async_private_cb(conf,
+                                      ssl_async_batch_sign_start, NULL,
+                                      ssl_async_batch_resume,
+                                      ssl_async_batch_cancel,
+                                      batch);
+}
+
+static void ssl_async_batch_sign_each(mbedtls_ssl_async_batch_op **ops,
+                                      size_t count)
+{
+    mbedtls_ssl_async_batch_op *op;
+    size_t i;
+
+    for (i = 0; i < count; i++) {
+        op = ops[i];
+        if (op->pk_type == MBEDTLS_PK_RSASSA_PSS) {
+            op->ret = mbedtls_pk_sign_ext(MBEDTLS_PK_RSASSA_PSS, op->key,
+                                          op->md_alg, op->hash, op->hash_len,
+                                          op->sig, sizeof(op->sig), &op->sig_len,
+                                          op->f_rng, op->p_rng);
+        } else {
+            op->ret = mbedtls_pk_sign(op->key,
+                                      op->md_alg, op->hash, op->hash_len,
+                                      op->sig, sizeof(op->sig), &op->sig_len,
+                                      op->f_rng, op->p_rng);
+        }
+    }
+}
+
+int mbedtls_ssl_async_batch_run(mbedtls_ssl_async_batch *batch)
+{
+    size_t i, count = 0;
+
+    if (batch->ops == NULL) {
+        return 0;
+    }
+
+    if (SSL_ASYNC_BATCH_LOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    if (!batch->running) {
+        for (i = 0; i < batch->capacity; i++) {
+            if (batch->ops[i].state == SSL_ASYNC_BATCH_QUEUED) {
+                batch->ops[i].state = SSL_ASYNC_BATCH_RUNNING;
+                batch->queue[count++] = &batch->ops[i];
+            }
+        }
+        batch->running = count != 0;
+    }
+
+    if (SSL_ASYNC_BATCH_UNLOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    if (count == 0) {
+        return 0;
+    }
+
+    if (batch->f_sign != NULL) {
+        batch->f_sign(batch->p_sign, batch->queue, count);
+    } else {
+        ssl_async_batch_sign_each(batch->queue, count);
+    }
+
+    if (SSL_ASYNC_BATCH_LOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    for (i = 0; i < count; i++) {
+        batch->queue[i]->state =
+            batch->queue[i]->state == SSL_ASYNC_BATCH_CANCELLED ?
+            SSL_ASYNC_BATCH_FREE : SSL_ASYNC_BATCH_DONE;
+    }
+    batch->running = 0;
+
+    if (SSL_ASYNC_BATCH_UNLOCK(batch) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return (int) count;
+}
+
+void mbedtls_ssl_async_batch_free(mbedtls_ssl_async_batch *batch)
+{
+    if (batch == NULL) {
+        return;
+    }
+
+    if (batch->ops != NULL) {
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&batch->mutex);
+#endif
+        mbedtls_platform_zeroize(batch->ops,
+                                 batch->capacity * sizeof(mbedtls_ssl_async_batch_op));
+        mbedtls_free(batch->ops);
+        mbedtls_free(batch->queue);
+    }
+
+    mbedtls_platform_zeroize(batch, sizeof(mbedtls_ssl_async_batch));
+}
+
+#endif /* MBEDTLS_SSL_ASYNC_BATCH_C */
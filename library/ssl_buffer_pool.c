@@ -0,0 +1,189 @@
+/*
+ *  SSL record buffer pool implementation
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Free buffers are kept on a singly linked list, with the link stored in
+ * the first bytes of each free buffer.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_BUFFER_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_buffer_pool.h"
+#include "mbedtls/error.h"
+
+#include <string.h>
+
+#define SSL_BUFFER_POOL_DEFAULT_BUF_LEN                              \
+    ((MBEDTLS_SSL_IN_BUFFER_LEN > MBEDTLS_SSL_OUT_BUFFER_LEN) ?      \
+     MBEDTLS_SSL_IN_BUFFER_LEN : MBEDTLS_SSL_OUT_BUFFER_LEN)
+
+void mbedtls_ssl_buffer_pool_init(mbedtls_ssl_buffer_pool *pool)
+{
+    memset(pool, 0, sizeof(mbedtls_ssl_buffer_pool));
+
+    pool->buf_len = SSL_BUFFER_POOL_DEFAULT_BUF_LEN;
+    pool->max_free = MBEDTLS_SSL_BUFFER_POOL_DEFAULT_MAX_FREE;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&pool->mutex);
+#endif
+}
+
+static unsigned char *ssl_buffer_pool_next(const unsigned char *buf)
+{
+    unsigned char *next;
+
+    memcpy(&next, buf, sizeof(next));
+    return next;
+}
+
+/* Drop all free buffers. The caller must hold the mutex. */
+static void ssl_buffer_pool_drain(mbedtls_ssl_buffer_pool *pool)
+{
+    while (pool->free_list != NULL) {
+        unsigned char *buf = pool->free_list;
+
+        pool->free_list = ssl_buffer_pool_next(buf);
+        mbedtls_zeroize_and_free(buf, pool->buf_len);
+    }
+
+    pool->free_count = 0;
+}
+
+int mbedtls_ssl_buffer_pool_set_buf_len(mbedtls_ssl_buffer_pool *pool,
+                                        size_t buf_len)
+{
+    int ret = 0;
+
+    if (buf_len < sizeof(unsigned char *)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (pool->in_use != 0) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto exit;
+    }
+
+    ssl_buffer_pool_drain(pool);
+    pool->buf_len = buf_len;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_buffer_pool_set_max_free(mbedtls_ssl_buffer_pool *pool,
+                                          size_t max_free)
+{
+    pool->max_free = max_free;
+}
+
+unsigned char *mbedtls_ssl_buffer_pool_get(void *p_pool, size_t len)
+{
+    mbedtls_ssl_buffer_pool *pool = (mbedtls_ssl_buffer_pool *) p_pool;
+    unsigned char *buf = NULL;
+
+    if (len > pool->buf_len) {
+        return mbedtls_calloc_tagged(SSL_RECORD, 1, len);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&pool->mutex) != 0) {
+        return NULL;
+    }
+#endif
+
+    if (pool->free_list != NULL) {
+        buf = pool->free_list;
+        pool->free_list = ssl_buffer_pool_next(buf);
+        pool->free_count--;
+
+        /* The rest of the buffer was wiped when it was released. */
+        memset(buf, 0, sizeof(unsigned char *));
+    } else {
+        buf = mbedtls_calloc_tagged(SSL_RECORD, 1, pool->buf_len);
+    }
+
+    if (buf != NULL) {
+        pool->in_use++;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+
+    return buf;
+}
+
+void mbedtls_ssl_buffer_pool_release(void *p_pool, unsigned char *buf,
+                                     size_t len)
+{
+    mbedtls_ssl_buffer_pool *pool = (mbedtls_ssl_buffer_pool *) p_pool;
+
+    if (buf == NULL) {
+        return;
+    }
+
+    if (len > pool->buf_len) {
+        mbedtls_zeroize_and_free(buf, len);
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&pool->mutex) != 0) {
+        /* Can't touch the pool: don't leak the buffer, but don't decrement
+         * in_use either, which only prevents resizing the pool later. */
+        mbedtls_zeroize_and_free(buf, pool->buf_len);
+        return;
+    }
+#endif
+
+    pool->in_use--;
+
+    if (pool->free_count < pool->max_free) {
+        memcpy(buf, &pool->free_list, sizeof(pool->free_list));
+        pool->free_list = buf;
+        pool->free_count++;
+    } else {
+        mbedtls_zeroize_and_free(buf, pool->buf_len);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+}
+
+void mbedtls_ssl_buffer_pool_free(mbedtls_ssl_buffer_pool *pool)
+{
+    if (pool == NULL) {
+        return;
+    }
+
+    ssl_buffer_pool_drain(pool);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&pool->mutex);
+#endif
+
+    mbedtls_platform_zeroize(pool, sizeof(mbedtls_ssl_buffer_pool));
+}
+
+#endif /* MBEDTLS_SSL_BUFFER_POOL_C */
@@ -5,8 +5,10 @@
  *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
  */
 /*
- * These session callbacks use a simple chained list
- * to store and retrieve the session information.
+ * These session callbacks use a doubly linked list, ordered from the oldest
+ * to the newest entry, to store and retrieve the session information.
+ * Since all entries share the same timeout, expired entries are always at
+ * the start of the list, as is the entry to evict when the cache is full.
  */
 
 #include "ssl_misc.h"
@@ -20,6 +22,24 @@
 
 #include <string.h>
 
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+#include "mbedtls/psa_util.h"
+/* Define a local translating function to save code size by not using too many
+ * arguments in each translating place. */
+static int local_err_translation(psa_status_t status)
+{
+    return psa_status_to_mbedtls(status, psa_to_ssl_errors,
+                                 ARRAY_LENGTH(psa_to_ssl_errors),
+                                 psa_generic_status_to_mbedtls);
+}
+#define PSA_TO_MBEDTLS_ERR(status) local_err_translation(status)
+#endif
+
+/* Entries never leave the process and are keyed by the session ID, so
+ * neither the version header nor the TLS 1.2 ID is packed with them. */
+#define SSL_CACHE_PACK_FLAGS (MBEDTLS_SSL_SESSION_PACK_NO_HEADER | \
+                              MBEDTLS_SSL_SESSION_PACK_NO_ID)
+
 void mbedtls_ssl_cache_init(mbedtls_ssl_cache_context *cache)
 {
     memset(cache, 0, sizeof(mbedtls_ssl_cache_context));
@@ -32,44 +52,149 @@ void mbedtls_ssl_cache_init(mbedtls_ssl_cache_context *cache)
 #endif
 }
 
+/* Unlink an entry from the chain, without freeing it. */
+static void ssl_cache_unlink(mbedtls_ssl_cache_context *cache,
+                             mbedtls_ssl_cache_entry *entry)
+{
+    if (entry->prev != NULL) {
+        entry->prev->next = entry->next;
+    } else {
+        cache->chain = entry->next;
+    }
+
+    if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+    } else {
+        cache->chain_tail = entry->prev;
+    }
+
+    entry->next = NULL;
+    entry->prev = NULL;
+    cache->count--;
+}
+
+/* Append an entry, which must not be chained, at the newest end. */
+static void ssl_cache_append(mbedtls_ssl_cache_context *cache,
+                             mbedtls_ssl_cache_entry *entry)
+{
+    entry->next = NULL;
+    entry->prev = cache->chain_tail;
+
+    if (cache->chain_tail != NULL) {
+        cache->chain_tail->next = entry;
+    } else {
+        cache->chain = entry;
+    }
+
+    cache->chain_tail = entry;
+    cache->count++;
+}
+
+/* zeroize a cache entry */
+static void ssl_cache_entry_zeroize(mbedtls_ssl_cache_entry *entry)
+{
+    if (entry == NULL) {
+        return;
+    }
+
+    /* zeroize and free session structure */
+    if (entry->session != NULL) {
+        mbedtls_zeroize_and_free(entry->session, entry->session_len);
+    }
+
+    if (entry->session_record != NULL) {
+        mbedtls_ssl_session_free(entry->session_record);
+        mbedtls_free(entry->session_record);
+    }
+
+    /* zeroize the whole entry structure */
+    mbedtls_platform_zeroize(entry, sizeof(mbedtls_ssl_cache_entry));
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+static int ssl_cache_entry_expired(const mbedtls_ssl_cache_context *cache,
+                                   const mbedtls_ssl_cache_entry *entry,
+                                   mbedtls_time_t t)
+{
+    return cache->timeout != 0 &&
+           (int) (t - entry->timestamp) > cache->timeout;
+}
+
+/*
+ * Drop the expired entries. They are all at the start of the chain, so
+ * this only looks at entries that are actually freed, plus one.
+ */
+static void ssl_cache_expire(mbedtls_ssl_cache_context *cache,
+                             mbedtls_time_t t)
+{
+    mbedtls_ssl_cache_entry *cur;
+
+    while ((cur = cache->chain) != NULL &&
+           ssl_cache_entry_expired(cache, cur, t)) {
+        ssl_cache_unlink(cache, cur);
+        ssl_cache_entry_zeroize(cur);
+        mbedtls_free(cur);
+        cache->stats.expirations++;
+    }
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_cache_find_entry(mbedtls_ssl_cache_context *cache,
                                 unsigned char const *session_id,
                                 size_t session_id_len,
                                 mbedtls_ssl_cache_entry **dst)
 {
-    int ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    mbedtls_ssl_cache_entry *cur;
 #if defined(MBEDTLS_HAVE_TIME)
     mbedtls_time_t t = mbedtls_time(NULL);
+
+    ssl_cache_expire(cache, t);
 #endif
-    mbedtls_ssl_cache_entry *cur;
 
     for (cur = cache->chain; cur != NULL; cur = cur->next) {
 #if defined(MBEDTLS_HAVE_TIME)
-        if (cache->timeout != 0 &&
-            (int) (t - cur->timestamp) > cache->timeout) {
+        /* Only needed if the clock went backwards. */
+        if (ssl_cache_entry_expired(cache, cur, t)) {
             continue;
         }
 #endif
 
-        if (session_id_len != cur->session_id_len ||
+        if (session_id_len == cur->session_id_len &&
             memcmp(session_id, cur->session_id,
-                   cur->session_id_len) != 0) {
-            continue;
+                   cur->session_id_len) == 0) {
+            *dst = cur;
+            return 0;
         }
+    }
+
+    return MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+}
+
+
+/* Get the session of an entry: a copy of it, or a parsed one. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cache_entry_get_session(const mbedtls_ssl_cache_entry *entry,
+                                       mbedtls_ssl_session *session)
+{
+    int ret;
 
-        break;
+    if (entry->session_record != NULL) {
+        return mbedtls_ssl_session_copy_shared(session, entry->session_record);
     }
 
-    if (cur != NULL) {
-        *dst = cur;
-        ret = 0;
+    ret = mbedtls_ssl_session_unpack(session, SSL_CACHE_PACK_FLAGS,
+                                     entry->session,
+                                     entry->session_len);
+    if (ret == 0 && session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+        /* The ID is the key of the entry, it is not packed again. */
+        session->id_len = entry->session_id_len;
+        memcpy(session->id, entry->session_id, entry->session_id_len);
     }
 
     return ret;
 }
 
-
 int mbedtls_ssl_cache_get(void *data,
                           unsigned char const *session_id,
                           size_t session_id_len,
@@ -87,16 +212,16 @@ int mbedtls_ssl_cache_get(void *data,
 
     ret = ssl_cache_find_entry(cache, session_id, session_id_len, &entry);
     if (ret != 0) {
+        cache->stats.misses++;
         goto exit;
     }
 
-    ret = mbedtls_ssl_session_load(session,
-                                   entry->session,
-                                   entry->session_len);
+    ret = ssl_cache_entry_get_session(entry, session);
     if (ret != 0) {
         goto exit;
     }
 
+    cache->stats.hits++;
     ret = 0;
 
 exit:
@@ -109,22 +234,6 @@ exit:
     return ret;
 }
 
-/* zeroize a cache entry */
-static void ssl_cache_entry_zeroize(mbedtls_ssl_cache_entry *entry)
-{
-    if (entry == NULL) {
-        return;
-    }
-
-    /* zeroize and free session structure */
-    if (entry->session != NULL) {
-        mbedtls_zeroize_and_free(entry->session, entry->session_len);
-    }
-
-    /* zeroize the whole entry structure */
-    mbedtls_platform_zeroize(entry, sizeof(mbedtls_ssl_cache_entry));
-}
-
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_cache_pick_writing_slot(mbedtls_ssl_cache_context *cache,
                                        unsigned char const *session_id,
@@ -132,134 +241,78 @@ static int ssl_cache_pick_writing_slot(mbedtls_ssl_cache_context *cache,
                                        mbedtls_ssl_cache_entry **dst)
 {
 #if defined(MBEDTLS_HAVE_TIME)
-    mbedtls_time_t t = mbedtls_time(NULL), oldest = 0;
+    mbedtls_time_t t = mbedtls_time(NULL);
 #endif /* MBEDTLS_HAVE_TIME */
+    mbedtls_ssl_cache_entry *cur;
 
-    mbedtls_ssl_cache_entry *old = NULL;
-    int count = 0;
-    mbedtls_ssl_cache_entry *cur, *last;
+    /* Check 1: Drop expired entries, which frees up space if there are
+     * any. */
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl_cache_expire(cache, t);
+#endif
 
-    /* Check 1: Is there already an entry with the given session ID?
-     *
-     * If yes, overwrite it.
+    /* Check 2: Is there already an entry with the given session ID?
      *
-     * If not, `count` will hold the size of the session cache
-     * at the end of this loop, and `last` will point to the last
-     * entry, both of which will be used later. */
-
-    last = NULL;
+     * If yes, overwrite it. It becomes the newest entry. */
     for (cur = cache->chain; cur != NULL; cur = cur->next) {
-        count++;
         if (session_id_len == cur->session_id_len &&
             memcmp(session_id, cur->session_id, cur->session_id_len) == 0) {
+            ssl_cache_unlink(cache, cur);
             goto found;
         }
-        last = cur;
-    }
-
-    /* Check 2: Is there an outdated entry in the cache?
-     *
-     * If so, overwrite it.
-     *
-     * If not, remember the oldest entry in `old` for later.
-     */
-
-#if defined(MBEDTLS_HAVE_TIME)
-    for (cur = cache->chain; cur != NULL; cur = cur->next) {
-        if (cache->timeout != 0 &&
-            (int) (t - cur->timestamp) > cache->timeout) {
-            goto found;
-        }
-
-        if (oldest == 0 || cur->timestamp < oldest) {
-            oldest = cur->timestamp;
-            old = cur;
-        }
     }
-#endif /* MBEDTLS_HAVE_TIME */
 
     /* Check 3: Is there free space in the cache? */
-
-    if (count < cache->max_entries) {
+    if (cache->count < cache->max_entries) {
         /* Create new entry */
-        cur = mbedtls_calloc(1, sizeof(mbedtls_ssl_cache_entry));
+        cur = mbedtls_calloc_tagged(SSL_CACHE, 1, sizeof(mbedtls_ssl_cache_entry));
         if (cur == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
 
-        /* Append to the end of the linked list. */
-        if (last == NULL) {
-            cache->chain = cur;
-        } else {
-            last->next = cur;
-        }
-
         goto found;
     }
 
     /* Last resort: The cache is full and doesn't contain any outdated
-     * elements. In this case, we evict the oldest one, judged by timestamp
-     * (if present) or cache-order. */
-
-#if defined(MBEDTLS_HAVE_TIME)
-    if (old == NULL) {
+     * elements. In this case, we evict the oldest one, which is the
+     * first in the chain. */
+    cur = cache->chain;
+    if (cur == NULL) {
         /* This should only happen on an ill-configured cache
          * with max_entries == 0. */
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
-#else /* MBEDTLS_HAVE_TIME */
-    /* Reuse first entry in chain, but move to last place. */
-    if (cache->chain == NULL) {
-        /* This should never happen */
-        return MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    }
-
-    old = cache->chain;
-    cache->chain = old->next;
-    old->next = NULL;
-    last->next = old;
-#endif /* MBEDTLS_HAVE_TIME */
-
-    /* Now `old` points to the oldest entry to be overwritten. */
-    cur = old;
+    ssl_cache_unlink(cache, cur);
+    cache->stats.evictions++;
 
 found:
 
     /* If we're reusing an entry, free it first. */
-    if (cur->session != NULL) {
-        /* `ssl_cache_entry_zeroize` would break the chain,
-         * so we reuse `old` to record `next` temporarily. */
-        old = cur->next;
-        ssl_cache_entry_zeroize(cur);
-        cur->next = old;
-    }
+    ssl_cache_entry_zeroize(cur);
 
 #if defined(MBEDTLS_HAVE_TIME)
     cur->timestamp = t;
 #endif
 
+    ssl_cache_append(cache, cur);
+
     *dst = cur;
     return 0;
 }
 
-int mbedtls_ssl_cache_set(void *data,
-                          unsigned char const *session_id,
-                          size_t session_id_len,
-                          const mbedtls_ssl_session *session)
+/* Store a session as the newest entry. The cache must be locked. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cache_store(mbedtls_ssl_cache_context *cache,
+                           unsigned char const *session_id,
+                           size_t session_id_len,
+                           const mbedtls_ssl_session *session)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    mbedtls_ssl_cache_context *cache = (mbedtls_ssl_cache_context *) data;
-    mbedtls_ssl_cache_entry *cur;
+    mbedtls_ssl_cache_entry *cur = NULL;
 
     size_t session_serialized_len = 0;
     unsigned char *session_serialized = NULL;
 
-#if defined(MBEDTLS_THREADING_C)
-    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
-        return ret;
-    }
-#endif
-
     ret = ssl_cache_pick_writing_slot(cache,
                                       session_id, session_id_len,
                                       &cur);
@@ -267,21 +320,43 @@ int mbedtls_ssl_cache_set(void *data,
         goto exit;
     }
 
+    if (session_id_len > sizeof(cur->session_id)) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto exit;
+    }
+
+    if (cache->store_mode == MBEDTLS_SSL_CACHE_STORE_SESSION) {
+        cur->session_record = mbedtls_calloc_tagged(SSL_CACHE, 1, sizeof(mbedtls_ssl_session));
+        if (cur->session_record == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto exit;
+        }
+        mbedtls_ssl_session_init(cur->session_record);
+
+        ret = mbedtls_ssl_session_copy(cur->session_record, session);
+        if (ret != 0) {
+            goto exit;
+        }
+
+        goto stored;
+    }
+
     /* Check how much space we need to serialize the session
      * and allocate a sufficiently large buffer. */
-    ret = mbedtls_ssl_session_save(session, NULL, 0, &session_serialized_len);
+    ret = mbedtls_ssl_session_pack(session, SSL_CACHE_PACK_FLAGS,
+                                   NULL, 0, &session_serialized_len);
     if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
         goto exit;
     }
 
-    session_serialized = mbedtls_calloc(1, session_serialized_len);
+    session_serialized = mbedtls_calloc_tagged(SSL_CACHE, 1, session_serialized_len);
     if (session_serialized == NULL) {
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto exit;
     }
 
     /* Now serialize the session into the allocated buffer. */
-    ret = mbedtls_ssl_session_save(session,
+    ret = mbedtls_ssl_session_pack(session, SSL_CACHE_PACK_FLAGS,
                                    session_serialized,
                                    session_serialized_len,
                                    &session_serialized_len);
@@ -289,25 +364,24 @@ int mbedtls_ssl_cache_set(void *data,
         goto exit;
     }
 
-    if (session_id_len > sizeof(cur->session_id)) {
-        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-        goto exit;
-    }
-    cur->session_id_len = session_id_len;
-    memcpy(cur->session_id, session_id, session_id_len);
-
     cur->session = session_serialized;
     cur->session_len = session_serialized_len;
     session_serialized = NULL;
 
+stored:
+    cur->session_id_len = session_id_len;
+    memcpy(cur->session_id, session_id, session_id_len);
+
+    cache->stats.puts++;
     ret = 0;
 
 exit:
-#if defined(MBEDTLS_THREADING_C)
-    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
-        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    /* Don't leave an empty entry behind. */
+    if (ret != 0 && cur != NULL) {
+        ssl_cache_unlink(cache, cur);
+        ssl_cache_entry_zeroize(cur);
+        mbedtls_free(cur);
     }
-#endif
 
     if (session_serialized != NULL) {
         mbedtls_zeroize_and_free(session_serialized, session_serialized_len);
@@ -317,6 +391,31 @@ exit:
     return ret;
 }
 
+int mbedtls_ssl_cache_set(void *data,
+                          unsigned char const *session_id,
+                          size_t session_id_len,
+                          const mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_context *cache = (mbedtls_ssl_cache_context *) data;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ret = ssl_cache_store(cache, session_id, session_id_len, session);
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
 int mbedtls_ssl_cache_remove(void *data,
                              unsigned char const *session_id,
                              size_t session_id_len)
@@ -324,7 +423,6 @@ int mbedtls_ssl_cache_remove(void *data,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_ssl_cache_context *cache = (mbedtls_ssl_cache_context *) data;
     mbedtls_ssl_cache_entry *entry;
-    mbedtls_ssl_cache_entry *prev;
 
 #if defined(MBEDTLS_THREADING_C)
     if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
@@ -339,19 +437,7 @@ int mbedtls_ssl_cache_remove(void *data,
         goto exit;
     }
 
-    /* Now we remove the entry from the chain */
-    if (entry == cache->chain) {
-        cache->chain = entry->next;
-        goto free;
-    }
-    for (prev = cache->chain; prev->next != NULL; prev = prev->next) {
-        if (prev->next == entry) {
-            prev->next = entry->next;
-            break;
-        }
-    }
-
-free:
+    ssl_cache_unlink(cache, entry);
     ssl_cache_entry_zeroize(entry);
     mbedtls_free(entry);
     ret = 0;
@@ -386,6 +472,310 @@ void mbedtls_ssl_cache_set_max_entries(mbedtls_ssl_cache_context *cache, int max
     cache->max_entries = max;
 }
 
+void mbedtls_ssl_cache_set_store_mode(mbedtls_ssl_cache_context *cache, int mode)
+{
+    cache->store_mode = mode;
+}
+
+int mbedtls_ssl_cache_get_stats(mbedtls_ssl_cache_context *cache,
+                                mbedtls_ssl_cache_stats *stats)
+{
+#if defined(MBEDTLS_THREADING_C)
+    int ret;
+
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    *stats = cache->stats;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+/*
+ * Snapshot format:
+ *
+ *    opaque magic[4] = "MSCS";
+ *    uint8 version;
+ *    uint8 nonce_len;
+ *    opaque nonce[nonce_len];
+ *    opaque encrypted_entries<..>;     (with the AEAD tag)
+ *
+ * The header up to the nonce is the additional data. Each entry, from the
+ * oldest to the newest, is:
+ *
+ *    uint32 age;                       (in seconds)
+ *    uint8 id_len;
+ *    opaque id[id_len];
+ *    uint32 session_len;
+ *    opaque session[session_len];      (as by mbedtls_ssl_session_save())
+ */
+#define SSL_CACHE_SNAPSHOT_VERSION      1
+#define SSL_CACHE_SNAPSHOT_HEADER_LEN   6
+
+static const unsigned char ssl_cache_snapshot_magic[4] = { 'M', 'S', 'C', 'S' };
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cache_snapshot_alg(mbedtls_svc_key_id_t key,
+                                  psa_algorithm_t *alg,
+                                  size_t *nonce_len, size_t *tag_len)
+{
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+    psa_status_t status;
+    psa_key_type_t key_type;
+
+    status = psa_get_key_attributes(key, &attributes);
+    if (status != PSA_SUCCESS) {
+        return PSA_TO_MBEDTLS_ERR(status);
+    }
+
+    *alg = psa_get_key_algorithm(&attributes);
+    key_type = psa_get_key_type(&attributes);
+    *nonce_len = PSA_AEAD_NONCE_LENGTH(key_type, *alg);
+    *tag_len = PSA_AEAD_TAG_LENGTH(key_type, psa_get_key_bits(&attributes),
+                                   *alg);
+    psa_reset_key_attributes(&attributes);
+
+    if (!PSA_ALG_IS_AEAD(*alg) || *nonce_len == 0 || *nonce_len > 255) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_cache_save(mbedtls_ssl_cache_context *cache,
+                           mbedtls_svc_key_id_t key,
+                           unsigned char *buf, size_t buf_len,
+                           size_t *olen)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status;
+    psa_algorithm_t alg;
+    size_t nonce_len, tag_len, header_len, plain_len = 0, len, ciph_len;
+    size_t prefix_len, room;
+    unsigned char *plain, *p;
+    mbedtls_ssl_cache_entry *cur;
+    mbedtls_ssl_session session;
+    uint32_t age = 0;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time(NULL);
+#endif
+
+    *olen = 0;
+
+    if ((ret = ssl_cache_snapshot_alg(key, &alg, &nonce_len, &tag_len)) != 0) {
+        return ret;
+    }
+    header_len = SSL_CACHE_SNAPSHOT_HEADER_LEN + nonce_len;
+    plain = buf_len > header_len ? buf + header_len : NULL;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl_cache_expire(cache, t);
+#endif
+
+    /* Write the entries where they fit, and count the bytes of all of
+     * them. */
+    for (cur = cache->chain; cur != NULL; cur = cur->next) {
+        mbedtls_ssl_session_init(&session);
+        if ((ret = ssl_cache_entry_get_session(cur, &session)) != 0) {
+            mbedtls_ssl_session_free(&session);
+            goto exit;
+        }
+
+        prefix_len = 9 + cur->session_id_len;
+        room = plain == NULL ? 0 : buf_len - header_len - plain_len;
+        p = room > prefix_len ? plain + plain_len : NULL;
+        ret = mbedtls_ssl_session_save(&session,
+                                       p == NULL ? NULL : p + prefix_len,
+                                       p == NULL ? 0 : room - prefix_len,
+                                       &len);
+        mbedtls_ssl_session_free(&session);
+        if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+            plain = NULL;
+        } else if (ret != 0) {
+            goto exit;
+        }
+
+        if (plain != NULL) {
+#if defined(MBEDTLS_HAVE_TIME)
+            age = t > cur->timestamp ? (uint32_t) (t - cur->timestamp) : 0;
+#endif
+            MBEDTLS_PUT_UINT32_BE(age, p, 0);
+            p[4] = (unsigned char) cur->session_id_len;
+            memcpy(p + 5, cur->session_id, cur->session_id_len);
+            MBEDTLS_PUT_UINT32_BE(len, p, 5 + cur->session_id_len);
+        }
+        plain_len += prefix_len + len;
+    }
+
+    *olen = header_len + plain_len + tag_len;
+    if (plain == NULL || buf_len < *olen) {
+        ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+        goto exit;
+    }
+
+    memcpy(buf, ssl_cache_snapshot_magic, sizeof(ssl_cache_snapshot_magic));
+    buf[4] = SSL_CACHE_SNAPSHOT_VERSION;
+    buf[5] = (unsigned char) nonce_len;
+    status = psa_generate_random(buf + SSL_CACHE_SNAPSHOT_HEADER_LEN, nonce_len);
+    if (status == PSA_SUCCESS) {
+        status = psa_aead_encrypt(key, alg,
+                                  buf + SSL_CACHE_SNAPSHOT_HEADER_LEN, nonce_len,
+                                  buf, header_len,
+                                  plain, plain_len,
+                                  plain, buf_len - header_len, &ciph_len);
+    }
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        goto exit;
+    }
+    ret = 0;
+
+exit:
+    /* Leave no session secrets in the clear. */
+    if (ret != 0 && buf_len > header_len) {
+        mbedtls_platform_zeroize(buf + header_len, buf_len - header_len);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_cache_load(mbedtls_ssl_cache_context *cache,
+                           mbedtls_svc_key_id_t key,
+                           const unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status;
+    psa_algorithm_t alg;
+    size_t nonce_len, tag_len, header_len, plain_len = 0, id_len, session_len;
+    unsigned char *plain = NULL;
+    const unsigned char *p, *end;
+    mbedtls_ssl_session session;
+    uint32_t age;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time(NULL);
+#endif
+
+    if ((ret = ssl_cache_snapshot_alg(key, &alg, &nonce_len, &tag_len)) != 0) {
+        return ret;
+    }
+    header_len = SSL_CACHE_SNAPSHOT_HEADER_LEN + nonce_len;
+
+    if (len < header_len + tag_len ||
+        memcmp(buf, ssl_cache_snapshot_magic,
+               sizeof(ssl_cache_snapshot_magic)) != 0 ||
+        buf[5] != nonce_len) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    if (buf[4] != SSL_CACHE_SNAPSHOT_VERSION) {
+        return MBEDTLS_ERR_SSL_VERSION_MISMATCH;
+    }
+
+    plain = mbedtls_calloc_tagged(SSL_CACHE, 1, len - header_len);
+    if (plain == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    status = psa_aead_decrypt(key, alg,
+                              buf + SSL_CACHE_SNAPSHOT_HEADER_LEN, nonce_len,
+                              buf, header_len,
+                              buf + header_len, len - header_len,
+                              plain, len - header_len, &plain_len);
+    if (status != PSA_SUCCESS) {
+        mbedtls_free(plain);
+        return PSA_TO_MBEDTLS_ERR(status);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        mbedtls_zeroize_and_free(plain, len - header_len);
+        return ret;
+    }
+#endif
+
+    /* Entries are restored oldest first, after which the chain would no
+     * longer be in order if the cache already had some. */
+    if (cache->count != 0) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto exit;
+    }
+
+    p = plain;
+    end = plain + plain_len;
+    while (p < end) {
+        if (end - p < 5 || (id_len = p[4]) > 32 ||
+            (size_t) (end - p) < 9 + id_len) {
+            ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            goto exit;
+        }
+        age = MBEDTLS_GET_UINT32_BE(p, 0);
+        session_len = MBEDTLS_GET_UINT32_BE(p, 5 + id_len);
+        if ((size_t) (end - p) - 9 - id_len < session_len) {
+            ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            goto exit;
+        }
+
+#if defined(MBEDTLS_HAVE_TIME)
+        if (cache->timeout != 0 && age > (uint32_t) cache->timeout) {
+            p += 9 + id_len + session_len;
+            continue;
+        }
+#else
+        (void) age;
+#endif
+
+        mbedtls_ssl_session_init(&session);
+        ret = mbedtls_ssl_session_load(&session, p + 9 + id_len, session_len);
+        if (ret == 0) {
+            ret = ssl_cache_store(cache, p + 5, id_len, &session);
+        }
+        mbedtls_ssl_session_free(&session);
+        if (ret != 0) {
+            goto exit;
+        }
+
+#if defined(MBEDTLS_HAVE_TIME)
+        /* The entry just stored is the newest one. */
+        cache->chain_tail->timestamp = t - (mbedtls_time_t) age;
+#endif
+        p += 9 + id_len + session_len;
+    }
+
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    mbedtls_zeroize_and_free(plain, len - header_len);
+
+    return ret;
+}
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
 void mbedtls_ssl_cache_free(mbedtls_ssl_cache_context *cache)
 {
     mbedtls_ssl_cache_entry *cur, *prv;
@@ -404,6 +794,8 @@ void mbedtls_ssl_cache_free(mbedtls_ssl_cache_context *cache)
     mbedtls_mutex_free(&cache->mutex);
 #endif
     cache->chain = NULL;
+    cache->chain_tail = NULL;
+    cache->count = 0;
 }
 
 #endif /* MBEDTLS_SSL_CACHE_C */
@@ -0,0 +1,453 @@
+/*
+ *  SSL session cache with hash-indexed, lock-striped shards
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * Each shard is a chained hash table keyed by session ID, plus a doubly
+ * linked list of its entries in insertion order. The session ID hash
+ * selects both the shard and the bucket within it. Only the selected
+ * shard is locked, and session serialization happens before taking the
+ * lock.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_cache_sharded.h"
+#include "mbedtls/error.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+/* Entries never leave the process and are keyed by the session ID, so
+ * neither the version header nor the TLS 1.2 ID is packed with them. */
+#define SSL_CACHE_PACK_FLAGS (MBEDTLS_SSL_SESSION_PACK_NO_HEADER | \
+                              MBEDTLS_SSL_SESSION_PACK_NO_ID)
+
+/* Upper bounds that keep the allocation sizes below far from overflow. */
+#define SSL_CACHE_SHARDED_MAX_SHARDS    4096
+#define SSL_CACHE_SHARDED_MAX_ENTRIES   (1u << 24)
+
+void mbedtls_ssl_cache_sharded_init(mbedtls_ssl_cache_sharded_context *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_ssl_cache_sharded_context));
+
+    cache->timeout = MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_TIMEOUT;
+}
+
+static size_t ssl_cache_sharded_round_pow2(size_t n)
+{
+    size_t p = 1;
+
+    while (p < n) {
+        p <<= 1;
+    }
+
+    return p;
+}
+
+int mbedtls_ssl_cache_sharded_setup(mbedtls_ssl_cache_sharded_context *cache,
+                                    size_t num_shards, size_t max_entries)
+{
+    size_t i, buckets;
+
+    if (cache->shards != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (num_shards == 0) {
+        num_shards = MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_SHARDS;
+    }
+    if (max_entries == 0) {
+        max_entries = MBEDTLS_SSL_CACHE_SHARDED_DEFAULT_MAX_ENTRIES;
+    }
+    if (num_shards > SSL_CACHE_SHARDED_MAX_SHARDS ||
+        max_entries > SSL_CACHE_SHARDED_MAX_ENTRIES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    num_shards = ssl_cache_sharded_round_pow2(num_shards);
+
+    cache->shards = mbedtls_calloc_tagged(SSL_CACHE, num_shards, sizeof(mbedtls_ssl_cache_shard));
+    if (cache->shards == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    cache->shard_mask = num_shards - 1;
+    cache->max_per_shard = (max_entries + num_shards - 1) / num_shards;
+
+#if defined(MBEDTLS_THREADING_C)
+    for (i = 0; i < num_shards; i++) {
+        mbedtls_mutex_init(&cache->shards[i].mutex);
+    }
+#endif
+
+    /* Keep the load factor at or below 1. */
+    buckets = ssl_cache_sharded_round_pow2(cache->max_per_shard);
+    for (i = 0; i < num_shards; i++) {
+        mbedtls_ssl_cache_shard *shard = &cache->shards[i];
+
+        shard->buckets = mbedtls_calloc_tagged(SSL_CACHE, buckets,
+                                               sizeof(mbedtls_ssl_cache_sharded_entry *));
+        if (shard->buckets == NULL) {
+            mbedtls_ssl_cache_sharded_free(cache);
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        shard->bucket_mask = buckets - 1;
+    }
+
+    return 0;
+}
+
+/* FNV-1a. Session IDs are random, so this only needs to be cheap. */
+static uint32_t ssl_cache_sharded_hash(unsigned char const *session_id,
+                                       size_t session_id_len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, session_id, session_id_len);
+}
+
+static mbedtls_ssl_cache_shard *ssl_cache_sharded_shard(
+    const mbedtls_ssl_cache_sharded_context *cache, uint32_t hash)
+{
+    return &cache->shards[hash & cache->shard_mask];
+}
+
+/* The low bits of the hash pick the shard, use the next ones for the bucket. */
+static mbedtls_ssl_cache_sharded_entry **ssl_cache_sharded_bucket(
+    const mbedtls_ssl_cache_sharded_context *cache,
+    const mbedtls_ssl_cache_shard *shard, uint32_t hash)
+{
+    return &shard->buckets[(hash / (cache->shard_mask + 1)) & shard->bucket_mask];
+}
+
+static void ssl_cache_sharded_entry_free(mbedtls_ssl_cache_sharded_entry *entry)
+{
+    if (entry->session != NULL) {
+        mbedtls_zeroize_and_free(entry->session, entry->session_len);
+    }
+
+    mbedtls_platform_zeroize(entry, sizeof(mbedtls_ssl_cache_sharded_entry));
+    mbedtls_free(entry);
+}
+
+/* Unlink an entry from its shard and free it. The caller must hold the mutex. */
+static void ssl_cache_sharded_evict(const mbedtls_ssl_cache_sharded_context *cache,
+                                    mbedtls_ssl_cache_shard *shard,
+                                    mbedtls_ssl_cache_sharded_entry *entry)
+{
+    mbedtls_ssl_cache_sharded_entry **p =
+        ssl_cache_sharded_bucket(cache, shard, entry->hash);
+
+    while (*p != entry) {
+        p = &(*p)->bucket_next;
+    }
+    *p = entry->bucket_next;
+
+    if (entry->older != NULL) {
+        entry->older->newer = entry->newer;
+    } else {
+        shard->oldest = entry->newer;
+    }
+    if (entry->newer != NULL) {
+        entry->newer->older = entry->older;
+    } else {
+        shard->newest = entry->older;
+    }
+
+    shard->count--;
+    ssl_cache_sharded_entry_free(entry);
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+static int ssl_cache_sharded_expired(const mbedtls_ssl_cache_sharded_context *cache,
+                                     const mbedtls_ssl_cache_sharded_entry *entry,
+                                     mbedtls_time_t t)
+{
+    return cache->timeout != 0 &&
+           (int) (t - entry->timestamp) > cache->timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+/* Look up an entry, expired or not. The caller must hold the mutex. */
+static mbedtls_ssl_cache_sharded_entry *ssl_cache_sharded_find(
+    const mbedtls_ssl_cache_sharded_context *cache,
+    const mbedtls_ssl_cache_shard *shard,
+    unsigned char const *session_id, size_t session_id_len, uint32_t hash)
+{
+    mbedtls_ssl_cache_sharded_entry *cur;
+
+    for (cur = *ssl_cache_sharded_bucket(cache, shard, hash);
+         cur != NULL; cur = cur->bucket_next) {
+        if (cur->hash == hash &&
+            cur->session_id_len == session_id_len &&
+            memcmp(cur->session_id, session_id, session_id_len) == 0) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+int mbedtls_ssl_cache_sharded_get(void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_sharded_context *cache =
+        (mbedtls_ssl_cache_sharded_context *) data;
+    mbedtls_ssl_cache_shard *shard;
+    mbedtls_ssl_cache_sharded_entry *entry;
+    uint32_t hash;
+
+    if (cache->shards == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    hash = ssl_cache_sharded_hash(session_id, session_id_len);
+    shard = ssl_cache_sharded_shard(cache, hash);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&shard->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_cache_sharded_find(cache, shard, session_id, session_id_len,
+                                   hash);
+    if (entry == NULL) {
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+
+#if defined(MBEDTLS_HAVE_TIME)
+    if (ssl_cache_sharded_expired(cache, entry, mbedtls_time(NULL))) {
+        ssl_cache_sharded_evict(cache, shard, entry);
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+#endif
+
+    ret = mbedtls_ssl_session_unpack(session, SSL_CACHE_PACK_FLAGS,
+                                     entry->session, entry->session_len);
+    if (ret == 0 && session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+        /* The ID is the key of the entry, it is not packed again. */
+        session->id_len = entry->session_id_len;
+        memcpy(session->id, entry->session_id, entry->session_id_len);
+    }
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&shard->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_cache_sharded_set(void *data,
+                                  unsigned char const *session_id,
+                                  size_t session_id_len,
+                                  const mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_sharded_context *cache =
+        (mbedtls_ssl_cache_sharded_context *) data;
+    mbedtls_ssl_cache_shard *shard;
+    mbedtls_ssl_cache_sharded_entry *entry = NULL, *old;
+    mbedtls_ssl_cache_sharded_entry **bucket;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time(NULL);
+#endif
+    size_t session_serialized_len = 0;
+    uint32_t hash;
+
+    if (cache->shards == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    entry = mbedtls_calloc_tagged(SSL_CACHE, 1, sizeof(mbedtls_ssl_cache_sharded_entry));
+    if (entry == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    if (session_id_len > sizeof(entry->session_id)) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto cleanup;
+    }
+
+    /* Serialize the session before taking the lock. */
+    ret = mbedtls_ssl_session_pack(session, SSL_CACHE_PACK_FLAGS,
+                                   NULL, 0, &session_serialized_len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        goto cleanup;
+    }
+
+    entry->session = mbedtls_calloc_tagged(SSL_CACHE, 1, session_serialized_len);
+    if (entry->session == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto cleanup;
+    }
+    entry->session_len = session_serialized_len;
+
+    ret = mbedtls_ssl_session_pack(session, SSL_CACHE_PACK_FLAGS,
+                                   entry->session,
+                                   entry->session_len,
+                                   &entry->session_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
+    hash = ssl_cache_sharded_hash(session_id, session_id_len);
+    memcpy(entry->session_id, session_id, session_id_len);
+    entry->session_id_len = session_id_len;
+    entry->hash = hash;
+#if defined(MBEDTLS_HAVE_TIME)
+    entry->timestamp = t;
+#endif
+
+    shard = ssl_cache_sharded_shard(cache, hash);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&shard->mutex)) != 0) {
+        goto cleanup;
+    }
+#endif
+
+    /* An existing entry for this session ID is replaced. */
+    old = ssl_cache_sharded_find(cache, shard, session_id, session_id_len,
+                                 hash);
+    if (old != NULL) {
+        ssl_cache_sharded_evict(cache, shard, old);
+    }
+
+    /* Entries are in insertion order, so expired ones are at the head. */
+#if defined(MBEDTLS_HAVE_TIME)
+    while (shard->oldest != NULL &&
+           ssl_cache_sharded_expired(cache, shard->oldest, t)) {
+        ssl_cache_sharded_evict(cache, shard, shard->oldest);
+    }
+#endif
+
+    if (shard->count >= cache->max_per_shard && shard->oldest != NULL) {
+        ssl_cache_sharded_evict(cache, shard, shard->oldest);
+    }
+
+    bucket = ssl_cache_sharded_bucket(cache, shard, hash);
+    entry->bucket_next = *bucket;
+    *bucket = entry;
+
+    entry->older = shard->newest;
+    if (shard->newest != NULL) {
+        shard->newest->newer = entry;
+    } else {
+        shard->oldest = entry;
+    }
+    shard->newest = entry;
+    shard->count++;
+
+    entry = NULL;
+    ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&shard->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+cleanup:
+    if (entry != NULL) {
+        ssl_cache_sharded_entry_free(entry);
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_cache_sharded_remove(void *data,
+                                     unsigned char const *session_id,
+                                     size_t session_id_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_sharded_context *cache =
+        (mbedtls_ssl_cache_sharded_context *) data;
+    mbedtls_ssl_cache_shard *shard;
+    mbedtls_ssl_cache_sharded_entry *entry;
+    uint32_t hash;
+
+    if (cache->shards == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    hash = ssl_cache_sharded_hash(session_id, session_id_len);
+    shard = ssl_cache_sharded_shard(cache, hash);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&shard->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_cache_sharded_find(cache, shard, session_id, session_id_len,
+                                   hash);
+    if (entry != NULL) {
+        ssl_cache_sharded_evict(cache, shard, entry);
+    }
+    ret = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&shard->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_ssl_cache_sharded_set_timeout(mbedtls_ssl_cache_sharded_context *cache,
+                                           int timeout)
+{
+    if (timeout < 0) {
+        timeout = 0;
+    }
+
+    cache->timeout = timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+void mbedtls_ssl_cache_sharded_free(mbedtls_ssl_cache_sharded_context *cache)
+{
+    size_t i;
+
+    if (cache->shards == NULL) {
+        return;
+    }
+
+    for (i = 0; i <= cache->shard_mask; i++) {
+        mbedtls_ssl_cache_shard *shard = &cache->shards[i];
+        mbedtls_ssl_cache_sharded_entry *cur = shard->oldest, *next;
+
+        while (cur != NULL) {
+            next = cur->newer;
+            ssl_cache_sharded_entry_free(cur);
+            cur = next;
+        }
+
+        mbedtls_free(shard->buckets);
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&shard->mutex);
+#endif
+    }
+
+    mbedtls_free(cache->shards);
+    cache->shards = NULL;
+    cache->shard_mask = 0;
+    cache->max_per_shard = 0;
+}
+
+#endif /* MBEDTLS_SSL_CACHE_SHARDED_C */
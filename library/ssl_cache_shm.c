@@ -0,0 +1,585 @@
+/*
+ *  SSL session cache in memory shared between processes
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * The mapping starts with a header holding the shared ticket key, then
+ * holds a power of two of sets, each made of a process-shared mutex and a
+ * fixed number of entries. The session ID hash selects the set, which is
+ * searched linearly. A new session replaces, in this order, the entry with
+ * the same ID, a free entry, an expired entry, or the oldest one. Nothing
+ * in the mapping is a pointer, since each process may map it elsewhere.
+ */
+
+/* pthread_mutex_consistent() and robust mutexes, MAP_ANONYMOUS. Must be set
+ * before mbedtls_config.h, which pulls in glibc's features.h indirectly. */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_cache_shm.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "mbedtls/threading.h"
+#include "fnv_internal.h"
+
+#if defined(_WIN32)
+#error "MBEDTLS_SSL_CACHE_SHM_C needs mmap() and process-shared pthread mutexes"
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+
+#if defined(__linux__) || defined(__FreeBSD__)
+#define SSL_CACHE_SHM_ROBUST
+#endif
+
+/* Entries per set. */
+#define SSL_CACHE_SHM_WAYS          8
+
+/* Upper bounds that keep the mapping size below far from overflow. */
+#define SSL_CACHE_SHM_MAX_ENTRIES   (1u << 24)
+#define SSL_CACHE_SHM_MAX_ENTRY     (1u << 16)
+
+/* Alignment of the sets and entries within the mapping. */
+#define SSL_CACHE_SHM_ALIGN(n)      (((n) + 15) & ~(size_t) 15)
+
+typedef struct {
+    pthread_mutex_t mutex;          /* protects the ticket key */
+#if defined(MBEDTLS_SSL_TICKET_C)
+    int has_key;
+    uint32_t generation;            /* incremented with each new key */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t created;
+#endif
+    unsigned char name[MBEDTLS_SSL_TICKET_KEY_NAME_BYTES];
+    unsigned char key[MBEDTLS_SSL_TICKET_MAX_KEY_BYTES];
+#endif /* MBEDTLS_SSL_TICKET_C */
+} ssl_cache_shm_header;
+
+typedef struct {
+    pthread_mutex_t mutex;
+    uint64_t clock;                 /* insertion counter of the set */
+} ssl_cache_shm_set;
+
+typedef struct {
+    uint64_t stamp;                 /* value of the clock when inserted */
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t timestamp;
+#endif
+    uint32_t hash;
+    uint32_t session_len;           /* 0 for a free entry */
+    size_t session_id_len;
+    unsigned char session_id[32];
+    /* followed by the serialized session */
+} ssl_cache_shm_entry;
+
+#define SSL_CACHE_SHM_HEADER_SIZE   SSL_CACHE_SHM_ALIGN(sizeof(ssl_cache_shm_header))
+#define SSL_CACHE_SHM_SET_SIZE      SSL_CACHE_SHM_ALIGN(sizeof(ssl_cache_shm_set))
+#define SSL_CACHE_SHM_ENTRY_SIZE    SSL_CACHE_SHM_ALIGN(sizeof(ssl_cache_shm_entry))
+
+void mbedtls_ssl_cache_shm_init(mbedtls_ssl_cache_shm_context *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_ssl_cache_shm_context));
+
+    cache->timeout = MBEDTLS_SSL_CACHE_SHM_DEFAULT_TIMEOUT;
+}
+
+static size_t ssl_cache_shm_set_stride(const mbedtls_ssl_cache_shm_context *cache)
+{
+    return SSL_CACHE_SHM_SET_SIZE + SSL_CACHE_SHM_WAYS * cache->entry_stride;
+}
+
+static ssl_cache_shm_header *ssl_cache_shm_get_header(
+    const mbedtls_ssl_cache_shm_context *cache)
+{
+    return (ssl_cache_shm_header *) cache->shm;
+}
+
+static ssl_cache_shm_set *ssl_cache_shm_get_set(
+    const mbedtls_ssl_cache_shm_context *cache, size_t index)
+{
+    return (ssl_cache_shm_set *) (cache->shm + SSL_CACHE_SHM_HEADER_SIZE +
+                                  index * ssl_cache_shm_set_stride(cache));
+}
+
+static ssl_cache_shm_entry *ssl_cache_shm_get_entry(
+    const mbedtls_ssl_cache_shm_context *cache, ssl_cache_shm_set *set,
+    size_t way)
+{
+    return (ssl_cache_shm_entry *) ((unsigned char *) set + SSL_CACHE_SHM_SET_SIZE +
+                                    way * cache->entry_stride);
+}
+
+static unsigned char *ssl_cache_shm_entry_session(ssl_cache_shm_entry *entry)
+{
+    return (unsigned char *) entry + SSL_CACHE_SHM_ENTRY_SIZE;
+}
+
+static int ssl_cache_shm_mutex_init(pthread_mutex_t *mutex)
+{
+    pthread_mutexattr_t attr;
+    int ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+
+    if (pthread_mutexattr_init(&attr) != 0) {
+        return ret;
+    }
+
+    if (pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED) == 0 &&
+#if defined(SSL_CACHE_SHM_ROBUST)
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST) == 0 &&
+#endif
+        pthread_mutex_init(mutex, &attr) == 0) {
+        ret = 0;
+    }
+
+    (void) pthread_mutexattr_destroy(&attr);
+
+    return ret;
+}
+
+/*
+ * Lock a mutex of the mapping. If its previous owner died holding it, what
+ * it protects may be inconsistent: report it so that the caller resets it.
+ */
+static int ssl_cache_shm_lock(pthread_mutex_t *mutex, int *owner_died)
+{
+    int ret = pthread_mutex_lock(mutex);
+
+    *owner_died = 0;
+
+#if defined(SSL_CACHE_SHM_ROBUST)
+    if (ret == EOWNERDEAD) {
+        *owner_died = 1;
+        ret = pthread_mutex_consistent(mutex);
+    }
+#endif
+
+    return ret == 0 ? 0 : MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+}
+
+static int ssl_cache_shm_unlock(pthread_mutex_t *mutex)
+{
+    return pthread_mutex_unlock(mutex) == 0 ? 0 : MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+}
+
+static void ssl_cache_shm_entry_clear(const mbedtls_ssl_cache_shm_context *cache,
+                                      ssl_cache_shm_entry *entry)
+{
+    mbedtls_platform_zeroize(entry, SSL_CACHE_SHM_ENTRY_SIZE + cache->entry_size);
+}
+
+/* Lock the set of a hash, emptying it if a process died while updating it. */
+static int ssl_cache_shm_lock_set(const mbedtls_ssl_cache_shm_context *cache,
+                                  uint32_t hash, ssl_cache_shm_set **set)
+{
+    int ret, owner_died;
+    size_t way;
+
+    *set = ssl_cache_shm_get_set(cache, hash & cache->set_mask);
+
+    if ((ret = ssl_cache_shm_lock(&(*set)->mutex, &owner_died)) != 0) {
+        return ret;
+    }
+
+    if (owner_died) {
+        for (way = 0; way < SSL_CACHE_SHM_WAYS; way++) {
+            ssl_cache_shm_entry_clear(cache, ssl_cache_shm_get_entry(cache, *set, way));
+        }
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_cache_shm_setup(mbedtls_ssl_cache_shm_context *cache,
+                                size_t max_entries, size_t entry_size)
+{
+    size_t sets = 1, i;
+    ssl_cache_shm_header *header;
+
+    if (cache->shm != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (max_entries == 0) {
+        max_entries = MBEDTLS_SSL_CACHE_SHM_DEFAULT_MAX_ENTRIES;
+    }
+    if (entry_size == 0) {
+        entry_size = MBEDTLS_SSL_CACHE_SHM_DEFAULT_ENTRY_SIZE;
+    }
+    if (max_entries > SSL_CACHE_SHM_MAX_ENTRIES ||
+        entry_size > SSL_CACHE_SHM_MAX_ENTRY) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (sets * SSL_CACHE_SHM_WAYS < max_entries) {
+        sets <<= 1;
+    }
+
+    cache->entry_size = entry_size;
+    cache->entry_stride = SSL_CACHE_SHM_ENTRY_SIZE + SSL_CACHE_SHM_ALIGN(entry_size);
+    cache->set_mask = sets - 1;
+    cache->shm_len = SSL_CACHE_SHM_HEADER_SIZE + sets * ssl_cache_shm_set_stride(cache);
+
+    /* Anonymous mappings are zero-filled: all the entries start free. */
+    cache->shm = mmap(NULL, cache->shm_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (cache->shm == MAP_FAILED) {
+        cache->shm = NULL;
+        cache->shm_len = 0;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    header = ssl_cache_shm_get_header(cache);
+    if (ssl_cache_shm_mutex_init(&header->mutex) != 0) {
+        goto fail;
+    }
+    for (i = 0; i < sets; i++) {
+        if (ssl_cache_shm_mutex_init(&ssl_cache_shm_get_set(cache, i)->mutex) != 0) {
+            while (i-- > 0) {
+                (void) pthread_mutex_destroy(&ssl_cache_shm_get_set(cache, i)->mutex);
+            }
+            (void) pthread_mutex_destroy(&header->mutex);
+            goto fail;
+        }
+    }
+
+    cache->owner = (long) getpid();
+    cache->ticket_generation = 0;
+
+    return 0;
+
+fail:
+    (void) munmap(cache->shm, cache->shm_len);
+    cache->shm = NULL;
+    cache->shm_len = 0;
+    return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+}
+
+/* FNV-1a. Session IDs are random, so this only needs to be cheap. */
+static uint32_t ssl_cache_shm_hash(unsigned char const *session_id,
+                                   size_t session_id_len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, session_id, session_id_len);
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+static int ssl_cache_shm_expired(const mbedtls_ssl_cache_shm_context *cache,
+                                 const ssl_cache_shm_entry *entry,
+                                 mbedtls_time_t t)
+{
+    return cache->timeout != 0 &&
+           (int) (t - entry->timestamp) > cache->timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+/* Look up an entry, expired or not. The caller must hold the set mutex. */
+static ssl_cache_shm_entry *ssl_cache_shm_find(
+    const mbedtls_ssl_cache_shm_context *cache, ssl_cache_shm_set *set,
+    unsigned char const *session_id, size_t session_id_len, uint32_t hash)
+{
+    ssl_cache_shm_entry *entry;
+    size_t way;
+
+    for (way = 0; way < SSL_CACHE_SHM_WAYS; way++) {
+        entry = ssl_cache_shm_get_entry(cache, set, way);
+        if (entry->session_len != 0 && entry->hash == hash &&
+            entry->session_id_len == session_id_len &&
+            memcmp(entry->session_id, session_id, session_id_len) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+int mbedtls_ssl_cache_shm_get(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_shm_context *cache = (mbedtls_ssl_cache_shm_context *) data;
+    ssl_cache_shm_set *set;
+    ssl_cache_shm_entry *entry;
+    uint32_t hash;
+
+    if (cache->shm == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    hash = ssl_cache_shm_hash(session_id, session_id_len);
+    if ((ret = ssl_cache_shm_lock_set(cache, hash, &set)) != 0) {
+        return ret;
+    }
+
+    entry = ssl_cache_shm_find(cache, set, session_id, session_id_len, hash);
+    if (entry == NULL) {
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+
+#if defined(MBEDTLS_HAVE_TIME)
+    if (ssl_cache_shm_expired(cache, entry, mbedtls_time(NULL))) {
+        ssl_cache_shm_entry_clear(cache, entry);
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+#endif
+
+    ret = mbedtls_ssl_session_load(session, ssl_cache_shm_entry_session(entry),
+                                   entry->session_len);
+
+exit:
+    if (ssl_cache_shm_unlock(&set->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_cache_shm_set(void *data,
+                              unsigned char const *session_id,
+                              size_t session_id_len,
+                              const mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_shm_context *cache = (mbedtls_ssl_cache_shm_context *) data;
+    ssl_cache_shm_set *set;
+    ssl_cache_shm_entry *entry, *cur;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time(NULL);
+#endif
+    unsigned char *serialized = NULL;
+    size_t serialized_len = 0, way;
+    uint32_t hash;
+
+    if (cache->shm == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (session_id_len > sizeof(entry->session_id)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Serialize the session before taking the lock. */
+    ret = mbedtls_ssl_session_save(session, NULL, 0, &serialized_len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return ret;
+    }
+    if (serialized_len == 0 || serialized_len > cache->entry_size) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    serialized = mbedtls_calloc_tagged(SSL_CACHE, 1, serialized_len);
+    if (serialized == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    ret = mbedtls_ssl_session_save(session, serialized, serialized_len,
+                                   &serialized_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
+    hash = ssl_cache_shm_hash(session_id, session_id_len);
+    if ((ret = ssl_cache_shm_lock_set(cache, hash, &set)) != 0) {
+        goto cleanup;
+    }
+
+    /* An existing entry for this session ID is replaced, otherwise a free
+     * one, an expired one, or the oldest one. */
+    entry = ssl_cache_shm_find(cache, set, session_id, session_id_len, hash);
+    for (way = 0; entry == NULL && way < SSL_CACHE_SHM_WAYS; way++) {
+        cur = ssl_cache_shm_get_entry(cache, set, way);
+        if (cur->session_len == 0) {
+            entry = cur;
+        }
+    }
+#if defined(MBEDTLS_HAVE_TIME)
+    for (way = 0; entry == NULL && way < SSL_CACHE_SHM_WAYS; way++) {
+        cur = ssl_cache_shm_get_entry(cache, set, way);
+        if (ssl_cache_shm_expired(cache, cur, t)) {
+            entry = cur;
+        }
+    }
+#endif
+    if (entry == NULL) {
+        entry = ssl_cache_shm_get_entry(cache, set, 0);
+        for (way = 1; way < SSL_CACHE_SHM_WAYS; way++) {
+            cur = ssl_cache_shm_get_entry(cache, set, way);
+            if (cur->stamp < entry->stamp) {
+                entry = cur;
+            }
+        }
+    }
+
+    ssl_cache_shm_entry_clear(cache, entry);
+    memcpy(ssl_cache_shm_entry_session(entry), serialized, serialized_len);
+    memcpy(entry->session_id, session_id, session_id_len);
+    entry->session_id_len = session_id_len;
+    entry->hash = hash;
+#if defined(MBEDTLS_HAVE_TIME)
+    entry->timestamp = t;
+#endif
+    entry->stamp = ++set->clock;
+    entry->session_len = (uint32_t) serialized_len;
+
+    ret = ssl_cache_shm_unlock(&set->mutex);
+
+cleanup:
+    mbedtls_zeroize_and_free(serialized, serialized_len);
+
+    return ret;
+}
+
+int mbedtls_ssl_cache_shm_remove(void *data,
+                                 unsigned char const *session_id,
+                                 size_t session_id_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cache_shm_context *cache = (mbedtls_ssl_cache_shm_context *) data;
+    ssl_cache_shm_set *set;
+    ssl_cache_shm_entry *entry;
+    uint32_t hash;
+
+    if (cache->shm == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    hash = ssl_cache_shm_hash(session_id, session_id_len);
+    if ((ret = ssl_cache_shm_lock_set(cache, hash, &set)) != 0) {
+        return ret;
+    }
+
+    entry = ssl_cache_shm_find(cache, set, session_id, session_id_len, hash);
+    if (entry != NULL) {
+        ssl_cache_shm_entry_clear(cache, entry);
+    }
+
+    return ssl_cache_shm_unlock(&set->mutex);
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_ssl_cache_shm_set_timeout(mbedtls_ssl_cache_shm_context *cache,
+                                       int timeout)
+{
+    if (timeout < 0) {
+        timeout = 0;
+    }
+
+    cache->timeout = timeout;
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+int mbedtls_ssl_cache_shm_ticket_sync(mbedtls_ssl_cache_shm_context *cache,
+                                      mbedtls_ssl_ticket_context *ticket,
+                                      int (*f_rng)(void *, unsigned char *, size_t),
+                                      void *p_rng,
+                                      uint32_t lifetime)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    ssl_cache_shm_header *header;
+    unsigned char name[MBEDTLS_SSL_TICKET_KEY_NAME_BYTES];
+    unsigned char key[MBEDTLS_SSL_TICKET_MAX_KEY_BYTES];
+    uint32_t generation = cache->ticket_generation;
+    int owner_died, expired;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t t = mbedtls_time(NULL);
+#endif
+
+    if (cache->shm == NULL || f_rng == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    header = ssl_cache_shm_get_header(cache);
+    if ((ret = ssl_cache_shm_lock(&header->mutex, &owner_died)) != 0) {
+        return ret;
+    }
+
+    /* A key that a dying process may have been writing is replaced. */
+    expired = owner_died || !header->has_key;
+#if defined(MBEDTLS_HAVE_TIME)
+    expired = expired ||
+              (lifetime != 0 && t - header->created >= (mbedtls_time_t) lifetime);
+#endif
+
+    if (expired) {
+        if ((ret = f_rng(p_rng, header->name, sizeof(header->name))) != 0 ||
+            (ret = f_rng(p_rng, header->key, sizeof(header->key))) != 0) {
+            header->has_key = 0;
+            goto unlock;
+        }
+#if defined(MBEDTLS_HAVE_TIME)
+        header->created = t;
+#endif
+        header->generation++;
+        header->has_key = 1;
+    }
+
+    generation = header->generation;
+    if (generation != cache->ticket_generation) {
+        memcpy(name, header->name, sizeof(name));
+        memcpy(key, header->key, sizeof(key));
+    }
+
+unlock:
+    if (ssl_cache_shm_unlock(&header->mutex) != 0 && ret == 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+    if (ret != 0 || generation == cache->ticket_generation) {
+        goto exit;
+    }
+
+    /* Outside the shared lock: this takes the ticket context mutex. */
+    ret = mbedtls_ssl_ticket_rotate(ticket, name, sizeof(name),
+                                    key, sizeof(key), lifetime);
+    if (ret == 0) {
+        cache->ticket_generation = generation;
+    }
+
+exit:
+    mbedtls_platform_zeroize(key, sizeof(key));
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TICKET_C */
+
+void mbedtls_ssl_cache_shm_free(mbedtls_ssl_cache_shm_context *cache)
+{
+    size_t i;
+
+    if (cache == NULL || cache->shm == NULL) {
+        return;
+    }
+
+    if (cache->owner == (long) getpid()) {
+        for (i = 0; i <= cache->set_mask; i++) {
+            (void) pthread_mutex_destroy(&ssl_cache_shm_get_set(cache, i)->mutex);
+        }
+        (void) pthread_mutex_destroy(&ssl_cache_shm_get_header(cache)->mutex);
+        mbedtls_platform_zeroize(cache->shm, cache->shm_len);
+    }
+
+    (void) munmap(cache->shm, cache->shm_len);
+
+    mbedtls_platform_zeroize(cache, sizeof(mbedtls_ssl_cache_shm_context));
+}
+
+#endif /* MBEDTLS_SSL_CACHE_SHM_C */
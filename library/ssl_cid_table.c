@@ -0,0 +1,367 @@
+/*
+ *  DTLS connection ID lookup table
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * An open addressing hash table with linear probing. Entries never move:
+ * a removed entry leaves a tombstone, which a later insertion may reuse, so
+ * a reader probing concurrently with an update sees every slot either before
+ * or after it. Each slot is protected by a sequence counter (a seqlock), so
+ * a reader copies it, then checks that the counter did not change and was
+ * even, meaning no update was in progress. Updates are serialized by the
+ * table mutex.
+ *
+ * The seqlock needs atomic loads and stores. Where the compiler offers none
+ * that this file knows, lookups take the table mutex instead.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CID_TABLE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_cid_table.h"
+#include "mbedtls/error.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+#if defined(MBEDTLS_THREADING_C)
+#if defined(__GNUC__) || defined(__clang__)
+#define CID_LOAD_ACQUIRE(p)         __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define CID_LOAD_RELAXED(p)         __atomic_load_n((p), __ATOMIC_RELAXED)
+#define CID_STORE_RELAXED(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define CID_STORE_RELEASE(p, v)     __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define CID_FENCE_ACQUIRE()         __atomic_thread_fence(__ATOMIC_ACQUIRE)
+#define CID_FENCE_RELEASE()         __atomic_thread_fence(__ATOMIC_RELEASE)
+#else
+#define SSL_CID_TABLE_LOCKED_LOOKUPS
+#endif
+#endif /* MBEDTLS_THREADING_C */
+
+#if !defined(MBEDTLS_THREADING_C) || defined(SSL_CID_TABLE_LOCKED_LOOKUPS)
+#define CID_LOAD_ACQUIRE(p)         (*(p))
+#define CID_LOAD_RELAXED(p)         (*(p))
+#define CID_STORE_RELAXED(p, v)     (*(p) = (v))
+#define CID_STORE_RELEASE(p, v)     (*(p) = (v))
+#define CID_FENCE_ACQUIRE()
+#define CID_FENCE_RELEASE()
+#endif
+
+#define SSL_CID_TABLE_EMPTY     0
+#define SSL_CID_TABLE_USED      1
+#define SSL_CID_TABLE_REMOVED   2
+
+/* More connections than one process serves. The table then has at most
+ * 2^25 slots, of about 48 bytes with the default MBEDTLS_SSL_CID_IN_LEN_MAX,
+ * a size that fits in a 32-bit size_t. */
+#define SSL_CID_TABLE_MAX_ENTRIES   (1u << 24)
+
+/* Offset of the CID in a DTLS 1.2 record header: type, version, epoch and
+ * sequence number precede it, and the length follows it. */
+#define SSL_CID_RECORD_CID_OFFSET   11
+
+int mbedtls_ssl_peek_record_cid(const unsigned char *buf, size_t len,
+                                size_t cid_len, const unsigned char **cid)
+{
+    if (cid_len == 0 || len < SSL_CID_RECORD_CID_OFFSET + cid_len + 2 ||
+        buf[0] != MBEDTLS_SSL_MSG_CID || buf[1] != 0xfe) {
+        return MBEDTLS_ERR_SSL_UNEXPECTED_RECORD;
+    }
+
+    *cid = buf + SSL_CID_RECORD_CID_OFFSET;
+
+    return 0;
+}
+
+void mbedtls_ssl_cid_table_init(mbedtls_ssl_cid_table *table)
+{
+    memset(table, 0, sizeof(mbedtls_ssl_cid_table));
+}
+
+int mbedtls_ssl_cid_table_setup(mbedtls_ssl_cid_table *table,
+                                size_t cid_len, size_t max_entries)
+{
+    size_t slots = 1;
+
+    if (table->entries != NULL || cid_len == 0 ||
+        cid_len > MBEDTLS_SSL_CID_IN_LEN_MAX || max_entries == 0 ||
+        max_entries > SSL_CID_TABLE_MAX_ENTRIES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Keep the load factor at or below 1/2. */
+    while (slots < 2 * max_entries) {
+        slots <<= 1;
+    }
+
+    table->entries = mbedtls_calloc_tagged(SSL_CACHE, slots, sizeof(mbedtls_ssl_cid_table_entry));
+    if (table->entries == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    table->mask = slots - 1;
+    table->cid_len = cid_len;
+    table->max_entries = max_entries;
+    table->count = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&table->mutex);
+#endif
+
+    return 0;
+}
+
+/* FNV-1a. Connection IDs are chosen by the server, so this only needs to
+ * be cheap. */
+static uint32_t ssl_cid_table_hash(const unsigned char *cid, size_t cid_len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, cid, cid_len);
+}
+
+/*
+ * Take a consistent snapshot of a slot, retrying while it is being
+ * written. Returns the state, and whether the CID matches in *match.
+ */
+static unsigned char ssl_cid_table_read(const mbedtls_ssl_cid_table_entry *entry,
+                                        const unsigned char *cid, size_t cid_len,
+                                        int *match, mbedtls_ssl_context **ssl)
+{
+    unsigned seq;
+    unsigned char state, diff;
+    size_t i;
+
+    for (;;) {
+        seq = CID_LOAD_ACQUIRE(&entry->seq);
+        if (seq & 1) {
+            continue;
+        }
+
+        state = CID_LOAD_RELAXED(&entry->state);
+        diff = 0;
+        for (i = 0; i < cid_len; i++) {
+            diff |= (unsigned char) (CID_LOAD_RELAXED(&entry->cid[i]) ^ cid[i]);
+        }
+        *ssl = CID_LOAD_RELAXED(&entry->ssl);
+
+        CID_FENCE_ACQUIRE();
+        if (CID_LOAD_RELAXED(&entry->seq) == seq) {
+            *match = (diff == 0);
+            return state;
+        }
+    }
+}
+
+/* Update a slot. The caller must hold the mutex. */
+static void ssl_cid_table_write(mbedtls_ssl_cid_table_entry *entry,
+                                unsigned char state,
+                                const unsigned char *cid, size_t cid_len,
+                                mbedtls_ssl_context *ssl)
+{
+    unsigned seq = entry->seq;
+    size_t i;
+
+    CID_STORE_RELAXED(&entry->seq, seq + 1);
+    CID_FENCE_RELEASE();
+
+    CID_STORE_RELAXED(&entry->state, state);
+    for (i = 0; cid != NULL && i < cid_len; i++) {
+        CID_STORE_RELAXED(&entry->cid[i], cid[i]);
+    }
+    CID_STORE_RELAXED(&entry->ssl, ssl);
+
+    CID_STORE_RELEASE(&entry->seq, seq + 2);
+}
+
+/*
+ * Find the slot holding a CID. If slot is not NULL, it is set to the first
+ * reusable slot on the probe sequence, for an insertion.
+ */
+static mbedtls_ssl_cid_table_entry *ssl_cid_table_find(
+    const mbedtls_ssl_cid_table *table, const unsigned char *cid,
+    mbedtls_ssl_cid_table_entry **slot, mbedtls_ssl_context **ssl)
+{
+    mbedtls_ssl_cid_table_entry *entry;
+    size_t i, n;
+    unsigned char state;
+    int match;
+
+    if (slot != NULL) {
+        *slot = NULL;
+    }
+
+    i = ssl_cid_table_hash(cid, table->cid_len) & table->mask;
+    for (n = 0; n <= table->mask; n++, i = (i + 1) & table->mask) {
+        entry = &table->entries[i];
+        state = ssl_cid_table_read(entry, cid, table->cid_len, &match, ssl);
+
+        if (state == SSL_CID_TABLE_USED && match) {
+            return entry;
+        }
+        if (state != SSL_CID_TABLE_USED && slot != NULL && *slot == NULL) {
+            *slot = entry;
+        }
+        if (state == SSL_CID_TABLE_EMPTY) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+mbedtls_ssl_context *mbedtls_ssl_cid_table_get(const mbedtls_ssl_cid_table *table,
+                                               const unsigned char *cid,
+                                               size_t cid_len)
+{
+    mbedtls_ssl_context *ssl;
+#if defined(SSL_CID_TABLE_LOCKED_LOOKUPS)
+    /* Locking does not change the contents of the table. */
+    mbedtls_threading_mutex_t *mutex = (mbedtls_threading_mutex_t *) &table->mutex;
+#endif
+
+    if (table->entries == NULL || cid_len != table->cid_len) {
+        return NULL;
+    }
+
+#if defined(SSL_CID_TABLE_LOCKED_LOOKUPS)
+    if (mbedtls_mutex_lock(mutex) != 0) {
+        return NULL;
+    }
+#endif
+
+    if (ssl_cid_table_find(table, cid, NULL, &ssl) == NULL) {
+        ssl = NULL;
+    }
+
+#if defined(SSL_CID_TABLE_LOCKED_LOOKUPS)
+    if (mbedtls_mutex_unlock(mutex) != 0) {
+        return NULL;
+    }
+#endif
+
+    return ssl;
+}
+
+mbedtls_ssl_context *mbedtls_ssl_cid_table_get_record(const mbedtls_ssl_cid_table *table,
+                                                      const unsigned char *buf,
+                                                      size_t len)
+{
+    const unsigned char *cid;
+
+    if (mbedtls_ssl_peek_record_cid(buf, len, table->cid_len, &cid) != 0) {
+        return NULL;
+    }
+
+    return mbedtls_ssl_cid_table_get(table, cid, table->cid_len);
+}
+
+int mbedtls_ssl_cid_table_add(mbedtls_ssl_cid_table *table,
+                              const unsigned char *cid, size_t cid_len,
+                              mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cid_table_entry *slot;
+    mbedtls_ssl_context *found;
+
+    if (table->entries == NULL || cid_len != table->cid_len || ssl == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&table->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (ssl_cid_table_find(table, cid, &slot, &found) != NULL) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto exit;
+    }
+    if (table->count >= table->max_entries || slot == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+
+    ssl_cid_table_write(slot, SSL_CID_TABLE_USED, cid, cid_len, ssl);
+    table->count++;
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&table->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_cid_table_remove(mbedtls_ssl_cid_table *table,
+                                 const unsigned char *cid, size_t cid_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_cid_table_entry *entry;
+    mbedtls_ssl_context *found;
+    size_t i;
+
+    if (table->entries == NULL || cid_len != table->cid_len) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&table->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    entry = ssl_cid_table_find(table, cid, NULL, &found);
+    if (entry == NULL) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto exit;
+    }
+
+    ssl_cid_table_write(entry, SSL_CID_TABLE_REMOVED, NULL, 0, NULL);
+    table->count--;
+
+    /* A run of tombstones followed by an empty slot cannot be on the probe
+     * sequence of any entry, so it can be emptied, which keeps failed
+     * lookups short. */
+    i = (size_t) (entry - table->entries);
+    if (table->entries[(i + 1) & table->mask].state == SSL_CID_TABLE_EMPTY) {
+        while (table->entries[i].state == SSL_CID_TABLE_REMOVED) {
+            ssl_cid_table_write(&table->entries[i], SSL_CID_TABLE_EMPTY,
+                                NULL, 0, NULL);
+            i = (i - 1) & table->mask;
+        }
+    }
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&table->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_cid_table_free(mbedtls_ssl_cid_table *table)
+{
+    if (table == NULL) {
+        return;
+    }
+
+    if (table->entries != NULL) {
+        mbedtls_free(table->entries);
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&table->mutex);
+#endif
+    }
+
+    mbedtls_platform_zeroize(table, sizeof(mbedtls_ssl_cid_table));
+}
+
+#endif /* MBEDTLS_SSL_CID_TABLE_C */
@@ -119,7 +119,7 @@ static int ssl_write_alpn_ext(mbedtls_ssl_context *ssl,
 
     *out_len = 0;
 
-    if (ssl->conf->alpn_list == NULL) {
+    if (mbedtls_ssl_get_alpn_list(ssl) == NULL) {
         return 0;
     }
 
@@ -141,7 +141,7 @@ static int ssl_write_alpn_ext(mbedtls_ssl_context *ssl,
      *     ProtocolName protocol_name_list<2..2^16-1>
      * } ProtocolNameList;
      */
-    for (const char **cur = ssl->conf->alpn_list; *cur != NULL; cur++) {
+    for (const char **cur = mbedtls_ssl_get_alpn_list(ssl); *cur != NULL; cur++) {
         /*
          * mbedtls_ssl_conf_set_alpn_protocols() checked that the length of
          * protocol names is less than 255.
@@ -336,7 +336,7 @@ static int ssl_write_client_hello_cipher_suites(
      * ( including secret key length ) and a hash to be used with
      * HKDF, in descending order of client preference.
      */
-    ciphersuite_list = ssl->conf->ciphersuite_list;
+    ciphersuite_list = mbedtls_ssl_get_ciphersuite_list(ssl);
 
     /* Check there is space for the cipher suite list length (2 bytes). */
     MBEDTLS_SSL_CHK_BUF_PTR(p, end, 2);
@@ -591,6 +591,14 @@ static int ssl_write_client_hello_body(mbedtls_ssl_context *ssl,
     p += output_len;
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    ret = mbedtls_ssl_write_cached_info_ext(ssl, p, end, &output_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += output_len;
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     if (propose_tls13) {
         ret = mbedtls_ssl_tls13_write_client_hello_exts(ssl, p, end,
@@ -725,9 +733,9 @@ static int ssl_generate_random(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_HAVE_TIME */
     }
 
-    ret = ssl->conf->f_rng(ssl->conf->p_rng,
-                           randbytes + gmt_unix_time_len,
-                           MBEDTLS_CLIENT_HELLO_RANDOM_LEN - gmt_unix_time_len);
+    ret = ssl->f_rng(ssl->p_rng,
+                     randbytes + gmt_unix_time_len,
+                     MBEDTLS_CLIENT_HELLO_RANDOM_LEN - gmt_unix_time_len);
     return ret;
 }
 
@@ -742,6 +750,10 @@ static int ssl_prepare_client_hello(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    mbedtls_ssl_session_store_resume(ssl);
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && \
     defined(MBEDTLS_SSL_SESSION_TICKETS) && \
     defined(MBEDTLS_HAVE_TIME)
@@ -843,7 +855,9 @@ static int ssl_prepare_client_hello(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
 #if defined(MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE)
-    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+    /* QUIC does not use the compatibility mode, RFC 9001 section 8.4. */
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3 &&
+        !mbedtls_ssl_is_quic(ssl)) {
         /*
          * Create a legacy session identifier for the purpose of middlebox
          * compatibility only if one has not been created already, which is
@@ -867,9 +881,9 @@ static int ssl_prepare_client_hello(mbedtls_ssl_context *ssl)
     if (session_id_len != session_negotiate->id_len) {
         session_negotiate->id_len = session_id_len;
         if (session_id_len > 0) {
-            ret = ssl->conf->f_rng(ssl->conf->p_rng,
-                                   session_negotiate->id,
-                                   session_id_len);
+            ret = ssl->f_rng(ssl->p_rng,
+                             session_negotiate->id,
+                             session_id_len);
             if (ret != 0) {
                 MBEDTLS_SSL_DEBUG_RET(1, "creating session id failed", ret);
                 return ret;
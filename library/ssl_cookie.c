@@ -42,10 +42,12 @@ static int local_err_translation(psa_status_t status)
 #if defined(PSA_WANT_ALG_SHA_256)
 #define COOKIE_MD           MBEDTLS_MD_SHA256
 #define COOKIE_MD_OUTLEN    32
+#define COOKIE_MD_BLOCKLEN  64
 #define COOKIE_HMAC_LEN     28
 #elif defined(PSA_WANT_ALG_SHA_384)
 #define COOKIE_MD           MBEDTLS_MD_SHA384
 #define COOKIE_MD_OUTLEN    48
+#define COOKIE_MD_BLOCKLEN  128
 #define COOKIE_HMAC_LEN     28
 #else
 #error "DTLS hello verify needs SHA-256 or SHA-384"
@@ -62,18 +64,13 @@ void mbedtls_ssl_cookie_init(mbedtls_ssl_cookie_ctx *ctx)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     ctx->psa_hmac_key = MBEDTLS_SVC_KEY_ID_INIT;
 #else
-    mbedtls_md_init(&ctx->hmac_ctx);
+    mbedtls_md_init(&ctx->inner_ctx);
+    mbedtls_md_init(&ctx->outer_ctx);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 #if !defined(MBEDTLS_HAVE_TIME)
     ctx->serial = 0;
 #endif
     ctx->timeout = MBEDTLS_SSL_COOKIE_TIMEOUT;
-
-#if !defined(MBEDTLS_USE_PSA_CRYPTO)
-#if defined(MBEDTLS_THREADING_C)
-    mbedtls_mutex_init(&ctx->mutex);
-#endif
-#endif /* !MBEDTLS_USE_PSA_CRYPTO */
 }
 
 void mbedtls_ssl_cookie_set_timeout(mbedtls_ssl_cookie_ctx *ctx, unsigned long delay)
@@ -90,11 +87,8 @@ void mbedtls_ssl_cookie_free(mbedtls_ssl_cookie_ctx *ctx)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_destroy_key(ctx->psa_hmac_key);
 #else
-    mbedtls_md_free(&ctx->hmac_ctx);
-
-#if defined(MBEDTLS_THREADING_C)
-    mbedtls_mutex_free(&ctx->mutex);
-#endif
+    mbedtls_md_free(&ctx->inner_ctx);
+    mbedtls_md_free(&ctx->outer_ctx);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
     mbedtls_platform_zeroize(ctx, sizeof(mbedtls_ssl_cookie_ctx));
@@ -130,55 +124,98 @@ int mbedtls_ssl_cookie_setup(mbedtls_ssl_cookie_ctx *ctx,
                                    &ctx->psa_hmac_key)) != PSA_SUCCESS) {
         return PSA_TO_MBEDTLS_ERR(status);
     }
+
+    return 0;
 #else
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(COOKIE_MD);
     unsigned char key[COOKIE_MD_OUTLEN];
+    unsigned char pad[COOKIE_MD_BLOCKLEN];
+    size_t i;
 
     if ((ret = f_rng(p_rng, key, sizeof(key))) != 0) {
-        return ret;
+        goto exit;
+    }
+
+    if ((ret = mbedtls_md_setup(&ctx->inner_ctx, md_info, 0)) != 0 ||
+        (ret = mbedtls_md_setup(&ctx->outer_ctx, md_info, 0)) != 0) {
+        goto exit;
     }
 
-    ret = mbedtls_md_setup(&ctx->hmac_ctx, mbedtls_md_info_from_type(COOKIE_MD), 1);
-    if (ret != 0) {
-        return ret;
+    /*
+     * The key is shorter than a block, so the pads are the key padded with
+     * zeros XORed with ipad and opad (RFC 2104). Absorbing them here leaves
+     * each cookie with only its own data to hash.
+     */
+    memset(pad, 0x36, sizeof(pad));
+    for (i = 0; i < sizeof(key); i++) {
+        pad[i] ^= key[i];
+    }
+    if ((ret = mbedtls_md_starts(&ctx->inner_ctx)) != 0 ||
+        (ret = mbedtls_md_update(&ctx->inner_ctx, pad, sizeof(pad))) != 0) {
+        goto exit;
     }
 
-    ret = mbedtls_md_hmac_starts(&ctx->hmac_ctx, key, sizeof(key));
-    if (ret != 0) {
-        return ret;
+    memset(pad, 0x5C, sizeof(pad));
+    for (i = 0; i < sizeof(key); i++) {
+        pad[i] ^= key[i];
+    }
+    if ((ret = mbedtls_md_starts(&ctx->outer_ctx)) != 0 ||
+        (ret = mbedtls_md_update(&ctx->outer_ctx, pad, sizeof(pad))) != 0) {
+        goto exit;
     }
 
+exit:
     mbedtls_platform_zeroize(key, sizeof(key));
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    mbedtls_platform_zeroize(pad, sizeof(pad));
 
-    return 0;
+    return ret;
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
 }
 
 #if !defined(MBEDTLS_USE_PSA_CRYPTO)
 /*
  * Generate the HMAC part of a cookie
+ *
+ * The precomputed pad states in the context are cloned into a local hash
+ * context rather than used in place, so the context is never written and
+ * concurrent callers need no lock.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_cookie_hmac(mbedtls_md_context_t *hmac_ctx,
+static int ssl_cookie_hmac(const mbedtls_ssl_cookie_ctx *ctx,
                            const unsigned char time[4],
                            unsigned char **p, unsigned char *end,
                            const unsigned char *cli_id, size_t cli_id_len)
 {
+    int ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    mbedtls_md_context_t md_ctx;
     unsigned char hmac_out[COOKIE_MD_OUTLEN];
 
     MBEDTLS_SSL_CHK_BUF_PTR(*p, end, COOKIE_HMAC_LEN);
 
-    if (mbedtls_md_hmac_reset(hmac_ctx) != 0 ||
-        mbedtls_md_hmac_update(hmac_ctx, time, 4) != 0 ||
-        mbedtls_md_hmac_update(hmac_ctx, cli_id, cli_id_len) != 0 ||
-        mbedtls_md_hmac_finish(hmac_ctx, hmac_out) != 0) {
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    mbedtls_md_init(&md_ctx);
+
+    if (mbedtls_md_setup(&md_ctx, mbedtls_md_info_from_type(COOKIE_MD), 0) != 0 ||
+        mbedtls_md_clone(&md_ctx, &ctx->inner_ctx) != 0 ||
+        mbedtls_md_update(&md_ctx, time, 4) != 0 ||
+        mbedtls_md_update(&md_ctx, cli_id, cli_id_len) != 0 ||
+        mbedtls_md_finish(&md_ctx, hmac_out) != 0 ||
+        mbedtls_md_clone(&md_ctx, &ctx->outer_ctx) != 0 ||
+        mbedtls_md_update(&md_ctx, hmac_out, sizeof(hmac_out)) != 0 ||
+        mbedtls_md_finish(&md_ctx, hmac_out) != 0) {
+        goto exit;
     }
 
     memcpy(*p, hmac_out, COOKIE_HMAC_LEN);
     *p += COOKIE_HMAC_LEN;
 
-    return 0;
+    ret = 0;
+
+exit:
+    mbedtls_md_free(&md_ctx);
+    mbedtls_platform_zeroize(hmac_out, sizeof(hmac_out));
+
+    return ret;
 }
 #endif /* !MBEDTLS_USE_PSA_CRYPTO */
 
@@ -244,21 +281,7 @@ int mbedtls_ssl_cookie_write(void *p_ctx,
 
     ret = 0;
 #else
-#if defined(MBEDTLS_THREADING_C)
-    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_SSL_INTERNAL_ERROR, ret);
-    }
-#endif
-
-    ret = ssl_cookie_hmac(&ctx->hmac_ctx, *p - 4,
-                          p, end, cli_id, cli_id_len);
-
-#if defined(MBEDTLS_THREADING_C)
-    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_SSL_INTERNAL_ERROR,
-                                 MBEDTLS_ERR_THREADING_MUTEX_ERROR);
-    }
-#endif
+    ret = ssl_cookie_hmac(ctx, *p - 4, p, end, cli_id, cli_id_len);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -327,26 +350,9 @@ int mbedtls_ssl_cookie_check(void *p_ctx,
 
     ret = 0;
 #else
-#if defined(MBEDTLS_THREADING_C)
-    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_SSL_INTERNAL_ERROR, ret);
-    }
-#endif
-
-    if (ssl_cookie_hmac(&ctx->hmac_ctx, cookie,
-                        &p, p + sizeof(ref_hmac),
+    if (ssl_cookie_hmac(ctx, cookie, &p, p + sizeof(ref_hmac),
                         cli_id, cli_id_len) != 0) {
         ret = -1;
-    }
-
-#if defined(MBEDTLS_THREADING_C)
-    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
-        ret = MBEDTLS_ERROR_ADD(MBEDTLS_ERR_SSL_INTERNAL_ERROR,
-                                MBEDTLS_ERR_THREADING_MUTEX_ERROR);
-    }
-#endif
-
-    if (ret != 0) {
         goto exit;
     }
 
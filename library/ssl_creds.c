@@ -0,0 +1,174 @@
+/*
+ *  Trusted CAs and own certificates, replaceable while handshakes run
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * The slot holds one reference to its current set, and each handshake one
+ * to the set it started with. The mutex of the slot covers the current
+ * pointer and the reference counts of the sets set in it, so that taking
+ * a reference cannot race with the set being replaced and released.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_CREDS_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_creds.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+void mbedtls_ssl_creds_init(mbedtls_ssl_creds *creds,
+                            mbedtls_ssl_creds_release_t *f_release,
+                            void *p_release)
+{
+    memset(creds, 0, sizeof(mbedtls_ssl_creds));
+    creds->f_release = f_release;
+    creds->p_release = p_release;
+}
+
+void mbedtls_ssl_creds_set_ca_chain(mbedtls_ssl_creds *creds,
+                                    mbedtls_x509_crt *ca_chain,
+                                    mbedtls_x509_crl *ca_crl)
+{
+    creds->ca_chain = ca_chain;
+    creds->ca_crl = ca_crl;
+}
+
+int mbedtls_ssl_creds_add_own_cert(mbedtls_ssl_creds *creds,
+                                   const mbedtls_ssl_config *conf,
+                                   mbedtls_x509_crt *own_cert,
+                                   mbedtls_pk_context *pk_key)
+{
+    if (creds->slot != NULL || own_cert == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    return mbedtls_ssl_key_cert_append(conf, &creds->key_cert, own_cert,
+                                       pk_key);
+}
+
+void mbedtls_ssl_creds_free(mbedtls_ssl_creds *creds)
+{
+    if (creds == NULL) {
+        return;
+    }
+
+    mbedtls_ssl_key_cert_free(creds->key_cert);
+
+    mbedtls_platform_zeroize(creds, sizeof(mbedtls_ssl_creds));
+}
+
+void mbedtls_ssl_creds_slot_init(mbedtls_ssl_creds_slot *slot)
+{
+    memset(slot, 0, sizeof(mbedtls_ssl_creds_slot));
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&slot->mutex);
+#endif
+}
+
+int mbedtls_ssl_creds_acquire(mbedtls_ssl_creds_slot *slot,
+                              mbedtls_ssl_creds **creds)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&slot->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    *creds = slot->current;
+    if (*creds != NULL) {
+        (*creds)->refs++;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&slot->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_creds_release(mbedtls_ssl_creds *creds)
+{
+    int last;
+
+    if (creds == NULL) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    /* Rather leak the set than release it while it may be in use. */
+    if (mbedtls_mutex_lock(&creds->slot->mutex) != 0) {
+        return;
+    }
+#endif
+
+    last = --creds->refs == 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&creds->slot->mutex);
+#endif
+
+    if (last && creds->f_release != NULL) {
+        creds->f_release(creds->p_release, creds);
+    }
+}
+
+int mbedtls_ssl_creds_slot_set(mbedtls_ssl_creds_slot *slot,
+                               mbedtls_ssl_creds *creds)
+{
+    mbedtls_ssl_creds *old;
+
+    if (creds != NULL) {
+        if (creds->slot != NULL) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        creds->slot = slot;
+        creds->refs = 1;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&slot->mutex) != 0) {
+        if (creds != NULL) {
+            creds->slot = NULL;
+            creds->refs = 0;
+        }
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    old = slot->current;
+    slot->current = creds;
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&slot->mutex);
+#endif
+
+    mbedtls_ssl_creds_release(old);
+
+    return 0;
+}
+
+void mbedtls_ssl_creds_slot_free(mbedtls_ssl_creds_slot *slot)
+{
+    if (slot == NULL) {
+        return;
+    }
+
+    (void) mbedtls_ssl_creds_slot_set(slot, NULL);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&slot->mutex);
+#endif
+
+    mbedtls_platform_zeroize(slot, sizeof(mbedtls_ssl_creds_slot));
+}
+
+#endif /* MBEDTLS_SSL_CREDS_C */
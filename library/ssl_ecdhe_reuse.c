@@ -0,0 +1,294 @@
+/*
+ *  Bounded reuse of ephemeral ECDHE key pairs by TLS 1.2 servers
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A list with the current key pair of each group. The list holds one
+ * reference to each of its key pairs and every handshake one to the key
+ * pair it uses, so that a key pair replaced while handshakes still need it
+ * is only destroyed after the last of them. New key pairs are generated
+ * outside the lock: a handshake only holds it to look up or swap an entry.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+
+#include "mbedtls/platform.h"
+#include "mbedtls/platform_time.h"
+
+#include "mbedtls/ssl_ecdhe_reuse.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+struct mbedtls_ssl_ecdhe_reuse_key {
+    struct mbedtls_ssl_ecdhe_reuse_key *next;   /*!< key pair of the next group */
+    mbedtls_ssl_ecdhe_reuse *ctx;               /*!< context it was made by */
+    psa_key_type_t type;                        /*!< PSA key pair type      */
+    size_t bits;
+    mbedtls_svc_key_id_t key;
+    unsigned char pub[PSA_EXPORT_PUBLIC_KEY_MAX_SIZE];
+    size_t pub_len;
+    mbedtls_ms_time_t created;
+    uint32_t uses;                              /*!< handshakes served      */
+    size_t refs;                                /*!< list and handshakes    */
+};
+
+void mbedtls_ssl_ecdhe_reuse_init(mbedtls_ssl_ecdhe_reuse *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ssl_ecdhe_reuse));
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&ctx->mutex);
+#endif
+}
+
+int mbedtls_ssl_ecdhe_reuse_setup(mbedtls_ssl_ecdhe_reuse *ctx,
+                                  uint32_t max_uses, uint32_t max_ms)
+{
+    if (ctx->max_uses != 0 || ctx->max_ms != 0 ||
+        (max_uses == 0 && max_ms == 0)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ctx->max_uses = max_uses;
+    ctx->max_ms = max_ms;
+
+    return 0;
+}
+
+static int ssl_ecdhe_reuse_expired(const mbedtls_ssl_ecdhe_reuse *ctx,
+                                   const struct mbedtls_ssl_ecdhe_reuse_key *cur,
+                                   mbedtls_ms_time_t now)
+{
+    if (ctx->max_uses != 0 && cur->uses >= ctx->max_uses) {
+        return 1;
+    }
+
+    return ctx->max_ms != 0 && now - cur->created >= (mbedtls_ms_time_t) ctx->max_ms;
+}
+
+static struct mbedtls_ssl_ecdhe_reuse_key **ssl_ecdhe_reuse_find(
+    mbedtls_ssl_ecdhe_reuse *ctx, const psa_key_attributes_t *attributes)
+{
+    struct mbedtls_ssl_ecdhe_reuse_key **cur;
+
+    for (cur = &ctx->keys; *cur != NULL; cur = &(*cur)->next) {
+        if ((*cur)->type == psa_get_key_type(attributes) &&
+            (*cur)->bits == psa_get_key_bits(attributes)) {
+            break;
+        }
+    }
+
+    return cur;
+}
+
+void mbedtls_ssl_ecdhe_reuse_release(struct mbedtls_ssl_ecdhe_reuse_key *entry)
+{
+    int last;
+
+    if (entry == NULL) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    /* Rather leak the key pair than destroy it while it may be in use. */
+    if (mbedtls_mutex_lock(&entry->ctx->mutex) != 0) {
+        return;
+    }
+#endif
+
+    last = --entry->refs == 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&entry->ctx->mutex);
+#endif
+
+    if (last) {
+        (void) psa_destroy_key(entry->key);
+        mbedtls_zeroize_and_free(entry, sizeof(struct mbedtls_ssl_ecdhe_reuse_key));
+    }
+}
+
+static int ssl_ecdhe_reuse_copy_out(const struct mbedtls_ssl_ecdhe_reuse_key *entry,
+                                    mbedtls_svc_key_id_t *key,
+                                    unsigned char *pub, size_t pub_size,
+                                    size_t *pub_len)
+{
+    if (entry->pub_len > pub_size) {
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    *key = entry->key;
+    memcpy(pub, entry->pub, entry->pub_len);
+    *pub_len = entry->pub_len;
+
+    return 0;
+}
+
+int mbedtls_ssl_ecdhe_reuse_take(mbedtls_ssl_ecdhe_reuse *ctx,
+                                 const psa_key_attributes_t *attributes,
+                                 struct mbedtls_ssl_ecdhe_reuse_key **entry,
+                                 mbedtls_svc_key_id_t *key,
+                                 unsigned char *pub, size_t pub_size,
+                                 size_t *pub_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    psa_status_t status;
+    struct mbedtls_ssl_ecdhe_reuse_key **slot, *cur, *old = NULL;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+
+    *entry = NULL;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    cur = *ssl_ecdhe_reuse_find(ctx, attributes);
+    if (cur != NULL && !ssl_ecdhe_reuse_expired(ctx, cur, now)) {
+        ret = ssl_ecdhe_reuse_copy_out(cur, key, pub, pub_size, pub_len);
+        if (ret == 0) {
+            cur->uses++;
+            cur->refs++;
+            ctx->reused++;
+            *entry = cur;
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&ctx->mutex);
+#endif
+
+    if (*entry != NULL) {
+        return 0;
+    }
+
+    /* No key pair to reuse: generate the next one. */
+    cur = mbedtls_calloc_tagged(SSL_CACHE, 1, sizeof(struct mbedtls_ssl_ecdhe_reuse_key));
+    if (cur == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    cur->ctx = ctx;
+    cur->type = psa_get_key_type(attributes);
+    cur->bits = psa_get_key_bits(attributes);
+    cur->created = now;
+    cur->uses = 1;
+    cur->refs = 1;
+
+    status = psa_generate_key(attributes, &cur->key);
+    if (status == PSA_SUCCESS) {
+        status = psa_export_public_key(cur->key, cur->pub, sizeof(cur->pub),
+                                       &cur->pub_len);
+    }
+    if (status != PSA_SUCCESS) {
+        (void) psa_destroy_key(cur->key);
+        mbedtls_free(cur);
+        return PSA_TO_MBEDTLS_ERR(status);
+    }
+
+    if ((ret = ssl_ecdhe_reuse_copy_out(cur, key, pub, pub_size,
+                                        pub_len)) != 0) {
+        mbedtls_ssl_ecdhe_reuse_release(cur);
+        return ret;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&ctx->mutex) != 0) {
+        /* The key pair is still good for this handshake alone. */
+        *entry = cur;
+        return 0;
+    }
+#endif
+
+    ctx->generated++;
+
+    /* Another handshake may have replaced the key pair meanwhile: then
+     * this one is only used once. */
+    slot = ssl_ecdhe_reuse_find(ctx, attributes);
+    if (*slot == NULL || ssl_ecdhe_reuse_expired(ctx, *slot, now)) {
+        old = *slot;
+        cur->next = old != NULL ? old->next : NULL;
+        *slot = cur;
+        cur->refs++;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&ctx->mutex);
+#endif
+
+    mbedtls_ssl_ecdhe_reuse_release(old);
+
+    *entry = cur;
+
+    return 0;
+}
+
+int mbedtls_ssl_ecdhe_reuse_stats(mbedtls_ssl_ecdhe_reuse *ctx,
+                                  uint64_t *generated, uint64_t *reused)
+{
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (generated != NULL) {
+        *generated = ctx->generated;
+    }
+    if (reused != NULL) {
+        *reused = ctx->reused;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_ecdhe_reuse_flush(mbedtls_ssl_ecdhe_reuse *ctx)
+{
+    struct mbedtls_ssl_ecdhe_reuse_key *cur, *next;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&ctx->mutex) != 0) {
+        return;
+    }
+#endif
+
+    cur = ctx->keys;
+    ctx->keys = NULL;
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&ctx->mutex);
+#endif
+
+    for (; cur != NULL; cur = next) {
+        next = cur->next;
+        mbedtls_ssl_ecdhe_reuse_release(cur);
+    }
+}
+
+void mbedtls_ssl_ecdhe_reuse_free(mbedtls_ssl_ecdhe_reuse *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    mbedtls_ssl_ecdhe_reuse_flush(ctx);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&ctx->mutex);
+#endif
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_ssl_ecdhe_reuse));
+}
+
+#endif /* MBEDTLS_SSL_ECDHE_REUSE_C */
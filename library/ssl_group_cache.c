@@ -0,0 +1,146 @@
+/*
+ *  Cache of the key exchange group each server selected
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A direct-mapped array of (name hash, group) slots. A newer server name
+ * simply evicts the one that shared its slot: only the prediction of the
+ * key share depends on it, the handshake checks the server choice anyway.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_group_cache.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+/* Entries are 8 bytes, so this caps the cache at 8 MiB, more server names
+ * than a client contacts. With more entries, the 32-bit name hashes would
+ * start to collide anyway. */
+#define SSL_GROUP_CACHE_MAX_ENTRIES (1u << 20)
+
+void mbedtls_ssl_group_cache_init(mbedtls_ssl_group_cache *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_ssl_group_cache));
+}
+
+int mbedtls_ssl_group_cache_setup(mbedtls_ssl_group_cache *cache,
+                                  size_t num_entries)
+{
+    size_t n = 1;
+
+    if (cache->entries != NULL || num_entries == 0 ||
+        num_entries > SSL_GROUP_CACHE_MAX_ENTRIES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < num_entries) {
+        n <<= 1;
+    }
+
+    cache->entries = mbedtls_calloc_tagged(SSL_CACHE, n, sizeof(mbedtls_ssl_group_cache_entry));
+    if (cache->entries == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    cache->mask = n - 1;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&cache->mutex);
+#endif
+
+    return 0;
+}
+
+/* FNV-1a. Server names are chosen by the application, so this only needs
+ * to be cheap. */
+static uint32_t ssl_group_cache_hash(const char *name)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT,
+                           (const unsigned char *) name, strlen(name));
+}
+
+uint16_t mbedtls_ssl_group_cache_get(mbedtls_ssl_group_cache *cache,
+                                     const char *name)
+{
+    const mbedtls_ssl_group_cache_entry *entry;
+    uint32_t h;
+    uint16_t group = MBEDTLS_SSL_IANA_TLS_GROUP_NONE;
+
+    if (cache->entries == NULL || name == NULL) {
+        return MBEDTLS_SSL_IANA_TLS_GROUP_NONE;
+    }
+
+    h = ssl_group_cache_hash(name);
+    entry = &cache->entries[h & cache->mask];
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&cache->mutex) != 0) {
+        return MBEDTLS_SSL_IANA_TLS_GROUP_NONE;
+    }
+#endif
+    if (entry->name_hash == h) {
+        group = entry->group;
+    }
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&cache->mutex);
+#endif
+
+    return group;
+}
+
+int mbedtls_ssl_group_cache_set(mbedtls_ssl_group_cache *cache,
+                                const char *name, uint16_t group)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_group_cache_entry *entry;
+    uint32_t h;
+
+    if (cache->entries == NULL || name == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    h = ssl_group_cache_hash(name);
+    entry = &cache->entries[h & cache->mask];
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+    entry->name_hash = h;
+    entry->group = group;
+    ret = 0;
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&cache->mutex);
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_group_cache_free(mbedtls_ssl_group_cache *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (cache->entries != NULL) {
+        mbedtls_mutex_free(&cache->mutex);
+    }
+#endif
+
+    mbedtls_free(cache->entries);
+
+    mbedtls_platform_zeroize(cache, sizeof(mbedtls_ssl_group_cache));
+}
+
+#endif /* MBEDTLS_SSL_GROUP_CACHE_C */
@@ -0,0 +1,218 @@
+/*
+ *  CPU budget for server handshakes, favouring cheap handshakes under
+ *  overload
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A token bucket kept in thousandths of cost units, so that refilling by
+ * the elapsed milliseconds times the rate per second is exact.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_HS_BUDGET_C)
+
+#include "mbedtls/ssl_hs_budget.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "debug_internal.h"
+
+#include <string.h>
+
+void mbedtls_ssl_hs_budget_init(mbedtls_ssl_hs_budget *budget)
+{
+    memset(budget, 0, sizeof(mbedtls_ssl_hs_budget));
+
+    budget->max_deferrals = MBEDTLS_SSL_HS_BUDGET_DEFAULT_MAX_DEFERRALS;
+    budget->cost[MBEDTLS_SSL_HS_BUDGET_RESUME] = 1;
+    budget->cost[MBEDTLS_SSL_HS_BUDGET_PSK] = 1;
+    budget->cost[MBEDTLS_SSL_HS_BUDGET_ECC] = 4;
+    budget->cost[MBEDTLS_SSL_HS_BUDGET_RSA] = 16;
+}
+
+int mbedtls_ssl_hs_budget_setup(mbedtls_ssl_hs_budget *budget,
+                                uint32_t rate, uint32_t capacity)
+{
+    if (budget->rate != 0 || rate == 0 || capacity == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    budget->rate = rate;
+    budget->capacity = capacity;
+    budget->level = (uint64_t) capacity * 1000;
+    budget->last = mbedtls_ms_time();
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&budget->mutex);
+#endif
+
+    return 0;
+}
+
+int mbedtls_ssl_hs_budget_set_cost(mbedtls_ssl_hs_budget *budget,
+                                   int hs_class, uint32_t cost)
+{
+    if (hs_class < 0 || hs_class >= MBEDTLS_SSL_HS_BUDGET_CLASSES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    budget->cost[hs_class] = cost;
+
+    return 0;
+}
+
+void mbedtls_ssl_hs_budget_set_reserve(mbedtls_ssl_hs_budget *budget,
+                                       uint32_t reserve)
+{
+    budget->reserve = reserve;
+}
+
+void mbedtls_ssl_hs_budget_set_max_deferrals(mbedtls_ssl_hs_budget *budget,
+                                             uint32_t max_deferrals)
+{
+    budget->max_deferrals = max_deferrals;
+}
+
+int mbedtls_ssl_hs_budget_class(const mbedtls_ssl_hs_admission_info *info)
+{
+    if (info->resume) {
+        return MBEDTLS_SSL_HS_BUDGET_RESUME;
+    }
+
+    switch (info->key_type) {
+        case MBEDTLS_PK_NONE:
+            return MBEDTLS_SSL_HS_BUDGET_PSK;
+
+        case MBEDTLS_PK_RSA:
+        case MBEDTLS_PK_RSASSA_PSS:
+            return MBEDTLS_SSL_HS_BUDGET_RSA;
+
+        default:
+            return MBEDTLS_SSL_HS_BUDGET_ECC;
+    }
+}
+
+static void ssl_hs_budget_refill(mbedtls_ssl_hs_budget *budget,
+                                 mbedtls_ms_time_t now)
+{
+    const uint64_t full = (uint64_t) budget->capacity * 1000;
+    mbedtls_ms_time_t elapsed = now - budget->last;
+
+    /* A clock going backwards earns nothing. */
+    if (elapsed <= 0) {
+        return;
+    }
+    budget->last = now;
+
+    /* Bound the elapsed time first, so that the product cannot overflow. */
+    if ((uint64_t) elapsed >= full / budget->rate + 1) {
+        budget->level = full;
+        return;
+    }
+
+    budget->level += (uint64_t) elapsed * budget->rate;
+    if (budget->level > full) {
+        budget->level = full;
+    }
+}
+
+int mbedtls_ssl_hs_budget_admit(void *p_budget, mbedtls_ssl_context *ssl,
+                                const mbedtls_ssl_hs_admission_info *info)
+{
+    int ret;
+    mbedtls_ssl_hs_budget *budget = (mbedtls_ssl_hs_budget *) p_budget;
+    int hs_class = mbedtls_ssl_hs_budget_class(info);
+    uint64_t cost, reserve = 0;
+
+    (void) ssl;
+
+    if (budget->rate == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&budget->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    ssl_hs_budget_refill(budget, mbedtls_ms_time());
+
+    cost = (uint64_t) budget->cost[hs_class] * 1000;
+    if (hs_class != MBEDTLS_SSL_HS_BUDGET_RESUME &&
+        hs_class != MBEDTLS_SSL_HS_BUDGET_PSK) {
+        reserve = (uint64_t) budget->reserve * 1000;
+    }
+
+    if (budget->level >= cost + reserve) {
+        budget->level -= cost;
+        budget->admitted++;
+        ret = 0;
+    } else if (info->deferrals < budget->max_deferrals) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("handshake over budget, deferred"));
+        budget->deferred++;
+        ret = MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+    } else {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("handshake over budget, rejected"));
+        budget->rejected++;
+        ret = MBEDTLS_ERR_SSL_HANDSHAKE_REJECTED;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&budget->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_hs_budget_get_stats(mbedtls_ssl_hs_budget *budget,
+                                    uint32_t *admitted, uint32_t *deferred,
+                                    uint32_t *rejected)
+{
+#if defined(MBEDTLS_THREADING_C)
+    int ret;
+
+    if ((ret = mbedtls_mutex_lock(&budget->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (admitted != NULL) {
+        *admitted = budget->admitted;
+    }
+    if (deferred != NULL) {
+        *deferred = budget->deferred;
+    }
+    if (rejected != NULL) {
+        *rejected = budget->rejected;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&budget->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_hs_budget_free(mbedtls_ssl_hs_budget *budget)
+{
+    if (budget == NULL) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (budget->rate != 0) {
+        mbedtls_mutex_free(&budget->mutex);
+    }
+#endif
+
+    mbedtls_platform_zeroize(budget, sizeof(mbedtls_ssl_hs_budget));
+}
+
+#endif /* MBEDTLS_SSL_HS_BUDGET_C */
@@ -0,0 +1,350 @@
+/*
+ *  Pool of pre-generated ephemeral key pairs for (EC)DHE handshakes
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A ring of key pairs per group, each with its exported public key so that
+ * the handshake does not have to export it again. Refilling generates the
+ * keys outside the lock: a handshake only holds the lock for the time it
+ * takes to pop an entry.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_key_share_pool.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/* Every pooled key pair holds a PSA key slot until a handshake uses it, and
+ * the key store is shared with the rest of the application, so only allow
+ * a pool that covers a burst of handshakes. */
+#define SSL_KEY_SHARE_POOL_MAX_RING_SIZE  1024
+
+struct mbedtls_ssl_key_share_ring {
+    uint16_t group;             /*!< IANA NamedGroup        */
+    psa_key_type_t type;        /*!< PSA key pair type      */
+    size_t bits;
+    psa_algorithm_t alg;        /*!< PSA_ALG_ECDH or PSA_ALG_FFDH */
+    size_t pub_size;            /*!< size of a public key slot in pubs */
+    mbedtls_svc_key_id_t *keys; /*!< ring_size entries      */
+    unsigned char *pubs;        /*!< ring_size * pub_size   */
+    size_t *pub_lens;           /*!< ring_size entries      */
+    size_t head;                /*!< oldest entry           */
+    size_t count;               /*!< entries in the ring    */
+};
+
+void mbedtls_ssl_key_share_pool_init(mbedtls_ssl_key_share_pool *pool)
+{
+    memset(pool, 0, sizeof(mbedtls_ssl_key_share_pool));
+}
+
+static int ssl_key_share_ring_set_group(struct mbedtls_ssl_key_share_ring *ring,
+                                        uint16_t group)
+{
+    ring->group = group;
+    ring->type = PSA_KEY_TYPE_NONE;
+
+#if defined(PSA_WANT_ALG_ECDH)
+    if (mbedtls_ssl_get_psa_curve_info_from_tls_id(group, &ring->type,
+                                                   &ring->bits) == PSA_SUCCESS) {
+        ring->alg = PSA_ALG_ECDH;
+    }
+#endif
+#if defined(PSA_WANT_ALG_FFDH)
+    if (mbedtls_ssl_get_psa_ffdh_info_from_tls_id(group, &ring->bits,
+                                                  &ring->type) == PSA_SUCCESS) {
+        ring->alg = PSA_ALG_FFDH;
+    }
+#endif
+
+    if (ring->type == PSA_KEY_TYPE_NONE) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ring->pub_size = PSA_EXPORT_PUBLIC_KEY_OUTPUT_SIZE(ring->type, ring->bits);
+
+    return 0;
+}
+
+int mbedtls_ssl_key_share_pool_setup(mbedtls_ssl_key_share_pool *pool,
+                                     const uint16_t *groups,
+                                     size_t ring_size)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct mbedtls_ssl_key_share_ring *ring;
+    size_t n = 0, i, j;
+
+    if (pool->rings != NULL || groups == NULL || ring_size == 0 ||
+        ring_size > SSL_KEY_SHARE_POOL_MAX_RING_SIZE) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (groups[n] != MBEDTLS_SSL_IANA_TLS_GROUP_NONE) {
+        for (j = 0; j < n; j++) {
+            if (groups[j] == groups[n]) {
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            }
+        }
+        n++;
+    }
+    if (n == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    pool->rings = mbedtls_calloc_tagged(SSL_CACHE, n, sizeof(struct mbedtls_ssl_key_share_ring));
+    if (pool->rings == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    pool->ring_count = n;
+    pool->ring_size = ring_size;
+
+    for (i = 0; i < n; i++) {
+        ring = &pool->rings[i];
+
+        if ((ret = ssl_key_share_ring_set_group(ring, groups[i])) != 0) {
+            goto cleanup;
+        }
+
+        ring->keys = mbedtls_calloc_tagged(SSL_CACHE, ring_size, sizeof(mbedtls_svc_key_id_t));
+        ring->pubs = mbedtls_calloc_tagged(SSL_CACHE, ring_size, ring->pub_size);
+        ring->pub_lens = mbedtls_calloc_tagged(SSL_CACHE, ring_size, sizeof(size_t));
+        if (ring->keys == NULL || ring->pubs == NULL || ring->pub_lens == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto cleanup;
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&pool->mutex);
+#endif
+
+    return 0;
+
+cleanup:
+    for (i = 0; i < n; i++) {
+        mbedtls_free(pool->rings[i].keys);
+        mbedtls_free(pool->rings[i].pubs);
+        mbedtls_free(pool->rings[i].pub_lens);
+    }
+    mbedtls_free(pool->rings);
+    mbedtls_ssl_key_share_pool_init(pool);
+
+    return ret;
+}
+
+/* The ring with most room, so that refilling in small steps keeps the
+ * groups balanced. Returns NULL if all the rings are full. */
+static struct mbedtls_ssl_key_share_ring *ssl_key_share_pool_emptiest(
+    mbedtls_ssl_key_share_pool *pool)
+{
+    struct mbedtls_ssl_key_share_ring *best = NULL;
+    size_t i;
+
+    for (i = 0; i < pool->ring_count; i++) {
+        if (pool->rings[i].count < pool->ring_size &&
+            (best == NULL || pool->rings[i].count < best->count)) {
+            best = &pool->rings[i];
+        }
+    }
+
+    return best;
+}
+
+int mbedtls_ssl_key_share_pool_refill(mbedtls_ssl_key_share_pool *pool,
+                                      size_t max_keys, size_t *generated)
+{
+    int ret = 0;
+    psa_status_t status;
+    psa_key_attributes_t attributes;
+    struct mbedtls_ssl_key_share_ring *ring;
+    mbedtls_svc_key_id_t key;
+    unsigned char pub[PSA_EXPORT_PUBLIC_KEY_MAX_SIZE];
+    size_t pub_len, tail, done = 0;
+
+    if (generated != NULL) {
+        *generated = 0;
+    }
+
+    if (pool->rings == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (max_keys == 0 || done < max_keys) {
+        attributes = psa_key_attributes_init();
+        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_DERIVE);
+
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+            break;
+        }
+#endif
+        /* The group attributes are fixed at setup, only the counts need
+         * the lock. */
+        ring = ssl_key_share_pool_emptiest(pool);
+#if defined(MBEDTLS_THREADING_C)
+        (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+        if (ring == NULL) {
+            break;
+        }
+
+        psa_set_key_algorithm(&attributes, ring->alg);
+        psa_set_key_type(&attributes, ring->type);
+        psa_set_key_bits(&attributes, ring->bits);
+
+        key = MBEDTLS_SVC_KEY_ID_INIT;
+        status = psa_generate_key(&attributes, &key);
+        if (status == PSA_SUCCESS) {
+            status = psa_export_public_key(key, pub, sizeof(pub), &pub_len);
+        }
+        if (status != PSA_SUCCESS) {
+            (void) psa_destroy_key(key);
+            ret = PSA_TO_MBEDTLS_ERR(status);
+            break;
+        }
+
+#if defined(MBEDTLS_THREADING_C)
+        if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+            (void) psa_destroy_key(key);
+            break;
+        }
+#endif
+        /* Another thread may have filled the ring meanwhile. */
+        if (ring->count < pool->ring_size) {
+            tail = (ring->head + ring->count) % pool->ring_size;
+            ring->keys[tail] = key;
+            memcpy(ring->pubs + tail * ring->pub_size, pub, pub_len);
+            ring->pub_lens[tail] = pub_len;
+            ring->count++;
+            key = MBEDTLS_SVC_KEY_ID_INIT;
+        }
+#if defined(MBEDTLS_THREADING_C)
+        (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+
+        if (!mbedtls_svc_key_id_is_null(key)) {
+            (void) psa_destroy_key(key);
+            continue;
+        }
+
+        done++;
+    }
+
+    if (generated != NULL) {
+        *generated = done;
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_key_share_pool_take(mbedtls_ssl_key_share_pool *pool,
+                                    const psa_key_attributes_t *attributes,
+                                    mbedtls_svc_key_id_t *key,
+                                    unsigned char *pub, size_t pub_size,
+                                    size_t *pub_len)
+{
+    int ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    struct mbedtls_ssl_key_share_ring *ring = NULL;
+    size_t i;
+
+    if (pool->rings == NULL) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    for (i = 0; i < pool->ring_count; i++) {
+        if (pool->rings[i].type == psa_get_key_type(attributes) &&
+            pool->rings[i].bits == psa_get_key_bits(attributes) &&
+            pool->rings[i].alg == psa_get_key_algorithm(attributes)) {
+            ring = &pool->rings[i];
+            break;
+        }
+    }
+    if (ring == NULL) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&pool->mutex) != 0) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif
+
+    if (ring->count > 0 && ring->pub_lens[ring->head] <= pub_size) {
+        *key = ring->keys[ring->head];
+        *pub_len = ring->pub_lens[ring->head];
+        memcpy(pub, ring->pubs + ring->head * ring->pub_size, *pub_len);
+        ring->keys[ring->head] = MBEDTLS_SVC_KEY_ID_INIT;
+        ring->head = (ring->head + 1) % pool->ring_size;
+        ring->count--;
+        ret = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+
+    return ret;
+}
+
+size_t mbedtls_ssl_key_share_pool_count(mbedtls_ssl_key_share_pool *pool,
+                                        uint16_t group)
+{
+    size_t count = 0, i;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (pool->rings == NULL || mbedtls_mutex_lock(&pool->mutex) != 0) {
+        return 0;
+    }
+#endif
+    for (i = 0; i < pool->ring_count; i++) {
+        if (pool->rings[i].group == group) {
+            count = pool->rings[i].count;
+            break;
+        }
+    }
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&pool->mutex);
+#endif
+
+    return count;
+}
+
+void mbedtls_ssl_key_share_pool_free(mbedtls_ssl_key_share_pool *pool)
+{
+    struct mbedtls_ssl_key_share_ring *ring;
+    size_t i, j;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    if (pool->rings != NULL) {
+        for (i = 0; i < pool->ring_count; i++) {
+            ring = &pool->rings[i];
+            for (j = 0; j < ring->count; j++) {
+                (void) psa_destroy_key(
+                    ring->keys[(ring->head + j) % pool->ring_size]);
+            }
+            mbedtls_free(ring->keys);
+            mbedtls_free(ring->pubs);
+            mbedtls_free(ring->pub_lens);
+        }
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&pool->mutex);
+#endif
+    }
+
+    mbedtls_free(pool->rings);
+
+    mbedtls_platform_zeroize(pool, sizeof(mbedtls_ssl_key_share_pool));
+}
+
+#endif /* MBEDTLS_SSL_KEY_SHARE_POOL_C */
@@ -49,13 +49,54 @@
 #include "x509_internal.h"
 #include "pk_internal.h"
 
-/* Shorthand for restartable ECC */
+#if defined(MBEDTLS_THREADING_C)
+#include "mbedtls/threading.h"
+#endif
+
+#if defined(MBEDTLS_SSL_ANTI_REPLAY_C)
+#include "mbedtls/ssl_anti_replay.h"
+#endif
+
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+#include "mbedtls/ssl_group_cache.h"
+#endif
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+#include "mbedtls/ssl_key_share_pool.h"
+#endif
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+#include "mbedtls/ssl_ecdhe_reuse.h"
+#endif
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+#include "mbedtls/ssl_session_store.h"
+#endif
+
+#if defined(MBEDTLS_SSL_CREDS_C)
+#include "mbedtls/ssl_creds.h"
+#endif
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+#include "mbedtls/ssl_peer_cert_table.h"
+#endif
+
+/* Shorthand for restartable ECC: TLS 1.2 clients with ECDHE-ECDSA, TLS 1.3
+ * clients and servers with certificates */
 #if defined(MBEDTLS_ECP_RESTARTABLE) && \
     defined(MBEDTLS_SSL_CLI_C) && \
     defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
     defined(MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA_ENABLED)
 #define MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED
 #endif
+#if defined(MBEDTLS_ECP_RESTARTABLE) && defined(MBEDTLS_ECDSA_C) && \
+    defined(MBEDTLS_SSL_PROTO_TLS1_3) && \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
+#define MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED
+#if !defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
+#define MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED
+#endif
+#endif
 
 #define MBEDTLS_SSL_INITIAL_HANDSHAKE           0
 #define MBEDTLS_SSL_RENEGOTIATION_IN_PROGRESS   1   /* In progress */
@@ -99,15 +140,82 @@
 #define MBEDTLS_SSL_EXT_ID_EXTENDED_MASTER_SECRET     26
 #define MBEDTLS_SSL_EXT_ID_SESSION_TICKET             27
 #define MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT          28
+#define MBEDTLS_SSL_EXT_ID_COMPRESS_CERTIFICATE       29
+#define MBEDTLS_SSL_EXT_ID_CACHED_INFO                30
+#define MBEDTLS_SSL_EXT_ID_QUIC_TRANSPORT_PARAMETERS  31
+#define MBEDTLS_SSL_EXT_ID_COUNT                      32
+
+/* Utility for translating IANA extension type, with a lookup table of the
+ * extension types below MBEDTLS_SSL_EXT_ID_TABLE_SIZE. */
+#define MBEDTLS_SSL_EXT_ID_TABLE_SIZE                 64
+extern const uint8_t mbedtls_ssl_extension_id_table[MBEDTLS_SSL_EXT_ID_TABLE_SIZE];
+
+static inline uint32_t mbedtls_ssl_get_extension_id(unsigned int extension_type)
+{
+    if (extension_type >= MBEDTLS_SSL_EXT_ID_TABLE_SIZE) {
+        return MBEDTLS_SSL_EXT_ID_UNRECOGNIZED;
+    }
+
+    return mbedtls_ssl_extension_id_table[extension_type];
+}
 
-/* Utility for translating IANA extension type. */
-uint32_t mbedtls_ssl_get_extension_id(unsigned int extension_type);
-uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
+static inline uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type)
+{
+    return (uint32_t) 1 << mbedtls_ssl_get_extension_id(extension_type);
+}
 /* Macros used to define mask constants */
 #define MBEDTLS_SSL_EXT_MASK(id)       (1ULL << (MBEDTLS_SSL_EXT_ID_##id))
 /* Reset value of extension mask */
 #define MBEDTLS_SSL_EXT_MASK_NONE                                              0
 
+#if defined(MBEDTLS_SSL_SRV_C)
+/*
+ * Extensions of a ClientHello, indexed by mbedtls_ssl_index_client_hello_exts()
+ * in a single pass over the extension list. The version negotiation and the
+ * parsers of each version look extensions up in the index rather than
+ * walking and checking the list again.
+ */
+typedef struct {
+    const unsigned char *exts;  /*!< first extension, NULL if not indexed */
+    const unsigned char *end;   /*!< end of the extension list */
+    uint32_t present;           /*!< masks of the recognized extensions */
+    uint16_t offset[MBEDTLS_SSL_EXT_ID_COUNT]; /*!< offset of each recognized
+                                                   extension from exts */
+} mbedtls_ssl_client_hello_exts;
+
+/**
+ * \brief    Index the extensions of a ClientHello.
+ *
+ * \param index  Index to fill.
+ * \param buf    Start of the extension list, after its length.
+ * \param end    End of the extension list.
+ *
+ * \return   \c 0 on success.
+ * \return   #MBEDTLS_ERR_SSL_DECODE_ERROR if an extension overflows the list
+ *           or a recognized extension is present twice (RFC 5246 section
+ *           7.4.1.4, RFC 8446 section 4.2). No alert is sent.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_index_client_hello_exts(mbedtls_ssl_client_hello_exts *index,
+                                        const unsigned char *buf,
+                                        const unsigned char *end);
+
+/**
+ * \brief    Look an extension up in a ClientHello index.
+ *
+ * \param index  Index filled by mbedtls_ssl_index_client_hello_exts().
+ * \param id     Extension identifier, MBEDTLS_SSL_EXT_ID_XXX, other than
+ *               MBEDTLS_SSL_EXT_ID_UNRECOGNIZED.
+ * \param data_end  On success, the end of the extension data.
+ *
+ * \return   The start of the extension data, or \c NULL if the extension is
+ *           not present.
+ */
+const unsigned char *mbedtls_ssl_client_hello_ext(
+    const mbedtls_ssl_client_hello_exts *index, uint32_t id,
+    const unsigned char **data_end);
+#endif /* MBEDTLS_SSL_SRV_C */
+
 /* In messages containing extension requests, we should ignore unrecognized
  * extensions. In messages containing extension responses, unrecognized
  * extensions should result in handshake abortion. Messages containing
@@ -136,6 +244,12 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
      MBEDTLS_SSL_EXT_MASK(TRUNCATED_HMAC)                         | \
      MBEDTLS_SSL_EXT_MASK(UNRECOGNIZED))
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+/* Largest cookie of a stateless HelloRetryRequest: cipher suite, group,
+ * hash of the first ClientHello and a MAC such as the one of ssl_cookie.c */
+#define MBEDTLS_SSL_TLS1_3_HRR_COOKIE_MAX_LEN   (5 + PSA_HASH_MAX_SIZE + 64)
+#endif
+
 /* RFC 8446 section 4.2. Allowed extensions for ClientHello */
 #define MBEDTLS_SSL_TLS1_3_ALLOWED_EXTS_OF_CH                                  \
     (MBEDTLS_SSL_EXT_MASK(SERVERNAME)                             | \
@@ -160,6 +274,9 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
      MBEDTLS_SSL_EXT_MASK(POST_HANDSHAKE_AUTH)                    | \
      MBEDTLS_SSL_EXT_MASK(SIG_ALG_CERT)                           | \
      MBEDTLS_SSL_EXT_MASK(RECORD_SIZE_LIMIT)                      | \
+     MBEDTLS_SSL_EXT_MASK(COMPRESS_CERTIFICATE)                   | \
+     MBEDTLS_SSL_EXT_MASK(CACHED_INFO)                            | \
+     MBEDTLS_SSL_EXT_MASK(QUIC_TRANSPORT_PARAMETERS)              | \
      MBEDTLS_SSL_TLS1_3_EXT_MASK_UNRECOGNIZED)
 
 /* RFC 8446 section 4.2. Allowed extensions for EncryptedExtensions */
@@ -173,7 +290,9 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
      MBEDTLS_SSL_EXT_MASK(CLI_CERT_TYPE)                          | \
      MBEDTLS_SSL_EXT_MASK(SERV_CERT_TYPE)                         | \
      MBEDTLS_SSL_EXT_MASK(EARLY_DATA)                             | \
-     MBEDTLS_SSL_EXT_MASK(RECORD_SIZE_LIMIT))
+     MBEDTLS_SSL_EXT_MASK(RECORD_SIZE_LIMIT)                      | \
+     MBEDTLS_SSL_EXT_MASK(CACHED_INFO)                            | \
+     MBEDTLS_SSL_EXT_MASK(QUIC_TRANSPORT_PARAMETERS))
 
 /* RFC 8446 section 4.2. Allowed extensions for CertificateRequest */
 #define MBEDTLS_SSL_TLS1_3_ALLOWED_EXTS_OF_CR                                  \
@@ -183,6 +302,7 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
      MBEDTLS_SSL_EXT_MASK(CERT_AUTH)                              | \
      MBEDTLS_SSL_EXT_MASK(OID_FILTERS)                            | \
      MBEDTLS_SSL_EXT_MASK(SIG_ALG_CERT)                           | \
+     MBEDTLS_SSL_EXT_MASK(COMPRESS_CERTIFICATE)                   | \
      MBEDTLS_SSL_TLS1_3_EXT_MASK_UNRECOGNIZED)
 
 /* RFC 8446 section 4.2. Allowed extensions for Certificate */
@@ -246,6 +366,13 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
 #define MBEDTLS_SSL_RETRANS_WAITING         2
 #define MBEDTLS_SSL_RETRANS_FINISHED        3
 
+/*
+ * States of the record cache of the current outgoing flight
+ */
+#define MBEDTLS_SSL_FLIGHT_CACHE_EMPTY      0
+#define MBEDTLS_SSL_FLIGHT_CACHE_RECORDING  1
+#define MBEDTLS_SSL_FLIGHT_CACHE_READY      2
+
 /*
  * Allow extra bytes for record, authentication and encryption overhead:
  * counter (8) + header (5) + IV(16) + MAC (16-48) + padding (0-256).
@@ -257,13 +384,15 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
 #if defined(PSA_WANT_ALG_CBC_NO_PADDING)      &&                                  \
     (defined(PSA_WANT_KEY_TYPE_AES)     ||                                  \
     defined(PSA_WANT_KEY_TYPE_CAMELLIA) ||                                  \
-    defined(PSA_WANT_KEY_TYPE_ARIA))
+    defined(PSA_WANT_KEY_TYPE_ARIA))    &&                                  \
+    !defined(MBEDTLS_SSL_RECORD_AEAD_ONLY)
 #define MBEDTLS_SSL_SOME_SUITES_USE_CBC
 #endif
 
 /* This macro determines whether a ciphersuite using a
  * stream cipher can be used. */
-#if defined(MBEDTLS_CIPHER_NULL_CIPHER)
+#if defined(MBEDTLS_CIPHER_NULL_CIPHER) && \
+    !defined(MBEDTLS_SSL_RECORD_AEAD_ONLY)
 #define MBEDTLS_SSL_SOME_SUITES_USE_STREAM
 #endif
 
@@ -284,8 +413,22 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
 #define MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM
 #endif
 
+/* This macro determines whether the PRF keeps the HMAC state of its secret,
+ * see mbedtls_ssl_tls12_prf_key. */
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && \
+    (defined(PSA_WANT_ALG_SHA_256) || defined(PSA_WANT_ALG_SHA_384))
+#define MBEDTLS_SSL_TLS12_PRF_HMAC_STATE
+#endif
+
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
+/* This macro determines whether the PSK store can lend raw TLS 1.3 PSKs to
+ * handshakes, see mbedtls_ssl_set_hs_psk_borrowed(). */
+#if defined(MBEDTLS_SSL_PSK_STORE_C) && defined(MBEDTLS_USE_PSA_CRYPTO) && \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
+#define MBEDTLS_SSL_HS_PSK_BORROWED
+#endif
+
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
 /* Ciphersuites using HMAC */
 #if defined(PSA_WANT_ALG_SHA_384)
@@ -327,6 +470,10 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
 /* The maximum number of buffered handshake messages. */
 #define MBEDTLS_SSL_MAX_BUFFERED_HS 4
 
+/* The maximum number of received byte ranges of a message being reassembled
+ * in the buffering area, see MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY. */
+#define MBEDTLS_SSL_DTLS_REASSEMBLY_RANGES 8
+
 /* Maximum length we can advertise as our max content length for
    RFC 6066 max_fragment_length extension negotiation purposes
    (the lesser of both sizes, if they are unequal.)
@@ -405,6 +552,49 @@ uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type);
      + (MBEDTLS_SSL_CID_OUT_LEN_MAX))
 #endif
 
+/* The smallest content length accepted by mbedtls_ssl_conf_max_content_len(),
+ * that of the smallest maximum fragment length. */
+#define MBEDTLS_SSL_MIN_CONTENT_LEN 512
+
+/*
+ * Maximum record content lengths of a configuration, see
+ * mbedtls_ssl_conf_max_content_len(), and the size of the record buffers
+ * holding one such record.
+ */
+static inline size_t mbedtls_ssl_conf_get_in_content_len(const mbedtls_ssl_config *conf)
+{
+    return conf->in_content_len != 0 ? conf->in_content_len :
+           MBEDTLS_SSL_IN_CONTENT_LEN;
+}
+
+static inline size_t mbedtls_ssl_conf_get_out_content_len(const mbedtls_ssl_config *conf)
+{
+    return conf->out_content_len != 0 ? conf->out_content_len :
+           MBEDTLS_SSL_OUT_CONTENT_LEN;
+}
+
+static inline size_t mbedtls_ssl_in_content_len(const mbedtls_ssl_context *ssl)
+{
+    return mbedtls_ssl_conf_get_in_content_len(ssl->conf);
+}
+
+static inline size_t mbedtls_ssl_out_content_len(const mbedtls_ssl_context *ssl)
+{
+    return mbedtls_ssl_conf_get_out_content_len(ssl->conf);
+}
+
+static inline size_t mbedtls_ssl_in_buffer_len(const mbedtls_ssl_context *ssl)
+{
+    return MBEDTLS_SSL_IN_BUFFER_LEN - MBEDTLS_SSL_IN_CONTENT_LEN +
+           mbedtls_ssl_in_content_len(ssl);
+}
+
+static inline size_t mbedtls_ssl_out_buffer_len(const mbedtls_ssl_context *ssl)
+{
+    return MBEDTLS_SSL_OUT_BUFFER_LEN - MBEDTLS_SSL_OUT_CONTENT_LEN +
+           mbedtls_ssl_out_content_len(ssl);
+}
+
 #define MBEDTLS_CLIENT_HELLO_RANDOM_LEN 32
 #define MBEDTLS_SERVER_HELLO_RANDOM_LEN 32
 
@@ -454,28 +644,148 @@ size_t mbedtls_ssl_get_input_max_frag_len(const mbedtls_ssl_context *ssl);
 size_t mbedtls_ssl_get_output_record_size_limit(const mbedtls_ssl_context *ssl);
 #endif /* MBEDTLS_SSL_RECORD_SIZE_LIMIT */
 
+/**
+ * \brief    Return the number of application data records that may be
+ *           protected back to back before the output buffer is flushed.
+ *           This is 1 unless batching was enabled with
+ *           mbedtls_ssl_conf_write_batch() on a stream transport.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         The number of records the output buffer is sized for.
+ */
+static inline size_t mbedtls_ssl_get_write_batch_records(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        return 1;
+    }
+#endif
+    return ssl->conf->write_batch_records > 1 ? ssl->conf->write_batch_records : 1;
+}
+
+/**
+ * \brief    Return the number of records the input buffer is sized for.
+ *           This is 1 unless read-ahead was enabled with
+ *           mbedtls_ssl_conf_read_ahead() on a stream transport.
+ *
+ * \param ssl      SSL context
+ *
+ * \return         The number of records the input buffer is sized for.
+ */
+static inline size_t mbedtls_ssl_get_read_ahead_records(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        return 1;
+    }
+#endif
+    return ssl->conf->read_ahead_records > 1 ? ssl->conf->read_ahead_records : 1;
+}
+
+/**
+ * \brief    Check whether handshake records are currently held back
+ *           until the end of the flight instead of being sent right away,
+ *           see mbedtls_ssl_conf_flight_coalescing().
+ *
+ * \param ssl      SSL context
+ *
+ * \return         1 during a TLS handshake with coalescing enabled,
+ *                 0 otherwise.
+ */
+static inline int mbedtls_ssl_is_coalescing_flight(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        return 0;
+    }
+#endif
+    return ssl->conf->flight_coalescing == MBEDTLS_SSL_FLIGHT_COALESCING_ENABLED &&
+           ssl->handshake != NULL &&
+           ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER;
+}
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+/**
+ * \brief          Read the clock of the handshake trace
+ *
+ * \param ssl      SSL context, with a trace callback set
+ *
+ * \return         The current time, in the unit of the trace clock.
+ */
+static inline uint64_t mbedtls_ssl_trace_clock(const mbedtls_ssl_context *ssl)
+{
+    if (ssl->conf->f_hs_clock != NULL) {
+        return ssl->conf->f_hs_clock(ssl->conf->p_hs_trace);
+    }
+#if defined(MBEDTLS_HAVE_TIME)
+    return (uint64_t) mbedtls_ms_time();
+#else
+    return 0;
+#endif
+}
+#endif /* MBEDTLS_SSL_HANDSHAKE_TRACE */
+
+#if defined(MBEDTLS_SSL_STATS)
+#define MBEDTLS_SSL_STATS_ADD(ssl, field, n) ((ssl)->stats.field += (n))
+#else
+#define MBEDTLS_SSL_STATS_ADD(ssl, field, n) ((void) 0)
+#endif
+#define MBEDTLS_SSL_STATS_INC(ssl, field) MBEDTLS_SSL_STATS_ADD(ssl, field, 1)
+
+/*
+ * USDT probes of the "mbedtls" provider. A probe is a single nop until a
+ * tracer attaches to it, but its arguments are always computed, so they
+ * must be values at hand.
+ */
+#if defined(MBEDTLS_SSL_USDT_PROBES)
+#include <sys/sdt.h>
+#define MBEDTLS_SSL_PROBE2(name, a, b) DTRACE_PROBE2(mbedtls, name, a, b)
+#define MBEDTLS_SSL_PROBE3(name, a, b, c) DTRACE_PROBE3(mbedtls, name, a, b, c)
+#else
+#define MBEDTLS_SSL_PROBE2(name, a, b) ((void) 0)
+#define MBEDTLS_SSL_PROBE3(name, a, b, c) ((void) 0)
+#endif
+
+#if defined(MBEDTLS_SSL_STATS)
+/*
+ * Count a completed handshake and its duration.
+ */
+void mbedtls_ssl_stats_handshake_over(mbedtls_ssl_context *ssl);
+#endif
+
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
 static inline size_t mbedtls_ssl_get_output_buflen(const mbedtls_ssl_context *ctx)
 {
+    size_t max_len = mbedtls_ssl_get_output_max_frag_len(ctx);
+
+    if (max_len > mbedtls_ssl_out_content_len(ctx)) {
+        max_len = mbedtls_ssl_out_content_len(ctx);
+    }
+
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    return mbedtls_ssl_get_output_max_frag_len(ctx)
-           + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD
-           + MBEDTLS_SSL_CID_OUT_LEN_MAX;
+    return (max_len
+            + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD
+            + MBEDTLS_SSL_CID_OUT_LEN_MAX)
+           * mbedtls_ssl_get_write_batch_records(ctx);
 #else
-    return mbedtls_ssl_get_output_max_frag_len(ctx)
-           + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD;
+    return (max_len
+            + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD)
+           * mbedtls_ssl_get_write_batch_records(ctx);
 #endif
 }
 
 static inline size_t mbedtls_ssl_get_input_buflen(const mbedtls_ssl_context *ctx)
 {
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    return mbedtls_ssl_get_input_max_frag_len(ctx)
-           + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD
-           + MBEDTLS_SSL_CID_IN_LEN_MAX;
+    return (mbedtls_ssl_get_input_max_frag_len(ctx)
+            + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD
+            + MBEDTLS_SSL_CID_IN_LEN_MAX)
+           * mbedtls_ssl_get_read_ahead_records(ctx);
 #else
-    return mbedtls_ssl_get_input_max_frag_len(ctx)
-           + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD;
+    return (mbedtls_ssl_get_input_max_frag_len(ctx)
+            + MBEDTLS_SSL_HEADER_LEN + MBEDTLS_SSL_PAYLOAD_OVERHEAD)
+           * mbedtls_ssl_get_read_ahead_records(ctx);
 #endif
 }
 #endif
@@ -638,6 +948,19 @@ typedef struct {
 /*
  * This structure contains the parameters only needed during handshake.
  */
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+/*
+ * HMAC of the TLS 1.2 PRF keyed with a secret: the hash states after the
+ * inner and outer padded keys, which each HMAC clones, rather than hashing
+ * the key again for each step of P_hash.
+ */
+typedef struct {
+    psa_algorithm_t alg;            /*!< hash, or 0 when not set up */
+    psa_hash_operation_t inner;     /*!< after H(K ^ ipad) */
+    psa_hash_operation_t outer;     /*!< after H(K ^ opad) */
+} mbedtls_ssl_tls12_prf_key;
+#endif
+
 struct mbedtls_ssl_handshake_params {
     /* Frequently-used boolean or byte fields (placed early to take
      * advantage of smaller code size for indirect access on Arm Thumb) */
@@ -655,11 +978,24 @@ struct mbedtls_ssl_handshake_params {
 #if defined(MBEDTLS_SSL_EARLY_DATA)
     /* Flag indicating if the server has accepted early data or not. */
     uint8_t early_data_accepted;
+    /* Binder of the first offered PSK, to detect replays. */
+    uint8_t early_data_binder_len;
+    unsigned char early_data_binder[MBEDTLS_TLS1_3_MD_MAX_SIZE];
+#endif
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+    /* Flag indicating if the admission callback accepted the handshake. */
+    uint8_t admitted;
+    /* Number of times the admission callback deferred the handshake. */
+    unsigned int admission_deferrals;
 #endif
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
     uint8_t new_session_ticket;         /*!< use NewSessionTicket?    */
+#if defined(MBEDTLS_SSL_SRV_C)
+    uint8_t ticket_fresh;               /*!< no need to replace the
+                                             resumed ticket           */
+#endif
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
 #if defined(MBEDTLS_SSL_CLI_C)
@@ -690,6 +1026,10 @@ struct mbedtls_ssl_handshake_params {
 
 #if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
     uint8_t async_in_progress; /*!< an asynchronous operation is in progress */
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    uint8_t async_verify_in_progress; /*!< the peer's chain is being verified */
+    mbedtls_x509_crt *async_peer_cert;  /*!< The peer's CRT chain meanwhile.  */
+#endif
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -709,6 +1049,7 @@ struct mbedtls_ssl_handshake_params {
         ssl_ecrs_ske_start_processing,  /*!< ServerKeyExchange: pk_verify() */
         ssl_ecrs_cke_ecdh_calc_secret,  /*!< ClientKeyExchange: ECDH step 2 */
         ssl_ecrs_crt_vrfy_sign,         /*!< CertificateVerify: pk_sign()   */
+        ssl_ecrs_crt_vrfy_verify,       /*!< CertificateVerify: pk_verify() */
     } ecrs_state;                       /*!< current (or last) operation    */
     mbedtls_x509_crt *ecrs_peer_cert;   /*!< The peer's CRT chain.          */
     size_t ecrs_n;                      /*!< place for saving a length      */
@@ -753,6 +1094,11 @@ struct mbedtls_ssl_handshake_params {
 #endif
     /** selected_group of key_share extension in HelloRetryRequest message. */
     uint16_t hrr_selected_group;
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    /** Cookie of the HelloRetryRequest being written, or NULL for none */
+    const unsigned char *hrr_cookie;
+    size_t hrr_cookie_len;
+#endif
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
     uint16_t new_session_tickets_count;         /*!< number of session tickets */
 #endif
@@ -787,6 +1133,10 @@ struct mbedtls_ssl_handshake_params {
     unsigned char xxdh_psa_peerkey[PSA_EXPORT_PUBLIC_KEY_MAX_SIZE];
     size_t xxdh_psa_peerkey_len;
 #endif /* MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED */
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+    struct mbedtls_ssl_ecdhe_reuse_key *ecdhe_reuse_key; /*!< shared key pair
+                                                              behind xxdh_psa_privkey */
+#endif
 
 #if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -812,6 +1162,12 @@ struct mbedtls_ssl_handshake_params {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     mbedtls_svc_key_id_t psk_opaque;            /*!< Opaque PSK from the callback   */
     uint8_t psk_opaque_is_internal;
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+    const unsigned char *psk_borrowed;  /*!<  TLS 1.3 raw PSK lent by the
+                                              callback, instead of an opaque
+                                              one                            */
+    size_t psk_borrowed_len;            /*!<  Length of psk_borrowed         */
+#endif
 #else
     unsigned char *psk;                 /*!<  PSK from the callback         */
     size_t psk_len;                     /*!<  Length of PSK from callback   */
@@ -827,9 +1183,17 @@ struct mbedtls_ssl_handshake_params {
     mbedtls_ssl_key_cert *key_cert;     /*!< chosen key/cert pair (server)  */
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     mbedtls_ssl_key_cert *sni_key_cert; /*!< key/cert list from SNI         */
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+    uint8_t sni_key_cert_shared;        /*!< sni_key_cert belongs to an SNI
+                                             table?                         */
+#endif
     mbedtls_x509_crt *sni_ca_chain;     /*!< trusted CAs from SNI callback  */
     mbedtls_x509_crl *sni_ca_crl;       /*!< trusted CAs CRLs from SNI      */
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
+#if defined(MBEDTLS_SSL_CREDS_C)
+    mbedtls_ssl_creds *creds;           /*!< credentials of the slot when
+                                             the handshake started          */
+#endif
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C) &&        \
@@ -839,7 +1203,10 @@ struct mbedtls_ssl_handshake_params {
 
     struct {
         size_t total_bytes_buffered; /*!< Cumulative size of heap allocated
-                                      *   buffers used for message buffering. */
+                                      *   buffers used for message buffering,
+                                      *   or bytes in use at the start of
+                                      *   \c area with
+                                      *   MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY. */
 
         uint8_t seen_ccs;               /*!< Indicates if a CCS message has
                                          *   been seen in the current flight. */
@@ -850,6 +1217,15 @@ struct mbedtls_ssl_handshake_params {
             unsigned is_complete   : 1;
             unsigned char *data;
             size_t data_len;
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+            uint8_t range_count;    /*!< Number of entries in \c ranges */
+            struct {
+                uint32_t start;
+                uint32_t end;
+            } ranges[MBEDTLS_SSL_DTLS_REASSEMBLY_RANGES]; /*!< Received
+                                     *   parts of the message body, sorted
+                                     *   and disjoint, end excluded. */
+#endif
         } hs[MBEDTLS_SSL_MAX_BUFFERED_HS];
 
         struct {
@@ -858,6 +1234,14 @@ struct mbedtls_ssl_handshake_params {
             unsigned epoch;
         } future_record;
 
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+        /* The buffers above, packed at the start of this area in the order
+         * they were taken, and moved down when one before them is freed. */
+        union {
+            unsigned char buf[MBEDTLS_SSL_DTLS_MAX_BUFFERING];
+            void *align_ptr;
+        } area;
+#endif
     } buffering;
 
 #if defined(MBEDTLS_SSL_CLI_C) && \
@@ -904,6 +1288,29 @@ struct mbedtls_ssl_handshake_params {
     unsigned char alt_out_ctr[MBEDTLS_SSL_SEQUENCE_NUMBER_LEN]; /*!<  Alternative record epoch/counter
                                                                       for resending messages         */
 
+    unsigned char *flight_cache;        /*!<  Unprotected records of the
+                                              current flight, as first sent  */
+    size_t flight_cache_len;            /*!<  Length of flight_cache         */
+    size_t flight_cache_size;           /*!<  Allocated size of flight_cache */
+    size_t flight_cache_sent;           /*!<  Bytes of flight_cache resent   */
+    size_t flight_cache_mtu;            /*!<  Datagram size the records of
+                                              flight_cache were packed for   */
+    mbedtls_ssl_flight_item *flight_cache_end_msg; /*!<  Message and position
+                                                    in it of the first record
+                                                    not in flight_cache      */
+    unsigned char *flight_cache_end_p;
+    uint8_t flight_cache_state;         /*!<  MBEDTLS_SSL_FLIGHT_CACHE_xxx   */
+
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t flight_sent_time; /*!<  First transmission of the
+                                              current outgoing flight        */
+    uint32_t srtt;                      /*!<  Smoothed round-trip time (ms)  */
+    uint32_t rttvar;                    /*!<  Round-trip time variation (ms) */
+    uint8_t rtt_pending;                /*!<  The answer to the current
+                                              flight gives an RTT sample     */
+    uint8_t rtt_valid;                  /*!<  srtt and rttvar are set        */
+#endif
+
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     /* The state of CID configuration in this handshake. */
 
@@ -936,6 +1343,15 @@ struct mbedtls_ssl_handshake_params {
     mbedtls_md_context_t fin_sha384;
 #endif
 #endif
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    /* PRF keyed with the master secret, for the key block and both
+     * Finished messages */
+    mbedtls_ssl_tls12_prf_key master_prf;
+#endif
+    /* Last transcript hash computed, valid until the next checksum update */
+    unsigned char transcript_snapshot[PSA_HASH_MAX_SIZE];
+    size_t transcript_snapshot_len;    /*!< 0 if there is no snapshot */
+    mbedtls_md_type_t transcript_snapshot_md;
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     uint16_t offered_group_id; /* The NamedGroup value for the group
@@ -991,6 +1407,11 @@ struct mbedtls_ssl_handshake_params {
     size_t pmslen;                      /*!<  premaster length        */
 #endif
 
+#if defined(MBEDTLS_SSL_SRV_C)
+    mbedtls_ssl_client_hello_exts client_hello_exts; /*!< extensions of the
+                                                        last ClientHello */
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     uint32_t sent_extensions;       /*!< extensions sent by endpoint */
     uint32_t received_extensions;   /*!< extensions received by endpoint */
@@ -1000,6 +1421,42 @@ struct mbedtls_ssl_handshake_params {
     unsigned char *certificate_request_context;
 #endif
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && defined(MBEDTLS_SSL_SRV_C)
+    uint16_t cert_compression_offered; /*!< bit n: the client can decompress
+                                        *   algorithm n (n < 16) */
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    uint8_t own_cert_type;              /*!< MBEDTLS_TLS_CERT_TYPE_XXX we
+                                         *   authenticate with */
+    uint8_t peer_cert_type;             /*!< MBEDTLS_TLS_CERT_TYPE_XXX the
+                                         *   peer authenticates with */
+#if defined(MBEDTLS_SSL_SRV_C)
+    uint8_t cli_cert_types;             /*!< bit n: the client can send
+                                         *   certificate type n (n < 8) */
+    uint8_t srv_cert_types;             /*!< bit n: the client accepts
+                                         *   certificate type n (n < 8) */
+#endif
+    mbedtls_pk_context peer_rpk;        /*!< raw public key of the peer */
+    unsigned char *peer_rpk_spki;       /*!< its SubjectPublicKeyInfo  */
+    size_t peer_rpk_spki_len;
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    uint8_t cached_info_offered;        /*!< the client sent the hash of a
+                                         *   chain it knows */
+    uint8_t cached_info_cert;           /*!< the server sends the hash of its
+                                         *   chain in place of the chain */
+#if defined(MBEDTLS_SSL_SRV_C)
+    unsigned char cached_info_hash[MBEDTLS_SSL_CACHED_INFO_HASH_LEN];
+#endif
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    uint8_t ocsp_requested;             /*!< the client sent status_request */
+    uint8_t ocsp_staple;                /*!< the server staples a response  */
+#endif
+
     /** TLS 1.3 transform for encrypted handshake messages. */
     mbedtls_ssl_transform *transform_handshake;
     union {
@@ -1031,6 +1488,17 @@ struct mbedtls_ssl_handshake_params {
     const mbedtls_x509_crt *dn_hints;   /*!< acceptable client cert issuers */
 #endif
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
+
+#if MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE > 0
+    /* Memory for mbedtls_ssl_hs_arena_calloc(), released all at once with
+     * the handshake (it is cleared by mbedtls_ssl_handshake_free()). */
+    union {
+        unsigned char buf[MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE];
+        void *align_ptr;
+        uint64_t align_u64;
+    } arena;
+    size_t arena_used;
+#endif
 };
 
 typedef struct mbedtls_ssl_hs_buffer mbedtls_ssl_hs_buffer;
@@ -1133,6 +1601,20 @@ struct mbedtls_ssl_transform {
     mbedtls_svc_key_id_t psa_mac_enc;           /*!<  MAC (encryption)        */
     mbedtls_svc_key_id_t psa_mac_dec;           /*!<  MAC (decryption)        */
     psa_algorithm_t psa_mac_alg;                /*!<  psa MAC algorithm       */
+    psa_hash_operation_t psa_mac_enc_inner;     /*!<  Hash state after the
+                                                      HMAC ikey (encryption) */
+    psa_hash_operation_t psa_mac_enc_outer;     /*!<  Hash state after the
+                                                      HMAC okey (encryption) */
+    psa_hash_operation_t psa_mac_dec_inner;     /*!<  Hash state after the
+                                                      HMAC ikey (decryption) */
+    psa_hash_operation_t psa_mac_dec_outer;     /*!<  Hash state after the
+                                                      HMAC okey (decryption) */
+    unsigned char psa_mac_enc_states;           /*!<  The encryption states are
+                                                      set up, used instead of
+                                                      psa_mac_enc           */
+    unsigned char psa_mac_dec_states;           /*!<  The decryption states are
+                                                      set up, used instead of
+                                                      psa_mac_dec           */
 #else
     mbedtls_md_context_t md_ctx_enc;            /*!<  MAC (encryption)        */
     mbedtls_md_context_t md_ctx_dec;            /*!<  MAC (decryption)        */
@@ -1162,6 +1644,15 @@ struct mbedtls_ssl_transform {
     unsigned char out_cid[MBEDTLS_SSL_CID_OUT_LEN_MAX];
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
+#if defined(MBEDTLS_SSL_KTLS)
+    /* Raw traffic keys, kept to hand the connection over to kernel TLS,
+     * see mbedtls_ssl_ktls_export(). ktls_keylen is 0 if they are not
+     * available. */
+    unsigned char ktls_key_enc[32];
+    unsigned char ktls_key_dec[32];
+    size_t ktls_keylen;
+#endif /* MBEDTLS_SSL_KTLS */
+
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
     /* We need the Hello random bytes in order to re-derive keys from the
      * Master Secret and other session info,
@@ -1169,9 +1660,21 @@ struct mbedtls_ssl_transform {
     unsigned char randbytes[MBEDTLS_SERVER_HELLO_RANDOM_LEN +
                             MBEDTLS_CLIENT_HELLO_RANDOM_LEN];
     /*!< ServerHello.random+ClientHello.random */
+    uint8_t has_randbytes;  /*!< 0 if loaded from the key block */
+
+    /* The part of the key block an AEAD transform uses, to save it without
+     * the PRF, see mbedtls_ssl_conf_context_save_keys(). key_block_len is 0
+     * if it is not available. */
+    unsigned char key_block[MBEDTLS_SSL_CONTEXT_KEY_BLOCK_MAX];
+    uint8_t key_block_len;
 #endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
 };
 
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+/* Two AEAD keys of up to 32 bytes and two implicit IVs of up to 12 bytes. */
+#define MBEDTLS_SSL_CONTEXT_KEY_BLOCK_MAX   (2 * (32 + 12))
+#endif
+
 /*
  * Return 1 if the transform uses an AEAD cipher, 0 otherwise.
  * Equivalently, return 0 if a separate MAC is used, 1 otherwise.
@@ -1207,6 +1710,10 @@ static inline int mbedtls_ssl_transform_uses_aead(
  * make space for the fixed IV.
  *
  */
+#if MBEDTLS_SSL_DTLS_REPLAY_WINDOW < 64 || MBEDTLS_SSL_DTLS_REPLAY_WINDOW % 64 != 0
+#error "MBEDTLS_SSL_DTLS_REPLAY_WINDOW must be a nonzero multiple of 64"
+#endif
+
 #if MBEDTLS_SSL_CID_OUT_LEN_MAX > MBEDTLS_SSL_CID_IN_LEN_MAX
 #define MBEDTLS_SSL_CID_LEN_MAX MBEDTLS_SSL_CID_OUT_LEN_MAX
 #else
@@ -1240,15 +1747,139 @@ typedef struct {
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 } mbedtls_record;
 
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+/*
+ * One record of a batch protected or deprotected by the pipeline callback,
+ * see mbedtls_ssl_conf_record_pipeline().
+ */
+typedef struct {
+    mbedtls_record rec;         /* Record, processed in place                */
+    const unsigned char *src;   /* Content to protect if not in rec, or NULL */
+    size_t expected;            /* Protected length of an outgoing record    */
+    int ret;                    /* Result for this record                    */
+} mbedtls_ssl_pipeline_entry;
+
+/*
+ * Records of one direction of a connection that are processed together.
+ * Outgoing records are laid out in the output buffer and protected when
+ * the batch is complete. Incoming records read ahead are deprotected with
+ * the current one, and then handed out one at a time.
+ */
+struct mbedtls_ssl_pipeline {
+    mbedtls_ssl_pipeline_entry *entries;
+    size_t size;                /* Number of entries                         */
+    size_t count;               /* Number of records in the current batch    */
+    mbedtls_ssl_transform *transform;   /* Transform of the current batch    */
+    int outgoing;               /* Whether records are protected             */
+
+    /* Outgoing: where the batch starts in the output buffer */
+    unsigned char *hdr;
+    size_t left;
+
+    /* Outgoing: whether the batch was handed to the asynchronous callback,
+     * and the number of its jobs that have not returned yet */
+    int in_flight;
+    size_t pending;
+    mbedtls_threading_mutex_t mutex;
+
+    /* Incoming: the decrypted records not handed out yet */
+    size_t next;
+    size_t ready;
+
+    /* Incoming, TLS 1.3: a copy of the records read ahead, restored if
+     * they follow a record that may change the key */
+    unsigned char *backup;
+    size_t backup_len;
+};
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 /*
  * List of certificate + private key pairs
  */
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/*
+ * The body of a CompressedCertificate message (RFC 8879 section 4) for a
+ * certificate chain, with an empty certificate_request_context.
+ */
+typedef struct mbedtls_ssl_compressed_cert mbedtls_ssl_compressed_cert;
+
+/* The largest Certificate message accepted, see
+ * mbedtls_ssl_tls13_parse_certificate(). */
+#define MBEDTLS_SSL_TLS1_3_CERT_MSG_MAX_LEN     (4 + 0xFFFF)
+
+struct mbedtls_ssl_compressed_cert {
+    uint16_t alg;                           /*!< compression algorithm      */
+    unsigned char *body;                    /*!< message body               */
+    size_t body_len;
+    mbedtls_ssl_compressed_cert *next;
+};
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
 struct mbedtls_ssl_key_cert {
     mbedtls_x509_crt *cert;                 /*!< cert                       */
     mbedtls_pk_context *key;                /*!< private key                */
     mbedtls_ssl_key_cert *next;             /*!< next key/cert pair         */
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    /* Whether the (extended) key usage of cert allows it to authenticate a
+     * TLS 1.3 server, checked once when the pair is added. */
+    unsigned char tls13_server_usage;
+#endif
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    mbedtls_ssl_compressed_cert *compressed; /*!< in algorithm preference order */
+#endif
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+    /* Entries of the certificate_list of the Certificate message, without
+     * its length, or NULL if they could not be encoded. */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    unsigned char *cert_list;
+    size_t cert_list_len;
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    unsigned char *cert_list_tls13;         /*!< with empty extensions      */
+    size_t cert_list_tls13_len;
+#endif
+#endif /* MBEDTLS_SSL_OWN_CERT_MSG_CACHE */
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    /* OCSP response stapled to cert, which mbedtls_ssl_conf_own_cert_ocsp()
+     * replaces while handshakes may be reading it. */
+    unsigned char *ocsp_resp;
+    size_t ocsp_resp_len;
+    mbedtls_time_t ocsp_refresh_at;         /*!< 0 for never                */
+    uint8_t ocsp_refresh_asked;             /*!< refresh callback called    */
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t ocsp_mutex;   /*!< protects the ocsp_ fields  */
+#endif
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
 };
+
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+/* Use a raw TLS 1.3 PSK owned by the caller for the current handshake,
+ * without importing it as mbedtls_ssl_set_hs_psk() does: the TLS 1.3 key
+ * schedule only needs the raw key. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_set_hs_psk_borrowed(mbedtls_ssl_context *ssl,
+                                    const unsigned char *psk, size_t psk_len);
+#endif
+
+#if defined(MBEDTLS_SSL_SNI_TABLE_C) || defined(MBEDTLS_SSL_CREDS_C)
+/* Build and free key/certificate lists for mbedtls_ssl_sni_table and
+ * mbedtls_ssl_creds, as mbedtls_ssl_conf_own_cert() and
+ * mbedtls_ssl_set_hs_own_cert() do. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_key_cert_append(const mbedtls_ssl_config *conf,
+                                mbedtls_ssl_key_cert **head,
+                                mbedtls_x509_crt *cert,
+                                mbedtls_pk_context *key);
+void mbedtls_ssl_key_cert_free(mbedtls_ssl_key_cert *key_cert);
+#endif /* MBEDTLS_SSL_SNI_TABLE_C || MBEDTLS_SSL_CREDS_C */
+
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+/* Use a key/certificate list owned by the caller for the current handshake,
+ * instead of building one with mbedtls_ssl_set_hs_own_cert(). */
+void mbedtls_ssl_set_hs_key_cert_list(mbedtls_ssl_context *ssl,
+                                      mbedtls_ssl_key_cert *key_cert);
+#endif /* MBEDTLS_SSL_SNI_TABLE_C */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
@@ -1319,6 +1950,33 @@ void mbedtls_ssl_transform_free(mbedtls_ssl_transform *transform);
  */
 void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl);
 
+/**
+ * \brief           Allocate zeroed memory that lives at most as long as a
+ *                  handshake, from the arena of the handshake context if it
+ *                  fits, or from the heap otherwise.
+ *
+ * \param handshake Handshake context
+ * \param n         Number of elements
+ * \param size      Size of each element
+ *
+ * \return          The allocated memory, to be released with
+ *                  mbedtls_ssl_hs_arena_free(), or \c NULL on failure.
+ */
+void *mbedtls_ssl_hs_arena_calloc(mbedtls_ssl_handshake_params *handshake,
+                                  size_t n, size_t size);
+
+/**
+ * \brief           Release memory from mbedtls_ssl_hs_arena_calloc()
+ *
+ *                  Memory from the arena is only reclaimed with the
+ *                  handshake context, heap memory is freed.
+ *
+ * \param handshake Handshake context \p p was allocated with
+ * \param p         Memory to release, or \c NULL
+ */
+void mbedtls_ssl_hs_arena_free(mbedtls_ssl_handshake_params *handshake,
+                               void *p);
+
 /* set inbound transform of ssl context */
 void mbedtls_ssl_set_inbound_transform(mbedtls_ssl_context *ssl,
                                        mbedtls_ssl_transform *transform);
@@ -1332,6 +1990,27 @@ int mbedtls_ssl_handshake_client_step(mbedtls_ssl_context *ssl);
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_handshake_server_step(mbedtls_ssl_context *ssl);
 void mbedtls_ssl_handshake_wrapup(mbedtls_ssl_context *ssl);
+
+/* mbedtls_ssl_handshake() without stopping where the client may False
+ * Start, for the read path. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_handshake_complete(mbedtls_ssl_context *ssl);
+
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+/* Run the admission callback, once the ClientHello is processed and before
+ * anything is written. Returns MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the
+ * handshake is deferred, and the callback's error, with a pending alert,
+ * if it is rejected. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_hs_admit(mbedtls_ssl_context *ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_FALSE_START)
+/* Whether the client sent its Finished message in a handshake that allows
+ * it to send application data before the server Finished (RFC 7918). */
+int mbedtls_ssl_tls12_false_start_ready(const mbedtls_ssl_context *ssl);
+#endif
+
 static inline void mbedtls_ssl_handshake_set_state(mbedtls_ssl_context *ssl,
                                                    mbedtls_ssl_states state)
 {
@@ -1438,6 +2117,12 @@ int mbedtls_ssl_read_record(mbedtls_ssl_context *ssl,
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want);
 
+/*
+ * Release the first n bytes of the application data record at in_offt,
+ * and the record itself once all of it is released.
+ */
+void mbedtls_ssl_consume_application_data(mbedtls_ssl_context *ssl, size_t n);
+
 /*
  * Write handshake message header
  */
@@ -1619,6 +2304,83 @@ mbedtls_ecp_group_id mbedtls_ssl_get_ecp_group_id_from_tls_id(uint16_t tls_id);
  */
 uint16_t mbedtls_ssl_get_tls_id_from_ecp_group_id(mbedtls_ecp_group_id grp_id);
 
+#if defined(PSA_WANT_ALG_FFDH)
+/**
+ * \brief Return PSA DH key type and bits for the specified TLS ID.
+ *
+ * \param tls_id    The TLS ID to look for
+ * \param bits      If the TLS ID is supported, the size of the group in bits
+ * \param key_type  If the TLS ID is supported, the PSA key pair type
+ * \return          PSA_SUCCESS if the TLS ID is a supported FFDH group,
+ *                  PSA_ERROR_NOT_SUPPORTED otherwise
+ */
+psa_status_t mbedtls_ssl_get_psa_ffdh_info_from_tls_id(
+    uint16_t tls_id, size_t *bits, psa_key_type_t *key_type);
+#endif /* PSA_WANT_ALG_FFDH */
+
+#if defined(MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED)
+/**
+ * \brief Set up the ephemeral (EC)DH key pair of the handshake in
+ *        \c handshake->xxdh_psa_privkey and export its public key.
+ *
+ *        The key pair is taken from the key share pool of the
+ *        configuration if it has one ready, and generated otherwise.
+ *
+ * \param ssl         SSL context
+ * \param attributes  Attributes of the key pair to generate
+ * \param pub         Buffer for the public key, in the format of
+ *                    psa_export_public_key()
+ * \param pub_size    Size of \p pub
+ * \param pub_len     On success, the length of the public key
+ *
+ * \return PSA_SUCCESS, or the PSA error of the generation or export.
+ *         On error, no key is left in \c handshake->xxdh_psa_privkey.
+ */
+psa_status_t mbedtls_ssl_generate_ephemeral_key(
+    mbedtls_ssl_context *ssl, const psa_key_attributes_t *attributes,
+    unsigned char *pub, size_t pub_size, size_t *pub_len);
+#endif /* MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED */
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+/**
+ * \brief Take a key pair with the given attributes from a key share pool.
+ *        (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *        The key is no longer in the pool: the caller destroys it.
+ *
+ * \return 0 on success, MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the pool
+ *         has no key pair ready that matches \p attributes or whose public
+ *         key fits in \p pub_size bytes.
+ */
+int mbedtls_ssl_key_share_pool_take(mbedtls_ssl_key_share_pool *pool,
+                                    const psa_key_attributes_t *attributes,
+                                    mbedtls_svc_key_id_t *key,
+                                    unsigned char *pub, size_t pub_size,
+                                    size_t *pub_len);
+#endif /* MBEDTLS_SSL_KEY_SHARE_POOL_C */
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+/**
+ * \brief Get the key pair with the given attributes to use for a handshake,
+ *        reusing the current one of the group if its window is not over.
+ *        (Thread-safe if MBEDTLS_THREADING_C is enabled)
+ *
+ *        The key stays owned by \p ctx: the handshake releases \p entry with
+ *        mbedtls_ssl_ecdhe_reuse_release() instead of destroying \p key.
+ *
+ * \return 0 on success, or an MBEDTLS_ERR_XXX code if a key pair cannot
+ *         be generated or its public key does not fit in \p pub_size bytes.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_ecdhe_reuse_take(mbedtls_ssl_ecdhe_reuse *ctx,
+                                 const psa_key_attributes_t *attributes,
+                                 struct mbedtls_ssl_ecdhe_reuse_key **entry,
+                                 mbedtls_svc_key_id_t *key,
+                                 unsigned char *pub, size_t pub_size,
+                                 size_t *pub_len);
+void mbedtls_ssl_ecdhe_reuse_release(struct mbedtls_ssl_ecdhe_reuse_key *entry);
+#endif /* MBEDTLS_SSL_ECDHE_REUSE_C */
+
 #if defined(MBEDTLS_DEBUG_C)
 /**
  * \brief Return EC's name for the specified TLS ID.
@@ -1647,32 +2409,98 @@ static inline mbedtls_ssl_srtp_profile mbedtls_ssl_check_srtp_profile_value
 #endif
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
+/*
+ * The own certificate/key pairs and trusted CAs of the configuration, or
+ * those of its credential slot when the handshake started.
+ */
+static inline mbedtls_ssl_key_cert *mbedtls_ssl_key_cert_list(
+    const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_CREDS_C)
+    if (ssl->handshake != NULL && ssl->handshake->creds != NULL &&
+        ssl->handshake->creds->key_cert != NULL) {
+        return ssl->handshake->creds->key_cert;
+    }
+#endif
+
+    return ssl->conf->key_cert;
+}
+
+static inline mbedtls_x509_crt *mbedtls_ssl_trusted_ca_chain(
+    const mbedtls_ssl_context *ssl, mbedtls_x509_crl **ca_crl)
+{
+#if defined(MBEDTLS_SSL_CREDS_C)
+    if (ssl->handshake != NULL && ssl->handshake->creds != NULL &&
+        ssl->handshake->creds->ca_chain != NULL) {
+        if (ca_crl != NULL) {
+            *ca_crl = ssl->handshake->creds->ca_crl;
+        }
+        return ssl->handshake->creds->ca_chain;
+    }
+#endif
+
+    if (ca_crl != NULL) {
+        *ca_crl = ssl->conf->ca_crl;
+    }
+    return ssl->conf->ca_chain;
+}
+
 static inline mbedtls_pk_context *mbedtls_ssl_own_key(mbedtls_ssl_context *ssl)
 {
     mbedtls_ssl_key_cert *key_cert;
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    if (ssl->handshake != NULL &&
+        ssl->handshake->own_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return ssl->conf->rpk_key;
+    }
+#endif
+
     if (ssl->handshake != NULL && ssl->handshake->key_cert != NULL) {
         key_cert = ssl->handshake->key_cert;
     } else {
-        key_cert = ssl->conf->key_cert;
+        key_cert = mbedtls_ssl_key_cert_list(ssl);
     }
 
     return key_cert == NULL ? NULL : key_cert->key;
 }
 
-static inline mbedtls_x509_crt *mbedtls_ssl_own_cert(mbedtls_ssl_context *ssl)
+static inline mbedtls_ssl_key_cert *mbedtls_ssl_own_key_cert(mbedtls_ssl_context *ssl)
 {
-    mbedtls_ssl_key_cert *key_cert;
-
     if (ssl->handshake != NULL && ssl->handshake->key_cert != NULL) {
-        key_cert = ssl->handshake->key_cert;
-    } else {
-        key_cert = ssl->conf->key_cert;
+        return ssl->handshake->key_cert;
     }
 
+    return mbedtls_ssl_key_cert_list(ssl);
+}
+
+static inline mbedtls_x509_crt *mbedtls_ssl_own_cert(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_key_cert *key_cert = mbedtls_ssl_own_key_cert(ssl);
+
     return key_cert == NULL ? NULL : key_cert->cert;
 }
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+/*
+ * The public key the peer authenticated with in the handshake: the key of
+ * its certificate, or its raw public key. NULL if it sent neither.
+ */
+static inline mbedtls_pk_context *mbedtls_ssl_tls13_peer_key(
+    mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    if (ssl->handshake->peer_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return mbedtls_pk_get_type(&ssl->handshake->peer_rpk) == MBEDTLS_PK_NONE ?
+               NULL : &ssl->handshake->peer_rpk;
+    }
+#endif
+
+    return ssl->session_negotiate->peer_cert == NULL ?
+           NULL : &ssl->session_negotiate->peer_cert->pk;
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 && MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
+
 /*
  * Verify a certificate.
  *
@@ -1782,6 +2610,129 @@ MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
                              const mbedtls_ssl_session *src);
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+/*
+ * Shared, reference-counted peer certificate chain, see
+ * mbedtls_ssl_session_copy_shared(). Sessions sharing a chain must not
+ * modify it.
+ */
+struct mbedtls_ssl_peer_cert_ref {
+    mbedtls_x509_crt crt;
+    unsigned refs;
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t mutex;    /* protects refs if not interned */
+#endif
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    mbedtls_ssl_peer_cert_table *table; /* the table it is interned in */
+    struct mbedtls_ssl_peer_cert_ref *table_next;
+    unsigned char digest[PSA_HASH_LENGTH(PSA_ALG_SHA_256)];
+#endif
+};
+
+/*
+ * Move a heap-allocated chain into a new handle with one reference.
+ * On failure, the chain is left untouched.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_peer_cert_ref_new(mbedtls_x509_crt *chain,
+                                  struct mbedtls_ssl_peer_cert_ref **ref);
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_peer_cert_ref_acquire(struct mbedtls_ssl_peer_cert_ref *ref);
+
+/* Drop a reference, and free the chain with the last one. */
+void mbedtls_ssl_peer_cert_ref_release(struct mbedtls_ssl_peer_cert_ref *ref);
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+/*
+ * Find a chain with the same DER certificates as chain in the table, or
+ * add chain to it, and return a new reference to it. On success, chain is
+ * consumed; on failure, it is left untouched.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_peer_cert_table_intern(mbedtls_ssl_peer_cert_table *table,
+                                       mbedtls_x509_crt *chain,
+                                       struct mbedtls_ssl_peer_cert_ref **ref);
+
+/* Unlink a chain whose last reference is gone. The table must be locked. */
+void mbedtls_ssl_peer_cert_table_remove(mbedtls_ssl_peer_cert_table *table,
+                                        struct mbedtls_ssl_peer_cert_ref *ref);
+
+/*
+ * Share the peer certificate chain of session through the table
+ * configured with mbedtls_ssl_conf_peer_cert_table(), if any.
+ */
+void mbedtls_ssl_session_intern_peer_cert(const mbedtls_ssl_context *ssl,
+                                          mbedtls_ssl_session *session);
+#endif /* MBEDTLS_SSL_PEER_CERT_TABLE_C */
+#endif /* MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
+
+/*
+ * Like mbedtls_ssl_session_copy(), but dst shares the peer certificate
+ * chain of src instead of parsing a copy of it. On first use, the chain of
+ * src is moved into a reference-counted handle, hence src is not const.
+ * mbedtls_ssl_session_copy() then shares it too.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_copy_shared(mbedtls_ssl_session *dst,
+                                    mbedtls_ssl_session *src);
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+/* Free the peer certificate chain of a session, or drop its reference. */
+void mbedtls_ssl_session_clear_peer_cert(mbedtls_ssl_session *session);
+#endif
+
+/*
+ * Packed form of a session, held by the session caches and tickets.
+ *
+ * It is the format of mbedtls_ssl_session_save(), which only has the
+ * fields of the negotiated TLS version, without the parts that the holder
+ * does not need:
+ * - MBEDTLS_SSL_SESSION_PACK_NO_HEADER: the library version and
+ *   configuration header, for sessions that never leave the process;
+ * - MBEDTLS_SSL_SESSION_PACK_NO_ID: the TLS 1.2 session ID, for holders
+ *   that key sessions by it or learn it from the ClientHello. Unpacked
+ *   sessions have an empty ID.
+ */
+#define MBEDTLS_SSL_SESSION_PACK_NO_HEADER  0x01
+#define MBEDTLS_SSL_SESSION_PACK_NO_ID      0x02
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_pack(const mbedtls_ssl_session *session,
+                             int flags,
+                             unsigned char *buf,
+                             size_t buf_len,
+                             size_t *olen);
+
+/* Like mbedtls_ssl_session_load(), with the flags the session was packed
+ * with. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_session_unpack(mbedtls_ssl_session *session,
+                               int flags,
+                               const unsigned char *buf,
+                               size_t len);
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+/*
+ * Client hooks of the session store set in the configuration, if any:
+ * offer a stored session before the first ClientHello, and store
+ * ssl->session once it can be resumed. Failures only cost resumption.
+ */
+void mbedtls_ssl_session_store_resume(mbedtls_ssl_context *ssl);
+void mbedtls_ssl_session_store_add(mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
+#if defined(MBEDTLS_SSL_CREDS_C)
+/*
+ * Take a reference to the current credentials of a slot, NULL if it has
+ * none, and drop it. The last reference to a replaced set releases it.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_creds_acquire(mbedtls_ssl_creds_slot *slot,
+                              mbedtls_ssl_creds **creds);
+void mbedtls_ssl_creds_release(mbedtls_ssl_creds *creds);
+#endif /* MBEDTLS_SSL_CREDS_C */
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
 /* The hash buffer must have at least MBEDTLS_MD_MAX_SIZE bytes of length. */
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -1796,17 +2747,56 @@ int mbedtls_ssl_get_key_exchange_md_tls1_2(mbedtls_ssl_context *ssl,
 #endif
 
 void mbedtls_ssl_transform_init(mbedtls_ssl_transform *transform);
+/*
+ * Records are protected one at a time, even for many connections: PSA has
+ * no multi-buffer AEAD operation that could take the records of several
+ * transforms in one call, so a batch entry point could only loop here.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
                             mbedtls_ssl_transform *transform,
                             mbedtls_record *rec,
                             int (*f_rng)(void *, unsigned char *, size_t),
                             void *p_rng);
+/*
+ * Like mbedtls_ssl_encrypt_buf(), but the rec->data_len bytes of plaintext
+ * are read from src instead of from the record buffer, which must not
+ * overlap it. For AEAD in TLS 1.2 without a CID, the cipher reads src and
+ * writes the record buffer directly. Otherwise src is first copied into the
+ * record buffer and the record is protected in place. src may be NULL.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_encrypt_buf_from(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_transform *transform,
+                                 mbedtls_record *rec,
+                                 const unsigned char *src,
+                                 int (*f_rng)(void *, unsigned char *, size_t),
+                                 void *p_rng);
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
                             mbedtls_ssl_transform *transform,
                             mbedtls_record *rec);
 
+/*
+ * Like mbedtls_ssl_decrypt_buf(), but the plaintext is written to dst,
+ * which must not overlap the record buffer, instead of in place. rec is
+ * updated as by mbedtls_ssl_decrypt_buf(), but the content of the record
+ * buffer is unspecified. For AEAD in TLS 1.2 without a CID, the cipher
+ * reads the record buffer and writes dst directly. Otherwise the record is
+ * decrypted in place and then copied to dst. If the plaintext is longer
+ * than dst_len, MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL is returned. dst may be
+ * NULL to decrypt in place.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_decrypt_buf_to(mbedtls_ssl_context const *ssl,
+                               mbedtls_ssl_transform *transform,
+                               mbedtls_record *rec,
+                               unsigned char *dst, size_t dst_len);
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+void mbedtls_ssl_pipeline_free(mbedtls_ssl_pipeline *pipe);
+#endif
+
 /* Length of the "epoch" field in the record header */
 static inline size_t mbedtls_ssl_ep_len(const mbedtls_ssl_context *ssl)
 {
@@ -1834,6 +2824,14 @@ void mbedtls_ssl_update_out_pointers(mbedtls_ssl_context *ssl,
                                      mbedtls_ssl_transform *transform);
 void mbedtls_ssl_update_in_pointers(mbedtls_ssl_context *ssl);
 
+/*
+ * Get back the record buffers released by mbedtls_ssl_release_buffers(),
+ * if any. Must be called before any use of in_buf/out_buf once the
+ * handshake is over.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_acquire_buffers(mbedtls_ssl_context *ssl);
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial);
 void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
@@ -1871,6 +2869,7 @@ int mbedtls_ssl_start_renegotiation(mbedtls_ssl_context *ssl);
 size_t mbedtls_ssl_get_current_mtu(const mbedtls_ssl_context *ssl);
 void mbedtls_ssl_buffering_free(mbedtls_ssl_context *ssl);
 void mbedtls_ssl_flight_free(mbedtls_ssl_flight_item *flight);
+void mbedtls_ssl_flight_cache_free(mbedtls_ssl_handshake_params *handshake);
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 /**
@@ -1886,6 +2885,45 @@ static inline int mbedtls_ssl_conf_is_tls13_only(const mbedtls_ssl_config *conf)
 
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
+/*
+ * Settings that a configuration overlay can override: the overlay of the
+ * context first, then its configuration.
+ */
+static inline const int *mbedtls_ssl_get_ciphersuite_list(
+    const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+    if (ssl->overlay != NULL && ssl->overlay->ciphersuite_list != NULL) {
+        return ssl->overlay->ciphersuite_list;
+    }
+#endif
+    return ssl->conf->ciphersuite_list;
+}
+
+#if defined(MBEDTLS_SSL_ALPN)
+static inline const char **mbedtls_ssl_get_alpn_list(
+    const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+    if (ssl->overlay != NULL && ssl->overlay->alpn_list != NULL) {
+        return ssl->overlay->alpn_list;
+    }
+#endif
+    return ssl->conf->alpn_list;
+}
+#endif /* MBEDTLS_SSL_ALPN */
+
+static inline int mbedtls_ssl_get_conf_authmode(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+    if (ssl->overlay != NULL &&
+        ssl->overlay->authmode != MBEDTLS_SSL_VERIFY_UNSET) {
+        return ssl->overlay->authmode;
+    }
+#endif
+    return ssl->conf->authmode;
+}
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
 static inline int mbedtls_ssl_conf_is_tls12_only(const mbedtls_ssl_config *conf)
 {
@@ -1926,6 +2964,12 @@ static inline int mbedtls_ssl_conf_is_hybrid_tls12_tls13(const mbedtls_ssl_confi
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 && MBEDTLS_SSL_PROTO_TLS1_3 */
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+/* Flags of ssl->key_update */
+#define MBEDTLS_SSL_KEY_UPDATE_SEND         1   /* a KeyUpdate is to be sent */
+#define MBEDTLS_SSL_KEY_UPDATE_REQUEST      2   /* with update_requested */
+#define MBEDTLS_SSL_KEY_UPDATE_AWAITING     4   /* the peer was asked to update */
+#define MBEDTLS_SSL_KEY_UPDATE_FLUSH        8   /* a KeyUpdate is being sent */
+
 extern const uint8_t mbedtls_ssl_tls13_hello_retry_request_magic[
     MBEDTLS_SERVER_HELLO_RANDOM_LEN];
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -2746,8 +3790,19 @@ typedef enum {
     MBEDTLS_SSL_MODE_AEAD
 } mbedtls_ssl_mode_t;
 
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
 mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_transform(
     const mbedtls_ssl_transform *transform);
+#else
+/* Without CBC and stream ciphersuites, every transform is AEAD, and the
+ * record protection code only keeps that path. */
+static inline mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_transform(
+    const mbedtls_ssl_transform *transform)
+{
+    (void) transform;
+    return MBEDTLS_SSL_MODE_AEAD;
+}
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC */
 
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
 mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_ciphersuite(
@@ -2770,7 +3825,7 @@ int mbedtls_ssl_tls13_read_public_xxdhe_share(mbedtls_ssl_context *ssl,
 static inline int mbedtls_ssl_tls13_cipher_suite_is_offered(
     mbedtls_ssl_context *ssl, int cipher_suite)
 {
-    const int *ciphersuite_list = ssl->conf->ciphersuite_list;
+    const int *ciphersuite_list = mbedtls_ssl_get_ciphersuite_list(ssl);
 
     /* Check whether we have offered this ciphersuite */
     for (size_t i = 0; ciphersuite_list[i] != 0; i++) {
@@ -2821,6 +3876,62 @@ int mbedtls_ssl_tls13_write_record_size_limit_ext(mbedtls_ssl_context *ssl,
                                                   size_t *out_len);
 #endif /* MBEDTLS_SSL_RECORD_SIZE_LIMIT */
 
+/* Whether the handshake messages go to a QUIC stack rather than records,
+ * see mbedtls_ssl_set_quic(). */
+static inline int mbedtls_ssl_is_quic(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_QUIC)
+    return ssl->f_quic_send != NULL;
+#else
+    ((void) ssl);
+    return 0;
+#endif
+}
+
+#if defined(MBEDTLS_SSL_QUIC)
+/*
+ * Give the traffic secrets of a level to the QUIC stack, from the point
+ * of view of this endpoint. Does nothing outside of QUIC.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_quic_set_secrets(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_quic_level level,
+                                 const unsigned char *client_secret,
+                                 const unsigned char *server_secret,
+                                 size_t secret_len);
+
+/*
+ * Handshake message I/O of QUIC, in place of the record layer: the message
+ * in out_msg goes to the QUIC stack, and the next whole message given at
+ * the current read level is loaded into in_msg, or
+ * MBEDTLS_ERR_SSL_WANT_READ is returned.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_quic_write_message(mbedtls_ssl_context *ssl);
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_quic_read_message(mbedtls_ssl_context *ssl);
+
+/* The quic_transport_parameters extension, RFC 9001 section 8.2 */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_parse_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl,
+    const unsigned char *buf,
+    const unsigned char *end);
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_write_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl,
+    unsigned char *buf,
+    const unsigned char *end,
+    size_t *out_len);
+
+/* Fail a QUIC handshake if the peer did not send the extension. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_check_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl);
+#endif /* MBEDTLS_SSL_QUIC */
+
 #if defined(MBEDTLS_SSL_ALPN)
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_parse_alpn_ext(mbedtls_ssl_context *ssl,
@@ -2835,6 +3946,36 @@ int mbedtls_ssl_write_alpn_ext(mbedtls_ssl_context *ssl,
                                size_t *out_len);
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+/*
+ * The cached_info extension: the hash of the chain the client knows in the
+ * ClientHello, and the types of what the server will not send in the
+ * ServerHello (TLS 1.2) or EncryptedExtensions (TLS 1.3).
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_parse_cached_info_ext(mbedtls_ssl_context *ssl,
+                                      const unsigned char *buf,
+                                      const unsigned char *end);
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_write_cached_info_ext(mbedtls_ssl_context *ssl,
+                                      unsigned char *buf,
+                                      const unsigned char *end,
+                                      size_t *out_len);
+
+#if defined(MBEDTLS_SSL_CLI_C)
+/*
+ * Parse the hash_value sent by the server in place of its certificate_list,
+ * and parse the cached chain it stands for into \p chain.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_parse_cached_certificate(mbedtls_ssl_context *ssl,
+                                         const unsigned char *buf,
+                                         const unsigned char *end,
+                                         mbedtls_x509_crt *chain);
+#endif
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
 #if defined(MBEDTLS_TEST_HOOKS)
 int mbedtls_ssl_check_dtls_clihlo_cookie(
     mbedtls_ssl_context *ssl,
@@ -2955,6 +4096,29 @@ static inline void mbedtls_ssl_tls13_session_clear_ticket_flags(
 int mbedtls_ssl_tls13_finalize_client_hello(mbedtls_ssl_context *ssl);
 #endif
 
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC) && defined(MBEDTLS_USE_PSA_CRYPTO)
+/** Set up the hash states of an HMAC key after its inner and outer key
+ * blocks, for mbedtls_ct_hmac_states().
+ *
+ * \param mac_alg           The HMAC algorithm.
+ * \param key               The HMAC key, no longer than the hash block.
+ * \param key_len           The length of \p key in bytes.
+ * \param inner             The inner hash state to set up. It must be
+ *                          initialized and not set up yet.
+ * \param outer             The outer hash state to set up. It must be
+ *                          initialized and not set up yet.
+ *
+ * \retval 0 on success. The caller aborts both states when done.
+ * \retval #MBEDTLS_ERR_SSL_BAD_INPUT_DATA if \p key is too long.
+ * \retval An error from the hash driver on failure. Both states are then
+ *         aborted.
+ */
+int mbedtls_ssl_hmac_setup_states(psa_algorithm_t mac_alg,
+                                  const unsigned char *key, size_t key_len,
+                                  psa_hash_operation_t *inner,
+                                  psa_hash_operation_t *outer);
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC && MBEDTLS_USE_PSA_CRYPTO */
+
 #if defined(MBEDTLS_TEST_HOOKS) && defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
 
 /** Compute the HMAC of variable-length data with constant flow.
@@ -3003,6 +4167,29 @@ int mbedtls_ct_hmac(mbedtls_svc_key_id_t key,
                     size_t min_data_len,
                     size_t max_data_len,
                     unsigned char *output);
+
+/** Compute the HMAC of variable-length data with constant flow, as
+ * mbedtls_ct_hmac() does, from the hash states set up by
+ * mbedtls_ssl_hmac_setup_states() instead of from a key.
+ *
+ * \param inner             Hash state after the HMAC inner key block. It
+ *                          is cloned, not modified.
+ * \param outer             Hash state after the HMAC outer key block. It
+ *                          is cloned, not modified.
+ * \param mac_alg           The HMAC algorithm of the two states.
+ *
+ * The other parameters are those of mbedtls_ct_hmac().
+ */
+int mbedtls_ct_hmac_states(const psa_hash_operation_t *inner,
+                           const psa_hash_operation_t *outer,
+                           psa_algorithm_t mac_alg,
+                           const unsigned char *add_data,
+                           size_t add_data_len,
+                           const unsigned char *data,
+                           size_t data_len_secret,
+                           size_t min_data_len,
+                           size_t max_data_len,
+                           unsigned char *output);
 #else
 int mbedtls_ct_hmac(mbedtls_md_context_t *ctx,
                     const unsigned char *add_data,
@@ -24,6 +24,11 @@
 #include "constant_time_internal.h"
 #include "mbedtls/constant_time.h"
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+#include "ssl_tls13_keys.h"
+#endif
+
+#include <limits.h>
 #include <string.h>
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -59,47 +64,31 @@ static int local_err_translation(psa_status_t status)
 #define MAX_HASH_BLOCK_LENGTH PSA_HASH_BLOCK_LENGTH(PSA_ALG_SHA_1)
 #endif
 
-MBEDTLS_STATIC_TESTABLE
-int mbedtls_ct_hmac(mbedtls_svc_key_id_t key,
-                    psa_algorithm_t mac_alg,
-                    const unsigned char *add_data,
-                    size_t add_data_len,
-                    const unsigned char *data,
-                    size_t data_len_secret,
-                    size_t min_data_len,
-                    size_t max_data_len,
-                    unsigned char *output)
+int mbedtls_ssl_hmac_setup_states(psa_algorithm_t mac_alg,
+                                  const unsigned char *key, size_t key_len,
+                                  psa_hash_operation_t *inner,
+                                  psa_hash_operation_t *outer)
 {
     /*
-     * This function breaks the HMAC abstraction and uses psa_hash_clone()
-     * extension in order to get constant-flow behaviour.
-     *
      * HMAC(msg) is defined as HASH(okey + HASH(ikey + msg)) where + means
      * concatenation, and okey/ikey are the XOR of the key with some fixed bit
-     * patterns (see RFC 2104, sec. 2).
+     * patterns (see RFC 2104, sec. 2). Both start with a whole block, so the
+     * hash states after ikey and okey can be kept and cloned for each
+     * message.
      *
-     * We'll first compute ikey/okey, then inner_hash = HASH(ikey + msg) by
-     * hashing up to minlen, then cloning the context, and for each byte up
-     * to maxlen finishing up the hash computation, keeping only the
-     * correct result.
-     *
-     * Then we only need to compute HASH(okey + inner_hash) and we're done.
+     * We assume key length is always exactly the output size
+     * which is never more than the block size.
      */
     psa_algorithm_t hash_alg = PSA_ALG_HMAC_GET_HASH(mac_alg);
     const size_t block_size = PSA_HASH_BLOCK_LENGTH(hash_alg);
     unsigned char key_buf[MAX_HASH_BLOCK_LENGTH];
-    const size_t hash_size = PSA_HASH_LENGTH(hash_alg);
-    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
-    size_t hash_length;
-
-    unsigned char aux_out[PSA_HASH_MAX_SIZE];
-    psa_hash_operation_t aux_operation = PSA_HASH_OPERATION_INIT;
-    size_t offset;
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-
-    size_t mac_key_length;
     size_t i;
 
+    if (key_len > block_size) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
 #define PSA_CHK(func_call)        \
     do {                            \
         status = (func_call);       \
@@ -107,25 +96,127 @@ int mbedtls_ct_hmac(mbedtls_svc_key_id_t key,
         goto cleanup;           \
     } while (0)
 
-    /* Export MAC key
-     * We assume key length is always exactly the output size
-     * which is never more than the block size, thus we use block_size
-     * as the key buffer size.
-     */
-    PSA_CHK(psa_export_key(key, key_buf, block_size, &mac_key_length));
-
     /* Calculate ikey */
-    for (i = 0; i < mac_key_length; i++) {
-        key_buf[i] = (unsigned char) (key_buf[i] ^ 0x36);
+    for (i = 0; i < key_len; i++) {
+        key_buf[i] = (unsigned char) (key[i] ^ 0x36);
     }
     for (; i < block_size; ++i) {
         key_buf[i] = 0x36;
     }
 
-    PSA_CHK(psa_hash_setup(&operation, hash_alg));
+    PSA_CHK(psa_hash_setup(inner, hash_alg));
+    PSA_CHK(psa_hash_update(inner, key_buf, block_size));
+
+    /* Calculate okey */
+    for (i = 0; i < key_len; i++) {
+        key_buf[i] = (unsigned char) (key[i] ^ 0x5C);
+    }
+    for (; i < block_size; ++i) {
+        key_buf[i] = 0x5C;
+    }
+
+    PSA_CHK(psa_hash_setup(outer, hash_alg));
+    PSA_CHK(psa_hash_update(outer, key_buf, block_size));
+
+#undef PSA_CHK
+
+cleanup:
+    mbedtls_platform_zeroize(key_buf, MAX_HASH_BLOCK_LENGTH);
+
+    if (status != PSA_SUCCESS) {
+        psa_hash_abort(inner);
+        psa_hash_abort(outer);
+    }
+    return PSA_TO_MBEDTLS_ERR(status);
+}
+
+/*
+ * HMAC of add_data + data from the hash states after the key blocks.
+ */
+static psa_status_t ssl_hmac_from_states(const psa_hash_operation_t *inner,
+                                         const psa_hash_operation_t *outer,
+                                         psa_algorithm_t mac_alg,
+                                         const unsigned char *add_data,
+                                         size_t add_data_len,
+                                         const unsigned char *data,
+                                         size_t data_len,
+                                         unsigned char *output)
+{
+    const size_t hash_size = PSA_HASH_LENGTH(PSA_ALG_HMAC_GET_HASH(mac_alg));
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+    unsigned char inner_hash[PSA_HASH_MAX_SIZE];
+    size_t hash_length;
+    psa_status_t status;
+
+#define PSA_CHK(func_call)        \
+    do {                            \
+        status = (func_call);       \
+        if (status != PSA_SUCCESS) \
+        goto cleanup;           \
+    } while (0)
+
+    PSA_CHK(psa_hash_clone(inner, &operation));
+    PSA_CHK(psa_hash_update(&operation, add_data, add_data_len));
+    PSA_CHK(psa_hash_update(&operation, data, data_len));
+    PSA_CHK(psa_hash_finish(&operation, inner_hash, sizeof(inner_hash),
+                            &hash_length));
+
+    PSA_CHK(psa_hash_clone(outer, &operation));
+    PSA_CHK(psa_hash_update(&operation, inner_hash, hash_size));
+    PSA_CHK(psa_hash_finish(&operation, output, hash_size, &hash_length));
+
+#undef PSA_CHK
+
+cleanup:
+    mbedtls_platform_zeroize(inner_hash, sizeof(inner_hash));
+
+    psa_hash_abort(&operation);
+    return status;
+}
+
+MBEDTLS_STATIC_TESTABLE
+int mbedtls_ct_hmac_states(const psa_hash_operation_t *inner,
+                           const psa_hash_operation_t *outer,
+                           psa_algorithm_t mac_alg,
+                           const unsigned char *add_data,
+                           size_t add_data_len,
+                           const unsigned char *data,
+                           size_t data_len_secret,
+                           size_t min_data_len,
+                           size_t max_data_len,
+                           unsigned char *output)
+{
+    /*
+     * This function breaks the HMAC abstraction and uses psa_hash_clone()
+     * extension in order to get constant-flow behaviour.
+     *
+     * Starting from the hash state after ikey, we'll compute
+     * inner_hash = HASH(ikey + msg) by hashing up to minlen, then cloning
+     * the context, and for each byte up to maxlen finishing up the hash
+     * computation, keeping only the correct result.
+     *
+     * Then we only need to add inner_hash to the hash state after okey and
+     * we're done.
+     */
+    psa_algorithm_t hash_alg = PSA_ALG_HMAC_GET_HASH(mac_alg);
+    const size_t hash_size = PSA_HASH_LENGTH(hash_alg);
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+    size_t hash_length;
+
+    unsigned char aux_out[PSA_HASH_MAX_SIZE];
+    psa_hash_operation_t aux_operation = PSA_HASH_OPERATION_INIT;
+    size_t offset;
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+
+#define PSA_CHK(func_call)        \
+    do {                            \
+        status = (func_call);       \
+        if (status != PSA_SUCCESS) \
+        goto cleanup;           \
+    } while (0)
 
     /* Now compute inner_hash = HASH(ikey + msg) */
-    PSA_CHK(psa_hash_update(&operation, key_buf, block_size));
+    PSA_CHK(psa_hash_clone(inner, &operation));
     PSA_CHK(psa_hash_update(&operation, add_data, add_data_len));
     PSA_CHK(psa_hash_update(&operation, data, min_data_len));
 
@@ -152,24 +243,14 @@ int mbedtls_ct_hmac(mbedtls_svc_key_id_t key,
     /* Abort current operation to prepare for final operation */
     PSA_CHK(psa_hash_abort(&operation));
 
-    /* Calculate okey */
-    for (i = 0; i < mac_key_length; i++) {
-        key_buf[i] = (unsigned char) ((key_buf[i] ^ 0x36) ^ 0x5C);
-    }
-    for (; i < block_size; ++i) {
-        key_buf[i] = 0x5C;
-    }
-
     /* Now compute HASH(okey + inner_hash) */
-    PSA_CHK(psa_hash_setup(&operation, hash_alg));
-    PSA_CHK(psa_hash_update(&operation, key_buf, block_size));
+    PSA_CHK(psa_hash_clone(outer, &operation));
     PSA_CHK(psa_hash_update(&operation, output, hash_size));
     PSA_CHK(psa_hash_finish(&operation, output, hash_size, &hash_length));
 
 #undef PSA_CHK
 
 cleanup:
-    mbedtls_platform_zeroize(key_buf, MAX_HASH_BLOCK_LENGTH);
     mbedtls_platform_zeroize(aux_out, PSA_HASH_MAX_SIZE);
 
     psa_hash_abort(&operation);
@@ -177,6 +258,56 @@ cleanup:
     return PSA_TO_MBEDTLS_ERR(status);
 }
 
+MBEDTLS_STATIC_TESTABLE
+int mbedtls_ct_hmac(mbedtls_svc_key_id_t key,
+                    psa_algorithm_t mac_alg,
+                    const unsigned char *add_data,
+                    size_t add_data_len,
+                    const unsigned char *data,
+                    size_t data_len_secret,
+                    size_t min_data_len,
+                    size_t max_data_len,
+                    unsigned char *output)
+{
+    psa_algorithm_t hash_alg = PSA_ALG_HMAC_GET_HASH(mac_alg);
+    const size_t block_size = PSA_HASH_BLOCK_LENGTH(hash_alg);
+    unsigned char key_buf[MAX_HASH_BLOCK_LENGTH];
+    psa_hash_operation_t inner = PSA_HASH_OPERATION_INIT;
+    psa_hash_operation_t outer = PSA_HASH_OPERATION_INIT;
+    size_t mac_key_length;
+    psa_status_t status;
+    int ret;
+
+    /* Export MAC key
+     * We assume key length is always exactly the output size
+     * which is never more than the block size, thus we use block_size
+     * as the key buffer size.
+     */
+    status = psa_export_key(key, key_buf, block_size, &mac_key_length);
+    if (status != PSA_SUCCESS) {
+        ret = PSA_TO_MBEDTLS_ERR(status);
+        goto cleanup;
+    }
+
+    ret = mbedtls_ssl_hmac_setup_states(mac_alg, key_buf, mac_key_length,
+                                        &inner, &outer);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
+    ret = mbedtls_ct_hmac_states(&inner, &outer, mac_alg,
+                                 add_data, add_data_len,
+                                 data, data_len_secret,
+                                 min_data_len, max_data_len, output);
+
+cleanup:
+    mbedtls_platform_zeroize(key_buf, MAX_HASH_BLOCK_LENGTH);
+
+    psa_hash_abort(&inner);
+    psa_hash_abort(&outer);
+    return ret;
+}
+
 #undef MAX_HASH_BLOCK_LENGTH
 
 #else
@@ -389,11 +520,7 @@ static int ssl_next_record_is_in_datagram(mbedtls_ssl_context *ssl);
 static size_t ssl_get_maximum_datagram_size(mbedtls_ssl_context const *ssl)
 {
     size_t mtu = mbedtls_ssl_get_current_mtu(ssl);
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t out_buf_len = ssl->out_buf_len;
-#else
-    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
-#endif
 
     if (mtu != 0 && mtu < out_buf_len) {
         return mtu;
@@ -423,7 +550,7 @@ static int ssl_get_remaining_payload_in_datagram(mbedtls_ssl_context const *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t remaining, expansion;
-    size_t max_len = MBEDTLS_SSL_OUT_CONTENT_LEN;
+    size_t max_len = mbedtls_ssl_out_content_len(ssl);
 
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
     const size_t mfl = mbedtls_ssl_get_output_max_frag_len(ssl);
@@ -472,6 +599,96 @@ static int ssl_get_remaining_payload_in_datagram(mbedtls_ssl_context const *ssl)
     return (int) remaining;
 }
 
+/*
+ * Datagram payload sizes tried in turn when lowering the path MTU: Ethernet
+ * over IPv4, Ethernet over IPv6, the minimum IPv6 MTU, and the size that the
+ * final paragraph of RFC 6347 section 4.1.1.1 falls back to.
+ */
+#define SSL_PMTU_MIN 508
+
+static const uint16_t ssl_pmtu_sizes[] = { 1472, 1452, 1232, SSL_PMTU_MIN };
+
+static uint16_t ssl_pmtu_next_lower(size_t datagram_size)
+{
+    size_t i;
+
+    for (i = 0; i < sizeof(ssl_pmtu_sizes) / sizeof(ssl_pmtu_sizes[0]); i++) {
+        if (ssl_pmtu_sizes[i] < datagram_size) {
+            return ssl_pmtu_sizes[i];
+        }
+    }
+
+    return SSL_PMTU_MIN;
+}
+
+/*
+ * Initial retransmit timeout of a flight: the configured minimum, or the
+ * RFC 6298 estimate SRTT + 4 * RTTVAR once the round-trip time is known.
+ */
+static uint32_t ssl_initial_retransmit_timeout(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    const mbedtls_ssl_handshake_params *hs = ssl->handshake;
+    uint64_t rto;
+
+    if (ssl->conf->hs_timeout_floor != 0 && hs->rtt_valid) {
+        rto = (uint64_t) hs->srtt +
+              (hs->rttvar != 0 ? 4 * (uint64_t) hs->rttvar : 1);
+        if (rto < ssl->conf->hs_timeout_floor) {
+            rto = ssl->conf->hs_timeout_floor;
+        }
+        if (rto > ssl->conf->hs_timeout_max) {
+            rto = ssl->conf->hs_timeout_max;
+        }
+        return (uint32_t) rto;
+    }
+#endif /* MBEDTLS_HAVE_TIME */
+
+    return ssl->conf->hs_timeout_min;
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+/*
+ * Update SRTT and RTTVAR as in RFC 6298 section 2 with the time it took the
+ * peer to answer the current flight, unless it was retransmitted (Karn's
+ * algorithm).
+ */
+static void ssl_update_rtt(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params *hs = ssl->handshake;
+    mbedtls_ms_time_t elapsed;
+    uint32_t rtt, delta;
+
+    if (ssl->conf->hs_timeout_floor == 0 || !hs->rtt_pending) {
+        return;
+    }
+    hs->rtt_pending = 0;
+
+    elapsed = mbedtls_ms_time() - hs->flight_sent_time;
+    if (elapsed < 0) {
+        rtt = 0;
+    } else if (elapsed > (mbedtls_ms_time_t) ssl->conf->hs_timeout_max) {
+        rtt = ssl->conf->hs_timeout_max;
+    } else {
+        rtt = (uint32_t) elapsed;
+    }
+
+    if (!hs->rtt_valid) {
+        hs->srtt = rtt;
+        hs->rttvar = rtt / 2;
+        hs->rtt_valid = 1;
+    } else {
+        delta = hs->srtt > rtt ? hs->srtt - rtt : rtt - hs->srtt;
+        hs->rttvar = (uint32_t) ((3 * (uint64_t) hs->rttvar + delta) / 4);
+        hs->srtt = (uint32_t) ((7 * (uint64_t) hs->srtt + rtt) / 8);
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("rtt sample %lu millisecs, srtt %lu, rttvar %lu",
+                              (unsigned long) rtt, (unsigned long) hs->srtt,
+                              (unsigned long) hs->rttvar));
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
 /*
  * Double the retransmit timeout value, within the allowed range,
  * returning -1 if the maximum value has already been reached.
@@ -491,8 +708,12 @@ static int ssl_double_retransmit_timeout(mbedtls_ssl_context *ssl)
      * This value is guaranteed to be deliverable (if not guaranteed to be
      * delivered) of any compliant IPv4 (and IPv6) network, and should work
      * on most non-IP stacks too. */
-    if (ssl->handshake->retransmit_timeout != ssl->conf->hs_timeout_min) {
-        ssl->handshake->mtu = 508;
+    if (ssl->handshake->retransmit_timeout != ssl_initial_retransmit_timeout(ssl)) {
+        if (ssl->conf->dtls_pmtu_probing == MBEDTLS_SSL_DTLS_PMTU_PROBING_ENABLED) {
+            ssl->handshake->mtu = ssl_pmtu_next_lower(ssl_get_maximum_datagram_size(ssl));
+        } else {
+            ssl->handshake->mtu = SSL_PMTU_MIN;
+        }
         MBEDTLS_SSL_DEBUG_MSG(2, ("mtu autoreduction to %d bytes", ssl->handshake->mtu));
     }
 
@@ -513,10 +734,25 @@ static int ssl_double_retransmit_timeout(mbedtls_ssl_context *ssl)
 
 static void ssl_reset_retransmit_timeout(mbedtls_ssl_context *ssl)
 {
-    ssl->handshake->retransmit_timeout = ssl->conf->hs_timeout_min;
+    ssl->handshake->retransmit_timeout = ssl_initial_retransmit_timeout(ssl);
     MBEDTLS_SSL_DEBUG_MSG(3, ("update timeout value to %lu millisecs",
                               (unsigned long) ssl->handshake->retransmit_timeout));
 }
+
+void mbedtls_ssl_update_path_mtu(mbedtls_ssl_context *ssl, uint16_t mtu)
+{
+    if (mtu == 0) {
+        mtu = ssl_pmtu_next_lower(ssl_get_maximum_datagram_size(ssl));
+    } else if (mtu < SSL_PMTU_MIN) {
+        mtu = SSL_PMTU_MIN;
+    }
+
+    ssl->path_mtu = mtu;
+    if (ssl->handshake != NULL && ssl->handshake->mtu > mtu) {
+        ssl->handshake->mtu = mtu;
+    }
+    MBEDTLS_SSL_DEBUG_MSG(2, ("path mtu set to %d bytes", ssl->path_mtu));
+}
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 /*
@@ -596,7 +832,13 @@ static int ssl_parse_inner_plaintext(unsigned char const *content,
 {
     size_t remaining = *content_size;
 
-    /* Determine length of padding by skipping zeroes from the back. */
+    /* Determine length of padding by skipping zeroes from the back, a word
+     * at a time first since peers may pad records up to the full size. */
+    while (remaining >= 8 &&
+           mbedtls_get_unaligned_uint64(content + remaining - 8) == 0) {
+        remaining -= 8;
+    }
+
     do {
         if (remaining == 0) {
             return -1;
@@ -895,6 +1137,66 @@ static void ssl_build_record_nonce(unsigned char *dst_iv,
     dst_iv += dst_iv_len - dynamic_iv_len;
     mbedtls_xor(dst_iv, dst_iv, dynamic_iv, dynamic_iv_len);
 }
+
+/*
+ * Fast path for the nonce and additional data of AEAD records without CID,
+ * which covers all TLS traffic. This is equivalent to ssl_build_record_nonce()
+ * followed by ssl_extract_add_data_from_record(), except that the fixed IV
+ * kept in the transform is used as a template in which only the sequence
+ * number is patched, and every byte of the output is written only once.
+ *
+ * Returns 1 if the nonce and additional data have been built, 0 if the
+ * record needs the generic functions (CID, unusual IV layout).
+ */
+static int ssl_build_aead_nonce_and_add_data(unsigned char iv[12],
+                                             unsigned char const *fixed_iv,
+                                             unsigned char const dynamic_iv[8],
+                                             unsigned char *add_data,
+                                             size_t *add_data_len,
+                                             mbedtls_record const *rec,
+                                             mbedtls_ssl_transform const *transform)
+{
+    unsigned char *cur = add_data;
+    size_t ad_len_field = rec->data_len;
+
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if (rec->cid_len != 0) {
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+
+    if (transform->fixed_ivlen == 4) {
+        /* IV = fixed_iv || dynamic_iv: TLS 1.2 with GCM or CCM */
+        memcpy(iv, fixed_iv, 4);
+        memcpy(iv + 4, dynamic_iv, 8);
+    } else if (transform->fixed_ivlen == 12) {
+        /* IV = fixed_iv XOR ( 0 || dynamic_iv ): TLS 1.3, ChaChaPoly */
+        memcpy(iv, fixed_iv, 4);
+        mbedtls_xor(iv + 4, fixed_iv + 4, dynamic_iv, 8);
+    } else {
+        return 0;
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        ad_len_field += transform->taglen;
+    } else
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+    {
+        memcpy(cur, rec->ctr, sizeof(rec->ctr));
+        cur += sizeof(rec->ctr);
+    }
+
+    cur[0] = rec->type;
+    cur[1] = rec->ver[0];
+    cur[2] = rec->ver[1];
+    MBEDTLS_PUT_UINT16_BE(ad_len_field, cur, 3);
+    cur += 5;
+
+    *add_data_len = (size_t) (cur - add_data);
+
+    return 1;
+}
 #endif /* MBEDTLS_SSL_HAVE_AEAD */
 
 int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
@@ -902,6 +1204,47 @@ int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
                             mbedtls_record *rec,
                             int (*f_rng)(void *, unsigned char *, size_t),
                             void *p_rng)
+{
+    return mbedtls_ssl_encrypt_buf_from(ssl, transform, rec, NULL,
+                                        f_rng, p_rng);
+}
+
+/*
+ * Whether the cipher can read the plaintext of a record from, or write it
+ * to, a buffer separate from the record buffer. This is the case when the
+ * record content is exactly the plaintext, which rules out the TLS 1.3 and
+ * CID inner plaintext and the MAC and padding of the other modes.
+ */
+static int ssl_transform_is_plain_aead(const mbedtls_ssl_transform *transform,
+                                       mbedtls_ssl_mode_t ssl_mode,
+                                       int outgoing)
+{
+#if defined(MBEDTLS_SSL_HAVE_AEAD) && defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (ssl_mode != MBEDTLS_SSL_MODE_AEAD ||
+        transform->tls_version != MBEDTLS_SSL_VERSION_TLS1_2) {
+        return 0;
+    }
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if ((outgoing ? transform->out_cid_len : transform->in_cid_len) != 0) {
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    (void) outgoing;
+    return 1;
+#else
+    (void) transform;
+    (void) ssl_mode;
+    (void) outgoing;
+    return 0;
+#endif /* MBEDTLS_SSL_HAVE_AEAD && MBEDTLS_SSL_PROTO_TLS1_2 */
+}
+
+static int ssl_encrypt_buf_from(mbedtls_ssl_context *ssl,
+                                mbedtls_ssl_transform *transform,
+                                mbedtls_record *rec,
+                                const unsigned char *src,
+                                int (*f_rng)(void *, unsigned char *, size_t),
+                                void *p_rng)
 {
     mbedtls_ssl_mode_t ssl_mode;
     int auth_done = 0;
@@ -953,8 +1296,14 @@ int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
 
     data = rec->buf + rec->data_offset;
     post_avail = rec->buf_len - (rec->data_len + rec->data_offset);
+
+    if (src != NULL && !ssl_transform_is_plain_aead(transform, ssl_mode, 1)) {
+        memcpy(data, src, rec->data_len);
+        src = NULL;
+    }
+
     MBEDTLS_SSL_DEBUG_BUF(4, "before encrypt: output payload",
-                          data, rec->data_len);
+                          src != NULL ? src : data, rec->data_len);
 
     if (rec->data_len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("Record content %" MBEDTLS_PRINTF_SIZET
@@ -1050,26 +1399,37 @@ int mbedtls_ssl_encrypt_buf(mbedtls_ssl_context *ssl,
                                          transform->taglen);
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-        status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
-                                    transform->psa_mac_alg);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+        if (transform->psa_mac_enc_states) {
+            status = ssl_hmac_from_states(&transform->psa_mac_enc_inner,
+                                          &transform->psa_mac_enc_outer,
+                                          transform->psa_mac_alg,
+                                          add_data, add_data_len,
+                                          data, rec->data_len, mac);
+            if (status != PSA_SUCCESS) {
+                goto hmac_failed_etm_disabled;
+            }
+        } else {
+            status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
+                                        transform->psa_mac_alg);
+            if (status != PSA_SUCCESS) {
+                goto hmac_failed_etm_disabled;
+            }
 
-        status = psa_mac_update(&operation, add_data, add_data_len);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+            status = psa_mac_update(&operation, add_data, add_data_len);
+            if (status != PSA_SUCCESS) {
+                goto hmac_failed_etm_disabled;
+            }
 
-        status = psa_mac_update(&operation, data, rec->data_len);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
-        }
+            status = psa_mac_update(&operation, data, rec->data_len);
+            if (status != PSA_SUCCESS) {
+                goto hmac_failed_etm_disabled;
+            }
 
-        status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
-                                     &sign_mac_length);
-        if (status != PSA_SUCCESS) {
-            goto hmac_failed_etm_disabled;
+            status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
+                                         &sign_mac_length);
+            if (status != PSA_SUCCESS) {
+                goto hmac_failed_etm_disabled;
+            }
         }
 #else
         ret = mbedtls_md_hmac_update(&transform->md_ctx_enc, add_data,
@@ -1164,19 +1524,24 @@ hmac_failed_etm_disabled:
         dynamic_iv     = rec->ctr;
         dynamic_iv_len = sizeof(rec->ctr);
 
-        ssl_build_record_nonce(iv, sizeof(iv),
-                               transform->iv_enc,
-                               transform->fixed_ivlen,
-                               dynamic_iv,
-                               dynamic_iv_len);
+        if (ssl_build_aead_nonce_and_add_data(iv, transform->iv_enc,
+                                              dynamic_iv, add_data,
+                                              &add_data_len, rec,
+                                              transform) == 0) {
+            ssl_build_record_nonce(iv, sizeof(iv),
+                                   transform->iv_enc,
+                                   transform->fixed_ivlen,
+                                   dynamic_iv,
+                                   dynamic_iv_len);
 
-        /*
-         * Build additional data for AEAD encryption.
-         * This depends on the TLS version.
-         */
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
+            /*
+             * Build additional data for AEAD encryption.
+             * This depends on the TLS version.
+             */
+            ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                             transform->tls_version,
+                                             transform->taglen);
+        }
 
         MBEDTLS_SSL_DEBUG_BUF(4, "IV used (internal)",
                               iv, transform->ivlen);
@@ -1190,14 +1555,18 @@ hmac_failed_etm_disabled:
                                   rec->data_len));
 
         /*
-         * Encrypt and authenticate
+         * Encrypt and authenticate, reading the plaintext from src if it
+         * was not copied to the record buffer.
          */
+        if (src == NULL) {
+            src = data;
+        }
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         status = psa_aead_encrypt(transform->psa_key_enc,
                                   transform->psa_alg,
                                   iv, transform->ivlen,
                                   add_data, add_data_len,
-                                  data, rec->data_len,
+                                  src, rec->data_len,
                                   data, rec->buf_len - (data - rec->buf),
                                   &rec->data_len);
 
@@ -1210,7 +1579,7 @@ hmac_failed_etm_disabled:
         if ((ret = mbedtls_cipher_auth_encrypt_ext(&transform->cipher_ctx_enc,
                                                    iv, transform->ivlen,
                                                    add_data, add_data_len,
-                                                   data, rec->data_len, /* src */
+                                                   src, rec->data_len, /* src */
                                                    data, rec->buf_len - (size_t) (data - rec->buf), /* dst */
                                                    &rec->data_len,
                                                    transform->taglen)) != 0) {
@@ -1393,26 +1762,37 @@ hmac_failed_etm_disabled:
             MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data,
                                   add_data_len);
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-            status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
-                                        transform->psa_mac_alg);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+            if (transform->psa_mac_enc_states) {
+                status = ssl_hmac_from_states(&transform->psa_mac_enc_inner,
+                                              &transform->psa_mac_enc_outer,
+                                              transform->psa_mac_alg,
+                                              add_data, add_data_len,
+                                              data, rec->data_len, mac);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
+            } else {
+                status = psa_mac_sign_setup(&operation, transform->psa_mac_enc,
+                                            transform->psa_mac_alg);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            status = psa_mac_update(&operation, add_data, add_data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+                status = psa_mac_update(&operation, add_data, add_data_len);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            status = psa_mac_update(&operation, data, rec->data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+                status = psa_mac_update(&operation, data, rec->data_len);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
-                                         &sign_mac_length);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
+                status = psa_mac_sign_finish(&operation, mac, MBEDTLS_SSL_MAC_ADD,
+                                             &sign_mac_length);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
             }
 #else
 
@@ -1475,9 +1855,33 @@ hmac_failed_etm_enabled:
     return 0;
 }
 
+int mbedtls_ssl_encrypt_buf_from(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_transform *transform,
+                                 mbedtls_record *rec,
+                                 const unsigned char *src,
+                                 int (*f_rng)(void *, unsigned char *, size_t),
+                                 void *p_rng)
+{
+    int ret;
+
+    MBEDTLS_SSL_PROBE2(encrypt_entry, ssl, rec->data_len);
+    ret = ssl_encrypt_buf_from(ssl, transform, rec, src, f_rng, p_rng);
+    MBEDTLS_SSL_PROBE3(encrypt_return, ssl, rec->data_len, ret);
+
+    return ret;
+}
+
 int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
                             mbedtls_ssl_transform *transform,
                             mbedtls_record *rec)
+{
+    return mbedtls_ssl_decrypt_buf_to(ssl, transform, rec, NULL, 0);
+}
+
+static int ssl_decrypt_buf_to(mbedtls_ssl_context const *ssl,
+                              mbedtls_ssl_transform *transform,
+                              mbedtls_record *rec,
+                              unsigned char *dst, size_t dst_len)
 {
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC) || defined(MBEDTLS_SSL_HAVE_AEAD)
     size_t olen;
@@ -1500,6 +1904,8 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
     unsigned char add_data[13];
 #endif
     size_t add_data_len;
+    /* Set if the plaintext is decrypted in place, then copied to dst */
+    unsigned char *copy_to = NULL;
 
 #if !defined(MBEDTLS_DEBUG_C)
     ssl = NULL; /* make sure we don't use it except for debug */
@@ -1518,6 +1924,11 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
     data = rec->buf + rec->data_offset;
     ssl_mode = mbedtls_ssl_get_mode_from_transform(transform);
 
+    if (dst != NULL && !ssl_transform_is_plain_aead(transform, ssl_mode, 0)) {
+        copy_to = dst;
+        dst = NULL;
+    }
+
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
     /*
      * Match record's CID with incoming CID.
@@ -1547,6 +1958,8 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
         unsigned char iv[12];
         unsigned char *dynamic_iv;
         size_t dynamic_iv_len;
+        unsigned char *out;
+        size_t out_len;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
@@ -1590,19 +2003,24 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
         /*
          * Prepare nonce from dynamic and static parts.
          */
-        ssl_build_record_nonce(iv, sizeof(iv),
-                               transform->iv_dec,
-                               transform->fixed_ivlen,
-                               dynamic_iv,
-                               dynamic_iv_len);
+        if (ssl_build_aead_nonce_and_add_data(iv, transform->iv_dec,
+                                              dynamic_iv, add_data,
+                                              &add_data_len, rec,
+                                              transform) == 0) {
+            ssl_build_record_nonce(iv, sizeof(iv),
+                                   transform->iv_dec,
+                                   transform->fixed_ivlen,
+                                   dynamic_iv,
+                                   dynamic_iv_len);
 
-        /*
-         * Build additional data for AEAD encryption.
-         * This depends on the TLS version.
-         */
-        ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
-                                         transform->tls_version,
-                                         transform->taglen);
+            /*
+             * Build additional data for AEAD decryption.
+             * This depends on the TLS version.
+             */
+            ssl_extract_add_data_from_record(add_data, &add_data_len, rec,
+                                             transform->tls_version,
+                                             transform->taglen);
+        }
         MBEDTLS_SSL_DEBUG_BUF(4, "additional data used for AEAD",
                               add_data, add_data_len);
 
@@ -1617,15 +2035,24 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
                               transform->taglen);
 
         /*
-         * Decrypt and authenticate
+         * Decrypt and authenticate, into dst if it is given.
          */
+        out = data;
+        out_len = rec->buf_len - (size_t) (data - rec->buf);
+        if (dst != NULL) {
+            if (dst_len < rec->data_len) {
+                return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+            }
+            out = dst;
+            out_len = dst_len;
+        }
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         status = psa_aead_decrypt(transform->psa_key_dec,
                                   transform->psa_alg,
                                   iv, transform->ivlen,
                                   add_data, add_data_len,
                                   data, rec->data_len + transform->taglen,
-                                  data, rec->buf_len - (data - rec->buf),
+                                  out, out_len,
                                   &olen);
 
         if (status != PSA_SUCCESS) {
@@ -1639,7 +2066,7 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
                        iv, transform->ivlen,
                        add_data, add_data_len,
                        data, rec->data_len + transform->taglen, /* src */
-                       data, rec->buf_len - (size_t) (data - rec->buf), &olen, /* dst */
+                       out, out_len, &olen, /* dst */
                        transform->taglen)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_cipher_auth_decrypt_ext", ret);
 
@@ -1718,9 +2145,8 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
         if (ssl_mode == MBEDTLS_SSL_MODE_CBC_ETM) {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
             psa_mac_operation_t operation = PSA_MAC_OPERATION_INIT;
-#else
-            unsigned char mac_expect[MBEDTLS_SSL_MAC_ADD];
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+            unsigned char mac_expect[MBEDTLS_SSL_MAC_ADD];
 
             MBEDTLS_SSL_DEBUG_MSG(3, ("using encrypt then mac"));
 
@@ -1743,27 +2169,46 @@ int mbedtls_ssl_decrypt_buf(mbedtls_ssl_context const *ssl,
             MBEDTLS_SSL_DEBUG_BUF(4, "MAC'd meta-data", add_data,
                                   add_data_len);
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-            status = psa_mac_verify_setup(&operation, transform->psa_mac_dec,
-                                          transform->psa_mac_alg);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+            if (transform->psa_mac_dec_states) {
+                status = ssl_hmac_from_states(&transform->psa_mac_dec_inner,
+                                              &transform->psa_mac_dec_outer,
+                                              transform->psa_mac_alg,
+                                              add_data, add_data_len,
+                                              data, rec->data_len, mac_expect);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            status = psa_mac_update(&operation, add_data, add_data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+                /* Compare expected MAC with MAC at the end of the record. */
+                if (mbedtls_ct_memcmp(data + rec->data_len, mac_expect,
+                                      transform->maclen) != 0) {
+                    MBEDTLS_SSL_DEBUG_MSG(1, ("message mac does not match"));
+                    status = PSA_ERROR_INVALID_SIGNATURE;
+                    goto hmac_failed_etm_enabled;
+                }
+            } else {
+                status = psa_mac_verify_setup(&operation, transform->psa_mac_dec,
+                                              transform->psa_mac_alg);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            status = psa_mac_update(&operation, data, rec->data_len);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
-            }
+                status = psa_mac_update(&operation, add_data, add_data_len);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
 
-            /* Compare expected MAC with MAC at the end of the record. */
-            status = psa_mac_verify_finish(&operation, data + rec->data_len,
-                                           transform->maclen);
-            if (status != PSA_SUCCESS) {
-                goto hmac_failed_etm_enabled;
+                status = psa_mac_update(&operation, data, rec->data_len);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
+
+                /* Compare expected MAC with MAC at the end of the record. */
+                status = psa_mac_verify_finish(&operation, data + rec->data_len,
+                                               transform->maclen);
+                if (status != PSA_SUCCESS) {
+                    goto hmac_failed_etm_enabled;
+                }
             }
 #else
             ret = mbedtls_md_hmac_update(&transform->md_ctx_dec, add_data,
@@ -1807,9 +2252,8 @@ hmac_failed_etm_enabled:
             if (ret == 0 && status != PSA_SUCCESS) {
                 ret = PSA_TO_MBEDTLS_ERR(status);
             }
-#else
-            mbedtls_platform_zeroize(mac_expect, transform->maclen);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+            mbedtls_platform_zeroize(mac_expect, transform->maclen);
             if (ret != 0) {
                 if (ret != MBEDTLS_ERR_SSL_INVALID_MAC) {
                     MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_hmac_xxx", ret);
@@ -1989,7 +2433,7 @@ hmac_failed_etm_enabled:
 
 #if defined(MBEDTLS_SSL_DEBUG_ALL)
     MBEDTLS_SSL_DEBUG_BUF(4, "raw buffer after decryption",
-                          data, rec->data_len);
+                          dst != NULL ? dst : data, rec->data_len);
 #endif
 
     /*
@@ -2037,11 +2481,20 @@ hmac_failed_etm_enabled:
         const size_t min_len = (max_len > 256) ? max_len - 256 : 0;
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-        ret = mbedtls_ct_hmac(transform->psa_mac_dec,
-                              transform->psa_mac_alg,
-                              add_data, add_data_len,
-                              data, rec->data_len, min_len, max_len,
-                              mac_expect);
+        if (transform->psa_mac_dec_states) {
+            ret = mbedtls_ct_hmac_states(&transform->psa_mac_dec_inner,
+                                         &transform->psa_mac_dec_outer,
+                                         transform->psa_mac_alg,
+                                         add_data, add_data_len,
+                                         data, rec->data_len, min_len, max_len,
+                                         mac_expect);
+        } else {
+            ret = mbedtls_ct_hmac(transform->psa_mac_dec,
+                                  transform->psa_mac_alg,
+                                  add_data, add_data_len,
+                                  data, rec->data_len, min_len, max_len,
+                                  mac_expect);
+        }
 #else
         ret = mbedtls_ct_hmac(&transform->md_ctx_dec,
                               add_data, add_data_len,
@@ -2117,15 +2570,155 @@ hmac_failed_etm_disabled:
     }
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
+    if (copy_to != NULL) {
+        if (dst_len < rec->data_len) {
+            return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+        }
+        memcpy(copy_to, data, rec->data_len);
+    }
+
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= decrypt buf"));
 
     return 0;
 }
 
+int mbedtls_ssl_decrypt_buf_to(mbedtls_ssl_context const *ssl,
+                               mbedtls_ssl_transform *transform,
+                               mbedtls_record *rec,
+                               unsigned char *dst, size_t dst_len)
+{
+    int ret;
+
+    MBEDTLS_SSL_PROBE2(decrypt_entry, ssl, rec->data_len);
+    ret = ssl_decrypt_buf_to(ssl, transform, rec, dst, dst_len);
+    MBEDTLS_SSL_PROBE3(decrypt_return, ssl, rec->data_len, ret);
+
+    return ret;
+}
+
 #undef MAC_NONE
 #undef MAC_PLAINTEXT
 #undef MAC_CIPHERTEXT
 
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+/* Account for a call to the send or receive callback in the trace of the
+ * current handshake step. */
+static void ssl_trace_io(mbedtls_ssl_context *ssl, uint64_t start,
+                         int ret, size_t *bytes)
+{
+    ssl->trace_io_time += mbedtls_ssl_trace_clock(ssl) - start;
+    if (ret > 0) {
+        *bytes += (size_t) ret;
+    }
+}
+#endif /* MBEDTLS_SSL_HANDSHAKE_TRACE */
+
+/*
+ * Call the receive callback, with a timeout if there is one.
+ */
+static int ssl_bio_recv(mbedtls_ssl_context *ssl, unsigned char *buf,
+                        size_t len, uint32_t timeout)
+{
+    int ret;
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    uint64_t start = 0;
+
+    if (ssl->conf->f_hs_trace != NULL) {
+        start = mbedtls_ssl_trace_clock(ssl);
+    }
+#endif
+
+    MBEDTLS_SSL_PROBE2(recv_entry, ssl, len);
+    if (ssl->f_recv_timeout != NULL) {
+        ret = ssl->f_recv_timeout(ssl->p_bio, buf, len, timeout);
+    } else {
+        ret = ssl->f_recv(ssl->p_bio, buf, len);
+    }
+    MBEDTLS_SSL_PROBE2(recv_return, ssl, ret);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ) {
+        MBEDTLS_SSL_STATS_INC(ssl, want_read);
+    }
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    if (ssl->conf->f_hs_trace != NULL) {
+        ssl_trace_io(ssl, start, ret, &ssl->trace_bytes_in);
+    }
+#endif
+
+    return ret;
+}
+
+static int ssl_bio_send(mbedtls_ssl_context *ssl, const unsigned char *buf,
+                        size_t len)
+{
+    int ret;
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    uint64_t start = 0;
+
+    if (ssl->conf->f_hs_trace != NULL) {
+        start = mbedtls_ssl_trace_clock(ssl);
+    }
+#endif
+
+    MBEDTLS_SSL_PROBE2(send_entry, ssl, len);
+    ret = ssl->f_send(ssl->p_bio, buf, len);
+    MBEDTLS_SSL_PROBE2(send_return, ssl, ret);
+
+    if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        MBEDTLS_SSL_STATS_INC(ssl, want_write);
+    }
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    if (ssl->conf->f_hs_trace != NULL) {
+        ssl_trace_io(ssl, start, ret, &ssl->trace_bytes_out);
+    }
+#endif
+
+    return ret;
+}
+
+/*
+ * TLS read-ahead: rather than moving the data read beyond the previous
+ * record to the front of the buffer each time, advance ssl->in_hdr to it.
+ * The buffer is compacted only when the record that is wanted next does
+ * not fit in what is left of it, or for free when it is empty, which keeps
+ * the cost linear in the amount of data read.
+ */
+static void ssl_tls_advance_input(mbedtls_ssl_context *ssl, size_t nb_want)
+{
+    unsigned char * const start = ssl->in_buf + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+
+    if (ssl->in_ahead_len != 0 && ssl->in_left == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("next record already read ahead, offset: %"
+                                  MBEDTLS_PRINTF_SIZET,
+                                  ssl->in_ahead_offset));
+        ssl->in_hdr += ssl->in_ahead_offset;
+        ssl->in_left = ssl->in_ahead_len;
+        ssl->in_ahead_offset = 0;
+        ssl->in_ahead_len = 0;
+        mbedtls_ssl_update_in_pointers(ssl);
+    }
+
+    if (ssl->in_hdr == start || ssl->in_ahead_len != 0) {
+        return;
+    }
+
+    if (ssl->in_left != 0 &&
+        nb_want <= ssl->in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf)) {
+        return;
+    }
+
+    if (ssl->in_left != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("compacting input buffer, offset: %"
+                                  MBEDTLS_PRINTF_SIZET,
+                                  (size_t) (ssl->in_hdr - start)));
+        memmove(start, ssl->in_hdr, ssl->in_left);
+    }
+    ssl->in_hdr = start;
+    mbedtls_ssl_update_in_pointers(ssl);
+}
+
 /*
  * Fill the input message buffer by appending data to it.
  * The amount of data already fetched is in ssl->in_left.
@@ -2134,22 +2727,21 @@ hmac_failed_etm_disabled:
  * available (from this read and/or a previous one). Otherwise, an error code
  * is returned (possibly EOF or WANT_READ).
  *
- * With stream transport (TLS) on success ssl->in_left == nb_want, but
+ * With stream transport (TLS) on success ssl->in_left == nb_want, unless
+ * read-ahead is enabled (see mbedtls_ssl_conf_read_ahead()), but
  * with datagram transport (DTLS) on success ssl->in_left >= nb_want,
  * since we always read a whole datagram at once.
  *
  * For DTLS, it is up to the caller to set ssl->next_record_offset when
- * they're done reading a record.
+ * they're done reading a record. For TLS with read-ahead, the caller
+ * records data beyond the current record in ssl->in_ahead_offset and
+ * ssl->in_ahead_len.
  */
 int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t len;
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t in_buf_len = ssl->in_buf_len;
-#else
-    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
-#endif
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> fetch input"));
 
@@ -2158,6 +2750,10 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        ssl_tls_advance_input(ssl, nb_want);
+    }
+
     if (nb_want > in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("requesting more data than fits"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
@@ -2219,6 +2815,12 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
             return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
         }
 
+        /* The current datagram is over, and only it was to be read. */
+        if (ssl->in_datagram_only) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("<= fetch input, end of datagram"));
+            return MBEDTLS_ERR_SSL_WANT_READ;
+        }
+
         /*
          * Don't even try to read if time's out already.
          * This avoids by-passing the timer when repeatedly receiving messages
@@ -2238,12 +2840,7 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
 
             MBEDTLS_SSL_DEBUG_MSG(3, ("f_recv_timeout: %lu ms", (unsigned long) timeout));
 
-            if (ssl->f_recv_timeout != NULL) {
-                ret = ssl->f_recv_timeout(ssl->p_bio, ssl->in_hdr, len,
-                                          timeout);
-            } else {
-                ret = ssl->f_recv(ssl->p_bio, ssl->in_hdr, len);
-            }
+            ret = ssl_bio_recv(ssl, ssl->in_hdr, len, timeout);
 
             MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_recv(_timeout)", ret);
 
@@ -2291,24 +2888,41 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
     } else
 #endif
     {
+        /*
+         * With read-ahead, we may have read beyond the previous record.
+         * ssl_tls_advance_input() has made ssl->in_hdr point to that data.
+         */
+        if (ssl->in_ahead_len != 0) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
         MBEDTLS_SSL_DEBUG_MSG(2, ("in_left: %" MBEDTLS_PRINTF_SIZET
                                   ", nb_want: %" MBEDTLS_PRINTF_SIZET,
                                   ssl->in_left, nb_want));
 
+        /* The peer will not answer before it has got our whole flight. */
+        if (ssl->in_left < nb_want && ssl->out_coalesce_len != 0 &&
+            (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            return ret;
+        }
+
         while (ssl->in_left < nb_want) {
             len = nb_want - ssl->in_left;
 
+            /* Once the handshake is over, read as much as fits if
+             * read-ahead is enabled. */
+            if (mbedtls_ssl_get_read_ahead_records(ssl) > 1 &&
+                mbedtls_ssl_is_handshake_over(ssl) == 1) {
+                len = in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf) -
+                      ssl->in_left;
+            }
+
             if (mbedtls_ssl_check_timer(ssl) != 0) {
                 ret = MBEDTLS_ERR_SSL_TIMEOUT;
             } else {
-                if (ssl->f_recv_timeout != NULL) {
-                    ret = ssl->f_recv_timeout(ssl->p_bio,
-                                              ssl->in_hdr + ssl->in_left, len,
-                                              ssl->conf->read_timeout);
-                } else {
-                    ret = ssl->f_recv(ssl->p_bio,
-                                      ssl->in_hdr + ssl->in_left, len);
-                }
+                ret = ssl_bio_recv(ssl, ssl->in_hdr + ssl->in_left, len,
+                                   ssl->conf->read_timeout);
             }
 
             MBEDTLS_SSL_DEBUG_MSG(2, ("in_left: %" MBEDTLS_PRINTF_SIZET
@@ -2342,33 +2956,72 @@ int mbedtls_ssl_fetch_input(mbedtls_ssl_context *ssl, size_t nb_want)
 }
 
 /*
- * Flush any data not yet written
+ * Handshake flight coalescing: hold back the records in the output buffer
+ * until the flight is complete, then send them to the peer in one go.
  */
-int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
+#define SSL_COALESCE_MAX_LEN  (4 * MBEDTLS_SSL_OUT_BUFFER_LEN)
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_coalesce_hold(mbedtls_ssl_context *ssl)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char *buf;
+    size_t len = ssl->out_left;
+    size_t needed = ssl->out_coalesce_len + len;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> flush output"));
+    if (needed > ssl->out_coalesce_size) {
+        size_t size = 2 * ssl->out_coalesce_size;
+        unsigned char *buf;
 
-    if (ssl->f_send == NULL) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("Bad usage of mbedtls_ssl_set_bio() "));
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        if (size < needed) {
+            size = needed;
+        }
+        if (size > SSL_COALESCE_MAX_LEN) {
+            size = SSL_COALESCE_MAX_LEN;
+        }
 
-    /* Avoid incrementing counter if data is flushed */
-    if (ssl->out_left == 0) {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("<= flush output"));
-        return 0;
+        /* If the flight is too large or we are out of memory, send what
+         * we have so far. */
+        if (needed > size || (buf = mbedtls_calloc_tagged(SSL_RECORD, 1, size)) == NULL) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("cannot hold back %" MBEDTLS_PRINTF_SIZET
+                                      " more bytes, flushing flight", len));
+            return mbedtls_ssl_flush_output(ssl);
+        }
+
+        if (ssl->out_coalesce_len != 0) {
+            memcpy(buf, ssl->out_coalesce_buf, ssl->out_coalesce_len);
+        }
+        mbedtls_free(ssl->out_coalesce_buf);
+        ssl->out_coalesce_buf = buf;
+        ssl->out_coalesce_size = size;
     }
 
-    while (ssl->out_left > 0) {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("message length: %" MBEDTLS_PRINTF_SIZET
-                                  ", out_left: %" MBEDTLS_PRINTF_SIZET,
-                                  mbedtls_ssl_out_hdr_len(ssl) + ssl->out_msglen, ssl->out_left));
+    memcpy(ssl->out_coalesce_buf + ssl->out_coalesce_len,
+           ssl->out_hdr - len, len);
+    ssl->out_coalesce_len = needed;
 
-        buf = ssl->out_hdr - ssl->out_left;
-        ret = ssl->f_send(ssl->p_bio, buf, ssl->out_left);
+    MBEDTLS_SSL_DEBUG_MSG(2, ("holding back %" MBEDTLS_PRINTF_SIZET
+                              " bytes of the flight", needed));
+
+    ssl->out_left = 0;
+    ssl->out_hdr = ssl->out_buf + 8;
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_coalesce_send(mbedtls_ssl_context *ssl)
+{
+    int ret;
+
+    while (ssl->out_coalesce_sent < ssl->out_coalesce_len) {
+        size_t left = ssl->out_coalesce_len - ssl->out_coalesce_sent;
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("flight length: %" MBEDTLS_PRINTF_SIZET
+                                  ", left: %" MBEDTLS_PRINTF_SIZET,
+                                  ssl->out_coalesce_len, left));
+
+        ret = ssl_bio_send(ssl,
+                           ssl->out_coalesce_buf + ssl->out_coalesce_sent, left);
 
         MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_send", ret);
 
@@ -2376,28 +3029,111 @@ int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
             return ret;
         }
 
-        if ((size_t) ret > ssl->out_left) {
+        if ((size_t) ret > left) {
             MBEDTLS_SSL_DEBUG_MSG(1,
                                   ("f_send returned %d bytes but only %" MBEDTLS_PRINTF_SIZET
                                    " bytes were sent",
-                                   ret, ssl->out_left));
+                                   ret, left));
             return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
         }
 
-        ssl->out_left -= ret;
-    }
-
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        ssl->out_hdr = ssl->out_buf;
-    } else
-#endif
-    {
-        ssl->out_hdr = ssl->out_buf + 8;
+        ssl->out_coalesce_sent += ret;
     }
-    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= flush output"));
+    /* A handshake has few flights: don't keep the buffer around
+     * in between. */
+    mbedtls_free(ssl->out_coalesce_buf);
+    ssl->out_coalesce_buf = NULL;
+    ssl->out_coalesce_size = 0;
+    ssl->out_coalesce_len = 0;
+    ssl->out_coalesce_sent = 0;
+
+    return 0;
+}
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_pipeline_complete(mbedtls_ssl_context *ssl);
+#endif
+
+/*
+ * Flush any data not yet written
+ */
+int mbedtls_ssl_flush_output(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *buf;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> flush output"));
+
+#if defined(MBEDTLS_SSL_QUIC)
+    /* The QUIC stack took each message when it was written. */
+    if (mbedtls_ssl_is_quic(ssl)) {
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    /* Records still being protected asynchronously cannot go out. */
+    if ((ret = ssl_pipeline_complete(ssl)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (ssl->f_send == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Bad usage of mbedtls_ssl_set_bio() "));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Records held back by flight coalescing go first. */
+    if (ssl->out_coalesce_len != 0 &&
+        (ret = ssl_coalesce_send(ssl)) != 0) {
+        return ret;
+    }
+
+    /* Avoid incrementing counter if data is flushed */
+    if (ssl->out_left == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("<= flush output"));
+        return 0;
+    }
+
+    while (ssl->out_left > 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("message length: %" MBEDTLS_PRINTF_SIZET
+                                  ", out_left: %" MBEDTLS_PRINTF_SIZET,
+                                  mbedtls_ssl_out_hdr_len(ssl) + ssl->out_msglen, ssl->out_left));
+
+        buf = ssl->out_hdr - ssl->out_left;
+        ret = ssl_bio_send(ssl, buf, ssl->out_left);
+
+        MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_send", ret);
+
+        if (ret <= 0) {
+            return ret;
+        }
+
+        if ((size_t) ret > ssl->out_left) {
+            MBEDTLS_SSL_DEBUG_MSG(1,
+                                  ("f_send returned %d bytes but only %" MBEDTLS_PRINTF_SIZET
+                                   " bytes were sent",
+                                   ret, ssl->out_left));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
+        ssl->out_left -= ret;
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        ssl->out_hdr = ssl->out_buf;
+        ssl->out_app_held = 0;
+    } else
+#endif
+    {
+        ssl->out_hdr = ssl->out_buf + 8;
+    }
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= flush output"));
 
     return 0;
 }
@@ -2417,14 +3153,31 @@ static int ssl_flight_append(mbedtls_ssl_context *ssl)
     MBEDTLS_SSL_DEBUG_BUF(4, "message appended to flight",
                           ssl->out_msg, ssl->out_msglen);
 
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    /* Keep the flight within its share of MBEDTLS_SSL_DTLS_MEMORY. */
+    {
+        size_t flight_len = ssl->out_msglen;
+
+        for (msg = ssl->handshake->flight; msg != NULL; msg = msg->next) {
+            flight_len += msg->len;
+        }
+        if (flight_len > MBEDTLS_SSL_DTLS_MAX_BUFFERING) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("flight of %" MBEDTLS_PRINTF_SIZET
+                                      " bytes over the memory budget",
+                                      flight_len));
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+    }
+#endif /* MBEDTLS_SSL_STATIC_MEMORY */
+
     /* Allocate space for current message */
-    if ((msg = mbedtls_calloc(1, sizeof(mbedtls_ssl_flight_item))) == NULL) {
+    if ((msg = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, sizeof(mbedtls_ssl_flight_item))) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc %" MBEDTLS_PRINTF_SIZET " bytes failed",
                                   sizeof(mbedtls_ssl_flight_item)));
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
 
-    if ((msg->p = mbedtls_calloc(1, ssl->out_msglen)) == NULL) {
+    if ((msg->p = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, ssl->out_msglen)) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc %" MBEDTLS_PRINTF_SIZET " bytes failed",
                                   ssl->out_msglen));
         mbedtls_free(msg);
@@ -2470,6 +3223,181 @@ void mbedtls_ssl_flight_free(mbedtls_ssl_flight_item *flight)
     }
 }
 
+/*
+ * Free the record cache of the current flight
+ */
+void mbedtls_ssl_flight_cache_free(mbedtls_ssl_handshake_params *handshake)
+{
+    mbedtls_free(handshake->flight_cache);
+    handshake->flight_cache = NULL;
+    handshake->flight_cache_len = 0;
+    handshake->flight_cache_size = 0;
+    handshake->flight_cache_sent = 0;
+    handshake->flight_cache_state = MBEDTLS_SSL_FLIGHT_CACHE_EMPTY;
+}
+
+/*
+ * Stop recording the records of the flight: the messages from msg_p in msg
+ * on are fragmented and protected again on each retransmission.
+ */
+static void ssl_flight_cache_stop(mbedtls_ssl_handshake_params *hs,
+                                  mbedtls_ssl_flight_item *msg,
+                                  unsigned char *msg_p)
+{
+    hs->flight_cache_end_msg = msg;
+    hs->flight_cache_end_p = msg_p;
+    hs->flight_cache_state = MBEDTLS_SSL_FLIGHT_CACHE_READY;
+}
+
+/*
+ * Add an unprotected record of the flight, sent from the position msg_p
+ * in msg, to the record cache.
+ */
+static void ssl_flight_cache_append(mbedtls_ssl_handshake_params *hs,
+                                    const unsigned char *rec, size_t len,
+                                    mbedtls_ssl_flight_item *msg,
+                                    unsigned char *msg_p)
+{
+    size_t needed = hs->flight_cache_len + len;
+
+    if (needed > hs->flight_cache_size) {
+        size_t size = 2 * hs->flight_cache_size;
+        unsigned char *buf;
+
+        if (size < needed) {
+            size = needed;
+        }
+
+        /* Out of memory: the rest of the flight is sent again as usual. */
+        if ((buf = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, size)) == NULL) {
+            ssl_flight_cache_stop(hs, msg, msg_p);
+            return;
+        }
+
+        if (hs->flight_cache_len != 0) {
+            memcpy(buf, hs->flight_cache, hs->flight_cache_len);
+        }
+        mbedtls_free(hs->flight_cache);
+        hs->flight_cache = buf;
+        hs->flight_cache_size = size;
+    }
+
+    memcpy(hs->flight_cache + hs->flight_cache_len, rec, len);
+    hs->flight_cache_len = needed;
+}
+
+/*
+ * Prepare the record cache for a transmission of the flight: record the
+ * flight on its first transmission, or when the maximum datagram or
+ * fragment size has changed since, otherwise resend the recorded records,
+ * then the rest of the flight from where the recording stopped.
+ */
+static void ssl_flight_cache_start(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    size_t mtu = ssl_get_maximum_datagram_size(ssl);
+
+    if (ssl->conf->dtls_flight_cache != MBEDTLS_SSL_DTLS_FLIGHT_CACHE_ENABLED) {
+        return;
+    }
+
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+    /* The maximum fragment length also limits the records and datagrams. */
+    if (mtu > mbedtls_ssl_get_output_max_frag_len(ssl)) {
+        mtu = mbedtls_ssl_get_output_max_frag_len(ssl);
+    }
+#endif
+
+    hs->flight_cache_sent = 0;
+
+    if (hs->flight_cache_state == MBEDTLS_SSL_FLIGHT_CACHE_READY &&
+        hs->flight_cache_mtu == mtu) {
+        hs->cur_msg = hs->flight_cache_end_msg;
+        hs->cur_msg_p = hs->flight_cache_end_p;
+        return;
+    }
+
+    hs->flight_cache_len = 0;
+    hs->flight_cache_mtu = mtu;
+    hs->flight_cache_state = MBEDTLS_SSL_FLIGHT_CACHE_RECORDING;
+}
+
+/*
+ * Resend the recorded records of the flight, each with the next record
+ * sequence number, packed into datagrams as for their first transmission.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_flight_cache_resend(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    size_t const hdr_len = mbedtls_ssl_out_hdr_len(ssl);
+    unsigned i;
+
+    if (hs->flight_cache_state != MBEDTLS_SSL_FLIGHT_CACHE_READY ||
+        hs->flight_cache_sent == hs->flight_cache_len) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("resend %" MBEDTLS_PRINTF_SIZET
+                              " bytes of recorded records",
+                              hs->flight_cache_len - hs->flight_cache_sent));
+
+    while (hs->flight_cache_sent < hs->flight_cache_len) {
+        const unsigned char * const rec = hs->flight_cache + hs->flight_cache_sent;
+        size_t const payload_len = MBEDTLS_GET_UINT16_BE(rec, hdr_len - 2);
+        size_t const rec_len = hdr_len + payload_len;
+
+        ret = ssl_get_remaining_payload_in_datagram(ssl);
+        if (ret < 0) {
+            return ret;
+        }
+
+        if (payload_len > (size_t) ret) {
+            if (ssl->out_left == 0) {
+                /* Should never happen, the datagram size has not changed */
+                return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            }
+
+            if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+                return ret;
+            }
+
+            continue;
+        }
+
+        memcpy(ssl->out_hdr, rec, rec_len);
+        memcpy(ssl->out_ctr, ssl->cur_out_ctr, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+
+        MBEDTLS_SSL_DEBUG_BUF(4, "output record sent to network",
+                              ssl->out_hdr, rec_len);
+
+        ssl->out_left += rec_len;
+        ssl->out_hdr  += rec_len;
+        mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+        hs->flight_cache_sent += rec_len;
+
+        for (i = 8; i > mbedtls_ssl_ep_len(ssl); i--) {
+            if (++ssl->cur_out_ctr[i - 1] != 0) {
+                break;
+            }
+        }
+
+        /* The loop goes to its end if the counter is wrapping */
+        if (i == mbedtls_ssl_ep_len(ssl)) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("outgoing message counter would wrap"));
+            return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+        }
+
+        if (ssl->disable_datagram_packing == 1 &&
+            (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
 /*
  * Swap transform_out and out_ctr with the alternative ones
  */
@@ -2513,6 +3441,12 @@ int mbedtls_ssl_resend(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> mbedtls_ssl_resend"));
 
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl->handshake->rtt_pending = 0;
+#endif
+
+    MBEDTLS_SSL_STATS_INC(ssl, retransmits);
+
     ret = mbedtls_ssl_flight_transmit(ssl);
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= mbedtls_ssl_resend"));
@@ -2542,12 +3476,21 @@ int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl)
             return ret;
         }
 
+        ssl_flight_cache_start(ssl);
+
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_SENDING;
     }
 
+    if ((ret = ssl_flight_cache_resend(ssl)) != 0) {
+        return ret;
+    }
+
     while (ssl->handshake->cur_msg != NULL) {
         size_t max_frag_len;
-        const mbedtls_ssl_flight_item * const cur = ssl->handshake->cur_msg;
+        mbedtls_ssl_flight_item * const cur = ssl->handshake->cur_msg;
+        unsigned char * const cur_p = ssl->handshake->cur_msg_p;
+        unsigned char *rec;
+        size_t rec_len;
 
         int const is_finished =
             (cur->type == MBEDTLS_SSL_MSG_HANDSHAKE &&
@@ -2567,6 +3510,12 @@ int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl)
             }
         }
 
+        /* Protected records depend on their sequence number. */
+        if (ssl->handshake->flight_cache_state == MBEDTLS_SSL_FLIGHT_CACHE_RECORDING &&
+            ssl->transform_out != NULL) {
+            ssl_flight_cache_stop(ssl->handshake, cur, cur_p);
+        }
+
         ret = ssl_get_remaining_payload_in_datagram(ssl);
         if (ret < 0) {
             return ret;
@@ -2657,12 +3606,25 @@ int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl)
         }
 
         /* Actually send the message out */
-        if ((ret = mbedtls_ssl_write_record(ssl, force_flush)) != 0) {
+        rec = ssl->out_hdr;
+        rec_len = mbedtls_ssl_out_hdr_len(ssl) + ssl->out_msglen;
+        ret = mbedtls_ssl_write_record(ssl, force_flush);
+
+        /* The record stays in the output buffer even once flushed. */
+        if (ssl->handshake->flight_cache_state == MBEDTLS_SSL_FLIGHT_CACHE_RECORDING) {
+            ssl_flight_cache_append(ssl->handshake, rec, rec_len, cur, cur_p);
+        }
+
+        if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
             return ret;
         }
     }
 
+    if (ssl->handshake->flight_cache_state == MBEDTLS_SSL_FLIGHT_CACHE_RECORDING) {
+        ssl_flight_cache_stop(ssl->handshake, NULL, NULL);
+    }
+
     if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
         return ret;
     }
@@ -2685,10 +3647,15 @@ int mbedtls_ssl_flight_transmit(mbedtls_ssl_context *ssl)
  */
 void mbedtls_ssl_recv_flight_completed(mbedtls_ssl_context *ssl)
 {
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl_update_rtt(ssl);
+#endif
+
     /* We won't need to resend that one any more */
     mbedtls_ssl_flight_free(ssl->handshake->flight);
     ssl->handshake->flight = NULL;
     ssl->handshake->cur_msg = NULL;
+    mbedtls_ssl_flight_cache_free(ssl->handshake);
 
     /* The next incoming flight will start with this msg_seq */
     ssl->handshake->in_flight_start_seq = ssl->handshake->in_msg_seq;
@@ -2702,6 +3669,15 @@ void mbedtls_ssl_recv_flight_completed(mbedtls_ssl_context *ssl)
     /* Cancel timer */
     mbedtls_ssl_set_timer(ssl, 0);
 
+    /* The peer answered a flight sent in smaller datagrams after losses:
+     * keep that size beyond the handshake. */
+    if (ssl->conf->dtls_pmtu_probing == MBEDTLS_SSL_DTLS_PMTU_PROBING_ENABLED &&
+        ssl->handshake->mtu != 0 &&
+        (ssl->path_mtu == 0 || ssl->handshake->mtu < ssl->path_mtu)) {
+        ssl->path_mtu = ssl->handshake->mtu;
+        MBEDTLS_SSL_DEBUG_MSG(2, ("path mtu set to %d bytes", ssl->path_mtu));
+    }
+
     if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
         ssl->in_msg[0] == MBEDTLS_SSL_HS_FINISHED) {
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_FINISHED;
@@ -2718,6 +3694,11 @@ void mbedtls_ssl_send_flight_completed(mbedtls_ssl_context *ssl)
     ssl_reset_retransmit_timeout(ssl);
     mbedtls_ssl_set_timer(ssl, ssl->handshake->retransmit_timeout);
 
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl->handshake->flight_sent_time = mbedtls_ms_time();
+    ssl->handshake->rtt_pending = 1;
+#endif
+
     if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
         ssl->in_msg[0] == MBEDTLS_SSL_HS_FINISHED) {
         ssl->handshake->retransmit_state = MBEDTLS_SSL_RETRANS_FINISHED;
@@ -2741,7 +3722,7 @@ int mbedtls_ssl_start_handshake_msg(mbedtls_ssl_context *ssl, unsigned char hs_t
      *    ...
      */
     *buf = ssl->out_msg + 4;
-    *buf_len = MBEDTLS_SSL_OUT_CONTENT_LEN - 4;
+    *buf_len = mbedtls_ssl_out_content_len(ssl) - 4;
 
     ssl->out_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
     ssl->out_msg[0]  = hs_type;
@@ -2790,10 +3771,11 @@ int mbedtls_ssl_write_handshake_msg_ext(mbedtls_ssl_context *ssl,
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    /* Whenever we send anything different from a
-     * HelloRequest we should be in a handshake - double check. */
+    /* Whenever we send anything different from a HelloRequest or a
+     * KeyUpdate we should be in a handshake - double check. */
     if (!(ssl->out_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
-          hs_type          == MBEDTLS_SSL_HS_HELLO_REQUEST) &&
+          (hs_type == MBEDTLS_SSL_HS_HELLO_REQUEST ||
+           hs_type == MBEDTLS_SSL_HS_KEY_UPDATE)) &&
         ssl->handshake == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
@@ -2816,12 +3798,12 @@ int mbedtls_ssl_write_handshake_msg_ext(mbedtls_ssl_context *ssl,
      *
      * Note: We deliberately do not check for the MTU or MFL here.
      */
-    if (ssl->out_msglen > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+    if (ssl->out_msglen > mbedtls_ssl_out_content_len(ssl)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("Record too large: "
                                   "size %" MBEDTLS_PRINTF_SIZET
                                   ", maximum %" MBEDTLS_PRINTF_SIZET,
                                   ssl->out_msglen,
-                                  (size_t) MBEDTLS_SSL_OUT_CONTENT_LEN));
+                                  mbedtls_ssl_out_content_len(ssl)));
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
@@ -2843,12 +3825,12 @@ int mbedtls_ssl_write_handshake_msg_ext(mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
         if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
             /* Make room for the additional DTLS fields */
-            if (MBEDTLS_SSL_OUT_CONTENT_LEN - ssl->out_msglen < 8) {
+            if (mbedtls_ssl_out_content_len(ssl) - ssl->out_msglen < 8) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("DTLS handshake message too large: "
                                           "size %" MBEDTLS_PRINTF_SIZET ", maximum %"
                                           MBEDTLS_PRINTF_SIZET,
                                           hs_len,
-                                          (size_t) (MBEDTLS_SSL_OUT_CONTENT_LEN - 12)));
+                                          mbedtls_ssl_out_content_len(ssl) - 12));
                 return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
             }
 
@@ -2932,23 +3914,41 @@ cleanup:
  *  - ssl->out_msgtype: type of the message (AppData, Handshake, Alert, CCS)
  *  - ssl->out_msglen: length of the record content (excl headers)
  *  - ssl->out_msg: record content
+ *
+ * If src is not NULL, the record content is read from there rather than
+ * from ssl->out_msg. The record is then protected straight from src when
+ * the transform allows it, which saves copying the content to
+ * ssl->out_msg first, see mbedtls_ssl_encrypt_buf_from().
  */
-int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_write_record_from(mbedtls_ssl_context *ssl,
+                                 const unsigned char *src, int force_flush)
 {
     int ret, done = 0;
     size_t len = ssl->out_msglen;
     int flush = force_flush;
+    /* The content type before encryption, which may hide it */
+    const int msgtype = ssl->out_msgtype;
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write record"));
 
+#if defined(MBEDTLS_SSL_QUIC)
+    /* Messages go to the QUIC stack, which only takes handshake data,
+     * never the content of src. */
+    if (mbedtls_ssl_is_quic(ssl)) {
+        return mbedtls_ssl_quic_write_message(ssl);
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
+    if (src != NULL && ssl->transform_out == NULL) {
+        memcpy(ssl->out_msg, src, len);
+        src = NULL;
+    }
+
     if (!done) {
         unsigned i;
         size_t protected_record_size;
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
         size_t out_buf_len = ssl->out_buf_len;
-#else
-        size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
-#endif
         /* Skip writing the record content type to after the encryption,
          * as it may change when using the CID extension. */
         mbedtls_ssl_protocol_version tls_ver = ssl->tls_version;
@@ -2965,6 +3965,10 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
         memcpy(ssl->out_ctr, ssl->cur_out_ctr, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
         MBEDTLS_PUT_UINT16_BE(len, ssl->out_len, 0);
 
+        /* Count the content before protection: an error below is fatal. */
+        MBEDTLS_SSL_STATS_INC(ssl, records_out);
+        MBEDTLS_SSL_STATS_ADD(ssl, bytes_out, len);
+
         if (ssl->transform_out != NULL) {
             mbedtls_record rec;
 
@@ -2982,8 +3986,9 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
             rec.cid_len = 0;
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-            if ((ret = mbedtls_ssl_encrypt_buf(ssl, ssl->transform_out, &rec,
-                                               ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+            if ((ret = mbedtls_ssl_encrypt_buf_from(ssl, ssl->transform_out,
+                                                    &rec, src,
+                                                    ssl->f_rng, ssl->p_rng)) != 0) {
                 MBEDTLS_SSL_DEBUG_RET(1, "ssl_encrypt_buf", ret);
                 return ret;
             }
@@ -3070,8 +4075,15 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
     }
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
-    if ((flush == SSL_FORCE_FLUSH) &&
-        (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+    if ((msgtype == MBEDTLS_SSL_MSG_HANDSHAKE ||
+         msgtype == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) &&
+        mbedtls_ssl_is_coalescing_flight(ssl) != 0) {
+        if ((ret = ssl_coalesce_hold(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_coalesce_hold", ret);
+            return ret;
+        }
+    } else if ((flush == SSL_FORCE_FLUSH) &&
+               (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
         return ret;
     }
@@ -3081,6 +4093,11 @@ int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
     return 0;
 }
 
+int mbedtls_ssl_write_record(mbedtls_ssl_context *ssl, int force_flush)
+{
+    return ssl_write_record_from(ssl, NULL, force_flush);
+}
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -3128,6 +4145,7 @@ static int ssl_check_hs_header(mbedtls_ssl_context const *ssl)
     return 0;
 }
 
+#if !defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
 /*
  * Mark bits in bitmask (used for DTLS HS reassembly)
  */
@@ -3193,6 +4211,122 @@ static int ssl_bitmask_check(unsigned char *mask, size_t len)
 
     return 0;
 }
+#else /* !MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY */
+/*
+ * Add the received bytes [start, end) of a message body of total_len bytes
+ * to the sorted, disjoint ranges of its buffer (used for DTLS HS reassembly).
+ *
+ * Return 1 if the whole body has been received, 0 if not yet, and -1 if
+ * the new range could not be tracked, which leaves the ranges unchanged.
+ */
+static int ssl_hs_ranges_add(mbedtls_ssl_hs_buffer *hs_buf,
+                             uint32_t start, uint32_t end,
+                             uint32_t total_len)
+{
+    uint8_t i = 0, j, n = hs_buf->range_count;
+
+    if (start < end) {
+        /* Skip the ranges entirely before the new one. */
+        while (i < n && hs_buf->ranges[i].end < start) {
+            i++;
+        }
+
+        /* Merge the ranges that overlap or touch the new one into it. */
+        for (j = i; j < n && hs_buf->ranges[j].start <= end; j++) {
+            if (hs_buf->ranges[j].start < start) {
+                start = hs_buf->ranges[j].start;
+            }
+            if (hs_buf->ranges[j].end > end) {
+                end = hs_buf->ranges[j].end;
+            }
+        }
+
+        if (i == j) {
+            if (n == MBEDTLS_SSL_DTLS_REASSEMBLY_RANGES) {
+                return -1;
+            }
+            memmove(&hs_buf->ranges[i + 1], &hs_buf->ranges[i],
+                    (size_t) (n - i) * sizeof(hs_buf->ranges[0]));
+            n++;
+        } else if (j > i + 1) {
+            memmove(&hs_buf->ranges[i + 1], &hs_buf->ranges[j],
+                    (size_t) (n - j) * sizeof(hs_buf->ranges[0]));
+            n -= j - i - 1;
+        }
+
+        hs_buf->ranges[i].start = start;
+        hs_buf->ranges[i].end = end;
+        hs_buf->range_count = n;
+    }
+
+    return n == 1 && hs_buf->ranges[0].start == 0 &&
+           hs_buf->ranges[0].end == total_len;
+}
+#endif /* !MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY */
+
+/*
+ * Take len bytes of buffering space, zeroed, or return NULL.
+ *
+ * With MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY, the buffers are packed at the
+ * start of the buffering area, so this is the next len bytes of it.
+ */
+static unsigned char *ssl_buffering_alloc(mbedtls_ssl_handshake_params *hs,
+                                          size_t len)
+{
+    unsigned char *p;
+
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+    if (len > MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+        hs->buffering.total_bytes_buffered) {
+        return NULL;
+    }
+    p = hs->buffering.area.buf + hs->buffering.total_bytes_buffered;
+    memset(p, 0, len);
+#else
+    p = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, len);
+    if (p == NULL) {
+        return NULL;
+    }
+#endif
+
+    hs->buffering.total_bytes_buffered += len;
+    return p;
+}
+
+/*
+ * Give back a buffer of len bytes taken with ssl_buffering_alloc().
+ *
+ * With MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY, the buffers after it are moved
+ * down to keep the free space in one piece at the end of the area.
+ */
+static void ssl_buffering_release(mbedtls_ssl_handshake_params *hs,
+                                  unsigned char *p, size_t len)
+{
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+    unsigned char * const end =
+        hs->buffering.area.buf + hs->buffering.total_bytes_buffered;
+    unsigned offset;
+
+    memmove(p, p + len, (size_t) (end - (p + len)));
+
+    for (offset = 0; offset < MBEDTLS_SSL_MAX_BUFFERED_HS; offset++) {
+        mbedtls_ssl_hs_buffer * const hs_buf = &hs->buffering.hs[offset];
+        if (hs_buf->is_valid == 1 && hs_buf->data > p) {
+            hs_buf->data -= len;
+        }
+    }
+    if (hs->buffering.future_record.data != NULL &&
+        hs->buffering.future_record.data > p) {
+        hs->buffering.future_record.data -= len;
+    }
+
+    mbedtls_platform_zeroize(end - len, len);
+#else
+    mbedtls_zeroize_and_free(p, len);
+#endif
+
+    hs->buffering.total_bytes_buffered -= len;
+}
 
 /* msg_len does not include the handshake header */
 static size_t ssl_get_reassembly_buffer_size(size_t msg_len,
@@ -3347,18 +4481,21 @@ int mbedtls_ssl_update_handshake_status(mbedtls_ssl_context *ssl)
 /*
  * DTLS anti-replay: RFC 6347 4.1.2.6
  *
- * in_window is a field of bits numbered from 0 (lsb) to 63 (msb).
+ * in_window is a field of MBEDTLS_SSL_DTLS_REPLAY_WINDOW bits, stored in
+ * 64-bit words with bit n in bit n % 64 of word n / 64.
  * Bit n is set iff record number in_window_top - n has been seen.
  *
- * Usually, in_window_top is the last record number seen and the lsb of
+ * Usually, in_window_top is the last record number seen and bit 0 of
  * in_window is set. The only exception is the initial state (record number 0
  * not seen yet).
  */
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+#define SSL_DTLS_REPLAY_WORDS (MBEDTLS_SSL_DTLS_REPLAY_WINDOW / 64)
+
 void mbedtls_ssl_dtls_replay_reset(mbedtls_ssl_context *ssl)
 {
     ssl->in_window_top = 0;
-    ssl->in_window = 0;
+    memset(ssl->in_window, 0, sizeof(ssl->in_window));
 }
 
 static inline uint64_t ssl_load_six_bytes(unsigned char *buf)
@@ -3409,17 +4546,40 @@ int mbedtls_ssl_dtls_replay_check(mbedtls_ssl_context const *ssl)
 
     bit = ssl->in_window_top - rec_seqnum;
 
-    if (bit >= 64) {
+    if (bit >= MBEDTLS_SSL_DTLS_REPLAY_WINDOW) {
         return -1;
     }
 
-    if ((ssl->in_window & ((uint64_t) 1 << bit)) != 0) {
+    if ((ssl->in_window[bit / 64] & ((uint64_t) 1 << (bit % 64))) != 0) {
         return -1;
     }
 
     return 0;
 }
 
+/*
+ * Shift the window by less than its width: whole words first, then the
+ * bits carried from each word into the next one.
+ */
+static void ssl_dtls_replay_shift(uint64_t window[SSL_DTLS_REPLAY_WORDS],
+                                  uint64_t shift)
+{
+    size_t words = (size_t) (shift / 64);
+    unsigned bits = (unsigned) (shift % 64);
+    size_t i;
+
+    for (i = SSL_DTLS_REPLAY_WORDS; i-- > words;) {
+        window[i] = window[i - words] << bits;
+        if (bits != 0 && i > words) {
+            window[i] |= window[i - words - 1] >> (64 - bits);
+        }
+    }
+
+    for (i = 0; i < words; i++) {
+        window[i] = 0;
+    }
+}
+
 /*
  * Update replay window on new validated record
  */
@@ -3435,26 +4595,26 @@ void mbedtls_ssl_dtls_replay_update(mbedtls_ssl_context *ssl)
         /* Update window_top and the contents of the window */
         uint64_t shift = rec_seqnum - ssl->in_window_top;
 
-        if (shift >= 64) {
-            ssl->in_window = 1;
+        if (shift >= MBEDTLS_SSL_DTLS_REPLAY_WINDOW) {
+            memset(ssl->in_window, 0, sizeof(ssl->in_window));
         } else {
-            ssl->in_window <<= shift;
-            ssl->in_window |= 1;
+            ssl_dtls_replay_shift(ssl->in_window, shift);
         }
+        ssl->in_window[0] |= 1;
 
         ssl->in_window_top = rec_seqnum;
     } else {
         /* Mark that number as seen in the current window */
         uint64_t bit = ssl->in_window_top - rec_seqnum;
 
-        if (bit < 64) { /* Always true, but be extra sure */
-            ssl->in_window |= (uint64_t) 1 << bit;
+        if (bit < MBEDTLS_SSL_DTLS_REPLAY_WINDOW) { /* Always true, but be extra sure */
+            ssl->in_window[bit / 64] |= (uint64_t) 1 << (bit % 64);
         }
     }
 }
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
-#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
+#if defined(MBEDTLS_SSL_DTLS_HELLO_VERIFY) && defined(MBEDTLS_SSL_SRV_C)
 /*
  * Check if a datagram looks like a ClientHello with a valid cookie,
  * and if it doesn't, generate a HelloVerifyRequest message.
@@ -3465,11 +4625,14 @@ void mbedtls_ssl_dtls_replay_update(mbedtls_ssl_context *ssl)
  *   fill obuf and set olen, then
  *   return MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED
  * - otherwise return a specific error code
+ *
+ * ssl is only used for debug output and may be NULL when no context has
+ * been allocated for the peer yet.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-MBEDTLS_STATIC_TESTABLE
-int mbedtls_ssl_check_dtls_clihlo_cookie(
+static int ssl_check_dtls_clihlo_cookie(
     mbedtls_ssl_context *ssl,
+    const mbedtls_ssl_config *conf,
     const unsigned char *cli_id, size_t cli_id_len,
     const unsigned char *in, size_t in_len,
     unsigned char *obuf, size_t buf_len, size_t *olen)
@@ -3543,9 +4706,9 @@ int mbedtls_ssl_check_dtls_clihlo_cookie(
 
     MBEDTLS_SSL_DEBUG_BUF(4, "cookie received from network",
                           in + sid_len + 61, cookie_len);
-    if (ssl->conf->f_cookie_check(ssl->conf->p_cookie,
-                                  in + sid_len + 61, cookie_len,
-                                  cli_id, cli_id_len) == 0) {
+    if (conf->f_cookie_check(conf->p_cookie,
+                             in + sid_len + 61, cookie_len,
+                             cli_id, cli_id_len) == 0) {
         MBEDTLS_SSL_DEBUG_MSG(4, ("check cookie: valid"));
         return 0;
     }
@@ -3582,9 +4745,9 @@ int mbedtls_ssl_check_dtls_clihlo_cookie(
 
     /* Generate and write actual cookie */
     p = obuf + 28;
-    if (ssl->conf->f_cookie_write(ssl->conf->p_cookie,
-                                  &p, obuf + buf_len,
-                                  cli_id, cli_id_len) != 0) {
+    if (conf->f_cookie_write(conf->p_cookie,
+                             &p, obuf + buf_len,
+                             cli_id, cli_id_len) != 0) {
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
@@ -3602,6 +4765,42 @@ int mbedtls_ssl_check_dtls_clihlo_cookie(
     return MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED;
 }
 
+int mbedtls_ssl_check_client_hello_cookie(
+    const mbedtls_ssl_config *conf,
+    const unsigned char *cli_id, size_t cli_id_len,
+    const unsigned char *in, size_t in_len,
+    unsigned char *obuf, size_t buf_len, size_t *olen)
+{
+    if (conf == NULL || cli_id == NULL || in == NULL ||
+        obuf == NULL || olen == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM ||
+        conf->f_cookie_write == NULL ||
+        conf->f_cookie_check == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    return ssl_check_dtls_clihlo_cookie(NULL, conf, cli_id, cli_id_len,
+                                        in, in_len, obuf, buf_len, olen);
+}
+#endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY && MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
+MBEDTLS_CHECK_RETURN_CRITICAL
+MBEDTLS_STATIC_TESTABLE
+int mbedtls_ssl_check_dtls_clihlo_cookie(
+    mbedtls_ssl_context *ssl,
+    const unsigned char *cli_id, size_t cli_id_len,
+    const unsigned char *in, size_t in_len,
+    unsigned char *obuf, size_t buf_len, size_t *olen)
+{
+    return ssl_check_dtls_clihlo_cookie(ssl, ssl->conf, cli_id, cli_id_len,
+                                        in, in_len, obuf, buf_len, olen);
+}
+
 /*
  * Handle possible client reconnect with the same UDP quadruplet
  * (RFC 6347 Section 4.2.8).
@@ -3641,7 +4840,7 @@ static int ssl_handle_possible_reconnect(mbedtls_ssl_context *ssl)
         ssl,
         ssl->cli_id, ssl->cli_id_len,
         ssl->in_buf, ssl->in_left,
-        ssl->out_buf, MBEDTLS_SSL_OUT_CONTENT_LEN, &len);
+        ssl->out_buf, mbedtls_ssl_out_content_len(ssl), &len);
 
     MBEDTLS_SSL_DEBUG_RET(2, "mbedtls_ssl_check_dtls_clihlo_cookie", ret);
 
@@ -3653,7 +4852,7 @@ static int ssl_handle_possible_reconnect(mbedtls_ssl_context *ssl)
         /* Don't check write errors as we can't do anything here.
          * If the error is permanent we'll catch it later,
          * if it's not, then hopefully it'll work next time. */
-        send_ret = ssl->f_send(ssl->p_bio, ssl->out_buf, len);
+        send_ret = ssl_bio_send(ssl, ssl->out_buf, len);
         MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_send", send_ret);
         (void) send_ret;
 
@@ -3737,6 +4936,35 @@ static int ssl_parse_record_header(mbedtls_ssl_context const *ssl,
     size_t       rec_hdr_len_offset; /* To be determined */
     size_t const rec_hdr_len_len    = 2;
 
+    /*
+     * Fast path for the common case of an application data record over
+     * stream transport, whose type and version are those of all protected
+     * TLS 1.2 and TLS 1.3 records: one load and compare of the first four
+     * bytes accepts them, and every other record takes the full path below.
+     */
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM)
+#endif
+    {
+        if (len >= 5 &&
+            (MBEDTLS_GET_UINT32_BE(buf, 0) & 0xFFFFFF00) == 0x17030300 &&
+            (rec->data_len = MBEDTLS_GET_UINT16_BE(buf, 3)) != 0) {
+            rec->type = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+            rec->ver[0] = MBEDTLS_SSL_MAJOR_VERSION_3;
+            rec->ver[1] = MBEDTLS_SSL_MINOR_VERSION_3;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+            rec->cid_len = 0;
+#endif
+            memcpy(&rec->ctr[0], ssl->in_ctr, rec_hdr_ctr_len);
+            rec->data_offset = 5;
+            rec->buf         = buf;
+            rec->buf_len     = 5 + rec->data_len;
+
+            MBEDTLS_SSL_DEBUG_BUF(4, "input record header", buf, 5);
+            return 0;
+        }
+    }
+
     /*
      * Check minimum lengths for record header.
      */
@@ -3951,2115 +5179,3986 @@ static int ssl_check_client_reconnect(mbedtls_ssl_context *ssl)
 }
 #endif /* MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE && MBEDTLS_SSL_SRV_C */
 
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
 /*
- * If applicable, decrypt record content
+ * Whether outgoing batches are protected asynchronously. The write queue
+ * takes the data as soon as it is protected, so it is not combined with
+ * records protected later.
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_prepare_record_content(mbedtls_ssl_context *ssl,
-                                      mbedtls_record *rec)
+static int ssl_pipeline_async(const mbedtls_ssl_context *ssl)
 {
-    int ret, done = 0;
+    return ssl->conf->f_pipeline_async != NULL &&
+           ssl->conf->write_queue != MBEDTLS_SSL_WRITE_QUEUE_ENABLED;
+}
 
-    MBEDTLS_SSL_DEBUG_BUF(4, "input record from network",
-                          rec->buf, rec->buf_len);
+/*
+ * Whether the records of a transform can go through the pipeline: AEAD
+ * records over TLS, whose protected length only depends on the content
+ * length. The legacy cipher contexts cannot be shared between threads, so
+ * this also needs PSA.
+ */
+static int ssl_pipeline_applies(const mbedtls_ssl_context *ssl,
+                                const mbedtls_ssl_transform *transform,
+                                int outgoing)
+{
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_SSL_HAVE_AEAD)
+    return (ssl->conf->f_pipeline != NULL ||
+            (outgoing && ssl_pipeline_async(ssl))) &&
+           ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+           transform != NULL &&
+           mbedtls_ssl_get_mode_from_transform(transform) == MBEDTLS_SSL_MODE_AEAD;
+#else
+    (void) ssl;
+    (void) transform;
+    (void) outgoing;
+    return 0;
+#endif
+}
 
-    /*
-     * In TLS 1.3, always treat ChangeCipherSpec records
-     * as unencrypted. The only thing we do with them is
-     * check the length and content and ignore them.
-     */
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_SSL_HAVE_AEAD)
+/* The length of an AEAD record protecting len bytes, excluding the header */
+static size_t ssl_pipeline_protected_len(const mbedtls_ssl_transform *transform,
+                                         size_t len)
+{
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-    if (ssl->transform_in != NULL &&
-        ssl->transform_in->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
-        if (rec->type == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
-            done = 1;
-        }
+    if (transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        len += 1 + ssl_compute_padding_length(len,
+                                              MBEDTLS_SSL_CID_TLS1_3_PADDING_GRANULARITY);
     }
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-    if (!done && ssl->transform_in != NULL) {
-        unsigned char const old_msg_type = rec->type;
+    return len + (transform->ivlen - transform->fixed_ivlen) + transform->taglen;
+}
+#endif /* MBEDTLS_USE_PSA_CRYPTO && MBEDTLS_SSL_HAVE_AEAD */
 
-        if ((ret = mbedtls_ssl_decrypt_buf(ssl, ssl->transform_in,
-                                           rec)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "ssl_decrypt_buf", ret);
+static void ssl_pipeline_job(void *job_ctx, size_t index)
+{
+    mbedtls_ssl_pipeline *pipe = job_ctx;
+    mbedtls_ssl_pipeline_entry *entry;
 
-#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
-            /*
-             * Although the server rejected early data, it might receive early
-             * data as long as it has not received the client Finished message.
-             * It is encrypted with early keys and should be ignored as stated
-             * in section 4.2.10 of RFC 8446:
-             *
-             * "Ignore the extension and return a regular 1-RTT response. The
-             * server then skips past early data by attempting to deprotect
-             * received records using the handshake traffic key, discarding
-             * records which fail deprotection (up to the configured
-             * max_early_data_size). Once a record is deprotected successfully,
-             * it is treated as the start of the client's second flight and the
-             * server proceeds as with an ordinary 1-RTT handshake."
-             */
-            if ((old_msg_type == MBEDTLS_SSL_MSG_APPLICATION_DATA) &&
-                (ssl->discard_early_data_record ==
-                 MBEDTLS_SSL_EARLY_DATA_TRY_TO_DEPROTECT_AND_DISCARD)) {
-                MBEDTLS_SSL_DEBUG_MSG(
-                    3, ("EarlyData: deprotect and discard app data records."));
+    if (index >= pipe->count) {
+        return;
+    }
+    entry = &pipe->entries[index];
 
-                ret = mbedtls_ssl_tls13_check_early_data_len(ssl, rec->data_len);
-                if (ret != 0) {
-                    return ret;
-                }
-                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-            }
-#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+    /* No context is passed: its debug callback may not be thread-safe. */
+    if (pipe->outgoing) {
+        entry->ret = mbedtls_ssl_encrypt_buf_from(NULL, pipe->transform,
+                                                  &entry->rec, entry->src,
+                                                  NULL, NULL);
+    } else {
+        entry->ret = mbedtls_ssl_decrypt_buf(NULL, pipe->transform,
+                                             &entry->rec);
+    }
 
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-            if (ret == MBEDTLS_ERR_SSL_UNEXPECTED_CID &&
-                ssl->conf->ignore_unexpected_cid
-                == MBEDTLS_SSL_UNEXPECTED_CID_IGNORE) {
-                MBEDTLS_SSL_DEBUG_MSG(3, ("ignoring unexpected CID"));
-                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-            }
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    /* The last job to return completes an asynchronous batch. */
+    if (mbedtls_mutex_lock(&pipe->mutex) == 0) {
+        pipe->pending--;
+        (void) mbedtls_mutex_unlock(&pipe->mutex);
+    }
+}
 
-            /*
-             * The decryption of the record failed, no reason to ignore it,
-             * return in error with the decryption error code.
-             */
+/* Process the records of the current batch, in parallel if there are more
+ * than one. The result of each record is left in its entry, or will be if
+ * MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS is returned. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_pipeline_run(mbedtls_ssl_context *ssl,
+                            mbedtls_ssl_pipeline *pipe)
+{
+    int ret;
+
+    pipe->pending = pipe->count;
+
+    if (pipe->outgoing && ssl_pipeline_async(ssl)) {
+        ret = ssl->conf->f_pipeline_async(ssl->conf->p_pipeline_async,
+                                          ssl_pipeline_job, pipe, pipe->count);
+        if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("protecting %" MBEDTLS_PRINTF_SIZET
+                                      " records asynchronously", pipe->count));
+            pipe->in_flight = 1;
             return ret;
         }
-
-#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
-        /*
-         * If the server were discarding protected records that it fails to
-         * deprotect because it has rejected early data, as we have just
-         * deprotected successfully a record, the server has to resume normal
-         * operation and fail the connection if the deprotection of a record
-         * fails.
-         */
-        if (ssl->discard_early_data_record ==
-            MBEDTLS_SSL_EARLY_DATA_TRY_TO_DEPROTECT_AND_DISCARD) {
-            ssl->discard_early_data_record = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "f_pipeline_async", ret);
         }
-#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+        return ret;
+    }
 
-        if (old_msg_type != rec->type) {
-            MBEDTLS_SSL_DEBUG_MSG(4, ("record type after decrypt (before %d): %d",
-                                      old_msg_type, rec->type));
-        }
+    if (pipe->count == 1) {
+        ssl_pipeline_job(pipe, 0);
+        return 0;
+    }
 
-        MBEDTLS_SSL_DEBUG_BUF(4, "input payload after decrypt",
-                              rec->buf + rec->data_offset, rec->data_len);
+    MBEDTLS_SSL_DEBUG_MSG(3, ("%s %" MBEDTLS_PRINTF_SIZET " records in parallel",
+                              pipe->outgoing ? "protecting" : "deprotecting",
+                              pipe->count));
 
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        /* We have already checked the record content type
-         * in ssl_parse_record_header(), failing or silently
-         * dropping the record in the case of an unknown type.
-         *
-         * Since with the use of CIDs, the record content type
-         * might change during decryption, re-check the record
-         * content type, but treat a failure as fatal this time. */
-        if (ssl_check_record_type(rec->type)) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("unknown record type"));
-            return MBEDTLS_ERR_SSL_INVALID_RECORD;
-        }
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    ret = ssl->conf->f_pipeline(ssl->conf->p_pipeline, ssl_pipeline_job,
+                                pipe, pipe->count);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_pipeline", ret);
+    }
 
-        if (rec->data_len == 0) {
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-            if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2
-                && rec->type != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
-                /* TLS v1.2 explicitly disallows zero-length messages which are not application data */
-                MBEDTLS_SSL_DEBUG_MSG(1, ("invalid zero-length message type: %d", ssl->in_msgtype));
-                return MBEDTLS_ERR_SSL_INVALID_RECORD;
-            }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    return ret;
+}
 
-            ssl->nb_zero++;
+/* Get the pipeline state of one direction, allocated on first use. NULL
+ * if out of memory, in which case records are processed serially. */
+static mbedtls_ssl_pipeline *ssl_pipeline_get(mbedtls_ssl_pipeline **pipe,
+                                              size_t size)
+{
+    if (*pipe != NULL && (*pipe)->size < size) {
+        mbedtls_ssl_pipeline_free(*pipe);
+        *pipe = NULL;
+    }
 
-            /*
-             * Three or more empty messages may be a DoS attack
-             * (excessive CPU consumption).
-             */
-            if (ssl->nb_zero > 3) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("received four consecutive empty "
-                                          "messages, possible DoS attack"));
-                /* Treat the records as if they were not properly authenticated,
-                 * thereby failing the connection if we see more than allowed
-                 * by the configured bad MAC threshold. */
-                return MBEDTLS_ERR_SSL_INVALID_MAC;
-            }
-        } else {
-            ssl->nb_zero = 0;
+    if (*pipe == NULL) {
+        mbedtls_ssl_pipeline *p = mbedtls_calloc(1, sizeof(*p));
+        if (p == NULL) {
+            return NULL;
         }
-
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            ; /* in_ctr read from peer, not maintained internally */
-        } else
-#endif
-        {
-            unsigned i;
-            for (i = MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-                 i > mbedtls_ssl_ep_len(ssl); i--) {
-                if (++ssl->in_ctr[i - 1] != 0) {
-                    break;
-                }
-            }
-
-            /* The loop goes to its end iff the counter is wrapping */
-            if (i == mbedtls_ssl_ep_len(ssl)) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("incoming message counter would wrap"));
-                return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
-            }
+        p->entries = mbedtls_calloc(size, sizeof(*p->entries));
+        if (p->entries == NULL) {
+            mbedtls_free(p);
+            return NULL;
         }
-
+        mbedtls_mutex_init(&p->mutex);
+        p->size = size;
+        *pipe = p;
     }
 
-#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
-    /*
-     * Although the server rejected early data because it needed to send an
-     * HelloRetryRequest message, it might receive early data as long as it has
-     * not received the client Finished message.
-     * The early data is encrypted with early keys and should be ignored as
-     * stated in section 4.2.10 of RFC 8446 (second case):
-     *
-     * "The server then ignores early data by skipping all records with an
-     * external content type of "application_data" (indicating that they are
-     * encrypted), up to the configured max_early_data_size. Ignore application
-     * data message before 2nd ClientHello when early_data was received in 1st
-     * ClientHello."
-     */
-    if (ssl->discard_early_data_record == MBEDTLS_SSL_EARLY_DATA_DISCARD) {
-        if (rec->type == MBEDTLS_SSL_MSG_APPLICATION_DATA) {
-
-            ret = mbedtls_ssl_tls13_check_early_data_len(ssl, rec->data_len);
-            if (ret != 0) {
-                return ret;
-            }
-
-            MBEDTLS_SSL_DEBUG_MSG(
-                3, ("EarlyData: Ignore application message before 2nd ClientHello"));
+    return *pipe;
+}
 
-            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-        } else if (rec->type == MBEDTLS_SSL_MSG_HANDSHAKE) {
-            ssl->discard_early_data_record = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
-        }
+void mbedtls_ssl_pipeline_free(mbedtls_ssl_pipeline *pipe)
+{
+    if (pipe == NULL) {
+        return;
     }
-#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
 
-#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        mbedtls_ssl_dtls_replay_update(ssl);
-    }
-#endif
+    mbedtls_mutex_free(&pipe->mutex);
+    mbedtls_free(pipe->backup);
+    mbedtls_free(pipe->entries);
+    mbedtls_free(pipe);
+}
 
-    /* Check actual (decrypted) record content length against
-     * configured maximum. */
-    if (rec->data_len > MBEDTLS_SSL_IN_CONTENT_LEN) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("bad message length"));
-        return MBEDTLS_ERR_SSL_INVALID_RECORD;
+/*
+ * Give up on the outgoing batch after a failure: its records may not all
+ * be protected, so none of them is sent.
+ */
+static void ssl_pipeline_discard(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_pipeline *pipe)
+{
+    mbedtls_platform_zeroize(pipe->hdr, (size_t) (ssl->out_hdr - pipe->hdr));
+    ssl->out_hdr  = pipe->hdr;
+    ssl->out_left = pipe->left;
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+    pipe->count = 0;
+}
+
+/*
+ * Check the results of the outgoing batch once its jobs have run.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_pipeline_finish(mbedtls_ssl_context *ssl,
+                               mbedtls_ssl_pipeline *pipe, int ret)
+{
+    size_t i;
+
+    for (i = 0; ret == 0 && i < pipe->count; i++) {
+        const mbedtls_ssl_pipeline_entry *entry = &pipe->entries[i];
+
+        if (entry->ret != 0) {
+            ret = entry->ret;
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_encrypt_buf", ret);
+        } else if (entry->rec.data_offset != 0 ||
+                   entry->rec.data_len != entry->expected ||
+                   entry->rec.type != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+    }
+
+    if (ret != 0) {
+        ssl_pipeline_discard(ssl, pipe);
+        return ret;
     }
 
+    MBEDTLS_SSL_DEBUG_BUF(4, "output records sent to network",
+                          pipe->hdr, (size_t) (ssl->out_hdr - pipe->hdr));
+
+    pipe->count = 0;
+
     return 0;
 }
 
 /*
- * Read a record.
- *
- * Silently ignore non-fatal alert (and for DTLS, invalid records as well,
- * RFC 6347 4.1.2.7) and continue reading until a valid record is found.
- *
+ * Protect the outgoing batch. On success, the records are ready to be sent.
  */
-
-/* Helper functions for mbedtls_ssl_read_record(). */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_consume_current_message(mbedtls_ssl_context *ssl);
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_get_next_record(mbedtls_ssl_context *ssl);
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_record_is_in_progress(mbedtls_ssl_context *ssl);
+static int ssl_pipeline_protect(mbedtls_ssl_context *ssl,
+                                mbedtls_ssl_pipeline *pipe)
+{
+    int ret;
 
-int mbedtls_ssl_read_record(mbedtls_ssl_context *ssl,
-                            unsigned update_hs_digest)
+    if (pipe->count == 0) {
+        return 0;
+    }
+
+    ret = ssl_pipeline_run(ssl, pipe);
+    if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        return ret;
+    }
+
+    return ssl_pipeline_finish(ssl, pipe, ret);
+}
+
+/*
+ * Finish the outgoing batch protected asynchronously, if any, once all its
+ * jobs have returned.
+ */
+static int ssl_pipeline_complete(mbedtls_ssl_context *ssl)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_pipeline *pipe = ssl->out_pipe;
+    size_t pending;
+    int ret;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read record"));
+    if (pipe == NULL || !pipe->in_flight) {
+        return 0;
+    }
 
-    if (ssl->keep_current_message == 0) {
-        do {
+    if (mbedtls_mutex_lock(&pipe->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+    pending = pipe->pending;
+    (void) mbedtls_mutex_unlock(&pipe->mutex);
 
-            ret = ssl_consume_current_message(ssl);
-            if (ret != 0) {
-                return ret;
-            }
+    if (pending != 0) {
+        return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+    }
 
-            if (ssl_record_is_in_progress(ssl) == 0) {
-                int dtls_have_buffered = 0;
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    pipe->in_flight = 0;
 
-                /* We only check for buffered messages if the
-                 * current datagram is fully consumed. */
-                if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
-                    ssl_next_record_is_in_datagram(ssl) == 0) {
-                    if (ssl_load_buffered_message(ssl) == 0) {
-                        dtls_have_buffered = 1;
-                    }
-                }
+    if ((ret = ssl_pipeline_finish(ssl, pipe, 0)) != 0) {
+        ssl->out_batch_len = 0;
+    }
 
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
-                if (dtls_have_buffered == 0) {
-                    ret = ssl_get_next_record(ssl);
-                    if (ret == MBEDTLS_ERR_SSL_CONTINUE_PROCESSING) {
-                        continue;
-                    }
+    return ret;
+}
 
-                    if (ret != 0) {
-                        MBEDTLS_SSL_DEBUG_RET(1, ("ssl_get_next_record"), ret);
-                        return ret;
-                    }
-                }
-            }
+/*
+ * Lay out the application data record in ssl->out_msg / src at the end of
+ * the output buffer, with its final header and sequence number, and queue
+ * it for protection. Like ssl_write_record_from(), but the batch is only
+ * protected once it is full or ssl_pipeline_protect() is called.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_pipeline_queue_record(mbedtls_ssl_context *ssl,
+                                     mbedtls_ssl_pipeline *pipe,
+                                     const unsigned char *src)
+{
+#if defined(MBEDTLS_USE_PSA_CRYPTO) && defined(MBEDTLS_SSL_HAVE_AEAD)
+    mbedtls_ssl_pipeline_entry *entry;
+    mbedtls_ssl_protocol_version tls_ver = ssl->tls_version;
+    size_t len = ssl->out_msglen;
+    size_t protected_len = ssl_pipeline_protected_len(ssl->transform_out, len);
+    unsigned i;
 
-            ret = mbedtls_ssl_handle_message_type(ssl);
+    if (pipe->count == 0) {
+        pipe->transform = ssl->transform_out;
+        pipe->outgoing = 1;
+        pipe->hdr = ssl->out_hdr;
+        pipe->left = ssl->out_left;
+    }
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-            if (ret == MBEDTLS_ERR_SSL_EARLY_MESSAGE) {
-                /* Buffer future message */
-                ret = ssl_buffer_message(ssl);
-                if (ret != 0) {
-                    return ret;
-                }
+    if (ssl->out_buf_len - (size_t) (ssl->out_iv - ssl->out_buf) < protected_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+        ssl_pipeline_discard(ssl, pipe);
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
 
-                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-            }
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (tls_ver == MBEDTLS_SSL_VERSION_TLS1_3) {
+        tls_ver = MBEDTLS_SSL_VERSION_TLS1_2;
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-        } while (MBEDTLS_ERR_SSL_NON_FATAL           == ret  ||
-                 MBEDTLS_ERR_SSL_CONTINUE_PROCESSING == ret);
+    /* The header is final already: AEAD records keep their content type
+     * without a CID, and their length is known in advance. */
+    ssl->out_hdr[0] = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    mbedtls_ssl_write_version(ssl->out_hdr + 1, ssl->conf->transport, tls_ver);
+    MBEDTLS_PUT_UINT16_BE(protected_len, ssl->out_len, 0);
+
+    entry = &pipe->entries[pipe->count++];
+    entry->rec.buf         = ssl->out_iv;
+    entry->rec.buf_len     = protected_len;
+    entry->rec.data_len    = len;
+    entry->rec.data_offset = (size_t) (ssl->out_msg - ssl->out_iv);
+    memcpy(&entry->rec.ctr[0], ssl->cur_out_ctr, sizeof(entry->rec.ctr));
+    mbedtls_ssl_write_version(entry->rec.ver, ssl->conf->transport, tls_ver);
+    entry->rec.type = ssl->out_msgtype;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    entry->rec.cid_len = 0;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    entry->src = src;
+    entry->expected = protected_len;
+    entry->ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        if (0 != ret) {
-            MBEDTLS_SSL_DEBUG_RET(1, ("mbedtls_ssl_handle_message_type"), ret);
-            return ret;
-        }
+    MBEDTLS_SSL_STATS_INC(ssl, records_out);
+    MBEDTLS_SSL_STATS_ADD(ssl, bytes_out, len);
 
-        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
-            update_hs_digest == 1) {
-            ret = mbedtls_ssl_update_handshake_status(ssl);
-            if (0 != ret) {
-                MBEDTLS_SSL_DEBUG_RET(1, ("mbedtls_ssl_update_handshake_status"), ret);
-                return ret;
-            }
+    ssl->out_left += protected_len + mbedtls_ssl_out_hdr_len(ssl);
+    ssl->out_hdr  += protected_len + mbedtls_ssl_out_hdr_len(ssl);
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+
+    for (i = 8; i > mbedtls_ssl_ep_len(ssl); i--) {
+        if (++ssl->cur_out_ctr[i - 1] != 0) {
+            break;
         }
-    } else {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("reuse previously read message"));
-        ssl->keep_current_message = 0;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read record"));
+    /* The loop goes to its end if the counter is wrapping */
+    if (i == mbedtls_ssl_ep_len(ssl)) {
+        int ret = ssl_pipeline_protect(ssl, pipe);
+        MBEDTLS_SSL_DEBUG_MSG(1, ("outgoing message counter would wrap"));
+        return ret != 0 && ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS ?
+               ret : MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+    }
+
+    if (pipe->count == pipe->size) {
+        return ssl_pipeline_protect(ssl, pipe);
+    }
 
     return 0;
+#else
+    (void) ssl;
+    (void) pipe;
+    (void) src;
+    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+#endif /* MBEDTLS_USE_PSA_CRYPTO && MBEDTLS_SSL_HAVE_AEAD */
 }
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_next_record_is_in_datagram(mbedtls_ssl_context *ssl)
+/*
+ * Decrypt the current incoming record, together with the complete
+ * application data records read ahead of it. Returns 0 if the record is
+ * to be decrypted serially, or 1 with its result in *ret.
+ *
+ * The records decrypted ahead are handed out by the following calls, up
+ * to the first one that failed or is not application data: with TLS 1.3,
+ * a KeyUpdate may change the key of the records after it, which are
+ * restored to be decrypted again.
+ */
+static int ssl_pipeline_decrypt(mbedtls_ssl_context *ssl,
+                                mbedtls_record *rec, int *ret)
 {
-    if (ssl->in_left > ssl->next_record_offset) {
+    mbedtls_ssl_pipeline *pipe = ssl->in_pipe;
+    mbedtls_ssl_pipeline_entry *entry;
+    const size_t size = mbedtls_ssl_get_read_ahead_records(ssl);
+    unsigned char *start, *p, *end;
+    uint64_t ctr;
+    size_t count, cut;
+
+    if (pipe != NULL && pipe->ready != 0) {
+        entry = &pipe->entries[pipe->next++];
+        pipe->ready--;
+
+        if (entry->rec.buf_len != rec->buf_len) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            *ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            return 1;
+        }
+
+        /* The record may have moved in the input buffer since. */
+        rec->type        = entry->rec.type;
+        rec->data_offset = entry->rec.data_offset;
+        rec->data_len    = entry->rec.data_len;
+        *ret = entry->ret;
         return 1;
     }
 
-    return 0;
-}
+    if (size < 2 || ssl->in_ahead_len == 0 ||
+        ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER ||
+        rec->type != MBEDTLS_SSL_MSG_APPLICATION_DATA ||
+        !ssl_pipeline_applies(ssl, ssl->transform_in, 0) ||
+        (pipe = ssl_pipeline_get(&ssl->in_pipe, size)) == NULL) {
+        return 0;
+    }
 
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_load_buffered_message(mbedtls_ssl_context *ssl)
-{
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
-    mbedtls_ssl_hs_buffer *hs_buf;
-    int ret = 0;
+    pipe->transform = ssl->transform_in;
+    pipe->outgoing = 0;
+    pipe->entries[0].rec = *rec;
 
-    if (hs == NULL) {
-        return -1;
-    }
+    start = p = rec->buf + rec->buf_len;
+    end = p + ssl->in_ahead_len;
+    ctr = MBEDTLS_GET_UINT64_BE(rec->ctr, 0);
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_load_buffered_message"));
+    /* Collect the complete protected records that follow, as parsed by the
+     * fast path of ssl_parse_record_header(). */
+    for (count = 1; count < size && end - p >= 5; count++) {
+        size_t n;
 
-    if (ssl->state == MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC ||
-        ssl->state == MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
-        /* Check if we have seen a ChangeCipherSpec before.
-         * If yes, synthesize a CCS record. */
-        if (!hs->buffering.seen_ccs) {
-            MBEDTLS_SSL_DEBUG_MSG(2, ("CCS not seen in the current flight"));
-            ret = -1;
-            goto exit;
+        if ((MBEDTLS_GET_UINT32_BE(p, 0) & 0xFFFFFF00) != 0x17030300 ||
+            (n = MBEDTLS_GET_UINT16_BE(p, 3)) == 0 ||
+            (size_t) (end - p) - 5 < n || ctr + count < ctr) {
+            break;
         }
 
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Injecting buffered CCS message"));
-        ssl->in_msgtype = MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC;
-        ssl->in_msglen = 1;
-        ssl->in_msg[0] = 1;
+        entry = &pipe->entries[count];
+        entry->rec = *rec;
+        entry->rec.buf         = p;
+        entry->rec.buf_len     = 5 + n;
+        entry->rec.data_offset = 5;
+        entry->rec.data_len    = n;
+        MBEDTLS_PUT_UINT64_BE(ctr + count, entry->rec.ctr, 0);
 
-        /* As long as they are equal, the exact value doesn't matter. */
-        ssl->in_left            = 0;
-        ssl->next_record_offset = 0;
+        p += 5 + n;
+    }
 
-        hs->buffering.seen_ccs = 0;
-        goto exit;
+    if (count == 1) {
+        return 0;
     }
 
-#if defined(MBEDTLS_DEBUG_C)
-    /* Debug only */
-    {
-        unsigned offset;
-        for (offset = 1; offset < MBEDTLS_SSL_MAX_BUFFERED_HS; offset++) {
-            hs_buf = &hs->buffering.hs[offset];
-            if (hs_buf->is_valid == 1) {
-                MBEDTLS_SSL_DEBUG_MSG(2, ("Future message with sequence number %u %s buffered.",
-                                          hs->in_msg_seq + offset,
-                                          hs_buf->is_complete ? "fully" : "partially"));
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (pipe->transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        if (pipe->backup_len < (size_t) (p - start)) {
+            mbedtls_free(pipe->backup);
+            pipe->backup_len = 0;
+            pipe->backup = mbedtls_calloc(1, ssl->in_buf_len);
+            if (pipe->backup == NULL) {
+                return 0;
             }
+            pipe->backup_len = ssl->in_buf_len;
         }
+        memcpy(pipe->backup, start, (size_t) (p - start));
     }
-#endif /* MBEDTLS_DEBUG_C */
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-    /* Check if we have buffered and/or fully reassembled the
-     * next handshake message. */
-    hs_buf = &hs->buffering.hs[0];
-    if ((hs_buf->is_valid == 1) && (hs_buf->is_complete == 1)) {
-        /* Synthesize a record containing the buffered HS message. */
-        size_t msg_len = MBEDTLS_GET_UINT24_BE(hs_buf->data, 1);
+    pipe->count = count;
+    if ((*ret = ssl_pipeline_run(ssl, pipe)) != 0) {
+        return 1;
+    }
 
-        /* Double-check that we haven't accidentally buffered
-         * a message that doesn't fit into the input buffer. */
-        if (msg_len + 12 > MBEDTLS_SSL_IN_CONTENT_LEN) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    for (cut = 0; cut < count; cut++) {
+        if (pipe->entries[cut].ret != 0 ||
+            pipe->entries[cut].rec.type != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+            break;
         }
+    }
 
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Next handshake message has been buffered - load"));
-        MBEDTLS_SSL_DEBUG_BUF(3, "Buffered handshake message (incl. header)",
-                              hs_buf->data, msg_len + 12);
-
-        ssl->in_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
-        ssl->in_hslen   = msg_len + 12;
-        ssl->in_msglen  = msg_len + 12;
-        memcpy(ssl->in_msg, hs_buf->data, ssl->in_hslen);
+    if (cut < count) {
+        unsigned char *restart = pipe->entries[cut].rec.buf +
+                                 pipe->entries[cut].rec.buf_len;
+        cut++;
 
-        ret = 0;
-        goto exit;
-    } else {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Next handshake message %u not or only partially bufffered",
-                                  hs->in_msg_seq));
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        if (pipe->transform->tls_version == MBEDTLS_SSL_VERSION_TLS1_3 &&
+            restart < p) {
+            memcpy(restart, pipe->backup + (restart - start),
+                   (size_t) (p - restart));
+        }
+#else
+        (void) restart;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
     }
 
-    ret = -1;
+    MBEDTLS_SSL_DEBUG_MSG(3, ("%" MBEDTLS_PRINTF_SIZET " records decrypted ahead",
+                              cut - 1));
 
-exit:
+    *rec = pipe->entries[0].rec;
+    *ret = pipe->entries[0].ret;
+    pipe->next = 1;
+    pipe->ready = cut - 1;
+    pipe->count = 0;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_load_buffered_message"));
-    return ret;
+    return 1;
 }
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
 
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_buffer_make_space(mbedtls_ssl_context *ssl,
-                                 size_t desired)
+/*
+ * Whether an incoming record can be decrypted straight into the buffer
+ * passed to mbedtls_ssl_read(): an application data record of an established
+ * TLS 1.2 AEAD connection whose plaintext fits in that buffer.
+ */
+static int ssl_record_fits_read_buffer(const mbedtls_ssl_context *ssl,
+                                       const mbedtls_record *rec)
 {
-    int offset;
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
-    MBEDTLS_SSL_DEBUG_MSG(2, ("Attempt to free buffered messages to have %u bytes available",
-                              (unsigned) desired));
-
-    /* Get rid of future records epoch first, if such exist. */
-    ssl_free_buffered_record(ssl);
-
-    /* Check if we have enough space available now. */
-    if (desired <= (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
-                    hs->buffering.total_bytes_buffered)) {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Enough space available after freeing future epoch record"));
+    const mbedtls_ssl_transform *transform = ssl->transform_in;
+    size_t overhead;
+
+    if (ssl->in_dst == NULL ||
+        ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER ||
+        rec->type != MBEDTLS_SSL_MSG_APPLICATION_DATA ||
+        !ssl_transform_is_plain_aead(transform,
+                                     mbedtls_ssl_get_mode_from_transform(transform),
+                                     0)) {
         return 0;
     }
 
-    /* We don't have enough space to buffer the next expected handshake
-     * message. Remove buffers used for future messages to gain space,
-     * starting with the most distant one. */
-    for (offset = MBEDTLS_SSL_MAX_BUFFERED_HS - 1;
-         offset >= 0; offset--) {
-        MBEDTLS_SSL_DEBUG_MSG(2,
-                              (
-                                  "Free buffering slot %d to make space for reassembly of next handshake message",
-                                  offset));
-
-        ssl_buffering_free_slot(ssl, (uint8_t) offset);
-
-        /* Check if we have enough space available now. */
-        if (desired <= (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
-                        hs->buffering.total_bytes_buffered)) {
-            MBEDTLS_SSL_DEBUG_MSG(2, ("Enough space available after freeing buffered HS messages"));
-            return 0;
-        }
+    overhead = transform->taglen;
+#if defined(MBEDTLS_SSL_HAVE_AEAD)
+    if (ssl_transform_aead_dynamic_iv_is_explicit(transform) == 1) {
+        overhead += transform->ivlen - transform->fixed_ivlen;
     }
+#endif /* MBEDTLS_SSL_HAVE_AEAD */
 
-    return -1;
+    return rec->data_len >= overhead &&
+           rec->data_len - overhead <= ssl->in_dst_len;
 }
 
+/*
+ * If applicable, decrypt record content
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_buffer_message(mbedtls_ssl_context *ssl)
+static int ssl_prepare_record_content(mbedtls_ssl_context *ssl,
+                                      mbedtls_record *rec)
 {
-    int ret = 0;
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    int ret, done = 0;
 
-    if (hs == NULL) {
-        return 0;
-    }
+    ssl->in_dst_used = 0;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_buffer_message"));
+    MBEDTLS_SSL_DEBUG_BUF(4, "input record from network",
+                          rec->buf, rec->buf_len);
 
-    switch (ssl->in_msgtype) {
-        case MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC:
-            MBEDTLS_SSL_DEBUG_MSG(2, ("Remember CCS message"));
+    /*
+     * In TLS 1.3, always treat ChangeCipherSpec records
+     * as unencrypted. The only thing we do with them is
+     * check the length and content and ignore them.
+     */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->transform_in != NULL &&
+        ssl->transform_in->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        if (rec->type == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
+            done = 1;
+        }
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-            hs->buffering.seen_ccs = 1;
-            break;
+    if (!done && ssl->transform_in != NULL) {
+        unsigned char const old_msg_type = rec->type;
+        unsigned char *dst = NULL;
+        size_t dst_len = 0;
 
-        case MBEDTLS_SSL_MSG_HANDSHAKE:
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+        if (ssl_pipeline_decrypt(ssl, rec, &ret) == 0)
+#endif
         {
-            unsigned recv_msg_seq_offset;
-            unsigned recv_msg_seq = MBEDTLS_GET_UINT16_BE(ssl->in_msg, 4);
-            mbedtls_ssl_hs_buffer *hs_buf;
-            size_t msg_len = ssl->in_hslen - 12;
-
-            /* We should never receive an old handshake
-             * message - double-check nonetheless. */
-            if (recv_msg_seq < ssl->handshake->in_msg_seq) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-                return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-            }
-
-            recv_msg_seq_offset = recv_msg_seq - ssl->handshake->in_msg_seq;
-            if (recv_msg_seq_offset >= MBEDTLS_SSL_MAX_BUFFERED_HS) {
-                /* Silently ignore -- message too far in the future */
-                MBEDTLS_SSL_DEBUG_MSG(2,
-                                      ("Ignore future HS message with sequence number %u, "
-                                       "buffering window %u - %u",
-                                       recv_msg_seq, ssl->handshake->in_msg_seq,
-                                       ssl->handshake->in_msg_seq + MBEDTLS_SSL_MAX_BUFFERED_HS -
-                                       1));
-
-                goto exit;
+            if (ssl_record_fits_read_buffer(ssl, rec)) {
+                dst = ssl->in_dst;
+                dst_len = ssl->in_dst_len;
             }
 
-            MBEDTLS_SSL_DEBUG_MSG(2, ("Buffering HS message with sequence number %u, offset %u ",
-                                      recv_msg_seq, recv_msg_seq_offset));
-
-            hs_buf = &hs->buffering.hs[recv_msg_seq_offset];
+            ret = mbedtls_ssl_decrypt_buf_to(ssl, ssl->transform_in,
+                                             rec, dst, dst_len);
+        }
 
-            /* Check if the buffering for this seq nr has already commenced. */
-            if (!hs_buf->is_valid) {
-                size_t reassembly_buf_sz;
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_decrypt_buf", ret);
 
-                hs_buf->is_fragmented =
-                    (ssl_hs_is_proper_fragment(ssl) == 1);
+            if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
+                MBEDTLS_SSL_STATS_INC(ssl, auth_failures);
+            }
 
-                /* We copy the message back into the input buffer
-                 * after reassembly, so check that it's not too large.
-                 * This is an implementation-specific limitation
-                 * and not one from the standard, hence it is not
-                 * checked in ssl_check_hs_header(). */
-                if (msg_len + 12 > MBEDTLS_SSL_IN_CONTENT_LEN) {
-                    /* Ignore message */
-                    goto exit;
-                }
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+            /*
+             * Although the server rejected early data, it might receive early
+             * data as long as it has not received the client Finished message.
+             * It is encrypted with early keys and should be ignored as stated
+             * in section 4.2.10 of RFC 8446:
+             *
+             * "Ignore the extension and return a regular 1-RTT response. The
+             * server then skips past early data by attempting to deprotect
+             * received records using the handshake traffic key, discarding
+             * records which fail deprotection (up to the configured
+             * max_early_data_size). Once a record is deprotected successfully,
+             * it is treated as the start of the client's second flight and the
+             * server proceeds as with an ordinary 1-RTT handshake."
+             */
+            if ((old_msg_type == MBEDTLS_SSL_MSG_APPLICATION_DATA) &&
+                (ssl->discard_early_data_record ==
+                 MBEDTLS_SSL_EARLY_DATA_TRY_TO_DEPROTECT_AND_DISCARD)) {
+                MBEDTLS_SSL_DEBUG_MSG(
+                    3, ("EarlyData: deprotect and discard app data records."));
 
-                /* Check if we have enough space to buffer the message. */
-                if (hs->buffering.total_bytes_buffered >
-                    MBEDTLS_SSL_DTLS_MAX_BUFFERING) {
-                    MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-                    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+                ret = mbedtls_ssl_tls13_check_early_data_len(ssl, rec->data_len);
+                if (ret != 0) {
+                    return ret;
                 }
+                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+            }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
 
-                reassembly_buf_sz = ssl_get_reassembly_buffer_size(msg_len,
-                                                                   hs_buf->is_fragmented);
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+            if (ret == MBEDTLS_ERR_SSL_UNEXPECTED_CID &&
+                ssl->conf->ignore_unexpected_cid
+                == MBEDTLS_SSL_UNEXPECTED_CID_IGNORE) {
+                MBEDTLS_SSL_DEBUG_MSG(3, ("ignoring unexpected CID"));
+                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+            }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-                if (reassembly_buf_sz > (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
-                                         hs->buffering.total_bytes_buffered)) {
-                    if (recv_msg_seq_offset > 0) {
-                        /* If we can't buffer a future message because
-                         * of space limitations -- ignore. */
-                        MBEDTLS_SSL_DEBUG_MSG(2,
-                                              ("Buffering of future message of size %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " would exceed the compile-time limit %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " (already %" MBEDTLS_PRINTF_SIZET
-                                               " bytes buffered) -- ignore\n",
-                                               msg_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
-                                               hs->buffering.total_bytes_buffered));
-                        goto exit;
-                    } else {
-                        MBEDTLS_SSL_DEBUG_MSG(2,
-                                              ("Buffering of future message of size %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " would exceed the compile-time limit %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " (already %" MBEDTLS_PRINTF_SIZET
-                                               " bytes buffered) -- attempt to make space by freeing buffered future messages\n",
-                                               msg_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
-                                               hs->buffering.total_bytes_buffered));
-                    }
+            /*
+             * The decryption of the record failed, no reason to ignore it,
+             * return in error with the decryption error code.
+             */
+            return ret;
+        }
 
-                    if (ssl_buffer_make_space(ssl, reassembly_buf_sz) != 0) {
-                        MBEDTLS_SSL_DEBUG_MSG(2,
-                                              ("Reassembly of next message of size %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " (%" MBEDTLS_PRINTF_SIZET
-                                               " with bitmap) would exceed"
-                                               " the compile-time limit %"
-                                               MBEDTLS_PRINTF_SIZET
-                                               " (already %" MBEDTLS_PRINTF_SIZET
-                                               " bytes buffered) -- fail\n",
-                                               msg_len,
-                                               reassembly_buf_sz,
-                                               (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
-                                               hs->buffering.total_bytes_buffered));
-                        ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
-                        goto exit;
-                    }
-                }
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+        /*
+         * If the server were discarding protected records that it fails to
+         * deprotect because it has rejected early data, as we have just
+         * deprotected successfully a record, the server has to resume normal
+         * operation and fail the connection if the deprotection of a record
+         * fails.
+         */
+        if (ssl->discard_early_data_record ==
+            MBEDTLS_SSL_EARLY_DATA_TRY_TO_DEPROTECT_AND_DISCARD) {
+            ssl->discard_early_data_record = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+        }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
 
-                MBEDTLS_SSL_DEBUG_MSG(2,
-                                      ("initialize reassembly, total length = %"
-                                       MBEDTLS_PRINTF_SIZET,
-                                       msg_len));
+        if (old_msg_type != rec->type) {
+            MBEDTLS_SSL_DEBUG_MSG(4, ("record type after decrypt (before %d): %d",
+                                      old_msg_type, rec->type));
+        }
 
-                hs_buf->data = mbedtls_calloc(1, reassembly_buf_sz);
-                if (hs_buf->data == NULL) {
-                    ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
-                    goto exit;
-                }
-                hs_buf->data_len = reassembly_buf_sz;
+        if (dst != NULL) {
+            ssl->in_dst_used = 1;
+        }
 
-                /* Prepare final header: copy msg_type, length and message_seq,
-                 * then add standardised fragment_offset and fragment_length */
-                memcpy(hs_buf->data, ssl->in_msg, 6);
-                memset(hs_buf->data + 6, 0, 3);
-                memcpy(hs_buf->data + 9, hs_buf->data + 1, 3);
+        MBEDTLS_SSL_DEBUG_BUF(4, "input payload after decrypt",
+                              dst != NULL ? dst : rec->buf + rec->data_offset,
+                              rec->data_len);
 
-                hs_buf->is_valid = 1;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        /* We have already checked the record content type
+         * in ssl_parse_record_header(), failing or silently
+         * dropping the record in the case of an unknown type.
+         *
+         * Since with the use of CIDs, the record content type
+         * might change during decryption, re-check the record
+         * content type, but treat a failure as fatal this time. */
+        if (ssl_check_record_type(rec->type)) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("unknown record type"));
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-                hs->buffering.total_bytes_buffered += reassembly_buf_sz;
-            } else {
-                /* Make sure msg_type and length are consistent */
-                if (memcmp(hs_buf->data, ssl->in_msg, 4) != 0) {
-                    MBEDTLS_SSL_DEBUG_MSG(1, ("Fragment header mismatch - ignore"));
-                    /* Ignore */
-                    goto exit;
-                }
+        if (rec->data_len == 0) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+            if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2
+                && rec->type != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+                /* TLS v1.2 explicitly disallows zero-length messages which are not application data */
+                MBEDTLS_SSL_DEBUG_MSG(1, ("invalid zero-length message type: %d", ssl->in_msgtype));
+                return MBEDTLS_ERR_SSL_INVALID_RECORD;
             }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
-            if (!hs_buf->is_complete) {
-                size_t frag_len, frag_off;
-                unsigned char * const msg = hs_buf->data + 12;
+            ssl->nb_zero++;
 
-                /*
-                 * Check and copy current fragment
-                 */
+            /*
+             * Three or more empty messages may be a DoS attack
+             * (excessive CPU consumption).
+             */
+            if (ssl->nb_zero > 3) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("received four consecutive empty "
+                                          "messages, possible DoS attack"));
+                /* Treat the records as if they were not properly authenticated,
+                 * thereby failing the connection if we see more than allowed
+                 * by the configured bad MAC threshold. */
+                return MBEDTLS_ERR_SSL_INVALID_MAC;
+            }
+        } else {
+            ssl->nb_zero = 0;
+        }
 
-                /* Validation of header fields already done in
-                 * mbedtls_ssl_prepare_handshake_record(). */
-                frag_off = ssl_get_hs_frag_off(ssl);
-                frag_len = ssl_get_hs_frag_len(ssl);
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+            ; /* in_ctr read from peer, not maintained internally */
+        } else
+#endif
+        {
+            unsigned i;
+            for (i = MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+                 i > mbedtls_ssl_ep_len(ssl); i--) {
+                if (++ssl->in_ctr[i - 1] != 0) {
+                    break;
+                }
+            }
 
-                MBEDTLS_SSL_DEBUG_MSG(2, ("adding fragment, offset = %" MBEDTLS_PRINTF_SIZET
-                                          ", length = %" MBEDTLS_PRINTF_SIZET,
-                                          frag_off, frag_len));
-                memcpy(msg + frag_off, ssl->in_msg + 12, frag_len);
+            /* The loop goes to its end iff the counter is wrapping */
+            if (i == mbedtls_ssl_ep_len(ssl)) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("incoming message counter would wrap"));
+                return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+            }
+        }
 
-                if (hs_buf->is_fragmented) {
-                    unsigned char * const bitmask = msg + msg_len;
-                    ssl_bitmask_set(bitmask, frag_off, frag_len);
-                    hs_buf->is_complete = (ssl_bitmask_check(bitmask,
-                                                             msg_len) == 0);
-                } else {
-                    hs_buf->is_complete = 1;
+    }
+
+#if defined(MBEDTLS_SSL_EARLY_DATA) && defined(MBEDTLS_SSL_SRV_C)
+    /*
+     * Although the server rejected early data because it needed to send an
+     * HelloRetryRequest message, it might receive early data as long as it has
+     * not received the client Finished message.
+     * The early data is encrypted with early keys and should be ignored as
+     * stated in section 4.2.10 of RFC 8446 (second case):
+     *
+     * "The server then ignores early data by skipping all records with an
+     * external content type of "application_data" (indicating that they are
+     * encrypted), up to the configured max_early_data_size. Ignore application
+     * data message before 2nd ClientHello when early_data was received in 1st
+     * ClientHello."
+     */
+    if (ssl->discard_early_data_record == MBEDTLS_SSL_EARLY_DATA_DISCARD) {
+        if (rec->type == MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+
+            ret = mbedtls_ssl_tls13_check_early_data_len(ssl, rec->data_len);
+            if (ret != 0) {
+                return ret;
+            }
+
+            MBEDTLS_SSL_DEBUG_MSG(
+                3, ("EarlyData: Ignore application message before 2nd ClientHello"));
+
+            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+        } else if (rec->type == MBEDTLS_SSL_MSG_HANDSHAKE) {
+            ssl->discard_early_data_record = MBEDTLS_SSL_EARLY_DATA_NO_DISCARD;
+        }
+    }
+#endif /* MBEDTLS_SSL_EARLY_DATA && MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        mbedtls_ssl_dtls_replay_update(ssl);
+    }
+#endif
+
+    /* Check actual (decrypted) record content length against
+     * configured maximum. */
+    if (rec->data_len > mbedtls_ssl_in_content_len(ssl)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad message length"));
+        return MBEDTLS_ERR_SSL_INVALID_RECORD;
+    }
+
+    MBEDTLS_SSL_STATS_INC(ssl, records_in);
+    MBEDTLS_SSL_STATS_ADD(ssl, bytes_in, rec->data_len);
+
+    return 0;
+}
+
+/*
+ * Read a record.
+ *
+ * Silently ignore non-fatal alert (and for DTLS, invalid records as well,
+ * RFC 6347 4.1.2.7) and continue reading until a valid record is found.
+ *
+ */
+
+/* Helper functions for mbedtls_ssl_read_record(). */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_consume_current_message(mbedtls_ssl_context *ssl);
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_get_next_record(mbedtls_ssl_context *ssl);
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_is_in_progress(mbedtls_ssl_context *ssl);
+
+int mbedtls_ssl_read_record(mbedtls_ssl_context *ssl,
+                            unsigned update_hs_digest)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read record"));
+
+    if (ssl->keep_current_message == 0) {
+        do {
+
+            ret = ssl_consume_current_message(ssl);
+            if (ret != 0) {
+                return ret;
+            }
+
+            if (ssl_record_is_in_progress(ssl) == 0) {
+                int dtls_have_buffered = 0;
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+
+                /* We only check for buffered messages if the
+                 * current datagram is fully consumed. */
+                if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+                    ssl_next_record_is_in_datagram(ssl) == 0) {
+                    if (ssl_load_buffered_message(ssl) == 0) {
+                        dtls_have_buffered = 1;
+                    }
+                }
+
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+                if (dtls_have_buffered == 0) {
+                    ret = ssl_get_next_record(ssl);
+                    if (ret == MBEDTLS_ERR_SSL_CONTINUE_PROCESSING) {
+                        continue;
+                    }
+
+                    if (ret != 0) {
+                        MBEDTLS_SSL_DEBUG_RET(1, ("ssl_get_next_record"), ret);
+                        return ret;
+                    }
+                }
+            }
+
+            ret = mbedtls_ssl_handle_message_type(ssl);
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+            if (ret == MBEDTLS_ERR_SSL_EARLY_MESSAGE) {
+                /* Buffer future message */
+                ret = ssl_buffer_message(ssl);
+                if (ret != 0) {
+                    return ret;
                 }
 
-                MBEDTLS_SSL_DEBUG_MSG(2, ("message %scomplete",
-                                          hs_buf->is_complete ? "" : "not yet "));
-            }
+                ret = MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+            }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+        } while (MBEDTLS_ERR_SSL_NON_FATAL           == ret  ||
+                 MBEDTLS_ERR_SSL_CONTINUE_PROCESSING == ret);
+
+        if (0 != ret) {
+            MBEDTLS_SSL_DEBUG_RET(1, ("mbedtls_ssl_handle_message_type"), ret);
+            return ret;
+        }
+
+        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE &&
+            update_hs_digest == 1) {
+            ret = mbedtls_ssl_update_handshake_status(ssl);
+            if (0 != ret) {
+                MBEDTLS_SSL_DEBUG_RET(1, ("mbedtls_ssl_update_handshake_status"), ret);
+                return ret;
+            }
+        }
+    } else {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("reuse previously read message"));
+        ssl->keep_current_message = 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read record"));
+
+    return 0;
+}
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_next_record_is_in_datagram(mbedtls_ssl_context *ssl)
+{
+    if (ssl->in_left > ssl->next_record_offset) {
+        return 1;
+    }
+
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_load_buffered_message(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    mbedtls_ssl_hs_buffer *hs_buf;
+    int ret = 0;
+
+    if (hs == NULL) {
+        return -1;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_load_buffered_message"));
+
+    if (ssl->state == MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC ||
+        ssl->state == MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
+        /* Check if we have seen a ChangeCipherSpec before.
+         * If yes, synthesize a CCS record. */
+        if (!hs->buffering.seen_ccs) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("CCS not seen in the current flight"));
+            ret = -1;
+            goto exit;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Injecting buffered CCS message"));
+        ssl->in_msgtype = MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC;
+        ssl->in_msglen = 1;
+        ssl->in_msg[0] = 1;
+
+        /* As long as they are equal, the exact value doesn't matter. */
+        ssl->in_left            = 0;
+        ssl->next_record_offset = 0;
+
+        hs->buffering.seen_ccs = 0;
+        goto exit;
+    }
+
+#if defined(MBEDTLS_DEBUG_C)
+    /* Debug only */
+    {
+        unsigned offset;
+        for (offset = 1; offset < MBEDTLS_SSL_MAX_BUFFERED_HS; offset++) {
+            hs_buf = &hs->buffering.hs[offset];
+            if (hs_buf->is_valid == 1) {
+                MBEDTLS_SSL_DEBUG_MSG(2, ("Future message with sequence number %u %s buffered.",
+                                          hs->in_msg_seq + offset,
+                                          hs_buf->is_complete ? "fully" : "partially"));
+            }
+        }
+    }
+#endif /* MBEDTLS_DEBUG_C */
+
+    /* Check if we have buffered and/or fully reassembled the
+     * next handshake message. */
+    hs_buf = &hs->buffering.hs[0];
+    if ((hs_buf->is_valid == 1) && (hs_buf->is_complete == 1)) {
+        /* Synthesize a record containing the buffered HS message. */
+        size_t msg_len = MBEDTLS_GET_UINT24_BE(hs_buf->data, 1);
+
+        /* Double-check that we haven't accidentally buffered
+         * a message that doesn't fit into the input buffer. */
+        if (msg_len + 12 > mbedtls_ssl_in_content_len(ssl)) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Next handshake message has been buffered - load"));
+        MBEDTLS_SSL_DEBUG_BUF(3, "Buffered handshake message (incl. header)",
+                              hs_buf->data, msg_len + 12);
+
+        ssl->in_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
+        ssl->in_hslen   = msg_len + 12;
+        ssl->in_msglen  = msg_len + 12;
+        memcpy(ssl->in_msg, hs_buf->data, ssl->in_hslen);
+
+        ret = 0;
+        goto exit;
+    } else {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Next handshake message %u not or only partially bufffered",
+                                  hs->in_msg_seq));
+    }
+
+    ret = -1;
+
+exit:
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_load_buffered_message"));
+    return ret;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_buffer_make_space(mbedtls_ssl_context *ssl,
+                                 size_t desired)
+{
+    int offset;
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    MBEDTLS_SSL_DEBUG_MSG(2, ("Attempt to free buffered messages to have %u bytes available",
+                              (unsigned) desired));
+
+    /* Get rid of future records epoch first, if such exist. */
+    if (hs->buffering.future_record.data != NULL) {
+        MBEDTLS_SSL_STATS_INC(ssl, buffered_dropped);
+    }
+    ssl_free_buffered_record(ssl);
+
+    /* Check if we have enough space available now. */
+    if (desired <= (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+                    hs->buffering.total_bytes_buffered)) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Enough space available after freeing future epoch record"));
+        return 0;
+    }
+
+    /* We don't have enough space to buffer the next expected handshake
+     * message. Remove buffers used for future messages to gain space,
+     * starting with the most distant one. */
+    for (offset = MBEDTLS_SSL_MAX_BUFFERED_HS - 1;
+         offset >= 0; offset--) {
+        MBEDTLS_SSL_DEBUG_MSG(2,
+                              (
+                                  "Free buffering slot %d to make space for reassembly of next handshake message",
+                                  offset));
+
+        if (hs->buffering.hs[offset].is_valid) {
+            MBEDTLS_SSL_STATS_INC(ssl, buffered_dropped);
+        }
+        ssl_buffering_free_slot(ssl, (uint8_t) offset);
+
+        /* Check if we have enough space available now. */
+        if (desired <= (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+                        hs->buffering.total_bytes_buffered)) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("Enough space available after freeing buffered HS messages"));
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_buffer_message(mbedtls_ssl_context *ssl)
+{
+    int ret = 0;
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+
+    if (hs == NULL) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_buffer_message"));
+
+    switch (ssl->in_msgtype) {
+        case MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC:
+            MBEDTLS_SSL_DEBUG_MSG(2, ("Remember CCS message"));
+
+            hs->buffering.seen_ccs = 1;
+            break;
+
+        case MBEDTLS_SSL_MSG_HANDSHAKE:
+        {
+            unsigned recv_msg_seq_offset;
+            unsigned recv_msg_seq = MBEDTLS_GET_UINT16_BE(ssl->in_msg, 4);
+            mbedtls_ssl_hs_buffer *hs_buf;
+            size_t msg_len = ssl->in_hslen - 12;
+
+            /* We should never receive an old handshake
+             * message - double-check nonetheless. */
+            if (recv_msg_seq < ssl->handshake->in_msg_seq) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+                return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            }
+
+            recv_msg_seq_offset = recv_msg_seq - ssl->handshake->in_msg_seq;
+            if (recv_msg_seq_offset >= MBEDTLS_SSL_MAX_BUFFERED_HS) {
+                /* Silently ignore -- message too far in the future */
+                MBEDTLS_SSL_DEBUG_MSG(2,
+                                      ("Ignore future HS message with sequence number %u, "
+                                       "buffering window %u - %u",
+                                       recv_msg_seq, ssl->handshake->in_msg_seq,
+                                       ssl->handshake->in_msg_seq + MBEDTLS_SSL_MAX_BUFFERED_HS -
+                                       1));
+
+                goto exit;
+            }
+
+            MBEDTLS_SSL_DEBUG_MSG(2, ("Buffering HS message with sequence number %u, offset %u ",
+                                      recv_msg_seq, recv_msg_seq_offset));
+
+            hs_buf = &hs->buffering.hs[recv_msg_seq_offset];
+
+            /* Check if the buffering for this seq nr has already commenced. */
+            if (!hs_buf->is_valid) {
+                size_t reassembly_buf_sz;
+
+                hs_buf->is_fragmented =
+                    (ssl_hs_is_proper_fragment(ssl) == 1);
+
+                /* We copy the message back into the input buffer
+                 * after reassembly, so check that it's not too large.
+                 * This is an implementation-specific limitation
+                 * and not one from the standard, hence it is not
+                 * checked in ssl_check_hs_header(). */
+                if (msg_len + 12 > mbedtls_ssl_in_content_len(ssl)) {
+                    /* Ignore message */
+                    goto exit;
+                }
+
+                /* Check if we have enough space to buffer the message. */
+                if (hs->buffering.total_bytes_buffered >
+                    MBEDTLS_SSL_DTLS_MAX_BUFFERING) {
+                    MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+                    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+                }
+
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+                reassembly_buf_sz = ssl_get_reassembly_buffer_size(msg_len, 0);
+#else
+                reassembly_buf_sz = ssl_get_reassembly_buffer_size(msg_len,
+                                                                   hs_buf->is_fragmented);
+#endif
+
+                if (reassembly_buf_sz > (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+                                         hs->buffering.total_bytes_buffered)) {
+                    if (recv_msg_seq_offset > 0) {
+                        /* If we can't buffer a future message because
+                         * of space limitations -- ignore. */
+                        MBEDTLS_SSL_DEBUG_MSG(2,
+                                              ("Buffering of future message of size %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " would exceed the compile-time limit %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " (already %" MBEDTLS_PRINTF_SIZET
+                                               " bytes buffered) -- ignore\n",
+                                               msg_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
+                                               hs->buffering.total_bytes_buffered));
+                        goto exit;
+                    } else {
+                        MBEDTLS_SSL_DEBUG_MSG(2,
+                                              ("Buffering of future message of size %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " would exceed the compile-time limit %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " (already %" MBEDTLS_PRINTF_SIZET
+                                               " bytes buffered) -- attempt to make space by freeing buffered future messages\n",
+                                               msg_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
+                                               hs->buffering.total_bytes_buffered));
+                    }
+
+                    if (ssl_buffer_make_space(ssl, reassembly_buf_sz) != 0) {
+                        MBEDTLS_SSL_DEBUG_MSG(2,
+                                              ("Reassembly of next message of size %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " (%" MBEDTLS_PRINTF_SIZET
+                                               " with bitmap) would exceed"
+                                               " the compile-time limit %"
+                                               MBEDTLS_PRINTF_SIZET
+                                               " (already %" MBEDTLS_PRINTF_SIZET
+                                               " bytes buffered) -- fail\n",
+                                               msg_len,
+                                               reassembly_buf_sz,
+                                               (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
+                                               hs->buffering.total_bytes_buffered));
+                        ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+                        goto exit;
+                    }
+                }
+
+                MBEDTLS_SSL_DEBUG_MSG(2,
+                                      ("initialize reassembly, total length = %"
+                                       MBEDTLS_PRINTF_SIZET,
+                                       msg_len));
+
+                hs_buf->data = ssl_buffering_alloc(hs, reassembly_buf_sz);
+                if (hs_buf->data == NULL) {
+                    ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+                    goto exit;
+                }
+                hs_buf->data_len = reassembly_buf_sz;
+
+                /* Prepare final header: copy msg_type, length and message_seq,
+                 * then add standardised fragment_offset and fragment_length */
+                memcpy(hs_buf->data, ssl->in_msg, 6);
+                memset(hs_buf->data + 6, 0, 3);
+                memcpy(hs_buf->data + 9, hs_buf->data + 1, 3);
+
+                hs_buf->is_valid = 1;
+            } else {
+                /* Make sure msg_type and length are consistent */
+                if (memcmp(hs_buf->data, ssl->in_msg, 4) != 0) {
+                    MBEDTLS_SSL_DEBUG_MSG(1, ("Fragment header mismatch - ignore"));
+                    /* Ignore */
+                    goto exit;
+                }
+            }
+
+            if (!hs_buf->is_complete) {
+                size_t frag_len, frag_off;
+                unsigned char * const msg = hs_buf->data + 12;
+
+                /*
+                 * Check and copy current fragment
+                 */
+
+                /* Validation of header fields already done in
+                 * mbedtls_ssl_prepare_handshake_record(). */
+                frag_off = ssl_get_hs_frag_off(ssl);
+                frag_len = ssl_get_hs_frag_len(ssl);
+
+                MBEDTLS_SSL_DEBUG_MSG(2, ("adding fragment, offset = %" MBEDTLS_PRINTF_SIZET
+                                          ", length = %" MBEDTLS_PRINTF_SIZET,
+                                          frag_off, frag_len));
+
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+                if (hs_buf->is_fragmented) {
+                    int complete = ssl_hs_ranges_add(hs_buf,
+                                                     (uint32_t) frag_off,
+                                                     (uint32_t) (frag_off + frag_len),
+                                                     (uint32_t) msg_len);
+                    if (complete < 0) {
+                        /* Wait for the retransmission of the flight. */
+                        MBEDTLS_SSL_DEBUG_MSG(2, ("Too many gaps in fragmented message - ignore"));
+                        goto exit;
+                    }
+                    hs_buf->is_complete = (complete == 1);
+                } else {
+                    hs_buf->is_complete = 1;
+                }
+                memcpy(msg + frag_off, ssl->in_msg + 12, frag_len);
+#else
+                memcpy(msg + frag_off, ssl->in_msg + 12, frag_len);
+
+                if (hs_buf->is_fragmented) {
+                    unsigned char * const bitmask = msg + msg_len;
+                    ssl_bitmask_set(bitmask, frag_off, frag_len);
+                    hs_buf->is_complete = (ssl_bitmask_check(bitmask,
+                                                             msg_len) == 0);
+                } else {
+                    hs_buf->is_complete = 1;
+                }
+#endif
+
+                MBEDTLS_SSL_DEBUG_MSG(2, ("message %scomplete",
+                                          hs_buf->is_complete ? "" : "not yet "));
+            }
+
+            break;
+        }
+
+        default:
+            /* We don't buffer other types of messages. */
+            break;
+    }
+
+exit:
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_buffer_message"));
+    return ret;
+}
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_consume_current_message(mbedtls_ssl_context *ssl)
+{
+    /*
+     * Consume last content-layer message and potentially
+     * update in_msglen which keeps track of the contents'
+     * consumption state.
+     *
+     * (1) Handshake messages:
+     *     Remove last handshake message, move content
+     *     and adapt in_msglen.
+     *
+     * (2) Alert messages:
+     *     Consume whole record content, in_msglen = 0.
+     *
+     * (3) Change cipher spec:
+     *     Consume whole record content, in_msglen = 0.
+     *
+     * (4) Application data:
+     *     Don't do anything - the record layer provides
+     *     the application data as a stream transport
+     *     and consumes through mbedtls_ssl_read only.
+     *
+     */
+
+    /* Case (1): Handshake messages */
+    if (ssl->in_hslen != 0) {
+        /* Hard assertion to be sure that no application data
+         * is in flight, as corrupting ssl->in_msglen during
+         * ssl->in_offt != NULL is fatal. */
+        if (ssl->in_offt != NULL) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
+        /*
+         * Get next Handshake message in the current record
+         */
+
+        /* Notes:
+         * (1) in_hslen is not necessarily the size of the
+         *     current handshake content: If DTLS handshake
+         *     fragmentation is used, that's the fragment
+         *     size instead. Using the total handshake message
+         *     size here is faulty and should be changed at
+         *     some point.
+         * (2) While it doesn't seem to cause problems, one
+         *     has to be very careful not to assume that in_hslen
+         *     is always <= in_msglen in a sensible communication.
+         *     Again, it's wrong for DTLS handshake fragmentation.
+         *     The following check is therefore mandatory, and
+         *     should not be treated as a silently corrected assertion.
+         *     Additionally, ssl->in_hslen might be arbitrarily out of
+         *     bounds after handling a DTLS message with an unexpected
+         *     sequence number, see mbedtls_ssl_prepare_handshake_record.
+         */
+        if (ssl->in_hslen < ssl->in_msglen) {
+            ssl->in_msglen -= ssl->in_hslen;
+            memmove(ssl->in_msg, ssl->in_msg + ssl->in_hslen,
+                    ssl->in_msglen);
+
+            MBEDTLS_SSL_DEBUG_BUF(4, "remaining content in record",
+                                  ssl->in_msg, ssl->in_msglen);
+        } else {
+            ssl->in_msglen = 0;
+        }
+
+        ssl->in_hslen   = 0;
+    }
+    /* Case (4): Application data */
+    else if (ssl->in_offt != NULL) {
+        return 0;
+    }
+    /* Everything else (CCS & Alerts) */
+    else {
+        ssl->in_msglen = 0;
+    }
+
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_record_is_in_progress(mbedtls_ssl_context *ssl)
+{
+    if (ssl->in_msglen > 0) {
+        return 1;
+    }
+
+    return 0;
+}
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+
+static void ssl_free_buffered_record(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    if (hs == NULL) {
+        return;
+    }
+
+    if (hs->buffering.future_record.data != NULL) {
+        ssl_buffering_release(hs, hs->buffering.future_record.data,
+                              hs->buffering.future_record.len);
+        hs->buffering.future_record.data = NULL;
+    }
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_load_buffered_record(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    unsigned char *rec;
+    size_t rec_len;
+    unsigned rec_epoch;
+    size_t in_buf_len = ssl->in_buf_len;
+    if (ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        return 0;
+    }
+
+    if (hs == NULL) {
+        return 0;
+    }
+
+    rec       = hs->buffering.future_record.data;
+    rec_len   = hs->buffering.future_record.len;
+    rec_epoch = hs->buffering.future_record.epoch;
+
+    if (rec == NULL) {
+        return 0;
+    }
+
+    /* Only consider loading future records if the
+     * input buffer is empty. */
+    if (ssl_next_record_is_in_datagram(ssl) == 1) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_load_buffered_record"));
+
+    if (rec_epoch != ssl->in_epoch) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Buffered record not from current epoch."));
+        goto exit;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("Found buffered record from current epoch - load"));
+
+    /* Double-check that the record is not too large */
+    if (rec_len > in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    memcpy(ssl->in_hdr, rec, rec_len);
+    ssl->in_left = rec_len;
+    ssl->next_record_offset = 0;
+
+    ssl_free_buffered_record(ssl);
+
+exit:
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_load_buffered_record"));
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_buffer_future_record(mbedtls_ssl_context *ssl,
+                                    mbedtls_record const *rec)
+{
+    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+
+    /* Don't buffer future records outside handshakes. */
+    if (hs == NULL) {
+        return 0;
+    }
+
+    /* Only buffer handshake records (we are only interested
+     * in Finished messages). */
+    if (rec->type != MBEDTLS_SSL_MSG_HANDSHAKE) {
+        return 0;
+    }
+
+    /* Don't buffer more than one future epoch record. */
+    if (hs->buffering.future_record.data != NULL) {
+        return 0;
+    }
+
+    /* Don't buffer record if there's not enough buffering space remaining. */
+    if (rec->buf_len > (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
+                        hs->buffering.total_bytes_buffered)) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("Buffering of future epoch record of size %" MBEDTLS_PRINTF_SIZET
+                                  " would exceed the compile-time limit %" MBEDTLS_PRINTF_SIZET
+                                  " (already %" MBEDTLS_PRINTF_SIZET
+                                  " bytes buffered) -- ignore\n",
+                                  rec->buf_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
+                                  hs->buffering.total_bytes_buffered));
+        return 0;
+    }
+
+    /* Buffer record */
+    MBEDTLS_SSL_DEBUG_MSG(2, ("Buffer record from epoch %u",
+                              ssl->in_epoch + 1U));
+    MBEDTLS_SSL_DEBUG_BUF(3, "Buffered record", rec->buf, rec->buf_len);
+
+    /* ssl_parse_record_header() only considers records
+     * of the next epoch as candidates for buffering. */
+    hs->buffering.future_record.epoch = ssl->in_epoch + 1;
+    hs->buffering.future_record.len   = rec->buf_len;
+
+    hs->buffering.future_record.data =
+        ssl_buffering_alloc(hs, hs->buffering.future_record.len);
+    if (hs->buffering.future_record.data == NULL) {
+        /* If we run out of RAM trying to buffer a
+         * record from the next epoch, just ignore. */
+        return 0;
+    }
+
+    memcpy(hs->buffering.future_record.data, rec->buf, rec->buf_len);
+
+    return 0;
+}
+
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+/*
+ * With MBEDTLS_SSL_FULL_DUPLEX, the context mutex serialises the calls on a
+ * context, except for a reader receiving a record, see ssl_read_app_record().
+ */
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_lock(mbedtls_ssl_context *ssl)
+{
+    if (mbedtls_mutex_lock(&ssl->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+    return 0;
+}
+
+static void ssl_unlock(mbedtls_ssl_context *ssl)
+{
+    (void) mbedtls_mutex_unlock(&ssl->mutex);
+}
+
+/* Release the mutex at the end of a read, unless getting it back failed */
+static void ssl_read_unlock(mbedtls_ssl_context *ssl)
+{
+    if (ssl->in_unlocked) {
+        ssl->in_unlocked = 0;
+    } else {
+        ssl_unlock(ssl);
+    }
+}
+#else
+MBEDTLS_CHECK_RETURN_CRITICAL
+static inline int ssl_lock(mbedtls_ssl_context *ssl)
+{
+    ((void) ssl);
+    return 0;
+}
+
+static inline void ssl_unlock(mbedtls_ssl_context *ssl)
+{
+    ((void) ssl);
+}
+
+static inline void ssl_read_unlock(mbedtls_ssl_context *ssl)
+{
+    ((void) ssl);
+}
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
+/*
+ * Report a record that failed authentication, from a reader that may not
+ * hold the mutex while a writer is sending.
+ */
+static void ssl_send_bad_record_mac(mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    if (ssl->in_unlocked) {
+        if (ssl_lock(ssl) == 0) {
+            mbedtls_ssl_send_alert_message(ssl,
+                                           MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                           MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
+            ssl_unlock(ssl);
+        }
+        return;
+    }
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
+
+    mbedtls_ssl_send_alert_message(ssl,
+                                   MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                   MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
+}
+#endif /* MBEDTLS_SSL_ALL_ALERT_MESSAGES */
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_get_next_record(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_record rec;
+
+#if defined(MBEDTLS_SSL_QUIC)
+    if (mbedtls_ssl_is_quic(ssl)) {
+        return mbedtls_ssl_quic_read_message(ssl);
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    /* We might have buffered a future record; if so,
+     * and if the epoch matches now, load it.
+     * On success, this call will set ssl->in_left to
+     * the length of the buffered record, so that
+     * the calls to ssl_fetch_input() below will
+     * essentially be no-ops. */
+    ret = ssl_load_buffered_record(ssl);
+    if (ret != 0) {
+        return ret;
+    }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+    /* Ensure that we have enough space available for the default form
+     * of TLS / DTLS record headers (5 Bytes for TLS, 13 Bytes for DTLS,
+     * with no space for CIDs counted in). */
+    ret = mbedtls_ssl_fetch_input(ssl, mbedtls_ssl_in_hdr_len(ssl));
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_fetch_input", ret);
+        return ret;
+    }
+
+    ret = ssl_parse_record_header(ssl, ssl->in_hdr, ssl->in_left, &rec);
+    if (ret != 0) {
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+            if (ret == MBEDTLS_ERR_SSL_EARLY_MESSAGE) {
+                ret = ssl_buffer_future_record(ssl, &rec);
+                if (ret != 0) {
+                    return ret;
+                }
+
+                /* Fall through to handling of unexpected records */
+                ret = MBEDTLS_ERR_SSL_UNEXPECTED_RECORD;
+            }
+
+            if (ret == MBEDTLS_ERR_SSL_UNEXPECTED_RECORD) {
+#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
+                /* Reset in pointers to default state for TLS/DTLS records,
+                 * assuming no CID and no offset between record content and
+                 * record plaintext. */
+                mbedtls_ssl_update_in_pointers(ssl);
+
+                /* Setup internal message pointers from record structure. */
+                ssl->in_msgtype = rec.type;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+                ssl->in_len = ssl->in_cid + rec.cid_len;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+                ssl->in_iv  = ssl->in_msg = ssl->in_len + 2;
+                ssl->in_msglen = rec.data_len;
+
+                ret = ssl_check_client_reconnect(ssl);
+                MBEDTLS_SSL_DEBUG_RET(2, "ssl_check_client_reconnect", ret);
+                if (ret != 0) {
+                    return ret;
+                }
+#endif
+
+                /* Skip unexpected record (but not whole datagram) */
+                ssl->next_record_offset = rec.buf_len;
+
+                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding unexpected record "
+                                          "(header)"));
+            } else {
+                /* Skip invalid record and the rest of the datagram */
+                ssl->next_record_offset = 0;
+                ssl->in_left = 0;
+
+                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding invalid record "
+                                          "(header)"));
+            }
+
+            /* Get next record */
+            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+        } else
+#endif
+        {
+            return ret;
+        }
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        /* Remember offset of next record within datagram. */
+        ssl->next_record_offset = rec.buf_len;
+        if (ssl->next_record_offset < ssl->in_left) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("more than one record within datagram"));
+        }
+    } else
+#endif
+    {
+        /*
+         * Fetch record contents from underlying transport.
+         */
+        ret = mbedtls_ssl_fetch_input(ssl, rec.buf_len);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_fetch_input", ret);
+            return ret;
+        }
+
+        /* The record may have been moved to the start of the buffer. */
+        rec.buf = ssl->in_hdr;
+
+        /* Keep any data read ahead beyond this record for the next call
+         * to mbedtls_ssl_fetch_input(). */
+        if (ssl->in_left > rec.buf_len) {
+            ssl->in_ahead_offset = rec.buf_len;
+            ssl->in_ahead_len = ssl->in_left - rec.buf_len;
+        }
+
+        ssl->in_left = 0;
+    }
+
+    /*
+     * Decrypt record contents.
+     */
+
+    if ((ret = ssl_prepare_record_content(ssl, &rec)) != 0) {
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+            /* Silently discard invalid records */
+            if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
+                /* Except when waiting for Finished as a bad mac here
+                 * probably means something went wrong in the handshake
+                 * (eg wrong psk used, mitm downgrade attempt, etc.) */
+                if (ssl->state == MBEDTLS_SSL_CLIENT_FINISHED ||
+                    ssl->state == MBEDTLS_SSL_SERVER_FINISHED) {
+#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
+                    if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
+                        mbedtls_ssl_send_alert_message(ssl,
+                                                       MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                                       MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
+                    }
+#endif
+                    return ret;
+                }
+
+                if (ssl->conf->badmac_limit != 0 &&
+                    ++ssl->badmac_seen >= ssl->conf->badmac_limit) {
+                    MBEDTLS_SSL_DEBUG_MSG(1, ("too many records with bad MAC"));
+                    return MBEDTLS_ERR_SSL_INVALID_MAC;
+                }
+
+                /* As above, invalid records cause
+                 * dismissal of the whole datagram. */
+
+                ssl->next_record_offset = 0;
+                ssl->in_left = 0;
+
+                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding invalid record (mac)"));
+                return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+            }
+
+            return ret;
+        } else
+#endif
+        {
+            /* Error out (and send alert) on invalid records */
+#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
+            if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
+                ssl_send_bad_record_mac(ssl);
+            }
+#endif
+            return ret;
+        }
+    }
+
+
+    /* Reset in pointers to default state for TLS/DTLS records,
+     * assuming no CID and no offset between record content and
+     * record plaintext. */
+    mbedtls_ssl_update_in_pointers(ssl);
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    ssl->in_len = ssl->in_cid + rec.cid_len;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    ssl->in_iv  = ssl->in_len + 2;
+
+    /* The record content type may change during decryption,
+     * so re-read it. */
+    ssl->in_msgtype = rec.type;
+    /* Also update the input buffer, because unfortunately
+     * the server-side ssl_parse_client_hello() reparses the
+     * record header when receiving a ClientHello initiating
+     * a renegotiation. */
+    ssl->in_hdr[0] = rec.type;
+    ssl->in_msg    = rec.buf + rec.data_offset;
+    ssl->in_msglen = rec.data_len;
+    MBEDTLS_PUT_UINT16_BE(rec.data_len, ssl->in_len, 0);
+
+    return 0;
+}
+
+int mbedtls_ssl_handle_message_type(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    /*
+     * Handle particular types of records
+     */
+    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE) {
+        if ((ret = mbedtls_ssl_prepare_handshake_record(ssl)) != 0) {
+            return ret;
+        }
+    }
+
+    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
+        if (ssl->in_msglen != 1) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid CCS message, len: %" MBEDTLS_PRINTF_SIZET,
+                                      ssl->in_msglen));
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+
+        if (ssl->in_msg[0] != 1) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid CCS message, content: %02x",
+                                      ssl->in_msg[0]));
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+            ssl->state != MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC    &&
+            ssl->state != MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
+            if (ssl->handshake == NULL) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("dropping ChangeCipherSpec outside handshake"));
+                return MBEDTLS_ERR_SSL_UNEXPECTED_RECORD;
+            }
+
+            MBEDTLS_SSL_DEBUG_MSG(1, ("received out-of-order ChangeCipherSpec - remember"));
+            return MBEDTLS_ERR_SSL_EARLY_MESSAGE;
+        }
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+            MBEDTLS_SSL_DEBUG_MSG(2,
+                                  ("Ignore ChangeCipherSpec in TLS 1.3 compatibility mode"));
+            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
+        }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+    }
+
+    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_ALERT) {
+        if (ssl->in_msglen != 2) {
+            /* Note: Standard allows for more than one 2 byte alert
+               to be packed in a single message, but Mbed TLS doesn't
+               currently support this. */
+            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid alert message, len: %" MBEDTLS_PRINTF_SIZET,
+                                      ssl->in_msglen));
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("got an alert message, type: [%u:%u]",
+                                  ssl->in_msg[0], ssl->in_msg[1]));
+
+        /*
+         * Ignore non-fatal alerts, except close_notify and no_renegotiation
+         */
+        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_FATAL) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("is a fatal alert message (msg %d)",
+                                      ssl->in_msg[1]));
+            return MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE;
+        }
+
+        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_WARNING &&
+            ssl->in_msg[1] == MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("is a close notify message"));
+            return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+        }
+
+#if defined(MBEDTLS_SSL_RENEGOTIATION_ENABLED)
+        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_WARNING &&
+            ssl->in_msg[1] == MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("is a no renegotiation alert"));
+            /* Will be handled when trying to parse ServerHello */
+            return 0;
+        }
+#endif
+        /* Silently ignore: fetch new message */
+        return MBEDTLS_ERR_SSL_NON_FATAL;
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        /* Drop unexpected ApplicationData records,
+         * except at the beginning of renegotiations */
+        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_APPLICATION_DATA &&
+            mbedtls_ssl_is_handshake_over(ssl) == 0
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+            && !(ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_IN_PROGRESS &&
+                 ssl->state == MBEDTLS_SSL_SERVER_HELLO)
+#endif
+            ) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("dropping unexpected ApplicationData"));
+            return MBEDTLS_ERR_SSL_NON_FATAL;
+        }
+
+        if (ssl->handshake != NULL &&
+            mbedtls_ssl_is_handshake_over(ssl) == 1) {
+            mbedtls_ssl_handshake_wrapup_free_hs_transform(ssl);
+        }
+    }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+    return 0;
+}
+
+int mbedtls_ssl_send_fatal_handshake_failure(mbedtls_ssl_context *ssl)
+{
+    return mbedtls_ssl_send_alert_message(ssl,
+                                          MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                          MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE);
+}
+
+int mbedtls_ssl_send_alert_message(mbedtls_ssl_context *ssl,
+                                   unsigned char level,
+                                   unsigned char message)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_TX) {
+        unsigned char alert[2];
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("send alert level=%u message=%u (kTLS)",
+                                  level, message));
+
+        alert[0] = level;
+        alert[1] = message;
+        ret = ssl->f_ktls_send_record(ssl->p_ktls_send_record,
+                                      MBEDTLS_SSL_MSG_ALERT,
+                                      alert, sizeof(alert));
+        if (ret < 0) {
+            return ret;
+        }
+        if (ret != (int) sizeof(alert)) {
+            return MBEDTLS_ERR_SSL_WANT_WRITE;
+        }
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+    if (mbedtls_ssl_is_quic(ssl)) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("send alert level=%u message=%u (QUIC)",
+                                  level, message));
+        return ssl->f_quic_alert(ssl->p_quic,
+                                 mbedtls_ssl_quic_write_level(ssl), message);
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
+    if ((ret = mbedtls_ssl_acquire_buffers(ssl)) != 0) {
+        return ret;
+    }
+
+    if (ssl->out_left != 0) {
+        return mbedtls_ssl_flush_output(ssl);
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> send alert message"));
+    MBEDTLS_SSL_DEBUG_MSG(3, ("send alert level=%u message=%u", level, message));
+
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_ALERT;
+    ssl->out_msglen = 2;
+    ssl->out_msg[0] = level;
+    ssl->out_msg[1] = message;
+
+    if ((ret = mbedtls_ssl_write_record(ssl, SSL_FORCE_FLUSH)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
+        return ret;
+    }
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= send alert message"));
+
+    return 0;
+}
+
+int mbedtls_ssl_write_change_cipher_spec(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> write change cipher spec"));
+
+    ssl->out_msgtype = MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC;
+    ssl->out_msglen  = 1;
+    ssl->out_msg[0]  = 1;
+
+    ssl->state++;
+
+    if ((ret = mbedtls_ssl_write_handshake_msg(ssl)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_handshake_msg", ret);
+        return ret;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= write change cipher spec"));
+
+    return 0;
+}
+
+int mbedtls_ssl_parse_change_cipher_spec(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> parse change cipher spec"));
+
+    if ((ret = mbedtls_ssl_read_record(ssl, 1)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
+        return ret;
+    }
+
+    if (ssl->in_msgtype != MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad change cipher spec message"));
+        mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                       MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE);
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    }
+
+    /* CCS records are only accepted if they have length 1 and content '1',
+     * so we don't need to check this here. */
+
+    /*
+     * Switch to our negotiated transform and session parameters for inbound
+     * data.
+     */
+    MBEDTLS_SSL_DEBUG_MSG(3, ("switching to new transform spec for inbound data"));
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    ssl->transform_in = ssl->transform_negotiate;
+#endif
+    ssl->session_in = ssl->session_negotiate;
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
+        mbedtls_ssl_dtls_replay_reset(ssl);
+#endif
+
+        /* Increment epoch */
+        if (++ssl->in_epoch == 0) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("DTLS epoch would wrap"));
+            /* This is highly unlikely to happen for legitimate reasons, so
+               treat it as an attack and don't send an alert. */
+            return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+        }
+    } else
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+    memset(ssl->in_ctr, 0, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+
+    mbedtls_ssl_update_in_pointers(ssl);
+
+    ssl->state++;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= parse change cipher spec"));
+
+    return 0;
+}
+
+/* Once ssl->out_hdr as the address of the beginning of the
+ * next outgoing record is set, deduce the other pointers.
+ *
+ * Note: For TLS, we save the implicit record sequence number
+ *       (entering MAC computation) in the 8 bytes before ssl->out_hdr,
+ *       and the caller has to make sure there's space for this.
+ */
+
+static size_t ssl_transform_get_explicit_iv_len(
+    mbedtls_ssl_transform const *transform)
+{
+    return transform->ivlen - transform->fixed_ivlen;
+}
+
+void mbedtls_ssl_update_out_pointers(mbedtls_ssl_context *ssl,
+                                     mbedtls_ssl_transform *transform)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        ssl->out_ctr = ssl->out_hdr +  3;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        ssl->out_cid = ssl->out_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+        ssl->out_len = ssl->out_cid;
+        if (transform != NULL) {
+            ssl->out_len += transform->out_cid_len;
+        }
+#else /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+        ssl->out_len = ssl->out_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+        ssl->out_iv  = ssl->out_len + 2;
+    } else
+#endif
+    {
+        ssl->out_len = ssl->out_hdr + 3;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        ssl->out_cid = ssl->out_len;
+#endif
+        ssl->out_iv  = ssl->out_hdr + 5;
+    }
+
+    ssl->out_msg = ssl->out_iv;
+    /* Adjust out_msg to make space for explicit IV, if used. */
+    if (transform != NULL) {
+        ssl->out_msg += ssl_transform_get_explicit_iv_len(transform);
+    }
+}
+
+/* Once ssl->in_hdr as the address of the beginning of the
+ * next incoming record is set, deduce the other pointers.
+ *
+ * Note: For TLS, we save the implicit record sequence number
+ *       (entering MAC computation) in the 8 bytes before ssl->in_hdr,
+ *       and the caller has to make sure there's space for this.
+ */
+
+void mbedtls_ssl_update_in_pointers(mbedtls_ssl_context *ssl)
+{
+    /* This function sets the pointers to match the case
+     * of unprotected TLS/DTLS records, with both  ssl->in_iv
+     * and ssl->in_msg pointing to the beginning of the record
+     * content.
+     *
+     * When decrypting a protected record, ssl->in_msg
+     * will be shifted to point to the beginning of the
+     * record plaintext.
+     */
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        /* This sets the header pointers to match records
+         * without CID. When we receive a record containing
+         * a CID, the fields are shifted accordingly in
+         * ssl_parse_record_header(). */
+        ssl->in_ctr = ssl->in_hdr +  3;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        ssl->in_cid = ssl->in_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+        ssl->in_len = ssl->in_cid; /* Default: no CID */
+#else /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+        ssl->in_len = ssl->in_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+        ssl->in_iv  = ssl->in_len + 2;
+    } else
+#endif
+    {
+        /* The incoming sequence number stays at the start of the buffer
+         * while ssl->in_hdr moves through data read ahead. */
+        ssl->in_ctr = ssl->in_buf;
+        ssl->in_len = ssl->in_hdr + 3;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+        ssl->in_cid = ssl->in_len;
+#endif
+        ssl->in_iv  = ssl->in_hdr + 5;
+    }
+
+    /* This will be adjusted at record decryption time. */
+    ssl->in_msg = ssl->in_iv;
+}
+
+/*
+ * Setup an SSL context
+ */
+
+void mbedtls_ssl_reset_in_out_pointers(mbedtls_ssl_context *ssl)
+{
+    /* Set the incoming and outgoing record pointers. */
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        ssl->out_hdr = ssl->out_buf;
+        ssl->in_hdr  = ssl->in_buf;
+    } else
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+    {
+        ssl->out_ctr = ssl->out_buf;
+        ssl->out_hdr = ssl->out_buf + 8;
+        ssl->in_hdr  = ssl->in_buf  + 8;
+    }
+
+    /* Derive other internal pointers. */
+    mbedtls_ssl_update_out_pointers(ssl, NULL /* no transform enabled */);
+    mbedtls_ssl_update_in_pointers(ssl);
+}
+
+/*
+ * SSL get accessors
+ */
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl)
+{
+    return ssl->in_offt == NULL ? 0 : ssl->in_msglen;
+}
+
+size_t mbedtls_ssl_get_bytes_unsent(const mbedtls_ssl_context *ssl)
+{
+    return ssl->out_left;
+}
+
+int mbedtls_ssl_check_pending(const mbedtls_ssl_context *ssl)
+{
+    /*
+     * Case A: We're currently holding back
+     * a message for further processing.
+     */
+
+    if (ssl->keep_current_message == 1) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: record held back for processing"));
+        return 1;
+    }
+
+    /*
+     * Case B: Further records are pending in the current datagram.
+     */
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+        ssl->in_left > ssl->next_record_offset) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: more records within current datagram"));
+        return 1;
+    }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+    /*
+     * Case C: A handshake message is being processed.
+     */
+
+    if (ssl->in_hslen > 0 && ssl->in_hslen < ssl->in_msglen) {
+        MBEDTLS_SSL_DEBUG_MSG(3,
+                              ("ssl_check_pending: more handshake messages within current record"));
+        return 1;
+    }
+
+    /*
+     * Case D: An application data message is being processed
+     */
+    if (ssl->in_offt != NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: application data record is being processed"));
+        return 1;
+    }
+
+    /*
+     * Case E: Data beyond the current record was read ahead (TLS).
+     */
+
+    if (ssl->in_ahead_len != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: more data read ahead"));
+        return 1;
+    }
+
+    /*
+     * In all other cases, the rest of the message can be dropped.
+     * As in ssl_get_next_record, this needs to be adapted if
+     * we implement support for multiple alerts in single records.
+     */
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: nothing pending"));
+    return 0;
+}
+
+
+int mbedtls_ssl_get_record_expansion(const mbedtls_ssl_context *ssl)
+{
+    size_t transform_expansion = 0;
+    const mbedtls_ssl_transform *transform = ssl->transform_out;
+    unsigned block_size;
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_key_attributes_t attr = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_type_t key_type;
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    size_t out_hdr_len = mbedtls_ssl_out_hdr_len(ssl);
+
+    if (transform == NULL) {
+        return (int) out_hdr_len;
+    }
+
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    if (transform->psa_alg == PSA_ALG_GCM ||
+        transform->psa_alg == PSA_ALG_CCM ||
+        transform->psa_alg == PSA_ALG_AEAD_WITH_SHORTENED_TAG(PSA_ALG_CCM, 8) ||
+        transform->psa_alg == PSA_ALG_CHACHA20_POLY1305 ||
+        transform->psa_alg == MBEDTLS_SSL_NULL_CIPHER) {
+        transform_expansion = transform->minlen;
+    } else if (transform->psa_alg == PSA_ALG_CBC_NO_PADDING) {
+        (void) psa_get_key_attributes(transform->psa_key_enc, &attr);
+        key_type = psa_get_key_type(&attr);
+
+        block_size = PSA_BLOCK_CIPHER_BLOCK_LENGTH(key_type);
+
+        /* Expansion due to the addition of the MAC. */
+        transform_expansion += transform->maclen;
+
+        /* Expansion due to the addition of CBC padding;
+         * Theoretically up to 256 bytes, but we never use
+         * more than the block size of the underlying cipher. */
+        transform_expansion += block_size;
+
+        /* For TLS 1.2 or higher, an explicit IV is added
+         * after the record header. */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        transform_expansion += block_size;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    } else {
+        MBEDTLS_SSL_DEBUG_MSG(1,
+                              ("Unsupported psa_alg spotted in mbedtls_ssl_get_record_expansion()"));
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+#else
+    switch (mbedtls_cipher_get_cipher_mode(&transform->cipher_ctx_enc)) {
+        case MBEDTLS_MODE_GCM:
+        case MBEDTLS_MODE_CCM:
+        case MBEDTLS_MODE_CHACHAPOLY:
+        case MBEDTLS_MODE_STREAM:
+            transform_expansion = transform->minlen;
+            break;
+
+        case MBEDTLS_MODE_CBC:
+
+            block_size = mbedtls_cipher_get_block_size(
+                &transform->cipher_ctx_enc);
+
+            /* Expansion due to the addition of the MAC. */
+            transform_expansion += transform->maclen;
+
+            /* Expansion due to the addition of CBC padding;
+             * Theoretically up to 256 bytes, but we never use
+             * more than the block size of the underlying cipher. */
+            transform_expansion += block_size;
+
+            /* For TLS 1.2 or higher, an explicit IV is added
+             * after the record header. */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+            transform_expansion += block_size;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
             break;
-        }
 
         default:
-            /* We don't buffer other types of messages. */
-            break;
+            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-exit:
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    if (transform->out_cid_len != 0) {
+        transform_expansion += MBEDTLS_SSL_MAX_CID_EXPANSION;
+    }
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_buffer_message"));
-    return ret;
+    return (int) (out_hdr_len + transform_expansion);
 }
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
 
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+/*
+ * Check record counters and renegotiate if they're above the limit.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_consume_current_message(mbedtls_ssl_context *ssl)
+static int ssl_check_ctr_renegotiate(mbedtls_ssl_context *ssl)
 {
-    /*
-     * Consume last content-layer message and potentially
-     * update in_msglen which keeps track of the contents'
-     * consumption state.
-     *
-     * (1) Handshake messages:
-     *     Remove last handshake message, move content
-     *     and adapt in_msglen.
-     *
-     * (2) Alert messages:
-     *     Consume whole record content, in_msglen = 0.
-     *
-     * (3) Change cipher spec:
-     *     Consume whole record content, in_msglen = 0.
-     *
-     * (4) Application data:
-     *     Don't do anything - the record layer provides
-     *     the application data as a stream transport
-     *     and consumes through mbedtls_ssl_read only.
-     *
-     */
-
-    /* Case (1): Handshake messages */
-    if (ssl->in_hslen != 0) {
-        /* Hard assertion to be sure that no application data
-         * is in flight, as corrupting ssl->in_msglen during
-         * ssl->in_offt != NULL is fatal. */
-        if (ssl->in_offt != NULL) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-        }
-
-        /*
-         * Get next Handshake message in the current record
-         */
-
-        /* Notes:
-         * (1) in_hslen is not necessarily the size of the
-         *     current handshake content: If DTLS handshake
-         *     fragmentation is used, that's the fragment
-         *     size instead. Using the total handshake message
-         *     size here is faulty and should be changed at
-         *     some point.
-         * (2) While it doesn't seem to cause problems, one
-         *     has to be very careful not to assume that in_hslen
-         *     is always <= in_msglen in a sensible communication.
-         *     Again, it's wrong for DTLS handshake fragmentation.
-         *     The following check is therefore mandatory, and
-         *     should not be treated as a silently corrected assertion.
-         *     Additionally, ssl->in_hslen might be arbitrarily out of
-         *     bounds after handling a DTLS message with an unexpected
-         *     sequence number, see mbedtls_ssl_prepare_handshake_record.
-         */
-        if (ssl->in_hslen < ssl->in_msglen) {
-            ssl->in_msglen -= ssl->in_hslen;
-            memmove(ssl->in_msg, ssl->in_msg + ssl->in_hslen,
-                    ssl->in_msglen);
-
-            MBEDTLS_SSL_DEBUG_BUF(4, "remaining content in record",
-                                  ssl->in_msg, ssl->in_msglen);
-        } else {
-            ssl->in_msglen = 0;
-        }
+    size_t ep_len = mbedtls_ssl_ep_len(ssl);
+    int in_ctr_cmp;
+    int out_ctr_cmp;
 
-        ssl->in_hslen   = 0;
-    }
-    /* Case (4): Application data */
-    else if (ssl->in_offt != NULL) {
+    if (mbedtls_ssl_is_handshake_over(ssl) == 0 ||
+        ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING ||
+        ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED) {
         return 0;
     }
-    /* Everything else (CCS & Alerts) */
-    else {
-        ssl->in_msglen = 0;
-    }
 
-    return 0;
-}
+    in_ctr_cmp = memcmp(ssl->in_ctr + ep_len,
+                        &ssl->conf->renego_period[ep_len],
+                        MBEDTLS_SSL_SEQUENCE_NUMBER_LEN - ep_len);
+    out_ctr_cmp = memcmp(&ssl->cur_out_ctr[ep_len],
+                         &ssl->conf->renego_period[ep_len],
+                         sizeof(ssl->cur_out_ctr) - ep_len);
 
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_record_is_in_progress(mbedtls_ssl_context *ssl)
-{
-    if (ssl->in_msglen > 0) {
-        return 1;
+    if (in_ctr_cmp <= 0 && out_ctr_cmp <= 0) {
+        return 0;
     }
 
-    return 0;
+    MBEDTLS_SSL_DEBUG_MSG(1, ("record counter limit reached: renegotiate"));
+    return mbedtls_ssl_renegotiate(ssl);
 }
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
 
-static void ssl_free_buffered_record(mbedtls_ssl_context *ssl)
+#if defined(MBEDTLS_SSL_CLI_C)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_is_new_session_ticket(mbedtls_ssl_context *ssl)
 {
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
-    if (hs == NULL) {
-        return;
-    }
-
-    if (hs->buffering.future_record.data != NULL) {
-        hs->buffering.total_bytes_buffered -=
-            hs->buffering.future_record.len;
 
-        mbedtls_free(hs->buffering.future_record.data);
-        hs->buffering.future_record.data = NULL;
+    if ((ssl->in_hslen == mbedtls_ssl_hs_hdr_len(ssl)) ||
+        (ssl->in_msg[0] != MBEDTLS_SSL_HS_NEW_SESSION_TICKET)) {
+        return 0;
     }
+
+    return 1;
 }
+#endif /* MBEDTLS_SSL_CLI_C */
 
+/*
+ * KeyUpdate, RFC 8446 section 4.6.3
+ *
+ *     enum {
+ *         update_not_requested(0), update_requested(1), (255)
+ *     } KeyUpdateRequest;
+ *
+ *     struct {
+ *         KeyUpdateRequest request_update;
+ *     } KeyUpdate;
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_load_buffered_record(mbedtls_ssl_context *ssl)
+static int ssl_tls13_parse_key_update(mbedtls_ssl_context *ssl)
 {
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
-    unsigned char *rec;
-    size_t rec_len;
-    unsigned rec_epoch;
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-    size_t in_buf_len = ssl->in_buf_len;
-#else
-    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
-#endif
-    if (ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        return 0;
-    }
-
-    if (hs == NULL) {
-        return 0;
-    }
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const size_t hs_hdr_len = mbedtls_ssl_hs_hdr_len(ssl);
+    unsigned char request_update;
 
-    rec       = hs->buffering.future_record.data;
-    rec_len   = hs->buffering.future_record.len;
-    rec_epoch = hs->buffering.future_record.epoch;
+    MBEDTLS_SSL_DEBUG_MSG(3, ("KeyUpdate received"));
 
-    if (rec == NULL) {
-        return 0;
+    if (ssl->in_hslen != hs_hdr_len + 1) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
     }
 
-    /* Only consider loading future records if the
-     * input buffer is empty. */
-    if (ssl_next_record_is_in_datagram(ssl) == 1) {
-        return 0;
+    /* The next record is protected with the next key, so the KeyUpdate
+     * must be the last message of its record. */
+    if (ssl->in_msglen != ssl->in_hslen) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("KeyUpdate not at the end of a record"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE,
+                                     MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE);
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> ssl_load_buffered_record"));
-
-    if (rec_epoch != ssl->in_epoch) {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Buffered record not from current epoch."));
-        goto exit;
+    request_update = ssl->in_msg[hs_hdr_len];
+    if (request_update != MBEDTLS_SSL_TLS1_3_KEY_UPDATE_NOT_REQUESTED &&
+        request_update != MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("Found buffered record from current epoch - load"));
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions != 0) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
 
-    /* Double-check that the record is not too large */
-    if (rec_len > in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf)) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    ret = mbedtls_ssl_tls13_update_application_keys(ssl, 0);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_update_application_keys", ret);
+        return ret;
     }
 
-    memcpy(ssl->in_hdr, rec, rec_len);
-    ssl->in_left = rec_len;
-    ssl->next_record_offset = 0;
+    ssl->key_update &= (unsigned char) ~MBEDTLS_SSL_KEY_UPDATE_AWAITING;
 
-    ssl_free_buffered_record(ssl);
+    /* Answer before sending more application data, without requesting an
+     * update in turn. */
+    if (request_update == MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED) {
+        ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_SEND;
+    }
 
-exit:
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= ssl_load_buffered_record"));
     return 0;
 }
 
+/*
+ * Send the pending KeyUpdate, if any, then switch to the next sending key.
+ *
+ * ssl_write_real_iov() takes a non-empty output buffer for the remains of the
+ * previous application data write, so the KeyUpdate waits until that is
+ * sent, and its own flush is completed here before anything else is written.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_buffer_future_record(mbedtls_ssl_context *ssl,
-                                    mbedtls_record const *rec)
+static int ssl_tls13_write_key_update(mbedtls_ssl_context *ssl)
 {
-    mbedtls_ssl_handshake_params * const hs = ssl->handshake;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const size_t hs_hdr_len = mbedtls_ssl_hs_hdr_len(ssl);
 
-    /* Don't buffer future records outside handshakes. */
-    if (hs == NULL) {
-        return 0;
-    }
+    if ((ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_FLUSH) == 0) {
+        if ((ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_SEND) == 0 ||
+            ssl->out_left != 0) {
+            return 0;
+        }
 
-    /* Only buffer handshake records (we are only interested
-     * in Finished messages). */
-    if (rec->type != MBEDTLS_SSL_MSG_HANDSHAKE) {
-        return 0;
+        MBEDTLS_SSL_DEBUG_MSG(2, ("=> write KeyUpdate"));
+
+        ssl->out_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
+        ssl->out_msg[0] = MBEDTLS_SSL_HS_KEY_UPDATE;
+        ssl->out_msg[hs_hdr_len] =
+            (ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_REQUEST) != 0 ?
+            MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED :
+            MBEDTLS_SSL_TLS1_3_KEY_UPDATE_NOT_REQUESTED;
+        ssl->out_msglen = hs_hdr_len + 1;
+
+        /* Protected with the current key, and kept in the output buffer. */
+        ret = mbedtls_ssl_write_handshake_msg_ext(ssl, 0, 0);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_handshake_msg_ext", ret);
+            return ret;
+        }
+
+        if ((ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_REQUEST) != 0) {
+            ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_AWAITING;
+        }
+        ssl->key_update = (unsigned char) ((ssl->key_update &
+                                            MBEDTLS_SSL_KEY_UPDATE_AWAITING) |
+                                           MBEDTLS_SSL_KEY_UPDATE_FLUSH);
+
+        ret = mbedtls_ssl_tls13_update_application_keys(ssl, 1);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_update_application_keys",
+                                  ret);
+            return ret;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("<= write KeyUpdate"));
     }
 
-    /* Don't buffer more than one future epoch record. */
-    if (hs->buffering.future_record.data != NULL) {
-        return 0;
+    if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+        return ret;
     }
 
-    /* Don't buffer record if there's not enough buffering space remaining. */
-    if (rec->buf_len > (MBEDTLS_SSL_DTLS_MAX_BUFFERING -
-                        hs->buffering.total_bytes_buffered)) {
-        MBEDTLS_SSL_DEBUG_MSG(2, ("Buffering of future epoch record of size %" MBEDTLS_PRINTF_SIZET
-                                  " would exceed the compile-time limit %" MBEDTLS_PRINTF_SIZET
-                                  " (already %" MBEDTLS_PRINTF_SIZET
-                                  " bytes buffered) -- ignore\n",
-                                  rec->buf_len, (size_t) MBEDTLS_SSL_DTLS_MAX_BUFFERING,
-                                  hs->buffering.total_bytes_buffered));
+    ssl->key_update &= (unsigned char) ~MBEDTLS_SSL_KEY_UPDATE_FLUSH;
+
+    return 0;
+}
+
+/*
+ * Check record counters against the key update limit, and send the
+ * pending KeyUpdate. The incoming counter is only checked when reading,
+ * as a concurrent reader may be updating it with MBEDTLS_SSL_FULL_DUPLEX.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_check_key_update(mbedtls_ssl_context *ssl, int reading)
+{
+    const uint32_t limit = ssl->conf->tls13_key_update_records;
+
+    if (ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+        mbedtls_ssl_is_handshake_over(ssl) == 0 ||
+        ssl->transform_application == NULL) {
         return 0;
     }
 
-    /* Buffer record */
-    MBEDTLS_SSL_DEBUG_MSG(2, ("Buffer record from epoch %u",
-                              ssl->in_epoch + 1U));
-    MBEDTLS_SSL_DEBUG_BUF(3, "Buffered record", rec->buf, rec->buf_len);
-
-    /* ssl_parse_record_header() only considers records
-     * of the next epoch as candidates for buffering. */
-    hs->buffering.future_record.epoch = ssl->in_epoch + 1;
-    hs->buffering.future_record.len   = rec->buf_len;
-
-    hs->buffering.future_record.data =
-        mbedtls_calloc(1, hs->buffering.future_record.len);
-    if (hs->buffering.future_record.data == NULL) {
-        /* If we run out of RAM trying to buffer a
-         * record from the next epoch, just ignore. */
+#if defined(MBEDTLS_SSL_KTLS)
+    /* The kernel cannot switch keys in the middle of the connection. */
+    if (ssl->ktls_directions != 0) {
         return 0;
     }
+#endif /* MBEDTLS_SSL_KTLS */
 
-    memcpy(hs->buffering.future_record.data, rec->buf, rec->buf_len);
+    if (limit != 0) {
+        if (MBEDTLS_GET_UINT64_BE(ssl->cur_out_ctr, 0) >= limit) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("record limit reached: update sending key"));
+            ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_SEND;
+        }
+        if (reading &&
+            (ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_AWAITING) == 0 &&
+            MBEDTLS_GET_UINT64_BE(ssl->in_ctr, 0) >= limit) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("record limit reached: request key update"));
+            ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_SEND |
+                               MBEDTLS_SSL_KEY_UPDATE_REQUEST;
+        }
+    }
 
-    hs->buffering.total_bytes_buffered += rec->buf_len;
-    return 0;
+    return ssl_tls13_write_key_update(ssl);
 }
 
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
-
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_get_next_record(mbedtls_ssl_context *ssl)
+int mbedtls_ssl_tls13_key_update(mbedtls_ssl_context *ssl, int request)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    mbedtls_record rec;
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    /* We might have buffered a future record; if so,
-     * and if the epoch matches now, load it.
-     * On success, this call will set ssl->in_left to
-     * the length of the buffered record, so that
-     * the calls to ssl_fetch_input() below will
-     * essentially be no-ops. */
-    ret = ssl_load_buffered_record(ssl);
-    if (ret != 0) {
-        return ret;
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
 
-    /* Ensure that we have enough space available for the default form
-     * of TLS / DTLS record headers (5 Bytes for TLS, 13 Bytes for DTLS,
-     * with no space for CIDs counted in). */
-    ret = mbedtls_ssl_fetch_input(ssl, mbedtls_ssl_in_hdr_len(ssl));
-    if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_fetch_input", ret);
+    if ((ret = ssl_lock(ssl)) != 0) {
         return ret;
     }
 
-    ret = ssl_parse_record_header(ssl, ssl->in_hdr, ssl->in_left, &rec);
-    if (ret != 0) {
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            if (ret == MBEDTLS_ERR_SSL_EARLY_MESSAGE) {
-                ret = ssl_buffer_future_record(ssl, &rec);
-                if (ret != 0) {
-                    return ret;
-                }
-
-                /* Fall through to handling of unexpected records */
-                ret = MBEDTLS_ERR_SSL_UNEXPECTED_RECORD;
+    if (ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+        mbedtls_ssl_is_handshake_over(ssl) == 0 ||
+        ssl->transform_application == NULL) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+#if defined(MBEDTLS_SSL_KTLS)
+    else if (ssl->ktls_directions != 0) {
+        ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+    else {
+        if ((ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_FLUSH) == 0) {
+            ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_SEND;
+            if (request == MBEDTLS_SSL_TLS1_3_KEY_UPDATE_REQUESTED) {
+                ssl->key_update |= MBEDTLS_SSL_KEY_UPDATE_REQUEST;
             }
+        }
 
-            if (ret == MBEDTLS_ERR_SSL_UNEXPECTED_RECORD) {
-#if defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) && defined(MBEDTLS_SSL_SRV_C)
-                /* Reset in pointers to default state for TLS/DTLS records,
-                 * assuming no CID and no offset between record content and
-                 * record plaintext. */
-                mbedtls_ssl_update_in_pointers(ssl);
+        /* The buffers of an idle connection may have been released. */
+        ret = mbedtls_ssl_acquire_buffers(ssl);
+        if (ret == 0) {
+            ret = ssl_tls13_write_key_update(ssl);
+        }
+    }
 
-                /* Setup internal message pointers from record structure. */
-                ssl->in_msgtype = rec.type;
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-                ssl->in_len = ssl->in_cid + rec.cid_len;
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-                ssl->in_iv  = ssl->in_msg = ssl->in_len + 2;
-                ssl->in_msglen = rec.data_len;
+    ssl_unlock(ssl);
 
-                ret = ssl_check_client_reconnect(ssl);
-                MBEDTLS_SSL_DEBUG_RET(2, "ssl_check_client_reconnect", ret);
-                if (ret != 0) {
-                    return ret;
-                }
+    return ret;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+{
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("received post-handshake message"));
+
+    if (ssl->in_msg[0] == MBEDTLS_SSL_HS_KEY_UPDATE) {
+        return ssl_tls13_parse_key_update(ssl);
+    }
+
+#if defined(MBEDTLS_SSL_CLI_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+        if (ssl_tls13_is_new_session_ticket(ssl)) {
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+            MBEDTLS_SSL_DEBUG_MSG(3, ("NewSessionTicket received"));
+            ssl->keep_current_message = 1;
+
+            mbedtls_ssl_handshake_set_state(ssl,
+                                            MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET);
+            return MBEDTLS_ERR_SSL_WANT_READ;
+#else
+            MBEDTLS_SSL_DEBUG_MSG(3, ("Ignore NewSessionTicket, not supported."));
+            return 0;
 #endif
+        }
+    }
+#endif /* MBEDTLS_SSL_CLI_C */
 
-                /* Skip unexpected record (but not whole datagram) */
-                ssl->next_record_offset = rec.buf_len;
+    /* Fail in all other cases. */
+    return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
-                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding unexpected record "
-                                          "(header)"));
-            } else {
-                /* Skip invalid record and the rest of the datagram */
-                ssl->next_record_offset = 0;
-                ssl->in_left = 0;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+/* This function is called from mbedtls_ssl_read() when a handshake message is
+ * received after the initial handshake. In this context, handshake messages
+ * may only be sent for the purpose of initiating renegotiations.
+ *
+ * This function is introduced as a separate helper since the handling
+ * of post-handshake handshake messages changes significantly in TLS 1.3,
+ * and having a helper function allows to distinguish between TLS <= 1.2 and
+ * TLS 1.3 in the future without bloating the logic of mbedtls_ssl_read().
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls12_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding invalid record "
-                                          "(header)"));
-            }
+    /*
+     * - For client-side, expect SERVER_HELLO_REQUEST.
+     * - For server-side, expect CLIENT_HELLO.
+     * - Fail (TLS) or silently drop record (DTLS) in other cases.
+     */
 
-            /* Get next record */
-            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-        } else
+#if defined(MBEDTLS_SSL_CLI_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
+        (ssl->in_msg[0] != MBEDTLS_SSL_HS_HELLO_REQUEST ||
+         ssl->in_hslen  != mbedtls_ssl_hs_hdr_len(ssl))) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake received (not HelloRequest)"));
+
+        /* With DTLS, drop the packet (probably from last handshake) */
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+            return 0;
+        }
 #endif
-        {
-            return ret;
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    }
+#endif /* MBEDTLS_SSL_CLI_C */
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
+        ssl->in_msg[0] != MBEDTLS_SSL_HS_CLIENT_HELLO) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake received (not ClientHello)"));
+
+        /* With DTLS, drop the packet (probably from last handshake) */
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+            return 0;
         }
+#endif
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
     }
+#endif /* MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    /* Determine whether renegotiation attempt should be accepted */
+    if (!(ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED ||
+          (ssl->secure_renegotiation == MBEDTLS_SSL_LEGACY_RENEGOTIATION &&
+           ssl->conf->allow_legacy_renegotiation ==
+           MBEDTLS_SSL_LEGACY_NO_RENEGOTIATION))) {
+        /*
+         * Accept renegotiation request
+         */
 
+        /* DTLS clients need to know renego is server-initiated */
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        /* Remember offset of next record within datagram. */
-        ssl->next_record_offset = rec.buf_len;
-        if (ssl->next_record_offset < ssl->in_left) {
-            MBEDTLS_SSL_DEBUG_MSG(3, ("more than one record within datagram"));
+        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+            ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+            ssl->renego_status = MBEDTLS_SSL_RENEGOTIATION_PENDING;
         }
-    } else
 #endif
+        ret = mbedtls_ssl_start_renegotiation(ssl);
+        if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
+            ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_start_renegotiation",
+                                  ret);
+            return ret;
+        }
+    } else
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
     {
         /*
-         * Fetch record contents from underlying transport.
+         * Refuse renegotiation
          */
-        ret = mbedtls_ssl_fetch_input(ssl, rec.buf_len);
-        if (ret != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_fetch_input", ret);
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("refusing renegotiation, sending alert"));
+
+        if ((ret = mbedtls_ssl_send_alert_message(ssl,
+                                                  MBEDTLS_SSL_ALERT_LEVEL_WARNING,
+                                                  MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION)) != 0) {
             return ret;
         }
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+{
+    /* Check protocol version and dispatch accordingly. */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        return ssl_tls13_handle_hs_message_post_handshake(ssl);
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (ssl->tls_version <= MBEDTLS_SSL_VERSION_TLS1_2) {
+        return ssl_tls12_handle_hs_message_post_handshake(ssl);
+    }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+    /* Should never happen */
+    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+}
+
+/*
+ * brief          Read at most 'len' application data bytes from the input
+ *                buffer.
+ *
+ * param ssl      SSL context:
+ *                - First byte of application data not read yet in the input
+ *                  buffer located at address `in_offt`.
+ *                - The number of bytes of data not read yet is `in_msglen`.
+ * param buf      buffer that will hold the data
+ * param len      maximum number of bytes to read
+ *
+ * note           The function updates the fields `in_offt` and `in_msglen`
+ *                according to the number of bytes read.
+ *
+ * return         The number of bytes read.
+ */
+void mbedtls_ssl_consume_application_data(mbedtls_ssl_context *ssl, size_t n)
+{
+    ssl->in_msglen -= n;
 
-        ssl->in_left = 0;
-    }
+    /* Zeroising the plaintext buffer to erase unused application data
+       from the memory. */
+    mbedtls_platform_zeroize(ssl->in_offt, n);
 
-    /*
-     * Decrypt record contents.
-     */
+    if (ssl->in_msglen == 0) {
+        /* all bytes consumed */
+        ssl->in_offt = NULL;
+        ssl->keep_current_message = 0;
+    } else {
+        /* more data available */
+        ssl->in_offt += n;
+    }
+}
 
-    if ((ret = ssl_prepare_record_content(ssl, &rec)) != 0) {
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            /* Silently discard invalid records */
-            if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
-                /* Except when waiting for Finished as a bad mac here
-                 * probably means something went wrong in the handshake
-                 * (eg wrong psk used, mitm downgrade attempt, etc.) */
-                if (ssl->state == MBEDTLS_SSL_CLIENT_FINISHED ||
-                    ssl->state == MBEDTLS_SSL_SERVER_FINISHED) {
-#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
-                    if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
-                        mbedtls_ssl_send_alert_message(ssl,
-                                                       MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                                       MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
-                    }
-#endif
-                    return ret;
-                }
+static int ssl_read_application_data(
+    mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+{
+    size_t n = (len < ssl->in_msglen) ? len : ssl->in_msglen;
 
-                if (ssl->conf->badmac_limit != 0 &&
-                    ++ssl->badmac_seen >= ssl->conf->badmac_limit) {
-                    MBEDTLS_SSL_DEBUG_MSG(1, ("too many records with bad MAC"));
-                    return MBEDTLS_ERR_SSL_INVALID_MAC;
-                }
+    if (len != 0) {
+        memcpy(buf, ssl->in_offt, n);
+    }
 
-                /* As above, invalid records cause
-                 * dismissal of the whole datagram. */
+    mbedtls_ssl_consume_application_data(ssl, n);
 
-                ssl->next_record_offset = 0;
-                ssl->in_left = 0;
+    return (int) n;
+}
 
-                MBEDTLS_SSL_DEBUG_MSG(1, ("discarding invalid record (mac)"));
-                return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-            }
+/*
+ * Read the next record while waiting for application data. With
+ * MBEDTLS_SSL_FULL_DUPLEX, an established TLS connection without
+ * renegotiation gives up the mutex for this: receiving and decrypting a
+ * record only touches the inbound state, which writers leave alone, and
+ * whatever else the record calls for is done once the mutex is back.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_read_app_record(mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-            return ret;
-        } else
-#endif
-        {
-            /* Error out (and send alert) on invalid records */
-#if defined(MBEDTLS_SSL_ALL_ALERT_MESSAGES)
-            if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
-                mbedtls_ssl_send_alert_message(ssl,
-                                               MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                               MBEDTLS_SSL_ALERT_MSG_BAD_RECORD_MAC);
-            }
+    if (ssl->state == MBEDTLS_SSL_HANDSHAKE_OVER &&
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+        ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED &&
 #endif
-            return ret;
-        }
-    }
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        ssl->in_unlocked = 1;
+        ssl_unlock(ssl);
 
+        ret = mbedtls_ssl_read_record(ssl, 1);
 
-    /* Reset in pointers to default state for TLS/DTLS records,
-     * assuming no CID and no offset between record content and
-     * record plaintext. */
-    mbedtls_ssl_update_in_pointers(ssl);
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    ssl->in_len = ssl->in_cid + rec.cid_len;
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-    ssl->in_iv  = ssl->in_len + 2;
+        if (ssl_lock(ssl) != 0) {
+            return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+        }
+        ssl->in_unlocked = 0;
 
-    /* The record content type may change during decryption,
-     * so re-read it. */
-    ssl->in_msgtype = rec.type;
-    /* Also update the input buffer, because unfortunately
-     * the server-side ssl_parse_client_hello() reparses the
-     * record header when receiving a ClientHello initiating
-     * a renegotiation. */
-    ssl->in_hdr[0] = rec.type;
-    ssl->in_msg    = rec.buf + rec.data_offset;
-    ssl->in_msglen = rec.data_len;
-    MBEDTLS_PUT_UINT16_BE(rec.data_len, ssl->in_len, 0);
+        return ret;
+    }
+#endif /* MBEDTLS_SSL_FULL_DUPLEX */
 
-    return 0;
+    return mbedtls_ssl_read_record(ssl, 1);
 }
 
-int mbedtls_ssl_handle_message_type(mbedtls_ssl_context *ssl)
+/*
+ * Drive the handshake and the record layer until decrypted application data
+ * is available in ssl->in_offt.
+ *
+ * Returns 0 when application data is available, MBEDTLS_ERR_SSL_CONN_EOF if
+ * the transport was closed, or another error code.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_wait_application_data(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+    if ((ret = mbedtls_ssl_acquire_buffers(ssl)) != 0) {
+        return ret;
+    }
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            return ret;
+        }
+
+        if (ssl->handshake != NULL &&
+            ssl->handshake->retransmit_state == MBEDTLS_SSL_RETRANS_SENDING) {
+            if ((ret = mbedtls_ssl_flight_transmit(ssl)) != 0) {
+                return ret;
+            }
+        }
+    }
+#endif
+
     /*
-     * Handle particular types of records
+     * Check if renegotiation is necessary and/or handshake is
+     * in process. If yes, perform/continue, and fall through
+     * if an unexpected packet is received while the client
+     * is waiting for the ServerHello.
+     *
+     * (There is no equivalent to the last condition on
+     *  the server-side as it is not treated as within
+     *  a handshake while waiting for the ClientHello
+     *  after a renegotiation request.)
      */
-    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE) {
-        if ((ret = mbedtls_ssl_prepare_handshake_record(ssl)) != 0) {
+
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    ret = ssl_check_ctr_renegotiate(ssl);
+    if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
+        ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
+        return ret;
+    }
+#endif
+
+    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        ret = mbedtls_ssl_handshake_complete(ssl);
+        if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
+            ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
             return ret;
         }
     }
 
-    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
-        if (ssl->in_msglen != 1) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid CCS message, len: %" MBEDTLS_PRINTF_SIZET,
-                                      ssl->in_msglen));
-            return MBEDTLS_ERR_SSL_INVALID_RECORD;
-        }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if ((ret = ssl_tls13_check_key_update(ssl, 1)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_tls13_check_key_update", ret);
+        return ret;
+    }
+#endif
 
-        if (ssl->in_msg[0] != 1) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid CCS message, content: %02x",
-                                      ssl->in_msg[0]));
-            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+    /* Loop as long as no application data record is available */
+    while (ssl->in_offt == NULL) {
+        /* Start timer if not already running */
+        if (ssl->f_get_timer != NULL &&
+            ssl->f_get_timer(ssl->p_timer) == -1) {
+            mbedtls_ssl_set_timer(ssl, ssl->conf->read_timeout);
         }
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
-            ssl->state != MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC    &&
-            ssl->state != MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC) {
-            if (ssl->handshake == NULL) {
-                MBEDTLS_SSL_DEBUG_MSG(1, ("dropping ChangeCipherSpec outside handshake"));
-                return MBEDTLS_ERR_SSL_UNEXPECTED_RECORD;
+        if ((ret = ssl_read_app_record(ssl)) != 0) {
+            if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+                return ret;
             }
 
-            MBEDTLS_SSL_DEBUG_MSG(1, ("received out-of-order ChangeCipherSpec - remember"));
-            return MBEDTLS_ERR_SSL_EARLY_MESSAGE;
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
+            return ret;
         }
-#endif
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-        if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
-            MBEDTLS_SSL_DEBUG_MSG(2,
-                                  ("Ignore ChangeCipherSpec in TLS 1.3 compatibility mode"));
-            return MBEDTLS_ERR_SSL_CONTINUE_PROCESSING;
-        }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
-    }
+        if (ssl->in_msglen  == 0 &&
+            ssl->in_msgtype == MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+            /*
+             * OpenSSL sends empty messages to randomize the IV
+             */
+            if ((ret = ssl_read_app_record(ssl)) != 0) {
+                if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+                    return ret;
+                }
 
-    if (ssl->in_msgtype == MBEDTLS_SSL_MSG_ALERT) {
-        if (ssl->in_msglen != 2) {
-            /* Note: Standard allows for more than one 2 byte alert
-               to be packed in a single message, but Mbed TLS doesn't
-               currently support this. */
-            MBEDTLS_SSL_DEBUG_MSG(1, ("invalid alert message, len: %" MBEDTLS_PRINTF_SIZET,
-                                      ssl->in_msglen));
-            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
+                return ret;
+            }
         }
 
-        MBEDTLS_SSL_DEBUG_MSG(2, ("got an alert message, type: [%u:%u]",
-                                  ssl->in_msg[0], ssl->in_msg[1]));
+        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE) {
+            ret = ssl_handle_hs_message_post_handshake(ssl);
+            if (ret != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "ssl_handle_hs_message_post_handshake",
+                                      ret);
+                return ret;
+            }
 
-        /*
-         * Ignore non-fatal alerts, except close_notify and no_renegotiation
-         */
-        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_FATAL) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("is a fatal alert message (msg %d)",
-                                      ssl->in_msg[1]));
-            return MBEDTLS_ERR_SSL_FATAL_ALERT_MESSAGE;
+            /* At this point, we don't know whether the renegotiation triggered
+             * by the post-handshake message has been completed or not. The cases
+             * to consider are the following:
+             * 1) The renegotiation is complete. In this case, no new record
+             *    has been read yet.
+             * 2) The renegotiation is incomplete because the client received
+             *    an application data record while awaiting the ServerHello.
+             * 3) The renegotiation is incomplete because the client received
+             *    a non-handshake, non-application data message while awaiting
+             *    the ServerHello.
+             *
+             * In each of these cases, looping will be the proper action:
+             * - For 1), the next iteration will read a new record and check
+             *   if it's application data.
+             * - For 2), the loop condition isn't satisfied as application data
+             *   is present, hence continue is the same as break
+             * - For 3), the loop condition is satisfied and read_record
+             *   will re-deliver the message that was held back by the client
+             *   when expecting the ServerHello.
+             */
+
+            continue;
+        }
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+        else if (ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING) {
+            if (ssl->conf->renego_max_records >= 0) {
+                if (++ssl->renego_records_seen > ssl->conf->renego_max_records) {
+                    MBEDTLS_SSL_DEBUG_MSG(1, ("renegotiation requested, "
+                                              "but not honored by client"));
+                    return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+                }
+            }
         }
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
 
-        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_WARNING &&
-            ssl->in_msg[1] == MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY) {
-            MBEDTLS_SSL_DEBUG_MSG(2, ("is a close notify message"));
-            return MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY;
+        /* Fatal and closure alerts handled by mbedtls_ssl_read_record() */
+        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_ALERT) {
+            MBEDTLS_SSL_DEBUG_MSG(2, ("ignoring non-fatal non-closure alert"));
+            return MBEDTLS_ERR_SSL_WANT_READ;
         }
 
-#if defined(MBEDTLS_SSL_RENEGOTIATION_ENABLED)
-        if (ssl->in_msg[0] == MBEDTLS_SSL_ALERT_LEVEL_WARNING &&
-            ssl->in_msg[1] == MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION) {
-            MBEDTLS_SSL_DEBUG_MSG(2, ("is a no renegotiation alert"));
-            /* Will be handled when trying to parse ServerHello */
-            return 0;
+        if (ssl->in_msgtype != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("bad application data message"));
+            return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
         }
-#endif
-        /* Silently ignore: fetch new message */
-        return MBEDTLS_ERR_SSL_NON_FATAL;
-    }
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        /* Drop unexpected ApplicationData records,
-         * except at the beginning of renegotiations */
-        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_APPLICATION_DATA &&
-            mbedtls_ssl_is_handshake_over(ssl) == 0
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-            && !(ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_IN_PROGRESS &&
-                 ssl->state == MBEDTLS_SSL_SERVER_HELLO)
-#endif
-            ) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("dropping unexpected ApplicationData"));
-            return MBEDTLS_ERR_SSL_NON_FATAL;
+        ssl->in_offt = ssl->in_msg;
+
+        /* We're going to return something now, cancel timer,
+         * except if handshake (renegotiation) is in progress */
+        if (mbedtls_ssl_is_handshake_over(ssl) == 1) {
+            mbedtls_ssl_set_timer(ssl, 0);
         }
 
-        if (ssl->handshake != NULL &&
-            mbedtls_ssl_is_handshake_over(ssl) == 1) {
-            mbedtls_ssl_handshake_wrapup_free_hs_transform(ssl);
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        /* If we requested renego but received AppData, resend HelloRequest.
+         * Do it now, after setting in_offt, to avoid taking this branch
+         * again if ssl_write_hello_request() returns WANT_WRITE */
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_RENEGOTIATION)
+        if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
+            ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING) {
+            if ((ret = mbedtls_ssl_resend_hello_request(ssl)) != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_resend_hello_request",
+                                      ret);
+                return ret;
+            }
         }
-    }
+#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_RENEGOTIATION */
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
+    }
 
     return 0;
 }
 
-int mbedtls_ssl_send_fatal_handshake_failure(mbedtls_ssl_context *ssl)
-{
-    return mbedtls_ssl_send_alert_message(ssl,
-                                          MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                          MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE);
-}
-
-int mbedtls_ssl_send_alert_message(mbedtls_ssl_context *ssl,
-                                   unsigned char level,
-                                   unsigned char message)
+#if defined(MBEDTLS_SSL_KTLS)
+/*
+ * Receive application data once the kernel protects incoming records
+ */
+static int ssl_ktls_read(mbedtls_ssl_context *ssl,
+                         unsigned char *buf, size_t len)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    if (ssl == NULL || ssl->conf == NULL) {
+    if (ssl->f_recv == NULL && ssl->f_recv_timeout == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Bad usage of mbedtls_ssl_set_bio() "));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    if (ssl->out_left != 0) {
-        return mbedtls_ssl_flush_output(ssl);
-    }
-
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> send alert message"));
-    MBEDTLS_SSL_DEBUG_MSG(3, ("send alert level=%u message=%u", level, message));
-
-    ssl->out_msgtype = MBEDTLS_SSL_MSG_ALERT;
-    ssl->out_msglen = 2;
-    ssl->out_msg[0] = level;
-    ssl->out_msg[1] = message;
-
-    if ((ret = mbedtls_ssl_write_record(ssl, SSL_FORCE_FLUSH)) != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
-        return ret;
+    if (len > INT_MAX) {
+        len = INT_MAX;
     }
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= send alert message"));
-
-    return 0;
-}
-
-int mbedtls_ssl_write_change_cipher_spec(mbedtls_ssl_context *ssl)
-{
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> write change cipher spec"));
-
-    ssl->out_msgtype = MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC;
-    ssl->out_msglen  = 1;
-    ssl->out_msg[0]  = 1;
-
-    ssl->state++;
-
-    if ((ret = mbedtls_ssl_write_handshake_msg(ssl)) != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_handshake_msg", ret);
-        return ret;
+    if (ssl->f_recv_timeout != NULL) {
+        ret = ssl->f_recv_timeout(ssl->p_bio, buf, len,
+                                  ssl->conf->read_timeout);
+    } else {
+        ret = ssl->f_recv(ssl->p_bio, buf, len);
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= write change cipher spec"));
+    MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_recv(_timeout) (kTLS)", ret);
 
-    return 0;
+    return ret;
 }
 
-int mbedtls_ssl_parse_change_cipher_spec(mbedtls_ssl_context *ssl)
+/*
+ * Send application data once the kernel protects outgoing records
+ */
+static int ssl_ktls_write_iov(mbedtls_ssl_context *ssl,
+                              const mbedtls_ssl_iovec *iov, size_t iovcnt)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t written = 0;
+    size_t chunk;
+    size_t i;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> parse change cipher spec"));
-
-    if ((ret = mbedtls_ssl_read_record(ssl, 1)) != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
-        return ret;
-    }
-
-    if (ssl->in_msgtype != MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("bad change cipher spec message"));
-        mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                       MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE);
-        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    if (ssl->f_send == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Bad usage of mbedtls_ssl_set_bio() "));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    /* CCS records are only accepted if they have length 1 and content '1',
-     * so we don't need to check this here. */
-
-    /*
-     * Switch to our negotiated transform and session parameters for inbound
-     * data.
-     */
-    MBEDTLS_SSL_DEBUG_MSG(3, ("switching to new transform spec for inbound data"));
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    ssl->transform_in = ssl->transform_negotiate;
-#endif
-    ssl->session_in = ssl->session_negotiate;
-
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-#if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
-        mbedtls_ssl_dtls_replay_reset(ssl);
-#endif
-
-        /* Increment epoch */
-        if (++ssl->in_epoch == 0) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("DTLS epoch would wrap"));
-            /* This is highly unlikely to happen for legitimate reasons, so
-               treat it as an attack and don't send an alert. */
-            return MBEDTLS_ERR_SSL_COUNTER_WRAPPING;
+    for (i = 0; i < iovcnt && written < INT_MAX; i++) {
+        if (iov[i].len == 0) {
+            continue;
         }
-    } else
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
-    memset(ssl->in_ctr, 0, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
-
-    mbedtls_ssl_update_in_pointers(ssl);
-
-    ssl->state++;
-
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= parse change cipher spec"));
-
-    return 0;
-}
-
-/* Once ssl->out_hdr as the address of the beginning of the
- * next outgoing record is set, deduce the other pointers.
- *
- * Note: For TLS, we save the implicit record sequence number
- *       (entering MAC computation) in the 8 bytes before ssl->out_hdr,
- *       and the caller has to make sure there's space for this.
- */
 
-static size_t ssl_transform_get_explicit_iv_len(
-    mbedtls_ssl_transform const *transform)
-{
-    return transform->ivlen - transform->fixed_ivlen;
-}
-
-void mbedtls_ssl_update_out_pointers(mbedtls_ssl_context *ssl,
-                                     mbedtls_ssl_transform *transform)
-{
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        ssl->out_ctr = ssl->out_hdr +  3;
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        ssl->out_cid = ssl->out_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-        ssl->out_len = ssl->out_cid;
-        if (transform != NULL) {
-            ssl->out_len += transform->out_cid_len;
+        chunk = iov[i].len;
+        if (chunk > INT_MAX - written) {
+            chunk = INT_MAX - written;
         }
-#else /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-        ssl->out_len = ssl->out_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-        ssl->out_iv  = ssl->out_len + 2;
-    } else
-#endif
-    {
-        ssl->out_len = ssl->out_hdr + 3;
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        ssl->out_cid = ssl->out_len;
-#endif
-        ssl->out_iv  = ssl->out_hdr + 5;
-    }
-
-    ssl->out_msg = ssl->out_iv;
-    /* Adjust out_msg to make space for explicit IV, if used. */
-    if (transform != NULL) {
-        ssl->out_msg += ssl_transform_get_explicit_iv_len(transform);
-    }
-}
-
-/* Once ssl->in_hdr as the address of the beginning of the
- * next incoming record is set, deduce the other pointers.
- *
- * Note: For TLS, we save the implicit record sequence number
- *       (entering MAC computation) in the 8 bytes before ssl->in_hdr,
- *       and the caller has to make sure there's space for this.
- */
 
-void mbedtls_ssl_update_in_pointers(mbedtls_ssl_context *ssl)
-{
-    /* This function sets the pointers to match the case
-     * of unprotected TLS/DTLS records, with both  ssl->in_iv
-     * and ssl->in_msg pointing to the beginning of the record
-     * content.
-     *
-     * When decrypting a protected record, ssl->in_msg
-     * will be shifted to point to the beginning of the
-     * record plaintext.
-     */
+        ret = ssl->f_send(ssl->p_bio, iov[i].base, chunk);
+        MBEDTLS_SSL_DEBUG_RET(2, "ssl->f_send() (kTLS)", ret);
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        /* This sets the header pointers to match records
-         * without CID. When we receive a record containing
-         * a CID, the fields are shifted accordingly in
-         * ssl_parse_record_header(). */
-        ssl->in_ctr = ssl->in_hdr +  3;
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        ssl->in_cid = ssl->in_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-        ssl->in_len = ssl->in_cid; /* Default: no CID */
-#else /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-        ssl->in_len = ssl->in_ctr + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
-        ssl->in_iv  = ssl->in_len + 2;
-    } else
-#endif
-    {
-        ssl->in_ctr = ssl->in_hdr - MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
-        ssl->in_len = ssl->in_hdr + 3;
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-        ssl->in_cid = ssl->in_len;
-#endif
-        ssl->in_iv  = ssl->in_hdr + 5;
+        if (ret < 0) {
+            /* Report what was already sent, the error comes next time. */
+            return (written != 0) ? (int) written : ret;
+        }
+
+        if ((size_t) ret > chunk) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("f_send returned more bytes than given"));
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+
+        written += (size_t) ret;
+        if ((size_t) ret < chunk) {
+            break;
+        }
     }
 
-    /* This will be adjusted at record decryption time. */
-    ssl->in_msg = ssl->in_iv;
+    return (int) written;
 }
+#endif /* MBEDTLS_SSL_KTLS */
 
 /*
- * Setup an SSL context
+ * Receive application data decrypted from the SSL layer, with the mutex held
  */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-void mbedtls_ssl_reset_in_out_pointers(mbedtls_ssl_context *ssl)
+    /* Unless data from a previous record is pending, let the next record
+     * be decrypted straight into buf, saving the copy out of in_msg. */
+    ssl->in_dst = (ssl->in_offt == NULL) ? buf : NULL;
+    ssl->in_dst_len = len;
+
+    ret = ssl_wait_application_data(ssl);
+
+    ssl->in_dst = NULL;
+
+    if (ret == 0 && ssl->in_dst_used && ssl->in_offt == ssl->in_msg) {
+        size_t n = ssl->in_msglen;
+
+        ssl->in_dst_used = 0;
+        mbedtls_ssl_consume_application_data(ssl, n);
+
+        MBEDTLS_SSL_DEBUG_MSG(2, ("<= read"));
+
+        return (int) n;
+    }
+    if (ssl->in_dst_used) {
+        /* The record went somewhere else than to the caller, put its
+         * plaintext back where the rest of the stack expects it. */
+        memcpy(ssl->in_msg, buf, ssl->in_msglen);
+        ssl->in_dst_used = 0;
+    }
+
+    if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+        return 0;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = ssl_read_application_data(ssl, buf, len);
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read"));
+
+    return ret;
+}
+
+/*
+ * Receive application data decrypted from the SSL layer
+ */
+int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
 {
-    /* Set the incoming and outgoing record pointers. */
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        ssl->out_hdr = ssl->out_buf;
-        ssl->in_hdr  = ssl->in_buf;
-    } else
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
-    {
-        ssl->out_ctr = ssl->out_buf;
-        ssl->out_hdr = ssl->out_buf + 8;
-        ssl->in_hdr  = ssl->in_buf  + 8;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    /* Derive other internal pointers. */
-    mbedtls_ssl_update_out_pointers(ssl, NULL /* no transform enabled */);
-    mbedtls_ssl_update_in_pointers(ssl);
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read"));
+
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_RX) {
+        return ssl_ktls_read(ssl, buf, len);
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
+
+    ret = ssl_read(ssl, buf, len);
+
+    ssl_read_unlock(ssl);
+
+    return ret;
 }
 
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
 /*
- * SSL get accessors
+ * Is the next record of the current datagram application data of at most
+ * room bytes? Its ciphertext is no shorter than its plaintext.
  */
-size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context *ssl)
+static int ssl_next_record_fits(const mbedtls_ssl_context *ssl, size_t room)
 {
-    return ssl->in_offt == NULL ? 0 : ssl->in_msglen;
+    const unsigned char *next = ssl->in_hdr + ssl->next_record_offset;
+    const size_t len_offset = (size_t) (ssl->in_len - ssl->in_hdr);
+
+    if (ssl->in_offt != NULL ||
+        ssl->in_left < ssl->next_record_offset + len_offset + 2) {
+        return 0;
+    }
+
+    if (next[0] != MBEDTLS_SSL_MSG_APPLICATION_DATA &&
+        next[0] != MBEDTLS_SSL_MSG_CID) {
+        return 0;
+    }
+
+    return MBEDTLS_GET_UINT16_BE(next, len_offset) <= room;
 }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
 
-int mbedtls_ssl_check_pending(const mbedtls_ssl_context *ssl)
+/*
+ * Receive the application data of all the records of the current datagram
+ */
+int mbedtls_ssl_read_datagram(mbedtls_ssl_context *ssl,
+                              unsigned char *buf, size_t len,
+                              mbedtls_ssl_iovec *spans, size_t max_spans,
+                              size_t *nspans)
 {
-    /*
-     * Case A: We're currently holding back
-     * a message for further processing.
-     */
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t used = 0, n = 0;
 
-    if (ssl->keep_current_message == 1) {
-        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: record held back for processing"));
-        return 1;
+    if (ssl == NULL || ssl->conf == NULL || spans == NULL || max_spans == 0 ||
+        nspans == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    /*
-     * Case B: Further records are pending in the current datagram.
-     */
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read datagram"));
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
-        ssl->in_left > ssl->next_record_offset) {
-        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: more records within current datagram"));
-        return 1;
+    *nspans = 0;
+
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_RX) {
+        ret = ssl_ktls_read(ssl, buf, len);
+        if (ret > 0) {
+            spans[0].base = buf;
+            spans[0].len = (size_t) ret;
+            *nspans = 1;
+        }
+        return ret;
     }
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
+#endif /* MBEDTLS_SSL_KTLS */
 
-    /*
-     * Case C: A handshake message is being processed.
-     */
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
 
-    if (ssl->in_hslen > 0 && ssl->in_hslen < ssl->in_msglen) {
-        MBEDTLS_SSL_DEBUG_MSG(3,
-                              ("ssl_check_pending: more handshake messages within current record"));
-        return 1;
+    ret = ssl_read(ssl, buf, len);
+    if (ret <= 0) {
+        goto exit;
     }
+    spans[n].base = buf;
+    spans[n].len = (size_t) ret;
+    used = (size_t) ret;
+    n++;
 
-    /*
-     * Case D: An application data message is being processed
-     */
-    if (ssl->in_offt != NULL) {
-        MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: application data record is being processed"));
-        return 1;
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        /* The records left in the datagram are there already: whatever
+         * happens to them, do not wait for the next one. */
+        ssl->in_datagram_only = 1;
+
+        while (n < max_spans && ssl_next_record_fits(ssl, len - used)) {
+            ret = ssl_read(ssl, buf + used, len - used);
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                /* The rest of the datagram was dropped, or is an alert
+                 * waiting to be sent: return the data read so far. */
+                break;
+            }
+            if (ret < 0) {
+                ssl->in_datagram_only = 0;
+                goto exit;
+            }
+            if (ret == 0) {
+                continue;
+            }
+            spans[n].base = buf + used;
+            spans[n].len = (size_t) ret;
+            used += (size_t) ret;
+            n++;
+        }
+
+        ssl->in_datagram_only = 0;
     }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
 
-    /*
-     * In all other cases, the rest of the message can be dropped.
-     * As in ssl_get_next_record, this needs to be adapted if
-     * we implement support for multiple alerts in single records.
-     */
+    ret = (int) used;
+    *nspans = n;
 
-    MBEDTLS_SSL_DEBUG_MSG(3, ("ssl_check_pending: nothing pending"));
-    return 0;
-}
+exit:
+    ssl_read_unlock(ssl);
 
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read datagram"));
 
-int mbedtls_ssl_get_record_expansion(const mbedtls_ssl_context *ssl)
+    return ret;
+}
+
+/*
+ * Expose decrypted application data in place, without copying it
+ */
+int mbedtls_ssl_read_peek(mbedtls_ssl_context *ssl,
+                          const unsigned char **buf, size_t *len)
 {
-    size_t transform_expansion = 0;
-    const mbedtls_ssl_transform *transform = ssl->transform_out;
-    unsigned block_size;
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_key_attributes_t attr = PSA_KEY_ATTRIBUTES_INIT;
-    psa_key_type_t key_type;
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    size_t out_hdr_len = mbedtls_ssl_out_hdr_len(ssl);
+    if (ssl == NULL || ssl->conf == NULL || buf == NULL || len == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
 
-    if (transform == NULL) {
-        return (int) out_hdr_len;
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read peek"));
+
+    *buf = NULL;
+    *len = 0;
+
+#if defined(MBEDTLS_SSL_KTLS)
+    /* Decrypted records are only available from the kernel by copy. */
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_RX) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
     }
+#endif /* MBEDTLS_SSL_KTLS */
 
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    if (transform->psa_alg == PSA_ALG_GCM ||
-        transform->psa_alg == PSA_ALG_CCM ||
-        transform->psa_alg == PSA_ALG_AEAD_WITH_SHORTENED_TAG(PSA_ALG_CCM, 8) ||
-        transform->psa_alg == PSA_ALG_CHACHA20_POLY1305 ||
-        transform->psa_alg == MBEDTLS_SSL_NULL_CIPHER) {
-        transform_expansion = transform->minlen;
-    } else if (transform->psa_alg == PSA_ALG_CBC_NO_PADDING) {
-        (void) psa_get_key_attributes(transform->psa_key_enc, &attr);
-        key_type = psa_get_key_type(&attr);
+    ret = ssl_wait_application_data(ssl);
+    if (ret == 0) {
+        if (ssl->in_msglen == 0) {
+            /* Nothing to expose from an empty record, release it right away */
+            mbedtls_ssl_consume_application_data(ssl, 0);
+        } else {
+            *buf = ssl->in_offt;
+            *len = ssl->in_msglen;
+        }
+        ret = (int) *len;
+    } else if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
+        ret = 0;
+    }
 
-        block_size = PSA_BLOCK_CIPHER_BLOCK_LENGTH(key_type);
+    ssl_read_unlock(ssl);
 
-        /* Expansion due to the addition of the MAC. */
-        transform_expansion += transform->maclen;
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read peek"));
 
-        /* Expansion due to the addition of CBC padding;
-         * Theoretically up to 256 bytes, but we never use
-         * more than the block size of the underlying cipher. */
-        transform_expansion += block_size;
+    return ret;
+}
 
-        /* For TLS 1.2 or higher, an explicit IV is added
-         * after the record header. */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-        transform_expansion += block_size;
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
-    } else {
-        MBEDTLS_SSL_DEBUG_MSG(1,
-                              ("Unsupported psa_alg spotted in mbedtls_ssl_get_record_expansion()"));
-        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
-    }
-#else
-    switch (mbedtls_cipher_get_cipher_mode(&transform->cipher_ctx_enc)) {
-        case MBEDTLS_MODE_GCM:
-        case MBEDTLS_MODE_CCM:
-        case MBEDTLS_MODE_CHACHAPOLY:
-        case MBEDTLS_MODE_STREAM:
-            transform_expansion = transform->minlen;
-            break;
+/*
+ * Release application data previously exposed by mbedtls_ssl_read_peek()
+ */
+int mbedtls_ssl_read_consume(mbedtls_ssl_context *ssl, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        case MBEDTLS_MODE_CBC:
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
 
-            block_size = mbedtls_cipher_get_block_size(
-                &transform->cipher_ctx_enc);
+    if (len == 0) {
+        return 0;
+    }
 
-            /* Expansion due to the addition of the MAC. */
-            transform_expansion += transform->maclen;
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
 
-            /* Expansion due to the addition of CBC padding;
-             * Theoretically up to 256 bytes, but we never use
-             * more than the block size of the underlying cipher. */
-            transform_expansion += block_size;
+    if (ssl->in_offt == NULL || len > ssl->in_msglen) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    } else {
+        mbedtls_ssl_consume_application_data(ssl, len);
+    }
 
-            /* For TLS 1.2 or higher, an explicit IV is added
-             * after the record header. */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-            transform_expansion += block_size;
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    ssl_unlock(ssl);
 
-            break;
+    return ret;
+}
 
-        default:
-            MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
-            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_EARLY_DATA)
+int mbedtls_ssl_read_early_data(mbedtls_ssl_context *ssl,
+                                unsigned char *buf, size_t len)
+{
+    if (ssl == NULL || (ssl->conf == NULL)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    if (transform->out_cid_len != 0) {
-        transform_expansion += MBEDTLS_SSL_MAX_CID_EXPANSION;
+    /*
+     * The server may receive early data only while waiting for the End of
+     * Early Data handshake message.
+     */
+    if ((ssl->state != MBEDTLS_SSL_END_OF_EARLY_DATA) ||
+        (ssl->in_offt == NULL)) {
+        return MBEDTLS_ERR_SSL_CANNOT_READ_EARLY_DATA;
     }
-#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
-    return (int) (out_hdr_len + transform_expansion);
+    return ssl_read_application_data(ssl, buf, len);
 }
+#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_EARLY_DATA */
 
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
 /*
- * Check record counters and renegotiate if they're above the limit.
+ * Send application data to be encrypted by the SSL layer, taking care of max
+ * fragment length and buffer size. The data is gathered from the fragments
+ * described by iov directly into the outgoing record.
+ *
+ * According to RFC 5246 Section 6.2.1:
+ *
+ *      Zero-length fragments of Application data MAY be sent as they are
+ *      potentially useful as a traffic analysis countermeasure.
+ *
+ * Therefore, it is possible that the input message length is 0 and the
+ * corresponding return code is 0 on success.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_check_ctr_renegotiate(mbedtls_ssl_context *ssl)
+/*
+ * Payload of the next application data records: small ones at the start of
+ * the connection and after an idle period, full ones afterwards.
+ */
+static size_t ssl_get_app_record_len(mbedtls_ssl_context *ssl, size_t max_len)
 {
-    size_t ep_len = mbedtls_ssl_ep_len(ssl);
-    int in_ctr_cmp;
-    int out_ctr_cmp;
-
-    if (mbedtls_ssl_is_handshake_over(ssl) == 0 ||
-        ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING ||
-        ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED) {
-        return 0;
+    if (ssl->conf->small_record_len == 0 ||
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        return max_len;
     }
 
-    in_ctr_cmp = memcmp(ssl->in_ctr + ep_len,
-                        &ssl->conf->renego_period[ep_len],
-                        MBEDTLS_SSL_SEQUENCE_NUMBER_LEN - ep_len);
-    out_ctr_cmp = memcmp(&ssl->cur_out_ctr[ep_len],
-                         &ssl->conf->renego_period[ep_len],
-                         sizeof(ssl->cur_out_ctr) - ep_len);
+#if defined(MBEDTLS_HAVE_TIME)
+    /* Not while a write is pending, whose length must not change. */
+    if (ssl->out_left == 0 && ssl->conf->small_record_idle != 0 &&
+        ssl->small_record_sent != 0 &&
+        mbedtls_ms_time() - ssl->last_write_time >
+        (mbedtls_ms_time_t) ssl->conf->small_record_idle) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("idle connection, back to small records"));
+        ssl->small_record_sent = 0;
+    }
+#endif
 
-    if (in_ctr_cmp <= 0 && out_ctr_cmp <= 0) {
-        return 0;
+    if (ssl->small_record_sent < ssl->conf->small_record_bytes &&
+        ssl->conf->small_record_len < max_len) {
+        return ssl->conf->small_record_len;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(1, ("record counter limit reached: renegotiate"));
-    return mbedtls_ssl_renegotiate(ssl);
+    return max_len;
 }
-#endif /* MBEDTLS_SSL_RENEGOTIATION */
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-
-#if defined(MBEDTLS_SSL_CLI_C)
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_tls13_is_new_session_ticket(mbedtls_ssl_context *ssl)
+static void ssl_app_data_written(mbedtls_ssl_context *ssl, size_t len)
 {
+    if (ssl->conf->small_record_len == 0) {
+        return;
+    }
 
-    if ((ssl->in_hslen == mbedtls_ssl_hs_hdr_len(ssl)) ||
-        (ssl->in_msg[0] != MBEDTLS_SSL_HS_NEW_SESSION_TICKET)) {
-        return 0;
+    if (ssl->small_record_sent < ssl->conf->small_record_bytes) {
+        ssl->small_record_sent += len;
     }
+#if defined(MBEDTLS_HAVE_TIME)
+    if (ssl->conf->small_record_idle != 0) {
+        ssl->last_write_time = mbedtls_ms_time();
+    }
+#endif
+}
 
-    return 1;
+/*
+ * With the write queue, move the records still waiting to be sent to the
+ * start of the output buffer, to make room for new ones behind them.
+ */
+static void ssl_compact_output(mbedtls_ssl_context *ssl)
+{
+    unsigned char *start = ssl->out_buf + 8;
+    unsigned char *pending = ssl->out_hdr - ssl->out_left;
+
+    if (pending != start) {
+        memmove(start, pending, ssl->out_left);
+        ssl->out_hdr = start + ssl->out_left;
+        mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+    }
 }
-#endif /* MBEDTLS_SSL_CLI_C */
 
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+/*
+ * With DTLS application data packing, send the records held by earlier
+ * writes once they waited long enough, or when a record of len bytes does
+ * not fit in their datagram.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_tls13_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+static int ssl_app_packing_flush(mbedtls_ssl_context *ssl, size_t len)
 {
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    MBEDTLS_SSL_DEBUG_MSG(3, ("received post-handshake message"));
-
-#if defined(MBEDTLS_SSL_CLI_C)
-    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
-        if (ssl_tls13_is_new_session_ticket(ssl)) {
-#if defined(MBEDTLS_SSL_SESSION_TICKETS)
-            MBEDTLS_SSL_DEBUG_MSG(3, ("NewSessionTicket received"));
-            ssl->keep_current_message = 1;
+    if (ssl->out_app_held == 0) {
+        return 0;
+    }
 
-            mbedtls_ssl_handshake_set_state(ssl,
-                                            MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET);
-            return MBEDTLS_ERR_SSL_WANT_READ;
-#else
-            MBEDTLS_SSL_DEBUG_MSG(3, ("Ignore NewSessionTicket, not supported."));
-            return 0;
+#if defined(MBEDTLS_HAVE_TIME)
+    if (mbedtls_ms_time() - ssl->out_app_held_time <
+        (mbedtls_ms_time_t) ssl->conf->app_packing_delay)
 #endif
+    {
+        ret = ssl_get_remaining_payload_in_datagram(ssl);
+        if (ret < 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_get_remaining_payload_in_datagram",
+                                  ret);
+            return ret;
+        }
+        if ((size_t) ret >= len) {
+            return 0;
         }
     }
-#endif /* MBEDTLS_SSL_CLI_C */
 
-    /* Fail in all other cases. */
-    return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    return mbedtls_ssl_flush_output(ssl);
 }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-/* This function is called from mbedtls_ssl_read() when a handshake message is
- * received after the initial handshake. In this context, handshake messages
- * may only be sent for the purpose of initiating renegotiations.
- *
- * This function is introduced as a separate helper since the handling
- * of post-handshake handshake messages changes significantly in TLS 1.3,
- * and having a helper function allows to distinguish between TLS <= 1.2 and
- * TLS 1.3 in the future without bloating the logic of mbedtls_ssl_read().
+/*
+ * Write the data of iov, or, if f_source is not NULL, source_len bytes
+ * that f_source reads straight into the records.
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_tls12_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+static int ssl_write_real_iov(mbedtls_ssl_context *ssl,
+                              const mbedtls_ssl_iovec *iov, size_t iovcnt,
+                              mbedtls_ssl_write_source_t *f_source,
+                              void *p_source, size_t source_len)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int ret = mbedtls_ssl_get_max_out_record_payload(ssl);
+    size_t max_len = (size_t) ret;
+    const size_t max_records = mbedtls_ssl_get_write_batch_records(ssl);
+    /* Early data keeps the usual semantics, as it is written during the
+     * handshake. */
+    const int queued =
+        ssl->conf->write_queue == MBEDTLS_SSL_WRITE_QUEUE_ENABLED &&
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+        mbedtls_ssl_is_handshake_over(ssl) == 1;
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    /* Likewise, DTLS packs application records once the handshake is
+     * over. */
+    const int packed =
+        ssl->conf->app_packing_delay != 0 &&
+        ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+        ssl->disable_datagram_packing == 0 &&
+        mbedtls_ssl_is_handshake_over(ssl) == 1;
+    int held;
+#else
+    const int packed = 0;
+#endif
+    size_t limit;
+    size_t len = 0;
+    size_t i;
 
-    /*
-     * - For client-side, expect SERVER_HELLO_REQUEST.
-     * - For server-side, expect CLIENT_HELLO.
-     * - Fail (TLS) or silently drop record (DTLS) in other cases.
-     */
+    if (ret < 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_get_max_out_record_payload", ret);
+        return ret;
+    }
 
-#if defined(MBEDTLS_SSL_CLI_C)
-    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
-        (ssl->in_msg[0] != MBEDTLS_SSL_HS_HELLO_REQUEST ||
-         ssl->in_hslen  != mbedtls_ssl_hs_hdr_len(ssl))) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake received (not HelloRequest)"));
+    max_len = ssl_get_app_record_len(ssl, max_len);
 
-        /* With DTLS, drop the packet (probably from last handshake) */
+    /* max_records is 1 for DTLS, so the limit is a single record there. */
+    limit = max_len * max_records;
+
+    if (f_source != NULL) {
+        iovcnt = 0;
+        len = source_len;
+        if (len > limit) {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            return 0;
-        }
+            if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("fragment larger than the (negotiated) "
+                                          "maximum fragment length: %" MBEDTLS_PRINTF_SIZET
+                                          " > %" MBEDTLS_PRINTF_SIZET,
+                                          len, max_len));
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            }
 #endif
-        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+            len = limit;
+        }
     }
-#endif /* MBEDTLS_SSL_CLI_C */
-
-#if defined(MBEDTLS_SSL_SRV_C)
-    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
-        ssl->in_msg[0] != MBEDTLS_SSL_HS_CLIENT_HELLO) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake received (not ClientHello)"));
 
-        /* With DTLS, drop the packet (probably from last handshake) */
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].len > limit - len) {
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            return 0;
-        }
+            if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("fragment larger than the (negotiated) "
+                                          "maximum fragment length: %" MBEDTLS_PRINTF_SIZET
+                                          " + iov[%" MBEDTLS_PRINTF_SIZET "].len %"
+                                          MBEDTLS_PRINTF_SIZET " > %" MBEDTLS_PRINTF_SIZET,
+                                          len, i, iov[i].len, max_len));
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            } else
 #endif
-        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+            len = limit;
+            break;
+        }
+        len += iov[i].len;
     }
-#endif /* MBEDTLS_SSL_SRV_C */
 
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-    /* Determine whether renegotiation attempt should be accepted */
-    if (!(ssl->conf->disable_renegotiation == MBEDTLS_SSL_RENEGOTIATION_DISABLED ||
-          (ssl->secure_renegotiation == MBEDTLS_SSL_LEGACY_RENEGOTIATION &&
-           ssl->conf->allow_legacy_renegotiation ==
-           MBEDTLS_SSL_LEGACY_NO_RENEGOTIATION))) {
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (packed && (ret = ssl_app_packing_flush(ssl, len)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_app_packing_flush", ret);
+        return ret;
+    }
+    held = ssl->out_app_held;
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
+
+    if (ssl->out_left != 0 && queued) {
         /*
-         * Accept renegotiation request
+         * The earlier records were accepted already: send what the
+         * transport takes, and queue the new data behind the rest.
          */
+        ret = mbedtls_ssl_flush_output(ssl);
+        if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+            return ret;
+        }
 
-        /* DTLS clients need to know renego is server-initiated */
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
-            ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
-            ssl->renego_status = MBEDTLS_SSL_RENEGOTIATION_PENDING;
+        if (ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+            /* A KeyUpdate waits for the queue to drain, so let it. */
+            if (ssl->key_update & MBEDTLS_SSL_KEY_UPDATE_SEND) {
+                return ret;
+            }
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+            ssl_compact_output(ssl);
         }
-#endif
-        ret = mbedtls_ssl_start_renegotiation(ssl);
-        if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
-            ret != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_start_renegotiation",
-                                  ret);
+    }
+
+    if (ssl->out_left != 0 && !queued && !(packed && held)) {
+        /*
+         * The user has previously tried to send the data and
+         * MBEDTLS_ERR_SSL_WANT_WRITE or the message was only partially
+         * written. In this case, we expect the high-level write function
+         * (e.g. mbedtls_ssl_write()) to be called with the same parameters
+         */
+        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
             return ret;
         }
-    } else
-#endif /* MBEDTLS_SSL_RENEGOTIATION */
-    {
+
+        /* A batch may have stopped short of len when the output buffer
+         * filled up, so report what was actually protected. */
+        if (ssl->out_batch_len != 0) {
+            len = ssl->out_batch_len;
+            ssl->out_batch_len = 0;
+        }
+    } else {
         /*
-         * Refuse renegotiation
+         * The user is trying to send a message the first time, so we need to
+         * copy the data into the internal buffers and setup the data structure
+         * to keep track of partial writes.
+         *
+         * With write batching, as many records as fit in the output buffer
+         * are protected back to back and then flushed together. Only the
+         * first record needs room for the implicit sequence number in
+         * front of the header.
          */
+        const size_t record_overhead =
+            MBEDTLS_SSL_OUT_BUFFER_LEN - 8 - MBEDTLS_SSL_OUT_CONTENT_LEN;
+        size_t written = 0;
+        size_t iov_off = 0;
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+        mbedtls_ssl_pipeline *pipe = NULL;
 
-        MBEDTLS_SSL_DEBUG_MSG(3, ("refusing renegotiation, sending alert"));
+        if (max_records > 1 &&
+            ssl_pipeline_applies(ssl, ssl->transform_out, 1)) {
+            pipe = ssl_pipeline_get(&ssl->out_pipe, max_records);
+        }
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
 
-        if ((ret = mbedtls_ssl_send_alert_message(ssl,
-                                                  MBEDTLS_SSL_ALERT_LEVEL_WARNING,
-                                                  MBEDTLS_SSL_ALERT_MSG_NO_RENEGOTIATION)) != 0) {
+        i = 0;
+        do {
+            unsigned char *p = ssl->out_msg;
+            const unsigned char *src = NULL;
+            size_t chunk = len - written;
+            size_t remaining;
+
+            if (chunk > max_len) {
+                chunk = max_len;
+            }
+
+            /* Stop the batch when the next record might not fit. With
+             * the write queue, nothing fits if the first record does not
+             * fit behind those still queued. */
+            if ((written > 0 || ssl->out_left != 0) &&
+                ssl->out_buf_len - (size_t) (ssl->out_hdr - ssl->out_buf) <
+                chunk + record_overhead) {
+                if (written == 0) {
+                    return MBEDTLS_ERR_SSL_WANT_WRITE;
+                }
+                break;
+            }
+
+            /* A record that comes from a single buffer is protected
+             * straight from it, others are gathered in out_msg. */
+            while (i < iovcnt && iov[i].len == iov_off) {
+                i++;
+                iov_off = 0;
+            }
+            if (f_source != NULL) {
+                /* Read into out_msg and protect in place. */
+                ret = chunk > 0 ? f_source(p_source, p, chunk) : 0;
+                if (ret < 0 || (size_t) ret > chunk) {
+                    MBEDTLS_SSL_DEBUG_RET(1, "f_source", ret);
+                    if (written != 0) {
+                        break;
+                    }
+                    return ret < 0 ? ret : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+                }
+                if (ret == 0 && chunk > 0) {
+                    /* End of the data. */
+                    if (written != 0) {
+                        break;
+                    }
+                    return 0;
+                }
+                /* A short read makes this record the last of the call,
+                 * and a retry after WANT_WRITE must report its length. */
+                if ((size_t) ret < chunk) {
+                    chunk = (size_t) ret;
+                    len = written + chunk;
+                    ssl->out_batch_len = len;
+                }
+            } else if (chunk > 0 && iov[i].len - iov_off >= chunk) {
+                src = iov[i].base + iov_off;
+                iov_off += chunk;
+            }
+
+            for (remaining = (src != NULL || f_source != NULL) ? 0 : chunk;
+                 remaining > 0;) {
+                size_t n = iov[i].len - iov_off;
+                if (n > remaining) {
+                    n = remaining;
+                }
+                if (n > 0) {
+                    memcpy(p, iov[i].base + iov_off, n);
+                }
+                p += n;
+                remaining -= n;
+                iov_off += n;
+                if (iov_off == iov[i].len) {
+                    i++;
+                    iov_off = 0;
+                }
+            }
+
+            ssl->out_msglen  = chunk;
+            ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+            /* The records held go out with this one: if sending it fails,
+             * they are part of this write. */
+            ssl->out_app_held = 0;
+#endif
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+            if (pipe != NULL) {
+                ret = ssl_pipeline_queue_record(ssl, pipe, src);
+            } else
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+            {
+                ret = ssl_write_record_from(ssl, src,
+                                            max_records > 1 || queued ||
+                                            packed ?
+                                            SSL_DONT_FORCE_FLUSH :
+                                            SSL_FORCE_FLUSH);
+            }
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+            /* A full batch went to the asynchronous callback: the next
+             * call reports it once it is protected and sent. */
+            if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+                ssl->out_batch_len = written + chunk;
+                return ret;
+            }
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+            if (ret != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
+                return ret;
+            }
+
+            written += chunk;
+        } while (written < len);
+
+        len = written;
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+        if (pipe != NULL && (ret = ssl_pipeline_protect(ssl, pipe)) != 0) {
+            if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+                ssl->out_batch_len = len;
+                return ret;
+            }
+            MBEDTLS_SSL_DEBUG_RET(1, "ssl_pipeline_protect", ret);
             return ret;
         }
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+
+        if (queued) {
+            /* The data is taken even if it cannot all be sent yet. */
+            ret = mbedtls_ssl_flush_output(ssl);
+            if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+                return ret;
+            }
+        } else if (max_records > 1) {
+            ssl->out_batch_len = len;
+
+            if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
+                return ret;
+            }
+
+            ssl->out_batch_len = 0;
+        }
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+        else if (packed && ssl->out_left != 0) {
+            /* The datagram has room for more: hold it. */
+#if defined(MBEDTLS_HAVE_TIME)
+            if (!held) {
+                ssl->out_app_held_time = mbedtls_ms_time();
+            }
+#endif
+            ssl->out_app_held = 1;
+        }
+#endif /* MBEDTLS_SSL_PROTO_DTLS */
     }
 
-    return 0;
+    ssl->out_batch_len = 0;
+    ssl_app_data_written(ssl, len);
+
+    return (int) len;
 }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_handle_hs_message_post_handshake(mbedtls_ssl_context *ssl)
+static int ssl_write_real(mbedtls_ssl_context *ssl,
+                          const unsigned char *buf, size_t len)
 {
-    /* Check protocol version and dispatch accordingly. */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
-    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
-        return ssl_tls13_handle_hs_message_post_handshake(ssl);
-    }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+    mbedtls_ssl_iovec iov;
 
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    if (ssl->tls_version <= MBEDTLS_SSL_VERSION_TLS1_2) {
-        return ssl_tls12_handle_hs_message_post_handshake(ssl);
-    }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    iov.base = buf;
+    iov.len = len;
 
-    /* Should never happen */
-    return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    return ssl_write_real_iov(ssl, &iov, 1, NULL, NULL, 0);
 }
 
 /*
- * brief          Read at most 'len' application data bytes from the input
- *                buffer.
- *
- * param ssl      SSL context:
- *                - First byte of application data not read yet in the input
- *                  buffer located at address `in_offt`.
- *                - The number of bytes of data not read yet is `in_msglen`.
- * param buf      buffer that will hold the data
- * param len      maximum number of bytes to read
- *
- * note           The function updates the fields `in_offt` and `in_msglen`
- *                according to the number of bytes read.
- *
- * return         The number of bytes read.
+ * Make sure the context is ready to send application data: handle
+ * renegotiation and complete the handshake if necessary, or run it up to
+ * the point where the client may False Start.
  */
-static int ssl_read_application_data(
-    mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_prepare_write(mbedtls_ssl_context *ssl)
 {
-    size_t n = (len < ssl->in_msglen) ? len : ssl->in_msglen;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    if (len != 0) {
-        memcpy(buf, ssl->in_offt, n);
-        ssl->in_msglen -= n;
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    /* Nothing else is written while a batch is being protected. */
+    if ((ret = ssl_pipeline_complete(ssl)) != 0) {
+        return ret;
     }
+#endif
 
-    /* Zeroising the plaintext buffer to erase unused application data
-       from the memory. */
-    mbedtls_platform_zeroize(ssl->in_offt, n);
+    if ((ret = mbedtls_ssl_acquire_buffers(ssl)) != 0) {
+        return ret;
+    }
 
-    if (ssl->in_msglen == 0) {
-        /* all bytes consumed */
-        ssl->in_offt = NULL;
-        ssl->keep_current_message = 0;
-    } else {
-        /* more data available */
-        ssl->in_offt += n;
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    if ((ret = ssl_check_ctr_renegotiate(ssl)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
+        return ret;
+    }
+#endif
+
+    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        if ((ret = mbedtls_ssl_handshake(ssl)) != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
+            return ret;
+        }
     }
 
-    return (int) n;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if ((ret = ssl_tls13_check_key_update(ssl, 0)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_tls13_check_key_update", ret);
+        return ret;
+    }
+#endif
+
+    return 0;
 }
 
 /*
- * Receive application data decrypted from the SSL layer
+ * Write application data (public-facing wrapper)
  */
-int mbedtls_ssl_read(mbedtls_ssl_context *ssl, unsigned char *buf, size_t len)
+int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> write"));
+
     if (ssl == NULL || ssl->conf == NULL) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> read"));
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_TX) {
+        mbedtls_ssl_iovec iov;
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
-            return ret;
-        }
+        iov.base = buf;
+        iov.len = len;
 
-        if (ssl->handshake != NULL &&
-            ssl->handshake->retransmit_state == MBEDTLS_SSL_RETRANS_SENDING) {
-            if ((ret = mbedtls_ssl_flight_transmit(ssl)) != 0) {
-                return ret;
-            }
-        }
+        return ssl_ktls_write_iov(ssl, &iov, 1);
     }
-#endif
-
-    /*
-     * Check if renegotiation is necessary and/or handshake is
-     * in process. If yes, perform/continue, and fall through
-     * if an unexpected packet is received while the client
-     * is waiting for the ServerHello.
-     *
-     * (There is no equivalent to the last condition on
-     *  the server-side as it is not treated as within
-     *  a handshake while waiting for the ClientHello
-     *  after a renegotiation request.)
-     */
+#endif /* MBEDTLS_SSL_KTLS */
 
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-    ret = ssl_check_ctr_renegotiate(ssl);
-    if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
-        ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
+    if ((ret = ssl_lock(ssl)) != 0) {
         return ret;
     }
-#endif
 
-    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
-        ret = mbedtls_ssl_handshake(ssl);
-        if (ret != MBEDTLS_ERR_SSL_WAITING_SERVER_HELLO_RENEGO &&
-            ret != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
-            return ret;
-        }
+    if ((ret = ssl_prepare_write(ssl)) == 0) {
+        ret = ssl_write_real(ssl, buf, len);
     }
 
-    /* Loop as long as no application data record is available */
-    while (ssl->in_offt == NULL) {
-        /* Start timer if not already running */
-        if (ssl->f_get_timer != NULL &&
-            ssl->f_get_timer(ssl->p_timer) == -1) {
-            mbedtls_ssl_set_timer(ssl, ssl->conf->read_timeout);
-        }
-
-        if ((ret = mbedtls_ssl_read_record(ssl, 1)) != 0) {
-            if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
-                return 0;
-            }
-
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
-            return ret;
-        }
-
-        if (ssl->in_msglen  == 0 &&
-            ssl->in_msgtype == MBEDTLS_SSL_MSG_APPLICATION_DATA) {
-            /*
-             * OpenSSL sends empty messages to randomize the IV
-             */
-            if ((ret = mbedtls_ssl_read_record(ssl, 1)) != 0) {
-                if (ret == MBEDTLS_ERR_SSL_CONN_EOF) {
-                    return 0;
-                }
-
-                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
-                return ret;
-            }
-        }
+    ssl_unlock(ssl);
 
-        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_HANDSHAKE) {
-            ret = ssl_handle_hs_message_post_handshake(ssl);
-            if (ret != 0) {
-                MBEDTLS_SSL_DEBUG_RET(1, "ssl_handle_hs_message_post_handshake",
-                                      ret);
-                return ret;
-            }
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= write"));
 
-            /* At this point, we don't know whether the renegotiation triggered
-             * by the post-handshake message has been completed or not. The cases
-             * to consider are the following:
-             * 1) The renegotiation is complete. In this case, no new record
-             *    has been read yet.
-             * 2) The renegotiation is incomplete because the client received
-             *    an application data record while awaiting the ServerHello.
-             * 3) The renegotiation is incomplete because the client received
-             *    a non-handshake, non-application data message while awaiting
-             *    the ServerHello.
-             *
-             * In each of these cases, looping will be the proper action:
-             * - For 1), the next iteration will read a new record and check
-             *   if it's application data.
-             * - For 2), the loop condition isn't satisfied as application data
-             *   is present, hence continue is the same as break
-             * - For 3), the loop condition is satisfied and read_record
-             *   will re-deliver the message that was held back by the client
-             *   when expecting the ServerHello.
-             */
+    return ret;
+}
 
-            continue;
-        }
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-        else if (ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING) {
-            if (ssl->conf->renego_max_records >= 0) {
-                if (++ssl->renego_records_seen > ssl->conf->renego_max_records) {
-                    MBEDTLS_SSL_DEBUG_MSG(1, ("renegotiation requested, "
-                                              "but not honored by client"));
-                    return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
-                }
-            }
-        }
-#endif /* MBEDTLS_SSL_RENEGOTIATION */
+/*
+ * Write application data gathered from several buffers
+ */
+int mbedtls_ssl_writev(mbedtls_ssl_context *ssl,
+                       const mbedtls_ssl_iovec *iov, size_t iovcnt)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        /* Fatal and closure alerts handled by mbedtls_ssl_read_record() */
-        if (ssl->in_msgtype == MBEDTLS_SSL_MSG_ALERT) {
-            MBEDTLS_SSL_DEBUG_MSG(2, ("ignoring non-fatal non-closure alert"));
-            return MBEDTLS_ERR_SSL_WANT_READ;
-        }
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> writev"));
 
-        if (ssl->in_msgtype != MBEDTLS_SSL_MSG_APPLICATION_DATA) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("bad application data message"));
-            return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
-        }
+    if (ssl == NULL || ssl->conf == NULL ||
+        (iov == NULL && iovcnt != 0)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
 
-        ssl->in_offt = ssl->in_msg;
+#if defined(MBEDTLS_SSL_KTLS)
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_TX) {
+        return ssl_ktls_write_iov(ssl, iov, iovcnt);
+    }
+#endif /* MBEDTLS_SSL_KTLS */
 
-        /* We're going to return something now, cancel timer,
-         * except if handshake (renegotiation) is in progress */
-        if (mbedtls_ssl_is_handshake_over(ssl) == 1) {
-            mbedtls_ssl_set_timer(ssl, 0);
-        }
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
 
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        /* If we requested renego but received AppData, resend HelloRequest.
-         * Do it now, after setting in_offt, to avoid taking this branch
-         * again if ssl_write_hello_request() returns WANT_WRITE */
-#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_RENEGOTIATION)
-        if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
-            ssl->renego_status == MBEDTLS_SSL_RENEGOTIATION_PENDING) {
-            if ((ret = mbedtls_ssl_resend_hello_request(ssl)) != 0) {
-                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_resend_hello_request",
-                                      ret);
-                return ret;
-            }
-        }
-#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_RENEGOTIATION */
-#endif /* MBEDTLS_SSL_PROTO_DTLS */
+    if ((ret = ssl_prepare_write(ssl)) == 0) {
+        ret = ssl_write_real_iov(ssl, iov, iovcnt, NULL, NULL, 0);
     }
 
-    ret = ssl_read_application_data(ssl, buf, len);
+    ssl_unlock(ssl);
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= read"));
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= writev"));
 
     return ret;
 }
 
-#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_EARLY_DATA)
-int mbedtls_ssl_read_early_data(mbedtls_ssl_context *ssl,
-                                unsigned char *buf, size_t len)
+/*
+ * Write application data read by a callback
+ */
+int mbedtls_ssl_write_from(mbedtls_ssl_context *ssl,
+                           mbedtls_ssl_write_source_t *f_source,
+                           void *p_source, size_t len)
 {
-    if (ssl == NULL || (ssl->conf == NULL)) {
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("=> write from"));
+
+    if (ssl == NULL || ssl->conf == NULL || f_source == NULL) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    /*
-     * The server may receive early data only while waiting for the End of
-     * Early Data handshake message.
-     */
-    if ((ssl->state != MBEDTLS_SSL_END_OF_EARLY_DATA) ||
-        (ssl->in_offt == NULL)) {
-        return MBEDTLS_ERR_SSL_CANNOT_READ_EARLY_DATA;
+#if defined(MBEDTLS_SSL_KTLS)
+    /* There is no record to read into: the kernel builds them. */
+    if (ssl->ktls_directions & MBEDTLS_SSL_KTLS_TX) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
+
+    if ((ret = ssl_prepare_write(ssl)) == 0) {
+        ret = ssl_write_real_iov(ssl, NULL, 0, f_source, p_source, len);
     }
 
-    return ssl_read_application_data(ssl, buf, len);
+    ssl_unlock(ssl);
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= write from"));
+
+    return ret;
 }
-#endif /* MBEDTLS_SSL_SRV_C && MBEDTLS_SSL_EARLY_DATA */
+
+typedef struct {
+    mbedtls_ssl_context *src;
+    int reads;
+} ssl_relay_source;
 
 /*
- * Send application data to be encrypted by the SSL layer, taking care of max
- * fragment length and buffer size.
- *
- * According to RFC 5246 Section 6.2.1:
- *
- *      Zero-length fragments of Application data MAY be sent as they are
- *      potentially useful as a traffic analysis countermeasure.
- *
- * Therefore, it is possible that the input message length is 0 and the
- * corresponding return code is 0 on success.
+ * Read the plaintext of the relayed connection into an outgoing record.
+ * After the first read, only the data already decrypted is taken.
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_write_real(mbedtls_ssl_context *ssl,
-                          const unsigned char *buf, size_t len)
+static int ssl_relay_read(void *ctx, unsigned char *buf, size_t len)
 {
-    int ret = mbedtls_ssl_get_max_out_record_payload(ssl);
-    const size_t max_len = (size_t) ret;
+    ssl_relay_source *relay = (ssl_relay_source *) ctx;
 
-    if (ret < 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_get_max_out_record_payload", ret);
-        return ret;
+    if (relay->reads++ > 0 && mbedtls_ssl_get_bytes_avail(relay->src) == 0) {
+        return 0;
     }
 
-    if (len > max_len) {
-#if defined(MBEDTLS_SSL_PROTO_DTLS)
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("fragment larger than the (negotiated) "
-                                      "maximum fragment length: %" MBEDTLS_PRINTF_SIZET
-                                      " > %" MBEDTLS_PRINTF_SIZET,
-                                      len, max_len));
-            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-        } else
-#endif
-        len = max_len;
-    }
+    return mbedtls_ssl_read(relay->src, buf, len);
+}
 
-    if (ssl->out_left != 0) {
-        /*
-         * The user has previously tried to send the data and
-         * MBEDTLS_ERR_SSL_WANT_WRITE or the message was only partially
-         * written. In this case, we expect the high-level write function
-         * (e.g. mbedtls_ssl_write()) to be called with the same parameters
-         */
-        if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_flush_output", ret);
-            return ret;
-        }
-    } else {
-        /*
-         * The user is trying to send a message the first time, so we need to
-         * copy the data into the internal buffers and setup the data structure
-         * to keep track of partial writes
-         */
-        ssl->out_msglen  = len;
-        ssl->out_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
-        if (len > 0) {
-            memcpy(ssl->out_msg, buf, len);
-        }
+/*
+ * Relay application data from src to dst
+ */
+int mbedtls_ssl_relay(mbedtls_ssl_context *dst, mbedtls_ssl_context *src,
+                      size_t len)
+{
+    ssl_relay_source relay;
 
-        if ((ret = mbedtls_ssl_write_record(ssl, SSL_FORCE_FLUSH)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_write_record", ret);
-            return ret;
-        }
+    if (src == NULL || src == dst) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    return (int) len;
+    relay.src = src;
+    relay.reads = 0;
+
+    return mbedtls_ssl_write_from(dst, ssl_relay_read, &relay, len);
 }
 
 /*
- * Write application data (public-facing wrapper)
+ * Send the records waiting in the output buffer
  */
-int mbedtls_ssl_write(mbedtls_ssl_context *ssl, const unsigned char *buf, size_t len)
+int mbedtls_ssl_flush(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("=> write"));
-
     if (ssl == NULL || ssl->conf == NULL) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-#if defined(MBEDTLS_SSL_RENEGOTIATION)
-    if ((ret = ssl_check_ctr_renegotiate(ssl)) != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "ssl_check_ctr_renegotiate", ret);
+    if ((ret = ssl_lock(ssl)) != 0) {
         return ret;
     }
-#endif
-
-    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
-        if ((ret = mbedtls_ssl_handshake(ssl)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_handshake", ret);
-            return ret;
-        }
-    }
 
-    ret = ssl_write_real(ssl, buf, len);
+    ret = mbedtls_ssl_flush_output(ssl);
 
-    MBEDTLS_SSL_DEBUG_MSG(2, ("<= write"));
+    ssl_unlock(ssl);
 
     return ret;
 }
@@ -6182,13 +9281,23 @@ int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write close notify"));
 
+    if ((ret = ssl_lock(ssl)) != 0) {
+        return ret;
+    }
+
     if (mbedtls_ssl_is_handshake_over(ssl) == 1) {
-        if ((ret = mbedtls_ssl_send_alert_message(ssl,
-                                                  MBEDTLS_SSL_ALERT_LEVEL_WARNING,
-                                                  MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY)) != 0) {
-            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_send_alert_message", ret);
-            return ret;
-        }
+        ret = mbedtls_ssl_send_alert_message(ssl,
+                                             MBEDTLS_SSL_ALERT_LEVEL_WARNING,
+                                             MBEDTLS_SSL_ALERT_MSG_CLOSE_NOTIFY);
+    } else {
+        ret = 0;
+    }
+
+    ssl_unlock(ssl);
+
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_send_alert_message", ret);
+        return ret;
     }
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= write close notify"));
@@ -6196,6 +9305,367 @@ int mbedtls_ssl_close_notify(mbedtls_ssl_context *ssl)
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_KTLS)
+int mbedtls_ssl_ktls_export(const mbedtls_ssl_context *ssl, int direction,
+                            mbedtls_ssl_ktls_params *params)
+{
+    const mbedtls_ssl_ciphersuite_t *suite;
+    const mbedtls_ssl_transform *transform;
+    const unsigned char *key;
+    const unsigned char *iv;
+    const unsigned char *ctr;
+
+    if (ssl == NULL || ssl->conf == NULL || params == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER || ssl->handshake != NULL ||
+        ssl->session == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (direction == MBEDTLS_SSL_KTLS_TX) {
+        /* Every byte up to the next record must have been sent. */
+        if (ssl->out_left != 0 || ssl->out_batch_len != 0 ||
+            ssl->out_coalesce_len != 0) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        transform = ssl->transform_out;
+        ctr = ssl->cur_out_ctr;
+    } else if (direction == MBEDTLS_SSL_KTLS_RX) {
+        /* The kernel must see the incoming stream from a record boundary. */
+        if (ssl->in_left != 0 || mbedtls_ssl_check_pending(ssl) != 0) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        transform = ssl->transform_in;
+        ctr = (ssl->in_buf != NULL) ? ssl->in_ctr : ssl->in_ctr_saved;
+    } else {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        transform == NULL || transform->ktls_keylen == 0 ||
+        transform->taglen != 16) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    suite = mbedtls_ssl_ciphersuite_from_id(ssl->session->ciphersuite);
+    if (suite == NULL) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    memset(params, 0, sizeof(*params));
+
+    switch (suite->cipher) {
+        case MBEDTLS_CIPHER_AES_128_GCM:
+            params->cipher = MBEDTLS_SSL_KTLS_AES_128_GCM;
+            break;
+        case MBEDTLS_CIPHER_AES_256_GCM:
+            params->cipher = MBEDTLS_SSL_KTLS_AES_256_GCM;
+            break;
+        case MBEDTLS_CIPHER_CHACHA20_POLY1305:
+            params->cipher = MBEDTLS_SSL_KTLS_CHACHA20_POLY1305;
+            break;
+        default:
+            return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    if (direction == MBEDTLS_SSL_KTLS_TX) {
+        key = transform->ktls_key_enc;
+        iv = transform->iv_enc;
+    } else {
+        key = transform->ktls_key_dec;
+        iv = transform->iv_dec;
+    }
+
+    if (transform->fixed_ivlen > sizeof(params->iv)) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+
+    params->tls_version = transform->tls_version;
+    memcpy(params->key, key, transform->ktls_keylen);
+    params->key_len = transform->ktls_keylen;
+    memcpy(params->iv, iv, transform->fixed_ivlen);
+    params->iv_len = transform->fixed_ivlen;
+    memcpy(params->rec_seq, ctr, sizeof(params->rec_seq));
+
+    return 0;
+}
+
+int mbedtls_ssl_ktls_start(mbedtls_ssl_context *ssl, int directions,
+                           mbedtls_ssl_send_record_t *f_send_record,
+                           void *p_send_record)
+{
+    if (ssl == NULL || ssl->conf == NULL || directions == 0 ||
+        (directions & ~(MBEDTLS_SSL_KTLS_TX | MBEDTLS_SSL_KTLS_RX)) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((directions & MBEDTLS_SSL_KTLS_TX) != 0) {
+        if (f_send_record == NULL) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        ssl->f_ktls_send_record = f_send_record;
+        ssl->p_ktls_send_record = p_send_record;
+    }
+
+    ssl->ktls_directions |= (unsigned char) directions;
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("record protection offloaded, directions %d",
+                              ssl->ktls_directions));
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+int mbedtls_ssl_set_quic(mbedtls_ssl_context *ssl,
+                         void *p_quic,
+                         mbedtls_ssl_quic_send_t *f_send,
+                         mbedtls_ssl_quic_secrets_t *f_secrets,
+                         mbedtls_ssl_quic_alert_t *f_alert)
+{
+    if (ssl == NULL || ssl->conf == NULL ||
+        f_send == NULL || f_secrets == NULL || f_alert == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* RFC 9001, section 4.2: QUIC only uses TLS 1.3 */
+    if (ssl->conf->min_tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+        ssl->conf->max_tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+    if (ssl->conf->early_data_enabled == MBEDTLS_SSL_EARLY_DATA_ENABLED) {
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+#endif
+
+    ssl->f_quic_send = f_send;
+    ssl->f_quic_secrets = f_secrets;
+    ssl->f_quic_alert = f_alert;
+    ssl->p_quic = p_quic;
+
+    return 0;
+}
+
+static mbedtls_ssl_quic_level ssl_quic_level(
+    const mbedtls_ssl_context *ssl, const mbedtls_ssl_transform *transform)
+{
+    if (transform == NULL) {
+        return MBEDTLS_SSL_QUIC_LEVEL_INITIAL;
+    }
+
+    if (ssl->handshake != NULL) {
+        if (transform == ssl->handshake->transform_handshake) {
+            return MBEDTLS_SSL_QUIC_LEVEL_HANDSHAKE;
+        }
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        if (transform == ssl->handshake->transform_earlydata) {
+            return MBEDTLS_SSL_QUIC_LEVEL_EARLY_DATA;
+        }
+#endif
+    }
+
+    return MBEDTLS_SSL_QUIC_LEVEL_APPLICATION;
+}
+
+mbedtls_ssl_quic_level mbedtls_ssl_quic_read_level(
+    const mbedtls_ssl_context *ssl)
+{
+    return ssl_quic_level(ssl, ssl->transform_in);
+}
+
+mbedtls_ssl_quic_level mbedtls_ssl_quic_write_level(
+    const mbedtls_ssl_context *ssl)
+{
+    return ssl_quic_level(ssl, ssl->transform_out);
+}
+
+int mbedtls_ssl_quic_provide_data(mbedtls_ssl_context *ssl,
+                                  mbedtls_ssl_quic_level level,
+                                  const unsigned char *buf, size_t len)
+{
+    unsigned char *in;
+    size_t in_len;
+
+    if (ssl == NULL || !mbedtls_ssl_is_quic(ssl) ||
+        (unsigned) level >= MBEDTLS_SSL_QUIC_LEVELS ||
+        (buf == NULL && len != 0)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    in_len = ssl->quic_in_len[level];
+    if (len > MBEDTLS_SSL_QUIC_MAX_BUFFERING - in_len) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("too much handshake data buffered"));
+        return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+    }
+
+    if (len == 0) {
+        return 0;
+    }
+
+    in = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, in_len + len);
+    if (in == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    if (in_len != 0) {
+        memcpy(in, ssl->quic_in[level], in_len);
+    }
+    memcpy(in + in_len, buf, len);
+
+    mbedtls_free(ssl->quic_in[level]);
+    ssl->quic_in[level] = in;
+    ssl->quic_in_len[level] = in_len + len;
+
+    return 0;
+}
+
+int mbedtls_ssl_quic_write_message(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_quic_level level = mbedtls_ssl_quic_write_level(ssl);
+
+    switch (ssl->out_msgtype) {
+        case MBEDTLS_SSL_MSG_HANDSHAKE:
+            break;
+
+        case MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC:
+            /* The dummy ChangeCipherSpec of TLS 1.3 has no place in QUIC,
+             * RFC 9001 section 8.4. */
+            MBEDTLS_SSL_DEBUG_MSG(3, ("skip ChangeCipherSpec over QUIC"));
+            return 0;
+
+        default:
+            MBEDTLS_SSL_DEBUG_MSG(1, ("only handshake messages go over QUIC"));
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("output handshake data: level = %u, "
+                              "len = %" MBEDTLS_PRINTF_SIZET,
+                              (unsigned) level, ssl->out_msglen));
+    MBEDTLS_SSL_DEBUG_BUF(4, "output handshake data",
+                          ssl->out_msg, ssl->out_msglen);
+
+    ret = ssl->f_quic_send(ssl->p_quic, level, ssl->out_msg, ssl->out_msglen);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_quic_send", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_quic_read_message(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_quic_level level = mbedtls_ssl_quic_read_level(ssl);
+    unsigned char *in = ssl->quic_in[level];
+    size_t in_len = ssl->quic_in_len[level];
+    size_t msg_len;
+
+    if (in_len < 4) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    msg_len = 4 + MBEDTLS_GET_UINT24_BE(in, 1);
+    if (msg_len > mbedtls_ssl_in_content_len(ssl)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("handshake message too long: %"
+                                  MBEDTLS_PRINTF_SIZET, msg_len));
+        return MBEDTLS_ERR_SSL_INVALID_RECORD;
+    }
+
+    if (in_len < msg_len) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    mbedtls_ssl_update_in_pointers(ssl);
+    memcpy(ssl->in_msg, in, msg_len);
+    ssl->in_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
+    ssl->in_msglen = msg_len;
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("input handshake data: level = %u, "
+                              "len = %" MBEDTLS_PRINTF_SIZET,
+                              (unsigned) level, msg_len));
+
+    /* Keep the rest for the next messages, and free the buffer once it is
+     * all processed. */
+    in_len -= msg_len;
+    if (in_len == 0) {
+        mbedtls_free(in);
+        ssl->quic_in[level] = NULL;
+    } else {
+        memmove(in, in + msg_len, in_len);
+    }
+    ssl->quic_in_len[level] = in_len;
+
+    return 0;
+}
+
+int mbedtls_ssl_quic_set_secrets(mbedtls_ssl_context *ssl,
+                                 mbedtls_ssl_quic_level level,
+                                 const unsigned char *client_secret,
+                                 const unsigned char *server_secret,
+                                 size_t secret_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const int is_client = ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT;
+
+    if (!mbedtls_ssl_is_quic(ssl)) {
+        return 0;
+    }
+
+    ret = ssl->f_quic_secrets(ssl->p_quic, level,
+                              ssl->handshake->ciphersuite_info->id,
+                              is_client ? server_secret : client_secret,
+                              is_client ? client_secret : server_secret,
+                              secret_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_quic_secrets", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+int mbedtls_ssl_set_quic_transport_params(mbedtls_ssl_context *ssl,
+                                          const unsigned char *params,
+                                          size_t len)
+{
+    unsigned char *tp = NULL;
+
+    /* The extension data is all of it, after a 4-byte header */
+    if (ssl == NULL || (params == NULL && len != 0) ||
+        len > 0xFFFF - 4) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (len != 0) {
+        tp = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, len);
+        if (tp == NULL) {
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        memcpy(tp, params, len);
+    }
+
+    mbedtls_free(ssl->quic_tp);
+    ssl->quic_tp = tp;
+    ssl->quic_tp_len = len;
+
+    return 0;
+}
+
+void mbedtls_ssl_get_peer_quic_transport_params(const mbedtls_ssl_context *ssl,
+                                                const unsigned char **params,
+                                                size_t *len)
+{
+    *params = ssl->quic_peer_tp;
+    *len = ssl->quic_peer_tp_len;
+}
+#endif /* MBEDTLS_SSL_QUIC */
+
 void mbedtls_ssl_transform_free(mbedtls_ssl_transform *transform)
 {
     if (transform == NULL) {
@@ -6214,6 +9684,10 @@ void mbedtls_ssl_transform_free(mbedtls_ssl_transform *transform)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_destroy_key(transform->psa_mac_enc);
     psa_destroy_key(transform->psa_mac_dec);
+    psa_hash_abort(&transform->psa_mac_enc_inner);
+    psa_hash_abort(&transform->psa_mac_enc_outer);
+    psa_hash_abort(&transform->psa_mac_dec_inner);
+    psa_hash_abort(&transform->psa_mac_dec_outer);
 #else
     mbedtls_md_free(&transform->md_ctx_enc);
     mbedtls_md_free(&transform->md_ctx_dec);
@@ -6266,8 +9740,7 @@ static void ssl_buffering_free_slot(mbedtls_ssl_context *ssl,
     }
 
     if (hs_buf->is_valid == 1) {
-        hs->buffering.total_bytes_buffered -= hs_buf->data_len;
-        mbedtls_zeroize_and_free(hs_buf->data, hs_buf->data_len);
+        ssl_buffering_release(hs, hs_buf->data, hs_buf->data_len);
         memset(hs_buf, 0, sizeof(mbedtls_ssl_hs_buffer));
     }
 }
@@ -0,0 +1,244 @@
+/*
+ *  Table of peer certificate chains shared between SSL sessions
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A hash table of the shared chains of mbedtls_ssl_peer_cert_ref, chained
+ * through their table_next field and keyed by a SHA-256 hash of their DER
+ * certificates. The table does not hold a reference: a chain is unlinked
+ * when its last reference is released. To make that safe against a
+ * concurrent lookup, the reference counts of interned chains are protected
+ * by the table mutex rather than by their own.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_peer_cert_table.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+
+#include <string.h>
+
+/* Buckets are pointers, so this caps the array at 64 MiB on 32-bit
+ * platforms, which is already one bucket per certificate of far more peers
+ * than a server keeps sessions for. */
+#define SSL_PEER_CERT_TABLE_MAX_BUCKETS (1u << 24)
+
+void mbedtls_ssl_peer_cert_table_init(mbedtls_ssl_peer_cert_table *table)
+{
+    memset(table, 0, sizeof(mbedtls_ssl_peer_cert_table));
+}
+
+int mbedtls_ssl_peer_cert_table_setup(mbedtls_ssl_peer_cert_table *table,
+                                      size_t num_buckets)
+{
+    size_t n = 1;
+
+    if (table->buckets != NULL || num_buckets == 0 ||
+        num_buckets > SSL_PEER_CERT_TABLE_MAX_BUCKETS) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < num_buckets) {
+        n <<= 1;
+    }
+
+    table->buckets = mbedtls_calloc_tagged(SSL_CACHE, n,
+                                           sizeof(struct mbedtls_ssl_peer_cert_ref *));
+    if (table->buckets == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    table->mask = n - 1;
+    table->count = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&table->mutex);
+#endif
+
+    return 0;
+}
+
+/*
+ * Hash the DER certificates of a chain, each preceded by its length so
+ * that different chains cannot have the same input.
+ */
+static int ssl_peer_cert_table_digest(const mbedtls_x509_crt *chain,
+                                      unsigned char *digest)
+{
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+    psa_status_t status;
+    const mbedtls_x509_crt *crt;
+    unsigned char len[4];
+    size_t digest_len;
+
+    status = psa_hash_setup(&operation, PSA_ALG_SHA_256);
+    for (crt = chain; status == PSA_SUCCESS && crt != NULL; crt = crt->next) {
+        MBEDTLS_PUT_UINT32_BE(crt->raw.len, len, 0);
+        status = psa_hash_update(&operation, len, sizeof(len));
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, crt->raw.p, crt->raw.len);
+        }
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_finish(&operation, digest,
+                                 PSA_HASH_LENGTH(PSA_ALG_SHA_256), &digest_len);
+    }
+    if (status != PSA_SUCCESS) {
+        psa_hash_abort(&operation);
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    return 0;
+}
+
+/* Do not rely on the hash alone: compare the certificates. */
+static int ssl_peer_cert_table_chain_eq(const mbedtls_x509_crt *a,
+                                        const mbedtls_x509_crt *b)
+{
+    for (; a != NULL && b != NULL; a = a->next, b = b->next) {
+        if (a->raw.len != b->raw.len ||
+            memcmp(a->raw.p, b->raw.p, a->raw.len) != 0) {
+            return 0;
+        }
+    }
+
+    return a == NULL && b == NULL;
+}
+
+static struct mbedtls_ssl_peer_cert_ref **ssl_peer_cert_table_bucket(
+    mbedtls_ssl_peer_cert_table *table, const unsigned char *digest)
+{
+    return &table->buckets[MBEDTLS_GET_UINT32_LE(digest, 0) & table->mask];
+}
+
+int mbedtls_ssl_peer_cert_table_intern(mbedtls_ssl_peer_cert_table *table,
+                                       mbedtls_x509_crt *chain,
+                                       struct mbedtls_ssl_peer_cert_ref **ref)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char digest[PSA_HASH_LENGTH(PSA_ALG_SHA_256)];
+    struct mbedtls_ssl_peer_cert_ref **bucket, *cur;
+
+    if (table->buckets == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_peer_cert_table_digest(chain, digest)) != 0) {
+        return ret;
+    }
+    bucket = ssl_peer_cert_table_bucket(table, digest);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&table->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    for (cur = *bucket; cur != NULL; cur = cur->table_next) {
+        if (memcmp(cur->digest, digest, sizeof(digest)) == 0 &&
+            ssl_peer_cert_table_chain_eq(&cur->crt, chain)) {
+            break;
+        }
+    }
+
+    if (cur != NULL) {
+        cur->refs++;
+    } else if ((ret = mbedtls_ssl_peer_cert_ref_new(chain, &cur)) == 0) {
+        chain = NULL;
+        cur->table = table;
+        memcpy(cur->digest, digest, sizeof(digest));
+        cur->table_next = *bucket;
+        *bucket = cur;
+        table->count++;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&table->mutex);
+#endif
+
+    if (cur == NULL) {
+        return ret;
+    }
+
+    /* The same chain was already there: drop this copy. */
+    if (chain != NULL) {
+        mbedtls_x509_crt_free(chain);
+        mbedtls_free(chain);
+    }
+
+    *ref = cur;
+
+    return 0;
+}
+
+void mbedtls_ssl_peer_cert_table_remove(mbedtls_ssl_peer_cert_table *table,
+                                        struct mbedtls_ssl_peer_cert_ref *ref)
+{
+    struct mbedtls_ssl_peer_cert_ref **p;
+
+    for (p = ssl_peer_cert_table_bucket(table, ref->digest); *p != NULL;
+         p = &(*p)->table_next) {
+        if (*p == ref) {
+            *p = ref->table_next;
+            table->count--;
+            break;
+        }
+    }
+
+    ref->table = NULL;
+    ref->table_next = NULL;
+}
+
+size_t mbedtls_ssl_peer_cert_table_count(mbedtls_ssl_peer_cert_table *table)
+{
+    size_t count;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&table->mutex) != 0) {
+        return 0;
+    }
+#endif
+    count = table->count;
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&table->mutex);
+#endif
+
+    return count;
+}
+
+void mbedtls_ssl_peer_cert_table_free(mbedtls_ssl_peer_cert_table *table)
+{
+    struct mbedtls_ssl_peer_cert_ref *cur, *next;
+    size_t i;
+
+    if (table == NULL) {
+        return;
+    }
+
+    /* Detach the chains still in use, which then count their own
+     * references. */
+    if (table->buckets != NULL) {
+        for (i = 0; i <= table->mask; i++) {
+            for (cur = table->buckets[i]; cur != NULL; cur = next) {
+                next = cur->table_next;
+                cur->table = NULL;
+                cur->table_next = NULL;
+            }
+        }
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&table->mutex);
+#endif
+    }
+
+    mbedtls_free(table->buckets);
+
+    mbedtls_platform_zeroize(table, sizeof(mbedtls_ssl_peer_cert_table));
+}
+
+#endif /* MBEDTLS_SSL_PEER_CERT_TABLE_C */
@@ -0,0 +1,233 @@
+/*
+ *  Server pre-shared keys by identity
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A chained hash table of identities. Each entry is a single allocation:
+ * the entry, then its identity, then its raw key if it has one, so that a
+ * store of millions of identities costs one block each.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_PSK_STORE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_psk_store.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+/* Buckets are pointers, so this caps the array at 1 GiB on 32-bit
+ * platforms. PSKs are provisioned per device, and a server may know many
+ * devices, so this bound is higher than for the other tables. */
+#define SSL_PSK_STORE_MAX_BUCKETS (1u << 28)
+
+struct mbedtls_ssl_psk_store_entry {
+    struct mbedtls_ssl_psk_store_entry *next;   /*!< next entry of the bucket */
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    mbedtls_svc_key_id_t key;                   /*!< opaque key, or null */
+#endif
+    uint16_t identity_len;
+    uint16_t psk_len;                           /*!< 0 for an opaque key */
+};
+
+#define SSL_PSK_STORE_IDENTITY(entry) ((unsigned char *) ((entry) + 1))
+#define SSL_PSK_STORE_PSK(entry)                                \
+    (SSL_PSK_STORE_IDENTITY(entry) + (entry)->identity_len)
+
+/* FNV-1a of the identity. */
+static uint32_t ssl_psk_store_hash(const unsigned char *identity,
+                                   size_t identity_len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, identity, identity_len);
+}
+
+static struct mbedtls_ssl_psk_store_entry *ssl_psk_store_find(
+    const mbedtls_ssl_psk_store *store,
+    const unsigned char *identity, size_t identity_len)
+{
+    struct mbedtls_ssl_psk_store_entry *cur;
+
+    if (store->buckets == NULL) {
+        return NULL;
+    }
+
+    cur = store->buckets[ssl_psk_store_hash(identity, identity_len) &
+                         store->mask];
+    for (; cur != NULL; cur = cur->next) {
+        if (cur->identity_len == identity_len &&
+            memcmp(SSL_PSK_STORE_IDENTITY(cur), identity, identity_len) == 0) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+void mbedtls_ssl_psk_store_init(mbedtls_ssl_psk_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_ssl_psk_store));
+}
+
+int mbedtls_ssl_psk_store_setup(mbedtls_ssl_psk_store *store,
+                                size_t num_buckets)
+{
+    size_t n = 1;
+
+    if (store->buckets != NULL || num_buckets == 0 ||
+        num_buckets > SSL_PSK_STORE_MAX_BUCKETS) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < num_buckets) {
+        n <<= 1;
+    }
+
+    store->buckets = mbedtls_calloc_tagged(SSL_CACHE, n,
+                                           sizeof(struct mbedtls_ssl_psk_store_entry *));
+    if (store->buckets == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    store->mask = n - 1;
+    store->count = 0;
+
+    return 0;
+}
+
+/* Insert a new entry for identity, with room for psk_len bytes of key. */
+static int ssl_psk_store_insert(mbedtls_ssl_psk_store *store,
+                                const unsigned char *identity,
+                                size_t identity_len, size_t psk_len,
+                                struct mbedtls_ssl_psk_store_entry **entry)
+{
+    struct mbedtls_ssl_psk_store_entry **bucket;
+
+    if (store->buckets == NULL || identity_len == 0 ||
+        identity_len > 0xFFFF ||
+        ssl_psk_store_find(store, identity, identity_len) != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    *entry = mbedtls_calloc_tagged(SSL_CACHE, 1,
+                                   sizeof(struct mbedtls_ssl_psk_store_entry) +
+                                   identity_len + psk_len);
+    if (*entry == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    (*entry)->identity_len = (uint16_t) identity_len;
+    (*entry)->psk_len = (uint16_t) psk_len;
+    memcpy(SSL_PSK_STORE_IDENTITY(*entry), identity, identity_len);
+
+    bucket = &store->buckets[ssl_psk_store_hash(identity, identity_len) &
+                             store->mask];
+    (*entry)->next = *bucket;
+    *bucket = *entry;
+    store->count++;
+
+    return 0;
+}
+
+int mbedtls_ssl_psk_store_add(mbedtls_ssl_psk_store *store,
+                              const unsigned char *identity,
+                              size_t identity_len,
+                              const unsigned char *psk, size_t psk_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct mbedtls_ssl_psk_store_entry *entry;
+
+    if (psk == NULL || psk_len == 0 || psk_len > MBEDTLS_PSK_MAX_LEN) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_psk_store_insert(store, identity, identity_len, psk_len,
+                                    &entry)) != 0) {
+        return ret;
+    }
+    memcpy(SSL_PSK_STORE_PSK(entry), psk, psk_len);
+
+    return 0;
+}
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+int mbedtls_ssl_psk_store_add_opaque(mbedtls_ssl_psk_store *store,
+                                     const unsigned char *identity,
+                                     size_t identity_len,
+                                     mbedtls_svc_key_id_t psk)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    struct mbedtls_ssl_psk_store_entry *entry;
+
+    if (mbedtls_svc_key_id_is_null(psk)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_psk_store_insert(store, identity, identity_len, 0,
+                                    &entry)) != 0) {
+        return ret;
+    }
+    entry->key = psk;
+
+    return 0;
+}
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+int mbedtls_ssl_psk_store_cb(void *p_store, mbedtls_ssl_context *ssl,
+                             const unsigned char *identity,
+                             size_t identity_len)
+{
+    const struct mbedtls_ssl_psk_store_entry *entry;
+
+    entry = ssl_psk_store_find(p_store, identity, identity_len);
+    if (entry == NULL) {
+        return MBEDTLS_ERR_SSL_UNKNOWN_IDENTITY;
+    }
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    if (entry->psk_len == 0) {
+        return mbedtls_ssl_set_hs_psk_opaque(ssl, entry->key);
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        return mbedtls_ssl_set_hs_psk_borrowed(ssl, SSL_PSK_STORE_PSK(entry),
+                                               entry->psk_len);
+    }
+#endif
+
+    return mbedtls_ssl_set_hs_psk(ssl, SSL_PSK_STORE_PSK(entry),
+                                  entry->psk_len);
+}
+
+void mbedtls_ssl_psk_store_free(mbedtls_ssl_psk_store *store)
+{
+    struct mbedtls_ssl_psk_store_entry *cur, *next;
+    size_t i;
+
+    if (store == NULL) {
+        return;
+    }
+
+    if (store->buckets != NULL) {
+        for (i = 0; i <= store->mask; i++) {
+            for (cur = store->buckets[i]; cur != NULL; cur = next) {
+                next = cur->next;
+                mbedtls_zeroize_and_free(cur,
+                                         sizeof(struct mbedtls_ssl_psk_store_entry) +
+                                         cur->identity_len + cur->psk_len);
+            }
+        }
+    }
+
+    mbedtls_free(store->buckets);
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_ssl_psk_store));
+}
+
+#endif /* MBEDTLS_SSL_PSK_STORE_C */
@@ -0,0 +1,641 @@
+/*
+ *  Client-side store of the sessions to resume, by server
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A fixed array of entries, one per server, reached through a chained hash
+ * table on the (port, name, ALPN) key and ordered by a doubly linked LRU
+ * list. Links are indices into the array, so setup is the only allocation
+ * besides the keys and the serialized sessions.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_session_store.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "debug_internal.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+/* Entries are found by uint32_t index, but each holds
+ * MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS sessions, so memory runs out long
+ * before the index does. A client does not resume with more servers. */
+#define SSL_SESSION_STORE_MAX_ENTRIES (1u << 20)
+
+#define SSL_SESSION_STORE_NONE UINT32_MAX
+
+/* Port, then name and protocol, each with a one-byte length. */
+#define SSL_SESSION_STORE_MAX_KEY_LEN (2 + 1 + 255 + 1 + 255)
+
+void mbedtls_ssl_session_store_init(mbedtls_ssl_session_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_ssl_session_store));
+
+    store->timeout = MBEDTLS_SSL_SESSION_STORE_DEFAULT_TIMEOUT;
+    store->free_head = SSL_SESSION_STORE_NONE;
+    store->lru_head = SSL_SESSION_STORE_NONE;
+    store->lru_tail = SSL_SESSION_STORE_NONE;
+}
+
+int mbedtls_ssl_session_store_setup(mbedtls_ssl_session_store *store,
+                                    size_t max_entries)
+{
+    size_t n = 1;
+    size_t i;
+
+    if (store->entries != NULL || max_entries == 0 ||
+        max_entries > SSL_SESSION_STORE_MAX_ENTRIES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < max_entries) {
+        n <<= 1;
+    }
+
+    store->entries = mbedtls_calloc(max_entries,
+                                    sizeof(mbedtls_ssl_session_store_entry));
+    store->buckets = mbedtls_calloc(n, sizeof(uint32_t));
+    if (store->entries == NULL || store->buckets == NULL) {
+        mbedtls_free(store->entries);
+        mbedtls_free(store->buckets);
+        store->entries = NULL;
+        store->buckets = NULL;
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    for (i = 0; i < n; i++) {
+        store->buckets[i] = SSL_SESSION_STORE_NONE;
+    }
+    store->mask = (uint32_t) (n - 1);
+    store->max_entries = (uint32_t) max_entries;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&store->mutex);
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_session_store_set_timeout(mbedtls_ssl_session_store *store,
+                                           uint32_t timeout)
+{
+    store->timeout = timeout;
+}
+
+static int ssl_session_store_key(const char *name, uint16_t port,
+                                 const char *alpn, unsigned char *key,
+                                 size_t *key_len)
+{
+    size_t name_len, alpn_len;
+
+    if (name == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    name_len = strlen(name);
+    alpn_len = alpn != NULL ? strlen(alpn) : 0;
+    if (name_len > 255 || alpn_len > 255) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    MBEDTLS_PUT_UINT16_BE(port, key, 0);
+    key[2] = (unsigned char) name_len;
+    memcpy(key + 3, name, name_len);
+    key[3 + name_len] = (unsigned char) alpn_len;
+    if (alpn_len != 0) {
+        memcpy(key + 4 + name_len, alpn, alpn_len);
+    }
+    *key_len = 4 + name_len + alpn_len;
+
+    return 0;
+}
+
+/* FNV-1a, as for the group cache. */
+static uint32_t ssl_session_store_hash(const unsigned char *key,
+                                       size_t key_len)
+{
+    return mbedtls_fnv1a32(MBEDTLS_FNV1A32_INIT, key, key_len);
+}
+
+static uint32_t ssl_session_store_find(const mbedtls_ssl_session_store *store,
+                                       uint32_t hash,
+                                       const unsigned char *key,
+                                       size_t key_len)
+{
+    uint32_t i = store->buckets[hash & store->mask];
+
+    while (i != SSL_SESSION_STORE_NONE) {
+        const mbedtls_ssl_session_store_entry *entry = &store->entries[i];
+
+        if (entry->hash == hash && entry->key_len == key_len &&
+            memcmp(entry->key, key, key_len) == 0) {
+            return i;
+        }
+        i = entry->bucket_next;
+    }
+
+    return SSL_SESSION_STORE_NONE;
+}
+
+static void ssl_session_store_lru_unlink(mbedtls_ssl_session_store *store,
+                                         uint32_t i)
+{
+    mbedtls_ssl_session_store_entry *entry = &store->entries[i];
+
+    if (entry->lru_prev != SSL_SESSION_STORE_NONE) {
+        store->entries[entry->lru_prev].lru_next = entry->lru_next;
+    } else {
+        store->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != SSL_SESSION_STORE_NONE) {
+        store->entries[entry->lru_next].lru_prev = entry->lru_prev;
+    } else {
+        store->lru_tail = entry->lru_prev;
+    }
+}
+
+static void ssl_session_store_lru_push(mbedtls_ssl_session_store *store,
+                                       uint32_t i)
+{
+    mbedtls_ssl_session_store_entry *entry = &store->entries[i];
+
+    entry->lru_prev = SSL_SESSION_STORE_NONE;
+    entry->lru_next = store->lru_head;
+    if (store->lru_head != SSL_SESSION_STORE_NONE) {
+        store->entries[store->lru_head].lru_prev = i;
+    } else {
+        store->lru_tail = i;
+    }
+    store->lru_head = i;
+}
+
+static void ssl_session_store_touch(mbedtls_ssl_session_store *store,
+                                    uint32_t i)
+{
+    if (store->lru_head != i) {
+        ssl_session_store_lru_unlink(store, i);
+        ssl_session_store_lru_push(store, i);
+    }
+}
+
+static void ssl_session_store_slot_free(mbedtls_ssl_session_store_slot *slot)
+{
+    if (slot->data != NULL) {
+        mbedtls_zeroize_and_free(slot->data, slot->len);
+    }
+    memset(slot, 0, sizeof(mbedtls_ssl_session_store_slot));
+}
+
+/* Drop the slot at index n of the entry, keeping the others in order. */
+static void ssl_session_store_drop(mbedtls_ssl_session_store_entry *entry,
+                                   uint8_t n)
+{
+    ssl_session_store_slot_free(&entry->slots[n]);
+    memmove(&entry->slots[n], &entry->slots[n + 1],
+            (size_t) (entry->count - n - 1) *
+            sizeof(mbedtls_ssl_session_store_slot));
+    entry->count--;
+    memset(&entry->slots[entry->count], 0,
+           sizeof(mbedtls_ssl_session_store_slot));
+}
+
+static void ssl_session_store_release(mbedtls_ssl_session_store *store,
+                                      uint32_t i)
+{
+    mbedtls_ssl_session_store_entry *entry = &store->entries[i];
+    uint32_t *link = &store->buckets[entry->hash & store->mask];
+
+    while (*link != i) {
+        link = &store->entries[*link].bucket_next;
+    }
+    *link = entry->bucket_next;
+
+    ssl_session_store_lru_unlink(store, i);
+
+    while (entry->count > 0) {
+        ssl_session_store_drop(entry, entry->count - 1);
+    }
+    mbedtls_free(entry->key);
+    memset(entry, 0, sizeof(mbedtls_ssl_session_store_entry));
+
+    entry->bucket_next = store->free_head;
+    store->free_head = i;
+}
+
+static int ssl_session_store_alloc(mbedtls_ssl_session_store *store,
+                                   uint32_t hash,
+                                   const unsigned char *key,
+                                   size_t key_len,
+                                   uint32_t *index)
+{
+    mbedtls_ssl_session_store_entry *entry;
+    uint32_t i;
+    unsigned char *key_copy = mbedtls_calloc(1, key_len);
+
+    if (key_copy == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    memcpy(key_copy, key, key_len);
+
+    if (store->free_head == SSL_SESSION_STORE_NONE) {
+        if (store->used < store->max_entries) {
+            store->entries[store->used].bucket_next = store->free_head;
+            store->free_head = store->used++;
+        } else {
+            ssl_session_store_release(store, store->lru_tail);
+        }
+    }
+
+    i = store->free_head;
+    entry = &store->entries[i];
+    store->free_head = entry->bucket_next;
+
+    entry->key = key_copy;
+    entry->key_len = key_len;
+    entry->hash = hash;
+    entry->bucket_next = store->buckets[hash & store->mask];
+    store->buckets[hash & store->mask] = i;
+    ssl_session_store_lru_push(store, i);
+
+    *index = i;
+    return 0;
+}
+
+static void ssl_session_store_expire(mbedtls_ssl_session_store_entry *entry,
+                                     mbedtls_ms_time_t now)
+{
+    uint8_t n = 0;
+
+    while (n < entry->count) {
+        if (entry->slots[n].expiry <= now) {
+            ssl_session_store_drop(entry, n);
+        } else {
+            n++;
+        }
+    }
+}
+
+/* Time at which a session can no longer be resumed, or an error if it
+ * cannot be resumed at all. */
+static int ssl_session_store_expiry(const mbedtls_ssl_session *session,
+                                    uint32_t timeout,
+                                    mbedtls_ms_time_t now,
+                                    mbedtls_ms_time_t *expiry)
+{
+    mbedtls_ms_time_t start = now;
+    uint32_t lifetime = timeout;
+    int resumable = 0;
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    if (session->ticket != NULL && session->ticket_len != 0) {
+        resumable = 1;
+        if (session->ticket_lifetime != 0 &&
+            session->ticket_lifetime < lifetime) {
+            lifetime = session->ticket_lifetime;
+        }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+            start = session->ticket_reception_time;
+        }
+#endif
+    }
+#endif /* MBEDTLS_SSL_SESSION_TICKETS */
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (session->tls_version == MBEDTLS_SSL_VERSION_TLS1_2 &&
+        session->id_len != 0) {
+        resumable = 1;
+    }
+#endif
+
+    if (!resumable || lifetime == 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    *expiry = start + (mbedtls_ms_time_t) lifetime * 1000;
+    return 0;
+}
+
+int mbedtls_ssl_session_store_get(mbedtls_ssl_session_store *store,
+                                  const char *name, uint16_t port,
+                                  const char *alpn,
+                                  mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[SSL_SESSION_STORE_MAX_KEY_LEN];
+    size_t key_len;
+    uint32_t hash, i;
+    mbedtls_ssl_session_store_entry *entry;
+    mbedtls_ssl_session_store_slot *slot;
+
+    if (store->entries == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_session_store_key(name, port, alpn, key, &key_len)) != 0) {
+        return ret;
+    }
+    hash = ssl_session_store_hash(key, key_len);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    i = ssl_session_store_find(store, hash, key, key_len);
+    if (i == SSL_SESSION_STORE_NONE) {
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+
+    entry = &store->entries[i];
+    ssl_session_store_expire(entry, mbedtls_ms_time());
+    if (entry->count == 0) {
+        ssl_session_store_release(store, i);
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+        goto exit;
+    }
+
+    /* The most recent session, which is the last to expire. */
+    slot = &entry->slots[entry->count - 1];
+    ret = mbedtls_ssl_session_unpack(session,
+                                     MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
+                                     slot->data, slot->len);
+
+    /* A TLS 1.3 ticket is used once; a slot that does not load is dropped
+     * as well. */
+    if (ret != 0 || entry->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        ssl_session_store_drop(entry, entry->count - 1);
+    }
+    if (entry->count == 0) {
+        ssl_session_store_release(store, i);
+    } else {
+        ssl_session_store_touch(store, i);
+    }
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_session_store_set(mbedtls_ssl_session_store *store,
+                                  const char *name, uint16_t port,
+                                  const char *alpn,
+                                  const mbedtls_ssl_session *session)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[SSL_SESSION_STORE_MAX_KEY_LEN];
+    size_t key_len, data_len = 0;
+    uint32_t hash, i;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+    mbedtls_ms_time_t expiry;
+    mbedtls_ssl_session_store_entry *entry;
+    mbedtls_ssl_session_store_slot *slot;
+    unsigned char *data = NULL;
+
+    if (store->entries == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_session_store_key(name, port, alpn, key, &key_len)) != 0) {
+        return ret;
+    }
+    if ((ret = ssl_session_store_expiry(session, store->timeout, now,
+                                        &expiry)) != 0) {
+        return ret;
+    }
+    if (expiry <= now) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* Serialize outside of the lock. */
+    ret = mbedtls_ssl_session_pack(session, MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
+                                   NULL, 0, &data_len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return ret != 0 ? ret : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+    data = mbedtls_calloc(1, data_len);
+    if (data == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    ret = mbedtls_ssl_session_pack(session, MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
+                                   data, data_len, &data_len);
+    if (ret != 0) {
+        mbedtls_zeroize_and_free(data, data_len);
+        return ret;
+    }
+
+    hash = ssl_session_store_hash(key, key_len);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        mbedtls_zeroize_and_free(data, data_len);
+        return ret;
+    }
+#endif
+
+    i = ssl_session_store_find(store, hash, key, key_len);
+    if (i == SSL_SESSION_STORE_NONE) {
+        ret = ssl_session_store_alloc(store, hash, key, key_len, &i);
+        if (ret != 0) {
+            goto exit;
+        }
+    } else {
+        ssl_session_store_touch(store, i);
+    }
+
+    entry = &store->entries[i];
+    ssl_session_store_expire(entry, now);
+
+    /* A TLS 1.2 session replaces the previous one, and a change of version
+     * makes the older sessions useless. */
+    if (session->tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+        entry->tls_version != MBEDTLS_SSL_VERSION_TLS1_3) {
+        while (entry->count > 0) {
+            ssl_session_store_drop(entry, entry->count - 1);
+        }
+    }
+    if (entry->count == MBEDTLS_SSL_SESSION_STORE_MAX_TICKETS) {
+        ssl_session_store_drop(entry, 0);
+    }
+
+    entry->tls_version = (uint16_t) session->tls_version;
+    slot = &entry->slots[entry->count++];
+    slot->data = data;
+    slot->len = data_len;
+    slot->expiry = expiry;
+    data = NULL;
+    ret = 0;
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (data != NULL) {
+        mbedtls_zeroize_and_free(data, data_len);
+    }
+
+    return ret;
+}
+
+int mbedtls_ssl_session_store_remove(mbedtls_ssl_session_store *store,
+                                     const char *name, uint16_t port,
+                                     const char *alpn)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char key[SSL_SESSION_STORE_MAX_KEY_LEN];
+    size_t key_len;
+    uint32_t hash, i;
+
+    if (store->entries == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if ((ret = ssl_session_store_key(name, port, alpn, key, &key_len)) != 0) {
+        return ret;
+    }
+    hash = ssl_session_store_hash(key, key_len);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&store->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    i = ssl_session_store_find(store, hash, key, key_len);
+    if (i == SSL_SESSION_STORE_NONE) {
+        ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    } else {
+        ssl_session_store_release(store, i);
+        ret = 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&store->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+/* First protocol of the configuration, which is part of the key. */
+static const char *ssl_session_store_alpn(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_ALPN)
+    const char **alpn_list = mbedtls_ssl_get_alpn_list(ssl);
+
+    if (alpn_list != NULL) {
+        return alpn_list[0];
+    }
+#else
+    (void) ssl;
+#endif
+    return NULL;
+}
+
+void mbedtls_ssl_session_store_resume(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_session session;
+    int ret;
+
+    if (ssl->conf->session_store == NULL || ssl->hostname == NULL ||
+        ssl->handshake->resume != 0) {
+        return;
+    }
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
+        return;
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    /* The second ClientHello offers what the first one did. */
+    if (ssl->handshake->hello_retry_request_flag) {
+        return;
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    if (ssl->handshake->cookie != NULL) {
+        return;
+    }
+#endif
+
+    mbedtls_ssl_session_init(&session);
+    ret = mbedtls_ssl_session_store_get(ssl->conf->session_store,
+                                        ssl->hostname, ssl->server_port,
+                                        ssl_session_store_alpn(ssl),
+                                        &session);
+    if (ret == 0) {
+        ret = mbedtls_ssl_set_session(ssl, &session);
+        if (ret == 0) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("resuming a session from the store"));
+        } else {
+            MBEDTLS_SSL_DEBUG_RET(2, "mbedtls_ssl_set_session", ret);
+        }
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+void mbedtls_ssl_session_store_add(mbedtls_ssl_context *ssl)
+{
+    int ret;
+
+    if (ssl->conf->session_store == NULL || ssl->hostname == NULL) {
+        return;
+    }
+
+    ret = mbedtls_ssl_session_store_set(ssl->conf->session_store,
+                                        ssl->hostname, ssl->server_port,
+                                        ssl_session_store_alpn(ssl),
+                                        ssl->session);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(2, "mbedtls_ssl_session_store_set", ret);
+    }
+}
+
+void mbedtls_ssl_session_store_free(mbedtls_ssl_session_store *store)
+{
+    uint32_t i;
+
+    if (store == NULL) {
+        return;
+    }
+
+    if (store->entries != NULL) {
+        for (i = 0; i < store->used; i++) {
+            mbedtls_ssl_session_store_entry *entry = &store->entries[i];
+
+            while (entry->count > 0) {
+                ssl_session_store_drop(entry, entry->count - 1);
+            }
+            mbedtls_free(entry->key);
+        }
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&store->mutex);
+#endif
+    }
+
+    mbedtls_free(store->entries);
+    mbedtls_free(store->buckets);
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_ssl_session_store));
+}
+
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
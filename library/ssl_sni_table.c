@@ -0,0 +1,261 @@
+/*
+ *  Server certificate selection by host name
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A chained hash table of names, keyed by the lowercase name and whether it
+ * is a wildcard. A wildcard name is stored without its "*." prefix, so that
+ * the lookup of a host name is the lookup of the name itself, then of the
+ * name without its first label as a wildcard. Each entry owns the list of
+ * its key/certificate pairs, which handshakes borrow.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_sni_table.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "fnv_internal.h"
+
+#include <string.h>
+
+/* Buckets are pointers, so this caps the array at 64 MiB on 32-bit
+ * platforms. No server has that many certificate names. */
+#define SSL_SNI_TABLE_MAX_BUCKETS (1u << 24)
+
+struct mbedtls_ssl_sni_entry {
+    struct mbedtls_ssl_sni_entry *next;     /*!< next entry of the bucket */
+    mbedtls_ssl_key_cert *key_cert;
+    mbedtls_x509_crt *ca_chain;
+    mbedtls_x509_crl *ca_crl;
+    int authmode;
+    unsigned char wildcard;
+    size_t name_len;
+    unsigned char *name;                    /*!< lowercase, after the entry */
+};
+
+static unsigned char ssl_sni_lower(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? (unsigned char) (c - 'A' + 'a') : c;
+}
+
+/* FNV-1a of the lowercase name. */
+static uint32_t ssl_sni_hash(const unsigned char *name, size_t name_len,
+                             unsigned char wildcard)
+{
+    uint32_t h = MBEDTLS_FNV1A32_INIT ^ wildcard;
+    unsigned char c;
+    size_t i;
+
+    for (i = 0; i < name_len; i++) {
+        c = ssl_sni_lower(name[i]);
+        h = mbedtls_fnv1a32(h, &c, 1);
+    }
+
+    return h;
+}
+
+static struct mbedtls_ssl_sni_entry *ssl_sni_find(
+    const mbedtls_ssl_sni_table *table,
+    const unsigned char *name, size_t name_len, unsigned char wildcard)
+{
+    struct mbedtls_ssl_sni_entry *cur;
+    size_t i;
+
+    if (table->buckets == NULL) {
+        return NULL;
+    }
+
+    cur = table->buckets[ssl_sni_hash(name, name_len, wildcard) & table->mask];
+    for (; cur != NULL; cur = cur->next) {
+        if (cur->wildcard != wildcard || cur->name_len != name_len) {
+            continue;
+        }
+        for (i = 0; i < name_len; i++) {
+            if (cur->name[i] != ssl_sni_lower(name[i])) {
+                break;
+            }
+        }
+        if (i == name_len) {
+            return cur;
+        }
+    }
+
+    return NULL;
+}
+
+/* The exact name, then the name without its first label as a wildcard. */
+static struct mbedtls_ssl_sni_entry *ssl_sni_match(
+    const mbedtls_ssl_sni_table *table,
+    const unsigned char *name, size_t name_len)
+{
+    struct mbedtls_ssl_sni_entry *entry;
+    const unsigned char *dot;
+
+    entry = ssl_sni_find(table, name, name_len, 0);
+    if (entry != NULL || name_len == 0) {
+        return entry;
+    }
+
+    dot = memchr(name, '.', name_len);
+    if (dot == NULL || dot == name || dot + 1 == name + name_len) {
+        return NULL;
+    }
+
+    return ssl_sni_find(table, dot + 1, (size_t) (name + name_len - dot - 1), 1);
+}
+
+void mbedtls_ssl_sni_table_init(mbedtls_ssl_sni_table *table)
+{
+    memset(table, 0, sizeof(mbedtls_ssl_sni_table));
+}
+
+int mbedtls_ssl_sni_table_setup(mbedtls_ssl_sni_table *table,
+                                size_t num_buckets)
+{
+    size_t n = 1;
+
+    if (table->buckets != NULL || num_buckets == 0 ||
+        num_buckets > SSL_SNI_TABLE_MAX_BUCKETS) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    while (n < num_buckets) {
+        n <<= 1;
+    }
+
+    table->buckets = mbedtls_calloc_tagged(SSL_CACHE, n, sizeof(struct mbedtls_ssl_sni_entry *));
+    if (table->buckets == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    table->mask = n - 1;
+    table->count = 0;
+
+    return 0;
+}
+
+int mbedtls_ssl_sni_table_add(mbedtls_ssl_sni_table *table,
+                              const mbedtls_ssl_config *conf,
+                              const char *name, size_t name_len,
+                              mbedtls_x509_crt *own_cert,
+                              mbedtls_pk_context *pk_key,
+                              mbedtls_x509_crt *ca_chain,
+                              mbedtls_x509_crl *ca_crl,
+                              int authmode)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *p = (const unsigned char *) name;
+    struct mbedtls_ssl_sni_entry *entry, **bucket;
+    unsigned char wildcard = 0;
+    size_t i;
+
+    if (name_len >= 2 && p[0] == '*' && p[1] == '.') {
+        wildcard = 1;
+        p += 2;
+        name_len -= 2;
+    }
+
+    if (table->buckets == NULL || name_len == 0 || own_cert == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    entry = ssl_sni_find(table, p, name_len, wildcard);
+    if (entry == NULL) {
+        entry = mbedtls_calloc_tagged(SSL_CACHE, 1,
+                                      sizeof(struct mbedtls_ssl_sni_entry) + name_len);
+        if (entry == NULL) {
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        entry->name = (unsigned char *) (entry + 1);
+        for (i = 0; i < name_len; i++) {
+            entry->name[i] = ssl_sni_lower(p[i]);
+        }
+        entry->name_len = name_len;
+        entry->wildcard = wildcard;
+
+        if ((ret = mbedtls_ssl_key_cert_append(conf, &entry->key_cert,
+                                               own_cert, pk_key)) != 0) {
+            mbedtls_free(entry);
+            return ret;
+        }
+
+        bucket = &table->buckets[ssl_sni_hash(p, name_len, wildcard) &
+                                 table->mask];
+        entry->next = *bucket;
+        *bucket = entry;
+        table->count++;
+    } else if ((ret = mbedtls_ssl_key_cert_append(conf, &entry->key_cert,
+                                                  own_cert, pk_key)) != 0) {
+        return ret;
+    }
+
+    entry->ca_chain = ca_chain;
+    entry->ca_crl = ca_crl;
+    entry->authmode = authmode;
+
+    return 0;
+}
+
+const mbedtls_x509_crt *mbedtls_ssl_sni_table_lookup(
+    const mbedtls_ssl_sni_table *table,
+    const unsigned char *name, size_t name_len)
+{
+    const struct mbedtls_ssl_sni_entry *entry;
+
+    entry = ssl_sni_match(table, name, name_len);
+
+    return entry != NULL ? entry->key_cert->cert : NULL;
+}
+
+int mbedtls_ssl_sni_table_cb(void *p_table, mbedtls_ssl_context *ssl,
+                             const unsigned char *name, size_t name_len)
+{
+    const struct mbedtls_ssl_sni_entry *entry;
+
+    entry = ssl_sni_match(p_table, name, name_len);
+    if (entry == NULL) {
+        return 0;
+    }
+
+    mbedtls_ssl_set_hs_key_cert_list(ssl, entry->key_cert);
+    if (entry->ca_chain != NULL) {
+        mbedtls_ssl_set_hs_ca_chain(ssl, entry->ca_chain, entry->ca_crl);
+    }
+    if (entry->authmode != MBEDTLS_SSL_VERIFY_UNSET) {
+        mbedtls_ssl_set_hs_authmode(ssl, entry->authmode);
+    }
+
+    return 0;
+}
+
+void mbedtls_ssl_sni_table_free(mbedtls_ssl_sni_table *table)
+{
+    struct mbedtls_ssl_sni_entry *cur, *next;
+    size_t i;
+
+    if (table == NULL) {
+        return;
+    }
+
+    if (table->buckets != NULL) {
+        for (i = 0; i <= table->mask; i++) {
+            for (cur = table->buckets[i]; cur != NULL; cur = next) {
+                next = cur->next;
+                mbedtls_ssl_key_cert_free(cur->key_cert);
+                mbedtls_free(cur);
+            }
+        }
+    }
+
+    mbedtls_free(table->buckets);
+
+    mbedtls_platform_zeroize(table, sizeof(mbedtls_ssl_sni_table));
+}
+
+#endif /* MBEDTLS_SSL_SNI_TABLE_C */
@@ -57,58 +57,325 @@ void mbedtls_ssl_ticket_init(mbedtls_ssl_ticket_context *ctx)
                              TICKET_CRYPT_LEN_BYTES)
 
 /*
- * Generate/update a key
+ * Key name index: open addressing with linear probing, at most a quarter
+ * full. It is rebuilt whenever the set of keys changes, so that it never
+ * holds deleted entries and a lookup stops at the first empty slot.
  */
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_ticket_gen_key(mbedtls_ssl_ticket_context *ctx,
-                              unsigned char index)
+static size_t ssl_ticket_name_hash(const unsigned char *name)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    unsigned char buf[MAX_KEY_BYTES] = { 0 };
-    mbedtls_ssl_ticket_key *key = ctx->keys + index;
+    uint32_t h = MBEDTLS_GET_UINT32_LE(name, 0) * 0x9E3779B1u;
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
-#endif
+    return (size_t) (h >> 16) % MBEDTLS_SSL_TICKET_INDEX_SIZE;
+}
 
-#if defined(MBEDTLS_HAVE_TIME)
-    key->generation_time = mbedtls_time(NULL);
-#endif
-    /* The lifetime of a key is the configured lifetime of the tickets when
-     * the key is created.
-     */
-    key->lifetime = ctx->ticket_lifetime;
+static void ssl_ticket_update_index(mbedtls_ssl_ticket_context *ctx)
+{
+    unsigned char i;
+    size_t h;
 
-    if ((ret = ctx->f_rng(ctx->p_rng, key->name, sizeof(key->name))) != 0) {
-        return ret;
+    memset(ctx->index, 0, sizeof(ctx->index));
+
+    for (i = 0; i < MBEDTLS_SSL_TICKET_MAX_KEYS; i++) {
+        if (ctx->keys[i].serial == 0) {
+            continue;
+        }
+
+        h = ssl_ticket_name_hash(ctx->keys[i].name);
+        while (ctx->index[h] != 0) {
+            h = (h + 1) % MBEDTLS_SSL_TICKET_INDEX_SIZE;
+        }
+        ctx->index[h] = i + 1;
     }
+}
 
-    if ((ret = ctx->f_rng(ctx->p_rng, buf, sizeof(buf))) != 0) {
-        return ret;
+/*
+ * Find a key by name, return its index or -1.
+ */
+static int ssl_ticket_find_key(const mbedtls_ssl_ticket_context *ctx,
+                               const unsigned char *name)
+{
+    size_t h = ssl_ticket_name_hash(name);
+    size_t probes;
+    unsigned char slot;
+
+    for (probes = 0; probes < MBEDTLS_SSL_TICKET_INDEX_SIZE; probes++) {
+        slot = ctx->index[h];
+        if (slot == 0) {
+            break;
+        }
+        if (memcmp(name, ctx->keys[slot - 1].name, TICKET_KEY_NAME_BYTES) == 0) {
+            return slot - 1;
+        }
+        h = (h + 1) % MBEDTLS_SSL_TICKET_INDEX_SIZE;
     }
 
+    return -1;
+}
+
+/*
+ * Pick the slot for a new key: a free one if any, else the oldest key that
+ * is not active.
+ */
+static unsigned char ssl_ticket_pick_slot(const mbedtls_ssl_ticket_context *ctx)
+{
+    unsigned char i, oldest = MBEDTLS_SSL_TICKET_MAX_KEYS;
+
+    for (i = 0; i < MBEDTLS_SSL_TICKET_MAX_KEYS; i++) {
+        if (i == ctx->active) {
+            continue;
+        }
+        if (ctx->keys[i].serial == 0) {
+            return i;
+        }
+        if (oldest == MBEDTLS_SSL_TICKET_MAX_KEYS ||
+            ctx->keys[i].serial < ctx->keys[oldest].serial) {
+            oldest = i;
+        }
+    }
+
+    return oldest;
+}
+
+/*
+ * Make a key slot unused and wipe its key.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_clear_key(mbedtls_ssl_ticket_key *key)
+{
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_status_t status;
+#else
+    mbedtls_cipher_type_t type;
+#endif
+
+    key->serial = 0;
+    key->lifetime = 0;
+    memset(key->name, 0, sizeof(key->name));
+
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
+    status = psa_destroy_key(key->key);
+    key->key = MBEDTLS_SVC_KEY_ID_INIT;
+    if (status != PSA_SUCCESS) {
+        return PSA_TO_MBEDTLS_ERR(status);
+    }
+    return 0;
+#else
+    type = mbedtls_cipher_get_type(&key->ctx);
+    mbedtls_cipher_free(&key->ctx);
+    return mbedtls_cipher_setup(&key->ctx, mbedtls_cipher_info_from_type(type));
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+}
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+/*
+ * Import a key of the type of the given slot
+ */
+static psa_status_t ssl_ticket_import_key(const mbedtls_ssl_ticket_key *key,
+                                          const unsigned char *k,
+                                          mbedtls_svc_key_id_t *key_id)
+{
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+
     psa_set_key_usage_flags(&attributes,
                             PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT);
     psa_set_key_algorithm(&attributes, key->alg);
     psa_set_key_type(&attributes, key->key_type);
     psa_set_key_bits(&attributes, key->key_bits);
 
-    ret = PSA_TO_MBEDTLS_ERR(
-        psa_import_key(&attributes, buf,
-                       PSA_BITS_TO_BYTES(key->key_bits),
-                       &key->key));
+    return psa_import_key(&attributes, k, PSA_BITS_TO_BYTES(key->key_bits),
+                          key_id);
+}
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+/*
+ * Load a key into a slot, which must be unused. The slot is left unused on
+ * failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_set_key(mbedtls_ssl_ticket_context *ctx,
+                              unsigned char index,
+                              const unsigned char *name,
+                              const unsigned char *k,
+                              uint32_t lifetime)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_ticket_key *key = ctx->keys + index;
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    ret = PSA_TO_MBEDTLS_ERR(ssl_ticket_import_key(key, k, &key->key));
 #else
     /* With GCM and CCM, same context can encrypt & decrypt */
-    ret = mbedtls_cipher_setkey(&key->ctx, buf,
+    ret = mbedtls_cipher_setkey(&key->ctx, k,
                                 mbedtls_cipher_get_key_bitlen(&key->ctx),
                                 MBEDTLS_ENCRYPT);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+    if (ret != 0) {
+        return ret;
+    }
 
+    memcpy(key->name, name, TICKET_KEY_NAME_BYTES);
+#if defined(MBEDTLS_HAVE_TIME)
+    key->generation_time = mbedtls_time(NULL);
+#endif
+    key->lifetime = lifetime;
+    key->serial = ++ctx->serial;
+
+    return 0;
+}
+
+/*
+ * Generate a key into a slot, which must be unused
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_gen_key(mbedtls_ssl_ticket_context *ctx,
+                              unsigned char index)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char buf[MAX_KEY_BYTES] = { 0 };
+    unsigned char name[TICKET_KEY_NAME_BYTES];
+
+    if ((ret = ctx->f_rng(ctx->p_rng, name, sizeof(name))) != 0) {
+        return ret;
+    }
+
+    if ((ret = ctx->f_rng(ctx->p_rng, buf, sizeof(buf))) != 0) {
+        return ret;
+    }
+
+    /* The lifetime of a key is the configured lifetime of the tickets when
+     * the key is created.
+     */
+    ret = ssl_ticket_set_key(ctx, index, name, buf, ctx->ticket_lifetime);
+
+    mbedtls_platform_zeroize(buf, sizeof(buf));
+
+    return ret;
+}
+
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+/*
+ * Number of the epoch of a time, which names the key derived for it
+ */
+static uint32_t ssl_ticket_epoch(const mbedtls_ssl_ticket_context *ctx,
+                                 mbedtls_time_t t)
+{
+    return t < 0 ? 0 : (uint32_t) ((uint64_t) t / ctx->epoch_length);
+}
+
+/*
+ * Derive the key of an epoch from the master secret:
+ * HKDF-SHA-256(secret, info = "mbedtls ticket key" || key name)
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_derive_key(const mbedtls_ssl_ticket_context *ctx,
+                                 const unsigned char *name,
+                                 unsigned char *k, size_t klength)
+{
+    static const char label[] = "mbedtls ticket key";
+    unsigned char info[sizeof(label) - 1 + TICKET_KEY_NAME_BYTES];
+    psa_key_derivation_operation_t op = PSA_KEY_DERIVATION_OPERATION_INIT;
+    psa_status_t status;
+
+    memcpy(info, label, sizeof(label) - 1);
+    memcpy(info + sizeof(label) - 1, name, TICKET_KEY_NAME_BYTES);
+
+    status = psa_key_derivation_setup(&op, PSA_ALG_HKDF(PSA_ALG_SHA_256));
+    if (status == PSA_SUCCESS) {
+        status = psa_key_derivation_input_bytes(&op,
+                                                PSA_KEY_DERIVATION_INPUT_SECRET,
+                                                ctx->master, ctx->master_len);
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_key_derivation_input_bytes(&op,
+                                                PSA_KEY_DERIVATION_INPUT_INFO,
+                                                info, sizeof(info));
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_key_derivation_output_bytes(&op, k, klength);
+    }
+    psa_key_derivation_abort(&op);
+
+    return PSA_TO_MBEDTLS_ERR(status);
+}
+
+/*
+ * Make the key of the current epoch the active one, deriving it into the
+ * oldest slot if needed
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_update_derived_keys(mbedtls_ssl_ticket_context *ctx)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char name[TICKET_KEY_NAME_BYTES];
+    unsigned char buf[MAX_KEY_BYTES];
+    uint32_t epoch = ssl_ticket_epoch(ctx, mbedtls_time(NULL));
+    int idx;
+
+    MBEDTLS_PUT_UINT32_BE(epoch, name, 0);
+
+    idx = ssl_ticket_find_key(ctx, name);
+    if (idx < 0) {
+        idx = ssl_ticket_pick_slot(ctx);
+        if ((ret = ssl_ticket_clear_key(ctx->keys + idx)) == 0 &&
+            (ret = ssl_ticket_derive_key(ctx, name, buf,
+                                         PSA_BITS_TO_BYTES(
+                                             ctx->keys[idx].key_bits))) == 0 &&
+            (ret = ssl_ticket_set_key(ctx, (unsigned char) idx, name, buf,
+                                      ctx->ticket_lifetime)) == 0) {
+            /* Every server agrees on when the key was created. */
+            ctx->keys[idx].generation_time =
+                (mbedtls_time_t) epoch * ctx->epoch_length;
+        }
+        mbedtls_platform_zeroize(buf, sizeof(buf));
+        ssl_ticket_update_index(ctx);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    ctx->active = (unsigned char) idx;
+
+    return 0;
+}
+
+/*
+ * Derive a temporary key for a ticket whose key is not in the context, if
+ * the ticket can still be valid. Return 0 and an invalid key if it cannot.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_derive_old_key(const mbedtls_ssl_ticket_context *ctx,
+                                     const unsigned char *name,
+                                     mbedtls_svc_key_id_t *key_id,
+                                     mbedtls_time_t *generation_time)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_ssl_ticket_key *proto = ctx->keys + ctx->active;
+    unsigned char buf[MAX_KEY_BYTES];
+    uint32_t current = ssl_ticket_epoch(ctx, mbedtls_time(NULL));
+    uint32_t epoch = MBEDTLS_GET_UINT32_BE(name, 0);
+
+    *key_id = MBEDTLS_SVC_KEY_ID_INIT;
+
+    /* The next epoch for a server whose clock is ahead, or a past one whose
+     * key issued tickets less than a lifetime ago. */
+    if (epoch != current + 1 &&
+        (epoch > current ||
+         (uint64_t) (current - epoch - 1) * ctx->epoch_length >=
+         ctx->ticket_lifetime)) {
+        return 0;
+    }
+
+    if ((ret = ssl_ticket_derive_key(ctx, name, buf,
+                                     PSA_BITS_TO_BYTES(proto->key_bits))) == 0) {
+        ret = PSA_TO_MBEDTLS_ERR(ssl_ticket_import_key(proto, buf, key_id));
+    }
     mbedtls_platform_zeroize(buf, sizeof(buf));
 
+    *generation_time = (mbedtls_time_t) epoch * ctx->epoch_length;
+
     return ret;
 }
+#endif /* MBEDTLS_SSL_TICKET_DERIVED_KEYS */
 
 /*
  * Rotate/generate keys if necessary
@@ -120,33 +387,91 @@ static int ssl_ticket_update_keys(mbedtls_ssl_ticket_context *ctx)
     ((void) ctx);
 #else
     mbedtls_ssl_ticket_key * const key = ctx->keys + ctx->active;
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+    if (ctx->epoch_length != 0) {
+        return ssl_ticket_update_derived_keys(ctx);
+    }
+#endif
     if (key->lifetime != 0) {
         mbedtls_time_t current_time = mbedtls_time(NULL);
         mbedtls_time_t key_time = key->generation_time;
-
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-        psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-#endif
+        unsigned char idx;
+        int ret;
 
         if (current_time >= key_time &&
             (uint64_t) (current_time - key_time) < key->lifetime) {
             return 0;
         }
 
-        ctx->active = 1 - ctx->active;
-
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-        if ((status = psa_destroy_key(ctx->keys[ctx->active].key)) != PSA_SUCCESS) {
-            return PSA_TO_MBEDTLS_ERR(status);
+        idx = ssl_ticket_pick_slot(ctx);
+        if ((ret = ssl_ticket_clear_key(ctx->keys + idx)) == 0 &&
+            (ret = ssl_ticket_gen_key(ctx, idx)) == 0) {
+            ctx->active = idx;
         }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+        ssl_ticket_update_index(ctx);
 
-        return ssl_ticket_gen_key(ctx, ctx->active);
+        return ret;
     } else
 #endif /* MBEDTLS_HAVE_TIME */
     return 0;
 }
 
+/*
+ * Add a session ticket key, with ctx->mutex held
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_ticket_add_key_locked(mbedtls_ssl_ticket_context *ctx,
+                                     const unsigned char *name, size_t nlength,
+                                     const unsigned char *k, size_t klength,
+                                     uint32_t lifetime, int activate,
+                                     int replace)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int existing;
+    unsigned char idx;
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    const size_t bitlen = ctx->keys[0].key_bits;
+#else
+    const int bitlen = mbedtls_cipher_get_key_bitlen(&ctx->keys[0].ctx);
+#endif
+
+    if (nlength < TICKET_KEY_NAME_BYTES || klength * 8 < (size_t) bitlen) {
+        return MBEDTLS_ERR_CIPHER_BAD_INPUT_DATA;
+    }
+
+    existing = ssl_ticket_find_key(ctx, name);
+    if (existing >= 0 && !replace) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    /* A key with the same name is replaced, unless it is active: it then
+     * stays in use until the new key is in place. */
+    if (existing >= 0 && existing != ctx->active) {
+        idx = (unsigned char) existing;
+    } else {
+        idx = ssl_ticket_pick_slot(ctx);
+    }
+
+    if ((ret = ssl_ticket_clear_key(ctx->keys + idx)) != 0 ||
+        (ret = ssl_ticket_set_key(ctx, idx, name, k, lifetime)) != 0) {
+        goto exit;
+    }
+
+    if (activate) {
+        ctx->active = idx;
+        ctx->ticket_lifetime = lifetime;
+    }
+
+    if (existing >= 0 && existing != idx) {
+        ret = ssl_ticket_clear_key(ctx->keys + existing);
+    }
+
+exit:
+    ssl_ticket_update_index(ctx);
+
+    return ret;
+}
+
 /*
  * Rotate active session ticket encryption key
  */
@@ -155,56 +480,90 @@ int mbedtls_ssl_ticket_rotate(mbedtls_ssl_ticket_context *ctx,
                               const unsigned char *k, size_t klength,
                               uint32_t lifetime)
 {
-    const unsigned char idx = 1 - ctx->active;
-    mbedtls_ssl_ticket_key * const key = ctx->keys + idx;
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
-    const size_t bitlen = key->key_bits;
-#else
-    const int bitlen = mbedtls_cipher_get_key_bitlen(&key->ctx);
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
 #endif
 
-    if (nlength < TICKET_KEY_NAME_BYTES || klength * 8 < (size_t) bitlen) {
-        return MBEDTLS_ERR_CIPHER_BAD_INPUT_DATA;
+    ret = ssl_ticket_add_key_locked(ctx, name, nlength, k, klength,
+                                    lifetime, 1, 1);
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
+#endif
 
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    if ((status = psa_destroy_key(key->key)) != PSA_SUCCESS) {
-        ret = PSA_TO_MBEDTLS_ERR(status);
+    return ret;
+}
+
+/*
+ * Add a session ticket key
+ */
+int mbedtls_ssl_ticket_add_key(mbedtls_ssl_ticket_context *ctx,
+                               const unsigned char *name, size_t nlength,
+                               const unsigned char *k, size_t klength,
+                               uint32_t lifetime, int activate)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
         return ret;
     }
+#endif
 
-    psa_set_key_usage_flags(&attributes,
-                            PSA_KEY_USAGE_ENCRYPT | PSA_KEY_USAGE_DECRYPT);
-    psa_set_key_algorithm(&attributes, key->alg);
-    psa_set_key_type(&attributes, key->key_type);
-    psa_set_key_bits(&attributes, key->key_bits);
+    ret = ssl_ticket_add_key_locked(ctx, name, nlength, k, klength,
+                                    lifetime, activate, 0);
 
-    if ((status = psa_import_key(&attributes, k,
-                                 PSA_BITS_TO_BYTES(key->key_bits),
-                                 &key->key)) != PSA_SUCCESS) {
-        ret = PSA_TO_MBEDTLS_ERR(status);
-        return ret;
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
-#else
-    ret = mbedtls_cipher_setkey(&key->ctx, k, bitlen, MBEDTLS_ENCRYPT);
-    if (ret != 0) {
+#endif
+
+    return ret;
+}
+
+/*
+ * Remove a session ticket key
+ */
+int mbedtls_ssl_ticket_retire_key(mbedtls_ssl_ticket_context *ctx,
+                                  const unsigned char *name, size_t nlength)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int idx;
+
+    if (nlength < TICKET_KEY_NAME_BYTES) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
         return ret;
     }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+#endif
 
-    ctx->active = idx;
-    ctx->ticket_lifetime = lifetime;
-    memcpy(key->name, name, TICKET_KEY_NAME_BYTES);
-#if defined(MBEDTLS_HAVE_TIME)
-    key->generation_time = mbedtls_time(NULL);
+    idx = ssl_ticket_find_key(ctx, name);
+    if (idx < 0) {
+        ret = 0;
+    } else if (idx == ctx->active) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    } else {
+        ret = ssl_ticket_clear_key(ctx->keys + idx);
+        ssl_ticket_update_index(ctx);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
 #endif
-    key->lifetime = lifetime;
 
-    return 0;
+    return ret;
 }
 
 /*
@@ -217,6 +576,7 @@ int mbedtls_ssl_ticket_setup(mbedtls_ssl_ticket_context *ctx,
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t key_bits;
+    unsigned char i;
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_algorithm_t alg;
@@ -255,32 +615,89 @@ int mbedtls_ssl_ticket_setup(mbedtls_ssl_ticket_context *ctx,
 
     ctx->ticket_lifetime = lifetime;
 
+    for (i = 0; i < MBEDTLS_SSL_TICKET_MAX_KEYS; i++) {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    ctx->keys[0].alg = alg;
-    ctx->keys[0].key_type = key_type;
-    ctx->keys[0].key_bits = key_bits;
-
-    ctx->keys[1].alg = alg;
-    ctx->keys[1].key_type = key_type;
-    ctx->keys[1].key_bits = key_bits;
+        ctx->keys[i].alg = alg;
+        ctx->keys[i].key_type = key_type;
+        ctx->keys[i].key_bits = key_bits;
 #else
-    if ((ret = mbedtls_cipher_setup(&ctx->keys[0].ctx, cipher_info)) != 0) {
-        return ret;
+        if ((ret = mbedtls_cipher_setup(&ctx->keys[i].ctx, cipher_info)) != 0) {
+            return ret;
+        }
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
     }
 
-    if ((ret = mbedtls_cipher_setup(&ctx->keys[1].ctx, cipher_info)) != 0) {
-        return ret;
+    /* Start with an active key and a spare one, as a context with two
+     * keys always has. */
+    ctx->active = 0;
+    ret = ssl_ticket_gen_key(ctx, 0);
+    if (ret == 0) {
+        ret = ssl_ticket_gen_key(ctx, 1);
     }
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
+    ssl_ticket_update_index(ctx);
 
-    if ((ret = ssl_ticket_gen_key(ctx, 0)) != 0 ||
-        (ret = ssl_ticket_gen_key(ctx, 1)) != 0) {
-        return ret;
+    return ret;
+}
+
+int mbedtls_ssl_ticket_set_renewal(mbedtls_ssl_ticket_context *ctx,
+                                   unsigned renewal)
+{
+    if (renewal > 100) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+    ctx->renewal = (unsigned char) renewal;
+
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+int mbedtls_ssl_ticket_set_master_secret(mbedtls_ssl_ticket_context *ctx,
+                                         const unsigned char *secret,
+                                         size_t secret_len,
+                                         uint32_t epoch_length)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char i;
+
+    if (ctx->f_rng == NULL || secret_len == 0 ||
+        secret_len > sizeof(ctx->master) ||
+        epoch_length == 0 || epoch_length > ctx->ticket_lifetime) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Drop the keys generated so far, random or derived from the previous
+     * secret: from now on all the servers issue tickets alike. */
+    for (i = 0; i < MBEDTLS_SSL_TICKET_MAX_KEYS; i++) {
+        if ((ret = ssl_ticket_clear_key(ctx->keys + i)) != 0) {
+            goto exit;
+        }
+    }
+    ssl_ticket_update_index(ctx);
+
+    memcpy(ctx->master, secret, secret_len);
+    ctx->master_len = secret_len;
+    ctx->epoch_length = epoch_length;
+
+    ret = ssl_ticket_update_derived_keys(ctx);
+
+exit:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TICKET_DERIVED_KEYS */
+
 /*
  * Create session ticket, with the following structure:
  *
@@ -313,6 +730,11 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    mbedtls_svc_key_id_t key_id;
+    psa_algorithm_t alg;
+#endif
+#if defined(MBEDTLS_THREADING_C)
+    int locked = 0;
 #endif
 
     *tlen = 0;
@@ -329,6 +751,7 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
     if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
         return ret;
     }
+    locked = 1;
 #endif
 
     if ((ret = ssl_ticket_update_keys(ctx)) != 0) {
@@ -345,8 +768,26 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
         goto cleanup;
     }
 
-    /* Dump session state */
-    if ((ret = mbedtls_ssl_session_save(session,
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    /* PSA keys can be used by several threads at once, so the lock is only
+     * needed to take a consistent snapshot of the key. If a rotation
+     * destroys the key meanwhile, PSA either lets the operation below
+     * finish with it or fails it with an invalid handle. Since rotation
+     * only destroys the previous key, the active key is only lost after
+     * two rotations. */
+    key_id = key->key;
+    alg = key->alg;
+#if defined(MBEDTLS_THREADING_C)
+    locked = 0;
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    /* Dump session state. The TLS 1.2 session ID is not needed: the
+     * server takes the one of the ClientHello that carries the ticket. */
+    if ((ret = mbedtls_ssl_session_pack(session, MBEDTLS_SSL_SESSION_PACK_NO_ID,
                                         state, (size_t) (end - state),
                                         &clear_len)) != 0 ||
         (unsigned long) clear_len > 65535) {
@@ -356,7 +797,7 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
 
     /* Encrypt and authenticate */
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    if ((status = psa_aead_encrypt(key->key, key->alg, iv, TICKET_IV_BYTES,
+    if ((status = psa_aead_encrypt(key_id, alg, iv, TICKET_IV_BYTES,
                                    key_name, TICKET_ADD_DATA_LEN,
                                    state, clear_len,
                                    state, end - state,
@@ -385,7 +826,7 @@ int mbedtls_ssl_ticket_write(void *p_ticket,
 
 cleanup:
 #if defined(MBEDTLS_THREADING_C)
-    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+    if (locked && mbedtls_mutex_unlock(&ctx->mutex) != 0) {
         return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
 #endif
@@ -400,15 +841,9 @@ static mbedtls_ssl_ticket_key *ssl_ticket_select_key(
     mbedtls_ssl_ticket_context *ctx,
     const unsigned char name[4])
 {
-    unsigned char i;
+    int idx = ssl_ticket_find_key(ctx, name);
 
-    for (i = 0; i < sizeof(ctx->keys) / sizeof(*ctx->keys); i++) {
-        if (memcmp(name, ctx->keys[i].name, 4) == 0) {
-            return &ctx->keys[i];
-        }
-    }
-
-    return NULL;
+    return idx < 0 ? NULL : &ctx->keys[idx];
 }
 
 /*
@@ -427,9 +862,23 @@ int mbedtls_ssl_ticket_parse(void *p_ticket,
     unsigned char *enc_len_p = iv + TICKET_IV_BYTES;
     unsigned char *ticket = enc_len_p + TICKET_CRYPT_LEN_BYTES;
     size_t enc_len, clear_len;
+    uint32_t key_lifetime = 0;
+    unsigned char renewal;
+    int retiring = 0;
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_time_t key_time = 0;
+#endif
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    mbedtls_svc_key_id_t key_id;
+    psa_algorithm_t alg;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+    mbedtls_svc_key_id_t derived = MBEDTLS_SVC_KEY_ID_INIT;
+#endif
+#if defined(MBEDTLS_THREADING_C)
+    int locked = 0;
 #endif
 
     if (ctx == NULL || ctx->f_rng == NULL) {
@@ -440,34 +889,95 @@ int mbedtls_ssl_ticket_parse(void *p_ticket,
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+    enc_len = MBEDTLS_GET_UINT16_BE(enc_len_p, 0);
+
+    if (len != TICKET_MIN_LEN + enc_len) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
 #if defined(MBEDTLS_THREADING_C)
     if ((ret = mbedtls_mutex_lock(&ctx->mutex)) != 0) {
         return ret;
     }
+    locked = 1;
 #endif
 
     if ((ret = ssl_ticket_update_keys(ctx)) != 0) {
         goto cleanup;
     }
 
-    enc_len = MBEDTLS_GET_UINT16_BE(enc_len_p, 0);
-
-    if (len != TICKET_MIN_LEN + enc_len) {
-        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-        goto cleanup;
+    /* Select key */
+    key = ssl_ticket_select_key(ctx, key_name);
+    renewal = ctx->renewal;
+
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+    if (key == NULL && ctx->epoch_length != 0) {
+        /* A key of another epoch: derive it just for this ticket. */
+        if ((ret = ssl_ticket_derive_old_key(ctx, key_name, &derived,
+                                             &key_time)) != 0) {
+            goto cleanup;
+        }
+        if (!mbedtls_svc_key_id_is_null(derived)) {
+            key_lifetime = ctx->ticket_lifetime;
+            retiring = 1;
+            key_id = derived;
+            alg = ctx->keys[ctx->active].alg;
+        }
     }
 
-    /* Select key */
-    if ((key = ssl_ticket_select_key(ctx, key_name)) == NULL) {
+    if (key == NULL && mbedtls_svc_key_id_is_null(derived))
+#else
+    if (key == NULL)
+#endif /* MBEDTLS_SSL_TICKET_DERIVED_KEYS */
+    {
         /* We can't know for sure but this is a likely option unless we're
          * under attack - this is only informative anyway */
         ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
         goto cleanup;
     }
 
+    if (key != NULL) {
+        key_lifetime = key->lifetime;
+        retiring = key != &ctx->keys[ctx->active];
+#if defined(MBEDTLS_HAVE_TIME)
+        key_time = key->generation_time;
+#endif
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        /* See mbedtls_ssl_ticket_write(). */
+        key_id = key->key;
+        alg = key->alg;
+#endif
+    }
+
+#if defined(MBEDTLS_HAVE_TIME)
+    /* A key is active for at most its lifetime, and so are the tickets
+     * created under it: once twice the lifetime has passed, all of them
+     * have expired and there is no need to decrypt the ticket to know. */
+    if (key_lifetime != 0) {
+        mbedtls_time_t current_time = mbedtls_time(NULL);
+
+        if (current_time >= key_time &&
+            (uint64_t) (current_time - key_time) >
+            2 * (uint64_t) key_lifetime) {
+            ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
+            goto cleanup;
+        }
+    }
+#endif /* MBEDTLS_HAVE_TIME */
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+#if defined(MBEDTLS_THREADING_C)
+    locked = 0;
+    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+        goto cleanup;
+    }
+#endif
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
     /* Decrypt and authenticate */
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    if ((status = psa_aead_decrypt(key->key, key->alg, iv, TICKET_IV_BYTES,
+    if ((status = psa_aead_decrypt(key_id, alg, iv, TICKET_IV_BYTES,
                                    key_name, TICKET_ADD_DATA_LEN,
                                    ticket, enc_len + TICKET_AUTH_TAG_BYTES,
                                    ticket, enc_len, &clear_len)) != PSA_SUCCESS) {
@@ -496,14 +1006,15 @@ int mbedtls_ssl_ticket_parse(void *p_ticket,
     }
 
     /* Actually load session */
-    if ((ret = mbedtls_ssl_session_load(session, ticket, clear_len)) != 0) {
+    if ((ret = mbedtls_ssl_session_unpack(session, MBEDTLS_SSL_SESSION_PACK_NO_ID,
+                                          ticket, clear_len)) != 0) {
         goto cleanup;
     }
 
 #if defined(MBEDTLS_HAVE_TIME)
     mbedtls_ms_time_t ticket_creation_time, ticket_age;
     mbedtls_ms_time_t ticket_lifetime =
-        (mbedtls_ms_time_t) key->lifetime * 1000;
+        (mbedtls_ms_time_t) key_lifetime * 1000;
 
     ret = mbedtls_ssl_session_get_ticket_creation_time(session,
                                                        &ticket_creation_time);
@@ -516,11 +1027,25 @@ int mbedtls_ssl_ticket_parse(void *p_ticket,
         ret = MBEDTLS_ERR_SSL_SESSION_TICKET_EXPIRED;
         goto cleanup;
     }
+
+    if (renewal != 0 && ticket_age >= ticket_lifetime / 100 * renewal) {
+        retiring = 1;
+    }
+#else
+    (void) key_lifetime;
 #endif
 
+    if (renewal != 0) {
+        ret = retiring ? MBEDTLS_SSL_TICKET_PARSE_RENEW :
+              MBEDTLS_SSL_TICKET_PARSE_FRESH;
+    }
+
 cleanup:
+#if defined(MBEDTLS_SSL_TICKET_DERIVED_KEYS)
+    psa_destroy_key(derived);
+#endif
 #if defined(MBEDTLS_THREADING_C)
-    if (mbedtls_mutex_unlock(&ctx->mutex) != 0) {
+    if (locked && mbedtls_mutex_unlock(&ctx->mutex) != 0) {
         return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
     }
 #endif
@@ -533,17 +1058,19 @@ cleanup:
  */
 void mbedtls_ssl_ticket_free(mbedtls_ssl_ticket_context *ctx)
 {
+    unsigned char i;
+
     if (ctx == NULL) {
         return;
     }
 
+    for (i = 0; i < MBEDTLS_SSL_TICKET_MAX_KEYS; i++) {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_destroy_key(ctx->keys[0].key);
-    psa_destroy_key(ctx->keys[1].key);
+        psa_destroy_key(ctx->keys[i].key);
 #else
-    mbedtls_cipher_free(&ctx->keys[0].ctx);
-    mbedtls_cipher_free(&ctx->keys[1].ctx);
+        mbedtls_cipher_free(&ctx->keys[i].ctx);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+    }
 
 #if defined(MBEDTLS_THREADING_C)
     mbedtls_mutex_free(&ctx->mutex);
@@ -17,6 +17,7 @@
 
 #include "mbedtls/ssl.h"
 #include "ssl_client.h"
+#include "ssl_tls13_keys.h"
 #include "ssl_debug_helpers.h"
 
 #include "debug_internal.h"
@@ -245,10 +246,21 @@ int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
-    if (src->peer_cert != NULL) {
+    dst->peer_cert = NULL;
+    dst->peer_cert_ref = NULL;
+
+    if (src->peer_cert_ref != NULL) {
+        /* Share the chain rather than parsing a copy of it. */
+        int ret = mbedtls_ssl_peer_cert_ref_acquire(src->peer_cert_ref);
+        if (ret != 0) {
+            return ret;
+        }
+        dst->peer_cert = src->peer_cert;
+        dst->peer_cert_ref = src->peer_cert_ref;
+    } else if (src->peer_cert != NULL) {
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-        dst->peer_cert = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+        dst->peer_cert = mbedtls_calloc_tagged(SSL_PEER_CERT, 1, sizeof(mbedtls_x509_crt));
         if (dst->peer_cert == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -265,7 +277,7 @@ int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
     if (src->peer_cert_digest != NULL) {
         dst->peer_cert_digest =
-            mbedtls_calloc(1, src->peer_cert_digest_len);
+            mbedtls_calloc_tagged(SSL_SESSION, 1, src->peer_cert_digest_len);
         if (dst->peer_cert_digest == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -291,7 +303,7 @@ int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_CLI_C)
     if (src->ticket != NULL) {
-        dst->ticket = mbedtls_calloc(1, src->ticket_len);
+        dst->ticket = mbedtls_calloc_tagged(SSL_SESSION, 1, src->ticket_len);
         if (dst->ticket == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -315,11 +327,271 @@ int mbedtls_ssl_session_copy(mbedtls_ssl_session *dst,
     return 0;
 }
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#if defined(MBEDTLS_THREADING_C)
+/*
+ * The reference count of an interned chain is protected by the mutex of
+ * its table, so that a lookup never finds a chain being freed.
+ */
+static mbedtls_threading_mutex_t *ssl_peer_cert_ref_mutex(
+    struct mbedtls_ssl_peer_cert_ref *ref)
+{
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    if (ref->table != NULL) {
+        return &ref->table->mutex;
+    }
+#endif
+    return &ref->mutex;
+}
+#endif /* MBEDTLS_THREADING_C */
+
+int mbedtls_ssl_peer_cert_ref_new(mbedtls_x509_crt *chain,
+                                  struct mbedtls_ssl_peer_cert_ref **ref)
+{
+    struct mbedtls_ssl_peer_cert_ref *new_ref;
+
+    new_ref = mbedtls_calloc_tagged(SSL_PEER_CERT, 1, sizeof(*new_ref));
+    if (new_ref == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* The chain is not self-referential, so the head can be moved by copy. */
+    memcpy(&new_ref->crt, chain, sizeof(mbedtls_x509_crt));
+    mbedtls_free(chain);
+    new_ref->refs = 1;
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&new_ref->mutex);
+#endif
+
+    *ref = new_ref;
+
+    return 0;
+}
+
+int mbedtls_ssl_peer_cert_ref_acquire(struct mbedtls_ssl_peer_cert_ref *ref)
+{
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t *mutex = ssl_peer_cert_ref_mutex(ref);
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = mbedtls_mutex_lock(mutex)) != 0) {
+        return ret;
+    }
+#endif
+    ref->refs++;
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_peer_cert_ref_release(struct mbedtls_ssl_peer_cert_ref *ref)
+{
+    unsigned refs;
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_threading_mutex_t *mutex = ssl_peer_cert_ref_mutex(ref);
+
+    /* There is no way to report a failure here: if locking fails,
+     * leak the chain rather than risk freeing it while in use. */
+    if (mbedtls_mutex_lock(mutex) != 0) {
+        return;
+    }
+#endif
+    refs = --ref->refs;
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    if (refs == 0 && ref->table != NULL) {
+        mbedtls_ssl_peer_cert_table_remove(ref->table, ref);
+    }
+#endif
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(mutex);
+#endif
+
+    if (refs == 0) {
+        mbedtls_x509_crt_free(&ref->crt);
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&ref->mutex);
+#endif
+        mbedtls_free(ref);
+    }
+}
+#endif /* MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
+
+int mbedtls_ssl_session_copy_shared(mbedtls_ssl_session *dst,
+                                    mbedtls_ssl_session *src)
+{
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (src->peer_cert != NULL && src->peer_cert_ref == NULL) {
+        /* Move the chain of src into a shared handle. */
+        ret = mbedtls_ssl_peer_cert_ref_new(src->peer_cert, &src->peer_cert_ref);
+        if (ret != 0) {
+            return ret;
+        }
+        src->peer_cert = &src->peer_cert_ref->crt;
+    }
+#endif /* MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
+
+    return mbedtls_ssl_session_copy(dst, src);
+}
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+void mbedtls_ssl_session_intern_peer_cert(const mbedtls_ssl_context *ssl,
+                                          mbedtls_ssl_session *session)
+{
+    struct mbedtls_ssl_peer_cert_ref *ref;
+
+    if (ssl->conf->peer_cert_table == NULL || session->peer_cert == NULL ||
+        session->peer_cert_ref != NULL) {
+        return;
+    }
+
+    /* Sharing only saves memory: on failure, keep the session's own copy. */
+    if (mbedtls_ssl_peer_cert_table_intern(ssl->conf->peer_cert_table,
+                                           session->peer_cert, &ref) == 0) {
+        session->peer_cert = &ref->crt;
+        session->peer_cert_ref = ref;
+    }
+}
+#endif /* MBEDTLS_SSL_PEER_CERT_TABLE_C */
+
+/*
+ * Get and release input/output record buffers, through the allocator set
+ * with mbedtls_ssl_conf_buffer_alloc() if any.
+ */
+static unsigned char *ssl_buffer_get(const mbedtls_ssl_config *conf,
+                                     size_t len)
+{
+    unsigned char *buf;
+
+    if (conf->f_buf_get == NULL || conf->f_buf_release == NULL) {
+        return mbedtls_calloc_tagged(SSL_RECORD, 1, len);
+    }
+
+    buf = conf->f_buf_get(conf->p_buf, len);
+    if (buf != NULL) {
+        memset(buf, 0, len);
+    }
+
+    return buf;
+}
+
+static void ssl_buffer_release(const mbedtls_ssl_config *conf,
+                               unsigned char *buf, size_t len)
+{
+    if (conf->f_buf_get == NULL || conf->f_buf_release == NULL) {
+        mbedtls_zeroize_and_free(buf, len);
+        return;
+    }
+
+    mbedtls_platform_zeroize(buf, len);
+    conf->f_buf_release(conf->p_buf, buf, len);
+}
+
+int mbedtls_ssl_release_buffers(mbedtls_ssl_context *ssl)
+{
+    if (ssl == NULL || ssl->conf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->in_buf == NULL && ssl->out_buf == NULL) {
+        return 0;
+    }
+
+    if (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER || ssl->handshake != NULL ||
+        ssl->in_buf == NULL || ssl->out_buf == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (ssl->in_left != 0 || ssl->out_left != 0 || ssl->out_batch_len != 0 ||
+        ssl->out_coalesce_len != 0 || mbedtls_ssl_check_pending(ssl) != 0) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("releasing idle record buffers"));
+
+    /* For TLS, the incoming record counter lives in the input buffer. */
+    memcpy(ssl->in_ctr_saved, ssl->in_ctr, sizeof(ssl->in_ctr_saved));
+
+    ssl_buffer_release(ssl->conf, ssl->in_buf, ssl->in_buf_len);
+    ssl_buffer_release(ssl->conf, ssl->out_buf, ssl->out_buf_len);
+    ssl->in_buf = NULL;
+    ssl->out_buf = NULL;
+
+    ssl->in_hdr = NULL;
+    ssl->in_ctr = NULL;
+    ssl->in_len = NULL;
+    ssl->in_iv = NULL;
+    ssl->in_msg = NULL;
+
+    ssl->out_hdr = NULL;
+    ssl->out_ctr = NULL;
+    ssl->out_len = NULL;
+    ssl->out_iv = NULL;
+    ssl->out_msg = NULL;
+
+    return 0;
+}
+
+/*
+ * Lazy setup: until its first record looks like a ClientHello, a server
+ * context reads into a small buffer of its own and has neither record
+ * buffers nor handshake structures.
+ */
+static inline int ssl_lazy_setup_pending(const mbedtls_ssl_context *ssl)
+{
+#if defined(MBEDTLS_SSL_SRV_C)
+    return ssl->in_buf == ssl->lazy_in_buf;
+#else
+    (void) ssl;
+    return 0;
+#endif
+}
+
+int mbedtls_ssl_acquire_buffers(mbedtls_ssl_context *ssl)
+{
+    if ((ssl->in_buf != NULL && ssl->out_buf != NULL) ||
+        ssl_lazy_setup_pending(ssl)) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("acquiring record buffers"));
+
+    if (ssl->in_buf == NULL) {
+        ssl->in_buf = ssl_buffer_get(ssl->conf, ssl->in_buf_len);
+        if (ssl->in_buf == NULL) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed",
+                                      ssl->in_buf_len));
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+    }
+
+    if (ssl->out_buf == NULL) {
+        ssl->out_buf = ssl_buffer_get(ssl->conf, ssl->out_buf_len);
+        if (ssl->out_buf == NULL) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed",
+                                      ssl->out_buf_len));
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+    }
+
+    mbedtls_ssl_reset_in_out_pointers(ssl);
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
+    memcpy(ssl->in_ctr, ssl->in_ctr_saved, sizeof(ssl->in_ctr_saved));
+
+    return 0;
+}
+
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int resize_buffer(unsigned char **buffer, size_t len_new, size_t *len_old)
+static int resize_buffer(const mbedtls_ssl_config *conf,
+                         unsigned char **buffer, size_t len_new, size_t *len_old)
 {
-    unsigned char *resized_buffer = mbedtls_calloc(1, len_new);
+    unsigned char *resized_buffer = ssl_buffer_get(conf, len_new);
     if (resized_buffer == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
@@ -330,7 +602,7 @@ static int resize_buffer(unsigned char **buffer, size_t len_new, size_t *len_old
      * lost, are done outside of this function. */
     memcpy(resized_buffer, *buffer,
            (len_new < *len_old) ? len_new : *len_old);
-    mbedtls_zeroize_and_free(*buffer, *len_old);
+    ssl_buffer_release(conf, *buffer, *len_old);
 
     *buffer = resized_buffer;
     *len_old = len_new;
@@ -344,15 +616,23 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
 {
     int modified = 0;
     size_t written_in = 0, iv_offset_in = 0, len_offset_in = 0;
+    size_t hdr_offset_in = 0;
     size_t written_out = 0, iv_offset_out = 0, len_offset_out = 0;
     if (ssl->in_buf != NULL) {
         written_in = ssl->in_msg - ssl->in_buf;
         iv_offset_in = ssl->in_iv - ssl->in_buf;
         len_offset_in = ssl->in_len - ssl->in_buf;
+        hdr_offset_in = ssl->in_hdr - ssl->in_buf;
+        /* Data read ahead beyond the current record must survive too */
+        size_t in_used = hdr_offset_in + ssl->in_left;
+        if (ssl->in_ahead_len != 0) {
+            in_used = hdr_offset_in + ssl->in_ahead_offset + ssl->in_ahead_len;
+        }
         if (downsizing ?
-            ssl->in_buf_len > in_buf_new_len && ssl->in_left < in_buf_new_len :
+            ssl->in_buf_len > in_buf_new_len && in_used < in_buf_new_len :
             ssl->in_buf_len < in_buf_new_len) {
-            if (resize_buffer(&ssl->in_buf, in_buf_new_len, &ssl->in_buf_len) != 0) {
+            if (resize_buffer(ssl->conf, &ssl->in_buf, in_buf_new_len,
+                              &ssl->in_buf_len) != 0) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("input buffer resizing failed - out of memory"));
             } else {
                 MBEDTLS_SSL_DEBUG_MSG(2, ("Reallocating in_buf to %" MBEDTLS_PRINTF_SIZET,
@@ -369,7 +649,8 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
         if (downsizing ?
             ssl->out_buf_len > out_buf_new_len && ssl->out_left < out_buf_new_len :
             ssl->out_buf_len < out_buf_new_len) {
-            if (resize_buffer(&ssl->out_buf, out_buf_new_len, &ssl->out_buf_len) != 0) {
+            if (resize_buffer(ssl->conf, &ssl->out_buf, out_buf_new_len,
+                              &ssl->out_buf_len) != 0) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("output buffer resizing failed - out of memory"));
             } else {
                 MBEDTLS_SSL_DEBUG_MSG(2, ("Reallocating out_buf to %" MBEDTLS_PRINTF_SIZET,
@@ -387,6 +668,7 @@ static void handle_buffer_resizing(mbedtls_ssl_context *ssl, int downsizing,
         ssl->out_len = ssl->out_buf + len_offset_out;
         ssl->out_iv = ssl->out_buf + iv_offset_out;
 
+        ssl->in_hdr = ssl->in_buf + hdr_offset_in;
         ssl->in_msg = ssl->in_buf + written_in;
         ssl->in_len = ssl->in_buf + len_offset_in;
         ssl->in_iv = ssl->in_buf + iv_offset_in;
@@ -420,6 +702,8 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
 #endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
                                         ssl_tls_prf_t tls_prf,
                                         const unsigned char randbytes[64],
+                                        const unsigned char *key_block,
+                                        size_t key_block_len,
                                         mbedtls_ssl_protocol_version tls_version,
                                         unsigned endpoint,
                                         const mbedtls_ssl_context *ssl);
@@ -448,6 +732,7 @@ static int ssl_calc_finished_tls_sha384(mbedtls_ssl_context *, unsigned char *,
 
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls12_session_load(mbedtls_ssl_session *session,
+                                  int flags,
                                   const unsigned char *buf,
                                   size_t len);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
@@ -491,10 +776,14 @@ int  mbedtls_ssl_tls_prf(const mbedtls_tls_prf_types prf,
 }
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
-static void ssl_clear_peer_cert(mbedtls_ssl_session *session)
+void mbedtls_ssl_session_clear_peer_cert(mbedtls_ssl_session *session)
 {
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
-    if (session->peer_cert != NULL) {
+    if (session->peer_cert_ref != NULL) {
+        mbedtls_ssl_peer_cert_ref_release(session->peer_cert_ref);
+        session->peer_cert_ref = NULL;
+        session->peer_cert = NULL;
+    } else if (session->peer_cert != NULL) {
         mbedtls_x509_crt_free(session->peer_cert);
         mbedtls_free(session->peer_cert);
         session->peer_cert = NULL;
@@ -511,107 +800,349 @@ static void ssl_clear_peer_cert(mbedtls_ssl_session *session)
 }
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
-uint32_t mbedtls_ssl_get_extension_id(unsigned int extension_type)
+/*
+ * Internal identity of each recognized extension type, indexed by the type.
+ * All of them are below MBEDTLS_SSL_EXT_ID_TABLE_SIZE, and the others are
+ * MBEDTLS_SSL_EXT_ID_UNRECOGNIZED, which is 0.
+ */
+const uint8_t mbedtls_ssl_extension_id_table[MBEDTLS_SSL_EXT_ID_TABLE_SIZE] = {
+    [MBEDTLS_TLS_EXT_SERVERNAME] = MBEDTLS_SSL_EXT_ID_SERVERNAME,
+    [MBEDTLS_TLS_EXT_MAX_FRAGMENT_LENGTH] =
+        MBEDTLS_SSL_EXT_ID_MAX_FRAGMENT_LENGTH,
+    [MBEDTLS_TLS_EXT_STATUS_REQUEST] = MBEDTLS_SSL_EXT_ID_STATUS_REQUEST,
+    [MBEDTLS_TLS_EXT_SUPPORTED_GROUPS] = MBEDTLS_SSL_EXT_ID_SUPPORTED_GROUPS,
+    [MBEDTLS_TLS_EXT_SIG_ALG] = MBEDTLS_SSL_EXT_ID_SIG_ALG,
+    [MBEDTLS_TLS_EXT_USE_SRTP] = MBEDTLS_SSL_EXT_ID_USE_SRTP,
+    [MBEDTLS_TLS_EXT_HEARTBEAT] = MBEDTLS_SSL_EXT_ID_HEARTBEAT,
+    [MBEDTLS_TLS_EXT_ALPN] = MBEDTLS_SSL_EXT_ID_ALPN,
+    [MBEDTLS_TLS_EXT_SCT] = MBEDTLS_SSL_EXT_ID_SCT,
+    [MBEDTLS_TLS_EXT_CLI_CERT_TYPE] = MBEDTLS_SSL_EXT_ID_CLI_CERT_TYPE,
+    [MBEDTLS_TLS_EXT_SERV_CERT_TYPE] = MBEDTLS_SSL_EXT_ID_SERV_CERT_TYPE,
+    [MBEDTLS_TLS_EXT_PADDING] = MBEDTLS_SSL_EXT_ID_PADDING,
+    [MBEDTLS_TLS_EXT_PRE_SHARED_KEY] = MBEDTLS_SSL_EXT_ID_PRE_SHARED_KEY,
+    [MBEDTLS_TLS_EXT_EARLY_DATA] = MBEDTLS_SSL_EXT_ID_EARLY_DATA,
+    [MBEDTLS_TLS_EXT_SUPPORTED_VERSIONS] =
+        MBEDTLS_SSL_EXT_ID_SUPPORTED_VERSIONS,
+    [MBEDTLS_TLS_EXT_COOKIE] = MBEDTLS_SSL_EXT_ID_COOKIE,
+    [MBEDTLS_TLS_EXT_PSK_KEY_EXCHANGE_MODES] =
+        MBEDTLS_SSL_EXT_ID_PSK_KEY_EXCHANGE_MODES,
+    [MBEDTLS_TLS_EXT_CERT_AUTH] = MBEDTLS_SSL_EXT_ID_CERT_AUTH,
+    [MBEDTLS_TLS_EXT_OID_FILTERS] = MBEDTLS_SSL_EXT_ID_OID_FILTERS,
+    [MBEDTLS_TLS_EXT_POST_HANDSHAKE_AUTH] =
+        MBEDTLS_SSL_EXT_ID_POST_HANDSHAKE_AUTH,
+    [MBEDTLS_TLS_EXT_SIG_ALG_CERT] = MBEDTLS_SSL_EXT_ID_SIG_ALG_CERT,
+    [MBEDTLS_TLS_EXT_KEY_SHARE] = MBEDTLS_SSL_EXT_ID_KEY_SHARE,
+    [MBEDTLS_TLS_EXT_TRUNCATED_HMAC] = MBEDTLS_SSL_EXT_ID_TRUNCATED_HMAC,
+    [MBEDTLS_TLS_EXT_SUPPORTED_POINT_FORMATS] =
+        MBEDTLS_SSL_EXT_ID_SUPPORTED_POINT_FORMATS,
+    [MBEDTLS_TLS_EXT_ENCRYPT_THEN_MAC] = MBEDTLS_SSL_EXT_ID_ENCRYPT_THEN_MAC,
+    [MBEDTLS_TLS_EXT_EXTENDED_MASTER_SECRET] =
+        MBEDTLS_SSL_EXT_ID_EXTENDED_MASTER_SECRET,
+    [MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT] = MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT,
+    [MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE] =
+        MBEDTLS_SSL_EXT_ID_COMPRESS_CERTIFICATE,
+    [MBEDTLS_TLS_EXT_CACHED_INFO] = MBEDTLS_SSL_EXT_ID_CACHED_INFO,
+    [MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS] =
+        MBEDTLS_SSL_EXT_ID_QUIC_TRANSPORT_PARAMETERS,
+    [MBEDTLS_TLS_EXT_SESSION_TICKET] = MBEDTLS_SSL_EXT_ID_SESSION_TICKET,
+};
+
+#if defined(MBEDTLS_SSL_SRV_C)
+int mbedtls_ssl_index_client_hello_exts(mbedtls_ssl_client_hello_exts *index,
+                                        const unsigned char *buf,
+                                        const unsigned char *end)
 {
-    switch (extension_type) {
-        case MBEDTLS_TLS_EXT_SERVERNAME:
-            return MBEDTLS_SSL_EXT_ID_SERVERNAME;
+    const unsigned char *p = buf;
+    uint32_t id;
+    size_t len;
 
-        case MBEDTLS_TLS_EXT_MAX_FRAGMENT_LENGTH:
-            return MBEDTLS_SSL_EXT_ID_MAX_FRAGMENT_LENGTH;
+    index->exts = NULL;
+    index->present = MBEDTLS_SSL_EXT_MASK_NONE;
 
-        case MBEDTLS_TLS_EXT_STATUS_REQUEST:
-            return MBEDTLS_SSL_EXT_ID_STATUS_REQUEST;
+    while (p < end) {
+        if (end - p < 4) {
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+        id = mbedtls_ssl_get_extension_id(MBEDTLS_GET_UINT16_BE(p, 0));
+        len = MBEDTLS_GET_UINT16_BE(p, 2);
+        if (len > (size_t) (end - p) - 4) {
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
 
-        case MBEDTLS_TLS_EXT_SUPPORTED_GROUPS:
-            return MBEDTLS_SSL_EXT_ID_SUPPORTED_GROUPS;
+        if (id != MBEDTLS_SSL_EXT_ID_UNRECOGNIZED) {
+            if (index->present & (1u << id)) {
+                return MBEDTLS_ERR_SSL_DECODE_ERROR;
+            }
+            index->present |= 1u << id;
+            /* The list is at most 2^16-1 bytes long. */
+            index->offset[id] = (uint16_t) (p - buf);
+        }
 
-        case MBEDTLS_TLS_EXT_SIG_ALG:
-            return MBEDTLS_SSL_EXT_ID_SIG_ALG;
+        p += 4 + len;
+    }
 
-        case MBEDTLS_TLS_EXT_USE_SRTP:
-            return MBEDTLS_SSL_EXT_ID_USE_SRTP;
+    index->exts = buf;
+    index->end = end;
 
-        case MBEDTLS_TLS_EXT_HEARTBEAT:
-            return MBEDTLS_SSL_EXT_ID_HEARTBEAT;
+    return 0;
+}
 
-        case MBEDTLS_TLS_EXT_ALPN:
-            return MBEDTLS_SSL_EXT_ID_ALPN;
+const unsigned char *mbedtls_ssl_client_hello_ext(
+    const mbedtls_ssl_client_hello_exts *index, uint32_t id,
+    const unsigned char **data_end)
+{
+    const unsigned char *ext;
 
-        case MBEDTLS_TLS_EXT_SCT:
-            return MBEDTLS_SSL_EXT_ID_SCT;
+    if (index->exts == NULL || (index->present & (1u << id)) == 0) {
+        return NULL;
+    }
 
-        case MBEDTLS_TLS_EXT_CLI_CERT_TYPE:
-            return MBEDTLS_SSL_EXT_ID_CLI_CERT_TYPE;
+    ext = index->exts + index->offset[id];
+    *data_end = ext + 4 + MBEDTLS_GET_UINT16_BE(ext, 2);
 
-        case MBEDTLS_TLS_EXT_SERV_CERT_TYPE:
-            return MBEDTLS_SSL_EXT_ID_SERV_CERT_TYPE;
+    return ext + 4;
+}
 
-        case MBEDTLS_TLS_EXT_PADDING:
-            return MBEDTLS_SSL_EXT_ID_PADDING;
+/*
+ * Skip a vector with a length of len_bytes bytes, checking that it is
+ * within the buffer.
+ */
+static int ssl_skip_vector(const unsigned char **p, const unsigned char *end,
+                           size_t len_bytes)
+{
+    size_t len;
 
-        case MBEDTLS_TLS_EXT_PRE_SHARED_KEY:
-            return MBEDTLS_SSL_EXT_ID_PRE_SHARED_KEY;
+    if ((size_t) (end - *p) < len_bytes) {
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    len = len_bytes == 1 ? (*p)[0] : MBEDTLS_GET_UINT16_BE(*p, 0);
+    *p += len_bytes;
+    if ((size_t) (end - *p) < len) {
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    *p += len;
 
-        case MBEDTLS_TLS_EXT_EARLY_DATA:
-            return MBEDTLS_SSL_EXT_ID_EARLY_DATA;
+    return 0;
+}
 
-        case MBEDTLS_TLS_EXT_SUPPORTED_VERSIONS:
-            return MBEDTLS_SSL_EXT_ID_SUPPORTED_VERSIONS;
+int mbedtls_ssl_parse_client_hello_info(const unsigned char *buf, size_t len,
+                                        mbedtls_ssl_client_hello_info *info)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_client_hello_exts index;
+    const unsigned char *p, *end, *data, *data_end;
+    size_t record_len, msg_len, name_len;
 
-        case MBEDTLS_TLS_EXT_COOKIE:
-            return MBEDTLS_SSL_EXT_ID_COOKIE;
+    memset(info, 0, sizeof(mbedtls_ssl_client_hello_info));
 
-        case MBEDTLS_TLS_EXT_PSK_KEY_EXCHANGE_MODES:
-            return MBEDTLS_SSL_EXT_ID_PSK_KEY_EXCHANGE_MODES;
+    /* Record header: type, version and length. */
+    if (len < 5) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (buf[0] != MBEDTLS_SSL_MSG_HANDSHAKE) {
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    }
+    record_len = MBEDTLS_GET_UINT16_BE(buf, 3);
+    if (len - 5 < record_len) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
 
-        case MBEDTLS_TLS_EXT_CERT_AUTH:
-            return MBEDTLS_SSL_EXT_ID_CERT_AUTH;
+    /* Handshake header: type and length. */
+    if (record_len < 4) {
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    p = buf + 5;
+    if (p[0] != MBEDTLS_SSL_HS_CLIENT_HELLO) {
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    }
+    msg_len = MBEDTLS_GET_UINT24_BE(p, 1);
+    if (msg_len > record_len - 4) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+    p += 4;
+    end = p + msg_len;
 
-        case MBEDTLS_TLS_EXT_OID_FILTERS:
-            return MBEDTLS_SSL_EXT_ID_OID_FILTERS;
+    /* legacy_version, random, legacy_session_id, cipher_suites and
+     * legacy_compression_methods. */
+    if (msg_len < 2 + MBEDTLS_CLIENT_HELLO_RANDOM_LEN) {
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    if (MBEDTLS_GET_UINT16_BE(p, 0) == MBEDTLS_SSL_VERSION_TLS1_2) {
+        info->max_tls_version = MBEDTLS_SSL_VERSION_TLS1_2;
+    }
+    p += 2 + MBEDTLS_CLIENT_HELLO_RANDOM_LEN;
+    if ((ret = ssl_skip_vector(&p, end, 1)) != 0 ||
+        (ret = ssl_skip_vector(&p, end, 2)) != 0 ||
+        (ret = ssl_skip_vector(&p, end, 1)) != 0) {
+        return ret;
+    }
 
-        case MBEDTLS_TLS_EXT_POST_HANDSHAKE_AUTH:
-            return MBEDTLS_SSL_EXT_ID_POST_HANDSHAKE_AUTH;
+    /* Extensions, optional. */
+    if (p == end) {
+        return 0;
+    }
+    data = p;
+    if ((ret = ssl_skip_vector(&p, end, 2)) != 0) {
+        return ret;
+    }
+    if (p != end) {
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    if ((ret = mbedtls_ssl_index_client_hello_exts(&index, data + 2,
+                                                   end)) != 0) {
+        return ret;
+    }
 
-        case MBEDTLS_TLS_EXT_SIG_ALG_CERT:
-            return MBEDTLS_SSL_EXT_ID_SIG_ALG_CERT;
+    /* struct {
+     *     NameType name_type;
+     *     opaque HostName<1..2^16-1>;
+     * } ServerName;
+     *
+     * ServerName server_name_list<1..2^16-1>; */
+    data = mbedtls_ssl_client_hello_ext(&index, MBEDTLS_SSL_EXT_ID_SERVERNAME,
+                                        &data_end);
+    if (data != NULL) {
+        if (data_end - data < 2 ||
+            MBEDTLS_GET_UINT16_BE(data, 0) != (size_t) (data_end - data) - 2) {
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+        for (p = data + 2; p < data_end;) {
+            if (data_end - p < 3) {
+                return MBEDTLS_ERR_SSL_DECODE_ERROR;
+            }
+            name_len = MBEDTLS_GET_UINT16_BE(p, 1);
+            if ((size_t) (data_end - p) - 3 < name_len) {
+                return MBEDTLS_ERR_SSL_DECODE_ERROR;
+            }
+            if (p[0] == MBEDTLS_TLS_EXT_SERVERNAME_HOSTNAME &&
+                info->server_name == NULL) {
+                info->server_name = p + 3;
+                info->server_name_len = name_len;
+            }
+            p += 3 + name_len;
+        }
+    }
 
-        case MBEDTLS_TLS_EXT_KEY_SHARE:
-            return MBEDTLS_SSL_EXT_ID_KEY_SHARE;
+    /* ProtocolName protocol_name_list<2..2^16-1>; */
+    data = mbedtls_ssl_client_hello_ext(&index, MBEDTLS_SSL_EXT_ID_ALPN,
+                                        &data_end);
+    if (data != NULL) {
+        if (data_end - data < 2 ||
+            MBEDTLS_GET_UINT16_BE(data, 0) != (size_t) (data_end - data) - 2) {
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+        for (p = data + 2; p < data_end;) {
+            if ((ret = ssl_skip_vector(&p, data_end, 1)) != 0) {
+                return ret;
+            }
+        }
+        info->alpn_list = data + 2;
+        info->alpn_list_len = (size_t) (data_end - data) - 2;
+    }
 
-        case MBEDTLS_TLS_EXT_TRUNCATED_HMAC:
-            return MBEDTLS_SSL_EXT_ID_TRUNCATED_HMAC;
+    /* ProtocolVersion versions<2..254>; */
+    data = mbedtls_ssl_client_hello_ext(&index,
+                                        MBEDTLS_SSL_EXT_ID_SUPPORTED_VERSIONS,
+                                        &data_end);
+    if (data != NULL) {
+        if (data_end - data < 1 || data[0] != (size_t) (data_end - data) - 1 ||
+            (data[0] & 1) != 0) {
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+        info->max_tls_version = MBEDTLS_SSL_VERSION_UNKNOWN;
+        for (p = data + 1; p < data_end; p += 2) {
+            uint16_t version = MBEDTLS_GET_UINT16_BE(p, 0);
+            if ((version == MBEDTLS_SSL_VERSION_TLS1_2 ||
+                 version == MBEDTLS_SSL_VERSION_TLS1_3) &&
+                version > info->max_tls_version) {
+                info->max_tls_version = (mbedtls_ssl_protocol_version) version;
+            }
+        }
+    }
 
-        case MBEDTLS_TLS_EXT_SUPPORTED_POINT_FORMATS:
-            return MBEDTLS_SSL_EXT_ID_SUPPORTED_POINT_FORMATS;
+    return 0;
+}
 
-        case MBEDTLS_TLS_EXT_ENCRYPT_THEN_MAC:
-            return MBEDTLS_SSL_EXT_ID_ENCRYPT_THEN_MAC;
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+void mbedtls_ssl_conf_hs_admission(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_hs_admission_t *f_admission,
+                                   void *p_admission)
+{
+    conf->f_admission = f_admission;
+    conf->p_admission = p_admission;
+}
 
-        case MBEDTLS_TLS_EXT_EXTENDED_MASTER_SECRET:
-            return MBEDTLS_SSL_EXT_ID_EXTENDED_MASTER_SECRET;
+int mbedtls_ssl_hs_admit(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    mbedtls_ssl_hs_admission_info info;
+    int uses_key = 0;
+    int ret;
 
-        case MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT:
-            return MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT;
+    if (ssl->conf->f_admission == NULL || handshake->admitted) {
+        return 0;
+    }
 
-        case MBEDTLS_TLS_EXT_SESSION_TICKET:
-            return MBEDTLS_SSL_EXT_ID_SESSION_TICKET;
+    memset(&info, 0, sizeof(info));
+    info.tls_version = ssl->tls_version;
+    info.ciphersuite = ssl->session_negotiate->ciphersuite;
+    info.resume = handshake->resume;
+    info.key_type = MBEDTLS_PK_NONE;
+    info.deferrals = handshake->admission_deferrals;
 
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        info.ephemeral = (handshake->key_exchange_mode &
+                          MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ALL) != 0;
+        uses_key = handshake->key_exchange_mode ==
+                   MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL;
     }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2 &&
+        handshake->ciphersuite_info != NULL && !handshake->resume) {
+        switch (handshake->ciphersuite_info->key_exchange) {
+            case MBEDTLS_KEY_EXCHANGE_DHE_RSA:
+            case MBEDTLS_KEY_EXCHANGE_ECDHE_RSA:
+            case MBEDTLS_KEY_EXCHANGE_ECDHE_ECDSA:
+            case MBEDTLS_KEY_EXCHANGE_DHE_PSK:
+            case MBEDTLS_KEY_EXCHANGE_ECDHE_PSK:
+                info.ephemeral = 1;
+                break;
 
-    return MBEDTLS_SSL_EXT_ID_UNRECOGNIZED;
-}
+            default:
+                break;
+        }
+        uses_key = mbedtls_ssl_ciphersuite_uses_srv_cert(
+            handshake->ciphersuite_info);
+    }
+#endif
 
-uint32_t mbedtls_ssl_get_extension_mask(unsigned int extension_type)
-{
-    return 1 << mbedtls_ssl_get_extension_id(extension_type);
-}
+    if (uses_key && mbedtls_ssl_own_key(ssl) != NULL) {
+        info.key_type = mbedtls_pk_get_type(mbedtls_ssl_own_key(ssl));
+    }
 
-#if defined(MBEDTLS_DEBUG_C)
-static const char *extension_name_table[] = {
-    [MBEDTLS_SSL_EXT_ID_UNRECOGNIZED] = "unrecognized",
-    [MBEDTLS_SSL_EXT_ID_SERVERNAME] = "server_name",
+    ret = ssl->conf->f_admission(ssl->conf->p_admission, ssl, &info);
+    if (ret == 0) {
+        handshake->admitted = 1;
+    } else if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("handshake deferred by admission callback"));
+        handshake->admission_deferrals++;
+    } else {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_admission", ret);
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_HANDSHAKE_FAILURE,
+                                     ret);
+    }
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_HS_ADMISSION */
+#endif /* MBEDTLS_SSL_SRV_C */
+
+#if defined(MBEDTLS_DEBUG_C)
+static const char *extension_name_table[] = {
+    [MBEDTLS_SSL_EXT_ID_UNRECOGNIZED] = "unrecognized",
+    [MBEDTLS_SSL_EXT_ID_SERVERNAME] = "server_name",
     [MBEDTLS_SSL_EXT_ID_MAX_FRAGMENT_LENGTH] = "max_fragment_length",
     [MBEDTLS_SSL_EXT_ID_STATUS_REQUEST] = "status_request",
     [MBEDTLS_SSL_EXT_ID_SUPPORTED_GROUPS] = "supported_groups",
@@ -638,7 +1169,10 @@ static const char *extension_name_table[] = {
     [MBEDTLS_SSL_EXT_ID_ENCRYPT_THEN_MAC] = "encrypt_then_mac",
     [MBEDTLS_SSL_EXT_ID_EXTENDED_MASTER_SECRET] = "extended_master_secret",
     [MBEDTLS_SSL_EXT_ID_SESSION_TICKET] = "session_ticket",
-    [MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT] = "record_size_limit"
+    [MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT] = "record_size_limit",
+    [MBEDTLS_SSL_EXT_ID_COMPRESS_CERTIFICATE] = "compress_certificate",
+    [MBEDTLS_SSL_EXT_ID_CACHED_INFO] = "cached_info",
+    [MBEDTLS_SSL_EXT_ID_QUIC_TRANSPORT_PARAMETERS] = "quic_transport_parameters"
 };
 
 static const unsigned int extension_type_table[] = {
@@ -670,7 +1204,11 @@ static const unsigned int extension_type_table[] = {
     [MBEDTLS_SSL_EXT_ID_ENCRYPT_THEN_MAC] = MBEDTLS_TLS_EXT_ENCRYPT_THEN_MAC,
     [MBEDTLS_SSL_EXT_ID_EXTENDED_MASTER_SECRET] = MBEDTLS_TLS_EXT_EXTENDED_MASTER_SECRET,
     [MBEDTLS_SSL_EXT_ID_SESSION_TICKET] = MBEDTLS_TLS_EXT_SESSION_TICKET,
-    [MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT] = MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT
+    [MBEDTLS_SSL_EXT_ID_RECORD_SIZE_LIMIT] = MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT,
+    [MBEDTLS_SSL_EXT_ID_COMPRESS_CERTIFICATE] = MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE,
+    [MBEDTLS_SSL_EXT_ID_CACHED_INFO] = MBEDTLS_TLS_EXT_CACHED_INFO,
+    [MBEDTLS_SSL_EXT_ID_QUIC_TRANSPORT_PARAMETERS] =
+        MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS
 };
 
 const char *mbedtls_ssl_get_extension_name(unsigned int extension_type)
@@ -694,6 +1232,8 @@ static const char *ssl_tls13_get_hs_msg_name(int hs_msg_type)
             return "EncryptedExtensions";
         case MBEDTLS_SSL_HS_CERTIFICATE:
             return "Certificate";
+        case MBEDTLS_SSL_HS_COMPRESSED_CERTIFICATE:
+            return "CompressedCertificate";
         case MBEDTLS_SSL_HS_CERTIFICATE_REQUEST:
             return "CertificateRequest";
     }
@@ -744,7 +1284,7 @@ void mbedtls_ssl_print_extensions(const mbedtls_ssl_context *ssl,
          i++) {
         mbedtls_ssl_print_extension(
             ssl, level, file, line, hs_msg_type, extension_type_table[i],
-            extensions_mask & (1 << i) ? "exists" : "does not exist", extra);
+            extensions_mask & ((uint32_t) 1 << i) ? "exists" : "does not exist", extra);
     }
 }
 
@@ -783,14 +1323,33 @@ void mbedtls_ssl_optimize_checksum(mbedtls_ssl_context *ssl,
 {
     ((void) ciphersuite_info);
 
+    /* The hash that the ciphersuite does not use is no longer needed:
+     * free it rather than keep it until the end of the handshake. It is
+     * set up again if the checksum is reset. */
 #if defined(PSA_WANT_ALG_SHA_384)
     if (ciphersuite_info->mac == MBEDTLS_MD_SHA384) {
         ssl->handshake->update_checksum = ssl_update_checksum_sha384;
+#if defined(PSA_WANT_ALG_SHA_256)
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        psa_hash_abort(&ssl->handshake->fin_sha256_psa);
+#else
+        mbedtls_md_free(&ssl->handshake->fin_sha256);
+        mbedtls_md_init(&ssl->handshake->fin_sha256);
+#endif
+#endif
     } else
 #endif
 #if defined(PSA_WANT_ALG_SHA_256)
     if (ciphersuite_info->mac != MBEDTLS_MD_SHA384) {
         ssl->handshake->update_checksum = ssl_update_checksum_sha256;
+#if defined(PSA_WANT_ALG_SHA_384)
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+        psa_hash_abort(&ssl->handshake->fin_sha384_psa);
+#else
+        mbedtls_md_free(&ssl->handshake->fin_sha384);
+        mbedtls_md_init(&ssl->handshake->fin_sha384);
+#endif
+#endif
     } else
 #endif
     {
@@ -836,9 +1395,13 @@ int mbedtls_ssl_reset_checksum(mbedtls_ssl_context *ssl)
 #else
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 #endif
-#else /* SHA-256 or SHA-384 */
-    ((void) ssl);
 #endif /* SHA-256 or SHA-384 */
+
+    /* Both hashes are running again, until the next
+     * mbedtls_ssl_optimize_checksum(). */
+    ssl->handshake->update_checksum = ssl_update_checksum_start;
+    ssl->handshake->transcript_snapshot_len = 0;
+
 #if defined(PSA_WANT_ALG_SHA_256)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     status = psa_hash_abort(&ssl->handshake->fin_sha256_psa);
@@ -902,10 +1465,10 @@ static int ssl_update_checksum_start(mbedtls_ssl_context *ssl,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 #endif
 #else /* SHA-256 or SHA-384 */
-    ((void) ssl);
     (void) buf;
     (void) len;
 #endif /* SHA-256 or SHA-384 */
+    ssl->handshake->transcript_snapshot_len = 0;
 #if defined(PSA_WANT_ALG_SHA_256)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     status = psa_hash_update(&ssl->handshake->fin_sha256_psa, buf, len);
@@ -939,6 +1502,7 @@ static int ssl_update_checksum_start(mbedtls_ssl_context *ssl,
 static int ssl_update_checksum_sha256(mbedtls_ssl_context *ssl,
                                       const unsigned char *buf, size_t len)
 {
+    ssl->handshake->transcript_snapshot_len = 0;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     return mbedtls_md_error_from_psa(psa_hash_update(
                                          &ssl->handshake->fin_sha256_psa, buf, len));
@@ -952,6 +1516,7 @@ static int ssl_update_checksum_sha256(mbedtls_ssl_context *ssl,
 static int ssl_update_checksum_sha384(mbedtls_ssl_context *ssl,
                                       const unsigned char *buf, size_t len)
 {
+    ssl->handshake->transcript_snapshot_len = 0;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     return mbedtls_md_error_from_psa(psa_hash_update(
                                          &ssl->handshake->fin_sha384_psa, buf, len));
@@ -982,6 +1547,11 @@ static void ssl_handshake_params_init(mbedtls_ssl_handshake_params *handshake)
 
     handshake->update_checksum = ssl_update_checksum_start;
 
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    handshake->master_prf.inner = psa_hash_operation_init();
+    handshake->master_prf.outer = psa_hash_operation_init();
+#endif
+
 #if defined(MBEDTLS_DHM_C)
     mbedtls_dhm_init(&handshake->dhm_ctx);
 #endif
@@ -1014,6 +1584,10 @@ static void ssl_handshake_params_init(mbedtls_ssl_handshake_params *handshake)
     !defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     mbedtls_pk_init(&handshake->peer_pubkey);
 #endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    mbedtls_pk_init(&handshake->peer_rpk);
+#endif
 }
 
 void mbedtls_ssl_transform_init(mbedtls_ssl_transform *transform)
@@ -1032,6 +1606,10 @@ void mbedtls_ssl_transform_init(mbedtls_ssl_transform *transform)
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     transform->psa_mac_enc = MBEDTLS_SVC_KEY_ID_INIT;
     transform->psa_mac_dec = MBEDTLS_SVC_KEY_ID_INIT;
+    transform->psa_mac_enc_inner = psa_hash_operation_init();
+    transform->psa_mac_enc_outer = psa_hash_operation_init();
+    transform->psa_mac_dec_inner = psa_hash_operation_init();
+    transform->psa_mac_dec_outer = psa_hash_operation_init();
 #else
     mbedtls_md_init(&transform->md_ctx_enc);
     mbedtls_md_init(&transform->md_ctx_dec);
@@ -1068,22 +1646,30 @@ static int ssl_handshake_init(mbedtls_ssl_context *ssl)
      * Now allocate missing structures.
      */
     if (ssl->transform_negotiate == NULL) {
-        ssl->transform_negotiate = mbedtls_calloc(1, sizeof(mbedtls_ssl_transform));
+        ssl->transform_negotiate = mbedtls_calloc_tagged(SSL_TRANSFORM, 1,
+                                                         sizeof(mbedtls_ssl_transform));
     }
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
     if (ssl->session_negotiate == NULL) {
-        ssl->session_negotiate = mbedtls_calloc(1, sizeof(mbedtls_ssl_session));
+        ssl->session_negotiate = mbedtls_calloc_tagged(SSL_SESSION, 1, sizeof(mbedtls_ssl_session));
     }
 
+    if (ssl->handshake == NULL && ssl->handshake_spare != NULL) {
+        ssl->handshake = ssl->handshake_spare;
+        ssl->handshake_spare = NULL;
+    }
     if (ssl->handshake == NULL) {
-        ssl->handshake = mbedtls_calloc(1, sizeof(mbedtls_ssl_handshake_params));
+        ssl->handshake = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1,
+                                               sizeof(mbedtls_ssl_handshake_params));
     }
 #if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     /* If the buffers are too small - reallocate */
 
-    handle_buffer_resizing(ssl, 0, MBEDTLS_SSL_IN_BUFFER_LEN,
-                           MBEDTLS_SSL_OUT_BUFFER_LEN);
+    handle_buffer_resizing(ssl, 0, mbedtls_ssl_in_buffer_len(ssl) *
+                           mbedtls_ssl_get_read_ahead_records(ssl),
+                           mbedtls_ssl_out_buffer_len(ssl) *
+                           mbedtls_ssl_get_write_batch_records(ssl));
 #endif
 
     /* All pointers should exist and can be directly freed without issue */
@@ -1140,6 +1726,18 @@ static int ssl_handshake_init(mbedtls_ssl_context *ssl)
         ssl->conf->new_session_tickets_count;
 #endif
 
+#if defined(MBEDTLS_SSL_CREDS_C)
+    /* The handshake keeps the credentials it starts with, even if new
+     * ones are set meanwhile. */
+    if (ssl->conf->creds != NULL) {
+        ret = mbedtls_ssl_creds_acquire(ssl->conf->creds,
+                                        &ssl->handshake->creds);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
         ssl->handshake->alt_transform_out = ssl->transform_out;
@@ -1170,7 +1768,7 @@ static int ssl_handshake_init(mbedtls_ssl_context *ssl)
         }
 
         /* Leave room for zero termination */
-        uint16_t *group_list = mbedtls_calloc(length + 1, sizeof(uint16_t));
+        uint16_t *group_list = mbedtls_calloc_tagged(SSL_HANDSHAKE, length + 1, sizeof(uint16_t));
         if (group_list == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -1232,8 +1830,8 @@ static int ssl_handshake_init(mbedtls_ssl_context *ssl)
             return MBEDTLS_ERR_SSL_BAD_CONFIG;
         }
 
-        ssl->handshake->sig_algs = mbedtls_calloc(1, sig_algs_len +
-                                                  sizeof(uint16_t));
+        ssl->handshake->sig_algs = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, sig_algs_len +
+                                                         sizeof(uint16_t));
         if (ssl->handshake->sig_algs == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -1302,12 +1900,21 @@ static int ssl_cookie_check_dummy(void *ctx,
 void mbedtls_ssl_init(mbedtls_ssl_context *ssl)
 {
     memset(ssl, 0, sizeof(mbedtls_ssl_context));
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    mbedtls_mutex_init(&ssl->mutex);
+#endif
 }
 
+/*
+ * Checks of a configuration. ssl is only used for debug output, and may
+ * be NULL.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_conf_version_check(const mbedtls_ssl_context *ssl)
+static int ssl_conf_version_check(const mbedtls_ssl_context *ssl,
+                                  const mbedtls_ssl_config *conf)
 {
-    const mbedtls_ssl_config *conf = ssl->conf;
+    ((void) ssl);
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     if (mbedtls_ssl_conf_is_tls13_only(conf)) {
@@ -1330,7 +1937,7 @@ static int ssl_conf_version_check(const mbedtls_ssl_context *ssl)
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2) && defined(MBEDTLS_SSL_PROTO_TLS1_3)
     if (mbedtls_ssl_conf_is_hybrid_tls12_tls13(conf)) {
-        if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
+        if (conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("DTLS not yet supported in Hybrid TLS 1.3 + TLS 1.2"));
             return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
         }
@@ -1345,24 +1952,132 @@ static int ssl_conf_version_check(const mbedtls_ssl_context *ssl)
 }
 
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_conf_check(const mbedtls_ssl_context *ssl)
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+/* With static reassembly, the DTLS buffering is part of the handshake
+ * structure, and already counted in MBEDTLS_SSL_DTLS_MEMORY. */
+#if defined(MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY)
+#define SSL_STATIC_REASSEMBLY_LEN MBEDTLS_SSL_DTLS_MAX_BUFFERING
+#else
+#define SSL_STATIC_REASSEMBLY_LEN 0
+#endif
+#endif /* MBEDTLS_SSL_STATIC_MEMORY */
+
+static int ssl_conf_check(const mbedtls_ssl_context *ssl,
+                          const mbedtls_ssl_config *conf)
 {
     int ret;
-    ret = ssl_conf_version_check(ssl);
+    ret = ssl_conf_version_check(ssl, conf);
     if (ret != 0) {
         return ret;
     }
 
-    if (ssl->conf->f_rng == NULL) {
+    if (conf->f_rng == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("no RNG provided"));
         return MBEDTLS_ERR_SSL_NO_RNG;
     }
 
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    MBEDTLS_STATIC_ASSERT(MBEDTLS_SSL_IN_BUFFER_LEN <=
+                          MBEDTLS_SSL_IN_CONTENT_LEN + MBEDTLS_SSL_RECORD_OVERHEAD_MAX &&
+                          MBEDTLS_SSL_OUT_BUFFER_LEN <=
+                          MBEDTLS_SSL_OUT_CONTENT_LEN + MBEDTLS_SSL_RECORD_OVERHEAD_MAX,
+                          "MBEDTLS_SSL_RECORD_OVERHEAD_MAX too small");
+    MBEDTLS_STATIC_ASSERT(sizeof(mbedtls_ssl_handshake_params) +
+                          2 * sizeof(mbedtls_ssl_transform) +
+                          sizeof(mbedtls_ssl_session) <=
+                          MBEDTLS_SSL_HANDSHAKE_MEMORY + SSL_STATIC_REASSEMBLY_LEN,
+                          "MBEDTLS_SSL_HANDSHAKE_MEMORY too small");
+
+    /* The I/O buffers only hold one record each in the budget. */
+    if (conf->read_ahead_records > 1 || conf->write_batch_records > 1) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("read-ahead and write batching are over "
+                                  "the memory budget"));
+        return MBEDTLS_ERR_SSL_BAD_CONFIG;
+    }
+#endif /* MBEDTLS_SSL_STATIC_MEMORY */
+
     /* Space for further checks */
 
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_SRV_C)
+static void ssl_lazy_setup_start(mbedtls_ssl_context *ssl)
+{
+    ssl->in_buf = ssl->lazy_in_buf;
+    ssl->in_buf_len = sizeof(ssl->lazy_in_buf);
+    ssl->in_hdr = ssl->in_buf + MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+    mbedtls_ssl_update_in_pointers(ssl);
+}
+
+/*
+ * Read the headers of the first record and, if they are those of a
+ * ClientHello, allocate what mbedtls_ssl_setup() left out.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_lazy_setup_finish(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *p = ssl->in_hdr;
+    size_t in_buf_len;
+    unsigned char *in_buf, *out_buf;
+
+    /* Over QUIC, the handshake messages do not go through the buffer. */
+    if (!mbedtls_ssl_is_quic(ssl)) {
+        ret = mbedtls_ssl_fetch_input(ssl, MBEDTLS_SSL_LAZY_SETUP_BUF_LEN -
+                                      MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+        if (ret != 0) {
+            return ret;
+        }
+
+        /* The record must be big enough for the smallest ClientHello, with
+         * one ciphersuite and no extension, so that what was read so far
+         * belongs to it. */
+        if (p[0] != MBEDTLS_SSL_MSG_HANDSHAKE || p[1] != 3 ||
+            MBEDTLS_GET_UINT16_BE(p, 3) < 4 + 41 ||
+            MBEDTLS_GET_UINT16_BE(p, 3) > mbedtls_ssl_in_content_len(ssl)) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("first record is not a handshake record"));
+            return MBEDTLS_ERR_SSL_INVALID_RECORD;
+        }
+
+        if (p[5] != MBEDTLS_SSL_HS_CLIENT_HELLO) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("first message is not a ClientHello"));
+            return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+        }
+
+        if (MBEDTLS_GET_UINT24_BE(p, 6) < 41 || p[9] != 3) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("bad client hello message"));
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(2, ("allocating the context for the ClientHello"));
+
+    in_buf_len = mbedtls_ssl_in_buffer_len(ssl) *
+                 mbedtls_ssl_get_read_ahead_records(ssl);
+    in_buf = ssl_buffer_get(ssl->conf, in_buf_len);
+    out_buf = in_buf != NULL ? ssl_buffer_get(ssl->conf, ssl->out_buf_len) : NULL;
+    if (out_buf == NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("alloc of record buffers failed"));
+        if (in_buf != NULL) {
+            ssl_buffer_release(ssl->conf, in_buf, in_buf_len);
+        }
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* The headers read so far keep their offset in the full buffer. */
+    memcpy(in_buf, ssl->lazy_in_buf, sizeof(ssl->lazy_in_buf));
+    mbedtls_platform_zeroize(ssl->lazy_in_buf, sizeof(ssl->lazy_in_buf));
+
+    ssl->in_buf = in_buf;
+    ssl->in_buf_len = in_buf_len;
+    ssl->out_buf = out_buf;
+    mbedtls_ssl_reset_in_out_pointers(ssl);
+
+    return ssl_handshake_init(ssl);
+}
+#endif /* MBEDTLS_SSL_SRV_C */
+
 /*
  * Setup an SSL context
  */
@@ -1371,15 +2086,22 @@ int mbedtls_ssl_setup(mbedtls_ssl_context *ssl,
                       const mbedtls_ssl_config *conf)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
-    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+    size_t in_buf_len;
+    size_t out_buf_len;
 
     ssl->conf = conf;
 
-    if ((ret = ssl_conf_check(ssl)) != 0) {
+    if (!conf->frozen && (ret = ssl_conf_check(ssl, conf)) != 0) {
         return ret;
     }
+
+    in_buf_len = mbedtls_ssl_in_buffer_len(ssl) *
+                 mbedtls_ssl_get_read_ahead_records(ssl);
+    out_buf_len = mbedtls_ssl_out_buffer_len(ssl) *
+                  mbedtls_ssl_get_write_batch_records(ssl);
     ssl->tls_version = ssl->conf->max_tls_version;
+    ssl->f_rng = conf->f_rng;
+    ssl->p_rng = conf->p_rng;
 
     /*
      * Prepare base structures
@@ -1388,20 +2110,30 @@ int mbedtls_ssl_setup(mbedtls_ssl_context *ssl,
     /* Set to NULL in case of an error condition */
     ssl->out_buf = NULL;
 
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-    ssl->in_buf_len = in_buf_len;
+#if defined(MBEDTLS_SSL_DTLS_SRTP)
+    memset(&ssl->dtls_srtp_info, 0, sizeof(ssl->dtls_srtp_info));
+#endif
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    if (conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
+        conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM &&
+        conf->lazy_setup == MBEDTLS_SSL_LAZY_SETUP_ENABLED) {
+        ssl->out_buf_len = out_buf_len;
+        ssl_lazy_setup_start(ssl);
+        return 0;
+    }
 #endif
-    ssl->in_buf = mbedtls_calloc(1, in_buf_len);
+
+    ssl->in_buf_len = in_buf_len;
+    ssl->in_buf = ssl_buffer_get(conf, in_buf_len);
     if (ssl->in_buf == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed", in_buf_len));
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto error;
     }
 
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     ssl->out_buf_len = out_buf_len;
-#endif
-    ssl->out_buf = mbedtls_calloc(1, out_buf_len);
+    ssl->out_buf = ssl_buffer_get(conf, out_buf_len);
     if (ssl->out_buf == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed", out_buf_len));
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -1410,10 +2142,6 @@ int mbedtls_ssl_setup(mbedtls_ssl_context *ssl,
 
     mbedtls_ssl_reset_in_out_pointers(ssl);
 
-#if defined(MBEDTLS_SSL_DTLS_SRTP)
-    memset(&ssl->dtls_srtp_info, 0, sizeof(ssl->dtls_srtp_info));
-#endif
-
     if ((ret = ssl_handshake_init(ssl)) != 0) {
         goto error;
     }
@@ -1421,15 +2149,17 @@ int mbedtls_ssl_setup(mbedtls_ssl_context *ssl,
     return 0;
 
 error:
-    mbedtls_free(ssl->in_buf);
-    mbedtls_free(ssl->out_buf);
+    if (ssl->in_buf != NULL) {
+        ssl_buffer_release(conf, ssl->in_buf, ssl->in_buf_len);
+    }
+    if (ssl->out_buf != NULL) {
+        ssl_buffer_release(conf, ssl->out_buf, ssl->out_buf_len);
+    }
 
     ssl->conf = NULL;
 
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     ssl->in_buf_len = 0;
     ssl->out_buf_len = 0;
-#endif
     ssl->in_buf = NULL;
     ssl->out_buf = NULL;
 
@@ -1458,14 +2188,6 @@ error:
 void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
                                          int partial)
 {
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-    size_t in_buf_len = ssl->in_buf_len;
-    size_t out_buf_len = ssl->out_buf_len;
-#else
-    size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
-    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
-#endif
-
 #if !defined(MBEDTLS_SSL_DTLS_CLIENT_PORT_REUSE) || !defined(MBEDTLS_SSL_SRV_C)
     partial = 0;
 #endif
@@ -1477,6 +2199,8 @@ void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
 
     /* Reset incoming message parsing */
     ssl->in_offt    = NULL;
+    ssl->in_dst     = NULL;
+    ssl->in_dst_used = 0;
     ssl->nb_zero    = 0;
     ssl->in_msgtype = 0;
     ssl->in_msglen  = 0;
@@ -1492,8 +2216,15 @@ void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
     /* Keep current datagram if partial == 1 */
     if (partial == 0) {
         ssl->in_left = 0;
-        memset(ssl->in_buf, 0, in_buf_len);
+        memset(ssl->in_buf, 0, ssl->in_buf_len);
     }
+    ssl->in_ahead_offset = 0;
+    ssl->in_ahead_len = 0;
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    if (ssl->in_pipe != NULL) {
+        ssl->in_pipe->ready = 0;
+    }
+#endif
 
     ssl->send_alert = 0;
 
@@ -1501,10 +2232,33 @@ void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
     ssl->out_msgtype = 0;
     ssl->out_msglen  = 0;
     ssl->out_left    = 0;
-    memset(ssl->out_buf, 0, out_buf_len);
+    ssl->out_batch_len = 0;
+    mbedtls_free(ssl->out_coalesce_buf);
+    ssl->out_coalesce_buf = NULL;
+    ssl->out_coalesce_size = 0;
+    ssl->out_coalesce_len = 0;
+    ssl->out_coalesce_sent = 0;
+    memset(ssl->out_buf, 0, ssl->out_buf_len);
     memset(ssl->cur_out_ctr, 0, sizeof(ssl->cur_out_ctr));
     ssl->transform_out = NULL;
 
+#if defined(MBEDTLS_SSL_KTLS)
+    ssl->ktls_directions = 0;
+    ssl->f_ktls_send_record = NULL;
+    ssl->p_ktls_send_record = NULL;
+#endif /* MBEDTLS_SSL_KTLS */
+
+#if defined(MBEDTLS_SSL_QUIC)
+    for (size_t i = 0; i < MBEDTLS_SSL_QUIC_LEVELS; i++) {
+        mbedtls_free(ssl->quic_in[i]);
+        ssl->quic_in[i] = NULL;
+        ssl->quic_in_len[i] = 0;
+    }
+    mbedtls_free(ssl->quic_peer_tp);
+    ssl->quic_peer_tp = NULL;
+    ssl->quic_peer_tp_len = 0;
+#endif /* MBEDTLS_SSL_QUIC */
+
 #if defined(MBEDTLS_SSL_DTLS_ANTI_REPLAY)
     mbedtls_ssl_dtls_replay_reset(ssl);
 #endif
@@ -1525,25 +2279,115 @@ void mbedtls_ssl_session_reset_msg_layer(mbedtls_ssl_context *ssl,
     if (ssl->handshake != NULL) {
 #if defined(MBEDTLS_SSL_EARLY_DATA)
         mbedtls_ssl_transform_free(ssl->handshake->transform_earlydata);
-        mbedtls_free(ssl->handshake->transform_earlydata);
+        mbedtls_ssl_hs_arena_free(ssl->handshake,
+                                  ssl->handshake->transform_earlydata);
         ssl->handshake->transform_earlydata = NULL;
 #endif
 
         mbedtls_ssl_transform_free(ssl->handshake->transform_handshake);
-        mbedtls_free(ssl->handshake->transform_handshake);
+        mbedtls_ssl_hs_arena_free(ssl->handshake,
+                                  ssl->handshake->transform_handshake);
         ssl->handshake->transform_handshake = NULL;
     }
 
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 }
 
+#if defined(MBEDTLS_SSL_STATS)
+const mbedtls_ssl_stats *mbedtls_ssl_get_stats(const mbedtls_ssl_context *ssl)
+{
+    return &ssl->stats;
+}
+
+void mbedtls_ssl_set_stats_sink(mbedtls_ssl_context *ssl,
+                                mbedtls_ssl_stats *sink)
+{
+    ssl->stats_sink = sink;
+}
+
+void mbedtls_ssl_stats_add(mbedtls_ssl_stats *total,
+                           const mbedtls_ssl_stats *stats)
+{
+    total->records_out += stats->records_out;
+    total->bytes_out += stats->bytes_out;
+    total->records_in += stats->records_in;
+    total->bytes_in += stats->bytes_in;
+    total->auth_failures += stats->auth_failures;
+    total->want_read += stats->want_read;
+    total->want_write += stats->want_write;
+    total->retransmits += stats->retransmits;
+    total->buffered_dropped += stats->buffered_dropped;
+    total->cache_hits += stats->cache_hits;
+    total->cache_misses += stats->cache_misses;
+    total->ticket_failures += stats->ticket_failures;
+    total->handshakes += stats->handshakes;
+    total->handshake_time += stats->handshake_time;
+}
+
+void mbedtls_ssl_stats_handshake_over(mbedtls_ssl_context *ssl)
+{
+    ssl->stats.handshakes++;
+#if defined(MBEDTLS_HAVE_TIME)
+    ssl->stats.handshake_time +=
+        (uint64_t) (mbedtls_ms_time() - ssl->stats_hs_start);
+#endif
+}
+
+/*
+ * Add the counters of the connection to the sink, and start over.
+ */
+static void ssl_stats_fold(mbedtls_ssl_context *ssl)
+{
+    if (ssl->stats_sink != NULL) {
+        mbedtls_ssl_stats_add(ssl->stats_sink, &ssl->stats);
+    }
+    memset(&ssl->stats, 0, sizeof(ssl->stats));
+}
+#endif /* MBEDTLS_SSL_STATS */
+
 int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
+#if defined(MBEDTLS_SSL_STATS)
+    ssl_stats_fold(ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    /* Before its ClientHello, the context has only read record headers. */
+    if (ssl_lazy_setup_pending(ssl)) {
+        mbedtls_ssl_set_timer(ssl, 0);
+        ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
+        ssl->tls_version = ssl->conf->max_tls_version;
+        ssl->in_left = 0;
+        mbedtls_platform_zeroize(ssl->lazy_in_buf, sizeof(ssl->lazy_in_buf));
+        return 0;
+    }
+#endif
+
+    if ((ret = mbedtls_ssl_acquire_buffers(ssl)) != 0) {
+        return ret;
+    }
+
     ssl->state = MBEDTLS_SSL_HELLO_REQUEST;
     ssl->tls_version = ssl->conf->max_tls_version;
 
+    /*
+     * Keep the structures of the previous connection for the next one,
+     * rather than freeing them here and allocating them again in
+     * ssl_handshake_init(), which clears them.
+     */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (ssl->transform != NULL && ssl->transform_negotiate == NULL) {
+        ssl->transform_negotiate = ssl->transform;
+        ssl->transform = NULL;
+    }
+#endif
+    if (ssl->session != NULL && ssl->session_negotiate == NULL) {
+        ssl->session_negotiate = ssl->session;
+        ssl->session = NULL;
+    }
+
     mbedtls_ssl_session_reset_msg_layer(ssl, partial);
 
     /* Reset renegotiation state */
@@ -1554,6 +2398,14 @@ int mbedtls_ssl_session_reset_int(mbedtls_ssl_context *ssl, int partial)
     ssl->verify_data_len = 0;
     memset(ssl->own_verify_data, 0, MBEDTLS_SSL_VERIFY_DATA_MAX_LEN);
     memset(ssl->peer_verify_data, 0, MBEDTLS_SSL_VERIFY_DATA_MAX_LEN);
+#endif
+#if defined(MBEDTLS_SSL_PROTO_DTLS)
+    ssl->path_mtu = 0;
+    ssl->out_app_held = 0;
+#endif
+    ssl->small_record_sent = 0;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    ssl->key_update = 0;
 #endif
     ssl->secure_renegotiation = MBEDTLS_SSL_LEGACY_RENEGOTIATION;
 
@@ -1622,6 +2474,81 @@ void mbedtls_ssl_conf_dtls_badmac_limit(mbedtls_ssl_config *conf, unsigned limit
     conf->badmac_limit = limit;
 }
 
+void mbedtls_ssl_conf_write_batch(mbedtls_ssl_config *conf,
+                                  unsigned char records)
+{
+    conf->write_batch_records = records;
+}
+
+void mbedtls_ssl_conf_write_queue(mbedtls_ssl_config *conf, int queue)
+{
+    conf->write_queue = (uint8_t) queue;
+}
+
+void mbedtls_ssl_conf_record_sizing(mbedtls_ssl_config *conf,
+                                    size_t len, size_t bytes, uint32_t idle)
+{
+    conf->small_record_len = len;
+    conf->small_record_bytes = bytes;
+#if defined(MBEDTLS_HAVE_TIME)
+    conf->small_record_idle = idle;
+#else
+    (void) idle;
+#endif
+}
+
+void mbedtls_ssl_conf_read_ahead(mbedtls_ssl_config *conf,
+                                 unsigned char records)
+{
+    conf->read_ahead_records = records;
+}
+
+void mbedtls_ssl_conf_flight_coalescing(mbedtls_ssl_config *conf,
+                                        int coalescing)
+{
+    conf->flight_coalescing = (uint8_t) coalescing;
+}
+
+void mbedtls_ssl_conf_handshake_reuse(mbedtls_ssl_config *conf, int reuse)
+{
+    conf->handshake_reuse = (uint8_t) reuse;
+}
+
+#if defined(MBEDTLS_SSL_SRV_C)
+void mbedtls_ssl_conf_lazy_setup(mbedtls_ssl_config *conf, int lazy)
+{
+    conf->lazy_setup = (uint8_t) lazy;
+}
+#endif
+
+void mbedtls_ssl_conf_buffer_alloc(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_buffer_get_t *f_get,
+                                   mbedtls_ssl_buffer_release_t *f_release,
+                                   void *p_buf)
+{
+    conf->f_buf_get     = f_get;
+    conf->f_buf_release = f_release;
+    conf->p_buf         = p_buf;
+}
+
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+void mbedtls_ssl_conf_record_pipeline(mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_pipeline_t *f_pipeline,
+                                      void *p_pipeline)
+{
+    conf->f_pipeline = f_pipeline;
+    conf->p_pipeline = p_pipeline;
+}
+
+void mbedtls_ssl_conf_record_pipeline_async(mbedtls_ssl_config *conf,
+                                            mbedtls_ssl_pipeline_t *f_async,
+                                            void *p_async)
+{
+    conf->f_pipeline_async = f_async;
+    conf->p_pipeline_async = p_async;
+}
+#endif /* MBEDTLS_SSL_RECORD_PIPELINE */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 
 void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
@@ -1630,12 +2557,36 @@ void mbedtls_ssl_set_datagram_packing(mbedtls_ssl_context *ssl,
     ssl->disable_datagram_packing = !allow_packing;
 }
 
+void mbedtls_ssl_conf_dtls_app_packing(mbedtls_ssl_config *conf,
+                                       uint32_t max_delay)
+{
+    conf->app_packing_delay = max_delay;
+}
+
 void mbedtls_ssl_conf_handshake_timeout(mbedtls_ssl_config *conf,
                                         uint32_t min, uint32_t max)
 {
     conf->hs_timeout_min = min;
     conf->hs_timeout_max = max;
 }
+
+#if defined(MBEDTLS_HAVE_TIME)
+void mbedtls_ssl_conf_dtls_adaptive_timeout(mbedtls_ssl_config *conf,
+                                            uint32_t floor)
+{
+    conf->hs_timeout_floor = floor;
+}
+#endif
+
+void mbedtls_ssl_conf_dtls_flight_cache(mbedtls_ssl_config *conf, int cache)
+{
+    conf->dtls_flight_cache = (uint8_t) cache;
+}
+
+void mbedtls_ssl_conf_dtls_pmtu_probing(mbedtls_ssl_config *conf, int probing)
+{
+    conf->dtls_pmtu_probing = (uint8_t) probing;
+}
 #endif
 
 void mbedtls_ssl_conf_authmode(mbedtls_ssl_config *conf, int authmode)
@@ -1669,6 +2620,28 @@ void mbedtls_ssl_conf_dbg(mbedtls_ssl_config *conf,
     conf->p_dbg      = p_dbg;
 }
 
+#if defined(MBEDTLS_DEBUG_C)
+void mbedtls_ssl_conf_dbg_event(mbedtls_ssl_config *conf,
+                                mbedtls_ssl_dbg_event_t *f_event,
+                                void *p_event)
+{
+    conf->f_dbg_event = f_event;
+    conf->p_dbg_event = p_event;
+}
+#endif /* MBEDTLS_DEBUG_C */
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+void mbedtls_ssl_conf_handshake_trace(mbedtls_ssl_config *conf,
+                                      mbedtls_ssl_handshake_trace_t *f_trace,
+                                      mbedtls_ssl_trace_clock_t *f_clock,
+                                      void *p_trace)
+{
+    conf->f_hs_trace = f_trace;
+    conf->f_hs_clock = f_clock;
+    conf->p_hs_trace = p_trace;
+}
+#endif /* MBEDTLS_SSL_HANDSHAKE_TRACE */
+
 void mbedtls_ssl_set_bio(mbedtls_ssl_context *ssl,
                          void *p_bio,
                          mbedtls_ssl_send_t *f_send,
@@ -1693,6 +2666,12 @@ void mbedtls_ssl_conf_read_timeout(mbedtls_ssl_config *conf, uint32_t timeout)
     conf->read_timeout   = timeout;
 }
 
+void mbedtls_ssl_conf_handshake_max_steps(mbedtls_ssl_config *conf,
+                                          unsigned int max_steps)
+{
+    conf->hs_max_steps = max_steps;
+}
+
 void mbedtls_ssl_set_timer_cb(mbedtls_ssl_context *ssl,
                               void *p_timer,
                               mbedtls_ssl_set_timer_t *f_set_timer,
@@ -1767,6 +2746,19 @@ int mbedtls_ssl_set_session(mbedtls_ssl_context *ssl, const mbedtls_ssl_session
 
     return 0;
 }
+
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+void mbedtls_ssl_conf_session_store(mbedtls_ssl_config *conf,
+                                    struct mbedtls_ssl_session_store *store)
+{
+    conf->session_store = store;
+}
+
+void mbedtls_ssl_set_server_port(mbedtls_ssl_context *ssl, uint16_t port)
+{
+    ssl->server_port = port;
+}
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
 #endif /* MBEDTLS_SSL_CLI_C */
 
 void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf,
@@ -1776,12 +2768,28 @@ void mbedtls_ssl_conf_ciphersuites(mbedtls_ssl_config *conf,
 }
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+#if defined(MBEDTLS_SSL_SRV_C)
+void mbedtls_ssl_conf_tls13_psk_limits(mbedtls_ssl_config *conf,
+                                       uint16_t max_identities,
+                                       uint16_t max_tickets)
+{
+    conf->tls13_max_psk_identities = max_identities;
+    conf->tls13_max_psk_tickets = max_tickets;
+}
+#endif /* MBEDTLS_SSL_SRV_C */
+
 void mbedtls_ssl_conf_tls13_key_exchange_modes(mbedtls_ssl_config *conf,
                                                const int kex_modes)
 {
     conf->tls13_kex_modes = kex_modes & MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_ALL;
 }
 
+void mbedtls_ssl_conf_tls13_key_update_limit(mbedtls_ssl_config *conf,
+                                             uint32_t records)
+{
+    conf->tls13_key_update_records = records;
+}
+
 #if defined(MBEDTLS_SSL_EARLY_DATA)
 void mbedtls_ssl_conf_early_data(mbedtls_ssl_config *conf,
                                  int early_data_enabled)
@@ -1795,9 +2803,37 @@ void mbedtls_ssl_conf_max_early_data_size(
 {
     conf->max_early_data_size = max_early_data_size;
 }
+
+void mbedtls_ssl_conf_early_data_anti_replay(mbedtls_ssl_config *conf,
+                                             mbedtls_ssl_early_data_replay_t *f_replay,
+                                             void *p_replay)
+{
+    conf->f_early_data_replay = f_replay;
+    conf->p_early_data_replay = p_replay;
+}
+
+void mbedtls_ssl_conf_early_data_cb(mbedtls_ssl_config *conf,
+                                    mbedtls_ssl_early_data_cb_t *f_early_data,
+                                    void *p_early_data)
+{
+    conf->f_early_data = f_early_data;
+    conf->p_early_data = p_early_data;
+}
 #endif /* MBEDTLS_SSL_SRV_C */
 
 #endif /* MBEDTLS_SSL_EARLY_DATA */
+
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+void mbedtls_ssl_conf_tls13_hrr_cookies(mbedtls_ssl_config *conf,
+                                        mbedtls_ssl_cookie_write_t *f_cookie_write,
+                                        mbedtls_ssl_cookie_check_t *f_cookie_check,
+                                        void *p_cookie)
+{
+    conf->f_hrr_cookie_write = f_cookie_write;
+    conf->f_hrr_cookie_check = f_cookie_check;
+    conf->p_hrr_cookie = p_cookie;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
@@ -1813,14 +2849,213 @@ static void ssl_key_cert_free(mbedtls_ssl_key_cert *key_cert)
 
     while (cur != NULL) {
         next = cur->next;
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+        while (cur->compressed != NULL) {
+            mbedtls_ssl_compressed_cert *compressed = cur->compressed;
+            cur->compressed = compressed->next;
+            mbedtls_free(compressed->body);
+            mbedtls_free(compressed);
+        }
+#endif
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        mbedtls_free(cur->cert_list);
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        mbedtls_free(cur->cert_list_tls13);
+#endif
+#endif /* MBEDTLS_SSL_OWN_CERT_MSG_CACHE */
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+        mbedtls_free(cur->ocsp_resp);
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&cur->ocsp_mutex);
+#endif
+#endif
         mbedtls_free(cur);
         cur = next;
     }
 }
 
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+/*
+ * Encode the entries of a certificate_list: the 3-byte length and DER of
+ * each certificate, followed by ext_len bytes of empty extensions.
+ *
+ * A chain too large for any Certificate message is left unencoded, so that
+ * writing the message reports the error as without the cache.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_encode_cert_list(const mbedtls_x509_crt *chain, size_t ext_len,
+                                unsigned char **list, size_t *list_len)
+{
+    const mbedtls_x509_crt *crt;
+    unsigned char *p;
+    size_t len = 0;
+
+    *list = NULL;
+    *list_len = 0;
+
+    for (crt = chain; crt != NULL; crt = crt->next) {
+        if (crt->raw.len > MBEDTLS_SSL_OUT_CONTENT_LEN ||
+            len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+            return 0;
+        }
+        len += 3 + crt->raw.len + ext_len;
+    }
+
+    if (len == 0 || len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+        return 0;
+    }
+
+    p = mbedtls_calloc_tagged(SSL, 1, len);
+    if (p == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    *list = p;
+    *list_len = len;
+
+    for (crt = chain; crt != NULL; crt = crt->next) {
+        MBEDTLS_PUT_UINT24_BE(crt->raw.len, p, 0);
+        memcpy(p + 3, crt->raw.p, crt->raw.len);
+        p += 3 + crt->raw.len;
+        /* Empty extensions, already zero */
+        p += ext_len;
+    }
+
+    return 0;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_key_cert_encode(mbedtls_ssl_key_cert *key_cert)
+{
+    int ret = 0;
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    ret = ssl_encode_cert_list(key_cert->cert, 0,
+                               &key_cert->cert_list, &key_cert->cert_list_len);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    ret = ssl_encode_cert_list(key_cert->cert, 2,
+                               &key_cert->cert_list_tls13,
+                               &key_cert->cert_list_tls13_len);
+#endif
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_OWN_CERT_MSG_CACHE */
+
 /* Append a new keycert entry to a (possibly empty) list */
 MBEDTLS_CHECK_RETURN_CRITICAL
-static int ssl_append_key_cert(mbedtls_ssl_key_cert **head,
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/*
+ * Compress the Certificate message of a server chain with each algorithm
+ * of the configuration, as the body of a CompressedCertificate message
+ * (RFC 8879 section 4):
+ *
+ *     struct {
+ *          CertificateCompressionAlgorithm algorithm;
+ *          uint24 uncompressed_length;
+ *          opaque compressed_certificate_message<1..2^24-1>;
+ *     } CompressedCertificate;
+ *
+ * Chains that are too large, and algorithms that do not make the message
+ * smaller, are skipped: the chain is then sent uncompressed.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_key_cert_compress(const mbedtls_ssl_config *conf,
+                                 mbedtls_ssl_key_cert *key_cert)
+{
+    int ret = 0;
+    const mbedtls_x509_crt *crt;
+    const uint16_t *alg;
+    mbedtls_ssl_compressed_cert *compressed, **tail = &key_cert->compressed;
+    unsigned char *msg = NULL, *out = NULL, *p;
+    size_t msg_len = 4, out_len;
+
+    if (conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        conf->cert_compression_algs == NULL || conf->f_cert_compress == NULL) {
+        return 0;
+    }
+
+    for (crt = key_cert->cert; crt != NULL; crt = crt->next) {
+        if (crt->raw.len > MBEDTLS_SSL_TLS1_3_CERT_MSG_MAX_LEN) {
+            return 0;
+        }
+        msg_len += 3 + crt->raw.len + 2;
+        if (msg_len > MBEDTLS_SSL_TLS1_3_CERT_MSG_MAX_LEN) {
+            return 0;
+        }
+    }
+
+    /* The Certificate message, with empty certificate extensions */
+    msg = mbedtls_calloc_tagged(SSL, 1, msg_len);
+    out = mbedtls_calloc_tagged(SSL, 1, msg_len);
+    if (msg == NULL || out == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto cleanup;
+    }
+
+    p = msg;
+    *p++ = 0;
+    MBEDTLS_PUT_UINT24_BE(msg_len - 4, p, 0);
+    p += 3;
+    for (crt = key_cert->cert; crt != NULL; crt = crt->next) {
+        MBEDTLS_PUT_UINT24_BE(crt->raw.len, p, 0);
+        memcpy(p + 3, crt->raw.p, crt->raw.len);
+        p += 3 + crt->raw.len + 2;
+    }
+
+    for (alg = conf->cert_compression_algs;
+         *alg != MBEDTLS_SSL_CERT_COMPRESSION_NONE; alg++) {
+        if (*alg >= 16) {
+            continue;
+        }
+
+        ret = conf->f_cert_compress(conf->p_cert_compression, *alg,
+                                    msg, msg_len, out, msg_len, &out_len);
+        if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL ||
+            (ret == 0 && (out_len == 0 || out_len >= msg_len))) {
+            ret = 0;
+            continue;
+        }
+        if (ret != 0) {
+            goto cleanup;
+        }
+
+        compressed = mbedtls_calloc_tagged(SSL, 1, sizeof(mbedtls_ssl_compressed_cert));
+        if (compressed == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto cleanup;
+        }
+        *tail = compressed;
+        tail = &compressed->next;
+
+        compressed->body = mbedtls_calloc_tagged(SSL, 1, 8 + out_len);
+        if (compressed->body == NULL) {
+            ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+            goto cleanup;
+        }
+        compressed->alg = *alg;
+        compressed->body_len = 8 + out_len;
+        MBEDTLS_PUT_UINT16_BE(*alg, compressed->body, 0);
+        MBEDTLS_PUT_UINT24_BE(msg_len, compressed->body, 2);
+        MBEDTLS_PUT_UINT24_BE(out_len, compressed->body, 5);
+        memcpy(compressed->body + 8, out, out_len);
+    }
+
+cleanup:
+    mbedtls_free(msg);
+    mbedtls_free(out);
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+static int ssl_append_key_cert(const mbedtls_ssl_config *conf,
+                               mbedtls_ssl_key_cert **head,
                                mbedtls_x509_crt *cert,
                                mbedtls_pk_context *key)
 {
@@ -1833,7 +3068,7 @@ static int ssl_append_key_cert(mbedtls_ssl_key_cert **head,
         return 0;
     }
 
-    new_cert = mbedtls_calloc(1, sizeof(mbedtls_ssl_key_cert));
+    new_cert = mbedtls_calloc_tagged(SSL, 1, sizeof(mbedtls_ssl_key_cert));
     if (new_cert == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
@@ -1841,6 +3076,35 @@ static int ssl_append_key_cert(mbedtls_ssl_key_cert **head,
     new_cert->cert = cert;
     new_cert->key  = key;
     new_cert->next = NULL;
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&new_cert->ocsp_mutex);
+#endif
+#if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    new_cert->tls13_server_usage =
+        mbedtls_x509_crt_check_key_usage(
+            cert, MBEDTLS_X509_KU_DIGITAL_SIGNATURE) == 0 &&
+        mbedtls_x509_crt_check_extended_key_usage(
+            cert, MBEDTLS_OID_SERVER_AUTH,
+            MBEDTLS_OID_SIZE(MBEDTLS_OID_SERVER_AUTH)) == 0;
+#endif
+
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+    if (ssl_key_cert_encode(new_cert) != 0) {
+        ssl_key_cert_free(new_cert);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+#endif
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    {
+        int ret = ssl_key_cert_compress(conf, new_cert);
+        if (ret != 0) {
+            ssl_key_cert_free(new_cert);
+            return ret;
+        }
+    }
+#else
+    (void) conf;
+#endif
 
     /* Update head if the list was null, else add to the end */
     if (*head == NULL) {
@@ -1856,42 +3120,285 @@ static int ssl_append_key_cert(mbedtls_ssl_key_cert **head,
     return 0;
 }
 
-int mbedtls_ssl_conf_own_cert(mbedtls_ssl_config *conf,
-                              mbedtls_x509_crt *own_cert,
-                              mbedtls_pk_context *pk_key)
+int mbedtls_ssl_conf_own_cert(mbedtls_ssl_config *conf,
+                              mbedtls_x509_crt *own_cert,
+                              mbedtls_pk_context *pk_key)
+{
+    return ssl_append_key_cert(conf, &conf->key_cert, own_cert, pk_key);
+}
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+/*
+ * Encode the certificate_authorities of the CertificateRequest message,
+ * written from the DN hints of a server configuration or else from its CA
+ * chain: the 2-byte length and subject DN of each certificate.
+ *
+ * On allocation failure, or for a list too large for the message, the
+ * cache stays empty and the message is written from the chain.
+ */
+static void ssl_conf_encode_ca_dn_list(mbedtls_ssl_config *conf)
+{
+    const mbedtls_x509_crt *chain = conf->ca_chain;
+    const mbedtls_x509_crt *crt;
+    unsigned char *p;
+    size_t len = 0;
+
+    mbedtls_free(conf->ca_dn_list);
+    conf->ca_dn_list = NULL;
+    conf->ca_dn_list_len = 0;
+    conf->ca_dn_list_src = NULL;
+
+    if (conf->endpoint != MBEDTLS_SSL_IS_SERVER) {
+        return;
+    }
+
+#if defined(MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED)
+    if (conf->dn_hints != NULL) {
+        chain = conf->dn_hints;
+    }
+#endif
+
+    for (crt = chain; crt != NULL && crt->version != 0; crt = crt->next) {
+        if (crt->subject_raw.len > MBEDTLS_SSL_OUT_CONTENT_LEN ||
+            len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+            return;
+        }
+        len += 2 + crt->subject_raw.len;
+    }
+
+    if (len == 0 || len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+        return;
+    }
+
+    p = mbedtls_calloc_tagged(SSL, 1, len);
+    if (p == NULL) {
+        return;
+    }
+    conf->ca_dn_list = p;
+    conf->ca_dn_list_len = len;
+    conf->ca_dn_list_src = chain;
+
+    for (crt = chain; crt != NULL && crt->version != 0; crt = crt->next) {
+        MBEDTLS_PUT_UINT16_BE(crt->subject_raw.len, p, 0);
+        memcpy(p + 2, crt->subject_raw.p, crt->subject_raw.len);
+        p += 2 + crt->subject_raw.len;
+    }
+}
+#endif /* MBEDTLS_SSL_CA_DN_LIST_CACHE */
+
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *conf,
+                               mbedtls_x509_crt *ca_chain,
+                               mbedtls_x509_crl *ca_crl)
+{
+    conf->ca_chain   = ca_chain;
+    conf->ca_crl     = ca_crl;
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+    /* mbedtls_ssl_conf_ca_chain() and mbedtls_ssl_conf_ca_cb()
+     * cannot be used together. */
+    conf->f_ca_cb = NULL;
+    conf->p_ca_cb = NULL;
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+    ssl_conf_encode_ca_dn_list(conf);
+#endif
+}
+
+#if defined(MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED)
+void mbedtls_ssl_conf_dn_hints(mbedtls_ssl_config *conf,
+                               const mbedtls_x509_crt *crt)
+{
+    conf->dn_hints = crt;
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+    ssl_conf_encode_ca_dn_list(conf);
+#endif
+}
+#endif /* MBEDTLS_KEY_EXCHANGE_CERT_REQ_ALLOWED_ENABLED */
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+void mbedtls_ssl_conf_ca_cb(mbedtls_ssl_config *conf,
+                            mbedtls_x509_crt_ca_cb_t f_ca_cb,
+                            void *p_ca_cb)
+{
+    conf->f_ca_cb = f_ca_cb;
+    conf->p_ca_cb = p_ca_cb;
+
+    /* mbedtls_ssl_conf_ca_chain() and mbedtls_ssl_conf_ca_cb()
+     * cannot be used together. */
+    conf->ca_chain   = NULL;
+    conf->ca_crl     = NULL;
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+    ssl_conf_encode_ca_dn_list(conf);
+#endif
+}
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+void mbedtls_ssl_conf_verify_cache(mbedtls_ssl_config *conf,
+                                   mbedtls_x509_crt_verify_cache *cache)
+{
+    conf->verify_cache = cache;
+}
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+void mbedtls_ssl_conf_peer_cert_table(mbedtls_ssl_config *conf,
+                                      struct mbedtls_ssl_peer_cert_table *table)
+{
+    conf->peer_cert_table = table;
+}
+#endif /* MBEDTLS_SSL_PEER_CERT_TABLE_C */
+
+void mbedtls_ssl_conf_peer_cert_lazy_ext(mbedtls_ssl_config *conf, int enable)
+{
+    conf->peer_cert_lazy_ext = (uint8_t) (enable != 0);
+}
+
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+void mbedtls_ssl_conf_context_save_keys(mbedtls_ssl_config *conf, int enable)
+{
+    conf->context_save_keys = (uint8_t) (enable != 0);
+}
+#endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+void mbedtls_ssl_conf_cert_compression(mbedtls_ssl_config *conf,
+                                       const uint16_t *algs,
+                                       mbedtls_ssl_cert_compress_t *f_compress,
+                                       mbedtls_ssl_cert_decompress_t *f_decompress,
+                                       void *p_ctx)
+{
+    conf->cert_compression_algs = algs;
+    conf->f_cert_compress = f_compress;
+    conf->f_cert_decompress = f_decompress;
+    conf->p_cert_compression = p_ctx;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/* Room to write the SubjectPublicKeyInfo of any key we can sign with. */
+#define SSL_RPK_SPKI_MAX_LEN    2048
+
+int mbedtls_ssl_conf_own_rpk(mbedtls_ssl_config *conf,
+                             mbedtls_pk_context *pk_key)
+{
+    unsigned char *buf;
+    int len;
+
+    mbedtls_free(conf->rpk_spki);
+    conf->rpk_key = NULL;
+    conf->rpk_spki = NULL;
+    conf->rpk_spki_len = 0;
+
+    if (pk_key == NULL) {
+        return 0;
+    }
+
+    buf = mbedtls_calloc(1, SSL_RPK_SPKI_MAX_LEN);
+    if (buf == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* The key is written at the end of the buffer. */
+    len = mbedtls_pk_write_pubkey_der(pk_key, buf, SSL_RPK_SPKI_MAX_LEN);
+    if (len <= 0) {
+        mbedtls_free(buf);
+        return len < 0 ? len : MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    conf->rpk_spki = mbedtls_calloc(1, (size_t) len);
+    if (conf->rpk_spki == NULL) {
+        mbedtls_free(buf);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    memcpy(conf->rpk_spki, buf + SSL_RPK_SPKI_MAX_LEN - len, (size_t) len);
+    mbedtls_free(buf);
+
+    conf->rpk_key = pk_key;
+    conf->rpk_spki_len = (size_t) len;
+
+    return 0;
+}
+
+void mbedtls_ssl_conf_rpk_verify(mbedtls_ssl_config *conf,
+                                 mbedtls_ssl_rpk_vrfy_t *f_rpk_vrfy,
+                                 void *p_rpk_vrfy)
 {
-    return ssl_append_key_cert(&conf->key_cert, own_cert, pk_key);
+    conf->f_rpk_vrfy = f_rpk_vrfy;
+    conf->p_rpk_vrfy = p_rpk_vrfy;
 }
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
 
-void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config *conf,
-                               mbedtls_x509_crt *ca_chain,
-                               mbedtls_x509_crl *ca_crl)
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+void mbedtls_ssl_conf_ocsp_stapling(mbedtls_ssl_config *conf, int enable)
 {
-    conf->ca_chain   = ca_chain;
-    conf->ca_crl     = ca_crl;
-
-#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
-    /* mbedtls_ssl_conf_ca_chain() and mbedtls_ssl_conf_ca_cb()
-     * cannot be used together. */
-    conf->f_ca_cb = NULL;
-    conf->p_ca_cb = NULL;
-#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+    conf->ocsp_stapling = (uint8_t) (enable != 0);
 }
 
-#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
-void mbedtls_ssl_conf_ca_cb(mbedtls_ssl_config *conf,
-                            mbedtls_x509_crt_ca_cb_t f_ca_cb,
-                            void *p_ca_cb)
+int mbedtls_ssl_conf_own_cert_ocsp(mbedtls_ssl_config *conf,
+                                   const mbedtls_x509_crt *own_cert,
+                                   const unsigned char *resp, size_t resp_len,
+                                   mbedtls_time_t refresh_at)
 {
-    conf->f_ca_cb = f_ca_cb;
-    conf->p_ca_cb = p_ca_cb;
+    mbedtls_ssl_key_cert *key_cert;
+    unsigned char *copy = NULL, *old;
 
-    /* mbedtls_ssl_conf_ca_chain() and mbedtls_ssl_conf_ca_cb()
-     * cannot be used together. */
-    conf->ca_chain   = NULL;
-    conf->ca_crl     = NULL;
+    for (key_cert = conf->key_cert; key_cert != NULL;
+         key_cert = key_cert->next) {
+        if (key_cert->cert == own_cert) {
+            break;
+        }
+    }
+
+    /* The CertificateStatus must fit in an extension. */
+    if (key_cert == NULL || resp_len > 0xFFFF - 4) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (resp_len != 0) {
+        copy = mbedtls_calloc_tagged(SSL, 1, resp_len);
+        if (copy == NULL) {
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        memcpy(copy, resp, resp_len);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&key_cert->ocsp_mutex) != 0) {
+        mbedtls_free(copy);
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    old = key_cert->ocsp_resp;
+    key_cert->ocsp_resp = copy;
+    key_cert->ocsp_resp_len = resp_len;
+    key_cert->ocsp_refresh_at = refresh_at;
+    key_cert->ocsp_refresh_asked = 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&key_cert->ocsp_mutex) != 0) {
+        mbedtls_free(old);
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    mbedtls_free(old);
+
+    return 0;
 }
-#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+void mbedtls_ssl_conf_ocsp_refresh(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_ocsp_refresh_t *f_refresh,
+                                   void *p_refresh)
+{
+    conf->f_ocsp_refresh = f_refresh;
+    conf->p_ocsp_refresh = p_refresh;
+}
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
 #endif /* MBEDTLS_X509_CRT_PARSE_C */
 
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
@@ -1906,7 +3413,14 @@ int mbedtls_ssl_set_hs_own_cert(mbedtls_ssl_context *ssl,
                                 mbedtls_x509_crt *own_cert,
                                 mbedtls_pk_context *pk_key)
 {
-    return ssl_append_key_cert(&ssl->handshake->sni_key_cert,
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+    /* Start a list of our own rather than appending to the shared one. */
+    if (ssl->handshake->sni_key_cert_shared) {
+        ssl->handshake->sni_key_cert = NULL;
+        ssl->handshake->sni_key_cert_shared = 0;
+    }
+#endif
+    return ssl_append_key_cert(ssl->conf, &ssl->handshake->sni_key_cert,
                                own_cert, pk_key);
 }
 
@@ -1931,9 +3445,44 @@ void mbedtls_ssl_set_hs_authmode(mbedtls_ssl_context *ssl,
 {
     ssl->handshake->sni_authmode = authmode;
 }
+
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+void mbedtls_ssl_set_hs_key_cert_list(mbedtls_ssl_context *ssl,
+                                      mbedtls_ssl_key_cert *key_cert)
+{
+    if (!ssl->handshake->sni_key_cert_shared) {
+        ssl_key_cert_free(ssl->handshake->sni_key_cert);
+    }
+    ssl->handshake->sni_key_cert = key_cert;
+    ssl->handshake->sni_key_cert_shared = 1;
+}
+#endif /* MBEDTLS_SSL_SNI_TABLE_C */
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
+#if defined(MBEDTLS_SSL_SNI_TABLE_C) || defined(MBEDTLS_SSL_CREDS_C)
+int mbedtls_ssl_key_cert_append(const mbedtls_ssl_config *conf,
+                                mbedtls_ssl_key_cert **head,
+                                mbedtls_x509_crt *cert,
+                                mbedtls_pk_context *key)
+{
+    return ssl_append_key_cert(conf, head, cert, key);
+}
+
+void mbedtls_ssl_key_cert_free(mbedtls_ssl_key_cert *key_cert)
+{
+    ssl_key_cert_free(key_cert);
+}
+#endif /* MBEDTLS_SSL_SNI_TABLE_C || MBEDTLS_SSL_CREDS_C */
+
+#if defined(MBEDTLS_SSL_CREDS_C)
+void mbedtls_ssl_conf_creds(mbedtls_ssl_config *conf,
+                            struct mbedtls_ssl_creds_slot *slot)
+{
+    conf->creds = slot;
+}
+#endif /* MBEDTLS_SSL_CREDS_C */
+
 void mbedtls_ssl_set_verify(mbedtls_ssl_context *ssl,
                             int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
                             void *p_vrfy)
@@ -1943,6 +3492,19 @@ void mbedtls_ssl_set_verify(mbedtls_ssl_context *ssl,
 }
 #endif
 
+void mbedtls_ssl_set_rng(mbedtls_ssl_context *ssl,
+                         int (*f_rng)(void *, unsigned char *, size_t),
+                         void *p_rng)
+{
+    if (f_rng == NULL) {
+        f_rng = ssl->f_rng;
+        p_rng = ssl->p_rng;
+    }
+
+    ssl->f_rng = f_rng;
+    ssl->p_rng = p_rng;
+}
+
 #if defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -2154,7 +3716,7 @@ static int ssl_conf_set_psk_identity(mbedtls_ssl_config *conf,
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    conf->psk_identity = mbedtls_calloc(1, psk_identity_len);
+    conf->psk_identity = mbedtls_calloc_tagged(SSL, 1, psk_identity_len);
     if (conf->psk_identity == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
@@ -2187,7 +3749,7 @@ int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf,
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    if ((conf->psk = mbedtls_calloc(1, psk_len)) == NULL) {
+    if ((conf->psk = mbedtls_calloc_tagged(SSL, 1, psk_len)) == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
     conf->psk_len = psk_len;
@@ -2205,6 +3767,10 @@ int mbedtls_ssl_conf_psk(mbedtls_ssl_config *conf,
 static void ssl_remove_psk(mbedtls_ssl_context *ssl)
 {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+    ssl->handshake->psk_borrowed = NULL;
+    ssl->handshake->psk_borrowed_len = 0;
+#endif
     if (!mbedtls_svc_key_id_is_null(ssl->handshake->psk_opaque)) {
         /* The maintenance of the external PSK key slot is the
          * user's responsibility. */
@@ -2276,7 +3842,7 @@ int mbedtls_ssl_set_hs_psk(mbedtls_ssl_context *ssl,
     ssl->handshake->psk_opaque_is_internal = 1;
     return mbedtls_ssl_set_hs_psk_opaque(ssl, key);
 #else
-    if ((ssl->handshake->psk = mbedtls_calloc(1, psk_len)) == NULL) {
+    if ((ssl->handshake->psk = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, psk_len)) == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
 
@@ -2330,6 +3896,23 @@ int mbedtls_ssl_set_hs_psk_opaque(mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+int mbedtls_ssl_set_hs_psk_borrowed(mbedtls_ssl_context *ssl,
+                                    const unsigned char *psk, size_t psk_len)
+{
+    if (psk == NULL || psk_len == 0 || psk_len > MBEDTLS_PSK_MAX_LEN ||
+        ssl->handshake == NULL ||
+        ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_3) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ssl_remove_psk(ssl);
+    ssl->handshake->psk_borrowed = psk;
+    ssl->handshake->psk_borrowed_len = psk_len;
+    return 0;
+}
+#endif /* MBEDTLS_SSL_HS_PSK_BORROWED */
+
 #if defined(MBEDTLS_SSL_SRV_C)
 void mbedtls_ssl_conf_psk_cb(mbedtls_ssl_config *conf,
                              int (*f_psk)(void *, mbedtls_ssl_context *, const unsigned char *,
@@ -2398,6 +3981,7 @@ static mbedtls_ssl_mode_t mbedtls_ssl_get_actual_mode(
     return base_mode;
 }
 
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
 mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_transform(
     const mbedtls_ssl_transform *transform)
 {
@@ -2415,6 +3999,7 @@ mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_transform(
 #endif
     return mbedtls_ssl_get_actual_mode(base_mode, encrypt_then_mac);
 }
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_MAC */
 
 mbedtls_ssl_mode_t mbedtls_ssl_get_mode_from_ciphersuite(
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
@@ -2766,6 +4351,30 @@ void mbedtls_ssl_conf_groups(mbedtls_ssl_config *conf,
     conf->group_list = group_list;
 }
 
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+void mbedtls_ssl_conf_group_cache(mbedtls_ssl_config *conf,
+                                  struct mbedtls_ssl_group_cache *cache)
+{
+    conf->group_cache = cache;
+}
+#endif /* MBEDTLS_SSL_GROUP_CACHE_C */
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+void mbedtls_ssl_conf_key_share_pool(mbedtls_ssl_config *conf,
+                                     struct mbedtls_ssl_key_share_pool *pool)
+{
+    conf->key_share_pool = pool;
+}
+#endif /* MBEDTLS_SSL_KEY_SHARE_POOL_C */
+
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+void mbedtls_ssl_conf_ecdhe_reuse(mbedtls_ssl_config *conf,
+                                  struct mbedtls_ssl_ecdhe_reuse *ctx)
+{
+    conf->ecdhe_reuse = ctx;
+}
+#endif /* MBEDTLS_SSL_ECDHE_REUSE_C */
+
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname)
 {
@@ -2794,7 +4403,7 @@ int mbedtls_ssl_set_hostname(mbedtls_ssl_context *ssl, const char *hostname)
     if (hostname == NULL) {
         ssl->hostname = NULL;
     } else {
-        ssl->hostname = mbedtls_calloc(1, hostname_len + 1);
+        ssl->hostname = mbedtls_calloc_tagged(SSL, 1, hostname_len + 1);
         if (ssl->hostname == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -2820,7 +4429,7 @@ void mbedtls_ssl_conf_sni(mbedtls_ssl_config *conf,
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
 
 #if defined(MBEDTLS_SSL_ALPN)
-int mbedtls_ssl_conf_alpn_protocols(mbedtls_ssl_config *conf, const char **protos)
+static int ssl_check_alpn_protocols(const char **protos)
 {
     size_t cur_len, tot_len;
     const char **p;
@@ -2842,6 +4451,17 @@ int mbedtls_ssl_conf_alpn_protocols(mbedtls_ssl_config *conf, const char **proto
         }
     }
 
+    return 0;
+}
+
+int mbedtls_ssl_conf_alpn_protocols(mbedtls_ssl_config *conf, const char **protos)
+{
+    int ret = ssl_check_alpn_protocols(protos);
+
+    if (ret != 0) {
+        return ret;
+    }
+
     conf->alpn_list = protos;
 
     return 0;
@@ -2853,6 +4473,49 @@ const char *mbedtls_ssl_get_alpn_protocol(const mbedtls_ssl_context *ssl)
 }
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_CONFIG_OVERLAY)
+void mbedtls_ssl_config_overlay_init(mbedtls_ssl_config_overlay *overlay)
+{
+    memset(overlay, 0, sizeof(mbedtls_ssl_config_overlay));
+
+    overlay->authmode = MBEDTLS_SSL_VERIFY_UNSET;
+}
+
+void mbedtls_ssl_overlay_ciphersuites(mbedtls_ssl_config_overlay *overlay,
+                                      const int *ciphersuites)
+{
+    overlay->ciphersuite_list = ciphersuites;
+}
+
+#if defined(MBEDTLS_SSL_ALPN)
+int mbedtls_ssl_overlay_alpn_protocols(mbedtls_ssl_config_overlay *overlay,
+                                       const char **protos)
+{
+    int ret;
+
+    if (protos != NULL && (ret = ssl_check_alpn_protocols(protos)) != 0) {
+        return ret;
+    }
+
+    overlay->alpn_list = protos;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_ALPN */
+
+void mbedtls_ssl_overlay_authmode(mbedtls_ssl_config_overlay *overlay,
+                                  int authmode)
+{
+    overlay->authmode = authmode;
+}
+
+void mbedtls_ssl_set_config_overlay(mbedtls_ssl_context *ssl,
+                                    const mbedtls_ssl_config_overlay *overlay)
+{
+    ssl->overlay = overlay;
+}
+#endif /* MBEDTLS_SSL_CONFIG_OVERLAY */
+
 #if defined(MBEDTLS_SSL_DTLS_SRTP)
 void mbedtls_ssl_conf_srtp_mki_value_supported(mbedtls_ssl_config *conf,
                                                int support_mki_value)
@@ -2957,6 +4620,13 @@ void mbedtls_ssl_conf_extended_master_secret(mbedtls_ssl_config *conf, char ems)
 }
 #endif
 
+#if defined(MBEDTLS_SSL_FALSE_START)
+void mbedtls_ssl_conf_false_start(mbedtls_ssl_config *conf, int false_start)
+{
+    conf->false_start = (uint8_t) false_start;
+}
+#endif /* MBEDTLS_SSL_FALSE_START */
+
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
 int mbedtls_ssl_conf_max_frag_len(mbedtls_ssl_config *conf, unsigned char mfl_code)
 {
@@ -2971,6 +4641,22 @@ int mbedtls_ssl_conf_max_frag_len(mbedtls_ssl_config *conf, unsigned char mfl_co
 }
 #endif /* MBEDTLS_SSL_MAX_FRAGMENT_LENGTH */
 
+int mbedtls_ssl_conf_max_content_len(mbedtls_ssl_config *conf,
+                                     size_t in_len, size_t out_len)
+{
+    if ((in_len != 0 && (in_len < MBEDTLS_SSL_MIN_CONTENT_LEN ||
+                         in_len > MBEDTLS_SSL_IN_CONTENT_LEN)) ||
+        (out_len != 0 && (out_len < MBEDTLS_SSL_MIN_CONTENT_LEN ||
+                          out_len > MBEDTLS_SSL_OUT_CONTENT_LEN))) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    conf->in_content_len = (uint16_t) in_len;
+    conf->out_content_len = (uint16_t) out_len;
+
+    return 0;
+}
+
 void mbedtls_ssl_conf_legacy_renegotiation(mbedtls_ssl_config *conf, int allow_legacy)
 {
     conf->allow_legacy_renegotiation = allow_legacy;
@@ -3010,6 +4696,12 @@ void mbedtls_ssl_conf_new_session_tickets(mbedtls_ssl_config *conf,
 {
     conf->new_session_tickets_count = num_tickets;
 }
+
+void mbedtls_ssl_conf_tls13_stateful_tickets(mbedtls_ssl_config *conf,
+                                             uint32_t lifetime)
+{
+    conf->tls13_stateful_ticket_lifetime = lifetime;
+}
 #endif
 
 void mbedtls_ssl_conf_session_tickets_cb(mbedtls_ssl_config *conf,
@@ -3069,6 +4761,18 @@ void mbedtls_ssl_set_async_operation_data(mbedtls_ssl_context *ssl,
         ssl->handshake->user_async_ctx = ctx;
     }
 }
+
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+void mbedtls_ssl_conf_async_verify(mbedtls_ssl_config *conf,
+                                   mbedtls_ssl_async_verify_t *f_async_verify,
+                                   mbedtls_ssl_async_verify_resume_t *f_async_verify_resume,
+                                   mbedtls_ssl_async_cancel_t *f_async_verify_cancel)
+{
+    conf->f_async_verify_start = f_async_verify;
+    conf->f_async_verify_resume = f_async_verify_resume;
+    conf->f_async_verify_cancel = f_async_verify_cancel;
+}
+#endif /* MBEDTLS_X509_CRT_PARSE_C */
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 /*
@@ -3132,7 +4836,7 @@ const char *mbedtls_ssl_get_version(const mbedtls_ssl_context *ssl)
 
 size_t mbedtls_ssl_get_output_record_size_limit(const mbedtls_ssl_context *ssl)
 {
-    const size_t max_len = MBEDTLS_SSL_OUT_CONTENT_LEN;
+    const size_t max_len = mbedtls_ssl_out_content_len(ssl);
     size_t record_size_limit = max_len;
 
     if (ssl->session != NULL &&
@@ -3156,14 +4860,15 @@ size_t mbedtls_ssl_get_output_record_size_limit(const mbedtls_ssl_context *ssl)
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
 size_t mbedtls_ssl_get_input_max_frag_len(const mbedtls_ssl_context *ssl)
 {
-    size_t max_len = MBEDTLS_SSL_IN_CONTENT_LEN;
+    size_t max_len = mbedtls_ssl_in_content_len(ssl);
     size_t read_mfl;
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
     /* Use the configured MFL for the client if we're past SERVER_HELLO_DONE */
     if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
         ssl->state >= MBEDTLS_SSL_SERVER_HELLO_DONE) {
-        return ssl_mfl_code_to_length(ssl->conf->mfl_code);
+        read_mfl = ssl_mfl_code_to_length(ssl->conf->mfl_code);
+        return read_mfl < max_len ? read_mfl : max_len;
     }
 #endif
 
@@ -3214,6 +4919,8 @@ size_t mbedtls_ssl_get_output_max_frag_len(const mbedtls_ssl_context *ssl)
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
 size_t mbedtls_ssl_get_current_mtu(const mbedtls_ssl_context *ssl)
 {
+    size_t mtu = ssl->mtu;
+
     /* Return unlimited mtu for client hello messages to avoid fragmentation. */
     if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
         (ssl->state == MBEDTLS_SSL_CLIENT_HELLO ||
@@ -3221,28 +4928,22 @@ size_t mbedtls_ssl_get_current_mtu(const mbedtls_ssl_context *ssl)
         return 0;
     }
 
-    if (ssl->handshake == NULL || ssl->handshake->mtu == 0) {
-        return ssl->mtu;
+    if (ssl->path_mtu != 0 && (mtu == 0 || ssl->path_mtu < mtu)) {
+        mtu = ssl->path_mtu;
     }
 
-    if (ssl->mtu == 0) {
-        return ssl->handshake->mtu;
+    if (ssl->handshake != NULL && ssl->handshake->mtu != 0 &&
+        (mtu == 0 || ssl->handshake->mtu < mtu)) {
+        mtu = ssl->handshake->mtu;
     }
 
-    return ssl->mtu < ssl->handshake->mtu ?
-           ssl->mtu : ssl->handshake->mtu;
+    return mtu;
 }
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
 int mbedtls_ssl_get_max_out_record_payload(const mbedtls_ssl_context *ssl)
 {
-    size_t max_len = MBEDTLS_SSL_OUT_CONTENT_LEN;
-
-#if !defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) && \
-    !defined(MBEDTLS_SSL_RECORD_SIZE_LIMIT) && \
-    !defined(MBEDTLS_SSL_PROTO_DTLS)
-    (void) ssl;
-#endif
+    size_t max_len = mbedtls_ssl_out_content_len(ssl);
 
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
     const size_t mfl = mbedtls_ssl_get_output_max_frag_len(ssl);
@@ -3308,11 +5009,7 @@ int mbedtls_ssl_get_max_out_record_payload(const mbedtls_ssl_context *ssl)
 
 int mbedtls_ssl_get_max_in_record_payload(const mbedtls_ssl_context *ssl)
 {
-    size_t max_len = MBEDTLS_SSL_IN_CONTENT_LEN;
-
-#if !defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
-    (void) ssl;
-#endif
+    size_t max_len = mbedtls_ssl_in_content_len(ssl);
 
 #if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
     const size_t mfl = mbedtls_ssl_get_input_max_frag_len(ssl);
@@ -3386,6 +5083,7 @@ int mbedtls_ssl_get_session(const mbedtls_ssl_context *ssl,
  * For more detail, see the description of ssl_session_save().
  */
 static size_t ssl_tls12_session_save(const mbedtls_ssl_session *session,
+                                     int flags,
                                      unsigned char *buf,
                                      size_t buf_len)
 {
@@ -3418,16 +5116,21 @@ static size_t ssl_tls12_session_save(const mbedtls_ssl_session *session,
     /*
      * Basic mandatory fields
      */
-    used += 1 /* id_len */
-            + sizeof(session->id)
-            + sizeof(session->master)
+    if ((flags & MBEDTLS_SSL_SESSION_PACK_NO_ID) == 0) {
+        used += 1 /* id_len */
+                + sizeof(session->id);
+
+        if (used <= buf_len) {
+            *p++ = MBEDTLS_BYTE_0(session->id_len);
+            memcpy(p, session->id, 32);
+            p += 32;
+        }
+    }
+
+    used += sizeof(session->master)
             + 4; /* verify_result */
 
     if (used <= buf_len) {
-        *p++ = MBEDTLS_BYTE_0(session->id_len);
-        memcpy(p, session->id, 32);
-        p += 32;
-
         memcpy(p, session->master, 48);
         p += 48;
 
@@ -3537,6 +5240,7 @@ static size_t ssl_tls12_session_save(const mbedtls_ssl_session *session,
 
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls12_session_load(mbedtls_ssl_session *session,
+                                  int flags,
                                   const unsigned char *buf,
                                   size_t len)
 {
@@ -3569,13 +5273,21 @@ static int ssl_tls12_session_load(mbedtls_ssl_session *session,
     /*
      * Basic mandatory fields
      */
-    if (1 + 32 + 48 + 4 > (size_t) (end - p)) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    if ((flags & MBEDTLS_SSL_SESSION_PACK_NO_ID) == 0) {
+        if (1 + 32 > (size_t) (end - p)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+        session->id_len = *p++;
+        memcpy(session->id, p, 32);
+        p += 32;
+    } else {
+        session->id_len = 0;
     }
 
-    session->id_len = *p++;
-    memcpy(session->id, p, 32);
-    p += 32;
+    if (48 + 4 > (size_t) (end - p)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
 
     memcpy(session->master, p, 48);
     p += 48;
@@ -3588,6 +5300,7 @@ static int ssl_tls12_session_load(mbedtls_ssl_session *session,
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
     session->peer_cert = NULL;
+    session->peer_cert_ref = NULL;
 #else
     session->peer_cert_digest = NULL;
 #endif /* !MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
@@ -3616,7 +5329,7 @@ static int ssl_tls12_session_load(mbedtls_ssl_session *session,
             return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
         }
 
-        session->peer_cert = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+        session->peer_cert = mbedtls_calloc_tagged(SSL_PEER_CERT, 1, sizeof(mbedtls_x509_crt));
 
         if (session->peer_cert == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -3658,7 +5371,7 @@ static int ssl_tls12_session_load(mbedtls_ssl_session *session,
         }
 
         session->peer_cert_digest =
-            mbedtls_calloc(1, session->peer_cert_digest_len);
+            mbedtls_calloc_tagged(SSL_SESSION, 1, session->peer_cert_digest_len);
         if (session->peer_cert_digest == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -3688,7 +5401,7 @@ static int ssl_tls12_session_load(mbedtls_ssl_session *session,
                 return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
             }
 
-            session->ticket = mbedtls_calloc(1, session->ticket_len);
+            session->ticket = mbedtls_calloc_tagged(SSL_SESSION, 1, session->ticket_len);
             if (session->ticket == NULL) {
                 return MBEDTLS_ERR_SSL_ALLOC_FAILED;
             }
@@ -3986,7 +5699,7 @@ static int ssl_tls13_session_load(mbedtls_ssl_session *session,
             return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
         }
         if (hostname_len > 0) {
-            session->hostname = mbedtls_calloc(1, hostname_len);
+            session->hostname = mbedtls_calloc_tagged(SSL_SESSION, 1, hostname_len);
             if (session->hostname == NULL) {
                 return MBEDTLS_ERR_SSL_ALLOC_FAILED;
             }
@@ -4018,7 +5731,7 @@ static int ssl_tls13_session_load(mbedtls_ssl_session *session,
             return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
         }
         if (session->ticket_len > 0) {
-            session->ticket = mbedtls_calloc(1, session->ticket_len);
+            session->ticket = mbedtls_calloc_tagged(SSL_SESSION, 1, session->ticket_len);
             if (session->ticket == NULL) {
                 return MBEDTLS_ERR_SSL_ALLOC_FAILED;
             }
@@ -4190,8 +5903,8 @@ static const unsigned char ssl_serialized_session_header[] = {
  * #if defined(MBEDTLS_HAVE_TIME)
  *    uint64 start_time;
  * #endif
- *     uint8 session_id_len;           // at most 32
- *     opaque session_id[32];
+ *     uint8 session_id_len;           // at most 32, both omitted
+ *     opaque session_id[32];          // with MBEDTLS_SSL_SESSION_PACK_NO_ID
  *     opaque master[48];              // fixed length in the standard
  *     uint32 verify_result;
  * #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE
@@ -4253,6 +5966,8 @@ static const unsigned char ssl_serialized_session_header[] = {
  *
  * struct {
  *
+ *                                 // Both omitted with
+ *                                 // MBEDTLS_SSL_SESSION_PACK_NO_HEADER:
  *    opaque mbedtls_version[3];   // library version: major, minor, patch
  *    opaque session_format[2];    // library-version specific 16-bit field
  *                                 // determining the format of the remaining
@@ -4287,7 +6002,7 @@ static const unsigned char ssl_serialized_session_header[] = {
 
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_session_save(const mbedtls_ssl_session *session,
-                            unsigned char omit_header,
+                            int flags,
                             unsigned char *buf,
                             size_t buf_len,
                             size_t *olen)
@@ -4303,7 +6018,7 @@ static int ssl_session_save(const mbedtls_ssl_session *session,
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    if (!omit_header) {
+    if ((flags & MBEDTLS_SSL_SESSION_PACK_NO_HEADER) == 0) {
         /*
          * Add Mbed TLS version identifier
          */
@@ -4334,7 +6049,7 @@ static int ssl_session_save(const mbedtls_ssl_session *session,
     switch (session->tls_version) {
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
         case MBEDTLS_SSL_VERSION_TLS1_2:
-            used += ssl_tls12_session_save(session, p, remaining_len);
+            used += ssl_tls12_session_save(session, flags, p, remaining_len);
             break;
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
@@ -4371,15 +6086,27 @@ int mbedtls_ssl_session_save(const mbedtls_ssl_session *session,
     return ssl_session_save(session, 0, buf, buf_len, olen);
 }
 
+/*
+ * Packed form for session stores, see ssl_misc.h
+ */
+int mbedtls_ssl_session_pack(const mbedtls_ssl_session *session,
+                             int flags,
+                             unsigned char *buf,
+                             size_t buf_len,
+                             size_t *olen)
+{
+    return ssl_session_save(session, flags, buf, buf_len, olen);
+}
+
 /*
  * Deserialize session, see mbedtls_ssl_session_save() for format.
  *
- * This internal version is wrapped by a public function that cleans up in
- * case of error, and has an extra option omit_header.
+ * This internal version is wrapped by public functions that clean up in
+ * case of error, and has extra options in flags.
  */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_session_load(mbedtls_ssl_session *session,
-                            unsigned char omit_header,
+                            int flags,
                             const unsigned char *buf,
                             size_t len)
 {
@@ -4392,7 +6119,7 @@ static int ssl_session_load(mbedtls_ssl_session *session,
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    if (!omit_header) {
+    if ((flags & MBEDTLS_SSL_SESSION_PACK_NO_HEADER) == 0) {
         /*
          * Check Mbed TLS version identifier
          */
@@ -4424,7 +6151,7 @@ static int ssl_session_load(mbedtls_ssl_session *session,
     switch (session->tls_version) {
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
         case MBEDTLS_SSL_VERSION_TLS1_2:
-            return ssl_tls12_session_load(session, p, remaining_len);
+            return ssl_tls12_session_load(session, flags, p, remaining_len);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
@@ -4453,6 +6180,20 @@ int mbedtls_ssl_session_load(mbedtls_ssl_session *session,
     return ret;
 }
 
+int mbedtls_ssl_session_unpack(mbedtls_ssl_session *session,
+                               int flags,
+                               const unsigned char *buf,
+                               size_t len)
+{
+    int ret = ssl_session_load(session, flags, buf, len);
+
+    if (ret != 0) {
+        mbedtls_ssl_session_free(session);
+    }
+
+    return ret;
+}
+
 /*
  * Perform a single step of the SSL handshake
  */
@@ -4475,8 +6216,12 @@ static int ssl_prepare_handshake_step(mbedtls_ssl_context *ssl)
      * peer. Data are only sent here and through
      * `mbedtls_ssl_handle_pending_alert` in case an error that triggered an
      * alert occurred.
+     * When coalescing flights, the records of the previous step have been
+     * held back rather than written to the output buffer, and are only sent
+     * once the handshake needs to read from the peer.
      */
-    if ((ret = mbedtls_ssl_flush_output(ssl)) != 0) {
+    if ((mbedtls_ssl_is_coalescing_flight(ssl) == 0 || ssl->out_left != 0) &&
+        (ret = mbedtls_ssl_flush_output(ssl)) != 0) {
         return ret;
     }
 
@@ -4495,6 +6240,16 @@ static int ssl_prepare_handshake_step(mbedtls_ssl_context *ssl)
 int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    mbedtls_ssl_handshake_trace trace;
+#endif
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    if (ssl != NULL && ssl_lazy_setup_pending(ssl) &&
+        (ret = ssl_lazy_setup_finish(ssl)) != 0) {
+        return ret;
+    }
+#endif
 
     if (ssl            == NULL                       ||
         ssl->conf      == NULL                       ||
@@ -4503,9 +6258,27 @@ int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    memset(&trace, 0, sizeof(trace));
+    if (ssl->conf->f_hs_trace != NULL) {
+        trace.state = ssl->state;
+        trace.start = mbedtls_ssl_trace_clock(ssl);
+        ssl->trace_io_time = 0;
+        ssl->trace_bytes_in = 0;
+        ssl->trace_bytes_out = 0;
+    }
+#endif
+    MBEDTLS_SSL_PROBE2(handshake_step_entry, ssl, ssl->state);
+
+#if defined(MBEDTLS_SSL_STATS) && defined(MBEDTLS_HAVE_TIME)
+    if (ssl->state == MBEDTLS_SSL_HELLO_REQUEST) {
+        ssl->stats_hs_start = mbedtls_ms_time();
+    }
+#endif
+
     ret = ssl_prepare_handshake_step(ssl);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
     ret = mbedtls_ssl_handle_pending_alert(ssl);
@@ -4574,16 +6347,40 @@ int mbedtls_ssl_handshake_step(mbedtls_ssl_context *ssl)
         }
     }
 
+    /* Send the last flight held back by flight coalescing. */
+    if (ret == 0 && ssl->out_coalesce_len != 0 &&
+        mbedtls_ssl_is_coalescing_flight(ssl) == 0) {
+        ret = mbedtls_ssl_flush_output(ssl);
+    }
+
 cleanup:
+#if defined(MBEDTLS_SSL_HANDSHAKE_TRACE)
+    if (ssl->conf->f_hs_trace != NULL) {
+        trace.next_state = ssl->state;
+        trace.ret = ret;
+        trace.end = mbedtls_ssl_trace_clock(ssl);
+        trace.io_time = ssl->trace_io_time;
+        trace.bytes_in = ssl->trace_bytes_in;
+        trace.bytes_out = ssl->trace_bytes_out;
+        ssl->conf->f_hs_trace(ssl->conf->p_hs_trace, ssl, &trace);
+    }
+#endif
+    MBEDTLS_SSL_PROBE3(handshake_step_return, ssl, ssl->state, ret);
     return ret;
 }
 
 /*
  * Perform the SSL handshake
  */
-int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
+/*
+ * Run the handshake, up to the point where the client may False Start if
+ * false_start is set, to its end otherwise.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_handshake(mbedtls_ssl_context *ssl, int false_start)
 {
     int ret = 0;
+    unsigned int steps = 0;
 
     /* Sanity checks */
 
@@ -4604,11 +6401,37 @@ int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
 
     /* Main handshake loop */
     while (ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+#if defined(MBEDTLS_SSL_FALSE_START)
+        if (false_start && mbedtls_ssl_tls12_false_start_ready(ssl)) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("false start"));
+            ret = mbedtls_ssl_flush_output(ssl);
+            break;
+        }
+#else
+        (void) false_start;
+#endif
         ret = mbedtls_ssl_handshake_step(ssl);
 
         if (ret != 0) {
             break;
         }
+
+        /* Give the other connections a turn. What this step wrote is either
+         * sent or held back with the rest of its flight. */
+        if (ssl->conf->hs_max_steps != 0 &&
+            ++steps >= ssl->conf->hs_max_steps &&
+            ssl->state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("handshake yields after %u steps",
+                                      steps));
+            ret = MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS;
+            break;
+        }
+    }
+
+    /* The last flight may still be held back if sending it was
+     * interrupted. */
+    if (ret == 0 && ssl->out_coalesce_len != 0) {
+        ret = mbedtls_ssl_flush_output(ssl);
     }
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= handshake"));
@@ -4616,6 +6439,16 @@ int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
     return ret;
 }
 
+int mbedtls_ssl_handshake(mbedtls_ssl_context *ssl)
+{
+    return ssl_handshake(ssl, 1);
+}
+
+int mbedtls_ssl_handshake_complete(mbedtls_ssl_context *ssl)
+{
+    return ssl_handshake(ssl, 0);
+}
+
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
 #if defined(MBEDTLS_SSL_SRV_C)
 /*
@@ -4700,6 +6533,17 @@ int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl)
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+#if defined(MBEDTLS_SSL_KTLS)
+    /* The kernel cannot switch keys in the middle of the connection. */
+    if (ssl->ktls_directions != 0) {
+        return MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    if (mbedtls_ssl_acquire_buffers(ssl) != 0) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
 #if defined(MBEDTLS_SSL_SRV_C)
     /* On server, just send the request */
     if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER) {
@@ -4740,9 +6584,53 @@ int mbedtls_ssl_renegotiate(mbedtls_ssl_context *ssl)
     }
 #endif /* MBEDTLS_SSL_CLI_C */
 
-    return ret;
+    return ret;
+}
+#endif /* MBEDTLS_SSL_RENEGOTIATION */
+
+#define SSL_HS_ARENA_ALIGN 8
+
+void *mbedtls_ssl_hs_arena_calloc(mbedtls_ssl_handshake_params *handshake,
+                                  size_t n, size_t size)
+{
+#if MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE > 0
+    size_t len;
+    unsigned char *p;
+
+    if (n != 0 && size <= MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE / n) {
+        len = (n * size + SSL_HS_ARENA_ALIGN - 1) &
+              ~(size_t) (SSL_HS_ARENA_ALIGN - 1);
+        if (len != 0 &&
+            len <= MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE - handshake->arena_used) {
+            p = handshake->arena.buf + handshake->arena_used;
+            handshake->arena_used += len;
+            memset(p, 0, len);
+            return p;
+        }
+    }
+#else
+    (void) handshake;
+#endif
+
+    return mbedtls_calloc_tagged(SSL_HANDSHAKE, n, size);
+}
+
+void mbedtls_ssl_hs_arena_free(mbedtls_ssl_handshake_params *handshake,
+                               void *p)
+{
+#if MBEDTLS_SSL_HANDSHAKE_ARENA_SIZE > 0
+    uintptr_t addr = (uintptr_t) p;
+    uintptr_t start = (uintptr_t) handshake->arena.buf;
+
+    if (addr >= start && addr - start < sizeof(handshake->arena.buf)) {
+        return;
+    }
+#else
+    (void) handshake;
+#endif
+
+    mbedtls_free(p);
 }
-#endif /* MBEDTLS_SSL_RENEGOTIATION */
 
 void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
 {
@@ -4780,6 +6668,17 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
         ssl->conf->f_async_cancel(ssl);
         handshake->async_in_progress = 0;
     }
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+    if (ssl->conf->f_async_verify_cancel != NULL &&
+        handshake->async_verify_in_progress != 0) {
+        ssl->conf->f_async_verify_cancel(ssl);
+        handshake->async_verify_in_progress = 0;
+    }
+    if (handshake->async_peer_cert != NULL) {
+        mbedtls_x509_crt_free(handshake->async_peer_cert);
+        mbedtls_free(handshake->async_peer_cert);
+    }
+#endif /* MBEDTLS_X509_CRT_PARSE_C */
 #endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 
 #if defined(PSA_WANT_ALG_SHA_256)
@@ -4796,6 +6695,10 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
     mbedtls_md_free(&handshake->fin_sha384);
 #endif
 #endif
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    psa_hash_abort(&handshake->master_prf.inner);
+    psa_hash_abort(&handshake->master_prf.outer);
+#endif
 
 #if defined(MBEDTLS_DHM_C)
     mbedtls_dhm_free(&handshake->dhm_ctx);
@@ -4831,7 +6734,7 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
     defined(MBEDTLS_KEY_EXCHANGE_WITH_ECDSA_ANY_ENABLED) || \
     defined(MBEDTLS_KEY_EXCHANGE_ECJPAKE_ENABLED)
     /* explicit void pointer cast for buggy MS compiler */
-    mbedtls_free((void *) handshake->curves_tls_id);
+    mbedtls_ssl_hs_arena_free(handshake, (void *) handshake->curves_tls_id);
 #endif
 
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_PSK_ENABLED)
@@ -4858,9 +6761,19 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
      * Free only the linked list wrapper, not the keys themselves
      * since the belong to the SNI callback
      */
+#if defined(MBEDTLS_SSL_SNI_TABLE_C)
+    if (handshake->sni_key_cert_shared) {
+        handshake->sni_key_cert = NULL;
+    }
+#endif
     ssl_key_cert_free(handshake->sni_key_cert);
 #endif /* MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_SSL_SERVER_NAME_INDICATION */
 
+#if defined(MBEDTLS_SSL_CREDS_C)
+    mbedtls_ssl_creds_release(handshake->creds);
+    handshake->creds = NULL;
+#endif
+
 #if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
     mbedtls_x509_crt_restart_free(&handshake->ecrs_ctx);
     if (handshake->ecrs_peer_cert != NULL) {
@@ -4874,14 +6787,20 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
     mbedtls_pk_free(&handshake->peer_pubkey);
 #endif /* MBEDTLS_X509_CRT_PARSE_C && !MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    mbedtls_pk_free(&handshake->peer_rpk);
+    mbedtls_free(handshake->peer_rpk_spki);
+#endif
+
 #if defined(MBEDTLS_SSL_CLI_C) && \
     (defined(MBEDTLS_SSL_PROTO_DTLS) || defined(MBEDTLS_SSL_PROTO_TLS1_3))
-    mbedtls_free(handshake->cookie);
+    mbedtls_ssl_hs_arena_free(handshake, handshake->cookie);
 #endif /* MBEDTLS_SSL_CLI_C &&
           ( MBEDTLS_SSL_PROTO_DTLS || MBEDTLS_SSL_PROTO_TLS1_3 ) */
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     mbedtls_ssl_flight_free(handshake->flight);
+    mbedtls_ssl_flight_cache_free(handshake);
     mbedtls_ssl_buffering_free(ssl);
 #endif /* MBEDTLS_SSL_PROTO_DTLS */
 
@@ -4890,13 +6809,17 @@ void mbedtls_ssl_handshake_free(mbedtls_ssl_context *ssl)
         psa_destroy_key(handshake->xxdh_psa_privkey);
     }
 #endif /* MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED */
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+    mbedtls_ssl_ecdhe_reuse_release(handshake->ecdhe_reuse_key);
+    handshake->ecdhe_reuse_key = NULL;
+#endif
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     mbedtls_ssl_transform_free(handshake->transform_handshake);
-    mbedtls_free(handshake->transform_handshake);
+    mbedtls_ssl_hs_arena_free(handshake, handshake->transform_handshake);
 #if defined(MBEDTLS_SSL_EARLY_DATA)
     mbedtls_ssl_transform_free(handshake->transform_earlydata);
-    mbedtls_free(handshake->transform_earlydata);
+    mbedtls_ssl_hs_arena_free(handshake, handshake->transform_earlydata);
 #endif
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
@@ -4922,7 +6845,7 @@ void mbedtls_ssl_session_free(mbedtls_ssl_session *session)
     }
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
-    ssl_clear_peer_cert(session);
+    mbedtls_ssl_session_clear_peer_cert(session);
 #endif
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_CLI_C)
@@ -4968,6 +6891,10 @@ void mbedtls_ssl_session_free(mbedtls_ssl_session *session)
 #define SSL_SERIALIZED_CONTEXT_CONFIG_DTLS_ANTI_REPLAY_BIT      2
 #define SSL_SERIALIZED_CONTEXT_CONFIG_ALPN_BIT                  3
 
+/* Not a configuration bit: set in the last byte of the header of a context
+ * saved with its key block rather than its random bytes. */
+#define SSL_SERIALIZED_CONTEXT_KEY_BLOCK_BIT                    7
+
 #define SSL_SERIALIZED_CONTEXT_CONFIG_BITFLAG   \
     ((uint32_t) (                              \
          (SSL_SERIALIZED_CONTEXT_CONFIG_DTLS_CONNECTION_ID << \
@@ -5006,18 +6933,36 @@ static const unsigned char ssl_serialized_context_header[] = {
  *
  *  // session sub-structure
  *  opaque session<1..2^32-1>;  // see mbedtls_ssl_session_save()
- *  // transform sub-structure
- *  uint8 random[64];           // ServerHello.random+ClientHello.random
+ *  // transform sub-structure, (D)TLS 1.2
+ *  uint8 random[64];           // ServerHello.random+ClientHello.random, or
+ *  opaque key_block<1..2^8-1>; // with SSL_SERIALIZED_CONTEXT_KEY_BLOCK_BIT,
+ *                              // the keys and implicit IVs
  *  uint8 in_cid<0..2^8-1>      // Connection ID: expected incoming value
  *  uint8 out_cid<0..2^8-1>     // Connection ID: outgoing value to use
+ *  // transform sub-structure, TLS 1.3, each of the hash length
+ *  opaque client_application_traffic_secret_N[];
+ *  opaque server_application_traffic_secret_N[];
+ *  opaque exporter_master_secret[];
+ *  opaque resumption_master_secret[];
  *  // fields from ssl_context
  *  uint32 badmac_seen;         // DTLS: number of records with failing MAC
  *  uint64 in_window_top;       // DTLS: last validated record seq_num
- *  uint64 in_window;           // DTLS: bitmask for replay protection
+ *  uint64 in_window;           // DTLS: bitmask for replay protection,
+ *                              //       of the last 64 records
  *  uint8 disable_datagram_packing; // DTLS: only one record per datagram
  *  uint64 cur_out_ctr;         // Record layer: outgoing sequence number
  *  uint16 mtu;                 // DTLS: path mtu (max outgoing fragment size)
  *  uint8 alpn_chosen<0..2^8-1> // ALPN: negotiated application protocol
+ *  // TLS only
+ *  uint64 in_ctr;              // Record layer: incoming sequence number
+ *  opaque out_pending<0..2^32-1>;  // records not sent yet
+ *  opaque in_plaintext<0..2^32-1>; // application data not read yet
+ *  opaque in_pending<0..2^32-1>;   // data received but not processed yet
+ *
+ * The version of the session determines the transform sub-structure, and
+ * the transport of the configuration whether the TLS-only fields are
+ * present, so the format of a DTLS 1.2 context is the same as before TLS
+ * contexts could be saved.
  *
  * Note that many fields of the ssl_context or sub-structures are not
  * serialized, as they fall in one of the following categories:
@@ -5028,6 +6973,23 @@ static const unsigned char ssl_serialized_context_header[] = {
  *  4. value was temporary (eg content of input buffer)
  *  5. value will be provided by the user again (eg I/O callbacks and context)
  */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+/* Length of each of the TLS 1.3 application secrets of a session, or 0 if
+ * its ciphersuite is unknown. */
+static size_t ssl_context_tls13_secret_len(const mbedtls_ssl_session *session)
+{
+    const mbedtls_ssl_ciphersuite_t *ciphersuite_info =
+        mbedtls_ssl_ciphersuite_from_id(session->ciphersuite);
+
+    if (ciphersuite_info == NULL) {
+        return 0;
+    }
+
+    return mbedtls_md_get_size(
+        mbedtls_md_info_from_type((mbedtls_md_type_t) ciphersuite_info->mac));
+}
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+
 int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
                              unsigned char *buf,
                              size_t buf_len,
@@ -5037,6 +6999,7 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
     size_t used = 0;
     size_t session_len;
     int ret = 0;
+    int save_keys = 0;
 
     /*
      * Enforce usage restrictions, see "return BAD_INPUT_DATA" in
@@ -5055,32 +7018,45 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
         MBEDTLS_SSL_DEBUG_MSG(1, ("Handshake isn't completed"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
+    /* Version must be 1.2, or 1.3 over TLS */
+    if (ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_2 &&
+        (ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_3 ||
+         ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Only (D)TLS 1.2 and TLS 1.3 supported"));
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
     /* Double-check that sub-structures are indeed ready */
-    if (ssl->transform == NULL || ssl->session == NULL) {
+    if (ssl->transform_out == NULL || ssl->session == NULL ||
+        (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2 &&
+         ssl->transform == NULL)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("Serialised structures aren't ready"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-    /* There must be no pending incoming or outgoing data */
-    if (mbedtls_ssl_check_pending(ssl) != 0) {
+    /* There must be no message being processed. With TLS, received and
+     * unsent records are saved, otherwise there must be none. */
+    if (ssl->keep_current_message != 0 ||
+        (ssl->in_hslen > 0 && ssl->in_hslen < ssl->in_msglen) ||
+        (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+         mbedtls_ssl_check_pending(ssl) != 0)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("There is pending incoming data"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-    if (ssl->out_left != 0) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("There is pending outgoing data"));
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
-    /* Protocol must be DTLS, not TLS */
-    if (ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("Only DTLS is supported"));
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    /* Records read ahead are saved as received, so none may have been
+     * decrypted already. */
+    if (ssl->in_pipe != NULL && ssl->in_pipe->ready != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("There are records decrypted ahead"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-    /* Version must be 1.2 */
-    if (ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_2) {
-        MBEDTLS_SSL_DEBUG_MSG(1, ("Only version 1.2 supported"));
+#endif
+    if (ssl->out_coalesce_len != 0 ||
+        (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+         ssl->out_left != 0)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("There is pending outgoing data"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
-    /* We must be using an AEAD ciphersuite */
-    if (mbedtls_ssl_transform_uses_aead(ssl->transform) != 1) {
+    /* We must be using an AEAD ciphersuite, as TLS 1.3 always does */
+    if (mbedtls_ssl_transform_uses_aead(ssl->transform_out) != 1) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("Only AEAD ciphersuites supported"));
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
@@ -5092,6 +7068,15 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
     }
 #endif
 
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_2) {
+        save_keys = ssl->transform->key_block_len != 0 &&
+                    (ssl->conf->context_save_keys ||
+                     !ssl->transform->has_randbytes);
+        if (!save_keys && !ssl->transform->has_randbytes) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+    }
+
     /*
      * Version and format identifier
      */
@@ -5101,12 +7086,16 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
         memcpy(p, ssl_serialized_context_header,
                sizeof(ssl_serialized_context_header));
         p += sizeof(ssl_serialized_context_header);
+        if (save_keys) {
+            p[-1] |= 1u << SSL_SERIALIZED_CONTEXT_KEY_BLOCK_BIT;
+        }
     }
 
     /*
      * Session (length + data)
      */
-    ret = ssl_session_save(ssl->session, 1, NULL, 0, &session_len);
+    ret = ssl_session_save(ssl->session, MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
+                           NULL, 0, &session_len);
     if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
         return ret;
     }
@@ -5116,7 +7105,7 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
         MBEDTLS_PUT_UINT32_BE(session_len, p, 0);
         p += 4;
 
-        ret = ssl_session_save(ssl->session, 1,
+        ret = ssl_session_save(ssl->session, MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
                                p, session_len, &session_len);
         if (ret != 0) {
             return ret;
@@ -5128,25 +7117,60 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
     /*
      * Transform
      */
-    used += sizeof(ssl->transform->randbytes);
-    if (used <= buf_len) {
-        memcpy(p, ssl->transform->randbytes,
-               sizeof(ssl->transform->randbytes));
-        p += sizeof(ssl->transform->randbytes);
-    }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        const mbedtls_ssl_tls13_application_secrets *secrets =
+            &ssl->session->app_secrets;
+        size_t hash_len = ssl_context_tls13_secret_len(ssl->session);
+
+        if (hash_len == 0) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+        used += 4 * hash_len;
+        if (used <= buf_len) {
+            memcpy(p, secrets->client_application_traffic_secret_N, hash_len);
+            p += hash_len;
+            memcpy(p, secrets->server_application_traffic_secret_N, hash_len);
+            p += hash_len;
+            memcpy(p, secrets->exporter_master_secret, hash_len);
+            p += hash_len;
+            memcpy(p, secrets->resumption_master_secret, hash_len);
+            p += hash_len;
+        }
+    } else
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+    {
+        if (save_keys) {
+            used += 1U + ssl->transform->key_block_len;
+            if (used <= buf_len) {
+                *p++ = ssl->transform->key_block_len;
+                memcpy(p, ssl->transform->key_block,
+                       ssl->transform->key_block_len);
+                p += ssl->transform->key_block_len;
+            }
+        } else {
+            used += sizeof(ssl->transform->randbytes);
+            if (used <= buf_len) {
+                memcpy(p, ssl->transform->randbytes,
+                       sizeof(ssl->transform->randbytes));
+                p += sizeof(ssl->transform->randbytes);
+            }
+        }
 
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    used += 2U + ssl->transform->in_cid_len + ssl->transform->out_cid_len;
-    if (used <= buf_len) {
-        *p++ = ssl->transform->in_cid_len;
-        memcpy(p, ssl->transform->in_cid, ssl->transform->in_cid_len);
-        p += ssl->transform->in_cid_len;
+        used += 2U + ssl->transform->in_cid_len + ssl->transform->out_cid_len;
+        if (used <= buf_len) {
+            *p++ = ssl->transform->in_cid_len;
+            memcpy(p, ssl->transform->in_cid, ssl->transform->in_cid_len);
+            p += ssl->transform->in_cid_len;
 
-        *p++ = ssl->transform->out_cid_len;
-        memcpy(p, ssl->transform->out_cid, ssl->transform->out_cid_len);
-        p += ssl->transform->out_cid_len;
-    }
+            *p++ = ssl->transform->out_cid_len;
+            memcpy(p, ssl->transform->out_cid, ssl->transform->out_cid_len);
+            p += ssl->transform->out_cid_len;
+        }
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+    }
 
     /*
      * Saved fields from top-level ssl_context structure
@@ -5163,7 +7187,7 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
         MBEDTLS_PUT_UINT64_BE(ssl->in_window_top, p, 0);
         p += 8;
 
-        MBEDTLS_PUT_UINT64_BE(ssl->in_window, p, 0);
+        MBEDTLS_PUT_UINT64_BE(ssl->in_window[0], p, 0);
         p += 8;
     }
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
@@ -5207,6 +7231,53 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
     }
 #endif /* MBEDTLS_SSL_ALPN */
 
+    /*
+     * Record layer state of TLS: the implicit incoming sequence number,
+     * and the data buffered in either direction.
+     */
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        const unsigned char *in_pending = ssl->in_hdr;
+        size_t in_pending_len = ssl->in_ahead_len;
+        size_t in_plaintext_len = ssl->in_offt != NULL ? ssl->in_msglen : 0;
+
+        /* A partially received record is still at the start. */
+        if (ssl->in_left != 0) {
+            in_pending_len = ssl->in_left;
+        } else if (in_pending_len != 0) {
+            in_pending += ssl->in_ahead_offset;
+        }
+
+        used += MBEDTLS_SSL_SEQUENCE_NUMBER_LEN + 12 + ssl->out_left +
+                in_plaintext_len + in_pending_len;
+        if (used <= buf_len) {
+            /* See mbedtls_ssl_release_buffers() */
+            memcpy(p, ssl->in_buf != NULL ? ssl->in_ctr : ssl->in_ctr_saved,
+                   MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+            p += MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+
+            MBEDTLS_PUT_UINT32_BE(ssl->out_left, p, 0);
+            p += 4;
+            if (ssl->out_left != 0) {
+                memcpy(p, ssl->out_hdr - ssl->out_left, ssl->out_left);
+                p += ssl->out_left;
+            }
+
+            MBEDTLS_PUT_UINT32_BE(in_plaintext_len, p, 0);
+            p += 4;
+            if (in_plaintext_len != 0) {
+                memcpy(p, ssl->in_offt, in_plaintext_len);
+                p += in_plaintext_len;
+            }
+
+            MBEDTLS_PUT_UINT32_BE(in_pending_len, p, 0);
+            p += 4;
+            if (in_pending_len != 0) {
+                memcpy(p, in_pending, in_pending_len);
+                p += in_pending_len;
+            }
+        }
+    }
+
     /*
      * Done
      */
@@ -5221,6 +7292,72 @@ int mbedtls_ssl_context_save(mbedtls_ssl_context *ssl,
     return mbedtls_ssl_session_reset_int(ssl, 0);
 }
 
+/*
+ * Restore the TLS record layer state saved by mbedtls_ssl_context_save().
+ * The unsent records go at the start of the output buffer, the application
+ * data not read yet where a decrypted record would be, and the data received
+ * but not processed yet after it, as if read ahead.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_context_load_tls_buffers(mbedtls_ssl_context *ssl,
+                                        const unsigned char **p_buf,
+                                        const unsigned char *end)
+{
+    const unsigned char *p = *p_buf;
+    size_t out_len, plaintext_len, pending_len, pending_offset;
+    const size_t in_room = ssl->in_buf_len - (size_t) (ssl->in_hdr - ssl->in_buf);
+    const size_t out_room = ssl->out_buf_len - (size_t) (ssl->out_hdr - ssl->out_buf);
+
+    if ((size_t) (end - p) < MBEDTLS_SSL_SEQUENCE_NUMBER_LEN + 4) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(ssl->in_ctr, p, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+    p += MBEDTLS_SSL_SEQUENCE_NUMBER_LEN;
+
+    out_len = MBEDTLS_GET_UINT32_BE(p, 0);
+    p += 4;
+    if (out_len > out_room || (size_t) (end - p) < out_len + 4) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(ssl->out_hdr, p, out_len);
+    ssl->out_hdr += out_len;
+    ssl->out_left = out_len;
+    p += out_len;
+
+    plaintext_len = MBEDTLS_GET_UINT32_BE(p, 0);
+    p += 4;
+    pending_offset = (size_t) (ssl->in_msg - ssl->in_hdr) + plaintext_len;
+    if (plaintext_len > mbedtls_ssl_in_content_len(ssl) ||
+        pending_offset > in_room ||
+        (size_t) (end - p) < plaintext_len + 4) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    if (plaintext_len != 0) {
+        memcpy(ssl->in_msg, p, plaintext_len);
+        ssl->in_msgtype = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+        ssl->in_msglen = plaintext_len;
+        ssl->in_offt = ssl->in_msg;
+        p += plaintext_len;
+    } else {
+        pending_offset = 0;
+    }
+
+    pending_len = MBEDTLS_GET_UINT32_BE(p, 0);
+    p += 4;
+    if (pending_len > in_room - pending_offset ||
+        (size_t) (end - p) < pending_len) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    memcpy(ssl->in_hdr + pending_offset, p, pending_len);
+    ssl->in_ahead_offset = pending_offset;
+    ssl->in_ahead_len = pending_len;
+    p += pending_len;
+
+    *p_buf = p;
+
+    return 0;
+}
+
 /*
  * Deserialize context, see mbedtls_ssl_context_save() for format.
  *
@@ -5236,8 +7373,10 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
     const unsigned char * const end = buf + len;
     size_t session_len;
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int key_block = 0;
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
     tls_prf_fn prf_func = NULL;
+    size_t key_block_len = 0;
 #endif
 
     /*
@@ -5259,9 +7398,9 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
         ssl->conf->disable_renegotiation != MBEDTLS_SSL_RENEGOTIATION_DISABLED ||
 #endif
-        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_DATAGRAM ||
-        ssl->conf->max_tls_version < MBEDTLS_SSL_VERSION_TLS1_2 ||
-        ssl->conf->min_tls_version > MBEDTLS_SSL_VERSION_TLS1_2
+        (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
+         (ssl->conf->max_tls_version < MBEDTLS_SSL_VERSION_TLS1_2 ||
+          ssl->conf->min_tls_version > MBEDTLS_SSL_VERSION_TLS1_2))
         ) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
@@ -5275,10 +7414,17 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
+    /* The last byte may have the key block bit set on top of the
+     * configuration bits. */
     if (memcmp(p, ssl_serialized_context_header,
-               sizeof(ssl_serialized_context_header)) != 0) {
+               sizeof(ssl_serialized_context_header) - 1) != 0 ||
+        (p[sizeof(ssl_serialized_context_header) - 1] &
+         ~(1u << SSL_SERIALIZED_CONTEXT_KEY_BLOCK_BIT)) !=
+        ssl_serialized_context_header[sizeof(ssl_serialized_context_header) - 1]) {
         return MBEDTLS_ERR_SSL_VERSION_MISMATCH;
     }
+    key_block = (p[sizeof(ssl_serialized_context_header) - 1] >>
+                 SSL_SERIALIZED_CONTEXT_KEY_BLOCK_BIT) & 1;
     p += sizeof(ssl_serialized_context_header);
 
     /*
@@ -5302,7 +7448,8 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    ret = ssl_session_load(ssl->session, 1, p, session_len);
+    ret = ssl_session_load(ssl->session, MBEDTLS_SSL_SESSION_PACK_NO_HEADER,
+                           p, session_len);
     if (ret != 0) {
         mbedtls_ssl_session_free(ssl->session);
         return ret;
@@ -5310,71 +7457,117 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
 
     p += session_len;
 
+    /* The version must be one the configuration allows, and DTLS 1.3 is
+     * not supported. Only (D)TLS 1.2 contexts have a key block. */
+    if (ssl->session->tls_version < ssl->conf->min_tls_version ||
+        ssl->session->tls_version > ssl->conf->max_tls_version ||
+        (ssl->session->tls_version != MBEDTLS_SSL_VERSION_TLS1_2 &&
+         (key_block ||
+          ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM))) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
     /*
      * Transform
      */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    if (ssl->session->tls_version == MBEDTLS_SSL_VERSION_TLS1_3) {
+        mbedtls_ssl_tls13_application_secrets *secrets =
+            &ssl->session->app_secrets;
+        size_t hash_len = ssl_context_tls13_secret_len(ssl->session);
 
-    /* This has been allocated by ssl_handshake_init(), called by
-     * by either mbedtls_ssl_session_reset_int() or mbedtls_ssl_setup(). */
-#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    ssl->transform = ssl->transform_negotiate;
-    ssl->transform_in = ssl->transform;
-    ssl->transform_out = ssl->transform;
-    ssl->transform_negotiate = NULL;
-#endif
+        if (hash_len == 0 || (size_t) (end - p) < 4 * hash_len) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+        memcpy(secrets->client_application_traffic_secret_N, p, hash_len);
+        p += hash_len;
+        memcpy(secrets->server_application_traffic_secret_N, p, hash_len);
+        p += hash_len;
+        memcpy(secrets->exporter_master_secret, p, hash_len);
+        p += hash_len;
+        memcpy(secrets->resumption_master_secret, p, hash_len);
+        p += hash_len;
 
+        ret = mbedtls_ssl_tls13_restore_application_transform(ssl);
+        if (ret != 0) {
+            return ret;
+        }
+        ssl->transform_in = ssl->transform_application;
+        ssl->transform_out = ssl->transform_application;
+    } else
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+    {
 #if defined(MBEDTLS_SSL_PROTO_TLS1_2)
-    prf_func = ssl_tls12prf_from_cs(ssl->session->ciphersuite);
-    if (prf_func == NULL) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        /* This has been allocated by ssl_handshake_init(), called by
+         * by either mbedtls_ssl_session_reset_int() or mbedtls_ssl_setup(). */
+        ssl->transform = ssl->transform_negotiate;
+        ssl->transform_in = ssl->transform;
+        ssl->transform_out = ssl->transform;
+        ssl->transform_negotiate = NULL;
 
-    /* Read random bytes and populate structure */
-    if ((size_t) (end - p) < sizeof(ssl->transform->randbytes)) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        prf_func = ssl_tls12prf_from_cs(ssl->session->ciphersuite);
+        if (prf_func == NULL) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+
+        /* Read the key block, or the random bytes to derive it from, and
+         * populate structure */
+        if (key_block) {
+            if ((size_t) (end - p) < 1 || (size_t) (end - p) < 1u + *p) {
+                return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+            }
+            key_block_len = *p++;
+        } else if ((size_t) (end - p) < sizeof(ssl->transform->randbytes)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
 
-    ret = ssl_tls12_populate_transform(ssl->transform,
-                                       ssl->session->ciphersuite,
-                                       ssl->session->master,
+        ret = ssl_tls12_populate_transform(ssl->transform,
+                                           ssl->session->ciphersuite,
+                                           ssl->session->master,
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
-                                       ssl->session->encrypt_then_mac,
+                                           ssl->session->encrypt_then_mac,
 #endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
-                                       prf_func,
-                                       p, /* currently pointing to randbytes */
-                                       MBEDTLS_SSL_VERSION_TLS1_2, /* (D)TLS 1.2 is forced */
-                                       ssl->conf->endpoint,
-                                       ssl);
-    if (ret != 0) {
-        return ret;
-    }
-#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
-    p += sizeof(ssl->transform->randbytes);
+                                           prf_func,
+                                           key_block ? NULL : p,
+                                           key_block ? p : NULL,
+                                           key_block_len,
+                                           MBEDTLS_SSL_VERSION_TLS1_2, /* (D)TLS 1.2 is forced */
+                                           ssl->conf->endpoint,
+                                           ssl);
+        if (ret != 0) {
+            return ret;
+        }
+        p += key_block ? key_block_len : sizeof(ssl->transform->randbytes);
 
 #if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
-    /* Read connection IDs and store them */
-    if ((size_t) (end - p) < 1) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        /* Read connection IDs and store them */
+        if ((size_t) (end - p) < 1) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
 
-    ssl->transform->in_cid_len = *p++;
+        ssl->transform->in_cid_len = *p++;
 
-    if ((size_t) (end - p) < ssl->transform->in_cid_len + 1u) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        if ((size_t) (end - p) < ssl->transform->in_cid_len + 1u) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
 
-    memcpy(ssl->transform->in_cid, p, ssl->transform->in_cid_len);
-    p += ssl->transform->in_cid_len;
+        memcpy(ssl->transform->in_cid, p, ssl->transform->in_cid_len);
+        p += ssl->transform->in_cid_len;
 
-    ssl->transform->out_cid_len = *p++;
+        ssl->transform->out_cid_len = *p++;
 
-    if ((size_t) (end - p) < ssl->transform->out_cid_len) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+        if ((size_t) (end - p) < ssl->transform->out_cid_len) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
 
-    memcpy(ssl->transform->out_cid, p, ssl->transform->out_cid_len);
-    p += ssl->transform->out_cid_len;
+        memcpy(ssl->transform->out_cid, p, ssl->transform->out_cid_len);
+        p += ssl->transform->out_cid_len;
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+#else
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+    }
 
     /*
      * Saved fields from top-level ssl_context structure
@@ -5394,7 +7587,10 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
     ssl->in_window_top = MBEDTLS_GET_UINT64_BE(p, 0);
     p += 8;
 
-    ssl->in_window = MBEDTLS_GET_UINT64_BE(p, 0);
+    /* Only the last 64 records were saved: consider the older ones seen
+     * rather than accept a replay of them. */
+    memset(ssl->in_window, 0xFF, sizeof(ssl->in_window));
+    ssl->in_window[0] = MBEDTLS_GET_UINT64_BE(p, 0);
     p += 8;
 #endif /* MBEDTLS_SSL_DTLS_ANTI_REPLAY */
 
@@ -5432,9 +7628,9 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
 
         alpn_len = *p++;
 
-        if (alpn_len != 0 && ssl->conf->alpn_list != NULL) {
+        if (alpn_len != 0 && mbedtls_ssl_get_alpn_list(ssl) != NULL) {
             /* alpn_chosen should point to an item in the configured list */
-            for (cur = ssl->conf->alpn_list; *cur != NULL; cur++) {
+            for (cur = mbedtls_ssl_get_alpn_list(ssl); *cur != NULL; cur++) {
                 if (strlen(*cur) == alpn_len &&
                     memcmp(p, *cur, alpn_len) == 0) {
                     ssl->alpn_chosen = *cur;
@@ -5452,6 +7648,13 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
     }
 #endif /* MBEDTLS_SSL_ALPN */
 
+    if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_STREAM) {
+        ret = ssl_context_load_tls_buffers(ssl, &p, end);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
     /*
      * Forced fields from top-level ssl_context structure
      *
@@ -5459,50 +7662,140 @@ static int ssl_context_load(mbedtls_ssl_context *ssl,
      * mbedtls_ssl_reset(), so we only need to set the remaining ones.
      */
     ssl->state = MBEDTLS_SSL_HANDSHAKE_OVER;
-    ssl->tls_version = MBEDTLS_SSL_VERSION_TLS1_2;
+    ssl->tls_version = ssl->session->tls_version;
 
     /* Adjust pointers for header fields of outgoing records to
      * the given transform, accounting for explicit IV and CID. */
-    mbedtls_ssl_update_out_pointers(ssl, ssl->transform);
+    mbedtls_ssl_update_out_pointers(ssl, ssl->transform_out);
 
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     ssl->in_epoch = 1;
 #endif
 
-    /* mbedtls_ssl_reset() leaves the handshake sub-structure allocated,
-     * which we don't want - otherwise we'd end up freeing the wrong transform
-     * by calling mbedtls_ssl_handshake_wrapup_free_hs_transform()
-     * inappropriately. */
-    if (ssl->handshake != NULL) {
-        mbedtls_ssl_handshake_free(ssl);
-        mbedtls_free(ssl->handshake);
-        ssl->handshake = NULL;
+    /* mbedtls_ssl_reset() leaves the handshake sub-structure allocated,
+     * which we don't want - otherwise we'd end up freeing the wrong transform
+     * by calling mbedtls_ssl_handshake_wrapup_free_hs_transform()
+     * inappropriately. */
+    if (ssl->handshake != NULL) {
+        mbedtls_ssl_handshake_free(ssl);
+        mbedtls_free(ssl->handshake);
+        ssl->handshake = NULL;
+    }
+
+    /*
+     * Done - should have consumed entire buffer
+     */
+    if (p != end) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    return 0;
+}
+
+/*
+ * Deserialize context: public wrapper for error cleaning
+ */
+int mbedtls_ssl_context_load(mbedtls_ssl_context *context,
+                             const unsigned char *buf,
+                             size_t len)
+{
+    int ret = ssl_context_load(context, buf, len);
+
+    if (ret != 0) {
+        mbedtls_ssl_free(context);
+    }
+
+    return ret;
+}
+
+/*
+ * Release what a context reset by mbedtls_ssl_context_save() still holds:
+ * the buffers and the handshake structure prepared for the next
+ * connection.
+ */
+static void ssl_context_park_release(mbedtls_ssl_context *ssl)
+{
+    if (ssl->out_buf != NULL) {
+        ssl_buffer_release(ssl->conf, ssl->out_buf, ssl->out_buf_len);
+    }
+    if (ssl->in_buf != NULL) {
+        ssl_buffer_release(ssl->conf, ssl->in_buf, ssl->in_buf_len);
+    }
+
+    if (ssl->handshake != NULL) {
+        mbedtls_ssl_handshake_free(ssl);
+        mbedtls_free(ssl->handshake);
+        ssl->handshake = NULL;
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        mbedtls_ssl_transform_free(ssl->transform_negotiate);
+        mbedtls_free(ssl->transform_negotiate);
+        ssl->transform_negotiate = NULL;
+#endif
+
+        mbedtls_ssl_session_free(ssl->session_negotiate);
+        mbedtls_free(ssl->session_negotiate);
+        ssl->session_negotiate = NULL;
+    }
+    mbedtls_free(ssl->handshake_spare);
+    ssl->handshake_spare = NULL;
+
+    ssl->in_buf_len = 0;
+    ssl->out_buf_len = 0;
+    ssl->in_buf = NULL;
+    ssl->out_buf = NULL;
+
+    ssl->in_hdr = NULL;
+    ssl->in_ctr = NULL;
+    ssl->in_len = NULL;
+    ssl->in_iv = NULL;
+    ssl->in_msg = NULL;
+
+    ssl->out_hdr = NULL;
+    ssl->out_ctr = NULL;
+    ssl->out_len = NULL;
+    ssl->out_iv = NULL;
+    ssl->out_msg = NULL;
+}
+
+int mbedtls_ssl_park(mbedtls_ssl_context *ssl,
+                     unsigned char *buf,
+                     size_t buf_len,
+                     size_t *olen)
+{
+    int ret = mbedtls_ssl_context_save(ssl, buf, buf_len, olen);
+
+    if (ret != 0) {
+        return ret;
     }
 
-    /*
-     * Done - should have consumed entire buffer
-     */
-    if (p != end) {
-        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-    }
+    ssl_context_park_release(ssl);
 
     return 0;
 }
 
-/*
- * Deserialize context: public wrapper for error cleaning
- */
-int mbedtls_ssl_context_load(mbedtls_ssl_context *context,
-                             const unsigned char *buf,
-                             size_t len)
+int mbedtls_ssl_unpark(mbedtls_ssl_context *ssl,
+                       const unsigned char *buf,
+                       size_t len)
 {
-    int ret = ssl_context_load(context, buf, len);
+    const mbedtls_ssl_config *conf = ssl->conf;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
-    if (ret != 0) {
-        mbedtls_ssl_free(context);
+    /* Unlike a context whose buffers were released, a parked one has no
+     * connection. */
+    if (conf == NULL || ssl->state != MBEDTLS_SSL_HELLO_REQUEST ||
+        ssl->session != NULL || ssl->in_buf != NULL || ssl->out_buf != NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
-    return ret;
+    if ((ret = mbedtls_ssl_setup(ssl, conf)) != 0) {
+        /* mbedtls_ssl_setup() leaves no buffer allocated on failure */
+        ssl_context_park_release(ssl);
+        ssl->conf = conf;
+        return ret;
+    }
+
+    return mbedtls_ssl_context_load(ssl, buf, len);
 }
 #endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
 
@@ -5517,27 +7810,21 @@ void mbedtls_ssl_free(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> free"));
 
-    if (ssl->out_buf != NULL) {
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-        size_t out_buf_len = ssl->out_buf_len;
-#else
-        size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN;
+#if defined(MBEDTLS_SSL_STATS)
+    ssl_stats_fold(ssl);
 #endif
 
-        mbedtls_zeroize_and_free(ssl->out_buf, out_buf_len);
+    if (ssl->out_buf != NULL) {
+        ssl_buffer_release(ssl->conf, ssl->out_buf, ssl->out_buf_len);
         ssl->out_buf = NULL;
     }
 
-    if (ssl->in_buf != NULL) {
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
-        size_t in_buf_len = ssl->in_buf_len;
-#else
-        size_t in_buf_len = MBEDTLS_SSL_IN_BUFFER_LEN;
-#endif
+    mbedtls_free(ssl->out_coalesce_buf);
 
-        mbedtls_zeroize_and_free(ssl->in_buf, in_buf_len);
-        ssl->in_buf = NULL;
+    if (ssl->in_buf != NULL && !ssl_lazy_setup_pending(ssl)) {
+        ssl_buffer_release(ssl->conf, ssl->in_buf, ssl->in_buf_len);
     }
+    ssl->in_buf = NULL;
 
     if (ssl->transform) {
         mbedtls_ssl_transform_free(ssl->transform);
@@ -5556,6 +7843,7 @@ void mbedtls_ssl_free(mbedtls_ssl_context *ssl)
         mbedtls_ssl_session_free(ssl->session_negotiate);
         mbedtls_free(ssl->session_negotiate);
     }
+    mbedtls_free(ssl->handshake_spare);
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
     mbedtls_ssl_transform_free(ssl->transform_application);
@@ -5577,6 +7865,23 @@ void mbedtls_ssl_free(mbedtls_ssl_context *ssl)
     mbedtls_free(ssl->cli_id);
 #endif
 
+#if defined(MBEDTLS_SSL_RECORD_PIPELINE)
+    mbedtls_ssl_pipeline_free(ssl->in_pipe);
+    mbedtls_ssl_pipeline_free(ssl->out_pipe);
+#endif
+
+#if defined(MBEDTLS_SSL_QUIC)
+    for (size_t i = 0; i < MBEDTLS_SSL_QUIC_LEVELS; i++) {
+        mbedtls_free(ssl->quic_in[i]);
+    }
+    mbedtls_free(ssl->quic_tp);
+    mbedtls_free(ssl->quic_peer_tp);
+#endif /* MBEDTLS_SSL_QUIC */
+
+#if defined(MBEDTLS_SSL_FULL_DUPLEX)
+    mbedtls_mutex_free(&ssl->mutex);
+#endif
+
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= free"));
 
     /* Actually clear after last debug message */
@@ -5825,11 +8130,15 @@ static int ssl_check_no_sig_alg_duplication(const uint16_t *sig_algs)
 int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
                                 int endpoint, int transport, int preset)
 {
-#if defined(MBEDTLS_DHM_C) && defined(MBEDTLS_SSL_SRV_C)
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-#endif
-
 #if defined(MBEDTLS_DEBUG_C) && defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
+    /* The preset tables are constant: check them for the first
+     * configuration only. Concurrent first calls just check twice. */
+    static int sig_algs_checked = 0;
+
+    if (sig_algs_checked) {
+        goto sig_algs_done;
+    }
+
     if (ssl_check_no_sig_alg_duplication(ssl_preset_suiteb_sig_algs)) {
         mbedtls_printf("ssl_preset_suiteb_sig_algs has duplicated entries\n");
         return MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -5851,6 +8160,10 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
         return MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     }
 #endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+
+    sig_algs_checked = 1;
+
+sig_algs_done:
 #endif /* MBEDTLS_DEBUG_C && MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
 
     /* Use the functions here so that they are covered in tests,
@@ -5903,20 +8216,9 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
     memset(conf->renego_period + 2, 0xFF, 6);
 #endif
 
-#if defined(MBEDTLS_DHM_C) && defined(MBEDTLS_SSL_SRV_C)
-    if (endpoint == MBEDTLS_SSL_IS_SERVER) {
-        const unsigned char dhm_p[] =
-            MBEDTLS_DHM_RFC3526_MODP_2048_P_BIN;
-        const unsigned char dhm_g[] =
-            MBEDTLS_DHM_RFC3526_MODP_2048_G_BIN;
-
-        if ((ret = mbedtls_ssl_conf_dh_param_bin(conf,
-                                                 dhm_p, sizeof(dhm_p),
-                                                 dhm_g, sizeof(dhm_g))) != 0) {
-            return ret;
-        }
-    }
-#endif
+    /* The default DHM group of servers is not parsed here: without
+     * mbedtls_ssl_conf_dh_param_bin() or mbedtls_ssl_conf_dh_param_ctx(),
+     * the first DHE handshake reads it from its static encoding. */
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
 
@@ -5930,11 +8232,16 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
 #if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SESSION_TICKETS)
     mbedtls_ssl_conf_new_session_tickets(
         conf, MBEDTLS_SSL_TLS1_3_DEFAULT_NEW_SESSION_TICKETS);
+#endif
+#if defined(MBEDTLS_SSL_SRV_C)
+    mbedtls_ssl_conf_tls13_psk_limits(conf, 0xFFFF, 0xFFFF);
 #endif
     /*
      * Allow all TLS 1.3 key exchange modes by default.
      */
     conf->tls13_kex_modes = MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_ALL;
+    mbedtls_ssl_conf_tls13_key_update_limit(conf,
+                                            MBEDTLS_SSL_TLS1_3_KEY_UPDATE_RECORDS);
 #endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
 
     if (transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM) {
@@ -6025,6 +8332,19 @@ int mbedtls_ssl_config_defaults(mbedtls_ssl_config *conf,
 /*
  * Free mbedtls_ssl_config
  */
+int mbedtls_ssl_config_freeze(mbedtls_ssl_config *conf)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = ssl_conf_check(NULL, conf)) != 0) {
+        return ret;
+    }
+
+    conf->frozen = 1;
+
+    return 0;
+}
+
 void mbedtls_ssl_config_free(mbedtls_ssl_config *conf)
 {
     if (conf == NULL) {
@@ -6059,6 +8379,14 @@ void mbedtls_ssl_config_free(mbedtls_ssl_config *conf)
     ssl_key_cert_free(conf->key_cert);
 #endif
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    mbedtls_free(conf->rpk_spki);
+#endif
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+    mbedtls_free(conf->ca_dn_list);
+#endif
+
     mbedtls_platform_zeroize(conf, sizeof(mbedtls_ssl_config));
 }
 
@@ -6308,6 +8636,84 @@ uint16_t mbedtls_ssl_get_tls_id_from_ecp_group_id(mbedtls_ecp_group_id grp_id)
     return 0;
 }
 
+#if defined(PSA_WANT_ALG_FFDH)
+psa_status_t mbedtls_ssl_get_psa_ffdh_info_from_tls_id(
+    uint16_t tls_id, size_t *bits, psa_key_type_t *key_type)
+{
+    switch (tls_id) {
+#if defined(PSA_WANT_DH_RFC7919_2048)
+        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE2048:
+            *bits = 2048;
+            *key_type = PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
+            return PSA_SUCCESS;
+#endif /* PSA_WANT_DH_RFC7919_2048 */
+#if defined(PSA_WANT_DH_RFC7919_3072)
+        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE3072:
+            *bits = 3072;
+            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
+            return PSA_SUCCESS;
+#endif /* PSA_WANT_DH_RFC7919_3072 */
+#if defined(PSA_WANT_DH_RFC7919_4096)
+        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE4096:
+            *bits = 4096;
+            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
+            return PSA_SUCCESS;
+#endif /* PSA_WANT_DH_RFC7919_4096 */
+#if defined(PSA_WANT_DH_RFC7919_6144)
+        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE6144:
+            *bits = 6144;
+            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
+            return PSA_SUCCESS;
+#endif /* PSA_WANT_DH_RFC7919_6144 */
+#if defined(PSA_WANT_DH_RFC7919_8192)
+        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE8192:
+            *bits = 8192;
+            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
+            return PSA_SUCCESS;
+#endif /* PSA_WANT_DH_RFC7919_8192 */
+        default:
+            return PSA_ERROR_NOT_SUPPORTED;
+    }
+}
+#endif /* PSA_WANT_ALG_FFDH */
+
+#if defined(MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED)
+psa_status_t mbedtls_ssl_generate_ephemeral_key(
+    mbedtls_ssl_context *ssl, const psa_key_attributes_t *attributes,
+    unsigned char *pub, size_t pub_size, size_t *pub_len)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    psa_status_t status;
+
+#if defined(MBEDTLS_SSL_KEY_SHARE_POOL_C)
+    if (ssl->conf->key_share_pool != NULL &&
+        mbedtls_ssl_key_share_pool_take(ssl->conf->key_share_pool, attributes,
+                                        &handshake->xxdh_psa_privkey,
+                                        pub, pub_size, pub_len) == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ephemeral key taken from the pool"));
+        return PSA_SUCCESS;
+    }
+#endif /* MBEDTLS_SSL_KEY_SHARE_POOL_C */
+
+    status = psa_generate_key(attributes, &handshake->xxdh_psa_privkey);
+    if (status != PSA_SUCCESS) {
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_generate_key", (int) status);
+        return status;
+    }
+
+    status = psa_export_public_key(handshake->xxdh_psa_privkey,
+                                   pub, pub_size, pub_len);
+    if (status != PSA_SUCCESS) {
+        MBEDTLS_SSL_DEBUG_RET(1, "psa_export_public_key", (int) status);
+        (void) psa_destroy_key(handshake->xxdh_psa_privkey);
+        handshake->xxdh_psa_privkey = MBEDTLS_SVC_KEY_ID_INIT;
+        return status;
+    }
+
+    return PSA_SUCCESS;
+}
+#endif /* MBEDTLS_KEY_EXCHANGE_SOME_XXDH_PSA_ANY_ENABLED */
+
 #if defined(MBEDTLS_DEBUG_C)
 static const struct {
     uint16_t tls_id;
@@ -6343,11 +8749,12 @@ const char *mbedtls_ssl_get_curve_name_from_tls_id(uint16_t tls_id)
 #endif
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-int mbedtls_ssl_get_handshake_transcript(mbedtls_ssl_context *ssl,
-                                         const mbedtls_md_type_t md,
-                                         unsigned char *dst,
-                                         size_t dst_len,
-                                         size_t *olen)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_compute_handshake_transcript(mbedtls_ssl_context *ssl,
+                                            const mbedtls_md_type_t md,
+                                            unsigned char *dst,
+                                            size_t dst_len,
+                                            size_t *olen)
 {
     psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
     psa_hash_operation_t *hash_operation_to_clone;
@@ -6467,11 +8874,12 @@ exit:
 }
 #endif /* PSA_WANT_ALG_SHA_256 */
 
-int mbedtls_ssl_get_handshake_transcript(mbedtls_ssl_context *ssl,
-                                         const mbedtls_md_type_t md,
-                                         unsigned char *dst,
-                                         size_t dst_len,
-                                         size_t *olen)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_compute_handshake_transcript(mbedtls_ssl_context *ssl,
+                                            const mbedtls_md_type_t md,
+                                            unsigned char *dst,
+                                            size_t dst_len,
+                                            size_t *olen)
 {
     switch (md) {
 
@@ -6500,6 +8908,39 @@ int mbedtls_ssl_get_handshake_transcript(mbedtls_ssl_context *ssl,
 
 #endif /* !MBEDTLS_USE_PSA_CRYPTO */
 
+/*
+ * The transcript hash is often needed more than once at the same point of
+ * the handshake, for example by the key schedule and by a Finished message.
+ * Keep the last one until the next message is added to the checksum.
+ */
+int mbedtls_ssl_get_handshake_transcript(mbedtls_ssl_context *ssl,
+                                         const mbedtls_md_type_t md,
+                                         unsigned char *dst,
+                                         size_t dst_len,
+                                         size_t *olen)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if (handshake->transcript_snapshot_len != 0 &&
+        handshake->transcript_snapshot_md == md &&
+        dst_len >= handshake->transcript_snapshot_len) {
+        memcpy(dst, handshake->transcript_snapshot,
+               handshake->transcript_snapshot_len);
+        *olen = handshake->transcript_snapshot_len;
+        return 0;
+    }
+
+    ret = ssl_compute_handshake_transcript(ssl, md, dst, dst_len, olen);
+    if (ret == 0 && *olen <= sizeof(handshake->transcript_snapshot)) {
+        memcpy(handshake->transcript_snapshot, dst, *olen);
+        handshake->transcript_snapshot_len = *olen;
+        handshake->transcript_snapshot_md = md;
+    }
+
+    return ret;
+}
+
 #if defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED)
 /* mbedtls_ssl_parse_sig_alg_ext()
  *
@@ -6609,6 +9050,7 @@ int mbedtls_ssl_parse_sig_alg_ext(mbedtls_ssl_context *ssl,
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
 
+#if defined(MBEDTLS_KEY_EXCHANGE_SOME_PSK_ENABLED)
 static psa_status_t setup_psa_key_derivation(psa_key_derivation_operation_t *derivation,
                                              mbedtls_svc_key_id_t key,
                                              psa_algorithm_t alg,
@@ -6672,82 +9114,187 @@ static psa_status_t setup_psa_key_derivation(psa_key_derivation_operation_t *der
 
     return PSA_SUCCESS;
 }
+#endif /* MBEDTLS_KEY_EXCHANGE_SOME_PSK_ENABLED */
 
 #if defined(PSA_WANT_ALG_SHA_384) || \
     defined(PSA_WANT_ALG_SHA_256)
-MBEDTLS_CHECK_RETURN_CRITICAL
-static int tls_prf_generic(mbedtls_md_type_t md_type,
-                           const unsigned char *secret, size_t slen,
-                           const char *label,
-                           const unsigned char *random, size_t rlen,
-                           unsigned char *dstbuf, size_t dlen)
-{
-    psa_status_t status;
-    psa_algorithm_t alg;
-    mbedtls_svc_key_id_t master_key = MBEDTLS_SVC_KEY_ID_INIT;
-    psa_key_derivation_operation_t derivation =
-        PSA_KEY_DERIVATION_OPERATION_INIT;
+/*
+ * Key the HMAC of P_hash (RFC 5246 section 5) with a secret, which can be
+ * empty: this PRF also derives IVs, as in EAP-TLS.
+ */
+static psa_status_t ssl_tls12_prf_key_setup(mbedtls_ssl_tls12_prf_key *key,
+                                            mbedtls_md_type_t md_type,
+                                            const unsigned char *secret,
+                                            size_t slen)
+{
+    psa_status_t status = PSA_SUCCESS;
+    psa_algorithm_t alg = mbedtls_md_psa_alg_from_type(md_type);
+    size_t block_size = PSA_HASH_BLOCK_LENGTH(alg);
+    unsigned char pad[PSA_HMAC_MAX_HASH_BLOCK_SIZE];
+    unsigned char hashed_secret[PSA_HASH_MAX_SIZE];
+    size_t i;
 
-    if (md_type == MBEDTLS_MD_SHA384) {
-        alg = PSA_ALG_TLS12_PRF(PSA_ALG_SHA_384);
-    } else {
-        alg = PSA_ALG_TLS12_PRF(PSA_ALG_SHA_256);
-    }
-
-    /* Normally a "secret" should be long enough to be impossible to
-     * find by brute force, and in particular should not be empty. But
-     * this PRF is also used to derive an IV, in particular in EAP-TLS,
-     * and for this use case it makes sense to have a 0-length "secret".
-     * Since the key API doesn't allow importing a key of length 0,
-     * keep master_key=0, which setup_psa_key_derivation() understands
-     * to mean a 0-length "secret" input. */
-    if (slen != 0) {
-        psa_key_attributes_t key_attributes = psa_key_attributes_init();
-        psa_set_key_usage_flags(&key_attributes, PSA_KEY_USAGE_DERIVE);
-        psa_set_key_algorithm(&key_attributes, alg);
-        psa_set_key_type(&key_attributes, PSA_KEY_TYPE_DERIVE);
+    psa_hash_abort(&key->inner);
+    psa_hash_abort(&key->outer);
+    key->alg = 0;
 
-        status = psa_import_key(&key_attributes, secret, slen, &master_key);
+    /* RFC 2104: a key longer than the block is hashed first */
+    if (slen > block_size) {
+        status = psa_hash_compute(alg, secret, slen, hashed_secret,
+                                  sizeof(hashed_secret), &slen);
         if (status != PSA_SUCCESS) {
-            return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+            goto exit;
         }
+        secret = hashed_secret;
     }
 
-    status = setup_psa_key_derivation(&derivation,
-                                      master_key, alg,
-                                      NULL, 0,
-                                      random, rlen,
-                                      (unsigned char const *) label,
-                                      (size_t) strlen(label),
-                                      NULL, 0,
-                                      dlen);
+    memset(pad, 0x36, block_size);
+    mbedtls_xor(pad, pad, secret, slen);
+    status = psa_hash_setup(&key->inner, alg);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&key->inner, pad, block_size);
+    }
     if (status != PSA_SUCCESS) {
-        psa_key_derivation_abort(&derivation);
-        psa_destroy_key(master_key);
-        return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+        goto exit;
     }
 
-    status = psa_key_derivation_output_bytes(&derivation, dstbuf, dlen);
+    for (i = 0; i < block_size; i++) {
+        pad[i] ^= 0x36 ^ 0x5C;
+    }
+    status = psa_hash_setup(&key->outer, alg);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&key->outer, pad, block_size);
+    }
     if (status != PSA_SUCCESS) {
-        psa_key_derivation_abort(&derivation);
-        psa_destroy_key(master_key);
-        return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+        goto exit;
     }
 
-    status = psa_key_derivation_abort(&derivation);
+    key->alg = alg;
+
+exit:
     if (status != PSA_SUCCESS) {
-        psa_destroy_key(master_key);
-        return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+        psa_hash_abort(&key->inner);
+        psa_hash_abort(&key->outer);
+    }
+    mbedtls_platform_zeroize(pad, sizeof(pad));
+    mbedtls_platform_zeroize(hashed_secret, sizeof(hashed_secret));
+
+    return status;
+}
+
+static void ssl_tls12_prf_key_free(mbedtls_ssl_tls12_prf_key *key)
+{
+    psa_hash_abort(&key->inner);
+    psa_hash_abort(&key->outer);
+    key->alg = 0;
+}
+
+/* HMAC(secret, a || b || c), with the keyed hash states */
+static psa_status_t ssl_tls12_prf_hmac(const mbedtls_ssl_tls12_prf_key *key,
+                                       const unsigned char *a, size_t a_len,
+                                       const unsigned char *b, size_t b_len,
+                                       const unsigned char *c, size_t c_len,
+                                       unsigned char *mac)
+{
+    psa_status_t status;
+    psa_hash_operation_t op = PSA_HASH_OPERATION_INIT;
+    size_t hash_len = PSA_HASH_LENGTH(key->alg);
+    size_t len;
+
+    status = psa_hash_clone(&key->inner, &op);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&op, a, a_len);
+    }
+    if (status == PSA_SUCCESS && b_len != 0) {
+        status = psa_hash_update(&op, b, b_len);
+    }
+    if (status == PSA_SUCCESS && c_len != 0) {
+        status = psa_hash_update(&op, c, c_len);
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_finish(&op, mac, hash_len, &len);
     }
 
-    if (!mbedtls_svc_key_id_is_null(master_key)) {
-        status = psa_destroy_key(master_key);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_clone(&key->outer, &op);
     }
-    if (status != PSA_SUCCESS) {
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&op, mac, hash_len);
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_finish(&op, mac, hash_len, &len);
+    }
+
+    psa_hash_abort(&op);
+
+    return status;
+}
+
+/*
+ * P_hash(secret, label + seed)[0..dlen] with a keyed HMAC:
+ *
+ *     A(0) = label + seed, A(i) = HMAC(secret, A(i-1))
+ *     P_hash = HMAC(secret, A(1) + label + seed) +
+ *              HMAC(secret, A(2) + label + seed) + ...
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls12_prf_key_run(const mbedtls_ssl_tls12_prf_key *key,
+                                 const char *label,
+                                 const unsigned char *random, size_t rlen,
+                                 unsigned char *dstbuf, size_t dlen)
+{
+    psa_status_t status;
+    size_t hash_len = PSA_HASH_LENGTH(key->alg);
+    size_t label_len = strlen(label);
+    unsigned char a[PSA_HASH_MAX_SIZE];
+    unsigned char h_i[PSA_HASH_MAX_SIZE];
+    size_t i, k;
+
+    status = ssl_tls12_prf_hmac(key, (const unsigned char *) label, label_len,
+                                random, rlen, NULL, 0, a);
+
+    for (i = 0; status == PSA_SUCCESS && i < dlen; i += hash_len) {
+        status = ssl_tls12_prf_hmac(key, a, hash_len,
+                                    (const unsigned char *) label, label_len,
+                                    random, rlen, h_i);
+        if (status != PSA_SUCCESS) {
+            break;
+        }
+
+        k = (i + hash_len > dlen) ? dlen - i : hash_len;
+        memcpy(dstbuf + i, h_i, k);
+
+        if (i + hash_len < dlen) {
+            status = ssl_tls12_prf_hmac(key, a, hash_len, NULL, 0, NULL, 0, a);
+        }
+    }
+
+    mbedtls_platform_zeroize(a, sizeof(a));
+    mbedtls_platform_zeroize(h_i, sizeof(h_i));
+
+    return status == PSA_SUCCESS ? 0 : MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+}
+
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int tls_prf_generic(mbedtls_md_type_t md_type,
+                           const unsigned char *secret, size_t slen,
+                           const char *label,
+                           const unsigned char *random, size_t rlen,
+                           unsigned char *dstbuf, size_t dlen)
+{
+    int ret;
+    mbedtls_ssl_tls12_prf_key key = { 0, PSA_HASH_OPERATION_INIT,
+                                      PSA_HASH_OPERATION_INIT };
+
+    if (ssl_tls12_prf_key_setup(&key, md_type, secret, slen) != PSA_SUCCESS) {
         return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
     }
 
-    return 0;
+    ret = ssl_tls12_prf_key_run(&key, label, random, rlen, dstbuf, dlen);
+
+    ssl_tls12_prf_key_free(&key);
+
+    return ret;
 }
 #endif /* PSA_WANT_ALG_SHA_256 || PSA_WANT_ALG_SHA_384 */
 #else /* MBEDTLS_USE_PSA_CRYPTO */
@@ -6780,7 +9327,7 @@ static int tls_prf_generic(mbedtls_md_type_t md_type,
     md_len = mbedtls_md_get_size(md_info);
 
     tmp_len = md_len + strlen(label) + rlen;
-    tmp = mbedtls_calloc(1, tmp_len);
+    tmp = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, tmp_len);
     if (tmp == NULL) {
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto exit;
@@ -7130,6 +9677,11 @@ int mbedtls_ssl_derive_keys(mbedtls_ssl_context *ssl)
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     const mbedtls_ssl_ciphersuite_t * const ciphersuite_info =
         ssl->handshake->ciphersuite_info;
+    const unsigned char *key_block = NULL;
+    size_t key_block_len = 0;
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    unsigned char keyblk[256];
+#endif
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> derive keys"));
 
@@ -7161,6 +9713,27 @@ int mbedtls_ssl_derive_keys(mbedtls_ssl_context *ssl)
         mbedtls_platform_zeroize(tmp, sizeof(tmp));
     }
 
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    /* Key the PRF with the master secret once, for the key block here and
+     * both Finished messages later. */
+    if (ssl_tls12_prf_key_setup(&ssl->handshake->master_prf,
+                                (mbedtls_md_type_t) ciphersuite_info->mac,
+                                ssl->session_negotiate->master,
+                                48) != PSA_SUCCESS) {
+        return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
+    }
+
+    ret = ssl_tls12_prf_key_run(&ssl->handshake->master_prf, "key expansion",
+                                ssl->handshake->randbytes, 64,
+                                keyblk, sizeof(keyblk));
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "prf", ret);
+        return ret;
+    }
+    key_block = keyblk;
+    key_block_len = sizeof(keyblk);
+#endif /* MBEDTLS_SSL_TLS12_PRF_HMAC_STATE */
+
     /* Populate transform structure */
     ret = ssl_tls12_populate_transform(ssl->transform_negotiate,
                                        ssl->session_negotiate->ciphersuite,
@@ -7170,9 +9743,13 @@ int mbedtls_ssl_derive_keys(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
                                        ssl->handshake->tls_prf,
                                        ssl->handshake->randbytes,
+                                       key_block, key_block_len,
                                        ssl->tls_version,
                                        ssl->conf->endpoint,
                                        ssl);
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    mbedtls_platform_zeroize(keyblk, sizeof(keyblk));
+#endif
     if (ret != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "ssl_tls12_populate_transform", ret);
         return ret;
@@ -7368,7 +9945,7 @@ int mbedtls_ssl_psk_derive_premaster(mbedtls_ssl_context *ssl, mbedtls_key_excha
         /* Write length only when we know the actual value */
         if ((ret = mbedtls_dhm_calc_secret(&ssl->handshake->dhm_ctx,
                                            p + 2, (size_t) (end - (p + 2)), &len,
-                                           ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                           ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_calc_secret", ret);
             return ret;
         }
@@ -7385,7 +9962,7 @@ int mbedtls_ssl_psk_derive_premaster(mbedtls_ssl_context *ssl, mbedtls_key_excha
 
         if ((ret = mbedtls_ecdh_calc_secret(&ssl->handshake->ecdh_ctx, &zlen,
                                             p + 2, (size_t) (end - (p + 2)),
-                                            ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                            ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_calc_secret", ret);
             return ret;
         }
@@ -7540,15 +10117,44 @@ int mbedtls_ssl_write_certificate(mbedtls_ssl_context *ssl)
      *     n  . n+2   length of cert. 2
      *    n+3 . ...   upper level cert, etc.
      */
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_SRV_C)
+    /* The client has our chain: send its hash in its place. */
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
+        ssl->handshake->cached_info_cert) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("send the hash of the cached chain"));
+        i = 4;
+        ssl->out_msg[i++] = MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+        memcpy(ssl->out_msg + i, ssl->handshake->cached_info_hash,
+               MBEDTLS_SSL_CACHED_INFO_HASH_LEN);
+        i += MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+        goto write_msg;
+    }
+#endif
+
     i = 7;
     crt = mbedtls_ssl_own_cert(ssl);
 
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+    if (crt != NULL) {
+        const mbedtls_ssl_key_cert *key_cert = mbedtls_ssl_own_key_cert(ssl);
+
+        /* Copy the list encoded when the chain was set, if it fits. */
+        if (key_cert->cert_list != NULL &&
+            key_cert->cert_list_len <= mbedtls_ssl_out_content_len(ssl) - i) {
+            memcpy(ssl->out_msg + i, key_cert->cert_list,
+                   key_cert->cert_list_len);
+            i += key_cert->cert_list_len;
+            crt = NULL;
+        }
+    }
+#endif
+
     while (crt != NULL) {
         n = crt->raw.len;
-        if (n > MBEDTLS_SSL_OUT_CONTENT_LEN - 3 - i) {
+        if (n > mbedtls_ssl_out_content_len(ssl) - 3 - i) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("certificate too large, %" MBEDTLS_PRINTF_SIZET
                                       " > %" MBEDTLS_PRINTF_SIZET,
-                                      i + 3 + n, (size_t) MBEDTLS_SSL_OUT_CONTENT_LEN));
+                                      i + 3 + n, mbedtls_ssl_out_content_len(ssl)));
             return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
         }
 
@@ -7564,6 +10170,9 @@ int mbedtls_ssl_write_certificate(mbedtls_ssl_context *ssl)
     ssl->out_msg[5]  = MBEDTLS_BYTE_1(i - 7);
     ssl->out_msg[6]  = MBEDTLS_BYTE_0(i - 7);
 
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_SRV_C)
+write_msg:
+#endif
     ssl->out_msglen  = i;
     ssl->out_msgtype = MBEDTLS_SSL_MSG_HANDSHAKE;
     ssl->out_msg[0]  = MBEDTLS_SSL_HS_CERTIFICATE;
@@ -7646,6 +10255,9 @@ static int ssl_parse_certificate_chain(mbedtls_ssl_context *ssl,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 #if defined(MBEDTLS_SSL_RENEGOTIATION) && defined(MBEDTLS_SSL_CLI_C)
     int crt_cnt = 0;
+#endif
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    int chain_len = 0;
 #endif
     size_t i, n;
     uint8_t alert;
@@ -7663,6 +10275,16 @@ static int ssl_parse_certificate_chain(mbedtls_ssl_context *ssl,
         return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
     }
 
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_CLI_C)
+    /* The server sent the hash of the chain we have in its place. */
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
+        ssl->handshake->cached_info_cert) {
+        return mbedtls_ssl_parse_cached_certificate(
+            ssl, ssl->in_msg + mbedtls_ssl_hs_hdr_len(ssl),
+            ssl->in_msg + ssl->in_hslen, chain);
+    }
+#endif
+
     if (ssl->in_hslen < mbedtls_ssl_hs_hdr_len(ssl) + 3 + 3) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
         mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
@@ -7716,9 +10338,22 @@ static int ssl_parse_certificate_chain(mbedtls_ssl_context *ssl,
             MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
             mbedtls_ssl_send_alert_message(ssl,
                                            MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                           MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR);
-            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+                                           MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR);
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+        /* Keep the parsed chain within MBEDTLS_SSL_PEER_CHAIN_MEMORY. */
+        if (++chain_len > MBEDTLS_X509_MAX_INTERMEDIATE_CA + 1 ||
+            n > MBEDTLS_SSL_MAX_PEER_CERT_LEN) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("peer certificate chain over the "
+                                      "memory budget"));
+            mbedtls_ssl_send_alert_message(ssl,
+                                           MBEDTLS_SSL_ALERT_LEVEL_FATAL,
+                                           MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_CERT);
+            return MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
         }
+#endif /* MBEDTLS_SSL_STATIC_MEMORY */
 
         /* Check if we're handling the first CRT in the chain. */
 #if defined(MBEDTLS_SSL_RENEGOTIATION) && defined(MBEDTLS_SSL_CLI_C)
@@ -7741,7 +10376,7 @@ static int ssl_parse_certificate_chain(mbedtls_ssl_context *ssl,
             }
 
             /* Now we can safely free the original chain. */
-            ssl_clear_peer_cert(ssl->session);
+            mbedtls_ssl_session_clear_peer_cert(ssl->session);
         }
 #endif /* MBEDTLS_SSL_RENEGOTIATION && MBEDTLS_SSL_CLI_C */
 
@@ -7844,7 +10479,7 @@ static int ssl_remember_peer_crt_digest(mbedtls_ssl_context *ssl,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     /* Remember digest of the peer's end-CRT. */
     ssl->session_negotiate->peer_cert_digest =
-        mbedtls_calloc(1, MBEDTLS_SSL_PEER_CERT_DIGEST_DFL_LEN);
+        mbedtls_calloc_tagged(SSL_SESSION, 1, MBEDTLS_SSL_PEER_CERT_DIGEST_DFL_LEN);
     if (ssl->session_negotiate->peer_cert_digest == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%d bytes) failed",
                                   MBEDTLS_SSL_PEER_CERT_DIGEST_DFL_LEN));
@@ -7896,9 +10531,9 @@ int mbedtls_ssl_parse_certificate(mbedtls_ssl_context *ssl)
 #if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     const int authmode = ssl->handshake->sni_authmode != MBEDTLS_SSL_VERIFY_UNSET
                        ? ssl->handshake->sni_authmode
-                       : ssl->conf->authmode;
+                       : mbedtls_ssl_get_conf_authmode(ssl);
 #else
-    const int authmode = ssl->conf->authmode;
+    const int authmode = mbedtls_ssl_get_conf_authmode(ssl);
 #endif
     void *rs_ctx = NULL;
     mbedtls_x509_crt *chain = NULL;
@@ -7911,6 +10546,14 @@ int mbedtls_ssl_parse_certificate(mbedtls_ssl_context *ssl)
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if (ssl->handshake->async_verify_in_progress) {
+        chain = ssl->handshake->async_peer_cert;
+        ssl->handshake->async_peer_cert = NULL;
+        goto crt_verify;
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
     if (ssl->handshake->ecrs_enabled &&
         ssl->handshake->ecrs_state == ssl_ecrs_crt_verify) {
@@ -7941,9 +10584,9 @@ int mbedtls_ssl_parse_certificate(mbedtls_ssl_context *ssl)
 
     /* Clear existing peer CRT structure in case we tried to
      * reuse a session but it failed, and allocate a new one. */
-    ssl_clear_peer_cert(ssl->session_negotiate);
+    mbedtls_ssl_session_clear_peer_cert(ssl->session_negotiate);
 
-    chain = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+    chain = mbedtls_calloc_tagged(SSL_PEER_CERT, 1, sizeof(mbedtls_x509_crt));
     if (chain == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc(%" MBEDTLS_PRINTF_SIZET " bytes) failed",
                                   sizeof(mbedtls_x509_crt)));
@@ -7955,6 +10598,7 @@ int mbedtls_ssl_parse_certificate(mbedtls_ssl_context *ssl)
         goto exit;
     }
     mbedtls_x509_crt_init(chain);
+    mbedtls_x509_crt_set_lazy_ext(chain, ssl->conf->peer_cert_lazy_ext);
 
     ret = ssl_parse_certificate_chain(ssl, chain);
     if (ret != 0) {
@@ -7965,8 +10609,12 @@ int mbedtls_ssl_parse_certificate(mbedtls_ssl_context *ssl)
     if (ssl->handshake->ecrs_enabled) {
         ssl->handshake->ecrs_state = ssl_ecrs_crt_verify;
     }
+#endif
 
+#if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED) || defined(MBEDTLS_SSL_ASYNC_PRIVATE)
 crt_verify:
+#endif
+#if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
     if (ssl->handshake->ecrs_enabled) {
         rs_ctx = &ssl->handshake->ecrs_ctx;
     }
@@ -8015,6 +10663,9 @@ crt_verify:
     /* Pass ownership to session structure. */
     ssl->session_negotiate->peer_cert = chain;
     chain = NULL;
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    mbedtls_ssl_session_intern_peer_cert(ssl, ssl->session_negotiate);
+#endif
 #endif /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= parse certificate"));
@@ -8032,6 +10683,13 @@ exit:
     }
 #endif
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        ssl->handshake->async_peer_cert = chain;
+        chain = NULL;
+    }
+#endif
+
     if (chain != NULL) {
         mbedtls_x509_crt_free(chain);
         mbedtls_free(chain);
@@ -8106,6 +10764,14 @@ static int ssl_calc_finished_tls_generic(mbedtls_ssl_context *ssl, void *ctx,
      *   hash = PRF( master, finished_label,
      *               Hash( handshake ) )[0.11]
      */
+#if defined(MBEDTLS_SSL_TLS12_PRF_HMAC_STATE)
+    if (ssl->handshake->master_prf.alg != 0) {
+        if (ssl_tls12_prf_key_run(&ssl->handshake->master_prf, sender,
+                                  padbuf, hlen, buf, len) != 0) {
+            status = PSA_ERROR_HARDWARE_FAILURE;
+        }
+    } else
+#endif
     ssl->handshake->tls_prf(session->master, 48, sender,
                             padbuf, hlen, buf, len);
 
@@ -8166,7 +10832,12 @@ void mbedtls_ssl_handshake_wrapup_free_hs_transform(mbedtls_ssl_context *ssl)
      * Free our handshake params
      */
     mbedtls_ssl_handshake_free(ssl);
-    mbedtls_free(ssl->handshake);
+    if (ssl->conf->handshake_reuse == MBEDTLS_SSL_HANDSHAKE_REUSE_ENABLED &&
+        ssl->handshake_spare == NULL) {
+        ssl->handshake_spare = ssl->handshake;
+    } else {
+        mbedtls_free(ssl->handshake);
+    }
     ssl->handshake = NULL;
 
     /*
@@ -8217,14 +10888,30 @@ void mbedtls_ssl_handshake_wrapup(mbedtls_ssl_context *ssl)
     if (ssl->conf->f_set_cache != NULL &&
         ssl->session->id_len != 0 &&
         resume == 0) {
-        if (ssl->conf->f_set_cache(ssl->conf->p_cache,
-                                   ssl->session->id,
-                                   ssl->session->id_len,
-                                   ssl->session) != 0) {
+        int ret = ssl->conf->f_set_cache(ssl->conf->p_cache,
+                                         ssl->session->id,
+                                         ssl->session->id_len,
+                                         ssl->session);
+        MBEDTLS_SSL_PROBE2(cache_set, ssl, ret);
+        if (ret != 0) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("cache did not store session"));
         }
     }
 
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+        /* A resumed session is only stored again with a ticket, which the
+         * server may have renewed. */
+        int renewed = 0;
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        renewed = ssl->session->ticket != NULL;
+#endif
+        if (resume == 0 || renewed) {
+            mbedtls_ssl_session_store_add(ssl);
+        }
+    }
+#endif /* MBEDTLS_SSL_SESSION_STORE_C */
+
 #if defined(MBEDTLS_SSL_PROTO_DTLS)
     if (ssl->conf->transport == MBEDTLS_SSL_TRANSPORT_DATAGRAM &&
         ssl->handshake->flight != NULL) {
@@ -8240,6 +10927,10 @@ void mbedtls_ssl_handshake_wrapup(mbedtls_ssl_context *ssl)
 
     ssl->state = MBEDTLS_SSL_HANDSHAKE_OVER;
 
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats_handshake_over(ssl);
+#endif
+
     MBEDTLS_SSL_DEBUG_MSG(3, ("<= handshake wrapup"));
 }
 
@@ -8498,7 +11189,10 @@ static mbedtls_tls_prf_types tls_prf_get_type(mbedtls_ssl_tls_prf_cb *tls_prf)
  * - [in] master
  * - [in] encrypt_then_mac
  * - [in] tls_prf: pointer to PRF to use for key derivation
- * - [in] randbytes: buffer holding ServerHello.random + ClientHello.random
+ * - [in] randbytes: buffer holding ServerHello.random + ClientHello.random,
+ *        or NULL if key_block is given
+ * - [in] key_block, key_block_len: the expanded key material, as saved by
+ *        mbedtls_ssl_context_save(), or NULL to derive it with tls_prf
  * - [in] tls_version: TLS version
  * - [in] endpoint: client or server
  * - [in] ssl: used for:
@@ -8515,6 +11209,8 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
 #endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM */
                                         ssl_tls_prf_t tls_prf,
                                         const unsigned char randbytes[64],
+                                        const unsigned char *key_block,
+                                        size_t key_block_len,
                                         mbedtls_ssl_protocol_version tls_version,
                                         unsigned endpoint,
                                         const mbedtls_ssl_context *ssl)
@@ -8553,7 +11249,10 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
     transform->tls_version = tls_version;
 
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
-    memcpy(transform->randbytes, randbytes, sizeof(transform->randbytes));
+    if (randbytes != NULL) {
+        memcpy(transform->randbytes, randbytes, sizeof(transform->randbytes));
+        transform->has_randbytes = 1;
+    }
 #endif
 
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3)
@@ -8640,18 +11339,26 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
     /*
-     * Compute key block using the PRF
+     * Compute key block using the PRF, unless it is given
      */
-    ret = tls_prf(master, 48, "key expansion", randbytes, 64, keyblk, 256);
-    if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "prf", ret);
-        return ret;
+    if (key_block != NULL) {
+        if (key_block_len > sizeof(keyblk)) {
+            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        }
+        memcpy(keyblk, key_block, key_block_len);
+        memset(keyblk + key_block_len, 0, sizeof(keyblk) - key_block_len);
+    } else {
+        ret = tls_prf(master, 48, "key expansion", randbytes, 64, keyblk, 256);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "prf", ret);
+            return ret;
+        }
+        MBEDTLS_SSL_DEBUG_BUF(4, "random bytes", randbytes, 64);
     }
 
     MBEDTLS_SSL_DEBUG_MSG(3, ("ciphersuite = %s",
                               mbedtls_ssl_get_ciphersuite_name(ciphersuite)));
     MBEDTLS_SSL_DEBUG_BUF(3, "master secret", master, 48);
-    MBEDTLS_SSL_DEBUG_BUF(4, "random bytes", randbytes, 64);
     MBEDTLS_SSL_DEBUG_BUF(4, "key block", keyblk, 256);
 
     /*
@@ -8815,7 +11522,32 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
         goto end;
     }
 
-    if (ssl->f_export_keys != NULL) {
+    if (key_block != NULL &&
+        key_block_len != 2 * (mac_key_len + keylen + iv_copy_len)) {
+        ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+        goto end;
+    }
+
+#if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
+    /* Only keep the key block if mbedtls_ssl_context_save() is to save it,
+     * or if it is all a loaded context can be saved from again. */
+    if (ssl_mode == MBEDTLS_SSL_MODE_AEAD &&
+        (ssl->conf->context_save_keys || randbytes == NULL) &&
+        2 * (keylen + iv_copy_len) <= sizeof(transform->key_block)) {
+        transform->key_block_len = (uint8_t) (2 * (keylen + iv_copy_len));
+        memcpy(transform->key_block, keyblk, transform->key_block_len);
+    }
+#endif /* MBEDTLS_SSL_CONTEXT_SERIALIZATION */
+
+#if defined(MBEDTLS_SSL_KTLS)
+    if (keylen <= sizeof(transform->ktls_key_enc)) {
+        memcpy(transform->ktls_key_enc, key1, keylen);
+        memcpy(transform->ktls_key_dec, key2, keylen);
+        transform->ktls_keylen = keylen;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    if (ssl->f_export_keys != NULL && randbytes != NULL) {
         ssl->f_export_keys(ssl->p_export_keys,
                            MBEDTLS_SSL_KEY_EXPORT_TLS12_MASTER_SECRET,
                            master, 48,
@@ -8880,7 +11612,7 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
         goto end;
     }
 
-#if defined(MBEDTLS_CIPHER_MODE_CBC)
+#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC)
     if (mbedtls_cipher_info_get_mode(cipher_info) == MBEDTLS_MODE_CBC) {
         if ((ret = mbedtls_cipher_set_padding_mode(&transform->cipher_ctx_enc,
                                                    MBEDTLS_PADDING_NONE)) != 0) {
@@ -8894,7 +11626,7 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
             goto end;
         }
     }
-#endif /* MBEDTLS_CIPHER_MODE_CBC */
+#endif /* MBEDTLS_SSL_SOME_SUITES_USE_CBC */
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
 #if defined(MBEDTLS_SSL_SOME_SUITES_USE_MAC)
@@ -8904,38 +11636,29 @@ static int ssl_tls12_populate_transform(mbedtls_ssl_transform *transform,
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         transform->psa_mac_alg = PSA_ALG_HMAC(mac_alg);
 
-        psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_SIGN_MESSAGE);
-        psa_set_key_algorithm(&attributes, PSA_ALG_HMAC(mac_alg));
-        psa_set_key_type(&attributes, PSA_KEY_TYPE_HMAC);
-
-        if ((status = psa_import_key(&attributes,
-                                     mac_enc, mac_key_len,
-                                     &transform->psa_mac_enc)) != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_import_mac_key", ret);
+        /* Rather than importing the MAC keys, keep the hash states after
+         * their inner and outer key blocks: records are protected and
+         * checked by cloning them, which also saves hashing the key
+         * blocks for each record. */
+        ret = mbedtls_ssl_hmac_setup_states(transform->psa_mac_alg,
+                                            mac_enc, mac_key_len,
+                                            &transform->psa_mac_enc_inner,
+                                            &transform->psa_mac_enc_outer);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_hmac_setup_states", ret);
             goto end;
         }
+        transform->psa_mac_enc_states = 1;
 
-        if ((transform->psa_alg == MBEDTLS_SSL_NULL_CIPHER) ||
-            ((transform->psa_alg == PSA_ALG_CBC_NO_PADDING)
-#if defined(MBEDTLS_SSL_SOME_SUITES_USE_CBC_ETM)
-             && (transform->encrypt_then_mac == MBEDTLS_SSL_ETM_DISABLED)
-#endif
-            )) {
-            /* mbedtls_ct_hmac() requires the key to be exportable */
-            psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_EXPORT |
-                                    PSA_KEY_USAGE_VERIFY_HASH);
-        } else {
-            psa_set_key_usage_flags(&attributes, PSA_KEY_USAGE_VERIFY_HASH);
-        }
-
-        if ((status = psa_import_key(&attributes,
-                                     mac_dec, mac_key_len,
-                                     &transform->psa_mac_dec)) != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_import_mac_key", ret);
+        ret = mbedtls_ssl_hmac_setup_states(transform->psa_mac_alg,
+                                            mac_dec, mac_key_len,
+                                            &transform->psa_mac_dec_inner,
+                                            &transform->psa_mac_dec_outer);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_hmac_setup_states", ret);
             goto end;
         }
+        transform->psa_mac_dec_states = 1;
 #else
         ret = mbedtls_md_hmac_starts(&transform->md_ctx_enc, mac_enc, mac_key_len);
         if (ret != 0) {
@@ -9453,7 +12176,7 @@ int mbedtls_ssl_parse_alpn_ext(mbedtls_ssl_context *ssl,
     size_t protocol_name_len;
 
     /* If ALPN not configured, just ignore the extension */
-    if (ssl->conf->alpn_list == NULL) {
+    if (mbedtls_ssl_get_alpn_list(ssl) == NULL) {
         return 0;
     }
 
@@ -9495,7 +12218,8 @@ int mbedtls_ssl_parse_alpn_ext(mbedtls_ssl_context *ssl,
     }
 
     /* Use our order of preference */
-    for (const char **alpn = ssl->conf->alpn_list; *alpn != NULL; alpn++) {
+    for (const char **alpn = mbedtls_ssl_get_alpn_list(ssl);
+         *alpn != NULL; alpn++) {
         size_t const alpn_len = strlen(*alpn);
         p = protocol_name_list;
         while (p < protocol_name_list_end) {
@@ -9562,6 +12286,298 @@ int mbedtls_ssl_write_alpn_ext(mbedtls_ssl_context *ssl,
 }
 #endif /* MBEDTLS_SSL_ALPN */
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+/*
+ * The hash of a chain is that of its certificate_list as in a TLS 1.2
+ * Certificate message (RFC 7924 section 5), in both versions: it does not
+ * depend on the extensions of TLS 1.3 certificate entries.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_cached_info_chain_hash(const mbedtls_x509_crt *chain,
+                                      unsigned char *hash)
+{
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+    psa_status_t status;
+    const mbedtls_x509_crt *crt;
+    unsigned char len[3];
+    size_t list_len = 0, hash_len;
+
+    for (crt = chain; crt != NULL; crt = crt->next) {
+        list_len += 3 + crt->raw.len;
+    }
+
+    status = psa_hash_setup(&operation, PSA_ALG_SHA_256);
+    if (status == PSA_SUCCESS) {
+        MBEDTLS_PUT_UINT24_BE(list_len, len, 0);
+        status = psa_hash_update(&operation, len, sizeof(len));
+    }
+    for (crt = chain; status == PSA_SUCCESS && crt != NULL; crt = crt->next) {
+        MBEDTLS_PUT_UINT24_BE(crt->raw.len, len, 0);
+        status = psa_hash_update(&operation, len, sizeof(len));
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, crt->raw.p, crt->raw.len);
+        }
+    }
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_finish(&operation, hash,
+                                 MBEDTLS_SSL_CACHED_INFO_HASH_LEN, &hash_len);
+    }
+    if (status != PSA_SUCCESS) {
+        psa_hash_abort(&operation);
+        return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    return 0;
+}
+
+#if defined(MBEDTLS_SSL_CLI_C)
+int mbedtls_ssl_set_cached_server_chain(mbedtls_ssl_context *ssl,
+                                        const mbedtls_x509_crt *chain)
+{
+    int ret;
+
+    if (ssl->conf->endpoint != MBEDTLS_SSL_IS_CLIENT) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ssl->cached_srv_chain = NULL;
+    if (chain == NULL) {
+        return 0;
+    }
+
+    ret = ssl_cached_info_chain_hash(chain, ssl->cached_srv_chain_hash);
+    if (ret != 0) {
+        return ret;
+    }
+    ssl->cached_srv_chain = chain;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_CLI_C */
+
+/*
+ * RFC 7924 section 3:
+ *
+ * enum {
+ *     cert(1), cert_req(2) (255)
+ * } CachedInformationType;
+ *
+ * struct {
+ *     select (type) {
+ *         case client:
+ *             CachedInformationType type;
+ *             opaque hash_value<1..255>;
+ *         case server:
+ *             CachedInformationType type;
+ *     } body;
+ * } CachedObject;
+ *
+ * struct {
+ *     CachedObject cached_info<1..2^16-1>;
+ * } CachedInformation;
+ */
+int mbedtls_ssl_parse_cached_info_ext(mbedtls_ssl_context *ssl,
+                                      const unsigned char *buf,
+                                      const unsigned char *end)
+{
+    const unsigned char *p = buf;
+    size_t list_len;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 2);
+    list_len = MBEDTLS_GET_UINT16_BE(p, 0);
+    p += 2;
+    if (list_len == 0 || list_len != (size_t) (end - p)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad cached_info extension"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+#if defined(MBEDTLS_SSL_CLI_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+        if (!ssl->handshake->cached_info_offered) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("cached_info extension not offered"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_EXT,
+                                         MBEDTLS_ERR_SSL_UNSUPPORTED_EXTENSION);
+            return MBEDTLS_ERR_SSL_UNSUPPORTED_EXTENSION;
+        }
+
+        /* We only offer our cached chain. */
+        for (; p < end; p++) {
+            if (*p != MBEDTLS_SSL_CACHED_INFO_TYPE_CERT) {
+                MBEDTLS_SSL_DEBUG_MSG(1, ("unexpected cached information type %u",
+                                          (unsigned) *p));
+                MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                             MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+                return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+            }
+        }
+
+        ssl->handshake->cached_info_cert = 1;
+
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_CLI_C */
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    while (p < end) {
+        unsigned int type;
+        size_t hash_len;
+
+        MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 2);
+        type = p[0];
+        hash_len = p[1];
+        p += 2;
+        MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, hash_len);
+        if (hash_len == 0) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("bad cached_info extension"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                         MBEDTLS_ERR_SSL_DECODE_ERROR);
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+
+        /* Only a SHA-256 hash of our chain can be of use. */
+        if (type == MBEDTLS_SSL_CACHED_INFO_TYPE_CERT &&
+            hash_len == MBEDTLS_SSL_CACHED_INFO_HASH_LEN) {
+            memcpy(ssl->handshake->cached_info_hash, p, hash_len);
+            ssl->handshake->cached_info_offered = 1;
+        }
+        p += hash_len;
+    }
+#endif /* MBEDTLS_SSL_SRV_C */
+
+    return 0;
+}
+
+int mbedtls_ssl_write_cached_info_ext(mbedtls_ssl_context *ssl,
+                                      unsigned char *buf,
+                                      const unsigned char *end,
+                                      size_t *out_len)
+{
+    unsigned char *p = buf;
+
+    *out_len = 0;
+
+#if defined(MBEDTLS_SSL_CLI_C)
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) {
+        if (ssl->cached_srv_chain == NULL) {
+            return 0;
+        }
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+        /* The parsing of a renegotiation checks the chain sent. */
+        if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
+            return 0;
+        }
+#endif
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding cached_info extension"));
+
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 8 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_CACHED_INFO, p, 0);
+        MBEDTLS_PUT_UINT16_BE(4 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN, p, 2);
+        MBEDTLS_PUT_UINT16_BE(2 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN, p, 4);
+        p[6] = MBEDTLS_SSL_CACHED_INFO_TYPE_CERT;
+        p[7] = MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+        memcpy(p + 8, ssl->cached_srv_chain_hash,
+               MBEDTLS_SSL_CACHED_INFO_HASH_LEN);
+        *out_len = 8 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+
+        ssl->handshake->cached_info_offered = 1;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_CACHED_INFO);
+#endif
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_CLI_C */
+
+#if defined(MBEDTLS_SSL_SRV_C)
+    {
+        const mbedtls_x509_crt *crt = mbedtls_ssl_own_cert(ssl);
+        unsigned char hash[MBEDTLS_SSL_CACHED_INFO_HASH_LEN];
+        int ret;
+
+        if (!ssl->handshake->cached_info_offered || crt == NULL) {
+            return 0;
+        }
+
+        ret = ssl_cached_info_chain_hash(crt, hash);
+        if (ret != 0) {
+            return ret;
+        }
+        if (memcmp(hash, ssl->handshake->cached_info_hash, sizeof(hash)) != 0) {
+            MBEDTLS_SSL_DEBUG_MSG(3, ("the client has another chain cached"));
+            return 0;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("server hello, adding cached_info extension"));
+
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 7);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_CACHED_INFO, p, 0);
+        MBEDTLS_PUT_UINT16_BE(3, p, 2);
+        MBEDTLS_PUT_UINT16_BE(1, p, 4);
+        p[6] = MBEDTLS_SSL_CACHED_INFO_TYPE_CERT;
+        *out_len = 7;
+
+        ssl->handshake->cached_info_cert = 1;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_CACHED_INFO);
+#endif
+    }
+#endif /* MBEDTLS_SSL_SRV_C */
+
+    return 0;
+}
+
+#if defined(MBEDTLS_SSL_CLI_C)
+/*
+ * RFC 7924 section 4.1:
+ *
+ * struct {
+ *     opaque hash_value<1..255>;
+ * } Certificate;
+ */
+int mbedtls_ssl_parse_cached_certificate(mbedtls_ssl_context *ssl,
+                                         const unsigned char *buf,
+                                         const unsigned char *end,
+                                         mbedtls_x509_crt *chain)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_x509_crt *crt;
+
+    if (end - buf != 1 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN ||
+        buf[0] != MBEDTLS_SSL_CACHED_INFO_HASH_LEN) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+    if (ssl->cached_srv_chain == NULL ||
+        memcmp(buf + 1, ssl->cached_srv_chain_hash,
+               MBEDTLS_SSL_CACHED_INFO_HASH_LEN) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("hash of a chain we do not have"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("server sent the hash of our cached chain"));
+
+    for (crt = ssl->cached_srv_chain; crt != NULL; crt = crt->next) {
+        ret = mbedtls_x509_crt_parse_der(chain, crt->raw.p, crt->raw.len);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_x509_crt_parse_der", ret);
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
+                                         ret);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_CLI_C */
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
 #if defined(MBEDTLS_SSL_PROTO_TLS1_3) && \
     defined(MBEDTLS_SSL_SESSION_TICKETS) && \
     defined(MBEDTLS_SSL_SERVER_NAME_INDICATION) && \
@@ -9593,7 +12609,7 @@ int mbedtls_ssl_session_set_hostname(mbedtls_ssl_session *session,
     if (hostname == NULL) {
         session->hostname = NULL;
     } else {
-        session->hostname = mbedtls_calloc(1, hostname_len + 1);
+        session->hostname = mbedtls_calloc_tagged(SSL_SESSION, 1, hostname_len + 1);
         if (session->hostname == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -9630,7 +12646,7 @@ int mbedtls_ssl_session_set_ticket_alpn(mbedtls_ssl_session *session,
     }
 
     if (alpn != NULL) {
-        session->ticket_alpn = mbedtls_calloc(alpn_len + 1, 1);
+        session->ticket_alpn = mbedtls_calloc_tagged(SSL_SESSION, alpn_len + 1, 1);
         if (session->ticket_alpn == NULL) {
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
         }
@@ -9727,6 +12743,49 @@ int mbedtls_ssl_check_cert_usage(const mbedtls_x509_crt *cert,
     return ret;
 }
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+/*
+ * Run the primary check through the asynchronous verifier, see
+ * mbedtls_ssl_conf_async_verify(). Returns
+ * MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH if the verifier declines the chain,
+ * and otherwise the same values as mbedtls_x509_crt_verify_with_profile(),
+ * or MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS.
+ */
+static int ssl_async_verify_certificate(mbedtls_ssl_context *ssl,
+                                        mbedtls_x509_crt *chain)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    uint32_t *flags = &ssl->session_negotiate->verify_result;
+
+    if (ssl->handshake->async_verify_in_progress == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("=> async verify certificate"));
+        ret = ssl->conf->f_async_verify_start(ssl, chain);
+        if (ret != 0 && ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+            return ret;
+        }
+        ssl->handshake->async_verify_in_progress = 1;
+        if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+            return ret;
+        }
+    }
+
+    *flags = 0;
+    ret = ssl->conf->f_async_verify_resume(ssl, flags);
+    if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        return ret;
+    }
+    ssl->handshake->async_verify_in_progress = 0;
+    MBEDTLS_SSL_DEBUG_MSG(2, ("<= async verify certificate"));
+
+    if (ret != 0) {
+        *flags = (uint32_t) -1;
+        return ret;
+    }
+
+    return *flags != 0 ? MBEDTLS_ERR_X509_CERT_VERIFY_FAILED : 0;
+}
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
 int mbedtls_ssl_verify_certificate(mbedtls_ssl_context *ssl,
                                    int authmode,
                                    mbedtls_x509_crt *chain,
@@ -9754,6 +12813,16 @@ int mbedtls_ssl_verify_certificate(mbedtls_ssl_context *ssl,
 
     int ret = 0;
     int have_ca_chain_or_callback = 0;
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if (ssl->conf->f_async_verify_start != NULL &&
+        (ret = ssl_async_verify_certificate(ssl, chain)) !=
+        MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH) {
+        if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+            return ret;
+        }
+        have_ca_chain_or_callback = 1;
+    } else
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
 #if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
     if (ssl->conf->f_ca_cb != NULL) {
         ((void) rs_ctx);
@@ -9780,14 +12849,23 @@ int mbedtls_ssl_verify_certificate(mbedtls_ssl_context *ssl,
         } else
 #endif
         {
-            ca_chain = ssl->conf->ca_chain;
-            ca_crl   = ssl->conf->ca_crl;
+            ca_chain = mbedtls_ssl_trusted_ca_chain(ssl, &ca_crl);
         }
 
         if (ca_chain != NULL) {
             have_ca_chain_or_callback = 1;
         }
 
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+        ret = mbedtls_x509_crt_verify_with_cache(
+            chain,
+            ca_chain, ca_crl,
+            ssl->conf->cert_profile,
+            ssl->hostname,
+            &ssl->session_negotiate->verify_result,
+            f_vrfy, p_vrfy, rs_ctx,
+            ssl->conf->verify_cache);
+#else
         ret = mbedtls_x509_crt_verify_restartable(
             chain,
             ca_chain, ca_crl,
@@ -9795,6 +12873,7 @@ int mbedtls_ssl_verify_certificate(mbedtls_ssl_context *ssl,
             ssl->hostname,
             &ssl->session_negotiate->verify_result,
             f_vrfy, p_vrfy, rs_ctx);
+#endif
     }
 
     if (ret != 0) {
@@ -176,7 +176,7 @@ static int ssl_write_ecjpake_kkpp_ext(mbedtls_ssl_context *ssl,
 #else
         ret = mbedtls_ecjpake_write_round_one(&ssl->handshake->ecjpake_ctx,
                                               p + 2, end - p - 2, &kkpp_len,
-                                              ssl->conf->f_rng, ssl->conf->p_rng);
+                                              ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1,
                                   "mbedtls_ecjpake_write_round_one", ret);
@@ -184,7 +184,7 @@ static int ssl_write_ecjpake_kkpp_ext(mbedtls_ssl_context *ssl,
         }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-        ssl->handshake->ecjpake_cache = mbedtls_calloc(1, kkpp_len);
+        ssl->handshake->ecjpake_cache = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, kkpp_len);
         if (ssl->handshake->ecjpake_cache == NULL) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("allocation failed"));
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -914,7 +914,7 @@ static int ssl_parse_alpn_ext(mbedtls_ssl_context *ssl,
     const char **p;
 
     /* If we didn't send it, the server shouldn't send it */
-    if (ssl->conf->alpn_list == NULL) {
+    if (mbedtls_ssl_get_alpn_list(ssl) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("non-matching ALPN extension"));
         mbedtls_ssl_send_alert_message(
             ssl,
@@ -955,7 +955,7 @@ static int ssl_parse_alpn_ext(mbedtls_ssl_context *ssl,
     }
 
     /* Check that the server chosen protocol was in our list and save it */
-    for (p = ssl->conf->alpn_list; *p != NULL; p++) {
+    for (p = mbedtls_ssl_get_alpn_list(ssl); *p != NULL; p++) {
         if (name_len == strlen(*p) &&
             memcmp(buf + 3, *p, name_len) == 0) {
             ssl->alpn_chosen = *p;
@@ -1148,9 +1148,10 @@ static int ssl_parse_hello_verify_request(mbedtls_ssl_context *ssl)
     }
     MBEDTLS_SSL_DEBUG_BUF(3, "cookie", p, cookie_len);
 
-    mbedtls_free(ssl->handshake->cookie);
+    mbedtls_ssl_hs_arena_free(ssl->handshake, ssl->handshake->cookie);
 
-    ssl->handshake->cookie = mbedtls_calloc(1, cookie_len);
+    ssl->handshake->cookie = mbedtls_ssl_hs_arena_calloc(ssl->handshake,
+                                                         1, cookie_len);
     if (ssl->handshake->cookie  == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc failed (%d bytes)", cookie_len));
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -1235,7 +1236,7 @@ static int ssl_parse_server_hello(mbedtls_ssl_context *ssl)
             return ssl_parse_hello_verify_request(ssl);
         } else {
             /* We made it through the verification process */
-            mbedtls_free(ssl->handshake->cookie);
+            mbedtls_ssl_hs_arena_free(ssl->handshake, ssl->handshake->cookie);
             ssl->handshake->cookie = NULL;
             ssl->handshake->cookie_len = 0;
         }
@@ -1393,7 +1394,7 @@ static int ssl_parse_server_hello(mbedtls_ssl_context *ssl)
      */
     i = 0;
     while (1) {
-        if (ssl->conf->ciphersuite_list[i] == 0) {
+        if (mbedtls_ssl_get_ciphersuite_list(ssl)[i] == 0) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("bad server hello message"));
             mbedtls_ssl_send_alert_message(
                 ssl,
@@ -1402,7 +1403,7 @@ static int ssl_parse_server_hello(mbedtls_ssl_context *ssl)
             return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
         }
 
-        if (ssl->conf->ciphersuite_list[i++] ==
+        if (mbedtls_ssl_get_ciphersuite_list(ssl)[i++] ==
             ssl->session_negotiate->ciphersuite) {
             break;
         }
@@ -1585,6 +1586,18 @@ static int ssl_parse_server_hello(mbedtls_ssl_context *ssl)
                 break;
 #endif /* MBEDTLS_SSL_DTLS_SRTP */
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+            case MBEDTLS_TLS_EXT_CACHED_INFO:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found cached_info extension"));
+
+                if ((ret = mbedtls_ssl_parse_cached_info_ext(
+                         ssl, ext + 4, ext + 4 + ext_size)) != 0) {
+                    return ret;
+                }
+
+                break;
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
             default:
                 MBEDTLS_SSL_DEBUG_MSG(3,
                                       ("unknown extension found: %u (ignoring)", ext_id));
@@ -1914,7 +1927,7 @@ static int ssl_write_encrypted_pms(mbedtls_ssl_context *ssl,
     unsigned char *p = ssl->handshake->premaster + pms_offset;
     mbedtls_pk_context *peer_pk;
 
-    if (offset + len_bytes > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+    if (offset + len_bytes > mbedtls_ssl_out_content_len(ssl)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("buffer too small for encrypted pms"));
         return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
     }
@@ -1929,7 +1942,7 @@ static int ssl_write_encrypted_pms(mbedtls_ssl_context *ssl,
     mbedtls_ssl_write_version(p, ssl->conf->transport,
                               MBEDTLS_SSL_VERSION_TLS1_2);
 
-    if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, p + 2, 46)) != 0) {
+    if ((ret = ssl->f_rng(ssl->p_rng, p + 2, 46)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "f_rng", ret);
         return ret;
     }
@@ -1958,8 +1971,8 @@ static int ssl_write_encrypted_pms(mbedtls_ssl_context *ssl,
     if ((ret = mbedtls_pk_encrypt(peer_pk,
                                   p, ssl->handshake->pmslen,
                                   ssl->out_msg + offset + len_bytes, olen,
-                                  MBEDTLS_SSL_OUT_CONTENT_LEN - offset - len_bytes,
-                                  ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                  mbedtls_ssl_out_content_len(ssl) - offset - len_bytes,
+                                  ssl->f_rng, ssl->p_rng)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_rsa_pkcs1_encrypt", ret);
         return ret;
     }
@@ -2716,7 +2729,7 @@ static int ssl_write_client_key_exchange(mbedtls_ssl_context *ssl)
         ret = mbedtls_dhm_make_public(&ssl->handshake->dhm_ctx,
                                       (int) mbedtls_dhm_get_len(&ssl->handshake->dhm_ctx),
                                       &ssl->out_msg[header_len], content_len,
-                                      ssl->conf->f_rng, ssl->conf->p_rng);
+                                      ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_make_public", ret);
             return ret;
@@ -2729,7 +2742,7 @@ static int ssl_write_client_key_exchange(mbedtls_ssl_context *ssl)
                                            ssl->handshake->premaster,
                                            MBEDTLS_PREMASTER_SIZE,
                                            &ssl->handshake->pmslen,
-                                           ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                           ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_calc_secret", ret);
             return ret;
         }
@@ -2773,27 +2786,19 @@ static int ssl_write_client_key_exchange(mbedtls_ssl_context *ssl)
         psa_set_key_type(&key_attributes, handshake->xxdh_psa_type);
         psa_set_key_bits(&key_attributes, handshake->xxdh_psa_bits);
 
-        /* Generate ECDH private key. */
-        status = psa_generate_key(&key_attributes,
-                                  &handshake->xxdh_psa_privkey);
-        if (status != PSA_SUCCESS) {
-            return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
-        }
-
-        /* Export the public part of the ECDH private key from PSA.
+        /* Generate ECDH private key and export its public part.
          * The export format is an ECPoint structure as expected by TLS,
          * but we just need to add a length byte before that. */
         unsigned char *own_pubkey = ssl->out_msg + header_len + 1;
-        unsigned char *end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+        unsigned char *end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
         size_t own_pubkey_max_len = (size_t) (end - own_pubkey);
         size_t own_pubkey_len;
 
-        status = psa_export_public_key(handshake->xxdh_psa_privkey,
-                                       own_pubkey, own_pubkey_max_len,
-                                       &own_pubkey_len);
+        status = mbedtls_ssl_generate_ephemeral_key(ssl, &key_attributes,
+                                                    own_pubkey,
+                                                    own_pubkey_max_len,
+                                                    &own_pubkey_len);
         if (status != PSA_SUCCESS) {
-            psa_destroy_key(handshake->xxdh_psa_privkey);
-            handshake->xxdh_psa_privkey = MBEDTLS_SVC_KEY_ID_INIT;
             return MBEDTLS_ERR_SSL_HW_ACCEL_FAILED;
         }
 
@@ -2836,7 +2841,7 @@ static int ssl_write_client_key_exchange(mbedtls_ssl_context *ssl)
         ret = mbedtls_ecdh_make_public(&ssl->handshake->ecdh_ctx,
                                        &content_len,
                                        &ssl->out_msg[header_len], 1000,
-                                       ssl->conf->f_rng, ssl->conf->p_rng);
+                                       ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_make_public", ret);
 #if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
@@ -2865,7 +2870,7 @@ ecdh_calc_secret:
                                             &ssl->handshake->pmslen,
                                             ssl->handshake->premaster,
                                             MBEDTLS_MPI_MAX_SIZE,
-                                            ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                            ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_calc_secret", ret);
 #if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
             if (ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -2908,7 +2913,7 @@ ecdh_calc_secret:
         header_len = 4;
 
         if (header_len + content_len_size + ssl->conf->psk_identity_len
-            > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+            > mbedtls_ssl_out_content_len(ssl)) {
             MBEDTLS_SSL_DEBUG_MSG(1,
                                   ("psk identity too long or SSL buffer too short"));
             return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
@@ -2945,27 +2950,19 @@ ecdh_calc_secret:
         psa_set_key_type(&key_attributes, handshake->xxdh_psa_type);
         psa_set_key_bits(&key_attributes, handshake->xxdh_psa_bits);
 
-        /* Generate ECDH private key. */
-        status = psa_generate_key(&key_attributes,
-                                  &handshake->xxdh_psa_privkey);
-        if (status != PSA_SUCCESS) {
-            return PSA_TO_MBEDTLS_ERR(status);
-        }
-
-        /* Export the public part of the ECDH private key from PSA.
+        /* Generate ECDH private key and export its public part.
          * The export format is an ECPoint structure as expected by TLS,
          * but we just need to add a length byte before that. */
         unsigned char *own_pubkey = p + 1;
-        unsigned char *end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+        unsigned char *end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
         size_t own_pubkey_max_len = (size_t) (end - own_pubkey);
         size_t own_pubkey_len = 0;
 
-        status = psa_export_public_key(handshake->xxdh_psa_privkey,
-                                       own_pubkey, own_pubkey_max_len,
-                                       &own_pubkey_len);
+        status = mbedtls_ssl_generate_ephemeral_key(ssl, &key_attributes,
+                                                    own_pubkey,
+                                                    own_pubkey_max_len,
+                                                    &own_pubkey_len);
         if (status != PSA_SUCCESS) {
-            psa_destroy_key(handshake->xxdh_psa_privkey);
-            handshake->xxdh_psa_privkey = MBEDTLS_SVC_KEY_ID_INIT;
             return PSA_TO_MBEDTLS_ERR(status);
         }
 
@@ -3024,7 +3021,7 @@ ecdh_calc_secret:
         header_len = 4;
         content_len = ssl->conf->psk_identity_len;
 
-        if (header_len + 2 + content_len > MBEDTLS_SSL_OUT_CONTENT_LEN) {
+        if (header_len + 2 + content_len > mbedtls_ssl_out_content_len(ssl)) {
             MBEDTLS_SSL_DEBUG_MSG(1,
                                   ("psk identity too long or SSL buffer too short"));
             return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
@@ -3051,7 +3048,7 @@ ecdh_calc_secret:
             content_len = mbedtls_dhm_get_len(&ssl->handshake->dhm_ctx);
 
             if (header_len + 2 + content_len >
-                MBEDTLS_SSL_OUT_CONTENT_LEN) {
+                mbedtls_ssl_out_content_len(ssl)) {
                 MBEDTLS_SSL_DEBUG_MSG(1,
                                       ("psk identity or DHM size too long or SSL buffer too short"));
                 return MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
@@ -3063,7 +3060,7 @@ ecdh_calc_secret:
             ret = mbedtls_dhm_make_public(&ssl->handshake->dhm_ctx,
                                           (int) mbedtls_dhm_get_len(&ssl->handshake->dhm_ctx),
                                           &ssl->out_msg[header_len], content_len,
-                                          ssl->conf->f_rng, ssl->conf->p_rng);
+                                          ssl->f_rng, ssl->p_rng);
             if (ret != 0) {
                 MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_make_public", ret);
                 return ret;
@@ -3077,7 +3074,7 @@ ecdh_calc_secret:
             /* Write length only when we know the actual value */
             if ((ret = mbedtls_dhm_calc_secret(&ssl->handshake->dhm_ctx,
                                                pms + 2, pms_end - (pms + 2), &pms_len,
-                                               ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                               ssl->f_rng, ssl->p_rng)) != 0) {
                 MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_calc_secret", ret);
                 return ret;
             }
@@ -3097,8 +3094,8 @@ ecdh_calc_secret:
             ret = mbedtls_ecdh_make_public(&ssl->handshake->ecdh_ctx,
                                            &content_len,
                                            &ssl->out_msg[header_len],
-                                           MBEDTLS_SSL_OUT_CONTENT_LEN - header_len,
-                                           ssl->conf->f_rng, ssl->conf->p_rng);
+                                           mbedtls_ssl_out_content_len(ssl) - header_len,
+                                           ssl->f_rng, ssl->p_rng);
             if (ret != 0) {
                 MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_make_public", ret);
                 return ret;
@@ -3139,7 +3136,7 @@ ecdh_calc_secret:
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         unsigned char *out_p = ssl->out_msg + header_len;
-        unsigned char *end_p = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN -
+        unsigned char *end_p = ssl->out_msg + mbedtls_ssl_out_content_len(ssl) -
                                header_len;
         ret = mbedtls_psa_ecjpake_write_round(&ssl->handshake->psa_pake_ctx,
                                               out_p, end_p - out_p, &content_len,
@@ -3153,9 +3150,9 @@ ecdh_calc_secret:
 #else
         ret = mbedtls_ecjpake_write_round_two(&ssl->handshake->ecjpake_ctx,
                                               ssl->out_msg + header_len,
-                                              MBEDTLS_SSL_OUT_CONTENT_LEN - header_len,
+                                              mbedtls_ssl_out_content_len(ssl) - header_len,
                                               &content_len,
-                                              ssl->conf->f_rng, ssl->conf->p_rng);
+                                              ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecjpake_write_round_two", ret);
             return ret;
@@ -3163,7 +3160,7 @@ ecdh_calc_secret:
 
         ret = mbedtls_ecjpake_derive_secret(&ssl->handshake->ecjpake_ctx,
                                             ssl->handshake->premaster, 32, &ssl->handshake->pmslen,
-                                            ssl->conf->f_rng, ssl->conf->p_rng);
+                                            ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecjpake_derive_secret", ret);
             return ret;
@@ -3230,11 +3227,7 @@ static int ssl_write_certificate_verify(mbedtls_ssl_context *ssl)
     mbedtls_md_type_t md_alg = MBEDTLS_MD_NONE;
     size_t hashlen;
     void *rs_ctx = NULL;
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t out_buf_len = ssl->out_buf_len - (size_t) (ssl->out_msg - ssl->out_buf);
-#else
-    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN - (size_t) (ssl->out_msg - ssl->out_buf);
-#endif
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write certificate verify"));
 
@@ -3325,7 +3318,7 @@ sign:
                                            ssl->out_msg + 6 + offset,
                                            out_buf_len - 6 - offset,
                                            &n,
-                                           ssl->conf->f_rng, ssl->conf->p_rng, rs_ctx)) != 0) {
+                                           ssl->f_rng, ssl->p_rng, rs_ctx)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_sign", ret);
 #if defined(MBEDTLS_SSL_ECP_RESTARTABLE_ENABLED)
         if (ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -3437,7 +3430,7 @@ static int ssl_parse_new_session_ticket(mbedtls_ssl_context *ssl)
     ssl->session_negotiate->ticket = NULL;
     ssl->session_negotiate->ticket_len = 0;
 
-    if ((ticket = mbedtls_calloc(1, ticket_len)) == NULL) {
+    if ((ticket = mbedtls_calloc_tagged(SSL_SESSION, 1, ticket_len)) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("ticket alloc failed"));
         mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
                                        MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR);
@@ -3464,6 +3457,46 @@ static int ssl_parse_new_session_ticket(mbedtls_ssl_context *ssl)
 }
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
 
+#if defined(MBEDTLS_SSL_FALSE_START)
+int mbedtls_ssl_tls12_false_start_ready(const mbedtls_ssl_context *ssl)
+{
+    const mbedtls_ssl_ciphersuite_t *suite;
+
+    if (ssl->conf->false_start != MBEDTLS_SSL_FALSE_START_ENABLED ||
+        ssl->conf->endpoint != MBEDTLS_SSL_IS_CLIENT ||
+        ssl->conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        ssl->tls_version != MBEDTLS_SSL_VERSION_TLS1_2 ||
+        ssl->handshake == NULL || ssl->handshake->resume != 0) {
+        return 0;
+    }
+#if defined(MBEDTLS_SSL_RENEGOTIATION)
+    if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
+        return 0;
+    }
+#endif
+
+    /* The client flight is out and only server messages are left. */
+    if (ssl->state != MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC &&
+        ssl->state != MBEDTLS_SSL_NEW_SESSION_TICKET &&
+        ssl->state != MBEDTLS_SSL_SERVER_FINISHED) {
+        return 0;
+    }
+
+    /* RFC 7918 section 3.1: forward secrecy and an AEAD cipher. */
+    suite = ssl->handshake->ciphersuite_info;
+    if (suite == NULL ||
+        mbedtls_ssl_get_mode_from_transform(ssl->transform_out) !=
+        MBEDTLS_SSL_MODE_AEAD) {
+        return 0;
+    }
+#if defined(MBEDTLS_KEY_EXCHANGE_SOME_PFS_ENABLED)
+    return mbedtls_ssl_ciphersuite_has_pfs(suite);
+#else
+    return 0;
+#endif
+}
+#endif /* MBEDTLS_SSL_FALSE_START */
+
 /*
  * SSL handshake -- client side -- single step
  */
@@ -54,7 +54,7 @@ int mbedtls_ssl_set_client_transport_id(mbedtls_ssl_context *ssl,
 
     mbedtls_free(ssl->cli_id);
 
-    if ((ssl->cli_id = mbedtls_calloc(1, ilen)) == NULL) {
+    if ((ssl->cli_id = mbedtls_calloc_tagged(SSL, 1, ilen)) == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
 
@@ -215,8 +215,8 @@ static int ssl_parse_supported_groups_ext(mbedtls_ssl_context *ssl,
         our_size = MBEDTLS_ECP_DP_MAX;
     }
 
-    if ((curves_tls_id = mbedtls_calloc(our_size,
-                                        sizeof(*curves_tls_id))) == NULL) {
+    if ((curves_tls_id = mbedtls_ssl_hs_arena_calloc(
+             ssl->handshake, our_size, sizeof(*curves_tls_id))) == NULL) {
         mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
                                        MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR);
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -499,9 +499,12 @@ static int ssl_parse_session_ticket_ext(mbedtls_ssl_context *ssl,
     /*
      * Failures are ok: just ignore the ticket and proceed.
      */
-    if ((ret = ssl->conf->f_ticket_parse(ssl->conf->p_ticket, &session,
-                                         buf, len)) != 0) {
+    ret = ssl->conf->f_ticket_parse(ssl->conf->p_ticket, &session, buf, len);
+    MBEDTLS_SSL_PROBE2(ticket_parse, ssl, ret);
+    if (ret != 0 && ret != MBEDTLS_SSL_TICKET_PARSE_FRESH &&
+        ret != MBEDTLS_SSL_TICKET_PARSE_RENEW) {
         mbedtls_ssl_session_free(&session);
+        MBEDTLS_SSL_STATS_INC(ssl, ticket_failures);
 
         if (ret == MBEDTLS_ERR_SSL_INVALID_MAC) {
             MBEDTLS_SSL_DEBUG_MSG(3, ("ticket is not authentic"));
@@ -531,8 +534,9 @@ static int ssl_parse_session_ticket_ext(mbedtls_ssl_context *ssl,
 
     ssl->handshake->resume = 1;
 
-    /* Don't send a new ticket after all, this one is OK */
-    ssl->handshake->new_session_ticket = 0;
+    /* Don't send a new ticket after all, this one is OK, unless the ticket
+     * module wants it replaced. */
+    ssl->handshake->new_session_ticket = ret == MBEDTLS_SSL_TICKET_PARSE_RENEW;
 
     return 0;
 }
@@ -703,7 +707,7 @@ static int ssl_pick_cert(mbedtls_ssl_context *ssl,
         list = ssl->handshake->sni_key_cert;
     } else
 #endif
-    list = ssl->conf->key_cert;
+    list = mbedtls_ssl_key_cert_list(ssl);
 
     int pk_alg_is_none = 0;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -1006,7 +1010,7 @@ read_record_header:
         if (ssl->keep_current_message) {
             ssl->keep_current_message = 0;
         } else {
-            if (msg_len > MBEDTLS_SSL_IN_CONTENT_LEN) {
+            if (msg_len > mbedtls_ssl_in_content_len(ssl)) {
                 MBEDTLS_SSL_DEBUG_MSG(1, ("bad client hello message"));
                 return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
             }
@@ -1316,24 +1320,29 @@ read_record_header:
     ext = buf + ext_offset + 2;
     MBEDTLS_SSL_DEBUG_BUF(3, "client hello extensions", ext, ext_len);
 
-    while (ext_len != 0) {
-        unsigned int ext_id;
-        unsigned int ext_size;
-        if (ext_len < 4) {
+    /*
+     * Check the framing of the extensions once, unless the TLS 1.3 version
+     * negotiation already indexed this very ClientHello.
+     */
+    if (ssl->handshake->client_hello_exts.exts != ext ||
+        ssl->handshake->client_hello_exts.end != ext + ext_len) {
+        ret = mbedtls_ssl_index_client_hello_exts(&ssl->handshake->client_hello_exts,
+                                                  ext, ext + ext_len);
+        if (ret != 0) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("bad client hello message"));
             mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
                                            MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR);
-            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+            return ret;
         }
+    }
+
+    while (ext_len != 0) {
+        unsigned int ext_id;
+        unsigned int ext_size;
+
         ext_id   = MBEDTLS_GET_UINT16_BE(ext, 0);
         ext_size = MBEDTLS_GET_UINT16_BE(ext, 2);
 
-        if (ext_size + 4 > ext_len) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("bad client hello message"));
-            mbedtls_ssl_send_alert_message(ssl, MBEDTLS_SSL_ALERT_LEVEL_FATAL,
-                                           MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR);
-            return MBEDTLS_ERR_SSL_DECODE_ERROR;
-        }
         switch (ext_id) {
 #if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
             case MBEDTLS_TLS_EXT_SERVERNAME:
@@ -1485,6 +1494,18 @@ read_record_header:
                 break;
 #endif /* MBEDTLS_SSL_DTLS_SRTP */
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+            case MBEDTLS_TLS_EXT_CACHED_INFO:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found cached_info extension"));
+
+                ret = mbedtls_ssl_parse_cached_info_ext(ssl, ext + 4,
+                                                        ext + 4 + ext_size);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
             default:
                 MBEDTLS_SSL_DEBUG_MSG(3, ("unknown extension found: %u (ignoring)",
                                           ext_id));
@@ -1595,7 +1616,7 @@ read_record_header:
      * or certificate from server certificate selection callback.)
      */
     got_common_suite = 0;
-    ciphersuites = ssl->conf->ciphersuite_list;
+    ciphersuites = mbedtls_ssl_get_ciphersuite_list(ssl);
     ciphersuite_info = NULL;
 
     if (ssl->conf->respect_cli_pref == MBEDTLS_SSL_SRV_CIPHERSUITE_ORDER_CLIENT) {
@@ -1656,6 +1677,7 @@ have_ciphersuite:
 
     ssl->session_negotiate->ciphersuite = ciphersuites[i];
     ssl->handshake->ciphersuite_info = ciphersuite_info;
+    mbedtls_ssl_optimize_checksum(ssl, ciphersuite_info);
 
     ssl->state++;
 
@@ -1692,7 +1714,7 @@ static void ssl_write_cid_ext(mbedtls_ssl_context *ssl,
 {
     unsigned char *p = buf;
     size_t ext_len;
-    const unsigned char *end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+    const unsigned char *end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
 
     *olen = 0;
 
@@ -1927,7 +1949,7 @@ static void ssl_write_ecjpake_kkpp_ext(mbedtls_ssl_context *ssl,
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     unsigned char *p = buf;
-    const unsigned char *end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+    const unsigned char *end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
     size_t kkpp_len;
 
     *olen = 0;
@@ -1961,7 +1983,7 @@ static void ssl_write_ecjpake_kkpp_ext(mbedtls_ssl_context *ssl,
 #else
     ret = mbedtls_ecjpake_write_round_one(&ssl->handshake->ecjpake_ctx,
                                           p + 2, (size_t) (end - p - 2), &kkpp_len,
-                                          ssl->conf->f_rng, ssl->conf->p_rng);
+                                          ssl->f_rng, ssl->p_rng);
     if (ret != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecjpake_write_round_one", ret);
         return;
@@ -1982,7 +2004,7 @@ static void ssl_write_use_srtp_ext(mbedtls_ssl_context *ssl,
 {
     size_t mki_len = 0, ext_len = 0;
     uint16_t profile_value = 0;
-    const unsigned char *end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+    const unsigned char *end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
 
     *olen = 0;
 
@@ -2071,7 +2093,7 @@ static int ssl_write_hello_verify_request(mbedtls_ssl_context *ssl)
     cookie_len_byte = p++;
 
     if ((ret = ssl->conf->f_cookie_write(ssl->conf->p_cookie,
-                                         &p, ssl->out_buf + MBEDTLS_SSL_OUT_BUFFER_LEN,
+                                         &p, ssl->out_buf + mbedtls_ssl_out_buffer_len(ssl),
                                          ssl->cli_id, ssl->cli_id_len)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "f_cookie_write", ret);
         return ret;
@@ -2106,7 +2128,12 @@ static int ssl_write_hello_verify_request(mbedtls_ssl_context *ssl)
 }
 #endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY */
 
-static void ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl)
+/*
+ * Returns MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS if the cache lookup is pending,
+ * and 0 otherwise: any other cache failure results in a full handshake.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl)
 {
     int ret;
     mbedtls_ssl_session session_tmp;
@@ -2115,17 +2142,17 @@ static void ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl)
     /* Resume is 0  by default, see ssl_handshake_init().
      * It may be already set to 1 by ssl_parse_session_ticket_ext(). */
     if (ssl->handshake->resume == 1) {
-        return;
+        return 0;
     }
     if (session->id_len == 0) {
-        return;
+        return 0;
     }
     if (ssl->conf->f_get_cache == NULL) {
-        return;
+        return 0;
     }
 #if defined(MBEDTLS_SSL_RENEGOTIATION)
     if (ssl->renego_status != MBEDTLS_SSL_INITIAL_HANDSHAKE) {
-        return;
+        return 0;
     }
 #endif
 
@@ -2135,15 +2162,25 @@ static void ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl)
                                  session->id,
                                  session->id_len,
                                  &session_tmp);
+    MBEDTLS_SSL_PROBE2(cache_get, ssl, ret);
+    if (ret == MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("session cache lookup in progress"));
+        goto exit;
+    }
     if (ret != 0) {
+        MBEDTLS_SSL_STATS_INC(ssl, cache_misses);
+        ret = 0;
         goto exit;
     }
 
     if (session->ciphersuite != session_tmp.ciphersuite) {
         /* Mismatch between cached and negotiated session */
+        MBEDTLS_SSL_STATS_INC(ssl, cache_misses);
         goto exit;
     }
 
+    MBEDTLS_SSL_STATS_INC(ssl, cache_hits);
+
     /* Move semantics */
     mbedtls_ssl_session_free(session);
     *session = session_tmp;
@@ -2155,6 +2192,8 @@ static void ssl_handle_id_based_session_resumption(mbedtls_ssl_context *ssl)
 exit:
 
     mbedtls_ssl_session_free(&session_tmp);
+
+    return ret;
 }
 
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -2179,6 +2218,22 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
     }
 #endif /* MBEDTLS_SSL_DTLS_HELLO_VERIFY */
 
+    /* Look up the session first: if the cache lookup is asynchronous, this
+     * step is repeated, and nothing must have been written yet. */
+    ret = ssl_handle_id_based_session_resumption(ssl);
+    if (ret != 0) {
+        return ret;
+    }
+
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+    /* Now that resumption is settled, before the first public key
+     * operation and before anything is written. */
+    ret = mbedtls_ssl_hs_admit(ssl);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+
     /*
      *     0  .   0   handshake type
      *     1  .   3   handshake length
@@ -2203,14 +2258,14 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
     MBEDTLS_SSL_DEBUG_MSG(3, ("server hello, current time: %" MBEDTLS_PRINTF_LONGLONG,
                               (long long) t));
 #else
-    if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, p, 4)) != 0) {
+    if ((ret = ssl->f_rng(ssl->p_rng, p, 4)) != 0) {
         return ret;
     }
 
     p += 4;
 #endif /* MBEDTLS_HAVE_TIME */
 
-    if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, p, 20)) != 0) {
+    if ((ret = ssl->f_rng(ssl->p_rng, p, 20)) != 0) {
         return ret;
     }
     p += 20;
@@ -2236,7 +2291,7 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
     } else
 #endif
     {
-        if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, p, 8)) != 0) {
+        if ((ret = ssl->f_rng(ssl->p_rng, p, 8)) != 0) {
             return ret;
         }
     }
@@ -2246,8 +2301,6 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_BUF(3, "server hello, random bytes", buf + 6, 32);
 
-    ssl_handle_id_based_session_resumption(ssl);
-
     if (ssl->handshake->resume == 0) {
         /*
          * New session, create a new session id,
@@ -2267,8 +2320,8 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_SESSION_TICKETS */
         {
             ssl->session_negotiate->id_len = n = 32;
-            if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, ssl->session_negotiate->id,
-                                        n)) != 0) {
+            if ((ret = ssl->f_rng(ssl->p_rng, ssl->session_negotiate->id,
+                                  n)) != 0) {
                 return ret;
             }
         }
@@ -2359,7 +2412,7 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
 #endif
 
 #if defined(MBEDTLS_SSL_ALPN)
-    unsigned char *end = buf + MBEDTLS_SSL_OUT_CONTENT_LEN - 4;
+    unsigned char *end = buf + mbedtls_ssl_out_content_len(ssl) - 4;
     if ((ret = mbedtls_ssl_write_alpn_ext(ssl, p + 2 + ext_len, end, &olen))
         != 0) {
         return ret;
@@ -2373,6 +2426,20 @@ static int ssl_write_server_hello(mbedtls_ssl_context *ssl)
     ext_len += olen;
 #endif
 
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    /* Only a full handshake sends the chain. */
+    if (!ssl->handshake->resume &&
+        mbedtls_ssl_ciphersuite_uses_srv_cert(ssl->handshake->ciphersuite_info)) {
+        ret = mbedtls_ssl_write_cached_info_ext(
+            ssl, p + 2 + ext_len, buf + mbedtls_ssl_out_content_len(ssl) - 4,
+            &olen);
+        if (ret != 0) {
+            return ret;
+        }
+        ext_len += olen;
+    }
+#endif
+
     MBEDTLS_SSL_DEBUG_MSG(3, ("server hello, total extension length: %" MBEDTLS_PRINTF_SIZET,
                               ext_len));
 
@@ -2420,7 +2487,7 @@ static int ssl_write_certificate_request(mbedtls_ssl_context *ssl)
     uint16_t dn_size, total_dn_size; /* excluding length bytes */
     size_t ct_len, sa_len; /* including length bytes */
     unsigned char *buf, *p;
-    const unsigned char * const end = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN;
+    const unsigned char * const end = ssl->out_msg + mbedtls_ssl_out_content_len(ssl);
     const mbedtls_x509_crt *crt;
     int authmode;
 
@@ -2433,7 +2500,7 @@ static int ssl_write_certificate_request(mbedtls_ssl_context *ssl)
         authmode = ssl->handshake->sni_authmode;
     } else
 #endif
-    authmode = ssl->conf->authmode;
+    authmode = mbedtls_ssl_get_conf_authmode(ssl);
 
     if (!mbedtls_ssl_ciphersuite_cert_req_allowed(ciphersuite_info) ||
         authmode == MBEDTLS_SSL_VERIFY_NONE) {
@@ -2546,7 +2613,22 @@ static int ssl_write_certificate_request(mbedtls_ssl_context *ssl)
             crt = ssl->handshake->sni_ca_chain;
         } else
 #endif
-        crt = ssl->conf->ca_chain;
+        crt = mbedtls_ssl_trusted_ca_chain(ssl, NULL);
+
+#if defined(MBEDTLS_SSL_CA_DN_LIST_CACHE)
+        /* Copy the list encoded with the configuration, if it fits. */
+        if (crt != NULL && crt == ssl->conf->ca_dn_list_src &&
+            end >= p && (size_t) (end - p) >= ssl->conf->ca_dn_list_len) {
+            memcpy(p, ssl->conf->ca_dn_list, ssl->conf->ca_dn_list_len);
+            p += ssl->conf->ca_dn_list_len;
+
+            MBEDTLS_SSL_DEBUG_BUF(3, "requested DNs", ssl->conf->ca_dn_list,
+                                  ssl->conf->ca_dn_list_len);
+
+            total_dn_size = (unsigned short) ssl->conf->ca_dn_list_len;
+            crt = NULL;
+        }
+#endif /* MBEDTLS_SSL_CA_DN_LIST_CACHE */
 
         while (crt != NULL && crt->version != 0) {
             /* It follows from RFC 5280 A.1 that this length
@@ -2774,7 +2856,7 @@ static int ssl_resume_server_key_exchange(mbedtls_ssl_context *ssl,
      * ssl_write_server_key_exchange also takes care of incrementing
      * ssl->out_msglen. */
     unsigned char *sig_start = ssl->out_msg + ssl->out_msglen + 2;
-    size_t sig_max_len = (ssl->out_buf + MBEDTLS_SSL_OUT_CONTENT_LEN
+    size_t sig_max_len = (ssl->out_buf + mbedtls_ssl_out_content_len(ssl)
                           - sig_start);
     int ret = ssl->conf->f_async_resume(ssl,
                                         sig_start, signature_len, sig_max_len);
@@ -2788,6 +2870,42 @@ static int ssl_resume_server_key_exchange(mbedtls_ssl_context *ssl,
 #endif /* defined(MBEDTLS_KEY_EXCHANGE_WITH_SERVER_SIGNATURE_ENABLED) &&
           defined(MBEDTLS_SSL_ASYNC_PRIVATE) */
 
+#if defined(MBEDTLS_KEY_EXCHANGE_SOME_DHE_ENABLED)
+/*
+ * Set the group of the ephemeral DHM context: the one configured with
+ * mbedtls_ssl_conf_dh_param_xxx(), or else the RFC 3526 2048-bit group,
+ * which mbedtls_ssl_config_defaults() leaves for the handshake to read so
+ * that setting up a configuration does not need to parse it.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_set_dhm_group(mbedtls_ssl_context *ssl)
+{
+    static const unsigned char dhm_p[] = MBEDTLS_DHM_RFC3526_MODP_2048_P_BIN;
+    static const unsigned char dhm_g[] = MBEDTLS_DHM_RFC3526_MODP_2048_G_BIN;
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_mpi P, G;
+
+    if (ssl->conf->dhm_P.p != NULL && ssl->conf->dhm_G.p != NULL) {
+        return mbedtls_dhm_set_group(&ssl->handshake->dhm_ctx,
+                                     &ssl->conf->dhm_P,
+                                     &ssl->conf->dhm_G);
+    }
+
+    mbedtls_mpi_init(&P);
+    mbedtls_mpi_init(&G);
+
+    if ((ret = mbedtls_mpi_read_binary(&P, dhm_p, sizeof(dhm_p))) == 0 &&
+        (ret = mbedtls_mpi_read_binary(&G, dhm_g, sizeof(dhm_g))) == 0) {
+        ret = mbedtls_dhm_set_group(&ssl->handshake->dhm_ctx, &P, &G);
+    }
+
+    mbedtls_mpi_free(&P);
+    mbedtls_mpi_free(&G);
+
+    return ret;
+}
+#endif /* MBEDTLS_KEY_EXCHANGE_SOME_DHE_ENABLED */
+
 /* Prepare the ServerKeyExchange message, up to and including
  * calculating the signature if any, but excluding formatting the
  * signature and sending the message. */
@@ -2810,11 +2928,7 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
 #endif /* MBEDTLS_KEY_EXCHANGE_WITH_SERVER_SIGNATURE_ENABLED */
 
 #if defined(MBEDTLS_KEY_EXCHANGE_WITH_SERVER_SIGNATURE_ENABLED)
-#if defined(MBEDTLS_SSL_VARIABLE_BUFFER_LENGTH)
     size_t out_buf_len = ssl->out_buf_len - (size_t) (ssl->out_msg - ssl->out_buf);
-#else
-    size_t out_buf_len = MBEDTLS_SSL_OUT_BUFFER_LEN - (size_t) (ssl->out_msg - ssl->out_buf);
-#endif
 #endif
 
     ssl->out_msglen = 4; /* header (type:1, length:3) to be written later */
@@ -2833,7 +2947,7 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
         unsigned char *out_p = ssl->out_msg + ssl->out_msglen;
-        unsigned char *end_p = ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN -
+        unsigned char *end_p = ssl->out_msg + mbedtls_ssl_out_content_len(ssl) -
                                ssl->out_msglen;
         size_t output_offset = 0;
         size_t output_len = 0;
@@ -2874,8 +2988,8 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
         ret = mbedtls_ecjpake_write_round_two(
             &ssl->handshake->ecjpake_ctx,
             ssl->out_msg + ssl->out_msglen,
-            MBEDTLS_SSL_OUT_CONTENT_LEN - ssl->out_msglen, &len,
-            ssl->conf->f_rng, ssl->conf->p_rng);
+            mbedtls_ssl_out_content_len(ssl) - ssl->out_msglen, &len,
+            ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecjpake_write_round_two", ret);
             return ret;
@@ -2909,11 +3023,6 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
         int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
         size_t len = 0;
 
-        if (ssl->conf->dhm_P.p == NULL || ssl->conf->dhm_G.p == NULL) {
-            MBEDTLS_SSL_DEBUG_MSG(1, ("no DH parameters set"));
-            return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
-        }
-
         /*
          * Ephemeral DH parameters:
          *
@@ -2923,9 +3032,7 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
          *     opaque dh_Ys<1..2^16-1>;
          * } ServerDHParams;
          */
-        if ((ret = mbedtls_dhm_set_group(&ssl->handshake->dhm_ctx,
-                                         &ssl->conf->dhm_P,
-                                         &ssl->conf->dhm_G)) != 0) {
+        if ((ret = ssl_set_dhm_group(ssl)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_set_group", ret);
             return ret;
         }
@@ -2934,7 +3041,7 @@ static int ssl_prepare_server_key_exchange(mbedtls_ssl_context *ssl,
                  &ssl->handshake->dhm_ctx,
                  (int) mbedtls_dhm_get_len(&ssl->handshake->dhm_ctx),
                  ssl->out_msg + ssl->out_msglen, &len,
-                 ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                 ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_make_params", ret);
             return ret;
         }
@@ -3034,15 +3141,6 @@ curve_matching_done:
         MBEDTLS_PUT_UINT16_BE(*curr_tls_id, p, 0);
         p += 2;
 
-        /* Generate ECDH private key. */
-        status = psa_generate_key(&key_attributes,
-                                  &handshake->xxdh_psa_privkey);
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_generate_key", ret);
-            return ret;
-        }
-
         /*
          * ECPoint  public
          *
@@ -3050,23 +3148,41 @@ curve_matching_done:
          * It will be filled later. p holds now the data length location.
          */
 
-        /* Export the public part of the ECDH private key from PSA.
+        /* Generate ECDH private key and export its public part.
          * Make one byte space for the length.
          */
         unsigned char *own_pubkey = p + data_length_size;
 
-        size_t own_pubkey_max_len = (size_t) (MBEDTLS_SSL_OUT_CONTENT_LEN
+        size_t own_pubkey_max_len = (size_t) (mbedtls_ssl_out_content_len(ssl)
                                               - (own_pubkey - ssl->out_msg));
 
-        status = psa_export_public_key(handshake->xxdh_psa_privkey,
-                                       own_pubkey, own_pubkey_max_len,
-                                       &len);
-        if (status != PSA_SUCCESS) {
-            ret = PSA_TO_MBEDTLS_ERR(status);
-            MBEDTLS_SSL_DEBUG_RET(1, "psa_export_public_key", ret);
-            (void) psa_destroy_key(handshake->xxdh_psa_privkey);
-            handshake->xxdh_psa_privkey = MBEDTLS_SVC_KEY_ID_INIT;
-            return ret;
+#if defined(MBEDTLS_SSL_ECDHE_REUSE_C)
+        /* ECDHE_PSK keeps a fresh key pair: its key exchange destroys it. */
+        if (ssl->conf->ecdhe_reuse != NULL &&
+            ciphersuite_info->key_exchange != MBEDTLS_KEY_EXCHANGE_ECDHE_PSK) {
+            ret = mbedtls_ssl_ecdhe_reuse_take(ssl->conf->ecdhe_reuse,
+                                               &key_attributes,
+                                               &handshake->ecdhe_reuse_key,
+                                               &handshake->xxdh_psa_privkey,
+                                               own_pubkey, own_pubkey_max_len,
+                                               &len);
+            if (ret != 0) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_ecdhe_reuse_take", ret);
+                return ret;
+            }
+            handshake->xxdh_psa_privkey_is_external = 1;
+        } else
+#endif /* MBEDTLS_SSL_ECDHE_REUSE_C */
+        {
+            status = mbedtls_ssl_generate_ephemeral_key(ssl, &key_attributes,
+                                                        own_pubkey,
+                                                        own_pubkey_max_len,
+                                                        &len);
+            if (status != PSA_SUCCESS) {
+                ret = PSA_TO_MBEDTLS_ERR(status);
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_generate_ephemeral_key", ret);
+                return ret;
+            }
         }
 
         /* Store the length of the exported public key. */
@@ -3087,8 +3203,8 @@ curve_matching_done:
         if ((ret = mbedtls_ecdh_make_params(
                  &ssl->handshake->ecdh_ctx, &len,
                  ssl->out_msg + ssl->out_msglen,
-                 MBEDTLS_SSL_OUT_CONTENT_LEN - ssl->out_msglen,
-                 ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                 mbedtls_ssl_out_content_len(ssl) - ssl->out_msglen,
+                 ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_make_params", ret);
             return ret;
         }
@@ -3227,8 +3343,8 @@ curve_matching_done:
                                    ssl->out_msg + ssl->out_msglen + 2,
                                    out_buf_len - ssl->out_msglen - 2,
                                    signature_len,
-                                   ssl->conf->f_rng,
-                                   ssl->conf->p_rng)) != 0) {
+                                   ssl->f_rng,
+                                   ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_sign", ret);
             return ret;
         }
@@ -3516,7 +3632,7 @@ static int ssl_decrypt_encrypted_pms(mbedtls_ssl_context *ssl,
 
     ret = mbedtls_pk_decrypt(private_key, p, len,
                              peer_pms, peer_pmslen, peer_pmssize,
-                             ssl->conf->f_rng, ssl->conf->p_rng);
+                             ssl->f_rng, ssl->p_rng);
     return ret;
 }
 
@@ -3574,7 +3690,7 @@ static int ssl_parse_encrypted_pms(mbedtls_ssl_context *ssl,
      * successful. In particular, always generate the fake premaster secret,
      * regardless of whether it will ultimately influence the output or not.
      */
-    ret = ssl->conf->f_rng(ssl->conf->p_rng, fake_pms, sizeof(fake_pms));
+    ret = ssl->f_rng(ssl->p_rng, fake_pms, sizeof(fake_pms));
     if (ret != 0) {
         /* It's ok to abort on an RNG failure, since this does not reveal
          * anything about the RSA decryption. */
@@ -3712,7 +3828,7 @@ static int ssl_parse_client_key_exchange(mbedtls_ssl_context *ssl)
                                            ssl->handshake->premaster,
                                            MBEDTLS_PREMASTER_SIZE,
                                            &ssl->handshake->pmslen,
-                                           ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                           ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_calc_secret", ret);
             return MBEDTLS_ERR_SSL_DECODE_ERROR;
         }
@@ -3803,7 +3919,7 @@ static int ssl_parse_client_key_exchange(mbedtls_ssl_context *ssl)
                                             &ssl->handshake->pmslen,
                                             ssl->handshake->premaster,
                                             MBEDTLS_MPI_MAX_SIZE,
-                                            ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                            ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecdh_calc_secret", ret);
             return MBEDTLS_ERR_SSL_DECODE_ERROR;
         }
@@ -3862,7 +3978,7 @@ static int ssl_parse_client_key_exchange(mbedtls_ssl_context *ssl)
         /* Write length only when we know the actual value */
         if ((ret = mbedtls_dhm_calc_secret(&ssl->handshake->dhm_ctx,
                                            pms + 2, pms_end - (pms + 2), &pms_len,
-                                           ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+                                           ssl->f_rng, ssl->p_rng)) != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_dhm_calc_secret", ret);
             return ret;
         }
@@ -4018,7 +4134,7 @@ static int ssl_parse_client_key_exchange(mbedtls_ssl_context *ssl)
 
         ret = mbedtls_ecjpake_derive_secret(&ssl->handshake->ecjpake_ctx,
                                             ssl->handshake->premaster, 32, &ssl->handshake->pmslen,
-                                            ssl->conf->f_rng, ssl->conf->p_rng);
+                                            ssl->f_rng, ssl->p_rng);
         if (ret != 0) {
             MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ecjpake_derive_secret", ret);
             return ret;
@@ -4251,7 +4367,7 @@ static int ssl_write_new_session_ticket(mbedtls_ssl_context *ssl)
     if ((ret = ssl->conf->f_ticket_write(ssl->conf->p_ticket,
                                          ssl->session_negotiate,
                                          ssl->out_msg + 10,
-                                         ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN,
+                                         ssl->out_msg + mbedtls_ssl_out_content_len(ssl),
                                          &tlen, &lifetime)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_ticket_write", ret);
         tlen = 0;
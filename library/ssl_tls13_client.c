@@ -132,7 +132,7 @@ static int ssl_tls13_parse_alpn_ext(mbedtls_ssl_context *ssl,
     const unsigned char *protocol_name_list_end;
 
     /* If we didn't send it, the server shouldn't send it */
-    if (ssl->conf->alpn_list == NULL) {
+    if (mbedtls_ssl_get_alpn_list(ssl) == NULL) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
 
@@ -158,7 +158,8 @@ static int ssl_tls13_parse_alpn_ext(mbedtls_ssl_context *ssl,
 
     /* Check that the server chosen protocol was in our list and save it */
     MBEDTLS_SSL_CHK_BUF_READ_PTR(p, protocol_name_list_end, protocol_name_len);
-    for (const char **alpn = ssl->conf->alpn_list; *alpn != NULL; alpn++) {
+    for (const char **alpn = mbedtls_ssl_get_alpn_list(ssl);
+         *alpn != NULL; alpn++) {
         if (protocol_name_len == strlen(*alpn) &&
             memcmp(p, *alpn, protocol_name_len) == 0) {
             ssl->alpn_chosen = *alpn;
@@ -246,6 +247,50 @@ static int ssl_tls13_get_default_group_id(mbedtls_ssl_context *ssl,
     return ret;
 }
 
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+/*
+ * The group the server selected last time, if the configuration still
+ * allows it. Returns 0 if there is none.
+ */
+static uint16_t ssl_tls13_get_cached_group_id(mbedtls_ssl_context *ssl)
+{
+    const uint16_t *group_list = mbedtls_ssl_get_groups(ssl);
+    uint16_t group_id;
+
+    if (ssl->conf->group_cache == NULL || ssl->hostname == NULL ||
+        group_list == NULL) {
+        return 0;
+    }
+
+    group_id = mbedtls_ssl_group_cache_get(ssl->conf->group_cache,
+                                           ssl->hostname);
+    if (group_id == 0) {
+        return 0;
+    }
+
+    for (; *group_list != 0; group_list++) {
+        if (*group_list != group_id) {
+            continue;
+        }
+#if defined(PSA_WANT_ALG_ECDH)
+        if ((mbedtls_ssl_get_psa_curve_info_from_tls_id(
+                 group_id, NULL, NULL) == PSA_SUCCESS) &&
+            mbedtls_ssl_tls13_named_group_is_ecdhe(group_id)) {
+            return group_id;
+        }
+#endif
+#if defined(PSA_WANT_ALG_FFDH)
+        if (mbedtls_ssl_tls13_named_group_is_ffdh(group_id)) {
+            return group_id;
+        }
+#endif
+        break;
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_GROUP_CACHE_C */
+
 /*
  * ssl_tls13_write_key_share_ext
  *
@@ -285,6 +330,13 @@ static int ssl_tls13_write_key_share_ext(mbedtls_ssl_context *ssl,
 
     /* HRR could already have requested something else. */
     group_id = ssl->handshake->offered_group_id;
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+    /* Otherwise, offer the group this server selected last time. */
+    if (!mbedtls_ssl_tls13_named_group_is_ecdhe(group_id) &&
+        !mbedtls_ssl_tls13_named_group_is_ffdh(group_id)) {
+        group_id = ssl_tls13_get_cached_group_id(ssl);
+    }
+#endif
     if (!mbedtls_ssl_tls13_named_group_is_ecdhe(group_id) &&
         !mbedtls_ssl_tls13_named_group_is_ffdh(group_id)) {
         MBEDTLS_SSL_PROC_CHK(ssl_tls13_get_default_group_id(ssl,
@@ -364,6 +416,18 @@ cleanup:
 }
 #endif /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED */
 
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+/* Remember the group the server selected, to offer it first next time. */
+static void ssl_tls13_cache_group_id(mbedtls_ssl_context *ssl,
+                                     uint16_t group_id)
+{
+    if (ssl->conf->group_cache != NULL && ssl->hostname != NULL) {
+        (void) mbedtls_ssl_group_cache_set(ssl->conf->group_cache,
+                                           ssl->hostname, group_id);
+    }
+}
+#endif /* MBEDTLS_SSL_GROUP_CACHE_C */
+
 /*
  * ssl_tls13_parse_hrr_key_share_ext()
  *      Parse key_share extension in Hello Retry Request
@@ -439,6 +503,9 @@ static int ssl_tls13_parse_hrr_key_share_ext(mbedtls_ssl_context *ssl,
 
     /* Remember server's preference for next ClientHello */
     ssl->handshake->offered_group_id = selected_group;
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+    ssl_tls13_cache_group_id(ssl, (uint16_t) selected_group);
+#endif
 
     return 0;
 #else /* PSA_WANT_ALG_ECDH || PSA_WANT_ALG_FFDH */
@@ -506,6 +573,10 @@ static int ssl_tls13_parse_key_share_ext(mbedtls_ssl_context *ssl,
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+#if defined(MBEDTLS_SSL_GROUP_CACHE_C)
+    ssl_tls13_cache_group_id(ssl, group);
+#endif
+
     return ret;
 }
 
@@ -542,9 +613,9 @@ static int ssl_tls13_parse_cookie_ext(mbedtls_ssl_context *ssl,
     MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, cookie_len);
     MBEDTLS_SSL_DEBUG_BUF(3, "cookie extension", p, cookie_len);
 
-    mbedtls_free(handshake->cookie);
+    mbedtls_ssl_hs_arena_free(handshake, handshake->cookie);
     handshake->cookie_len = 0;
-    handshake->cookie = mbedtls_calloc(1, cookie_len);
+    handshake->cookie = mbedtls_ssl_hs_arena_calloc(handshake, 1, cookie_len);
     if (handshake->cookie == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1,
                               ("alloc failed ( %ud bytes )",
@@ -596,6 +667,181 @@ static int ssl_tls13_write_cookie_ext(mbedtls_ssl_context *ssl,
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/*
+ * ssl_tls13_write_compress_certificate_ext() structure (RFC 8879):
+ *
+ * enum { zlib(1), brotli(2), zstd(3), (65535) } CertificateCompressionAlgorithm;
+ *
+ * struct {
+ *     CertificateCompressionAlgorithm algorithms<2..2^8-2>;
+ * } CertificateCompressionAlgorithms;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_compress_certificate_ext(mbedtls_ssl_context *ssl,
+                                                    unsigned char *buf,
+                                                    unsigned char *end,
+                                                    size_t *out_len)
+{
+    unsigned char *p = buf;
+    const uint16_t *alg;
+    size_t algs_len = 0;
+
+    *out_len = 0;
+
+    if (ssl->conf->cert_compression_algs == NULL ||
+        ssl->conf->f_cert_decompress == NULL) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_CHK_BUF_PTR(p, end, 5);
+    p += 5;
+
+    for (alg = ssl->conf->cert_compression_algs;
+         *alg != MBEDTLS_SSL_CERT_COMPRESSION_NONE; alg++) {
+        if (*alg >= 16) {
+            continue;
+        }
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 2);
+        MBEDTLS_PUT_UINT16_BE(*alg, p, 0);
+        p += 2;
+        algs_len += 2;
+    }
+
+    if (algs_len == 0) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding compress_certificate extension"));
+
+    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE, buf, 0);
+    MBEDTLS_PUT_UINT16_BE(algs_len + 1, buf, 2);
+    buf[4] = (unsigned char) algs_len;
+
+    *out_len = p - buf;
+
+    mbedtls_ssl_tls13_set_hs_sent_ext_mask(
+        ssl, MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE);
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/*
+ * ssl_tls13_write_cert_type_exts() structure (RFC 7250 section 3):
+ *
+ * struct {
+ *     CertificateType client_certificate_types<1..2^8-1>;
+ * } ClientCertTypeExtension;
+ *
+ * struct {
+ *     CertificateType server_certificate_types<1..2^8-1>;
+ * } ServerCertTypeExtension;
+ *
+ * The types are in order of preference: raw public keys first.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_cert_type_exts(mbedtls_ssl_context *ssl,
+                                          unsigned char *buf,
+                                          unsigned char *end,
+                                          size_t *out_len)
+{
+    unsigned char *p = buf;
+    size_t types_len;
+
+    *out_len = 0;
+
+    if (ssl->conf->f_rpk_vrfy != NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding server_certificate_type extension"));
+
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 7);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_SERV_CERT_TYPE, p, 0);
+        MBEDTLS_PUT_UINT16_BE(3, p, 2);
+        p[4] = 2;
+        p[5] = MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY;
+        p[6] = MBEDTLS_TLS_CERT_TYPE_X509;
+        p += 7;
+
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(
+            ssl, MBEDTLS_TLS_EXT_SERV_CERT_TYPE);
+    }
+
+    if (ssl->conf->rpk_key != NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding client_certificate_type extension"));
+
+        /* Offer our certificate chain too, if we have one. */
+        types_len = mbedtls_ssl_key_cert_list(ssl) != NULL ? 2 : 1;
+
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 5 + types_len);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_CLI_CERT_TYPE, p, 0);
+        MBEDTLS_PUT_UINT16_BE(1 + types_len, p, 2);
+        p[4] = (unsigned char) types_len;
+        p[5] = MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY;
+        if (types_len == 2) {
+            p[6] = MBEDTLS_TLS_CERT_TYPE_X509;
+        }
+        p += 5 + types_len;
+
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(
+            ssl, MBEDTLS_TLS_EXT_CLI_CERT_TYPE);
+    }
+
+    *out_len = p - buf;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+/*
+ * ssl_tls13_write_status_request_ext() structure (RFC 6066 section 8):
+ *
+ * struct {
+ *     CertificateStatusType status_type;
+ *     select (status_type) {
+ *         case ocsp: OCSPStatusRequest;
+ *     } request;
+ * } CertificateStatusRequest;
+ *
+ * struct {
+ *     ResponderID responder_id_list<0..2^16-1>;
+ *     Extensions  request_extensions;
+ * } OCSPStatusRequest;
+ *
+ * Both lists are empty: the server knows its responder.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_status_request_ext(mbedtls_ssl_context *ssl,
+                                              unsigned char *buf,
+                                              unsigned char *end,
+                                              size_t *out_len)
+{
+    unsigned char *p = buf;
+
+    *out_len = 0;
+
+    if (!ssl->conf->ocsp_stapling) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("client hello, adding status_request extension"));
+
+    MBEDTLS_SSL_CHK_BUF_PTR(p, end, 9);
+    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_STATUS_REQUEST, p, 0);
+    MBEDTLS_PUT_UINT16_BE(5, p, 2);
+    p[4] = MBEDTLS_SSL_CERT_STATUS_TYPE_OCSP;
+    MBEDTLS_PUT_UINT16_BE(0, p, 5);
+    MBEDTLS_PUT_UINT16_BE(0, p, 7);
+
+    mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_STATUS_REQUEST);
+
+    *out_len = 9;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
+
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
 /*
  * ssl_tls13_write_psk_key_exchange_modes_ext() structure:
@@ -1169,6 +1415,39 @@ int mbedtls_ssl_tls13_write_client_hello_exts(mbedtls_ssl_context *ssl,
     p += ext_len;
 #endif
 
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_tls13_write_quic_transport_params_ext(
+        ssl, p, end, &ext_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += ext_len;
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    ret = ssl_tls13_write_compress_certificate_ext(ssl, p, end, &ext_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += ext_len;
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    ret = ssl_tls13_write_cert_type_exts(ssl, p, end, &ext_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += ext_len;
+#endif
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    ret = ssl_tls13_write_status_request_ext(ssl, p, end, &ext_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += ext_len;
+#endif
+
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_EPHEMERAL_ENABLED)
     if (mbedtls_ssl_conf_tls13_is_some_ephemeral_enabled(ssl)) {
         ret = ssl_tls13_write_key_share_ext(ssl, p, end, &ext_len);
@@ -2054,6 +2333,54 @@ cleanup:
  * the cryptographic context.
  */
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/*
+ * The server_certificate_type or client_certificate_type extension of
+ * EncryptedExtensions (RFC 7250 section 3):
+ *
+ * struct {
+ *     CertificateType certificate_type;
+ * } CertTypeExtension;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_cert_type_ext(mbedtls_ssl_context *ssl,
+                                         unsigned int extension_type,
+                                         const unsigned char *buf,
+                                         const unsigned char *end)
+{
+    uint8_t type;
+
+    if (end - buf != 1) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    type = buf[0];
+
+    /* The server must choose one of the types we offered: both for its
+     * own certificate, and ours for the client certificate. */
+    if ((type != MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY &&
+         type != MBEDTLS_TLS_CERT_TYPE_X509) ||
+        (extension_type == MBEDTLS_TLS_EXT_CLI_CERT_TYPE &&
+         type == MBEDTLS_TLS_CERT_TYPE_X509 &&
+         mbedtls_ssl_key_cert_list(ssl) == NULL)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("unexpected certificate type %u",
+                                  (unsigned) type));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    if (extension_type == MBEDTLS_TLS_EXT_SERV_CERT_TYPE) {
+        ssl->handshake->peer_cert_type = type;
+    } else {
+        ssl->handshake->own_cert_type = type;
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
 /* Parse EncryptedExtensions message
  * struct {
  *     Extension extensions<0..2^16-1>;
@@ -2145,6 +2472,43 @@ static int ssl_tls13_parse_encrypted_extensions(mbedtls_ssl_context *ssl,
                 break;
 #endif /* MBEDTLS_SSL_RECORD_SIZE_LIMIT */
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+            case MBEDTLS_TLS_EXT_SERV_CERT_TYPE:
+            case MBEDTLS_TLS_EXT_CLI_CERT_TYPE:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found certificate type extension"));
+
+                ret = ssl_tls13_parse_cert_type_ext(
+                    ssl, extension_type, p, p + extension_data_len);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+            case MBEDTLS_TLS_EXT_CACHED_INFO:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found cached_info extension"));
+
+                ret = mbedtls_ssl_parse_cached_info_ext(
+                    ssl, p, p + extension_data_len);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
+#if defined(MBEDTLS_SSL_QUIC)
+            case MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found quic_transport_parameters extension"));
+
+                ret = mbedtls_ssl_tls13_parse_quic_transport_params_ext(
+                    ssl, p, p + extension_data_len);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_QUIC */
+
             default:
                 MBEDTLS_SSL_PRINT_EXT(
                     3, MBEDTLS_SSL_HS_ENCRYPTED_EXTENSIONS,
@@ -2169,6 +2533,13 @@ static int ssl_tls13_parse_encrypted_extensions(mbedtls_ssl_context *ssl,
     MBEDTLS_SSL_PRINT_EXTS(3, MBEDTLS_SSL_HS_ENCRYPTED_EXTENSIONS,
                            handshake->received_extensions);
 
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_tls13_check_quic_transport_params_ext(ssl);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+
     /* Check that we consumed all the message. */
     if (p != end) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("EncryptedExtension lengths misaligned"));
@@ -2414,7 +2785,7 @@ static int ssl_tls13_parse_certificate_request(mbedtls_ssl_context *ssl,
                               p, certificate_request_context_len);
 
         handshake->certificate_request_context =
-            mbedtls_calloc(1, certificate_request_context_len);
+            mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, certificate_request_context_len);
         if (handshake->certificate_request_context == NULL) {
             MBEDTLS_SSL_DEBUG_MSG(1, ("buffer too small"));
             return MBEDTLS_ERR_SSL_ALLOC_FAILED;
@@ -2641,6 +3012,12 @@ static int ssl_tls13_write_client_certificate(mbedtls_ssl_context *ssl)
             return ret;
         }
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+        if (ssl->handshake->own_cert_type ==
+            MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+            non_empty_certificate_msg = ssl->conf->rpk_key != NULL;
+        } else
+#endif
         if (mbedtls_ssl_own_cert(ssl) != NULL) {
             non_empty_certificate_msg = 1;
         }
@@ -2889,7 +3266,7 @@ static int ssl_tls13_parse_new_session_ticket(mbedtls_ssl_context *ssl,
         session->ticket_len = 0;
     }
 
-    if ((ticket = mbedtls_calloc(1, ticket_len)) == NULL) {
+    if ((ticket = mbedtls_calloc_tagged(SSL_SESSION, 1, ticket_len)) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("ticket alloc failed"));
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
@@ -3040,6 +3417,9 @@ static int ssl_tls13_process_new_session_ticket(mbedtls_ssl_context *ssl)
              * be exported now and we signal the ticket to the application.
              */
             ssl->session->exported = 0;
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+            mbedtls_ssl_session_store_add(ssl);
+#endif
             ret = MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET;
             break;
 
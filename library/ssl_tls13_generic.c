@@ -226,6 +226,7 @@ static int ssl_tls13_parse_certificate_verify(mbedtls_ssl_context *ssl,
     psa_algorithm_t hash_alg = PSA_ALG_NONE;
     unsigned char verify_hash[PSA_HASH_MAX_SIZE];
     size_t verify_hash_len;
+    mbedtls_pk_context *peer_key = mbedtls_ssl_tls13_peer_key(ssl);
 
     void const *options = NULL;
 #if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
@@ -282,7 +283,7 @@ static int ssl_tls13_parse_certificate_verify(mbedtls_ssl_context *ssl,
     /*
      * Check the certificate's key type matches the signature alg
      */
-    if (!mbedtls_pk_can_do(&ssl->session_negotiate->peer_cert->pk, sig_alg)) {
+    if (peer_key == NULL || !mbedtls_pk_can_do(peer_key, sig_alg)) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("signature algorithm doesn't match cert key"));
         goto error;
     }
@@ -313,10 +314,24 @@ static int ssl_tls13_parse_certificate_verify(mbedtls_ssl_context *ssl,
     }
 #endif /* MBEDTLS_X509_RSASSA_PSS_SUPPORT */
 
-    if ((ret = mbedtls_pk_verify_ext(sig_alg, options,
-                                     &ssl->session_negotiate->peer_cert->pk,
-                                     md_alg, verify_hash, verify_hash_len,
-                                     p, signature_len)) == 0) {
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if (sig_alg == MBEDTLS_PK_ECDSA) {
+        ssl->handshake->ecrs_state = ssl_ecrs_crt_vrfy_verify;
+        ret = mbedtls_pk_verify_restartable(peer_key,
+                                            md_alg, verify_hash, verify_hash_len,
+                                            p, signature_len,
+                                            &ssl->handshake->ecrs_ctx.pk);
+        if (ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
+            MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_verify_restartable", ret);
+            return MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS;
+        }
+        ssl->handshake->ecrs_state = ssl_ecrs_none;
+    } else
+#endif
+    ret = mbedtls_pk_verify_ext(sig_alg, options, peer_key,
+                                md_alg, verify_hash, verify_hash_len,
+                                p, signature_len);
+    if (ret == 0) {
         return 0;
     }
     MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_verify_ext", ret);
@@ -348,6 +363,14 @@ int mbedtls_ssl_tls13_process_certificate_verify(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> parse certificate verify"));
 
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    /* Resume the verification of the signature of the message, which is
+     * still in the input buffer and not in the transcript yet. */
+    if (ssl->handshake->ecrs_state == ssl_ecrs_crt_vrfy_verify) {
+        buf = ssl->in_msg + 4;
+        buf_len = ssl->in_hslen - 4;
+    } else
+#endif
     MBEDTLS_SSL_PROC_CHK(
         mbedtls_ssl_tls13_fetch_handshake_msg(
             ssl, MBEDTLS_SSL_HS_CERTIFICATE_VERIFY, &buf, &buf_len));
@@ -435,6 +458,134 @@ cleanup:
  *
  */
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/*
+ * Parse a Certificate message that carries a raw public key (RFC 7250
+ * section 3): a single CertificateEntry with the SubjectPublicKeyInfo of
+ * the key, or none if the client has no key.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_raw_public_key(mbedtls_ssl_context *ssl,
+                                          const unsigned char *buf,
+                                          const unsigned char *end)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *p = buf;
+    size_t certificate_list_len, spki_len, extensions_len;
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 4);
+    certificate_list_len = MBEDTLS_GET_UINT24_BE(p, 1);
+    if (p[0] != 0 || certificate_list_len != (size_t) (end - p - 4)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    p += 4;
+
+    mbedtls_pk_free(&handshake->peer_rpk);
+    mbedtls_pk_init(&handshake->peer_rpk);
+    mbedtls_free(handshake->peer_rpk_spki);
+    handshake->peer_rpk_spki = NULL;
+    handshake->peer_rpk_spki_len = 0;
+
+    /* This is used by ssl_tls13_validate_certificate() */
+    if (certificate_list_len == 0) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 3);
+    spki_len = MBEDTLS_GET_UINT24_BE(p, 0);
+    p += 3;
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, spki_len);
+
+    ret = mbedtls_pk_parse_public_key(&handshake->peer_rpk, p, spki_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_parse_public_key", ret);
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_BAD_CERT,
+                                     MBEDTLS_ERR_SSL_BAD_CERTIFICATE);
+        return MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
+    }
+
+    handshake->peer_rpk_spki = mbedtls_calloc(1, spki_len);
+    if (handshake->peer_rpk_spki == NULL) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
+                                     MBEDTLS_ERR_SSL_ALLOC_FAILED);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    memcpy(handshake->peer_rpk_spki, p, spki_len);
+    handshake->peer_rpk_spki_len = spki_len;
+    p += spki_len;
+
+    /* The key comes alone, and we know no extension of its entry. */
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 2);
+    extensions_len = MBEDTLS_GET_UINT16_BE(p, 0);
+    p += 2;
+    if (extensions_len != (size_t) (end - p)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+    MBEDTLS_SSL_DEBUG_BUF(3, "peer raw public key",
+                          handshake->peer_rpk_spki, spki_len);
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+/*
+ * Parse the status_request extension of the end-entity CertificateEntry
+ * (RFC 8446 section 4.4.2.1) and attach the OCSP response to the
+ * certificate, which checks it while verifying the chain.
+ *
+ * struct {
+ *     CertificateStatusType status_type;
+ *     select (status_type) {
+ *         case ocsp: OCSPResponse;
+ *     } response;
+ * } CertificateStatus;
+ *
+ * opaque OCSPResponse<1..2^24-1>;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_ocsp_staple_ext(mbedtls_ssl_context *ssl,
+                                           mbedtls_x509_crt *crt,
+                                           const unsigned char *buf,
+                                           const unsigned char *end)
+{
+    int ret;
+    const unsigned char *p = buf;
+    size_t response_len;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 4);
+    response_len = MBEDTLS_GET_UINT24_BE(p, 1);
+    if (p[0] != MBEDTLS_SSL_CERT_STATUS_TYPE_OCSP || response_len == 0 ||
+        response_len != (size_t) (end - p - 4)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad status_request extension"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+    p += 4;
+
+    MBEDTLS_SSL_DEBUG_BUF(4, "stapled OCSP response", p, response_len);
+
+    ret = mbedtls_x509_crt_set_ocsp_response(crt, p, response_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_x509_crt_set_ocsp_response", ret);
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
+                                     MBEDTLS_ERR_SSL_ALLOC_FAILED);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
+
 /* Parse certificate chain send by the server. */
 MBEDTLS_CHECK_RETURN_CRITICAL
 MBEDTLS_STATIC_TESTABLE
@@ -448,6 +599,45 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
     const unsigned char *p = buf;
     const unsigned char *certificate_list_end;
     mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    int chain_len = 0;
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    if (handshake->peer_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return ssl_tls13_parse_raw_public_key(ssl, buf, end);
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_CLI_C)
+    /* An empty certificate_request_context, then the hash of the chain we
+     * have in place of certificate_list. */
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT &&
+        handshake->cached_info_cert) {
+        MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 1);
+        if (p[0] != 0) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("bad certificate message"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                         MBEDTLS_ERR_SSL_DECODE_ERROR);
+            return MBEDTLS_ERR_SSL_DECODE_ERROR;
+        }
+
+        mbedtls_ssl_session_clear_peer_cert(ssl->session_negotiate);
+        if ((ssl->session_negotiate->peer_cert =
+                 mbedtls_calloc_tagged(SSL_PEER_CERT, 1,
+                                       sizeof(mbedtls_x509_crt))) == NULL) {
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
+                                         MBEDTLS_ERR_SSL_ALLOC_FAILED);
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        mbedtls_x509_crt_init(ssl->session_negotiate->peer_cert);
+        mbedtls_x509_crt_set_lazy_ext(ssl->session_negotiate->peer_cert,
+                                      ssl->conf->peer_cert_lazy_ext);
+
+        return mbedtls_ssl_parse_cached_certificate(
+            ssl, p + 1, end, ssl->session_negotiate->peer_cert);
+    }
+#endif
 
     MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 4);
     certificate_request_context_len = p[0];
@@ -466,10 +656,7 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
     }
 
     /* In case we tried to reuse a session but it failed */
-    if (ssl->session_negotiate->peer_cert != NULL) {
-        mbedtls_x509_crt_free(ssl->session_negotiate->peer_cert);
-        mbedtls_free(ssl->session_negotiate->peer_cert);
-    }
+    mbedtls_ssl_session_clear_peer_cert(ssl->session_negotiate);
 
     /* This is used by ssl_tls13_validate_certificate() */
     if (certificate_list_len == 0) {
@@ -479,7 +666,7 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
     }
 
     if ((ssl->session_negotiate->peer_cert =
-             mbedtls_calloc(1, sizeof(mbedtls_x509_crt))) == NULL) {
+             mbedtls_calloc_tagged(SSL_PEER_CERT, 1, sizeof(mbedtls_x509_crt))) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("alloc( %" MBEDTLS_PRINTF_SIZET " bytes ) failed",
                                   sizeof(mbedtls_x509_crt)));
         MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
@@ -488,12 +675,19 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
     }
 
     mbedtls_x509_crt_init(ssl->session_negotiate->peer_cert);
+    mbedtls_x509_crt_set_lazy_ext(ssl->session_negotiate->peer_cert,
+                                  ssl->conf->peer_cert_lazy_ext);
 
     MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, certificate_list_len);
     certificate_list_end = p + certificate_list_len;
     while (p < certificate_list_end) {
         size_t cert_data_len, extensions_len;
         const unsigned char *extensions_end;
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+        /* Only the end-entity entry has a status, RFC 8446 section 4.4.2.1 */
+        int leaf_entry = (p == certificate_list_end - certificate_list_len);
+        int leaf_parsed;
+#endif
 
         MBEDTLS_SSL_CHK_BUF_READ_PTR(p, certificate_list_end, 3);
         cert_data_len = MBEDTLS_GET_UINT24_BE(p, 0);
@@ -511,10 +705,26 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
             return MBEDTLS_ERR_SSL_DECODE_ERROR;
         }
 
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+        /* Keep the parsed chain within MBEDTLS_SSL_PEER_CHAIN_MEMORY. */
+        if (++chain_len > MBEDTLS_X509_MAX_INTERMEDIATE_CA + 1 ||
+            cert_data_len > MBEDTLS_SSL_MAX_PEER_CERT_LEN) {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("peer certificate chain over the "
+                                      "memory budget"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_CERT,
+                                         MBEDTLS_ERR_SSL_BAD_CERTIFICATE);
+            return MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
+        }
+#endif /* MBEDTLS_SSL_STATIC_MEMORY */
+
         MBEDTLS_SSL_CHK_BUF_READ_PTR(p, certificate_list_end, cert_data_len);
         ret = mbedtls_x509_crt_parse_der(ssl->session_negotiate->peer_cert,
                                          p, cert_data_len);
 
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+        leaf_parsed = leaf_entry && ret == 0;
+#endif
+
         switch (ret) {
             case 0: /*ok*/
                 break;
@@ -578,6 +788,23 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
             }
 
             switch (extension_type) {
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+                case MBEDTLS_TLS_EXT_STATUS_REQUEST:
+                    if (!leaf_parsed) {
+                        MBEDTLS_SSL_PRINT_EXT(
+                            3, MBEDTLS_SSL_HS_CERTIFICATE,
+                            extension_type, "( ignored )");
+                        break;
+                    }
+                    ret = ssl_tls13_parse_ocsp_staple_ext(
+                        ssl, ssl->session_negotiate->peer_cert,
+                        p, p + extension_data_len);
+                    if (ret != 0) {
+                        return ret;
+                    }
+                    break;
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
+
                 default:
                     MBEDTLS_SSL_PRINT_EXT(
                         3, MBEDTLS_SSL_HS_CERTIFICATE,
@@ -623,17 +850,53 @@ int mbedtls_ssl_tls13_parse_certificate(mbedtls_ssl_context *ssl,
 
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
 #if defined(MBEDTLS_SSL_KEEP_PEER_CERTIFICATE)
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/* Check that the raw public key of the peer is trusted, as the checks of
+ * mbedtls_ssl_verify_certificate() would for a chain. */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_verify_raw_public_key(mbedtls_ssl_context *ssl,
+                                           int authmode)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+
+    if (authmode == MBEDTLS_SSL_VERIFY_NONE) {
+        return 0;
+    }
+
+    ssl->session_negotiate->verify_result = 0;
+    if (ssl->conf->f_rpk_vrfy == NULL ||
+        ssl->conf->f_rpk_vrfy(ssl->conf->p_rpk_vrfy, ssl,
+                              &handshake->peer_rpk,
+                              handshake->peer_rpk_spki,
+                              handshake->peer_rpk_spki_len) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("raw public key not trusted"));
+        ssl->session_negotiate->verify_result = MBEDTLS_X509_BADCERT_NOT_TRUSTED;
+
+        if (authmode == MBEDTLS_SSL_VERIFY_REQUIRED) {
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_BAD_CERT,
+                                         MBEDTLS_ERR_SSL_BAD_CERTIFICATE);
+            return MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
+        }
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
 /* Validate certificate chain sent by the server. */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_validate_certificate(mbedtls_ssl_context *ssl)
 {
+    int ret;
+    void *rs_ctx = NULL;
+
     /* Authmode: precedence order is SNI if used else configuration */
 #if defined(MBEDTLS_SSL_SRV_C) && defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
     const int authmode = ssl->handshake->sni_authmode != MBEDTLS_SSL_VERIFY_UNSET
                        ? ssl->handshake->sni_authmode
-                       : ssl->conf->authmode;
+                       : mbedtls_ssl_get_conf_authmode(ssl);
 #else
-    const int authmode = ssl->conf->authmode;
+    const int authmode = mbedtls_ssl_get_conf_authmode(ssl);
 #endif
 
     /*
@@ -643,7 +906,7 @@ static int ssl_tls13_validate_certificate(mbedtls_ssl_context *ssl)
      * Check for that and handle it depending on the
      * authentication mode.
      */
-    if (ssl->session_negotiate->peer_cert == NULL) {
+    if (mbedtls_ssl_tls13_peer_key(ssl) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("peer has no certificate"));
 
 #if defined(MBEDTLS_SSL_SRV_C)
@@ -678,9 +941,29 @@ static int ssl_tls13_validate_certificate(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_CLI_C */
     }
 
-    return mbedtls_ssl_verify_certificate(ssl, authmode,
-                                          ssl->session_negotiate->peer_cert,
-                                          NULL, NULL);
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    if (ssl->handshake->peer_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return ssl_tls13_verify_raw_public_key(ssl, authmode);
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    /* TLS 1.3 handshakes can always be restarted. */
+    ssl->handshake->ecrs_state = ssl_ecrs_crt_verify;
+    rs_ctx = &ssl->handshake->ecrs_ctx;
+#endif
+
+    ret = mbedtls_ssl_verify_certificate(ssl, authmode,
+                                         ssl->session_negotiate->peer_cert,
+                                         NULL, rs_ctx);
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    if (ret != MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS) {
+        ssl->handshake->ecrs_state = ssl_ecrs_none;
+    }
+#endif
+
+    return ret;
 }
 #else /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -692,6 +975,130 @@ static int ssl_tls13_validate_certificate(mbedtls_ssl_context *ssl)
 #endif /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE */
 #endif /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED */
 
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED) && \
+    defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/*
+ * Fetch a Certificate message, or a CompressedCertificate message if we
+ * offered certificate compression.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_fetch_certificate_msg(mbedtls_ssl_context *ssl,
+                                           unsigned char **buf,
+                                           size_t *buf_len)
+{
+    int ret;
+
+    if ((ssl->handshake->sent_extensions &
+         MBEDTLS_SSL_EXT_MASK(COMPRESS_CERTIFICATE)) == 0) {
+        return mbedtls_ssl_tls13_fetch_handshake_msg(
+            ssl, MBEDTLS_SSL_HS_CERTIFICATE, buf, buf_len);
+    }
+
+    if ((ret = mbedtls_ssl_read_record(ssl, 0)) != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_read_record", ret);
+        return ret;
+    }
+
+    if (ssl->in_msgtype != MBEDTLS_SSL_MSG_HANDSHAKE ||
+        (ssl->in_msg[0] != MBEDTLS_SSL_HS_CERTIFICATE &&
+         ssl->in_msg[0] != MBEDTLS_SSL_HS_COMPRESSED_CERTIFICATE)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("Receive unexpected handshake message."));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNEXPECTED_MESSAGE,
+                                     MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE);
+        return MBEDTLS_ERR_SSL_UNEXPECTED_MESSAGE;
+    }
+
+    *buf = ssl->in_msg + 4;
+    *buf_len = ssl->in_hslen - 4;
+
+    return 0;
+}
+
+/*
+ * Structure of CompressedCertificate message (RFC 8879 section 4):
+ *
+ * struct {
+ *      CertificateCompressionAlgorithm algorithm;
+ *      uint24 uncompressed_length;
+ *      opaque compressed_certificate_message<1..2^24-1>;
+ * } CompressedCertificate;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_compressed_certificate(mbedtls_ssl_context *ssl,
+                                                  const unsigned char *buf,
+                                                  const unsigned char *end)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *p = buf;
+    const uint16_t *offered;
+    uint16_t alg;
+    size_t uncompressed_len, compressed_len;
+    unsigned char *msg;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 8);
+    alg = MBEDTLS_GET_UINT16_BE(p, 0);
+    uncompressed_len = MBEDTLS_GET_UINT24_BE(p, 2);
+    compressed_len = MBEDTLS_GET_UINT24_BE(p, 5);
+    p += 8;
+
+    if (compressed_len == 0 || compressed_len != (size_t) (end - p)) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad CompressedCertificate message"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+    /* The algorithm must be one that we offered. */
+    for (offered = ssl->conf->cert_compression_algs;
+         *offered != MBEDTLS_SSL_CERT_COMPRESSION_NONE; offered++) {
+        if (*offered == alg && alg < 16) {
+            break;
+        }
+    }
+    if (*offered == MBEDTLS_SSL_CERT_COMPRESSION_NONE) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("certificate compression algorithm %u not offered",
+                                  (unsigned) alg));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    /* Bound the memory a small message can make us allocate. */
+    if (uncompressed_len < 4 ||
+        uncompressed_len > MBEDTLS_SSL_TLS1_3_CERT_MSG_MAX_LEN) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad uncompressed certificate length"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_BAD_CERT,
+                                     MBEDTLS_ERR_SSL_BAD_CERTIFICATE);
+        return MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
+    }
+
+    msg = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, uncompressed_len);
+    if (msg == NULL) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_INTERNAL_ERROR,
+                                     MBEDTLS_ERR_SSL_ALLOC_FAILED);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    ret = ssl->conf->f_cert_decompress(ssl->conf->p_cert_compression, alg,
+                                       p, compressed_len,
+                                       msg, uncompressed_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_cert_decompress", ret);
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_BAD_CERT,
+                                     MBEDTLS_ERR_SSL_BAD_CERTIFICATE);
+        ret = MBEDTLS_ERR_SSL_BAD_CERTIFICATE;
+    } else {
+        ret = mbedtls_ssl_tls13_parse_certificate(ssl, msg,
+                                                  msg + uncompressed_len);
+    }
+
+    mbedtls_free(msg);
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED &&
+          MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
 int mbedtls_ssl_tls13_process_certificate(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -701,18 +1108,56 @@ int mbedtls_ssl_tls13_process_certificate(mbedtls_ssl_context *ssl)
     unsigned char *buf;
     size_t buf_len;
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE) && defined(MBEDTLS_X509_CRT_PARSE_C)
+    /* Resume the verification of the chain already parsed from the
+     * message, which is still in the input buffer. */
+    if (ssl->handshake->async_verify_in_progress) {
+        buf = ssl->in_msg + 4;
+        buf_len = ssl->in_hslen - 4;
+        goto validate;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+    /* Likewise, resume a restartable verification. */
+    if (ssl->handshake->ecrs_state == ssl_ecrs_crt_verify) {
+        buf = ssl->in_msg + 4;
+        buf_len = ssl->in_hslen - 4;
+        goto validate;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    MBEDTLS_SSL_PROC_CHK(ssl_tls13_fetch_certificate_msg(ssl, &buf, &buf_len));
+
+    if (ssl->in_msg[0] == MBEDTLS_SSL_HS_COMPRESSED_CERTIFICATE) {
+        MBEDTLS_SSL_PROC_CHK(ssl_tls13_parse_compressed_certificate(
+                                 ssl, buf, buf + buf_len));
+        goto validate;
+    }
+#else
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_tls13_fetch_handshake_msg(
                              ssl, MBEDTLS_SSL_HS_CERTIFICATE,
                              &buf, &buf_len));
+#endif
 
     /* Parse the certificate chain sent by the peer. */
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_tls13_parse_certificate(ssl, buf,
                                                              buf + buf_len));
+#if (defined(MBEDTLS_SSL_ASYNC_PRIVATE) && defined(MBEDTLS_X509_CRT_PARSE_C)) || \
+    defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) || \
+    defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+validate:
+#endif
     /* Validate the certificate chain and set the verification results. */
     MBEDTLS_SSL_PROC_CHK(ssl_tls13_validate_certificate(ssl));
+#if defined(MBEDTLS_SSL_PEER_CERT_TABLE_C)
+    mbedtls_ssl_session_intern_peer_cert(ssl, ssl->session_negotiate);
+#endif
 
+    /* The transcript has the message as received, compressed or not. */
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_add_hs_msg_to_checksum(
-                             ssl, MBEDTLS_SSL_HS_CERTIFICATE, buf, buf_len));
+                             ssl, ssl->in_msg[0], buf, buf_len));
 
 cleanup:
 #else /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED */
@@ -747,6 +1192,135 @@ cleanup:
  *        CertificateEntry certificate_list<0..2^24-1>;
  *    } Certificate;
  */
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && defined(MBEDTLS_SSL_SRV_C)
+/*
+ * Whether we staple the OCSP response of our chain, and ask for a new one
+ * once it is due.
+ */
+static int ssl_tls13_ocsp_staple_wanted(mbedtls_ssl_context *ssl)
+{
+    mbedtls_ssl_key_cert *own = mbedtls_ssl_own_key_cert(ssl);
+    mbedtls_ssl_key_cert *key_cert;
+    int staple, refresh = 0;
+
+    if (ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        !ssl->handshake->ocsp_requested) {
+        return 0;
+    }
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    if (ssl->handshake->own_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return 0;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    /* The chain is not sent, so neither is its status. */
+    if (ssl->handshake->cached_info_cert) {
+        return 0;
+    }
+#endif
+
+    /* Only the chains set in the configuration have a response. */
+    for (key_cert = ssl->conf->key_cert; key_cert != NULL;
+         key_cert = key_cert->next) {
+        if (key_cert == own) {
+            break;
+        }
+    }
+    if (key_cert == NULL) {
+        return 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&key_cert->ocsp_mutex) != 0) {
+        return 0;
+    }
+#endif
+
+    staple = key_cert->ocsp_resp != NULL;
+    if (staple && ssl->conf->f_ocsp_refresh != NULL &&
+        key_cert->ocsp_refresh_at != 0 && !key_cert->ocsp_refresh_asked &&
+        mbedtls_time(NULL) >= key_cert->ocsp_refresh_at) {
+        key_cert->ocsp_refresh_asked = 1;
+        refresh = 1;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&key_cert->ocsp_mutex) != 0) {
+        return 0;
+    }
+#endif
+
+    /* Outside of the lock, so that the callback can set a response. */
+    if (refresh) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("stapled OCSP response is due for refresh"));
+        ssl->conf->f_ocsp_refresh(ssl->conf->p_ocsp_refresh, key_cert->cert);
+    }
+
+    return staple;
+}
+
+/*
+ * The extensions of our end-entity CertificateEntry: status_request with
+ * the stapled CertificateStatus, see ssl_tls13_parse_ocsp_staple_ext().
+ * The response is read under the lock, as it may be replaced meanwhile.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_ocsp_staple_exts(mbedtls_ssl_context *ssl,
+                                            unsigned char *buf,
+                                            unsigned char *end,
+                                            size_t *out_len)
+{
+    int ret = 0;
+    mbedtls_ssl_key_cert *key_cert = mbedtls_ssl_own_key_cert(ssl);
+    unsigned char *p = buf;
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("server certificate, adding status_request extension"));
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&key_cert->ocsp_mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    if (key_cert->ocsp_resp == NULL) {
+        /* Removed since we checked: send no status. */
+        if (end - p < 2) {
+            ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+            goto unlock;
+        }
+        MBEDTLS_PUT_UINT16_BE(0, p, 0);
+        p += 2;
+    } else {
+        size_t resp_len = key_cert->ocsp_resp_len;
+
+        if ((size_t) (end - p) < 2 + 4 + 4 + resp_len) {
+            ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+            goto unlock;
+        }
+        MBEDTLS_PUT_UINT16_BE(4 + 4 + resp_len, p, 0);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_STATUS_REQUEST, p, 2);
+        MBEDTLS_PUT_UINT16_BE(4 + resp_len, p, 4);
+        p[6] = MBEDTLS_SSL_CERT_STATUS_TYPE_OCSP;
+        MBEDTLS_PUT_UINT24_BE(resp_len, p, 7);
+        memcpy(p + 10, key_cert->ocsp_resp, resp_len);
+        p += 10 + resp_len;
+    }
+
+    *out_len = p - buf;
+
+unlock:
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&key_cert->ocsp_mutex) != 0 && ret == 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_OCSP_STAPLING && MBEDTLS_SSL_SRV_C */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_certificate_body(mbedtls_ssl_context *ssl,
                                             unsigned char *buf,
@@ -773,6 +1347,21 @@ static int ssl_tls13_write_certificate_body(mbedtls_ssl_context *ssl,
         p += certificate_request_context_len;
     }
 
+#if defined(MBEDTLS_SSL_CACHED_INFO) && defined(MBEDTLS_SSL_SRV_C)
+    /* The client has our chain: send its hash in its place. */
+    if (ssl->conf->endpoint == MBEDTLS_SSL_IS_SERVER &&
+        ssl->handshake->cached_info_cert) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("send the hash of the cached chain"));
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 1 + MBEDTLS_SSL_CACHED_INFO_HASH_LEN);
+        *p++ = MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+        memcpy(p, ssl->handshake->cached_info_hash,
+               MBEDTLS_SSL_CACHED_INFO_HASH_LEN);
+        p += MBEDTLS_SSL_CACHED_INFO_HASH_LEN;
+        *out_len = p - buf;
+        return 0;
+    }
+#endif
+
     /* ...
      * CertificateEntry certificate_list<0..2^24-1>;
      * ...
@@ -781,8 +1370,45 @@ static int ssl_tls13_write_certificate_body(mbedtls_ssl_context *ssl,
     p_certificate_list_len = p;
     p += 3;
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    /* A single entry with our SubjectPublicKeyInfo. */
+    if (ssl->handshake->own_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        crt = NULL;
+        if (ssl->conf->rpk_spki != NULL) {
+            MBEDTLS_SSL_DEBUG_BUF(3, "own raw public key",
+                                  ssl->conf->rpk_spki, ssl->conf->rpk_spki_len);
+            MBEDTLS_SSL_CHK_BUF_PTR(p, end, ssl->conf->rpk_spki_len + 3 + 2);
+            MBEDTLS_PUT_UINT24_BE(ssl->conf->rpk_spki_len, p, 0);
+            p += 3;
+            memcpy(p, ssl->conf->rpk_spki, ssl->conf->rpk_spki_len);
+            p += ssl->conf->rpk_spki_len;
+            MBEDTLS_PUT_UINT16_BE(0, p, 0);
+            p += 2;
+        }
+    }
+#endif
+
     MBEDTLS_SSL_DEBUG_CRT(3, "own certificate", crt);
 
+#if defined(MBEDTLS_SSL_OWN_CERT_MSG_CACHE)
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && defined(MBEDTLS_SSL_SRV_C)
+    /* The cached list has no status. */
+    if (crt != NULL && !ssl->handshake->ocsp_staple) {
+#else
+    if (crt != NULL) {
+#endif
+        const mbedtls_ssl_key_cert *key_cert = mbedtls_ssl_own_key_cert(ssl);
+
+        /* Copy the list encoded when the chain was set. */
+        if (key_cert->cert_list_tls13 != NULL) {
+            MBEDTLS_SSL_CHK_BUF_PTR(p, end, key_cert->cert_list_tls13_len);
+            memcpy(p, key_cert->cert_list_tls13, key_cert->cert_list_tls13_len);
+            p += key_cert->cert_list_tls13_len;
+            crt = NULL;
+        }
+    }
+#endif
+
     while (crt != NULL) {
         size_t cert_data_len = crt->raw.len;
 
@@ -792,6 +1418,23 @@ static int ssl_tls13_write_certificate_body(mbedtls_ssl_context *ssl,
 
         memcpy(p, crt->raw.p, cert_data_len);
         p += cert_data_len;
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && defined(MBEDTLS_SSL_SRV_C)
+        /* The status of the end-entity certificate. */
+        if (ssl->handshake->ocsp_staple &&
+            crt == mbedtls_ssl_own_cert(ssl)) {
+            int ret;
+            size_t ext_len;
+
+            crt = crt->next;
+            ret = ssl_tls13_write_ocsp_staple_exts(ssl, p, end, &ext_len);
+            if (ret != 0) {
+                return ret;
+            }
+            p += ext_len;
+            continue;
+        }
+#endif
         crt = crt->next;
 
         /* Currently, we don't have any certificate extensions defined.
@@ -812,24 +1455,104 @@ static int ssl_tls13_write_certificate_body(mbedtls_ssl_context *ssl,
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && defined(MBEDTLS_SSL_SRV_C)
+/*
+ * The CompressedCertificate message body of our certificate chain, with
+ * the first algorithm we prefer that the client offered, or NULL to send
+ * it uncompressed.
+ */
+static const mbedtls_ssl_compressed_cert *ssl_tls13_get_compressed_cert(
+    mbedtls_ssl_context *ssl)
+{
+    const mbedtls_ssl_key_cert *key_cert;
+    const mbedtls_ssl_compressed_cert *compressed;
+
+    if (ssl->conf->endpoint != MBEDTLS_SSL_IS_SERVER ||
+        ssl->handshake->cert_compression_offered == 0) {
+        return NULL;
+    }
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    /* Only certificate chains are compressed. */
+    if (ssl->handshake->own_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        return NULL;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    /* The hash of a cached chain is smaller still. */
+    if (ssl->handshake->cached_info_cert) {
+        return NULL;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    /* The compressed bodies have no status. */
+    if (ssl->handshake->ocsp_staple) {
+        return NULL;
+    }
+#endif
+
+    key_cert = mbedtls_ssl_own_key_cert(ssl);
+    if (key_cert == NULL) {
+        return NULL;
+    }
+
+    for (compressed = key_cert->compressed; compressed != NULL;
+         compressed = compressed->next) {
+        if (ssl->handshake->cert_compression_offered & (1u << compressed->alg)) {
+            return compressed;
+        }
+    }
+
+    return NULL;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION && MBEDTLS_SSL_SRV_C */
+
 int mbedtls_ssl_tls13_write_certificate(mbedtls_ssl_context *ssl)
 {
     int ret;
     unsigned char *buf;
     size_t buf_len, msg_len;
+    unsigned hs_type = MBEDTLS_SSL_HS_CERTIFICATE;
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && defined(MBEDTLS_SSL_SRV_C)
+    const mbedtls_ssl_compressed_cert *compressed;
+#endif
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING) && defined(MBEDTLS_SSL_SRV_C)
+    ssl->handshake->ocsp_staple = (uint8_t) ssl_tls13_ocsp_staple_wanted(ssl);
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && defined(MBEDTLS_SSL_SRV_C)
+    compressed = ssl_tls13_get_compressed_cert(ssl);
+    if (compressed != NULL) {
+        hs_type = MBEDTLS_SSL_HS_COMPRESSED_CERTIFICATE;
+    }
+#endif
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write certificate"));
 
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_start_handshake_msg(
-                             ssl, MBEDTLS_SSL_HS_CERTIFICATE, &buf, &buf_len));
-
-    MBEDTLS_SSL_PROC_CHK(ssl_tls13_write_certificate_body(ssl,
-                                                          buf,
-                                                          buf + buf_len,
-                                                          &msg_len));
+                             ssl, hs_type, &buf, &buf_len));
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION) && defined(MBEDTLS_SSL_SRV_C)
+    if (compressed != NULL) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("compress certificate with algorithm %u",
+                                  (unsigned) compressed->alg));
+        MBEDTLS_SSL_CHK_BUF_PTR(buf, buf + buf_len, compressed->body_len);
+        memcpy(buf, compressed->body, compressed->body_len);
+        msg_len = compressed->body_len;
+    } else
+#endif
+    {
+        MBEDTLS_SSL_PROC_CHK(ssl_tls13_write_certificate_body(ssl,
+                                                              buf,
+                                                              buf + buf_len,
+                                                              &msg_len));
+    }
 
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_add_hs_msg_to_checksum(
-                             ssl, MBEDTLS_SSL_HS_CERTIFICATE, buf, msg_len));
+                             ssl, hs_type, buf, msg_len));
 
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_finish_handshake_msg(
                              ssl, buf_len, msg_len));
@@ -886,6 +1609,38 @@ int mbedtls_ssl_tls13_check_sig_alg_cert_key_match(uint16_t sig_alg,
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+/*
+ * Complete the signature started with f_async_sign_start. The algorithm
+ * identifier was written before starting it, and the message buffer is
+ * left alone while the operation is in progress.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_resume_certificate_verify(mbedtls_ssl_context *ssl,
+                                               unsigned char *buf,
+                                               unsigned char *end,
+                                               size_t *out_len)
+{
+    size_t signature_len = 0;
+    int ret = ssl->conf->f_async_resume(ssl, buf + 4, &signature_len,
+                                        (size_t) (end - (buf + 4)));
+
+    if (ret != MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS) {
+        ssl->handshake->async_in_progress = 0;
+        mbedtls_ssl_set_async_operation_data(ssl, NULL);
+    }
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(2, "f_async_resume", ret);
+        return ret;
+    }
+
+    MBEDTLS_PUT_UINT16_BE(signature_len, buf, 2);
+    *out_len = 4 + signature_len;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_certificate_verify_body(mbedtls_ssl_context *ssl,
                                                    unsigned char *buf,
@@ -906,6 +1661,13 @@ static int ssl_tls13_write_certificate_verify_body(mbedtls_ssl_context *ssl,
 
     *out_len = 0;
 
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+    if (ssl->handshake->async_in_progress != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("resuming signature operation"));
+        return ssl_tls13_resume_certificate_verify(ssl, buf, end, out_len);
+    }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
     own_key = mbedtls_ssl_own_key(ssl);
     if (own_key == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
@@ -976,10 +1738,60 @@ static int ssl_tls13_write_certificate_verify_body(mbedtls_ssl_context *ssl,
 
         MBEDTLS_SSL_DEBUG_BUF(3, "verify hash", verify_hash, verify_hash_len);
 
-        if ((ret = mbedtls_pk_sign_ext(pk_type, own_key,
-                                       md_alg, verify_hash, verify_hash_len,
-                                       p + 4, (size_t) (end - (p + 4)), &signature_len,
-                                       ssl->conf->f_rng, ssl->conf->p_rng)) != 0) {
+#if defined(MBEDTLS_SSL_ASYNC_PRIVATE)
+        /* The callback identifies the key by its certificate. */
+        if (ssl->conf->f_async_sign_start != NULL
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+            && ssl->handshake->own_cert_type != MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY
+#endif
+            ) {
+            ret = ssl->conf->f_async_sign_start(ssl,
+                                                mbedtls_ssl_own_cert(ssl),
+                                                md_alg, verify_hash,
+                                                verify_hash_len);
+            switch (ret) {
+                case MBEDTLS_ERR_SSL_HW_ACCEL_FALLTHROUGH:
+                    /* act as if f_async_sign was null */
+                    break;
+                case 0:
+                    MBEDTLS_PUT_UINT16_BE(*sig_alg, p, 0);
+                    ssl->handshake->async_in_progress = 1;
+                    return ssl_tls13_resume_certificate_verify(ssl, buf, end,
+                                                               out_len);
+                case MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS:
+                    MBEDTLS_PUT_UINT16_BE(*sig_alg, p, 0);
+                    ssl->handshake->async_in_progress = 1;
+                    return MBEDTLS_ERR_SSL_ASYNC_IN_PROGRESS;
+                default:
+                    MBEDTLS_SSL_DEBUG_RET(1, "f_async_sign_start", ret);
+                    return ret;
+            }
+        }
+#endif /* MBEDTLS_SSL_ASYNC_PRIVATE */
+
+#if defined(MBEDTLS_SSL_TLS1_3_ECP_RESTARTABLE_ENABLED)
+        /* A restarted call gets here again with the same transcript, so
+         * the same algorithm, and carries on with the signature. */
+        if (pk_type == MBEDTLS_PK_ECDSA) {
+            ssl->handshake->ecrs_state = ssl_ecrs_crt_vrfy_sign;
+            ret = mbedtls_pk_sign_restartable(own_key,
+                                              md_alg, verify_hash, verify_hash_len,
+                                              p + 4, (size_t) (end - (p + 4)),
+                                              &signature_len,
+                                              ssl->f_rng, ssl->p_rng,
+                                              &ssl->handshake->ecrs_ctx.pk);
+            if (ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
+                MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_pk_sign_restartable", ret);
+                return MBEDTLS_ERR_SSL_CRYPTO_IN_PROGRESS;
+            }
+            ssl->handshake->ecrs_state = ssl_ecrs_none;
+        } else
+#endif
+        ret = mbedtls_pk_sign_ext(pk_type, own_key,
+                                  md_alg, verify_hash, verify_hash_len,
+                                  p + 4, (size_t) (end - (p + 4)), &signature_len,
+                                  ssl->f_rng, ssl->p_rng);
+        if (ret != 0) {
             MBEDTLS_SSL_DEBUG_MSG(2, ("CertificateVerify signature failed with %s",
                                       mbedtls_ssl_sig_alg_to_str(*sig_alg)));
             MBEDTLS_SSL_DEBUG_RET(2, "mbedtls_pk_sign_ext", ret);
@@ -1239,6 +2051,17 @@ void mbedtls_ssl_tls13_handshake_wrapup(mbedtls_ssl_context *ssl)
     ssl->session = ssl->session_negotiate;
     ssl->session_negotiate = NULL;
 
+#if defined(MBEDTLS_SSL_CREDS_C)
+    /* The handshake structure outlives the handshake in TLS 1.3, but the
+     * credentials are not needed anymore: let a replaced set go. */
+    mbedtls_ssl_creds_release(ssl->handshake->creds);
+    ssl->handshake->creds = NULL;
+#endif
+
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats_handshake_over(ssl);
+#endif
+
     MBEDTLS_SSL_DEBUG_MSG(3, ("<= handshake wrapup"));
 }
 
@@ -1278,7 +2101,7 @@ int mbedtls_ssl_tls13_write_change_cipher_spec(mbedtls_ssl_context *ssl)
     /* Write CCS message */
     MBEDTLS_SSL_PROC_CHK(ssl_tls13_write_change_cipher_spec_body(
                              ssl, ssl->out_msg,
-                             ssl->out_msg + MBEDTLS_SSL_OUT_CONTENT_LEN,
+                             ssl->out_msg + mbedtls_ssl_out_content_len(ssl),
                              &ssl->out_msglen));
 
     ssl->out_msgtype = MBEDTLS_SSL_MSG_CHANGE_CIPHER_SPEC;
@@ -1482,47 +2305,6 @@ int mbedtls_ssl_tls13_read_public_xxdhe_share(mbedtls_ssl_context *ssl,
     return 0;
 }
 
-#if defined(PSA_WANT_ALG_FFDH)
-static psa_status_t  mbedtls_ssl_get_psa_ffdh_info_from_tls_id(
-    uint16_t tls_id, size_t *bits, psa_key_type_t *key_type)
-{
-    switch (tls_id) {
-#if defined(PSA_WANT_DH_RFC7919_2048)
-        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE2048:
-            *bits = 2048;
-            *key_type = PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
-            return PSA_SUCCESS;
-#endif /* PSA_WANT_DH_RFC7919_2048 */
-#if defined(PSA_WANT_DH_RFC7919_3072)
-        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE3072:
-            *bits = 3072;
-            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
-            return PSA_SUCCESS;
-#endif /* PSA_WANT_DH_RFC7919_3072 */
-#if defined(PSA_WANT_DH_RFC7919_4096)
-        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE4096:
-            *bits = 4096;
-            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
-            return PSA_SUCCESS;
-#endif /* PSA_WANT_DH_RFC7919_4096 */
-#if defined(PSA_WANT_DH_RFC7919_6144)
-        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE6144:
-            *bits = 6144;
-            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
-            return PSA_SUCCESS;
-#endif /* PSA_WANT_DH_RFC7919_6144 */
-#if defined(PSA_WANT_DH_RFC7919_8192)
-        case MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE8192:
-            *bits = 8192;
-            *key_type =  PSA_KEY_TYPE_DH_KEY_PAIR(PSA_DH_FAMILY_RFC7919);
-            return PSA_SUCCESS;
-#endif /* PSA_WANT_DH_RFC7919_8192 */
-        default:
-            return PSA_ERROR_NOT_SUPPORTED;
-    }
-}
-#endif /* PSA_WANT_ALG_FFDH */
-
 int mbedtls_ssl_tls13_generate_and_write_xxdh_key_exchange(
     mbedtls_ssl_context *ssl,
     uint16_t named_group,
@@ -1573,24 +2355,13 @@ int mbedtls_ssl_tls13_generate_and_write_xxdh_key_exchange(
     psa_set_key_type(&key_attributes, handshake->xxdh_psa_type);
     psa_set_key_bits(&key_attributes, handshake->xxdh_psa_bits);
 
-    /* Generate ECDH/FFDH private key. */
-    status = psa_generate_key(&key_attributes,
-                              &handshake->xxdh_psa_privkey);
+    /* Generate ECDH/FFDH private key and export its public part. */
+    status = mbedtls_ssl_generate_ephemeral_key(ssl, &key_attributes,
+                                                buf, buf_size,
+                                                &own_pubkey_len);
     if (status != PSA_SUCCESS) {
         ret = PSA_TO_MBEDTLS_ERR(status);
-        MBEDTLS_SSL_DEBUG_RET(1, "psa_generate_key", ret);
-        return ret;
-
-    }
-
-    /* Export the public part of the ECDH/FFDH private key from PSA. */
-    status = psa_export_public_key(handshake->xxdh_psa_privkey,
-                                   buf, buf_size,
-                                   &own_pubkey_len);
-
-    if (status != PSA_SUCCESS) {
-        ret = PSA_TO_MBEDTLS_ERR(status);
-        MBEDTLS_SSL_DEBUG_RET(1, "psa_export_public_key", ret);
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_generate_ephemeral_key", ret);
         return ret;
     }
 
@@ -1728,12 +2499,12 @@ int mbedtls_ssl_tls13_write_record_size_limit_ext(mbedtls_ssl_context *ssl,
     MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT, p, 0);
     MBEDTLS_PUT_UINT16_BE(MBEDTLS_SSL_RECORD_SIZE_LIMIT_EXTENSION_DATA_LENGTH,
                           p, 2);
-    MBEDTLS_PUT_UINT16_BE(MBEDTLS_SSL_IN_CONTENT_LEN, p, 4);
+    MBEDTLS_PUT_UINT16_BE(mbedtls_ssl_in_content_len(ssl), p, 4);
 
     *out_len = 6;
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("Sent RecordSizeLimit: %d Bytes",
-                              MBEDTLS_SSL_IN_CONTENT_LEN));
+                              (int) mbedtls_ssl_in_content_len(ssl)));
 
     mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_RECORD_SIZE_LIMIT);
 
@@ -1742,4 +2513,94 @@ int mbedtls_ssl_tls13_write_record_size_limit_ext(mbedtls_ssl_context *ssl,
 
 #endif /* MBEDTLS_SSL_RECORD_SIZE_LIMIT */
 
+#if defined(MBEDTLS_SSL_QUIC)
+/* RFC 9001, section 8.2:
+ *
+ *    enum {
+ *       quic_transport_parameters(0x39), (65535)
+ *    } ExtensionType;
+ *
+ * The extension_data is the encoded transport parameters, which are
+ * handed over to the QUIC stack as they are.
+ */
+int mbedtls_ssl_tls13_parse_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl,
+    const unsigned char *buf,
+    const unsigned char *end)
+{
+    size_t len = (size_t) (end - buf);
+    unsigned char *tp = NULL;
+
+    if (!mbedtls_ssl_is_quic(ssl)) {
+        /* Not offered by a client outside of QUIC, and ignored by a server
+         * that does not run QUIC. */
+        return 0;
+    }
+
+    if (len != 0) {
+        tp = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, len);
+        if (tp == NULL) {
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        memcpy(tp, buf, len);
+    }
+
+    mbedtls_free(ssl->quic_peer_tp);
+    ssl->quic_peer_tp = tp;
+    ssl->quic_peer_tp_len = len;
+
+    MBEDTLS_SSL_DEBUG_BUF(3, "peer QUIC transport parameters", buf, len);
+
+    return 0;
+}
+
+int mbedtls_ssl_tls13_write_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl,
+    unsigned char *buf,
+    const unsigned char *end,
+    size_t *out_len)
+{
+    unsigned char *p = buf;
+
+    *out_len = 0;
+
+    if (!mbedtls_ssl_is_quic(ssl)) {
+        return 0;
+    }
+
+    MBEDTLS_SSL_CHK_BUF_PTR(p, end, 4 + ssl->quic_tp_len);
+
+    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS, p, 0);
+    MBEDTLS_PUT_UINT16_BE(ssl->quic_tp_len, p, 2);
+    p += 4;
+    if (ssl->quic_tp_len != 0) {
+        memcpy(p, ssl->quic_tp, ssl->quic_tp_len);
+    }
+
+    *out_len = 4 + ssl->quic_tp_len;
+
+    mbedtls_ssl_tls13_set_hs_sent_ext_mask(
+        ssl, MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS);
+
+    return 0;
+}
+
+int mbedtls_ssl_tls13_check_quic_transport_params_ext(
+    mbedtls_ssl_context *ssl)
+{
+    /* RFC 9001, section 8.2: an endpoint MUST treat the absence of the
+     * extension as a missing_extension alert. */
+    if (mbedtls_ssl_is_quic(ssl) &&
+        (ssl->handshake->received_extensions &
+         MBEDTLS_SSL_EXT_MASK(QUIC_TRANSPORT_PARAMETERS)) == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("no quic_transport_parameters extension"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_MISSING_EXTENSION,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_QUIC */
+
 #endif /* MBEDTLS_SSL_TLS_C && MBEDTLS_SSL_PROTO_TLS1_3 */
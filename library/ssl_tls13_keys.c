@@ -135,19 +135,86 @@ static void ssl_tls13_hkdf_encode_label(
     *dst_len = total_hkdf_lbl_len;
 }
 
-int mbedtls_ssl_tls13_hkdf_expand_label(
+/*
+ * HMAC as in RFC 2104, with the hash states after the padded key kept in
+ * the context. HKDF-Expand is then
+ *
+ *   T(i) = HMAC(PRK, T(i-1) | info | i)
+ *
+ * which in TLS 1.3 is almost always a single block.
+ */
+int mbedtls_ssl_tls13_hkdf_key_setup(
+    mbedtls_ssl_tls13_hkdf_key *key,
     psa_algorithm_t hash_alg,
-    const unsigned char *secret, size_t secret_len,
+    const unsigned char *secret, size_t secret_len)
+{
+    unsigned char pad[PSA_HMAC_MAX_HASH_BLOCK_SIZE];
+    unsigned char hashed_secret[PSA_HASH_MAX_SIZE];
+    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
+    size_t block_len, i;
+
+    key->hash_alg = hash_alg;
+    key->inner = psa_hash_operation_init();
+    key->outer = psa_hash_operation_init();
+
+    if (!PSA_ALG_IS_HASH(hash_alg)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    block_len = PSA_HASH_BLOCK_LENGTH(hash_alg);
+    if (block_len == 0 || block_len > sizeof(pad)) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    if (secret_len > block_len) {
+        status = psa_hash_compute(hash_alg, secret, secret_len,
+                                  hashed_secret, sizeof(hashed_secret),
+                                  &secret_len);
+        if (status != PSA_SUCCESS) {
+            goto cleanup;
+        }
+        secret = hashed_secret;
+    }
+
+    memset(pad, 0x36, block_len);
+    for (i = 0; i < secret_len; i++) {
+        pad[i] ^= secret[i];
+    }
+    status = psa_hash_setup(&key->inner, hash_alg);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&key->inner, pad, block_len);
+    }
+    if (status != PSA_SUCCESS) {
+        goto cleanup;
+    }
+
+    for (i = 0; i < block_len; i++) {
+        pad[i] ^= 0x36 ^ 0x5C;
+    }
+    status = psa_hash_setup(&key->outer, hash_alg);
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&key->outer, pad, block_len);
+    }
+
+cleanup:
+    mbedtls_platform_zeroize(pad, sizeof(pad));
+    mbedtls_platform_zeroize(hashed_secret, sizeof(hashed_secret));
+    return PSA_TO_MBEDTLS_ERR(status);
+}
+
+int mbedtls_ssl_tls13_hkdf_key_expand_label(
+    const mbedtls_ssl_tls13_hkdf_key *key,
     const unsigned char *label, size_t label_len,
     const unsigned char *ctx, size_t ctx_len,
     unsigned char *buf, size_t buf_len)
 {
     unsigned char hkdf_label[SSL_TLS1_3_KEY_SCHEDULE_MAX_HKDF_LABEL_LEN];
     size_t hkdf_label_len = 0;
-    psa_status_t status = PSA_ERROR_CORRUPTION_DETECTED;
-    psa_status_t abort_status = PSA_ERROR_CORRUPTION_DETECTED;
-    psa_key_derivation_operation_t operation =
-        PSA_KEY_DERIVATION_OPERATION_INIT;
+    unsigned char t[PSA_HASH_MAX_SIZE];
+    size_t t_len = 0, hash_len, len, done = 0;
+    unsigned char counter = 1;
+    psa_status_t status = PSA_SUCCESS;
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
 
     if (label_len > MBEDTLS_SSL_TLS1_3_KEY_SCHEDULE_MAX_LABEL_LEN) {
         /* Should never happen since this is an internal
@@ -166,9 +233,10 @@ int mbedtls_ssl_tls13_hkdf_expand_label(
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
-    if (!PSA_ALG_IS_HASH(hash_alg)) {
+    if (!PSA_ALG_IS_HASH(key->hash_alg)) {
         return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
     }
+    hash_len = PSA_HASH_LENGTH(key->hash_alg);
 
     ssl_tls13_hkdf_encode_label(buf_len,
                                 label, label_len,
@@ -176,43 +244,76 @@ int mbedtls_ssl_tls13_hkdf_expand_label(
                                 hkdf_label,
                                 &hkdf_label_len);
 
-    status = psa_key_derivation_setup(&operation, PSA_ALG_HKDF_EXPAND(hash_alg));
-
-    if (status != PSA_SUCCESS) {
-        goto cleanup;
-    }
+    while (done < buf_len) {
+        /* Inner hash: T(i-1) | info | i */
+        status = psa_hash_clone(&key->inner, &operation);
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, t, t_len);
+        }
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, hkdf_label, hkdf_label_len);
+        }
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, &counter, 1);
+        }
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_finish(&operation, t, sizeof(t), &t_len);
+        }
+        if (status != PSA_SUCCESS) {
+            goto cleanup;
+        }
 
-    status = psa_key_derivation_input_bytes(&operation,
-                                            PSA_KEY_DERIVATION_INPUT_SECRET,
-                                            secret,
-                                            secret_len);
+        /* Outer hash */
+        status = psa_hash_clone(&key->outer, &operation);
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_update(&operation, t, t_len);
+        }
+        if (status == PSA_SUCCESS) {
+            status = psa_hash_finish(&operation, t, sizeof(t), &t_len);
+        }
+        if (status != PSA_SUCCESS) {
+            goto cleanup;
+        }
 
-    if (status != PSA_SUCCESS) {
-        goto cleanup;
+        len = buf_len - done < hash_len ? buf_len - done : hash_len;
+        memcpy(buf + done, t, len);
+        done += len;
+        counter++;
     }
 
-    status = psa_key_derivation_input_bytes(&operation,
-                                            PSA_KEY_DERIVATION_INPUT_INFO,
-                                            hkdf_label,
-                                            hkdf_label_len);
+cleanup:
+    psa_hash_abort(&operation);
+    mbedtls_platform_zeroize(t, sizeof(t));
+    mbedtls_platform_zeroize(hkdf_label, hkdf_label_len);
+    return PSA_TO_MBEDTLS_ERR(status);
+}
 
-    if (status != PSA_SUCCESS) {
-        goto cleanup;
-    }
+void mbedtls_ssl_tls13_hkdf_key_free(mbedtls_ssl_tls13_hkdf_key *key)
+{
+    psa_hash_abort(&key->inner);
+    psa_hash_abort(&key->outer);
+}
 
-    status = psa_key_derivation_output_bytes(&operation,
-                                             buf,
-                                             buf_len);
+int mbedtls_ssl_tls13_hkdf_expand_label(
+    psa_algorithm_t hash_alg,
+    const unsigned char *secret, size_t secret_len,
+    const unsigned char *label, size_t label_len,
+    const unsigned char *ctx, size_t ctx_len,
+    unsigned char *buf, size_t buf_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_tls13_hkdf_key key;
 
-    if (status != PSA_SUCCESS) {
-        goto cleanup;
+    ret = mbedtls_ssl_tls13_hkdf_key_setup(&key, hash_alg, secret, secret_len);
+    if (ret == 0) {
+        ret = mbedtls_ssl_tls13_hkdf_key_expand_label(&key,
+                                                      label, label_len,
+                                                      ctx, ctx_len,
+                                                      buf, buf_len);
     }
+    mbedtls_ssl_tls13_hkdf_key_free(&key);
 
-cleanup:
-    abort_status = psa_key_derivation_abort(&operation);
-    status = (status == PSA_SUCCESS ? abort_status : status);
-    mbedtls_platform_zeroize(hkdf_label, hkdf_label_len);
-    return PSA_TO_MBEDTLS_ERR(status);
+    return ret;
 }
 
 MBEDTLS_CHECK_RETURN_CRITICAL
@@ -223,23 +324,31 @@ static int ssl_tls13_make_traffic_key(
     unsigned char *iv, size_t iv_len)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_tls13_hkdf_key hkdf_key;
 
-    ret = mbedtls_ssl_tls13_hkdf_expand_label(
-        hash_alg,
-        secret, secret_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_setup(&hkdf_key, hash_alg,
+                                           secret, secret_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(key),
         NULL, 0,
         key, key_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    ret = mbedtls_ssl_tls13_hkdf_expand_label(
-        hash_alg,
-        secret, secret_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(iv),
         NULL, 0,
         iv, iv_len);
+
+cleanup:
+    mbedtls_ssl_tls13_hkdf_key_free(&hkdf_key);
     return ret;
 }
 
@@ -426,6 +535,7 @@ int mbedtls_ssl_tls13_derive_early_secrets(
 {
     int ret;
     size_t const hash_len = PSA_HASH_LENGTH(hash_alg);
+    mbedtls_ssl_tls13_hkdf_key hkdf_key;
 
     /* We should never call this function with an unknown hash,
      * but add an assertion anyway. */
@@ -433,6 +543,13 @@ int mbedtls_ssl_tls13_derive_early_secrets(
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+    /* All the secrets of the stage are expanded from early_secret. */
+    ret = mbedtls_ssl_tls13_hkdf_key_setup(&hkdf_key, hash_alg,
+                                           early_secret, hash_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
     /*
      *            0
      *            |
@@ -448,32 +565,30 @@ int mbedtls_ssl_tls13_derive_early_secrets(
      */
 
     /* Create client_early_traffic_secret */
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        early_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(c_e_traffic),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->client_early_traffic_secret,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
     /* Create early exporter */
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        early_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(e_exp_master),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->early_exporter_master_secret,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    return 0;
+cleanup:
+    mbedtls_ssl_tls13_hkdf_key_free(&hkdf_key);
+    return ret;
 }
 
 int mbedtls_ssl_tls13_derive_handshake_secrets(
@@ -484,6 +599,7 @@ int mbedtls_ssl_tls13_derive_handshake_secrets(
 {
     int ret;
     size_t const hash_len = PSA_HASH_LENGTH(hash_alg);
+    mbedtls_ssl_tls13_hkdf_key hkdf_key;
 
     /* We should never call this function with an unknown hash,
      * but add an assertion anyway. */
@@ -491,6 +607,13 @@ int mbedtls_ssl_tls13_derive_handshake_secrets(
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+    /* All the secrets of the stage are expanded from handshake_secret. */
+    ret = mbedtls_ssl_tls13_hkdf_key_setup(&hkdf_key, hash_alg,
+                                           handshake_secret, hash_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
     /*
      *
      * Handshake Secret
@@ -510,16 +633,14 @@ int mbedtls_ssl_tls13_derive_handshake_secrets(
      * Derive-Secret( ., "c hs traffic", ClientHello...ServerHello )
      */
 
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        handshake_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(c_hs_traffic),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->client_handshake_traffic_secret,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
     /*
@@ -527,19 +648,19 @@ int mbedtls_ssl_tls13_derive_handshake_secrets(
      * Derive-Secret( ., "s hs traffic", ClientHello...ServerHello )
      */
 
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        handshake_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(s_hs_traffic),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->server_handshake_traffic_secret,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    return 0;
+cleanup:
+    mbedtls_ssl_tls13_hkdf_key_free(&hkdf_key);
+    return ret;
 }
 
 int mbedtls_ssl_tls13_derive_application_secrets(
@@ -550,6 +671,7 @@ int mbedtls_ssl_tls13_derive_application_secrets(
 {
     int ret;
     size_t const hash_len = PSA_HASH_LENGTH(hash_alg);
+    mbedtls_ssl_tls13_hkdf_key hkdf_key;
 
     /* We should never call this function with an unknown hash,
      * but add an assertion anyway. */
@@ -557,6 +679,13 @@ int mbedtls_ssl_tls13_derive_application_secrets(
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
 
+    /* All the secrets of the stage are expanded from application_secret. */
+    ret = mbedtls_ssl_tls13_hkdf_key_setup(&hkdf_key, hash_alg,
+                                           application_secret, hash_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+
     /* Generate {client,server}_application_traffic_secret_0
      *
      * Master Secret
@@ -575,43 +704,39 @@ int mbedtls_ssl_tls13_derive_application_secrets(
      *
      */
 
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        application_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(c_ap_traffic),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->client_application_traffic_secret_N,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        application_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(s_ap_traffic),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->server_application_traffic_secret_N,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    ret = mbedtls_ssl_tls13_derive_secret(
-        hash_alg,
-        application_secret, hash_len,
+    ret = mbedtls_ssl_tls13_hkdf_key_expand_label(
+        &hkdf_key,
         MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(exp_master),
         transcript, transcript_len,
-        MBEDTLS_SSL_TLS1_3_CONTEXT_HASHED,
         derived->exporter_master_secret,
         hash_len);
     if (ret != 0) {
-        return ret;
+        goto cleanup;
     }
 
-    return 0;
+cleanup:
+    mbedtls_ssl_tls13_hkdf_key_free(&hkdf_key);
+    return ret;
 }
 
 /* Generate resumption_master_secret for use with the ticket exchange.
@@ -1003,6 +1128,14 @@ int mbedtls_ssl_tls13_populate_transform(
     memcpy(transform->iv_enc, iv_enc, traffic_keys->iv_len);
     memcpy(transform->iv_dec, iv_dec, traffic_keys->iv_len);
 
+#if defined(MBEDTLS_SSL_KTLS)
+    if (traffic_keys->key_len <= sizeof(transform->ktls_key_enc)) {
+        memcpy(transform->ktls_key_enc, key_enc, traffic_keys->key_len);
+        memcpy(transform->ktls_key_dec, key_dec, traffic_keys->key_len);
+        transform->ktls_keylen = traffic_keys->key_len;
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
 #if !defined(MBEDTLS_USE_PSA_CRYPTO)
     if ((ret = mbedtls_cipher_setkey(&transform->cipher_ctx_enc,
                                      key_enc, (int) mbedtls_cipher_info_get_key_bitlen(cipher_info),
@@ -1243,7 +1376,8 @@ int mbedtls_ssl_tls13_compute_early_transform(mbedtls_ssl_context *ssl)
         goto cleanup;
     }
 
-    transform_earlydata = mbedtls_calloc(1, sizeof(mbedtls_ssl_transform));
+    transform_earlydata = mbedtls_ssl_hs_arena_calloc(
+        handshake, 1, sizeof(mbedtls_ssl_transform));
     if (transform_earlydata == NULL) {
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto cleanup;
@@ -1264,7 +1398,7 @@ int mbedtls_ssl_tls13_compute_early_transform(mbedtls_ssl_context *ssl)
 cleanup:
     mbedtls_platform_zeroize(&traffic_keys, sizeof(traffic_keys));
     if (ret != 0) {
-        mbedtls_free(transform_earlydata);
+        mbedtls_ssl_hs_arena_free(handshake, transform_earlydata);
     }
 
     return ret;
@@ -1411,6 +1545,17 @@ static int ssl_tls13_generate_handshake_keys(mbedtls_ssl_context *ssl,
             MBEDTLS_SSL_TLS_PRF_NONE /* TODO: FIX! */);
     }
 
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_quic_set_secrets(
+        ssl, MBEDTLS_SSL_QUIC_LEVEL_HANDSHAKE,
+        tls13_hs_secrets->client_handshake_traffic_secret,
+        tls13_hs_secrets->server_handshake_traffic_secret,
+        hash_len);
+    if (ret != 0) {
+        goto exit;
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
     ret = mbedtls_ssl_tls13_make_traffic_keys(
         hash_alg,
         tls13_hs_secrets->client_handshake_traffic_secret,
@@ -1496,7 +1641,7 @@ static int ssl_tls13_key_schedule_stage_handshake(mbedtls_ssl_context *ssl)
 
             shared_secret_len = PSA_BITS_TO_BYTES(
                 psa_get_key_bits(&key_attributes));
-            shared_secret = mbedtls_calloc(1, shared_secret_len);
+            shared_secret = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, shared_secret_len);
             if (shared_secret == NULL) {
                 return MBEDTLS_ERR_SSL_ALLOC_FAILED;
             }
@@ -1672,6 +1817,17 @@ static int ssl_tls13_generate_application_keys(
                                         a new constant for TLS 1.3! */);
     }
 
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_quic_set_secrets(
+        ssl, MBEDTLS_SSL_QUIC_LEVEL_APPLICATION,
+        app_secrets->client_application_traffic_secret_N,
+        app_secrets->server_application_traffic_secret_N,
+        hash_len);
+    if (ret != 0) {
+        goto cleanup;
+    }
+#endif /* MBEDTLS_SSL_QUIC */
+
     MBEDTLS_SSL_DEBUG_BUF(4, "client application_write_key:",
                           traffic_keys->client_write_key, key_len);
     MBEDTLS_SSL_DEBUG_BUF(4, "server application write key",
@@ -1715,7 +1871,8 @@ int mbedtls_ssl_tls13_compute_handshake_transform(mbedtls_ssl_context *ssl)
         goto cleanup;
     }
 
-    transform_handshake = mbedtls_calloc(1, sizeof(mbedtls_ssl_transform));
+    transform_handshake = mbedtls_ssl_hs_arena_calloc(
+        handshake, 1, sizeof(mbedtls_ssl_transform));
     if (transform_handshake == NULL) {
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto cleanup;
@@ -1736,7 +1893,7 @@ int mbedtls_ssl_tls13_compute_handshake_transform(mbedtls_ssl_context *ssl)
 cleanup:
     mbedtls_platform_zeroize(&traffic_keys, sizeof(traffic_keys));
     if (ret != 0) {
-        mbedtls_free(transform_handshake);
+        mbedtls_ssl_hs_arena_free(handshake, transform_handshake);
     }
 
     return ret;
@@ -1806,7 +1963,7 @@ int mbedtls_ssl_tls13_compute_application_transform(mbedtls_ssl_context *ssl)
     }
 
     transform_application =
-        mbedtls_calloc(1, sizeof(mbedtls_ssl_transform));
+        mbedtls_calloc_tagged(SSL_TRANSFORM, 1, sizeof(mbedtls_ssl_transform));
     if (transform_application == NULL) {
         ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
         goto cleanup;
@@ -1834,6 +1991,204 @@ cleanup:
     return ret;
 }
 
+int mbedtls_ssl_tls13_restore_application_transform(mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
+    mbedtls_ssl_tls13_application_secrets *app_secrets =
+        &ssl->session->app_secrets;
+    mbedtls_ssl_key_set traffic_keys;
+    mbedtls_ssl_transform *transform_application = NULL;
+    psa_algorithm_t hash_alg;
+    size_t key_len = 0, iv_len = 0;
+
+    ciphersuite_info = mbedtls_ssl_ciphersuite_from_id(ssl->session->ciphersuite);
+    if (ciphersuite_info == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_tls13_get_cipher_key_info(ciphersuite_info, &key_len, &iv_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    hash_alg = mbedtls_md_psa_alg_from_type((mbedtls_md_type_t) ciphersuite_info->mac);
+
+    ret = mbedtls_ssl_tls13_make_traffic_keys(
+        hash_alg,
+        app_secrets->client_application_traffic_secret_N,
+        app_secrets->server_application_traffic_secret_N,
+        PSA_HASH_LENGTH(hash_alg), key_len, iv_len, &traffic_keys);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_make_traffic_keys", ret);
+        goto cleanup;
+    }
+
+    transform_application =
+        mbedtls_calloc_tagged(SSL_TRANSFORM, 1, sizeof(mbedtls_ssl_transform));
+    if (transform_application == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto cleanup;
+    }
+
+    ret = mbedtls_ssl_tls13_populate_transform(
+        transform_application,
+        ssl->conf->endpoint,
+        ciphersuite_info->id,
+        &traffic_keys,
+        ssl);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_populate_transform", ret);
+        goto cleanup;
+    }
+
+    ssl->transform_application = transform_application;
+
+cleanup:
+
+    mbedtls_platform_zeroize(&traffic_keys, sizeof(traffic_keys));
+    if (ret != 0) {
+        mbedtls_free(transform_application);
+    }
+    return ret;
+}
+
+int mbedtls_ssl_tls13_update_application_keys(mbedtls_ssl_context *ssl,
+                                              int outbound)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
+    mbedtls_ssl_transform *transform = ssl->transform_application;
+    mbedtls_ssl_tls13_application_secrets *app_secrets;
+    unsigned char *secret;
+    unsigned char next_secret[MBEDTLS_TLS1_3_MD_MAX_SIZE];
+    unsigned char key[MBEDTLS_SSL_MAX_KEY_LENGTH];
+    unsigned char iv[MBEDTLS_SSL_MAX_IV_LENGTH];
+    psa_algorithm_t hash_alg;
+    size_t hash_len, key_len = 0, iv_len = 0;
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_key_attributes_t attributes = PSA_KEY_ATTRIBUTES_INIT;
+    psa_key_type_t key_type;
+    psa_algorithm_t alg;
+    size_t key_bits;
+    mbedtls_svc_key_id_t *key_id;
+    psa_status_t status;
+#endif
+
+    if (transform == NULL || ssl->session == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    app_secrets = &ssl->session->app_secrets;
+
+    ciphersuite_info = mbedtls_ssl_ciphersuite_from_id(ssl->session->ciphersuite);
+    if (ciphersuite_info == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    ret = ssl_tls13_get_cipher_key_info(ciphersuite_info, &key_len, &iv_len);
+    if (ret != 0) {
+        return ret;
+    }
+
+    hash_alg = mbedtls_md_psa_alg_from_type((mbedtls_md_type_t) ciphersuite_info->mac);
+    hash_len = PSA_HASH_LENGTH(hash_alg);
+
+    if ((ssl->conf->endpoint == MBEDTLS_SSL_IS_CLIENT) == (outbound != 0)) {
+        secret = app_secrets->client_application_traffic_secret_N;
+    } else {
+        secret = app_secrets->server_application_traffic_secret_N;
+    }
+
+    /*
+     * application_traffic_secret_N+1 =
+     *     HKDF-Expand-Label(application_traffic_secret_N,
+     *                       "traffic upd", "", Hash.length)
+     */
+    ret = mbedtls_ssl_tls13_hkdf_expand_label(
+        hash_alg, secret, hash_len,
+        MBEDTLS_SSL_TLS1_3_LBL_WITH_LEN(traffic_upd),
+        NULL, 0,
+        next_secret, hash_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_tls13_hkdf_expand_label", ret);
+        goto cleanup;
+    }
+
+    ret = ssl_tls13_make_traffic_key(hash_alg, next_secret, hash_len,
+                                     key, key_len, iv, iv_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_tls13_make_traffic_key", ret);
+        goto cleanup;
+    }
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    if (transform->psa_alg != MBEDTLS_SSL_NULL_CIPHER) {
+        status = mbedtls_ssl_cipher_to_psa(
+            (mbedtls_cipher_type_t) ciphersuite_info->cipher,
+            transform->taglen, &alg, &key_type, &key_bits);
+        if (status != PSA_SUCCESS) {
+            ret = PSA_TO_MBEDTLS_ERR(status);
+            goto cleanup;
+        }
+
+        key_id = outbound ? &transform->psa_key_enc : &transform->psa_key_dec;
+
+        psa_set_key_usage_flags(&attributes, outbound ? PSA_KEY_USAGE_ENCRYPT :
+                                PSA_KEY_USAGE_DECRYPT);
+        psa_set_key_algorithm(&attributes, alg);
+        psa_set_key_type(&attributes, key_type);
+
+        /* The key is destroyed first, so the transform never holds a
+         * stale key identifier if the import fails. */
+        psa_destroy_key(*key_id);
+        *key_id = MBEDTLS_SVC_KEY_ID_INIT;
+
+        status = psa_import_key(&attributes, key, PSA_BITS_TO_BYTES(key_bits),
+                                key_id);
+        if (status != PSA_SUCCESS) {
+            ret = PSA_TO_MBEDTLS_ERR(status);
+            MBEDTLS_SSL_DEBUG_RET(1, "psa_import_key", ret);
+            goto cleanup;
+        }
+    }
+#else
+    ret = mbedtls_cipher_setkey(outbound ? &transform->cipher_ctx_enc :
+                                &transform->cipher_ctx_dec,
+                                key, (int) (key_len * 8),
+                                outbound ? MBEDTLS_ENCRYPT : MBEDTLS_DECRYPT);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_cipher_setkey", ret);
+        goto cleanup;
+    }
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    memcpy(outbound ? transform->iv_enc : transform->iv_dec, iv, iv_len);
+
+#if defined(MBEDTLS_SSL_KTLS)
+    if (key_len <= sizeof(transform->ktls_key_enc)) {
+        memcpy(outbound ? transform->ktls_key_enc : transform->ktls_key_dec,
+               key, key_len);
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    memcpy(secret, next_secret, hash_len);
+
+    if (outbound) {
+        memset(ssl->cur_out_ctr, 0, sizeof(ssl->cur_out_ctr));
+    } else {
+        memset(ssl->in_ctr, 0, MBEDTLS_SSL_SEQUENCE_NUMBER_LEN);
+    }
+
+    MBEDTLS_SSL_DEBUG_BUF(4, outbound ? "next write traffic secret" :
+                          "next read traffic secret", secret, hash_len);
+
+cleanup:
+    mbedtls_platform_zeroize(next_secret, sizeof(next_secret));
+    mbedtls_platform_zeroize(key, sizeof(key));
+    mbedtls_platform_zeroize(iv, sizeof(iv));
+    return ret;
+}
+
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
 int mbedtls_ssl_tls13_export_handshake_psk(mbedtls_ssl_context *ssl,
                                            unsigned char **psk,
@@ -1846,6 +2201,21 @@ int mbedtls_ssl_tls13_export_handshake_psk(mbedtls_ssl_context *ssl,
     *psk_len = 0;
     *psk = NULL;
 
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+    /* A lent raw key is copied, as the callers free what they get. */
+    if (ssl->handshake->psk_borrowed != NULL) {
+        *psk = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1,
+                                     ssl->handshake->psk_borrowed_len);
+        if (*psk == NULL) {
+            return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        }
+        memcpy(*psk, ssl->handshake->psk_borrowed,
+               ssl->handshake->psk_borrowed_len);
+        *psk_len = ssl->handshake->psk_borrowed_len;
+        return 0;
+    }
+#endif /* MBEDTLS_SSL_HS_PSK_BORROWED */
+
     if (mbedtls_svc_key_id_is_null(ssl->handshake->psk_opaque)) {
         return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
     }
@@ -1856,7 +2226,7 @@ int mbedtls_ssl_tls13_export_handshake_psk(mbedtls_ssl_context *ssl,
     }
 
     *psk_len = PSA_BITS_TO_BYTES(psa_get_key_bits(&key_attributes));
-    *psk = mbedtls_calloc(1, *psk_len);
+    *psk = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, *psk_len);
     if (*psk == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
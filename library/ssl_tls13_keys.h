@@ -115,6 +115,61 @@ int mbedtls_ssl_tls13_hkdf_expand_label(
     const unsigned char *ctx, size_t ctx_len,
     unsigned char *buf, size_t buf_len);
 
+/*
+ * A secret prepared for several HKDF-Expand-Label operations: the HMAC
+ * inner and outer hash states after the padded secret, so that each
+ * expansion only hashes the HkdfLabel and the inner digest.
+ */
+typedef struct {
+    psa_algorithm_t hash_alg;
+    psa_hash_operation_t inner;
+    psa_hash_operation_t outer;
+} mbedtls_ssl_tls13_hkdf_key;
+
+/**
+ * \brief            Prepare a secret for mbedtls_ssl_tls13_hkdf_key_expand_label().
+ *
+ * \param key        The context to set up. It must be freed with
+ *                   mbedtls_ssl_tls13_hkdf_key_free(), even on failure.
+ * \param hash_alg   The identifier for the hash algorithm to use.
+ * \param secret     The \c Secret argument to \c HKDF-Expand-Label.
+ *                   This must be a readable buffer of length
+ *                   \p secret_len Bytes.
+ * \param secret_len The length of \p secret in Bytes.
+ *
+ * \returns          \c 0 on success.
+ * \return           A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_hkdf_key_setup(
+    mbedtls_ssl_tls13_hkdf_key *key,
+    psa_algorithm_t hash_alg,
+    const unsigned char *secret, size_t secret_len);
+
+/**
+ * \brief            \c HKDF-Expand-Label with a secret prepared by
+ *                   mbedtls_ssl_tls13_hkdf_key_setup().
+ *
+ *                   The parameters are those of
+ *                   mbedtls_ssl_tls13_hkdf_expand_label().
+ *
+ * \returns          \c 0 on success.
+ * \return           A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_hkdf_key_expand_label(
+    const mbedtls_ssl_tls13_hkdf_key *key,
+    const unsigned char *label, size_t label_len,
+    const unsigned char *ctx, size_t ctx_len,
+    unsigned char *buf, size_t buf_len);
+
+/**
+ * \brief            Free a secret prepared by mbedtls_ssl_tls13_hkdf_key_setup().
+ *
+ * \param key        The context to free.
+ */
+void mbedtls_ssl_tls13_hkdf_key_free(mbedtls_ssl_tls13_hkdf_key *key);
+
 /**
  * \brief           This function is part of the TLS 1.3 key schedule.
  *                  It extracts key and IV for the actual client/server traffic
@@ -628,6 +683,41 @@ int mbedtls_ssl_tls13_compute_handshake_transform(mbedtls_ssl_context *ssl);
 MBEDTLS_CHECK_RETURN_CRITICAL
 int mbedtls_ssl_tls13_compute_application_transform(mbedtls_ssl_context *ssl);
 
+/**
+ * \brief Rebuild the TLS 1.3 application transform from the application
+ *        traffic secrets of the current session, when loading a context
+ *        saved with mbedtls_ssl_context_save()
+ *
+ * \param ssl  The SSL context to operate on. ssl->session must hold the
+ *             ciphersuite and the application secrets.
+ *
+ * \returns    \c 0 on success, with ssl->transform_application set.
+ * \returns    A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_restore_application_transform(mbedtls_ssl_context *ssl);
+
+/**
+ * \brief Move one direction of the TLS 1.3 application transform to the next
+ *        application traffic secret, as for a KeyUpdate message
+ *
+ *        The secret in ssl->session is replaced by
+ *        HKDF-Expand-Label(secret, "traffic upd", "", Hash.length), the key
+ *        and IV of the direction are derived from it and set in
+ *        ssl->transform_application in place, and the record sequence number
+ *        of the direction is reset.
+ *
+ * \param ssl       The SSL context to operate on, after the handshake.
+ * \param outbound  \c 1 to update the sending keys, \c 0 for the receiving
+ *                  keys.
+ *
+ * \returns    \c 0 on success.
+ * \returns    A negative error code on failure.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+int mbedtls_ssl_tls13_update_application_keys(mbedtls_ssl_context *ssl,
+                                              int outbound);
+
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
 /**
  * \brief Export TLS 1.3 PSK from handshake context
@@ -146,7 +146,108 @@ static int ssl_tls13_parse_key_exchange_modes_ext(mbedtls_ssl_context *ssl,
     ssl->handshake->tls13_kex_modes = ke_modes;
     return 0;
 }
+#endif /* MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED */
+
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+/* From RFC 8879:
+ *
+ *   struct {
+ *       CertificateCompressionAlgorithm algorithms<2..2^8-2>;
+ *   } CertificateCompressionAlgorithms;
+ *
+ * Only the algorithms below 16 are recorded: they are the only ones we can
+ * be configured with.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_compress_certificate_ext(mbedtls_ssl_context *ssl,
+                                                    const unsigned char *buf,
+                                                    const unsigned char *end)
+{
+    const unsigned char *p = buf;
+    size_t algs_len;
+    uint16_t offered = 0;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 1);
+    algs_len = *p++;
+    if (algs_len < 2 || algs_len % 2 != 0 || algs_len != (size_t) (end - p)) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+    for (; p < end; p += 2) {
+        uint16_t alg = MBEDTLS_GET_UINT16_BE(p, 0);
+        MBEDTLS_SSL_DEBUG_MSG(3, ("Found certificate compression algorithm %u",
+                                  (unsigned) alg));
+        if (alg < 16) {
+            offered |= (uint16_t) (1u << alg);
+        }
+    }
+
+    ssl->handshake->cert_compression_offered = offered;
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/* From RFC 7250 section 3:
+ *
+ *   struct {
+ *       select(ClientOrServerExtension) {
+ *           case client:
+ *               CertificateType client_certificate_types<1..2^8-1>;
+ *           case server:
+ *               CertificateType client_certificate_type;
+ *       }
+ *   } ClientCertTypeExtension;
+ *
+ * and likewise for server_certificate_type. Only the types below 8 are
+ * recorded: they include those we know.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_parse_cert_type_ext(mbedtls_ssl_context *ssl,
+                                         const unsigned char *buf,
+                                         const unsigned char *end,
+                                         uint8_t *types)
+{
+    const unsigned char *p = buf;
+    size_t types_len;
+
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, 1);
+    types_len = *p++;
+    if (types_len == 0 || types_len != (size_t) (end - p)) {
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                                     MBEDTLS_ERR_SSL_DECODE_ERROR);
+        return MBEDTLS_ERR_SSL_DECODE_ERROR;
+    }
+
+    *types = 0;
+    for (; p < end; p++) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("Found certificate type %u", (unsigned) *p));
+        if (*p < 8) {
+            *types |= (uint8_t) (1u << *p);
+        }
+    }
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+/* Length of the identifiers sent as tickets when their state is in the
+ * session cache, see mbedtls_ssl_conf_tls13_stateful_tickets(). It is
+ * shorter than any ticket of mbedtls_ssl_ticket_write(). */
+#define SSL_TLS1_3_STATEFUL_TICKET_LEN 16
 
+static int ssl_tls13_stateful_tickets_enabled(const mbedtls_ssl_context *ssl)
+{
+    return ssl->conf->tls13_stateful_ticket_lifetime != 0 &&
+           ssl->conf->f_get_cache != NULL &&
+           ssl->conf->f_set_cache != NULL;
+}
+#endif /* MBEDTLS_SSL_SESSION_TICKETS */
+
+#if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
 /*
  * Non-error return values of
  * ssl_tls13_offered_psks_check_identity_match_ticket() and
@@ -184,10 +285,12 @@ static int ssl_tls13_offered_psks_check_identity_match_ticket(
     const unsigned char *identity,
     size_t identity_len,
     uint32_t obfuscated_ticket_age,
+    uint16_t *tickets_left,
     mbedtls_ssl_session *session)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     unsigned char *ticket_buffer;
+    int stateful;
 #if defined(MBEDTLS_HAVE_TIME)
     mbedtls_ms_time_t now;
     mbedtls_ms_time_t server_age;
@@ -199,17 +302,50 @@ static int ssl_tls13_offered_psks_check_identity_match_ticket(
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> check_identity_match_ticket"));
 
+    stateful = ssl_tls13_stateful_tickets_enabled(ssl) &&
+               identity_len == SSL_TLS1_3_STATEFUL_TICKET_LEN;
+
     /* Ticket parser is not configured, Skip */
-    if (ssl->conf->f_ticket_parse == NULL || identity_len == 0) {
+    if ((ssl->conf->f_ticket_parse == NULL && !stateful) || identity_len == 0) {
+        return SSL_TLS1_3_PSK_IDENTITY_DOES_NOT_MATCH;
+    }
+
+    /* Bound the number of tickets we decrypt for a single ClientHello. */
+    if (*tickets_left == 0) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ticket limit reached, skip"));
         return SSL_TLS1_3_PSK_IDENTITY_DOES_NOT_MATCH;
     }
+    (*tickets_left)--;
+
+    /* The last ticket that matches is the one of the selected PSK, if any. */
+    ssl->handshake->ticket_fresh = 0;
+
+    if (stateful) {
+        /* The cache only returns sessions it stored, so a hit is as good
+         * as an authentic ticket. */
+        ret = ssl->conf->f_get_cache(ssl->conf->p_cache, identity,
+                                     identity_len, session);
+        MBEDTLS_SSL_PROBE2(cache_get, ssl, ret);
+        if (ret == 0) {
+            MBEDTLS_SSL_STATS_INC(ssl, cache_hits);
+            ret = SSL_TLS1_3_PSK_IDENTITY_MATCH;
+            goto check_session;
+        }
+        MBEDTLS_SSL_DEBUG_MSG(3, ("ticket not found in cache"));
+        MBEDTLS_SSL_STATS_INC(ssl, cache_misses);
+        if (ssl->conf->f_ticket_parse == NULL) {
+            ret = SSL_TLS1_3_PSK_IDENTITY_DOES_NOT_MATCH;
+            goto exit;
+        }
+        mbedtls_ssl_session_free(session);
+    }
 
     /* We create a copy of the encrypted ticket since the ticket parsing
      * function is allowed to use its input buffer as an output buffer
      * (in-place decryption). We do, however, need the original buffer for
      * computing the PSK binder value.
      */
-    ticket_buffer = mbedtls_calloc(1, identity_len);
+    ticket_buffer = mbedtls_calloc_tagged(SSL_HANDSHAKE, 1, identity_len);
     if (ticket_buffer == NULL) {
         return MBEDTLS_ERR_SSL_ALLOC_FAILED;
     }
@@ -218,8 +354,15 @@ static int ssl_tls13_offered_psks_check_identity_match_ticket(
     ret = ssl->conf->f_ticket_parse(ssl->conf->p_ticket,
                                     session,
                                     ticket_buffer, identity_len);
+    MBEDTLS_SSL_PROBE2(ticket_parse, ssl, ret);
     switch (ret) {
+        case MBEDTLS_SSL_TICKET_PARSE_FRESH:
+            ssl->handshake->ticket_fresh = 1;
+            ret = SSL_TLS1_3_PSK_IDENTITY_MATCH;
+            break;
+
         case 0:
+        case MBEDTLS_SSL_TICKET_PARSE_RENEW:
             ret = SSL_TLS1_3_PSK_IDENTITY_MATCH;
             break;
 
@@ -242,9 +385,11 @@ static int ssl_tls13_offered_psks_check_identity_match_ticket(
     mbedtls_free(ticket_buffer);
 
     if (ret != SSL_TLS1_3_PSK_IDENTITY_MATCH) {
+        MBEDTLS_SSL_STATS_INC(ssl, ticket_failures);
         goto exit;
     }
 
+check_session:
     /*
      * The identity matches that of a ticket. Now check that it has suitable
      * attributes and bet it will not be the case.
@@ -331,6 +476,7 @@ static int ssl_tls13_offered_psks_check_identity_match(
     const unsigned char *identity,
     size_t identity_len,
     uint32_t obfuscated_ticket_age,
+    uint16_t *tickets_left,
     int *psk_type,
     mbedtls_ssl_session *session)
 {
@@ -338,13 +484,15 @@ static int ssl_tls13_offered_psks_check_identity_match(
 
     ((void) session);
     ((void) obfuscated_ticket_age);
+    ((void) tickets_left);
     *psk_type = MBEDTLS_SSL_TLS1_3_PSK_EXTERNAL;
 
     MBEDTLS_SSL_DEBUG_BUF(4, "identity", identity, identity_len);
 
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
     ret = ssl_tls13_offered_psks_check_identity_match_ticket(
-        ssl, identity, identity_len, obfuscated_ticket_age, session);
+        ssl, identity, identity_len, obfuscated_ticket_age, tickets_left,
+        session);
     if (ret == SSL_TLS1_3_PSK_IDENTITY_MATCH) {
         *psk_type = MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION;
         ret = mbedtls_ssl_set_hs_psk(ssl,
@@ -533,6 +681,8 @@ static int ssl_tls13_parse_pre_shared_key_ext(
     const unsigned char *binders_end;
     int matched_identity = -1;
     int identity_id = -1;
+    uint16_t identities_left = ssl->conf->tls13_max_psk_identities;
+    uint16_t tickets_left = ssl->conf->tls13_max_psk_tickets;
 
     MBEDTLS_SSL_DEBUG_BUF(3, "pre_shared_key extension",
                           pre_shared_key_ext,
@@ -592,13 +742,17 @@ static int ssl_tls13_parse_pre_shared_key_ext(
         p_binder_len += binder_len + 1;
 
         identity_id++;
-        if (matched_identity != -1) {
+        /* Only the binder of the first usable identity is checked: the
+         * identities after it, or after the configured limit, are only
+         * parsed. */
+        if (matched_identity != -1 || identities_left == 0) {
             continue;
         }
+        identities_left--;
 
         ret = ssl_tls13_offered_psks_check_identity_match(
             ssl, identity, identity_len, obfuscated_ticket_age,
-            &psk->type, &session);
+            &tickets_left, &psk->type, &session);
         if (ret != SSL_TLS1_3_PSK_IDENTITY_MATCH) {
             continue;
         }
@@ -640,6 +794,9 @@ static int ssl_tls13_parse_pre_shared_key_ext(
 
         if (psk->key_exchange_mode == MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_NONE) {
             MBEDTLS_SSL_DEBUG_MSG(3, ("No suitable PSK key exchange mode"));
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+            mbedtls_ssl_session_free(&session);
+#endif
             continue;
         }
 
@@ -683,6 +840,12 @@ static int ssl_tls13_parse_pre_shared_key_ext(
 
         matched_identity = identity_id;
 
+#if defined(MBEDTLS_SSL_EARLY_DATA)
+        /* binder_len is checked against the hash length above. */
+        memcpy(ssl->handshake->early_data_binder, binder, binder_len);
+        ssl->handshake->early_data_binder_len = (uint8_t) binder_len;
+#endif
+
 #if defined(MBEDTLS_SSL_SESSION_TICKETS)
         if (psk->type == MBEDTLS_SSL_TLS1_3_PSK_RESUMPTION) {
             ret = ssl_tls13_session_copy_ticket(ssl->session_negotiate,
@@ -741,6 +904,9 @@ static int ssl_tls13_write_server_pre_shared_key_ext(mbedtls_ssl_context *ssl,
     int not_using_psk = 0;
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
     not_using_psk = (mbedtls_svc_key_id_is_null(ssl->handshake->psk_opaque));
+#if defined(MBEDTLS_SSL_HS_PSK_BORROWED)
+    not_using_psk = not_using_psk && ssl->handshake->psk_borrowed == NULL;
+#endif
 #else
     not_using_psk = (ssl->handshake->psk == NULL);
 #endif
@@ -1121,7 +1287,7 @@ static int ssl_tls13_pick_key_cert(mbedtls_ssl_context *ssl)
         key_cert_list = ssl->handshake->sni_key_cert;
     } else
 #endif /* MBEDTLS_SSL_SERVER_NAME_INDICATION */
-    key_cert_list = ssl->conf->key_cert;
+    key_cert_list = mbedtls_ssl_key_cert_list(ssl);
 
     if (key_cert_list == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(3, ("server has no certificate"));
@@ -1150,11 +1316,7 @@ static int ssl_tls13_pick_key_cert(mbedtls_ssl_context *ssl)
              * This avoids sending the client a cert it'll reject based on
              * keyUsage or other extensions.
              */
-            if (mbedtls_x509_crt_check_key_usage(
-                    key_cert->cert, MBEDTLS_X509_KU_DIGITAL_SIGNATURE) != 0 ||
-                mbedtls_x509_crt_check_extended_key_usage(
-                    key_cert->cert, MBEDTLS_OID_SERVER_AUTH,
-                    MBEDTLS_OID_SIZE(MBEDTLS_OID_SERVER_AUTH)) != 0) {
+            if (!key_cert->tls13_server_usage) {
                 MBEDTLS_SSL_DEBUG_MSG(3, ("certificate mismatch: "
                                           "(extended) key usage extension"));
                 continue;
@@ -1244,6 +1406,127 @@ static int ssl_tls13_pick_key_cert(mbedtls_ssl_context *ssl)
 #define SSL_CLIENT_HELLO_HRR_REQUIRED 1
 #define SSL_CLIENT_HELLO_TLS1_2       2
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_server_hello_body(mbedtls_ssl_context *ssl,
+                                             unsigned char *buf,
+                                             unsigned char *end,
+                                             size_t *out_len,
+                                             int is_hrr);
+
+/*
+ * Restore the state of a stateless HelloRetryRequest from the cookie of the
+ * second ClientHello, see ssl_tls13_write_hrr_cookie():
+ *
+ * - check the cookie, and that the client kept the cipher suite and took
+ *   the group we selected;
+ * - replay the transcript up to the second ClientHello, that is the
+ *   message_hash of the first one then the HelloRetryRequest, rebuilt into
+ *   the output buffer as it was sent.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_restore_hrr_state(mbedtls_ssl_context *ssl,
+                                       const unsigned char *cookie,
+                                       size_t cookie_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    const mbedtls_ssl_ciphersuite_t *ciphersuite_info =
+        handshake->ciphersuite_info;
+    size_t hash_len = PSA_HASH_LENGTH(mbedtls_md_psa_alg_from_type(
+                                          (mbedtls_md_type_t) ciphersuite_info->mac));
+    size_t state_len = 5 + hash_len;
+    unsigned char header[4];
+    unsigned char *buf;
+    size_t buf_len, msg_len;
+    int key_exchange_mode = handshake->key_exchange_mode;
+    uint16_t offered_group_id = handshake->offered_group_id;
+    uint16_t group;
+
+    if (cookie_len <= state_len || cookie[4] != hash_len ||
+        MBEDTLS_GET_UINT16_BE(cookie, 0) != ciphersuite_info->id ||
+        ssl->conf->f_hrr_cookie_check(ssl->conf->p_hrr_cookie,
+                                      cookie + state_len,
+                                      cookie_len - state_len,
+                                      cookie, state_len) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("bad HelloRetryRequest cookie"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    /* RFC 8446 section 4.1.2, no early data after a HelloRetryRequest, and
+     * no PSK since the first ClientHello had none. */
+    group = MBEDTLS_GET_UINT16_BE(cookie, 2);
+    if (offered_group_id != group ||
+        (handshake->received_extensions &
+         (MBEDTLS_SSL_EXT_MASK(EARLY_DATA) |
+          MBEDTLS_SSL_EXT_MASK(PRE_SHARED_KEY)))) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("second ClientHello does not match the "
+                                  "HelloRetryRequest"));
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_ILLEGAL_PARAMETER,
+                                     MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER);
+        return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
+    }
+
+    MBEDTLS_SSL_DEBUG_MSG(3, ("restore HelloRetryRequest state from cookie"));
+
+    header[0] = MBEDTLS_SSL_HS_MESSAGE_HASH;
+    header[1] = 0;
+    header[2] = 0;
+    header[3] = (unsigned char) hash_len;
+
+    ret = mbedtls_ssl_reset_checksum(ssl);
+    if (ret == 0) {
+        ret = handshake->update_checksum(ssl, header, sizeof(header));
+    }
+    if (ret == 0) {
+        ret = handshake->update_checksum(ssl, cookie + 5, hash_len);
+    }
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "update_checksum", ret);
+        return ret;
+    }
+
+    /* The HelloRetryRequest had our key_share, since the first ClientHello
+     * had no usable one, and echoed this cookie. */
+    handshake->key_exchange_mode = MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL;
+    handshake->offered_group_id = 0;
+    handshake->hrr_selected_group = group;
+    handshake->hrr_cookie = cookie;
+    handshake->hrr_cookie_len = cookie_len;
+
+    ret = mbedtls_ssl_start_handshake_msg(ssl, MBEDTLS_SSL_HS_SERVER_HELLO,
+                                          &buf, &buf_len);
+    if (ret == 0) {
+        ret = ssl_tls13_write_server_hello_body(ssl, buf, buf + buf_len,
+                                                &msg_len, 1);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_add_hs_msg_to_checksum(
+            ssl, MBEDTLS_SSL_HS_SERVER_HELLO, buf, msg_len);
+    }
+
+    handshake->key_exchange_mode = key_exchange_mode;
+    handshake->offered_group_id = offered_group_id;
+    handshake->hrr_cookie = NULL;
+    handshake->hrr_cookie_len = 0;
+
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "ssl_tls13_write_server_hello_body", ret);
+        return ret;
+    }
+
+    handshake->hello_retry_request_flag = 1;
+#if defined(MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE)
+    /* We sent our change_cipher_spec after the HelloRetryRequest. */
+    handshake->ccs_sent = 1;
+#endif
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
                                         const unsigned char *buf,
@@ -1258,12 +1541,17 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
     const unsigned char *cipher_suites;
     const unsigned char *cipher_suites_end;
     size_t extensions_len;
+    const unsigned char *extensions;
     const unsigned char *extensions_end;
     const unsigned char *supported_versions_data;
     const unsigned char *supported_versions_data_end;
     mbedtls_ssl_handshake_params *handshake = ssl->handshake;
     int hrr_required = 0;
     int no_usable_share_for_key_agreement = 0;
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    const unsigned char *cookie = NULL;
+    size_t cookie_len = 0;
+#endif
 
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
     int got_psk = 0;
@@ -1366,42 +1654,48 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
     MBEDTLS_SSL_CHK_BUF_READ_PTR(p + 1, end, p[0] + 2);
 
     /*
-     * Search for the supported versions extension and parse it to determine
-     * if the client supports TLS 1.3.
+     * Index the extensions, then look for the supported versions extension
+     * and parse it to determine if the client supports TLS 1.3. The TLS 1.2
+     * parser reuses the index if it does not.
      */
-    ret = mbedtls_ssl_tls13_is_supported_versions_ext_present_in_exts(
-        ssl, p + 1 + p[0], end,
-        &supported_versions_data, &supported_versions_data_end);
-    if (ret < 0) {
-        MBEDTLS_SSL_DEBUG_RET(1,
-                              ("mbedtls_ssl_tls13_is_supported_versions_ext_present_in_exts"), ret);
+    extensions_len = MBEDTLS_GET_UINT16_BE(p + 1 + p[0], 0);
+    extensions = p + 1 + p[0] + 2;
+    MBEDTLS_SSL_CHK_BUF_READ_PTR(extensions, end, extensions_len);
+    extensions_end = extensions + extensions_len;
+
+    ret = mbedtls_ssl_index_client_hello_exts(&handshake->client_hello_exts,
+                                              extensions, extensions_end);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_index_client_hello_exts", ret);
+        MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR, ret);
         return ret;
     }
 
-    if (ret == 0) {
+    supported_versions_data = mbedtls_ssl_client_hello_ext(
+        &handshake->client_hello_exts, MBEDTLS_SSL_EXT_ID_SUPPORTED_VERSIONS,
+        &supported_versions_data_end);
+    if (supported_versions_data == NULL) {
         return SSL_CLIENT_HELLO_TLS1_2;
     }
 
-    if (ret == 1) {
-        ret = ssl_tls13_parse_supported_versions_ext(ssl,
-                                                     supported_versions_data,
-                                                     supported_versions_data_end);
-        if (ret < 0) {
-            MBEDTLS_SSL_DEBUG_RET(1,
-                                  ("ssl_tls13_parse_supported_versions_ext"), ret);
-            return ret;
-        }
+    ret = ssl_tls13_parse_supported_versions_ext(ssl,
+                                                 supported_versions_data,
+                                                 supported_versions_data_end);
+    if (ret < 0) {
+        MBEDTLS_SSL_DEBUG_RET(1,
+                              ("ssl_tls13_parse_supported_versions_ext"), ret);
+        return ret;
+    }
 
-        /*
-         * The supported versions extension was parsed successfully as the
-         * value returned by ssl_tls13_parse_supported_versions_ext() is
-         * positive. The return value is then equal to
-         * MBEDTLS_SSL_VERSION_TLS1_2 or MBEDTLS_SSL_VERSION_TLS1_3, defining
-         * the TLS version to negotiate.
-         */
-        if (MBEDTLS_SSL_VERSION_TLS1_2 == ret) {
-            return SSL_CLIENT_HELLO_TLS1_2;
-        }
+    /*
+     * The supported versions extension was parsed successfully as the
+     * value returned by ssl_tls13_parse_supported_versions_ext() is
+     * positive. The return value is then equal to
+     * MBEDTLS_SSL_VERSION_TLS1_2 or MBEDTLS_SSL_VERSION_TLS1_3, defining
+     * the TLS version to negotiate.
+     */
+    if (MBEDTLS_SSL_VERSION_TLS1_2 == ret) {
+        return SSL_CLIENT_HELLO_TLS1_2;
     }
 
     /*
@@ -1470,14 +1764,26 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
      *    ExtensionType extension_type;
      *    opaque extension_data<0..2^16-1>;
      * } Extension;
+     *
+     * The list was delimited and its framing checked when indexing it.
      */
-    extensions_len = MBEDTLS_GET_UINT16_BE(p, 0);
-    p += 2;
-    MBEDTLS_SSL_CHK_BUF_READ_PTR(p, end, extensions_len);
-    extensions_end = p + extensions_len;
+    p = extensions;
 
     MBEDTLS_SSL_DEBUG_BUF(3, "client hello extensions", p, extensions_len);
     handshake->received_extensions = MBEDTLS_SSL_EXT_MASK_NONE;
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+    handshake->cert_compression_offered = 0;
+#endif
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    handshake->cli_cert_types = 0;
+    handshake->srv_cert_types = 0;
+#endif
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+    handshake->cached_info_offered = 0;
+#endif
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+    handshake->ocsp_requested = 0;
+#endif
 
     while (p < extensions_end) {
         unsigned int extension_type;
@@ -1506,12 +1812,9 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
             return MBEDTLS_ERR_SSL_ILLEGAL_PARAMETER;
         }
 
-        MBEDTLS_SSL_CHK_BUF_READ_PTR(p, extensions_end, 4);
         extension_type = MBEDTLS_GET_UINT16_BE(p, 0);
         extension_data_len = MBEDTLS_GET_UINT16_BE(p, 2);
         p += 4;
-
-        MBEDTLS_SSL_CHK_BUF_READ_PTR(p, extensions_end, extension_data_len);
         extension_data_end = p + extension_data_len;
 
         ret = mbedtls_ssl_tls13_check_received_extension(
@@ -1663,6 +1966,96 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
                 break;
 #endif /* MBEDTLS_SSL_RECORD_SIZE_LIMIT */
 
+#if defined(MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION)
+            case MBEDTLS_TLS_EXT_COMPRESS_CERTIFICATE:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found compress_certificate extension"));
+
+                ret = ssl_tls13_parse_compress_certificate_ext(
+                    ssl, p, extension_data_end);
+                if (ret != 0) {
+                    MBEDTLS_SSL_DEBUG_RET(
+                        1, "ssl_tls13_parse_compress_certificate_ext", ret);
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_TLS1_3_CERT_COMPRESSION */
+
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+            case MBEDTLS_TLS_EXT_CLI_CERT_TYPE:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found client_certificate_type extension"));
+
+                ret = ssl_tls13_parse_cert_type_ext(
+                    ssl, p, extension_data_end, &handshake->cli_cert_types);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+
+            case MBEDTLS_TLS_EXT_SERV_CERT_TYPE:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found server_certificate_type extension"));
+
+                ret = ssl_tls13_parse_cert_type_ext(
+                    ssl, p, extension_data_end, &handshake->srv_cert_types);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
+#if defined(MBEDTLS_SSL_CACHED_INFO)
+            case MBEDTLS_TLS_EXT_CACHED_INFO:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found cached_info extension"));
+
+                ret = mbedtls_ssl_parse_cached_info_ext(
+                    ssl, p, extension_data_end);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_CACHED_INFO */
+
+#if defined(MBEDTLS_SSL_QUIC)
+            case MBEDTLS_TLS_EXT_QUIC_TRANSPORT_PARAMETERS:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found quic_transport_parameters extension"));
+
+                ret = mbedtls_ssl_tls13_parse_quic_transport_params_ext(
+                    ssl, p, extension_data_end);
+                if (ret != 0) {
+                    return ret;
+                }
+                break;
+#endif /* MBEDTLS_SSL_QUIC */
+
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+            case MBEDTLS_TLS_EXT_COOKIE:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found cookie extension"));
+
+                /* opaque cookie<1..2^16-1> */
+                if (extension_data_len < 3 ||
+                    MBEDTLS_GET_UINT16_BE(p, 0) != extension_data_len - 2) {
+                    MBEDTLS_SSL_PEND_FATAL_ALERT(
+                        MBEDTLS_SSL_ALERT_MSG_DECODE_ERROR,
+                        MBEDTLS_ERR_SSL_DECODE_ERROR);
+                    return MBEDTLS_ERR_SSL_DECODE_ERROR;
+                }
+                cookie = p + 2;
+                cookie_len = extension_data_len - 2;
+                break;
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
+#if defined(MBEDTLS_SSL_OCSP_STAPLING)
+            case MBEDTLS_TLS_EXT_STATUS_REQUEST:
+                MBEDTLS_SSL_DEBUG_MSG(3, ("found status_request extension"));
+
+                /* We staple the response we have, whatever the responders
+                 * and extensions of the request. */
+                if (extension_data_end > p &&
+                    p[0] == MBEDTLS_SSL_CERT_STATUS_TYPE_OCSP) {
+                    handshake->ocsp_requested = 1;
+                }
+                break;
+#endif /* MBEDTLS_SSL_OCSP_STAPLING */
+
             default:
                 MBEDTLS_SSL_PRINT_EXT(
                     3, MBEDTLS_SSL_HS_CLIENT_HELLO,
@@ -1676,6 +2069,25 @@ static int ssl_tls13_parse_client_hello(mbedtls_ssl_context *ssl,
     MBEDTLS_SSL_PRINT_EXTS(3, MBEDTLS_SSL_HS_CLIENT_HELLO,
                            handshake->received_extensions);
 
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_tls13_check_quic_transport_params_ext(ssl);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    /* The second ClientHello after a stateless HelloRetryRequest, or a
+     * cookie we did not ask for. */
+    if (cookie != NULL && !handshake->hello_retry_request_flag &&
+        ssl->conf->f_hrr_cookie_check != NULL) {
+        ret = ssl_tls13_restore_hrr_state(ssl, cookie, cookie_len);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+#endif
+
     ret = mbedtls_ssl_add_hs_hdr_to_checksum(ssl,
                                              MBEDTLS_SSL_HS_CLIENT_HELLO,
                                              p - buf);
@@ -1855,26 +2267,37 @@ static int ssl_tls13_check_early_data_requirements(mbedtls_ssl_context *ssl)
 
 #if defined(MBEDTLS_SSL_ALPN)
     const char *alpn = mbedtls_ssl_get_alpn_protocol(ssl);
-    size_t alpn_len;
-
-    if (alpn == NULL && ssl->session_negotiate->ticket_alpn == NULL) {
-        return 0;
-    }
+    size_t alpn_len = 0;
 
     if (alpn != NULL) {
         alpn_len = strlen(alpn);
     }
 
-    if (alpn == NULL ||
-        ssl->session_negotiate->ticket_alpn == NULL ||
-        alpn_len != strlen(ssl->session_negotiate->ticket_alpn) ||
-        (memcmp(alpn, ssl->session_negotiate->ticket_alpn, alpn_len) != 0)) {
+    if ((alpn != NULL || ssl->session_negotiate->ticket_alpn != NULL) &&
+        (alpn == NULL ||
+         ssl->session_negotiate->ticket_alpn == NULL ||
+         alpn_len != strlen(ssl->session_negotiate->ticket_alpn) ||
+         (memcmp(alpn, ssl->session_negotiate->ticket_alpn, alpn_len) != 0))) {
         MBEDTLS_SSL_DEBUG_MSG(1, ("EarlyData: rejected, the selected ALPN is different "
                                   "from the one associated with the pre-shared key."));
         return -1;
     }
 #endif
 
+    /* RFC 8446 section 8
+     *
+     * Checked last, so that only the attempts that would otherwise be
+     * accepted are recorded.
+     */
+    if (ssl->conf->f_early_data_replay != NULL &&
+        ssl->conf->f_early_data_replay(ssl->conf->p_early_data_replay,
+                                       handshake->early_data_binder,
+                                       handshake->early_data_binder_len) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(
+            1, ("EarlyData: rejected, the ClientHello may be a replay."));
+        return -1;
+    }
+
     return 0;
 }
 #endif /* MBEDTLS_SSL_EARLY_DATA */
@@ -2007,8 +2430,8 @@ static int ssl_tls13_prepare_server_hello(mbedtls_ssl_context *ssl)
     unsigned char *server_randbytes =
         ssl->handshake->randbytes + MBEDTLS_CLIENT_HELLO_RANDOM_LEN;
 
-    if ((ret = ssl->conf->f_rng(ssl->conf->p_rng, server_randbytes,
-                                MBEDTLS_SERVER_HELLO_RANDOM_LEN)) != 0) {
+    if ((ret = ssl->f_rng(ssl->p_rng, server_randbytes,
+                          MBEDTLS_SERVER_HELLO_RANDOM_LEN)) != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "f_rng", ret);
         return ret;
     }
@@ -2236,6 +2659,40 @@ static int ssl_tls13_write_hrr_key_share_ext(mbedtls_ssl_context *ssl,
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+/*
+ * cookie extension of the HelloRetryRequest
+ *
+ *  struct {
+ *      opaque cookie<1..2^16-1>;
+ *  } Cookie;
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_hrr_cookie_ext(mbedtls_ssl_context *ssl,
+                                          unsigned char *buf,
+                                          unsigned char *end,
+                                          size_t *out_len)
+{
+    size_t cookie_len = ssl->handshake->hrr_cookie_len;
+
+    *out_len = 0;
+
+    MBEDTLS_SSL_CHK_BUF_PTR(buf, end, 6 + cookie_len);
+    MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_COOKIE, buf, 0);
+    MBEDTLS_PUT_UINT16_BE(cookie_len + 2, buf, 2);
+    MBEDTLS_PUT_UINT16_BE(cookie_len, buf, 4);
+    memcpy(buf + 6, ssl->handshake->hrr_cookie, cookie_len);
+
+    MBEDTLS_SSL_DEBUG_BUF(3, "HRR cookie", buf + 6, cookie_len);
+
+    *out_len = 6 + cookie_len;
+
+    mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_COOKIE);
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
 /*
  * Structure of ServerHello message:
  *
@@ -2360,6 +2817,16 @@ static int ssl_tls13_write_server_hello_body(mbedtls_ssl_context *ssl,
         p += output_len;
     }
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    if (is_hrr && ssl->handshake->hrr_cookie != NULL) {
+        ret = ssl_tls13_write_hrr_cookie_ext(ssl, p, end, &output_len);
+        if (ret != 0) {
+            return ret;
+        }
+        p += output_len;
+    }
+#endif
+
 #if defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_SOME_PSK_ENABLED)
     if (!is_hrr && mbedtls_ssl_tls13_key_exchange_mode_with_psk(ssl)) {
         ret = ssl_tls13_write_server_pre_shared_key_ext(ssl, p, end, &output_len);
@@ -2413,6 +2880,23 @@ static int ssl_tls13_write_server_hello(mbedtls_ssl_context *ssl)
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write server hello"));
 
+#if defined(MBEDTLS_SSL_HS_ADMISSION)
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
+    /* Pick the certificate now, so that the admission callback knows the
+     * type of key the handshake will sign with. A failure is reported when
+     * the certificate is written. */
+    if (ssl->conf->f_admission != NULL && !ssl->handshake->admitted &&
+        ssl->handshake->key_exchange_mode ==
+        MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL &&
+        ssl_tls13_pick_key_cert(ssl) != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("no certificate for the admission callback"));
+    }
+#endif
+    /* Before the ephemeral key share is generated. */
+    MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_hs_admit(ssl));
+#endif /* MBEDTLS_SSL_HS_ADMISSION */
+
     MBEDTLS_SSL_PROC_CHK(ssl_tls13_prepare_server_hello(ssl));
 
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_start_handshake_msg(
@@ -2477,15 +2961,93 @@ static int ssl_tls13_prepare_hello_retry_request(mbedtls_ssl_context *ssl)
     return 0;
 }
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+/*
+ * Whether the HelloRetryRequest carries our state in a cookie, so that
+ * the context can go once it is sent. That is only for full handshakes:
+ * the early data records that follow the first ClientHello would reach the
+ * next context as garbage, and the PSK binders of the second ClientHello are
+ * checked before the cookie.
+ */
+static int ssl_tls13_hrr_is_stateless(mbedtls_ssl_context *ssl)
+{
+    return ssl->conf->f_hrr_cookie_write != NULL &&
+           ssl->conf->f_hrr_cookie_check != NULL &&
+           (ssl->handshake->received_extensions &
+            (MBEDTLS_SSL_EXT_MASK(EARLY_DATA) |
+             MBEDTLS_SSL_EXT_MASK(PRE_SHARED_KEY))) == 0;
+}
+
+/*
+ * The cookie of a stateless HelloRetryRequest, before the transcript is
+ * reset:
+ *
+ *     uint16 cipher_suite;
+ *     NamedGroup selected_group;
+ *     opaque client_hello_hash<0..255>;   // Hash(ClientHello1)
+ *     opaque mac[...];                     // by f_hrr_cookie_write
+ *
+ * The MAC covers all that precedes it.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_hrr_cookie(mbedtls_ssl_context *ssl,
+                                      unsigned char *buf,
+                                      unsigned char *end,
+                                      size_t *out_len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *p;
+    size_t hash_len;
+
+    MBEDTLS_SSL_CHK_BUF_PTR(buf, end, 5);
+    ret = mbedtls_ssl_get_handshake_transcript(
+        ssl, (mbedtls_md_type_t) ssl->handshake->ciphersuite_info->mac,
+        buf + 5, end - buf - 5, &hash_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "mbedtls_ssl_get_handshake_transcript", ret);
+        return ret;
+    }
+
+    MBEDTLS_PUT_UINT16_BE(ssl->session_negotiate->ciphersuite, buf, 0);
+    MBEDTLS_PUT_UINT16_BE(ssl->handshake->hrr_selected_group, buf, 2);
+    buf[4] = (unsigned char) hash_len;
+
+    p = buf + 5 + hash_len;
+    ret = ssl->conf->f_hrr_cookie_write(ssl->conf->p_hrr_cookie, &p, end,
+                                        buf, 5 + hash_len);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "f_hrr_cookie_write", ret);
+        return ret;
+    }
+
+    *out_len = p - buf;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_hello_retry_request(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     unsigned char *buf;
     size_t buf_len, msg_len;
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    unsigned char cookie[MBEDTLS_SSL_TLS1_3_HRR_COOKIE_MAX_LEN];
+    int stateless = ssl_tls13_hrr_is_stateless(ssl);
+#endif
 
     MBEDTLS_SSL_DEBUG_MSG(2, ("=> write hello retry request"));
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    if (stateless && !ssl->handshake->hello_retry_request_flag) {
+        MBEDTLS_SSL_PROC_CHK(ssl_tls13_write_hrr_cookie(
+                                 ssl, cookie, cookie + sizeof(cookie),
+                                 &ssl->handshake->hrr_cookie_len));
+        ssl->handshake->hrr_cookie = cookie;
+    }
+#endif
+
     MBEDTLS_SSL_PROC_CHK(ssl_tls13_prepare_hello_retry_request(ssl));
 
     MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_start_handshake_msg(
@@ -2512,11 +3074,18 @@ static int ssl_tls13_write_hello_retry_request(mbedtls_ssl_context *ssl)
      */
     mbedtls_ssl_handshake_set_state(
         ssl, MBEDTLS_SSL_SERVER_CCS_AFTER_HELLO_RETRY_REQUEST);
+#elif defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    mbedtls_ssl_handshake_set_state(
+        ssl, stateless ? MBEDTLS_SSL_SERVER_HELLO_VERIFY_REQUEST_SENT :
+        MBEDTLS_SSL_CLIENT_HELLO);
 #else
     mbedtls_ssl_handshake_set_state(ssl, MBEDTLS_SSL_CLIENT_HELLO);
 #endif /* MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE */
 
 cleanup:
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+    ssl->handshake->hrr_cookie = NULL;
+#endif
     MBEDTLS_SSL_DEBUG_MSG(2, ("<= write hello retry request"));
     return ret;
 }
@@ -2525,6 +3094,118 @@ cleanup:
  * Handler for MBEDTLS_SSL_ENCRYPTED_EXTENSIONS
  */
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+/* Whether the client accepts a signature with our raw public key. */
+static int ssl_tls13_rpk_can_sign(mbedtls_ssl_context *ssl)
+{
+    const uint16_t *sig_alg = ssl->handshake->received_sig_algs;
+
+    if (ssl->conf->rpk_key == NULL) {
+        return 0;
+    }
+
+    for (; *sig_alg != MBEDTLS_TLS1_3_SIG_NONE; sig_alg++) {
+        if (mbedtls_ssl_sig_alg_is_offered(ssl, *sig_alg) &&
+            mbedtls_ssl_tls13_sig_alg_for_cert_verify_is_supported(*sig_alg) &&
+            mbedtls_ssl_tls13_check_sig_alg_cert_key_match(*sig_alg,
+                                                           ssl->conf->rpk_key)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Choose the certificate types of the handshake among those the client
+ * offered, and write the server_certificate_type and client_certificate_type
+ * extensions (RFC 7250 section 4.2). We send our raw public key whenever the
+ * client accepts it, and accept the raw public key of the client whenever
+ * we can verify it.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_cert_type_exts(mbedtls_ssl_context *ssl,
+                                          unsigned char *buf,
+                                          const unsigned char *end,
+                                          size_t *out_len)
+{
+    mbedtls_ssl_handshake_params *handshake = ssl->handshake;
+    unsigned char *p = buf;
+    int authmode;
+
+    *out_len = 0;
+
+    if (mbedtls_ssl_tls13_key_exchange_mode_with_psk(ssl)) {
+        return 0;
+    }
+
+    if (handshake->received_extensions & MBEDTLS_SSL_EXT_MASK(SERV_CERT_TYPE)) {
+        if ((handshake->srv_cert_types &
+             (1u << MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY)) &&
+            ssl_tls13_rpk_can_sign(ssl)) {
+            handshake->own_cert_type = MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY;
+        } else if (handshake->srv_cert_types &
+                   (1u << MBEDTLS_TLS_CERT_TYPE_X509)) {
+            handshake->own_cert_type = MBEDTLS_TLS_CERT_TYPE_X509;
+        } else {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("no server certificate type in common"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_CERT,
+                                         MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE);
+            return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("server hello, adding server_certificate_type"
+                                  " extension, type %u",
+                                  (unsigned) handshake->own_cert_type));
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 5);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_SERV_CERT_TYPE, p, 0);
+        MBEDTLS_PUT_UINT16_BE(1, p, 2);
+        p[4] = handshake->own_cert_type;
+        p += 5;
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_SERV_CERT_TYPE);
+    }
+
+#if defined(MBEDTLS_SSL_SERVER_NAME_INDICATION)
+    if (handshake->sni_authmode != MBEDTLS_SSL_VERIFY_UNSET) {
+        authmode = handshake->sni_authmode;
+    } else
+#endif
+    authmode = mbedtls_ssl_get_conf_authmode(ssl);
+
+    /* Only sent along with a CertificateRequest. */
+    if (authmode != MBEDTLS_SSL_VERIFY_NONE &&
+        (handshake->received_extensions & MBEDTLS_SSL_EXT_MASK(CLI_CERT_TYPE))) {
+        if ((handshake->cli_cert_types &
+             (1u << MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY)) &&
+            ssl->conf->f_rpk_vrfy != NULL) {
+            handshake->peer_cert_type = MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY;
+        } else if (handshake->cli_cert_types &
+                   (1u << MBEDTLS_TLS_CERT_TYPE_X509)) {
+            handshake->peer_cert_type = MBEDTLS_TLS_CERT_TYPE_X509;
+        } else {
+            MBEDTLS_SSL_DEBUG_MSG(1, ("no client certificate type in common"));
+            MBEDTLS_SSL_PEND_FATAL_ALERT(MBEDTLS_SSL_ALERT_MSG_UNSUPPORTED_CERT,
+                                         MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE);
+            return MBEDTLS_ERR_SSL_HANDSHAKE_FAILURE;
+        }
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("server hello, adding client_certificate_type"
+                                  " extension, type %u",
+                                  (unsigned) handshake->peer_cert_type));
+        MBEDTLS_SSL_CHK_BUF_PTR(p, end, 5);
+        MBEDTLS_PUT_UINT16_BE(MBEDTLS_TLS_EXT_CLI_CERT_TYPE, p, 0);
+        MBEDTLS_PUT_UINT16_BE(1, p, 2);
+        p[4] = handshake->peer_cert_type;
+        p += 5;
+        mbedtls_ssl_tls13_set_hs_sent_ext_mask(ssl, MBEDTLS_TLS_EXT_CLI_CERT_TYPE);
+    }
+
+    *out_len = p - buf;
+
+    return 0;
+}
+#endif /* MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY */
+
 /*
  * struct {
  *    Extension extensions<0..2 ^ 16 - 1>;
@@ -2583,6 +3264,40 @@ static int ssl_tls13_write_encrypted_extensions_body(mbedtls_ssl_context *ssl,
     }
 #endif
 
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    ret = ssl_tls13_write_cert_type_exts(ssl, p, end, &output_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += output_len;
+#endif
+
+#if defined(MBEDTLS_SSL_QUIC)
+    ret = mbedtls_ssl_tls13_write_quic_transport_params_ext(
+        ssl, p, end, &output_len);
+    if (ret != 0) {
+        return ret;
+    }
+    p += output_len;
+#endif
+
+#if defined(MBEDTLS_SSL_CACHED_INFO) && \
+    defined(MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED)
+    /* The chain is picked here rather than when the Certificate message is
+     * written, to know whether the client has it. */
+    if (!mbedtls_ssl_tls13_key_exchange_mode_with_psk(ssl)
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+        && ssl->handshake->own_cert_type != MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY
+#endif
+        && ssl_tls13_pick_key_cert(ssl) == 0) {
+        ret = mbedtls_ssl_write_cached_info_ext(ssl, p, end, &output_len);
+        if (ret != 0) {
+            return ret;
+        }
+        p += output_len;
+    }
+#endif
+
     extensions_len = (p - p_extensions_len) - 2;
     MBEDTLS_PUT_UINT16_BE(extensions_len, p_extensions_len, 0);
 
@@ -2661,7 +3376,7 @@ static int ssl_tls13_certificate_request_coordinate(mbedtls_ssl_context *ssl)
         authmode = ssl->handshake->sni_authmode;
     } else
 #endif
-    authmode = ssl->conf->authmode;
+    authmode = mbedtls_ssl_get_conf_authmode(ssl);
 
     if (authmode == MBEDTLS_SSL_VERIFY_NONE) {
         ssl->session_negotiate->verify_result = MBEDTLS_X509_BADCERT_SKIP_VERIFY;
@@ -2782,6 +3497,13 @@ static int ssl_tls13_write_server_certificate(mbedtls_ssl_context *ssl)
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C)
+#if defined(MBEDTLS_SSL_TLS1_3_RAW_PUBLIC_KEY)
+    /* The key was matched with the signature algorithms of the client when
+     * the certificate types were chosen. */
+    if (ssl->handshake->own_cert_type == MBEDTLS_TLS_CERT_TYPE_RAW_PUBLIC_KEY) {
+        MBEDTLS_SSL_DEBUG_MSG(3, ("send raw public key"));
+    } else
+#endif
     if ((ssl_tls13_pick_key_cert(ssl) != 0) ||
         mbedtls_ssl_own_cert(ssl) == NULL) {
         MBEDTLS_SSL_DEBUG_MSG(2, ("No certificate available."));
@@ -3046,8 +3768,20 @@ static int ssl_tls13_process_end_of_early_data(mbedtls_ssl_context *ssl)
         ssl_tls13_prepare_for_handshake_second_flight(ssl);
 
     } else if (ret == SSL_GOT_EARLY_DATA) {
-        ret = MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA;
-        goto cleanup;
+        if (ssl->conf->f_early_data == NULL) {
+            ret = MBEDTLS_ERR_SSL_RECEIVED_EARLY_DATA;
+            goto cleanup;
+        }
+
+        /* Hand the record over in place, and stay in this state for the
+         * next one. */
+        ret = ssl->conf->f_early_data(ssl->conf->p_early_data, ssl,
+                                      ssl->in_offt, ssl->in_msglen);
+        mbedtls_ssl_consume_application_data(ssl, ssl->in_msglen);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "f_early_data", ret);
+            goto cleanup;
+        }
     } else {
         MBEDTLS_SSL_DEBUG_MSG(1, ("should never happen"));
         ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
@@ -3121,7 +3855,8 @@ MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_write_new_session_ticket_coordinate(mbedtls_ssl_context *ssl)
 {
     /* Check whether the use of session tickets is enabled */
-    if (ssl->conf->f_ticket_write == NULL) {
+    if (ssl->conf->f_ticket_write == NULL &&
+        !ssl_tls13_stateful_tickets_enabled(ssl)) {
         MBEDTLS_SSL_DEBUG_MSG(2, ("NewSessionTicket: disabled,"
                                   " callback is not set"));
         return SSL_NEW_SESSION_TICKET_SKIP;
@@ -3138,11 +3873,23 @@ static int ssl_tls13_write_new_session_ticket_coordinate(mbedtls_ssl_context *ss
         return SSL_NEW_SESSION_TICKET_SKIP;
     }
 
+    if (ssl->handshake->resume && ssl->handshake->ticket_fresh) {
+        MBEDTLS_SSL_DEBUG_MSG(2, ("NewSessionTicket: the ticket of the "
+                                  "session is fresh"));
+        return SSL_NEW_SESSION_TICKET_SKIP;
+    }
+
     return SSL_NEW_SESSION_TICKET_WRITE;
 }
 
+/*
+ * Prepare ssl->session for the next ticket. \p random holds the 4 bytes of
+ * ticket_age_add followed by the ticket_nonce_size bytes of the nonce, so
+ * that the random data for a batch of tickets is generated at once.
+ */
 MBEDTLS_CHECK_RETURN_CRITICAL
 static int ssl_tls13_prepare_new_session_ticket(mbedtls_ssl_context *ssl,
+                                                const unsigned char *random,
                                                 unsigned char *ticket_nonce,
                                                 size_t ticket_nonce_size)
 {
@@ -3182,22 +3929,14 @@ static int ssl_tls13_prepare_new_session_ticket(mbedtls_ssl_context *ssl,
     }
 #endif
 
-    /* Generate ticket_age_add */
-    if ((ret = ssl->conf->f_rng(ssl->conf->p_rng,
-                                (unsigned char *) &session->ticket_age_add,
-                                sizeof(session->ticket_age_add)) != 0)) {
-        MBEDTLS_SSL_DEBUG_RET(1, "generate_ticket_age_add", ret);
-        return ret;
-    }
+    /* Set ticket_age_add */
+    memcpy(&session->ticket_age_add, random, sizeof(session->ticket_age_add));
     MBEDTLS_SSL_DEBUG_MSG(3, ("ticket_age_add: %u",
                               (unsigned int) session->ticket_age_add));
 
-    /* Generate ticket_nonce */
-    ret = ssl->conf->f_rng(ssl->conf->p_rng, ticket_nonce, ticket_nonce_size);
-    if (ret != 0) {
-        MBEDTLS_SSL_DEBUG_RET(1, "generate_ticket_nonce", ret);
-        return ret;
-    }
+    /* Set ticket_nonce */
+    memcpy(ticket_nonce, random + sizeof(session->ticket_age_add),
+           ticket_nonce_size);
     MBEDTLS_SSL_DEBUG_BUF(3, "ticket_nonce:",
                           ticket_nonce, ticket_nonce_size);
 
@@ -3246,6 +3985,42 @@ static int ssl_tls13_prepare_new_session_ticket(mbedtls_ssl_context *ssl,
     return 0;
 }
 
+/*
+ * Store the session in the cache under a random identifier, which is
+ * written as the ticket.
+ */
+MBEDTLS_CHECK_RETURN_CRITICAL
+static int ssl_tls13_write_stateful_ticket(mbedtls_ssl_context *ssl,
+                                           const mbedtls_ssl_session *session,
+                                           unsigned char *buf,
+                                           unsigned char *end,
+                                           size_t *ticket_len,
+                                           uint32_t *ticket_lifetime)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    MBEDTLS_SSL_CHK_BUF_PTR(buf, end, SSL_TLS1_3_STATEFUL_TICKET_LEN);
+
+    ret = ssl->f_rng(ssl->p_rng, buf,
+                     SSL_TLS1_3_STATEFUL_TICKET_LEN);
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = ssl->conf->f_set_cache(ssl->conf->p_cache, buf,
+                                 SSL_TLS1_3_STATEFUL_TICKET_LEN, session);
+    MBEDTLS_SSL_PROBE2(cache_set, ssl, ret);
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_MSG(1, ("cache did not store session"));
+        return ret < 0 ? ret : MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+    }
+
+    *ticket_len = SSL_TLS1_3_STATEFUL_TICKET_LEN;
+    *ticket_lifetime = ssl->conf->tls13_stateful_ticket_lifetime;
+
+    return 0;
+}
+
 /* This function creates a NewSessionTicket message in the following format:
  *
  * struct {
@@ -3260,6 +4035,9 @@ static int ssl_tls13_prepare_new_session_ticket(mbedtls_ssl_context *ssl,
  * carrying the necessary information so that the server is later able to
  * re-start the communication.
  *
+ * With mbedtls_ssl_conf_tls13_stateful_tickets(), the ticket is instead a
+ * random identifier under which the session is stored in the session cache.
+ *
  * The following fields are placed inside the ticket by the
  * f_ticket_write() function:
  *
@@ -3301,12 +4079,20 @@ static int ssl_tls13_write_new_session_ticket_body(mbedtls_ssl_context *ssl,
 #if defined(MBEDTLS_HAVE_TIME)
     session->ticket_creation_time = mbedtls_ms_time();
 #endif
-    ret = ssl->conf->f_ticket_write(ssl->conf->p_ticket,
-                                    session,
-                                    p + 9 + ticket_nonce_size + 2,
-                                    end,
-                                    &ticket_len,
-                                    &ticket_lifetime);
+    if (ssl_tls13_stateful_tickets_enabled(ssl)) {
+        ret = ssl_tls13_write_stateful_ticket(ssl, session,
+                                              p + 9 + ticket_nonce_size + 2,
+                                              end,
+                                              &ticket_len,
+                                              &ticket_lifetime);
+    } else {
+        ret = ssl->conf->f_ticket_write(ssl->conf->p_ticket,
+                                        session,
+                                        p + 9 + ticket_nonce_size + 2,
+                                        end,
+                                        &ticket_len,
+                                        &ticket_lifetime);
+    }
     if (ret != 0) {
         MBEDTLS_SSL_DEBUG_RET(1, "write_ticket", ret);
         return ret;
@@ -3391,7 +4177,15 @@ static int ssl_tls13_write_new_session_ticket_body(mbedtls_ssl_context *ssl,
 
 /*
  * Handler for MBEDTLS_SSL_TLS1_3_NEW_SESSION_TICKET
+ *
+ * When several tickets are to be sent, up to SSL_NEW_SESSION_TICKET_BATCH of
+ * them are issued together: their random data is generated at once, and the
+ * NewSessionTicket messages are coalesced into as few records as the
+ * maximum record payload allows, rather than one record each.
  */
+#define SSL_NEW_SESSION_TICKET_BATCH 8
+#define SSL_NEW_SESSION_TICKET_RANDOM_LEN \
+    (4 + MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH)
 static int ssl_tls13_write_new_session_ticket(mbedtls_ssl_context *ssl)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
@@ -3399,32 +4193,83 @@ static int ssl_tls13_write_new_session_ticket(mbedtls_ssl_context *ssl)
     MBEDTLS_SSL_PROC_CHK_NEG(ssl_tls13_write_new_session_ticket_coordinate(ssl));
 
     if (ret == SSL_NEW_SESSION_TICKET_WRITE) {
+        unsigned char random[SSL_NEW_SESSION_TICKET_BATCH *
+                             SSL_NEW_SESSION_TICKET_RANDOM_LEN];
         unsigned char ticket_nonce[MBEDTLS_SSL_TLS1_3_TICKET_NONCE_LENGTH];
         unsigned char *buf;
-        size_t buf_len, msg_len;
+        size_t buf_len, msg_len, offset = 0;
+        unsigned count, written = 0;
+        int max_payload;
 
-        MBEDTLS_SSL_PROC_CHK(ssl_tls13_prepare_new_session_ticket(
-                                 ssl, ticket_nonce, sizeof(ticket_nonce)));
+        /* Limit session tickets count to one when resumption connection.
+         *
+         * See document of mbedtls_ssl_conf_new_session_tickets.
+         */
+        count = ssl->handshake->resume == 1 ?
+                1 : ssl->handshake->new_session_tickets_count;
+        if (count > SSL_NEW_SESSION_TICKET_BATCH) {
+            count = SSL_NEW_SESSION_TICKET_BATCH;
+        }
+
+        max_payload = mbedtls_ssl_get_max_out_record_payload(ssl);
+        if (max_payload < 0) {
+            ret = max_payload;
+            goto cleanup;
+        }
+
+        ret = ssl->f_rng(ssl->p_rng, random,
+                         count * SSL_NEW_SESSION_TICKET_RANDOM_LEN);
+        if (ret != 0) {
+            MBEDTLS_SSL_DEBUG_RET(1, "generate ticket random data", ret);
+            goto cleanup;
+        }
 
         MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_start_handshake_msg(
                                  ssl, MBEDTLS_SSL_HS_NEW_SESSION_TICKET,
                                  &buf, &buf_len));
+        buf = ssl->out_msg;
+        buf_len = (size_t) max_payload;
+
+        while (written < count && buf_len - offset > 4) {
+            MBEDTLS_SSL_PROC_CHK(ssl_tls13_prepare_new_session_ticket(
+                                     ssl,
+                                     random + written * SSL_NEW_SESSION_TICKET_RANDOM_LEN,
+                                     ticket_nonce, sizeof(ticket_nonce)));
+
+            ret = ssl_tls13_write_new_session_ticket_body(
+                ssl, buf + offset + 4, buf + buf_len, &msg_len,
+                ticket_nonce, sizeof(ticket_nonce));
+            if (ret == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL && written > 0) {
+                /* The record is full, send the rest in the next one. */
+                break;
+            }
+            if (ret != 0) {
+                goto cleanup;
+            }
 
-        MBEDTLS_SSL_PROC_CHK(ssl_tls13_write_new_session_ticket_body(
-                                 ssl, buf, buf + buf_len, &msg_len,
-                                 ticket_nonce, sizeof(ticket_nonce)));
+            buf[offset] = MBEDTLS_SSL_HS_NEW_SESSION_TICKET;
+            MBEDTLS_PUT_UINT24_BE(msg_len, buf, offset + 1);
+            offset += 4 + msg_len;
+            written++;
+        }
 
-        MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_finish_handshake_msg(
-                                 ssl, buf_len, msg_len));
+        if (written == 0) {
+            ret = MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL;
+            goto cleanup;
+        }
+
+        /* NewSessionTicket is not part of the transcript, so the messages
+         * go straight to the record layer. */
+        ssl->out_msglen = offset;
+        MBEDTLS_SSL_PROC_CHK(mbedtls_ssl_write_record(ssl, 0));
+
+        MBEDTLS_SSL_DEBUG_MSG(3, ("sent %u NewSessionTicket messages in one record",
+                                  written));
 
-        /* Limit session tickets count to one when resumption connection.
-         *
-         * See document of mbedtls_ssl_conf_new_session_tickets.
-         */
         if (ssl->handshake->resume == 1) {
             ssl->handshake->new_session_tickets_count = 0;
         } else {
-            ssl->handshake->new_session_tickets_count--;
+            ssl->handshake->new_session_tickets_count -= written;
         }
 
         mbedtls_ssl_handshake_set_state(
@@ -3509,6 +4354,13 @@ int mbedtls_ssl_tls13_handshake_server_step(mbedtls_ssl_context *ssl)
         case MBEDTLS_SSL_SERVER_CCS_AFTER_HELLO_RETRY_REQUEST:
             ret = mbedtls_ssl_tls13_write_change_cipher_spec(ssl);
             if (ret == 0) {
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+                if (ssl_tls13_hrr_is_stateless(ssl)) {
+                    mbedtls_ssl_handshake_set_state(
+                        ssl, MBEDTLS_SSL_SERVER_HELLO_VERIFY_REQUEST_SENT);
+                    break;
+                }
+#endif
                 mbedtls_ssl_handshake_set_state(ssl, MBEDTLS_SSL_CLIENT_HELLO);
             }
             break;
@@ -3522,6 +4374,18 @@ int mbedtls_ssl_tls13_handshake_server_step(mbedtls_ssl_context *ssl)
             break;
 #endif /* MBEDTLS_SSL_TLS1_3_COMPATIBILITY_MODE */
 
+#if defined(MBEDTLS_SSL_TLS1_3_STATELESS_HRR)
+        case MBEDTLS_SSL_SERVER_HELLO_VERIFY_REQUEST_SENT:
+            /* Our state is in the cookie: once the HelloRetryRequest is out,
+             * the context can be reset or freed. */
+            ret = mbedtls_ssl_flush_output(ssl);
+            if (ret == 0) {
+                MBEDTLS_SSL_DEBUG_MSG(2, ("stateless HelloRetryRequest sent"));
+                ret = MBEDTLS_ERR_SSL_HELLO_VERIFY_REQUIRED;
+            }
+            break;
+#endif /* MBEDTLS_SSL_TLS1_3_STATELESS_HRR */
+
         case MBEDTLS_SSL_SERVER_FINISHED:
             ret = ssl_tls13_write_server_finished(ssl);
             break;
@@ -3544,7 +4408,7 @@ int mbedtls_ssl_tls13_handshake_server_step(mbedtls_ssl_context *ssl)
         case MBEDTLS_SSL_CLIENT_CERTIFICATE:
             ret = mbedtls_ssl_tls13_process_certificate(ssl);
             if (ret == 0) {
-                if (ssl->session_negotiate->peer_cert != NULL) {
+                if (mbedtls_ssl_tls13_peer_key(ssl) != NULL) {
                     mbedtls_ssl_handshake_set_state(
                         ssl, MBEDTLS_SSL_CLIENT_CERTIFICATE_VERIFY);
                 } else {
@@ -0,0 +1,406 @@
+/*
+ *  Client-side pool of connections established ahead of use
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+/*
+ * A fixed array of connections, each in one of the states below. The mutex
+ * only guards the states: a connection being set up is owned by the thread
+ * in mbedtls_ssl_warm_pool_prewarm(), and an acquired one by the
+ * application, so nothing else touches them until they change state again.
+ */
+
+#include "ssl_misc.h"
+
+#if defined(MBEDTLS_SSL_WARM_POOL_C)
+
+#include "mbedtls/platform.h"
+
+#include "mbedtls/ssl_warm_pool.h"
+#include "mbedtls/error.h"
+#include "mbedtls/platform_util.h"
+#include "debug_internal.h"
+
+#include <string.h>
+
+/* Each connection holds a socket and a whole SSL context, so this is
+ * already more than the file descriptors most processes may open. */
+#define SSL_WARM_POOL_MAX_CONNS (1u << 16)
+
+#define SSL_WARM_CONN_FREE          0
+#define SSL_WARM_CONN_CONNECTING    1
+#define SSL_WARM_CONN_HANDSHAKE     2
+#define SSL_WARM_CONN_READY         3
+#define SSL_WARM_CONN_ACQUIRED      4
+
+void mbedtls_ssl_warm_pool_init(mbedtls_ssl_warm_pool *pool)
+{
+    memset(pool, 0, sizeof(mbedtls_ssl_warm_pool));
+
+    pool->idle_timeout = MBEDTLS_SSL_WARM_POOL_DEFAULT_IDLE_TIMEOUT;
+    pool->connect_timeout = MBEDTLS_SSL_WARM_POOL_DEFAULT_CONNECT_TIMEOUT;
+}
+
+int mbedtls_ssl_warm_pool_setup(mbedtls_ssl_warm_pool *pool,
+                                const mbedtls_ssl_config *conf,
+                                size_t max_conns)
+{
+    if (pool->conns != NULL || conf == NULL ||
+        conf->endpoint != MBEDTLS_SSL_IS_CLIENT ||
+        conf->transport != MBEDTLS_SSL_TRANSPORT_STREAM ||
+        max_conns == 0 || max_conns > SSL_WARM_POOL_MAX_CONNS) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+    pool->conns = mbedtls_calloc(max_conns, sizeof(mbedtls_ssl_warm_conn));
+    if (pool->conns == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    pool->conf = conf;
+    pool->max_conns = max_conns;
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&pool->mutex);
+#endif
+
+    return 0;
+}
+
+void mbedtls_ssl_warm_pool_set_idle_timeout(mbedtls_ssl_warm_pool *pool,
+                                            uint32_t timeout)
+{
+    pool->idle_timeout = timeout;
+}
+
+void mbedtls_ssl_warm_pool_set_connect_timeout(mbedtls_ssl_warm_pool *pool,
+                                               uint32_t timeout)
+{
+    pool->connect_timeout = timeout;
+}
+
+/*
+ * Close a connection and make its place free. The close_notify alert is
+ * sent without waiting: if the socket would block, the server sees the
+ * TCP connection close instead.
+ */
+static void ssl_warm_conn_close(mbedtls_ssl_warm_conn *conn, int notify)
+{
+    if (notify) {
+        (void) mbedtls_ssl_close_notify(&conn->ssl);
+    }
+    mbedtls_ssl_free(&conn->ssl);
+    mbedtls_net_free(&conn->net);
+    mbedtls_free(conn->host);
+    conn->host = NULL;
+    conn->state = SSL_WARM_CONN_FREE;
+}
+
+/*
+ * Take a free place, or else the place of the established connection that
+ * would time out first.
+ */
+static mbedtls_ssl_warm_conn *ssl_warm_pool_take(mbedtls_ssl_warm_pool *pool)
+{
+    mbedtls_ssl_warm_conn *victim = NULL;
+    size_t i;
+
+    for (i = 0; i < pool->max_conns; i++) {
+        mbedtls_ssl_warm_conn *conn = &pool->conns[i];
+
+        if (conn->state == SSL_WARM_CONN_FREE) {
+            return conn;
+        }
+        if (conn->state == SSL_WARM_CONN_READY &&
+            (victim == NULL || conn->deadline < victim->deadline)) {
+            victim = conn;
+        }
+    }
+
+    if (victim != NULL) {
+        ssl_warm_conn_close(victim, 1);
+    }
+
+    return victim;
+}
+
+int mbedtls_ssl_warm_pool_prewarm(mbedtls_ssl_warm_pool *pool,
+                                  const char *host, uint16_t port)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_ssl_warm_conn *conn;
+    mbedtls_ssl_context *ssl;
+    mbedtls_ms_time_t start = mbedtls_ms_time();
+    char port_str[6];
+    size_t host_len;
+    int ready = 0;
+
+    if (pool->conns == NULL || host == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+    host_len = strlen(host);
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    conn = ssl_warm_pool_take(pool);
+    if (conn != NULL) {
+        conn->state = SSL_WARM_CONN_CONNECTING;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (conn == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    /* The pool lock is not held while connecting, which may take a while. */
+    ssl = &conn->ssl;
+    mbedtls_net_init(&conn->net);
+    mbedtls_ssl_init(ssl);
+    conn->port = port;
+    conn->host = mbedtls_calloc(1, host_len + 1);
+    if (conn->host == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+    memcpy(conn->host, host, host_len);
+
+    mbedtls_snprintf(port_str, sizeof(port_str), "%u", (unsigned) port);
+    if ((ret = mbedtls_net_connect_timeout(&conn->net, host, port_str,
+                                           MBEDTLS_NET_PROTO_TCP, 0,
+                                           pool->connect_timeout)) != 0 ||
+        (ret = mbedtls_net_set_nonblock(&conn->net)) != 0 ||
+        (ret = mbedtls_ssl_setup(ssl, pool->conf)) != 0 ||
+        (ret = mbedtls_ssl_set_hostname(ssl, host)) != 0) {
+        goto exit;
+    }
+#if defined(MBEDTLS_SSL_SESSION_STORE_C)
+    mbedtls_ssl_set_server_port(ssl, port);
+#endif
+    mbedtls_ssl_set_bio(ssl, &conn->net,
+                        mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    ret = mbedtls_ssl_handshake(ssl);
+    if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        ret = 0;
+    } else if (ret == 0) {
+        start = mbedtls_ms_time();
+        ready = 1;
+    }
+
+exit:
+    if (ret != 0) {
+        MBEDTLS_SSL_DEBUG_RET(1, "warm pool connection", ret);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    {
+        int lock_ret = mbedtls_mutex_lock(&pool->mutex);
+        if (lock_ret != 0) {
+            return lock_ret;
+        }
+    }
+#endif
+
+    if (ret != 0) {
+        ssl_warm_conn_close(conn, 0);
+    } else {
+        conn->deadline = start + pool->idle_timeout;
+        conn->state = ready ? SSL_WARM_CONN_READY : SSL_WARM_CONN_HANDSHAKE;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_warm_pool_run(mbedtls_ssl_warm_pool *pool)
+{
+    int ret;
+    int pending = 0;
+    mbedtls_ms_time_t now;
+    size_t i;
+
+    if (pool->conns == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    now = mbedtls_ms_time();
+    for (i = 0; i < pool->max_conns; i++) {
+        mbedtls_ssl_warm_conn *conn = &pool->conns[i];
+        mbedtls_ssl_context *ssl = &conn->ssl;
+
+        if (conn->state == SSL_WARM_CONN_HANDSHAKE) {
+            ret = mbedtls_ssl_handshake(ssl);
+            if (ret == 0) {
+                conn->deadline = now + pool->idle_timeout;
+                conn->state = SSL_WARM_CONN_READY;
+            } else if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
+                       ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                MBEDTLS_SSL_DEBUG_RET(1, "warm pool handshake", ret);
+                ssl_warm_conn_close(conn, 0);
+            } else if (now >= conn->deadline) {
+                ssl_warm_conn_close(conn, 1);
+            } else {
+                pending++;
+            }
+        } else if (conn->state == SSL_WARM_CONN_READY) {
+            if (now >= conn->deadline) {
+                ssl_warm_conn_close(conn, 1);
+                continue;
+            }
+
+            /* Take in post-handshake messages, and the Finished message of
+             * a False Start, while leaving any application data to the
+             * application. */
+            ret = mbedtls_ssl_read(ssl, NULL, 0);
+            if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+                ssl_warm_conn_close(conn, 1);
+            } else if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+                       ret != MBEDTLS_ERR_SSL_WANT_WRITE &&
+                       ret != MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+                MBEDTLS_SSL_DEBUG_RET(1, "warm pool read", ret);
+                ssl_warm_conn_close(conn, 0);
+            }
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return pending;
+}
+
+int mbedtls_ssl_warm_pool_acquire(mbedtls_ssl_warm_pool *pool,
+                                  const char *host, uint16_t port,
+                                  mbedtls_ssl_context **ssl,
+                                  mbedtls_net_context **net)
+{
+    int ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+    mbedtls_ms_time_t now;
+    size_t i;
+
+    if (pool->conns == NULL || host == NULL || ssl == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+    ret = MBEDTLS_ERR_SSL_CACHE_ENTRY_NOT_FOUND;
+#endif
+
+    now = mbedtls_ms_time();
+    for (i = 0; i < pool->max_conns; i++) {
+        mbedtls_ssl_warm_conn *conn = &pool->conns[i];
+
+        if (conn->state != SSL_WARM_CONN_READY || conn->port != port ||
+            strcmp(conn->host, host) != 0) {
+            continue;
+        }
+        if (now >= conn->deadline) {
+            ssl_warm_conn_close(conn, 1);
+            continue;
+        }
+
+        conn->state = SSL_WARM_CONN_ACQUIRED;
+        *ssl = &conn->ssl;
+        if (net != NULL) {
+            *net = &conn->net;
+        }
+        ret = 0;
+        break;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+int mbedtls_ssl_warm_pool_release(mbedtls_ssl_warm_pool *pool,
+                                  mbedtls_ssl_context *ssl)
+{
+    int ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    size_t i;
+
+    if (pool->conns == NULL || ssl == NULL) {
+        return MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&pool->mutex)) != 0) {
+        return ret;
+    }
+    ret = MBEDTLS_ERR_SSL_BAD_INPUT_DATA;
+#endif
+
+    for (i = 0; i < pool->max_conns; i++) {
+        mbedtls_ssl_warm_conn *conn = &pool->conns[i];
+
+        if (conn->state == SSL_WARM_CONN_ACQUIRED && &conn->ssl == ssl) {
+            ssl_warm_conn_close(conn, 1);
+            ret = 0;
+            break;
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&pool->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return ret;
+}
+
+void mbedtls_ssl_warm_pool_free(mbedtls_ssl_warm_pool *pool)
+{
+    size_t i;
+
+    if (pool == NULL) {
+        return;
+    }
+
+    if (pool->conns != NULL) {
+        for (i = 0; i < pool->max_conns; i++) {
+            if (pool->conns[i].state != SSL_WARM_CONN_FREE) {
+                ssl_warm_conn_close(&pool->conns[i], 1);
+            }
+        }
+#if defined(MBEDTLS_THREADING_C)
+        mbedtls_mutex_free(&pool->mutex);
+#endif
+    }
+
+    mbedtls_free(pool->conns);
+
+    mbedtls_platform_zeroize(pool, sizeof(mbedtls_ssl_warm_pool));
+}
+
+#endif /* MBEDTLS_SSL_WARM_POOL_C */
@@ -5,12 +5,21 @@
  *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
  */
 
+/* Enable definition of clock_gettime() even when compiling with -std=c99.
+ * Must be set before mbedtls_config.h, which pulls in glibc's features.h
+ * indirectly. Harmless on other platforms. */
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "ssl_misc.h"
 
 #if defined(MBEDTLS_TIMING_C)
 
 #include "mbedtls/timing.h"
 
+#include <string.h>
+
 #if !defined(MBEDTLS_TIMING_ALT)
 
 #if !defined(unix) && !defined(__unix__) && !defined(__unix) && \
@@ -37,9 +46,17 @@ struct _hr_time {
  * platform matches the ifdefs above, it will be used. */
 #include <time.h>
 #include <sys/time.h>
+/* Prefer a clock that does not jump when the wall-clock time is set. */
+#if defined(CLOCK_MONOTONIC)
+#define TIMING_HAVE_MONOTONIC
+struct _hr_time {
+    struct timespec start;
+};
+#else
 struct _hr_time {
     struct timeval start;
 };
+#endif
 #endif /* _WIN32 && !EFIX64 && !EFI32 */
 
 /**
@@ -81,6 +98,42 @@ unsigned long mbedtls_timing_get_timer(struct mbedtls_timing_hr_time *val, int r
     }
 }
 
+uint64_t mbedtls_timing_get_monotonic_ms(void)
+{
+    LARGE_INTEGER now, hfreq;
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&hfreq);
+    return (uint64_t) (now.QuadPart / hfreq.QuadPart) * 1000u +
+           (uint64_t) (now.QuadPart % hfreq.QuadPart) * 1000u /
+           (uint64_t) hfreq.QuadPart;
+}
+
+#elif defined(TIMING_HAVE_MONOTONIC)
+
+unsigned long mbedtls_timing_get_timer(struct mbedtls_timing_hr_time *val, int reset)
+{
+    struct _hr_time *t = (struct _hr_time *) val;
+
+    if (reset) {
+        clock_gettime(CLOCK_MONOTONIC, &t->start);
+        return 0;
+    } else {
+        unsigned long delta;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        delta = (now.tv_sec  - t->start.tv_sec) * 1000ul
+                + (now.tv_nsec - t->start.tv_nsec) / 1000000;
+        return delta;
+    }
+}
+
+uint64_t mbedtls_timing_get_monotonic_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000u + (uint64_t) now.tv_nsec / 1000000u;
+}
+
 #else /* _WIN32 && !EFIX64 && !EFI32 */
 
 unsigned long mbedtls_timing_get_timer(struct mbedtls_timing_hr_time *val, int reset)
@@ -100,6 +153,14 @@ unsigned long mbedtls_timing_get_timer(struct mbedtls_timing_hr_time *val, int r
     }
 }
 
+/* No monotonic clock: the best we can do is the wall-clock time. */
+uint64_t mbedtls_timing_get_monotonic_ms(void)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    return (uint64_t) now.tv_sec * 1000u + (uint64_t) now.tv_usec / 1000u;
+}
+
 #endif /* _WIN32 && !EFIX64 && !EFI32 */
 
 /*
@@ -150,5 +211,337 @@ uint32_t mbedtls_timing_get_final_delay(
 {
     return data->fin_ms;
 }
+
 #endif /* !MBEDTLS_TIMING_ALT */
+
+#if defined(MBEDTLS_TIMING_WHEEL)
+/*
+ * Hierarchical timer wheel
+ *
+ * Each slot of level L spans 64^L ticks. A timer due in less than 64 ticks
+ * is kept in level 0, in the slot of the tick it is due. A timer due later
+ * is kept in the lowest level whose span covers its delay, and is moved
+ * down ("cascaded") when the wheel reaches the start of its slot. A bitmap
+ * of the non-empty slots of each level lets the wheel jump straight to the
+ * next tick where something happens.
+ */
+#define WHEEL_BITS          MBEDTLS_TIMING_WHEEL_SLOT_BITS
+#define WHEEL_MASK          (MBEDTLS_TIMING_WHEEL_SLOTS - 1)
+#define WHEEL_MAX_DELTA     ((uint64_t) 1 << (WHEEL_BITS * MBEDTLS_TIMING_WHEEL_LEVELS))
+
+/* Milliseconds since the wheel was set up */
+static uint64_t wheel_clock(mbedtls_timing_wheel *wheel)
+{
+#if !defined(MBEDTLS_TIMING_ALT)
+    return mbedtls_timing_get_monotonic_ms() - wheel->origin;
+#else
+    return mbedtls_timing_get_timer(&wheel->clock, 0);
+#endif
+}
+
+/* Index of the lowest set bit of x, which must not be 0 */
+static unsigned wheel_ctz(uint64_t x)
+{
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static void wheel_insert(mbedtls_timing_wheel *wheel,
+                         mbedtls_timing_wheel_timer *timer, uint64_t expires)
+{
+    uint64_t delta = expires - wheel->tick;
+    unsigned level = 0;
+    unsigned slot;
+
+    if (delta >= WHEEL_MAX_DELTA) {
+        /* Wake up at the end of the range, and wait some more then. */
+        delta = WHEEL_MAX_DELTA - 1;
+        expires = wheel->tick + delta;
+    }
+
+    while (level < MBEDTLS_TIMING_WHEEL_LEVELS - 1 &&
+           delta >= ((uint64_t) 1 << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+    slot = (unsigned) (expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+
+    timer->expires = expires;
+    timer->slot = (int) ((level << WHEEL_BITS) | slot);
+    timer->prev = NULL;
+    timer->next = wheel->slots[level][slot];
+    if (timer->next != NULL) {
+        timer->next->prev = timer;
+    }
+    wheel->slots[level][slot] = timer;
+    wheel->occupied[level] |= (uint64_t) 1 << slot;
+    wheel->count++;
+}
+
+static void wheel_remove(mbedtls_timing_wheel *wheel,
+                         mbedtls_timing_wheel_timer *timer)
+{
+    unsigned level = (unsigned) timer->slot >> WHEEL_BITS;
+    unsigned slot = (unsigned) timer->slot & WHEEL_MASK;
+
+    if (timer->prev != NULL) {
+        timer->prev->next = timer->next;
+    } else {
+        wheel->slots[level][slot] = timer->next;
+        if (timer->next == NULL) {
+            wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+        }
+    }
+    if (timer->next != NULL) {
+        timer->next->prev = timer->prev;
+    }
+
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->slot = -1;
+    wheel->count--;
+}
+
+/* Queue a timer for its final deadline. */
+static void wheel_arm(mbedtls_timing_wheel *wheel,
+                      mbedtls_timing_wheel_timer *timer)
+{
+    uint64_t expires = (timer->fin_at + wheel->tick_ms - 1) / wheel->tick_ms;
+
+    if (expires <= wheel->tick) {
+        expires = wheel->tick + 1;
+    }
+    wheel_insert(wheel, timer, expires);
+}
+
+/* The first tick after the current one where a level 0 slot expires or a
+ * higher level slot is cascaded, or UINT64_MAX if the wheel is empty. */
+static uint64_t wheel_next_tick(const mbedtls_timing_wheel *wheel)
+{
+    uint64_t next = UINT64_MAX;
+    unsigned level;
+
+    for (level = 0; level < MBEDTLS_TIMING_WHEEL_LEVELS; level++) {
+        unsigned shift = WHEEL_BITS * level;
+        uint64_t cur = wheel->tick >> shift;
+        uint64_t occupied = wheel->occupied[level];
+        unsigned start;
+        uint64_t candidate;
+
+        if (occupied == 0) {
+            continue;
+        }
+
+        /* Rotate, so that bit 0 is the slot after the current one. */
+        start = (unsigned) ((cur + 1) & WHEEL_MASK);
+        if (start != 0) {
+            occupied = (occupied >> start) |
+                       (occupied << (MBEDTLS_TIMING_WHEEL_SLOTS - start));
+        }
+
+        candidate = (cur + 1 + wheel_ctz(occupied)) << shift;
+        if (candidate < next) {
+            next = candidate;
+        }
+    }
+
+    return next;
+}
+
+/* Move the timers of the higher level slots that start at the current
+ * tick down the wheel. */
+static void wheel_cascade(mbedtls_timing_wheel *wheel)
+{
+    unsigned level;
+
+    for (level = 1; level < MBEDTLS_TIMING_WHEEL_LEVELS; level++) {
+        unsigned shift = WHEEL_BITS * level;
+        unsigned slot;
+        mbedtls_timing_wheel_timer *timer, *next;
+
+        if ((wheel->tick & (((uint64_t) 1 << shift) - 1)) != 0) {
+            break;
+        }
+
+        slot = (unsigned) (wheel->tick >> shift) & WHEEL_MASK;
+        timer = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        wheel->occupied[level] &= ~((uint64_t) 1 << slot);
+
+        for (; timer != NULL; timer = next) {
+            next = timer->next;
+            wheel->count--;
+            wheel_insert(wheel, timer, timer->expires);
+        }
+    }
+}
+
+/* Fire the timers of the level 0 slot of the current tick. */
+static void wheel_expire(mbedtls_timing_wheel *wheel)
+{
+    unsigned slot = (unsigned) wheel->tick & WHEEL_MASK;
+    mbedtls_timing_wheel_timer *timer;
+
+    /* The callback may change any timer, so start over from the head of
+     * the list each time. */
+    while ((timer = wheel->slots[0][slot]) != NULL) {
+        wheel_remove(wheel, timer);
+
+        if (wheel->now < timer->fin_at) {
+            /* A delay beyond the range of the wheel */
+            wheel_arm(wheel, timer);
+            continue;
+        }
+
+        if (wheel->f_expired != NULL) {
+            wheel->f_expired(wheel->p_expired, timer->arg);
+        }
+    }
+}
+
+void mbedtls_timing_wheel_init(mbedtls_timing_wheel *wheel)
+{
+    memset(wheel, 0, sizeof(mbedtls_timing_wheel));
+}
+
+void mbedtls_timing_wheel_setup(mbedtls_timing_wheel *wheel, uint32_t tick_ms,
+                                mbedtls_timing_wheel_cb_t *f_expired,
+                                void *p_expired)
+{
+    wheel->tick_ms = tick_ms != 0 ? tick_ms : 1;
+#if !defined(MBEDTLS_TIMING_ALT)
+    wheel->origin = mbedtls_timing_get_monotonic_ms();
+#else
+    (void) mbedtls_timing_get_timer(&wheel->clock, 1);
+#endif
+    wheel->now = 0;
+    wheel->tick = 0;
+    wheel->f_expired = f_expired;
+    wheel->p_expired = p_expired;
+}
+
+void mbedtls_timing_wheel_advance(mbedtls_timing_wheel *wheel, uint64_t now_ms)
+{
+    uint64_t target;
+
+    if (now_ms <= wheel->now) {
+        return;
+    }
+
+    wheel->now = now_ms;
+    target = now_ms / wheel->tick_ms;
+
+    while (wheel->tick < target) {
+        uint64_t next = wheel_next_tick(wheel);
+
+        if (next > target) {
+            wheel->tick = target;
+            break;
+        }
+
+        wheel->tick = next;
+        wheel_cascade(wheel);
+        wheel_expire(wheel);
+    }
+}
+
+void mbedtls_timing_wheel_run(mbedtls_timing_wheel *wheel)
+{
+    mbedtls_timing_wheel_advance(wheel, wheel_clock(wheel));
+}
+
+uint64_t mbedtls_timing_wheel_now(const mbedtls_timing_wheel *wheel)
+{
+    return wheel->now;
+}
+
+uint32_t mbedtls_timing_wheel_next_timeout(const mbedtls_timing_wheel *wheel)
+{
+    uint64_t next_ms;
+
+    if (wheel->count == 0) {
+        return (uint32_t) -1;
+    }
+
+    next_ms = wheel_next_tick(wheel) * wheel->tick_ms;
+    if (next_ms <= wheel->now) {
+        return 0;
+    }
+    if (next_ms - wheel->now >= UINT32_MAX) {
+        return UINT32_MAX - 1;
+    }
+    return (uint32_t) (next_ms - wheel->now);
+}
+
+void mbedtls_timing_wheel_timer_init(mbedtls_timing_wheel_timer *timer,
+                                     mbedtls_timing_wheel *wheel, void *arg)
+{
+    memset(timer, 0, sizeof(mbedtls_timing_wheel_timer));
+    timer->wheel = wheel;
+    timer->arg = arg;
+    timer->slot = -1;
+}
+
+void mbedtls_timing_wheel_set_delay(void *data, uint32_t int_ms, uint32_t fin_ms)
+{
+    mbedtls_timing_wheel_timer *timer = (mbedtls_timing_wheel_timer *) data;
+    mbedtls_timing_wheel *wheel = timer->wheel;
+
+    if (timer->slot >= 0) {
+        wheel_remove(wheel, timer);
+    }
+
+    if (fin_ms == 0) {
+        timer->int_at = 0;
+        timer->fin_at = 0;
+        return;
+    }
+
+    timer->int_at = wheel->now + int_ms;
+    timer->fin_at = wheel->now + fin_ms;
+    wheel_arm(wheel, timer);
+}
+
+int mbedtls_timing_wheel_get_delay(void *data)
+{
+    mbedtls_timing_wheel_timer *timer = (mbedtls_timing_wheel_timer *) data;
+    uint64_t now = timer->wheel->now;
+
+    if (timer->fin_at == 0) {
+        return -1;
+    }
+
+    if (now >= timer->fin_at) {
+        return 2;
+    }
+
+    if (now >= timer->int_at) {
+        return 1;
+    }
+
+    return 0;
+}
+
+void mbedtls_timing_wheel_timer_free(mbedtls_timing_wheel_timer *timer)
+{
+    if (timer == NULL) {
+        return;
+    }
+
+    if (timer->wheel != NULL && timer->slot >= 0) {
+        wheel_remove(timer->wheel, timer);
+    }
+
+    memset(timer, 0, sizeof(mbedtls_timing_wheel_timer));
+    timer->slot = -1;
+}
+
+#endif /* MBEDTLS_TIMING_WHEEL */
 #endif /* MBEDTLS_TIMING_C */
@@ -527,7 +527,7 @@ int mbedtls_x509_get_name(unsigned char **p, const unsigned char *end,
             /* Mark this item as being no the only one in a set */
             cur->next_merged = 1;
 
-            cur->next = mbedtls_calloc(1, sizeof(mbedtls_x509_name));
+            cur->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_name));
 
             if (cur->next == NULL) {
                 ret = MBEDTLS_ERR_X509_ALLOC_FAILED;
@@ -544,7 +544,7 @@ int mbedtls_x509_get_name(unsigned char **p, const unsigned char *end,
             return 0;
         }
 
-        cur->next = mbedtls_calloc(1, sizeof(mbedtls_x509_name));
+        cur->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_name));
 
         if (cur->next == NULL) {
             ret = MBEDTLS_ERR_X509_ALLOC_FAILED;
@@ -562,6 +562,68 @@ error:
     return ret;
 }
 
+/*
+ * Arena mode of certificate and CSR parsing: move the list nodes that were
+ * allocated one by one into an arena sized from the counts.
+ */
+size_t mbedtls_x509_count_names(const mbedtls_x509_name *name)
+{
+    size_t n = 0;
+
+    for (; name != NULL; name = name->next) {
+        n++;
+    }
+    return n;
+}
+
+size_t mbedtls_x509_count_sequence(const mbedtls_x509_sequence *seq)
+{
+    size_t n = 0;
+
+    for (; seq != NULL; seq = seq->next) {
+        n++;
+    }
+    return n;
+}
+
+void mbedtls_x509_arena_move_names(mbedtls_x509_name *head,
+                                   mbedtls_x509_name **arena)
+{
+    mbedtls_x509_name *old = head->next;
+    mbedtls_x509_name *prev = head;
+    const mbedtls_x509_name *src;
+
+    for (src = old; src != NULL; src = src->next) {
+        mbedtls_x509_name *dst = (*arena)++;
+
+        *dst = *src;
+        dst->next = NULL;
+        prev->next = dst;
+        prev = dst;
+    }
+
+    mbedtls_asn1_free_named_data_list_shallow(old);
+}
+
+void mbedtls_x509_arena_move_sequence(mbedtls_x509_sequence *head,
+                                      mbedtls_x509_sequence **arena)
+{
+    mbedtls_x509_sequence *old = head->next;
+    mbedtls_x509_sequence *prev = head;
+    const mbedtls_x509_sequence *src;
+
+    for (src = old; src != NULL; src = src->next) {
+        mbedtls_x509_sequence *dst = (*arena)++;
+
+        *dst = *src;
+        dst->next = NULL;
+        prev->next = dst;
+        prev = dst;
+    }
+
+    mbedtls_asn1_sequence_free(old);
+}
+
 static int x509_date_is_valid(const mbedtls_x509_time *t)
 {
     unsigned int month_days;
@@ -732,7 +794,7 @@ int mbedtls_x509_get_sig_alg(const mbedtls_x509_buf *sig_oid, const mbedtls_x509
     if (*pk_alg == MBEDTLS_PK_RSASSA_PSS) {
         mbedtls_pk_rsassa_pss_options *pss_opts;
 
-        pss_opts = mbedtls_calloc(1, sizeof(mbedtls_pk_rsassa_pss_options));
+        pss_opts = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_pk_rsassa_pss_options));
         if (pss_opts == NULL) {
             return MBEDTLS_ERR_X509_ALLOC_FAILED;
         }
@@ -760,6 +822,51 @@ int mbedtls_x509_get_sig_alg(const mbedtls_x509_buf *sig_oid, const mbedtls_x509
     return 0;
 }
 
+/*
+ * Type of a supported extension, as mbedtls_oid_get_x509_ext_type() gives.
+ * All but one are id-ce OIDs, told apart by their last byte, which saves
+ * searching the OID table for each extension of each certificate.
+ */
+int mbedtls_x509_get_ext_type(const mbedtls_x509_buf *oid, int *ext_type)
+{
+    if (oid->len == MBEDTLS_OID_SIZE(MBEDTLS_OID_ID_CE) + 1 &&
+        memcmp(oid->p, MBEDTLS_OID_ID_CE,
+               MBEDTLS_OID_SIZE(MBEDTLS_OID_ID_CE)) == 0) {
+        switch (oid->p[oid->len - 1]) {
+            case 0x0E: /* id-ce-subjectKeyIdentifier */
+                *ext_type = MBEDTLS_X509_EXT_SUBJECT_KEY_IDENTIFIER;
+                return 0;
+            case 0x0F: /* id-ce-keyUsage */
+                *ext_type = MBEDTLS_X509_EXT_KEY_USAGE;
+                return 0;
+            case 0x11: /* id-ce-subjectAltName */
+                *ext_type = MBEDTLS_X509_EXT_SUBJECT_ALT_NAME;
+                return 0;
+            case 0x13: /* id-ce-basicConstraints */
+                *ext_type = MBEDTLS_X509_EXT_BASIC_CONSTRAINTS;
+                return 0;
+            case 0x20: /* id-ce-certificatePolicies */
+                *ext_type = MBEDTLS_X509_EXT_CERTIFICATE_POLICIES;
+                return 0;
+            case 0x23: /* id-ce-authorityKeyIdentifier */
+                *ext_type = MBEDTLS_X509_EXT_AUTHORITY_KEY_IDENTIFIER;
+                return 0;
+            case 0x25: /* id-ce-extKeyUsage */
+                *ext_type = MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE;
+                return 0;
+            default:
+                return MBEDTLS_ERR_OID_NOT_FOUND;
+        }
+    }
+
+    if (MBEDTLS_OID_CMP(MBEDTLS_OID_NS_CERT_TYPE, oid) == 0) {
+        *ext_type = MBEDTLS_X509_EXT_NS_CERT_TYPE;
+        return 0;
+    }
+
+    return MBEDTLS_ERR_OID_NOT_FOUND;
+}
+
 /*
  * X.509 Extensions (No parsing of extensions, pointer should
  * be either manually updated or extensions should be parsed!)
@@ -1117,6 +1224,24 @@ int mbedtls_x509_time_cmp(const mbedtls_x509_time *t1,
     return x;
 }
 
+/*
+ * Seconds since the Epoch of a date of the proleptic Gregorian calendar,
+ * counting days from 0000-03-01 so that leap days end the years.
+ */
+int64_t mbedtls_x509_time_to_epoch(const mbedtls_x509_time *t)
+{
+    int64_t year = t->year - (t->mon <= 2);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t year_of_era = year - era * 400;
+    int64_t day_of_year = (153 * (t->mon + (t->mon > 2 ? -3 : 9)) + 2) / 5 +
+                          t->day - 1;
+    int64_t day_of_era = year_of_era * 365 + year_of_era / 4 -
+                         year_of_era / 100 + day_of_year;
+    int64_t days = era * 146097 + day_of_era - 719468;
+
+    return days * 86400 + t->hour * 3600 + t->min * 60 + t->sec;
+}
+
 #if defined(MBEDTLS_HAVE_TIME_DATE)
 int mbedtls_x509_time_gmtime(mbedtls_time_t tt, mbedtls_x509_time *now)
 {
@@ -1329,7 +1454,7 @@ int mbedtls_x509_get_subject_alt_name_ext(unsigned char **p,
                 return MBEDTLS_ERR_X509_INVALID_EXTENSIONS;
             }
 
-            cur->next = mbedtls_calloc(1, sizeof(mbedtls_asn1_sequence));
+            cur->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_asn1_sequence));
 
             if (cur->next == NULL) {
                 return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_EXTENSIONS,
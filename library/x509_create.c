@@ -19,6 +19,10 @@
 
 #include "mbedtls/asn1.h"
 
+#if defined(MBEDTLS_PEM_WRITE_C)
+#include "mbedtls/base64.h"
+#endif
+
 /* Structure linking OIDs for X.509 DN AttributeTypes to their
  * string representations and default string encodings used by Mbed TLS. */
 typedef struct {
@@ -225,7 +229,7 @@ static int parse_attribute_value_hex_der_encoded(const char *s,
     }
 
     /* Step 2: Decode the hex string into an intermediate buffer. */
-    unsigned char *der = mbedtls_calloc(1, der_length);
+    unsigned char *der = mbedtls_calloc_tagged(X509, 1, der_length);
     if (der == NULL) {
         return MBEDTLS_ERR_X509_ALLOC_FAILED;
     }
@@ -361,7 +365,7 @@ int mbedtls_oid_from_numeric_string(mbedtls_asn1_buf *oid,
     size_t bytes_per_subidentifier = (((sizeof(unsigned int) * 8) - 1) / 7)
                                      + 1;
     size_t max_possible_bytes = num_dots * bytes_per_subidentifier;
-    oid->p = mbedtls_calloc(max_possible_bytes, 1);
+    oid->p = mbedtls_calloc_tagged(X509, max_possible_bytes, 1);
     if (oid->p == NULL) {
         return MBEDTLS_ERR_ASN1_ALLOC_FAILED;
     }
@@ -432,7 +436,7 @@ int mbedtls_oid_from_numeric_string(mbedtls_asn1_buf *oid,
     }
 
     encoded_len = (size_t) (out_ptr - oid->p);
-    resized_mem = mbedtls_calloc(encoded_len, 1);
+    resized_mem = mbedtls_calloc_tagged(X509, encoded_len, 1);
     if (resized_mem == NULL) {
         ret = MBEDTLS_ERR_ASN1_ALLOC_FAILED;
         goto error;
@@ -480,7 +484,7 @@ int mbedtls_x509_string_to_names(mbedtls_asn1_named_data **head, const char *nam
                 }
             } else {
                 oid.len = strlen(attr_descr->oid);
-                oid.p = mbedtls_calloc(1, oid.len);
+                oid.p = mbedtls_calloc_tagged(X509, 1, oid.len);
                 memcpy(oid.p, attr_descr->oid, oid.len);
                 numericoid = 0;
             }
@@ -683,6 +687,175 @@ int mbedtls_x509_write_sig(unsigned char **p, unsigned char *start,
     return (int) len;
 }
 
+/* Length of the length octets of a DER element of len bytes. */
+static size_t x509_asn1_len_len(size_t len)
+{
+    size_t n = 1;
+
+    if (len < 0x80) {
+        return 1;
+    }
+
+    while (len != 0) {
+        len >>= 8;
+        n++;
+    }
+
+    return n;
+}
+
+/*
+ * Length of what mbedtls_x509_write_sig() writes for a signature of
+ * sig_len bytes.
+ */
+size_t mbedtls_x509_write_sig_len(size_t oid_len, size_t sig_len,
+                                  mbedtls_pk_type_t pk_alg)
+{
+    size_t alg_len, bits_len;
+
+    alg_len = 1 + x509_asn1_len_len(oid_len) + oid_len;
+    if (pk_alg != MBEDTLS_PK_ECDSA) {
+        alg_len += 2;
+    }
+
+    bits_len = sig_len + 1;
+
+    return 1 + x509_asn1_len_len(alg_len) + alg_len +
+           1 + x509_asn1_len_len(bits_len) + bits_len;
+}
+
+/*
+ * Upper bound of the length of a signature by key: exact for RSA, the
+ * largest DER encoding of the two integers for ECDSA.
+ */
+size_t mbedtls_x509_sig_max_len(mbedtls_pk_context *key,
+                                mbedtls_pk_type_t pk_alg)
+{
+    size_t n, int_len, max_len;
+
+    if (pk_alg == MBEDTLS_PK_ECDSA) {
+        n = (mbedtls_pk_get_bitlen(key) + 7) / 8 + 1;
+        int_len = 1 + x509_asn1_len_len(n) + n;
+        max_len = 1 + x509_asn1_len_len(2 * int_len) + 2 * int_len;
+    } else {
+        max_len = mbedtls_pk_get_len(key);
+    }
+
+    if (max_len == 0 || max_len > MBEDTLS_PK_SIGNATURE_MAX_SIZE) {
+        max_len = MBEDTLS_PK_SIGNATURE_MAX_SIZE;
+    }
+
+    return max_len;
+}
+
+/*
+ * Complete a CRT or CSR whose len bytes of data to be signed are at *c,
+ * written with reserved bytes left free at the end of buf for the
+ * signature: write the signature there and the outer SEQUENCE header
+ * before the data, leaving the result at the end of buf.
+ *
+ * The data only moves when the signature turns out shorter or longer than
+ * reserved, which happens for ECDSA when an integer is shorter than the
+ * maximum, and then only by those few bytes.
+ */
+int mbedtls_x509_write_der_signed(unsigned char *buf, size_t size,
+                                  unsigned char **c, size_t len,
+                                  size_t reserved,
+                                  const char *oid, size_t oid_len,
+                                  unsigned char *sig, size_t sig_len,
+                                  mbedtls_pk_type_t pk_alg)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t sig_and_oid_len = mbedtls_x509_write_sig_len(oid_len, sig_len, pk_alg);
+    unsigned char *c2;
+
+    if (sig_and_oid_len > size || len > size - sig_and_oid_len) {
+        return MBEDTLS_ERR_ASN1_BUF_TOO_SMALL;
+    }
+
+    if (sig_and_oid_len != reserved) {
+        c2 = buf + size - sig_and_oid_len - len;
+        memmove(c2, *c, len);
+        *c = c2;
+    }
+
+    c2 = buf + size;
+    MBEDTLS_ASN1_CHK_ADD(sig_and_oid_len,
+                         mbedtls_x509_write_sig(&c2, *c + len, oid, oid_len,
+                                                sig, sig_len, pk_alg));
+
+    len += sig_and_oid_len;
+    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_len(c, buf, len));
+    MBEDTLS_ASN1_CHK_ADD(len,
+                         mbedtls_asn1_write_tag(c, buf,
+                                                MBEDTLS_ASN1_CONSTRUCTED |
+                                                MBEDTLS_ASN1_SEQUENCE));
+
+    return (int) len;
+}
+
+#if defined(MBEDTLS_PEM_WRITE_C)
+/*
+ * PEM-encode the der_len bytes of DER at the end of buf into buf, one line
+ * at a time, without an intermediate buffer.
+ *
+ * A full line is 65 bytes of output for 48 bytes of input, so after k lines
+ * the output ends header_len + 17 * k bytes after the start of the DER
+ * would if nothing had moved. This is less than size - der_len whenever
+ * the whole output fits in buf, so a line is never written over DER that
+ * is not encoded yet.
+ */
+int mbedtls_x509_write_pem(const char *header, const char *footer,
+                           unsigned char *buf, size_t size,
+                           size_t der_len, size_t *olen)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *der = buf + size - der_len;
+    unsigned char line[65];
+    size_t header_len = strlen(header), footer_len = strlen(footer);
+    size_t needed, use_len, chunk;
+    unsigned char *p = buf;
+
+    needed = header_len + der_len / 48 * 65 + footer_len + 1;
+    if (der_len % 48 != 0) {
+        needed += (der_len % 48 + 2) / 3 * 4 + 1;
+    }
+
+    if (needed > size) {
+        *olen = needed;
+        return MBEDTLS_ERR_BASE64_BUFFER_TOO_SMALL;
+    }
+
+    memcpy(p, header, header_len);
+    p += header_len;
+
+    while (der_len != 0) {
+        chunk = der_len > 48 ? 48 : der_len;
+        if ((ret = mbedtls_base64_encode(line, sizeof(line), &use_len,
+                                         der, chunk)) != 0) {
+            return ret;
+        }
+        der += chunk;
+        der_len -= chunk;
+
+        memcpy(p, line, use_len);
+        p += use_len;
+        *p++ = '\n';
+    }
+
+    memcpy(p, footer, footer_len);
+    p += footer_len;
+
+    *p++ = '\0';
+    *olen = (size_t) (p - buf);
+
+    /* Clean the rest of the buffer, including what is left of the DER */
+    memset(buf + *olen, 0, size - *olen);
+
+    return 0;
+}
+#endif /* MBEDTLS_PEM_WRITE_C */
+
 static int x509_write_extension(unsigned char **p, unsigned char *start,
                                 mbedtls_asn1_named_data *ext)
 {
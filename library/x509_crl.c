@@ -30,6 +30,11 @@
 #include "mbedtls/pem.h"
 #endif
 
+#if defined(MBEDTLS_X509_CRL_STREAM)
+#include "psa/crypto.h"
+#include "mbedtls/psa_util.h"
+#endif
+
 #include "mbedtls/platform.h"
 
 #if defined(MBEDTLS_HAVE_TIME)
@@ -263,7 +268,7 @@ static int x509_get_entries(unsigned char **p,
         }
 
         if (*p < end) {
-            cur_entry->next = mbedtls_calloc(1, sizeof(mbedtls_x509_crl_entry));
+            cur_entry->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crl_entry));
 
             if (cur_entry->next == NULL) {
                 return MBEDTLS_ERR_X509_ALLOC_FAILED;
@@ -276,6 +281,243 @@ static int x509_get_entries(unsigned char **p,
     return 0;
 }
 
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+/*
+ * Order serials by length, then by value
+ */
+static int x509_crl_serial_cmp(const mbedtls_x509_buf *a,
+                               const mbedtls_x509_buf *b)
+{
+    if (a->len != b->len) {
+        return a->len < b->len ? -1 : 1;
+    }
+
+    return memcmp(a->p, b->p, a->len);
+}
+
+static void x509_crl_sift_down(const mbedtls_x509_crl_entry **heap,
+                               size_t root, size_t count)
+{
+    const mbedtls_x509_crl_entry *tmp;
+    size_t child;
+
+    while ((child = 2 * root + 1) < count) {
+        if (child + 1 < count &&
+            x509_crl_serial_cmp(&heap[child]->serial,
+                                &heap[child + 1]->serial) < 0) {
+            child++;
+        }
+
+        if (x509_crl_serial_cmp(&heap[root]->serial,
+                                &heap[child]->serial) >= 0) {
+            return;
+        }
+
+        tmp = heap[root];
+        heap[root] = heap[child];
+        heap[child] = tmp;
+        root = child;
+    }
+}
+
+/*
+ * Sort the entries of a CRL by serial, so that revocation checks do not
+ * walk the whole list. Without memory for the index, they still can.
+ */
+static void x509_crl_build_serial_index(mbedtls_x509_crl *crl)
+{
+    const mbedtls_x509_crl_entry *cur, *tmp;
+    const mbedtls_x509_crl_entry **index;
+    size_t count = 0, i;
+
+    /* Same entries as the list walk in mbedtls_x509_crt_is_revoked() */
+    for (cur = &crl->entry; cur != NULL && cur->serial.len != 0; cur = cur->next) {
+        count++;
+    }
+
+    if (count == 0) {
+        return;
+    }
+
+    index = mbedtls_calloc_tagged(X509, count, sizeof(*index));
+    if (index == NULL) {
+        return;
+    }
+
+    for (cur = &crl->entry, i = 0; i < count; cur = cur->next, i++) {
+        index[i] = cur;
+    }
+
+    /* Heap sort: no recursion, no extra memory */
+    for (i = count / 2; i-- > 0;) {
+        x509_crl_sift_down(index, i, count);
+    }
+
+    for (i = count; --i > 0;) {
+        tmp = index[0];
+        index[0] = index[i];
+        index[i] = tmp;
+        x509_crl_sift_down(index, 0, i);
+    }
+
+    crl->serial_index = index;
+    crl->serial_count = count;
+}
+
+const mbedtls_x509_crl_entry *mbedtls_x509_crl_find_serial(const mbedtls_x509_crl *crl,
+                                                          const mbedtls_x509_buf *serial)
+{
+    size_t lo = 0, hi = crl->serial_count, mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = x509_crl_serial_cmp(&crl->serial_index[mid]->serial, serial);
+
+        if (cmp == 0) {
+            return crl->serial_index[mid];
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+#endif /* MBEDTLS_X509_CRL_SERIAL_INDEX */
+
+/*
+ * TBSCertList fields before revokedCertificates
+ */
+static int x509_crl_get_header(mbedtls_x509_crl *crl,
+                               unsigned char **p, const unsigned char *end,
+                               mbedtls_x509_buf *sig_params1)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t len;
+
+    /*
+     * Version  ::=  INTEGER  OPTIONAL {  v1(0), v2(1)  }
+     *               -- if present, MUST be v2
+     *
+     * signature            AlgorithmIdentifier
+     */
+    if ((ret = x509_crl_get_version(p, end, &crl->version)) != 0 ||
+        (ret = mbedtls_x509_get_alg(p, end, &crl->sig_oid, sig_params1)) != 0) {
+        return ret;
+    }
+
+    if (crl->version < 0 || crl->version > 1) {
+        return MBEDTLS_ERR_X509_UNKNOWN_VERSION;
+    }
+
+    crl->version++;
+
+    if ((ret = mbedtls_x509_get_sig_alg(&crl->sig_oid, sig_params1,
+                                        &crl->sig_md, &crl->sig_pk,
+                                        &crl->sig_opts)) != 0) {
+        return MBEDTLS_ERR_X509_UNKNOWN_SIG_ALG;
+    }
+
+    /*
+     * issuer               Name
+     */
+    crl->issuer_raw.p = *p;
+
+    if ((ret = mbedtls_asn1_get_tag(p, end, &len,
+                                    MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)) != 0) {
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT, ret);
+    }
+
+    if ((ret = mbedtls_x509_get_name(p, *p + len, &crl->issuer)) != 0) {
+        return ret;
+    }
+
+    crl->issuer_raw.len = (size_t) (*p - crl->issuer_raw.p);
+
+    /*
+     * thisUpdate          Time
+     * nextUpdate          Time OPTIONAL
+     */
+    if ((ret = mbedtls_x509_get_time(p, end, &crl->this_update)) != 0) {
+        return ret;
+    }
+
+    if ((ret = mbedtls_x509_get_time(p, end, &crl->next_update)) != 0) {
+        if (ret != (MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_DATE,
+                                      MBEDTLS_ERR_ASN1_UNEXPECTED_TAG)) &&
+            ret != (MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_DATE,
+                                      MBEDTLS_ERR_ASN1_OUT_OF_DATA))) {
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * TBSCertList fields after revokedCertificates, and everything after
+ * TBSCertList
+ */
+static int x509_crl_get_trailer(mbedtls_x509_crl *crl,
+                                unsigned char **p, const unsigned char *tbs_end,
+                                const unsigned char *end,
+                                const mbedtls_x509_buf *sig_params1)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_buf sig_params2, sig_oid2;
+
+    memset(&sig_params2, 0, sizeof(mbedtls_x509_buf));
+    memset(&sig_oid2, 0, sizeof(mbedtls_x509_buf));
+
+    /*
+     * crlExtensions          EXPLICIT Extensions OPTIONAL
+     *                              -- if present, MUST be v2
+     */
+    if (crl->version == 2) {
+        ret = x509_get_crl_ext(p, tbs_end, &crl->crl_ext);
+
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    if (*p != tbs_end) {
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
+    }
+
+    /*
+     *  signatureAlgorithm   AlgorithmIdentifier,
+     *  signatureValue       BIT STRING
+     */
+    if ((ret = mbedtls_x509_get_alg(p, end, &sig_oid2, &sig_params2)) != 0) {
+        return ret;
+    }
+
+    if (crl->sig_oid.len != sig_oid2.len ||
+        memcmp(crl->sig_oid.p, sig_oid2.p, crl->sig_oid.len) != 0 ||
+        sig_params1->len != sig_params2.len ||
+        (sig_params1->len != 0 &&
+         memcmp(sig_params1->p, sig_params2.p, sig_params1->len) != 0)) {
+        return MBEDTLS_ERR_X509_SIG_MISMATCH;
+    }
+
+    if ((ret = mbedtls_x509_get_sig(p, end, &crl->sig)) != 0) {
+        return ret;
+    }
+
+    if (*p != end) {
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
+    }
+
+    return 0;
+}
+
 /*
  * Parse one  CRLs in DER format and append it to the chained list
  */
@@ -285,7 +527,7 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     size_t len;
     unsigned char *p = NULL, *end = NULL;
-    mbedtls_x509_buf sig_params1, sig_params2, sig_oid2;
+    mbedtls_x509_buf sig_params1;
     mbedtls_x509_crl *crl = chain;
 
     /*
@@ -296,8 +538,6 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
     }
 
     memset(&sig_params1, 0, sizeof(mbedtls_x509_buf));
-    memset(&sig_params2, 0, sizeof(mbedtls_x509_buf));
-    memset(&sig_oid2, 0, sizeof(mbedtls_x509_buf));
 
     /*
      * Add new CRL on the end of the chain if needed.
@@ -307,7 +547,7 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
     }
 
     if (crl->version != 0 && crl->next == NULL) {
-        crl->next = mbedtls_calloc(1, sizeof(mbedtls_x509_crl));
+        crl->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crl));
 
         if (crl->next == NULL) {
             mbedtls_x509_crl_free(crl);
@@ -325,7 +565,7 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
         return MBEDTLS_ERR_X509_INVALID_FORMAT;
     }
 
-    p = mbedtls_calloc(1, buflen);
+    p = mbedtls_calloc_tagged(X509, 1, buflen);
     if (p == NULL) {
         return MBEDTLS_ERR_X509_ALLOC_FAILED;
     }
@@ -369,69 +609,11 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
     end = p + len;
     crl->tbs.len = (size_t) (end - crl->tbs.p);
 
-    /*
-     * Version  ::=  INTEGER  OPTIONAL {  v1(0), v2(1)  }
-     *               -- if present, MUST be v2
-     *
-     * signature            AlgorithmIdentifier
-     */
-    if ((ret = x509_crl_get_version(&p, end, &crl->version)) != 0 ||
-        (ret = mbedtls_x509_get_alg(&p, end, &crl->sig_oid, &sig_params1)) != 0) {
-        mbedtls_x509_crl_free(crl);
-        return ret;
-    }
-
-    if (crl->version < 0 || crl->version > 1) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERR_X509_UNKNOWN_VERSION;
-    }
-
-    crl->version++;
-
-    if ((ret = mbedtls_x509_get_sig_alg(&crl->sig_oid, &sig_params1,
-                                        &crl->sig_md, &crl->sig_pk,
-                                        &crl->sig_opts)) != 0) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERR_X509_UNKNOWN_SIG_ALG;
-    }
-
-    /*
-     * issuer               Name
-     */
-    crl->issuer_raw.p = p;
-
-    if ((ret = mbedtls_asn1_get_tag(&p, end, &len,
-                                    MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)) != 0) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT, ret);
-    }
-
-    if ((ret = mbedtls_x509_get_name(&p, p + len, &crl->issuer)) != 0) {
-        mbedtls_x509_crl_free(crl);
-        return ret;
-    }
-
-    crl->issuer_raw.len = (size_t) (p - crl->issuer_raw.p);
-
-    /*
-     * thisUpdate          Time
-     * nextUpdate          Time OPTIONAL
-     */
-    if ((ret = mbedtls_x509_get_time(&p, end, &crl->this_update)) != 0) {
+    if ((ret = x509_crl_get_header(crl, &p, end, &sig_params1)) != 0) {
         mbedtls_x509_crl_free(crl);
         return ret;
     }
 
-    if ((ret = mbedtls_x509_get_time(&p, end, &crl->next_update)) != 0) {
-        if (ret != (MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_DATE,
-                                      MBEDTLS_ERR_ASN1_UNEXPECTED_TAG)) &&
-            ret != (MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_DATE,
-                                      MBEDTLS_ERR_ASN1_OUT_OF_DATA))) {
-            mbedtls_x509_crl_free(crl);
-            return ret;
-        }
-    }
-
     /*
      * revokedCertificates    SEQUENCE OF SEQUENCE   {
      *      userCertificate        CertificateSerialNumber,
@@ -445,55 +627,15 @@ int mbedtls_x509_crl_parse_der(mbedtls_x509_crl *chain,
         return ret;
     }
 
-    /*
-     * crlExtensions          EXPLICIT Extensions OPTIONAL
-     *                              -- if present, MUST be v2
-     */
-    if (crl->version == 2) {
-        ret = x509_get_crl_ext(&p, end, &crl->crl_ext);
-
-        if (ret != 0) {
-            mbedtls_x509_crl_free(crl);
-            return ret;
-        }
-    }
-
-    if (p != end) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
-                                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
-    }
-
-    end = crl->raw.p + crl->raw.len;
-
-    /*
-     *  signatureAlgorithm   AlgorithmIdentifier,
-     *  signatureValue       BIT STRING
-     */
-    if ((ret = mbedtls_x509_get_alg(&p, end, &sig_oid2, &sig_params2)) != 0) {
-        mbedtls_x509_crl_free(crl);
-        return ret;
-    }
-
-    if (crl->sig_oid.len != sig_oid2.len ||
-        memcmp(crl->sig_oid.p, sig_oid2.p, crl->sig_oid.len) != 0 ||
-        sig_params1.len != sig_params2.len ||
-        (sig_params1.len != 0 &&
-         memcmp(sig_params1.p, sig_params2.p, sig_params1.len) != 0)) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERR_X509_SIG_MISMATCH;
-    }
-
-    if ((ret = mbedtls_x509_get_sig(&p, end, &crl->sig)) != 0) {
+    if ((ret = x509_crl_get_trailer(crl, &p, end, crl->raw.p + crl->raw.len,
+                                    &sig_params1)) != 0) {
         mbedtls_x509_crl_free(crl);
         return ret;
     }
 
-    if (p != end) {
-        mbedtls_x509_crl_free(crl);
-        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
-                                 MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
-    }
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+    x509_crl_build_serial_index(crl);
+#endif
 
     return 0;
 }
@@ -581,25 +723,732 @@ int mbedtls_x509_crl_parse_file(mbedtls_x509_crl *chain, const char *path)
 }
 #endif /* MBEDTLS_FS_IO */
 
-#if !defined(MBEDTLS_X509_REMOVE_INFO)
+#if defined(MBEDTLS_X509_CRL_STREAM)
 /*
- * Return an informational string about the certificate.
+ * Streaming parser
+ *
+ * The CRL is read one TLV at a time into ctx->elem, except for the
+ * SEQUENCEs around the bulk of the data, of which only the header is read.
+ * Revoked entries are reduced to serial records as they go by. All other
+ * fields are copied to ctx->meta, to be parsed by the same code as for
+ * mbedtls_x509_crl_parse_der() once the whole CRL has been seen.
  */
-#define BEFORE_COLON    14
-#define BC              "14"
+#define X509_CRL_STREAM_OUTER       0   /* CertificateList header */
+#define X509_CRL_STREAM_TBS         1   /* TBSCertList header */
+#define X509_CRL_STREAM_TBS_FIELD   2   /* A field of TBSCertList */
+#define X509_CRL_STREAM_ENTRY       3   /* An element of revokedCertificates */
+#define X509_CRL_STREAM_TRAILER     4   /* signatureAlgorithm, signatureValue */
+#define X509_CRL_STREAM_DONE        5
+#define X509_CRL_STREAM_CLOSED      6   /* Failed or finished */
+
+#define X509_CRL_STEP_NONE          0
+#define X509_CRL_STEP_VERSION       1
+#define X509_CRL_STEP_SIGNATURE     2
+#define X509_CRL_STEP_ISSUER        3
+#define X509_CRL_STEP_THIS_UPDATE   4
+#define X509_CRL_STEP_NEXT_UPDATE   5
+#define X509_CRL_STEP_ENTRIES       6
+#define X509_CRL_STEP_EXTENSIONS    7
+
+/* A length byte, then the serial padded with zeros, so that memcmp() on
+ * records orders serials like x509_crl_serial_cmp() */
+#define X509_CRL_SERIAL_RECORD_SIZE (1 + MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN)
+
+#define X509_CRL_SEQUENCE           (MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE)
+
 /*
- * Return an informational string about the CRL.
+ * Make room for at least needed bytes in a buffer holding len bytes
  */
-int mbedtls_x509_crl_info(char *buf, size_t size, const char *prefix,
-                          const mbedtls_x509_crl *crl)
+static int x509_crl_stream_grow(unsigned char **buf, size_t *size,
+                                size_t len, size_t needed)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    size_t n;
-    char *p;
-    const mbedtls_x509_crl_entry *entry;
+    unsigned char *p;
+    size_t new_size = *size == 0 ? 256 : *size;
 
-    p = buf;
-    n = size;
+    if (needed <= *size) {
+        return 0;
+    }
+
+    while (new_size < needed) {
+        if (new_size > SIZE_MAX / 2) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+        new_size *= 2;
+    }
+
+    p = mbedtls_calloc_tagged(X509, 1, new_size);
+    if (p == NULL) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    if (*buf != NULL) {
+        memcpy(p, *buf, len);
+        mbedtls_free(*buf);
+    }
+
+    *buf = p;
+    *size = new_size;
+
+    return 0;
+}
+
+static int x509_crl_stream_append(unsigned char **buf, size_t *len,
+                                  size_t *size,
+                                  const unsigned char *data, size_t n)
+{
+    int ret;
+
+    if (n > SIZE_MAX - *len) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    if ((ret = x509_crl_stream_grow(buf, size, *len, *len + n)) != 0) {
+        return ret;
+    }
+
+    memcpy(*buf + *len, data, n);
+    *len += n;
+
+    return 0;
+}
+
+/*
+ * Account for input bytes: keep them if asked to, hash those of TBSCertList
+ */
+static int x509_crl_stream_consume(mbedtls_x509_crl_stream *ctx,
+                                   const unsigned char *buf, size_t n)
+{
+    int ret;
+    size_t hashed;
+
+    if (ctx->keep_raw &&
+        (ret = x509_crl_stream_append(&ctx->raw, &ctx->raw_len,
+                                      &ctx->raw_size, buf, n)) != 0) {
+        return ret;
+    }
+
+    if (ctx->hash_alg != 0 && ctx->off < ctx->tbs_end) {
+        hashed = ctx->tbs_end - ctx->off < n ? ctx->tbs_end - ctx->off : n;
+
+        if (psa_hash_update(&ctx->hash, buf, hashed) != PSA_SUCCESS) {
+            return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        }
+    }
+
+    ctx->off += n;
+
+    return 0;
+}
+
+/*
+ * End of the structure the next element belongs to
+ */
+static size_t x509_crl_stream_container_end(const mbedtls_x509_crl_stream *ctx)
+{
+    switch (ctx->state) {
+        case X509_CRL_STREAM_OUTER:
+            return SIZE_MAX;
+        case X509_CRL_STREAM_TBS:
+        case X509_CRL_STREAM_TRAILER:
+            return ctx->outer_end;
+        case X509_CRL_STREAM_TBS_FIELD:
+            return ctx->tbs_end;
+        case X509_CRL_STREAM_ENTRY:
+            return ctx->entries_end;
+        default:
+            return ctx->off;
+    }
+}
+
+/*
+ * Whether only the header of the next element is read, as its content is
+ * parsed as a sequence of elements
+ */
+static int x509_crl_stream_header_only(const mbedtls_x509_crl_stream *ctx)
+{
+    return ctx->state == X509_CRL_STREAM_OUTER ||
+           ctx->state == X509_CRL_STREAM_TBS ||
+           (ctx->state == X509_CRL_STREAM_TBS_FIELD &&
+            ctx->elem[0] == X509_CRL_SEQUENCE &&
+            (ctx->step == X509_CRL_STEP_THIS_UPDATE ||
+             ctx->step == X509_CRL_STEP_NEXT_UPDATE));
+}
+
+/*
+ * Buffer the next element from the input. Return 1 if the input runs out
+ * before it is complete, 0 when it is.
+ */
+static int x509_crl_stream_fill(mbedtls_x509_crl_stream *ctx,
+                                const unsigned char **buf, size_t *len,
+                                size_t *content_len)
+{
+    int ret;
+    size_t need, hdr_len, n, i;
+    size_t start = ctx->off - ctx->elem_len;
+    size_t avail = x509_crl_stream_container_end(ctx) - start;
+
+    for (;;) {
+        need = 2;
+
+        if (ctx->elem_len >= 2) {
+            hdr_len = 2;
+            *content_len = ctx->elem[1];
+
+            if ((ctx->elem[1] & 0x80) != 0) {
+                n = ctx->elem[1] & 0x7F;
+                if (n == 0 || n > 4) {
+                    return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                             MBEDTLS_ERR_ASN1_INVALID_LENGTH);
+                }
+
+                hdr_len += n;
+                *content_len = 0;
+                for (i = 0; i < n && 2 + i < ctx->elem_len; i++) {
+                    *content_len = (*content_len << 8) | ctx->elem[2 + i];
+                }
+            }
+
+            need = hdr_len;
+
+            if (ctx->elem_len >= hdr_len) {
+                if (hdr_len > avail || *content_len > avail - hdr_len) {
+                    return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                             MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
+                }
+
+                if (!x509_crl_stream_header_only(ctx)) {
+                    need += *content_len;
+                }
+
+                if (ctx->elem_len == need) {
+                    ctx->elem_hdr_len = hdr_len;
+                    return 0;
+                }
+            }
+        }
+
+        if (need > avail) {
+            return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                     MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
+        }
+
+        if (need > MBEDTLS_X509_CRL_STREAM_MAX_ELEMENT_LEN) {
+            return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                     MBEDTLS_ERR_ASN1_INVALID_LENGTH);
+        }
+
+        if (*len == 0) {
+            return 1;
+        }
+
+        n = need - ctx->elem_len < *len ? need - ctx->elem_len : *len;
+
+        if ((ret = x509_crl_stream_grow(&ctx->elem, &ctx->elem_size,
+                                        ctx->elem_len, need)) != 0 ||
+            (ret = x509_crl_stream_consume(ctx, *buf, n)) != 0) {
+            return ret;
+        }
+
+        memcpy(ctx->elem + ctx->elem_len, *buf, n);
+        ctx->elem_len += n;
+        *buf += n;
+        *len -= n;
+    }
+}
+
+/*
+ * Start hashing TBSCertList once its signature algorithm is known
+ */
+static int x509_crl_stream_start_hash(mbedtls_x509_crl_stream *ctx)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *p = ctx->elem;
+    mbedtls_x509_buf sig_oid, sig_params;
+    mbedtls_md_type_t sig_md;
+    mbedtls_pk_type_t sig_pk;
+    void *sig_opts = NULL;
+    psa_algorithm_t alg;
+
+    memset(&sig_params, 0, sizeof(mbedtls_x509_buf));
+
+    if ((ret = mbedtls_x509_get_alg(&p, p + ctx->elem_len,
+                                    &sig_oid, &sig_params)) != 0) {
+        return ret;
+    }
+
+    if (mbedtls_x509_get_sig_alg(&sig_oid, &sig_params, &sig_md, &sig_pk,
+                                 &sig_opts) != 0) {
+        return MBEDTLS_ERR_X509_UNKNOWN_SIG_ALG;
+    }
+
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    mbedtls_free(sig_opts);
+#endif
+
+    alg = mbedtls_md_psa_alg_from_type(sig_md);
+
+    /* Everything read of TBSCertList so far is in ctx->meta */
+    if (psa_hash_setup(&ctx->hash, alg) != PSA_SUCCESS) {
+        return MBEDTLS_ERR_X509_UNKNOWN_SIG_ALG;
+    }
+
+    ctx->hash_alg = alg;
+
+    if (psa_hash_update(&ctx->hash, ctx->meta, ctx->meta_len) != PSA_SUCCESS) {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+
+    return 0;
+}
+
+static int x509_crl_stream_tbs_field(mbedtls_x509_crl_stream *ctx,
+                                     size_t content_len)
+{
+    int ret;
+    unsigned char tag = ctx->elem[0];
+    int is_time = tag == MBEDTLS_ASN1_UTC_TIME ||
+                  tag == MBEDTLS_ASN1_GENERALIZED_TIME;
+    int step;
+
+    if (tag == MBEDTLS_ASN1_INTEGER && ctx->step == X509_CRL_STEP_NONE) {
+        step = X509_CRL_STEP_VERSION;
+    } else if (tag == X509_CRL_SEQUENCE && ctx->step < X509_CRL_STEP_SIGNATURE) {
+        step = X509_CRL_STEP_SIGNATURE;
+    } else if (tag == X509_CRL_SEQUENCE && ctx->step == X509_CRL_STEP_SIGNATURE) {
+        step = X509_CRL_STEP_ISSUER;
+    } else if (is_time && ctx->step == X509_CRL_STEP_ISSUER) {
+        step = X509_CRL_STEP_THIS_UPDATE;
+    } else if (is_time && ctx->step == X509_CRL_STEP_THIS_UPDATE) {
+        step = X509_CRL_STEP_NEXT_UPDATE;
+    } else if (tag == X509_CRL_SEQUENCE && ctx->step >= X509_CRL_STEP_THIS_UPDATE &&
+               ctx->step < X509_CRL_STEP_ENTRIES) {
+        step = X509_CRL_STEP_ENTRIES;
+    } else if (tag == (MBEDTLS_ASN1_CONTEXT_SPECIFIC | MBEDTLS_ASN1_CONSTRUCTED | 0) &&
+               ctx->step >= X509_CRL_STEP_THIS_UPDATE &&
+               ctx->step < X509_CRL_STEP_EXTENSIONS) {
+        step = X509_CRL_STEP_EXTENSIONS;
+    } else {
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                 MBEDTLS_ERR_ASN1_UNEXPECTED_TAG);
+    }
+
+    ctx->step = step;
+
+    if (step == X509_CRL_STEP_ENTRIES) {
+        ctx->entries_end = ctx->off + content_len;
+        ctx->state = X509_CRL_STREAM_ENTRY;
+        return 0;
+    }
+
+    if ((ret = x509_crl_stream_append(&ctx->meta, &ctx->meta_len,
+                                      &ctx->meta_size,
+                                      ctx->elem, ctx->elem_len)) != 0) {
+        return ret;
+    }
+
+    if (step == X509_CRL_STEP_SIGNATURE) {
+        return x509_crl_stream_start_hash(ctx);
+    }
+
+    return 0;
+}
+
+/*
+ * Reduce a revokedCertificates element to a serial record
+ */
+static int x509_crl_stream_entry(mbedtls_x509_crl_stream *ctx)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *p = ctx->elem;
+    const unsigned char *end;
+    unsigned char *record;
+    size_t len;
+    mbedtls_x509_buf serial, entry_ext;
+    mbedtls_x509_time revocation_date;
+
+    if ((ret = mbedtls_asn1_get_tag(&p, p + ctx->elem_len, &len,
+                                    X509_CRL_SEQUENCE)) != 0) {
+        return ret;
+    }
+
+    end = p + len;
+
+    if ((ret = mbedtls_x509_get_serial(&p, end, &serial)) != 0) {
+        return ret;
+    }
+
+    if ((ret = mbedtls_x509_get_time(&p, end, &revocation_date)) != 0) {
+        return ret;
+    }
+
+    if ((ret = x509_get_crl_entry_ext(&p, end, &entry_ext)) != 0) {
+        return ret;
+    }
+
+    if (serial.len > MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN) {
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_SERIAL,
+                                 MBEDTLS_ERR_ASN1_INVALID_LENGTH);
+    }
+
+    if (ctx->serials_count >= SIZE_MAX / X509_CRL_SERIAL_RECORD_SIZE - 1) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    if ((ret = x509_crl_stream_grow(&ctx->serials, &ctx->serials_size,
+                                    ctx->serials_count * X509_CRL_SERIAL_RECORD_SIZE,
+                                    (ctx->serials_count + 1) *
+                                    X509_CRL_SERIAL_RECORD_SIZE)) != 0) {
+        return ret;
+    }
+
+    record = ctx->serials + ctx->serials_count * X509_CRL_SERIAL_RECORD_SIZE;
+    record[0] = (unsigned char) serial.len;
+    memcpy(record + 1, serial.p, serial.len);
+    memset(record + 1 + serial.len, 0,
+           MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN - serial.len);
+    ctx->serials_count++;
+
+    return 0;
+}
+
+static int x509_crl_stream_process(mbedtls_x509_crl_stream *ctx,
+                                   size_t content_len)
+{
+    int ret;
+
+    switch (ctx->state) {
+        case X509_CRL_STREAM_OUTER:
+            if (ctx->elem[0] != X509_CRL_SEQUENCE) {
+                return MBEDTLS_ERR_X509_INVALID_FORMAT;
+            }
+
+            ctx->outer_end = ctx->off + content_len;
+            ctx->state = X509_CRL_STREAM_TBS;
+            return 0;
+
+        case X509_CRL_STREAM_TBS:
+            if (ctx->elem[0] != X509_CRL_SEQUENCE) {
+                return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                         MBEDTLS_ERR_ASN1_UNEXPECTED_TAG);
+            }
+
+            ctx->tbs_start = ctx->off - ctx->elem_len;
+            ctx->tbs_end = ctx->off + content_len;
+            ctx->meta_hdr_len = ctx->elem_len;
+            ctx->state = X509_CRL_STREAM_TBS_FIELD;
+            return x509_crl_stream_append(&ctx->meta, &ctx->meta_len,
+                                          &ctx->meta_size,
+                                          ctx->elem, ctx->elem_len);
+
+        case X509_CRL_STREAM_TBS_FIELD:
+            return x509_crl_stream_tbs_field(ctx, content_len);
+
+        case X509_CRL_STREAM_ENTRY:
+            return x509_crl_stream_entry(ctx);
+
+        case X509_CRL_STREAM_TRAILER:
+            if ((ret = x509_crl_stream_append(&ctx->meta, &ctx->meta_len,
+                                              &ctx->meta_size,
+                                              ctx->elem, ctx->elem_len)) != 0) {
+                return ret;
+            }
+
+            ctx->trailer++;
+            return 0;
+
+        default:
+            return MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    }
+}
+
+/*
+ * Leave the structures that end at the current offset
+ */
+static int x509_crl_stream_advance(mbedtls_x509_crl_stream *ctx)
+{
+    size_t hash_len;
+
+    for (;;) {
+        if (ctx->state == X509_CRL_STREAM_ENTRY && ctx->off == ctx->entries_end) {
+            ctx->state = X509_CRL_STREAM_TBS_FIELD;
+            continue;
+        }
+
+        if (ctx->state == X509_CRL_STREAM_TBS_FIELD && ctx->off == ctx->tbs_end) {
+            if (ctx->step < X509_CRL_STEP_THIS_UPDATE) {
+                return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                         MBEDTLS_ERR_ASN1_OUT_OF_DATA);
+            }
+
+            ctx->hash_alg = 0;
+            if (psa_hash_finish(&ctx->hash, ctx->crl.tbs_hash,
+                                sizeof(ctx->crl.tbs_hash),
+                                &hash_len) != PSA_SUCCESS) {
+                return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+            }
+
+            ctx->crl.tbs_hash_len = hash_len;
+            ctx->meta_tbs_len = ctx->meta_len;
+            ctx->state = X509_CRL_STREAM_TRAILER;
+            continue;
+        }
+
+        if (ctx->state == X509_CRL_STREAM_TRAILER && ctx->trailer == 2) {
+            if (ctx->off != ctx->outer_end) {
+                return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                         MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
+            }
+
+            ctx->state = X509_CRL_STREAM_DONE;
+        }
+
+        return 0;
+    }
+}
+
+static void x509_crl_record_swap(unsigned char *a, unsigned char *b)
+{
+    unsigned char tmp[X509_CRL_SERIAL_RECORD_SIZE];
+
+    memcpy(tmp, a, sizeof(tmp));
+    memcpy(a, b, sizeof(tmp));
+    memcpy(b, tmp, sizeof(tmp));
+}
+
+static void x509_crl_record_sift_down(unsigned char *records,
+                                      size_t root, size_t count)
+{
+    size_t child;
+
+    while ((child = 2 * root + 1) < count) {
+        if (child + 1 < count &&
+            memcmp(records + child * X509_CRL_SERIAL_RECORD_SIZE,
+                   records + (child + 1) * X509_CRL_SERIAL_RECORD_SIZE,
+                   X509_CRL_SERIAL_RECORD_SIZE) < 0) {
+            child++;
+        }
+
+        if (memcmp(records + root * X509_CRL_SERIAL_RECORD_SIZE,
+                   records + child * X509_CRL_SERIAL_RECORD_SIZE,
+                   X509_CRL_SERIAL_RECORD_SIZE) >= 0) {
+            return;
+        }
+
+        x509_crl_record_swap(records + root * X509_CRL_SERIAL_RECORD_SIZE,
+                             records + child * X509_CRL_SERIAL_RECORD_SIZE);
+        root = child;
+    }
+}
+
+static void x509_crl_sort_records(unsigned char *records, size_t count)
+{
+    size_t i;
+
+    for (i = count / 2; i-- > 0;) {
+        x509_crl_record_sift_down(records, i, count);
+    }
+
+    for (i = count; i > 1; i--) {
+        x509_crl_record_swap(records,
+                             records + (i - 1) * X509_CRL_SERIAL_RECORD_SIZE);
+        x509_crl_record_sift_down(records, 0, i - 1);
+    }
+}
+
+int mbedtls_x509_crl_has_serial(const mbedtls_x509_crl *crl,
+                                const mbedtls_x509_buf *serial)
+{
+    unsigned char key[X509_CRL_SERIAL_RECORD_SIZE];
+    size_t lo = 0, hi = crl->serials_count, mid;
+    int cmp;
+
+    if (serial->len > MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN) {
+        return 0;
+    }
+
+    key[0] = (unsigned char) serial->len;
+    memcpy(key + 1, serial->p, serial->len);
+    memset(key + 1 + serial->len, 0,
+           MBEDTLS_X509_CRL_STREAM_MAX_SERIAL_LEN - serial->len);
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = memcmp(crl->serials + mid * X509_CRL_SERIAL_RECORD_SIZE,
+                     key, sizeof(key));
+
+        if (cmp == 0) {
+            return 1;
+        }
+
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return 0;
+}
+
+void mbedtls_x509_crl_stream_init(mbedtls_x509_crl_stream *ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_x509_crl_stream));
+    ctx->hash = psa_hash_operation_init();
+    mbedtls_x509_crl_init(&ctx->crl);
+}
+
+void mbedtls_x509_crl_stream_set_keep_raw(mbedtls_x509_crl_stream *ctx,
+                                          int keep_raw)
+{
+    ctx->keep_raw = keep_raw;
+}
+
+int mbedtls_x509_crl_stream_update(mbedtls_x509_crl_stream *ctx,
+                                   const unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t content_len = 0;
+
+    if (ctx->state == X509_CRL_STREAM_CLOSED) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    while (len > 0) {
+        ret = x509_crl_stream_fill(ctx, &buf, &len, &content_len);
+        if (ret == 1) {
+            break;
+        }
+
+        if (ret == 0) {
+            ret = x509_crl_stream_process(ctx, content_len);
+        }
+
+        if (ret == 0) {
+            ret = x509_crl_stream_advance(ctx);
+        }
+
+        if (ret != 0) {
+            ctx->state = X509_CRL_STREAM_CLOSED;
+            return ret;
+        }
+
+        ctx->elem_len = 0;
+    }
+
+    return 0;
+}
+
+int mbedtls_x509_crl_stream_finish(mbedtls_x509_crl_stream *ctx,
+                                   mbedtls_x509_crl *chain)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crl *crl = &ctx->crl;
+    mbedtls_x509_crl *tail = chain;
+    mbedtls_x509_buf sig_params1;
+    unsigned char *p;
+
+    if (chain == NULL || ctx->state == X509_CRL_STREAM_CLOSED) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    if (ctx->state != X509_CRL_STREAM_DONE) {
+        ctx->state = X509_CRL_STREAM_CLOSED;
+        return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_FORMAT,
+                                 MBEDTLS_ERR_ASN1_OUT_OF_DATA);
+    }
+
+    ctx->state = X509_CRL_STREAM_CLOSED;
+
+    /* From here on, the CRL owns all the buffers */
+    crl->stream_data = ctx->meta;
+    crl->stream_data_len = ctx->meta_size;
+    ctx->meta = NULL;
+
+    crl->serials = ctx->serials;
+    crl->serials_count = ctx->serials_count;
+    ctx->serials = NULL;
+
+    if (ctx->keep_raw) {
+        crl->raw.p = ctx->raw;
+        crl->raw.len = ctx->raw_len;
+        crl->tbs.p = ctx->raw + ctx->tbs_start;
+        crl->tbs.len = ctx->tbs_end - ctx->tbs_start;
+        ctx->raw = NULL;
+    }
+
+    memset(&sig_params1, 0, sizeof(mbedtls_x509_buf));
+    p = crl->stream_data + ctx->meta_hdr_len;
+
+    if ((ret = x509_crl_get_header(crl, &p, crl->stream_data + ctx->meta_tbs_len,
+                                   &sig_params1)) != 0 ||
+        (ret = x509_crl_get_trailer(crl, &p, crl->stream_data + ctx->meta_tbs_len,
+                                    crl->stream_data + ctx->meta_len,
+                                    &sig_params1)) != 0) {
+        return ret;
+    }
+
+    x509_crl_sort_records(crl->serials, crl->serials_count);
+
+    /*
+     * Add the CRL on the end of the chain, like mbedtls_x509_crl_parse_der()
+     */
+    while (tail->version != 0 && tail->next != NULL) {
+        tail = tail->next;
+    }
+
+    if (tail->version != 0) {
+        tail->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crl));
+        if (tail->next == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+
+        tail = tail->next;
+    }
+
+    crl->next = tail->next;
+    *tail = *crl;
+    mbedtls_x509_crl_init(crl);
+
+    return 0;
+}
+
+void mbedtls_x509_crl_stream_free(mbedtls_x509_crl_stream *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+
+    psa_hash_abort(&ctx->hash);
+
+    mbedtls_free(ctx->elem);
+    mbedtls_free(ctx->meta);
+    mbedtls_free(ctx->raw);
+    mbedtls_free(ctx->serials);
+    mbedtls_x509_crl_free(&ctx->crl);
+
+    mbedtls_platform_zeroize(ctx, sizeof(mbedtls_x509_crl_stream));
+}
+#endif /* MBEDTLS_X509_CRL_STREAM */
+
+#if !defined(MBEDTLS_X509_REMOVE_INFO)
+/*
+ * Return an informational string about the certificate.
+ */
+#define BEFORE_COLON    14
+#define BC              "14"
+/*
+ * Return an informational string about the CRL.
+ */
+int mbedtls_x509_crl_info(char *buf, size_t size, const char *prefix,
+                          const mbedtls_x509_crl *crl)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t n;
+    char *p;
+    const mbedtls_x509_crl_entry *entry;
+
+    p = buf;
+    n = size;
 
     ret = mbedtls_snprintf(p, n, "%sCRL version   : %d",
                            prefix, crl->version);
@@ -687,6 +1536,15 @@ void mbedtls_x509_crl_free(mbedtls_x509_crl *crl)
 
         mbedtls_asn1_free_named_data_list_shallow(crl_cur->issuer.next);
 
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+        mbedtls_free(crl_cur->serial_index);
+#endif
+
+#if defined(MBEDTLS_X509_CRL_STREAM)
+        mbedtls_free(crl_cur->serials);
+        mbedtls_free(crl_cur->stream_data);
+#endif
+
         entry_cur = crl_cur->entry.next;
         while (entry_cur != NULL) {
             entry_prv = entry_cur;
@@ -30,6 +30,7 @@
 
 #if defined(MBEDTLS_PEM_PARSE_C)
 #include "mbedtls/pem.h"
+#include "mbedtls/base64.h"
 #endif
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
@@ -38,6 +39,7 @@
 #include "mbedtls/psa_util.h"
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 #include "pk_internal.h"
+#include "fnv_internal.h"
 
 #include "mbedtls/platform.h"
 
@@ -368,6 +370,77 @@ static int x509_name_cmp(const mbedtls_x509_name *a, const mbedtls_x509_name *b)
     return 0;
 }
 
+/*
+ * FNV-1a of a tag and a value, good enough to tell most names apart and to
+ * spread names and key IDs over the buckets of a trust store
+ */
+static uint32_t x509_hash_buf(uint32_t hash, int tag,
+                              const unsigned char *p, size_t len,
+                              int fold)
+{
+    size_t i;
+    unsigned char c = (unsigned char) tag;
+
+    hash = mbedtls_fnv1a32(hash, &c, 1);
+
+    if (!fold) {
+        return mbedtls_fnv1a32(hash, p, len);
+    }
+
+    for (i = 0; i < len; i++) {
+        c = p[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        hash = mbedtls_fnv1a32(hash, &c, 1);
+    }
+
+    return hash;
+}
+
+/*
+ * Hash a Name so that names that x509_name_cmp() considers equal have the
+ * same hash: UTF8String and PrintableString values are case-folded and
+ * hashed without their tag, as x509_string_cmp() compares them.
+ */
+static uint32_t x509_name_hash(const mbedtls_x509_name *name)
+{
+    uint32_t hash = MBEDTLS_FNV1A32_INIT;
+
+    for (; name != NULL; name = name->next) {
+        hash = x509_hash_buf(hash, name->oid.tag,
+                             name->oid.p, name->oid.len, 0);
+
+        if (name->val.tag == MBEDTLS_ASN1_UTF8_STRING ||
+            name->val.tag == MBEDTLS_ASN1_PRINTABLE_STRING) {
+            hash = x509_hash_buf(hash, 0, name->val.p, name->val.len, 1);
+        } else {
+            hash = x509_hash_buf(hash, name->val.tag,
+                                 name->val.p, name->val.len, 0);
+        }
+
+        hash = x509_hash_buf(hash, name->next_merged, NULL, 0, 0);
+    }
+
+    return hash;
+}
+
+/*
+ * Compare the issuer of child with the subject of parent. The name hashes
+ * computed at parse time rule out most candidates without walking the names.
+ *
+ * Return 0 if equal, -1 otherwise.
+ */
+static int x509_crt_issuer_cmp(const mbedtls_x509_crt *child,
+                               const mbedtls_x509_crt *parent)
+{
+    if (child->issuer_hash != parent->subject_hash) {
+        return -1;
+    }
+
+    return x509_name_cmp(&child->issuer, &parent->subject);
+}
+
 /*
  * Reset (init or clear) a verify_chain
  */
@@ -386,6 +459,9 @@ static void x509_crt_verify_chain_reset(
 #if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
     ver_chain->trust_ca_cb_result = NULL;
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+    ver_chain->trust_ca_cache_entry = NULL;
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
 }
 
 /*
@@ -804,7 +880,7 @@ static int x509_get_certificate_policies(unsigned char **p,
                 return MBEDTLS_ERR_X509_INVALID_EXTENSIONS;
             }
 
-            cur->next = mbedtls_calloc(1, sizeof(mbedtls_asn1_sequence));
+            cur->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_asn1_sequence));
 
             if (cur->next == NULL) {
                 return MBEDTLS_ERROR_ADD(MBEDTLS_ERR_X509_INVALID_EXTENSIONS,
@@ -854,6 +930,98 @@ static int x509_get_certificate_policies(unsigned char **p,
     return parse_ret;
 }
 
+/*
+ * Lazy extension mode: the subject alternative name, extended key usage
+ * and certificate policies extensions are located at parse time and only
+ * decoded when needed.
+ */
+static void x509_crt_defer_ext(mbedtls_x509_crt *crt, int ext_type,
+                               mbedtls_x509_buf *value,
+                               unsigned char **p, const unsigned char *end)
+{
+    value->tag = MBEDTLS_ASN1_OCTET_STRING;
+    value->p = *p;
+    value->len = (size_t) (end - *p);
+    crt->deferred_ext |= ext_type;
+    *p = (unsigned char *) end;
+}
+
+static const mbedtls_x509_sequence *x509_crt_ext_list(const mbedtls_x509_crt *crt,
+                                                      int ext_type)
+{
+    switch (ext_type) {
+        case MBEDTLS_X509_EXT_SUBJECT_ALT_NAME:
+            return &crt->subject_alt_names;
+        case MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE:
+            return &crt->ext_key_usage;
+        default:
+            return &crt->certificate_policies;
+    }
+}
+
+/*
+ * Decode a deferred extension into list, which must be empty. On failure,
+ * list is left empty.
+ */
+static int x509_crt_decode_deferred(const mbedtls_x509_crt *crt, int ext_type,
+                                    mbedtls_x509_sequence *list)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    unsigned char *p;
+
+    switch (ext_type) {
+        case MBEDTLS_X509_EXT_SUBJECT_ALT_NAME:
+            p = crt->deferred_san.p;
+            ret = mbedtls_x509_get_subject_alt_name(&p, p + crt->deferred_san.len,
+                                                    list);
+            break;
+
+        case MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE:
+            p = crt->deferred_ext_key_usage.p;
+            ret = x509_get_ext_key_usage(&p, p + crt->deferred_ext_key_usage.len,
+                                         list);
+            break;
+
+        default:
+            p = crt->deferred_policies.p;
+            ret = x509_get_certificate_policies(&p, p + crt->deferred_policies.len,
+                                                list);
+            /* As when parsing a non-critical extension: the policies are
+             * listed even if they cannot be interpreted. */
+            if (ret == MBEDTLS_ERR_X509_FEATURE_UNAVAILABLE) {
+                ret = 0;
+            }
+            break;
+    }
+
+    if (ret != 0) {
+        mbedtls_asn1_sequence_free(list->next);
+        memset(list, 0, sizeof(mbedtls_x509_sequence));
+    }
+
+    return ret;
+}
+
+/*
+ * Get the list of an extension. If it is deferred, decode it into tmp
+ * rather than into the certificate, which may be shared between threads.
+ * The caller must free tmp->next.
+ */
+static int x509_crt_get_ext_list(const mbedtls_x509_crt *crt, int ext_type,
+                                 mbedtls_x509_sequence *tmp,
+                                 const mbedtls_x509_sequence **list)
+{
+    memset(tmp, 0, sizeof(mbedtls_x509_sequence));
+
+    if ((crt->deferred_ext & ext_type) == 0) {
+        *list = x509_crt_ext_list(crt, ext_type);
+        return 0;
+    }
+
+    *list = tmp;
+    return x509_crt_decode_deferred(crt, ext_type, tmp);
+}
+
 /*
  * X.509 v3 extensions
  *
@@ -861,6 +1029,7 @@ static int x509_get_certificate_policies(unsigned char **p,
 static int x509_get_crt_ext(unsigned char **p,
                             const unsigned char *end,
                             mbedtls_x509_crt *crt,
+                            int lazy,
                             mbedtls_x509_crt_ext_cb_t cb,
                             void *p_ctx)
 {
@@ -928,7 +1097,7 @@ static int x509_get_crt_ext(unsigned char **p,
         /*
          * Detect supported extensions
          */
-        ret = mbedtls_oid_get_x509_ext_type(&extn_oid, &ext_type);
+        ret = mbedtls_x509_get_ext_type(&extn_oid, &ext_type);
 
         if (ret != 0) {
             /* Give the callback (if any) a chance to handle the extension */
@@ -977,6 +1146,11 @@ static int x509_get_crt_ext(unsigned char **p,
                 break;
 
             case MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE:
+                if (lazy && !is_critical) {
+                    x509_crt_defer_ext(crt, ext_type, &crt->deferred_ext_key_usage,
+                                       p, end_ext_octet);
+                    break;
+                }
                 /* Parse extended key usage */
                 if ((ret = x509_get_ext_key_usage(p, end_ext_octet,
                                                   &crt->ext_key_usage)) != 0) {
@@ -1000,6 +1174,11 @@ static int x509_get_crt_ext(unsigned char **p,
                 }
                 break;
             case MBEDTLS_X509_EXT_SUBJECT_ALT_NAME:
+                if (lazy && !is_critical) {
+                    x509_crt_defer_ext(crt, ext_type, &crt->deferred_san,
+                                       p, end_ext_octet);
+                    break;
+                }
                 /* Parse subject alt name
                  * SubjectAltName ::= GeneralNames
                  */
@@ -1018,6 +1197,13 @@ static int x509_get_crt_ext(unsigned char **p,
                 break;
 
             case MBEDTLS_OID_X509_EXT_CERTIFICATE_POLICIES:
+                /* Unsupported policies are given to the callback, which
+                 * cannot be deferred. */
+                if (lazy && !is_critical && cb == NULL) {
+                    x509_crt_defer_ext(crt, ext_type, &crt->deferred_policies,
+                                       p, end_ext_octet);
+                    break;
+                }
                 /* Parse certificate policies type */
                 if ((ret = x509_get_certificate_policies(p, end_ext_octet,
                                                          &crt->certificate_policies)) != 0) {
@@ -1073,6 +1259,7 @@ static int x509_crt_parse_der_core(mbedtls_x509_crt *crt,
                                    const unsigned char *buf,
                                    size_t buflen,
                                    int make_copy,
+                                   int lazy_ext,
                                    mbedtls_x509_crt_ext_cb_t cb,
                                    void *p_ctx)
 {
@@ -1113,7 +1300,7 @@ static int x509_crt_parse_der_core(mbedtls_x509_crt *crt,
     crt->raw.len = (size_t) (crt_end - buf);
     if (make_copy != 0) {
         /* Create and populate a new buffer for the raw field. */
-        crt->raw.p = p = mbedtls_calloc(1, crt->raw.len);
+        crt->raw.p = p = mbedtls_calloc_tagged(X509, 1, crt->raw.len);
         if (crt->raw.p == NULL) {
             return MBEDTLS_ERR_X509_ALLOC_FAILED;
         }
@@ -1200,6 +1387,10 @@ static int x509_crt_parse_der_core(mbedtls_x509_crt *crt,
         mbedtls_x509_crt_free(crt);
         return ret;
     }
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    crt->valid_from_ts = mbedtls_x509_time_to_epoch(&crt->valid_from);
+    crt->valid_to_ts = mbedtls_x509_time_to_epoch(&crt->valid_to);
+#endif
 
     /*
      * subject              Name
@@ -1254,7 +1445,7 @@ static int x509_crt_parse_der_core(mbedtls_x509_crt *crt,
     }
 
     if (crt->version == 3) {
-        ret = x509_get_crt_ext(&p, end, crt, cb, p_ctx);
+        ret = x509_get_crt_ext(&p, end, crt, lazy_ext, cb, p_ctx);
         if (ret != 0) {
             mbedtls_x509_crt_free(crt);
             return ret;
@@ -1302,22 +1493,191 @@ static int x509_crt_parse_der_core(mbedtls_x509_crt *crt,
                                  MBEDTLS_ERR_ASN1_LENGTH_MISMATCH);
     }
 
+    crt->issuer_hash = x509_name_hash(&crt->issuer);
+    crt->subject_hash = x509_name_hash(&crt->subject);
+
     return 0;
 }
 
 /*
- * Parse one X.509 certificate in DER format from a buffer and add them to a
- * chained list
+ * Arena mode: move the sub-structures of a certificate that were allocated
+ * one by one during parsing into a single allocation.
  */
-static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
-                                               const unsigned char *buf,
-                                               size_t buflen,
-                                               int make_copy,
-                                               mbedtls_x509_crt_ext_cb_t cb,
-                                               void *p_ctx)
+static void x509_crt_arena_pack(mbedtls_x509_crt *crt)
+{
+    size_t names, seqs, len, opts_len = 0;
+    mbedtls_x509_name *name_arena;
+    mbedtls_x509_sequence *seq_arena;
+
+    names = mbedtls_x509_count_names(crt->issuer.next) +
+            mbedtls_x509_count_names(crt->subject.next);
+    seqs = mbedtls_x509_count_sequence(crt->ext_key_usage.next) +
+           mbedtls_x509_count_sequence(crt->subject_alt_names.next) +
+           mbedtls_x509_count_sequence(crt->certificate_policies.next) +
+           mbedtls_x509_count_sequence(crt->authority_key_id.authorityCertIssuer.next);
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    if (crt->sig_opts != NULL) {
+        opts_len = sizeof(mbedtls_pk_rsassa_pss_options);
+    }
+#endif
+
+    len = names * sizeof(mbedtls_x509_name) +
+          seqs * sizeof(mbedtls_x509_sequence) + opts_len;
+    if (len == 0) {
+        return;
+    }
+
+    /* Without memory for the arena, the certificate keeps its individual
+     * allocations, which is just as valid. */
+    crt->arena = mbedtls_calloc_tagged(X509, 1, len);
+    if (crt->arena == NULL) {
+        return;
+    }
+    crt->arena_len = len;
+
+    name_arena = (mbedtls_x509_name *) crt->arena;
+    mbedtls_x509_arena_move_names(&crt->issuer, &name_arena);
+    mbedtls_x509_arena_move_names(&crt->subject, &name_arena);
+
+    seq_arena = (mbedtls_x509_sequence *) name_arena;
+    mbedtls_x509_arena_move_sequence(&crt->ext_key_usage, &seq_arena);
+    mbedtls_x509_arena_move_sequence(&crt->subject_alt_names, &seq_arena);
+    mbedtls_x509_arena_move_sequence(&crt->certificate_policies, &seq_arena);
+    mbedtls_x509_arena_move_sequence(&crt->authority_key_id.authorityCertIssuer,
+                                     &seq_arena);
+
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    if (opts_len != 0) {
+        void *opts = seq_arena;
+
+        memcpy(opts, crt->sig_opts, opts_len);
+        mbedtls_free(crt->sig_opts);
+        crt->sig_opts = opts;
+    }
+#endif
+}
+
+/*
+ * Index of the DNS names of the subject alternative name extension, sorted
+ * case-insensitively so that a name is looked up by binary search. It is
+ * only built for certificates with many names, the others are scanned.
+ */
+#define X509_SAN_INDEX_MIN 16
+
+/*
+ * Compare name with the concatenation of a and b, folding ASCII letters as
+ * x509_memcasecmp() does.
+ */
+static int x509_san_cmp(const mbedtls_x509_buf *name,
+                        const unsigned char *a, size_t a_len,
+                        const unsigned char *b, size_t b_len)
+{
+    size_t i, len = a_len + b_len;
+    unsigned char c1, c2;
+
+    for (i = 0; i < name->len && i < len; i++) {
+        c1 = name->p[i];
+        c2 = i < a_len ? a[i] : b[i - a_len];
+        if (c1 >= 'A' && c1 <= 'Z') {
+            c1 += 'a' - 'A';
+        }
+        if (c2 >= 'A' && c2 <= 'Z') {
+            c2 += 'a' - 'A';
+        }
+        if (c1 != c2) {
+            return c1 < c2 ? -1 : 1;
+        }
+    }
+
+    return name->len < len ? -1 : name->len > len;
+}
+
+static void x509_san_index_sift_down(mbedtls_x509_buf *names,
+                                     size_t root, size_t count)
+{
+    mbedtls_x509_buf tmp;
+    size_t child;
+
+    while ((child = 2 * root + 1) < count) {
+        if (child + 1 < count &&
+            x509_san_cmp(&names[child], names[child + 1].p,
+                         names[child + 1].len, NULL, 0) < 0) {
+            child++;
+        }
+
+        if (x509_san_cmp(&names[root], names[child].p,
+                         names[child].len, NULL, 0) >= 0) {
+            return;
+        }
+
+        tmp = names[root];
+        names[root] = names[child];
+        names[child] = tmp;
+        root = child;
+    }
+}
+
+static void x509_crt_san_index_build(mbedtls_x509_crt *crt)
+{
+    const mbedtls_x509_sequence *cur;
+    mbedtls_x509_buf tmp;
+    size_t i, count = 0;
+    unsigned char type;
+
+    crt->san_types = 0;
+    for (cur = &crt->subject_alt_names; cur != NULL; cur = cur->next) {
+        if (cur->buf.p == NULL) {
+            continue;
+        }
+        type = (unsigned char) cur->buf.tag & MBEDTLS_ASN1_TAG_VALUE_MASK;
+        crt->san_types |= 1u << type;
+        count += type == MBEDTLS_X509_SAN_DNS_NAME;
+    }
+
+    /* Without memory for the index, the names are scanned, which is just
+     * as correct. */
+    if (count < X509_SAN_INDEX_MIN ||
+        (crt->san_dns = mbedtls_calloc_tagged(X509, count, sizeof(mbedtls_x509_buf))) == NULL) {
+        return;
+    }
+
+    for (cur = &crt->subject_alt_names; cur != NULL; cur = cur->next) {
+        if (cur->buf.p != NULL &&
+            ((unsigned char) cur->buf.tag & MBEDTLS_ASN1_TAG_VALUE_MASK) ==
+            MBEDTLS_X509_SAN_DNS_NAME) {
+            crt->san_dns[crt->san_dns_len++] = cur->buf;
+        }
+    }
+
+    /* Heap sort, so that lookups are a binary search */
+    for (i = count / 2; i-- > 0;) {
+        x509_san_index_sift_down(crt->san_dns, i, count);
+    }
+
+    for (i = count; i > 1; i--) {
+        tmp = crt->san_dns[0];
+        crt->san_dns[0] = crt->san_dns[i - 1];
+        crt->san_dns[i - 1] = tmp;
+        x509_san_index_sift_down(crt->san_dns, 0, i - 1);
+    }
+}
+
+/*
+ * Parse one X.509 certificate in DER format from a buffer and add it to a
+ * chained list, looking for the end of the chain from *tail if it is not
+ * NULL. On success, *tail is the new certificate.
+ */
+static int x509_crt_parse_der_append(mbedtls_x509_crt *chain,
+                                     mbedtls_x509_crt **tail,
+                                     const unsigned char *buf,
+                                     size_t buflen,
+                                     int make_copy,
+                                     mbedtls_x509_crt_ext_cb_t cb,
+                                     void *p_ctx)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_x509_crt *crt = chain, *prev = NULL;
+    int use_arena, use_lazy_ext;
 
     /*
      * Check for valid input
@@ -1326,6 +1686,13 @@ static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
         return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
     }
 
+    if (*tail != NULL) {
+        crt = *tail;
+    }
+
+    use_arena = chain->use_arena;
+    use_lazy_ext = chain->use_lazy_ext;
+
     while (crt->version != 0 && crt->next != NULL) {
         prev = crt;
         crt = crt->next;
@@ -1335,7 +1702,7 @@ static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
      * Add new certificate on the end of the chain if needed.
      */
     if (crt->version != 0 && crt->next == NULL) {
-        crt->next = mbedtls_calloc(1, sizeof(mbedtls_x509_crt));
+        crt->next = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
 
         if (crt->next == NULL) {
             return MBEDTLS_ERR_X509_ALLOC_FAILED;
@@ -1346,7 +1713,8 @@ static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
         crt = crt->next;
     }
 
-    ret = x509_crt_parse_der_core(crt, buf, buflen, make_copy, cb, p_ctx);
+    ret = x509_crt_parse_der_core(crt, buf, buflen, make_copy, use_lazy_ext,
+                                  cb, p_ctx);
     if (ret != 0) {
         if (prev) {
             prev->next = NULL;
@@ -1354,11 +1722,108 @@ static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
 
         if (crt != chain) {
             mbedtls_free(crt);
+        } else {
+            /* The failed certificate was freed, but the chain keeps its
+             * modes for the next one. */
+            chain->use_arena = use_arena;
+            chain->use_lazy_ext = use_lazy_ext;
         }
 
         return ret;
     }
 
+    if (use_arena) {
+        x509_crt_arena_pack(crt);
+    }
+
+    x509_crt_san_index_build(crt);
+
+    *tail = crt;
+
+    return 0;
+}
+
+/*
+ * Parse one X.509 certificate in DER format from a buffer and add them to a
+ * chained list
+ */
+static int mbedtls_x509_crt_parse_der_internal(mbedtls_x509_crt *chain,
+                                               const unsigned char *buf,
+                                               size_t buflen,
+                                               int make_copy,
+                                               mbedtls_x509_crt_ext_cb_t cb,
+                                               void *p_ctx)
+{
+    mbedtls_x509_crt *tail = NULL;
+
+    return x509_crt_parse_der_append(chain, &tail, buf, buflen, make_copy,
+                                     cb, p_ctx);
+}
+
+void mbedtls_x509_crt_set_arena(mbedtls_x509_crt *chain, int enable)
+{
+    chain->use_arena = enable != 0;
+}
+
+void mbedtls_x509_crt_set_lazy_ext(mbedtls_x509_crt *chain, int enable)
+{
+    chain->use_lazy_ext = enable != 0;
+}
+
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+int mbedtls_x509_crt_set_ocsp_response(mbedtls_x509_crt *crt,
+                                       const unsigned char *buf, size_t len)
+{
+    unsigned char *copy = NULL;
+
+    if (len != 0) {
+        copy = mbedtls_calloc_tagged(X509, 1, len);
+        if (copy == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+        memcpy(copy, buf, len);
+    }
+
+    mbedtls_free(crt->ocsp_response);
+    crt->ocsp_response = copy;
+    crt->ocsp_response_len = len;
+
+    return 0;
+}
+#endif /* MBEDTLS_X509_OCSP_STAPLE */
+
+int mbedtls_x509_crt_load_ext(mbedtls_x509_crt *chain)
+{
+    static const int ext_types[] = {
+        MBEDTLS_X509_EXT_SUBJECT_ALT_NAME,
+        MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE,
+        MBEDTLS_X509_EXT_CERTIFICATE_POLICIES,
+    };
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt *crt;
+    size_t i;
+
+    for (crt = chain; crt != NULL; crt = crt->next) {
+        for (i = 0; i < sizeof(ext_types) / sizeof(ext_types[0]); i++) {
+            if ((crt->deferred_ext & ext_types[i]) == 0) {
+                continue;
+            }
+
+            ret = x509_crt_decode_deferred(crt, ext_types[i],
+                                           (mbedtls_x509_sequence *)
+                                           x509_crt_ext_list(crt, ext_types[i]));
+            if (ret != 0) {
+                return ret;
+            }
+            crt->deferred_ext &= ~ext_types[i];
+            crt->late_ext |= ext_types[i];
+
+            if (ext_types[i] == MBEDTLS_X509_EXT_SUBJECT_ALT_NAME) {
+                x509_crt_san_index_build(crt);
+            }
+        }
+    }
+
     return 0;
 }
 
@@ -1500,33 +1965,301 @@ int mbedtls_x509_crt_parse(mbedtls_x509_crt *chain,
 #endif /* MBEDTLS_PEM_PARSE_C */
 }
 
-#if defined(MBEDTLS_FS_IO)
+#if defined(MBEDTLS_PEM_PARSE_C)
 /*
- * Load one or more certificates and add them to the chained list
+ * Values of the base64 characters, 0xFF for the others. Certificates are
+ * public, so unlike the base64 module this does not need to be constant-time.
  */
-int mbedtls_x509_crt_parse_file(mbedtls_x509_crt *chain, const char *path)
+static const unsigned char x509_crt_base64_dec[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+/*
+ * Decode the base64 body of a PEM certificate, with the whitespace the
+ * base64 module accepts: line breaks, and spaces at the end of a line.
+ * dst must hold 3 bytes per 4 characters, rounded up.
+ */
+static int x509_crt_pem_decode(const unsigned char *src, size_t slen,
+                               unsigned char *dst, size_t *olen)
 {
-    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
-    size_t n;
-    unsigned char *buf;
+    const unsigned char *const dec = x509_crt_base64_dec;
+    unsigned char *p = dst;
+    uint32_t acc = 0;
+    size_t i = 0, n = 0, equals = 0;
+    unsigned char c;
+
+    while (i < slen) {
+        /* Most of the body is whole lines of characters of the alphabet:
+         * take them eight at a time, with one check, for six bytes. */
+        if (n == 0 && equals == 0 && slen - i >= 8) {
+            const unsigned char *s = src + i;
+            uint64_t v0 = dec[s[0]], v1 = dec[s[1]], v2 = dec[s[2]],
+                     v3 = dec[s[3]], v4 = dec[s[4]], v5 = dec[s[5]],
+                     v6 = dec[s[6]], v7 = dec[s[7]];
+
+            if ((v0 | v1 | v2 | v3 | v4 | v5 | v6 | v7) < 64) {
+                uint64_t v = (v0 << 42) | (v1 << 36) | (v2 << 30) |
+                             (v3 << 24) | (v4 << 18) | (v5 << 12) |
+                             (v6 << 6) | v7;
+
+                p[0] = MBEDTLS_BYTE_5(v);
+                p[1] = MBEDTLS_BYTE_4(v);
+                p[2] = MBEDTLS_BYTE_3(v);
+                p[3] = MBEDTLS_BYTE_2(v);
+                p[4] = MBEDTLS_BYTE_1(v);
+                p[5] = MBEDTLS_BYTE_0(v);
+                p += 6;
+                i += 8;
+                continue;
+            }
+        }
 
-    if ((ret = mbedtls_pk_load_file(path, &buf, &n)) != 0) {
-        return ret;
+        c = src[i];
+
+        if (c == ' ') {
+            while (i < slen && src[i] == ' ') {
+                i++;
+            }
+            if (i == slen || src[i] == '\n' ||
+                (src[i] == '\r' && i + 1 < slen && src[i + 1] == '\n')) {
+                continue;
+            }
+            /* Space inside a line */
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+
+        if (c == '\n') {
+            i++;
+            continue;
+        }
+        if (c == '\r' && i + 1 < slen && src[i + 1] == '\n') {
+            i += 2;
+            continue;
+        }
+
+        if (c == '=') {
+            if (++equals > 2) {
+                return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+            }
+            acc <<= 6;
+        } else {
+            if (dec[c] >= 64 || equals != 0) {
+                return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+            }
+            acc = (acc << 6) | dec[c];
+        }
+        i++;
+
+        if (++n == 4) {
+            *p++ = MBEDTLS_BYTE_2(acc);
+            if (equals < 2) {
+                *p++ = MBEDTLS_BYTE_1(acc);
+            }
+            if (equals < 1) {
+                *p++ = MBEDTLS_BYTE_0(acc);
+            }
+            acc = 0;
+            n = 0;
+        }
     }
 
-    ret = mbedtls_x509_crt_parse(chain, buf, n);
+    /* Padding may be left out, but not half of it, nor a lone character */
+    if (n != 0) {
+        if (equals != 0 || n == 1) {
+            return MBEDTLS_ERR_BASE64_INVALID_CHARACTER;
+        }
+        acc <<= 6 * (4 - n);
+        *p++ = MBEDTLS_BYTE_2(acc);
+        if (n == 3) {
+            *p++ = MBEDTLS_BYTE_1(acc);
+        }
+    }
 
-    mbedtls_zeroize_and_free(buf, n);
+    *olen = (size_t) (p - dst);
 
-    return ret;
+    return 0;
 }
 
-int mbedtls_x509_crt_parse_path(mbedtls_x509_crt *chain, const char *path)
+static const unsigned char *x509_crt_find_marker(const unsigned char *p,
+                                                 const unsigned char *end,
+                                                 const char *marker,
+                                                 size_t len)
 {
-    int ret = 0;
-#if defined(_WIN32) && !defined(EFIX64) && !defined(EFI32)
-    int w_ret;
-    WCHAR szDir[MAX_PATH];
+    while ((size_t) (end - p) >= len) {
+        p = memchr(p, marker[0], (size_t) (end - p) - len + 1);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (memcmp(p, marker, len) == 0) {
+            return p;
+        }
+        p++;
+    }
+
+    return NULL;
+}
+
+/*
+ * Parse a bundle of PEM certificates in one pass, each decoded into the
+ * buffer the certificate keeps
+ */
+int mbedtls_x509_crt_parse_bundle(mbedtls_x509_crt *chain,
+                                  const unsigned char *buf,
+                                  size_t buflen)
+{
+    static const char header[] = "-----BEGIN CERTIFICATE-----";
+    static const char footer[] = "-----END CERTIFICATE-----";
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int success = 0, first_error = 0, total_failed = 0;
+    mbedtls_x509_crt *tail = NULL;
+    const unsigned char *p, *end, *s, *e;
+    unsigned char *der;
+    size_t der_len;
+
+    if (chain == NULL || buf == NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    p = buf;
+    end = buf + buflen;
+
+    while ((s = x509_crt_find_marker(p, end, header,
+                                     sizeof(header) - 1)) != NULL) {
+        s += sizeof(header) - 1;
+        p = s;
+
+        /* The header must end its line */
+        while (s < end && *s == ' ') {
+            s++;
+        }
+        if (s < end && *s == '\r') {
+            s++;
+        }
+        if (s == end || *s != '\n') {
+            continue;
+        }
+        s++;
+
+        e = x509_crt_find_marker(s, end, footer, sizeof(footer) - 1);
+        if (e == NULL) {
+            break;
+        }
+        p = e + sizeof(footer) - 1;
+
+        der = mbedtls_calloc_tagged(X509, 1, (size_t) (e - s) / 4 * 3 + 3);
+        if (der == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+
+        ret = x509_crt_pem_decode(s, (size_t) (e - s), der, &der_len);
+        if (ret != 0) {
+            ret = MBEDTLS_ERROR_ADD(MBEDTLS_ERR_PEM_INVALID_DATA, ret);
+        } else {
+            ret = x509_crt_parse_der_append(chain, &tail, der, der_len, 0,
+                                            NULL, NULL);
+        }
+
+        if (ret != 0) {
+            mbedtls_free(der);
+
+            /*
+             * Quit parsing on a memory error
+             */
+            if (ret == MBEDTLS_ERR_X509_ALLOC_FAILED) {
+                return ret;
+            }
+
+            if (first_error == 0) {
+                first_error = ret;
+            }
+
+            total_failed++;
+            continue;
+        }
+
+        /* The certificate was parsed in place: it owns the buffer now */
+        tail->own_buffer = 1;
+        success = 1;
+    }
+
+    if (success) {
+        return total_failed;
+    } else if (first_error) {
+        return first_error;
+    } else {
+        return MBEDTLS_ERR_X509_CERT_UNKNOWN_FORMAT;
+    }
+}
+#endif /* MBEDTLS_PEM_PARSE_C */
+
+#if defined(MBEDTLS_FS_IO)
+/*
+ * Load one or more certificates and add them to the chained list
+ */
+int mbedtls_x509_crt_parse_file(mbedtls_x509_crt *chain, const char *path)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t n;
+    unsigned char *buf;
+
+    if ((ret = mbedtls_pk_load_file(path, &buf, &n)) != 0) {
+        return ret;
+    }
+
+    ret = mbedtls_x509_crt_parse(chain, buf, n);
+
+    mbedtls_zeroize_and_free(buf, n);
+
+    return ret;
+}
+
+#if defined(MBEDTLS_PEM_PARSE_C)
+int mbedtls_x509_crt_parse_bundle_file(mbedtls_x509_crt *chain,
+                                       const char *path)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t n;
+    unsigned char *buf;
+
+    if ((ret = mbedtls_pk_load_file(path, &buf, &n)) != 0) {
+        return ret;
+    }
+
+    ret = mbedtls_x509_crt_parse_bundle(chain, buf, n);
+
+    mbedtls_zeroize_and_free(buf, n);
+
+    return ret;
+}
+#endif /* MBEDTLS_PEM_PARSE_C */
+
+/*
+ * Call f_file on each regular file of a directory, with its path and its
+ * name. Return the sum of what it returns, or the first negative value.
+ */
+static int x509_crt_for_each_file(const char *path,
+                                  int (*f_file)(void *, const char *, const char *),
+                                  void *p_file)
+{
+    int ret = 0;
+#if defined(_WIN32) && !defined(EFIX64) && !defined(EFI32)
+    int w_ret;
+    WCHAR szDir[MAX_PATH];
     char filename[MAX_PATH];
     char *p;
     size_t len = strlen(path);
@@ -1575,12 +2308,13 @@ int mbedtls_x509_crt_parse_path(mbedtls_x509_crt *chain, const char *path)
             goto cleanup;
         }
 
-        w_ret = mbedtls_x509_crt_parse_file(chain, filename);
+        w_ret = f_file(p_file, filename, p);
         if (w_ret < 0) {
-            ret++;
-        } else {
-            ret += w_ret;
+            ret = w_ret;
+            goto cleanup;
         }
+
+        ret += w_ret;
     } while (FindNextFileW(hFind, &file_data) != 0);
 
     if (GetLastError() != ERROR_NO_MORE_FILES) {
@@ -1637,14 +2371,13 @@ cleanup:
             continue;
         }
 
-        // Ignore parse errors
-        //
-        t_ret = mbedtls_x509_crt_parse_file(chain, entry_name);
+        t_ret = f_file(p_file, entry_name, entry->d_name);
         if (t_ret < 0) {
-            ret++;
-        } else {
-            ret += t_ret;
+            ret = t_ret;
+            goto cleanup;
         }
+
+        ret += t_ret;
     }
 
 cleanup:
@@ -1660,6 +2393,28 @@ cleanup:
 
     return ret;
 }
+
+/*
+ * Parse one file of a directory, counting errors
+ */
+static int x509_crt_parse_path_file(void *p_chain, const char *path,
+                                    const char *name)
+{
+    int ret;
+
+    (void) name;
+
+    // Ignore parse errors
+    //
+    ret = mbedtls_x509_crt_parse_file(p_chain, path);
+
+    return ret < 0 ? 1 : ret;
+}
+
+int mbedtls_x509_crt_parse_path(mbedtls_x509_crt *chain, const char *path)
+{
+    return x509_crt_for_each_file(path, x509_crt_parse_path_file, chain);
+}
 #endif /* MBEDTLS_FS_IO */
 
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
@@ -1754,6 +2509,8 @@ int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix,
     size_t n;
     char *p;
     char key_size_str[BEFORE_COLON];
+    mbedtls_x509_sequence tmp;
+    const mbedtls_x509_sequence *list;
 
     p = buf;
     n = size;
@@ -1835,9 +2592,13 @@ int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix,
         ret = mbedtls_snprintf(p, n, "\n%ssubject alt name  :", prefix);
         MBEDTLS_X509_SAFE_SNPRINTF;
 
-        if ((ret = mbedtls_x509_info_subject_alt_name(&p, &n,
-                                                      &crt->subject_alt_names,
-                                                      prefix)) != 0) {
+        if ((ret = x509_crt_get_ext_list(crt, MBEDTLS_X509_EXT_SUBJECT_ALT_NAME,
+                                         &tmp, &list)) != 0) {
+            return ret;
+        }
+        ret = mbedtls_x509_info_subject_alt_name(&p, &n, list, prefix);
+        mbedtls_asn1_sequence_free(tmp.next);
+        if (ret != 0) {
             return ret;
         }
     }
@@ -1864,8 +2625,13 @@ int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix,
         ret = mbedtls_snprintf(p, n, "\n%sext key usage     : ", prefix);
         MBEDTLS_X509_SAFE_SNPRINTF;
 
-        if ((ret = x509_info_ext_key_usage(&p, &n,
-                                           &crt->ext_key_usage)) != 0) {
+        if ((ret = x509_crt_get_ext_list(crt, MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE,
+                                         &tmp, &list)) != 0) {
+            return ret;
+        }
+        ret = x509_info_ext_key_usage(&p, &n, list);
+        mbedtls_asn1_sequence_free(tmp.next);
+        if (ret != 0) {
             return ret;
         }
     }
@@ -1874,8 +2640,13 @@ int mbedtls_x509_crt_info(char *buf, size_t size, const char *prefix,
         ret = mbedtls_snprintf(p, n, "\n%scertificate policies : ", prefix);
         MBEDTLS_X509_SAFE_SNPRINTF;
 
-        if ((ret = x509_info_cert_policies(&p, &n,
-                                           &crt->certificate_policies)) != 0) {
+        if ((ret = x509_crt_get_ext_list(crt, MBEDTLS_X509_EXT_CERTIFICATE_POLICIES,
+                                         &tmp, &list)) != 0) {
+            return ret;
+        }
+        ret = x509_info_cert_policies(&p, &n, list);
+        mbedtls_asn1_sequence_free(tmp.next);
+        if (ret != 0) {
             return ret;
         }
     }
@@ -1956,30 +2727,42 @@ int mbedtls_x509_crt_check_extended_key_usage(const mbedtls_x509_crt *crt,
                                               const char *usage_oid,
                                               size_t usage_len)
 {
-    const mbedtls_x509_sequence *cur;
+    int ret = MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    mbedtls_x509_sequence tmp;
+    const mbedtls_x509_sequence *list, *cur;
 
     /* Extension is not mandatory, absent means no restriction */
     if ((crt->ext_types & MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE) == 0) {
         return 0;
     }
 
+    /* A malformed deferred extension allows no usage. */
+    if (x509_crt_get_ext_list(crt, MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE,
+                              &tmp, &list) != 0) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
     /*
      * Look for the requested usage (or wildcard ANY) in our list
      */
-    for (cur = &crt->ext_key_usage; cur != NULL; cur = cur->next) {
+    for (cur = list; cur != NULL; cur = cur->next) {
         const mbedtls_x509_buf *cur_oid = &cur->buf;
 
         if (cur_oid->len == usage_len &&
             memcmp(cur_oid->p, usage_oid, usage_len) == 0) {
-            return 0;
+            ret = 0;
+            break;
         }
 
         if (MBEDTLS_OID_CMP(MBEDTLS_OID_ANY_EXTENDED_KEY_USAGE, cur_oid) == 0) {
-            return 0;
+            ret = 0;
+            break;
         }
     }
 
-    return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    mbedtls_asn1_sequence_free(tmp.next);
+
+    return ret;
 }
 
 #if defined(MBEDTLS_X509_CRL_PARSE_C)
@@ -1990,6 +2773,18 @@ int mbedtls_x509_crt_is_revoked(const mbedtls_x509_crt *crt, const mbedtls_x509_
 {
     const mbedtls_x509_crl_entry *cur = &crl->entry;
 
+#if defined(MBEDTLS_X509_CRL_STREAM)
+    if (crl->serials != NULL) {
+        return mbedtls_x509_crl_has_serial(crl, &crt->serial);
+    }
+#endif
+
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+    if (crl->serial_index != NULL) {
+        return mbedtls_x509_crl_find_serial(crl, &crt->serial) != NULL;
+    }
+#endif
+
     while (cur != NULL && cur->serial.len != 0) {
         if (crt->serial.len == cur->serial.len &&
             memcmp(crt->serial.p, cur->serial.p, crt->serial.len) == 0) {
@@ -2051,30 +2846,39 @@ static int x509_crt_verifycrl(mbedtls_x509_crt *crt, mbedtls_x509_crt *ca,
             flags |= MBEDTLS_X509_BADCRL_BAD_PK;
         }
 
+#if defined(MBEDTLS_X509_CRL_STREAM)
+        /* A streamed CRL was hashed as it was parsed */
+        if (crl_list->tbs_hash_len != 0) {
+            memcpy(hash, crl_list->tbs_hash, crl_list->tbs_hash_len);
+            hash_length = crl_list->tbs_hash_len;
+        } else
+#endif
+        {
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-        psa_algorithm = mbedtls_md_psa_alg_from_type(crl_list->sig_md);
-        if (psa_hash_compute(psa_algorithm,
-                             crl_list->tbs.p,
-                             crl_list->tbs.len,
-                             hash,
-                             sizeof(hash),
-                             &hash_length) != PSA_SUCCESS) {
-            /* Note: this can't happen except after an internal error */
-            flags |= MBEDTLS_X509_BADCRL_NOT_TRUSTED;
-            break;
-        }
+            psa_algorithm = mbedtls_md_psa_alg_from_type(crl_list->sig_md);
+            if (psa_hash_compute(psa_algorithm,
+                                 crl_list->tbs.p,
+                                 crl_list->tbs.len,
+                                 hash,
+                                 sizeof(hash),
+                                 &hash_length) != PSA_SUCCESS) {
+                /* Note: this can't happen except after an internal error */
+                flags |= MBEDTLS_X509_BADCRL_NOT_TRUSTED;
+                break;
+            }
 #else
-        md_info = mbedtls_md_info_from_type(crl_list->sig_md);
-        hash_length = mbedtls_md_get_size(md_info);
-        if (mbedtls_md(md_info,
-                       crl_list->tbs.p,
-                       crl_list->tbs.len,
-                       hash) != 0) {
-            /* Note: this can't happen except after an internal error */
-            flags |= MBEDTLS_X509_BADCRL_NOT_TRUSTED;
-            break;
-        }
+            md_info = mbedtls_md_info_from_type(crl_list->sig_md);
+            hash_length = mbedtls_md_get_size(md_info);
+            if (mbedtls_md(md_info,
+                           crl_list->tbs.p,
+                           crl_list->tbs.len,
+                           hash) != 0) {
+                /* Note: this can't happen except after an internal error */
+                flags |= MBEDTLS_X509_BADCRL_NOT_TRUSTED;
+                break;
+            }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
+        }
 
         if (x509_profile_check_key(profile, &ca->pk) != 0) {
             flags |= MBEDTLS_X509_BADCERT_BAD_KEY;
@@ -2170,100 +2974,1887 @@ static int x509_crt_check_signature(const mbedtls_x509_crt *child,
                                  child->sig.p, child->sig.len);
 }
 
-/*
- * Check if 'parent' is a suitable parent (signing CA) for 'child'.
- * Return 0 if yes, -1 if not.
- *
- * top means parent is a locally-trusted certificate
- */
-static int x509_crt_check_parent(const mbedtls_x509_crt *child,
-                                 const mbedtls_x509_crt *parent,
-                                 int top)
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+/* id-pkix-ocsp-basic, RFC 6960 4.2.1 */
+#define X509_OID_OCSP_BASIC     MBEDTLS_OID_PKIX "\x30\x01\x01"
+
+#define X509_OCSP_BY_NAME       (MBEDTLS_ASN1_CONTEXT_SPECIFIC | \
+                                 MBEDTLS_ASN1_CONSTRUCTED | 1)
+#define X509_OCSP_BY_KEY        (MBEDTLS_ASN1_CONTEXT_SPECIFIC | \
+                                 MBEDTLS_ASN1_CONSTRUCTED | 2)
+
+#define X509_OCSP_GOOD          (MBEDTLS_ASN1_CONTEXT_SPECIFIC | 0)
+#define X509_OCSP_REVOKED       (MBEDTLS_ASN1_CONTEXT_SPECIFIC | \
+                                 MBEDTLS_ASN1_CONSTRUCTED | 1)
+#define X509_OCSP_UNKNOWN       (MBEDTLS_ASN1_CONTEXT_SPECIFIC | 2)
+
+static int x509_ocsp_hash(mbedtls_md_type_t md_alg,
+                          const unsigned char *buf, size_t len,
+                          unsigned char *hash, size_t *hash_len)
 {
-    int need_ca_bit;
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    if (psa_hash_compute(mbedtls_md_psa_alg_from_type(md_alg), buf, len,
+                         hash, MBEDTLS_MD_MAX_SIZE, hash_len) != PSA_SUCCESS) {
+        return -1;
+    }
+#else
+    const mbedtls_md_info_t *md_info = mbedtls_md_info_from_type(md_alg);
 
-    /* Parent must be the issuer */
-    if (x509_name_cmp(&child->issuer, &parent->subject) != 0) {
+    if (md_info == NULL || mbedtls_md(md_info, buf, len, hash) != 0) {
         return -1;
     }
+    *hash_len = mbedtls_md_get_size(md_info);
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-    /* Parent must have the basicConstraints CA bit set as a general rule */
-    need_ca_bit = 1;
+    return 0;
+}
 
-    /* Exception: v1/v2 certificates that are locally trusted. */
-    if (top && parent->version < 3) {
-        need_ca_bit = 0;
+/*
+ * Hash the subjectPublicKey of a certificate, the value of the BIT STRING
+ * without its unused bits count, as the CertID and ResponderID do.
+ */
+static int x509_ocsp_key_hash(const mbedtls_x509_crt *crt,
+                              mbedtls_md_type_t md_alg,
+                              unsigned char *hash, size_t *hash_len)
+{
+    unsigned char *p = crt->pk_raw.p;
+    const unsigned char *end = p + crt->pk_raw.len;
+    size_t len;
+
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0) {
+        return -1;
     }
+    end = p + len;
 
-    if (need_ca_bit && !parent->ca_istrue) {
+    /* algorithm */
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0) {
         return -1;
     }
+    p += len;
 
-    if (need_ca_bit &&
-        mbedtls_x509_crt_check_key_usage(parent, MBEDTLS_X509_KU_KEY_CERT_SIGN) != 0) {
+    if (mbedtls_asn1_get_bitstring_null(&p, end, &len) != 0) {
         return -1;
     }
 
-    return 0;
+    return x509_ocsp_hash(md_alg, p, len, hash, hash_len);
 }
 
 /*
- * Find a suitable parent for child in candidates, or return NULL.
- *
- * Here suitable is defined as:
- *  1. subject name matches child's issuer
- *  2. if necessary, the CA bit is set and key usage allows signing certs
- *  3. for trusted roots, the signature is correct
- *     (for intermediates, the signature is checked and the result reported)
- *  4. pathlen constraints are satisfied
- *
- * If there's a suitable candidate which is also time-valid, return the first
- * such. Otherwise, return the first suitable candidate (or NULL if there is
- * none).
- *
- * The rationale for this rule is that someone could have a list of trusted
- * roots with two versions on the same root with different validity periods.
- * (At least one user reported having such a list and wanted it to just work.)
- * The reason we don't just require time-validity is that generally there is
- * only one version, and if it's expired we want the flags to state that
- * rather than NOT_TRUSTED, as would be the case if we required it here.
- *
- * The rationale for rule 3 (signature for trusted roots) is that users might
- * have two versions of the same CA with different keys in their list, and the
- * way we select the correct one is by checking the signature (as we don't
- * rely on key identifier extensions). (This is one way users might choose to
- * handle key rollover, another relies on self-issued certs, see [SIRO].)
- *
- * Arguments:
- *  - [in] child: certificate for which we're looking for a parent
- *  - [in] candidates: chained list of potential parents
- *  - [out] r_parent: parent found (or NULL)
- *  - [out] r_signature_is_good: 1 if child signature by parent is valid, or 0
- *  - [in] top: 1 if candidates consists of trusted roots, ie we're at the top
- *         of the chain, 0 otherwise
- *  - [in] path_cnt: number of intermediates seen so far
- *  - [in] self_cnt: number of self-signed intermediates seen so far
- *         (will never be greater than path_cnt)
- *  - [in-out] rs_ctx: context for restarting operations
+ * Whether a certificate is the responder named by a ResponderID: its DER
+ * subject byName, its SHA-1 key hash byKey.
+ */
+static int x509_ocsp_is_responder(const mbedtls_x509_crt *crt, int id_tag,
+                                  const mbedtls_x509_buf *id)
+{
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+    size_t hash_len;
+
+    if (id_tag == X509_OCSP_BY_NAME) {
+        return id->len == crt->subject_raw.len &&
+               memcmp(id->p, crt->subject_raw.p, id->len) == 0;
+    }
+
+    return x509_ocsp_key_hash(crt, MBEDTLS_MD_SHA1, hash, &hash_len) == 0 &&
+           id->len == hash_len && memcmp(id->p, hash, hash_len) == 0;
+}
+
+/*
+ *  CertID ::= SEQUENCE {
+ *      hashAlgorithm       AlgorithmIdentifier,
+ *      issuerNameHash      OCTET STRING,
+ *      issuerKeyHash       OCTET STRING,
+ *      serialNumber        CertificateSerialNumber }
  *
- * Return value:
- *  - 0 on success
- *  - MBEDTLS_ERR_ECP_IN_PROGRESS otherwise
+ * Sets match if it identifies crt, issued by issuer. A hash algorithm we
+ * cannot compute identifies no certificate.
  */
-static int x509_crt_find_parent_in(
-    mbedtls_x509_crt *child,
-    mbedtls_x509_crt *candidates,
-    mbedtls_x509_crt **r_parent,
-    int *r_signature_is_good,
-    int top,
-    unsigned path_cnt,
-    unsigned self_cnt,
-    mbedtls_x509_crt_restart_ctx *rs_ctx,
-    const mbedtls_x509_time *now)
+static int x509_ocsp_parse_cert_id(unsigned char **p, const unsigned char *end,
+                                   const mbedtls_x509_crt *crt,
+                                   const mbedtls_x509_crt *issuer, int *match)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_buf alg, params, name_hash, key_hash, serial;
+    mbedtls_md_type_t md_alg;
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+    size_t len, hash_len;
+
+    *match = 0;
+
+    if ((ret = mbedtls_asn1_get_tag(p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                                    MBEDTLS_ASN1_SEQUENCE)) != 0) {
+        return ret;
+    }
+    end = *p + len;
+
+    if ((ret = mbedtls_x509_get_alg(p, end, &alg, &params)) != 0) {
+        return ret;
+    }
+
+    if ((ret = mbedtls_asn1_get_tag(p, end, &name_hash.len,
+                                    MBEDTLS_ASN1_OCTET_STRING)) != 0) {
+        return ret;
+    }
+    name_hash.p = *p;
+    *p += name_hash.len;
+
+    if ((ret = mbedtls_asn1_get_tag(p, end, &key_hash.len,
+                                    MBEDTLS_ASN1_OCTET_STRING)) != 0) {
+        return ret;
+    }
+    key_hash.p = *p;
+    *p += key_hash.len;
+
+    if ((ret = mbedtls_x509_get_serial(p, end, &serial)) != 0) {
+        return ret;
+    }
+
+    if (*p != end) {
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+    }
+
+    if (serial.len != crt->serial.len ||
+        memcmp(serial.p, crt->serial.p, serial.len) != 0 ||
+        mbedtls_oid_get_md_alg(&alg, &md_alg) != 0) {
+        return 0;
+    }
+
+    if (x509_ocsp_hash(md_alg, crt->issuer_raw.p, crt->issuer_raw.len,
+                       hash, &hash_len) != 0 ||
+        name_hash.len != hash_len ||
+        memcmp(name_hash.p, hash, hash_len) != 0) {
+        return 0;
+    }
+
+    if (x509_ocsp_key_hash(issuer, md_alg, hash, &hash_len) != 0 ||
+        key_hash.len != hash_len ||
+        memcmp(key_hash.p, hash, hash_len) != 0) {
+        return 0;
+    }
+
+    *match = 1;
+
+    return 0;
+}
+
+/*
+ * Check the OCSP response attached to an end-entity certificate, against
+ * the issuer found for it (RFC 6960 4.2.1):
+ *
+ *  OCSPResponse ::= SEQUENCE {
+ *      responseStatus         OCSPResponseStatus,
+ *      responseBytes          [0] EXPLICIT ResponseBytes OPTIONAL }
+ *
+ *  ResponseBytes ::= SEQUENCE {
+ *      responseType   OBJECT IDENTIFIER,
+ *      response       OCTET STRING }
+ *
+ *  BasicOCSPResponse ::= SEQUENCE {
+ *      tbsResponseData      ResponseData,
+ *      signatureAlgorithm   AlgorithmIdentifier,
+ *      signature            BIT STRING,
+ *      certs            [0] EXPLICIT SEQUENCE OF Certificate OPTIONAL }
+ *
+ *  ResponseData ::= SEQUENCE {
+ *      version              [0] EXPLICIT Version DEFAULT v1,
+ *      responderID              ResponderID,
+ *      producedAt               GeneralizedTime,
+ *      responses                SEQUENCE OF SingleResponse,
+ *      responseExtensions   [1] EXPLICIT Extensions OPTIONAL }
+ *
+ *  SingleResponse ::= SEQUENCE {
+ *      certID                       CertID,
+ *      certStatus                   CertStatus,
+ *      thisUpdate                   GeneralizedTime,
+ *      nextUpdate         [0]       EXPLICIT GeneralizedTime OPTIONAL,
+ *      singleExtensions   [1]       EXPLICIT Extensions OPTIONAL }
+ *
+ * Any parsing or signature failure flags the response as not trusted.
+ */
+static uint32_t x509_crt_check_ocsp(mbedtls_x509_crt *crt,
+                                    mbedtls_x509_crt *issuer,
+                                    const mbedtls_x509_crt_profile *profile,
+                                    const mbedtls_x509_time *now)
+{
+    uint32_t flags = MBEDTLS_X509_BADOCSP_NOT_TRUSTED;
+    unsigned char *p = crt->ocsp_response;
+    const unsigned char *end = p + crt->ocsp_response_len;
+    const unsigned char *tbs_end, *list_end, *single_end;
+    unsigned char *tbs;
+    mbedtls_x509_buf id, oid, sig_oid, sig_params, sig;
+    mbedtls_md_type_t sig_md;
+    mbedtls_pk_type_t sig_pk;
+    void *sig_opts = NULL;
+    mbedtls_x509_crt certs;
+    mbedtls_x509_crt *signer = NULL, *cur;
+    mbedtls_x509_time produced_at, this_update, next_update;
+    mbedtls_x509_time single_this, single_next;
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+    size_t len, hash_len;
+    int id_tag, status, cert_status = -1, tag, match;
+    int has_next_update = 0, single_has_next;
+
+    mbedtls_x509_crt_init(&certs);
+    memset(&this_update, 0, sizeof(this_update));
+    memset(&next_update, 0, sizeof(next_update));
+    memset(&single_next, 0, sizeof(single_next));
+
+    /* OCSPResponse */
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0 ||
+        p + len != end) {
+        goto exit;
+    }
+
+    /* Only successful(0) responses have a status */
+    if (mbedtls_asn1_get_enum(&p, end, &status) != 0 || status != 0) {
+        goto exit;
+    }
+
+    /* ResponseBytes of type id-pkix-ocsp-basic */
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONTEXT_SPECIFIC |
+                             MBEDTLS_ASN1_CONSTRUCTED | 0) != 0 ||
+        mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0 ||
+        mbedtls_asn1_get_tag(&p, end, &oid.len, MBEDTLS_ASN1_OID) != 0) {
+        goto exit;
+    }
+    oid.p = p;
+    p += oid.len;
+    if (MBEDTLS_OID_CMP(X509_OID_OCSP_BASIC, &oid) != 0 ||
+        mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_OCTET_STRING) != 0) {
+        goto exit;
+    }
+    end = p + len;
+
+    /* BasicOCSPResponse */
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0) {
+        goto exit;
+    }
+    end = p + len;
+
+    /* ResponseData */
+    tbs = p;
+    if (mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0) {
+        goto exit;
+    }
+    tbs_end = p + len;
+
+    /* Skip the version, only v1(0) is defined */
+    if (p < tbs_end && *p == (MBEDTLS_ASN1_CONTEXT_SPECIFIC |
+                              MBEDTLS_ASN1_CONSTRUCTED | 0)) {
+        if (mbedtls_asn1_get_tag(&p, tbs_end, &len, *p) != 0) {
+            goto exit;
+        }
+        p += len;
+    }
+
+    /* ResponderID: the Name byName, the OCTET STRING value byKey */
+    if (p >= tbs_end ||
+        (*p != X509_OCSP_BY_NAME && *p != X509_OCSP_BY_KEY)) {
+        goto exit;
+    }
+    id_tag = *p;
+    if (mbedtls_asn1_get_tag(&p, tbs_end, &id.len, id_tag) != 0) {
+        goto exit;
+    }
+    if (id_tag == X509_OCSP_BY_KEY &&
+        mbedtls_asn1_get_tag(&p, tbs_end, &id.len,
+                             MBEDTLS_ASN1_OCTET_STRING) != 0) {
+        goto exit;
+    }
+    id.p = p;
+    p += id.len;
+
+    if (mbedtls_x509_get_time(&p, tbs_end, &produced_at) != 0) {
+        goto exit;
+    }
+
+    /* The status of crt among the responses */
+    if (mbedtls_asn1_get_tag(&p, tbs_end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                             MBEDTLS_ASN1_SEQUENCE) != 0) {
+        goto exit;
+    }
+    list_end = p + len;
+
+    while (p < list_end) {
+        if (mbedtls_asn1_get_tag(&p, list_end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                                 MBEDTLS_ASN1_SEQUENCE) != 0) {
+            goto exit;
+        }
+        single_end = p + len;
+
+        if (x509_ocsp_parse_cert_id(&p, single_end, crt, issuer, &match) != 0) {
+            goto exit;
+        }
+
+        if (p >= single_end) {
+            goto exit;
+        }
+        tag = *p;
+        if ((tag != X509_OCSP_GOOD && tag != X509_OCSP_REVOKED &&
+             tag != X509_OCSP_UNKNOWN) ||
+            mbedtls_asn1_get_tag(&p, single_end, &len, tag) != 0) {
+            goto exit;
+        }
+        p += len;
+
+        if (mbedtls_x509_get_time(&p, single_end, &single_this) != 0) {
+            goto exit;
+        }
+
+        single_has_next = 0;
+        if (p < single_end && *p == (MBEDTLS_ASN1_CONTEXT_SPECIFIC |
+                                     MBEDTLS_ASN1_CONSTRUCTED | 0)) {
+            if (mbedtls_asn1_get_tag(&p, single_end, &len, *p) != 0 ||
+                mbedtls_x509_get_time(&p, p + len, &single_next) != 0) {
+                goto exit;
+            }
+            single_has_next = 1;
+        }
+
+        /* Skip the singleExtensions */
+        p = (unsigned char *) single_end;
+
+        if (match && cert_status < 0) {
+            cert_status = tag;
+            this_update = single_this;
+            next_update = single_next;
+            has_next_update = single_has_next;
+        }
+    }
+
+    /* Skip the responseExtensions */
+    p = (unsigned char *) tbs_end;
+
+    if (mbedtls_x509_get_alg(&p, end, &sig_oid, &sig_params) != 0 ||
+        mbedtls_x509_get_sig_alg(&sig_oid, &sig_params, &sig_md, &sig_pk,
+                                 &sig_opts) != 0 ||
+        mbedtls_x509_get_sig(&p, end, &sig) != 0) {
+        goto exit;
+    }
+
+    /* Responder certificates */
+    if (p < end && *p == (MBEDTLS_ASN1_CONTEXT_SPECIFIC |
+                          MBEDTLS_ASN1_CONSTRUCTED | 0)) {
+        if (mbedtls_asn1_get_tag(&p, end, &len, *p) != 0 ||
+            mbedtls_asn1_get_tag(&p, end, &len, MBEDTLS_ASN1_CONSTRUCTED |
+                                 MBEDTLS_ASN1_SEQUENCE) != 0) {
+            goto exit;
+        }
+        list_end = p + len;
+
+        while (p < list_end) {
+            unsigned char *der = p;
+
+            if (mbedtls_asn1_get_tag(&p, list_end, &len,
+                                     MBEDTLS_ASN1_CONSTRUCTED |
+                                     MBEDTLS_ASN1_SEQUENCE) != 0 ||
+                mbedtls_x509_crt_parse_der(&certs, der,
+                                           (size_t) (p + len - der)) != 0) {
+                goto exit;
+            }
+            p += len;
+        }
+    }
+
+    if (p != end) {
+        goto exit;
+    }
+
+    /* Nothing about crt: as if there was no response */
+    if (cert_status < 0 || cert_status == X509_OCSP_UNKNOWN) {
+        flags = 0;
+        goto exit;
+    }
+
+    /* The issuer itself, or a certificate it issued for OCSP signing */
+    if (x509_ocsp_is_responder(issuer, id_tag, &id)) {
+        signer = issuer;
+    } else {
+        for (cur = &certs; cur != NULL && cur->version != 0; cur = cur->next) {
+            if (!x509_ocsp_is_responder(cur, id_tag, &id) ||
+                x509_name_cmp(&cur->issuer, &issuer->subject) != 0 ||
+                (cur->ext_types & MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE) == 0 ||
+                mbedtls_x509_crt_check_extended_key_usage(
+                    cur, MBEDTLS_OID_OCSP_SIGNING,
+                    MBEDTLS_OID_SIZE(MBEDTLS_OID_OCSP_SIGNING)) != 0) {
+                continue;
+            }
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+            if (mbedtls_x509_time_cmp(&cur->valid_to, now) < 0 ||
+                mbedtls_x509_time_cmp(&cur->valid_from, now) > 0) {
+                continue;
+            }
+#endif
+            if (x509_crt_check_signature(cur, issuer, NULL) == 0) {
+                signer = cur;
+                break;
+            }
+        }
+    }
+
+    if (signer == NULL ||
+        x509_profile_check_md_alg(profile, sig_md) != 0 ||
+        x509_profile_check_pk_alg(profile, sig_pk) != 0 ||
+        x509_profile_check_key(profile, &signer->pk) != 0 ||
+        !mbedtls_pk_can_do(&signer->pk, sig_pk)) {
+        goto exit;
+    }
+
+    if (x509_ocsp_hash(sig_md, tbs, (size_t) (tbs_end - tbs),
+                       hash, &hash_len) != 0 ||
+        mbedtls_pk_verify_ext(sig_pk, sig_opts, &signer->pk, sig_md,
+                              hash, hash_len, sig.p, sig.len) != 0) {
+        goto exit;
+    }
+
+    flags = 0;
+
+    if (cert_status == X509_OCSP_REVOKED) {
+        flags |= MBEDTLS_X509_BADCERT_REVOKED;
+    }
+
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    if (mbedtls_x509_time_cmp(&this_update, now) > 0) {
+        flags |= MBEDTLS_X509_BADOCSP_FUTURE;
+    }
+
+    if (has_next_update && mbedtls_x509_time_cmp(&next_update, now) < 0) {
+        flags |= MBEDTLS_X509_BADOCSP_EXPIRED;
+    }
+#else
+    (void) now;
+    (void) this_update;
+    (void) next_update;
+    (void) has_next_update;
+#endif
+
+exit:
+    mbedtls_x509_crt_free(&certs);
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    mbedtls_free(sig_opts);
+#endif
+
+    return flags;
+}
+#endif /* MBEDTLS_X509_OCSP_STAPLE */
+
+#if defined(MBEDTLS_X509_TRUST_STORE)
+static uint32_t x509_trust_store_hash_key_id(const mbedtls_x509_buf *key_id)
+{
+    return x509_hash_buf(MBEDTLS_FNV1A32_INIT, 0, key_id->p, key_id->len, 0);
+}
+
+static int x509_trust_store_key_id_eq(const mbedtls_x509_buf *a,
+                                      const mbedtls_x509_buf *b)
+{
+    return a->len == b->len && memcmp(a->p, b->p, a->len) == 0;
+}
+
+void mbedtls_x509_trust_store_init(mbedtls_x509_trust_store *store)
+{
+    memset(store, 0, sizeof(mbedtls_x509_trust_store));
+}
+
+int mbedtls_x509_trust_store_setup(mbedtls_x509_trust_store *store,
+                                   mbedtls_x509_crt *cas)
+{
+    mbedtls_x509_crt *crt;
+    mbedtls_x509_trust_store_entry *entry, **bucket;
+    size_t count = 0, num_buckets = 1, n, i;
+
+    if (store->cas != NULL || cas == NULL || cas->trust_store != NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    for (crt = cas; crt != NULL; crt = crt->next) {
+        count++;
+    }
+
+    while (num_buckets < count) {
+        num_buckets <<= 1;
+    }
+
+    store->entries = mbedtls_calloc_tagged(X509, 2 * count,
+                                           sizeof(mbedtls_x509_trust_store_entry));
+    store->buckets = mbedtls_calloc_tagged(X509, 2 * num_buckets,
+                                           sizeof(mbedtls_x509_trust_store_entry *));
+    if (store->entries == NULL || store->buckets == NULL) {
+        mbedtls_free(store->entries);
+        mbedtls_free(store->buckets);
+        store->entries = NULL;
+        store->buckets = NULL;
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    store->mask = num_buckets - 1;
+
+    /* The subject entries come first, the key ID entries after them. */
+    n = 0;
+    for (crt = cas; crt != NULL; crt = crt->next) {
+        store->entries[n].crt = crt;
+        store->entries[n].hash = crt->subject_hash;
+
+        if (crt->subject_key_id.len != 0) {
+            store->entries[count + n].crt = crt;
+            store->entries[count + n].hash =
+                x509_trust_store_hash_key_id(&crt->subject_key_id);
+        }
+        n++;
+    }
+
+    /* Insert backwards so that each hash chain is in the order of cas. */
+    for (i = 2 * count; i-- > 0;) {
+        entry = &store->entries[i];
+        if (entry->crt == NULL) {
+            continue;
+        }
+
+        bucket = &store->buckets[(i < count ? 0 : num_buckets) +
+                                 (entry->hash & store->mask)];
+        entry->next = *bucket;
+        *bucket = entry;
+    }
+
+    store->cas = cas;
+    store->count = count;
+    cas->trust_store = store;
+
+    return 0;
+}
+
+/*
+ * Position in the index while looking for the parents of a certificate:
+ * first the CAs whose key ID matches the authority key ID of the child,
+ * then the other CAs whose subject hash matches the issuer hash of the
+ * child. x509_crt_check_parent() still compares the names.
+ */
+typedef struct {
+    const mbedtls_x509_trust_store *store;
+    const mbedtls_x509_buf *key_id;
+    const mbedtls_x509_trust_store_entry *entry;
+    uint32_t name_hash;
+    uint32_t key_id_hash;
+    int by_key_id;
+} x509_trust_store_iter;
+
+static void x509_trust_store_iter_init(x509_trust_store_iter *it,
+                                       const mbedtls_x509_trust_store *store,
+                                       const mbedtls_x509_crt *child)
+{
+    it->store = store;
+    it->entry = NULL;
+    it->key_id = &child->authority_key_id.keyIdentifier;
+    it->by_key_id = it->key_id->len != 0;
+    it->name_hash = child->issuer_hash;
+    it->key_id_hash = it->by_key_id ? x509_trust_store_hash_key_id(it->key_id) : 0;
+}
+
+/*
+ * Resume from the entry of parent, or from the start if entry is NULL
+ */
+static void x509_trust_store_iter_seek(x509_trust_store_iter *it,
+                                       const mbedtls_x509_trust_store_entry *entry)
+{
+    it->entry = entry;
+    if (entry != NULL) {
+        it->by_key_id = entry >= it->store->entries + it->store->count;
+    }
+}
+
+static mbedtls_x509_crt *x509_trust_store_iter_next(x509_trust_store_iter *it)
+{
+    const mbedtls_x509_trust_store *store = it->store;
+    const mbedtls_x509_trust_store_entry *entry;
+
+    if (it->entry != NULL) {
+        entry = it->entry->next;
+    } else if (it->by_key_id) {
+        entry = store->buckets[store->mask + 1 + (it->key_id_hash & store->mask)];
+    } else {
+        entry = store->buckets[it->name_hash & store->mask];
+    }
+
+    while (1) {
+        for (; entry != NULL; entry = entry->next) {
+            if (it->by_key_id) {
+                if (entry->hash == it->key_id_hash &&
+                    x509_trust_store_key_id_eq(&entry->crt->subject_key_id,
+                                               it->key_id)) {
+                    break;
+                }
+            } else if (entry->hash == it->name_hash) {
+                /* Skip the CAs already tried by key ID */
+                if (it->key_id->len == 0 ||
+                    !x509_trust_store_key_id_eq(&entry->crt->subject_key_id,
+                                                it->key_id)) {
+                    break;
+                }
+            }
+        }
+
+        if (entry != NULL || !it->by_key_id) {
+            break;
+        }
+
+        it->by_key_id = 0;
+        entry = store->buckets[it->name_hash & store->mask];
+    }
+
+    it->entry = entry;
+
+    return entry != NULL ? entry->crt : NULL;
+}
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+int mbedtls_x509_trust_store_ca_cb(void *p_store,
+                                   mbedtls_x509_crt const *child,
+                                   mbedtls_x509_crt **candidate_cas)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_x509_trust_store *store = p_store;
+    x509_trust_store_iter it;
+    mbedtls_x509_crt *ca, *first = NULL;
+
+    *candidate_cas = NULL;
+
+    if (store->cas == NULL) {
+        return 0;
+    }
+
+    x509_trust_store_iter_init(&it, store, child);
+
+    while ((ca = x509_trust_store_iter_next(&it)) != NULL) {
+        if (x509_crt_issuer_cmp(child, ca) != 0) {
+            continue;
+        }
+
+        if (first == NULL) {
+            first = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
+            if (first == NULL) {
+                return MBEDTLS_ERR_X509_ALLOC_FAILED;
+            }
+            mbedtls_x509_crt_init(first);
+        }
+
+        /* Refer to the data of the trusted CA rather than copying it. */
+        ret = mbedtls_x509_crt_parse_der_nocopy(first, ca->raw.p, ca->raw.len);
+        if (ret != 0) {
+            mbedtls_x509_crt_free(first);
+            mbedtls_free(first);
+            return ret;
+        }
+    }
+
+    *candidate_cas = first;
+
+    return 0;
+}
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+void mbedtls_x509_trust_store_free(mbedtls_x509_trust_store *store)
+{
+    if (store == NULL) {
+        return;
+    }
+
+    if (store->cas != NULL && store->cas->trust_store == store) {
+        store->cas->trust_store = NULL;
+    }
+
+    mbedtls_free(store->entries);
+    mbedtls_free(store->buckets);
+
+    mbedtls_platform_zeroize(store, sizeof(mbedtls_x509_trust_store));
+}
+#endif /* MBEDTLS_X509_TRUST_STORE */
+
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+/*
+ * Trust image layout, all integers are 32-bit big-endian:
+ *
+ *   header     "MBTI", version, number of certificates n,
+ *              number of certificates with a key ID k
+ *   records    n times: offset and length of the DER certificate, subject
+ *              hash, offset and length of the subject key ID, key ID hash
+ *   indexes    n record numbers sorted by subject hash,
+ *              k record numbers sorted by key ID hash
+ *   data       the DER certificates
+ *
+ * The hashes are the ones of the trust store, ties are ordered by record
+ * number so that lookups return the CAs in the order they were written.
+ */
+#define X509_TRUST_IMAGE_MAGIC          "MBTI"
+#define X509_TRUST_IMAGE_VERSION        1
+#define X509_TRUST_IMAGE_HEADER_LEN     16
+#define X509_TRUST_IMAGE_RECORD_LEN     24
+
+/* Fields of a record */
+#define X509_TRUST_IMAGE_DER_OFF        0
+#define X509_TRUST_IMAGE_DER_LEN        4
+#define X509_TRUST_IMAGE_SUBJECT_HASH   8
+#define X509_TRUST_IMAGE_KEY_ID_OFF     12
+#define X509_TRUST_IMAGE_KEY_ID_LEN     16
+#define X509_TRUST_IMAGE_KEY_ID_HASH    20
+
+#define X509_TRUST_IMAGE_FIELD(records, i, field) \
+    MBEDTLS_GET_UINT32_BE(records, (size_t) (i) * X509_TRUST_IMAGE_RECORD_LEN + (field))
+
+/*
+ * Compare the entries a and b of an index by hash, then by record number
+ */
+static int x509_trust_image_index_lt(const unsigned char *records,
+                                     const unsigned char *index, int field,
+                                     size_t a, size_t b)
+{
+    uint32_t rec_a = MBEDTLS_GET_UINT32_BE(index, 4 * a);
+    uint32_t rec_b = MBEDTLS_GET_UINT32_BE(index, 4 * b);
+    uint32_t hash_a = X509_TRUST_IMAGE_FIELD(records, rec_a, field);
+    uint32_t hash_b = X509_TRUST_IMAGE_FIELD(records, rec_b, field);
+
+    return hash_a < hash_b || (hash_a == hash_b && rec_a < rec_b);
+}
+
+static void x509_trust_image_index_swap(unsigned char *index, size_t a, size_t b)
+{
+    unsigned char tmp[4];
+
+    memcpy(tmp, index + 4 * a, 4);
+    memcpy(index + 4 * a, index + 4 * b, 4);
+    memcpy(index + 4 * b, tmp, 4);
+}
+
+static void x509_trust_image_sift_down(const unsigned char *records,
+                                       unsigned char *index, int field,
+                                       size_t i, size_t n)
+{
+    size_t child;
+
+    while ((child = 2 * i + 1) < n) {
+        if (child + 1 < n &&
+            x509_trust_image_index_lt(records, index, field, child, child + 1)) {
+            child++;
+        }
+        if (!x509_trust_image_index_lt(records, index, field, i, child)) {
+            break;
+        }
+        x509_trust_image_index_swap(index, i, child);
+        i = child;
+    }
+}
+
+static void x509_trust_image_sort(const unsigned char *records,
+                                  unsigned char *index, int field, size_t n)
+{
+    size_t i;
+
+    for (i = n / 2; i-- > 0;) {
+        x509_trust_image_sift_down(records, index, field, i, n);
+    }
+    while (n > 1) {
+        x509_trust_image_index_swap(index, 0, --n);
+        x509_trust_image_sift_down(records, index, field, 0, n);
+    }
+}
+
+int mbedtls_x509_trust_image_write(const mbedtls_x509_crt *cas,
+                                   unsigned char *buf, size_t size,
+                                   size_t *olen)
+{
+    const mbedtls_x509_crt *crt;
+    unsigned char *records, *by_subject, *by_key_id;
+    uint64_t len;
+    size_t count = 0, key_id_count = 0, data_len = 0, off, n, k;
+
+    *olen = 0;
+
+    for (crt = cas; crt != NULL; crt = crt->next) {
+        if (crt->raw.len == 0) {
+            continue;
+        }
+        count++;
+        if (crt->subject_key_id.len != 0) {
+            key_id_count++;
+        }
+        data_len += crt->raw.len;
+    }
+
+    len = X509_TRUST_IMAGE_HEADER_LEN +
+          (uint64_t) count * (X509_TRUST_IMAGE_RECORD_LEN + 4) +
+          (uint64_t) key_id_count * 4 + data_len;
+    if (len > 0xFFFFFFFF) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    *olen = (size_t) len;
+    if (size < *olen) {
+        return MBEDTLS_ERR_X509_BUFFER_TOO_SMALL;
+    }
+
+    memcpy(buf, X509_TRUST_IMAGE_MAGIC, 4);
+    MBEDTLS_PUT_UINT32_BE(X509_TRUST_IMAGE_VERSION, buf, 4);
+    MBEDTLS_PUT_UINT32_BE(count, buf, 8);
+    MBEDTLS_PUT_UINT32_BE(key_id_count, buf, 12);
+
+    records = buf + X509_TRUST_IMAGE_HEADER_LEN;
+    by_subject = records + count * X509_TRUST_IMAGE_RECORD_LEN;
+    by_key_id = by_subject + 4 * count;
+    off = (size_t) (by_key_id + 4 * key_id_count - buf);
+
+    n = 0;
+    k = 0;
+    for (crt = cas; crt != NULL; crt = crt->next) {
+        unsigned char *rec = records + n * X509_TRUST_IMAGE_RECORD_LEN;
+        size_t key_id_off = 0;
+
+        if (crt->raw.len == 0) {
+            continue;
+        }
+
+        memcpy(buf + off, crt->raw.p, crt->raw.len);
+
+        MBEDTLS_PUT_UINT32_BE(off, rec, X509_TRUST_IMAGE_DER_OFF);
+        MBEDTLS_PUT_UINT32_BE(crt->raw.len, rec, X509_TRUST_IMAGE_DER_LEN);
+        MBEDTLS_PUT_UINT32_BE(crt->subject_hash,
+                              rec, X509_TRUST_IMAGE_SUBJECT_HASH);
+        MBEDTLS_PUT_UINT32_BE(n, by_subject, 4 * n);
+
+        /* The key ID is within the certificate, point to its copy */
+        if (crt->subject_key_id.len != 0) {
+            key_id_off = off + (size_t) (crt->subject_key_id.p - crt->raw.p);
+            MBEDTLS_PUT_UINT32_BE(x509_trust_store_hash_key_id(&crt->subject_key_id),
+                                  rec, X509_TRUST_IMAGE_KEY_ID_HASH);
+            MBEDTLS_PUT_UINT32_BE(n, by_key_id, 4 * k);
+            k++;
+        } else {
+            MBEDTLS_PUT_UINT32_BE(0, rec, X509_TRUST_IMAGE_KEY_ID_HASH);
+        }
+        MBEDTLS_PUT_UINT32_BE(key_id_off, rec, X509_TRUST_IMAGE_KEY_ID_OFF);
+        MBEDTLS_PUT_UINT32_BE(crt->subject_key_id.len, rec, X509_TRUST_IMAGE_KEY_ID_LEN);
+
+        off += crt->raw.len;
+        n++;
+    }
+
+    x509_trust_image_sort(records, by_subject, X509_TRUST_IMAGE_SUBJECT_HASH, count);
+    x509_trust_image_sort(records, by_key_id, X509_TRUST_IMAGE_KEY_ID_HASH, key_id_count);
+
+    return 0;
+}
+
+void mbedtls_x509_trust_image_init(mbedtls_x509_trust_image *image)
+{
+    memset(image, 0, sizeof(mbedtls_x509_trust_image));
+}
+
+/*
+ * Check that an index only refers to existing records, which have a key ID
+ * if it is the key ID index, and that it is sorted
+ */
+static int x509_trust_image_check_index(const unsigned char *records,
+                                        size_t count,
+                                        const unsigned char *index, size_t n,
+                                        int field)
+{
+    size_t i;
+    uint32_t rec;
+
+    for (i = 0; i < n; i++) {
+        rec = MBEDTLS_GET_UINT32_BE(index, 4 * i);
+        if (rec >= count) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT;
+        }
+        if (field == X509_TRUST_IMAGE_KEY_ID_HASH &&
+            X509_TRUST_IMAGE_FIELD(records, rec, X509_TRUST_IMAGE_KEY_ID_LEN) == 0) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT;
+        }
+        if (i > 0 && !x509_trust_image_index_lt(records, index, field, i - 1, i)) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT;
+        }
+    }
+
+    return 0;
+}
+
+int mbedtls_x509_trust_image_setup(mbedtls_x509_trust_image *image,
+                                   const unsigned char *buf, size_t len)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const unsigned char *records, *by_subject, *by_key_id;
+    size_t count, key_id_count, data_off, i;
+    uint32_t der_off, der_len, key_id_off, key_id_len;
+
+    if (image->buf != NULL || buf == NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    if (len < X509_TRUST_IMAGE_HEADER_LEN ||
+        memcmp(buf, X509_TRUST_IMAGE_MAGIC, 4) != 0 ||
+        MBEDTLS_GET_UINT32_BE(buf, 4) != X509_TRUST_IMAGE_VERSION) {
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+    }
+
+    count = MBEDTLS_GET_UINT32_BE(buf, 8);
+    key_id_count = MBEDTLS_GET_UINT32_BE(buf, 12);
+
+    if (count > (len - X509_TRUST_IMAGE_HEADER_LEN) / (X509_TRUST_IMAGE_RECORD_LEN + 4)) {
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+    }
+    data_off = X509_TRUST_IMAGE_HEADER_LEN + count * (X509_TRUST_IMAGE_RECORD_LEN + 4);
+    if (key_id_count > count || key_id_count > (len - data_off) / 4) {
+        return MBEDTLS_ERR_X509_INVALID_FORMAT;
+    }
+    data_off += 4 * key_id_count;
+
+    records = buf + X509_TRUST_IMAGE_HEADER_LEN;
+    by_subject = records + count * X509_TRUST_IMAGE_RECORD_LEN;
+    by_key_id = by_subject + 4 * count;
+
+    /* Check the bounds once, so that lookups can trust the offsets */
+    for (i = 0; i < count; i++) {
+        der_off = X509_TRUST_IMAGE_FIELD(records, i, X509_TRUST_IMAGE_DER_OFF);
+        der_len = X509_TRUST_IMAGE_FIELD(records, i, X509_TRUST_IMAGE_DER_LEN);
+        key_id_off = X509_TRUST_IMAGE_FIELD(records, i, X509_TRUST_IMAGE_KEY_ID_OFF);
+        key_id_len = X509_TRUST_IMAGE_FIELD(records, i, X509_TRUST_IMAGE_KEY_ID_LEN);
+
+        if (der_off < data_off || der_off > len || der_len == 0 ||
+            der_len > len - der_off) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT;
+        }
+        if (key_id_len != 0 &&
+            (key_id_off < der_off || key_id_off - der_off > der_len ||
+             key_id_len > der_len - (key_id_off - der_off))) {
+            return MBEDTLS_ERR_X509_INVALID_FORMAT;
+        }
+    }
+
+    if ((ret = x509_trust_image_check_index(records, count, by_subject, count,
+                                            X509_TRUST_IMAGE_SUBJECT_HASH)) != 0 ||
+        (ret = x509_trust_image_check_index(records, count, by_key_id, key_id_count,
+                                            X509_TRUST_IMAGE_KEY_ID_HASH)) != 0) {
+        return ret;
+    }
+
+    image->buf = buf;
+    image->len = len;
+    image->count = count;
+    image->key_id_count = key_id_count;
+    image->records = records;
+    image->by_subject = by_subject;
+    image->by_key_id = by_key_id;
+
+    return 0;
+}
+
+size_t mbedtls_x509_trust_image_count(const mbedtls_x509_trust_image *image)
+{
+    return image->count;
+}
+
+#if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
+/*
+ * Position of the first entry of an index with the given hash
+ */
+static size_t x509_trust_image_lower_bound(const unsigned char *records,
+                                           const unsigned char *index, size_t n,
+                                           int field, uint32_t hash)
+{
+    size_t lo = 0, hi = n, mid;
+    uint32_t rec;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        rec = MBEDTLS_GET_UINT32_BE(index, 4 * mid);
+        if (X509_TRUST_IMAGE_FIELD(records, rec, field) < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+static int x509_trust_image_key_id_eq(const mbedtls_x509_trust_image *image,
+                                      uint32_t rec, const mbedtls_x509_buf *key_id)
+{
+    uint32_t key_id_len =
+        X509_TRUST_IMAGE_FIELD(image->records, rec, X509_TRUST_IMAGE_KEY_ID_LEN);
+    uint32_t key_id_off =
+        X509_TRUST_IMAGE_FIELD(image->records, rec, X509_TRUST_IMAGE_KEY_ID_OFF);
+
+    return key_id_len == key_id->len &&
+           memcmp(image->buf + key_id_off, key_id->p, key_id->len) == 0;
+}
+
+/*
+ * Append the certificate of a record to the candidates if its subject is
+ * the issuer of the child, and not only its hash
+ */
+static int x509_trust_image_add(mbedtls_x509_crt **first,
+                                const mbedtls_x509_trust_image *image,
+                                uint32_t rec, const mbedtls_x509_crt *child)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt *crt, *prev = NULL;
+
+    if (*first == NULL) {
+        *first = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
+        if (*first == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+        mbedtls_x509_crt_init(*first);
+    }
+
+    /* Refer to the data of the image rather than copying it. */
+    ret = mbedtls_x509_crt_parse_der_nocopy(*first, image->buf +
+                                            X509_TRUST_IMAGE_FIELD(image->records, rec,
+                                                                   X509_TRUST_IMAGE_DER_OFF),
+                                            X509_TRUST_IMAGE_FIELD(image->records, rec,
+                                                                   X509_TRUST_IMAGE_DER_LEN));
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (crt = *first; crt->next != NULL; crt = crt->next) {
+        prev = crt;
+    }
+
+    if (x509_crt_issuer_cmp(child, crt) == 0) {
+        return 0;
+    }
+
+    mbedtls_x509_crt_free(crt);
+    if (prev != NULL) {
+        prev->next = NULL;
+        mbedtls_free(crt);
+    } else {
+        mbedtls_x509_crt_init(crt);
+    }
+
+    return 0;
+}
+
+int mbedtls_x509_trust_image_ca_cb(void *p_image,
+                                   mbedtls_x509_crt const *child,
+                                   mbedtls_x509_crt **candidate_cas)
+{
+    int ret = 0;
+    const mbedtls_x509_trust_image *image = p_image;
+    const mbedtls_x509_buf *key_id = &child->authority_key_id.keyIdentifier;
+    mbedtls_x509_crt *first = NULL;
+    uint32_t hash, rec;
+    size_t i;
+
+    *candidate_cas = NULL;
+
+    if (image->buf == NULL) {
+        return 0;
+    }
+
+    /* First the CAs whose key ID matches the authority key ID of the child */
+    if (key_id->len != 0) {
+        hash = x509_trust_store_hash_key_id(key_id);
+        i = x509_trust_image_lower_bound(image->records, image->by_key_id,
+                                         image->key_id_count,
+                                         X509_TRUST_IMAGE_KEY_ID_HASH, hash);
+        for (; ret == 0 && i < image->key_id_count; i++) {
+            rec = MBEDTLS_GET_UINT32_BE(image->by_key_id, 4 * i);
+            if (X509_TRUST_IMAGE_FIELD(image->records, rec,
+                                       X509_TRUST_IMAGE_KEY_ID_HASH) != hash) {
+                break;
+            }
+            if (x509_trust_image_key_id_eq(image, rec, key_id)) {
+                ret = x509_trust_image_add(&first, image, rec, child);
+            }
+        }
+    }
+
+    /* Then the other CAs whose subject matches the issuer of the child */
+    hash = child->issuer_hash;
+    i = x509_trust_image_lower_bound(image->records, image->by_subject,
+                                     image->count,
+                                     X509_TRUST_IMAGE_SUBJECT_HASH, hash);
+    for (; ret == 0 && i < image->count; i++) {
+        rec = MBEDTLS_GET_UINT32_BE(image->by_subject, 4 * i);
+        if (X509_TRUST_IMAGE_FIELD(image->records, rec,
+                                   X509_TRUST_IMAGE_SUBJECT_HASH) != hash) {
+            break;
+        }
+        if (key_id->len == 0 || !x509_trust_image_key_id_eq(image, rec, key_id)) {
+            ret = x509_trust_image_add(&first, image, rec, child);
+        }
+    }
+
+    if (ret != 0 || (first != NULL && first->raw.p == NULL)) {
+        mbedtls_x509_crt_free(first);
+        mbedtls_free(first);
+        return ret;
+    }
+
+    *candidate_cas = first;
+
+    return 0;
+}
+#endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+
+void mbedtls_x509_trust_image_free(mbedtls_x509_trust_image *image)
+{
+    if (image == NULL) {
+        return;
+    }
+
+    mbedtls_platform_zeroize(image, sizeof(mbedtls_x509_trust_image));
+}
+#endif /* MBEDTLS_X509_TRUST_IMAGE */
+
+#if defined(MBEDTLS_X509_CRT_CA_DIR)
+/*
+ * OpenSSL's canonical encoding of names, from which c_rehash computes the
+ * subject hash: the RDNs without the outer SEQUENCE, with text values
+ * converted to UTF8String, lower-cased, and with runs of white space
+ * collapsed to a single space and stripped at both ends.
+ */
+#define X509_CANON_HDR_ROOM     6   /* Longest DER header written */
+
+static int x509_canon_is_space(unsigned char c)
+{
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+/*
+ * Write the header of a TLV whose content was written at
+ * buf + X509_CANON_HDR_ROOM, moving the content right after it.
+ */
+static size_t x509_canon_wrap(unsigned char *buf, unsigned char tag, size_t len)
+{
+    unsigned char hdr[X509_CANON_HDR_ROOM];
+    size_t n = 0, i;
+
+    hdr[n++] = tag;
+    if (len < 0x80) {
+        hdr[n++] = (unsigned char) len;
+    } else {
+        for (i = 4; i > 1 && (len >> (8 * (i - 1))) == 0; i--) {
+        }
+        hdr[n++] = (unsigned char) (0x80 | i);
+        while (i-- > 0) {
+            hdr[n++] = MBEDTLS_BYTE_0(len >> (8 * i));
+        }
+    }
+
+    memmove(buf + n, buf + X509_CANON_HDR_ROOM, len);
+    memcpy(buf, hdr, n);
+
+    return n + len;
+}
+
+/*
+ * Canonical text of a string value: at most twice as long as the value
+ */
+static int x509_canon_string(const mbedtls_x509_buf *val,
+                             unsigned char *out, size_t *out_len)
+{
+    size_t width, i, j, n = 0, start, end;
+    uint32_t c;
+
+    switch (val->tag) {
+        case MBEDTLS_ASN1_UTF8_STRING:
+            width = 0;
+            break;
+        case MBEDTLS_ASN1_BMP_STRING:
+            width = 2;
+            break;
+        case MBEDTLS_ASN1_UNIVERSAL_STRING:
+            width = 4;
+            break;
+        default:
+            /* PrintableString, IA5String, and T61String read as Latin-1 */
+            width = 1;
+            break;
+    }
+
+    if (width == 0) {
+        memcpy(out, val->p, val->len);
+        n = val->len;
+    } else {
+        if (val->len % width != 0) {
+            return MBEDTLS_ERR_X509_INVALID_NAME;
+        }
+
+        for (i = 0; i < val->len; i += width) {
+            for (c = 0, j = 0; j < width; j++) {
+                c = (c << 8) | val->p[i + j];
+            }
+
+            if (c < 0x80) {
+                out[n++] = (unsigned char) c;
+            } else if (c < 0x800) {
+                out[n++] = (unsigned char) (0xC0 | (c >> 6));
+                out[n++] = (unsigned char) (0x80 | (c & 0x3F));
+            } else if (c < 0x10000) {
+                out[n++] = (unsigned char) (0xE0 | (c >> 12));
+                out[n++] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+                out[n++] = (unsigned char) (0x80 | (c & 0x3F));
+            } else if (c < 0x110000) {
+                out[n++] = (unsigned char) (0xF0 | (c >> 18));
+                out[n++] = (unsigned char) (0x80 | ((c >> 12) & 0x3F));
+                out[n++] = (unsigned char) (0x80 | ((c >> 6) & 0x3F));
+                out[n++] = (unsigned char) (0x80 | (c & 0x3F));
+            } else {
+                return MBEDTLS_ERR_X509_INVALID_NAME;
+            }
+        }
+    }
+
+    /* Strip, collapse white space and lower-case ASCII, in place */
+    for (start = 0; start < n && x509_canon_is_space(out[start]); start++) {
+    }
+    for (end = n; end > start && x509_canon_is_space(out[end - 1]); end--) {
+    }
+
+    for (i = start, j = 0; i < end;) {
+        if (x509_canon_is_space(out[i])) {
+            out[j++] = ' ';
+            while (x509_canon_is_space(out[i])) {
+                i++;
+            }
+        } else {
+            c = out[i++];
+            out[j++] = (unsigned char) (c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c);
+        }
+    }
+
+    *out_len = j;
+
+    return 0;
+}
+
+/*
+ * Canonical encoding of one AttributeTypeAndValue
+ */
+static int x509_canon_ava(const mbedtls_x509_name *ava, unsigned char *out,
+                          size_t *out_len)
+{
+    int ret;
+    unsigned char *p = out + X509_CANON_HDR_ROOM;
+    size_t len;
+
+    memcpy(p + X509_CANON_HDR_ROOM, ava->oid.p, ava->oid.len);
+    p += x509_canon_wrap(p, MBEDTLS_ASN1_OID, ava->oid.len);
+
+    if (ava->val.tag == MBEDTLS_ASN1_BIT_STRING) {
+        memcpy(p + X509_CANON_HDR_ROOM, ava->val.p, ava->val.len);
+        p += x509_canon_wrap(p, MBEDTLS_ASN1_BIT_STRING, ava->val.len);
+    } else {
+        if ((ret = x509_canon_string(&ava->val, p + X509_CANON_HDR_ROOM,
+                                     &len)) != 0) {
+            return ret;
+        }
+        p += x509_canon_wrap(p, MBEDTLS_ASN1_UTF8_STRING, len);
+    }
+
+    *out_len = x509_canon_wrap(out, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE,
+                               (size_t) (p - out - X509_CANON_HDR_ROOM));
+
+    return 0;
+}
+
+/*
+ * DER order of the members of a SET OF
+ */
+static int x509_canon_cmp(const unsigned char *a, size_t a_len,
+                          const unsigned char *b, size_t b_len)
+{
+    int cmp = memcmp(a, b, a_len < b_len ? a_len : b_len);
+
+    if (cmp != 0) {
+        return cmp;
+    }
+
+    return a_len < b_len ? -1 : a_len > b_len;
+}
+
+/*
+ * Canonical encoding of one RelativeDistinguishedName, starting at *name.
+ * Multi-valued RDNs are rare, and small: insertion sort their members.
+ */
+static int x509_canon_rdn(const mbedtls_x509_name **name, unsigned char *out,
+                          unsigned char *tmp, size_t *out_len)
+{
+    int ret;
+    const mbedtls_x509_name *cur = *name;
+    unsigned char *end = out + X509_CANON_HDR_ROOM;
+    unsigned char *prev, *next;
+    size_t len, prev_len, next_len;
+
+    for (;;) {
+        if ((ret = x509_canon_ava(cur, end, &len)) != 0) {
+            return ret;
+        }
+
+        /* Move the new member down past the ones that sort after it */
+        memcpy(tmp, end, len);
+        next = end;
+        prev = out + X509_CANON_HDR_ROOM;
+        while (prev < next) {
+            /* Members are SEQUENCEs with a short header */
+            prev_len = 2 + (size_t) prev[1];
+            if ((prev[1] & 0x80) != 0) {
+                size_t i, n = prev[1] & 0x7F;
+                for (prev_len = 0, i = 0; i < n; i++) {
+                    prev_len = (prev_len << 8) | prev[2 + i];
+                }
+                prev_len += 2 + n;
+            }
+
+            if (x509_canon_cmp(prev, prev_len, tmp, len) > 0) {
+                break;
+            }
+            prev += prev_len;
+        }
+        next_len = (size_t) (end - prev);
+        memmove(prev + len, prev, next_len);
+        memcpy(prev, tmp, len);
+        end += len;
+
+        if (!cur->next_merged || cur->next == NULL) {
+            break;
+        }
+        cur = cur->next;
+    }
+
+    *name = cur->next;
+    *out_len = x509_canon_wrap(out, MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SET,
+                               (size_t) (end - out - X509_CANON_HDR_ROOM));
+
+    return 0;
+}
+
+int mbedtls_x509_name_openssl_hash(const mbedtls_x509_name *name, uint32_t *hash)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_x509_name *cur;
+    unsigned char *buf, *tmp;
+    unsigned char md[PSA_HASH_LENGTH(PSA_ALG_SHA_1)];
+    size_t size = 0, len = 0, rdn_len, md_len, max_ava = 0, ava;
+
+    /* Bound the size of the encoding, and of its largest member */
+    for (cur = name; cur != NULL; cur = cur->next) {
+        if (cur->oid.p == NULL) {
+            continue;
+        }
+        ava = 4 * X509_CANON_HDR_ROOM + cur->oid.len + 2 * cur->val.len;
+        max_ava = ava > max_ava ? ava : max_ava;
+        size += ava;
+    }
+
+    buf = mbedtls_calloc_tagged(X509, 1, size + max_ava + 1);
+    if (buf == NULL) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+    tmp = buf + size;
+
+    for (cur = name; cur != NULL && cur->oid.p != NULL;) {
+        if ((ret = x509_canon_rdn(&cur, buf + len, tmp, &rdn_len)) != 0) {
+            goto cleanup;
+        }
+        len += rdn_len;
+    }
+
+    if (psa_hash_compute(PSA_ALG_SHA_1, buf, len, md, sizeof(md),
+                         &md_len) != PSA_SUCCESS) {
+        ret = MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+        goto cleanup;
+    }
+
+    *hash = MBEDTLS_GET_UINT32_LE(md, 0);
+    ret = 0;
+
+cleanup:
+    mbedtls_free(buf);
+
+    return ret;
+}
+
+#define X509_CA_DIR_NOT_LOADED  0
+#define X509_CA_DIR_LOADED      1
+#define X509_CA_DIR_FAILED      2
+
+/*
+ * Parse a c_rehash file name: 8 hexadecimal digits, a dot and a number
+ */
+static int x509_ca_dir_parse_name(const char *name, uint32_t *hash,
+                                  unsigned *suffix)
+{
+    size_t i;
+    int digit;
+
+    for (*hash = 0, i = 0; i < 8; i++) {
+        if (name[i] >= '0' && name[i] <= '9') {
+            digit = name[i] - '0';
+        } else if (name[i] >= 'a' && name[i] <= 'f') {
+            digit = name[i] - 'a' + 10;
+        } else if (name[i] >= 'A' && name[i] <= 'F') {
+            digit = name[i] - 'A' + 10;
+        } else {
+            return -1;
+        }
+        *hash = (*hash << 4) | (uint32_t) digit;
+    }
+
+    if (name[i++] != '.' || name[i] == '\0') {
+        return -1;
+    }
+
+    for (*suffix = 0; name[i] != '\0'; i++) {
+        if (name[i] < '0' || name[i] > '9' || *suffix > 9999) {
+            return -1;
+        }
+        *suffix = *suffix * 10 + (unsigned) (name[i] - '0');
+    }
+
+    return 0;
+}
+
+static int x509_ca_dir_add(void *p_dir, const char *path, const char *name)
+{
+    mbedtls_x509_crt_ca_dir *dir = p_dir;
+    mbedtls_x509_crt_ca_dir_file *files, *file;
+    uint32_t hash;
+    unsigned suffix;
+    size_t len = strlen(path);
+
+    if (x509_ca_dir_parse_name(name, &hash, &suffix) != 0) {
+        return 0;
+    }
+
+    if (dir->count == dir->size) {
+        if (dir->size > SIZE_MAX / 2 / sizeof(*files)) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+
+        files = mbedtls_calloc_tagged(X509, dir->size == 0 ? 64 : 2 * dir->size, sizeof(*files));
+        if (files == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+
+        if (dir->files != NULL) {
+            memcpy(files, dir->files, dir->count * sizeof(*files));
+            mbedtls_free(dir->files);
+        }
+
+        dir->files = files;
+        dir->size = dir->size == 0 ? 64 : 2 * dir->size;
+    }
+
+    file = &dir->files[dir->count];
+    file->path = mbedtls_calloc_tagged(X509, 1, len + 1);
+    if (file->path == NULL) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    memcpy(file->path, path, len);
+    file->hash = hash;
+    file->suffix = suffix;
+    dir->count++;
+
+    return 0;
+}
+
+static int x509_ca_dir_file_cmp(const mbedtls_x509_crt_ca_dir_file *a,
+                                const mbedtls_x509_crt_ca_dir_file *b)
+{
+    if (a->hash != b->hash) {
+        return a->hash < b->hash ? -1 : 1;
+    }
+
+    return a->suffix < b->suffix ? -1 : a->suffix > b->suffix;
+}
+
+static void x509_ca_dir_sift_down(mbedtls_x509_crt_ca_dir_file *files,
+                                  size_t root, size_t count)
+{
+    mbedtls_x509_crt_ca_dir_file tmp;
+    size_t child;
+
+    while ((child = 2 * root + 1) < count) {
+        if (child + 1 < count &&
+            x509_ca_dir_file_cmp(&files[child], &files[child + 1]) < 0) {
+            child++;
+        }
+
+        if (x509_ca_dir_file_cmp(&files[root], &files[child]) >= 0) {
+            return;
+        }
+
+        tmp = files[root];
+        files[root] = files[child];
+        files[child] = tmp;
+        root = child;
+    }
+}
+
+void mbedtls_x509_crt_ca_dir_init(mbedtls_x509_crt_ca_dir *dir)
+{
+    memset(dir, 0, sizeof(mbedtls_x509_crt_ca_dir));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&dir->mutex);
+#endif
+}
+
+int mbedtls_x509_crt_ca_dir_setup(mbedtls_x509_crt_ca_dir *dir, const char *path)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt_ca_dir_file tmp;
+    size_t i;
+
+    if (dir->files != NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    ret = x509_crt_for_each_file(path, x509_ca_dir_add, dir);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /* Heap sort, so that lookups are a binary search */
+    for (i = dir->count / 2; i-- > 0;) {
+        x509_ca_dir_sift_down(dir->files, i, dir->count);
+    }
+
+    for (i = dir->count; i > 1; i--) {
+        tmp = dir->files[0];
+        dir->files[0] = dir->files[i - 1];
+        dir->files[i - 1] = tmp;
+        x509_ca_dir_sift_down(dir->files, 0, i - 1);
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a file if it was not yet. The file is parsed without holding the
+ * mutex, so that concurrent preloads do not wait for each other.
+ */
+static int x509_ca_dir_load(mbedtls_x509_crt_ca_dir *dir,
+                            mbedtls_x509_crt_ca_dir_file *file)
+{
+    int ret = 0;
+    int state;
+    mbedtls_x509_crt *crt;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&dir->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    state = file->state;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&dir->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (state != X509_CA_DIR_NOT_LOADED) {
+        return 0;
+    }
+
+    crt = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
+    if (crt == NULL) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    mbedtls_x509_crt_init(crt);
+
+    /* A file with several certificates is usable if any of them is */
+    (void) mbedtls_x509_crt_parse_file(crt, file->path);
+    if (crt->raw.p == NULL) {
+        mbedtls_x509_crt_free(crt);
+        mbedtls_free(crt);
+        crt = NULL;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&dir->mutex)) != 0) {
+        goto cleanup;
+    }
+#endif
+
+    if (file->state == X509_CA_DIR_NOT_LOADED) {
+        file->crt = crt;
+        file->state = crt != NULL ? X509_CA_DIR_LOADED : X509_CA_DIR_FAILED;
+        crt = NULL;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&dir->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+
+cleanup:
+#endif
+    /* Someone else was quicker */
+    if (crt != NULL) {
+        mbedtls_x509_crt_free(crt);
+        mbedtls_free(crt);
+    }
+
+    return ret;
+}
+
+int mbedtls_x509_crt_ca_dir_preload(mbedtls_x509_crt_ca_dir *dir,
+                                    size_t worker, size_t num_workers)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    size_t i;
+    int failed = 0;
+
+    if (num_workers == 0 || worker >= num_workers) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    for (i = worker; i < dir->count; i += num_workers) {
+        if ((ret = x509_ca_dir_load(dir, &dir->files[i])) != 0) {
+            return ret;
+        }
+
+        /* Once loaded, a file does not change until the directory is freed */
+        if (dir->files[i].crt == NULL) {
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+int mbedtls_x509_crt_ca_dir_ca_cb(void *p_dir,
+                                  mbedtls_x509_crt const *child,
+                                  mbedtls_x509_crt **candidate_cas)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt_ca_dir *dir = p_dir;
+    mbedtls_x509_crt *ca, *first = NULL;
+    size_t lo = 0, hi = dir->count, mid;
+    uint32_t hash;
+
+    *candidate_cas = NULL;
+
+    ret = mbedtls_x509_name_openssl_hash(&child->issuer, &hash);
+    if (ret == MBEDTLS_ERR_X509_INVALID_NAME) {
+        /* No file can be named after this issuer */
+        return 0;
+    }
+    if (ret != 0) {
+        return ret;
+    }
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (dir->files[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    for (; lo < dir->count && dir->files[lo].hash == hash; lo++) {
+        if ((ret = x509_ca_dir_load(dir, &dir->files[lo])) != 0) {
+            goto error;
+        }
+
+        /* Once loaded, a file does not change until the directory is freed */
+        for (ca = dir->files[lo].crt; ca != NULL; ca = ca->next) {
+            if (x509_crt_issuer_cmp(child, ca) != 0) {
+                continue;
+            }
+
+            if (first == NULL) {
+                first = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
+                if (first == NULL) {
+                    return MBEDTLS_ERR_X509_ALLOC_FAILED;
+                }
+                mbedtls_x509_crt_init(first);
+            }
+
+            /* Refer to the data of the cached CA rather than copying it. */
+            ret = mbedtls_x509_crt_parse_der_nocopy(first, ca->raw.p, ca->raw.len);
+            if (ret != 0) {
+                goto error;
+            }
+        }
+    }
+
+    *candidate_cas = first;
+
+    return 0;
+
+error:
+    mbedtls_x509_crt_free(first);
+    mbedtls_free(first);
+
+    return ret;
+}
+
+void mbedtls_x509_crt_ca_dir_free(mbedtls_x509_crt_ca_dir *dir)
+{
+    size_t i;
+
+    if (dir == NULL) {
+        return;
+    }
+
+    for (i = 0; i < dir->count; i++) {
+        mbedtls_free(dir->files[i].path);
+        mbedtls_x509_crt_free(dir->files[i].crt);
+        mbedtls_free(dir->files[i].crt);
+    }
+
+    mbedtls_free(dir->files);
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&dir->mutex);
+#endif
+
+    mbedtls_platform_zeroize(dir, sizeof(mbedtls_x509_crt_ca_dir));
+}
+#endif /* MBEDTLS_X509_CRT_CA_DIR */
+
+/*
+ * Check if 'parent' is a suitable parent (signing CA) for 'child'.
+ * Return 0 if yes, -1 if not.
+ *
+ * top means parent is a locally-trusted certificate
+ */
+static int x509_crt_check_parent(const mbedtls_x509_crt *child,
+                                 const mbedtls_x509_crt *parent,
+                                 int top)
+{
+    int need_ca_bit;
+
+    /* Parent must be the issuer */
+    if (x509_crt_issuer_cmp(child, parent) != 0) {
+        return -1;
+    }
+
+    /* Parent must have the basicConstraints CA bit set as a general rule */
+    need_ca_bit = 1;
+
+    /* Exception: v1/v2 certificates that are locally trusted. */
+    if (top && parent->version < 3) {
+        need_ca_bit = 0;
+    }
+
+    if (need_ca_bit && !parent->ca_istrue) {
+        return -1;
+    }
+
+    if (need_ca_bit &&
+        mbedtls_x509_crt_check_key_usage(parent, MBEDTLS_X509_KU_KEY_CERT_SIGN) != 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+/*
+ * Time-validity of a certificate at now, in seconds since the Epoch:
+ * MBEDTLS_X509_BADCERT_EXPIRED, MBEDTLS_X509_BADCERT_FUTURE or 0.
+ */
+uint32_t mbedtls_x509_crt_check_validity(const mbedtls_x509_crt *crt,
+                                         int64_t now)
+{
+    uint32_t flags = 0;
+
+    if (crt->valid_to_ts < now) {
+        flags |= MBEDTLS_X509_BADCERT_EXPIRED;
+    }
+    if (crt->valid_from_ts > now) {
+        flags |= MBEDTLS_X509_BADCERT_FUTURE;
+    }
+
+    return flags;
+}
+#endif /* MBEDTLS_HAVE_TIME_DATE */
+
+/*
+ * Find a suitable parent for child in candidates, or return NULL.
+ *
+ * Here suitable is defined as:
+ *  1. subject name matches child's issuer
+ *  2. if necessary, the CA bit is set and key usage allows signing certs
+ *  3. for trusted roots, the signature is correct
+ *     (for intermediates, the signature is checked and the result reported)
+ *  4. pathlen constraints are satisfied
+ *
+ * If there's a suitable candidate which is also time-valid, return the first
+ * such. Otherwise, return the first suitable candidate (or NULL if there is
+ * none).
+ *
+ * The rationale for this rule is that someone could have a list of trusted
+ * roots with two versions on the same root with different validity periods.
+ * (At least one user reported having such a list and wanted it to just work.)
+ * The reason we don't just require time-validity is that generally there is
+ * only one version, and if it's expired we want the flags to state that
+ * rather than NOT_TRUSTED, as would be the case if we required it here.
+ *
+ * The rationale for rule 3 (signature for trusted roots) is that users might
+ * have two versions of the same CA with different keys in their list, and the
+ * way we select the correct one is by checking the signature (as we don't
+ * rely on key identifier extensions). (This is one way users might choose to
+ * handle key rollover, another relies on self-issued certs, see [SIRO].)
+ *
+ * Arguments:
+ *  - [in] child: certificate for which we're looking for a parent
+ *  - [in] candidates: chained list of potential parents
+ *  - [out] r_parent: parent found (or NULL)
+ *  - [out] r_signature_is_good: 1 if child signature by parent is valid, or 0
+ *  - [in] top: 1 if candidates consists of trusted roots, ie we're at the top
+ *         of the chain, 0 otherwise
+ *  - [in] path_cnt: number of intermediates seen so far
+ *  - [in] self_cnt: number of self-signed intermediates seen so far
+ *         (will never be greater than path_cnt)
+ *  - [in-out] rs_ctx: context for restarting operations
+ *  - [in] defer_sig: 1 if signatures are checked later by the caller, and
+ *         assumed to be good here, 0 otherwise
+ *
+ * Return value:
+ *  - 0 on success
+ *  - MBEDTLS_ERR_ECP_IN_PROGRESS otherwise
+ */
+static int x509_crt_find_parent_in(
+    mbedtls_x509_crt *child,
+    mbedtls_x509_crt *candidates,
+    mbedtls_x509_crt **r_parent,
+    int *r_signature_is_good,
+    int top,
+    unsigned path_cnt,
+    unsigned self_cnt,
+    mbedtls_x509_crt_restart_ctx *rs_ctx,
+    int64_t now,
+    int defer_sig)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_x509_crt *parent, *fallback_parent;
     int signature_is_good = 0, fallback_signature_is_good;
+#if defined(MBEDTLS_X509_TRUST_STORE)
+    /* Only trusted CAs are indexed, look up the candidates if they are */
+    const mbedtls_x509_trust_store *store =
+        top && candidates != NULL ? candidates->trust_store : NULL;
+    x509_trust_store_iter it;
+
+    if (store != NULL) {
+        x509_trust_store_iter_init(&it, store, child);
+    }
+#endif
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
     /* did we have something in progress? */
@@ -2272,6 +4863,12 @@ static int x509_crt_find_parent_in(
         parent = rs_ctx->parent;
         fallback_parent = rs_ctx->fallback_parent;
         fallback_signature_is_good = rs_ctx->fallback_signature_is_good;
+#if defined(MBEDTLS_X509_TRUST_STORE)
+        if (store != NULL) {
+            x509_trust_store_iter_seek(&it, rs_ctx->parent_entry);
+        }
+        rs_ctx->parent_entry = NULL;
+#endif
 
         /* clear saved state */
         rs_ctx->parent = NULL;
@@ -2286,7 +4883,13 @@ static int x509_crt_find_parent_in(
     fallback_parent = NULL;
     fallback_signature_is_good = 0;
 
+#if defined(MBEDTLS_X509_TRUST_STORE)
+    for (parent = store != NULL ? x509_trust_store_iter_next(&it) : candidates;
+         parent != NULL;
+         parent = store != NULL ? x509_trust_store_iter_next(&it) : parent->next) {
+#else
     for (parent = candidates; parent != NULL; parent = parent->next) {
+#endif
         /* basic parenting skills (name, CA bit, key usage) */
         if (x509_crt_check_parent(child, parent, top) != 0) {
             continue;
@@ -2302,7 +4905,7 @@ static int x509_crt_find_parent_in(
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
 check_signature:
 #endif
-        ret = x509_crt_check_signature(child, parent, rs_ctx);
+        ret = defer_sig ? 0 : x509_crt_check_signature(child, parent, rs_ctx);
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
         if (rs_ctx != NULL && ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -2310,6 +4913,9 @@ check_signature:
             rs_ctx->parent = parent;
             rs_ctx->fallback_parent = fallback_parent;
             rs_ctx->fallback_signature_is_good = fallback_signature_is_good;
+#if defined(MBEDTLS_X509_TRUST_STORE)
+            rs_ctx->parent_entry = store != NULL ? it.entry : NULL;
+#endif
 
             return ret;
         }
@@ -2324,8 +4930,7 @@ check_signature:
 
 #if defined(MBEDTLS_HAVE_TIME_DATE)
         /* optional time check */
-        if (mbedtls_x509_time_cmp(&parent->valid_to, now) < 0 ||    /* past */
-            mbedtls_x509_time_cmp(&parent->valid_from, now) > 0) {  /* future */
+        if (mbedtls_x509_crt_check_validity(parent, now) != 0) {
             if (fallback_parent == NULL) {
                 fallback_parent = parent;
                 fallback_signature_is_good = signature_is_good;
@@ -2368,6 +4973,7 @@ check_signature:
  *  - [in] self_cnt: number of self-signed certs in the chain so far
  *         (will always be no greater than path_cnt)
  *  - [in-out] rs_ctx: context for restarting operations
+ *  - [in] defer_sig: as in find_parent_in()
  *
  * Return value:
  *  - 0 on success
@@ -2382,7 +4988,8 @@ static int x509_crt_find_parent(
     unsigned path_cnt,
     unsigned self_cnt,
     mbedtls_x509_crt_restart_ctx *rs_ctx,
-    const mbedtls_x509_time *now)
+    int64_t now,
+    int defer_sig)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_x509_crt *search_list;
@@ -2403,7 +5010,8 @@ static int x509_crt_find_parent(
         ret = x509_crt_find_parent_in(child, search_list,
                                       parent, signature_is_good,
                                       *parent_is_trusted,
-                                      path_cnt, self_cnt, rs_ctx, now);
+                                      path_cnt, self_cnt, rs_ctx, now,
+                                      defer_sig);
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
         if (rs_ctx != NULL && ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -2446,7 +5054,7 @@ static int x509_crt_check_ee_locally_trusted(
     mbedtls_x509_crt *cur;
 
     /* must be self-issued */
-    if (x509_name_cmp(&crt->issuer, &crt->subject) != 0) {
+    if (x509_crt_issuer_cmp(crt, crt) != 0) {
         return -1;
     }
 
@@ -2462,6 +5070,323 @@ static int x509_crt_check_ee_locally_trusted(
     return -1;
 }
 
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+void mbedtls_x509_crt_ca_cache_init(mbedtls_x509_crt_ca_cache *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_x509_crt_ca_cache));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&cache->mutex);
+#endif
+}
+
+int mbedtls_x509_crt_ca_cache_setup(mbedtls_x509_crt_ca_cache *cache,
+                                    mbedtls_x509_crt_ca_cb_t f_ca_cb,
+                                    void *p_ca_cb,
+                                    size_t max_entries, uint32_t ttl)
+{
+    if (cache->max_entries != 0 || f_ca_cb == NULL ||
+        max_entries == 0 || ttl == 0) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    cache->f_ca_cb = f_ca_cb;
+    cache->p_ca_cb = p_ca_cb;
+    cache->max_entries = max_entries;
+    cache->ttl = ttl;
+
+    return 0;
+}
+
+static void x509_ca_cache_entry_free(mbedtls_x509_crt_ca_cache_entry *entry)
+{
+    mbedtls_x509_crt_free(entry->cas);
+    mbedtls_free(entry->cas);
+    mbedtls_free(entry->key);
+    mbedtls_free(entry);
+}
+
+static int x509_ca_cache_expired(const mbedtls_x509_crt_ca_cache *cache,
+                                 const mbedtls_x509_crt_ca_cache_entry *entry,
+                                 mbedtls_ms_time_t now)
+{
+    mbedtls_ms_time_t age = now - entry->created;
+
+    return entry->stale || age < 0 || age >= (mbedtls_ms_time_t) cache->ttl;
+}
+
+/*
+ * Free the expired entries no verification is using, and if there is
+ * still no room for a new entry, the least recently used unused one.
+ * The cache must be locked.
+ */
+static void x509_ca_cache_prune(mbedtls_x509_crt_ca_cache *cache,
+                                mbedtls_ms_time_t now)
+{
+    mbedtls_x509_crt_ca_cache_entry **link = &cache->entries, **lru = NULL;
+    mbedtls_x509_crt_ca_cache_entry *cur;
+
+    while ((cur = *link) != NULL) {
+        if (cur->refs == 0 && x509_ca_cache_expired(cache, cur, now)) {
+            *link = cur->next;
+            cache->count--;
+            x509_ca_cache_entry_free(cur);
+            continue;
+        }
+        if (cur->refs == 0) {
+            lru = link;
+        }
+        link = &cur->next;
+    }
+
+    if (cache->count >= cache->max_entries && lru != NULL) {
+        cur = *lru;
+        *lru = cur->next;
+        cache->count--;
+        x509_ca_cache_entry_free(cur);
+    }
+}
+
+/*
+ * Get the candidate parents of child: in *entry, referenced until
+ * x509_ca_cache_release(), if they are cached, otherwise in
+ * *candidate_cas, owned by the caller.
+ */
+static int x509_ca_cache_get(mbedtls_x509_crt_ca_cache *cache,
+                             const mbedtls_x509_crt *child,
+                             mbedtls_x509_crt_ca_cache_entry **entry,
+                             mbedtls_x509_crt **candidate_cas)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    const mbedtls_x509_buf *issuer = &child->issuer_raw;
+    const mbedtls_x509_buf *key_id = &child->authority_key_id.keyIdentifier;
+    mbedtls_x509_crt_ca_cache_entry **link, *cur, *fresh;
+    mbedtls_x509_crt *cas = NULL;
+    size_t key_len = issuer->len + key_id->len;
+    mbedtls_ms_time_t now = mbedtls_ms_time();
+
+    *entry = NULL;
+    *candidate_cas = NULL;
+
+    if (cache->max_entries == 0) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    for (link = &cache->entries; (cur = *link) != NULL; link = &cur->next) {
+        if (cur->issuer_len == issuer->len && cur->key_len == key_len &&
+            memcmp(cur->key, issuer->p, issuer->len) == 0 &&
+            memcmp(cur->key + issuer->len, key_id->p, key_id->len) == 0 &&
+            !x509_ca_cache_expired(cache, cur, now)) {
+            /* Most recently used first */
+            *link = cur->next;
+            cur->next = cache->entries;
+            cache->entries = cur;
+
+            cur->refs++;
+            *entry = cur;
+            break;
+        }
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (*entry != NULL) {
+        return 0;
+    }
+
+    /* On a miss, the callback runs without the lock, as it may be slow. */
+    ret = cache->f_ca_cb(cache->p_ca_cb, child, &cas);
+    if (ret != 0) {
+        return ret;
+    }
+
+    fresh = mbedtls_calloc_tagged(X509, 1,
+                                  sizeof(mbedtls_x509_crt_ca_cache_entry));
+    if (fresh != NULL && key_len != 0) {
+        fresh->key = mbedtls_calloc_tagged(X509, 1, key_len);
+    }
+    if (fresh == NULL || (key_len != 0 && fresh->key == NULL)) {
+        /* Not cached, which does not change the answer */
+        mbedtls_free(fresh);
+        *candidate_cas = cas;
+        return 0;
+    }
+
+    if (issuer->len != 0) {
+        memcpy(fresh->key, issuer->p, issuer->len);
+    }
+    if (key_id->len != 0) {
+        memcpy(fresh->key + issuer->len, key_id->p, key_id->len);
+    }
+    fresh->issuer_len = issuer->len;
+    fresh->key_len = key_len;
+    fresh->cas = cas;
+    fresh->created = mbedtls_ms_time();
+    fresh->refs = 1;
+
+#if defined(MBEDTLS_THREADING_C)
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        x509_ca_cache_entry_free(fresh);
+        return ret;
+    }
+#endif
+
+    x509_ca_cache_prune(cache, fresh->created);
+
+    if (cache->count < cache->max_entries) {
+        fresh->next = cache->entries;
+        cache->entries = fresh;
+        cache->count++;
+        *entry = fresh;
+    } else {
+        /* Every entry is in use: hand the candidates over instead */
+        *candidate_cas = cas;
+        fresh->cas = NULL;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        ret = MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    if (*entry == NULL) {
+        x509_ca_cache_entry_free(fresh);
+    }
+
+    return ret;
+}
+
+static void x509_ca_cache_release(mbedtls_x509_crt_ca_cache *cache,
+                                  mbedtls_x509_crt_ca_cache_entry *entry)
+{
+    if (entry == NULL) {
+        return;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    /* Without the lock, the entry stays in use and is never freed before
+     * the cache, which is safe. */
+    if (mbedtls_mutex_lock(&cache->mutex) != 0) {
+        return;
+    }
+#else
+    (void) cache;
+#endif
+
+    entry->refs--;
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&cache->mutex);
+#endif
+}
+
+int mbedtls_x509_crt_ca_cache_cb(void *p_cache,
+                                 mbedtls_x509_crt const *child,
+                                 mbedtls_x509_crt **candidate_cas)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt_ca_cache *cache = p_cache;
+    mbedtls_x509_crt_ca_cache_entry *entry;
+    mbedtls_x509_crt *cur, *first = NULL;
+
+    ret = x509_ca_cache_get(cache, child, &entry, candidate_cas);
+    if (ret != 0 || entry == NULL) {
+        x509_ca_cache_release(cache, entry);
+        return ret;
+    }
+
+    /* The caller owns what it gets, and the entry may be freed once
+     * released: return copies of the candidates. */
+    for (cur = entry->cas; cur != NULL && ret == 0; cur = cur->next) {
+        if (first == NULL) {
+            first = mbedtls_calloc_tagged(X509, 1, sizeof(mbedtls_x509_crt));
+            if (first == NULL) {
+                ret = MBEDTLS_ERR_X509_ALLOC_FAILED;
+                break;
+            }
+            mbedtls_x509_crt_init(first);
+        }
+
+        ret = mbedtls_x509_crt_parse_der(first, cur->raw.p, cur->raw.len);
+    }
+
+    x509_ca_cache_release(cache, entry);
+
+    if (ret != 0) {
+        mbedtls_x509_crt_free(first);
+        mbedtls_free(first);
+        return ret;
+    }
+
+    *candidate_cas = first;
+
+    return 0;
+}
+
+int mbedtls_x509_crt_ca_cache_flush(mbedtls_x509_crt_ca_cache *cache)
+{
+    mbedtls_x509_crt_ca_cache_entry **link = &cache->entries, *cur;
+#if defined(MBEDTLS_THREADING_C)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Entries in use are freed by a later prune, once released. */
+    while ((cur = *link) != NULL) {
+        if (cur->refs == 0) {
+            *link = cur->next;
+            cache->count--;
+            x509_ca_cache_entry_free(cur);
+            continue;
+        }
+        cur->stale = 1;
+        link = &cur->next;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_x509_crt_ca_cache_free(mbedtls_x509_crt_ca_cache *cache)
+{
+    mbedtls_x509_crt_ca_cache_entry *cur, *next;
+
+    if (cache == NULL) {
+        return;
+    }
+
+    for (cur = cache->entries; cur != NULL; cur = next) {
+        next = cur->next;
+        x509_ca_cache_entry_free(cur);
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&cache->mutex);
+#endif
+
+    mbedtls_platform_zeroize(cache, sizeof(mbedtls_x509_crt_ca_cache));
+}
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
+
 /*
  * Build and verify a certificate chain
  *
@@ -2496,6 +5421,8 @@ static int x509_crt_check_ee_locally_trusted(
  *      Only valid when return value is 0, may contain garbage otherwise!
  *      Restart note: need not be the same when calling again to resume.
  *  - [in-out] rs_ctx: context for restarting operations
+ *  - [in] defer_sig: 1 to only build the chain, without checking the
+ *      signatures nor setting NOT_TRUSTED for them, 0 otherwise
  *
  * Return value:
  *  - non-zero if the chain could not be fully built and examined
@@ -2510,7 +5437,8 @@ static int x509_crt_verify_chain(
     void *p_ca_cb,
     const mbedtls_x509_crt_profile *profile,
     mbedtls_x509_crt_verify_chain *ver_chain,
-    mbedtls_x509_crt_restart_ctx *rs_ctx)
+    mbedtls_x509_crt_restart_ctx *rs_ctx,
+    int defer_sig)
 {
     /* Don't initialize any of those variables here, so that the compiler can
      * catch potential issues with jumping ahead when restarting */
@@ -2525,9 +5453,13 @@ static int x509_crt_verify_chain(
     unsigned self_cnt;
     mbedtls_x509_crt *cur_trust_ca = NULL;
     mbedtls_x509_time now;
+    int64_t now_ts = 0;
 
 #if defined(MBEDTLS_HAVE_TIME_DATE)
-    if (mbedtls_x509_time_gmtime(mbedtls_time(NULL), &now) != 0) {
+    /* One clock reading for the whole chain: broken down for the CRLs and
+     * OCSP responses, in seconds for the validity of the certificates */
+    now_ts = (int64_t) mbedtls_time(NULL);
+    if (mbedtls_x509_time_gmtime((mbedtls_time_t) now_ts, &now) != 0) {
         return MBEDTLS_ERR_X509_FATAL_ERROR;
     }
 #endif
@@ -2563,13 +5495,7 @@ static int x509_crt_verify_chain(
 
 #if defined(MBEDTLS_HAVE_TIME_DATE)
         /* Check time-validity (all certificates) */
-        if (mbedtls_x509_time_cmp(&child->valid_to, &now) < 0) {
-            *flags |= MBEDTLS_X509_BADCERT_EXPIRED;
-        }
-
-        if (mbedtls_x509_time_cmp(&child->valid_from, &now) > 0) {
-            *flags |= MBEDTLS_X509_BADCERT_FUTURE;
-        }
+        *flags |= mbedtls_x509_crt_check_validity(child, now_ts);
 #endif
 
         /* Stop here for trusted roots (but not for trusted EE certs) */
@@ -2604,12 +5530,28 @@ find_parent:
             mbedtls_free(ver_chain->trust_ca_cb_result);
             ver_chain->trust_ca_cb_result = NULL;
 
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+            x509_ca_cache_release(p_ca_cb, ver_chain->trust_ca_cache_entry);
+            ver_chain->trust_ca_cache_entry = NULL;
+
+            /* Use the cached candidates in place, without copying them */
+            if (f_ca_cb == mbedtls_x509_crt_ca_cache_cb) {
+                ret = x509_ca_cache_get(p_ca_cb, child,
+                                        &ver_chain->trust_ca_cache_entry,
+                                        &ver_chain->trust_ca_cb_result);
+            } else
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
             ret = f_ca_cb(p_ca_cb, child, &ver_chain->trust_ca_cb_result);
             if (ret != 0) {
                 return MBEDTLS_ERR_X509_FATAL_ERROR;
             }
 
             cur_trust_ca = ver_chain->trust_ca_cb_result;
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+            if (ver_chain->trust_ca_cache_entry != NULL) {
+                cur_trust_ca = ver_chain->trust_ca_cache_entry->cas;
+            }
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
         } else
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
         {
@@ -2622,7 +5564,7 @@ find_parent:
         ret = x509_crt_find_parent(child, cur_trust_ca, &parent,
                                    &parent_is_trusted, &signature_is_good,
                                    ver_chain->len - 1, self_cnt, rs_ctx,
-                                   &now);
+                                   now_ts, defer_sig);
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
         if (rs_ctx != NULL && ret == MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -2647,7 +5589,7 @@ find_parent:
          * These can occur with some strategies for key rollover, see [SIRO],
          * and should be excluded from max_pathlen checks. */
         if (ver_chain->len != 1 &&
-            x509_name_cmp(&child->issuer, &child->subject) == 0) {
+            x509_crt_issuer_cmp(child, child) == 0) {
             self_cnt++;
         }
 
@@ -2676,6 +5618,13 @@ find_parent:
         (void) ca_crl;
 #endif
 
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+        /* Check the OCSP response attached to the EE cert */
+        if (ver_chain->len == 1 && child->ocsp_response != NULL) {
+            *flags |= x509_crt_check_ocsp(child, parent, profile, &now);
+        }
+#endif
+
         /* prepare for next iteration */
         child = parent;
         parent = NULL;
@@ -2684,6 +5633,82 @@ find_parent:
     }
 }
 
+#if defined(MBEDTLS_X509_PARALLEL_VERIFY)
+int mbedtls_x509_crt_sig_job_run(mbedtls_x509_crt_sig_job *job)
+{
+    job->ret = x509_crt_check_signature(job->child, job->parent, NULL);
+
+    return job->ret;
+}
+
+/*
+ * Build a chain like verify_chain(), then check all its signatures at once
+ * through an executor
+ *
+ * Parents are chosen regardless of their signature. This gives the chain
+ * verify_chain() builds, unless the signature of the trusted root is bad:
+ * verify_chain() would then have tried the next trusted candidate. The
+ * chain is verified again sequentially in that case, which only happens
+ * with forged or misconfigured chains.
+ */
+static int x509_crt_verify_chain_parallel(
+    mbedtls_x509_crt *crt,
+    mbedtls_x509_crt *trust_ca,
+    mbedtls_x509_crl *ca_crl,
+    const mbedtls_x509_crt_profile *profile,
+    mbedtls_x509_crt_verify_chain *ver_chain,
+    mbedtls_x509_crt_executor_t f_exec,
+    void *p_exec)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_x509_crt_sig_job jobs[MBEDTLS_X509_MAX_VERIFY_CHAIN_SIZE - 1];
+    unsigned count, i;
+    int top_is_trusted;
+
+    ret = x509_crt_verify_chain(crt, trust_ca, ca_crl, NULL, NULL, profile,
+                                ver_chain, NULL, 1);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* Each certificate but the last one was given a parent. Since no
+     * signature was checked yet, the last one is flagged NOT_TRUSTED only
+     * if it has no parent, i.e. if the chain does not end in a trusted CA. */
+    count = ver_chain->len - 1;
+    if (count == 0) {
+        return 0;
+    }
+    top_is_trusted =
+        (ver_chain->items[count].flags & MBEDTLS_X509_BADCERT_NOT_TRUSTED) == 0;
+
+    for (i = 0; i < count; i++) {
+        jobs[i].child = ver_chain->items[i].crt;
+        jobs[i].parent = ver_chain->items[i + 1].crt;
+        jobs[i].ret = -1;
+    }
+
+    if (f_exec(p_exec, jobs, count) != 0) {
+        return MBEDTLS_ERR_X509_FATAL_ERROR;
+    }
+
+    if (top_is_trusted && jobs[count - 1].ret != 0) {
+        x509_crt_verify_chain_reset(ver_chain);
+        return x509_crt_verify_chain(crt, trust_ca, ca_crl, NULL, NULL,
+                                     profile, ver_chain, NULL, 0);
+    }
+
+    for (i = 0; i < count; i++) {
+        if (jobs[i].ret != 0) {
+            ver_chain->items[i].flags |= MBEDTLS_X509_BADCERT_NOT_TRUSTED;
+        }
+    }
+
+    return 0;
+}
+#else /* MBEDTLS_X509_PARALLEL_VERIFY */
+typedef void *mbedtls_x509_crt_executor_t;
+#endif /* MBEDTLS_X509_PARALLEL_VERIFY */
+
 #ifdef _WIN32
 #ifdef _MSC_VER
 #pragma comment(lib, "ws2_32.lib")
@@ -2977,6 +6002,66 @@ static int x509_crt_check_san(const mbedtls_x509_sequence *san,
     return -1;
 }
 
+static int x509_crt_san_index_find(const mbedtls_x509_crt *crt,
+                                   const unsigned char *a, size_t a_len,
+                                   const unsigned char *b, size_t b_len)
+{
+    size_t lo = 0, hi = crt->san_dns_len, mid;
+    int cmp;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        cmp = x509_san_cmp(&crt->san_dns[mid], a, a_len, b, b_len);
+        if (cmp == 0) {
+            return 0;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return -1;
+}
+
+/*
+ * Same as x509_crt_check_san(), looking DNS names up in the index
+ */
+static int x509_crt_check_san_index(const mbedtls_x509_crt *crt,
+                                    const char *cn, size_t cn_len)
+{
+    const unsigned char *name = (const unsigned char *) cn;
+    size_t cn_idx;
+
+    if (x509_crt_san_index_find(crt, name, cn_len, NULL, 0) == 0) {
+        return 0;
+    }
+
+    /* A wildcard matches if it is "*" followed by the part of cn from its
+     * first dot, and is at least 3 characters long. */
+    cn_idx = 0;
+    while (cn_idx < cn_len && cn[cn_idx] != '.') {
+        cn_idx++;
+    }
+    if (cn_idx != 0 && cn_len - cn_idx >= 2 &&
+        x509_crt_san_index_find(crt, (const unsigned char *) "*", 1,
+                                name + cn_idx, cn_len - cn_idx) == 0) {
+        return 0;
+    }
+
+    if ((crt->san_types & (1u << MBEDTLS_X509_SAN_IP_ADDRESS)) != 0 &&
+        x509_crt_check_san_ip(&crt->subject_alt_names, cn, cn_len) == 0) {
+        return 0;
+    }
+    if ((crt->san_types & (1u << MBEDTLS_X509_SAN_UNIFORM_RESOURCE_IDENTIFIER)) != 0 &&
+        x509_crt_check_san_uri(&crt->subject_alt_names, cn, cn_len) == 0) {
+        return 0;
+    }
+
+    return -1;
+}
+
 /*
  * Verify the requested CN - only call this if cn is not NULL!
  */
@@ -2987,8 +6072,21 @@ static void x509_crt_verify_name(const mbedtls_x509_crt *crt,
     const mbedtls_x509_name *name;
     size_t cn_len = strlen(cn);
 
-    if (crt->ext_types & MBEDTLS_X509_EXT_SUBJECT_ALT_NAME) {
-        if (x509_crt_check_san(&crt->subject_alt_names, cn, cn_len) == 0) {
+    if (crt->san_dns != NULL) {
+        if (x509_crt_check_san_index(crt, cn, cn_len) == 0) {
+            return;
+        }
+    } else if (crt->ext_types & MBEDTLS_X509_EXT_SUBJECT_ALT_NAME) {
+        mbedtls_x509_sequence tmp;
+        const mbedtls_x509_sequence *san;
+        int match;
+
+        /* A malformed deferred extension matches no name. */
+        match = x509_crt_get_ext_list(crt, MBEDTLS_X509_EXT_SUBJECT_ALT_NAME,
+                                      &tmp, &san) == 0 &&
+                x509_crt_check_san(san, cn, cn_len) == 0;
+        mbedtls_asn1_sequence_free(tmp.next);
+        if (match) {
             return;
         }
     } else {
@@ -3034,6 +6132,355 @@ static int x509_crt_merge_flags_with_cb(
     return 0;
 }
 
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+#define X509_VERIFY_CACHE_ROOT  0xFF
+
+void mbedtls_x509_crt_verify_cache_init(mbedtls_x509_crt_verify_cache *cache)
+{
+    memset(cache, 0, sizeof(mbedtls_x509_crt_verify_cache));
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_init(&cache->mutex);
+#endif
+}
+
+int mbedtls_x509_crt_verify_cache_setup(mbedtls_x509_crt_verify_cache *cache,
+                                        size_t max_entries)
+{
+    size_t slots = 1;
+
+    if (cache->entries != NULL || max_entries == 0 ||
+        max_entries > (SIZE_MAX / 2) / sizeof(mbedtls_x509_crt_verify_cache_entry)) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    while (slots < max_entries) {
+        slots <<= 1;
+    }
+
+    cache->entries = mbedtls_calloc_tagged(X509, slots,
+                                           sizeof(mbedtls_x509_crt_verify_cache_entry));
+    if (cache->entries == NULL) {
+        return MBEDTLS_ERR_X509_ALLOC_FAILED;
+    }
+
+    cache->mask = slots - 1;
+    cache->generation = 1;
+
+    return 0;
+}
+
+int mbedtls_x509_crt_verify_cache_flush(mbedtls_x509_crt_verify_cache *cache)
+{
+#if defined(MBEDTLS_THREADING_C)
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = mbedtls_mutex_lock(&cache->mutex)) != 0) {
+        return ret;
+    }
+#endif
+
+    /* Entries of older generations never match again, unless the counter
+     * wraps around. */
+    if (++cache->generation == 0) {
+        if (cache->entries != NULL) {
+            memset(cache->entries, 0,
+                   (cache->mask + 1) * sizeof(mbedtls_x509_crt_verify_cache_entry));
+        }
+        cache->generation = 1;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        return MBEDTLS_ERR_THREADING_MUTEX_ERROR;
+    }
+#endif
+
+    return 0;
+}
+
+void mbedtls_x509_crt_verify_cache_free(mbedtls_x509_crt_verify_cache *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    if (cache->entries != NULL) {
+        mbedtls_zeroize_and_free(cache->entries,
+                                 (cache->mask + 1) *
+                                 sizeof(mbedtls_x509_crt_verify_cache_entry));
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    mbedtls_mutex_free(&cache->mutex);
+#endif
+
+    mbedtls_platform_zeroize(cache, sizeof(mbedtls_x509_crt_verify_cache));
+}
+
+static psa_status_t x509_verify_cache_hash_ref(psa_hash_operation_t *operation,
+                                               const void *p, size_t len)
+{
+    unsigned char ref[sizeof(const void *) + sizeof(size_t)];
+
+    /* Identify a trusted object by its address and length, so that adding
+     * a CA or CRL to a list gives a different key. */
+    memcpy(ref, &p, sizeof(const void *));
+    memcpy(ref + sizeof(const void *), &len, sizeof(size_t));
+
+    return psa_hash_update(operation, ref, sizeof(ref));
+}
+
+/*
+ * Compute the key of a verification: the certificates presented by the
+ * peer, the trusted CAs and CRLs, and the profile.
+ *
+ * Return 0 on success, -1 if the cache cannot be used.
+ */
+static int x509_verify_cache_digest(const mbedtls_x509_crt *crt,
+                                    const mbedtls_x509_crt *trust_ca,
+                                    const mbedtls_x509_crl *ca_crl,
+                                    const mbedtls_x509_crt_profile *profile,
+                                    unsigned char digest[32])
+{
+    psa_hash_operation_t operation = PSA_HASH_OPERATION_INIT;
+    psa_status_t status;
+    unsigned char len[4];
+    size_t digest_len;
+
+    status = psa_hash_setup(&operation, PSA_ALG_SHA_256);
+
+    for (; status == PSA_SUCCESS && crt != NULL; crt = crt->next) {
+        MBEDTLS_PUT_UINT32_BE(crt->raw.len, len, 0);
+        status = psa_hash_update(&operation, len, sizeof(len));
+        if (status == PSA_SUCCESS && crt->raw.len != 0) {
+            status = psa_hash_update(&operation, crt->raw.p, crt->raw.len);
+        }
+    }
+
+    for (; status == PSA_SUCCESS && trust_ca != NULL; trust_ca = trust_ca->next) {
+        status = x509_verify_cache_hash_ref(&operation, trust_ca, trust_ca->raw.len);
+    }
+
+    for (; status == PSA_SUCCESS && ca_crl != NULL; ca_crl = ca_crl->next) {
+        status = x509_verify_cache_hash_ref(&operation, ca_crl, ca_crl->raw.len);
+    }
+
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_update(&operation, (const unsigned char *) profile,
+                                 sizeof(mbedtls_x509_crt_profile));
+    }
+
+    if (status == PSA_SUCCESS) {
+        status = psa_hash_finish(&operation, digest, 32, &digest_len);
+    }
+
+    psa_hash_abort(&operation);
+
+    return status == PSA_SUCCESS ? 0 : -1;
+}
+
+static mbedtls_x509_crt_verify_cache_entry *x509_verify_cache_slot(
+    const mbedtls_x509_crt_verify_cache *cache, const unsigned char digest[32])
+{
+    return &cache->entries[MBEDTLS_GET_UINT32_BE(digest, 0) & cache->mask];
+}
+
+/*
+ * Rebuild a verified chain from the cache.
+ *
+ * Return 1 on a hit, 0 otherwise.
+ */
+static int x509_verify_cache_lookup(mbedtls_x509_crt_verify_cache *cache,
+                                    const unsigned char digest[32],
+                                    mbedtls_x509_crt *crt,
+                                    mbedtls_x509_crl *ca_crl,
+                                    mbedtls_x509_crt_verify_chain *ver_chain)
+{
+    mbedtls_x509_crt_verify_cache_entry entry;
+    mbedtls_x509_crt *cur;
+    unsigned i, j;
+    int hit;
+
+    if (cache->entries == NULL) {
+        return 0;
+    }
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&cache->mutex) != 0) {
+        return 0;
+    }
+#endif
+
+    entry = *x509_verify_cache_slot(cache, digest); /* struct copy */
+    hit = entry.generation == cache->generation &&
+          memcmp(entry.digest, digest, sizeof(entry.digest)) == 0;
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_unlock(&cache->mutex) != 0) {
+        return 0;
+    }
+#endif
+
+    if (!hit) {
+        return 0;
+    }
+
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    {
+        mbedtls_x509_time now;
+
+        /* The result holds until the first validity boundary after the
+         * time it was computed. */
+        if (mbedtls_x509_time_gmtime(mbedtls_time(NULL), &now) != 0 ||
+            mbedtls_x509_time_cmp(&now, &entry.verified_at) < 0 ||
+            (entry.has_horizon &&
+             mbedtls_x509_time_cmp(&now, &entry.horizon) >= 0)) {
+            return 0;
+        }
+    }
+#endif
+
+    for (i = 0; i < entry.len; i++) {
+        if (entry.peer_index[i] == X509_VERIFY_CACHE_ROOT) {
+            cur = entry.root;
+        } else {
+            for (cur = crt, j = 0; cur != NULL && j < entry.peer_index[i]; j++) {
+                cur = cur->next;
+            }
+        }
+
+        if (cur == NULL) {
+            return 0;
+        }
+
+        ver_chain->items[i].crt = cur;
+        ver_chain->items[i].flags = entry.flags[i];
+    }
+    ver_chain->len = entry.len;
+
+#if defined(MBEDTLS_X509_CRL_PARSE_C)
+    /* Cheap revocation check, in case a CRL was updated in place */
+    for (i = 0; i + 1 < ver_chain->len; i++) {
+        const mbedtls_x509_crl *crl;
+
+        if (ver_chain->items[i].flags & MBEDTLS_X509_BADCERT_REVOKED) {
+            continue;
+        }
+
+        for (crl = ca_crl; crl != NULL; crl = crl->next) {
+            if (crl->version != 0 &&
+                x509_name_cmp(&crl->issuer, &ver_chain->items[i + 1].crt->subject) == 0 &&
+                mbedtls_x509_crt_is_revoked(ver_chain->items[i].crt, crl)) {
+                return 0;
+            }
+        }
+    }
+#else
+    (void) ca_crl;
+#endif
+
+    return 1;
+}
+
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+static void x509_verify_cache_bound(mbedtls_x509_crt_verify_cache_entry *entry,
+                                    const mbedtls_x509_time *t,
+                                    const mbedtls_x509_time *now)
+{
+    /* Boundaries in the past cannot change the result any more */
+    if (mbedtls_x509_time_cmp(t, now) < 0) {
+        return;
+    }
+
+    if (!entry->has_horizon || mbedtls_x509_time_cmp(t, &entry->horizon) < 0) {
+        entry->horizon = *t;
+        entry->has_horizon = 1;
+    }
+}
+#endif
+
+static void x509_verify_cache_store(mbedtls_x509_crt_verify_cache *cache,
+                                    const unsigned char digest[32],
+                                    const mbedtls_x509_crt *crt,
+                                    const mbedtls_x509_crt *trust_ca,
+                                    const mbedtls_x509_crl *ca_crl,
+                                    const mbedtls_x509_crt_verify_chain *ver_chain)
+{
+    mbedtls_x509_crt_verify_cache_entry entry;
+    const mbedtls_x509_crt *cur;
+    unsigned i, j;
+
+    if (cache->entries == NULL) {
+        return;
+    }
+
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.digest, digest, sizeof(entry.digest));
+
+    for (i = 0; i < ver_chain->len; i++) {
+        for (cur = crt, j = 0; cur != NULL && cur != ver_chain->items[i].crt &&
+             j < X509_VERIFY_CACHE_ROOT; j++) {
+            cur = cur->next;
+        }
+
+        if (cur == ver_chain->items[i].crt) {
+            entry.peer_index[i] = (unsigned char) j;
+        } else if (i + 1 == ver_chain->len) {
+            /* Only the last certificate can come from trust_ca */
+            entry.peer_index[i] = X509_VERIFY_CACHE_ROOT;
+            entry.root = ver_chain->items[i].crt;
+        } else {
+            return;
+        }
+
+        entry.flags[i] = ver_chain->items[i].flags;
+    }
+    entry.len = (unsigned char) ver_chain->len;
+
+#if defined(MBEDTLS_HAVE_TIME_DATE)
+    if (mbedtls_x509_time_gmtime(mbedtls_time(NULL), &entry.verified_at) != 0) {
+        return;
+    }
+
+    /* Any certificate or CRL may be picked or flagged differently once
+     * the time crosses one of its boundaries. */
+    for (cur = crt; cur != NULL; cur = cur->next) {
+        x509_verify_cache_bound(&entry, &cur->valid_from, &entry.verified_at);
+        x509_verify_cache_bound(&entry, &cur->valid_to, &entry.verified_at);
+    }
+
+    for (cur = trust_ca; cur != NULL; cur = cur->next) {
+        x509_verify_cache_bound(&entry, &cur->valid_from, &entry.verified_at);
+        x509_verify_cache_bound(&entry, &cur->valid_to, &entry.verified_at);
+    }
+
+    for (; ca_crl != NULL; ca_crl = ca_crl->next) {
+        x509_verify_cache_bound(&entry, &ca_crl->this_update, &entry.verified_at);
+        x509_verify_cache_bound(&entry, &ca_crl->next_update, &entry.verified_at);
+    }
+#else
+    (void) trust_ca;
+    (void) ca_crl;
+#endif
+
+#if defined(MBEDTLS_THREADING_C)
+    if (mbedtls_mutex_lock(&cache->mutex) != 0) {
+        return;
+    }
+#endif
+
+    entry.generation = cache->generation;
+    *x509_verify_cache_slot(cache, digest) = entry; /* struct copy */
+
+#if defined(MBEDTLS_THREADING_C)
+    (void) mbedtls_mutex_unlock(&cache->mutex);
+#endif
+}
+#else /* MBEDTLS_X509_VERIFY_CACHE */
+typedef void mbedtls_x509_crt_verify_cache;
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
 /*
  * Verify the certificate validity, with profile, restartable version
  *
@@ -3050,6 +6497,13 @@ static int x509_crt_merge_flags_with_cb(
  * be disabled. Otherwise, `trust_ca` will be used as the static list
  * of trusted signers, and `ca_crl` will be use as the static list
  * of CRLs.
+ *
+ * If `cache` is not NULL, the chain built and verified for `trust_ca` is
+ * looked up in and stored to it. CA callbacks are not cached.
+ *
+ * If `f_exec` is not NULL, the signatures of the chain built for `trust_ca`
+ * are checked through it, see verify_chain_parallel(). It must not be used
+ * together with `f_ca_cb` or `rs_ctx`.
  */
 static int x509_crt_verify_restartable_ca_cb(mbedtls_x509_crt *crt,
                                              mbedtls_x509_crt *trust_ca,
@@ -3063,12 +6517,21 @@ static int x509_crt_verify_restartable_ca_cb(mbedtls_x509_crt *crt,
                                                            int,
                                                            uint32_t *),
                                              void *p_vrfy,
-                                             mbedtls_x509_crt_restart_ctx *rs_ctx)
+                                             mbedtls_x509_crt_restart_ctx *rs_ctx,
+                                             mbedtls_x509_crt_verify_cache *cache,
+                                             mbedtls_x509_crt_executor_t f_exec,
+                                             void *p_exec)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     mbedtls_pk_type_t pk_type;
     mbedtls_x509_crt_verify_chain ver_chain;
     uint32_t ee_flags;
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+    unsigned char digest[32];
+    int use_cache = 0, lookup, hit = 0;
+#else
+    (void) cache;
+#endif
 
     *flags = 0;
     ee_flags = 0;
@@ -3095,13 +6558,58 @@ static int x509_crt_verify_restartable_ca_cb(mbedtls_x509_crt *crt,
         ee_flags |= MBEDTLS_X509_BADCERT_BAD_KEY;
     }
 
-    /* Check the chain */
-    ret = x509_crt_verify_chain(crt, trust_ca, ca_crl,
-                                f_ca_cb, p_ca_cb, profile,
-                                &ver_chain, rs_ctx);
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+    /* The verdict also depends on the response */
+    if (crt->ocsp_response != NULL) {
+        cache = NULL;
+    }
+#endif
 
-    if (ret != 0) {
-        goto exit;
+    if (cache != NULL && f_ca_cb == NULL) {
+        use_cache = x509_verify_cache_digest(crt, trust_ca, ca_crl,
+                                             profile, digest) == 0;
+    }
+
+    lookup = use_cache;
+#if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
+    /* A verification in progress was a miss already */
+    if (rs_ctx != NULL && rs_ctx->in_progress != x509_crt_rs_none) {
+        lookup = 0;
+    }
+#endif
+    if (lookup) {
+        hit = x509_verify_cache_lookup(cache, digest, crt, ca_crl, &ver_chain);
+    }
+
+    if (!hit)
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+    {
+        /* Check the chain */
+#if defined(MBEDTLS_X509_PARALLEL_VERIFY)
+        if (f_exec != NULL) {
+            ret = x509_crt_verify_chain_parallel(crt, trust_ca, ca_crl,
+                                                 profile, &ver_chain,
+                                                 f_exec, p_exec);
+        } else
+#else
+        (void) f_exec;
+        (void) p_exec;
+#endif
+        ret = x509_crt_verify_chain(crt, trust_ca, ca_crl,
+                                    f_ca_cb, p_ca_cb, profile,
+                                    &ver_chain, rs_ctx, 0);
+
+        if (ret != 0) {
+            goto exit;
+        }
+
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+        if (use_cache) {
+            x509_verify_cache_store(cache, digest, crt, trust_ca, ca_crl,
+                                    &ver_chain);
+        }
+#endif
     }
 
     /* Merge end-entity flags */
@@ -3117,6 +6625,10 @@ exit:
     mbedtls_free(ver_chain.trust_ca_cb_result);
     ver_chain.trust_ca_cb_result = NULL;
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
+#if defined(MBEDTLS_X509_CA_CB_CACHE)
+    x509_ca_cache_release(p_ca_cb, ver_chain.trust_ca_cache_entry);
+    ver_chain.trust_ca_cache_entry = NULL;
+#endif /* MBEDTLS_X509_CA_CB_CACHE */
 
 #if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_ECP_RESTARTABLE)
     if (rs_ctx != NULL && ret != MBEDTLS_ERR_ECP_IN_PROGRESS) {
@@ -3158,7 +6670,8 @@ int mbedtls_x509_crt_verify(mbedtls_x509_crt *crt,
                                              NULL, NULL,
                                              &mbedtls_x509_crt_profile_default,
                                              cn, flags,
-                                             f_vrfy, p_vrfy, NULL);
+                                             f_vrfy, p_vrfy, NULL, NULL,
+                                             NULL, NULL);
 }
 
 /*
@@ -3175,7 +6688,8 @@ int mbedtls_x509_crt_verify_with_profile(mbedtls_x509_crt *crt,
     return x509_crt_verify_restartable_ca_cb(crt, trust_ca, ca_crl,
                                              NULL, NULL,
                                              profile, cn, flags,
-                                             f_vrfy, p_vrfy, NULL);
+                                             f_vrfy, p_vrfy, NULL, NULL,
+                                             NULL, NULL);
 }
 
 #if defined(MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK)
@@ -3194,7 +6708,8 @@ int mbedtls_x509_crt_verify_with_ca_cb(mbedtls_x509_crt *crt,
     return x509_crt_verify_restartable_ca_cb(crt, NULL, NULL,
                                              f_ca_cb, p_ca_cb,
                                              profile, cn, flags,
-                                             f_vrfy, p_vrfy, NULL);
+                                             f_vrfy, p_vrfy, NULL, NULL,
+                                             NULL, NULL);
 }
 #endif /* MBEDTLS_X509_TRUSTED_CERTIFICATE_CALLBACK */
 
@@ -3210,8 +6725,47 @@ int mbedtls_x509_crt_verify_restartable(mbedtls_x509_crt *crt,
     return x509_crt_verify_restartable_ca_cb(crt, trust_ca, ca_crl,
                                              NULL, NULL,
                                              profile, cn, flags,
-                                             f_vrfy, p_vrfy, rs_ctx);
+                                             f_vrfy, p_vrfy, rs_ctx, NULL,
+                                             NULL, NULL);
+}
+
+#if defined(MBEDTLS_X509_VERIFY_CACHE)
+int mbedtls_x509_crt_verify_with_cache(mbedtls_x509_crt *crt,
+                                       mbedtls_x509_crt *trust_ca,
+                                       mbedtls_x509_crl *ca_crl,
+                                       const mbedtls_x509_crt_profile *profile,
+                                       const char *cn, uint32_t *flags,
+                                       int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                                       void *p_vrfy,
+                                       mbedtls_x509_crt_restart_ctx *rs_ctx,
+                                       mbedtls_x509_crt_verify_cache *cache)
+{
+    return x509_crt_verify_restartable_ca_cb(crt, trust_ca, ca_crl,
+                                             NULL, NULL,
+                                             profile, cn, flags,
+                                             f_vrfy, p_vrfy, rs_ctx, cache,
+                                             NULL, NULL);
+}
+#endif /* MBEDTLS_X509_VERIFY_CACHE */
+
+#if defined(MBEDTLS_X509_PARALLEL_VERIFY)
+int mbedtls_x509_crt_verify_parallel(mbedtls_x509_crt *crt,
+                                     mbedtls_x509_crt *trust_ca,
+                                     mbedtls_x509_crl *ca_crl,
+                                     const mbedtls_x509_crt_profile *profile,
+                                     const char *cn, uint32_t *flags,
+                                     int (*f_vrfy)(void *, mbedtls_x509_crt *, int, uint32_t *),
+                                     void *p_vrfy,
+                                     mbedtls_x509_crt_executor_t f_exec,
+                                     void *p_exec)
+{
+    return x509_crt_verify_restartable_ca_cb(crt, trust_ca, ca_crl,
+                                             NULL, NULL,
+                                             profile, cn, flags,
+                                             f_vrfy, p_vrfy, NULL, NULL,
+                                             f_exec, p_exec);
 }
+#endif /* MBEDTLS_X509_PARALLEL_VERIFY */
 
 
 /*
@@ -3232,17 +6786,36 @@ void mbedtls_x509_crt_free(mbedtls_x509_crt *crt)
 
     while (cert_cur != NULL) {
         mbedtls_pk_free(&cert_cur->pk);
+        mbedtls_free(cert_cur->san_dns);
+#if defined(MBEDTLS_X509_OCSP_STAPLE)
+        mbedtls_free(cert_cur->ocsp_response);
+#endif
 
+        if (cert_cur->arena != NULL) {
+            /* All the lists and the signature options are in the arena,
+             * except for the extensions decoded later on. */
+            mbedtls_zeroize_and_free(cert_cur->arena, cert_cur->arena_len);
+            if (cert_cur->late_ext & MBEDTLS_X509_EXT_SUBJECT_ALT_NAME) {
+                mbedtls_asn1_sequence_free(cert_cur->subject_alt_names.next);
+            }
+            if (cert_cur->late_ext & MBEDTLS_X509_EXT_EXTENDED_KEY_USAGE) {
+                mbedtls_asn1_sequence_free(cert_cur->ext_key_usage.next);
+            }
+            if (cert_cur->late_ext & MBEDTLS_X509_EXT_CERTIFICATE_POLICIES) {
+                mbedtls_asn1_sequence_free(cert_cur->certificate_policies.next);
+            }
+        } else {
 #if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
-        mbedtls_free(cert_cur->sig_opts);
+            mbedtls_free(cert_cur->sig_opts);
 #endif
 
-        mbedtls_asn1_free_named_data_list_shallow(cert_cur->issuer.next);
-        mbedtls_asn1_free_named_data_list_shallow(cert_cur->subject.next);
-        mbedtls_asn1_sequence_free(cert_cur->ext_key_usage.next);
-        mbedtls_asn1_sequence_free(cert_cur->subject_alt_names.next);
-        mbedtls_asn1_sequence_free(cert_cur->certificate_policies.next);
-        mbedtls_asn1_sequence_free(cert_cur->authority_key_id.authorityCertIssuer.next);
+            mbedtls_asn1_free_named_data_list_shallow(cert_cur->issuer.next);
+            mbedtls_asn1_free_named_data_list_shallow(cert_cur->subject.next);
+            mbedtls_asn1_sequence_free(cert_cur->ext_key_usage.next);
+            mbedtls_asn1_sequence_free(cert_cur->subject_alt_names.next);
+            mbedtls_asn1_sequence_free(cert_cur->certificate_policies.next);
+            mbedtls_asn1_sequence_free(cert_cur->authority_key_id.authorityCertIssuer.next);
+        }
 
         if (cert_cur->raw.p != NULL && cert_cur->own_buffer) {
             mbedtls_zeroize_and_free(cert_cur->raw.p, cert_cur->raw.len);
@@ -3269,6 +6842,9 @@ void mbedtls_x509_crt_restart_init(mbedtls_x509_crt_restart_ctx *ctx)
     ctx->parent = NULL;
     ctx->fallback_parent = NULL;
     ctx->fallback_signature_is_good = 0;
+#if defined(MBEDTLS_X509_TRUST_STORE)
+    ctx->parent_entry = NULL;
+#endif
 
     ctx->parent_is_trusted = -1;
 
@@ -30,6 +30,11 @@
 #include "mbedtls/pem.h"
 #endif
 
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+#include "psa/crypto.h"
+#include "mbedtls/psa_util.h"
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
 #include "mbedtls/platform.h"
 
 #if defined(MBEDTLS_FS_IO) || defined(EFIX64) || defined(EFI32)
@@ -114,7 +119,7 @@ static int x509_csr_parse_extensions(mbedtls_x509_csr *csr,
         /*
          * Detect supported extensions and skip unsupported extensions
          */
-        ret = mbedtls_oid_get_x509_ext_type(&extn_oid, &ext_type);
+        ret = mbedtls_x509_get_ext_type(&extn_oid, &ext_type);
 
         if (ret != 0) {
             /* Give the callback (if any) a chance to handle the extension */
@@ -263,6 +268,7 @@ static int x509_csr_parse_attributes(mbedtls_x509_csr *csr,
  */
 static int mbedtls_x509_csr_parse_der_internal(mbedtls_x509_csr *csr,
                                                const unsigned char *buf, size_t buflen,
+                                               int make_copy,
                                                mbedtls_x509_csr_ext_cb_t cb,
                                                void *p_ctx)
 {
@@ -283,15 +289,21 @@ static int mbedtls_x509_csr_parse_der_internal(mbedtls_x509_csr *csr,
     mbedtls_x509_csr_init(csr);
 
     /*
-     * first copy the raw DER data
+     * first copy the raw DER data, unless the caller keeps it
      */
-    p = mbedtls_calloc(1, len = buflen);
+    len = buflen;
+    if (make_copy != 0) {
+        p = mbedtls_calloc_tagged(X509, 1, len);
 
-    if (p == NULL) {
-        return MBEDTLS_ERR_X509_ALLOC_FAILED;
-    }
+        if (p == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
 
-    memcpy(p, buf, buflen);
+        memcpy(p, buf, buflen);
+        csr->own_buffer = 1;
+    } else {
+        p = (unsigned char *) buf;
+    }
 
     csr->raw.p = p;
     csr->raw.len = len;
@@ -433,7 +445,16 @@ static int mbedtls_x509_csr_parse_der_internal(mbedtls_x509_csr *csr,
 int mbedtls_x509_csr_parse_der(mbedtls_x509_csr *csr,
                                const unsigned char *buf, size_t buflen)
 {
-    return mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, NULL, NULL);
+    return mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, 1, NULL, NULL);
+}
+
+/*
+ * Parse a CSR in DER format, referring to the caller's buffer
+ */
+int mbedtls_x509_csr_parse_der_nocopy(mbedtls_x509_csr *csr,
+                                      const unsigned char *buf, size_t buflen)
+{
+    return mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, 0, NULL, NULL);
 }
 
 /*
@@ -444,7 +465,120 @@ int mbedtls_x509_csr_parse_der_with_ext_cb(mbedtls_x509_csr *csr,
                                            mbedtls_x509_csr_ext_cb_t cb,
                                            void *p_ctx)
 {
-    return mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, cb, p_ctx);
+    return mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, 1, cb, p_ctx);
+}
+
+/*
+ * Move the subject and SAN nodes and the signature options of a CSR into a
+ * single allocation, as x509_crt_arena_pack() does for certificates.
+ */
+static void x509_csr_arena_pack(mbedtls_x509_csr *csr)
+{
+    size_t names, seqs, len, opts_len = 0;
+    mbedtls_x509_name *name_arena;
+    mbedtls_x509_sequence *seq_arena;
+
+    names = mbedtls_x509_count_names(csr->subject.next);
+    seqs = mbedtls_x509_count_sequence(csr->subject_alt_names.next);
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    if (csr->sig_opts != NULL) {
+        opts_len = sizeof(mbedtls_pk_rsassa_pss_options);
+    }
+#endif
+
+    len = names * sizeof(mbedtls_x509_name) +
+          seqs * sizeof(mbedtls_x509_sequence) + opts_len;
+    if (len == 0) {
+        return;
+    }
+
+    /* Without memory for the arena, the CSR keeps its individual
+     * allocations, which is just as valid. */
+    csr->arena = mbedtls_calloc_tagged(X509, 1, len);
+    if (csr->arena == NULL) {
+        return;
+    }
+    csr->arena_len = len;
+
+    name_arena = (mbedtls_x509_name *) csr->arena;
+    mbedtls_x509_arena_move_names(&csr->subject, &name_arena);
+
+    seq_arena = (mbedtls_x509_sequence *) name_arena;
+    mbedtls_x509_arena_move_sequence(&csr->subject_alt_names, &seq_arena);
+
+#if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
+    if (opts_len != 0) {
+        void *opts = seq_arena;
+
+        memcpy(opts, csr->sig_opts, opts_len);
+        mbedtls_free(csr->sig_opts);
+        csr->sig_opts = opts;
+    }
+#endif
+}
+
+/*
+ * Check the signature of the CertificationRequestInfo with the key it holds
+ */
+static int x509_csr_check_signature(mbedtls_x509_csr *csr)
+{
+    size_t hash_len;
+    unsigned char hash[MBEDTLS_MD_MAX_SIZE];
+#if !defined(MBEDTLS_USE_PSA_CRYPTO)
+    const mbedtls_md_info_t *md_info;
+
+    md_info = mbedtls_md_info_from_type(csr->sig_md);
+    if (md_info == NULL) {
+        return MBEDTLS_ERR_X509_FEATURE_UNAVAILABLE;
+    }
+    hash_len = mbedtls_md_get_size(md_info);
+
+    if (mbedtls_md(md_info, csr->cri.p, csr->cri.len, hash) != 0) {
+        return MBEDTLS_ERR_X509_FATAL_ERROR;
+    }
+#else
+    psa_algorithm_t hash_alg = mbedtls_md_psa_alg_from_type(csr->sig_md);
+
+    if (psa_hash_compute(hash_alg, csr->cri.p, csr->cri.len,
+                         hash, sizeof(hash), &hash_len) != PSA_SUCCESS) {
+        return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
+    }
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    if (!mbedtls_pk_can_do(&csr->pk, csr->sig_pk)) {
+        return MBEDTLS_ERR_X509_SIG_MISMATCH;
+    }
+
+    if (mbedtls_pk_verify_ext(csr->sig_pk, csr->sig_opts, &csr->pk,
+                              csr->sig_md, hash, hash_len,
+                              csr->sig.p, csr->sig.len) != 0) {
+        return MBEDTLS_ERR_X509_CERT_VERIFY_FAILED;
+    }
+
+    return 0;
+}
+
+/*
+ * Parse a CSR in DER format without copying it, and check its signature
+ */
+int mbedtls_x509_csr_parse_der_verify(mbedtls_x509_csr *csr,
+                                      const unsigned char *buf, size_t buflen)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+
+    if ((ret = mbedtls_x509_csr_parse_der_internal(csr, buf, buflen, 0,
+                                                   NULL, NULL)) != 0) {
+        return ret;
+    }
+
+    x509_csr_arena_pack(csr);
+
+    if ((ret = x509_csr_check_signature(csr)) != 0) {
+        mbedtls_x509_csr_free(csr);
+        return ret;
+    }
+
+    return 0;
 }
 
 /*
@@ -621,14 +755,19 @@ void mbedtls_x509_csr_free(mbedtls_x509_csr *csr)
 
     mbedtls_pk_free(&csr->pk);
 
+    if (csr->arena != NULL) {
+        /* The lists and the signature options are in the arena. */
+        mbedtls_zeroize_and_free(csr->arena, csr->arena_len);
+    } else {
 #if defined(MBEDTLS_X509_RSASSA_PSS_SUPPORT)
-    mbedtls_free(csr->sig_opts);
+        mbedtls_free(csr->sig_opts);
 #endif
 
-    mbedtls_asn1_free_named_data_list_shallow(csr->subject.next);
-    mbedtls_asn1_sequence_free(csr->subject_alt_names.next);
+        mbedtls_asn1_free_named_data_list_shallow(csr->subject.next);
+        mbedtls_asn1_sequence_free(csr->subject_alt_names.next);
+    }
 
-    if (csr->raw.p != NULL) {
+    if (csr->raw.p != NULL && csr->own_buffer) {
         mbedtls_zeroize_and_free(csr->raw.p, csr->raw.len);
     }
 
@@ -15,13 +15,22 @@
 #include "mbedtls/private_access.h"
 
 #include "mbedtls/x509.h"
+#include "mbedtls/x509_crl.h"
+#include "mbedtls/x509_crt.h"
 #include "mbedtls/asn1.h"
 #include "pk_internal.h"
+#include "memory_profile_internal.h"
 
 #if defined(MBEDTLS_RSA_C)
 #include "mbedtls/rsa.h"
 #endif
 
+size_t mbedtls_x509_count_names(const mbedtls_x509_name *name);
+size_t mbedtls_x509_count_sequence(const mbedtls_x509_sequence *seq);
+void mbedtls_x509_arena_move_names(mbedtls_x509_name *head,
+                                   mbedtls_x509_name **arena);
+void mbedtls_x509_arena_move_sequence(mbedtls_x509_sequence *head,
+                                      mbedtls_x509_sequence **arena);
 int mbedtls_x509_get_name(unsigned char **p, const unsigned char *end,
                           mbedtls_x509_name *cur);
 int mbedtls_x509_get_alg_null(unsigned char **p, const unsigned char *end,
@@ -43,6 +52,23 @@ int mbedtls_x509_get_serial(unsigned char **p, const unsigned char *end,
                             mbedtls_x509_buf *serial);
 int mbedtls_x509_get_ext(unsigned char **p, const unsigned char *end,
                          mbedtls_x509_buf *ext, int tag);
+int mbedtls_x509_get_ext_type(const mbedtls_x509_buf *oid, int *ext_type);
+int64_t mbedtls_x509_time_to_epoch(const mbedtls_x509_time *t);
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_HAVE_TIME_DATE)
+uint32_t mbedtls_x509_crt_check_validity(const mbedtls_x509_crt *crt,
+                                         int64_t now);
+#endif
+#if defined(MBEDTLS_X509_CRL_SERIAL_INDEX)
+const mbedtls_x509_crl_entry *mbedtls_x509_crl_find_serial(const mbedtls_x509_crl *crl,
+                                                          const mbedtls_x509_buf *serial);
+#endif
+#if defined(MBEDTLS_X509_CRT_CA_DIR)
+int mbedtls_x509_name_openssl_hash(const mbedtls_x509_name *name, uint32_t *hash);
+#endif
+#if defined(MBEDTLS_X509_CRL_STREAM)
+int mbedtls_x509_crl_has_serial(const mbedtls_x509_crl *crl,
+                                const mbedtls_x509_buf *serial);
+#endif
 #if !defined(MBEDTLS_X509_REMOVE_INFO)
 int mbedtls_x509_sig_alg_gets(char *buf, size_t size, const mbedtls_x509_buf *sig_oid,
                               mbedtls_pk_type_t pk_alg, mbedtls_md_type_t md_alg,
@@ -60,6 +86,21 @@ int mbedtls_x509_write_sig(unsigned char **p, unsigned char *start,
                            const char *oid, size_t oid_len,
                            unsigned char *sig, size_t size,
                            mbedtls_pk_type_t pk_alg);
+size_t mbedtls_x509_write_sig_len(size_t oid_len, size_t sig_len,
+                                  mbedtls_pk_type_t pk_alg);
+size_t mbedtls_x509_sig_max_len(mbedtls_pk_context *key,
+                                mbedtls_pk_type_t pk_alg);
+int mbedtls_x509_write_der_signed(unsigned char *buf, size_t size,
+                                  unsigned char **c, size_t len,
+                                  size_t reserved,
+                                  const char *oid, size_t oid_len,
+                                  unsigned char *sig, size_t sig_len,
+                                  mbedtls_pk_type_t pk_alg);
+#if defined(MBEDTLS_PEM_WRITE_C)
+int mbedtls_x509_write_pem(const char *header, const char *footer,
+                           unsigned char *buf, size_t size,
+                           size_t der_len, size_t *olen);
+#endif
 int mbedtls_x509_get_ns_cert_type(unsigned char **p,
                                   const unsigned char *end,
                                   unsigned char *ns_cert_type);
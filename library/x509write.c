@@ -88,7 +88,7 @@ int mbedtls_x509_write_set_san_common(mbedtls_asn1_named_data **extensions,
     CHECK_OVERFLOW_ADD(buflen, 4 + 1);
 
     /* Allocate buffer */
-    buf = mbedtls_calloc(1, buflen);
+    buf = mbedtls_calloc_tagged(X509, 1, buflen);
     if (buf == NULL) {
         return MBEDTLS_ERR_ASN1_ALLOC_FAILED;
     }
@@ -415,15 +415,61 @@ static int x509_write_time(unsigned char **p, unsigned char *start,
     return (int) len;
 }
 
-int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
-                              unsigned char *buf, size_t size,
-                              int (*f_rng)(void *, unsigned char *, size_t),
-                              void *p_rng)
+/* The signature algorithm of the certificates an issuer key signs. */
+static int x509write_crt_sig_alg(mbedtls_pk_context *issuer_key,
+                                 mbedtls_md_type_t md_alg,
+                                 mbedtls_pk_type_t *pk_alg,
+                                 const char **sig_oid, size_t *sig_oid_len)
+{
+    /* There's no direct way of extracting a signature algorithm
+     * (represented as an element of mbedtls_pk_type_t) from a PK instance. */
+    if (mbedtls_pk_can_do(issuer_key, MBEDTLS_PK_RSA)) {
+        *pk_alg = MBEDTLS_PK_RSA;
+    } else if (mbedtls_pk_can_do(issuer_key, MBEDTLS_PK_ECDSA)) {
+        *pk_alg = MBEDTLS_PK_ECDSA;
+    } else {
+        return MBEDTLS_ERR_X509_INVALID_ALG;
+    }
+
+    return mbedtls_oid_get_oid_by_sig_alg(*pk_alg, md_alg, sig_oid, sig_oid_len);
+}
+
+static int x509write_crt_write_sig_alg_id(unsigned char **p, unsigned char *start,
+                                          mbedtls_pk_type_t pk_alg,
+                                          const char *sig_oid)
+{
+    int write_sig_null_par;
+
+    if (pk_alg == MBEDTLS_PK_ECDSA) {
+        /*
+         * The AlgorithmIdentifier's parameters field must be absent for DSA/ECDSA signature
+         * algorithms, see https://www.rfc-editor.org/rfc/rfc5480#page-17 and
+         * https://www.rfc-editor.org/rfc/rfc5758#section-3.
+         */
+        write_sig_null_par = 0;
+    } else {
+        write_sig_null_par = 1;
+    }
+
+    return mbedtls_asn1_write_algorithm_identifier_ext(p, start,
+                                                       sig_oid, strlen(sig_oid),
+                                                       0, write_sig_null_par);
+}
+
+/*
+ * Write a certificate, either entirely from ctx, or from the issuer-side
+ * fragments of tmpl and the subject-side fields of ctx.
+ */
+static int x509write_crt_der_internal(mbedtls_x509write_cert *ctx,
+                                      const mbedtls_x509write_crt_template *tmpl,
+                                      unsigned char *buf, size_t size,
+                                      int (*f_rng)(void *, unsigned char *, size_t),
+                                      void *p_rng)
 {
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     const char *sig_oid;
     size_t sig_oid_len = 0;
-    unsigned char *c, *c2;
+    unsigned char *c;
     unsigned char sig[MBEDTLS_PK_SIGNATURE_MAX_SIZE];
     size_t hash_length = 0;
     unsigned char hash[MBEDTLS_MD_MAX_SIZE];
@@ -435,36 +481,53 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
     size_t sub_len = 0, pub_len = 0, sig_and_oid_len = 0, sig_len;
     size_t len = 0;
     mbedtls_pk_type_t pk_alg;
-    int write_sig_null_par;
-
-    /*
-     * Prepare data to be signed at the end of the target buffer
-     */
-    c = buf + size;
+    mbedtls_pk_context *issuer_key;
+    mbedtls_md_type_t md_alg;
+    int version;
 
     /* Signature algorithm needed in TBS, and later for actual signature */
-
-    /* There's no direct way of extracting a signature algorithm
-     * (represented as an element of mbedtls_pk_type_t) from a PK instance. */
-    if (mbedtls_pk_can_do(ctx->issuer_key, MBEDTLS_PK_RSA)) {
-        pk_alg = MBEDTLS_PK_RSA;
-    } else if (mbedtls_pk_can_do(ctx->issuer_key, MBEDTLS_PK_ECDSA)) {
-        pk_alg = MBEDTLS_PK_ECDSA;
+    if (tmpl != NULL) {
+        issuer_key = tmpl->issuer_key;
+        md_alg = tmpl->md_alg;
+        version = tmpl->version;
+        pk_alg = tmpl->pk_alg;
+        sig_oid = tmpl->sig_oid;
+        sig_oid_len = tmpl->sig_oid_len;
     } else {
-        return MBEDTLS_ERR_X509_INVALID_ALG;
+        issuer_key = ctx->issuer_key;
+        md_alg = ctx->md_alg;
+        version = ctx->version;
+        if ((ret = x509write_crt_sig_alg(issuer_key, md_alg, &pk_alg,
+                                         &sig_oid, &sig_oid_len)) != 0) {
+            return ret;
+        }
     }
 
-    if ((ret = mbedtls_oid_get_oid_by_sig_alg(pk_alg, ctx->md_alg,
-                                              &sig_oid, &sig_oid_len)) != 0) {
-        return ret;
+    /*
+     * Prepare data to be signed at the end of the target buffer, leaving
+     * room after it for the signature so that it is written in place.
+     */
+    sig_and_oid_len = mbedtls_x509_write_sig_len(sig_oid_len,
+                                                 mbedtls_x509_sig_max_len(issuer_key,
+                                                                          pk_alg),
+                                                 pk_alg);
+    if (sig_and_oid_len > size) {
+        return MBEDTLS_ERR_ASN1_BUF_TOO_SMALL;
     }
+    c = buf + size - sig_and_oid_len;
 
     /*
      *  Extensions  ::=  SEQUENCE SIZE (1..MAX) OF Extension
      */
 
     /* Only for v3 */
-    if (ctx->version == MBEDTLS_X509_CRT_VERSION_3) {
+    if (version == MBEDTLS_X509_CRT_VERSION_3) {
+        if (tmpl != NULL) {
+            MBEDTLS_ASN1_CHK_ADD(len,
+                                 mbedtls_asn1_write_raw_buffer(&c, buf,
+                                                               tmpl->extensions,
+                                                               tmpl->extensions_len));
+        }
         MBEDTLS_ASN1_CHK_ADD(len,
                              mbedtls_x509_write_extensions(&c,
                                                            buf, ctx->extensions));
@@ -521,26 +584,26 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
     /*
      *  Issuer  ::=  Name
      */
-    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_x509_write_names(&c, buf,
-                                                       ctx->issuer));
+    if (tmpl != NULL) {
+        MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_raw_buffer(&c, buf,
+                                                                tmpl->issuer,
+                                                                tmpl->issuer_len));
+    } else {
+        MBEDTLS_ASN1_CHK_ADD(len, mbedtls_x509_write_names(&c, buf,
+                                                           ctx->issuer));
+    }
 
     /*
      *  Signature   ::=  AlgorithmIdentifier
      */
-    if (pk_alg == MBEDTLS_PK_ECDSA) {
-        /*
-         * The AlgorithmIdentifier's parameters field must be absent for DSA/ECDSA signature
-         * algorithms, see https://www.rfc-editor.org/rfc/rfc5480#page-17 and
-         * https://www.rfc-editor.org/rfc/rfc5758#section-3.
-         */
-        write_sig_null_par = 0;
+    if (tmpl != NULL) {
+        MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_raw_buffer(&c, buf,
+                                                                tmpl->sig_alg,
+                                                                tmpl->sig_alg_len));
     } else {
-        write_sig_null_par = 1;
+        MBEDTLS_ASN1_CHK_ADD(len, x509write_crt_write_sig_alg_id(&c, buf,
+                                                                 pk_alg, sig_oid));
     }
-    MBEDTLS_ASN1_CHK_ADD(len,
-                         mbedtls_asn1_write_algorithm_identifier_ext(&c, buf,
-                                                                     sig_oid, strlen(sig_oid),
-                                                                     0, write_sig_null_par));
 
     /*
      *  Serial   ::=  INTEGER
@@ -573,10 +636,10 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
      */
 
     /* Can be omitted for v1 */
-    if (ctx->version != MBEDTLS_X509_CRT_VERSION_1) {
+    if (version != MBEDTLS_X509_CRT_VERSION_1) {
         sub_len = 0;
         MBEDTLS_ASN1_CHK_ADD(sub_len,
-                             mbedtls_asn1_write_int(&c, buf, ctx->version));
+                             mbedtls_asn1_write_int(&c, buf, version));
         len += sub_len;
         MBEDTLS_ASN1_CHK_ADD(len,
                              mbedtls_asn1_write_len(&c, buf, sub_len));
@@ -597,7 +660,7 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
 
     /* Compute hash of CRT. */
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_algorithm = mbedtls_md_psa_alg_from_type(ctx->md_alg);
+    psa_algorithm = mbedtls_md_psa_alg_from_type(md_alg);
 
     status = psa_hash_compute(psa_algorithm,
                               c,
@@ -609,50 +672,139 @@ int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
         return MBEDTLS_ERR_PLATFORM_HW_ACCEL_FAILED;
     }
 #else
-    if ((ret = mbedtls_md(mbedtls_md_info_from_type(ctx->md_alg), c,
+    if ((ret = mbedtls_md(mbedtls_md_info_from_type(md_alg), c,
                           len, hash)) != 0) {
         return ret;
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
 
-    if ((ret = mbedtls_pk_sign(ctx->issuer_key, ctx->md_alg,
+    if ((ret = mbedtls_pk_sign(issuer_key, md_alg,
                                hash, hash_length, sig, sizeof(sig), &sig_len,
                                f_rng, p_rng)) != 0) {
         return ret;
     }
 
-    /* Move CRT to the front of the buffer to have space
-     * for the signature. */
-    memmove(buf, c, len);
-    c = buf + len;
-
-    /* Add signature at the end of the buffer,
-     * making sure that it doesn't underflow
-     * into the CRT buffer. */
-    c2 = buf + size;
-    MBEDTLS_ASN1_CHK_ADD(sig_and_oid_len, mbedtls_x509_write_sig(&c2, c,
-                                                                 sig_oid, sig_oid_len,
-                                                                 sig, sig_len, pk_alg));
-
     /*
-     * Memory layout after this step:
+     * Memory layout at this step:
      *
-     * buf       c=buf+len                c2            buf+size
-     * [CRT0,...,CRTn, UNUSED, ..., UNUSED, SIG0, ..., SIGm]
+     * buf          c            c+len            buf+size
+     * [UNUSED, ..., CRT0,...,CRTn, RESERVED, ..., RESERVED]
+     *
+     * Add signature in the reserved space.
      */
+    return mbedtls_x509_write_der_signed(buf, size, &c, len, sig_and_oid_len,
+                                         sig_oid, sig_oid_len,
+                                         sig, sig_len, pk_alg);
+}
 
-    /* Move raw CRT to just before the signature. */
-    c = c2 - len;
-    memmove(c, buf, len);
+int mbedtls_x509write_crt_der(mbedtls_x509write_cert *ctx,
+                              unsigned char *buf, size_t size,
+                              int (*f_rng)(void *, unsigned char *, size_t),
+                              void *p_rng)
+{
+    return x509write_crt_der_internal(ctx, NULL, buf, size, f_rng, p_rng);
+}
 
-    len += sig_and_oid_len;
-    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_len(&c, buf, len));
-    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_tag(&c, buf,
-                                                     MBEDTLS_ASN1_CONSTRUCTED |
-                                                     MBEDTLS_ASN1_SEQUENCE));
+void mbedtls_x509write_crt_template_init(mbedtls_x509write_crt_template *tmpl)
+{
+    memset(tmpl, 0, sizeof(mbedtls_x509write_crt_template));
+}
 
-    return (int) len;
+/* Upper bound on the size of the encoded issuer name and extensions. */
+#define X509WRITE_CRT_TEMPLATE_MAX_SIZE  (1u << 16)
+
+int mbedtls_x509write_crt_template_setup(mbedtls_x509write_crt_template *tmpl,
+                                         const mbedtls_x509write_cert *ctx)
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    mbedtls_pk_type_t pk_alg;
+    const char *sig_oid;
+    size_t sig_oid_len = 0;
+    size_t size, ext_len = 0, issuer_len = 0, alg_len = 0;
+    unsigned char *buf = NULL, *c;
+
+    if (tmpl->buf != NULL || ctx->issuer_key == NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    if ((ret = x509write_crt_sig_alg(ctx->issuer_key, ctx->md_alg, &pk_alg,
+                                     &sig_oid, &sig_oid_len)) != 0) {
+        return ret;
+    }
+
+    /* Encode backwards as in x509write_crt_der_internal(), growing the
+     * buffer until the fragments fit. */
+    for (size = 512; ; size *= 2) {
+        buf = mbedtls_calloc_tagged(X509, 1, size);
+        if (buf == NULL) {
+            return MBEDTLS_ERR_X509_ALLOC_FAILED;
+        }
+        c = buf + size;
+
+        ret = 0;
+        if (ctx->version == MBEDTLS_X509_CRT_VERSION_3) {
+            ret = mbedtls_x509_write_extensions(&c, buf, ctx->extensions);
+            ext_len = (size_t) ret;
+        }
+        if (ret >= 0) {
+            ret = mbedtls_x509_write_names(&c, buf, ctx->issuer);
+            issuer_len = (size_t) ret;
+        }
+        if (ret >= 0) {
+            ret = x509write_crt_write_sig_alg_id(&c, buf, pk_alg, sig_oid);
+            alg_len = (size_t) ret;
+        }
+
+        if (ret >= 0) {
+            break;
+        }
+
+        mbedtls_free(buf);
+        if (ret != MBEDTLS_ERR_ASN1_BUF_TOO_SMALL ||
+            size >= X509WRITE_CRT_TEMPLATE_MAX_SIZE) {
+            return ret;
+        }
+    }
+
+    tmpl->buf = buf;
+    tmpl->sig_alg = c;
+    tmpl->sig_alg_len = alg_len;
+    tmpl->issuer = c + alg_len;
+    tmpl->issuer_len = issuer_len;
+    tmpl->extensions = c + alg_len + issuer_len;
+    tmpl->extensions_len = ext_len;
+    tmpl->issuer_key = ctx->issuer_key;
+    tmpl->md_alg = ctx->md_alg;
+    tmpl->version = ctx->version;
+    tmpl->pk_alg = pk_alg;
+    tmpl->sig_oid = sig_oid;
+    tmpl->sig_oid_len = sig_oid_len;
+
+    return 0;
+}
+
+int mbedtls_x509write_crt_der_from_template(const mbedtls_x509write_crt_template *tmpl,
+                                            mbedtls_x509write_cert *ctx,
+                                            unsigned char *buf, size_t size,
+                                            int (*f_rng)(void *, unsigned char *, size_t),
+                                            void *p_rng)
+{
+    if (tmpl->buf == NULL) {
+        return MBEDTLS_ERR_X509_BAD_INPUT_DATA;
+    }
+
+    return x509write_crt_der_internal(ctx, tmpl, buf, size, f_rng, p_rng);
+}
+
+void mbedtls_x509write_crt_template_free(mbedtls_x509write_crt_template *tmpl)
+{
+    if (tmpl == NULL) {
+        return;
+    }
+
+    mbedtls_free(tmpl->buf);
+    mbedtls_platform_zeroize(tmpl, sizeof(mbedtls_x509write_crt_template));
 }
 
 #define PEM_BEGIN_CRT           "-----BEGIN CERTIFICATE-----\n"
@@ -672,9 +824,8 @@ int mbedtls_x509write_crt_pem(mbedtls_x509write_cert *crt,
         return ret;
     }
 
-    if ((ret = mbedtls_pem_write_buffer(PEM_BEGIN_CRT, PEM_END_CRT,
-                                        buf + size - ret, ret,
-                                        buf, size, &olen)) != 0) {
+    if ((ret = mbedtls_x509_write_pem(PEM_BEGIN_CRT, PEM_END_CRT,
+                                      buf, size, ret, &olen)) != 0) {
         return ret;
     }
 
@@ -140,7 +140,7 @@ static int x509write_csr_der_internal(mbedtls_x509write_csr *ctx,
     int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
     const char *sig_oid;
     size_t sig_oid_len = 0;
-    unsigned char *c, *c2;
+    unsigned char *c;
     unsigned char hash[MBEDTLS_MD_MAX_SIZE];
     size_t pub_len = 0, sig_and_oid_len = 0, sig_len;
     size_t len = 0;
@@ -150,8 +150,31 @@ static int x509write_csr_der_internal(mbedtls_x509write_csr *ctx,
     psa_algorithm_t hash_alg = mbedtls_md_psa_alg_from_type(ctx->md_alg);
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-    /* Write the CSR backwards starting from the end of buf */
-    c = buf + size;
+    if (mbedtls_pk_can_do(ctx->key, MBEDTLS_PK_RSA)) {
+        pk_alg = MBEDTLS_PK_RSA;
+    } else if (mbedtls_pk_can_do(ctx->key, MBEDTLS_PK_ECDSA)) {
+        pk_alg = MBEDTLS_PK_ECDSA;
+    } else {
+        return MBEDTLS_ERR_X509_INVALID_ALG;
+    }
+
+    if ((ret = mbedtls_oid_get_oid_by_sig_alg(pk_alg, ctx->md_alg,
+                                              &sig_oid, &sig_oid_len)) != 0) {
+        return ret;
+    }
+
+    /*
+     * Write the CSR backwards, leaving room at the end of buf for the
+     * signature so that it is written in place.
+     */
+    sig_and_oid_len = mbedtls_x509_write_sig_len(sig_oid_len,
+                                                 mbedtls_x509_sig_max_len(ctx->key,
+                                                                          pk_alg),
+                                                 pk_alg);
+    if (sig_and_oid_len > size) {
+        return MBEDTLS_ERR_ASN1_BUF_TOO_SMALL;
+    }
+    c = buf + size - sig_and_oid_len;
 
     MBEDTLS_ASN1_CHK_ADD(len, mbedtls_x509_write_extensions(&c, buf,
                                                             ctx->extensions));
@@ -234,54 +257,18 @@ static int x509write_csr_der_internal(mbedtls_x509write_csr *ctx,
         return ret;
     }
 
-    if (mbedtls_pk_can_do(ctx->key, MBEDTLS_PK_RSA)) {
-        pk_alg = MBEDTLS_PK_RSA;
-    } else if (mbedtls_pk_can_do(ctx->key, MBEDTLS_PK_ECDSA)) {
-        pk_alg = MBEDTLS_PK_ECDSA;
-    } else {
-        return MBEDTLS_ERR_X509_INVALID_ALG;
-    }
-
-    if ((ret = mbedtls_oid_get_oid_by_sig_alg(pk_alg, ctx->md_alg,
-                                              &sig_oid, &sig_oid_len)) != 0) {
+    /* Write sig and its OID into the room left at the end of buf. */
+    ret = mbedtls_x509_write_der_signed(buf, size, &c, len, sig_and_oid_len,
+                                        sig_oid, sig_oid_len,
+                                        sig, sig_len, pk_alg);
+    if (ret < 0) {
         return ret;
     }
 
-    /*
-     * Move the written CSR data to the start of buf to create space for
-     * writing the signature into buf.
-     */
-    memmove(buf, c, len);
-
-    /*
-     * Write sig and its OID into buf backwards from the end of buf.
-     * Note: mbedtls_x509_write_sig will check for c2 - ( buf + len ) < sig_len
-     * and return MBEDTLS_ERR_ASN1_BUF_TOO_SMALL if needed.
-     */
-    c2 = buf + size;
-    MBEDTLS_ASN1_CHK_ADD(sig_and_oid_len,
-                         mbedtls_x509_write_sig(&c2, buf + len, sig_oid, sig_oid_len,
-                                                sig, sig_len, pk_alg));
-
-    /*
-     * Compact the space between the CSR data and signature by moving the
-     * CSR data to the start of the signature.
-     */
-    c2 -= len;
-    memmove(c2, buf, len);
-
-    /* ASN encode the total size and tag the CSR data with it. */
-    len += sig_and_oid_len;
-    MBEDTLS_ASN1_CHK_ADD(len, mbedtls_asn1_write_len(&c2, buf, len));
-    MBEDTLS_ASN1_CHK_ADD(len,
-                         mbedtls_asn1_write_tag(
-                             &c2, buf,
-                             MBEDTLS_ASN1_CONSTRUCTED | MBEDTLS_ASN1_SEQUENCE));
-
     /* Zero the unused bytes at the start of buf */
-    memset(buf, 0, (size_t) (c2 - buf));
+    memset(buf, 0, (size_t) (c - buf));
 
-    return (int) len;
+    return ret;
 }
 
 int mbedtls_x509write_csr_der(mbedtls_x509write_csr *ctx, unsigned char *buf,
@@ -292,7 +279,7 @@ int mbedtls_x509write_csr_der(mbedtls_x509write_csr *ctx, unsigned char *buf,
     int ret;
     unsigned char *sig;
 
-    if ((sig = mbedtls_calloc(1, MBEDTLS_PK_SIGNATURE_MAX_SIZE)) == NULL) {
+    if ((sig = mbedtls_calloc_tagged(X509, 1, MBEDTLS_PK_SIGNATURE_MAX_SIZE)) == NULL) {
         return MBEDTLS_ERR_X509_ALLOC_FAILED;
     }
 
@@ -321,9 +308,8 @@ int mbedtls_x509write_csr_pem(mbedtls_x509write_csr *ctx, unsigned char *buf, si
         return ret;
     }
 
-    if ((ret = mbedtls_pem_write_buffer(PEM_BEGIN_CSR, PEM_END_CSR,
-                                        buf + size - ret,
-                                        ret, buf, size, &olen)) != 0) {
+    if ((ret = mbedtls_x509_write_pem(PEM_BEGIN_CSR, PEM_END_CSR,
+                                      buf, size, ret, &olen)) != 0) {
         return ret;
     }
 
@@ -103,3 +103,19 @@ int fuzz_recv_timeout(void *ctx, unsigned char *buf, size_t len,
 
     return fuzz_recv(ctx, buf, len);
 }
+
+#if defined(MBEDTLS_CTR_DRBG_C)
+int dummy_drbg_seed(mbedtls_ctr_drbg_context *ctr_drbg, const char *pers)
+{
+    int ret;
+
+    ret = mbedtls_ctr_drbg_seed(ctr_drbg, dummy_entropy, NULL,
+                                (const unsigned char *) pers, strlen(pers));
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ctr_drbg_set_reseed_interval(ctr_drbg, INT_MAX);
+
+    return 0;
+}
+#endif
@@ -24,5 +24,15 @@ int dummy_entropy(void *data, unsigned char *output, size_t len);
 int fuzz_recv_timeout(void *ctx, unsigned char *buf, size_t len,
                       uint32_t timeout);
 
+#if defined(MBEDTLS_CTR_DRBG_C)
+#include "mbedtls/ctr_drbg.h"
+
+/* Seed a DRBG meant to live for the whole process, as the network targets
+ * keep their contexts from one input to the next. It never reseeds: that
+ * would consume rand() in the middle of an input, and the same input would
+ * then not always behave the same. */
+int dummy_drbg_seed(mbedtls_ctr_drbg_context *ctr_drbg, const char *pers);
+#endif
+
 /* Implemented in the fuzz_*.c sources and required by onefile.c */
 int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size);
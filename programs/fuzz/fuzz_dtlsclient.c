@@ -14,69 +14,51 @@
     defined(MBEDTLS_CTR_DRBG_C) && \
     defined(MBEDTLS_TIMING_C)
 static int initialized = 0;
+static mbedtls_ctr_drbg_context ctr_drbg;
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
 static mbedtls_x509_crt cacert;
 #endif
+static mbedtls_timing_delay_context timer;
+static mbedtls_ssl_config conf;
+static mbedtls_ssl_context ssl;
 
 const char *pers = "fuzz_dtlsclient";
-#endif
-#endif // MBEDTLS_SSL_PROTO_DTLS
-
-
 
-int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+/* Set up everything that does not depend on the input, once per process:
+ * the configuration and context are then reset between inputs. */
+static int fuzz_init(void)
 {
-#if defined(MBEDTLS_SSL_PROTO_DTLS) && \
-    defined(MBEDTLS_SSL_CLI_C) && \
-    defined(MBEDTLS_ENTROPY_C) && \
-    defined(MBEDTLS_CTR_DRBG_C) && \
-    defined(MBEDTLS_TIMING_C)
-    int ret;
-    size_t len;
-    mbedtls_ssl_context ssl;
-    mbedtls_ssl_config conf;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_entropy_context entropy;
-    mbedtls_timing_delay_context timer;
-    unsigned char buf[4096];
-    fuzzBufferOffset_t biomemfuzz;
-
-    if (initialized == 0) {
+    mbedtls_ctr_drbg_init(&ctr_drbg);
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
-        mbedtls_x509_crt_init(&cacert);
-        if (mbedtls_x509_crt_parse(&cacert, (const unsigned char *) mbedtls_test_cas_pem,
-                                   mbedtls_test_cas_pem_len) != 0) {
-            return 1;
-        }
+    mbedtls_x509_crt_init(&cacert);
 #endif
-        dummy_init();
-
-        initialized = 1;
-    }
-
-    mbedtls_ssl_init(&ssl);
     mbedtls_ssl_config_init(&conf);
-    mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_entropy_init(&entropy);
+    mbedtls_ssl_init(&ssl);
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_status_t status = psa_crypto_init();
-    if (status != PSA_SUCCESS) {
-        goto exit;
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        return 1;
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
     srand(1);
-    if (mbedtls_ctr_drbg_seed(&ctr_drbg, dummy_entropy, &entropy,
-                              (const unsigned char *) pers, strlen(pers)) != 0) {
-        goto exit;
+    if (dummy_drbg_seed(&ctr_drbg, pers) != 0) {
+        return 1;
     }
 
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
+    if (mbedtls_x509_crt_parse(&cacert, (const unsigned char *) mbedtls_test_cas_pem,
+                               mbedtls_test_cas_pem_len) != 0) {
+        return 1;
+    }
+#endif
+    dummy_init();
+
     if (mbedtls_ssl_config_defaults(&conf,
                                     MBEDTLS_SSL_IS_CLIENT,
                                     MBEDTLS_SSL_TRANSPORT_DATAGRAM,
                                     MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
-        goto exit;
+        return 1;
     }
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
@@ -86,7 +68,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
     mbedtls_ssl_conf_rng(&conf, dummy_random, &ctr_drbg);
 
     if (mbedtls_ssl_setup(&ssl, &conf) != 0) {
-        goto exit;
+        return 1;
     }
 
     mbedtls_ssl_set_timer_cb(&ssl, &timer, mbedtls_timing_set_delay,
@@ -94,10 +76,41 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
     if (mbedtls_ssl_set_hostname(&ssl, "localhost") != 0) {
-        goto exit;
+        return 1;
     }
 #endif
 
+    return 0;
+}
+#endif
+#endif // MBEDTLS_SSL_PROTO_DTLS
+
+
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS) && \
+    defined(MBEDTLS_SSL_CLI_C) && \
+    defined(MBEDTLS_ENTROPY_C) && \
+    defined(MBEDTLS_CTR_DRBG_C) && \
+    defined(MBEDTLS_TIMING_C)
+    int ret;
+    size_t len;
+    unsigned char buf[4096];
+    fuzzBufferOffset_t biomemfuzz;
+
+    if (initialized == 0) {
+        if (fuzz_init() != 0) {
+            return 1;
+        }
+        initialized = 1;
+    }
+
+    srand(1);
+    if (mbedtls_ssl_session_reset(&ssl) != 0) {
+        return 0;
+    }
+
     biomemfuzz.Data = Data;
     biomemfuzz.Size = Size;
     biomemfuzz.Offset = 0;
@@ -119,15 +132,6 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
         } while (1);
     }
 
-exit:
-    mbedtls_entropy_free(&entropy);
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_ssl_config_free(&conf);
-    mbedtls_ssl_free(&ssl);
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    mbedtls_psa_crypto_free();
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
-
 #else
     (void) Data;
     (void) Size;
@@ -19,97 +19,75 @@
 const char *pers = "fuzz_dtlsserver";
 const unsigned char client_ip[4] = { 0x7F, 0, 0, 1 };
 static int initialized = 0;
+static mbedtls_ctr_drbg_context ctr_drbg;
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
 static mbedtls_x509_crt srvcert;
 static mbedtls_pk_context pkey;
 #endif
-#endif
-#endif // MBEDTLS_SSL_PROTO_DTLS
-
-int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+static mbedtls_ssl_cookie_ctx cookie_ctx;
+static mbedtls_timing_delay_context timer;
+static mbedtls_ssl_config conf;
+static mbedtls_ssl_context ssl;
+
+/* Set up everything that does not depend on the input, once per process:
+ * the configuration and context are then reset between inputs. */
+static int fuzz_init(void)
 {
-#if defined(MBEDTLS_SSL_PROTO_DTLS) && \
-    defined(MBEDTLS_SSL_SRV_C) && \
-    defined(MBEDTLS_ENTROPY_C) && \
-    defined(MBEDTLS_CTR_DRBG_C) && \
-    defined(MBEDTLS_TIMING_C) && \
-    (defined(PSA_WANT_ALG_SHA_384) || \
-    defined(PSA_WANT_ALG_SHA_256))
-    int ret;
-    size_t len;
-    mbedtls_ssl_context ssl;
-    mbedtls_ssl_config conf;
-    mbedtls_ctr_drbg_context ctr_drbg;
-    mbedtls_entropy_context entropy;
-    mbedtls_timing_delay_context timer;
-    mbedtls_ssl_cookie_ctx cookie_ctx;
-    unsigned char buf[4096];
-    fuzzBufferOffset_t biomemfuzz;
-
     mbedtls_ctr_drbg_init(&ctr_drbg);
-    mbedtls_entropy_init(&entropy);
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
     mbedtls_x509_crt_init(&srvcert);
     mbedtls_pk_init(&pkey);
 #endif
-    mbedtls_ssl_init(&ssl);
-    mbedtls_ssl_config_init(&conf);
     mbedtls_ssl_cookie_init(&cookie_ctx);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ssl_init(&ssl);
 
 #if defined(MBEDTLS_USE_PSA_CRYPTO)
-    psa_status_t status = psa_crypto_init();
-    if (status != PSA_SUCCESS) {
-        goto exit;
+    if (psa_crypto_init() != PSA_SUCCESS) {
+        return 1;
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
-    if (mbedtls_ctr_drbg_seed(&ctr_drbg, dummy_entropy, &entropy,
-                              (const unsigned char *) pers, strlen(pers)) != 0) {
-        goto exit;
+    srand(1);
+    if (dummy_drbg_seed(&ctr_drbg, pers) != 0) {
+        return 1;
     }
 
-    if (initialized == 0) {
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
-
-        if (mbedtls_x509_crt_parse(&srvcert, (const unsigned char *) mbedtls_test_srv_crt,
-                                   mbedtls_test_srv_crt_len) != 0) {
-            return 1;
-        }
-        if (mbedtls_x509_crt_parse(&srvcert, (const unsigned char *) mbedtls_test_cas_pem,
-                                   mbedtls_test_cas_pem_len) != 0) {
-            return 1;
-        }
-        if (mbedtls_pk_parse_key(&pkey, (const unsigned char *) mbedtls_test_srv_key,
-                                 mbedtls_test_srv_key_len, NULL, 0,
-                                 dummy_random, &ctr_drbg) != 0) {
-            return 1;
-        }
-#endif
-        dummy_init();
-
-        initialized = 1;
+    if (mbedtls_x509_crt_parse(&srvcert, (const unsigned char *) mbedtls_test_srv_crt,
+                               mbedtls_test_srv_crt_len) != 0) {
+        return 1;
+    }
+    if (mbedtls_x509_crt_parse(&srvcert, (const unsigned char *) mbedtls_test_cas_pem,
+                               mbedtls_test_cas_pem_len) != 0) {
+        return 1;
     }
+    if (mbedtls_pk_parse_key(&pkey, (const unsigned char *) mbedtls_test_srv_key,
+                             mbedtls_test_srv_key_len, NULL, 0,
+                             dummy_random, &ctr_drbg) != 0) {
+        return 1;
+    }
+#endif
+    dummy_init();
 
     if (mbedtls_ssl_config_defaults(&conf,
                                     MBEDTLS_SSL_IS_SERVER,
                                     MBEDTLS_SSL_TRANSPORT_DATAGRAM,
                                     MBEDTLS_SSL_PRESET_DEFAULT) != 0) {
-        goto exit;
+        return 1;
     }
 
-
-    srand(1);
     mbedtls_ssl_conf_rng(&conf, dummy_random, &ctr_drbg);
 
 #if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
     mbedtls_ssl_conf_ca_chain(&conf, srvcert.next, NULL);
     if (mbedtls_ssl_conf_own_cert(&conf, &srvcert, &pkey) != 0) {
-        goto exit;
+        return 1;
     }
 #endif
 
     if (mbedtls_ssl_cookie_setup(&cookie_ctx, dummy_random, &ctr_drbg) != 0) {
-        goto exit;
+        return 1;
     }
 
     mbedtls_ssl_conf_dtls_cookies(&conf,
@@ -118,18 +96,49 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
                                   &cookie_ctx);
 
     if (mbedtls_ssl_setup(&ssl, &conf) != 0) {
-        goto exit;
+        return 1;
     }
 
     mbedtls_ssl_set_timer_cb(&ssl, &timer, mbedtls_timing_set_delay,
                              mbedtls_timing_get_delay);
 
+    return 0;
+}
+#endif
+#endif // MBEDTLS_SSL_PROTO_DTLS
+
+int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
+{
+#if defined(MBEDTLS_SSL_PROTO_DTLS) && \
+    defined(MBEDTLS_SSL_SRV_C) && \
+    defined(MBEDTLS_ENTROPY_C) && \
+    defined(MBEDTLS_CTR_DRBG_C) && \
+    defined(MBEDTLS_TIMING_C) && \
+    (defined(PSA_WANT_ALG_SHA_384) || \
+    defined(PSA_WANT_ALG_SHA_256))
+    int ret;
+    size_t len;
+    unsigned char buf[4096];
+    fuzzBufferOffset_t biomemfuzz;
+
+    if (initialized == 0) {
+        if (fuzz_init() != 0) {
+            return 1;
+        }
+        initialized = 1;
+    }
+
+    srand(1);
+    if (mbedtls_ssl_session_reset(&ssl) != 0) {
+        return 0;
+    }
+
     biomemfuzz.Data = Data;
     biomemfuzz.Size = Size;
     biomemfuzz.Offset = 0;
     mbedtls_ssl_set_bio(&ssl, &biomemfuzz, dummy_send, fuzz_recv, fuzz_recv_timeout);
     if (mbedtls_ssl_set_client_transport_id(&ssl, client_ip, sizeof(client_ip)) != 0) {
-        goto exit;
+        return 0;
     }
 
     ret = mbedtls_ssl_handshake(&ssl);
@@ -139,7 +148,7 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
         mbedtls_ssl_session_reset(&ssl);
         mbedtls_ssl_set_bio(&ssl, &biomemfuzz, dummy_send, fuzz_recv, fuzz_recv_timeout);
         if (mbedtls_ssl_set_client_transport_id(&ssl, client_ip, sizeof(client_ip)) != 0) {
-            goto exit;
+            return 0;
         }
 
         ret = mbedtls_ssl_handshake(&ssl);
@@ -159,20 +168,6 @@ int LLVMFuzzerTestOneInput(const uint8_t *Data, size_t Size)
         }
     }
 
-exit:
-    mbedtls_ssl_cookie_free(&cookie_ctx);
-    mbedtls_entropy_free(&entropy);
-#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_PEM_PARSE_C)
-    mbedtls_pk_free(&pkey);
-    mbedtls_x509_crt_free(&srvcert);
-#endif
-    mbedtls_ctr_drbg_free(&ctr_drbg);
-    mbedtls_ssl_config_free(&conf);
-    mbedtls_ssl_free(&ssl);
-#if defined(MBEDTLS_USE_PSA_CRYPTO)
-    mbedtls_psa_crypto_free();
-#endif /* MBEDTLS_USE_PSA_CRYPTO */
-
 #else
     (void) Data;
     (void) Size;
@@ -457,6 +457,7 @@ int main(void)
     "                                otherwise. The expansion of the macro\n" \
     "                                is printed if it is defined\n"           \
     USAGE_SERIALIZATION                                                       \
+    USAGE_STREAM                                                              \
     "\n"
 
 /*
@@ -501,6 +502,7 @@ struct options {
     int renegotiate;            /* attempt renegotiation?                   */
     int renego_delay;           /* delay before enforcing renegotiation     */
     int exchanges;              /* number of data exchanges                 */
+    stream_options stream;      /* bulk transfer instead of exchanges       */
     int min_version;            /* minimum protocol version accepted        */
     int max_version;            /* maximum protocol version accepted        */
     int allow_sha1;             /* flag for SHA-1 support                   */
@@ -949,6 +951,7 @@ int main(int argc, char *argv[])
     opt.allow_legacy        = DFL_ALLOW_LEGACY;
     opt.renegotiate         = DFL_RENEGOTIATE;
     opt.exchanges           = DFL_EXCHANGES;
+    stream_options_init(&opt.stream);
     opt.min_version         = DFL_MIN_VERSION;
     opt.max_version         = DFL_MAX_VERSION;
     opt.allow_sha1          = DFL_SHA1;
@@ -1043,6 +1046,15 @@ usage:
         }
         *q++ = '\0';
 
+        if ((ret = stream_option_parse(&opt.stream, p, q)) != 0) {
+            if (ret < 0) {
+                ret = 0;
+                goto usage;
+            }
+            ret = 0;
+            continue;
+        }
+
         if (strcmp(p, "server_name") == 0) {
             opt.server_name = q;
         } else if (strcmp(p, "server_addr") == 0) {
@@ -1490,6 +1502,13 @@ usage:
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+    if (opt.stream.mode != STREAM_NONE &&
+        opt.transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        mbedtls_printf("stream is only supported with TLS\n");
+        ret = 2;
+        goto usage;
+    }
+
     if (opt.force_ciphersuite[0] > 0) {
         const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
         ciphersuite_info =
@@ -2030,6 +2049,10 @@ usage:
     }
 #endif /* MBEDTLS_SSL_EARLY_DATA */
 
+    if (opt.stream.write_batch > 1) {
+        mbedtls_ssl_conf_write_batch(&conf, (unsigned char) opt.stream.write_batch);
+    }
+
     if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0) {
         mbedtls_printf(" failed\n  ! mbedtls_ssl_setup returned -0x%x\n\n",
                        (unsigned int) -ret);
@@ -2498,6 +2521,15 @@ usage:
     }
 #endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
 
+#if defined(MBEDTLS_HAVE_TIME)
+    if (opt.stream.mode != STREAM_NONE) {
+        if ((ret = stream_run(&ssl, &server_fd, opt.event, &opt.stream)) != 0) {
+            goto exit;
+        }
+        goto close_notify;
+    }
+#endif /* MBEDTLS_HAVE_TIME */
+
     /*
      * 6. Write the GET request
      */
@@ -0,0 +1,561 @@
+/*
+ *  Contention benchmark for the objects that servers share between threads
+ *
+ *  Runs the operations of the session cache, the session ticket context,
+ *  the DTLS cookie context and the SSL configuration from 1 to N threads
+ *  sharing one object, and reports the total rate and the scaling
+ *  efficiency, that is the rate on N threads divided by N times the rate
+ *  on one thread.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) || \
+    !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_HAVE_TIME)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_SSL_SRV_C and/or MBEDTLS_HAVE_TIME "
+                   "not defined.\n");
+    mbedtls_exit(0);
+}
+#elif !defined(MBEDTLS_THREADING_C) || !defined(MBEDTLS_THREADING_PTHREAD)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_THREADING_PTHREAD not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/error.h"
+#include "psa/crypto.h"
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+#include "mbedtls/ssl_cache.h"
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+#include "mbedtls/ssl_ticket.h"
+#endif
+#if defined(MBEDTLS_SSL_COOKIE_C)
+#include "mbedtls/ssl_cookie.h"
+#endif
+
+#define DFL_THREADS             8
+#define DFL_OPS                 10000
+#define MAX_THREADS             256
+
+/* Session IDs of each thread in the cache, so that it stays populated. */
+#define CACHE_IDS_PER_THREAD    64
+
+#define USAGE \
+    "\n usage: ssl_contention_bench param=<>...\n"                      \
+    "\n acceptable parameters:\n"                                       \
+    "    threads=%%d         largest number of threads, measured from\n" \
+    "                        1 in powers of two and this number\n"      \
+    "                        default: %d, at most %d\n"                 \
+    "    ops=%%d             operations per thread and measurement\n"   \
+    "                        default: %d\n"                             \
+    "    object=%%s          cache, ticket, cookie, config or all\n"    \
+    "                        default: all\n"                            \
+    "\n"
+
+typedef struct bench_thread bench_thread;
+
+typedef struct {
+    const char *name;
+    const char *op;             /* what one operation is */
+    int (*run)(bench_thread *t);
+} bench_object;
+
+struct bench_thread {
+    pthread_t id;
+    unsigned index;
+    const bench_object *object;
+    int ret;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned ready;
+    int go;
+    int ops;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_ssl_session session;        /* template, read by all threads */
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_context ticket;
+#endif
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    mbedtls_ssl_cookie_ctx cookie;
+#endif
+    mbedtls_ssl_config conf;
+} bench_shared;
+
+static unsigned long long bench_usec(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long) now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+static void bench_put_u32(unsigned long n, unsigned char *buf)
+{
+    buf[0] = (unsigned char) (n >> 24);
+    buf[1] = (unsigned char) (n >> 16);
+    buf[2] = (unsigned char) (n >> 8);
+    buf[3] = (unsigned char) n;
+}
+
+/* Called by each thread once set up: returns when all of them are. */
+static void bench_thread_start(void)
+{
+    pthread_mutex_lock(&bench_shared.mutex);
+    bench_shared.ready++;
+    pthread_cond_broadcast(&bench_shared.cond);
+    while (!bench_shared.go) {
+        pthread_cond_wait(&bench_shared.cond, &bench_shared.mutex);
+    }
+    pthread_mutex_unlock(&bench_shared.mutex);
+}
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+/* A set and a get of a session ID of this thread. */
+static int bench_cache(bench_thread *t)
+{
+    unsigned char id[32];
+    mbedtls_ssl_session session;
+    int ret = 0;
+
+    memset(id, 0, sizeof(id));
+    bench_put_u32(t->index, id);
+
+    bench_thread_start();
+    for (int i = 0; ret == 0 && i < bench_shared.ops; i++) {
+        bench_put_u32((unsigned long) (i % CACHE_IDS_PER_THREAD), id + 4);
+
+        ret = mbedtls_ssl_cache_set(&bench_shared.cache, id, sizeof(id),
+                                    &bench_shared.session);
+        if (ret != 0) {
+            break;
+        }
+
+        mbedtls_ssl_session_init(&session);
+        ret = mbedtls_ssl_cache_get(&bench_shared.cache, id, sizeof(id),
+                                    &session);
+        mbedtls_ssl_session_free(&session);
+    }
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_CACHE_C */
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+/* A write and a parse of a ticket. */
+static int bench_ticket(bench_thread *t)
+{
+    unsigned char buf[1024];
+    size_t len;
+    uint32_t lifetime;
+    mbedtls_ssl_session session;
+    int ret = 0;
+
+    (void) t;
+
+    bench_thread_start();
+    for (int i = 0; ret == 0 && i < bench_shared.ops; i++) {
+        ret = mbedtls_ssl_ticket_write(&bench_shared.ticket,
+                                       &bench_shared.session,
+                                       buf, buf + sizeof(buf),
+                                       &len, &lifetime);
+        if (ret != 0) {
+            break;
+        }
+
+        mbedtls_ssl_session_init(&session);
+        ret = mbedtls_ssl_ticket_parse(&bench_shared.ticket, &session,
+                                       buf, len);
+        mbedtls_ssl_session_free(&session);
+        /* A ticket that is due for renewal is still a successful parse. */
+        if (ret > 0) {
+            ret = 0;
+        }
+    }
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TICKET_C */
+
+#if defined(MBEDTLS_SSL_COOKIE_C)
+/* A write and a check of a cookie for a client address of this thread. */
+static int bench_cookie(bench_thread *t)
+{
+    unsigned char cookie[64], *p;
+    unsigned char cli_id[4];
+    int ret = 0;
+
+    bench_put_u32(t->index, cli_id);
+
+    bench_thread_start();
+    for (int i = 0; ret == 0 && i < bench_shared.ops; i++) {
+        p = cookie;
+        ret = mbedtls_ssl_cookie_write(&bench_shared.cookie, &p,
+                                       cookie + sizeof(cookie),
+                                       cli_id, sizeof(cli_id));
+        if (ret != 0) {
+            break;
+        }
+
+        ret = mbedtls_ssl_cookie_check(&bench_shared.cookie, cookie,
+                                       (size_t) (p - cookie),
+                                       cli_id, sizeof(cli_id));
+    }
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_COOKIE_C */
+
+/* The setup and free of a context on the shared configuration. */
+static int bench_config(bench_thread *t)
+{
+    mbedtls_ssl_context ssl;
+    int ret = 0;
+
+    (void) t;
+
+    bench_thread_start();
+    for (int i = 0; ret == 0 && i < bench_shared.ops; i++) {
+        mbedtls_ssl_init(&ssl);
+        ret = mbedtls_ssl_setup(&ssl, &bench_shared.conf);
+        mbedtls_ssl_free(&ssl);
+    }
+
+    return ret;
+}
+
+static const bench_object objects[] = {
+#if defined(MBEDTLS_SSL_CACHE_C)
+    { "cache", "set+get", bench_cache },
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    { "ticket", "write+parse", bench_ticket },
+#endif
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    { "cookie", "write+check", bench_cookie },
+#endif
+    { "config", "setup+free", bench_config },
+};
+
+static void *bench_thread_main(void *arg)
+{
+    bench_thread *t = (bench_thread *) arg;
+
+    t->ret = t->object->run(t);
+
+    return NULL;
+}
+
+/*
+ * One measurement of an object on nthreads threads: returns 0 and the
+ * elapsed time in microseconds, or an error code.
+ */
+static int bench_run(const bench_object *object, bench_thread *threads,
+                     unsigned nthreads, unsigned long long *elapsed)
+{
+    unsigned i, started;
+    unsigned long long start;
+    int ret = 0;
+
+    bench_shared.ready = 0;
+    bench_shared.go = 0;
+
+    for (started = 0; started < nthreads; started++) {
+        threads[started].index = started;
+        threads[started].object = object;
+        threads[started].ret = 0;
+        if (pthread_create(&threads[started].id, NULL, bench_thread_main,
+                           &threads[started]) != 0) {
+            ret = MBEDTLS_ERR_ERROR_GENERIC_ERROR;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&bench_shared.mutex);
+    while (bench_shared.ready < started) {
+        pthread_cond_wait(&bench_shared.cond, &bench_shared.mutex);
+    }
+    start = bench_usec();
+    bench_shared.go = 1;
+    pthread_cond_broadcast(&bench_shared.cond);
+    pthread_mutex_unlock(&bench_shared.mutex);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].id, NULL);
+        if (ret == 0) {
+            ret = threads[i].ret;
+        }
+    }
+    *elapsed = bench_usec() - start;
+
+    return ret;
+}
+
+/* Fill the session that the cache and ticket threads store. */
+static void bench_session_setup(mbedtls_ssl_session *session)
+{
+    mbedtls_ssl_session_init(session);
+    session->endpoint = MBEDTLS_SSL_IS_SERVER;
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    session->tls_version = MBEDTLS_SSL_VERSION_TLS1_2;
+#else
+    session->tls_version = MBEDTLS_SSL_VERSION_TLS1_3;
+#endif
+    session->ciphersuite = mbedtls_ssl_list_ciphersuites()[0];
+    session->id_len = 32;
+    memset(session->id, 0x5A, session->id_len);
+    memset(session->master, 0xA5, sizeof(session->master));
+    session->start = mbedtls_time(NULL);
+}
+
+static void bench_shared_init(void)
+{
+    pthread_mutex_init(&bench_shared.mutex, NULL);
+    pthread_cond_init(&bench_shared.cond, NULL);
+    mbedtls_ctr_drbg_init(&bench_shared.ctr_drbg);
+    bench_session_setup(&bench_shared.session);
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_init(&bench_shared.cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_init(&bench_shared.ticket);
+#endif
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    mbedtls_ssl_cookie_init(&bench_shared.cookie);
+#endif
+    mbedtls_ssl_config_init(&bench_shared.conf);
+}
+
+static int bench_shared_setup(unsigned max_threads)
+{
+    mbedtls_entropy_context *entropy = NULL;
+    int ret;
+
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_set_max_entries(&bench_shared.cache,
+                                      (int) max_threads * CACHE_IDS_PER_THREAD);
+#else
+    (void) max_threads;
+#endif
+
+    /* The entropy context is only needed to seed the DRBG. */
+    entropy = mbedtls_calloc(1, sizeof(*entropy));
+    if (entropy == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    mbedtls_entropy_init(entropy);
+    ret = mbedtls_ctr_drbg_seed(&bench_shared.ctr_drbg, mbedtls_entropy_func,
+                                entropy, (const unsigned char *) "contention",
+                                10);
+    mbedtls_entropy_free(entropy);
+    mbedtls_free(entropy);
+    if (ret != 0) {
+        return ret;
+    }
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+    ret = mbedtls_ssl_ticket_setup(&bench_shared.ticket,
+                                   mbedtls_ctr_drbg_random,
+                                   &bench_shared.ctr_drbg,
+                                   MBEDTLS_CIPHER_AES_256_GCM, 86400);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    ret = mbedtls_ssl_cookie_setup(&bench_shared.cookie,
+                                   mbedtls_ctr_drbg_random,
+                                   &bench_shared.ctr_drbg);
+    if (ret != 0) {
+        return ret;
+    }
+#endif
+
+    ret = mbedtls_ssl_config_defaults(&bench_shared.conf,
+                                      MBEDTLS_SSL_IS_SERVER,
+                                      MBEDTLS_SSL_TRANSPORT_STREAM,
+                                      MBEDTLS_SSL_PRESET_DEFAULT);
+    if (ret != 0) {
+        return ret;
+    }
+    mbedtls_ssl_conf_rng(&bench_shared.conf, mbedtls_ctr_drbg_random,
+                         &bench_shared.ctr_drbg);
+
+    return 0;
+}
+
+/* Thread counts are powers of two up to max, then max; 0 after max. */
+static int bench_next_threads(int n, int max)
+{
+    if (n == max) {
+        return 0;
+    }
+    return n * 2 < max ? n * 2 : max;
+}
+
+static void bench_shared_free(void)
+{
+    mbedtls_ssl_config_free(&bench_shared.conf);
+#if defined(MBEDTLS_SSL_COOKIE_C)
+    mbedtls_ssl_cookie_free(&bench_shared.cookie);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&bench_shared.ticket);
+#endif
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_free(&bench_shared.cache);
+#endif
+    mbedtls_ssl_session_free(&bench_shared.session);
+    mbedtls_ctr_drbg_free(&bench_shared.ctr_drbg);
+    pthread_cond_destroy(&bench_shared.cond);
+    pthread_mutex_destroy(&bench_shared.mutex);
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int max_threads = DFL_THREADS;
+    const char *want_object = NULL;
+    bench_thread *threads = NULL;
+    char *p, *q;
+
+    bench_shared_init();
+    bench_shared.ops = DFL_OPS;
+
+    for (int i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "threads") == 0) {
+            max_threads = atoi(q);
+            if (max_threads <= 0 || max_threads > MAX_THREADS) {
+                goto usage;
+            }
+        } else if (strcmp(p, "ops") == 0) {
+            bench_shared.ops = atoi(q);
+            if (bench_shared.ops <= 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "object") == 0) {
+            if (strcmp(q, "all") != 0) {
+                want_object = q;
+            }
+        } else {
+            goto usage;
+        }
+    }
+
+    ret = psa_crypto_init();
+    if (ret != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto: %d\n", ret);
+        goto exit;
+    }
+
+    ret = bench_shared_setup((unsigned) max_threads);
+    if (ret != 0) {
+        mbedtls_fprintf(stderr, "Failed to set up the shared objects: "
+                                "-0x%04x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    threads = mbedtls_calloc((size_t) max_threads, sizeof(*threads));
+    if (threads == NULL) {
+        mbedtls_fprintf(stderr, "Failed to allocate the threads\n");
+        goto exit;
+    }
+
+    mbedtls_printf("\n  %-7s %-12s %7s %12s %10s\n",
+                   "object", "operation", "threads", "ops/s", "scaling");
+
+    for (size_t o = 0; o < sizeof(objects) / sizeof(objects[0]); o++) {
+        double single_rate = 0.0;
+
+        if (want_object != NULL && strcmp(want_object, objects[o].name) != 0) {
+            continue;
+        }
+
+        for (int n = 1; n != 0; n = bench_next_threads(n, max_threads)) {
+            unsigned long long elapsed = 0;
+            double rate;
+
+            mbedtls_printf("  %-7s %-12s %7d ", objects[o].name, objects[o].op, n);
+            fflush(stdout);
+
+            ret = bench_run(&objects[o], threads, (unsigned) n, &elapsed);
+            if (ret != 0) {
+                mbedtls_printf("failed: -0x%04x\n", (unsigned int) -ret);
+                break;
+            }
+
+            rate = elapsed != 0 ?
+                   (double) n * bench_shared.ops * 1000000.0 / elapsed : 0.0;
+            if (n == 1) {
+                single_rate = rate;
+            }
+            mbedtls_printf("%12.0f %9.0f%%\n", rate,
+                           single_rate != 0.0 ?
+                           100.0 * rate / (n * single_rate) : 0.0);
+        }
+    }
+
+    mbedtls_printf("\n");
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+exit:
+    mbedtls_free(threads);
+    bench_shared_free();
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+
+usage:
+    mbedtls_printf(USAGE, DFL_THREADS, MAX_THREADS, DFL_OPS);
+    mbedtls_exit(MBEDTLS_EXIT_FAILURE);
+}
+
+#endif /* MBEDTLS_ENTROPY_C && MBEDTLS_CTR_DRBG_C && MBEDTLS_SSL_SRV_C &&
+          MBEDTLS_HAVE_TIME && MBEDTLS_THREADING_PTHREAD */
@@ -27,6 +27,7 @@ int main(void)
 #endif
 
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <string.h>
 #if defined(MBEDTLS_HAVE_TIME)
@@ -85,6 +86,12 @@ int main(void)
 #define MIN_BASE64_LEN      (MIN_SERIALIZED_DATA * 4 / 3)
 #define MAX_BASE64_LEN      (MAX_SERIALIZED_DATA * 4 / 3 + 3)
 
+/*
+ * Number of power of two buckets in the size histograms of the batch mode,
+ * enough for MAX_SERIALIZED_DATA.
+ */
+#define SIZE_HIST_LEN       27
+
 /*
  * A macro that prevents from reading out of the ssl buffer range.
  */
@@ -98,6 +105,70 @@ int main(void)
         }                                   \
     } while (0)
 
+/*
+ * Fields of the serialized data that are accounted for separately in the
+ * size breakdown of the batch mode. The sizes include the length prefixes.
+ */
+enum {
+    FIELD_HEADER,
+    FIELD_SESSION_LEN,
+    FIELD_START_TIME,
+    FIELD_CIPHERSUITE,
+    FIELD_COMPRESSION,
+    FIELD_SESSION_ID,
+    FIELD_MASTER,
+    FIELD_VERIFY_RESULT,
+    FIELD_PEER_CERT,
+    FIELD_PEER_CERT_DIGEST,
+    FIELD_TICKET,
+    FIELD_TICKET_LIFETIME,
+    FIELD_SESSION_FLAGS,
+    FIELD_RANDOM,
+    FIELD_CID,
+    FIELD_REPLAY,
+    FIELD_DATAGRAM_PACKING,
+    FIELD_OUT_CTR,
+    FIELD_MTU,
+    FIELD_ALPN,
+    FIELD_UNPARSED,
+    FIELD_COUNT
+};
+
+static const char *const field_names[FIELD_COUNT] = {
+    "header",
+    "session length",
+    "start time",
+    "ciphersuite",
+    "compression",
+    "session ID",
+    "master secret",
+    "verify result",
+    "peer certificate",
+    "peer cert digest",
+    "ticket",
+    "ticket lifetime",
+    "MFL/HMAC/EtM",
+    "random bytes",
+    "connection IDs",
+    "replay state",
+    "datagram packing",
+    "out record ctr",
+    "MTU",
+    "ALPN",
+    "unparsed"
+};
+
+/*
+ * Size statistics collected in the batch mode
+ */
+typedef struct {
+    uint64_t count;                 /* number of values */
+    uint64_t total;                 /* sum of the values */
+    uint32_t min;
+    uint32_t max;
+    uint32_t hist[SIZE_HIST_LEN];   /* bucket i counts values < 2^i */
+} size_stats;
+
 /*
  * Global values
  */
@@ -105,9 +176,21 @@ FILE *b64_file = NULL;                  /* file with base64 codes to deserialize
 char conf_keep_peer_certificate = 1;    /* MBEDTLS_SSL_KEEP_PEER_CERTIFICATE from mbedTLS configuration */
 char conf_dtls_proto = 1;               /* MBEDTLS_SSL_PROTO_DTLS from mbedTLS configuration */
 char debug = 0;                         /* flag for debug messages */
+char batch = 0;                         /* flag for the batch mode with statistics only */
+uint32_t err_count = 0;                 /* number of errors reported so far */
 const char alloc_err[] = "Cannot allocate memory\n";
 const char buf_ln_err[] = "Buffer does not have enough data to complete the parsing\n";
 
+/*
+ * Statistics of the batch mode
+ */
+static size_stats blob_stats;           /* decoded size of the codes */
+static size_stats cert_stats;           /* size of the peer certificates */
+static size_stats ticket_stats;         /* size of the tickets */
+static size_stats field_stats[FIELD_COUNT];
+static uint32_t suite_counts[0x10000];
+static uint32_t blobs_failed = 0;       /* codes with at least one error */
+
 /*
  * Basic printing functions
  */
@@ -124,7 +207,11 @@ static void print_usage(void)
            "separated, e.g. by a newline.\n\n");
     printf(
         "Usage:\n"
-        "\t-f path            - Path to the file with base64 code\n"
+        "\t-f path            - Path to the file with base64 code, or - for stdin\n"
+        "\t-b                 - Batch mode: do not print the codes, only the\n"
+        "\t                     statistics (size distribution, ciphersuites,\n"
+        "\t                     size breakdown per field) of all of them. The\n"
+        "\t                     codes are read from stdin if -f is not given\n"
         "\t-v                 - Show version\n"
         "\t-h                 - Show this usage\n"
         "\t-d                 - Print more information\n"
@@ -150,10 +237,33 @@ static void printf_dbg(const char *str, ...)
     }
 }
 
+/*
+ * Print the details of a code, unless the batch mode is enabled
+ */
+MBEDTLS_PRINTF_ATTRIBUTE(1, 2)
+static void printf_out(const char *str, ...)
+{
+    if (!batch) {
+        va_list args;
+        va_start(args, str);
+        vprintf(str, args);
+        va_end(args);
+    }
+}
+
+/*
+ * Errors are counted, and only printed in the batch mode with -d
+ */
 MBEDTLS_PRINTF_ATTRIBUTE(1, 2)
 static void printf_err(const char *str, ...)
 {
     va_list args;
+
+    err_count++;
+    if (batch && !debug) {
+        return;
+    }
+
     va_start(args, str);
     fflush(stdout);
     fprintf(stderr, "ERROR: ");
@@ -167,7 +277,7 @@ static void printf_err(const char *str, ...)
  */
 static void error_exit(void)
 {
-    if (NULL != b64_file) {
+    if (NULL != b64_file && stdin != b64_file) {
         fclose(b64_file);
     }
     exit(-1);
@@ -188,6 +298,8 @@ static void parse_arguments(int argc, char *argv[])
     while (i < argc) {
         if (strcmp(argv[i], "-d") == 0) {
             debug = 1;
+        } else if (strcmp(argv[i], "-b") == 0) {
+            batch = 1;
         } else if (strcmp(argv[i], "-h") == 0) {
             print_usage();
         } else if (strcmp(argv[i], "-v") == 0) {
@@ -203,7 +315,9 @@ static void parse_arguments(int argc, char *argv[])
                 error_exit();
             }
 
-            if ((b64_file = fopen(argv[i], "r")) == NULL) {
+            if (strcmp(argv[i], "-") == 0) {
+                b64_file = stdin;
+            } else if ((b64_file = fopen(argv[i], "r")) == NULL) {
                 printf_err("Cannot find file \"%s\"\n", argv[i]);
                 error_exit();
             }
@@ -218,6 +332,132 @@ static void parse_arguments(int argc, char *argv[])
 
         i++;
     }
+
+    if (batch && NULL == b64_file) {
+        b64_file = stdin;
+    }
+}
+
+/*
+ * Account for one value in the size statistics
+ */
+static void stats_add(size_stats *st, size_t len)
+{
+    size_t bucket = 0;
+
+    if (st->count == 0 || len < st->min) {
+        st->min = (uint32_t) len;
+    }
+    if (len > st->max) {
+        st->max = (uint32_t) len;
+    }
+    st->count++;
+    st->total += len;
+
+    while (bucket < SIZE_HIST_LEN - 1 && (len >> bucket) != 0) {
+        bucket++;
+    }
+    st->hist[bucket]++;
+}
+
+/*
+ * Account for the bytes used by one field of the serialized data
+ */
+static void stats_field(int field, size_t len)
+{
+    if (batch) {
+        stats_add(&field_stats[field], len);
+    }
+}
+
+/*
+ * Print the histogram of the size statistics
+ */
+static void print_stats_hist(const size_stats *st)
+{
+    size_t i;
+
+    for (i = 0; i < SIZE_HIST_LEN; i++) {
+        if (st->hist[i] != 0) {
+            printf("\t%8lu .. %8lu : %u\n",
+                   i == 0 ? 0ul : 1ul << (i - 1), (1ul << i) - 1, st->hist[i]);
+        }
+    }
+}
+
+/*
+ * Print the summary of the size statistics
+ */
+static void print_stats_line(const size_stats *st)
+{
+    if (st->count == 0) {
+        printf("none\n");
+        return;
+    }
+
+    printf("%" PRIu64 " values, min %u, max %u, avg %" PRIu64 ", total %" PRIu64 "\n",
+           st->count, st->min, st->max, st->total / st->count, st->total);
+}
+
+/*
+ * Print all the statistics collected in the batch mode
+ */
+static void print_batch_stats(uint32_t b64_counter)
+{
+    const struct mbedtls_ssl_ciphersuite_t *ciphersuite_info;
+    uint32_t id;
+    int i;
+
+    printf("\nBatch summary:\n");
+    printf("\tcodes found      : %u\n", b64_counter);
+    printf("\twith errors      : %u\n", blobs_failed);
+    printf("\tserialized size  : ");
+    print_stats_line(&blob_stats);
+
+    if (blob_stats.count == 0) {
+        return;
+    }
+
+    printf("\nSize distribution:\n");
+    print_stats_hist(&blob_stats);
+
+    printf("\nCiphersuites:\n");
+    for (id = 0; id < 0x10000; id++) {
+        if (suite_counts[id] == 0) {
+            continue;
+        }
+        ciphersuite_info = mbedtls_ssl_ciphersuite_from_id((int) id);
+        if (ciphersuite_info == NULL) {
+            printf("\tunknown (0x%04X)", id);
+        } else {
+            printf("\t%s", mbedtls_ssl_ciphersuite_get_name(ciphersuite_info));
+        }
+        printf(" : %u\n", suite_counts[id]);
+    }
+
+    printf("\nPeer certificate size : ");
+    print_stats_line(&cert_stats);
+    print_stats_hist(&cert_stats);
+
+    printf("\nTicket size : ");
+    print_stats_line(&ticket_stats);
+    print_stats_hist(&ticket_stats);
+
+    printf("\nSize breakdown per field:\n");
+    printf("\t%-17s %10s %8s %8s %8s %6s\n",
+           "field", "count", "min", "max", "avg", "share");
+    for (i = 0; i < FIELD_COUNT; i++) {
+        const size_stats *st = &field_stats[i];
+
+        if (st->count == 0) {
+            continue;
+        }
+        printf("\t%-17s %10" PRIu64 " %8u %8u %8" PRIu64 " %5.1f%%\n",
+               field_names[i], st->count, st->min, st->max,
+               st->total / st->count,
+               100.0 * (double) st->total / (double) blob_stats.total);
+    }
+    printf("\n");
 }
 
 /*
@@ -227,6 +467,11 @@ static void print_b64(const uint8_t *b, size_t len)
 {
     size_t i = 0;
     const uint8_t *end = b + len;
+
+    if (batch) {
+        return;
+    }
+
     printf("\t");
     while (b < end) {
         if (++i > 75) {
@@ -253,6 +498,10 @@ static void print_hex(const uint8_t *b, size_t len,
     size_t i = 0;
     const uint8_t *end = b + len;
 
+    if (batch) {
+        return;
+    }
+
     if (prefix == NULL) {
         prefix = "";
     }
@@ -279,13 +528,13 @@ static void print_time(const uint64_t *time)
     static const char format[] = "%Y-%m-%d %H:%M:%S";
     if (NULL != t) {
         strftime(buf, sizeof(buf), format, t);
-        printf("%s\n", buf);
+        printf_out("%s\n", buf);
     } else {
-        printf("unknown\n");
+        printf_out("unknown\n");
     }
 #else
     (void) time;
-    printf("not supported\n");
+    printf_out("not supported\n");
 #endif
 }
 
@@ -295,7 +544,7 @@ static void print_time(const uint64_t *time)
 static void print_if_bit(const char *str, int bit, int val)
 {
     if (bit & val) {
-        printf("\t%s\n", str);
+        printf_out("\t%s\n", str);
     }
 }
 
@@ -450,14 +699,18 @@ static void print_deserialized_ssl_cert(const uint8_t *ssl, uint32_t len)
     int ret;
     char str[STRLEN];
 
-    printf("\nCertificate:\n");
+    if (batch) {
+        return;
+    }
+
+    printf_out("\nCertificate:\n");
 
     mbedtls_x509_crt_init(&crt);
     ret = mbedtls_x509_crt_parse_der(&crt, ssl, len);
     if (0 != ret) {
         mbedtls_strerror(ret, str, STRLEN);
         printf_err("Invalid format of X.509 - %s\n", str);
-        printf("Cannot deserialize:\n\t");
+        printf_out("Cannot deserialize:\n\t");
         print_hex(ssl, len, 25, "\t");
     } else {
         mbedtls_x509_crt *current = &crt;
@@ -468,13 +721,13 @@ static void print_deserialized_ssl_cert(const uint8_t *ssl, uint32_t len)
                 mbedtls_strerror(ret, str, STRLEN);
                 printf_err("Cannot write to the output - %s\n", str);
             } else {
-                printf("%s", str);
+                printf_out("%s", str);
             }
 
             current = current->next;
 
             if (current) {
-                printf("\n");
+                printf_out("\n");
             }
 
         }
@@ -518,7 +771,7 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
     uint32_t verify_result, ticket_lifetime;
     const uint8_t *end = ssl + len;
 
-    printf("\nSession info:\n");
+    printf_out("\nSession info:\n");
 
     if (session_cfg_flag & SESSION_CONFIG_TIME_BIT) {
         uint64_t start;
@@ -532,7 +785,8 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
                 ((uint64_t) ssl[6] <<  8) |
                 ((uint64_t) ssl[7]);
         ssl += 8;
-        printf("\tstart time     : ");
+        stats_field(FIELD_START_TIME, 8);
+        printf_out("\tstart time     : ");
         print_time(&start);
     }
 
@@ -540,6 +794,8 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
     ciphersuite_id = ((int) ssl[0] << 8) | (int) ssl[1];
     printf_dbg("Ciphersuite ID: %d\n", ciphersuite_id);
     ssl += 2;
+    stats_field(FIELD_CIPHERSUITE, 2);
+    suite_counts[ciphersuite_id]++;
 
     ciphersuite_info = mbedtls_ssl_ciphersuite_from_id(ciphersuite_id);
     if (ciphersuite_info == NULL) {
@@ -549,8 +805,8 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
         const mbedtls_md_info_t *md_info;
 #endif
 
-        printf("\tciphersuite    : %s\n", mbedtls_ssl_ciphersuite_get_name(ciphersuite_info));
-        printf("\tcipher flags   : 0x%02X\n", ciphersuite_info->MBEDTLS_PRIVATE(flags));
+        printf_out("\tciphersuite    : %s\n", mbedtls_ssl_ciphersuite_get_name(ciphersuite_info));
+        printf_out("\tcipher flags   : 0x%02X\n", ciphersuite_info->MBEDTLS_PRIVATE(flags));
 
 #if defined(MBEDTLS_CIPHER_C)
         const mbedtls_cipher_info_t *cipher_info;
@@ -558,10 +814,10 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
         if (cipher_info == NULL) {
             printf_err("Cannot find cipher info\n");
         } else {
-            printf("\tcipher         : %s\n", mbedtls_cipher_info_get_name(cipher_info));
+            printf_out("\tcipher         : %s\n", mbedtls_cipher_info_get_name(cipher_info));
         }
 #else /* MBEDTLS_CIPHER_C */
-        printf("\tcipher type     : %d\n", ciphersuite_info->MBEDTLS_PRIVATE(cipher));
+        printf_out("\tcipher type     : %d\n", ciphersuite_info->MBEDTLS_PRIVATE(cipher));
 #endif /* MBEDTLS_CIPHER_C */
 
 #if defined(MBEDTLS_MD_C)
@@ -569,27 +825,30 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
         if (md_info == NULL) {
             printf_err("Cannot find Message-Digest info\n");
         } else {
-            printf("\tMessage-Digest : %s\n", mbedtls_md_get_name(md_info));
+            printf_out("\tMessage-Digest : %s\n", mbedtls_md_get_name(md_info));
         }
 #endif /* MBEDTLS_MD_C */
     }
 
     CHECK_SSL_END(1);
-    printf("\tcompression    : %s\n", get_enabled_str(*ssl++));
+    printf_out("\tcompression    : %s\n", get_enabled_str(*ssl++));
+    stats_field(FIELD_COMPRESSION, 1);
 
     /* Note - Here we can get session ID length from serialized data, but we
      * use hardcoded 32-bytes length. This approach was taken from
      * 'mbedtls_ssl_session_load()'. */
     CHECK_SSL_END(1 + 32);
     printf_dbg("Session id length: %u\n", (uint32_t) *ssl++);
-    printf("\tsession ID     : ");
+    printf_out("\tsession ID     : ");
     print_hex(ssl, 32, 16, "\t                 ");
     ssl += 32;
+    stats_field(FIELD_SESSION_ID, 1 + 32);
 
-    printf("\tmaster secret  : ");
+    printf_out("\tmaster secret  : ");
     CHECK_SSL_END(48);
     print_hex(ssl, 48, 16, "\t                 ");
     ssl += 48;
+    stats_field(FIELD_MASTER, 48);
 
     CHECK_SSL_END(4);
     verify_result = ((uint32_t) ssl[0] << 24) |
@@ -597,7 +856,8 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
                     ((uint32_t) ssl[2] <<  8) |
                     ((uint32_t) ssl[3]);
     ssl += 4;
-    printf("\tverify result  : 0x%08X\n", verify_result);
+    stats_field(FIELD_VERIFY_RESULT, 4);
+    printf_out("\tverify result  : 0x%08X\n", verify_result);
 
     if (SESSION_CONFIG_CRT_BIT & session_cfg_flag) {
         if (conf_keep_peer_certificate) {
@@ -614,38 +874,42 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
                 print_deserialized_ssl_cert(ssl, cert_len);
 #endif
                 ssl += cert_len;
+                if (batch) {
+                    stats_add(&cert_stats, cert_len);
+                }
             }
+            stats_field(FIELD_PEER_CERT, 3 + cert_len);
         } else {
-            printf("\tPeer digest    : ");
+            printf_out("\tPeer digest    : ");
 
             CHECK_SSL_END(1);
             switch ((mbedtls_md_type_t) *ssl++) {
                 case MBEDTLS_MD_NONE:
-                    printf("none\n");
+                    printf_out("none\n");
                     break;
                 case MBEDTLS_MD_MD5:
-                    printf("MD5\n");
+                    printf_out("MD5\n");
                     break;
                 case MBEDTLS_MD_SHA1:
-                    printf("SHA1\n");
+                    printf_out("SHA1\n");
                     break;
                 case MBEDTLS_MD_SHA224:
-                    printf("SHA224\n");
+                    printf_out("SHA224\n");
                     break;
                 case MBEDTLS_MD_SHA256:
-                    printf("SHA256\n");
+                    printf_out("SHA256\n");
                     break;
                 case MBEDTLS_MD_SHA384:
-                    printf("SHA384\n");
+                    printf_out("SHA384\n");
                     break;
                 case MBEDTLS_MD_SHA512:
-                    printf("SHA512\n");
+                    printf_out("SHA512\n");
                     break;
                 case MBEDTLS_MD_RIPEMD160:
-                    printf("RIPEMD160\n");
+                    printf_out("RIPEMD160\n");
                     break;
                 default:
-                    printf("undefined or erroneous\n");
+                    printf_out("undefined or erroneous\n");
                     break;
             }
 
@@ -654,16 +918,17 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
             printf_dbg("Message-Digest length: %u\n", cert_len);
 
             if (cert_len > 0) {
-                printf("\tPeer digest cert : ");
+                printf_out("\tPeer digest cert : ");
                 CHECK_SSL_END(cert_len);
                 print_hex(ssl, cert_len, 16, "\t                   ");
                 ssl += cert_len;
             }
+            stats_field(FIELD_PEER_CERT_DIGEST, 1 + 1 + cert_len);
         }
     }
 
     if (SESSION_CONFIG_CLIENT_TICKET_BIT & session_cfg_flag) {
-        printf("\nTicket:\n");
+        printf_out("\nTicket:\n");
 
         CHECK_SSL_END(3);
         ticket_len = ((uint32_t) ssl[0] << 16) |
@@ -673,12 +938,16 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
         printf_dbg("Ticket length: %u\n", ticket_len);
 
         if (ticket_len > 0) {
-            printf("\t");
+            printf_out("\t");
             CHECK_SSL_END(ticket_len);
             print_hex(ssl, ticket_len, 22, "\t");
             ssl += ticket_len;
-            printf("\n");
+            printf_out("\n");
+            if (batch) {
+                stats_add(&ticket_stats, ticket_len);
+            }
         }
+        stats_field(FIELD_TICKET, 3 + ticket_len);
 
         CHECK_SSL_END(4);
         ticket_lifetime = ((uint32_t) ssl[0] << 24) |
@@ -686,30 +955,35 @@ static void print_deserialized_ssl_session(const uint8_t *ssl, uint32_t len,
                           ((uint32_t) ssl[2] <<  8) |
                           ((uint32_t) ssl[3]);
         ssl += 4;
-        printf("\tlifetime : %u sec.\n", ticket_lifetime);
+        stats_field(FIELD_TICKET_LIFETIME, 4);
+        printf_out("\tlifetime : %u sec.\n", ticket_lifetime);
     }
 
     if (ssl < end) {
-        printf("\nSession others:\n");
+        printf_out("\nSession others:\n");
     }
 
     if (SESSION_CONFIG_MFL_BIT & session_cfg_flag) {
         CHECK_SSL_END(1);
-        printf("\tMFL                      : %s\n", get_mfl_str(*ssl++));
+        printf_out("\tMFL                      : %s\n", get_mfl_str(*ssl++));
+        stats_field(FIELD_SESSION_FLAGS, 1);
     }
 
     if (SESSION_CONFIG_TRUNC_HMAC_BIT & session_cfg_flag) {
         CHECK_SSL_END(1);
-        printf("\tnegotiate truncated HMAC : %s\n", get_enabled_str(*ssl++));
+        printf_out("\tnegotiate truncated HMAC : %s\n", get_enabled_str(*ssl++));
+        stats_field(FIELD_SESSION_FLAGS, 1);
     }
 
     if (SESSION_CONFIG_ETM_BIT & session_cfg_flag) {
         CHECK_SSL_END(1);
-        printf("\tEncrypt-then-MAC         : %s\n", get_enabled_str(*ssl++));
+        printf_out("\tEncrypt-then-MAC         : %s\n", get_enabled_str(*ssl++));
+        stats_field(FIELD_SESSION_FLAGS, 1);
     }
 
     if (0 != (end - ssl)) {
         printf_err("%i bytes left to analyze from session\n", (int32_t) (end - ssl));
+        stats_field(FIELD_UNPARSED, (size_t) (end - ssl));
     }
 }
 
@@ -753,15 +1027,15 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
     int session_cfg_flag;
     int context_cfg_flag;
 
-    printf("\nMbed TLS version:\n");
+    printf_out("\nMbed TLS version:\n");
 
     CHECK_SSL_END(3 + 2 + 3);
 
-    printf("\tmajor    %u\n", (uint32_t) *ssl++);
-    printf("\tminor    %u\n", (uint32_t) *ssl++);
-    printf("\tpath     %u\n", (uint32_t) *ssl++);
+    printf_out("\tmajor    %u\n", (uint32_t) *ssl++);
+    printf_out("\tminor    %u\n", (uint32_t) *ssl++);
+    printf_out("\tpath     %u\n", (uint32_t) *ssl++);
 
-    printf("\nEnabled session and context configuration:\n");
+    printf_out("\nEnabled session and context configuration:\n");
 
     session_cfg_flag = ((int) ssl[0] << 8) | ((int) ssl[1]);
     ssl += 2;
@@ -773,6 +1047,7 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
 
     printf_dbg("Session config flags 0x%04X\n", session_cfg_flag);
     printf_dbg("Context config flags 0x%06X\n", context_cfg_flag);
+    stats_field(FIELD_HEADER, 3 + 2 + 3);
 
     print_if_bit("MBEDTLS_HAVE_TIME", SESSION_CONFIG_TIME_BIT, session_cfg_flag);
     print_if_bit("MBEDTLS_X509_CRT_PARSE_C", SESSION_CONFIG_CRT_BIT, session_cfg_flag);
@@ -798,18 +1073,20 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
                   ((uint32_t) ssl[3]);
     ssl += 4;
     printf_dbg("Session length %u\n", session_len);
+    stats_field(FIELD_SESSION_LEN, 4);
 
     CHECK_SSL_END(session_len);
     print_deserialized_ssl_session(ssl, session_len, session_cfg_flag);
     ssl += session_len;
 
-    printf("\nRandom bytes:\n\t");
+    printf_out("\nRandom bytes:\n\t");
 
     CHECK_SSL_END(TRANSFORM_RANDBYTE_LEN);
     print_hex(ssl, TRANSFORM_RANDBYTE_LEN, 22, "\t");
     ssl += TRANSFORM_RANDBYTE_LEN;
+    stats_field(FIELD_RANDOM, TRANSFORM_RANDBYTE_LEN);
 
-    printf("\nContext others:\n");
+    printf_out("\nContext others:\n");
 
     if (CONTEXT_CONFIG_DTLS_CONNECTION_ID_BIT & context_cfg_flag) {
         uint8_t cid_len;
@@ -817,27 +1094,29 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
         CHECK_SSL_END(1);
         cid_len = *ssl++;
         printf_dbg("In CID length %u\n", (uint32_t) cid_len);
+        stats_field(FIELD_CID, 1 + (size_t) cid_len);
 
-        printf("\tin CID                             : ");
+        printf_out("\tin CID                             : ");
         if (cid_len > 0) {
             CHECK_SSL_END(cid_len);
             print_hex(ssl, cid_len, 20, "\t");
             ssl += cid_len;
         } else {
-            printf("none\n");
+            printf_out("none\n");
         }
 
         CHECK_SSL_END(1);
         cid_len = *ssl++;
         printf_dbg("Out CID length %u\n", (uint32_t) cid_len);
+        stats_field(FIELD_CID, 1 + (size_t) cid_len);
 
-        printf("\tout CID                            : ");
+        printf_out("\tout CID                            : ");
         if (cid_len > 0) {
             CHECK_SSL_END(cid_len);
             print_hex(ssl, cid_len, 20, "\t");
             ssl += cid_len;
         } else {
-            printf("none\n");
+            printf_out("none\n");
         }
     }
 
@@ -850,39 +1129,43 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
                       ((uint32_t) ssl[2] <<  8) |
                       ((uint32_t) ssl[3]);
         ssl += 4;
-        printf("\tbad MAC seen number                : %u\n", badmac_seen);
+        printf_out("\tbad MAC seen number                : %u\n", badmac_seen);
 
         /* value 'in_window_top' from mbedtls_ssl_context */
-        printf("\tlast validated record sequence no. : ");
+        printf_out("\tlast validated record sequence no. : ");
         CHECK_SSL_END(8);
         print_hex(ssl, 8, 20, "");
         ssl += 8;
 
         /* value 'in_window' from mbedtls_ssl_context */
-        printf("\tbitmask for replay detection       : ");
+        printf_out("\tbitmask for replay detection       : ");
         CHECK_SSL_END(8);
         print_hex(ssl, 8, 20, "");
         ssl += 8;
+        stats_field(FIELD_REPLAY, 4 + 8 + 8);
     }
 
     if (conf_dtls_proto) {
         CHECK_SSL_END(1);
-        printf("\tDTLS datagram packing              : %s\n",
+        printf_out("\tDTLS datagram packing              : %s\n",
                get_enabled_str(!(*ssl++)));
+        stats_field(FIELD_DATAGRAM_PACKING, 1);
     }
 
     /* value 'cur_out_ctr' from mbedtls_ssl_context */
-    printf("\toutgoing record sequence no.       : ");
+    printf_out("\toutgoing record sequence no.       : ");
     CHECK_SSL_END(8);
     print_hex(ssl, 8, 20, "");
     ssl += 8;
+    stats_field(FIELD_OUT_CTR, 8);
 
     if (conf_dtls_proto) {
         uint16_t mtu;
         CHECK_SSL_END(2);
         mtu = (ssl[0] << 8) | ssl[1];
         ssl += 2;
-        printf("\tMTU                                : %u\n", mtu);
+        stats_field(FIELD_MTU, 2);
+        printf_out("\tMTU                                : %u\n", mtu);
     }
 
 
@@ -893,25 +1176,27 @@ static void print_deserialized_ssl_context(const uint8_t *ssl, size_t len)
         alpn_len = *ssl++;
         printf_dbg("ALPN length %u\n", (uint32_t) alpn_len);
 
-        printf("\tALPN negotiation                   : ");
+        printf_out("\tALPN negotiation                   : ");
         CHECK_SSL_END(alpn_len);
+        stats_field(FIELD_ALPN, 1 + (size_t) alpn_len);
         if (alpn_len > 0) {
             if (strlen((const char *) ssl) == alpn_len) {
-                printf("%s\n", ssl);
+                printf_out("%s\n", ssl);
             } else {
-                printf("\n");
+                printf_out("\n");
                 printf_err("\tALPN negotiation is incorrect\n");
             }
             ssl += alpn_len;
         } else {
-            printf("not selected\n");
+            printf_out("not selected\n");
         }
     }
 
     if (0 != (end - ssl)) {
         printf_err("%i bytes left to analyze from context\n", (int32_t) (end - ssl));
+        stats_field(FIELD_UNPARSED, (size_t) (end - ssl));
     }
-    printf("\n");
+    printf_out("\n");
 }
 
 int main(int argc, char *argv[])
@@ -924,6 +1209,7 @@ int main(int argc, char *argv[])
     size_t b64_max_len = SSL_INIT_LEN;
     size_t ssl_max_len = SSL_INIT_LEN;
     size_t ssl_len = 0;
+    uint32_t blob_errors = 0;
 
     psa_status_t status = psa_crypto_init();
     if (status != PSA_SUCCESS) {
@@ -966,25 +1252,35 @@ int main(int argc, char *argv[])
                 ssl_max_len = ssl_required_len;
             }
 
-            printf("\nDeserializing number %u:\n",  ++b64_counter);
+            blob_errors = err_count;
+            printf_out("\nDeserializing number %u:\n",  ++b64_counter);
 
-            printf("\nBase64 code:\n");
+            printf_out("\nBase64 code:\n");
             print_b64(b64_buf, b64_len);
 
             ret = mbedtls_base64_decode(ssl_buf, ssl_max_len, &ssl_len, b64_buf, b64_len);
             if (ret != 0) {
                 mbedtls_strerror(ret, (char *) b64_buf, b64_max_len);
                 printf_err("base64 code cannot be decoded - %s\n", b64_buf);
+                blobs_failed++;
                 continue;
             }
 
+            if (batch) {
+                stats_add(&blob_stats, ssl_len);
+            }
+
             if (debug) {
-                printf("\nDecoded data in hex:\n\t");
+                printf_out("\nDecoded data in hex:\n\t");
                 print_hex(ssl_buf, ssl_len, 25, "\t");
             }
 
             print_deserialized_ssl_context(ssl_buf, ssl_len);
 
+            if (err_count != blob_errors) {
+                blobs_failed++;
+            }
+
         } else {
             fclose(b64_file);
             b64_file = NULL;
@@ -994,6 +1290,10 @@ int main(int argc, char *argv[])
     free(b64_buf);
     free(ssl_buf);
 
+    if (batch && b64_counter > 0) {
+        print_batch_stats(b64_counter);
+    }
+
     if (b64_counter > 0) {
         printf_dbg("Finished. Found %u base64 codes\n", b64_counter);
     } else {
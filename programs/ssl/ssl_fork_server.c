@@ -37,6 +37,15 @@ int main(void)
 #include "mbedtls/net_sockets.h"
 #include "mbedtls/timing.h"
 
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+#include "mbedtls/ssl_cache_shm.h"
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_SHM_C) && defined(MBEDTLS_SSL_TICKET_C)
+#include "mbedtls/ssl_ticket.h"
+#define TICKET_LIFETIME 86400
+#endif
+
 #include <string.h>
 #include <signal.h>
 
@@ -76,6 +85,12 @@ int main(void)
     mbedtls_ssl_config conf;
     mbedtls_x509_crt srvcert;
     mbedtls_pk_context pkey;
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+    mbedtls_ssl_cache_shm_context cache;
+#endif
+#if defined(TICKET_LIFETIME)
+    mbedtls_ssl_ticket_context ticket_ctx;
+#endif
 
     mbedtls_net_init(&listen_fd);
     mbedtls_net_init(&client_fd);
@@ -85,6 +100,12 @@ int main(void)
     mbedtls_pk_init(&pkey);
     mbedtls_x509_crt_init(&srvcert);
     mbedtls_ctr_drbg_init(&ctr_drbg);
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+    mbedtls_ssl_cache_shm_init(&cache);
+#endif
+#if defined(TICKET_LIFETIME)
+    mbedtls_ssl_ticket_init(&ticket_ctx);
+#endif
 
     psa_status_t status = psa_crypto_init();
     if (status != PSA_SUCCESS) {
@@ -168,6 +189,36 @@ int main(void)
         goto exit;
     }
 
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+    /*
+     * The cache lives in memory shared with the children, so a client can
+     * resume a session established with another one.
+     */
+    if ((ret = mbedtls_ssl_cache_shm_setup(&cache, 0, 0)) != 0) {
+        mbedtls_printf(" failed!  mbedtls_ssl_cache_shm_setup returned %d\n\n", ret);
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_session_cache(&conf, &cache,
+                                   mbedtls_ssl_cache_shm_get,
+                                   mbedtls_ssl_cache_shm_set);
+#endif
+
+#if defined(TICKET_LIFETIME)
+    if ((ret = mbedtls_ssl_ticket_setup(&ticket_ctx,
+                                        mbedtls_ctr_drbg_random, &ctr_drbg,
+                                        MBEDTLS_CIPHER_AES_256_GCM,
+                                        TICKET_LIFETIME)) != 0) {
+        mbedtls_printf(" failed!  mbedtls_ssl_ticket_setup returned %d\n\n", ret);
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_session_tickets_cb(&conf,
+                                        mbedtls_ssl_ticket_write,
+                                        mbedtls_ssl_ticket_parse,
+                                        &ticket_ctx);
+#endif
+
     mbedtls_printf(" ok\n");
 
     /*
@@ -247,6 +298,19 @@ int main(void)
             goto exit;
         }
 
+#if defined(TICKET_LIFETIME)
+        /* Issue tickets with the key shared by all the children */
+        if ((ret = mbedtls_ssl_cache_shm_ticket_sync(&cache, &ticket_ctx,
+                                                     mbedtls_ctr_drbg_random,
+                                                     &ctr_drbg,
+                                                     TICKET_LIFETIME)) != 0) {
+            mbedtls_printf(
+                "pid %d: SSL setup failed!  mbedtls_ssl_cache_shm_ticket_sync returned %d\n\n",
+                pid, ret);
+            goto exit;
+        }
+#endif
+
         if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0) {
             mbedtls_printf(
                 "pid %d: SSL setup failed!  mbedtls_ssl_setup returned %d\n\n",
@@ -364,6 +428,12 @@ exit:
     mbedtls_pk_free(&pkey);
     mbedtls_ssl_free(&ssl);
     mbedtls_ssl_config_free(&conf);
+#if defined(TICKET_LIFETIME)
+    mbedtls_ssl_ticket_free(&ticket_ctx);
+#endif
+#if defined(MBEDTLS_SSL_CACHE_SHM_C)
+    mbedtls_ssl_cache_shm_free(&cache);
+#endif
     mbedtls_ctr_drbg_free(&ctr_drbg);
     mbedtls_entropy_free(&entropy);
     mbedtls_psa_crypto_free();
@@ -0,0 +1,514 @@
+/*
+ *  Benchmark for TLS handshakes
+ *
+ *  Runs a client and a server in the same process, connected through the
+ *  in-memory sockets of the test framework, and measures the handshake
+ *  rate and latency for full, resumed and PSK handshakes.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_SRV_C) || \
+    !defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED) || \
+    !defined(MBEDTLS_HAVE_TIME)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_CLI_C and/or MBEDTLS_SSL_SRV_C and/or "
+                   "MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED and/or "
+                   "MBEDTLS_HAVE_TIME not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+#include "psa/crypto.h"
+
+#include <test/ssl_helpers.h>
+
+#define DFL_ITERATIONS          100
+#define SOCKET_BUF_SIZE         (32 * 1024)
+
+#define USAGE \
+    "\n usage: ssl_handshake_bench param=<>...\n"                       \
+    "\n acceptable parameters:\n"                                       \
+    "    iterations=%%d      handshakes per measurement\n"              \
+    "                        default: %d\n"                             \
+    "    version=%%s         tls12, tls13 or all\n"                     \
+    "                        default: all\n"                            \
+    "    mode=%%s            full, cache, ticket, psk or all\n"         \
+    "                        default: all\n"                            \
+    "\n"
+
+enum {
+    MODE_FULL,
+    MODE_CACHE,
+    MODE_TICKET,
+    MODE_PSK,
+    MODE_COUNT
+};
+
+static const char * const mode_names[MODE_COUNT] = {
+    "full", "cache", "ticket", "psk"
+};
+
+typedef struct {
+    const char *name;
+    uint16_t group;
+} hs_bench_group;
+
+static const hs_bench_group groups[] = {
+    { "secp256r1", MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1 },
+    { "secp384r1", MBEDTLS_SSL_IANA_TLS_GROUP_SECP384R1 },
+    { "x25519", MBEDTLS_SSL_IANA_TLS_GROUP_X25519 },
+    { "ffdhe2048", MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE2048 },
+};
+
+typedef struct {
+    const char *name;
+    int pk_alg;
+} hs_bench_sig;
+
+static const hs_bench_sig sigs[] = {
+    { "ecdsa", MBEDTLS_PK_ECDSA },
+    { "rsa", MBEDTLS_PK_RSA },
+};
+
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_PSK_ENABLED)
+static const unsigned char bench_psk[32] = {
+    0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08,
+    0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10,
+    0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18,
+    0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20
+};
+static const unsigned char bench_psk_identity[] = "ssl_handshake_bench";
+#endif
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
+    defined(MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED)
+static const int tls12_psk_ciphersuites[] = {
+    MBEDTLS_TLS_ECDHE_PSK_WITH_AES_128_CBC_SHA256,
+    0
+};
+#endif
+
+static unsigned long long bench_usec(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long) now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * Reset both endpoints and their sockets so that a new handshake can run
+ * on the existing contexts. If a session is given, the client tries to
+ * resume it.
+ */
+static int hs_reset(mbedtls_test_ssl_endpoint *client,
+                    mbedtls_test_ssl_endpoint *server,
+                    const mbedtls_ssl_session *session)
+{
+    int ret;
+
+    mbedtls_test_mock_socket_close(&client->socket);
+    mbedtls_test_mock_socket_close(&server->socket);
+
+    if ((ret = mbedtls_ssl_session_reset(&client->ssl)) != 0 ||
+        (ret = mbedtls_ssl_session_reset(&server->ssl)) != 0) {
+        return ret;
+    }
+
+    if (session != NULL &&
+        (ret = mbedtls_ssl_set_session(&client->ssl, session)) != 0) {
+        return ret;
+    }
+
+    return mbedtls_test_mock_socket_connect(&client->socket, &server->socket,
+                                            SOCKET_BUF_SIZE);
+}
+
+static int hs_run(mbedtls_test_ssl_endpoint *client,
+                  mbedtls_test_ssl_endpoint *server)
+{
+    int ret;
+
+    ret = mbedtls_test_move_handshake_to_state(&client->ssl, &server->ssl,
+                                               MBEDTLS_SSL_HANDSHAKE_OVER);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return mbedtls_test_move_handshake_to_state(&server->ssl, &client->ssl,
+                                                MBEDTLS_SSL_HANDSHAKE_OVER);
+}
+
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+/*
+ * TLS 1.3 tickets are sent after the handshake: let the client read
+ * until it has received one.
+ */
+static int hs_receive_tls13_ticket(mbedtls_test_ssl_endpoint *client)
+{
+    unsigned char buf[16];
+    int ret;
+
+    for (int i = 0; i < 100; i++) {
+        ret = mbedtls_ssl_read(&client->ssl, buf, sizeof(buf));
+        if (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+            return 0;
+        }
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
+            ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            return ret;
+        }
+    }
+
+    return -1;
+}
+#endif
+
+/*
+ * Set up a client and a server for the given mode, then time
+ * `iterations` handshakes. Returns 0 and fills the results on success,
+ * MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE if the combination cannot be run
+ * with this configuration, or another error code.
+ */
+static int hs_bench(mbedtls_ssl_protocol_version version, int mode,
+                    int pk_alg, uint16_t group, int iterations,
+                    unsigned long long *latencies,
+                    unsigned long long *total_us)
+{
+    int ret;
+    mbedtls_test_handshake_test_options options;
+    mbedtls_test_ssl_endpoint client, server;
+    mbedtls_ssl_session session;
+    const mbedtls_ssl_session *resume = NULL;
+    uint16_t group_list[2] = { group, MBEDTLS_SSL_IANA_TLS_GROUP_NONE };
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_context ticket_ctx;
+
+    mbedtls_ssl_ticket_init(&ticket_ctx);
+#endif
+
+    mbedtls_platform_zeroize(&client, sizeof(client));
+    mbedtls_platform_zeroize(&server, sizeof(server));
+    mbedtls_ssl_session_init(&session);
+    mbedtls_test_init_handshake_options(&options);
+
+    options.pk_alg = pk_alg;
+    options.group_list = group_list;
+    options.client_min_version = version;
+    options.client_max_version = version;
+    options.server_min_version = version;
+    options.server_max_version = version;
+
+    ret = mbedtls_test_ssl_endpoint_init(&client, MBEDTLS_SSL_IS_CLIENT,
+                                         &options, NULL, NULL, NULL);
+    if (ret != 0) {
+        goto exit;
+    }
+    ret = mbedtls_test_ssl_endpoint_init(&server, MBEDTLS_SSL_IS_SERVER,
+                                         &options, NULL, NULL, NULL);
+    if (ret != 0) {
+        goto exit;
+    }
+
+    ret = MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE;
+    switch (mode) {
+        case MODE_FULL:
+            break;
+
+        case MODE_CACHE:
+#if defined(MBEDTLS_SSL_CACHE_C)
+            if (version != MBEDTLS_SSL_VERSION_TLS1_2) {
+                goto exit;
+            }
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+            mbedtls_ssl_conf_session_tickets(&client.conf,
+                                             MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif
+            break;
+#else
+            goto exit;
+#endif
+
+        case MODE_TICKET:
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+#if defined(MBEDTLS_SSL_TICKET_C)
+            ret = mbedtls_ssl_ticket_setup(&ticket_ctx, mbedtls_test_random,
+                                           NULL, MBEDTLS_CIPHER_AES_256_GCM,
+                                           86400);
+            if (ret != 0) {
+                goto exit;
+            }
+            mbedtls_ssl_conf_session_tickets_cb(&server.conf,
+                                                mbedtls_ssl_ticket_write,
+                                                mbedtls_ssl_ticket_parse,
+                                                &ticket_ctx);
+#else
+            mbedtls_ssl_conf_session_tickets_cb(&server.conf,
+                                                mbedtls_test_ticket_write,
+                                                mbedtls_test_ticket_parse,
+                                                NULL);
+#endif
+            break;
+#else
+            goto exit;
+#endif
+
+        case MODE_PSK:
+#if defined(MBEDTLS_SSL_HANDSHAKE_WITH_PSK_ENABLED)
+            if (version == MBEDTLS_SSL_VERSION_TLS1_2) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2) && \
+                defined(MBEDTLS_KEY_EXCHANGE_ECDHE_PSK_ENABLED)
+                mbedtls_ssl_conf_ciphersuites(&client.conf,
+                                              tls12_psk_ciphersuites);
+#else
+                goto exit;
+#endif
+            }
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+            if (version == MBEDTLS_SSL_VERSION_TLS1_3) {
+                mbedtls_ssl_conf_tls13_key_exchange_modes(
+                    &client.conf, MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_PSK_ALL);
+            }
+#endif
+            if ((ret = mbedtls_ssl_conf_psk(&client.conf,
+                                            bench_psk, sizeof(bench_psk),
+                                            bench_psk_identity,
+                                            sizeof(bench_psk_identity) - 1)) != 0 ||
+                (ret = mbedtls_ssl_conf_psk(&server.conf,
+                                            bench_psk, sizeof(bench_psk),
+                                            bench_psk_identity,
+                                            sizeof(bench_psk_identity) - 1)) != 0) {
+                goto exit;
+            }
+            break;
+#else
+            goto exit;
+#endif
+
+        default:
+            goto exit;
+    }
+
+    /* Untimed first handshake, which also yields the session to resume. */
+    if ((ret = hs_reset(&client, &server, NULL)) != 0 ||
+        (ret = hs_run(&client, &server)) != 0) {
+        goto exit;
+    }
+
+    if (mode == MODE_CACHE || mode == MODE_TICKET) {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3) && defined(MBEDTLS_SSL_SESSION_TICKETS)
+        if (version == MBEDTLS_SSL_VERSION_TLS1_3 &&
+            (ret = hs_receive_tls13_ticket(&client)) != 0) {
+            goto exit;
+        }
+#endif
+        if ((ret = mbedtls_ssl_get_session(&client.ssl, &session)) != 0) {
+            goto exit;
+        }
+        resume = &session;
+    }
+
+    *total_us = 0;
+    for (int i = 0; i < iterations; i++) {
+        unsigned long long start;
+
+        if ((ret = hs_reset(&client, &server, resume)) != 0) {
+            goto exit;
+        }
+
+        start = bench_usec();
+        ret = hs_run(&client, &server);
+        latencies[i] = bench_usec() - start;
+        if (ret != 0) {
+            goto exit;
+        }
+        *total_us += latencies[i];
+    }
+
+    ret = 0;
+
+exit:
+    mbedtls_test_ssl_endpoint_free(&client, NULL);
+    mbedtls_test_ssl_endpoint_free(&server, NULL);
+    mbedtls_ssl_session_free(&session);
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&ticket_ctx);
+#endif
+    mbedtls_test_free_handshake_options(&options);
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int iterations = DFL_ITERATIONS;
+    int want_tls12 = 1, want_tls13 = 1;
+    int want_mode = -1;
+    unsigned long long *latencies = NULL;
+    char *p, *q;
+
+    for (int i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "iterations") == 0) {
+            iterations = atoi(q);
+            if (iterations <= 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "version") == 0) {
+            if (strcmp(q, "tls12") == 0) {
+                want_tls13 = 0;
+            } else if (strcmp(q, "tls13") == 0) {
+                want_tls12 = 0;
+            } else if (strcmp(q, "all") != 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "mode") == 0) {
+            if (strcmp(q, "all") != 0) {
+                for (want_mode = 0; want_mode < MODE_COUNT; want_mode++) {
+                    if (strcmp(q, mode_names[want_mode]) == 0) {
+                        break;
+                    }
+                }
+                if (want_mode == MODE_COUNT) {
+                    goto usage;
+                }
+            }
+        } else {
+            goto usage;
+        }
+    }
+
+    ret = psa_crypto_init();
+    if (ret != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto: %d\n", ret);
+        goto exit;
+    }
+
+    latencies = mbedtls_calloc((size_t) iterations, sizeof(*latencies));
+    if (latencies == NULL) {
+        mbedtls_fprintf(stderr, "Failed to allocate latency samples\n");
+        goto exit;
+    }
+
+    mbedtls_printf("\n  %-7s %-7s %-6s %-10s %10s %10s %10s\n",
+                   "version", "mode", "sig", "group",
+                   "hs/s", "p50 (us)", "p99 (us)");
+
+    for (int v = 0; v < 2; v++) {
+        mbedtls_ssl_protocol_version version =
+            v == 0 ? MBEDTLS_SSL_VERSION_TLS1_2 : MBEDTLS_SSL_VERSION_TLS1_3;
+
+        if ((version == MBEDTLS_SSL_VERSION_TLS1_2 && !want_tls12) ||
+            (version == MBEDTLS_SSL_VERSION_TLS1_3 && !want_tls13)) {
+            continue;
+        }
+#if !defined(MBEDTLS_SSL_PROTO_TLS1_2)
+        if (version == MBEDTLS_SSL_VERSION_TLS1_2) {
+            continue;
+        }
+#endif
+#if !defined(MBEDTLS_SSL_PROTO_TLS1_3)
+        if (version == MBEDTLS_SSL_VERSION_TLS1_3) {
+            continue;
+        }
+#endif
+
+        for (int mode = 0; mode < MODE_COUNT; mode++) {
+            if (want_mode >= 0 && mode != want_mode) {
+                continue;
+            }
+
+            for (size_t s = 0; s < sizeof(sigs) / sizeof(sigs[0]); s++) {
+                for (size_t g = 0; g < sizeof(groups) / sizeof(groups[0]);
+                     g++) {
+                    unsigned long long total_us = 0;
+
+                    mbedtls_printf("  %-7s %-7s %-6s %-10s ",
+                                   v == 0 ? "1.2" : "1.3", mode_names[mode],
+                                   sigs[s].name, groups[g].name);
+                    fflush(stdout);
+
+                    ret = hs_bench(version, mode, sigs[s].pk_alg,
+                                   groups[g].group, iterations,
+                                   latencies, &total_us);
+                    if (ret == MBEDTLS_ERR_SSL_FEATURE_UNAVAILABLE) {
+                        mbedtls_printf("%10s\n", "n/a");
+                        continue;
+                    }
+                    if (ret != 0) {
+                        mbedtls_printf("failed: -0x%04x\n",
+                                       (unsigned int) -ret);
+                        continue;
+                    }
+
+                    qsort(latencies, (size_t) iterations, sizeof(*latencies),
+                          cmp_ull);
+                    mbedtls_printf("%10.1f %10llu %10llu\n",
+                                   total_us != 0 ?
+                                   (double) iterations * 1000000.0 / total_us :
+                                   0.0,
+                                   latencies[(iterations - 1) / 2],
+                                   latencies[(iterations - 1) * 99 / 100]);
+                }
+            }
+        }
+    }
+
+    mbedtls_printf("\n");
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+exit:
+    mbedtls_free(latencies);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+
+usage:
+    mbedtls_printf(USAGE, DFL_ITERATIONS);
+    mbedtls_exit(MBEDTLS_EXIT_FAILURE);
+}
+
+#endif /* MBEDTLS_SSL_CLI_C && MBEDTLS_SSL_SRV_C &&
+          MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED && MBEDTLS_HAVE_TIME */
@@ -0,0 +1,684 @@
+/*
+ *  Capture and replay of the client side of TLS handshakes
+ *
+ *  Records the bytes that a client sends during a handshake with an
+ *  in-process server, whose random generator is reseeded from a fixed
+ *  seed, then replays them to a server alone, over the in-memory sockets
+ *  of the test framework, in a loop. The replayed server draws the same
+ *  random bytes as the recorded one, so it produces the same messages and
+ *  accepts the recorded Finished: the loop runs the server side of the
+ *  handshake only, without a client or a network, for profiling.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_SRV_C) || \
+    !defined(MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED) || \
+    !defined(MBEDTLS_HAVE_TIME) || !defined(MBEDTLS_FS_IO)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_CLI_C and/or MBEDTLS_SSL_SRV_C and/or "
+                   "MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED and/or "
+                   "MBEDTLS_HAVE_TIME and/or MBEDTLS_FS_IO not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "mbedtls/ssl.h"
+#include "psa/crypto.h"
+
+#include <test/ssl_helpers.h>
+#if defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG)
+#include <test/fake_external_rng_for_test.h>
+#endif
+
+#if defined(MBEDTLS_DEBUG_C)
+#include "ssl_debug_helpers.h"
+#endif
+
+#define DFL_MODE                "replay"
+#define DFL_FILE                "handshake.rec"
+#define DFL_ITERATIONS          1000
+#define DFL_SEED                1
+#define SOCKET_BUF_SIZE         (64 * 1024)
+#define MAX_STEPS               1000
+#define MAX_STATES              64
+
+#define USAGE \
+    "\n usage: ssl_handshake_replay param=<>...\n"                      \
+    "\n acceptable parameters:\n"                                       \
+    "    mode=%%s            record or replay\n"                       \
+    "                        default: " DFL_MODE "\n"                  \
+    "    file=%%s            capture file\n"                           \
+    "                        default: " DFL_FILE "\n"                  \
+    "    version=%%s         with mode=record: tls12 or tls13\n"       \
+    "                        default: tls13\n"                         \
+    "    sig=%%s             with mode=record: ecdsa or rsa\n"         \
+    "                        default: ecdsa\n"                         \
+    "    group=%%s           with mode=record: secp256r1, secp384r1,\n" \
+    "                        x25519 or ffdhe2048\n"                    \
+    "                        default: secp256r1\n"                     \
+    "    seed=%%d            with mode=record: seed of the server RNG\n" \
+    "                        default: %d\n"                            \
+    "    iterations=%%d      with mode=replay: handshakes replayed\n"  \
+    "                        default: %d\n"                            \
+    "\n"                                                               \
+    " The replayed server must draw the same random bytes as the\n"    \
+    " recorded one: build with MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG for the\n" \
+    " keys that PSA generates, and with MBEDTLS_PLATFORM_TIME_ALT for\n" \
+    " the time in the TLS 1.2 server random.\n"                        \
+    "\n"
+
+typedef struct {
+    const char *name;
+    uint16_t group;
+} replay_group;
+
+static const replay_group groups[] = {
+    { "secp256r1", MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1 },
+    { "secp384r1", MBEDTLS_SSL_IANA_TLS_GROUP_SECP384R1 },
+    { "x25519", MBEDTLS_SSL_IANA_TLS_GROUP_X25519 },
+    { "ffdhe2048", MBEDTLS_SSL_IANA_TLS_GROUP_FFDHE2048 },
+};
+
+/*
+ * A recorded handshake: the parameters of the server, and the bytes that
+ * the client sent and the server sent.
+ *
+ * Capture file: "HSRP", then, in big-endian order:
+ *   2  TLS version, as an mbedtls_ssl_protocol_version
+ *   1  signature algorithm of the certificates, as an mbedtls_pk_type_t
+ *   2  group, as an IANA identifier
+ *   4  seed of the server RNG
+ *   8  time of the recording
+ *   4  length of the client bytes, then the client bytes
+ *   4  length of the server bytes, then the server bytes
+ */
+typedef struct {
+    mbedtls_ssl_protocol_version version;
+    int pk_alg;
+    uint16_t group;
+    uint32_t seed;
+    uint64_t time;
+    unsigned char in[SOCKET_BUF_SIZE];
+    size_t in_len;
+    unsigned char out[SOCKET_BUF_SIZE];
+    size_t out_len;
+} replay_record;
+
+static const unsigned char replay_magic[4] = { 'H', 'S', 'R', 'P' };
+
+/*
+ * Transport of the server: the mock socket, with a copy of what goes
+ * through it.
+ */
+typedef struct {
+    mbedtls_test_mock_socket *socket;
+    unsigned char *in;          /* bytes received, or NULL */
+    size_t *in_len;
+    unsigned char *out;         /* bytes sent, or NULL */
+    size_t *out_len;
+} replay_tap;
+
+static int replay_tap_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    replay_tap *tap = ctx;
+    int ret = mbedtls_test_mock_tcp_send_nb(tap->socket, buf, len);
+
+    if (ret > 0 && tap->out != NULL) {
+        if (*tap->out_len + (size_t) ret > SOCKET_BUF_SIZE) {
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+        memcpy(tap->out + *tap->out_len, buf, (size_t) ret);
+        *tap->out_len += (size_t) ret;
+    }
+
+    return ret;
+}
+
+static int replay_tap_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    replay_tap *tap = ctx;
+    int ret = mbedtls_test_mock_tcp_recv_nb(tap->socket, buf, len);
+
+    if (ret > 0 && tap->in != NULL) {
+        if (*tap->in_len + (size_t) ret > SOCKET_BUF_SIZE) {
+            return MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+        }
+        memcpy(tap->in + *tap->in_len, buf, (size_t) ret);
+        *tap->in_len += (size_t) ret;
+    }
+
+    return ret;
+}
+
+#if defined(MBEDTLS_PLATFORM_TIME_ALT)
+/* Frozen clock, so that the TLS 1.2 server random does not change. */
+static mbedtls_time_t replay_now;
+
+static mbedtls_time_t replay_time(mbedtls_time_t *timer)
+{
+    if (timer != NULL) {
+        *timer = replay_now;
+    }
+    return replay_now;
+}
+#endif
+
+static unsigned long long replay_usec(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long) now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+/*
+ * Run one handshake step of the server. The RNG of the test framework,
+ * which the endpoints use and the fake PSA external RNG draws from, is
+ * reseeded before each step from the seed and the number of steps done
+ * so far. So the server draws the same bytes whether its peer is a live
+ * client, which draws from the same generator between the server steps,
+ * or a recording. A step that waits for the peer draws nothing and does
+ * not count.
+ */
+static int replay_server_step(mbedtls_ssl_context *server, uint32_t seed,
+                              unsigned *steps)
+{
+    int ret;
+
+    srand((unsigned) (seed + *steps));
+    ret = mbedtls_ssl_handshake_step(server);
+    if (ret == 0) {
+        (*steps)++;
+    }
+
+    return ret;
+}
+
+static void replay_options(mbedtls_test_handshake_test_options *options,
+                           const replay_record *rec, uint16_t *group_list)
+{
+    mbedtls_test_init_handshake_options(options);
+
+    group_list[0] = rec->group;
+    group_list[1] = MBEDTLS_SSL_IANA_TLS_GROUP_NONE;
+
+    options->pk_alg = rec->pk_alg;
+    options->group_list = group_list;
+    options->client_min_version = rec->version;
+    options->client_max_version = rec->version;
+    options->server_min_version = rec->version;
+    options->server_max_version = rec->version;
+}
+
+static void replay_put(unsigned char **p, uint64_t value, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        (*p)[i] = (unsigned char) (value >> (8 * (len - 1 - i)));
+    }
+    *p += len;
+}
+
+static uint64_t replay_get(const unsigned char **p, size_t len)
+{
+    uint64_t value = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        value = (value << 8) | (*p)[i];
+    }
+    *p += len;
+
+    return value;
+}
+
+static int replay_save(const char *path, const replay_record *rec)
+{
+    unsigned char header[4 + 2 + 1 + 2 + 4 + 8];
+    unsigned char len[4];
+    unsigned char *p = header;
+    FILE *f;
+    int ok;
+
+    memcpy(p, replay_magic, sizeof(replay_magic));
+    p += sizeof(replay_magic);
+    replay_put(&p, (uint64_t) rec->version, 2);
+    replay_put(&p, (uint64_t) rec->pk_alg, 1);
+    replay_put(&p, rec->group, 2);
+    replay_put(&p, rec->seed, 4);
+    replay_put(&p, rec->time, 8);
+
+    if ((f = fopen(path, "wb")) == NULL) {
+        return -1;
+    }
+    ok = fwrite(header, 1, sizeof(header), f) == sizeof(header);
+    p = len;
+    replay_put(&p, rec->in_len, 4);
+    ok = ok && fwrite(len, 1, sizeof(len), f) == sizeof(len) &&
+         fwrite(rec->in, 1, rec->in_len, f) == rec->in_len;
+    p = len;
+    replay_put(&p, rec->out_len, 4);
+    ok = ok && fwrite(len, 1, sizeof(len), f) == sizeof(len) &&
+         fwrite(rec->out, 1, rec->out_len, f) == rec->out_len;
+
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+static int replay_load(const char *path, replay_record *rec)
+{
+    unsigned char header[4 + 2 + 1 + 2 + 4 + 8];
+    unsigned char len[4];
+    const unsigned char *p = header;
+    FILE *f;
+    int ok;
+
+    if ((f = fopen(path, "rb")) == NULL) {
+        return -1;
+    }
+    ok = fread(header, 1, sizeof(header), f) == sizeof(header) &&
+         memcmp(header, replay_magic, sizeof(replay_magic)) == 0;
+    if (ok) {
+        p += sizeof(replay_magic);
+        rec->version = (mbedtls_ssl_protocol_version) replay_get(&p, 2);
+        rec->pk_alg = (int) replay_get(&p, 1);
+        rec->group = (uint16_t) replay_get(&p, 2);
+        rec->seed = (uint32_t) replay_get(&p, 4);
+        rec->time = replay_get(&p, 8);
+    }
+
+    ok = ok && fread(len, 1, sizeof(len), f) == sizeof(len);
+    if (ok) {
+        p = len;
+        rec->in_len = (size_t) replay_get(&p, 4);
+        ok = rec->in_len <= SOCKET_BUF_SIZE &&
+             fread(rec->in, 1, rec->in_len, f) == rec->in_len;
+    }
+    ok = ok && fread(len, 1, sizeof(len), f) == sizeof(len);
+    if (ok) {
+        p = len;
+        rec->out_len = (size_t) replay_get(&p, 4);
+        ok = rec->out_len <= SOCKET_BUF_SIZE &&
+             fread(rec->out, 1, rec->out_len, f) == rec->out_len;
+    }
+
+    fclose(f);
+    return ok ? 0 : -1;
+}
+
+/*
+ * Run a handshake between an in-process client and server, and record
+ * the bytes that each of them sent.
+ */
+static int replay_record_handshake(replay_record *rec)
+{
+    int ret;
+    mbedtls_test_handshake_test_options options;
+    mbedtls_test_ssl_endpoint client, server;
+    uint16_t group_list[2];
+    replay_tap tap = { &server.socket, rec->in, &rec->in_len,
+                       rec->out, &rec->out_len };
+    unsigned steps = 0;
+
+    mbedtls_platform_zeroize(&client, sizeof(client));
+    mbedtls_platform_zeroize(&server, sizeof(server));
+    replay_options(&options, rec, group_list);
+    rec->in_len = 0;
+    rec->out_len = 0;
+
+    if ((ret = mbedtls_test_ssl_endpoint_init(&client, MBEDTLS_SSL_IS_CLIENT,
+                                              &options, NULL, NULL,
+                                              NULL)) != 0 ||
+        (ret = mbedtls_test_ssl_endpoint_init(&server, MBEDTLS_SSL_IS_SERVER,
+                                              &options, NULL, NULL,
+                                              NULL)) != 0 ||
+        (ret = mbedtls_test_mock_socket_connect(&client.socket,
+                                                &server.socket,
+                                                SOCKET_BUF_SIZE)) != 0) {
+        goto exit;
+    }
+    mbedtls_ssl_set_bio(&server.ssl, &tap, replay_tap_send, replay_tap_recv,
+                        NULL);
+
+    for (int i = 0; i < MAX_STEPS; i++) {
+        if (mbedtls_ssl_is_handshake_over(&client.ssl) &&
+            mbedtls_ssl_is_handshake_over(&server.ssl)) {
+            ret = 0;
+            goto exit;
+        }
+
+        if (!mbedtls_ssl_is_handshake_over(&client.ssl)) {
+            ret = mbedtls_ssl_handshake_step(&client.ssl);
+            if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+                ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                goto exit;
+            }
+        }
+        if (!mbedtls_ssl_is_handshake_over(&server.ssl)) {
+            ret = replay_server_step(&server.ssl, rec->seed, &steps);
+            if (ret != 0 && ret != MBEDTLS_ERR_SSL_WANT_READ &&
+                ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                goto exit;
+            }
+        }
+    }
+    ret = -1;
+
+exit:
+    mbedtls_test_ssl_endpoint_free(&client, NULL);
+    mbedtls_test_ssl_endpoint_free(&server, NULL);
+    mbedtls_test_free_handshake_options(&options);
+
+    return ret;
+}
+
+/*
+ * Replay a recording to a server, `iterations` times, and add the time
+ * of the steps to step_us by state. The server must send what it sent
+ * when the handshake was recorded: *diverged is set, and the replay
+ * stops, at the first byte where it does not.
+ */
+static int replay_handshakes(const replay_record *rec, int iterations,
+                             unsigned long long *step_us,
+                             unsigned long long *total_us,
+                             size_t *diverged)
+{
+    int ret;
+    mbedtls_test_handshake_test_options options;
+    mbedtls_test_ssl_endpoint server;
+    mbedtls_test_mock_socket peer;
+    uint16_t group_list[2];
+    unsigned char *out = NULL;
+    size_t out_len = 0;
+    replay_tap tap = { &server.socket, NULL, NULL, NULL, &out_len };
+
+    mbedtls_platform_zeroize(&server, sizeof(server));
+    mbedtls_test_mock_socket_init(&peer);
+    replay_options(&options, rec, group_list);
+    *total_us = 0;
+    *diverged = SIZE_MAX;
+
+    if ((out = mbedtls_calloc(1, SOCKET_BUF_SIZE)) == NULL) {
+        ret = MBEDTLS_ERR_SSL_ALLOC_FAILED;
+        goto exit;
+    }
+    tap.out = out;
+
+    if ((ret = mbedtls_test_ssl_endpoint_init(&server, MBEDTLS_SSL_IS_SERVER,
+                                              &options, NULL, NULL,
+                                              NULL)) != 0) {
+        goto exit;
+    }
+    mbedtls_ssl_set_bio(&server.ssl, &tap, replay_tap_send, replay_tap_recv,
+                        NULL);
+
+    for (int i = 0; i < iterations; i++) {
+        unsigned long long start, end;
+        unsigned steps = 0;
+        int n;
+
+        mbedtls_test_mock_socket_close(&peer);
+        mbedtls_test_mock_socket_close(&server.socket);
+        if ((ret = mbedtls_ssl_session_reset(&server.ssl)) != 0 ||
+            (ret = mbedtls_test_mock_socket_connect(&peer, &server.socket,
+                                                    SOCKET_BUF_SIZE)) != 0) {
+            goto exit;
+        }
+
+        /* The whole client side is there from the start. */
+        ret = mbedtls_test_mock_tcp_send_nb(&peer, rec->in, rec->in_len);
+        if (ret < 0 || (size_t) ret != rec->in_len) {
+            ret = MBEDTLS_ERR_SSL_INTERNAL_ERROR;
+            goto exit;
+        }
+        out_len = 0;
+
+        for (n = 0; !mbedtls_ssl_is_handshake_over(&server.ssl); n++) {
+            int state = server.ssl.state;
+
+            if (n == MAX_STEPS) {
+                ret = -1;
+                goto exit;
+            }
+
+            start = replay_usec();
+            ret = replay_server_step(&server.ssl, rec->seed, &steps);
+            end = replay_usec();
+            if (state >= 0 && state < MAX_STATES) {
+                step_us[state] += end - start;
+            }
+            *total_us += end - start;
+
+            /* Check the messages that the recorded client answered. */
+            if (i == 0) {
+                size_t cmp_len = out_len < rec->out_len ?
+                                 out_len : rec->out_len;
+
+                if (memcmp(out, rec->out, cmp_len) != 0 ||
+                    out_len > rec->out_len) {
+                    *diverged = 0;
+                    while (*diverged < cmp_len &&
+                           out[*diverged] == rec->out[*diverged]) {
+                        (*diverged)++;
+                    }
+                    ret = -1;
+                    goto exit;
+                }
+            }
+            if (ret != 0) {
+                goto exit;
+            }
+        }
+
+        /* Checked once: stop copying the output. */
+        tap.out = NULL;
+    }
+
+    ret = 0;
+
+exit:
+    mbedtls_test_mock_socket_close(&peer);
+    mbedtls_test_ssl_endpoint_free(&server, NULL);
+    mbedtls_test_free_handshake_options(&options);
+    mbedtls_free(out);
+
+    return ret;
+}
+
+static void replay_print_states(const unsigned long long *step_us,
+                                int iterations)
+{
+    mbedtls_printf("\n  %-44s %12s\n", "server state", "us/handshake");
+    for (int state = 0; state < MAX_STATES; state++) {
+        if (step_us[state] == 0) {
+            continue;
+        }
+#if defined(MBEDTLS_DEBUG_C)
+        mbedtls_printf("  %-44s %12.1f\n",
+                       mbedtls_ssl_states_str((mbedtls_ssl_states) state),
+                       (double) step_us[state] / iterations);
+#else
+        mbedtls_printf("  %-44d %12.1f\n", state,
+                       (double) step_us[state] / iterations);
+#endif
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int record = 0;
+    const char *file = DFL_FILE;
+    int iterations = DFL_ITERATIONS;
+    replay_record *rec = NULL;
+    unsigned long long step_us[MAX_STATES] = { 0 };
+    unsigned long long total_us;
+    size_t diverged;
+    char *p, *q;
+
+    rec = mbedtls_calloc(1, sizeof(*rec));
+    if (rec == NULL) {
+        mbedtls_fprintf(stderr, "Failed to allocate the recording\n");
+        mbedtls_exit(MBEDTLS_EXIT_FAILURE);
+    }
+    rec->version = MBEDTLS_SSL_VERSION_TLS1_3;
+    rec->pk_alg = MBEDTLS_PK_ECDSA;
+    rec->group = MBEDTLS_SSL_IANA_TLS_GROUP_SECP256R1;
+    rec->seed = DFL_SEED;
+
+    for (int i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "mode") == 0) {
+            if (strcmp(q, "record") == 0) {
+                record = 1;
+            } else if (strcmp(q, "replay") != 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "file") == 0) {
+            file = q;
+        } else if (strcmp(p, "version") == 0) {
+            if (strcmp(q, "tls12") == 0) {
+                rec->version = MBEDTLS_SSL_VERSION_TLS1_2;
+            } else if (strcmp(q, "tls13") != 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "sig") == 0) {
+            if (strcmp(q, "rsa") == 0) {
+                rec->pk_alg = MBEDTLS_PK_RSA;
+            } else if (strcmp(q, "ecdsa") != 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "group") == 0) {
+            size_t g;
+
+            for (g = 0; g < sizeof(groups) / sizeof(groups[0]); g++) {
+                if (strcmp(q, groups[g].name) == 0) {
+                    break;
+                }
+            }
+            if (g == sizeof(groups) / sizeof(groups[0])) {
+                goto usage;
+            }
+            rec->group = groups[g].group;
+        } else if (strcmp(p, "seed") == 0) {
+            rec->seed = (uint32_t) strtoul(q, NULL, 0);
+        } else if (strcmp(p, "iterations") == 0) {
+            iterations = atoi(q);
+            if (iterations <= 0) {
+                goto usage;
+            }
+        } else {
+            goto usage;
+        }
+    }
+
+    ret = psa_crypto_init();
+    if (ret != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto: %d\n", ret);
+        goto exit;
+    }
+#if defined(MBEDTLS_PSA_CRYPTO_EXTERNAL_RNG)
+    mbedtls_test_enable_insecure_external_rng();
+#endif
+
+    if (record) {
+        rec->time = (uint64_t) mbedtls_time(NULL);
+    } else if (replay_load(file, rec) != 0) {
+        mbedtls_fprintf(stderr, "Failed to read the recording %s\n", file);
+        goto exit;
+    }
+#if defined(MBEDTLS_PLATFORM_TIME_ALT)
+    replay_now = (mbedtls_time_t) rec->time;
+    mbedtls_platform_set_time(replay_time);
+#endif
+
+    if (record) {
+        mbedtls_printf("  . Recording a handshake...");
+        fflush(stdout);
+        if ((ret = replay_record_handshake(rec)) != 0) {
+            mbedtls_printf(" failed: -0x%04x\n", (unsigned int) -ret);
+            goto exit;
+        }
+        if (replay_save(file, rec) != 0) {
+            mbedtls_printf(" failed\n  ! Cannot write %s\n", file);
+            goto exit;
+        }
+        mbedtls_printf(" ok (%u bytes from the client, %u from the server)\n",
+                       (unsigned) rec->in_len, (unsigned) rec->out_len);
+
+        /* Check that the recording can be replayed. */
+        iterations = 1;
+    }
+
+    mbedtls_printf("  . Replaying %d handshake%s...", iterations,
+                   iterations > 1 ? "s" : "");
+    fflush(stdout);
+    ret = replay_handshakes(rec, iterations, step_us, &total_us, &diverged);
+    if (diverged != SIZE_MAX) {
+        mbedtls_printf(" failed\n  ! The server output differs from the "
+                       "recording at byte %u:\n  ! its random bytes or "
+                       "its configuration changed\n", (unsigned) diverged);
+        goto exit;
+    }
+    if (ret != 0) {
+        mbedtls_printf(" failed: -0x%04x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    mbedtls_printf(" ok\n");
+
+    if (!record) {
+        mbedtls_printf("\n  %.1f handshakes/s, %.1f us/handshake\n",
+                       total_us != 0 ?
+                       (double) iterations * 1000000.0 / total_us : 0.0,
+                       (double) total_us / iterations);
+        replay_print_states(step_us, iterations);
+    }
+
+    mbedtls_printf("\n");
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+exit:
+    mbedtls_free(rec);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+
+usage:
+    mbedtls_free(rec);
+    mbedtls_printf(USAGE, DFL_SEED, DFL_ITERATIONS);
+    mbedtls_exit(MBEDTLS_EXIT_FAILURE);
+}
+
+#endif /* MBEDTLS_SSL_CLI_C && MBEDTLS_SSL_SRV_C &&
+          MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED && MBEDTLS_HAVE_TIME &&
+          MBEDTLS_FS_IO */
@@ -0,0 +1,613 @@
+/*
+ *  TLS load generator
+ *
+ *  Keeps many client connections to a server in progress at once, on
+ *  non-blocking sockets driven by a network reactor, with a mix of full
+ *  and resumed handshakes. Reports the connection rate, handshake latency
+ *  percentiles and histograms, and the application data throughput.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||      \
+    !defined(MBEDTLS_NET_C) || !defined(MBEDTLS_NET_REACTOR) ||         \
+    !defined(MBEDTLS_SSL_CLI_C)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_NET_C and/or MBEDTLS_NET_REACTOR and/or "
+                   "MBEDTLS_SSL_CLI_C not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/error.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define DFL_SERVER_ADDR         "localhost"
+#define DFL_SERVER_PORT         "4433"
+#define DFL_SERVER_NAME         "localhost"
+#define DFL_CONNECTIONS         1000
+#define DFL_CONCURRENCY         100
+#define DFL_RESUME              50
+#define DFL_EXCHANGE            1
+#define DFL_CA_FILE             ""
+
+/* Give up when no socket has been ready for this many seconds. */
+#define STALL_TIMEOUT           10
+
+/* Latency histogram buckets: [2^i, 2^(i+1)) microseconds. */
+#define HISTOGRAM_BUCKETS       24
+
+#define GET_REQUEST "GET / HTTP/1.0\r\n\r\n"
+
+#define USAGE \
+    "\n usage: ssl_load_client param=<>...\n"                               \
+    "\n acceptable parameters:\n"                                           \
+    "    server_addr=%%s      default: " DFL_SERVER_ADDR "\n"                 \
+    "    server_port=%%s      default: " DFL_SERVER_PORT "\n"                 \
+    "    server_name=%%s      name to check in the certificate and SNI\n"    \
+    "                        default: " DFL_SERVER_NAME "\n"                  \
+    "    connections=%%d      connections to complete\n"                     \
+    "                        default: %d\n"                                  \
+    "    concurrency=%%d      connections in progress at once\n"             \
+    "                        default: %d\n"                                  \
+    "    resume=%%d           percentage of connections that offer to\n"     \
+    "                        resume the last session, 0 to 100\n"           \
+    "                        default: %d\n"                                  \
+    "    exchange=%%d         1: send a request and read the response until\n" \
+    "                        the server closes the connection,\n"           \
+    "                        0: close after the handshake\n"                \
+    "                        default: %d\n"                                  \
+    "    force_version=%%s    tls12 or tls13, default: negotiated\n"          \
+    "    ca_file=%%s          CA to verify the server with,\n"               \
+    "                        default: no verification\n"                    \
+    "\n"                                                                    \
+    " TLS 1.3 tickets arrive after the handshake, so with TLS 1.3 resumption\n" \
+    " needs exchange=1. The TCP connection itself is opened synchronously.\n" \
+    "\n"
+
+enum {
+    CONN_IDLE,
+    CONN_HANDSHAKE,
+    CONN_WRITE,
+    CONN_READ,
+};
+
+typedef struct {
+    mbedtls_net_context fd;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_reactor_item item;
+    int state;
+    int resume;                 /* whether a session was offered */
+    size_t written;             /* of the request */
+    unsigned long long start;   /* of the handshake, in microseconds */
+} load_conn;
+
+static struct options {
+    const char *server_addr;
+    const char *server_port;
+    const char *server_name;
+    int connections;
+    int concurrency;
+    int resume;
+    int exchange;
+    const char *force_version;
+    const char *ca_file;
+} opt;
+
+static struct {
+    mbedtls_net_reactor reactor;
+    mbedtls_ssl_config conf;
+    mbedtls_ssl_session session;    /* last session received */
+    int have_session;
+    load_conn *conns;
+    int *idle;                      /* stack of idle connections */
+    int idle_count;
+    int started, done, failed;
+    int last_error;
+    unsigned long long bytes;       /* application data, both directions */
+    unsigned long long *full_us, *resume_us;    /* handshake latencies */
+    int full_count, resume_count;
+} load;
+
+static unsigned long long load_usec(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+static int cmp_ull(const void *a, const void *b)
+{
+    unsigned long long x = *(const unsigned long long *) a;
+    unsigned long long y = *(const unsigned long long *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Keep the latest session of the server for the next resumptions. */
+static void load_save_session(load_conn *c)
+{
+    if (load.have_session) {
+        mbedtls_ssl_session_free(&load.session);
+        mbedtls_ssl_session_init(&load.session);
+        load.have_session = 0;
+    }
+
+    if (mbedtls_ssl_get_session(&c->ssl, &load.session) == 0) {
+        load.have_session = 1;
+    }
+}
+
+static void load_finish(load_conn *c, int ret)
+{
+    if (c->state == CONN_HANDSHAKE || ret != 0) {
+        load.failed++;
+        load.last_error = ret;
+    } else {
+        load.done++;
+    }
+
+    (void) mbedtls_net_reactor_remove(&load.reactor, &c->item);
+    mbedtls_net_free(&c->fd);
+
+    c->state = CONN_IDLE;
+    load.idle[load.idle_count++] = (int) (c - load.conns);
+}
+
+/*
+ * Run a connection until it needs the network. Because the reactor is
+ * edge-triggered, it must not stop before the SSL layer asks to wait.
+ */
+static void load_step(load_conn *c)
+{
+    unsigned char buf[4096];
+    int ret;
+
+    for (;;) {
+        switch (c->state) {
+            case CONN_HANDSHAKE:
+                ret = mbedtls_ssl_handshake(&c->ssl);
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret != 0) {
+                    load_finish(c, ret);
+                    return;
+                }
+
+                if (c->resume) {
+                    load.resume_us[load.resume_count++] = load_usec() - c->start;
+                } else {
+                    load.full_us[load.full_count++] = load_usec() - c->start;
+                }
+
+                /* TLS 1.3 sessions come with the tickets, while reading. */
+                if (mbedtls_ssl_get_version_number(&c->ssl) ==
+                    MBEDTLS_SSL_VERSION_TLS1_2) {
+                    load_save_session(c);
+                }
+
+                if (!opt.exchange) {
+                    (void) mbedtls_ssl_close_notify(&c->ssl);
+                    load_finish(c, 0);
+                    return;
+                }
+                c->written = 0;
+                c->state = CONN_WRITE;
+                break;
+
+            case CONN_WRITE:
+                ret = mbedtls_ssl_write(&c->ssl,
+                                        (const unsigned char *) GET_REQUEST + c->written,
+                                        sizeof(GET_REQUEST) - 1 - c->written);
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret < 0) {
+                    load_finish(c, ret);
+                    return;
+                }
+                c->written += (size_t) ret;
+                load.bytes += (unsigned long long) ret;
+                if (c->written == sizeof(GET_REQUEST) - 1) {
+                    c->state = CONN_READ;
+                }
+                break;
+
+            case CONN_READ:
+                ret = mbedtls_ssl_read(&c->ssl, buf, sizeof(buf));
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+                    load_save_session(c);
+                    break;
+                }
+                if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ||
+                    ret == MBEDTLS_ERR_NET_CONN_RESET) {
+                    load_finish(c, 0);
+                    return;
+                }
+                if (ret < 0) {
+                    load_finish(c, ret);
+                    return;
+                }
+                load.bytes += (unsigned long long) ret;
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+static void load_ready(void *p_ready, uint32_t events)
+{
+    (void) events;
+
+    load_step((load_conn *) p_ready);
+}
+
+/* Open the next connection on an idle slot. */
+static int load_start(load_conn *c)
+{
+    int ret;
+
+    load.started++;
+
+    if ((ret = mbedtls_ssl_session_reset(&c->ssl)) != 0 ||
+        (ret = mbedtls_net_connect(&c->fd, opt.server_addr, opt.server_port,
+                                   MBEDTLS_NET_PROTO_TCP)) != 0) {
+        return ret;
+    }
+
+    if ((ret = mbedtls_net_set_nonblock(&c->fd)) != 0) {
+        mbedtls_net_free(&c->fd);
+        return ret;
+    }
+
+    c->resume = load.have_session &&
+                load.started % 100 < opt.resume;
+    if (c->resume &&
+        (ret = mbedtls_ssl_set_session(&c->ssl, &load.session)) != 0) {
+        mbedtls_net_free(&c->fd);
+        return ret;
+    }
+
+    mbedtls_ssl_set_bio(&c->ssl, &c->fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+    if ((ret = mbedtls_net_reactor_add(&load.reactor, &c->item, &c->fd,
+                                       load_ready, c)) != 0) {
+        mbedtls_net_free(&c->fd);
+        return ret;
+    }
+
+    c->state = CONN_HANDSHAKE;
+    c->start = load_usec();
+    load_step(c);
+
+    return 0;
+}
+
+static void print_latencies(const char *name, unsigned long long *us, int count)
+{
+    if (count == 0) {
+        mbedtls_printf("  %-8s %8d\n", name, count);
+        return;
+    }
+
+    qsort(us, (size_t) count, sizeof(*us), cmp_ull);
+    mbedtls_printf("  %-8s %8d %10llu %10llu %10llu %10llu\n", name, count,
+                   us[count / 2], us[count * 9 / 10], us[count * 99 / 100],
+                   us[count - 1]);
+}
+
+static void histogram(const unsigned long long *us, int count,
+                      unsigned buckets[HISTOGRAM_BUCKETS])
+{
+    int i, b;
+
+    memset(buckets, 0, HISTOGRAM_BUCKETS * sizeof(unsigned));
+    for (i = 0; i < count; i++) {
+        b = 0;
+        while (b < HISTOGRAM_BUCKETS - 1 && us[i] >= (2ULL << b)) {
+            b++;
+        }
+        buckets[b]++;
+    }
+}
+
+static void print_report(unsigned long long elapsed_us)
+{
+    unsigned full[HISTOGRAM_BUCKETS], resumed[HISTOGRAM_BUCKETS];
+    int b;
+
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    mbedtls_printf("\n  %d connections, %d failed, in %llu ms: %llu connections/s\n",
+                   load.done, load.failed, elapsed_us / 1000,
+                   (unsigned long long) load.done * 1000000 / elapsed_us);
+    mbedtls_printf("  application data: %llu bytes, %llu KiB/s\n",
+                   load.bytes, load.bytes * 1000000 / 1024 / elapsed_us);
+    if (load.failed != 0) {
+        mbedtls_printf("  last error: -0x%04x\n", (unsigned int) -load.last_error);
+    }
+
+    mbedtls_printf("\n  %-8s %8s %10s %10s %10s %10s\n", "handshake", "count",
+                   "p50 (us)", "p90 (us)", "p99 (us)", "max (us)");
+    print_latencies("full", load.full_us, load.full_count);
+    print_latencies("resumed", load.resume_us, load.resume_count);
+
+    histogram(load.full_us, load.full_count, full);
+    histogram(load.resume_us, load.resume_count, resumed);
+    mbedtls_printf("\n  %-14s %8s %8s\n", "latency (us)", "full", "resumed");
+    for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        if (full[b] == 0 && resumed[b] == 0) {
+            continue;
+        }
+        mbedtls_printf("  < %-12llu %8u %8u\n", 2ULL << b, full[b], resumed[b]);
+    }
+    mbedtls_printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 1, i, stalled = 0;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    const char *pers = "ssl_load_client";
+    unsigned long long start;
+    char *p, *q;
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_FS_IO)
+    mbedtls_x509_crt cacert;
+
+    mbedtls_x509_crt_init(&cacert);
+#endif
+
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ssl_config_init(&load.conf);
+    mbedtls_ssl_session_init(&load.session);
+    mbedtls_net_reactor_init(&load.reactor);
+
+    opt.server_addr = DFL_SERVER_ADDR;
+    opt.server_port = DFL_SERVER_PORT;
+    opt.server_name = DFL_SERVER_NAME;
+    opt.connections = DFL_CONNECTIONS;
+    opt.concurrency = DFL_CONCURRENCY;
+    opt.resume = DFL_RESUME;
+    opt.exchange = DFL_EXCHANGE;
+    opt.force_version = NULL;
+    opt.ca_file = DFL_CA_FILE;
+
+    for (i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "server_addr") == 0) {
+            opt.server_addr = q;
+        } else if (strcmp(p, "server_port") == 0) {
+            opt.server_port = q;
+        } else if (strcmp(p, "server_name") == 0) {
+            opt.server_name = q;
+        } else if (strcmp(p, "connections") == 0) {
+            opt.connections = atoi(q);
+            if (opt.connections <= 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "concurrency") == 0) {
+            opt.concurrency = atoi(q);
+            if (opt.concurrency <= 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "resume") == 0) {
+            opt.resume = atoi(q);
+            if (opt.resume < 0 || opt.resume > 100) {
+                goto usage;
+            }
+        } else if (strcmp(p, "exchange") == 0) {
+            opt.exchange = atoi(q);
+            if (opt.exchange < 0 || opt.exchange > 1) {
+                goto usage;
+            }
+        } else if (strcmp(p, "force_version") == 0) {
+            if (strcmp(q, "tls12") != 0 && strcmp(q, "tls13") != 0) {
+                goto usage;
+            }
+            opt.force_version = q;
+        } else if (strcmp(p, "ca_file") == 0) {
+            opt.ca_file = q;
+        } else {
+            goto usage;
+        }
+    }
+
+    if (opt.concurrency > opt.connections) {
+        opt.concurrency = opt.connections;
+    }
+
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        mbedtls_printf(" failed\n  ! mbedtls_ctr_drbg_seed returned %d\n", ret);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ssl_config_defaults(&load.conf,
+                                           MBEDTLS_SSL_IS_CLIENT,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        mbedtls_printf(" failed\n  ! mbedtls_ssl_config_defaults returned %d\n\n", ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_rng(&load.conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_authmode(&load.conf, MBEDTLS_SSL_VERIFY_NONE);
+
+    if (opt.force_version != NULL) {
+        mbedtls_ssl_protocol_version version =
+            strcmp(opt.force_version, "tls12") == 0 ?
+            MBEDTLS_SSL_VERSION_TLS1_2 : MBEDTLS_SSL_VERSION_TLS1_3;
+        mbedtls_ssl_conf_min_tls_version(&load.conf, version);
+        mbedtls_ssl_conf_max_tls_version(&load.conf, version);
+    }
+
+    if (strlen(opt.ca_file) != 0) {
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_FS_IO)
+        if ((ret = mbedtls_x509_crt_parse_file(&cacert, opt.ca_file)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_x509_crt_parse_file returned -0x%x\n\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+        mbedtls_ssl_conf_ca_chain(&load.conf, &cacert, NULL);
+        mbedtls_ssl_conf_authmode(&load.conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+#else
+        mbedtls_printf("ca_file needs MBEDTLS_X509_CRT_PARSE_C and MBEDTLS_FS_IO\n");
+        goto exit;
+#endif
+    }
+
+    if ((ret = mbedtls_net_reactor_setup(&load.reactor)) != 0) {
+        mbedtls_printf(" failed\n  ! mbedtls_net_reactor_setup returned -0x%x\n\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+
+    load.conns = mbedtls_calloc((size_t) opt.concurrency, sizeof(load_conn));
+    load.idle = mbedtls_calloc((size_t) opt.concurrency, sizeof(int));
+    load.full_us = mbedtls_calloc((size_t) opt.connections, sizeof(unsigned long long));
+    load.resume_us = mbedtls_calloc((size_t) opt.connections, sizeof(unsigned long long));
+    if (load.conns == NULL || load.idle == NULL ||
+        load.full_us == NULL || load.resume_us == NULL) {
+        mbedtls_printf("  ! Failed to allocate %d connections\n", opt.concurrency);
+        goto exit;
+    }
+
+    for (i = 0; i < opt.concurrency; i++) {
+        load_conn *c = &load.conns[i];
+
+        mbedtls_net_init(&c->fd);
+        mbedtls_ssl_init(&c->ssl);
+        c->state = CONN_IDLE;
+        load.idle[load.idle_count++] = opt.concurrency - 1 - i;
+
+        if ((ret = mbedtls_ssl_setup(&c->ssl, &load.conf)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_ssl_setup returned -0x%x\n\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+#if defined(MBEDTLS_X509_CRT_PARSE_C)
+        if ((ret = mbedtls_ssl_set_hostname(&c->ssl, opt.server_name)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_ssl_set_hostname returned %d\n\n", ret);
+            goto exit;
+        }
+#endif
+    }
+
+    mbedtls_printf("  . %d connections to %s:%s, %d at once, %d%% offering resumption...\n",
+                   opt.connections, opt.server_addr, opt.server_port,
+                   opt.concurrency, opt.resume);
+    fflush(stdout);
+
+    start = load_usec();
+
+    while (load.done + load.failed < opt.connections) {
+        while (load.idle_count > 0 && load.started < opt.connections) {
+            load_conn *c = &load.conns[load.idle[--load.idle_count]];
+
+            if ((ret = load_start(c)) != 0) {
+                load.failed++;
+                load.last_error = ret;
+                load.idle[load.idle_count++] = (int) (c - load.conns);
+                if (load.done == 0 && load.failed >= opt.concurrency) {
+                    mbedtls_printf("  ! Cannot connect: -0x%x\n", (unsigned int) -ret);
+                    goto exit;
+                }
+            }
+        }
+
+        if (load.done + load.failed >= opt.connections) {
+            break;
+        }
+
+        ret = mbedtls_net_reactor_dispatch(&load.reactor, 1000);
+        if (ret < 0) {
+            mbedtls_printf("  ! mbedtls_net_reactor_dispatch returned -0x%x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+        stalled = ret == 0 ? stalled + 1 : 0;
+        if (stalled == STALL_TIMEOUT) {
+            mbedtls_printf("  ! No progress in %d seconds, giving up\n", STALL_TIMEOUT);
+            break;
+        }
+    }
+
+    print_report(load_usec() - start);
+
+    exit_code = load.failed == 0 ? MBEDTLS_EXIT_SUCCESS : MBEDTLS_EXIT_FAILURE;
+    goto exit;
+
+usage:
+    mbedtls_printf(USAGE, DFL_CONNECTIONS, DFL_CONCURRENCY, DFL_RESUME, DFL_EXCHANGE);
+
+exit:
+    if (load.conns != NULL) {
+        for (i = 0; i < opt.concurrency; i++) {
+            if (load.conns[i].state != CONN_IDLE) {
+                (void) mbedtls_net_reactor_remove(&load.reactor, &load.conns[i].item);
+            }
+            mbedtls_net_free(&load.conns[i].fd);
+            mbedtls_ssl_free(&load.conns[i].ssl);
+        }
+    }
+    mbedtls_free(load.conns);
+    mbedtls_free(load.idle);
+    mbedtls_free(load.full_us);
+    mbedtls_free(load.resume_us);
+    mbedtls_net_reactor_free(&load.reactor);
+    mbedtls_ssl_session_free(&load.session);
+    mbedtls_ssl_config_free(&load.conf);
+#if defined(MBEDTLS_X509_CRT_PARSE_C) && defined(MBEDTLS_FS_IO)
+    mbedtls_x509_crt_free(&cacert);
+#endif
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+}
+
+#endif /* MBEDTLS_ENTROPY_C && MBEDTLS_CTR_DRBG_C && MBEDTLS_NET_C &&
+          MBEDTLS_NET_REACTOR && MBEDTLS_SSL_CLI_C */
@@ -0,0 +1,943 @@
+/*
+ *  Multi-threaded HTTPS server with one event loop per thread
+ *
+ *  Each thread accepts connections on its own listening socket (bound with
+ *  SO_REUSEPORT where available, so that the kernel balances the clients)
+ *  and drives all of them with non-blocking I/O from a network reactor. The
+ *  threads share one SSL configuration, a sharded session cache and a
+ *  session ticket context, and report statistics periodically. Each thread
+ *  seeds a DRBG of its own for its connections.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||      \
+    !defined(MBEDTLS_NET_C) || !defined(MBEDTLS_NET_REACTOR) ||         \
+    !defined(MBEDTLS_SSL_SRV_C) || !defined(MBEDTLS_PEM_PARSE_C) ||     \
+    !defined(MBEDTLS_X509_CRT_PARSE_C)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_NET_C and/or MBEDTLS_NET_REACTOR and/or "
+                   "MBEDTLS_SSL_SRV_C and/or MBEDTLS_PEM_PARSE_C and/or "
+                   "MBEDTLS_X509_CRT_PARSE_C not defined.\n");
+    mbedtls_exit(0);
+}
+#elif !defined(MBEDTLS_THREADING_C) || !defined(MBEDTLS_THREADING_PTHREAD)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_THREADING_PTHREAD not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509.h"
+#include "mbedtls/ssl.h"
+#include "mbedtls/net_sockets.h"
+#include "mbedtls/error.h"
+#include "test/certs.h"
+
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+#include "mbedtls/ssl_cache_sharded.h"
+#elif defined(MBEDTLS_SSL_CACHE_C)
+#include "mbedtls/ssl_cache.h"
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+#include "mbedtls/ssl_ticket.h"
+#endif
+
+#define DFL_SERVER_ADDR         NULL
+#define DFL_SERVER_PORT         "4433"
+#define DFL_THREADS             4
+#define DFL_MAX_CONNECTIONS     1024
+#define DFL_DURATION            0
+#define DFL_STATS_INTERVAL      1
+#define DFL_CACHE_SHARDS        0
+#define DFL_CACHE_MAX           0
+#define DFL_TICKETS             1
+#define DFL_CRT_FILE            ""
+#define DFL_KEY_FILE            ""
+
+#define MAX_THREADS             256
+
+/* How long a thread waits for its sockets before checking for a stop. */
+#define DISPATCH_TIMEOUT_MS     200
+
+/* Handshake latency histogram buckets: [2^i, 2^(i+1)) microseconds. */
+#define HISTOGRAM_BUCKETS       24
+
+#define HTTP_RESPONSE \
+    "HTTP/1.0 200 OK\r\nContent-Type: text/html\r\n\r\n" \
+    "<h2>Mbed TLS Test Server</h2>\r\n" \
+    "<p>Successful connection</p>\r\n"
+
+#define USAGE \
+    "\n usage: ssl_reactor_server param=<>...\n"                            \
+    "\n acceptable parameters:\n"                                           \
+    "    server_addr=%%s      default: all interfaces\n"                     \
+    "    server_port=%%s      default: " DFL_SERVER_PORT "\n"                 \
+    "    threads=%%d          event loop threads, 1 to %d\n"                 \
+    "                        default: %d\n"                                  \
+    "    max_connections=%%d  open connections per thread\n"                 \
+    "                        default: %d\n"                                  \
+    "    duration=%%d         seconds to run, 0 for no limit\n"              \
+    "                        default: %d\n"                                  \
+    "    stats_interval=%%d   seconds between statistics, 0 for none\n"      \
+    "                        default: %d\n"                                  \
+    "    cache_shards=%%d     session cache shards, 0 for the default\n"     \
+    "    cache_max=%%d        cached sessions, 0 for the default\n"          \
+    "    tickets=%%d          1: issue session tickets, 0: don't\n"          \
+    "                        default: %d\n"                                  \
+    "    crt_file=%%s         server certificate chain,\n"                   \
+    "                        default: the embedded test certificate\n"      \
+    "    key_file=%%s         server private key,\n"                         \
+    "                        default: the embedded test key\n"              \
+    "\n"
+
+enum {
+    CONN_FREE,
+    CONN_HANDSHAKE,
+    CONN_READ,
+    CONN_WRITE,
+};
+
+typedef struct server_thread server_thread;
+
+typedef struct {
+    server_thread *thread;
+    mbedtls_net_context fd;
+    mbedtls_ssl_context ssl;
+    mbedtls_net_reactor_item item;
+    int state;
+    size_t written;             /* of the response */
+    unsigned long long start;   /* of the handshake, in microseconds */
+} server_conn;
+
+/* Counters of a thread. A thread updates its own without locking and
+ * publishes a copy under its mutex for the statistics. */
+typedef struct {
+    unsigned long long accepted;
+    unsigned long long rejected;    /* max_connections reached */
+    unsigned long long handshakes;
+    unsigned long long failed;
+    unsigned long long open;
+    unsigned long long histogram[HISTOGRAM_BUCKETS];
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_ssl_stats ssl;          /* sink of the SSL contexts */
+#endif
+} server_stats;
+
+struct server_thread {
+    pthread_t thread;
+    mbedtls_net_context listen_fd;
+    int own_listen_fd;              /* listen_fd is not shared */
+    mbedtls_net_reactor reactor;
+    mbedtls_net_reactor_item listen_item;
+    mbedtls_ctr_drbg_context ctr_drbg;  /* RNG of the thread's connections */
+    server_conn *conns;
+    int *free;                      /* stack of free connections */
+    int free_count;
+    server_stats stats;
+
+    mbedtls_threading_mutex_t mutex;    /* protects the fields below */
+    server_stats published;
+    int stop;
+    int ret;
+};
+
+static struct options {
+    const char *server_addr;
+    const char *server_port;
+    int threads;
+    int max_connections;
+    int duration;
+    int stats_interval;
+    int cache_shards;
+    int cache_max;
+    int tickets;
+    const char *crt_file;
+    const char *key_file;
+} opt;
+
+/* Read-only once the threads are started. */
+static mbedtls_ssl_config conf;
+
+static server_thread threads[MAX_THREADS];
+
+static unsigned long long server_usec(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+}
+
+/*
+ * Bind a listening TCP socket of its own for each thread if the platform
+ * can balance connections between them, like mbedtls_net_bind() otherwise.
+ */
+static int bind_listen(mbedtls_net_context *ctx)
+{
+#if defined(SO_REUSEPORT)
+    struct addrinfo hints, *addr_list, *cur;
+    int one = 1, ret = MBEDTLS_ERR_NET_UNKNOWN_HOST;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    if (opt.server_addr == NULL) {
+        hints.ai_flags = AI_PASSIVE;
+    }
+
+    if (getaddrinfo(opt.server_addr, opt.server_port, &hints, &addr_list) != 0) {
+        return MBEDTLS_ERR_NET_UNKNOWN_HOST;
+    }
+
+    for (cur = addr_list; cur != NULL; cur = cur->ai_next) {
+        ctx->fd = socket(cur->ai_family, cur->ai_socktype, cur->ai_protocol);
+        if (ctx->fd < 0) {
+            ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+            continue;
+        }
+
+        if (setsockopt(ctx->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+            setsockopt(ctx->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0) {
+            mbedtls_net_free(ctx);
+            ret = MBEDTLS_ERR_NET_SOCKET_FAILED;
+            continue;
+        }
+
+        if (bind(ctx->fd, cur->ai_addr, cur->ai_addrlen) != 0) {
+            mbedtls_net_free(ctx);
+            ret = MBEDTLS_ERR_NET_BIND_FAILED;
+            continue;
+        }
+
+        if (listen(ctx->fd, SOMAXCONN) != 0) {
+            mbedtls_net_free(ctx);
+            ret = MBEDTLS_ERR_NET_LISTEN_FAILED;
+            continue;
+        }
+
+        ret = 0;
+        break;
+    }
+
+    freeaddrinfo(addr_list);
+
+    return ret;
+#else
+    return mbedtls_net_bind(ctx, opt.server_addr, opt.server_port,
+                            MBEDTLS_NET_PROTO_TCP);
+#endif /* SO_REUSEPORT */
+}
+
+static void conn_finish(server_conn *c, int ret)
+{
+    server_thread *t = c->thread;
+
+    if (ret != 0) {
+        t->stats.failed++;
+    }
+    t->stats.open--;
+
+    (void) mbedtls_net_reactor_remove(&t->reactor, &c->item);
+    mbedtls_net_free(&c->fd);
+
+    /* This also adds the counters of the connection to the sink. */
+    (void) mbedtls_ssl_session_reset(&c->ssl);
+
+    c->state = CONN_FREE;
+    t->free[t->free_count++] = (int) (c - t->conns);
+}
+
+/*
+ * Run a connection until it needs the network. Because the reactor is
+ * edge-triggered, it must not stop before the SSL layer asks to wait.
+ */
+static void conn_step(server_conn *c)
+{
+    unsigned char buf[1024];
+    unsigned long long us;
+    int ret, b;
+
+    for (;;) {
+        switch (c->state) {
+            case CONN_HANDSHAKE:
+                ret = mbedtls_ssl_handshake(&c->ssl);
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret != 0) {
+                    conn_finish(c, ret);
+                    return;
+                }
+
+                us = server_usec() - c->start;
+                b = 0;
+                while (b < HISTOGRAM_BUCKETS - 1 && us >= (2ULL << b)) {
+                    b++;
+                }
+                c->thread->stats.histogram[b]++;
+                c->thread->stats.handshakes++;
+                c->state = CONN_READ;
+                break;
+
+            case CONN_READ:
+                ret = mbedtls_ssl_read(&c->ssl, buf, sizeof(buf));
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ||
+                    ret == MBEDTLS_ERR_NET_CONN_RESET || ret == 0) {
+                    conn_finish(c, 0);
+                    return;
+                }
+                if (ret < 0) {
+                    conn_finish(c, ret);
+                    return;
+                }
+                /* Any data is taken as a complete request. */
+                c->written = 0;
+                c->state = CONN_WRITE;
+                break;
+
+            case CONN_WRITE:
+                ret = mbedtls_ssl_write(&c->ssl,
+                                        (const unsigned char *) HTTP_RESPONSE + c->written,
+                                        sizeof(HTTP_RESPONSE) - 1 - c->written);
+                if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+                    ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                    return;
+                }
+                if (ret < 0) {
+                    conn_finish(c, ret);
+                    return;
+                }
+                c->written += (size_t) ret;
+                if (c->written == sizeof(HTTP_RESPONSE) - 1) {
+                    /* Best effort: the connection is closed either way. */
+                    (void) mbedtls_ssl_close_notify(&c->ssl);
+                    conn_finish(c, 0);
+                    return;
+                }
+                break;
+
+            default:
+                return;
+        }
+    }
+}
+
+static void conn_ready(void *p_ready, uint32_t events)
+{
+    (void) events;
+
+    conn_step((server_conn *) p_ready);
+}
+
+/* Accept every pending connection, as the listening socket is also
+ * edge-triggered. With a shared socket, other threads may take some. */
+static void listen_ready(void *p_ready, uint32_t events)
+{
+    server_thread *t = (server_thread *) p_ready;
+    mbedtls_net_context client_fd;
+    server_conn *c;
+    int ret;
+
+    (void) events;
+
+    for (;;) {
+        mbedtls_net_init(&client_fd);
+        ret = mbedtls_net_accept(&t->listen_fd, &client_fd, NULL, 0, NULL);
+        if (ret != 0) {
+            /* MBEDTLS_ERR_SSL_WANT_READ once the backlog is empty */
+            return;
+        }
+
+        t->stats.accepted++;
+        if (t->free_count == 0 ||
+            mbedtls_net_set_nonblock(&client_fd) != 0) {
+            t->stats.rejected++;
+            mbedtls_net_free(&client_fd);
+            continue;
+        }
+
+        c = &t->conns[t->free[--t->free_count]];
+        c->fd = client_fd;
+        mbedtls_ssl_set_bio(&c->ssl, &c->fd, mbedtls_net_send, mbedtls_net_recv, NULL);
+
+        if (mbedtls_net_reactor_add(&t->reactor, &c->item, &c->fd,
+                                    conn_ready, c) != 0) {
+            t->stats.rejected++;
+            mbedtls_net_free(&c->fd);
+            t->free[t->free_count++] = (int) (c - t->conns);
+            continue;
+        }
+
+        t->stats.open++;
+        c->state = CONN_HANDSHAKE;
+        c->start = server_usec();
+        conn_step(c);
+    }
+}
+
+static void *thread_main(void *data)
+{
+    server_thread *t = (server_thread *) data;
+    int ret, stop = 0, i;
+
+    while (!stop) {
+        ret = mbedtls_net_reactor_dispatch(&t->reactor, DISPATCH_TIMEOUT_MS);
+
+        if (mbedtls_mutex_lock(&t->mutex) != 0) {
+            break;
+        }
+        t->published = t->stats;
+        if (ret < 0) {
+            t->ret = ret;
+            t->stop = 1;
+        }
+        stop = t->stop;
+        mbedtls_mutex_unlock(&t->mutex);
+    }
+
+    for (i = 0; i < opt.max_connections; i++) {
+        if (t->conns[i].state != CONN_FREE) {
+            conn_finish(&t->conns[i], 0);
+        }
+    }
+
+    if (mbedtls_mutex_lock(&t->mutex) == 0) {
+        t->published = t->stats;
+        mbedtls_mutex_unlock(&t->mutex);
+    }
+
+    return NULL;
+}
+
+static int thread_setup(server_thread *t, int index,
+                        mbedtls_entropy_context *entropy)
+{
+    int ret, i;
+    char pers[32];
+
+    mbedtls_net_init(&t->listen_fd);
+    mbedtls_net_reactor_init(&t->reactor);
+    mbedtls_ctr_drbg_init(&t->ctr_drbg);
+    mbedtls_mutex_init(&t->mutex);
+
+    if ((ret = mbedtls_net_reactor_setup(&t->reactor)) != 0) {
+        return ret;
+    }
+
+    /* A DRBG per thread, so that handshakes running in different threads
+     * do not wait for each other on the lock of a shared one. */
+    mbedtls_snprintf(pers, sizeof(pers), "ssl_reactor_server %d", index);
+    if ((ret = mbedtls_ctr_drbg_seed(&t->ctr_drbg, mbedtls_entropy_func, entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        return ret;
+    }
+
+#if defined(SO_REUSEPORT)
+    t->own_listen_fd = 1;
+#else
+    t->own_listen_fd = index == 0;
+#endif
+    if (t->own_listen_fd) {
+        if ((ret = bind_listen(&t->listen_fd)) != 0) {
+            return ret;
+        }
+    } else {
+        t->listen_fd = threads[0].listen_fd;
+    }
+
+    if ((ret = mbedtls_net_set_nonblock(&t->listen_fd)) != 0) {
+        return ret;
+    }
+
+    t->conns = mbedtls_calloc((size_t) opt.max_connections, sizeof(server_conn));
+    t->free = mbedtls_calloc((size_t) opt.max_connections, sizeof(int));
+    if (t->conns == NULL || t->free == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    for (i = 0; i < opt.max_connections; i++) {
+        server_conn *c = &t->conns[i];
+
+        c->thread = t;
+        mbedtls_net_init(&c->fd);
+        mbedtls_ssl_init(&c->ssl);
+        c->state = CONN_FREE;
+        t->free[t->free_count++] = opt.max_connections - 1 - i;
+
+        if ((ret = mbedtls_ssl_setup(&c->ssl, &conf)) != 0) {
+            return ret;
+        }
+        mbedtls_ssl_set_rng(&c->ssl, mbedtls_ctr_drbg_random, &t->ctr_drbg);
+#if defined(MBEDTLS_SSL_STATS)
+        mbedtls_ssl_set_stats_sink(&c->ssl, &t->stats.ssl);
+#endif
+    }
+
+    return mbedtls_net_reactor_add(&t->reactor, &t->listen_item, &t->listen_fd,
+                                   listen_ready, t);
+}
+
+static void thread_free(server_thread *t)
+{
+    int i;
+
+    if (t->conns != NULL) {
+        for (i = 0; i < opt.max_connections; i++) {
+            mbedtls_ssl_free(&t->conns[i].ssl);
+        }
+    }
+    mbedtls_free(t->conns);
+    mbedtls_free(t->free);
+
+    mbedtls_net_reactor_free(&t->reactor);
+    mbedtls_ctr_drbg_free(&t->ctr_drbg);
+    if (t->own_listen_fd) {
+        mbedtls_net_free(&t->listen_fd);
+    }
+    mbedtls_mutex_free(&t->mutex);
+}
+
+/* Upper bound of the bucket holding the given fraction of the handshakes. */
+static unsigned long long histogram_percentile(const unsigned long long *histogram,
+                                               unsigned long long total,
+                                               unsigned permille)
+{
+    unsigned long long seen = 0;
+    int b;
+
+    for (b = 0; b < HISTOGRAM_BUCKETS - 1; b++) {
+        seen += histogram[b];
+        if (seen * 1000 >= total * permille) {
+            break;
+        }
+    }
+
+    return 2ULL << b;
+}
+
+static void print_stats(server_stats *last, unsigned long long elapsed_us)
+{
+    server_stats total;
+    unsigned long long handshakes;
+    int i, b;
+
+    memset(&total, 0, sizeof(total));
+    for (i = 0; i < opt.threads; i++) {
+        server_thread *t = &threads[i];
+
+        if (mbedtls_mutex_lock(&t->mutex) != 0) {
+            continue;
+        }
+        total.accepted += t->published.accepted;
+        total.rejected += t->published.rejected;
+        total.handshakes += t->published.handshakes;
+        total.failed += t->published.failed;
+        total.open += t->published.open;
+        for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+            total.histogram[b] += t->published.histogram[b];
+        }
+#if defined(MBEDTLS_SSL_STATS)
+        mbedtls_ssl_stats_add(&total.ssl, &t->published.ssl);
+#endif
+        mbedtls_mutex_unlock(&t->mutex);
+    }
+
+    if (elapsed_us == 0) {
+        elapsed_us = 1;
+    }
+
+    handshakes = total.handshakes - last->handshakes;
+    for (b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        last->histogram[b] = total.histogram[b] - last->histogram[b];
+    }
+
+    mbedtls_printf("  %llu handshakes/s, %llu open, %llu accepted, %llu rejected, "
+                   "%llu failed",
+                   handshakes * 1000000 / elapsed_us, total.open,
+                   total.accepted, total.rejected, total.failed);
+    if (handshakes != 0) {
+        mbedtls_printf(", handshake p50 < %llu us, p99 < %llu us",
+                       histogram_percentile(last->histogram, handshakes, 500),
+                       histogram_percentile(last->histogram, handshakes, 990));
+    }
+#if defined(MBEDTLS_SSL_STATS)
+    mbedtls_printf(", cache hits %llu, misses %llu, ticket failures %llu",
+                   (unsigned long long) total.ssl.cache_hits,
+                   (unsigned long long) total.ssl.cache_misses,
+                   (unsigned long long) total.ssl.ticket_failures);
+#endif
+    mbedtls_printf("\n");
+    fflush(stdout);
+
+    *last = total;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 1, i, set_up = 0, started = 0, stop = 0;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    const char pers[] = "ssl_reactor_server";
+    unsigned long long start, last_us, now;
+    server_stats last;
+    char *p, *q;
+
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt srvcert;
+    mbedtls_pk_context pkey;
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+    mbedtls_ssl_cache_sharded_context cache;
+#elif defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_context ticket_ctx;
+#endif
+
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+    mbedtls_ssl_cache_sharded_init(&cache);
+#elif defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_init(&cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_init(&ticket_ctx);
+#endif
+    mbedtls_x509_crt_init(&srvcert);
+    mbedtls_pk_init(&pkey);
+    mbedtls_ssl_config_init(&conf);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_entropy_init(&entropy);
+    memset(threads, 0, sizeof(threads));
+    memset(&last, 0, sizeof(last));
+
+    opt.server_addr = DFL_SERVER_ADDR;
+    opt.server_port = DFL_SERVER_PORT;
+    opt.threads = DFL_THREADS;
+    opt.max_connections = DFL_MAX_CONNECTIONS;
+    opt.duration = DFL_DURATION;
+    opt.stats_interval = DFL_STATS_INTERVAL;
+    opt.cache_shards = DFL_CACHE_SHARDS;
+    opt.cache_max = DFL_CACHE_MAX;
+    opt.tickets = DFL_TICKETS;
+    opt.crt_file = DFL_CRT_FILE;
+    opt.key_file = DFL_KEY_FILE;
+
+    for (i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "server_addr") == 0) {
+            opt.server_addr = q;
+        } else if (strcmp(p, "server_port") == 0) {
+            opt.server_port = q;
+        } else if (strcmp(p, "threads") == 0) {
+            opt.threads = atoi(q);
+            if (opt.threads < 1 || opt.threads > MAX_THREADS) {
+                goto usage;
+            }
+        } else if (strcmp(p, "max_connections") == 0) {
+            opt.max_connections = atoi(q);
+            if (opt.max_connections < 1) {
+                goto usage;
+            }
+        } else if (strcmp(p, "duration") == 0) {
+            opt.duration = atoi(q);
+            if (opt.duration < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "stats_interval") == 0) {
+            opt.stats_interval = atoi(q);
+            if (opt.stats_interval < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "cache_shards") == 0) {
+            opt.cache_shards = atoi(q);
+            if (opt.cache_shards < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "cache_max") == 0) {
+            opt.cache_max = atoi(q);
+            if (opt.cache_max < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "tickets") == 0) {
+            opt.tickets = atoi(q);
+            if (opt.tickets < 0 || opt.tickets > 1) {
+                goto usage;
+            }
+        } else if (strcmp(p, "crt_file") == 0) {
+            opt.crt_file = q;
+        } else if (strcmp(p, "key_file") == 0) {
+            opt.key_file = q;
+        } else {
+            goto usage;
+        }
+    }
+
+    /* A client closing early must not kill the whole server. */
+    signal(SIGPIPE, SIG_IGN);
+
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+
+    /*
+     * 1. Seed the random number generator, shared by all the threads. It
+     *    is thread-safe with MBEDTLS_THREADING_C.
+     */
+    mbedtls_printf("  . Seeding the random number generator...");
+
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        mbedtls_printf(" failed: mbedtls_ctr_drbg_seed returned -0x%04x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+
+    mbedtls_printf(" ok\n");
+
+    /*
+     * 2. Load the certificate and the private key
+     */
+    mbedtls_printf("  . Loading the server cert. and key...");
+    fflush(stdout);
+
+#if defined(MBEDTLS_FS_IO)
+    if (strlen(opt.crt_file) != 0) {
+        ret = mbedtls_x509_crt_parse_file(&srvcert, opt.crt_file);
+    } else
+#endif
+    ret = mbedtls_x509_crt_parse(&srvcert, (const unsigned char *) mbedtls_test_srv_crt,
+                                 mbedtls_test_srv_crt_len);
+    if (ret != 0) {
+        mbedtls_printf(" failed\n  !  mbedtls_x509_crt_parse returned %d\n\n", ret);
+        goto exit;
+    }
+
+#if defined(MBEDTLS_FS_IO)
+    if (strlen(opt.key_file) != 0) {
+        ret = mbedtls_pk_parse_keyfile(&pkey, opt.key_file, NULL,
+                                       mbedtls_ctr_drbg_random, &ctr_drbg);
+    } else
+#endif
+    ret = mbedtls_pk_parse_key(&pkey, (const unsigned char *) mbedtls_test_srv_key,
+                               mbedtls_test_srv_key_len, NULL, 0,
+                               mbedtls_ctr_drbg_random, &ctr_drbg);
+    if (ret != 0) {
+        mbedtls_printf(" failed\n  !  mbedtls_pk_parse_key returned %d\n\n", ret);
+        goto exit;
+    }
+
+    mbedtls_printf(" ok\n");
+
+    /*
+     * 3. Prepare the configuration shared by all the connections. It must
+     *    not be modified once the threads are started.
+     */
+    mbedtls_printf("  . Setting up the SSL data....");
+
+    if ((ret = mbedtls_ssl_config_defaults(&conf,
+                                           MBEDTLS_SSL_IS_SERVER,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        mbedtls_printf(" failed: mbedtls_ssl_config_defaults returned -0x%04x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+
+    mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+
+    /* The cache callbacks and the ticket callbacks lock internally with
+     * MBEDTLS_THREADING_C. The shards of the sharded cache keep the
+     * threads from contending on a single lock. */
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+    if ((ret = mbedtls_ssl_cache_sharded_setup(&cache, (size_t) opt.cache_shards,
+                                               (size_t) opt.cache_max)) != 0) {
+        mbedtls_printf(" failed\n  ! mbedtls_ssl_cache_sharded_setup returned %d\n\n", ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_session_cache(&conf, &cache,
+                                   mbedtls_ssl_cache_sharded_get,
+                                   mbedtls_ssl_cache_sharded_set);
+#elif defined(MBEDTLS_SSL_CACHE_C)
+    if (opt.cache_max != 0) {
+        mbedtls_ssl_cache_set_max_entries(&cache, opt.cache_max);
+    }
+    mbedtls_ssl_conf_session_cache(&conf, &cache,
+                                   mbedtls_ssl_cache_get,
+                                   mbedtls_ssl_cache_set);
+#endif
+
+#if defined(MBEDTLS_SSL_TICKET_C)
+    if (opt.tickets) {
+        if ((ret = mbedtls_ssl_ticket_setup(&ticket_ctx,
+                                            mbedtls_ctr_drbg_random, &ctr_drbg,
+                                            MBEDTLS_CIPHER_AES_256_GCM,
+                                            86400)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_ssl_ticket_setup returned %d\n\n", ret);
+            goto exit;
+        }
+        mbedtls_ssl_conf_session_tickets_cb(&conf,
+                                            mbedtls_ssl_ticket_write,
+                                            mbedtls_ssl_ticket_parse,
+                                            &ticket_ctx);
+    }
+#endif
+
+    if ((ret = mbedtls_ssl_conf_own_cert(&conf, &srvcert, &pkey)) != 0) {
+        mbedtls_printf(" failed\n  ! mbedtls_ssl_conf_own_cert returned %d\n\n", ret);
+        goto exit;
+    }
+
+    mbedtls_printf(" ok\n");
+
+    /*
+     * 4. Set up the threads: listening socket, reactor and connections
+     */
+    mbedtls_printf("  . Bind on https://%s:%s/ with %d threads ...",
+                   opt.server_addr != NULL ? opt.server_addr : "localhost",
+                   opt.server_port, opt.threads);
+    fflush(stdout);
+
+    for (set_up = 0; set_up < opt.threads; set_up++) {
+        if ((ret = thread_setup(&threads[set_up], set_up, &entropy)) != 0) {
+            mbedtls_printf(" failed\n  ! thread %d setup returned -0x%04x\n\n",
+                           set_up, (unsigned int) -ret);
+            set_up++;
+            goto exit;
+        }
+    }
+
+    for (started = 0; started < opt.threads; started++) {
+        if ((ret = pthread_create(&threads[started].thread, NULL, thread_main,
+                                  &threads[started])) != 0) {
+            mbedtls_printf(" failed\n  ! pthread_create returned %d\n\n", ret);
+            goto stop;
+        }
+    }
+
+    mbedtls_printf(" ok\n");
+    fflush(stdout);
+
+    /*
+     * 5. Report the statistics until the duration is over or a thread fails
+     */
+    start = last_us = server_usec();
+    while (!stop) {
+        sleep(opt.stats_interval != 0 ? (unsigned) opt.stats_interval : 1);
+        now = server_usec();
+
+        if (opt.stats_interval != 0) {
+            print_stats(&last, now - last_us);
+            last_us = now;
+        }
+
+        for (i = 0; i < opt.threads; i++) {
+            if (mbedtls_mutex_lock(&threads[i].mutex) == 0) {
+                stop |= threads[i].stop;
+                mbedtls_mutex_unlock(&threads[i].mutex);
+            }
+        }
+        if (opt.duration != 0 &&
+            now - start >= (unsigned long long) opt.duration * 1000000) {
+            stop = 1;
+        }
+    }
+
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+stop:
+    for (i = 0; i < started; i++) {
+        if (mbedtls_mutex_lock(&threads[i].mutex) == 0) {
+            threads[i].stop = 1;
+            mbedtls_mutex_unlock(&threads[i].mutex);
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (threads[i].ret != 0) {
+            mbedtls_printf("  ! thread %d: mbedtls_net_reactor_dispatch returned -0x%04x\n",
+                           i, (unsigned int) -threads[i].ret);
+            exit_code = MBEDTLS_EXIT_FAILURE;
+        }
+    }
+
+    if (started == opt.threads) {
+        memset(&last, 0, sizeof(last));
+        mbedtls_printf("  . Total since start:\n");
+        print_stats(&last, server_usec() - start);
+    }
+
+    goto exit;
+
+usage:
+    mbedtls_printf(USAGE, MAX_THREADS, DFL_THREADS, DFL_MAX_CONNECTIONS,
+                   DFL_DURATION, DFL_STATS_INTERVAL, DFL_TICKETS);
+
+exit:
+#ifdef MBEDTLS_ERROR_C
+    if (exit_code != MBEDTLS_EXIT_SUCCESS && ret < 0) {
+        char error_buf[100];
+        mbedtls_strerror(ret, error_buf, 100);
+        mbedtls_printf("  Last error was: -0x%04x - %s\n", (unsigned int) -ret,
+                       error_buf);
+    }
+#endif
+
+    /* Free the listening socket shared by the other threads last. */
+    for (i = set_up - 1; i >= 0; i--) {
+        thread_free(&threads[i]);
+    }
+    mbedtls_x509_crt_free(&srvcert);
+    mbedtls_pk_free(&pkey);
+#if defined(MBEDTLS_SSL_CACHE_SHARDED_C)
+    mbedtls_ssl_cache_sharded_free(&cache);
+#elif defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_free(&cache);
+#endif
+#if defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&ticket_ctx);
+#endif
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_ssl_config_free(&conf);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+}
+
+#endif /* configuration allows running this program */
@@ -0,0 +1,344 @@
+/*
+ *  Benchmark for the TLS record protection layer
+ *
+ *  Times mbedtls_ssl_encrypt_buf() and mbedtls_ssl_decrypt_buf() on real
+ *  transforms for a range of ciphersuite-like configurations and record
+ *  sizes, without any handshake or I/O involved.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_TLS_C) || !defined(MBEDTLS_HAVE_TIME)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_TLS_C and/or MBEDTLS_HAVE_TIME not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/ssl.h"
+#include "psa/crypto.h"
+
+#include "ssl_misc.h"
+#include <test/ssl_helpers.h>
+
+#define DFL_DURATION_MS         250
+
+/*
+ * Room left in front of and after the plaintext. This covers the explicit
+ * IV / nonce, the MAC or tag, CBC padding and the TLS 1.3 inner content
+ * type.
+ */
+#define RECORD_PRE_ROOM         64
+#define RECORD_POST_ROOM        512
+
+#define USAGE \
+    "\n usage: ssl_record_bench param=<>...\n"                          \
+    "\n acceptable parameters:\n"                                       \
+    "    duration=%%d        milliseconds per measurement\n"            \
+    "                        default: %d\n"                             \
+    "    version=%%s         tls12, tls13 or all\n"                     \
+    "                        default: all\n"                            \
+    "\n"
+
+/*
+ * Cycle counter. Only provided where it is cheap and reliable to read;
+ * elsewhere cycles/record is reported as "-".
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__amd64__) || \
+    defined(__i386__))
+#define HAVE_CYCLE_COUNTER
+static unsigned long long bench_cycles(void)
+{
+    unsigned int lo, hi;
+    __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+    return ((unsigned long long) hi << 32) | lo;
+}
+#endif
+
+typedef struct {
+    const char *name;
+    int cipher_type;
+    int hash_id;
+    int etm;
+    mbedtls_ssl_protocol_version version;
+    size_t cid_len;
+} record_bench_config;
+
+static const record_bench_config configs[] = {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    { "1.2 AES-128-GCM", MBEDTLS_CIPHER_AES_128_GCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+    { "1.2 AES-256-GCM", MBEDTLS_CIPHER_AES_256_GCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+    { "1.2 AES-128-CCM", MBEDTLS_CIPHER_AES_128_CCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+    { "1.2 CHACHA20-POLY1305", MBEDTLS_CIPHER_CHACHA20_POLY1305,
+      MBEDTLS_MD_NONE, 0, MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+    { "1.2 AES-128-CBC-SHA256", MBEDTLS_CIPHER_AES_128_CBC, MBEDTLS_MD_SHA256,
+      0, MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+    { "1.2 AES-128-CBC-SHA256 EtM", MBEDTLS_CIPHER_AES_128_CBC,
+      MBEDTLS_MD_SHA256, 1, MBEDTLS_SSL_VERSION_TLS1_2, 0 },
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    { "1.2 AES-128-GCM CID", MBEDTLS_CIPHER_AES_128_GCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_2, 4 },
+    { "1.2 CHACHA20-POLY1305 CID", MBEDTLS_CIPHER_CHACHA20_POLY1305,
+      MBEDTLS_MD_NONE, 0, MBEDTLS_SSL_VERSION_TLS1_2, 4 },
+    { "1.2 AES-128-CBC-SHA256 EtM CID", MBEDTLS_CIPHER_AES_128_CBC,
+      MBEDTLS_MD_SHA256, 1, MBEDTLS_SSL_VERSION_TLS1_2, 4 },
+#endif /* MBEDTLS_SSL_DTLS_CONNECTION_ID */
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    { "1.3 AES-128-GCM", MBEDTLS_CIPHER_AES_128_GCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_3, 0 },
+    { "1.3 AES-256-GCM", MBEDTLS_CIPHER_AES_256_GCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_3, 0 },
+    { "1.3 AES-128-CCM", MBEDTLS_CIPHER_AES_128_CCM, MBEDTLS_MD_NONE, 0,
+      MBEDTLS_SSL_VERSION_TLS1_3, 0 },
+    { "1.3 CHACHA20-POLY1305", MBEDTLS_CIPHER_CHACHA20_POLY1305,
+      MBEDTLS_MD_NONE, 0, MBEDTLS_SSL_VERSION_TLS1_3, 0 },
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+};
+
+static const size_t record_sizes[] = { 64, 256, 1024, 4096, 16384 };
+
+static void record_setup(mbedtls_record *rec, unsigned char *buf,
+                         size_t buf_len, size_t data_len)
+{
+    memset(rec->ctr, 0, sizeof(rec->ctr));
+    rec->type = MBEDTLS_SSL_MSG_APPLICATION_DATA;
+    rec->ver[0] = 0x03;
+    rec->ver[1] = 0x03;
+    rec->buf = buf;
+    rec->buf_len = buf_len;
+    rec->data_offset = RECORD_PRE_ROOM;
+    rec->data_len = data_len;
+#if defined(MBEDTLS_SSL_DTLS_CONNECTION_ID)
+    rec->cid_len = 0;
+#endif
+}
+
+typedef struct {
+    unsigned long records;
+    mbedtls_ms_time_t ms;
+    unsigned long long cycles;
+} bench_result;
+
+/*
+ * Run encryption only (round_trip == 0) or encryption followed by
+ * decryption of the same record (round_trip != 0) for at least
+ * duration_ms milliseconds. Decryption restores the plaintext in place,
+ * so the round trip can be repeated without copying any data.
+ */
+static int bench_run(mbedtls_ssl_context *ssl,
+                     mbedtls_ssl_transform *t_enc,
+                     mbedtls_ssl_transform *t_dec,
+                     unsigned char *buf, size_t buf_len, size_t data_len,
+                     int round_trip, mbedtls_ms_time_t duration_ms,
+                     bench_result *res)
+{
+    int ret = 0;
+    mbedtls_record rec;
+    mbedtls_ms_time_t start;
+#if defined(HAVE_CYCLE_COUNTER)
+    unsigned long long c_start;
+#endif
+
+    memset(res, 0, sizeof(*res));
+
+    start = mbedtls_ms_time();
+#if defined(HAVE_CYCLE_COUNTER)
+    c_start = bench_cycles();
+#endif
+    do {
+        /* Check the clock only every few records, it is not free. */
+        for (int i = 0; i < 16; i++) {
+            record_setup(&rec, buf, buf_len, data_len);
+            ret = mbedtls_ssl_encrypt_buf(ssl, t_enc, &rec,
+                                          mbedtls_test_rnd_std_rand, NULL);
+            if (ret != 0) {
+                return ret;
+            }
+            if (round_trip) {
+                ret = mbedtls_ssl_decrypt_buf(ssl, t_dec, &rec);
+                if (ret != 0) {
+                    return ret;
+                }
+            }
+        }
+        res->records += 16;
+        res->ms = mbedtls_ms_time() - start;
+    } while (res->ms < duration_ms);
+#if defined(HAVE_CYCLE_COUNTER)
+    res->cycles = bench_cycles() - c_start;
+#endif
+
+    return 0;
+}
+
+static void print_result(const char *what, size_t data_len,
+                         unsigned long records, mbedtls_ms_time_t ms,
+                         unsigned long long cycles)
+{
+    double mbps = 0;
+
+    if (ms > 0) {
+        mbps = ((double) records * data_len) / ((double) ms * 1000.0);
+    }
+    mbedtls_printf("  %s %9.1f MB/s", what, mbps);
+#if defined(HAVE_CYCLE_COUNTER)
+    mbedtls_printf(" %9llu cycles/rec", records ? cycles / records : 0);
+#else
+    (void) cycles;
+    mbedtls_printf("         - cycles/rec");
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 0;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    mbedtls_ms_time_t duration_ms = DFL_DURATION_MS;
+    int want_tls12 = 1, want_tls13 = 1;
+    unsigned char *buf = NULL;
+    size_t buf_len;
+    mbedtls_ssl_context ssl; /* only used for debug output */
+    char *p, *q;
+
+    for (int i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "duration") == 0) {
+            duration_ms = atoi(q);
+            if (duration_ms <= 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "version") == 0) {
+            if (strcmp(q, "tls12") == 0) {
+                want_tls13 = 0;
+            } else if (strcmp(q, "tls13") == 0) {
+                want_tls12 = 0;
+            } else if (strcmp(q, "all") != 0) {
+                goto usage;
+            }
+        } else {
+            goto usage;
+        }
+    }
+
+    mbedtls_ssl_init(&ssl);
+
+    ret = psa_crypto_init();
+    if (ret != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto: %d\n", ret);
+        goto exit;
+    }
+
+    buf_len = RECORD_PRE_ROOM +
+              record_sizes[sizeof(record_sizes) / sizeof(record_sizes[0]) - 1] +
+              RECORD_POST_ROOM;
+    buf = mbedtls_calloc(1, buf_len);
+    if (buf == NULL) {
+        mbedtls_fprintf(stderr, "Failed to allocate %u bytes\n",
+                        (unsigned) buf_len);
+        goto exit;
+    }
+
+    mbedtls_printf("\n  %-32s %6s\n", "configuration", "size");
+
+    for (size_t c = 0; c < sizeof(configs) / sizeof(configs[0]); c++) {
+        const record_bench_config *cfg = &configs[c];
+        mbedtls_ssl_transform t_dec, t_enc;
+
+        if ((cfg->version == MBEDTLS_SSL_VERSION_TLS1_2 && !want_tls12) ||
+            (cfg->version == MBEDTLS_SSL_VERSION_TLS1_3 && !want_tls13)) {
+            continue;
+        }
+
+        mbedtls_ssl_transform_init(&t_dec);
+        mbedtls_ssl_transform_init(&t_enc);
+
+        ret = mbedtls_test_ssl_build_transforms(&t_dec, &t_enc,
+                                                cfg->cipher_type, cfg->hash_id,
+                                                cfg->etm, 0, cfg->version,
+                                                cfg->cid_len, cfg->cid_len);
+        if (ret != 0) {
+            mbedtls_printf("  %-32s skipped (not supported in this build)\n",
+                           cfg->name);
+            goto next;
+        }
+
+        for (size_t s = 0; s < sizeof(record_sizes) / sizeof(record_sizes[0]);
+             s++) {
+            bench_result enc, rt;
+            unsigned long long dec_cycles = 0;
+
+            ret = bench_run(&ssl, &t_enc, &t_dec, buf, buf_len,
+                            record_sizes[s], 0, duration_ms, &enc);
+            if (ret == 0) {
+                ret = bench_run(&ssl, &t_enc, &t_dec, buf, buf_len,
+                                record_sizes[s], 1, duration_ms, &rt);
+            }
+            if (ret != 0) {
+                mbedtls_printf("  %-32s %6u failed: -0x%04x\n", cfg->name,
+                               (unsigned) record_sizes[s],
+                               (unsigned int) -ret);
+                continue;
+            }
+
+            /*
+             * Decryption cost is the round trip cost minus the cost of
+             * the encryption it contains, scaled to the same number of
+             * records.
+             */
+            mbedtls_ms_time_t enc_ms_scaled =
+                (mbedtls_ms_time_t) ((double) enc.ms * rt.records / enc.records);
+            unsigned long long enc_cycles_scaled =
+                (unsigned long long) ((double) enc.cycles * rt.records /
+                                      enc.records);
+            if (rt.cycles > enc_cycles_scaled) {
+                dec_cycles = rt.cycles - enc_cycles_scaled;
+            }
+
+            mbedtls_printf("  %-32s %6u", cfg->name, (unsigned) record_sizes[s]);
+            print_result("enc", record_sizes[s], enc.records, enc.ms,
+                         enc.cycles);
+            print_result("dec", record_sizes[s], rt.records,
+                         rt.ms > enc_ms_scaled ? rt.ms - enc_ms_scaled : 0,
+                         dec_cycles);
+            mbedtls_printf("\n");
+        }
+
+next:
+        mbedtls_ssl_transform_free(&t_dec);
+        mbedtls_ssl_transform_free(&t_enc);
+    }
+
+    mbedtls_printf("\n");
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+exit:
+    mbedtls_free(buf);
+    mbedtls_ssl_free(&ssl);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+
+usage:
+    mbedtls_printf(USAGE, DFL_DURATION_MS);
+    mbedtls_exit(MBEDTLS_EXIT_FAILURE);
+}
+
+#endif /* MBEDTLS_SSL_TLS_C && MBEDTLS_HAVE_TIME */
@@ -583,6 +583,7 @@ int main(void)
     "                                otherwise. The expansion of the macro\n" \
     "                                is printed if it is defined\n"           \
     USAGE_SERIALIZATION                                                       \
+    USAGE_STREAM                                                              \
     "\n"
 
 #define PUT_UINT64_BE(out_be, in_le, i)                                   \
@@ -649,6 +650,7 @@ struct options {
     int renego_delay;           /* delay before enforcing renegotiation     */
     uint64_t renego_period;     /* period for automatic renegotiation       */
     int exchanges;              /* number of data exchanges                 */
+    stream_options stream;      /* bulk transfer instead of exchanges       */
     int min_version;            /* minimum protocol version accepted        */
     int max_version;            /* maximum protocol version accepted        */
     int allow_sha1;             /* flag for SHA-1 support                   */
@@ -1265,6 +1267,18 @@ static int ssl_async_resume(mbedtls_ssl_context *ssl,
                                      config_data->f_rng, config_data->p_rng);
             break;
         case ASYNC_OP_SIGN:
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+            /* TLS 1.3 signs with RSASSA-PSS only. */
+            if (mbedtls_ssl_get_version_number(ssl) == MBEDTLS_SSL_VERSION_TLS1_3 &&
+                mbedtls_pk_can_do(key_slot->pk, MBEDTLS_PK_RSA)) {
+                ret = mbedtls_pk_sign_ext(MBEDTLS_PK_RSASSA_PSS, key_slot->pk,
+                                          ctx->md_alg,
+                                          ctx->input, ctx->input_len,
+                                          output, output_size, output_len,
+                                          config_data->f_rng, config_data->p_rng);
+                break;
+            }
+#endif
             ret = mbedtls_pk_sign(key_slot->pk,
                                   ctx->md_alg,
                                   ctx->input, ctx->input_len,
@@ -1619,7 +1633,15 @@ int main(int argc, char *argv[])
     mbedtls_memory_buffer_alloc_init(alloc_buf, sizeof(alloc_buf));
 #if defined(MBEDTLS_MEMORY_DEBUG)
     size_t current_heap_memory, peak_heap_memory, heap_blocks;
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    size_t base_heap_memory;
+#endif
 #endif  /* MBEDTLS_MEMORY_DEBUG */
+#elif defined(MBEDTLS_MEMORY_PROFILE)
+    mbedtls_memory_profile_usage memory_usage;
+    mbedtls_memory_tag memory_tag;
+
+    mbedtls_memory_profile_init();
 #endif  /* MBEDTLS_MEMORY_BUFFER_ALLOC_C */
 
 #if defined(MBEDTLS_TEST_HOOKS)
@@ -1728,6 +1750,7 @@ int main(int argc, char *argv[])
     opt.renego_delay        = DFL_RENEGO_DELAY;
     opt.renego_period       = DFL_RENEGO_PERIOD;
     opt.exchanges           = DFL_EXCHANGES;
+    stream_options_init(&opt.stream);
     opt.min_version         = DFL_MIN_VERSION;
     opt.max_version         = DFL_MAX_VERSION;
     opt.allow_sha1          = DFL_SHA1;
@@ -1832,6 +1855,15 @@ usage:
         }
         *q++ = '\0';
 
+        if ((ret = stream_option_parse(&opt.stream, p, q)) != 0) {
+            if (ret < 0) {
+                ret = 0;
+                goto usage;
+            }
+            ret = 0;
+            continue;
+        }
+
         if (strcmp(p, "server_port") == 0) {
             opt.server_port = q;
         } else if (strcmp(p, "server_addr") == 0) {
@@ -2372,6 +2404,13 @@ usage:
     }
 #endif /* MBEDTLS_USE_PSA_CRYPTO */
 
+    if (opt.stream.mode != STREAM_NONE &&
+        opt.transport != MBEDTLS_SSL_TRANSPORT_STREAM) {
+        mbedtls_printf("stream is only supported with TLS\n");
+        ret = 2;
+        goto usage;
+    }
+
     if (opt.force_ciphersuite[0] > 0) {
         const mbedtls_ssl_ciphersuite_t *ciphersuite_info;
         ciphersuite_info =
@@ -3253,6 +3292,16 @@ usage:
         mbedtls_ssl_conf_max_tls_version(&conf, opt.max_version);
     }
 
+    if (opt.stream.write_batch > 1) {
+        mbedtls_ssl_conf_write_batch(&conf, (unsigned char) opt.stream.write_batch);
+    }
+
+#if defined(MBEDTLS_MEMORY_DEBUG) && defined(MBEDTLS_SSL_STATIC_MEMORY)
+    /* What the connection uses is counted from here. */
+    mbedtls_memory_buffer_alloc_max_reset();
+    mbedtls_memory_buffer_alloc_cur_get(&base_heap_memory, &heap_blocks);
+#endif
+
     if ((ret = mbedtls_ssl_setup(&ssl, &conf)) != 0) {
         mbedtls_printf(" failed\n  ! mbedtls_ssl_setup returned -0x%x\n\n", (unsigned int) -ret);
         goto exit;
@@ -3713,8 +3762,34 @@ handshake:
     mbedtls_memory_buffer_alloc_max_get(&peak_heap_memory, &heap_blocks);
     mbedtls_printf("Heap memory usage after handshake: %lu bytes. Peak memory usage was %lu\n",
                    (unsigned long) current_heap_memory, (unsigned long) peak_heap_memory);
+#if defined(MBEDTLS_SSL_STATIC_MEMORY)
+    mbedtls_printf("Connection memory usage: peak %lu bytes, budget %lu bytes\n",
+                   (unsigned long) (peak_heap_memory - base_heap_memory),
+                   (unsigned long) MBEDTLS_SSL_CONNECTION_MEMORY);
+#endif
+#elif defined(MBEDTLS_MEMORY_PROFILE) && !defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
+    for (memory_tag = MBEDTLS_MEMORY_TAG_OTHER; memory_tag < MBEDTLS_MEMORY_TAG_COUNT;
+         memory_tag++) {
+        mbedtls_memory_profile_get(memory_tag, &memory_usage);
+        mbedtls_printf("Heap memory usage of %s after handshake: %lu bytes in %lu blocks."
+                       " Peak memory usage was %lu\n",
+                       mbedtls_memory_profile_tag_name(memory_tag),
+                       (unsigned long) memory_usage.current,
+                       (unsigned long) memory_usage.blocks,
+                       (unsigned long) memory_usage.peak);
+    }
+    mbedtls_memory_profile_reset_peak();
 #endif  /* MBEDTLS_MEMORY_DEBUG */
 
+#if defined(MBEDTLS_HAVE_TIME)
+    if (opt.stream.mode != STREAM_NONE) {
+        if ((ret = stream_run(&ssl, &client_fd, opt.event, &opt.stream)) != 0) {
+            goto reset;
+        }
+        goto close_notify;
+    }
+#endif /* MBEDTLS_HAVE_TIME */
+
     if (opt.exchanges == 0) {
         goto close_notify;
     }
@@ -4339,6 +4414,8 @@ exit:
     mbedtls_memory_buffer_alloc_status();
 #endif
     mbedtls_memory_buffer_alloc_free();
+#elif defined(MBEDTLS_MEMORY_PROFILE)
+    mbedtls_memory_profile_free();
 #endif  /* MBEDTLS_MEMORY_BUFFER_ALLOC_C */
 
     if (opt.query_config_mode == DFL_QUERY_CONFIG_MODE) {
@@ -11,6 +11,8 @@
 
 #include "ssl_test_lib.h"
 
+#include <time.h>
+
 #if defined(MBEDTLS_TEST_HOOKS)
 #include "test/threading_helpers.h"
 #endif
@@ -439,6 +441,259 @@ int idle(mbedtls_net_context *fd,
     return 0;
 }
 
+#define STREAM_MAX_IOVEC        16
+
+void stream_options_init(stream_options *so)
+{
+    so->mode = STREAM_NONE;
+    so->mb = 1024;
+    so->write_size = 16384;
+    so->iovec = 0;
+    so->write_batch = 1;
+    so->ktls = 0;
+}
+
+int stream_option_parse(stream_options *so, const char *name, const char *value)
+{
+#if defined(MBEDTLS_HAVE_TIME)
+    if (strcmp(name, "stream") == 0) {
+        if (strcmp(value, "none") == 0) {
+            so->mode = STREAM_NONE;
+        } else if (strcmp(value, "send") == 0) {
+            so->mode = STREAM_SEND;
+        } else if (strcmp(value, "recv") == 0) {
+            so->mode = STREAM_RECV;
+        } else {
+            return -1;
+        }
+    } else if (strcmp(name, "stream_mb") == 0) {
+        so->mb = atoi(value);
+        if (so->mb < 1 || so->mb > 1024 * 1024) {
+            return -1;
+        }
+    } else if (strcmp(name, "write_size") == 0) {
+        so->write_size = atoi(value);
+        if (so->write_size < 1 || so->write_size > 16 * 1024 * 1024) {
+            return -1;
+        }
+    } else if (strcmp(name, "iovec") == 0) {
+        so->iovec = atoi(value);
+        if (so->iovec < 0 || so->iovec > STREAM_MAX_IOVEC) {
+            return -1;
+        }
+    } else if (strcmp(name, "write_batch") == 0) {
+        so->write_batch = atoi(value);
+        if (so->write_batch < 1 || so->write_batch > 255) {
+            return -1;
+        }
+#if defined(MBEDTLS_SSL_KTLS)
+    } else if (strcmp(name, "ktls") == 0) {
+        so->ktls = atoi(value);
+        if (so->ktls < 0 || so->ktls > 1) {
+            return -1;
+        }
+#endif
+    } else {
+        return 0;
+    }
+
+    return 1;
+#else
+    /* The transfer needs a clock to report its rate */
+    (void) so;
+    (void) name;
+    (void) value;
+    return 0;
+#endif /* MBEDTLS_HAVE_TIME */
+}
+
+#if defined(MBEDTLS_HAVE_TIME)
+static void stream_report(const char *verb, unsigned long long bytes,
+                          mbedtls_ms_time_t start_ms, clock_t start_cpu)
+{
+    mbedtls_ms_time_t ms = mbedtls_ms_time() - start_ms;
+    double cpu_ns = (double) (clock() - start_cpu) * 1e9 / CLOCKS_PER_SEC;
+
+    if (ms <= 0) {
+        ms = 1;
+    }
+
+    mbedtls_printf("  . %s %llu bytes in %lld ms: %.1f Mbit/s goodput, "
+                   "%.2f ns CPU per byte\n", verb, bytes, (long long) ms,
+                   (double) bytes * 8 / 1000 / (double) ms,
+                   bytes != 0 ? cpu_ns / (double) bytes : 0.0);
+}
+
+static int stream_wait(mbedtls_net_context *fd, int event, int ret)
+{
+    if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+        return ret;
+    }
+    if (event == 1 /* level triggered IO */) {
+#if defined(MBEDTLS_TIMING_C)
+        return idle(fd, NULL, ret);
+#else
+        return idle(fd, ret);
+#endif
+    }
+    return 0;
+}
+
+static int stream_send(mbedtls_ssl_context *ssl, mbedtls_net_context *fd, int event,
+                       unsigned long long total, size_t write_size, int iovec)
+{
+    int ret = 0;
+    int i;
+    size_t j;
+    unsigned char *buf;
+    unsigned long long sent = 0;
+    mbedtls_ssl_iovec iov[STREAM_MAX_IOVEC];
+    mbedtls_ms_time_t start_ms;
+    clock_t start_cpu;
+
+    if (iovec > STREAM_MAX_IOVEC) {
+        iovec = STREAM_MAX_IOVEC;
+    }
+
+    buf = mbedtls_calloc(1, write_size);
+    if (buf == NULL) {
+        mbedtls_printf("  ! Failed to allocate %" MBEDTLS_PRINTF_SIZET " bytes\n",
+                       write_size);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    for (j = 0; j < write_size; j++) {
+        buf[j] = (unsigned char) ('a' + j % 26);
+    }
+
+    mbedtls_printf("  > Sending %llu bytes, %" MBEDTLS_PRINTF_SIZET
+                   " bytes per %s\n", total, write_size,
+                   iovec > 1 ? "mbedtls_ssl_writev()" : "mbedtls_ssl_write()");
+    fflush(stdout);
+
+    start_ms = mbedtls_ms_time();
+    start_cpu = clock();
+
+    while (sent < total) {
+        size_t len = write_size;
+
+        if (total - sent < len) {
+            len = (size_t) (total - sent);
+        }
+
+        /* A partial write leaves the rest of this block for the next call,
+         * so the data is always a prefix of buf. */
+        if (iovec > 1) {
+            size_t frag = (len + (size_t) iovec - 1) / (size_t) iovec;
+            size_t off = 0;
+
+            for (i = 0; i < iovec; i++) {
+                iov[i].base = buf + off;
+                iov[i].len = len - off < frag ? len - off : frag;
+                off += iov[i].len;
+            }
+            ret = mbedtls_ssl_writev(ssl, iov, (size_t) iovec);
+        } else {
+            ret = mbedtls_ssl_write(ssl, buf, len);
+        }
+
+        if (ret < 0) {
+            if ((ret = stream_wait(fd, event, ret)) != 0) {
+                mbedtls_printf("  ! write returned -0x%x\n", (unsigned int) -ret);
+                goto exit;
+            }
+            continue;
+        }
+        sent += (unsigned long long) ret;
+    }
+
+    stream_report("Sent", sent, start_ms, start_cpu);
+    ret = 0;
+
+exit:
+    mbedtls_free(buf);
+    return ret;
+}
+
+static int stream_recv(mbedtls_ssl_context *ssl, mbedtls_net_context *fd, int event,
+                       size_t read_size)
+{
+    int ret = 0;
+    unsigned char *buf;
+    unsigned long long received = 0;
+    mbedtls_ms_time_t start_ms = 0;
+    clock_t start_cpu = 0;
+
+    buf = mbedtls_calloc(1, read_size);
+    if (buf == NULL) {
+        mbedtls_printf("  ! Failed to allocate %" MBEDTLS_PRINTF_SIZET " bytes\n",
+                       read_size);
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+
+    mbedtls_printf("  < Receiving until the peer closes the connection\n");
+    fflush(stdout);
+
+    while (1) {
+        ret = mbedtls_ssl_read(ssl, buf, read_size);
+
+        if (ret > 0) {
+            /* Start the clocks at the first byte, not while waiting for
+             * the peer to start sending. */
+            if (received == 0) {
+                start_ms = mbedtls_ms_time();
+                start_cpu = clock();
+            }
+            received += (unsigned long long) ret;
+            continue;
+        }
+
+        if (ret == 0 || ret == MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY ||
+            ret == MBEDTLS_ERR_NET_CONN_RESET) {
+            break;
+        }
+
+        if ((ret = stream_wait(fd, event, ret)) != 0) {
+            mbedtls_printf("  ! mbedtls_ssl_read returned -0x%x\n", (unsigned int) -ret);
+            goto exit;
+        }
+    }
+
+    stream_report("Received", received, start_ms, start_cpu);
+    ret = 0;
+
+exit:
+    mbedtls_free(buf);
+    return ret;
+}
+
+int stream_run(mbedtls_ssl_context *ssl, mbedtls_net_context *fd, int event,
+               const stream_options *so)
+{
+#if defined(MBEDTLS_SSL_KTLS)
+    int ret;
+
+    if (so->ktls) {
+        mbedtls_printf("  . Offloading records to kernel TLS...");
+        fflush(stdout);
+        if ((ret = mbedtls_net_ktls_enable(fd, ssl, MBEDTLS_SSL_KTLS_TX |
+                                           MBEDTLS_SSL_KTLS_RX)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_net_ktls_enable returned -0x%x\n",
+                           (unsigned int) -ret);
+            return ret;
+        }
+        mbedtls_printf(" ok\n");
+    }
+#endif /* MBEDTLS_SSL_KTLS */
+
+    if (so->mode == STREAM_SEND) {
+        return stream_send(ssl, fd, event,
+                           (unsigned long long) so->mb * 1024 * 1024,
+                           (size_t) so->write_size, so->iovec);
+    }
+    return stream_recv(ssl, fd, event, (size_t) so->write_size);
+}
+#endif /* MBEDTLS_HAVE_TIME */
+
 #if defined(MBEDTLS_TEST_HOOKS)
 
 void test_hooks_init(void)
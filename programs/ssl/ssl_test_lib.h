@@ -64,6 +64,10 @@
 #include "mbedtls/memory_buffer_alloc.h"
 #endif
 
+#if defined(MBEDTLS_MEMORY_PROFILE)
+#include "mbedtls/memory_profile.h"
+#endif
+
 #include <test/helpers.h>
 
 #include "../test/query_config.h"
@@ -324,6 +328,66 @@ void test_hooks_free(void);
 
 #endif /* !MBEDTLS_TEST_HOOKS */
 
+/*
+ * Bulk transfer mode of ssl_client2 and ssl_server2: after the handshake,
+ * send application data as fast as possible, or receive it until the peer
+ * closes the connection, then print the goodput and the CPU time per byte.
+ */
+#define STREAM_NONE             0
+#define STREAM_SEND             1
+#define STREAM_RECV             2
+
+#if defined(MBEDTLS_SSL_KTLS)
+#define USAGE_STREAM_KTLS \
+    "    ktls=%%d             with stream, 1: offload the records to kernel\n" \
+    "                        TLS after the handshake. default: 0\n"
+#else
+#define USAGE_STREAM_KTLS ""
+#endif
+
+#if defined(MBEDTLS_HAVE_TIME)
+#define USAGE_STREAM \
+    "    stream=%%s           bulk transfer instead of exchanges (TLS only)\n" \
+    "                        options: none, send, recv. default: none\n"   \
+    "    stream_mb=%%d        MiB sent with stream=send. default: 1024\n"   \
+    "    write_size=%%d       bytes per write or read call. default: 16384\n" \
+    "    iovec=%%d            with stream=send, fragments per\n"            \
+    "                        mbedtls_ssl_writev() call.\n"                 \
+    "                        default: 0 (mbedtls_ssl_write())\n"           \
+    "    write_batch=%%d      records per flush. default: 1\n"             \
+    USAGE_STREAM_KTLS
+#else
+#define USAGE_STREAM ""
+#endif
+
+typedef struct {
+    int mode;                   /* STREAM_NONE, STREAM_SEND or STREAM_RECV  */
+    int mb;                     /* MiB to send                              */
+    int write_size;             /* bytes per write or read call             */
+    int iovec;                  /* fragments per mbedtls_ssl_writev() call  */
+    int write_batch;            /* records per flush                        */
+    int ktls;                   /* offload the records to kernel TLS        */
+} stream_options;
+
+void stream_options_init(stream_options *so);
+
+/** Parse a bulk transfer option.
+ *
+ * \return \c 1 if \p name is a bulk transfer option and \p value is valid,
+ *         \c -1 if \p value is not valid, \c 0 if \p name is another option.
+ */
+int stream_option_parse(stream_options *so, const char *name, const char *value);
+
+#if defined(MBEDTLS_HAVE_TIME)
+/** Run the bulk transfer selected by \p so on an established connection.
+ * With \p event, wait in idle() instead of retrying on WANT_READ/WRITE.
+ *
+ * \return \c 0 on success, or the error of the failing library call.
+ */
+int stream_run(mbedtls_ssl_context *ssl, mbedtls_net_context *fd, int event,
+               const stream_options *so);
+#endif /* MBEDTLS_HAVE_TIME */
+
 /* Helper functions for FFDH groups. */
 int parse_groups(const char *groups, uint16_t *group_list, size_t group_list_len);
 
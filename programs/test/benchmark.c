@@ -5,6 +5,11 @@
  *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
  */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+/* For pthread_setaffinity_np() and CPU_SET() */
+#define _GNU_SOURCE
+#endif
+
 #include "mbedtls/build_info.h"
 
 #include "mbedtls/platform.h"
@@ -19,6 +24,8 @@ int main(void)
 
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
+#include <limits.h>
 
 #include "mbedtls/md5.h"
 #include "mbedtls/ripemd160.h"
@@ -41,6 +48,8 @@ int main(void)
 #include "mbedtls/ctr_drbg.h"
 #include "mbedtls/hmac_drbg.h"
 
+#include "mbedtls/ssl.h"
+
 #include "mbedtls/rsa.h"
 #include "mbedtls/dhm.h"
 #include "mbedtls/ecdsa.h"
@@ -81,6 +90,16 @@ struct _hr_time {
 #include "mbedtls/memory_buffer_alloc.h"
 #endif
 
+#if defined(MBEDTLS_THREADING_PTHREAD) && \
+    !(defined(_WIN32) && !defined(EFIX64) && !defined(EFI32))
+#define BENCHMARK_THREADS
+#include <pthread.h>
+#endif
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
 #ifdef MBEDTLS_TIMING_ALT
 void mbedtls_set_alarm(int seconds);
 unsigned long mbedtls_timing_hardclock(void);
@@ -112,8 +131,136 @@ static unsigned long mbedtls_timing_hardclock(void);
     "des3, des, camellia, chacha20,\n"                                       \
     "aes_cbc, aes_cfb128, aes_cfb8, aes_gcm, aes_ccm, aes_xts, chachapoly\n" \
     "aes_cmac, des3_cmac, poly1305\n"                                        \
-    "ctr_drbg, hmac_drbg\n"                                                  \
-    "rsa, dhm, ecdsa, ecdh.\n"
+    "ctr_drbg, hmac_drbg, tls_prf\n"                                         \
+    "rsa, dhm, ecdsa, ecdh,\n"                                               \
+    "csv, json, threads=N, runs=N, warmup=N, pin=CPU.\n"
+
+#define FORMAT_TEXT     0
+#define FORMAT_CSV      1
+#define FORMAT_JSON     2
+
+/* Upper bound of runs=N + warmup=N. */
+#define BENCHMARK_MAX_RUNS  64
+
+static int output_format = FORMAT_TEXT;
+static unsigned output_count = 0;
+static unsigned bench_runs = 1;     /* measured runs of each case */
+static unsigned bench_warmup = 0;   /* discarded runs before them */
+static long bench_pin = -1;         /* first CPU to run on, -1 for any */
+
+/* Integer square root, for the standard deviation. */
+static unsigned long long bench_isqrt(unsigned long long n)
+{
+    unsigned long long x = n, y = (n + 1) / 2;
+
+    while (y < x) {
+        x = y;
+        y = (x + n / x) / 2;
+    }
+
+    return x;
+}
+
+/*
+ * Median and sample standard deviation of the count results of a case,
+ * rates[] being sorted as a side effect. With a single run the standard
+ * deviation is 0.
+ */
+static void bench_stats(unsigned long *rates, unsigned count,
+                        unsigned long *median, unsigned long *stddev)
+{
+    unsigned i, j;
+    unsigned long tmp;
+    unsigned long long sum = 0, var = 0, mean, diff;
+
+    *median = 0;
+    *stddev = 0;
+    if (count == 0) {
+        return;
+    }
+
+    for (i = 1; i < count; i++) {
+        tmp = rates[i];
+        for (j = i; j > 0 && rates[j - 1] > tmp; j--) {
+            rates[j] = rates[j - 1];
+        }
+        rates[j] = tmp;
+    }
+
+    *median = count % 2 != 0 ? rates[count / 2] :
+              (rates[count / 2 - 1] + rates[count / 2]) / 2;
+
+    if (count > 1) {
+        for (i = 0; i < count; i++) {
+            sum += rates[i];
+        }
+        mean = sum / count;
+        for (i = 0; i < count; i++) {
+            diff = rates[i] > mean ? rates[i] - mean : mean - rates[i];
+            var += diff * diff;
+        }
+        *stddev = (unsigned long) bench_isqrt(var / (count - 1));
+    }
+}
+
+/* Spread of the runs, in the human-readable output. */
+static void print_stats(unsigned long stddev)
+{
+    if (bench_runs > 1) {
+        mbedtls_printf(",  median of %u, stddev %lu", bench_runs, stddev);
+    }
+}
+
+/* Start a result line of the human-readable output. */
+static void print_title(const char *title)
+{
+    if (output_format == FORMAT_TEXT) {
+        mbedtls_printf(HEADER_FORMAT, title);
+        fflush(stdout);
+    }
+}
+
+/*
+ * One measurement in the CSV or JSON output, or the result part of a
+ * multi-threaded measurement in the human-readable output. total is the
+ * median throughput of all threads together, min and max that of the
+ * slowest and fastest thread, stddev the spread of total over the runs.
+ */
+static void print_record(const char *title, const char *unit, unsigned threads,
+                         unsigned long total, unsigned long min, unsigned long max,
+                         unsigned long cycles, unsigned long stddev, int ret)
+{
+    while (*unit == ' ') {
+        unit++;
+    }
+
+    if (output_format == FORMAT_CSV) {
+        if (output_count == 0) {
+            mbedtls_printf("title,unit,threads,total,per_thread_min,"
+                           "per_thread_max,cycles_per_byte,runs,stddev,error\n");
+        }
+        mbedtls_printf("%s,%s,%u,%lu,%lu,%lu,%lu,%u,%lu,%d\n",
+                       title, unit, threads, total, min, max, cycles,
+                       bench_runs, stddev, ret);
+    } else if (output_format == FORMAT_JSON) {
+        mbedtls_printf("%s  {\"title\": \"%s\", \"unit\": \"%s\", \"threads\": %u, "
+                       "\"total\": %lu, \"per_thread_min\": %lu, "
+                       "\"per_thread_max\": %lu, \"cycles_per_byte\": %lu, "
+                       "\"runs\": %u, \"stddev\": %lu, \"error\": %d}",
+                       output_count == 0 ? "" : ",\n",
+                       title, unit, threads, total, min, max, cycles,
+                       bench_runs, stddev, ret);
+    } else if (ret != 0) {
+        mbedtls_printf("FAILED: -0x%04x\n", (unsigned int) -ret);
+    } else {
+        mbedtls_printf("%9lu %s, %3u threads, %9lu - %lu per thread",
+                       total, unit, threads, min, max);
+        print_stats(stddev);
+        mbedtls_printf("\n");
+    }
+
+    output_count++;
+}
 
 #if defined(MBEDTLS_ERROR_C)
 #define PRINT_ERROR                                                     \
@@ -128,16 +275,24 @@ static unsigned long mbedtls_timing_hardclock(void);
 #define TIME_AND_TSC(TITLE, CODE)                                     \
     do {                                                                    \
         unsigned long ii, jj, tsc;                                          \
+        unsigned long rates[BENCHMARK_MAX_RUNS], median, stddev;            \
+        unsigned run;                                                       \
         int ret = 0;                                                        \
                                                                         \
-        mbedtls_printf(HEADER_FORMAT, TITLE);                             \
-        fflush(stdout);                                                   \
+        print_title(TITLE);                                               \
                                                                         \
-        mbedtls_set_alarm(1);                                             \
-        for (ii = 1; ret == 0 && !mbedtls_timing_alarmed; ii++)           \
+        for (run = 0; ret == 0 && run < bench_warmup + bench_runs; run++)   \
         {                                                                   \
-            ret = CODE;                                                     \
+            mbedtls_set_alarm(1);                                         \
+            for (ii = 1; ret == 0 && !mbedtls_timing_alarmed; ii++)       \
+            {                                                               \
+                ret = CODE;                                                 \
+            }                                                               \
+            if (run >= bench_warmup) {                                      \
+                rates[run - bench_warmup] = ii * BUFSIZE / 1024;            \
+            }                                                               \
         }                                                                   \
+        bench_stats(rates, ret == 0 ? bench_runs : 0, &median, &stddev);    \
                                                                         \
         tsc = mbedtls_timing_hardclock();                                   \
         for (jj = 0; ret == 0 && jj < 1024; jj++)                          \
@@ -145,16 +300,24 @@ static unsigned long mbedtls_timing_hardclock(void);
             ret = CODE;                                                     \
         }                                                                   \
                                                                         \
-        if (ret != 0)                                                      \
+        if (output_format != FORMAT_TEXT)                                  \
+        {                                                                   \
+            print_record(TITLE, "KiB/s", 1, median, median, median,         \
+                         jj == 0 ? 0 : (mbedtls_timing_hardclock() - tsc)   \
+                         / (jj * BUFSIZE), stddev, ret);                    \
+        }                                                                   \
+        else if (ret != 0)                                                 \
         {                                                                   \
             PRINT_ERROR;                                                    \
         }                                                                   \
         else                                                                \
         {                                                                   \
-            mbedtls_printf("%9lu KiB/s,  %9lu cycles/byte\n",              \
-                           ii * BUFSIZE / 1024,                           \
+            mbedtls_printf("%9lu KiB/s,  %9lu cycles/byte",                \
+                           median,                                        \
                            (mbedtls_timing_hardclock() - tsc)           \
                            / (jj * BUFSIZE));                          \
+            print_stats(stddev);                                          \
+            mbedtls_printf("\n");                                         \
         }                                                                   \
     } while (0)
 
@@ -202,33 +365,49 @@ static unsigned long mbedtls_timing_hardclock(void);
 #define TIME_PUBLIC(TITLE, TYPE, CODE)                                \
     do {                                                                    \
         unsigned long ii;                                                   \
+        unsigned long rates[BENCHMARK_MAX_RUNS], median, stddev;            \
+        unsigned run;                                                       \
         int ret;                                                            \
         MEMORY_MEASURE_INIT;                                                \
                                                                         \
-        mbedtls_printf(HEADER_FORMAT, TITLE);                             \
-        fflush(stdout);                                                   \
-        mbedtls_set_alarm(3);                                             \
+        print_title(TITLE);                                               \
                                                                         \
         ret = 0;                                                            \
-        for (ii = 1; !mbedtls_timing_alarmed && !ret; ii++)             \
+        for (run = 0; ret == 0 && run < bench_warmup + bench_runs; run++)   \
         {                                                                   \
-            MEMORY_MEASURE_RESET;                                           \
-            CODE;                                                           \
+            mbedtls_set_alarm(3);                                         \
+            for (ii = 1; !mbedtls_timing_alarmed && !ret; ii++)         \
+            {                                                               \
+                MEMORY_MEASURE_RESET;                                       \
+                CODE;                                                       \
+            }                                                               \
+            if (run >= bench_warmup) {                                      \
+                rates[run - bench_warmup] = ii / 3;                         \
+            }                                                               \
         }                                                                   \
+        bench_stats(rates, ret == 0 ? bench_runs : 0, &median, &stddev);    \
                                                                         \
         if (ret == MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED)               \
         {                                                                   \
-            mbedtls_printf("Feature Not Supported. Skipping.\n");         \
+            if (output_format == FORMAT_TEXT) {                             \
+                mbedtls_printf("Feature Not Supported. Skipping.\n");     \
+            }                                                               \
             ret = 0;                                                        \
         }                                                                   \
+        else if (output_format != FORMAT_TEXT)                             \
+        {                                                                   \
+            print_record(TITLE, TYPE "/s", 1, median, median, median, 0,    \
+                         stddev, ret);                                      \
+        }                                                                   \
         else if (ret != 0)                                                 \
         {                                                                   \
             PRINT_ERROR;                                                    \
         }                                                                   \
         else                                                                \
         {                                                                   \
-            mbedtls_printf("%6lu " TYPE "/s", ii / 3);                    \
+            mbedtls_printf("%6lu " TYPE "/s", median);                    \
             MEMORY_MEASURE_PRINT(sizeof(TYPE) + 1);                     \
+            print_stats(stddev);                                          \
             mbedtls_printf("\n");                                         \
         }                                                                   \
     } while (0)
@@ -478,7 +657,9 @@ static int myrand(void *rng_state, unsigned char *output, size_t len)
     {                                                                   \
         int CHECK_AND_CONTINUE_ret = (R);                             \
         if (CHECK_AND_CONTINUE_ret == MBEDTLS_ERR_PLATFORM_FEATURE_UNSUPPORTED) { \
-            mbedtls_printf("Feature not supported. Skipping.\n");     \
+            if (output_format == FORMAT_TEXT) {                         \
+                mbedtls_printf("Feature not supported. Skipping.\n"); \
+            }                                                           \
             continue;                                                   \
         }                                                               \
         else if (CHECK_AND_CONTINUE_ret != 0) {                        \
@@ -500,6 +681,38 @@ static int set_ecp_curve(const char *string, mbedtls_ecp_curve_info *curve)
 }
 #endif
 
+#if defined(MBEDTLS_SSL_TLS_C) && defined(MBEDTLS_SSL_PROTO_TLS1_2)
+/* The PRF calls of a full handshake: the master secret from a P-256
+ * premaster, the key block of an AES-256-CBC suite and both Finished. */
+static int bench_tls12_prf(mbedtls_tls_prf_types prf)
+{
+    unsigned char premaster[32], master[48], randbytes[64], out[136];
+    int ret;
+
+    memset(premaster, 0x2A, sizeof(premaster));
+    memset(randbytes, 0x5C, sizeof(randbytes));
+
+    ret = mbedtls_ssl_tls_prf(prf, premaster, sizeof(premaster),
+                              "master secret", randbytes, sizeof(randbytes),
+                              master, sizeof(master));
+    if (ret == 0) {
+        ret = mbedtls_ssl_tls_prf(prf, master, sizeof(master), "key expansion",
+                                  randbytes, sizeof(randbytes),
+                                  out, sizeof(out));
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_tls_prf(prf, master, sizeof(master),
+                                  "client finished", randbytes, 32, out, 12);
+    }
+    if (ret == 0) {
+        ret = mbedtls_ssl_tls_prf(prf, master, sizeof(master),
+                                  "server finished", randbytes, 32, out, 12);
+    }
+
+    return ret;
+}
+#endif /* MBEDTLS_SSL_TLS_C && MBEDTLS_SSL_PROTO_TLS1_2 */
+
 unsigned char buf[BUFSIZE];
 
 typedef struct {
@@ -510,17 +723,394 @@ typedef struct {
          aes_cmac, des3_cmac,
          aria, camellia, chacha20,
          poly1305,
-         ctr_drbg, hmac_drbg,
+         ctr_drbg, hmac_drbg, tls_prf,
          rsa, dhm, ecdsa, ecdh;
 } todo_list;
 
+#if defined(BENCHMARK_THREADS)
+/*
+ * Multi-threaded mode: each case runs on 1 to N threads at once, pinned to
+ * distinct cores where the platform allows it, for the same alarm window as
+ * in the single-threaded mode. Each thread has its own context, except for
+ * the cases whose point is to share one, such as the CTR_DRBG one. All the
+ * threads set up their context, wait for each other, then run until the
+ * alarm.
+ */
+
+#define BENCHMARK_MAX_THREADS   256
+
+typedef struct bench_thread bench_thread;
+
+typedef struct {
+    size_t todo;                /* offset of the option in todo_list */
+    const char *title;
+    const char *unit;           /* "KiB/s" for BUFSIZE-byte operations,
+                                 * otherwise the operation per second */
+    int seconds;
+    void (*run)(bench_thread *t);
+} bench_case;
+
+struct bench_thread {
+    pthread_t id;
+    unsigned index;
+    const bench_case *bcase;
+    unsigned long count;
+    int ret;
+};
+
+static struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned ready;
+    int go;
+#if defined(MBEDTLS_CTR_DRBG_C)
+    mbedtls_ctr_drbg_context ctr_drbg;  /* used by all the threads */
+#endif
+#if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
+    mbedtls_rsa_context rsa;            /* copied by each thread */
+#endif
+} bench_shared;
+
+/* Called by each thread once set up: returns when all of them are. */
+static void bench_thread_start(void)
+{
+    pthread_mutex_lock(&bench_shared.mutex);
+    bench_shared.ready++;
+    pthread_cond_broadcast(&bench_shared.cond);
+    while (!bench_shared.go) {
+        pthread_cond_wait(&bench_shared.cond, &bench_shared.mutex);
+    }
+    pthread_mutex_unlock(&bench_shared.mutex);
+}
+
+/* A failed setup leaves an error in T->ret, and the thread then only waits. */
+#define BENCH_THREAD_LOOP(T, CODE)                                      \
+    do {                                                                \
+        bench_thread_start();                                           \
+        while ((T)->ret == 0 && !mbedtls_timing_alarmed) {              \
+            (T)->ret = CODE;                                            \
+            (T)->count++;                                               \
+        }                                                               \
+    } while (0)
+
+#if defined(MBEDTLS_MD5_C)
+static void bench_thread_md5(bench_thread *t)
+{
+    unsigned char in[BUFSIZE], out[16];
+
+    memset(in, 0xAA, sizeof(in));
+    BENCH_THREAD_LOOP(t, mbedtls_md5(in, BUFSIZE, out));
+}
+#endif
+
+#if defined(MBEDTLS_SHA1_C)
+static void bench_thread_sha1(bench_thread *t)
+{
+    unsigned char in[BUFSIZE], out[20];
+
+    memset(in, 0xAA, sizeof(in));
+    BENCH_THREAD_LOOP(t, mbedtls_sha1(in, BUFSIZE, out));
+}
+#endif
+
+#if defined(MBEDTLS_SHA256_C)
+static void bench_thread_sha256(bench_thread *t)
+{
+    unsigned char in[BUFSIZE], out[32];
+
+    memset(in, 0xAA, sizeof(in));
+    BENCH_THREAD_LOOP(t, mbedtls_sha256(in, BUFSIZE, out, 0));
+}
+#endif
+
+#if defined(MBEDTLS_SHA512_C)
+static void bench_thread_sha512(bench_thread *t)
+{
+    unsigned char in[BUFSIZE], out[64];
+
+    memset(in, 0xAA, sizeof(in));
+    BENCH_THREAD_LOOP(t, mbedtls_sha512(in, BUFSIZE, out, 0));
+}
+#endif
+
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_GCM_C)
+static void bench_thread_aes_gcm(bench_thread *t)
+{
+    mbedtls_gcm_context gcm;
+    unsigned char data[BUFSIZE], key[16], iv[12], tag[16];
+
+    memset(data, 0, sizeof(data));
+    memset(key, 0, sizeof(key));
+    memset(iv, 0, sizeof(iv));
+
+    mbedtls_gcm_init(&gcm);
+    t->ret = mbedtls_gcm_setkey(&gcm, MBEDTLS_CIPHER_ID_AES, key, 128);
+    BENCH_THREAD_LOOP(t, mbedtls_gcm_crypt_and_tag(&gcm, MBEDTLS_GCM_ENCRYPT, BUFSIZE,
+                                                   iv, sizeof(iv), NULL, 0,
+                                                   data, data, sizeof(tag), tag));
+    mbedtls_gcm_free(&gcm);
+}
+#endif
+
+#if defined(MBEDTLS_CHACHAPOLY_C)
+static void bench_thread_chachapoly(bench_thread *t)
+{
+    mbedtls_chachapoly_context chachapoly;
+    unsigned char data[BUFSIZE], key[32], nonce[12], tag[16];
+
+    memset(data, 0, sizeof(data));
+    memset(key, 0, sizeof(key));
+    memset(nonce, 0, sizeof(nonce));
+
+    mbedtls_chachapoly_init(&chachapoly);
+    t->ret = mbedtls_chachapoly_setkey(&chachapoly, key);
+    BENCH_THREAD_LOOP(t, mbedtls_chachapoly_encrypt_and_tag(&chachapoly, BUFSIZE, nonce,
+                                                            NULL, 0, data, data, tag));
+    mbedtls_chachapoly_free(&chachapoly);
+}
+#endif
+
+#if defined(MBEDTLS_CTR_DRBG_C)
+static void bench_thread_ctr_drbg(bench_thread *t)
+{
+    unsigned char out[BUFSIZE];
+
+    BENCH_THREAD_LOOP(t, mbedtls_ctr_drbg_random(&bench_shared.ctr_drbg, out, BUFSIZE));
+}
+#endif
+
+#if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
+static void bench_thread_rsa(bench_thread *t)
+{
+    mbedtls_rsa_context rsa;
+    unsigned char data[256];
+
+    memset(data, 0, sizeof(data));
+
+    mbedtls_rsa_init(&rsa);
+    t->ret = mbedtls_rsa_copy(&rsa, &bench_shared.rsa);
+    BENCH_THREAD_LOOP(t, (data[0] = 0, mbedtls_rsa_private(&rsa, myrand, NULL, data, data)));
+    mbedtls_rsa_free(&rsa);
+}
+#endif
+
+#if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_SHA256_C) && \
+    defined(MBEDTLS_ECP_DP_SECP256R1_ENABLED)
+static void bench_thread_ecdsa(bench_thread *t)
+{
+    mbedtls_ecdsa_context ecdsa;
+    unsigned char hash[32], sig[MBEDTLS_ECDSA_MAX_LEN];
+    size_t sig_len;
+
+    memset(hash, 0x2A, sizeof(hash));
+
+    mbedtls_ecdsa_init(&ecdsa);
+    t->ret = mbedtls_ecdsa_genkey(&ecdsa, MBEDTLS_ECP_DP_SECP256R1, myrand, NULL);
+    BENCH_THREAD_LOOP(t, mbedtls_ecdsa_write_signature(&ecdsa, MBEDTLS_MD_SHA256,
+                                                       hash, sizeof(hash),
+                                                       sig, sizeof(sig), &sig_len,
+                                                       myrand, NULL));
+    mbedtls_ecdsa_free(&ecdsa);
+}
+#endif
+
+static const bench_case bench_cases[] = {
+#if defined(MBEDTLS_MD5_C)
+    { offsetof(todo_list, md5), "MD5", "KiB/s", 1, bench_thread_md5 },
+#endif
+#if defined(MBEDTLS_SHA1_C)
+    { offsetof(todo_list, sha1), "SHA-1", "KiB/s", 1, bench_thread_sha1 },
+#endif
+#if defined(MBEDTLS_SHA256_C)
+    { offsetof(todo_list, sha256), "SHA-256", "KiB/s", 1, bench_thread_sha256 },
+#endif
+#if defined(MBEDTLS_SHA512_C)
+    { offsetof(todo_list, sha512), "SHA-512", "KiB/s", 1, bench_thread_sha512 },
+#endif
+#if defined(MBEDTLS_AES_C) && defined(MBEDTLS_GCM_C)
+    { offsetof(todo_list, aes_gcm), "AES-GCM-128", "KiB/s", 1, bench_thread_aes_gcm },
+#endif
+#if defined(MBEDTLS_CHACHAPOLY_C)
+    { offsetof(todo_list, chachapoly), "ChaCha20-Poly1305", "KiB/s", 1,
+      bench_thread_chachapoly },
+#endif
+#if defined(MBEDTLS_CTR_DRBG_C)
+    { offsetof(todo_list, ctr_drbg), "CTR_DRBG (shared)", "KiB/s", 1,
+      bench_thread_ctr_drbg },
+#endif
+#if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
+    { offsetof(todo_list, rsa), "RSA-2048", "private/s", 3, bench_thread_rsa },
+#endif
+#if defined(MBEDTLS_ECDSA_C) && defined(MBEDTLS_SHA256_C) && \
+    defined(MBEDTLS_ECP_DP_SECP256R1_ENABLED)
+    { offsetof(todo_list, ecdsa), "ECDSA-secp256r1", "sign/s", 3, bench_thread_ecdsa },
+#endif
+    { 0, NULL, NULL, 0, NULL }
+};
+
+static void *bench_thread_main(void *arg)
+{
+    bench_thread *t = (bench_thread *) arg;
+
+#if defined(__linux__)
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    cpu_set_t cpus;
+
+    if (ncpu > 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET((t->index + (bench_pin >= 0 ? (unsigned long) bench_pin : 0)) %
+                (unsigned long) ncpu, &cpus);
+        /* Best effort: the measurement is still valid unpinned. */
+        (void) pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+
+    t->bcase->run(t);
+
+    return NULL;
+}
+
+/* One run of a case on nthreads threads. */
+static int bench_run_once(const bench_case *bcase, bench_thread *threads,
+                          unsigned nthreads, unsigned long *total,
+                          unsigned long *min, unsigned long *max)
+{
+    unsigned i, started;
+    unsigned long rate;
+    int ret = 0;
+
+    bench_shared.ready = 0;
+    bench_shared.go = 0;
+
+    for (started = 0; started < nthreads; started++) {
+        threads[started].index = started;
+        threads[started].bcase = bcase;
+        threads[started].count = 0;
+        threads[started].ret = 0;
+        if (pthread_create(&threads[started].id, NULL, bench_thread_main,
+                           &threads[started]) != 0) {
+            ret = MBEDTLS_ERR_ERROR_GENERIC_ERROR;
+            break;
+        }
+    }
+
+    pthread_mutex_lock(&bench_shared.mutex);
+    while (bench_shared.ready < started) {
+        pthread_cond_wait(&bench_shared.cond, &bench_shared.mutex);
+    }
+    mbedtls_set_alarm(ret == 0 ? bcase->seconds : 0);
+    bench_shared.go = 1;
+    pthread_cond_broadcast(&bench_shared.cond);
+    pthread_mutex_unlock(&bench_shared.mutex);
+
+    *total = 0;
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i].id, NULL);
+        if (ret == 0) {
+            ret = threads[i].ret;
+        }
+
+        rate = threads[i].count / bcase->seconds;
+        if (strcmp(bcase->unit, "KiB/s") == 0) {
+            rate = rate * BUFSIZE / 1024;
+        }
+        *total += rate;
+        *min = rate < *min ? rate : *min;
+        *max = rate > *max ? rate : *max;
+    }
+
+    return ret;
+}
+
+static void bench_run_case(const bench_case *bcase, bench_thread *threads,
+                           unsigned nthreads)
+{
+    unsigned run;
+    unsigned long totals[BENCHMARK_MAX_RUNS], median, stddev;
+    unsigned long min = ULONG_MAX, max = 0, run_min, run_max;
+    int ret = 0;
+
+    print_title(bcase->title);
+
+    for (run = 0; ret == 0 && run < bench_warmup + bench_runs; run++) {
+        run_min = ULONG_MAX;
+        run_max = 0;
+        ret = bench_run_once(bcase, threads, nthreads,
+                             &totals[run < bench_warmup ? 0 : run - bench_warmup],
+                             &run_min, &run_max);
+        if (run >= bench_warmup) {
+            min = run_min < min ? run_min : min;
+            max = run_max > max ? run_max : max;
+        }
+    }
+    bench_stats(totals, ret == 0 ? bench_runs : 0, &median, &stddev);
+
+    if (min > max) {
+        min = 0;
+    }
+
+    print_record(bcase->title, bcase->unit, nthreads, median, min, max, 0,
+                 stddev, ret);
+}
+
+static void benchmark_threads(const todo_list *todo, unsigned max_threads)
+{
+    const bench_case *bcase;
+    bench_thread *threads;
+    unsigned nthreads;
+
+    threads = mbedtls_calloc(max_threads, sizeof(bench_thread));
+    if (threads == NULL) {
+        mbedtls_exit(1);
+    }
+
+    pthread_mutex_init(&bench_shared.mutex, NULL);
+    pthread_cond_init(&bench_shared.cond, NULL);
+
+#if defined(MBEDTLS_CTR_DRBG_C)
+    mbedtls_ctr_drbg_init(&bench_shared.ctr_drbg);
+    if (todo->ctr_drbg &&
+        mbedtls_ctr_drbg_seed(&bench_shared.ctr_drbg, myrand, NULL, NULL, 0) != 0) {
+        mbedtls_exit(1);
+    }
+#endif
+#if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
+    mbedtls_rsa_init(&bench_shared.rsa);
+    if (todo->rsa &&
+        mbedtls_rsa_gen_key(&bench_shared.rsa, myrand, NULL, 2048, 65537) != 0) {
+        mbedtls_exit(1);
+    }
+#endif
+
+    for (bcase = bench_cases; bcase->title != NULL; bcase++) {
+        if (!((const char *) todo)[bcase->todo]) {
+            continue;
+        }
+        for (nthreads = 1; nthreads <= max_threads; nthreads++) {
+            bench_run_case(bcase, threads, nthreads);
+        }
+    }
+
+#if defined(MBEDTLS_CTR_DRBG_C)
+    mbedtls_ctr_drbg_free(&bench_shared.ctr_drbg);
+#endif
+#if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
+    mbedtls_rsa_free(&bench_shared.rsa);
+#endif
+    pthread_cond_destroy(&bench_shared.cond);
+    pthread_mutex_destroy(&bench_shared.mutex);
+    mbedtls_free(threads);
+}
+#endif /* BENCHMARK_THREADS */
+
 
 int main(int argc, char *argv[])
 {
     int i;
     unsigned char tmp[200];
     char title[TITLE_LEN];
-    todo_list todo;
+    todo_list todo, none;
+    unsigned long threads = 0;
 #if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
     unsigned char alloc_buf[HEAP_SIZE] = { 0 };
 #endif
@@ -596,6 +1186,8 @@ int main(int argc, char *argv[])
                 todo.ctr_drbg = 1;
             } else if (strcmp(argv[i], "hmac_drbg") == 0) {
                 todo.hmac_drbg = 1;
+            } else if (strcmp(argv[i], "tls_prf") == 0) {
+                todo.tls_prf = 1;
             } else if (strcmp(argv[i], "rsa") == 0) {
                 todo.rsa = 1;
             } else if (strcmp(argv[i], "dhm") == 0) {
@@ -609,15 +1201,66 @@ int main(int argc, char *argv[])
             else if (set_ecp_curve(argv[i], single_curve)) {
                 curve_list = single_curve;
             }
+#endif
+            else if (strcmp(argv[i], "csv") == 0) {
+                output_format = FORMAT_CSV;
+            } else if (strcmp(argv[i], "json") == 0) {
+                output_format = FORMAT_JSON;
+            } else if (strncmp(argv[i], "runs=", 5) == 0) {
+                bench_runs = (unsigned) strtoul(argv[i] + 5, NULL, 10);
+            } else if (strncmp(argv[i], "warmup=", 7) == 0) {
+                bench_warmup = (unsigned) strtoul(argv[i] + 7, NULL, 10);
+            } else if (strncmp(argv[i], "pin=", 4) == 0) {
+                bench_pin = strtol(argv[i] + 4, NULL, 10);
+            }
+#if defined(BENCHMARK_THREADS)
+            else if (strncmp(argv[i], "threads=", 8) == 0) {
+                threads = strtoul(argv[i] + 8, NULL, 10);
+                if (threads == 0 || threads > BENCHMARK_MAX_THREADS) {
+                    mbedtls_printf("Invalid number of threads: %s\n", argv[i] + 8);
+                    mbedtls_exit(1);
+                }
+            }
 #endif
             else {
                 mbedtls_printf("Unrecognized option: %s\n", argv[i]);
                 mbedtls_printf("Available options: " OPTIONS);
             }
         }
+
+        /* Only output options: run everything. */
+        memset(&none, 0, sizeof(none));
+        if (memcmp(&todo, &none, sizeof(todo)) == 0) {
+            memset(&todo, 1, sizeof(todo));
+        }
+    }
+
+    if (bench_runs == 0 || bench_runs > BENCHMARK_MAX_RUNS ||
+        bench_warmup > BENCHMARK_MAX_RUNS - bench_runs) {
+        mbedtls_printf("runs=N and warmup=N: at most %u runs in total\n",
+                       BENCHMARK_MAX_RUNS);
+        mbedtls_exit(1);
+    }
+
+#if defined(__linux__)
+    /* Pin the single-threaded measurements; the threads pin themselves. */
+    if (bench_pin >= 0 && threads == 0) {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET((size_t) bench_pin, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0) {
+            mbedtls_printf("Cannot run on CPU %ld\n", bench_pin);
+            mbedtls_exit(1);
+        }
     }
+#endif
 
-    mbedtls_printf("\n");
+    if (output_format == FORMAT_JSON) {
+        mbedtls_printf("[\n");
+    } else if (output_format == FORMAT_TEXT) {
+        mbedtls_printf("\n");
+    }
 
 #if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
     mbedtls_memory_buffer_alloc_init(alloc_buf, sizeof(alloc_buf));
@@ -629,6 +1272,15 @@ int main(int argc, char *argv[])
      * symmetric crypto. */
     (void) mbedtls_timing_hardclock;
 
+#if defined(BENCHMARK_THREADS)
+    if (threads != 0) {
+        benchmark_threads(&todo, (unsigned) threads);
+        goto exit;
+    }
+#else
+    (void) threads;
+#endif
+
 #if defined(MBEDTLS_MD5_C)
     if (todo.md5) {
         TIME_AND_TSC("MD5", mbedtls_md5(buf, BUFSIZE, tmp));
@@ -1041,6 +1693,23 @@ int main(int argc, char *argv[])
     }
 #endif /* MBEDTLS_HMAC_DRBG_C && ( MBEDTLS_SHA1_C || MBEDTLS_SHA256_C ) */
 
+#if defined(MBEDTLS_SSL_TLS_C) && defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    if (todo.tls_prf) {
+        if (psa_crypto_init() != PSA_SUCCESS) {
+            mbedtls_exit(1);
+        }
+
+#if defined(PSA_WANT_ALG_SHA_256)
+        TIME_PUBLIC("TLS 1.2 PRF SHA-256", "derive",
+                    ret = bench_tls12_prf(MBEDTLS_SSL_TLS_PRF_SHA256));
+#endif
+#if defined(PSA_WANT_ALG_SHA_384)
+        TIME_PUBLIC("TLS 1.2 PRF SHA-384", "derive",
+                    ret = bench_tls12_prf(MBEDTLS_SSL_TLS_PRF_SHA384));
+#endif
+    }
+#endif /* MBEDTLS_SSL_TLS_C && MBEDTLS_SSL_PROTO_TLS1_2 */
+
 #if defined(MBEDTLS_RSA_C) && defined(MBEDTLS_GENPRIME)
     if (todo.rsa) {
         int keysize;
@@ -1260,7 +1929,14 @@ int main(int argc, char *argv[])
     }
 #endif
 
-    mbedtls_printf("\n");
+#if defined(BENCHMARK_THREADS)
+exit:
+#endif
+    if (output_format == FORMAT_JSON) {
+        mbedtls_printf("\n]\n");
+    } else if (output_format == FORMAT_TEXT) {
+        mbedtls_printf("\n");
+    }
 
 #if defined(MBEDTLS_MEMORY_BUFFER_ALLOC_C)
     mbedtls_memory_buffer_alloc_free();
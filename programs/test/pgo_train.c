@@ -0,0 +1,498 @@
+/*
+ *  Training workload for profile-guided optimization
+ *
+ *  Runs the hot paths of the TLS and X.509 libraries in-process, so that a
+ *  build instrumented for profile-guided optimization collects a profile
+ *  that looks like the one of a busy TLS endpoint: certificate parsing and
+ *  verification, full and resumed handshakes in each protocol version, with
+ *  the session cache and with tickets, and application data records of
+ *  common sizes in both directions.
+ *
+ *  See the PgoGen and PgoUse build types in README.md.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_SRV_C) ||       \
+    !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||      \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_PEM_PARSE_C)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_CLI_C and/or MBEDTLS_SSL_SRV_C and/or "
+                   "MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_X509_CRT_PARSE_C and/or MBEDTLS_PEM_PARSE_C "
+                   "not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/ssl_cache.h"
+#include "mbedtls/ssl_ticket.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "psa/crypto.h"
+
+#include "test/certs.h"
+
+#define DFL_CERTS               200
+#define DFL_HANDSHAKES          50
+#define DFL_RECORDS             20
+#define PIPE_SIZE               (64 * 1024)
+
+#define USAGE \
+    "\n usage: pgo_train param=<>...\n"                                 \
+    "\n acceptable parameters:\n"                                       \
+    "    certs=%%d           certificate chains parsed and verified\n"  \
+    "                        default: %d\n"                             \
+    "    handshakes=%%d      connections of each kind of handshake\n"   \
+    "                        default: %d\n"                             \
+    "    records=%%d         records of each size sent each way on\n"   \
+    "                        each connection, default: %d\n"            \
+    "\n"
+
+/* Application data sizes: small requests, typical responses, full records */
+static const size_t record_sizes[] = { 32, 512, 1400, 4096, 16384 };
+
+/* One direction of the in-memory connection */
+typedef struct {
+    unsigned char buf[PIPE_SIZE];
+    size_t len;
+} record_pipe;
+
+typedef struct {
+    record_pipe *in;
+    record_pipe *out;
+} record_bio;
+
+/* A kind of connection of the workload */
+typedef struct {
+    const char *name;
+    mbedtls_ssl_protocol_version version;
+    int tickets;            /* the client asks for tickets */
+    int resume;             /* resume the session of the last connection */
+} workload;
+
+static const workload workloads[] = {
+#if defined(MBEDTLS_SSL_PROTO_TLS1_2)
+    { "TLS 1.2 full", MBEDTLS_SSL_VERSION_TLS1_2, 0, 0 },
+#if defined(MBEDTLS_SSL_CACHE_C)
+    { "TLS 1.2 resumed from the session cache",
+      MBEDTLS_SSL_VERSION_TLS1_2, 0, 1 },
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    { "TLS 1.2 resumed with a ticket", MBEDTLS_SSL_VERSION_TLS1_2, 1, 1 },
+#endif
+#endif /* MBEDTLS_SSL_PROTO_TLS1_2 */
+#if defined(MBEDTLS_SSL_PROTO_TLS1_3)
+    { "TLS 1.3 full", MBEDTLS_SSL_VERSION_TLS1_3, 1, 0 },
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    { "TLS 1.3 resumed with a ticket", MBEDTLS_SSL_VERSION_TLS1_3, 1, 1 },
+#endif
+#endif /* MBEDTLS_SSL_PROTO_TLS1_3 */
+};
+
+static unsigned char data[16384];
+
+static int pipe_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    record_pipe *out = ((record_bio *) ctx)->out;
+
+    if (len > PIPE_SIZE - out->len) {
+        len = PIPE_SIZE - out->len;
+    }
+    if (len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+    return (int) len;
+}
+
+static int pipe_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    record_pipe *in = ((record_bio *) ctx)->in;
+
+    if (in->len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (len > in->len) {
+        len = in->len;
+    }
+
+    memcpy(buf, in->buf, len);
+    memmove(in->buf, in->buf + len, in->len - len);
+    in->len -= len;
+    return (int) len;
+}
+
+static int handshake_step(mbedtls_ssl_context *ssl, int *done)
+{
+    int ret;
+
+    if (*done) {
+        return 0;
+    }
+
+    ret = mbedtls_ssl_handshake(ssl);
+    if (ret == 0) {
+        *done = 1;
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+               ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        ret = 0;
+    }
+    return ret;
+}
+
+/* Send len bytes from one end and read them at the other. The client also
+ * processes the tickets of TLS 1.3 as it reads. */
+static int transfer(mbedtls_ssl_context *from, mbedtls_ssl_context *to,
+                    size_t len)
+{
+    int ret;
+    size_t done;
+
+    for (done = 0; done < len; done += (size_t) ret) {
+        ret = mbedtls_ssl_write(from, data + done, len - done);
+        if (ret <= 0) {
+            mbedtls_printf("  ! mbedtls_ssl_write returned -0x%x\n",
+                           (unsigned int) -ret);
+            return ret;
+        }
+    }
+
+    for (done = 0; done < len; done += (size_t) ret) {
+        ret = mbedtls_ssl_read(to, data + done, len - done);
+        if (ret == MBEDTLS_ERR_SSL_RECEIVED_NEW_SESSION_TICKET) {
+            ret = 0;
+            continue;
+        }
+        if (ret <= 0) {
+            mbedtls_printf("  ! mbedtls_ssl_read returned -0x%x\n",
+                           (unsigned int) -ret);
+            return ret;
+        }
+    }
+
+    return 0;
+}
+
+static int train_certs(int count)
+{
+    int ret = 0, i;
+    uint32_t flags;
+    mbedtls_x509_crt cacert, srvcert;
+
+    for (i = 0; i < count && ret == 0; i++) {
+        mbedtls_x509_crt_init(&cacert);
+        mbedtls_x509_crt_init(&srvcert);
+
+        if ((ret = mbedtls_x509_crt_parse(&cacert,
+                                          (const unsigned char *) mbedtls_test_cas_pem,
+                                          mbedtls_test_cas_pem_len)) != 0 ||
+            (ret = mbedtls_x509_crt_parse(&srvcert,
+                                          (const unsigned char *) mbedtls_test_srv_crt,
+                                          mbedtls_test_srv_crt_len)) != 0) {
+            mbedtls_printf("  ! mbedtls_x509_crt_parse returned -0x%x\n",
+                           (unsigned int) -ret);
+        } else if ((ret = mbedtls_x509_crt_verify(&srvcert, &cacert, NULL,
+                                                  "localhost", &flags,
+                                                  NULL, NULL)) != 0) {
+            mbedtls_printf("  ! mbedtls_x509_crt_verify returned -0x%x\n",
+                           (unsigned int) -ret);
+        }
+
+        mbedtls_x509_crt_free(&srvcert);
+        mbedtls_x509_crt_free(&cacert);
+    }
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 1;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int i, w, n, r, client_done, server_done, have_session = 0;
+    int certs = DFL_CERTS, handshakes = DFL_HANDSHAKES, records = DFL_RECORDS;
+    size_t s;
+    const char *pers = "pgo_train";
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt cacert, srvcert;
+    mbedtls_pk_context pkey;
+    mbedtls_ssl_config client_conf, server_conf;
+    mbedtls_ssl_context client, server;
+    mbedtls_ssl_session session;
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_context cache;
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_context ticket;
+#endif
+    record_pipe *to_client = NULL, *to_server = NULL;
+    record_bio client_bio, server_bio;
+    char *p, *q;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_x509_crt_init(&cacert);
+    mbedtls_x509_crt_init(&srvcert);
+    mbedtls_pk_init(&pkey);
+    mbedtls_ssl_config_init(&client_conf);
+    mbedtls_ssl_config_init(&server_conf);
+    mbedtls_ssl_init(&client);
+    mbedtls_ssl_init(&server);
+    mbedtls_ssl_session_init(&session);
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_init(&cache);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_init(&ticket);
+#endif
+
+    for (i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "certs") == 0) {
+            certs = atoi(q);
+            if (certs < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "handshakes") == 0) {
+            handshakes = atoi(q);
+            if (handshakes < 0) {
+                goto usage;
+            }
+        } else if (strcmp(p, "records") == 0) {
+            records = atoi(q);
+            if (records < 0) {
+                goto usage;
+            }
+        } else {
+            goto usage;
+        }
+    }
+
+    to_client = mbedtls_calloc(1, sizeof(record_pipe));
+    to_server = mbedtls_calloc(1, sizeof(record_pipe));
+    if (to_client == NULL || to_server == NULL) {
+        mbedtls_printf("  ! Failed to allocate the connection buffers\n");
+        goto exit;
+    }
+    memset(data, 0x2a, sizeof(data));
+
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        mbedtls_printf("  ! mbedtls_ctr_drbg_seed returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    mbedtls_printf("  . X.509: %d chains parsed and verified\n", certs);
+    if ((ret = train_certs(certs)) != 0) {
+        goto exit;
+    }
+
+    if ((ret = mbedtls_x509_crt_parse(&cacert,
+                                      (const unsigned char *) mbedtls_test_cas_pem,
+                                      mbedtls_test_cas_pem_len)) != 0 ||
+        (ret = mbedtls_x509_crt_parse(&srvcert,
+                                      (const unsigned char *) mbedtls_test_srv_crt,
+                                      mbedtls_test_srv_crt_len)) != 0) {
+        mbedtls_printf("  ! mbedtls_x509_crt_parse returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_pk_parse_key(&pkey,
+                                    (const unsigned char *) mbedtls_test_srv_key,
+                                    mbedtls_test_srv_key_len, NULL, 0,
+                                    mbedtls_ctr_drbg_random, &ctr_drbg)) != 0) {
+        mbedtls_printf("  ! mbedtls_pk_parse_key returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ssl_config_defaults(&client_conf, MBEDTLS_SSL_IS_CLIENT,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+        (ret = mbedtls_ssl_config_defaults(&server_conf, MBEDTLS_SSL_IS_SERVER,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_config_defaults returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_rng(&client_conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_rng(&server_conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_ca_chain(&client_conf, &cacert, NULL);
+    if ((ret = mbedtls_ssl_conf_own_cert(&server_conf, &srvcert, &pkey)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_conf_own_cert returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_conf_session_cache(&server_conf, &cache,
+                                   mbedtls_ssl_cache_get,
+                                   mbedtls_ssl_cache_set);
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    if ((ret = mbedtls_ssl_ticket_setup(&ticket, mbedtls_ctr_drbg_random,
+                                        &ctr_drbg, MBEDTLS_CIPHER_AES_256_GCM,
+                                        86400)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_ticket_setup returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_session_tickets_cb(&server_conf,
+                                        mbedtls_ssl_ticket_write,
+                                        mbedtls_ssl_ticket_parse,
+                                        &ticket);
+#endif
+
+    if ((ret = mbedtls_ssl_setup(&client, &client_conf)) != 0 ||
+        (ret = mbedtls_ssl_setup(&server, &server_conf)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_setup returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_ssl_set_hostname(&client, "localhost")) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_set_hostname returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    client_bio.in = to_client;
+    client_bio.out = to_server;
+    server_bio.in = to_server;
+    server_bio.out = to_client;
+    mbedtls_ssl_set_bio(&client, &client_bio, pipe_send, pipe_recv, NULL);
+    mbedtls_ssl_set_bio(&server, &server_bio, pipe_send, pipe_recv, NULL);
+
+    for (w = 0; w < (int) (sizeof(workloads) / sizeof(workloads[0])); w++) {
+        const workload *work = &workloads[w];
+
+        mbedtls_printf("  . %s: %d handshakes\n", work->name, handshakes);
+
+        mbedtls_ssl_conf_min_tls_version(&client_conf, work->version);
+        mbedtls_ssl_conf_max_tls_version(&client_conf, work->version);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&client_conf,
+                                         work->tickets ?
+                                         MBEDTLS_SSL_SESSION_TICKETS_ENABLED :
+                                         MBEDTLS_SSL_SESSION_TICKETS_DISABLED);
+#endif
+        have_session = 0;
+
+        for (n = 0; n < handshakes; n++) {
+            /* The contexts pick up the new settings when reset. */
+            to_client->len = 0;
+            to_server->len = 0;
+            if ((ret = mbedtls_ssl_session_reset(&client)) != 0 ||
+                (ret = mbedtls_ssl_session_reset(&server)) != 0) {
+                mbedtls_printf("  ! mbedtls_ssl_session_reset returned -0x%x\n",
+                               (unsigned int) -ret);
+                goto exit;
+            }
+            if (work->resume && have_session &&
+                (ret = mbedtls_ssl_set_session(&client, &session)) != 0) {
+                mbedtls_printf("  ! mbedtls_ssl_set_session returned -0x%x\n",
+                               (unsigned int) -ret);
+                goto exit;
+            }
+
+            client_done = 0;
+            server_done = 0;
+            while (!client_done || !server_done) {
+                if ((ret = handshake_step(&client, &client_done)) != 0 ||
+                    (ret = handshake_step(&server, &server_done)) != 0) {
+                    mbedtls_printf("  ! mbedtls_ssl_handshake returned -0x%x\n",
+                                   (unsigned int) -ret);
+                    goto exit;
+                }
+            }
+
+            /* A first response lets the client take its TLS 1.3 tickets. */
+            if ((ret = transfer(&server, &client, 1)) != 0) {
+                goto exit;
+            }
+            for (s = 0; s < sizeof(record_sizes) / sizeof(record_sizes[0]); s++) {
+                for (r = 0; r < records; r++) {
+                    if ((ret = transfer(&client, &server, record_sizes[s])) != 0 ||
+                        (ret = transfer(&server, &client, record_sizes[s])) != 0) {
+                        goto exit;
+                    }
+                }
+            }
+
+            if (work->resume && !have_session) {
+                have_session = mbedtls_ssl_get_session(&client, &session) == 0;
+            }
+
+            if ((ret = mbedtls_ssl_close_notify(&client)) != 0) {
+                mbedtls_printf("  ! mbedtls_ssl_close_notify returned -0x%x\n",
+                               (unsigned int) -ret);
+                goto exit;
+            }
+            ret = mbedtls_ssl_read(&server, data, sizeof(data));
+            if (ret != MBEDTLS_ERR_SSL_PEER_CLOSE_NOTIFY) {
+                mbedtls_printf("  ! mbedtls_ssl_read returned -0x%x\n",
+                               (unsigned int) -ret);
+                goto exit;
+            }
+        }
+
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_session_init(&session);
+    }
+
+    mbedtls_printf("  . done\n");
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+    goto exit;
+
+usage:
+    mbedtls_printf(USAGE, DFL_CERTS, DFL_HANDSHAKES, DFL_RECORDS);
+
+exit:
+    mbedtls_ssl_session_free(&session);
+    mbedtls_ssl_free(&client);
+    mbedtls_ssl_free(&server);
+    mbedtls_ssl_config_free(&client_conf);
+    mbedtls_ssl_config_free(&server_conf);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS) && defined(MBEDTLS_SSL_TICKET_C)
+    mbedtls_ssl_ticket_free(&ticket);
+#endif
+#if defined(MBEDTLS_SSL_CACHE_C)
+    mbedtls_ssl_cache_free(&cache);
+#endif
+    mbedtls_free(to_client);
+    mbedtls_free(to_server);
+    mbedtls_pk_free(&pkey);
+    mbedtls_x509_crt_free(&srvcert);
+    mbedtls_x509_crt_free(&cacert);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+}
+
+#endif /* MBEDTLS_SSL_CLI_C && MBEDTLS_SSL_SRV_C && MBEDTLS_ENTROPY_C &&
+          MBEDTLS_CTR_DRBG_C && MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_PEM_PARSE_C */
@@ -0,0 +1,514 @@
+/*
+ *  Benchmark for record processing on many SSL contexts
+ *
+ *  Sets up a number of client and server contexts with established
+ *  connections, then sends records round-robin over all of them, as a
+ *  server handling many connections does. Each record touches a context
+ *  that was evicted from the CPU caches by the others, so the time and,
+ *  on Linux, the cache misses per record reflect how much of each context
+ *  record processing reads and writes.
+ *
+ *  The connections are clones of a single handshake, made with
+ *  mbedtls_ssl_context_save() and mbedtls_ssl_context_load(), so that
+ *  setting up many of them stays fast.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#define MBEDTLS_ALLOW_PRIVATE_ACCESS
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_SRV_C) ||       \
+    !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||      \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_PEM_PARSE_C) || \
+    !defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION) || !defined(MBEDTLS_HAVE_TIME)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_CLI_C and/or MBEDTLS_SSL_SRV_C and/or "
+                   "MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_X509_CRT_PARSE_C and/or MBEDTLS_PEM_PARSE_C and/or "
+                   "MBEDTLS_SSL_CONTEXT_SERIALIZATION and/or "
+                   "MBEDTLS_HAVE_TIME not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "psa/crypto.h"
+
+#include "test/certs.h"
+
+#define DFL_CONTEXTS            4096
+#define DFL_RECORDS             16
+#define DFL_SIZE                1024
+#define MAX_SIZE                4096
+#define PIPE_SIZE               (64 * 1024)
+
+#define USAGE \
+    "\n usage: ssl_context_bench param=<>...\n"                          \
+    "\n acceptable parameters:\n"                                       \
+    "    contexts=%%d        connections, each a client and a server\n" \
+    "                        context, default: %d\n"                    \
+    "    records=%%d         records sent on each connection\n"         \
+    "                        default: %d\n"                             \
+    "    size=%%d            application data bytes per record\n"       \
+    "                        default: %d, maximum: %d\n"                \
+    "    version=%%s         tls12 or tls13\n"                          \
+    "                        default: negotiated\n"                     \
+    "\n"
+
+/* One direction of the in-memory connections, shared by all of them since
+ * each record is read as soon as it is written */
+typedef struct {
+    unsigned char buf[PIPE_SIZE];
+    size_t len;
+} record_pipe;
+
+typedef struct {
+    record_pipe *in;
+    record_pipe *out;
+} record_bio;
+
+static unsigned long long bench_usec(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long) now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+/* Counter of the cache misses of this process, or -1 where there is none */
+static int cache_misses_open(void)
+{
+#if defined(__linux__)
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#else
+    return -1;
+#endif
+}
+
+static void cache_misses_start(int fd)
+{
+#if defined(__linux__)
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void) fd;
+#endif
+}
+
+static unsigned long long cache_misses_stop(int fd)
+{
+#if defined(__linux__)
+    unsigned long long count = 0;
+
+    if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != (ssize_t) sizeof(count)) {
+            count = 0;
+        }
+    }
+    return count;
+#else
+    (void) fd;
+    return 0;
+#endif
+}
+
+static int pipe_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    record_pipe *out = ((record_bio *) ctx)->out;
+
+    if (len > PIPE_SIZE - out->len) {
+        len = PIPE_SIZE - out->len;
+    }
+    if (len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+    return (int) len;
+}
+
+static int pipe_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    record_pipe *in = ((record_bio *) ctx)->in;
+
+    if (in->len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (len > in->len) {
+        len = in->len;
+    }
+
+    memcpy(buf, in->buf, len);
+    memmove(in->buf, in->buf + len, in->len - len);
+    in->len -= len;
+    return (int) len;
+}
+
+static int handshake_step(mbedtls_ssl_context *ssl, int *done)
+{
+    int ret;
+
+    if (*done) {
+        return 0;
+    }
+
+    ret = mbedtls_ssl_handshake(ssl);
+    if (ret == 0) {
+        *done = 1;
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+               ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        ret = 0;
+    }
+    return ret;
+}
+
+/* Save an established context so that it can be loaded into many others.
+ * This resets it. */
+static int save_context(mbedtls_ssl_context *ssl,
+                        unsigned char **buf, size_t *len)
+{
+    int ret;
+
+    ret = mbedtls_ssl_context_save(ssl, NULL, 0, len);
+    if (ret != MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+        return ret == 0 ? MBEDTLS_ERR_SSL_INTERNAL_ERROR : ret;
+    }
+    if ((*buf = mbedtls_calloc(1, *len)) == NULL) {
+        return MBEDTLS_ERR_SSL_ALLOC_FAILED;
+    }
+    return mbedtls_ssl_context_save(ssl, *buf, *len, len);
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 1;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int i, r, contexts = DFL_CONTEXTS, records = DFL_RECORDS, size = DFL_SIZE;
+    int client_done = 0, server_done = 0, misses_fd = -1;
+    const char *version = NULL;
+    const char *pers = "ssl_context_bench";
+    unsigned long long t_start, t_end, misses;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt cacert, srvcert;
+    mbedtls_pk_context pkey;
+    mbedtls_ssl_config client_conf, server_conf;
+    mbedtls_ssl_context client, server;
+    mbedtls_ssl_context *clients = NULL, *servers = NULL;
+    unsigned char *client_state = NULL, *server_state = NULL;
+    size_t client_state_len = 0, server_state_len = 0;
+    record_pipe *to_client = NULL, *to_server = NULL;
+    record_bio client_bio, server_bio;
+    unsigned char data[MAX_SIZE];
+    size_t total;
+    char *p, *q;
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_x509_crt_init(&cacert);
+    mbedtls_x509_crt_init(&srvcert);
+    mbedtls_pk_init(&pkey);
+    mbedtls_ssl_config_init(&client_conf);
+    mbedtls_ssl_config_init(&server_conf);
+    mbedtls_ssl_init(&client);
+    mbedtls_ssl_init(&server);
+
+    for (i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "contexts") == 0) {
+            contexts = atoi(q);
+            if (contexts < 1 || contexts > 1000000) {
+                goto usage;
+            }
+        } else if (strcmp(p, "records") == 0) {
+            records = atoi(q);
+            if (records < 1) {
+                goto usage;
+            }
+        } else if (strcmp(p, "size") == 0) {
+            size = atoi(q);
+            if (size < 1 || size > MAX_SIZE) {
+                goto usage;
+            }
+        } else if (strcmp(p, "version") == 0) {
+            if (strcmp(q, "tls12") != 0 && strcmp(q, "tls13") != 0) {
+                goto usage;
+            }
+            version = q;
+        } else {
+            goto usage;
+        }
+    }
+
+    clients = mbedtls_calloc((size_t) contexts, sizeof(mbedtls_ssl_context));
+    servers = mbedtls_calloc((size_t) contexts, sizeof(mbedtls_ssl_context));
+    to_client = mbedtls_calloc(1, sizeof(record_pipe));
+    to_server = mbedtls_calloc(1, sizeof(record_pipe));
+    if (clients == NULL || servers == NULL || to_client == NULL || to_server == NULL) {
+        mbedtls_printf("  ! Failed to allocate %d connections\n", contexts);
+        goto exit;
+    }
+    for (i = 0; i < contexts; i++) {
+        mbedtls_ssl_init(&clients[i]);
+        mbedtls_ssl_init(&servers[i]);
+    }
+    memset(data, 0x2a, sizeof(data));
+
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        mbedtls_printf("  ! mbedtls_ctr_drbg_seed returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_x509_crt_parse(&cacert,
+                                      (const unsigned char *) mbedtls_test_cas_pem,
+                                      mbedtls_test_cas_pem_len)) != 0 ||
+        (ret = mbedtls_x509_crt_parse(&srvcert,
+                                      (const unsigned char *) mbedtls_test_srv_crt,
+                                      mbedtls_test_srv_crt_len)) != 0) {
+        mbedtls_printf("  ! mbedtls_x509_crt_parse returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_pk_parse_key(&pkey,
+                                    (const unsigned char *) mbedtls_test_srv_key,
+                                    mbedtls_test_srv_key_len, NULL, 0,
+                                    mbedtls_ctr_drbg_random, &ctr_drbg)) != 0) {
+        mbedtls_printf("  ! mbedtls_pk_parse_key returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ssl_config_defaults(&client_conf, MBEDTLS_SSL_IS_CLIENT,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0 ||
+        (ret = mbedtls_ssl_config_defaults(&server_conf, MBEDTLS_SSL_IS_SERVER,
+                                           MBEDTLS_SSL_TRANSPORT_STREAM,
+                                           MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_config_defaults returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    mbedtls_ssl_conf_rng(&client_conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_rng(&server_conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+    mbedtls_ssl_conf_ca_chain(&client_conf, &cacert, NULL);
+    if ((ret = mbedtls_ssl_conf_own_cert(&server_conf, &srvcert, &pkey)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_conf_own_cert returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    /* Records of at most MAX_SIZE bytes keep the buffers of all the
+     * connections small enough to fit in memory. */
+    if ((ret = mbedtls_ssl_conf_max_content_len(&client_conf,
+                                                MAX_SIZE, MAX_SIZE)) != 0 ||
+        (ret = mbedtls_ssl_conf_max_content_len(&server_conf,
+                                                MAX_SIZE, MAX_SIZE)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_conf_max_content_len returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    if (version != NULL) {
+        mbedtls_ssl_protocol_version v = strcmp(version, "tls12") == 0 ?
+                                         MBEDTLS_SSL_VERSION_TLS1_2 :
+                                         MBEDTLS_SSL_VERSION_TLS1_3;
+        mbedtls_ssl_conf_min_tls_version(&client_conf, v);
+        mbedtls_ssl_conf_max_tls_version(&client_conf, v);
+        mbedtls_ssl_conf_min_tls_version(&server_conf, v);
+        mbedtls_ssl_conf_max_tls_version(&server_conf, v);
+    }
+
+    if ((ret = mbedtls_ssl_setup(&client, &client_conf)) != 0 ||
+        (ret = mbedtls_ssl_setup(&server, &server_conf)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_setup returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_ssl_set_hostname(&client, "localhost")) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_set_hostname returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    client_bio.in = to_client;
+    client_bio.out = to_server;
+    server_bio.in = to_server;
+    server_bio.out = to_client;
+    mbedtls_ssl_set_bio(&client, &client_bio, pipe_send, pipe_recv, NULL);
+    mbedtls_ssl_set_bio(&server, &server_bio, pipe_send, pipe_recv, NULL);
+
+    while (!client_done || !server_done) {
+        if ((ret = handshake_step(&client, &client_done)) != 0 ||
+            (ret = handshake_step(&server, &server_done)) != 0) {
+            mbedtls_printf("  ! mbedtls_ssl_handshake returned -0x%x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+    }
+
+    mbedtls_printf("  . %s, %d connections, %d records of %d bytes each\n",
+                   mbedtls_ssl_get_ciphersuite(&client), contexts, records, size);
+
+    if ((ret = save_context(&client, &client_state, &client_state_len)) != 0 ||
+        (ret = save_context(&server, &server_state, &server_state_len)) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_context_save returned -0x%x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+
+    for (i = 0; i < contexts; i++) {
+        if ((ret = mbedtls_ssl_setup(&clients[i], &client_conf)) != 0 ||
+            (ret = mbedtls_ssl_setup(&servers[i], &server_conf)) != 0 ||
+            (ret = mbedtls_ssl_context_load(&clients[i], client_state,
+                                            client_state_len)) != 0 ||
+            (ret = mbedtls_ssl_context_load(&servers[i], server_state,
+                                            server_state_len)) != 0) {
+            mbedtls_printf("  ! setting up connection %d returned -0x%x\n",
+                           i, (unsigned int) -ret);
+            goto exit;
+        }
+        mbedtls_ssl_set_bio(&clients[i], &client_bio, pipe_send, pipe_recv, NULL);
+        mbedtls_ssl_set_bio(&servers[i], &server_bio, pipe_send, pipe_recv, NULL);
+    }
+
+    misses_fd = cache_misses_open();
+
+    t_start = bench_usec();
+    cache_misses_start(misses_fd);
+
+    for (r = 0; r < records; r++) {
+        for (i = 0; i < contexts; i++) {
+            ret = mbedtls_ssl_write(&clients[i], data, (size_t) size);
+            if (ret != size) {
+                mbedtls_printf("  ! mbedtls_ssl_write returned -0x%x\n",
+                               (unsigned int) -ret);
+                goto exit;
+            }
+            for (total = 0; total < (size_t) size; total += (size_t) ret) {
+                ret = mbedtls_ssl_read(&servers[i], data + total,
+                                       (size_t) size - total);
+                if (ret <= 0) {
+                    mbedtls_printf("  ! mbedtls_ssl_read returned -0x%x\n",
+                                   (unsigned int) -ret);
+                    goto exit;
+                }
+            }
+        }
+    }
+
+    misses = cache_misses_stop(misses_fd);
+    t_end = bench_usec();
+
+    /* Each record is written by one context and read by another. */
+    total = (size_t) contexts * (size_t) records;
+    mbedtls_printf("  %-28s %10u bytes\n", "context size",
+                   (unsigned) sizeof(mbedtls_ssl_context));
+    mbedtls_printf("  %-28s %10u bytes\n", "record state",
+                   (unsigned) (offsetof(mbedtls_ssl_context, cur_out_ctr) +
+                               MBEDTLS_SSL_SEQUENCE_NUMBER_LEN));
+    mbedtls_printf("  %-28s %10llu ns\n", "time per record",
+                   (t_end - t_start) * 1000 / total);
+    if (misses_fd >= 0) {
+        mbedtls_printf("  %-28s %10.1f\n", "cache misses per record",
+                       (double) misses / (double) total);
+    } else {
+        mbedtls_printf("  %-28s %10s\n", "cache misses per record", "n/a");
+    }
+
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+    goto exit;
+
+usage:
+    mbedtls_printf(USAGE, DFL_CONTEXTS, DFL_RECORDS, DFL_SIZE, MAX_SIZE);
+
+exit:
+#if defined(__linux__)
+    if (misses_fd >= 0) {
+        close(misses_fd);
+    }
+#endif
+    if (clients != NULL && servers != NULL) {
+        for (i = 0; i < contexts; i++) {
+            mbedtls_ssl_free(&clients[i]);
+            mbedtls_ssl_free(&servers[i]);
+        }
+    }
+    mbedtls_free(clients);
+    mbedtls_free(servers);
+    mbedtls_free(client_state);
+    mbedtls_free(server_state);
+    mbedtls_ssl_free(&client);
+    mbedtls_ssl_free(&server);
+    mbedtls_ssl_config_free(&client_conf);
+    mbedtls_ssl_config_free(&server_conf);
+    mbedtls_free(to_client);
+    mbedtls_free(to_server);
+    mbedtls_pk_free(&pkey);
+    mbedtls_x509_crt_free(&srvcert);
+    mbedtls_x509_crt_free(&cacert);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+}
+
+#endif /* MBEDTLS_SSL_CLI_C && MBEDTLS_SSL_SRV_C && MBEDTLS_ENTROPY_C &&
+          MBEDTLS_CTR_DRBG_C && MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_PEM_PARSE_C &&
+          MBEDTLS_SSL_CONTEXT_SERIALIZATION && MBEDTLS_HAVE_TIME */
@@ -0,0 +1,341 @@
+/*
+ *  Benchmark for the start-up of TLS processes
+ *
+ *  Measures the time from the start of the process to the end of its
+ *  first handshake: crypto initialization, certificate and key parsing,
+ *  setting up a number of SSL configurations, and one handshake between
+ *  an in-process client and server. Each invocation measures one cold
+ *  start, so run the program several times to get a distribution.
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_SSL_CLI_C) || !defined(MBEDTLS_SSL_SRV_C) ||       \
+    !defined(MBEDTLS_ENTROPY_C) || !defined(MBEDTLS_CTR_DRBG_C) ||      \
+    !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_PEM_PARSE_C) || \
+    !defined(MBEDTLS_HAVE_TIME)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_SSL_CLI_C and/or MBEDTLS_SSL_SRV_C and/or "
+                   "MBEDTLS_ENTROPY_C and/or MBEDTLS_CTR_DRBG_C and/or "
+                   "MBEDTLS_X509_CRT_PARSE_C and/or MBEDTLS_PEM_PARSE_C and/or "
+                   "MBEDTLS_HAVE_TIME not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "mbedtls/ssl.h"
+#include "mbedtls/entropy.h"
+#include "mbedtls/ctr_drbg.h"
+#include "mbedtls/x509_crt.h"
+#include "psa/crypto.h"
+
+#include "test/certs.h"
+
+#define DFL_CONFIGS             32
+#define PIPE_SIZE               (64 * 1024)
+
+#define USAGE \
+    "\n usage: ssl_startup_bench param=<>...\n"                         \
+    "\n acceptable parameters:\n"                                       \
+    "    configs=%%d         SSL configurations set up before the\n"    \
+    "                        handshake, half client and half server\n"  \
+    "                        default: %d\n"                             \
+    "    version=%%s         tls12 or tls13\n"                          \
+    "                        default: negotiated\n"                     \
+    "\n"
+
+/* One direction of the in-memory connection */
+typedef struct {
+    unsigned char buf[PIPE_SIZE];
+    size_t len;
+} startup_pipe;
+
+typedef struct {
+    startup_pipe *in;
+    startup_pipe *out;
+} startup_bio;
+
+static unsigned long long bench_usec(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER now, freq;
+
+    QueryPerformanceCounter(&now);
+    QueryPerformanceFrequency(&freq);
+    return (unsigned long long) now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + now.tv_usec;
+#endif
+}
+
+static int pipe_send(void *ctx, const unsigned char *buf, size_t len)
+{
+    startup_pipe *out = ((startup_bio *) ctx)->out;
+
+    if (len > PIPE_SIZE - out->len) {
+        len = PIPE_SIZE - out->len;
+    }
+    if (len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_WRITE;
+    }
+
+    memcpy(out->buf + out->len, buf, len);
+    out->len += len;
+    return (int) len;
+}
+
+static int pipe_recv(void *ctx, unsigned char *buf, size_t len)
+{
+    startup_pipe *in = ((startup_bio *) ctx)->in;
+
+    if (in->len == 0) {
+        return MBEDTLS_ERR_SSL_WANT_READ;
+    }
+    if (len > in->len) {
+        len = in->len;
+    }
+
+    memcpy(buf, in->buf, len);
+    memmove(in->buf, in->buf + len, in->len - len);
+    in->len -= len;
+    return (int) len;
+}
+
+static int handshake_step(mbedtls_ssl_context *ssl, int *done)
+{
+    int ret;
+
+    if (*done) {
+        return 0;
+    }
+
+    ret = mbedtls_ssl_handshake(ssl);
+    if (ret == 0) {
+        *done = 1;
+    } else if (ret == MBEDTLS_ERR_SSL_WANT_READ ||
+               ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+        ret = 0;
+    }
+    return ret;
+}
+
+static void print_phase(const char *name, unsigned long long start,
+                        unsigned long long end)
+{
+    mbedtls_printf("  %-28s %10llu us\n", name, end - start);
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 1;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    int i, configs = DFL_CONFIGS;
+    int client_done = 0, server_done = 0;
+    const char *version = NULL;
+    const char *pers = "ssl_startup_bench";
+    unsigned long long t_start, t_psa, t_certs, t_configs, t_handshake;
+    mbedtls_entropy_context entropy;
+    mbedtls_ctr_drbg_context ctr_drbg;
+    mbedtls_x509_crt cacert, srvcert;
+    mbedtls_pk_context pkey;
+    mbedtls_ssl_config *confs = NULL;
+    mbedtls_ssl_context client, server;
+    startup_pipe *to_client = NULL, *to_server = NULL;
+    startup_bio client_bio, server_bio;
+    char *p, *q;
+
+    /* Everything before the first library call is part of the start-up */
+    t_start = bench_usec();
+
+    mbedtls_entropy_init(&entropy);
+    mbedtls_ctr_drbg_init(&ctr_drbg);
+    mbedtls_x509_crt_init(&cacert);
+    mbedtls_x509_crt_init(&srvcert);
+    mbedtls_pk_init(&pkey);
+    mbedtls_ssl_init(&client);
+    mbedtls_ssl_init(&server);
+
+    for (i = 1; i < argc; i++) {
+        p = argv[i];
+        if ((q = strchr(p, '=')) == NULL) {
+            goto usage;
+        }
+        *q++ = '\0';
+
+        if (strcmp(p, "configs") == 0) {
+            configs = atoi(q);
+            if (configs < 2 || configs > 100000) {
+                goto usage;
+            }
+        } else if (strcmp(p, "version") == 0) {
+            if (strcmp(q, "tls12") != 0 && strcmp(q, "tls13") != 0) {
+                goto usage;
+            }
+            version = q;
+        } else {
+            goto usage;
+        }
+    }
+
+    confs = mbedtls_calloc((size_t) configs, sizeof(mbedtls_ssl_config));
+    to_client = mbedtls_calloc(1, sizeof(startup_pipe));
+    to_server = mbedtls_calloc(1, sizeof(startup_pipe));
+    if (confs == NULL || to_client == NULL || to_server == NULL) {
+        mbedtls_printf("  ! Failed to allocate %d configurations\n", configs);
+        goto exit;
+    }
+    for (i = 0; i < configs; i++) {
+        mbedtls_ssl_config_init(&confs[i]);
+    }
+
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+                                     (const unsigned char *) pers,
+                                     strlen(pers))) != 0) {
+        mbedtls_printf("  ! mbedtls_ctr_drbg_seed returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    t_psa = bench_usec();
+
+    if ((ret = mbedtls_x509_crt_parse(&cacert,
+                                      (const unsigned char *) mbedtls_test_cas_pem,
+                                      mbedtls_test_cas_pem_len)) != 0 ||
+        (ret = mbedtls_x509_crt_parse(&srvcert,
+                                      (const unsigned char *) mbedtls_test_srv_crt,
+                                      mbedtls_test_srv_crt_len)) != 0) {
+        mbedtls_printf("  ! mbedtls_x509_crt_parse returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_pk_parse_key(&pkey,
+                                    (const unsigned char *) mbedtls_test_srv_key,
+                                    mbedtls_test_srv_key_len, NULL, 0,
+                                    mbedtls_ctr_drbg_random, &ctr_drbg)) != 0) {
+        mbedtls_printf("  ! mbedtls_pk_parse_key returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    t_certs = bench_usec();
+
+    /* Even configurations are clients, odd ones servers, as a process
+     * serving several virtual hosts and upstreams would have. */
+    for (i = 0; i < configs; i++) {
+        mbedtls_ssl_config *conf = &confs[i];
+        int endpoint = (i & 1) ? MBEDTLS_SSL_IS_SERVER : MBEDTLS_SSL_IS_CLIENT;
+
+        if ((ret = mbedtls_ssl_config_defaults(conf, endpoint,
+                                               MBEDTLS_SSL_TRANSPORT_STREAM,
+                                               MBEDTLS_SSL_PRESET_DEFAULT)) != 0) {
+            mbedtls_printf("  ! mbedtls_ssl_config_defaults returned -0x%x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+        mbedtls_ssl_conf_rng(conf, mbedtls_ctr_drbg_random, &ctr_drbg);
+        mbedtls_ssl_conf_ca_chain(conf, &cacert, NULL);
+        if (endpoint == MBEDTLS_SSL_IS_SERVER &&
+            (ret = mbedtls_ssl_conf_own_cert(conf, &srvcert, &pkey)) != 0) {
+            mbedtls_printf("  ! mbedtls_ssl_conf_own_cert returned -0x%x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+        if (version != NULL) {
+            mbedtls_ssl_protocol_version v = strcmp(version, "tls12") == 0 ?
+                                             MBEDTLS_SSL_VERSION_TLS1_2 :
+                                             MBEDTLS_SSL_VERSION_TLS1_3;
+            mbedtls_ssl_conf_min_tls_version(conf, v);
+            mbedtls_ssl_conf_max_tls_version(conf, v);
+        }
+    }
+
+    t_configs = bench_usec();
+
+    if ((ret = mbedtls_ssl_setup(&client, &confs[0])) != 0 ||
+        (ret = mbedtls_ssl_setup(&server, &confs[1])) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_setup returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+    if ((ret = mbedtls_ssl_set_hostname(&client, "localhost")) != 0) {
+        mbedtls_printf("  ! mbedtls_ssl_set_hostname returned -0x%x\n", (unsigned int) -ret);
+        goto exit;
+    }
+
+    client_bio.in = to_client;
+    client_bio.out = to_server;
+    server_bio.in = to_server;
+    server_bio.out = to_client;
+    mbedtls_ssl_set_bio(&client, &client_bio, pipe_send, pipe_recv, NULL);
+    mbedtls_ssl_set_bio(&server, &server_bio, pipe_send, pipe_recv, NULL);
+
+    while (!client_done || !server_done) {
+        if ((ret = handshake_step(&client, &client_done)) != 0 ||
+            (ret = handshake_step(&server, &server_done)) != 0) {
+            mbedtls_printf("  ! mbedtls_ssl_handshake returned -0x%x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+    }
+
+    t_handshake = bench_usec();
+
+    mbedtls_printf("  . %s, %d configurations\n",
+                   mbedtls_ssl_get_ciphersuite(&client), configs);
+    print_phase("crypto and RNG init", t_start, t_psa);
+    print_phase("certificates and key", t_psa, t_certs);
+    print_phase("configurations", t_certs, t_configs);
+    print_phase("first handshake", t_configs, t_handshake);
+    print_phase("time to first handshake", t_start, t_handshake);
+
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+    goto exit;
+
+usage:
+    mbedtls_printf(USAGE, DFL_CONFIGS);
+
+exit:
+    mbedtls_ssl_free(&client);
+    mbedtls_ssl_free(&server);
+    if (confs != NULL) {
+        for (i = 0; i < configs; i++) {
+            mbedtls_ssl_config_free(&confs[i]);
+        }
+    }
+    mbedtls_free(confs);
+    mbedtls_free(to_client);
+    mbedtls_free(to_server);
+    mbedtls_pk_free(&pkey);
+    mbedtls_x509_crt_free(&srvcert);
+    mbedtls_x509_crt_free(&cacert);
+    mbedtls_ctr_drbg_free(&ctr_drbg);
+    mbedtls_entropy_free(&entropy);
+    mbedtls_psa_crypto_free();
+
+    mbedtls_exit(exit_code);
+}
+
+#endif /* MBEDTLS_SSL_CLI_C && MBEDTLS_SSL_SRV_C && MBEDTLS_ENTROPY_C &&
+          MBEDTLS_CTR_DRBG_C && MBEDTLS_X509_CRT_PARSE_C && MBEDTLS_PEM_PARSE_C &&
+          MBEDTLS_HAVE_TIME */
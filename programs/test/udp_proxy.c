@@ -14,6 +14,11 @@
 
 #include "mbedtls/build_info.h"
 
+/* Throughput mode: many flows, batched I/O, bandwidth limit and latency */
+#if defined(MBEDTLS_NET_DGRAM_DEMUX) && defined(MBEDTLS_NET_REACTOR)
+#define UDP_PROXY_THROUGHPUT
+#endif
+
 #if defined(MBEDTLS_PLATFORM_C)
 #include "mbedtls/platform.h"
 #else
@@ -60,7 +65,8 @@ int main(void)
 #endif
 #endif /* _MSC_VER */
 #else /* ( _WIN32 || _WIN32_WCE ) && !EFIX64 && !EFI32 */
-#if defined(MBEDTLS_HAVE_TIME) || (defined(MBEDTLS_TIMING_C) && !defined(MBEDTLS_TIMING_ALT))
+#if defined(MBEDTLS_HAVE_TIME) || (defined(MBEDTLS_TIMING_C) && !defined(MBEDTLS_TIMING_ALT)) || \
+    defined(UDP_PROXY_THROUGHPUT)
 #include <sys/time.h>
 #endif
 #include <sys/select.h>
@@ -75,6 +81,8 @@ int main(void)
 #define DFL_LISTEN_ADDR         "localhost"
 #define DFL_LISTEN_PORT         "5556"
 #define DFL_PACK                0
+#define DFL_BURST               32768
+#define DFL_QUEUE               1024
 
 #if defined(MBEDTLS_TIMING_C)
 #define USAGE_PACK                                                          \
@@ -84,6 +92,28 @@ int main(void)
 #define USAGE_PACK
 #endif
 
+#if defined(UDP_PROXY_THROUGHPUT)
+#define USAGE_THROUGHPUT                                                    \
+    "\n"                                                                    \
+    "    flows=%%d            default: 0 (forward for a single client)\n"   \
+    "                        throughput mode: forward for up to N clients\n" \
+    "                        at once, receiving and sending datagrams in\n" \
+    "                        batches. Only drop and mtu apply; drop then\n" \
+    "                        covers all datagrams and may be up to 10000.\n" \
+    "    bandwidth=%%d        default: 0 (unlimited)\n"                     \
+    "                        limit each direction to N kbit/s, shared by\n" \
+    "                        all flows (token bucket)\n"                    \
+    "    burst=%%d            default: 32768\n"                             \
+    "                        token bucket depth in bytes\n"                 \
+    "    latency=%%d          default: 0\n"                                 \
+    "                        delay every datagram by N ms, each direction\n" \
+    "    queue=%%d            default: 1024\n"                              \
+    "                        datagrams held per direction, beyond which\n" \
+    "                        arriving datagrams are dropped\n"
+#else
+#define USAGE_THROUGHPUT
+#endif
+
 #define USAGE                                                               \
     "\n usage: udp_proxy param=<>...\n"                                     \
     "\n acceptable parameters:\n"                                           \
@@ -126,6 +156,7 @@ int main(void)
     "\n"                                                                    \
     "    seed=%%d             default: (use current time)\n"                \
     USAGE_PACK                                                              \
+    USAGE_THROUGHPUT                                                        \
     "\n"
 
 /*
@@ -159,6 +190,12 @@ static struct options {
     unsigned pack;              /* merge packets into single datagram for
                                  * at most \c merge milliseconds if > 0     */
     unsigned int seed;          /* seed for "random" events                 */
+
+    int flows;                  /* throughput mode: concurrent clients      */
+    unsigned bandwidth;         /* kbit/s per direction (unlimited if 0)    */
+    unsigned burst;             /* token bucket depth, in bytes             */
+    unsigned latency;           /* constant delay in ms, each direction     */
+    unsigned queue;             /* datagrams held per direction             */
 } opt;
 
 static void exit_usage(const char *name, const char *value)
@@ -183,6 +220,8 @@ static void get_options(int argc, char *argv[])
     opt.listen_addr    = DFL_LISTEN_ADDR;
     opt.listen_port    = DFL_LISTEN_PORT;
     opt.pack           = DFL_PACK;
+    opt.burst          = DFL_BURST;
+    opt.queue          = DFL_QUEUE;
     /* Other members default to 0 */
 
     opt.delay_cli_cnt = 0;
@@ -251,8 +290,9 @@ static void get_options(int argc, char *argv[])
 
             delay_list[(*delay_cnt)++] = buf;
         } else if (strcmp(p, "drop") == 0) {
+            /* Up to 20 unless in throughput mode, checked below */
             opt.drop = atoi(q);
-            if (opt.drop < 0 || opt.drop > 20 || opt.drop == 1) {
+            if (opt.drop < 0 || opt.drop > 10000 || opt.drop == 1) {
                 exit_usage(p, q);
             }
         } else if (strcmp(p, "pack") == 0) {
@@ -298,10 +338,60 @@ static void get_options(int argc, char *argv[])
             if (opt.seed == 0) {
                 exit_usage(p, q);
             }
-        } else {
+        }
+#if defined(UDP_PROXY_THROUGHPUT)
+        else if (strcmp(p, "flows") == 0) {
+            opt.flows = atoi(q);
+            if (opt.flows < 0 || opt.flows > 65536) {
+                exit_usage(p, q);
+            }
+        } else if (strcmp(p, "bandwidth") == 0) {
+            opt.bandwidth = (unsigned) atoi(q);
+            if (atoi(q) < 0) {
+                exit_usage(p, q);
+            }
+        } else if (strcmp(p, "burst") == 0) {
+            opt.burst = (unsigned) atoi(q);
+            if (atoi(q) <= 0) {
+                exit_usage(p, q);
+            }
+        } else if (strcmp(p, "latency") == 0) {
+            opt.latency = (unsigned) atoi(q);
+            if (atoi(q) < 0 || opt.latency > 60000) {
+                exit_usage(p, q);
+            }
+        } else if (strcmp(p, "queue") == 0) {
+            opt.queue = (unsigned) atoi(q);
+            if (atoi(q) <= 0 || opt.queue > 1000000) {
+                exit_usage(p, q);
+            }
+        }
+#endif /* UDP_PROXY_THROUGHPUT */
+        else {
             exit_usage(p, NULL);
         }
     }
+
+    if (opt.flows == 0) {
+        if (opt.drop > 20) {
+            mbedtls_printf(" option drop: more than 20 needs flows\n");
+            mbedtls_printf(USAGE);
+            mbedtls_exit(1);
+        }
+        if (opt.bandwidth != 0 || opt.burst != DFL_BURST ||
+            opt.latency != 0 || opt.queue != DFL_QUEUE) {
+            mbedtls_printf(" options bandwidth, burst, latency and queue need flows\n");
+            mbedtls_printf(USAGE);
+            mbedtls_exit(1);
+        }
+    } else if (opt.duplicate != 0 || opt.delay != 0 || opt.delay_ccs != 0 ||
+               opt.delay_cli_cnt != 0 || opt.delay_srv_cnt != 0 ||
+               opt.bad_ad != 0 || opt.bad_cid != 0 || opt.protect_hvr != 0 ||
+               opt.protect_len != 0 || opt.inject_clihlo != 0 || opt.pack != 0) {
+        mbedtls_printf(" option flows: only drop and mtu apply in throughput mode\n");
+        mbedtls_printf(USAGE);
+        mbedtls_exit(1);
+    }
 }
 
 static const char *msg_type(unsigned char *msg, size_t len)
@@ -756,6 +846,491 @@ static int handle_message(const char *way,
     return 0;
 }
 
+#if defined(UDP_PROXY_THROUGHPUT)
+/*
+ * Throughput mode
+ *
+ * The single-flow mode above handles one datagram at a time and prints
+ * each of them, which is what interoperability tests need but limits the
+ * rate. This mode instead forwards for many clients at once: datagrams
+ * from clients arrive on the listening socket through a datagram
+ * demultiplexer, which receives and sends them in batches, and each
+ * client (flow) gets its own socket connected to the server, so that the
+ * server sees distinct peers.
+ *
+ * Each direction models a link: datagrams wait in a FIFO queue for the
+ * token bucket to allow them (bandwidth, burst), then for a constant
+ * delay (latency). The queue is shared by all flows, like a bottleneck
+ * router, and arriving datagrams are dropped when it is full.
+ */
+
+#define THROUGHPUT_SLOT_SIZE    (MAX_MSG_SIZE)
+
+typedef struct {
+    int used;
+    unsigned gen;               /* incremented each time the slot is reused */
+    unsigned long long last_active;
+    mbedtls_net_dgram_peer peer;    /* the client, behind the listen socket */
+    mbedtls_net_context server_fd;  /* connected to the server              */
+    mbedtls_net_reactor_item item;
+} flow;
+
+typedef struct {
+    size_t flow;                /* index in the flow table                  */
+    unsigned gen;               /* generation of the flow                   */
+    size_t len;
+    unsigned long long due;     /* when to send it, once through the bucket */
+    unsigned char *data;
+} queued_datagram;
+
+typedef struct {
+    const char *way;
+    queued_datagram *ring;
+    unsigned char *pool;
+    size_t head;                /* oldest datagram                          */
+    size_t count;               /* datagrams in the queue                   */
+    size_t shaped;              /* of which were let through by the bucket  */
+    unsigned long long tokens;  /* in millionths of a byte                  */
+    unsigned long long refilled;
+
+    unsigned long long datagrams, bytes;    /* forwarded                    */
+    unsigned long long dropped;             /* loss, MTU, full queue        */
+    unsigned long long interval_bytes;
+} link_queue;
+
+static struct {
+    mbedtls_net_reactor reactor;
+    mbedtls_net_reactor_item listen_item;
+    mbedtls_net_dgram_demux demux;
+    flow *flows;
+    int active;                 /* flows in use                             */
+    link_queue link[2];         /* S <- C and S -> C                        */
+    unsigned long long start, last_stats;
+    unsigned char scratch[THROUGHPUT_SLOT_SIZE];
+} tp;
+
+static unsigned long long throughput_now(void)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (unsigned long long) now.tv_sec * 1000000 + (unsigned long long) now.tv_usec;
+}
+
+/* Bytes per second and bucket depth in millionths of a byte */
+static unsigned long long link_rate(void)
+{
+    return (unsigned long long) opt.bandwidth * 125;
+}
+
+static unsigned long long link_depth(void)
+{
+    return (unsigned long long) opt.burst * 1000000;
+}
+
+static int link_setup(link_queue *link, const char *way)
+{
+    size_t i;
+
+    link->way = way;
+    link->ring = mbedtls_calloc(opt.queue, sizeof(queued_datagram));
+    link->pool = mbedtls_calloc(opt.queue, THROUGHPUT_SLOT_SIZE);
+    if (link->ring == NULL || link->pool == NULL) {
+        return -1;
+    }
+    for (i = 0; i < opt.queue; i++) {
+        link->ring[i].data = link->pool + i * THROUGHPUT_SLOT_SIZE;
+    }
+    link->tokens = link_depth();
+    link->refilled = throughput_now();
+
+    return 0;
+}
+
+static void link_free(link_queue *link)
+{
+    mbedtls_free(link->ring);
+    mbedtls_free(link->pool);
+}
+
+/*
+ * Read the datagrams available from a flow into the tail of a link
+ */
+static void link_receive(link_queue *link, flow *f,
+                         mbedtls_ssl_recv_t *f_recv, void *ctx)
+{
+    queued_datagram *d;
+    int ret, errors = 0;
+
+    while (1) {
+        d = NULL;
+        if (link->count < opt.queue) {
+            d = &link->ring[(link->head + link->count) % opt.queue];
+        }
+
+        ret = f_recv(ctx, d != NULL ? d->data : tp.scratch, THROUGHPUT_SLOT_SIZE);
+        if (ret < 0) {
+            /* An error, such as ECONNREFUSED before the server is up, is
+             * reported once: try again before giving up on the socket. */
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ || ++errors > 1) {
+                break;
+            }
+            continue;
+        }
+
+        f->last_active = throughput_now();
+        if (d == NULL ||
+            (opt.mtu != 0 && ret > opt.mtu) ||
+            (opt.drop != 0 && rand() % opt.drop == 0)) {
+            link->dropped++;
+            continue;
+        }
+
+        d->flow = (size_t) (f - tp.flows);
+        d->gen = f->gen;
+        d->len = (size_t) ret;
+        d->due = 0;
+        link->count++;
+    }
+}
+
+/*
+ * Let datagrams through the token bucket, in order
+ */
+static void link_shape(link_queue *link, unsigned long long now)
+{
+    unsigned long long need, elapsed;
+    queued_datagram *d;
+
+    if (opt.bandwidth != 0 && now > link->refilled) {
+        elapsed = now - link->refilled;
+        if (elapsed >= (link_depth() - link->tokens) / link_rate()) {
+            link->tokens = link_depth();
+        } else {
+            link->tokens += elapsed * link_rate();
+        }
+    }
+    link->refilled = now;
+
+    while (link->shaped < link->count) {
+        d = &link->ring[(link->head + link->shaped) % opt.queue];
+        if (opt.bandwidth != 0) {
+            need = (unsigned long long) d->len * 1000000;
+            /* A datagram larger than the bucket goes with a full bucket */
+            if (link->tokens < need && link->tokens < link_depth()) {
+                break;
+            }
+            link->tokens = link->tokens >= need ? link->tokens - need : 0;
+        }
+        d->due = now + (unsigned long long) opt.latency * 1000;
+        link->shaped++;
+    }
+}
+
+/*
+ * Send the datagrams whose delay is over
+ */
+static void link_send(link_queue *link, int to_server,
+                      unsigned long long now)
+{
+    queued_datagram *d;
+    flow *f;
+    int ret;
+
+    while (link->shaped > 0) {
+        d = &link->ring[link->head];
+        if (d->due > now) {
+            break;
+        }
+
+        f = &tp.flows[d->flow];
+        if (!f->used || f->gen != d->gen) {
+            ret = -1;
+        } else if (to_server) {
+            ret = mbedtls_net_send(&f->server_fd, d->data, d->len);
+        } else {
+            ret = mbedtls_net_dgram_peer_send(&f->peer, d->data, d->len);
+        }
+
+        if (ret < 0) {
+            link->dropped++;
+        } else {
+            link->datagrams++;
+            link->bytes += d->len;
+            link->interval_bytes += d->len;
+        }
+
+        link->head = (link->head + 1) % opt.queue;
+        link->count--;
+        link->shaped--;
+    }
+}
+
+/*
+ * Microseconds until a link has something to do, or -1
+ */
+static unsigned long long link_wait(const link_queue *link,
+                                    unsigned long long now)
+{
+    const queued_datagram *d;
+    unsigned long long need;
+
+    if (link->shaped > 0) {
+        d = &link->ring[link->head];
+        return d->due > now ? d->due - now : 0;
+    }
+
+    if (link->shaped < link->count) {
+        /* Waiting for tokens, so the bandwidth is limited */
+        d = &link->ring[(link->head + link->shaped) % opt.queue];
+        need = (unsigned long long) d->len * 1000000;
+        if (need > link_depth()) {
+            need = link_depth();
+        }
+        if (link->tokens >= need) {
+            return 0;
+        }
+        return (need - link->tokens + link_rate() - 1) / link_rate();
+    }
+
+    return (unsigned long long) -1;
+}
+
+static void flow_close(flow *f)
+{
+    mbedtls_net_reactor_remove(&tp.reactor, &f->item);
+    mbedtls_net_dgram_peer_remove(&f->peer);
+    mbedtls_net_free(&f->server_fd);
+    f->used = 0;
+    f->gen++;
+    tp.active--;
+}
+
+static void flow_client_ready(void *p_ready, uint32_t events)
+{
+    flow *f = (flow *) p_ready;
+
+    (void) events;
+    link_receive(&tp.link[0], f, mbedtls_net_dgram_peer_recv, &f->peer);
+}
+
+static void flow_server_ready(void *p_ready, uint32_t events)
+{
+    flow *f = (flow *) p_ready;
+
+    if (events & MBEDTLS_NET_POLL_READ) {
+        link_receive(&tp.link[1], f, mbedtls_net_recv, &f->server_fd);
+    }
+}
+
+/*
+ * A datagram from a new client: open a flow for it. The table has a spare
+ * slot, as the demultiplexer does not allow closing another flow from
+ * here; flow_evict() makes room again afterwards.
+ */
+static mbedtls_net_dgram_peer *flow_accept(void *p_accept,
+                                           const unsigned char *addr,
+                                           size_t addr_len,
+                                           const unsigned char *buf,
+                                           size_t len)
+{
+    flow *f = NULL;
+    int i, ret;
+
+    (void) p_accept;
+    (void) buf;
+    (void) len;
+
+    for (i = 0; i <= opt.flows && f == NULL; i++) {
+        if (!tp.flows[i].used) {
+            f = &tp.flows[i];
+        }
+    }
+    if (f == NULL) {
+        /* More new clients in one batch than spare slots: as if lost */
+        tp.link[0].dropped++;
+        return NULL;
+    }
+
+    mbedtls_net_init(&f->server_fd);
+    mbedtls_net_dgram_peer_init(&f->peer);
+
+    if ((ret = mbedtls_net_connect(&f->server_fd, opt.server_addr, opt.server_port,
+                                   MBEDTLS_NET_PROTO_UDP)) != 0 ||
+        (ret = mbedtls_net_set_nonblock(&f->server_fd)) != 0 ||
+        (ret = mbedtls_net_reactor_add(&tp.reactor, &f->item, &f->server_fd,
+                                       flow_server_ready, f)) != 0) {
+        mbedtls_printf("  ! cannot open a flow to the server: -%#04x\n",
+                       (unsigned int) -ret);
+        mbedtls_net_free(&f->server_fd);
+        return NULL;
+    }
+    if ((ret = mbedtls_net_dgram_peer_add(&tp.demux, &f->peer, addr, addr_len,
+                                          flow_client_ready, f)) != 0) {
+        mbedtls_printf("  ! mbedtls_net_dgram_peer_add returned -%#04x\n",
+                       (unsigned int) -ret);
+        mbedtls_net_reactor_remove(&tp.reactor, &f->item);
+        mbedtls_net_free(&f->server_fd);
+        return NULL;
+    }
+
+    f->used = 1;
+    f->last_active = throughput_now();
+    tp.active++;
+    mbedtls_printf("  . flow %u: new client, %d active\n",
+                   (unsigned) (f - tp.flows), tp.active);
+    fflush(stdout);
+
+    return &f->peer;
+}
+
+/*
+ * Close the least recently active flows beyond the limit
+ */
+static void flow_evict(void)
+{
+    flow *f;
+    int i;
+
+    while (tp.active > opt.flows) {
+        f = NULL;
+        for (i = 0; i <= opt.flows; i++) {
+            if (tp.flows[i].used &&
+                (f == NULL || tp.flows[i].last_active < f->last_active)) {
+                f = &tp.flows[i];
+            }
+        }
+        mbedtls_printf("  . flow %u: closed to make room\n", (unsigned) (f - tp.flows));
+        flow_close(f);
+    }
+}
+
+static void listen_ready(void *p_ready, uint32_t events)
+{
+    (void) p_ready;
+
+    /* Edge-triggered: drain the socket */
+    if (events & MBEDTLS_NET_POLL_READ) {
+        while (mbedtls_net_dgram_receive(&tp.demux) > 0) {
+        }
+    }
+    if (events & MBEDTLS_NET_POLL_WRITE) {
+        mbedtls_net_dgram_flush(&tp.demux);
+    }
+}
+
+/* Print the counters about once per second while there is traffic */
+static void throughput_stats(unsigned long long now)
+{
+    unsigned long long interval = now - tp.last_stats;
+
+    if (interval < 1000000) {
+        return;
+    }
+
+    if (tp.link[0].interval_bytes != 0 || tp.link[1].interval_bytes != 0) {
+        mbedtls_printf("  %05llu %s %llu datagrams, %llu kbit/s, %llu dropped;"
+                       " %s %llu datagrams, %llu kbit/s, %llu dropped; %d flows\n",
+                       (now - tp.start) / 1000,
+                       tp.link[0].way, tp.link[0].datagrams,
+                       tp.link[0].interval_bytes * 8000 / interval,
+                       tp.link[0].dropped,
+                       tp.link[1].way, tp.link[1].datagrams,
+                       tp.link[1].interval_bytes * 8000 / interval,
+                       tp.link[1].dropped,
+                       tp.active);
+        fflush(stdout);
+    }
+
+    tp.link[0].interval_bytes = 0;
+    tp.link[1].interval_bytes = 0;
+    tp.last_stats = now;
+}
+
+static int throughput_proxy(mbedtls_net_context *listen_fd)
+{
+    unsigned long long now, wait, w;
+    int i, ret, listening = 0;
+
+    mbedtls_net_reactor_init(&tp.reactor);
+    mbedtls_net_dgram_init(&tp.demux);
+
+    tp.flows = mbedtls_calloc((size_t) opt.flows + 1, sizeof(flow));
+    if (tp.flows == NULL ||
+        link_setup(&tp.link[0], "S <- C") != 0 ||
+        link_setup(&tp.link[1], "S -> C") != 0) {
+        mbedtls_printf("  ! allocation failed\n");
+        ret = -1;
+        goto exit;
+    }
+
+    if ((ret = mbedtls_net_set_nonblock(listen_fd)) != 0 ||
+        (ret = mbedtls_net_reactor_setup(&tp.reactor)) != 0 ||
+        (ret = mbedtls_net_dgram_setup(&tp.demux, listen_fd, THROUGHPUT_SLOT_SIZE,
+                                       (size_t) opt.flows, 0)) != 0 ||
+        (ret = mbedtls_net_reactor_add(&tp.reactor, &tp.listen_item, listen_fd,
+                                       listen_ready, NULL)) != 0) {
+        mbedtls_printf("  ! cannot set up throughput mode: -%#04x\n",
+                       (unsigned int) -ret);
+        goto exit;
+    }
+    listening = 1;
+    mbedtls_net_dgram_set_accept_cb(&tp.demux, flow_accept, NULL);
+
+    mbedtls_printf("  . Forwarding for up to %d flows (kill the process to terminate it)\n",
+                   opt.flows);
+    fflush(stdout);
+
+    tp.start = throughput_now();
+    tp.last_stats = tp.start;
+
+    while (1) {
+        now = throughput_now();
+        for (i = 0; i < 2; i++) {
+            link_shape(&tp.link[i], now);
+            link_send(&tp.link[i], i == 0, now);
+        }
+        mbedtls_net_dgram_flush(&tp.demux);
+        throughput_stats(now);
+
+        wait = 1000000 - (now - tp.last_stats);
+        for (i = 0; i < 2; i++) {
+            w = link_wait(&tp.link[i], now);
+            if (w < wait) {
+                wait = w;
+            }
+        }
+
+        ret = mbedtls_net_reactor_dispatch(&tp.reactor, (uint32_t) ((wait + 999) / 1000));
+        if (ret < 0) {
+            mbedtls_printf("  ! mbedtls_net_reactor_dispatch returned -%#04x\n",
+                           (unsigned int) -ret);
+            goto exit;
+        }
+        flow_evict();
+    }
+
+exit:
+    if (tp.flows != NULL) {
+        for (i = 0; i <= opt.flows; i++) {
+            if (tp.flows[i].used) {
+                flow_close(&tp.flows[i]);
+            }
+        }
+    }
+    if (listening) {
+        mbedtls_net_reactor_remove(&tp.reactor, &tp.listen_item);
+    }
+    mbedtls_net_dgram_free(&tp.demux);
+    mbedtls_net_reactor_free(&tp.reactor);
+    link_free(&tp.link[0]);
+    link_free(&tp.link[1]);
+    mbedtls_free(tp.flows);
+
+    return ret;
+}
+#endif /* UDP_PROXY_THROUGHPUT */
+
 int main(int argc, char *argv[])
 {
     int ret = 1;
@@ -799,19 +1374,21 @@ int main(int argc, char *argv[])
     srand(opt.seed);
 
     /*
-     * 0. "Connect" to the server
+     * 0. "Connect" to the server, unless each flow does
      */
-    mbedtls_printf("  . Connect to server on UDP/%s/%s ...",
-                   opt.server_addr, opt.server_port);
-    fflush(stdout);
+    if (opt.flows == 0) {
+        mbedtls_printf("  . Connect to server on UDP/%s/%s ...",
+                       opt.server_addr, opt.server_port);
+        fflush(stdout);
 
-    if ((ret = mbedtls_net_connect(&server_fd, opt.server_addr, opt.server_port,
-                                   MBEDTLS_NET_PROTO_UDP)) != 0) {
-        mbedtls_printf(" failed\n  ! mbedtls_net_connect returned %d\n\n", ret);
-        goto exit;
-    }
+        if ((ret = mbedtls_net_connect(&server_fd, opt.server_addr, opt.server_port,
+                                       MBEDTLS_NET_PROTO_UDP)) != 0) {
+            mbedtls_printf(" failed\n  ! mbedtls_net_connect returned %d\n\n", ret);
+            goto exit;
+        }
 
-    mbedtls_printf(" ok\n");
+        mbedtls_printf(" ok\n");
+    }
 
     /*
      * 1. Setup the "listening" UDP socket
@@ -828,6 +1405,13 @@ int main(int argc, char *argv[])
 
     mbedtls_printf(" ok\n");
 
+#if defined(UDP_PROXY_THROUGHPUT)
+    if (opt.flows > 0) {
+        ret = throughput_proxy(&listen_fd);
+        goto exit;
+    }
+#endif /* UDP_PROXY_THROUGHPUT */
+
     /*
      * 2. Wait until a client connects
      */
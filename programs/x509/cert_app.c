@@ -36,9 +36,27 @@ int main(void)
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(MBEDTLS_HAVE_TIME)
+#include "mbedtls/platform_time.h"
+#endif
+
+#if defined(MBEDTLS_THREADING_PTHREAD) && \
+    !(defined(_WIN32) && !defined(EFIX64) && !defined(EFI32))
+#define BULK_THREADS
+#include <pthread.h>
+#endif
+
+#if !defined(_WIN32) || defined(EFIX64) || defined(EFI32)
+#define BULK_DIRECTORY
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#endif
+
 #define MODE_NONE               0
 #define MODE_FILE               1
 #define MODE_SSL                2
+#define MODE_BULK               3
 
 #define DFL_MODE                MODE_NONE
 #define DFL_FILENAME            "cert.crt"
@@ -49,6 +67,11 @@ int main(void)
 #define DFL_SERVER_PORT         "4433"
 #define DFL_DEBUG_LEVEL         0
 #define DFL_PERMISSIVE          0
+#define DFL_CERT_PATH           ""
+#define DFL_THREADS             1
+
+#define BULK_MAX_THREADS        256
+#define BULK_QUEUE_SIZE         1024
 
 #define USAGE_IO \
     "    ca_file=%%s          The single file containing the top-level CA(s) you fully trust\n" \
@@ -58,12 +81,19 @@ int main(void)
     "    ca_path=%%s          The path containing the top-level CA(s) you fully trust\n" \
     "                        default: \"\" (none) (overrides ca_file)\n"
 
+#define USAGE_BULK \
+    "    cert_path=%%s        mode=bulk: directory with one certificate or chain\n" \
+    "                        per file, leaf first (overrides filename, which\n" \
+    "                        is otherwise read as a stream of PEM leaves)\n" \
+    "    threads=%%d          mode=bulk: verifying threads, default: 1\n"
+
 #define USAGE \
     "\n usage: cert_app param=<>...\n"                  \
     "\n acceptable parameters:\n"                       \
-    "    mode=file|ssl       default: none\n"           \
+    "    mode=file|ssl|bulk  default: none\n"           \
     "    filename=%%s         default: cert.crt\n"      \
     USAGE_IO                                            \
+    USAGE_BULK                                          \
     "    server_name=%%s      default: localhost\n"     \
     "    server_port=%%d      default: 4433\n"          \
     "    debug_level=%%d      default: 0 (disabled)\n"  \
@@ -84,6 +114,8 @@ struct options {
     const char *server_port;    /* port on which the ssl service runs   */
     int debug_level;            /* level of debugging                   */
     int permissive;             /* permissive parsing                   */
+    const char *cert_path;      /* directory of certificates (bulk only) */
+    int threads;                /* verifying threads (bulk only)        */
 } opt;
 
 static void my_debug(void *ctx, int level,
@@ -115,6 +147,343 @@ static int my_verify(void *data, mbedtls_x509_crt *crt, int depth, uint32_t *fla
     return 0;
 }
 
+/*
+ * Bulk verification: the main thread streams the certificates into a queue,
+ * and the threads verify them against the same trusted CAs and CRLs, which
+ * they only read.
+ */
+static const struct {
+    uint32_t flags;
+    const char *name;
+} bulk_classes[] = {
+    { MBEDTLS_X509_BADCERT_NOT_TRUSTED, "not trusted" },
+    { MBEDTLS_X509_BADCERT_EXPIRED | MBEDTLS_X509_BADCRL_EXPIRED, "expired" },
+    { MBEDTLS_X509_BADCERT_FUTURE | MBEDTLS_X509_BADCRL_FUTURE, "not yet valid" },
+    { MBEDTLS_X509_BADCERT_REVOKED, "revoked" },
+    { MBEDTLS_X509_BADCERT_BAD_MD | MBEDTLS_X509_BADCRL_BAD_MD, "bad hash" },
+    { MBEDTLS_X509_BADCERT_BAD_PK | MBEDTLS_X509_BADCRL_BAD_PK, "bad key type" },
+    { MBEDTLS_X509_BADCERT_BAD_KEY | MBEDTLS_X509_BADCRL_BAD_KEY, "bad key" },
+    { MBEDTLS_X509_BADCERT_KEY_USAGE | MBEDTLS_X509_BADCERT_EXT_KEY_USAGE |
+      MBEDTLS_X509_BADCERT_NS_CERT_TYPE, "bad usage" },
+    { MBEDTLS_X509_BADCRL_NOT_TRUSTED, "untrusted CRL" },
+    { MBEDTLS_X509_BADCERT_OTHER, "other" },
+};
+
+#define BULK_CLASSES (sizeof(bulk_classes) / sizeof(bulk_classes[0]))
+
+typedef struct {
+    unsigned long verified;     /* certificates verified                */
+    unsigned long failed;       /* certificates that failed to verify   */
+    unsigned long parse_errors; /* items that failed to parse           */
+    unsigned long errors;       /* verifications that failed otherwise  */
+    unsigned long classes[BULK_CLASSES];
+} bulk_stats;
+
+/* A PEM certificate of the stream, or the path of a file if len is 0 */
+typedef struct {
+    char *data;
+    size_t len;
+} bulk_item;
+
+static struct {
+    mbedtls_x509_crt *cacert;
+    mbedtls_x509_crl *cacrl;
+#if defined(BULK_THREADS)
+    pthread_mutex_t mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    bulk_item queue[BULK_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    int done;
+#endif
+} bulk;
+
+static void bulk_verify(bulk_item *item, bulk_stats *stats)
+{
+    int ret;
+    size_t i;
+    uint32_t flags;
+    mbedtls_x509_crt crt;
+
+    mbedtls_x509_crt_init(&crt);
+
+    if (item->len != 0) {
+        ret = mbedtls_x509_crt_parse(&crt, (const unsigned char *) item->data,
+                                     item->len);
+    } else {
+        ret = mbedtls_x509_crt_parse_file(&crt, item->data);
+    }
+    if (ret < 0 || (ret > 0 && opt.permissive == 0) || crt.raw.len == 0) {
+        stats->parse_errors++;
+        goto exit;
+    }
+
+    ret = mbedtls_x509_crt_verify(&crt, bulk.cacert, bulk.cacrl, NULL, &flags,
+                                  NULL, NULL);
+    if (ret == 0) {
+        stats->verified++;
+    } else if (ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
+        stats->failed++;
+        for (i = 0; i < BULK_CLASSES; i++) {
+            if (flags & bulk_classes[i].flags) {
+                stats->classes[i]++;
+            }
+        }
+    } else {
+        stats->errors++;
+    }
+
+exit:
+    mbedtls_x509_crt_free(&crt);
+    mbedtls_free(item->data);
+}
+
+#if defined(BULK_THREADS)
+typedef struct {
+    pthread_t id;
+    bulk_stats stats;
+} bulk_thread;
+
+static void *bulk_worker(void *arg)
+{
+    bulk_thread *t = (bulk_thread *) arg;
+    bulk_item item;
+
+    for (;;) {
+        pthread_mutex_lock(&bulk.mutex);
+        while (bulk.count == 0 && !bulk.done) {
+            pthread_cond_wait(&bulk.not_empty, &bulk.mutex);
+        }
+        if (bulk.count == 0) {
+            pthread_mutex_unlock(&bulk.mutex);
+            return NULL;
+        }
+        item = bulk.queue[bulk.head];
+        bulk.head = (bulk.head + 1) % BULK_QUEUE_SIZE;
+        bulk.count--;
+        pthread_cond_signal(&bulk.not_full);
+        pthread_mutex_unlock(&bulk.mutex);
+
+        bulk_verify(&item, &t->stats);
+    }
+}
+#endif /* BULK_THREADS */
+
+/* Hand an item over to the threads, or verify it now without threads */
+static void bulk_submit(bulk_item *item, bulk_stats *stats)
+{
+#if defined(BULK_THREADS)
+    if (opt.threads > 1) {
+        pthread_mutex_lock(&bulk.mutex);
+        while (bulk.count == BULK_QUEUE_SIZE) {
+            pthread_cond_wait(&bulk.not_full, &bulk.mutex);
+        }
+        bulk.queue[(bulk.head + bulk.count) % BULK_QUEUE_SIZE] = *item;
+        bulk.count++;
+        pthread_cond_signal(&bulk.not_empty);
+        pthread_mutex_unlock(&bulk.mutex);
+        return;
+    }
+#endif
+    bulk_verify(item, stats);
+}
+
+/* Submit each PEM certificate of a file, without loading the whole file */
+static int bulk_read_file(const char *path, bulk_stats *stats)
+{
+    FILE *f;
+    char line[1024];
+    char *pem = NULL, *grown;
+    size_t len = 0, size = 0, n;
+    bulk_item item;
+
+    if ((f = fopen(path, "rb")) == NULL) {
+        mbedtls_printf(" failed\n  !  Cannot open %s\n\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (pem == NULL && strncmp(line, "-----BEGIN CERTIFICATE-----", 27) != 0) {
+            continue;
+        }
+
+        n = strlen(line);
+        if (pem == NULL || len + n + 1 > size) {
+            size = (len + n + 1) * 2;
+            if ((grown = mbedtls_calloc(1, size)) == NULL) {
+                mbedtls_free(pem);
+                fclose(f);
+                mbedtls_printf(" failed\n  !  Out of memory\n\n");
+                return -1;
+            }
+            if (pem != NULL) {
+                memcpy(grown, pem, len);
+                mbedtls_free(pem);
+            }
+            pem = grown;
+        }
+        memcpy(pem + len, line, n + 1);
+        len += n;
+
+        if (strncmp(line, "-----END CERTIFICATE-----", 25) == 0) {
+            /* The PEM parser wants the terminating null byte. */
+            item.data = pem;
+            item.len = len + 1;
+            bulk_submit(&item, stats);
+            pem = NULL;
+            len = 0;
+        }
+    }
+
+    mbedtls_free(pem);
+    fclose(f);
+    return 0;
+}
+
+#if defined(BULK_DIRECTORY)
+/* Submit the path of each regular file of a directory */
+static int bulk_read_directory(const char *path, bulk_stats *stats)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct stat sb;
+    bulk_item item;
+    size_t len;
+
+    if ((dir = opendir(path)) == NULL) {
+        mbedtls_printf(" failed\n  !  Cannot open directory %s\n\n", path);
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        len = strlen(path) + strlen(entry->d_name) + 2;
+        if ((item.data = mbedtls_calloc(1, len)) == NULL) {
+            closedir(dir);
+            mbedtls_printf(" failed\n  !  Out of memory\n\n");
+            return -1;
+        }
+        mbedtls_snprintf(item.data, len, "%s/%s", path, entry->d_name);
+        item.len = 0;
+
+        if (stat(item.data, &sb) != 0 || !S_ISREG(sb.st_mode)) {
+            mbedtls_free(item.data);
+            continue;
+        }
+        bulk_submit(&item, stats);
+    }
+
+    closedir(dir);
+    return 0;
+}
+#endif /* BULK_DIRECTORY */
+
+static int bulk_run(mbedtls_x509_crt *cacert, mbedtls_x509_crl *cacrl)
+{
+    int ret;
+    size_t c;
+    unsigned long total;
+    bulk_stats stats;
+#if defined(BULK_THREADS)
+    static bulk_thread threads[BULK_MAX_THREADS];
+    int i, started = 0;
+#endif
+#if defined(MBEDTLS_HAVE_TIME)
+    mbedtls_ms_time_t start = mbedtls_ms_time(), elapsed;
+#endif
+
+    memset(&stats, 0, sizeof(stats));
+    bulk.cacert = cacert;
+    bulk.cacrl = cacrl;
+
+#if defined(BULK_THREADS)
+    if (opt.threads > 1) {
+        pthread_mutex_init(&bulk.mutex, NULL);
+        pthread_cond_init(&bulk.not_empty, NULL);
+        pthread_cond_init(&bulk.not_full, NULL);
+        for (; started < opt.threads; started++) {
+            memset(&threads[started].stats, 0, sizeof(bulk_stats));
+            if (pthread_create(&threads[started].id, NULL, bulk_worker,
+                               &threads[started]) != 0) {
+                break;
+            }
+        }
+        if (started == 0) {
+            mbedtls_printf(" failed\n  !  Cannot start the threads\n\n");
+            return -1;
+        }
+    }
+#else
+    if (opt.threads > 1) {
+        mbedtls_printf("\n  ! Threads not supported, verifying in one thread\n");
+    }
+#endif
+
+    mbedtls_printf("\n  . Verifying the certificates ...");
+    fflush(stdout);
+
+#if defined(BULK_DIRECTORY)
+    if (strlen(opt.cert_path)) {
+        ret = bulk_read_directory(opt.cert_path, &stats);
+    } else {
+        ret = bulk_read_file(opt.filename, &stats);
+    }
+#else
+    ret = bulk_read_file(opt.filename, &stats);
+#endif
+
+#if defined(BULK_THREADS)
+    if (opt.threads > 1) {
+        pthread_mutex_lock(&bulk.mutex);
+        bulk.done = 1;
+        pthread_cond_broadcast(&bulk.not_empty);
+        pthread_mutex_unlock(&bulk.mutex);
+
+        for (i = 0; i < started; i++) {
+            pthread_join(threads[i].id, NULL);
+            stats.verified += threads[i].stats.verified;
+            stats.failed += threads[i].stats.failed;
+            stats.parse_errors += threads[i].stats.parse_errors;
+            stats.errors += threads[i].stats.errors;
+            for (c = 0; c < BULK_CLASSES; c++) {
+                stats.classes[c] += threads[i].stats.classes[c];
+            }
+        }
+
+        pthread_cond_destroy(&bulk.not_full);
+        pthread_cond_destroy(&bulk.not_empty);
+        pthread_mutex_destroy(&bulk.mutex);
+    }
+#endif
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    total = stats.verified + stats.failed + stats.parse_errors + stats.errors;
+    mbedtls_printf(" ok\n");
+    mbedtls_printf("  . Certificates: %lu, verified: %lu, failed: %lu, "
+                   "unparsable: %lu, errors: %lu\n", total, stats.verified,
+                   stats.failed, stats.parse_errors, stats.errors);
+#if defined(MBEDTLS_HAVE_TIME)
+    elapsed = mbedtls_ms_time() - start;
+    mbedtls_printf("  . Time: %lu ms, %lu certificates/s\n",
+                   (unsigned long) elapsed,
+                   elapsed > 0 ? (unsigned long) (total * 1000 / elapsed) : total);
+#endif
+    if (stats.failed != 0) {
+        mbedtls_printf("  . Failure classes (a certificate can have several):\n");
+        for (c = 0; c < BULK_CLASSES; c++) {
+            if (stats.classes[c] != 0) {
+                mbedtls_printf("      %-16s %lu\n", bulk_classes[c].name,
+                               stats.classes[c]);
+            }
+        }
+    }
+
+    return 0;
+}
+
 int main(int argc, char *argv[])
 {
     int ret = 1;
@@ -174,6 +543,8 @@ usage:
     opt.server_port         = DFL_SERVER_PORT;
     opt.debug_level         = DFL_DEBUG_LEVEL;
     opt.permissive          = DFL_PERMISSIVE;
+    opt.cert_path           = DFL_CERT_PATH;
+    opt.threads             = DFL_THREADS;
 
     for (i = 1; i < argc; i++) {
         p = argv[i];
@@ -193,6 +564,8 @@ usage:
                 opt.mode = MODE_FILE;
             } else if (strcmp(q, "ssl") == 0) {
                 opt.mode = MODE_SSL;
+            } else if (strcmp(q, "bulk") == 0) {
+                opt.mode = MODE_BULK;
             } else {
                 goto usage;
             }
@@ -218,6 +591,13 @@ usage:
             if (opt.permissive < 0 || opt.permissive > 1) {
                 goto usage;
             }
+        } else if (strcmp(p, "cert_path") == 0) {
+            opt.cert_path = q;
+        } else if (strcmp(p, "threads") == 0) {
+            opt.threads = atoi(q);
+            if (opt.threads < 1 || opt.threads > BULK_MAX_THREADS) {
+                goto usage;
+            }
         } else {
             goto usage;
         }
@@ -329,6 +709,15 @@ usage:
         }
 
         mbedtls_x509_crt_free(&crt);
+    } else if (opt.mode == MODE_BULK) {
+        if (!verify) {
+            mbedtls_printf("  ! mode=bulk needs ca_file or ca_path\n\n");
+            goto exit;
+        }
+
+        if (bulk_run(&cacert, &cacrl) != 0) {
+            goto exit;
+        }
     } else if (opt.mode == MODE_SSL) {
         /*
          * 1. Initialize the RNG and the session data
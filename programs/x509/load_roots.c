@@ -27,14 +27,39 @@ int main(void)
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(MBEDTLS_X509_TRUST_IMAGE) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define DFL_ITERATIONS          1
 #define DFL_PRIME_CACHE         1
+#define DFL_IMAGE               NULL
+#define DFL_BUNDLE              0
+
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+#define USAGE_IMAGE \
+    "    image=%%s            Load this trust image (see trust_image) instead of FILE...\n"
+#else
+#define USAGE_IMAGE ""
+#endif
+
+#if defined(MBEDTLS_PEM_PARSE_C)
+#define USAGE_BUNDLE \
+    "    bundle=%%d           Parse FILE... with mbedtls_x509_crt_parse_bundle_file()? Default: 0 (no)\n"
+#else
+#define USAGE_BUNDLE ""
+#endif
 
 #define USAGE \
     "\n usage: load_roots param=<>... [--] FILE...\n"   \
     "\n acceptable parameters:\n"                       \
     "    iterations=%%d        Iteration count (not including cache priming); default: 1\n"  \
     "    prime=%%d             Prime the disk read cache? Default: 1 (yes)\n"  \
+    USAGE_IMAGE                                         \
+    USAGE_BUNDLE                                        \
     "\n"
 
 
@@ -45,6 +70,8 @@ struct options {
     const char **filenames;     /* NULL-terminated list of file names */
     unsigned iterations;        /* Number of iterations to time */
     int prime_cache;            /* Prime the disk read cache? */
+    const char *image;          /* trust image to load instead */
+    int bundle;                 /* Use the PEM bundle loader? */
 } opt;
 
 
@@ -57,6 +84,11 @@ static int read_certificates(const char *const *filenames)
     mbedtls_x509_crt_init(&cas);
 
     for (cur = filenames; *cur != NULL; cur++) {
+#if defined(MBEDTLS_PEM_PARSE_C)
+        if (opt.bundle) {
+            ret = mbedtls_x509_crt_parse_bundle_file(&cas, *cur);
+        } else
+#endif
         ret = mbedtls_x509_crt_parse_file(&cas, *cur);
         if (ret != 0) {
 #if defined(MBEDTLS_ERROR_C) || defined(MBEDTLS_ERROR_STRERROR_DUMMY)
@@ -77,6 +109,84 @@ exit:
     return ret == 0;
 }
 
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+/*
+ * Map the image read-only, as a server would before forking its workers,
+ * so that they all share one copy of it.
+ */
+static int read_image(const char *filename)
+{
+    mbedtls_x509_trust_image image;
+    unsigned char *buf = NULL;
+    size_t len = 0;
+    int ret;
+#if !defined(_WIN32)
+    struct stat st;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        printf("\n%s: cannot open\n", filename);
+        return 0;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        printf("\n%s: cannot stat or empty\n", filename);
+        return 0;
+    }
+    len = (size_t) st.st_size;
+    buf = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (buf == MAP_FAILED) {
+        printf("\n%s: cannot map\n", filename);
+        return 0;
+    }
+#else
+    FILE *f;
+    long size;
+
+    if ((f = fopen(filename, "rb")) == NULL ||
+        fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 ||
+        fseek(f, 0, SEEK_SET) != 0 ||
+        (buf = mbedtls_calloc(1, (size_t) size)) == NULL ||
+        fread(buf, 1, (size_t) size, f) != (size_t) size) {
+        if (f != NULL) {
+            fclose(f);
+        }
+        mbedtls_free(buf);
+        printf("\n%s: cannot read\n", filename);
+        return 0;
+    }
+    fclose(f);
+    len = (size_t) size;
+#endif
+
+    mbedtls_x509_trust_image_init(&image);
+    ret = mbedtls_x509_trust_image_setup(&image, buf, len);
+    if (ret != 0) {
+        printf("\n%s: -0x%04x\n", filename, (unsigned) -ret);
+    }
+    mbedtls_x509_trust_image_free(&image);
+
+#if !defined(_WIN32)
+    munmap(buf, len);
+#else
+    mbedtls_free(buf);
+#endif
+
+    return ret == 0;
+}
+#endif /* MBEDTLS_X509_TRUST_IMAGE */
+
+static int read_all(void)
+{
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+    if (opt.image != NULL) {
+        return read_image(opt.image);
+    }
+#endif
+    return read_certificates(opt.filenames);
+}
+
 int main(int argc, char *argv[])
 {
     int exit_code = MBEDTLS_EXIT_FAILURE;
@@ -101,6 +211,8 @@ int main(int argc, char *argv[])
     opt.filenames = NULL;
     opt.iterations = DFL_ITERATIONS;
     opt.prime_cache = DFL_PRIME_CACHE;
+    opt.image = DFL_IMAGE;
+    opt.bundle = DFL_BUNDLE;
 
     for (i = 1; i < (unsigned) argc; i++) {
         char *p = argv[i];
@@ -124,6 +236,14 @@ int main(int argc, char *argv[])
             opt.iterations = atoi(q);
         } else if (strcmp(p, "prime") == 0) {
             opt.iterations = atoi(q) != 0;
+#if defined(MBEDTLS_X509_TRUST_IMAGE)
+        } else if (strcmp(p, "image") == 0) {
+            opt.image = q;
+#endif
+#if defined(MBEDTLS_PEM_PARSE_C)
+        } else if (strcmp(p, "bundle") == 0) {
+            opt.bundle = atoi(q) != 0;
+#endif
         } else {
             mbedtls_printf("Unknown option: %s\n", p);
             mbedtls_printf(USAGE);
@@ -132,14 +252,16 @@ int main(int argc, char *argv[])
     }
 
     opt.filenames = (const char **) argv + i;
-    if (*opt.filenames == 0) {
+    if (opt.image != NULL) {
+        mbedtls_printf("Loading trust image %s", opt.image);
+    } else if (*opt.filenames == 0) {
         mbedtls_printf("Missing list of certificate files to parse\n");
         goto exit;
+    } else {
+        mbedtls_printf("Parsing %u certificates", argc - i);
     }
-
-    mbedtls_printf("Parsing %u certificates", argc - i);
     if (opt.prime_cache) {
-        if (!read_certificates(opt.filenames)) {
+        if (!read_all()) {
             goto exit;
         }
         mbedtls_printf(" ");
@@ -147,7 +269,7 @@ int main(int argc, char *argv[])
 
     (void) mbedtls_timing_get_timer(&timer, 1);
     for (i = 1; i <= opt.iterations; i++) {
-        if (!read_certificates(opt.filenames)) {
+        if (!read_all()) {
             goto exit;
         }
         mbedtls_printf(".");
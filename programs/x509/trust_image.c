@@ -0,0 +1,208 @@
+/*
+ *  Trust image compiler
+ *
+ *  Copyright The Mbed TLS Contributors
+ *  SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+ */
+
+#include "mbedtls/build_info.h"
+
+#include "mbedtls/platform.h"
+
+#if !defined(MBEDTLS_X509_CRT_PARSE_C) || !defined(MBEDTLS_FS_IO) ||  \
+    !defined(MBEDTLS_X509_TRUST_IMAGE)
+int main(void)
+{
+    mbedtls_printf("MBEDTLS_X509_CRT_PARSE_C and/or MBEDTLS_FS_IO and/or "
+                   "MBEDTLS_X509_TRUST_IMAGE not defined.\n");
+    mbedtls_exit(0);
+}
+#else
+
+#include "mbedtls/error.h"
+#include "mbedtls/x509_crt.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DFL_OUTPUT_FILE         "trust.img"
+
+#define USAGE \
+    "\n usage: trust_image param=<>... [--] FILE...\n"  \
+    "\n Compile the trusted CAs of FILE... (certificate files or directories)\n" \
+    " into an image for mbedtls_x509_trust_image_setup().\n" \
+    "\n acceptable parameters:\n"                       \
+    "    output_file=%%s      default: " DFL_OUTPUT_FILE "\n" \
+    "\n"
+
+
+/*
+ * global options
+ */
+struct options {
+    const char **filenames;     /* NULL-terminated list of file names */
+    const char *output_file;    /* where to write the image */
+} opt;
+
+static void print_error(const char *what, int ret)
+{
+#if defined(MBEDTLS_ERROR_C) || defined(MBEDTLS_ERROR_STRERROR_DUMMY)
+    char error_message[200];
+    mbedtls_strerror(ret, error_message, sizeof(error_message));
+    mbedtls_printf(" failed\n  !  %s: -0x%04x (%s)\n",
+                   what, (unsigned) -ret, error_message);
+#else
+    mbedtls_printf(" failed\n  !  %s: -0x%04x\n", what, (unsigned) -ret);
+#endif
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = MBEDTLS_ERR_ERROR_CORRUPTION_DETECTED;
+    int exit_code = MBEDTLS_EXIT_FAILURE;
+    mbedtls_x509_crt cas;
+    mbedtls_x509_trust_image image;
+    unsigned char *buf = NULL;
+    size_t len = 0;
+    const char *const *cur;
+    FILE *f = NULL;
+    unsigned i, j;
+
+    mbedtls_x509_crt_init(&cas);
+    mbedtls_x509_trust_image_init(&image);
+
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    psa_status_t status = psa_crypto_init();
+    if (status != PSA_SUCCESS) {
+        mbedtls_fprintf(stderr, "Failed to initialize PSA Crypto implementation: %d\n",
+                        (int) status);
+        goto exit;
+    }
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    if (argc <= 1) {
+        mbedtls_printf(USAGE);
+        goto exit;
+    }
+
+    opt.filenames = NULL;
+    opt.output_file = DFL_OUTPUT_FILE;
+
+    for (i = 1; i < (unsigned) argc; i++) {
+        char *p = argv[i];
+        char *q = NULL;
+
+        if (strcmp(p, "--") == 0) {
+            i++;
+            break;
+        }
+        if ((q = strchr(p, '=')) == NULL) {
+            break;
+        }
+        *q++ = '\0';
+
+        for (j = 0; p + j < q; j++) {
+            if (argv[i][j] >= 'A' && argv[i][j] <= 'Z') {
+                argv[i][j] |= 0x20;
+            }
+        }
+
+        if (strcmp(p, "output_file") == 0) {
+            opt.output_file = q;
+        } else {
+            mbedtls_printf("Unknown option: %s\n", p);
+            mbedtls_printf(USAGE);
+            goto exit;
+        }
+    }
+
+    opt.filenames = (const char **) argv + i;
+    if (*opt.filenames == 0) {
+        mbedtls_printf("Missing list of certificate files to compile\n");
+        goto exit;
+    }
+
+    /*
+     * 1. Load the trusted CAs
+     */
+    mbedtls_printf("\n  . Loading the trusted CAs ...");
+    fflush(stdout);
+
+    for (cur = opt.filenames; *cur != NULL; cur++) {
+        ret = mbedtls_x509_crt_parse_path(&cas, *cur);
+        if (ret == MBEDTLS_ERR_X509_FILE_IO_ERROR) {
+            ret = mbedtls_x509_crt_parse_file(&cas, *cur);
+        }
+        if (ret < 0) {
+            print_error(*cur, ret);
+            goto exit;
+        }
+        if (ret > 0) {
+            mbedtls_printf("\n  !  %s: %d certificates skipped", *cur, ret);
+        }
+    }
+
+    mbedtls_printf(" ok\n");
+
+    /*
+     * 2. Write the image, and check that it can be used
+     */
+    mbedtls_printf("  . Writing the image ...");
+    fflush(stdout);
+
+    ret = mbedtls_x509_trust_image_write(&cas, NULL, 0, &len);
+    if (ret != MBEDTLS_ERR_X509_BUFFER_TOO_SMALL) {
+        print_error("mbedtls_x509_trust_image_write", ret);
+        goto exit;
+    }
+
+    buf = mbedtls_calloc(1, len);
+    if (buf == NULL) {
+        mbedtls_printf(" failed\n  !  Out of memory\n");
+        goto exit;
+    }
+
+    if ((ret = mbedtls_x509_trust_image_write(&cas, buf, len, &len)) != 0) {
+        print_error("mbedtls_x509_trust_image_write", ret);
+        goto exit;
+    }
+
+    if ((ret = mbedtls_x509_trust_image_setup(&image, buf, len)) != 0) {
+        print_error("mbedtls_x509_trust_image_setup", ret);
+        goto exit;
+    }
+
+    if ((f = fopen(opt.output_file, "wb")) == NULL ||
+        fwrite(buf, 1, len, f) != len) {
+        mbedtls_printf(" failed\n  !  Cannot write %s\n", opt.output_file);
+        goto exit;
+    }
+
+    if (fclose(f) != 0) {
+        f = NULL;
+        mbedtls_printf(" failed\n  !  Cannot write %s\n", opt.output_file);
+        goto exit;
+    }
+    f = NULL;
+
+    mbedtls_printf(" ok (%u certificates, %u bytes in %s)\n",
+                   (unsigned) mbedtls_x509_trust_image_count(&image),
+                   (unsigned) len, opt.output_file);
+
+    exit_code = MBEDTLS_EXIT_SUCCESS;
+
+exit:
+    if (f != NULL) {
+        fclose(f);
+    }
+    mbedtls_x509_trust_image_free(&image);
+    mbedtls_free(buf);
+    mbedtls_x509_crt_free(&cas);
+#if defined(MBEDTLS_USE_PSA_CRYPTO)
+    mbedtls_psa_crypto_free();
+#endif /* MBEDTLS_USE_PSA_CRYPTO */
+
+    mbedtls_exit(exit_code);
+}
+#endif /* necessary configuration */
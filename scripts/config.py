@@ -102,6 +102,9 @@ EXCLUDE_FROM_FULL = frozenset([
     'MBEDTLS_SHA256_USE_ARMV8_A_CRYPTO_ONLY', # interacts with *_USE_ARMV8_A_CRYPTO_IF_PRESENT
     'MBEDTLS_SHA512_USE_A64_CRYPTO_ONLY', # interacts with *_USE_A64_CRYPTO_IF_PRESENT
     'MBEDTLS_SHA256_USE_A64_CRYPTO_IF_PRESENT', # setting *_USE_ARMV8_A_CRYPTO is sufficient
+    'MBEDTLS_SSL_RECORD_AEAD_ONLY', # removes a feature
+    'MBEDTLS_SSL_STATIC_MEMORY', # incompatible with SSL_VARIABLE_BUFFER_LENGTH, refuses read-ahead
+    'MBEDTLS_SSL_USDT_PROBES', # build dependency (SystemTap sdt.h)
     'MBEDTLS_TEST_CONSTANT_FLOW_MEMSAN', # build dependency (clang+memsan)
     'MBEDTLS_TEST_CONSTANT_FLOW_VALGRIND', # build dependency (valgrind headers)
     'MBEDTLS_X509_REMOVE_INFO', # removes a feature
@@ -96,6 +96,9 @@ FILTER=""
 EXCLUDE='NULL\|ARIA\|CHACHA20_POLY1305'
 VERBOSE=""
 MEMCHECK=0
+PERF=0
+PERF_HANDSHAKES=20
+PERF_MB=16
 MIN_TESTS=1
 PRESERVE_LOGS=0
 PEERS="OpenSSL$PEER_GNUTLS mbedTLS"
@@ -115,6 +118,10 @@ print_usage() {
     printf "  -p|--peers\tWhich peers to use (Default: '%s')\n" "$PEERS"
     printf "            \tAlso available: GnuTLS (needs v3.2.15 or higher)\n"
     printf "  -M|--memcheck\tCheck memory leaks and errors.\n"
+    printf "     --perf     \tAlso measure the handshake rate and bulk throughput\n"
+    printf "                \tof each passing test case.\n"
+    printf "     --perf-handshakes\tHandshakes per rate measurement (Default: %s)\n" "$PERF_HANDSHAKES"
+    printf "     --perf-mb  \tMiB sent per throughput measurement (Default: %s)\n" "$PERF_MB"
     printf "  -v|--verbose\tSet verbose output.\n"
     printf "     --list-test-cases\tList all potential test cases (No Execution)\n"
     printf "     --min      \tMinimum number of non-skipped tests (default 1)\n"
@@ -186,6 +193,15 @@ get_options() {
             -M|--memcheck)
                 MEMCHECK=1
                 ;;
+            --perf)
+                PERF=1
+                ;;
+            --perf-handshakes)
+                shift; PERF_HANDSHAKES=$1
+                ;;
+            --perf-mb)
+                shift; PERF_MB=$1
+                ;;
             # Please check scripts/check_test_cases.py correspondingly
             # if you have to modify option, --list-test-cases
             --list-test-cases)
@@ -788,18 +804,26 @@ else
 fi
 
 
-# start_server <name>
+# start_server <name> [sink]
 # also saves name and command
+# With "sink", start a server that reads and discards the bulk data of
+# perf_case instead (OpenSSL and mbedTLS only).
 start_server() {
     case $1 in
         [Oo]pen*)
             SERVER_CMD="$OPENSSL s_server $O_SERVER_ARGS"
+            if [ -n "${2-}" ]; then
+                SERVER_CMD="$(echo "$SERVER_CMD" | sed 's/ -www//') -quiet"
+            fi
             ;;
         [Gg]nu*)
             SERVER_CMD="$GNUTLS_SERV $G_SERVER_ARGS --priority $G_SERVER_PRIO"
             ;;
         mbed*)
             SERVER_CMD="$M_SRV $M_SERVER_ARGS"
+            if [ -n "${2-}" ]; then
+                SERVER_CMD="$SERVER_CMD stream=recv"
+            fi
             if [ "$MEMCHECK" -gt 0 ]; then
                 SERVER_CMD="valgrind --leak-check=full $SERVER_CMD"
             fi
@@ -814,7 +838,12 @@ start_server() {
     log "$SERVER_CMD"
     echo "$SERVER_CMD" > $SRV_OUT
     # for servers without -www or equivalent
-    while :; do echo bla; sleep 1; done | $SERVER_CMD >> $SRV_OUT 2>&1 &
+    if [ -n "${2-}" ]; then
+        # s_server prints what it receives: don't log the bulk data
+        while :; do echo bla; sleep 1; done | $SERVER_CMD >/dev/null 2>&1 &
+    else
+        while :; do echo bla; sleep 1; done | $SERVER_CMD >> $SRV_OUT 2>&1 &
+    fi
     SRV_PID=$!
 
     wait_server_start "$PORT" "$SRV_PID"
@@ -840,7 +869,7 @@ stop_server() {
 
 # kill the running server (used when killed by signal)
 cleanup() {
-    rm -f $SRV_OUT $CLI_OUT
+    rm -f $SRV_OUT $CLI_OUT $PERF_OUT
     kill $SRV_PID >/dev/null 2>&1
     kill $WATCHDOG_PID >/dev/null 2>&1
     exit 1
@@ -910,6 +939,108 @@ report_fail() {
     fi
 }
 
+# Print the current time in milliseconds (in seconds, times 1000, where date
+# has no %N)
+case $(date +%N 2>/dev/null) in
+    [0-9]*)
+        perf_now() {
+            echo $(( $(date +%s%N) / 1000000 ))
+        }
+        ;;
+    *)
+        perf_now() {
+            echo $(( $(date +%s) * 1000 ))
+        }
+        ;;
+esac
+
+# perf_rate <COUNT> <START_MS>
+# print COUNT per second since START_MS
+perf_rate() {
+    awk -v n="$1" -v ms="$(( $(perf_now) - $2 ))" \
+        'BEGIN { if (ms < 1) ms = 1; printf "%.1f", n * 1000 / ms }'
+}
+
+# perf_run <CLIENT> <CLIENT_CMD> [bulk]
+# run a client command to completion and set EXIT
+# With "bulk", give OpenSSL and GnuTLS clients $PERF_MB MiB to send.
+perf_run() {
+    echo "$2" > $CLI_OUT
+    case "$1,${3-}" in
+        mbed*)
+            $2 >> $CLI_OUT 2>&1 &
+            ;;
+        *,bulk)
+            dd if=/dev/zero bs=1048576 count=$PERF_MB 2>/dev/null |
+                $2 >> $CLI_OUT 2>&1 &
+            ;;
+        *)
+            printf 'GET HTTP/1.0\r\n\r\n' | $2 >> $CLI_OUT 2>&1 &
+            ;;
+    esac
+    wait_client_done
+}
+
+# perf_case PROGRAM_NAME STANDARD_CIPHER_SUITE PROGRAM_CIPHER_SUITE
+# Measure the handshake rate and bulk throughput of a case that run_client
+# just passed, and save them for the final report.
+perf_case() {
+    # Handshake rate: repeat the client command of the test case, so the
+    # rate includes the start-up of the client program.
+    PERF_HS="fail"
+    PERF_START=$(perf_now)
+    i=0
+    while [ $i -lt $PERF_HANDSHAKES ]; do
+        perf_run $1 "$CLIENT_CMD"
+        if [ $EXIT -ne 0 ]; then
+            break
+        fi
+        i=$(( $i + 1 ))
+    done
+    if [ $i -eq $PERF_HANDSHAKES ]; then
+        PERF_HS=$(perf_rate $PERF_HANDSHAKES $PERF_START)
+    fi
+
+    # Bulk throughput: send $PERF_MB MiB to a server that discards them.
+    # Only over TLS, and not to gnutls-serv, which can only echo the data
+    # back to a client that does not read it.
+    PERF_BULK="n/a"
+    case "$MODE,$SERVER_NAME" in
+        dtls*|*,[Gg]nu*) :;;
+        *)
+            case $1 in
+                [Oo]pen*)
+                    PERF_CMD="$OPENSSL s_client $O_CLIENT_ARGS -cipher $3"
+                    ;;
+                [Gg]nu*)
+                    PERF_CMD="$GNUTLS_CLI $G_CLIENT_ARGS --priority $G_PRIO_MODE:$3 localhost"
+                    ;;
+                mbed*)
+                    PERF_CMD="$M_CLI $M_CLIENT_ARGS force_ciphersuite=$3 stream=send stream_mb=$PERF_MB"
+                    ;;
+            esac
+            log "$PERF_CMD"
+
+            PERF_SERVER=$SERVER_NAME
+            stop_server
+            start_server $PERF_SERVER sink
+            PERF_START=$(perf_now)
+            perf_run $1 "$PERF_CMD" bulk
+            if [ $EXIT -eq 0 ]; then
+                PERF_BULK=$(perf_rate $PERF_MB $PERF_START)
+            else
+                PERF_BULK="fail"
+            fi
+            stop_server
+            start_server $PERF_SERVER
+            ;;
+    esac
+
+    printf "  perf: %s handshakes/s, %s MiB/s\n" "$PERF_HS" "$PERF_BULK"
+    echo "$2 $MODE,$VERIF ${1%"${1#?}"}->${SERVER_NAME%"${SERVER_NAME#?}"} $PERF_HS $PERF_BULK" >> $PERF_OUT
+    rm -f $CLI_OUT
+}
+
 # run_client PROGRAM_NAME STANDARD_CIPHER_SUITE PROGRAM_CIPHER_SUITE
 run_client() {
     # announce what we're going to do
@@ -1013,6 +1144,9 @@ run_client() {
             if [ "$PRESERVE_LOGS" -gt 0 ]; then
                 save_logs
             fi
+            if [ "$PERF" -gt 0 ]; then
+                perf_case "$@"
+            fi
             ;;
         "1")
             record_outcome "SKIP"
@@ -1067,6 +1201,11 @@ if echo "$PEERS" | grep -i gnutls > /dev/null; then
     done
 fi
 
+if [ "$PERF" -gt 0 ] && [ "$MEMCHECK" -gt 0 ]; then
+    echo "--perf and --memcheck cannot be used together" >&2
+    exit 1
+fi
+
 for PEER in $PEERS; do
     case "$PEER" in
         mbed*|[Oo]pen*|[Gg]nu*)
@@ -1084,6 +1223,7 @@ PORT="1$(echo $PORT | tail -c 5)"
 # Also pick a unique name for intermediate files
 SRV_OUT="srv_out.$$"
 CLI_OUT="cli_out.$$"
+PERF_OUT="perf_out.$$"
 
 # client timeout delay: be more patient with valgrind
 if [ "$MEMCHECK" -gt 0 ]; then
@@ -1221,6 +1361,14 @@ fi
 PASSED=$(( $TESTS - $FAILED ))
 echo " ($PASSED / $TESTS tests ($SKIPPED skipped$MEMREPORT))"
 
+# Performance report, with the peers of each ciphersuite side by side
+if [ "$PERF" -gt 0 ] && [ -s "$PERF_OUT" ]; then
+    echo "------------------------------------------------------------------------"
+    printf "%-48s %-5s %12s %9s\n" "ciphersuite mode,verif" "peers" "handshakes/s" "MiB/s"
+    sort $PERF_OUT | awk '{ printf "%-48s %-5s %12s %9s\n", $1 " " $2, $3, $4, $5 }'
+fi
+rm -f $PERF_OUT
+
 if [ $((TESTS - SKIPPED)) -lt $MIN_TESTS ]; then
     cat <<EOF
 Error: Expected to run at least $MIN_TESTS, but only ran $((TESTS - SKIPPED)).
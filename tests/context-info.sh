@@ -415,6 +415,24 @@ run_test "Decoder continues past 0xff character" \
          -n "No valid base64" \
          -u "ciphersuite.* TLS-"
 
+run_test "Batch mode, client" \
+         "cli_def.txt" \
+         -arg "-b" \
+         -n "ERROR" \
+         -n "Deserializing" \
+         -u "codes found.* 1$" \
+         -u "with errors.* 0$" \
+         -u "TLS-ECDHE-RSA-WITH-CHACHA20-POLY1305-SHA256 : 1$" \
+         -u "peer certificate  " \
+         -n "unparsed"
+
+run_test "Batch mode, errors are counted" \
+         "def_b64_too_big_3.txt" \
+         -arg "-b" \
+         -n "ERROR" \
+         -m "with errors.* [1-9]" \
+         -u "unparsed "
+
 
 # End of tests
 
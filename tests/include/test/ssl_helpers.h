@@ -119,6 +119,13 @@ typedef struct mbedtls_test_handshake_test_options {
     int resize_buffers;
     int early_data;
     int max_early_data_size;
+    int write_batch;
+    int read_ahead;
+    int max_content_len;
+    int flight_coalescing;
+    mbedtls_ssl_buffer_get_t *buf_get;
+    mbedtls_ssl_buffer_release_t *buf_release;
+    void *p_buf;
 #if defined(MBEDTLS_SSL_CACHE_C)
     mbedtls_ssl_cache_context *cache;
 #endif
@@ -477,6 +484,23 @@ int mbedtls_test_move_handshake_to_state(mbedtls_ssl_context *ssl,
                                          mbedtls_ssl_context *second_ssl,
                                          int state);
 
+/*
+ * Initializes a client endpoint \p client_ep and a server endpoint
+ * \p server_ep with \p options, connects their sockets with buffers of
+ * \p bufsize bytes and completes the handshake on both sides.
+ *
+ * It is important to call `mbedtls_test_ssl_endpoint_free()` on both
+ * endpoints after calling this function, even if it fails. Both endpoints
+ * must have been zeroized beforehand.
+ *
+ * \retval  0 on success, otherwise error code.
+ */
+int mbedtls_test_ssl_connect_endpoints(
+    mbedtls_test_ssl_endpoint *client_ep,
+    mbedtls_test_ssl_endpoint *server_ep,
+    mbedtls_test_handshake_test_options *options,
+    size_t bufsize);
+
 #endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
 
 /*
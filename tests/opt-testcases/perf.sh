@@ -0,0 +1,174 @@
+# Performance regression tests: handshake and transfer time, and peak
+# server heap usage, compared to a stored baseline.
+#
+# Timings depend on the machine, so this group only runs when requested
+# explicitly, with "--test-suite perf", and never under memcheck:
+#
+#   PERF_RECORD=1 tests/ssl-opt.sh --test-suite perf  # store a baseline
+#   tests/ssl-opt.sh --test-suite perf                # compare to it
+#
+# Settings, from the environment:
+#   PERF_BASELINE      baseline file, default: perf-baseline.txt in the
+#                      current directory. Each line is "name value".
+#   PERF_RECORD        1: store the measured values in the baseline
+#                      instead of comparing them.
+#   PERF_TOLERANCE     percentage by which a time may exceed its baseline,
+#                      default: 20.
+#   PERF_MEMORY_TOLERANCE  same for the peak heap usage, default: 2.
+#   PERF_CONNECTIONS   handshakes per scenario, default: 200.
+#
+# A measurement without a baseline value passes and is reported.
+
+# Copyright The Mbed TLS Contributors
+# SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+
+: ${PROGRAMS_DIR:=../programs/ssl}
+: ${PERF_BASELINE:=perf-baseline.txt}
+: ${PERF_RECORD:=0}
+: ${PERF_TOLERANCE:=20}
+: ${PERF_MEMORY_TOLERANCE:=2}
+: ${PERF_CONNECTIONS:=200}
+
+P_LOAD="$PROGRAMS_DIR/ssl_load_client server_addr=127.0.0.1 server_port=+SRV_PORT"
+
+# Get the value of a metric from a program output: the time taken by
+# ssl_load_client, or the largest peak heap usage reported by ssl_server2.
+perf_metric_get() {
+    OUTPUT_VARIABLE="$1"
+    METRIC="$2"
+    OUTPUT_FILE="$3"
+
+    case "$METRIC" in
+        time)
+            if ! grep -q " connections, 0 failed, in " "$OUTPUT_FILE"; then
+                echo "Error: some connections failed"
+                return 1
+            fi
+            VALUE=$(sed -n 's/.* connections, 0 failed, in \([0-9]*\) ms.*/\1/p' \
+                        < "$OUTPUT_FILE" | head -1)
+            ;;
+        peak)
+            VALUE=$(sed -n 's/.*Peak memory usage was \([0-9]*\).*/\1/p' \
+                        < "$OUTPUT_FILE" | sort -n | tail -1)
+            ;;
+    esac
+
+    if [ -z "$VALUE" ]; then
+        echo "Error: Can not read the $METRIC measurement"
+        return 1
+    fi
+    eval "$OUTPUT_VARIABLE=$VALUE"
+}
+
+# Record a measurement in the baseline, replacing any previous value.
+perf_baseline_store() {
+    if [ -f "$PERF_BASELINE" ]; then
+        grep -v "^$1 " "$PERF_BASELINE" > "$PERF_BASELINE.tmp"
+    else
+        : > "$PERF_BASELINE.tmp"
+    fi
+    echo "$1 $2" >> "$PERF_BASELINE.tmp"
+    mv "$PERF_BASELINE.tmp" "$PERF_BASELINE"
+}
+
+# Compare a measurement to the baseline, or store it with PERF_RECORD=1.
+#  first argument ($1) is the name of the measurement in the baseline
+#  second argument ($2) is the metric: time or peak
+#  third argument ($3) is the output file to read it from
+perf_check() {
+    if ! perf_metric_get MEASURED "$2" "$3"; then
+        return 1
+    fi
+
+    if [ "$PERF_RECORD" -eq 1 ]; then
+        perf_baseline_store "$1" "$MEASURED"
+        return 0
+    fi
+
+    BASELINE=
+    if [ -f "$PERF_BASELINE" ]; then
+        BASELINE=$(sed -n "s/^$1 \([0-9]*\)$/\1/p" < "$PERF_BASELINE")
+    fi
+    if [ -z "$BASELINE" ]; then
+        echo "$1: $MEASURED, no baseline" >> "$3"
+        return 0
+    fi
+
+    if [ "$2" = "peak" ]; then
+        TOLERANCE=$PERF_MEMORY_TOLERANCE
+    else
+        TOLERANCE=$PERF_TOLERANCE
+    fi
+    LIMIT=$(( BASELINE * (100 + TOLERANCE) / 100 ))
+    echo "$1: $MEASURED, baseline $BASELINE, limit $LIMIT" >> "$3"
+
+    if [ "$MEASURED" -gt "$LIMIT" ]; then
+        echo "\nFailed: $1 was $MEASURED, but should be below $LIMIT" \
+             "($BASELINE + $TOLERANCE%)"
+        return 1
+    fi
+}
+
+# Handshake time for the given protocol version, with and without
+# resumption.
+#  first argument ($1) is the protocol version: tls12 or tls13
+run_perf_handshake_tests() {
+    requires_protocol_version $1
+    requires_config_enabled MBEDTLS_NET_REACTOR
+    run_test    "Perf: full handshakes, $1" \
+                "$P_SRV force_version=$1 tickets=0" \
+                "$P_LOAD force_version=$1 connections=$PERF_CONNECTIONS concurrency=1 \
+                    resume=0 exchange=0" \
+                0 \
+                -f "perf_check handshake_full_$1 time"
+
+    requires_protocol_version $1
+    requires_config_enabled MBEDTLS_NET_REACTOR
+    requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+    run_test    "Perf: resumed handshakes, $1" \
+                "$P_SRV force_version=$1 tickets=1" \
+                "$P_LOAD force_version=$1 connections=$PERF_CONNECTIONS concurrency=1 \
+                    resume=100 exchange=1" \
+                0 \
+                -f "perf_check handshake_resumed_$1 time"
+}
+
+# Time to transfer full records, after the handshake.
+#  first argument ($1) is the protocol version: tls12 or tls13
+run_perf_transfer_test() {
+    requires_protocol_version $1
+    requires_config_enabled MBEDTLS_NET_REACTOR
+    requires_max_content_len 16384
+    run_test    "Perf: 16 KiB responses, $1" \
+                "$P_SRV force_version=$1 tickets=0 response_size=16384" \
+                "$P_LOAD force_version=$1 connections=$PERF_CONNECTIONS concurrency=1 \
+                    resume=100 exchange=1" \
+                0 \
+                -f "perf_check transfer_16k_$1 time"
+}
+
+# Peak heap usage of the server during a handshake.
+#  first argument ($1) is the protocol version: tls12 or tls13
+run_perf_memory_test() {
+    requires_protocol_version $1
+    requires_config_enabled MBEDTLS_MEMORY_DEBUG
+    requires_config_enabled MBEDTLS_MEMORY_BUFFER_ALLOC_C
+    run_test    "Perf: server peak heap usage, $1" \
+                "$P_SRV force_version=$1 tickets=0" \
+                "$P_CLI force_version=$1" \
+                0 \
+                -F "perf_check memory_peak_$1 peak"
+}
+
+case ",$RUN_TEST_SUITE," in
+    *",$TEST_SUITE_NAME,"*)
+        if [ "$MEMCHECK" -eq 0 ]; then
+            for PERF_VERSION in tls12 tls13; do
+                run_perf_handshake_tests $PERF_VERSION
+                run_perf_transfer_test $PERF_VERSION
+                run_perf_memory_test $PERF_VERSION
+            done
+            unset PERF_VERSION
+        fi
+        ;;
+esac
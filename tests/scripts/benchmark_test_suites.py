@@ -0,0 +1,145 @@
+#!/usr/bin/env python3
+"""Time the test cases of the test suites, as a microbenchmark corpus.
+
+Each selected test case is run once, then repeated ITERATIONS times in a
+single run of its test suite. The difference between the two runs, divided
+by ITERATIONS, is the time of one iteration of the case, without the cost
+of starting the test suite.
+
+Run this from the directory that holds the test suite executables and their
+.datax files, typically tests/ in the build tree. For example:
+
+    ../../tests/scripts/benchmark_test_suites.py -n 1000 \\
+        -s test_suite_x509parse -f 'Parse.*CRT'
+"""
+
+# Copyright The Mbed TLS Contributors
+# SPDX-License-Identifier: Apache-2.0 OR GPL-2.0-or-later
+
+import argparse
+import glob
+import os
+import re
+import subprocess
+import sys
+import tempfile
+import time
+
+SUMMARY_RE = re.compile(r'\((\d+) / (\d+) tests \((\d+) skipped\)\)')
+
+def read_cases(datax_file):
+    """Return the (description, text) pairs of the test cases of a .datax file.
+
+    In a .datax file, each test case is a block of lines ended by a blank
+    line, whose first line is the description.
+    """
+    with open(datax_file, encoding='utf-8') as datax:
+        blocks = datax.read().split('\n\n')
+    return [(block.strip().split('\n', 1)[0], block.strip() + '\n\n')
+            for block in blocks if block.strip()]
+
+def run_case(suite, text, count):
+    """Run a test case count times in one run of its test suite.
+
+    Return the elapsed time in seconds, or None if the case failed or was
+    skipped.
+    """
+    with tempfile.NamedTemporaryFile('w', suffix='.datax',
+                                     delete=False) as datax:
+        datax.write(text * count)
+    try:
+        start = time.perf_counter()
+        result = subprocess.run([suite, datax.name],
+                                stdout=subprocess.PIPE,
+                                stderr=subprocess.STDOUT,
+                                universal_newlines=True,
+                                check=False)
+        elapsed = time.perf_counter() - start
+    finally:
+        os.remove(datax.name)
+    summary = SUMMARY_RE.search(result.stdout)
+    if result.returncode != 0 or summary is None or \
+       int(summary.group(1)) != count or int(summary.group(3)) != 0:
+        return None
+    return elapsed
+
+def benchmark_case(suite, text, iterations, repeat):
+    """Return the time of one iteration of a test case, in seconds.
+
+    Keep the best of repeat measurements. Return None if the case failed or
+    was skipped.
+    """
+    best = None
+    for _ in range(repeat):
+        once = run_case(suite, text, 1)
+        many = run_case(suite, text, iterations + 1)
+        if once is None or many is None:
+            return None
+        per_iteration = max(many - once, 0.0) / iterations
+        if best is None or per_iteration < best:
+            best = per_iteration
+    return best
+
+def find_suites(patterns):
+    """Return the test suite executables with a .datax file whose name matches
+    one of patterns, or all of them if patterns is empty."""
+    suites = []
+    for datax_file in sorted(glob.glob('test_suite_*.datax')):
+        suite = datax_file[:-len('.datax')]
+        if patterns and not any(re.search(pattern, suite)
+                                for pattern in patterns):
+            continue
+        for executable in (suite, suite + '.exe'):
+            if os.access(executable, os.X_OK):
+                suites.append((os.path.join('.', executable), datax_file))
+                break
+    return suites
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--iterations', '-n', type=int, default=100,
+                        help='repetitions of each test case (default: 100)')
+    parser.add_argument('--repeat', '-r', type=int, default=3,
+                        help='measurements of each test case, of which the '
+                        'best is kept (default: 3)')
+    parser.add_argument('--suite', '-s', action='append', default=[],
+                        metavar='REGEX',
+                        help='only run the test suites matching REGEX; '
+                        'can be given several times')
+    parser.add_argument('--filter', '-f', default='', metavar='REGEX',
+                        help='only run the test cases whose description '
+                        'matches REGEX')
+    options = parser.parse_args()
+    if options.iterations < 1 or options.repeat < 1:
+        parser.error('--iterations and --repeat must be positive')
+
+    suites = find_suites(options.suite)
+    if not suites:
+        sys.stderr.write('{}: no test suite found\n'.format(sys.argv[0]))
+        return 1
+
+    # in case test suites are linked dynamically
+    os.environ['LD_LIBRARY_PATH'] = os.path.join(os.getcwd(),
+                                                 os.path.pardir, 'library')
+    os.environ['DYLD_LIBRARY_PATH'] = os.environ['LD_LIBRARY_PATH']
+
+    case_filter = re.compile(options.filter)
+    print('{:>12}  {}'.format('us/iter', 'suite: test case'))
+    for suite, datax_file in suites:
+        for description, text in read_cases(datax_file):
+            if not case_filter.search(description):
+                continue
+            seconds = benchmark_case(suite, text,
+                                     options.iterations, options.repeat)
+            timing = 'skip/fail' if seconds is None else \
+                '{:.3f}'.format(seconds * 1e6)
+            print('{:>12}  {}: {}'.format(timing,
+                                          os.path.basename(suite),
+                                          description))
+            sys.stdout.flush()
+    return 0
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -148,6 +148,23 @@ component_test_tls1_2_default_cbc_legacy_cbc_etm_cipher_only () {
     tests/ssl-opt.sh -f "TLS 1.2"
 }
 
+component_test_tls_record_aead_only () {
+    msg "build: default + MBEDTLS_SSL_RECORD_AEAD_ONLY + MBEDTLS_CIPHER_NULL_CIPHER"
+
+    scripts/config.py set MBEDTLS_SSL_RECORD_AEAD_ONLY
+    # Keep CBC and the NULL cipher in the crypto configuration, the CBC and
+    # stream ciphersuites must be removed anyway.
+    scripts/config.py set MBEDTLS_CIPHER_NULL_CIPHER
+
+    make
+
+    msg "test: default + MBEDTLS_SSL_RECORD_AEAD_ONLY + MBEDTLS_CIPHER_NULL_CIPHER"
+    make test
+
+    msg "test: default + MBEDTLS_SSL_RECORD_AEAD_ONLY - ssl-opt.sh (subset)"
+    tests/ssl-opt.sh -f "TLS 1.3"
+}
+
 component_test_config_thread () {
     msg "build: configs/config-thread.h"
     MBEDTLS_CONFIG="configs/config-thread.h"
@@ -242,6 +259,19 @@ component_test_small_mbedtls_ssl_dtls_max_buffering () {
     tests/ssl-opt.sh -f "DTLS reordering: Buffer encrypted Finished message, drop for fragmented NewSessionTicket"
 }
 
+component_test_dtls_static_reassembly () {
+    msg "build: default config + MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY"
+    scripts/config.py set MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY
+    CC=$ASAN_CC cmake -D CMAKE_BUILD_TYPE:String=Asan .
+    make
+
+    msg "test: MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY - test_suite_ssl"
+    (cd tests; ./test_suite_ssl)
+
+    msg "test: MBEDTLS_SSL_DTLS_STATIC_REASSEMBLY - ssl-opt.sh DTLS reassembly and reordering"
+    tests/ssl-opt.sh -f 'DTLS reassembly\|DTLS reordering\|DTLS proxy'
+}
+
 # Common helper for component_full_without_ecdhe_ecdsa() and
 # component_full_without_ecdhe_ecdsa_and_tls13() which:
 # - starts from the "full" configuration minus the list of symbols passed in
@@ -387,6 +417,34 @@ component_test_ssl_alloc_buffer_and_mfl () {
     tests/ssl-opt.sh -f "Handshake memory usage"
 }
 
+component_test_ssl_static_memory () {
+    msg "build: default config with memory buffer allocator and MBEDTLS_SSL_STATIC_MEMORY"
+    scripts/config.py set MBEDTLS_MEMORY_BUFFER_ALLOC_C
+    scripts/config.py set MBEDTLS_PLATFORM_MEMORY
+    scripts/config.py set MBEDTLS_MEMORY_DEBUG
+    scripts/config.py set MBEDTLS_SSL_STATIC_MEMORY
+    cmake -DCMAKE_BUILD_TYPE:String=Release .
+    make
+
+    msg "test: ssl-opt.sh, MBEDTLS_SSL_STATIC_MEMORY and MBEDTLS_MEMORY_BUFFER_ALLOC_C"
+    tests/ssl-opt.sh -f "Connection memory budget"
+}
+
+component_test_ssl_usdt_probes () {
+    msg "build: full config with MBEDTLS_SSL_USDT_PROBES"
+    scripts/config.py full
+    scripts/config.py set MBEDTLS_SSL_USDT_PROBES
+    cmake -DCMAKE_BUILD_TYPE:String=Release .
+    make
+
+    msg "test: full config with MBEDTLS_SSL_USDT_PROBES"
+    make test
+}
+
+support_test_ssl_usdt_probes () {
+    [ -e /usr/include/sys/sdt.h ]
+}
+
 component_test_when_no_ciphersuites_have_mac () {
     msg "build: when no ciphersuites have MAC"
     scripts/config.py -f "$CRYPTO_CONFIG_H" unset PSA_WANT_ALG_CBC_NO_PADDING
@@ -852,6 +852,17 @@ int mbedtls_test_ssl_endpoint_init(
     }
 #endif
 
+    mbedtls_ssl_conf_write_batch(&(ep->conf),
+                                 (unsigned char) options->write_batch);
+    mbedtls_ssl_conf_read_ahead(&(ep->conf),
+                                (unsigned char) options->read_ahead);
+    mbedtls_ssl_conf_flight_coalescing(&(ep->conf), options->flight_coalescing);
+    TEST_EQUAL(mbedtls_ssl_conf_max_content_len(&(ep->conf),
+                                                (size_t) options->max_content_len,
+                                                (size_t) options->max_content_len), 0);
+    mbedtls_ssl_conf_buffer_alloc(&(ep->conf), options->buf_get,
+                                  options->buf_release, options->p_buf);
+
     ret = mbedtls_ssl_setup(&(ep->ssl), &(ep->conf));
     TEST_ASSERT(ret == 0);
 
@@ -945,6 +956,45 @@ int mbedtls_test_move_handshake_to_state(mbedtls_ssl_context *ssl,
     return (max_steps >= 0) ? ret : -1;
 }
 
+int mbedtls_test_ssl_connect_endpoints(
+    mbedtls_test_ssl_endpoint *client_ep,
+    mbedtls_test_ssl_endpoint *server_ep,
+    mbedtls_test_handshake_test_options *options,
+    size_t bufsize)
+{
+    int ret = -1;
+
+    ret = mbedtls_test_ssl_endpoint_init(client_ep, MBEDTLS_SSL_IS_CLIENT,
+                                         options, NULL, NULL, NULL);
+    TEST_EQUAL(ret, 0);
+
+    ret = mbedtls_test_ssl_endpoint_init(server_ep, MBEDTLS_SSL_IS_SERVER,
+                                         options, NULL, NULL, NULL);
+    TEST_EQUAL(ret, 0);
+
+    ret = mbedtls_test_mock_socket_connect(&(client_ep->socket),
+                                           &(server_ep->socket), bufsize);
+    TEST_EQUAL(ret, 0);
+
+    ret = mbedtls_test_move_handshake_to_state(&(client_ep->ssl),
+                                               &(server_ep->ssl),
+                                               MBEDTLS_SSL_HANDSHAKE_OVER);
+    TEST_EQUAL(ret, 0);
+
+    ret = mbedtls_test_move_handshake_to_state(&(server_ep->ssl),
+                                               &(client_ep->ssl),
+                                               MBEDTLS_SSL_HANDSHAKE_OVER);
+    TEST_EQUAL(ret, 0);
+
+    ret = -1;
+    TEST_ASSERT(mbedtls_ssl_is_handshake_over(&(client_ep->ssl)));
+    TEST_ASSERT(mbedtls_ssl_is_handshake_over(&(server_ep->ssl)));
+    ret = 0;
+
+exit:
+    return ret;
+}
+
 #endif /* MBEDTLS_SSL_HANDSHAKE_WITH_CERT_ENABLED */
 
 /*
@@ -1402,6 +1452,19 @@ int mbedtls_test_ssl_build_transforms(mbedtls_ssl_transform *t_in,
         CHK(psa_import_key(&attributes,
                            md0, maclen,
                            &t_out->psa_mac_dec) == PSA_SUCCESS);
+
+        /* As the library does for CBC without EtM */
+        if (cipher_mode == MBEDTLS_MODE_CBC &&
+            etm == MBEDTLS_SSL_ETM_DISABLED) {
+            CHK(mbedtls_ssl_hmac_setup_states(PSA_ALG_HMAC(alg), md1, maclen,
+                                              &t_in->psa_mac_dec_inner,
+                                              &t_in->psa_mac_dec_outer) == 0);
+            t_in->psa_mac_dec_states = 1;
+            CHK(mbedtls_ssl_hmac_setup_states(PSA_ALG_HMAC(alg), md0, maclen,
+                                              &t_out->psa_mac_dec_inner,
+                                              &t_out->psa_mac_dec_outer) == 0);
+            t_out->psa_mac_dec_states = 1;
+        }
 #else
         CHK(mbedtls_md_setup(&t_out->md_ctx_enc, md_info, 1) == 0);
         CHK(mbedtls_md_setup(&t_out->md_ctx_dec, md_info, 1) == 0);
@@ -2226,8 +2289,10 @@ void mbedtls_test_ssl_perform_handshake(
                     == 0);
     }
 #if defined(MBEDTLS_SSL_CONTEXT_SERIALIZATION)
-    if (options->serialize == 1) {
-        TEST_ASSERT(options->dtls == 1);
+    if (options->serialize != 0) {
+        /* 2: save the traffic keys rather than the random bytes */
+        mbedtls_ssl_conf_context_save_keys(&(server.conf),
+                                           options->serialize == 2);
 
         TEST_ASSERT(mbedtls_ssl_context_save(&(server.ssl), NULL,
                                              0, &context_buf_len)
@@ -2246,10 +2311,17 @@ void mbedtls_test_ssl_perform_handshake(
 
         TEST_ASSERT(mbedtls_ssl_setup(&(server.ssl), &(server.conf)) == 0);
 
-        mbedtls_ssl_set_bio(&(server.ssl), &server_context,
-                            mbedtls_test_mock_tcp_send_msg,
-                            mbedtls_test_mock_tcp_recv_msg,
-                            NULL);
+        if (options->dtls != 0) {
+            mbedtls_ssl_set_bio(&(server.ssl), &server_context,
+                                mbedtls_test_mock_tcp_send_msg,
+                                mbedtls_test_mock_tcp_recv_msg,
+                                NULL);
+        } else {
+            mbedtls_ssl_set_bio(&(server.ssl), &(server.socket),
+                                mbedtls_test_mock_tcp_send_nb,
+                                mbedtls_test_mock_tcp_recv_nb,
+                                NULL);
+        }
 
         mbedtls_ssl_set_user_data_p(&server.ssl, &server);
 
@@ -168,7 +168,8 @@ print_usage() {
     printf "     --proxy-port\tTCP/UDP proxy port (default: randomish 2xxxx)\n"
     printf "     --seed     \tInteger seed value to use for this test run\n"
     printf "     --test-suite\tOnly matching test suites are executed\n"
-    printf "                 \t(comma-separated, e.g. 'ssl-opt,tls13-compat')\n\n"
+    printf "                 \t(comma-separated, e.g. 'ssl-opt,tls13-compat')\n"
+    printf "                 \tThe 'perf' suite only runs when listed here.\n\n"
 }
 
 get_options() {
@@ -1232,6 +1233,29 @@ handshake_memory_check() {
     fi
 }
 
+# Check that the peak heap memory usage of the connection, from a pattern
+# like "Connection memory usage: peak 61234 bytes, budget 187000 bytes", is
+# within its compile-time budget
+connection_memory_check() {
+    OUTPUT_FILE="$1"
+
+    PEAK=$(sed -n 's/.*Connection memory usage: peak \([0-9]*\) bytes.*/\1/p' < "$OUTPUT_FILE" | head -1)
+    BUDGET=$(sed -n 's/.*Connection memory usage: .*budget \([0-9]*\) bytes.*/\1/p' < "$OUTPUT_FILE" | head -1)
+
+    if [ -z "$PEAK" ] || [ -z "$BUDGET" ]; then
+        echo "Error: Can not read the connection memory usage"
+        return 1
+    fi
+
+    if [ "$PEAK" -gt "$BUDGET" ]; then
+        echo "\nFailed: Connection memory usage was $PEAK bytes," \
+             "but the budget is $BUDGET bytes"
+        return 1
+    else
+        return 0
+    fi
+}
+
 # wait for client to terminate and set CLI_EXIT
 # must be called right after starting the client
 wait_client_done() {
@@ -9254,6 +9278,53 @@ run_test    "mbedtls_ssl_get_bytes_avail: extra data (max)" \
             0 \
             -s "Read from client: $MAX_CONTENT_LEN bytes read (100 + $((MAX_CONTENT_LEN - 100)))"
 
+# Tests for the bulk transfer mode
+
+requires_config_enabled MBEDTLS_HAVE_TIME
+run_test    "Stream: client to server" \
+            "$P_SRV stream=recv" \
+            "$P_CLI stream=send stream_mb=4" \
+            0 \
+            -c "Sent 4194304 bytes in" \
+            -s "Received 4194304 bytes in" \
+            -S "error" \
+            -C "error"
+
+requires_config_enabled MBEDTLS_HAVE_TIME
+run_test    "Stream: server to client" \
+            "$P_SRV stream=send stream_mb=4" \
+            "$P_CLI stream=recv" \
+            0 \
+            -s "Sent 4194304 bytes in" \
+            -c "Received 4194304 bytes in" \
+            -S "error" \
+            -C "error"
+
+requires_config_enabled MBEDTLS_HAVE_TIME
+run_test    "Stream: small writes, mbedtls_ssl_writev()" \
+            "$P_SRV stream=recv write_size=1000" \
+            "$P_CLI stream=send stream_mb=1 write_size=1000 iovec=3" \
+            0 \
+            -c "bytes per mbedtls_ssl_writev()" \
+            -s "Received 1048576 bytes in"
+
+requires_config_enabled MBEDTLS_HAVE_TIME
+requires_max_content_len 16384
+run_test    "Stream: batched writes, non-blocking" \
+            "$P_SRV stream=recv nbio=2" \
+            "$P_CLI stream=send stream_mb=4 write_size=65536 write_batch=4 nbio=2" \
+            0 \
+            -c "Sent 4194304 bytes in" \
+            -s "Received 4194304 bytes in"
+
+requires_config_enabled MBEDTLS_HAVE_TIME
+requires_config_enabled MBEDTLS_SSL_PROTO_DTLS
+run_test    "Stream: rejected with DTLS" \
+            "$P_SRV dtls=1" \
+            "$P_CLI dtls=1 stream=send" \
+            1 \
+            -c "stream is only supported with TLS"
+
 # Tests for small client packets
 
 run_test    "Small client packet TLS 1.2 BlockCipher" \
@@ -9768,6 +9839,58 @@ run_test    "EC restart: TLS, max_ops=1000, ECDHE-RSA" \
             -C "mbedtls_ecdh_make_public.*4b00" \
             -C "mbedtls_pk_sign.*4b00"
 
+# In TLS 1.3, the certificate chain verification and the CertificateVerify
+# signature and its verification are restartable. The key exchange is not,
+# as TLS calls PSA directly.
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_3
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, max_ops=1000" \
+            "$P_SRV groups=secp256r1 auth_mode=required \
+             crt_file=$DATA_FILES_PATH/server5.crt \
+             key_file=$DATA_FILES_PATH/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=$DATA_FILES_PATH/server5.key crt_file=$DATA_FILES_PATH/server5.crt  \
+             debug_level=1 ec_max_ops=1000" \
+            0 \
+            -c "x509_verify_cert.*4b00" \
+            -c "mbedtls_pk_verify.*4b00" \
+            -c "mbedtls_pk_sign.*4b00"
+
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_3
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, max_ops=0" \
+            "$P_SRV groups=secp256r1 auth_mode=required \
+             crt_file=$DATA_FILES_PATH/server5.crt \
+             key_file=$DATA_FILES_PATH/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=$DATA_FILES_PATH/server5.key crt_file=$DATA_FILES_PATH/server5.crt  \
+             debug_level=1 ec_max_ops=0" \
+            0 \
+            -C "x509_verify_cert.*4b00" \
+            -C "mbedtls_pk_verify.*4b00" \
+            -C "mbedtls_pk_sign.*4b00"
+
+requires_config_enabled MBEDTLS_ECP_RESTARTABLE
+requires_config_enabled MBEDTLS_ECP_DP_SECP256R1_ENABLED
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_3
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "EC restart: TLS 1.3, max_ops=1000, badsign" \
+            "$P_SRV groups=secp256r1 auth_mode=required \
+             crt_file=$DATA_FILES_PATH/server5-badsign.crt \
+             key_file=$DATA_FILES_PATH/server5.key" \
+            "$P_CLI force_version=tls13 \
+             key_file=$DATA_FILES_PATH/server5.key crt_file=$DATA_FILES_PATH/server5.crt  \
+             debug_level=1 ec_max_ops=1000" \
+            1 \
+            -c "x509_verify_cert.*4b00" \
+            -C "mbedtls_pk_sign.*4b00" \
+            -c "! The certificate is not correctly signed by the trusted CA" \
+            -c "! mbedtls_ssl_handshake returned"
+
 # Tests of asynchronous private key support in SSL
 
 requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
@@ -9801,6 +9924,18 @@ run_test    "SSL async private: sign, delay=2" \
             -s "Async resume (slot [0-9]): call 0 more times." \
             -s "Async resume (slot [0-9]): sign done, status=0"
 
+requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_3
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+run_test    "SSL async private: sign, TLS 1.3, delay=1" \
+            "$P_SRV force_version=tls13 \
+             async_operations=s async_private_delay1=1 async_private_delay2=1" \
+            "$P_CLI" \
+            0 \
+            -s "Async sign callback: using key slot " \
+            -s "Async resume (slot [0-9]): call 0 more times." \
+            -s "Async resume (slot [0-9]): sign done, status=0"
+
 requires_config_enabled MBEDTLS_SSL_ASYNC_PRIVATE
 requires_config_disabled MBEDTLS_X509_REMOVE_INFO
 run_test    "SSL async private: sign, SNI" \
@@ -11872,6 +12007,51 @@ run_test    "DTLS proxy: delay ChangeCipherSpec" \
             -s "Extra-header:" \
             -c "HTTP/1.0 200 OK"
 
+# Tests for the throughput mode of the proxy
+
+requires_config_enabled MBEDTLS_NET_DGRAM_DEMUX
+requires_config_enabled MBEDTLS_NET_REACTOR
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+not_with_valgrind # spurious resend due to timeout
+run_test    "DTLS proxy: throughput mode" \
+            -p "$P_PXY flows=4" \
+            "$P_SRV dtls=1 debug_level=2 hs_timeout=10000-20000" \
+            "$P_CLI dtls=1 debug_level=2 hs_timeout=10000-20000" \
+            0 \
+            -S "resend" \
+            -C "resend" \
+            -s "Extra-header:" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_NET_DGRAM_DEMUX
+requires_config_enabled MBEDTLS_NET_REACTOR
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+not_with_valgrind # spurious resend due to timeout
+run_test    "DTLS proxy: throughput mode, bandwidth and latency" \
+            -p "$P_PXY flows=4 bandwidth=2000 burst=4096 latency=40" \
+            "$P_SRV dtls=1 debug_level=2 hs_timeout=10000-20000" \
+            "$P_CLI dtls=1 debug_level=2 hs_timeout=10000-20000" \
+            0 \
+            -S "resend" \
+            -C "resend" \
+            -s "Extra-header:" \
+            -c "HTTP/1.0 200 OK"
+
+requires_config_enabled MBEDTLS_NET_DGRAM_DEMUX
+requires_config_enabled MBEDTLS_NET_REACTOR
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_SESSION_TICKETS
+not_with_valgrind # spurious resend due to timeout
+run_test    "DTLS proxy: throughput mode, new flow on reconnect" \
+            -p "$P_PXY flows=1 latency=20" \
+            "$P_SRV dtls=1 debug_level=2 tickets=1 hs_timeout=10000-20000" \
+            "$P_CLI dtls=1 debug_level=2 tickets=1 hs_timeout=10000-20000 \
+                reconnect=1 skip_close_notify=1" \
+            0 \
+            -s "a session has been resumed" \
+            -c "a session has been resumed" \
+            -c "HTTP/1.0 200 OK"
+
 # Tests for reordering support with DTLS
 
 requires_certificate_authentication
@@ -14158,6 +14338,53 @@ requires_config_enabled MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
 requires_max_content_len 16384
 run_tests_memory_after_handshake
 
+# Test heap memory usage of a connection against its compile-time budget
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_SSL_STATIC_MEMORY
+requires_config_enabled MBEDTLS_MEMORY_DEBUG
+requires_config_enabled MBEDTLS_MEMORY_BUFFER_ALLOC_C
+run_test    "Connection memory budget: TLS 1.2" \
+            "$P_SRV debug_level=1 auth_mode=required force_version=tls12" \
+            "$P_CLI crt_file=$DATA_FILES_PATH/server5.crt key_file=$DATA_FILES_PATH/server5.key" \
+            0 \
+            -s "Connection memory usage: peak [1-9]" \
+            -F "connection_memory_check"
+
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_3
+requires_config_enabled MBEDTLS_SSL_TLS1_3_KEY_EXCHANGE_MODE_EPHEMERAL_ENABLED
+requires_config_enabled MBEDTLS_SSL_STATIC_MEMORY
+requires_config_enabled MBEDTLS_MEMORY_DEBUG
+requires_config_enabled MBEDTLS_MEMORY_BUFFER_ALLOC_C
+run_test    "Connection memory budget: TLS 1.3" \
+            "$P_SRV debug_level=1 auth_mode=required force_version=tls13" \
+            "$P_CLI crt_file=$DATA_FILES_PATH/server5.crt key_file=$DATA_FILES_PATH/server5.key" \
+            0 \
+            -s "Connection memory usage: peak [1-9]" \
+            -F "connection_memory_check"
+
+requires_config_enabled MBEDTLS_SSL_PROTO_DTLS
+requires_config_enabled MBEDTLS_SSL_STATIC_MEMORY
+requires_config_enabled MBEDTLS_MEMORY_DEBUG
+requires_config_enabled MBEDTLS_MEMORY_BUFFER_ALLOC_C
+run_test    "Connection memory budget: DTLS" \
+            "$P_SRV debug_level=1 dtls=1 auth_mode=required" \
+            "$P_CLI dtls=1 crt_file=$DATA_FILES_PATH/server5.crt key_file=$DATA_FILES_PATH/server5.key" \
+            0 \
+            -s "Connection memory usage: peak [1-9]" \
+            -F "connection_memory_check"
+
+# Test heap memory usage per subsystem after handshake
+requires_config_enabled MBEDTLS_SSL_PROTO_TLS1_2
+requires_config_enabled MBEDTLS_MEMORY_PROFILE
+requires_config_disabled MBEDTLS_MEMORY_BUFFER_ALLOC_C
+run_test    "Handshake memory usage per subsystem" \
+            "$P_SRV force_version=tls12" \
+            "$P_CLI" \
+            0 \
+            -s "Heap memory usage of ssl_record after handshake: [1-9]" \
+            -s "Heap memory usage of ssl_transform after handshake: [1-9]" \
+            -s "Heap memory usage of ssl_session after handshake: [1-9]"
+
 if [ "$LIST_TESTS" -eq 0 ]; then
 
     # Final report